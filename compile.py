@@ -3,10 +3,11 @@ import os
 import sys
 import argparse
 import src.system.include.configure as configure
+import src.system.include.cmdtable as cmdtable
 
 available_os = ["LINUX", "FREERTOS"]
 available_archs = ["X86", "GROUNDSTATION", "RPI", "NANOMIND", "ESP32", "AVR32"]
-available_tests = ['test_cmd', 'test_unit', 'test_load', 'test_bug_delay', 'test_sgp4', 'test_fuzz']
+available_tests = ['test_cmd', 'test_unit', 'test_load', 'test_bug_delay', 'test_sgp4', 'test_fuzz', 'test_fuzz_target', 'test_adcs', 'test_adcs_bench']
 available_test_archs = ["X86"]
 available_log_lvl = ["LOG_LVL_NONE", "LOG_LVL_ERROR", "LOG_LVL_WARN", "LOG_LVL_INFO", "LOG_LVL_DEBUG", "LOG_LVL_VERBOSE"]
 
@@ -28,13 +29,15 @@ def get_parameters():
     parser.add_argument('--hk', type=str, default="1")
     parser.add_argument('--sen', type=str, default="0")
     parser.add_argument('--adcs', type=str, default="0")
+    parser.add_argument('--dl', type=str, default="1")
     parser.add_argument('--test', type=str, default="0")
     parser.add_argument('--node', type=str, default="1")
     parser.add_argument('--zmq_in', type=str, default="tcp://127.0.0.1:8001")
     parser.add_argument('--zmq_out', type=str, default="tcp://127.0.0.1:8002")
+    parser.add_argument('--zmq_ipc', action="store_true", help="Use ZMQ IPC sockets, for nodes in the same host")
     parser.add_argument('--st_mode', type=str, default="1")
     parser.add_argument('--st_triple_wr', type=str, default="1")
-    parser.add_argument('--buffers_csp', type=str, default="10")
+    parser.add_argument('--buffers_csp', type=str, default="100")
     parser.add_argument('--socket_len', type=str, default="100")
     # Build parameters
     parser.add_argument('--drivers', action="store_true", help="Install platform drivers")
@@ -62,6 +65,10 @@ if __name__ == "__main__":
         configure.make_config(args,
                               'src/system/include/config_template.h',
                               'src/system/include/config.h')
+        # Static command table, used if SCH_CMD_STATIC is set
+        cmdtable.make_table('src/system',
+                            'src/system/cmdTable.c',
+                            'src/system/include/cmdTable.h')
 
     result = 0
 
@@ -83,7 +90,10 @@ if __name__ == "__main__":
             os.system('rm -rf {}'.format(test_dir))
             os.system('mkdir {}'.format(test_dir))
             os.chdir(test_dir)
-            os.system('cmake ..')
+            if args.test_type == 'test_fuzz_target':
+                os.system('CC=clang cmake ..')
+            else:
+                os.system('cmake ..')
             result = os.system('make')
 
             # Run the test
@@ -98,6 +108,11 @@ if __name__ == "__main__":
                 elif args.test_type == 'test_fuzz':
                     os.chdir("..")
                     result = os.system('python3 fs_seqs_executer.py')
+                elif args.test_type == 'test_fuzz_target':
+                    os.system('mkdir corpus')
+                    result = os.system('./SUCHAI_Flight_Software_Test -max_total_time=60 corpus ../corpus')
+                elif args.test_type == 'test_adcs':
+                    result = os.system('./SUCHAI_Flight_Software_Test && ./SUCHAI_Flight_Software_Test_Float')
                 else:
                     result = os.system('./SUCHAI_Flight_Software_Test')
         # Build
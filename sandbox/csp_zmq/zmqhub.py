@@ -11,6 +11,7 @@ print(sys.path)
 from zmqnode import CspZmqNode
 from zmqnode import threaded
 from zmqnode import CspHeader
+from zmqnode import zmq_endpoint
 
 
 class CspZmqHub(CspZmqNode):
@@ -26,6 +27,7 @@ class CspZmqHub(CspZmqNode):
         :param mon_port: monitor port, internal PUB-SUB socket.
         :param reader: activate monitor
         :param writer: activate console
+        :param proto: transport, tcp or ipc (nodes in the same host), @see zmq_endpoint
         """
         CspZmqNode.__init__(self, None, ip, mon_port, in_port, reader, writer, proto)
         self.mon_port_hub = mon_port
@@ -64,15 +66,14 @@ class CspZmqHub(CspZmqNode):
         # Create sockets
         xpub_out = self._context.socket(zmq.XPUB)
         xsub_in = self._context.socket(zmq.XSUB)
-        hub_ip = "*" if self._proto == "tcp" else self.hub_ip
-        xpub_out.bind('{}://{}:{}'.format(self._proto, hub_ip, self.out_port_hub))
-        xsub_in.bind('{}://{}:{}'.format(self._proto, hub_ip, self.in_port_hub))
+        xpub_out.bind(zmq_endpoint(self._proto, self.hub_ip, self.out_port_hub, bind=True))
+        xsub_in.bind(zmq_endpoint(self._proto, self.hub_ip, self.in_port_hub, bind=True))
 
         s_mon = None
         if self.monitor:
             # Crate monitor socket
             s_mon = self._context.socket(zmq.PUB)
-            s_mon.bind('tcp://*:{}'.format(self.mon_port_hub))
+            s_mon.bind(zmq_endpoint(self._proto, self.hub_ip, self.mon_port_hub, bind=True))
 
         if self.console:
             self.console_hub()
@@ -103,7 +104,7 @@ def get_parameters():
     parser.add_argument("-o", "--out_port", default="8001", help="Output port")
     parser.add_argument("-m", "--mon_port", default="8003", help="Monitor port")
     parser.add_argument("-d", "--ip", default="localhost", help="Hub IP address")
-    parser.add_argument("-p", "--proto", default="tcp", help="Monitor port")
+    parser.add_argument("-p", "--proto", default="tcp", choices=["tcp", "ipc"], help="Transport, ipc for nodes in the same host")
     parser.add_argument("--mon", action="store_true", help="Enable monitor socket")
     parser.add_argument("--wrt", action="store_true", help="Enable console task")
 
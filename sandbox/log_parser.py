@@ -1,4 +1,6 @@
+import os
 import re
+import struct
 import argparse
 import pandas as pd
 
@@ -9,6 +11,14 @@ re_info = re.compile(r'\[INFO \]\[(\d+)\]\[(\w+)\](.+)')
 re_debug = re.compile(r'\[DEBUG\]\[(\d+)\]\[(\w+)\](.+)')
 re_verbose = re.compile(r'\[VERB \]\[(\d+)\]\[(\w+)\](.+)')
 
+# Binary logs, printed as hex by the receiving node (see log_binary)
+re_binary = re.compile(r'\[REMOT\]\[(\d+)\]\[\w+\] \[(\d+)\] BIN ([0-9a-fA-F]+)')
+re_log_call = re.compile(r'\bLOG([EWIDVR])\s*\(\s*(\w+|"[^"]*")\s*,\s*((?:"(?:[^"\\]|\\.)*"\s*)+)[,)]')
+re_log_tag = re.compile(r'static\s+const\s+char\s*\*\s*tag\s*=\s*"([^"]*)"')
+re_conversion = re.compile(r'%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|L|q|j|z|t)?([diuxXocfFeEgGaApsn%])')
+
+log_levels = {1: "RES  ", 2: "ERROR", 3: "WARN ", 4: "INFO ", 5: "DEBUG", 6: "VERB "}
+
 # Specific expressions
 re_cmd_run = re.compile(r'\[INFO \]\[(\d+)]\[Executer\] Running the command: (.+)')
 re_cmd_result = re.compile(r'\[INFO \]\[(\d+)]\[Executer\] Command result: (\d+)')
@@ -29,6 +39,8 @@ def get_parameters():
     # Specific expressions
     parser.add_argument('--cmd-run', action="store_const", const=re_cmd_run)
     parser.add_argument('--cmd-result', action="store_const", const=re_cmd_result)
+    # Binary logs
+    parser.add_argument('--binary', type=str, metavar="SRC", help="Render binary logs using the sources in SRC")
 
     return parser.parse_args()
 
@@ -37,6 +49,100 @@ def parse_text(text, regexp):
     return regexp.findall(text)
 
 
+def log_hash(name, line):
+    """
+    FNV-1a hash of "<file base name>:<line>", the ID of a log call site
+    """
+    h = 2166136261
+    for c in "{}:{}".format(name, line).encode():
+        h = ((h ^ c) * 16777619) & 0xFFFFFFFF
+    return h if h != 0 else 1
+
+
+def load_formats(src):
+    """
+    Find the LOGx calls in the C sources and map their IDs to the module tag
+    and format string
+    """
+    formats = {}
+    for root, dirs, files in os.walk(src):
+        for name in files:
+            if not name.endswith(".c"):
+                continue
+            with open(os.path.join(root, name), errors="replace") as source:
+                code = source.read()
+            tag = re_log_tag.search(code)
+            for call in re_log_call.finditer(code):
+                line = code.count("\n", 0, call.start()) + 1
+                literals = re.findall(r'"((?:[^"\\]|\\.)*)"', call.group(3))
+                fmt = "".join(literals).encode().decode("unicode_escape")
+                module = call.group(2).strip('"') if call.group(2).startswith('"') or tag is None else tag.group(1)
+                formats[log_hash(name, line)] = (module, fmt)
+    return formats
+
+
+def render(fmt, args):
+    """
+    Render a printf format with the raw arguments of a binary log record
+    """
+    out, pos = [], 0
+    for conv in re_conversion.finditer(fmt):
+        out.append(fmt[pos:conv.start()])
+        pos = conv.end()
+        flags, width, precision, mod, kind = conv.groups()
+        if kind == '%':
+            out.append('%')
+            continue
+        try:
+            if width == '*':
+                width, args = str(struct.unpack(">i", args[:4])[0]), args[4:]
+            if precision == '*':
+                precision, args = str(struct.unpack(">i", args[:4])[0]), args[4:]
+            spec = "%" + flags + (width or "") + ("." + precision if precision else "")
+            wide = mod in ("l", "ll", "q", "j", "z", "t")
+            if kind in "diuxXoc":
+                size = 8 if wide else 4
+                if len(args) < size:
+                    raise ValueError
+                value = int.from_bytes(args[:size], "big", signed=kind in "di")
+                args = args[size:]
+                if kind == 'c':
+                    out.append((spec + 'c') % chr(value & 0xFF))
+                else:
+                    out.append((spec + ('d' if kind in "iu" else kind)) % value)
+            elif kind in "fFeEgGaA":
+                value = struct.unpack(">f", args[:4])[0]
+                args = args[4:]
+                out.append((spec + ('f' if kind in "aA" else kind)) % value)
+            elif kind == 'p':
+                value = struct.unpack(">Q", args[:8])[0]
+                args = args[8:]
+                out.append("%#x" % value)
+            elif kind == 's':
+                end = args.index(b'\0')
+                out.append((spec + 's') % args[:end].decode(errors="replace"))
+                args = args[end+1:]
+        except (ValueError, struct.error):
+            out.append("?")
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+def parse_binary(text, formats):
+    """
+    Render the binary log records in text as regular log lines
+    """
+    lines = []
+    for time, node, data in re_binary.findall(text):
+        data = bytes.fromhex(data)
+        while len(data) >= 10:
+            log_id, log_time, level, length = struct.unpack(">IIBB", data[:10])
+            args, data = data[10:10+length], data[10+length:]
+            module, fmt = formats.get(log_id, ("unknown", "id {:08x} args {}".format(log_id, args.hex())))
+            lines.append("[{}][{}][{}] {}".format(log_levels.get(level, "?????"), log_time, module, render(fmt, args)))
+    return lines
+
+
 def save_parsed(logs, file, format=None):
     df = pd.DataFrame(logs)
     # print(df)
@@ -50,7 +156,16 @@ if __name__ == "__main__":
     with open(args.file) as logfile:
         text = logfile.read()
 
+    # Render binary logs and parse them as text logs
+    if args.binary is not None:
+        print("Rendering binary logs...")
+        lines = parse_binary(text, load_formats(args.binary))
+        with open(args.file + "binary.txt", "w") as binfile:
+            binfile.write("\n".join(lines) + "\n")
+        text += "\n".join(lines) + "\n"
+
     args = vars(args)
+    args.pop("binary")
     print(args)
 
     for type, regexp in args.items():
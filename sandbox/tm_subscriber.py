@@ -0,0 +1,59 @@
+#!/usr/bin/python3
+
+"""
+Print the decoded payload samples published by the ground station ingest
+(SCH_INGEST_PUB_URI, see ingest_pub_header_t in taskIngest.h).
+
+Messages have five parts: topic (payload table), header, fields format, fields
+names and samples. Samples are packed structs in the ground station byte order,
+little endian on x86.
+"""
+
+import zmq
+import struct
+import argparse
+
+# ingest_pub_header_t: node, payload, count, size
+HEADER = struct.Struct("<HHIH")
+
+# data_order conversions to struct formats
+FORMATS = {"%d": "i", "%i": "i", "%u": "I", "%f": "f", "%lf": "d", "%hd": "h", "%hu": "H",
+           "%hhd": "b", "%hhu": "B", "%lld": "q", "%llu": "Q"}
+
+
+def get_parameters():
+    """
+    Parse script arguments
+    """
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--uri', type=str, default="tcp://localhost:8010", help="Ground station publisher URI")
+    parser.add_argument('--payload', type=str, nargs='*', default=[""], help="Payload tables to subscribe, all by default")
+    return parser.parse_args()
+
+
+def decode(header, order, names, data):
+    """
+    Decode the samples of a message
+    :return: Node, list of samples as dicts
+    """
+    node, payload, count, size = HEADER.unpack(header)
+    fmt = "<" + "".join(FORMATS[f] for f in order.decode().split())
+    names = names.decode().split()
+    if struct.calcsize(fmt) != size or len(data) != count*size:
+        raise ValueError("Payload {} samples do not match the fields".format(payload))
+    return node, [dict(zip(names, s)) for s in struct.iter_unpack(fmt, data)]
+
+
+if __name__ == "__main__":
+    args = get_parameters()
+    ctx = zmq.Context()
+    sock = ctx.socket(zmq.SUB)
+    sock.connect(args.uri)
+    for topic in args.payload:
+        sock.setsockopt_string(zmq.SUBSCRIBE, topic)
+
+    while True:
+        table, header, order, names, data = sock.recv_multipart()
+        node, samples = decode(header, order, names, data)
+        for sample in samples:
+            print(table.decode(), node, sample)
@@ -16,6 +16,7 @@ __author__ = 'gdiaz'
 
 """
 
+import os
 import zmq
 import sys
 import time
@@ -32,6 +33,8 @@ from gps import *
 from struct import *
 
 sys.path.append('../')
+sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "csp_zmq"))
+from zmqnode import zmq_endpoint
 
 # Get Nodes and Ports Parameters
 with open('node_list.json') as data_file:
@@ -94,14 +97,14 @@ class GpsComInterface:
             if handler_exist:
                 self.gps_handler.next()
 
-    def console(self, ip="localhost", in_port_tcp=8002, out_port_tcp=8001):
+    def console(self, ip="localhost", in_port_tcp=8002, out_port_tcp=8001, proto="tcp"):
         """ Send messages to node """
         ctx = zmq.Context()
         pub = ctx.socket(zmq.PUB)
         sub = ctx.socket(zmq.SUB)
         sub.setsockopt(zmq.SUBSCRIBE, self.node)
-        pub.connect('tcp://{}:{}'.format(ip, out_port_tcp))
-        sub.connect('tcp://{}:{}'.format(ip, in_port_tcp))
+        pub.connect(zmq_endpoint(proto, ip, out_port_tcp))
+        sub.connect(zmq_endpoint(proto, ip, in_port_tcp))
         print('Start GPS Intreface as node: {}'.format(int(codecs.encode(self.node, 'hex'), 16)))
 
         while True:
@@ -178,6 +181,7 @@ def get_parameters():
     parser.add_argument("-d", "--ip", default="localhost", help="Hub IP address")
     parser.add_argument("-i", "--in_port", default="8001", help="Hub Input port")
     parser.add_argument("-o", "--out_port", default="8002", help="Hub Output port")
+    parser.add_argument("-p", "--proto", default="tcp", choices=["tcp", "ipc"], help="Transport, ipc for nodes in the same host")
     parser.add_argument("--nmon", action="store_false", help="Disable monitor task")
     parser.add_argument("--ncon", action="store_false", help="Disable console task")
     parser.add_argument("--sim", action="store_true", help="Make available simulation of gps")
@@ -200,7 +204,7 @@ if __name__ == '__main__':
 
     if args.ncon:
         # Create a console socket
-        console_th = Thread(target=gps.console, args=(args.ip, args.out_port, args.in_port))
+        console_th = Thread(target=gps.console, args=(args.ip, args.out_port, args.in_port, args.proto))
         # console_th.daemon = True
         tasks.append(console_th)
         console_th.start()
@@ -41,6 +41,7 @@ CSRCS = \
        $(PROJ_ROOT)/system/cmdCOM.c                       \
        $(PROJ_ROOT)/system/cmdEPS.c                       \
        $(PROJ_ROOT)/system/repoCommand.c                  \
+       $(PROJ_ROOT)/system/cmdTable.c                     \
        $(PROJ_ROOT)/system/repoData.c                     \
        $(PROJ_ROOT)/system/taskWatchdog.c                 \
        $(PROJ_ROOT)/system/taskInit.c	                  \
@@ -2,6 +2,7 @@
 // Created by carlos on 22-08-17.
 //
 
+#define LOG_TAG_ID LOG_TAG_DATA
 #include "data_storage.h"
 #include "suchai-drivers-obc/lib/libthirdparty/include/gs/thirdparty/fram/fm33256b.h"
 
@@ -20,6 +21,117 @@ typedef struct {
 } numbers_container_t;
 
 static int max_command_size = (SCH_CMD_MAX_STR_NAME+SCH_CMD_MAX_STR_PARAMS)*sizeof(char)+sizeof(uint32_t)+sizeof(numbers_container_t);
+/* RAM copy of the flight plan entries time, by storage index. Entries are
+ * found and the next entry is selected without reading the flash */
+static uint32_t fp_index_time[SCH_FP_MAX_ENTRIES];
+
+/**
+ * Payloads are stored as an append-only log over the SCH_SECTIONS_PER_PAYLOAD
+ * flash sections of each payload, used as a ring. Samples keep the fixed slots
+ * of each section (SCH_SIZE_PER_SECTION/size samples per section). Log
+ * positions count slots since the log was formatted and are mapped to a
+ * section and slot modulo the payload capacity.
+ *
+ * The log index (positions of the payload index 0, of the log head and of the
+ * end of the erased sections) is kept in FRAM, after the status variables.
+ * Samples are buffered in RAM and programmed in full flash pages. Sections in
+ * front of the head are erased in advance by storage_sync, so the sampling
+ * path only erases if the log reaches a section not erased yet.
+ *
+ * With SCH_STORAGE_CRC each slot keeps the sample followed by its CRC32C,
+ * checked when the sample is read, so flash bit flips are detected. The slots
+ * layout changes, so the log index mark does too and the log is formatted.
+ */
+#define STORAGE_FLASH_PAGE_SIZE (512)           ///< S25FL512S programming page size
+#define STORAGE_LOG_FRAM_ADDR   (0x4000)        ///< Payload log index address in FRAM, after the status variables
+#if SCH_STORAGE_CRC
+#define STORAGE_LOG_MAGIC       (0x4C4F4743)    ///< Valid log index mark, slots with CRC
+#define STORAGE_RECORD_CRC_LEN  (sizeof(uint32_t))  ///< CRC bytes after each sample
+#else
+#define STORAGE_LOG_MAGIC       (0x4C4F4731)    ///< Valid log index mark
+#define STORAGE_RECORD_CRC_LEN  (0)
+#endif
+#define STORAGE_PAGE_NONE       (0xFFFFFFFF)    ///< No page buffered
+
+typedef struct {
+    uint32_t magic;     ///< STORAGE_LOG_MAGIC if the index is valid
+    uint32_t base;      ///< Log position of the payload index 0
+    uint32_t head;      ///< Log position of the next sample to write
+    uint32_t erased;    ///< Log position of the end of the erased sections
+} storage_log_t;
+
+typedef struct {
+    uint32_t add;       ///< Flash address of the buffered page, STORAGE_PAGE_NONE if none
+    uint16_t flushed;   ///< Bytes of the page already programmed
+    uint16_t len;       ///< Bytes of the page written to the buffer
+    uint8_t data[STORAGE_FLASH_PAGE_SIZE];
+} storage_page_t;
+
+static storage_log_t payload_log[last_sensor];
+static storage_page_t payload_page[last_sensor];
+static uint32_t payload_crc_errors = 0;     ///< Samples that failed the CRC check
+
+/**
+ * The flight plan journal of the RAM storage mode (see dat_repo_init) is kept
+ * in FRAM, after the payloads log index, in two slots. Appends go to the
+ * active slot, compacting writes the other slot and then switches the active
+ * slot in the journal header, so a reset while compacting keeps the previous
+ * journal.
+ */
+#define STORAGE_FPJ_FRAM_ADDR   (0x4400)        ///< Flight plan journal header address in FRAM
+#define STORAGE_FPJ_FRAM_END    (0x8000)        ///< End of the FRAM (FM33256B, 32 KiB)
+#define STORAGE_FPJ_MAGIC       (0x46504A31)    ///< Valid journal header mark
+#define STORAGE_FPJ_SLOT_ADDR   (STORAGE_FPJ_FRAM_ADDR + sizeof(storage_fpj_t))
+#define STORAGE_FPJ_SLOT_LEN    ((STORAGE_FPJ_FRAM_END - STORAGE_FPJ_SLOT_ADDR)/2)
+
+typedef struct {
+    uint32_t magic;     ///< STORAGE_FPJ_MAGIC if the header is valid
+    uint32_t slot;      ///< Active slot, 0 or 1
+    uint32_t len;       ///< Bytes used in the active slot
+} storage_fpj_t;
+
+static storage_fpj_t fp_journal;
+
+/**
+ * RAM mirror of the status variables block in FRAM (all the copies if tripled
+ * writing is enabled). The block is read in one FRAM burst by
+ * storage_table_repo_init, then reads are served from RAM and writes go to
+ * both, the mirror and the FRAM. Indexes out of the block are read from FRAM.
+ */
+#if SCH_STORAGE_TRIPLE_WR == 1
+#define STORAGE_REPO_LEN        (dat_status_last_address*3)
+#else
+#define STORAGE_REPO_LEN        (dat_status_last_address)
+#endif
+
+#if SCH_STORAGE_NOINIT == 1
+/* The mirror is kept across software resets, the linker script must place the
+ * .noinit section out of the RAM cleared at boot */
+#define STORAGE_NOINIT          __attribute__((section(".noinit")))
+#define STORAGE_REPO_MAGIC      (0x5250534C)    ///< Sealed mirror mark
+#else
+#define STORAGE_NOINIT
+#endif
+
+static uint32_t repo_mirror[STORAGE_REPO_LEN] STORAGE_NOINIT;
+static int repo_mirror_ok = 0;
+#if SCH_STORAGE_NOINIT == 1
+static uint32_t repo_seal[3] STORAGE_NOINIT;    ///< Magic, length and hash of the sealed mirror
+
+/**
+ * FNV-1a hash of the mirror
+ */
+static uint32_t storage_repo_hash(void)
+{
+    const uint8_t *bytes = (const uint8_t *)repo_mirror;
+    uint32_t i, hash = 2166136261u;
+    for(i=0; i < sizeof(repo_mirror); i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+#endif
+
+static int storage_page_flush(int payload);
 
 int storage_init(const char *file)
 {
@@ -65,6 +177,29 @@ int storage_init(const char *file)
 
 int storage_table_repo_init(char* table, int drop)
 {
+#if SCH_STORAGE_NOINIT == 1
+    // After a sealed software reset the mirror is still valid, the seal is
+    // removed so the block is read again after any other reset
+    int sealed = repo_seal[0] == STORAGE_REPO_MAGIC && repo_seal[1] == STORAGE_REPO_LEN &&
+                 repo_seal[2] == storage_repo_hash();
+    repo_seal[0] = 0;
+    if(sealed)
+    {
+        LOGI(tag, "Status variables kept across the software reset");
+        repo_mirror_ok = 1;
+        return 0;
+    }
+#endif
+
+    // Loads the status variables mirror, the only time the block is read
+    uint16_t len = (uint16_t)(STORAGE_REPO_LEN*sizeof(uint32_t));
+    int rc = (int)gs_fm33256b_fram_read(0, 0, (uint8_t *)repo_mirror, len);
+    if(rc != 0)
+    {
+        LOGE(tag, "Unable to read the status variables from FRAM (%d)", rc);
+        return -1;
+    }
+    repo_mirror_ok = 1;
     return 0;
 }
 
@@ -76,12 +211,32 @@ int storage_table_flight_plan_init(int drop, int * entries)
     if (drop == 1)
         rc = storage_flight_plan_reset(entries);
 
+    if (*entries < 0 || *entries > SCH_FP_MAX_ENTRIES)
+    {
+        LOGW(tag, "Invalid flight plan entries %d, resetting", *entries);
+        *entries = SCH_FP_MAX_ENTRIES;
+        rc = storage_flight_plan_reset(entries);
+        *entries = 0;
+    }
+
+    // Loads the time index, the only time the entries time is read from flash
+    int commands_per_section = SCH_SIZE_PER_SECTION/max_command_size;
+    for (int i = 0; i < *entries; i++)
+    {
+        int section_index = i/commands_per_section;
+        int index_in_section = i%commands_per_section;
+        uint32_t add = storage_addresses_flight_plan[section_index] + index_in_section*max_command_size;
+        spn_fl512s_read_data(0, add, (uint8_t*)&fp_index_time[i], sizeof(uint32_t));
+    }
+
     return rc;
 }
 
 int storage_repo_get_value_idx(int index, char *table)
 {
-    // TODO: Check if this is necessary
+    if(repo_mirror_ok && index >= 0 && index < STORAGE_REPO_LEN)
+        return (int)repo_mirror[index];
+
     data32_t data;
     uint16_t len = (uint16_t)(sizeof(uint32_t));
     uint16_t add = (uint16_t)(index*len);
@@ -107,9 +262,57 @@ int storage_repo_set_value_idx(int index, int value, char *table)
     uint16_t add = (uint16_t)(index*len);
 
     LOGV(tag, "Writing 0x%X", (unsigned int)data.data32);
-    gs_fm33256b_fram_write(0, add, data.data8_p, len);
+    int rc = (int)gs_fm33256b_fram_write(0, add, data.data8_p, len);
+    if(index >= 0 && index < STORAGE_REPO_LEN)
+        repo_mirror[index] = data.data32;
 
-    return 0;
+    return rc == 0 ? 0 : -1;
+}
+
+int storage_repo_get_values_idx(int index, int n, int *values, char *table)
+{
+    if(index < 0 || n < 0)
+        return -1;
+    if(repo_mirror_ok && index + n <= STORAGE_REPO_LEN)
+    {
+        memcpy(values, &repo_mirror[index], n*sizeof(uint32_t));
+        return 0;
+    }
+    // Values are stored as consecutive uint32_t, same as storage_repo_get_value_idx
+    uint16_t add = (uint16_t)(index*sizeof(uint32_t));
+    uint16_t len = (uint16_t)(n*sizeof(uint32_t));
+    int rc = (int)gs_fm33256b_fram_read(0, add, (uint8_t *)values, len);
+    return rc == 0 ? 0 : -1;
+}
+
+int storage_repo_set_values_idx(int index, int n, const int *values, char *table)
+{
+    if(index < 0 || n < 0)
+        return -1;
+    uint16_t add = (uint16_t)(index*sizeof(uint32_t));
+    uint16_t len = (uint16_t)(n*sizeof(uint32_t));
+    int rc = (int)gs_fm33256b_fram_write(0, add, (uint8_t *)values, len);
+    if(index + n <= STORAGE_REPO_LEN)
+        memcpy(&repo_mirror[index], values, n*sizeof(uint32_t));
+    return rc == 0 ? 0 : -1;
+}
+
+int storage_repo_get_copies_idx(int index, int n, int *values, char *table)
+{
+    // Each copy is a FRAM block of dat_status_last_address values
+    int rc = storage_repo_get_values_idx(index, n, values, table);
+    int rc2 = storage_repo_get_values_idx(index + dat_status_last_address, n, values + n, table);
+    int rc3 = storage_repo_get_values_idx(index + dat_status_last_address*2, n, values + n*2, table);
+    return rc & rc2 & rc3;
+}
+
+int storage_repo_set_copies_idx(int index, int n, const int *values, char *table)
+{
+    // Each copy is a FRAM block of dat_status_last_address values
+    int rc = storage_repo_set_values_idx(index, n, values, table);
+    int rc2 = storage_repo_set_values_idx(index + dat_status_last_address, n, values, table);
+    int rc3 = storage_repo_set_values_idx(index + dat_status_last_address*2, n, values, table);
+    return rc & rc2 & rc3;
 }
 
 int storage_repo_set_value_str(char *name, int value, char *table)
@@ -123,31 +326,17 @@ int storage_repo_set_value_str(char *name, int value, char *table)
  * IMPORTANT: Flight plan entries are saved as consecutive binary values using the following scheme:
  * timetodo(uint32_t) executions(uint32_t) periodical(uint32_t) name_length(uint32_t) args_length(uint32_t) name(char*SCH_CMD_MAX_STR_NAME) args(char*SCH_CMD_MAX_STR_PARAMS)
  *
- * The total size of each command is then stored in 'max_command_size'.
+ * The total size of each command is then stored in 'max_command_size'. The
+ * entries time is read from the RAM index (fp_index_time), not from flash.
  *
  * @param timetodo Execution time of the command to find
  * @return The command's index, -1 if not found or error
  */
 static int flight_plan_find_index(int timetodo, int entries)
 {
-    // Calculates information on how the flight plan is stored
-    int commands_per_section = SCH_SIZE_PER_SECTION/max_command_size;
-
-    // For every index
     for (int i = 0; i < entries; i++)
     {
-        // Translates the index into an address in memory
-        int section_index = i/commands_per_section;
-        int index_in_section = i%commands_per_section;
-
-        uint32_t add = storage_addresses_flight_plan[section_index] + index_in_section*max_command_size;
-
-        // Reads the entry's timetodo
-        uint32_t found_time;
-        spn_fl512s_read_data(0, add, (uint8_t*)&found_time, sizeof(uint32_t));
-
-        // If found, returns
-        if (found_time == (uint32_t)timetodo)
+        if (fp_index_time[i] == (uint32_t)timetodo)
             return i;
     }
 
@@ -155,6 +344,20 @@ static int flight_plan_find_index(int timetodo, int entries)
     return -1;
 }
 
+int storage_flight_plan_next(int entries)
+{
+    int timetodo = -1;
+
+    // 0 is an empty entry
+    for (int i = 0; i < entries; i++)
+    {
+        if (fp_index_time[i] != 0 && (timetodo == -1 || (int)fp_index_time[i] < timetodo))
+            timetodo = (int)fp_index_time[i];
+    }
+
+    return timetodo;
+}
+
 /**
  * Function for deleting a flight plan entry on a given index.
  *
@@ -215,6 +418,7 @@ static int flight_plan_erase_index(int index, int * entries)
 
             // Moves to the next address
             add += max_command_size;
+            fp_index_time[written_entries] = (uint32_t)timetodo;
             written_entries++;
         }
     }
@@ -225,8 +429,12 @@ static int flight_plan_erase_index(int index, int * entries)
     return 0;
 }
 
-int storage_flight_plan_set(int timetodo, char* command, char* args, int executions, int periodical, int * entries)
+int storage_flight_plan_set(int timetodo, char* command, char* args, int executions, int periodical, int ms, int * entries)
 {
+    // The flash entries layout has no milliseconds field
+    if (ms != 0)
+        LOGW(tag, "Flight plan storage does not support milliseconds, %s runs at %d.000", command, timetodo);
+
     // Finds an index with an empty entry
     int index = *entries;
 
@@ -297,19 +505,29 @@ int storage_flight_plan_set(int timetodo, char* command, char* args, int executi
         return -1;
     }
 
+    fp_index_time[index] = found_time;
     *entries =  *entries + 1;
 
     return 0;
 }
 
-int storage_flight_plan_get(int timetodo, char* command, char* args, int* executions, int* periodical, int * entries)
+int storage_flight_plan_set_batch(fp_entry_t *fp, int n, int * entries)
 {
-    // Finds the table index for timetodo
-    int index = flight_plan_find_index(timetodo, *entries);
-
-    if (index < 0)
+    if (*entries + n > SCH_FP_MAX_ENTRIES)
+    {
+        LOGE(tag, "Flight plan storage no longer has space for %d commands", n);
         return -1;
+    }
 
+    int i;
+    for(i=0; i<n; i++)
+        if(storage_flight_plan_set(fp[i].unixtime, fp[i].cmd, fp[i].args, fp[i].executions, fp[i].periodical, fp[i].ms, entries) != 0)
+            return -1;
+    return 0;
+}
+
+static void flight_plan_read_index(int index, char* command, char* args, int* executions, int* periodical)
+{
     // Calculates memory address
     int commands_per_section = SCH_SIZE_PER_SECTION/max_command_size;
     int section_index = index/commands_per_section;
@@ -340,6 +558,19 @@ int storage_flight_plan_get(int timetodo, char* command, char* args, int* execut
     // Sets the executions and periodical values
     *executions = (int)numbers_container.exec;
     *periodical = (int)numbers_container.peri;
+}
+
+int storage_flight_plan_get(int timetodo, char* command, char* args, int* executions, int* periodical, int* ms, int * entries)
+{
+    *ms = 0;
+
+    // Finds the table index for timetodo
+    int index = flight_plan_find_index(timetodo, *entries);
+
+    if (index < 0)
+        return -1;
+
+    flight_plan_read_index(index, command, args, executions, periodical);
 
     // Deletes the command from storage
     int rc;
@@ -348,18 +579,76 @@ int storage_flight_plan_get(int timetodo, char* command, char* args, int* execut
     if (rc != 0)
         return -1;
 
-    // If the command is periodical, a copy is made set to execute later
-    /*if (*periodical > 0)
+    // If the command is periodical, a copy is made set to execute later.
+    // Flash can not be updated in place, so the entry is written again.
+    if (*periodical > 0 && *executions > 1)
     {
-        rc = storage_flight_plan_set(timetodo+*periodical, command, args, *executions, *periodical);
+        rc = storage_flight_plan_set(timetodo+*periodical, command, args, *executions-1, *periodical, 0, entries);
 
         if (rc != 0)
             return -1;
-    }*/
+    }
 
     return 0;
 }
 
+int storage_flight_plan_peek(int timetodo, fp_entry_t *fp, int entries)
+{
+    int index = flight_plan_find_index(timetodo, entries);
+    if (index < 0)
+        return -1;
+
+    fp->unixtime = timetodo;
+    fp->ms = 0;
+    flight_plan_read_index(index, fp->cmd, fp->args, &fp->executions, &fp->periodical);
+    return 0;
+}
+
+int storage_flight_plan_update(int timetodo, int new_time, int executions, int * entries)
+{
+    char command[SCH_CMD_MAX_STR_NAME+1];
+    char args[SCH_CMD_MAX_STR_PARAMS+1];
+    int old_executions, periodical;
+
+    int index = flight_plan_find_index(timetodo, *entries);
+    if (index < 0)
+        return -1;
+
+    flight_plan_read_index(index, command, args, &old_executions, &periodical);
+
+    if (flight_plan_erase_index(index, entries) != 0)
+        return -1;
+
+    // Written again after the entries at new_time
+    return storage_flight_plan_set(new_time, command, args, executions, periodical, 0, entries);
+}
+
+int storage_flight_plan_foreach(int from, int to, fp_visit_t visit, void *arg, int entries)
+{
+    // Entries are visited in storage order, the time index avoids reading
+    // the entries out of range
+    fp_entry_t entry;
+    int index, visited = 0;
+    for(index=0; index<entries; index++)
+    {
+        if((from >= 0 && fp_index_time[index] < (uint32_t)from) ||
+           (to >= 0 && fp_index_time[index] > (uint32_t)to))
+            continue;
+        entry.unixtime = (int)fp_index_time[index];
+        entry.ms = 0;
+        flight_plan_read_index(index, entry.cmd, entry.args, &entry.executions, &entry.periodical);
+        visited++;
+        if(visit(&entry, arg) != 0)
+            break;
+    }
+    return visited;
+}
+
+int storage_flight_plan_sorted(void)
+{
+    return 0;
+}
+
 int storage_flight_plan_erase(int timetodo, int * entries)
 {
     // Finds the index to erase
@@ -467,37 +756,151 @@ int storage_flight_plan_show_table(int entries)
 
 int storage_close(void)
 {
+    int i;
+    for(i = 0;  i < last_sensor; ++i)
+        storage_page_flush(i);
     free(storage_addresses_payloads);
     free(storage_addresses_flight_plan);
     return 0;
 }
 
-int write_data_with_check(uint32_t add, uint8_t * data, uint16_t size)
+/**
+ * Bytes of a payload slot, the sample and its CRC
+ */
+static int storage_log_slot_size(int payload)
 {
-    int i;
-    uint8_t data_aux[size];
-    for (i=0 ; i < 10; ++i) {
-        uint32_t add_aux = add + i*size;
-        int ret_write = spn_fl512s_write_data(0, add_aux, data, size);
+    return data_map[payload].size + (int)STORAGE_RECORD_CRC_LEN;
+}
 
-        int ret_read = spn_fl512s_read_data(0, add_aux, data_aux, size);
+static int storage_log_section_len(int payload)
+{
+    return SCH_SIZE_PER_SECTION/storage_log_slot_size(payload);
+}
 
-        if (ret_read != 0 || ret_write != 0 ) {
-            return -1;
-        }
+/**
+ * Translate a log position into a flash address
+ */
+static uint32_t storage_log_address(int payload, uint32_t pos)
+{
+    uint32_t pps = (uint32_t)storage_log_section_len(payload);
+    uint32_t slot = pos % (pps*SCH_SECTIONS_PER_PAYLOAD);
+    return storage_addresses_payloads[payload*SCH_SECTIONS_PER_PAYLOAD + slot/pps] + (slot%pps)*storage_log_slot_size(payload);
+}
+
+static int storage_log_save(int payload)
+{
+    uint16_t add = (uint16_t)(STORAGE_LOG_FRAM_ADDR + payload*sizeof(storage_log_t));
+    int rc = (int)gs_fm33256b_fram_write(0, add, (uint8_t *)&payload_log[payload], sizeof(storage_log_t));
+    if (rc != 0)
+        LOGE(tag, "Failed attempt at writing payload %d log index in FRAM", payload);
+    return rc != 0 ? -1 : 0;
+}
+
+/**
+ * Program the buffered bytes of the payload page and check them
+ */
+static int storage_page_flush(int payload)
+{
+    storage_page_t *page = &payload_page[payload];
+    if (page->add == STORAGE_PAGE_NONE || page->len == page->flushed)
+        return 0;
+
+    uint32_t add = page->add + page->flushed;
+    uint16_t len = page->len - page->flushed;
+    int rc = spn_fl512s_write_data(0, add, page->data + page->flushed, len);
+    if (rc == 0)
+    {
         // Check integrity
-        int j, integrity=0;
-        for (j=0; j < size; j++) {
-            if (data[j] != data_aux[j]) {
-                integrity += 1;
-                break;
-            }
-        }
-        if (integrity == 0) {
-            return i;
+        uint8_t data_aux[STORAGE_FLASH_PAGE_SIZE];
+        rc = spn_fl512s_read_data(0, add, data_aux, len);
+        if (rc == 0 && memcmp(data_aux, page->data + page->flushed, len) != 0)
+            rc = -1;
+    }
+    page->flushed = page->len;
+
+    if (rc != 0)
+    {
+        LOGE(tag, "Failed attempt at writing data in storage address %u", (unsigned int)add);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Write data to the page buffers. Data continuing the buffered page is
+ * appended, otherwise the page is flushed and a new one is started. Full
+ * pages are programmed.
+ */
+static int storage_page_write(int payload, uint32_t add, uint8_t *data, int size)
+{
+    storage_page_t *page = &payload_page[payload];
+    int rc = 0;
+    while (size > 0)
+    {
+        uint32_t page_add = add - add%STORAGE_FLASH_PAGE_SIZE;
+        uint16_t offset = (uint16_t)(add - page_add);
+        if (page->add != page_add || page->len != offset)
+        {
+            rc |= storage_page_flush(payload);
+            page->add = page_add;
+            page->flushed = page->len = offset;
         }
+
+        int n = STORAGE_FLASH_PAGE_SIZE - offset;
+        n = n < size ? n : size;
+        memcpy(page->data + offset, data, n);
+        page->len += n;
+        if (page->len == STORAGE_FLASH_PAGE_SIZE)
+            rc |= storage_page_flush(payload);
+
+        add += n;
+        data += n;
+        size -= n;
     }
-    return -1;
+    return rc != 0 ? -1 : 0;
+}
+
+/**
+ * Read data from flash, bytes not programmed yet are read from the page buffer
+ */
+static int storage_page_read(int payload, uint32_t add, uint8_t *data, int size)
+{
+    if (spn_fl512s_read_data(0, add, data, size) != 0)
+        return -1;
+
+    storage_page_t *page = &payload_page[payload];
+    if (page->add != STORAGE_PAGE_NONE && page->len > page->flushed)
+    {
+        uint32_t start = add > page->add + page->flushed ? add : page->add + page->flushed;
+        uint32_t end = add + size < page->add + page->len ? add + size : page->add + page->len;
+        if (start < end)
+            memcpy(data + (start - add), page->data + (start - page->add), end - start);
+    }
+    return 0;
+}
+
+/**
+ * Erase the next section in front of the log head
+ */
+static int storage_log_erase_next(int payload)
+{
+    storage_log_t *log = &payload_log[payload];
+    uint32_t pps = (uint32_t)storage_log_section_len(payload);
+
+    // The section may hold the buffered page after the log wraps
+    storage_page_flush(payload);
+
+    uint32_t add = storage_log_address(payload, log->erased - log->erased%pps);
+    LOGI(tag, "Deleting section in address %u", (unsigned int)add);
+    int rc = spn_fl512s_erase_block(0, add);
+    if (rc != 0)
+    {
+        LOGE(tag, "Failed attempt at deleting data in storage address %u", (unsigned int)add);
+        return -1;
+    }
+
+    log->erased = log->erased - log->erased%pps + pps;
+    return storage_log_save(payload);
 }
 
 int storage_set_payload_data(int index, void* data, int payload)
@@ -508,52 +911,101 @@ int storage_set_payload_data(int index, void* data, int payload)
         return -1;
     }
 
-    int payloads_per_section = SCH_SIZE_PER_SECTION/data_map[payload].size;
-
-    int payload_section = index/payloads_per_section;
-    int index_in_section = index%payloads_per_section;
+    storage_log_t *log = &payload_log[payload];
+    uint32_t pos = log->base + (uint32_t)index;
+    if (log->magic != STORAGE_LOG_MAGIC || index < 0 || pos < log->head)
+    {
+        LOGE(tag, "Payload %d index %d is not valid or already written", payload, index);
+        return -1;
+    }
 
-    int section_index = payload*SCH_SECTIONS_PER_PAYLOAD + payload_section;
+    // Sections are erased in advance, only erase here if the log reached them
+    uint32_t pps = (uint32_t)storage_log_section_len(payload);
+    int i;
+    for (i = 0; pos >= log->erased && i < SCH_SECTIONS_PER_PAYLOAD; i++)
+    {
+        if (storage_log_erase_next(payload) != 0)
+            return -1;
+    }
+    if (pos >= log->erased)
+        log->erased = pos - pos%pps + pps;  // Skipped a whole ring, all sections were erased
+
+    uint32_t add = storage_log_address(payload, pos);
+    LOGV(tag, "Writing in address: %u, %d bytes", (unsigned int)add, storage_log_slot_size(payload));
+    int rc = storage_page_write(payload, add, (uint8_t *)data, data_map[payload].size);
+#if SCH_STORAGE_CRC
+    // The CRC follows the sample in the same page buffer
+    uint32_t crc = crc32c_update(0, data, (size_t)data_map[payload].size);
+    crc = crc != 0 ? crc : 0xFFFFFFFF;
+    rc |= storage_page_write(payload, add + data_map[payload].size, (uint8_t *)&crc, sizeof(crc));
+#endif
+
+    log->head = pos + 1;
+    storage_log_save(payload);
+    return rc;
+}
 
-    uint32_t add = storage_addresses_payloads[section_index] + index_in_section*data_map[payload].size;
+int storage_get_payload_data(int index, void* data, int payload)
+{
+    if(payload >= last_sensor)
+    {
+        LOGE(tag, "payload id: %d greater than maximum id: %d", payload, last_sensor);
+        return -1;
+    }
 
-    if (payload_section >= SCH_SECTIONS_PER_PAYLOAD)
+    // Valid samples are behind the log head and were not erased by the ring
+    storage_log_t *log = &payload_log[payload];
+    uint32_t capacity = (uint32_t)storage_log_section_len(payload)*SCH_SECTIONS_PER_PAYLOAD;
+    uint32_t pos = log->base + (uint32_t)index;
+    if (log->magic != STORAGE_LOG_MAGIC || index < 0 || pos >= log->head || pos + capacity < log->erased)
     {
-        LOGE(tag, "Payload address: %u is out of bounds", (unsigned int)add);
+        LOGW(tag, "Payload %d index %d not found", payload, index);
         return -1;
     }
 
-    LOGI(tag, "Writing in address: %u, %d bytes\n", (unsigned int)add, data_map[payload].size);
-//    int ret = spn_fl512s_write_data(0, add, data, data_map[payload].size);
-    int ret = write_data_with_check(add, (uint8_t *)data, data_map[payload].size);
-    return ret;
+    uint32_t add = storage_log_address(payload, pos);
+    LOGV(tag, "Reading in address: %u, %d bytes", (unsigned int)add, storage_log_slot_size(payload));
+#if SCH_STORAGE_CRC
+    uint8_t slot[storage_log_slot_size(payload)];
+    uint32_t crc;
+    if(storage_page_read(payload, add, slot, storage_log_slot_size(payload)) != 0)
+        return -1;
+    memcpy(data, slot, data_map[payload].size);
+    memcpy(&crc, slot + data_map[payload].size, sizeof(crc));
+    uint32_t computed = crc32c_update(0, slot, (size_t)data_map[payload].size);
+    if((computed != 0 ? computed : 0xFFFFFFFF) != crc)
+    {
+        LOGW(tag, "Payload %d index %d failed the CRC check, discarded", payload, index);
+        payload_crc_errors++;
+        return -1;
+    }
+    return 0;
+#else
+    return storage_page_read(payload, add, (uint8_t *)data, data_map[payload].size);
+#endif
 }
 
-int read_data_with_check(uint32_t add, uint8_t * data, uint16_t size) {
+uint32_t storage_payload_crc_errors(int reset)
+{
+    uint32_t errors = payload_crc_errors;
+    if(reset)
+        payload_crc_errors = 0;
+    return errors;
+}
 
+int storage_set_payload_data_batch(int index, void* data, int payload, int n)
+{
+    // Samples are appended to the page buffers, so this is a plain loop
     int i;
-    for (i=0 ; i < 10; ++i) {
-        uint32_t add_aux = add + i*size;
-        int read_ret = spn_fl512s_read_data(0, add_aux, data, size);
-
-        if( read_ret != 0) {
+    for(i=0; i < n; i++)
+    {
+        if(storage_set_payload_data(index+i, (uint8_t *)data + i*data_map[payload].size, payload) < 0)
             return -1;
-        }
-        int j, integity=0;
-        for (j=0; j<size/4; ++j) {
-            if ( ((uint32_t*)data)[j] == 0xffffffff) {
-                integity +=1;
-                break;
-            }
-        }
-        if (integity == 0) {
-            return i;
-        }
     }
-    return -1;
+    return 0;
 }
 
-int storage_get_payload_data(int index, void* data, int payload)
+int storage_get_payload_data_range(int index, int count, void* data, int payload)
 {
     if(payload >= last_sensor)
     {
@@ -561,52 +1013,196 @@ int storage_get_payload_data(int index, void* data, int payload)
         return -1;
     }
 
-    int payloads_per_section = SCH_SIZE_PER_SECTION/data_map[payload].size;
-
-    int payload_section = index/payloads_per_section;
-    int index_in_section = index%payloads_per_section;
-
-    int section_index = payload*SCH_SECTIONS_PER_PAYLOAD + payload_section;
+    // Missing samples are zeroed
+    int i, n = 0;
+    for(i=0; i < count; i++)
+    {
+        uint8_t *sample = (uint8_t *)data + i*data_map[payload].size;
+        if(storage_get_payload_data(index+i, sample, payload) < 0)
+            memset(sample, 0, data_map[payload].size);
+        else
+            n++;
+    }
+    return n;
+}
 
-    uint32_t add = storage_addresses_payloads[section_index] + index_in_section*data_map[payload].size;
+int storage_get_payload_index_time(uint32_t timestamp, int payload, int next)
+{
+    if(payload >= last_sensor)
+    {
+        LOGE(tag, "payload id: %d greater than maximum id: %d", payload, last_sensor);
+        return -1;
+    }
 
-    if (payload_section >= SCH_SECTIONS_PER_PAYLOAD)
+    const dat_payload_schema_t *schema = dat_get_payload_schema(payload);
+    const dat_payload_field_t *field = NULL;
+    int i;
+    for(i=0; i < schema->nfields; i++)
     {
-        LOGE(tag, "payload address: %u is out of bounds", (unsigned int)add);
+        if(strcmp(schema->fields[i].name, "timestamp") == 0 && schema->fields[i].size == sizeof(uint32_t))
+            field = &schema->fields[i];
+    }
+    if(field == NULL)
         return -1;
+
+    // Binary search over the samples not erased by the ring, one flash read
+    // per step
+    storage_log_t *log = &payload_log[payload];
+    uint32_t capacity = (uint32_t)storage_log_section_len(payload)*SCH_SECTIONS_PER_PAYLOAD;
+    int low = 0, high = next;
+    if(log->erased > log->base + capacity)
+        low = (int)(log->erased - capacity - log->base);
+    if(low > high)
+        low = high;
+
+    uint8_t sample[data_map[payload].size];
+    while(low < high)
+    {
+        int mid = low + (high - low)/2;
+        uint32_t sample_time;
+        if(storage_get_payload_data(mid, sample, payload) != 0)
+            return -1;
+        memcpy(&sample_time, sample + field->offset, sizeof(sample_time));
+        if(sample_time < timestamp)
+            low = mid + 1;
+        else
+            high = mid;
     }
+    return low;
+}
 
-    LOGI(tag, "Reading in address: %u, %d bytes\n", (unsigned int)add, data_map[payload].size);
-//    printf("Reading values of size %u \n", data_map[payload]);
-//    spn_fl512s_read_data(add, (uint8_t *) data, data_map[payload]);
-    int read_ret = 0;
-//    read_ret = spn_fl512s_read_data(0, add, (uint8_t *)data, data_map[payload].size);
-    read_ret = read_data_with_check(add, (uint8_t *)data, data_map[payload].size);
-    if (read_ret < 0) {
-        return -1 ;
+int storage_trim_payload_data(int payload, int end, int max)
+{
+    if(payload >= last_sensor)
+    {
+        LOGE(tag, "payload id: %d greater than maximum id: %d", payload, last_sensor);
+        return -1;
     }
+    // The log reuses the sections of the oldest samples, storage_sync erases
+    // one section at a time in front of the head, so nothing is deleted here
     return 0;
 }
 
 int storage_delete_memory_sections()
 {
-    // Deleting Payload Memory Sections
-    //spn_fl512s_erase_chip(0);
-    for(int i = 0;  i < SCH_SECTIONS_PER_PAYLOAD*last_sensor; ++i)
+    // Samples are deleted moving the payload index 0 to the log head, the
+    // sections are erased when the log reaches them
+    int i, rc = 0;
+    for(i = 0;  i < last_sensor; ++i)
     {
-        LOGI(tag, "deleting section in address %u\n", (unsigned int)storage_addresses_payloads[i]);
-        int rc = spn_fl512s_erase_block(0, storage_addresses_payloads[i]);
-        if (rc != 0)
+        rc |= storage_page_flush(i);
+        payload_log[i].base = payload_log[i].head;
+        rc |= storage_log_save(i);
+    }
+    return rc != 0 ? -1 : 0;
+}
+
+int storage_table_payload_init(int drop)
+{
+    int i, rc = 0;
+    for(i = 0;  i < last_sensor; ++i)
+    {
+        uint16_t add = (uint16_t)(STORAGE_LOG_FRAM_ADDR + i*sizeof(storage_log_t));
+        payload_page[i].add = STORAGE_PAGE_NONE;
+        int error = (int)gs_fm33256b_fram_read(0, add, (uint8_t *)&payload_log[i], sizeof(storage_log_t));
+        if(error != 0 || payload_log[i].magic != STORAGE_LOG_MAGIC || drop)
         {
-            LOGE(tag, "Failed attempt at deleting data in storage address %u", (unsigned int)storage_addresses_payloads[i]);
-            return -1;
+            // The flash contents are unknown, sections are erased before use
+            LOGI(tag, "Formatting payload %d log", i);
+            payload_log[i].magic = STORAGE_LOG_MAGIC;
+            payload_log[i].base = 0;
+            payload_log[i].head = 0;
+            payload_log[i].erased = 0;
+            rc |= storage_log_save(i);
         }
+        LOGD(tag, "Payload %d log base %u head %u erased %u", i, (unsigned int)payload_log[i].base,
+             (unsigned int)payload_log[i].head, (unsigned int)payload_log[i].erased);
+    }
+    return rc != 0 ? -1 : 0;
+}
+
+int storage_sync(void)
+{
+    int i, rc = 0;
+    for(i = 0;  i < last_sensor; ++i)
+    {
+        rc |= storage_page_flush(i);
+        // Keep one section erased in front of the log head
+        uint32_t pps = (uint32_t)storage_log_section_len(i);
+        if(payload_log[i].magic == STORAGE_LOG_MAGIC && payload_log[i].erased - payload_log[i].head < pps)
+            rc |= storage_log_erase_next(i);
     }
+    return rc != 0 ? -1 : 0;
+}
+
+int storage_repo_seal(void)
+{
+#if SCH_STORAGE_NOINIT == 1
+    if(!repo_mirror_ok)
+        return -1;
+    repo_seal[1] = STORAGE_REPO_LEN;
+    repo_seal[2] = storage_repo_hash();
+    repo_seal[0] = STORAGE_REPO_MAGIC;
+#endif
     return 0;
 }
 
-int storage_table_payload_init(int drop)
+static int storage_fpj_save(void)
+{
+    int rc = (int)gs_fm33256b_fram_write(0, STORAGE_FPJ_FRAM_ADDR, (uint8_t *)&fp_journal, sizeof(fp_journal));
+    if (rc != 0)
+        LOGE(tag, "Failed attempt at writing the flight plan journal header in FRAM");
+    return rc != 0 ? -1 : 0;
+}
+
+int storage_fp_journal_init(const char *file)
 {
-    // FIXME: IMPLEMENT
+    int error = (int)gs_fm33256b_fram_read(0, STORAGE_FPJ_FRAM_ADDR, (uint8_t *)&fp_journal, sizeof(fp_journal));
+    if(error != 0 || fp_journal.magic != STORAGE_FPJ_MAGIC || fp_journal.slot > 1 || fp_journal.len > STORAGE_FPJ_SLOT_LEN)
+    {
+        LOGI(tag, "Formatting flight plan journal");
+        fp_journal.magic = STORAGE_FPJ_MAGIC;
+        fp_journal.slot = 0;
+        fp_journal.len = 0;
+        return storage_fpj_save();
+    }
     return 0;
 }
+
+int storage_fp_journal_read(int offset, void *data, int len)
+{
+    if(offset < 0 || (uint32_t)offset >= fp_journal.len)
+        return 0;
+    if((uint32_t)(offset + len) > fp_journal.len)
+        len = (int)fp_journal.len - offset;
+    uint16_t add = (uint16_t)(STORAGE_FPJ_SLOT_ADDR + fp_journal.slot*STORAGE_FPJ_SLOT_LEN + offset);
+    int rc = (int)gs_fm33256b_fram_read(0, add, (uint8_t *)data, (uint16_t)len);
+    return rc == 0 ? len : -1;
+}
+
+int storage_fp_journal_append(const void *data, int len)
+{
+    if(fp_journal.len + len > STORAGE_FPJ_SLOT_LEN)
+        return -1;
+    uint16_t add = (uint16_t)(STORAGE_FPJ_SLOT_ADDR + fp_journal.slot*STORAGE_FPJ_SLOT_LEN + fp_journal.len);
+    if(gs_fm33256b_fram_write(0, add, (uint8_t *)data, (uint16_t)len) != 0)
+        return -1;
+    fp_journal.len += len;
+    return storage_fpj_save();
+}
+
+int storage_fp_journal_rewrite(const void *data, int len)
+{
+    if(len > STORAGE_FPJ_SLOT_LEN)
+    {
+        LOGE(tag, "Flight plan journal does not fit in FRAM (%d bytes)", len);
+        return -1;
+    }
+    uint32_t slot = 1 - fp_journal.slot;
+    uint16_t add = (uint16_t)(STORAGE_FPJ_SLOT_ADDR + slot*STORAGE_FPJ_SLOT_LEN);
+    if(gs_fm33256b_fram_write(0, add, (uint8_t *)data, (uint16_t)len) != 0)
+        return -1;
+    fp_journal.slot = slot;
+    fp_journal.len = (uint32_t)len;
+    return storage_fpj_save();
+}
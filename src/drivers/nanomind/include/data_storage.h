@@ -11,6 +11,7 @@
 #include "log_utils.h"
 #include "config.h"
 #include "globals.h"
+#include "repoDataSchema.h"
 #include "repoData.h"
 
 /**
@@ -103,6 +104,65 @@ int storage_repo_get_value_str(char *name, char *table);
  */
 int storage_repo_set_value_idx(int index, int value, char *table);
 
+/**
+ * Get @n consecutive INT (integer) values from table, starting at index,
+ * with one FM33256B FRAM read of @n*4 bytes.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param index Int. Index of the first value
+ * @param n Int. Number of values to get
+ * @param values Pointer to an array of at least @n integers
+ * @param table Str. Table name
+ * @return 0 OK, -1 Error
+ */
+int storage_repo_get_values_idx(int index, int n, int *values, char *table);
+
+/**
+ * Set or update @n consecutive INT (integer) values, starting at index,
+ * with one FM33256B FRAM write of @n*4 bytes.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param index Int. Index of the first variable
+ * @param n Int. Number of values to set
+ * @param values Pointer to an array of @n integers
+ * @param table Str. Table name
+ * @return 0 OK, -1 Error
+ */
+int storage_repo_set_values_idx(int index, int n, const int *values, char *table);
+
+/**
+ * Get @n consecutive status variables, starting at index, with the copies of
+ * tripled writing (SCH_STORAGE_TRIPLE_WR). The copy c of the variable
+ * index + i is returned in values[c*n + i], to be voted by the caller.
+ * The copy c is also accessed by index + c*dat_status_last_address.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param index Int. Index of the first variable
+ * @param n Int. Number of variables to get
+ * @param values Pointer to an array of at least @n*3 integers
+ * @param table Str. Table name
+ * @return 0 OK, -1 Error
+ */
+int storage_repo_get_copies_idx(int index, int n, int *values, char *table);
+
+/**
+ * Set or update @n consecutive status variables, starting at index, and
+ * their copies of tripled writing (SCH_STORAGE_TRIPLE_WR). Each copy is
+ * written to its own FRAM block.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param index Int. Index of the first variable
+ * @param n Int. Number of values to set
+ * @param values Pointer to an array of @n integers
+ * @param table Str. Table name
+ * @return 0 OK, -1 Error
+ */
+int storage_repo_set_copies_idx(int index, int n, const int *values, char *table);
+
 /**
  * Set or update the value of a INT (integer) variable by name.
  *
@@ -125,12 +185,29 @@ int storage_repo_set_value_str(char *name, int value, char *table);
  * @param command Str. Command to set
  * @param args Str. command's arguments
  * @param repeat Int. Value of time to run the command
+ * @param ms Int. Milliseconds after timetodo
  * @return 0 OK, -1 Error
  */
-int storage_flight_plan_set(int timetodo, char* command, char* args, int repeat, int periodical, int * entries);
+int storage_flight_plan_set(int timetodo, char* command, char* args, int repeat, int periodical, int ms, int * entries);
+
+/**
+ * Set or update @n flight plan entries. With SQL storage the entries are
+ * inserted in one transaction, so all of them or none are stored. Other
+ * storages check there is space for all the entries first.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param fp Pointer to an array of @n entries
+ * @param n Int. Number of entries
+ * @param entries Int. Number of entries in the flight plan
+ * @return 0 OK, -1 Error
+ */
+int storage_flight_plan_set_batch(fp_entry_t *fp, int n, int * entries);
 
 /**
  * Get the first entry in the flight plan table that's set to execute at the given time.
+ * The entry is removed, unless it is periodical and has more than one
+ * execution left, then it is written again at timetodo + periodical.
  *
  * @note: non-reentrant function, use mutex to sync access
  *
@@ -138,9 +215,10 @@ int storage_flight_plan_set(int timetodo, char* command, char* args, int repeat,
  * @param command Str. Command to get
  * @param args Str. command's arguments
  * @param repeat Int. Value of times to run the command
+ * @param ms Int. Milliseconds after timetodo
  * @return 0 OK, -1 Error
  */
-int storage_flight_plan_get(int timetodo, char* command, char* args, int* repeat, int* periodical, int * entries);
+int storage_flight_plan_get(int timetodo, char* command, char* args, int* repeat, int* periodical, int* ms, int * entries);
 
 /**
  * Erase the first entry in the flight plan table that's set to execute at the given time.
@@ -152,6 +230,56 @@ int storage_flight_plan_get(int timetodo, char* command, char* args, int* repeat
  */
 int storage_flight_plan_erase(int timetodo, int * entries);
 
+/**
+ * Get the execution time of the earliest entry in the flight plan.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param entries Int. Number of entries in the flight plan
+ * @return Time of the earliest entry, -1 if the flight plan is empty or Error
+ */
+int storage_flight_plan_next(int entries);
+
+/**
+ * Visit the entries scheduled from time @from up to time @to, one at a time,
+ * without copying the table to memory. SQL storages visit the entries sorted
+ * by time, other storages in storage order (@see storage_flight_plan_sorted).
+ *
+ * @note: non-reentrant function, use mutex to sync access. @visit must not
+ * modify the flight plan.
+ *
+ * @param from Int. Min. time of the visited entries, -1 to visit all
+ * @param to Int. Max. time of the visited entries, -1 to visit all
+ * @param visit Function called for each entry, returns non zero to stop
+ * @param arg Pointer passed to @visit
+ * @param entries Int. Number of entries in the flight plan
+ * @return Number of visited entries, -1 Error
+ */
+int storage_flight_plan_foreach(int from, int to, fp_visit_t visit, void *arg, int entries);
+
+/**
+ * Check if storage_flight_plan_foreach visits the entries sorted by time,
+ * and entries with the same time in execution order.
+ *
+ * @return 1 if sorted, 0 if visited in storage order
+ */
+int storage_flight_plan_sorted(void);
+
+/**
+ * Move the entry at timetodo to new_time, with executions remaining
+ * executions, replacing any entry at new_time. Used to advance periodic entries
+ * without deleting and inserting them again.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param timetodo Int. Current time of the entry
+ * @param new_time Int. New time of the entry
+ * @param executions Int. Remaining executions
+ * @param entries Int. Number of entries in the flight plan
+ * @return 0 OK, -1 Error
+ */
+int storage_flight_plan_update(int timetodo, int new_time, int executions, int * entries);
+
 /**
  * Reset the flight plan table.
  *
@@ -208,6 +336,62 @@ int storage_set_payload_data(int index, void * data, int payload);
  */
 int storage_get_payload_data(int index, void* data, int payload);
 
+/**
+ * Set @n consecutive values for specific payload, starting at index address
+ * in NOR FLASH
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param index Int. index address of the first value in NOR FLASH
+ * @param data Pointer to an array of @n structs
+ * @param payload Int. payload to store
+ * @param n Int. number of structs in data
+ * @return 0 OK, -1 Error
+ */
+int storage_set_payload_data_batch(int index, void* data, int payload, int n);
+
+/**
+ * Get @count consecutive values for specific payload, starting at index
+ * address in NOR FLASH
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param index Int. index address of the first value in NOR FLASH
+ * @param count Int. number of values to get
+ * @param data Pointer to an array of at least @count structs
+ * @param payload Int. payload to get value
+ * @return Number of values found (missing values are zeroed), -1 Error
+ */
+int storage_get_payload_data_range(int index, int count, void* data, int payload);
+
+/**
+ * Find the index of the first payload sample, of the first @next samples,
+ * with a timestamp after or equal to @timestamp. Binary search over the
+ * samples in flash, assumes the samples were stored in time order.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param timestamp Unix time
+ * @param payload Int. payload to search
+ * @param next Int. index of the next sample to store
+ * @return The sample index, @next if all samples are older, -1 Error
+ */
+int storage_get_payload_index_time(uint32_t timestamp, int payload, int next);
+
+/**
+ * Delete the oldest samples of a payload, up to @max samples with index lower
+ * than @end. The flash log already reuses the sections of the oldest samples,
+ * so no sample is deleted (see storage_sync).
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param payload Int. payload to trim
+ * @param end Int. index of the first sample to keep
+ * @param max Int. max. samples to delete
+ * @return Number of samples deleted, 0 if none is left before @end, -1 Error
+ */
+int storage_trim_payload_data(int payload, int end, int max);
+
 /**
  * Get recent values from for specific payload
  * in NOR FLASH
@@ -222,7 +406,8 @@ int storage_get_payload_data(int index, void* data, int payload);
 //int storage_get_recent_payload_data(void* data, int payload, int delay);
 
 /**
- * Delete all memory sections in NOR FLASH
+ * Delete all payload samples in NOR FLASH. Samples are deleted from the log
+ * index, sections are erased when the payload log reaches them.
  *
  * @note: non-reentrant function, use mutex to sync access
  * @return OK 0, Error -1
@@ -241,12 +426,88 @@ int storage_delete_memory_sections(void);
 int storage_close(void);
 
 /**
- * FIXME: IMPLEMENT
- * @param drop
- * @return
+ * Load the payloads log index from FRAM. If the index is not valid, or drop
+ * is set to 1, the payloads log is formatted (previous samples are lost).
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param drop Int. Set to 1 to format the payloads log
+ * @return 0 OK, -1 Error
  */
 int storage_table_payload_init(int drop);
 
+/**
+ * Program the payload samples buffered in RAM and erase in advance the next
+ * flash section of each payload log, out of the sampling path. Called
+ * periodically (see dat_repo_sync).
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @return 0 OK, -1 Error
+ */
+int storage_sync(void);
+
+/**
+ * Seal the RAM mirror of the status variables before a software reset (see
+ * dat_repo_seal). With SCH_STORAGE_NOINIT the mirror is kept in a .noinit
+ * section, so a sealed mirror is used by the next storage_table_repo_init
+ * without reading the FRAM. The FRAM is written through, it already has the
+ * same values.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @return 0 OK, -1 Error
+ */
+int storage_repo_seal(void);
+
+/**
+ * Open the flight plan journal, used to keep the flight plan of the RAM
+ * storage mode (SCH_STORAGE_MODE 0) across resets. The journal is created if
+ * it does not exist.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param file Str. Journal file path, not used, the journal is kept in FRAM
+ * @return 0 OK, -1 Error
+ */
+int storage_fp_journal_init(const char *file);
+
+/**
+ * Read @len bytes of the flight plan journal, starting at @offset.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param offset Int. Journal position
+ * @param data Pointer to a buffer of at least @len bytes
+ * @param len Int. Number of bytes to read
+ * @return Number of bytes read, less than @len at the end of the journal, -1 Error
+ */
+int storage_fp_journal_read(int offset, void *data, int len);
+
+/**
+ * Append @len bytes to the flight plan journal, written through to the
+ * non-volatile storage.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param data Pointer to the data to append
+ * @param len Int. Number of bytes
+ * @return 0 OK, -1 Error or journal full
+ */
+int storage_fp_journal_append(const void *data, int len);
+
+/**
+ * Replace the contents of the flight plan journal with @len bytes, used to
+ * compact it. If the storage fails, the previous contents are kept.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param data Pointer to the new journal contents
+ * @param len Int. Number of bytes
+ * @return 0 OK, -1 Error or journal full
+ */
+int storage_fp_journal_rewrite(const void *data, int len);
+
 
 
 #endif //SCH_PERSISTENT_H
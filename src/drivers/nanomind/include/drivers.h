@@ -68,5 +68,9 @@
 // GSSB
 #include <gs/gssb/gssb_all_devices.h>
 #include <gs/gssb/gssb_autodeploy.h>
+// I2C bus managers
+#include "taskI2CBus.h"
+
+#define SCH_A3200_I2C_BUS 2  ///< TWI2 bus manager: gyroscope, magnetometer, GSSB devices and reaction wheels
 
 #endif
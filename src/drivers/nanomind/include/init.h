@@ -9,6 +9,7 @@ void sch_a3200_init_spi0(bool decode);
 void sch_a3200_init_spi1(void);
 void sch_a3200_init_twi0(gs_avr32_i2c_mode_t mode, uint8_t addr, uint32_t bps);
 void sch_a3200_init_twi2(void);
+int sch_a3200_i2c_transfer(int bus, i2c_bus_xfer_t *xfers, int n, uint32_t timeout_ms);
 void sch_a3200_init_can(bool enable);
 gs_error_t sch_a3200_uart_init(uint8_t uart, bool enable, uint32_t bps);
 static gs_error_t sch_init_rtc(void);
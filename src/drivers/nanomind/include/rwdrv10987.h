@@ -38,6 +38,8 @@
 #define MOTOR2_ID 2
 #define MOTOR3_ID 3
 
+#define RWDRV10987_SAMPLE_MS 200  ///< Delay between a sample request and its result
+
 
 /**************************************************************************/
 /*!
@@ -46,6 +48,26 @@
 /**************************************************************************/
 int rwdrv10987_init(void);
 
+/**************************************************************************/
+/*!
+    @brief request a speed or current sample of the specified motor, the
+    result is ready to be read with rwdrv10987_sample_read after
+    RWDRV10987_SAMPLE_MS
+    @param motor_id:[1-3]
+    @param current: 1 to sample the current, 0 to sample the speed
+*/
+/**************************************************************************/
+int8_t rwdrv10987_sample_request(uint8_t motor_id, int current);
+
+/**************************************************************************/
+/*!
+    @brief read the sample requested with rwdrv10987_sample_request
+    @param current: 1 if a current [mA] was requested, 0 for a speed
+    @param value: the sampled value
+*/
+/**************************************************************************/
+int8_t rwdrv10987_sample_read(int current, float *value);
+
 /**************************************************************************/
 /*!
     @brief get speed of the specified motor from the drv10987 driver
@@ -70,4 +92,13 @@ float rwdrv10987_get_current(uint8_t motor_id);
 /**************************************************************************/
 int8_t rwdrv10987_set_speed(uint8_t motor_id, uint16_t speed);
 
+/**************************************************************************/
+/*!
+    @brief set the speed of the three motors, the commands are sent back to
+    back so the torques change together
+    @param speed: speed of motor 1, 2 and 3
+*/
+/**************************************************************************/
+int8_t rwdrv10987_set_speed_all(uint16_t speed[3]);
+
 #endif //SUCHAI_FLIGHT_SOFTWARE_RWDRV10987_H
@@ -64,6 +64,24 @@ void sch_a3200_init_twi2(void)
     gs_avr_i2c_init(2, GS_AVR_I2C_MASTER, 1, 150000);
 }
 
+/**
+ * I2C bus manager transfer function (@see i2c_bus_init). Each transfer is a
+ * master transaction, the write and the read with a repeated start. All the
+ * transfers are run, even if one fails.
+ */
+int sch_a3200_i2c_transfer(int bus, i2c_bus_xfer_t *xfers, int n, uint32_t timeout_ms)
+{
+    int i, result = 0;
+    for(i = 0; i < n; i++)
+    {
+        gs_error_t rc = gs_i2c_master_transaction((uint8_t)bus, xfers[i].addr, xfers[i].tx, xfers[i].tx_len,
+                                                  xfers[i].rx, xfers[i].rx_len, timeout_ms);
+        if(rc != GS_OK)
+            result = -1;
+    }
+    return result;
+}
+
 void sch_a3200_init_can(bool enable)
 {
     /* Setup the generic clock for CAN */
@@ -207,6 +225,8 @@ void on_init_task(void * param)
      */
     /* Init I2C controller for gyroscope, magnetometer and GSSB devices */
     sch_a3200_init_twi2();
+    rc = i2c_bus_init(SCH_A3200_I2C_BUS, sch_a3200_i2c_transfer);
+    if(rc!=0) LOGE(tag, "I2C bus manager not initialized!");
     /* Init gyroscope */
     gs_mpu3300_init(GS_MPU3300_BW_5, GS_MPU3300_FSR_225);
     /* Init magnetometer */
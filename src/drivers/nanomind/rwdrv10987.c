@@ -26,41 +26,70 @@ int rwdrv10987_init(void)
 
 /**************************************************************************/
 /*!
-    @brief get speed of the specified motor from the drv10987 driver
+    @brief request a speed or current sample of the specified motor, the
+    result is ready to be read with rwdrv10987_sample_read after
+    RWDRV10987_SAMPLE_MS
     @param motor_id:[1-3]
+    @param current: 1 to sample the current, 0 to sample the speed
 */
 /**************************************************************************/
-uint16_t rwdrv10987_get_speed(uint8_t motor_id)
+int8_t rwdrv10987_sample_request(uint8_t motor_id, int current)
 {
-    //send sample speed cmd
-    if(motor_id == MOTOR1_ID){
-        uint8_t cmd[3] = {SAMPLE_SPEED_CODE_MOTOR1, 0x00, 0x00};
-        gs_i2c_master_transaction(2, BIuC_ADDR, cmd, 3, NULL, 0, 1000);
-    }
-    else if(motor_id == MOTOR2_ID){
-        uint8_t cmd[3] = {SAMPLE_SPEED_CODE_MOTOR2, 0x00, 0x00};
-        gs_i2c_master_transaction(2, BIuC_ADDR, cmd, 3, NULL, 0, 1000);
-    }
-    else if(motor_id == MOTOR3_ID){
-        uint8_t cmd[3] = {SAMPLE_SPEED_CODE_MOTOR3, 0x00, 0x00};
-        gs_i2c_master_transaction(2, BIuC_ADDR, cmd, 3, NULL, 0, 1000);
-    }
-    else{
+    static const uint8_t codes[2][3] = {
+        {SAMPLE_SPEED_CODE_MOTOR1, SAMPLE_SPEED_CODE_MOTOR2, SAMPLE_SPEED_CODE_MOTOR3},
+        {SAMPLE_CURRENT_CODE_MOTOR1, SAMPLE_CURRENT_CODE_MOTOR2, SAMPLE_CURRENT_CODE_MOTOR3}
+    };
+    if(motor_id < MOTOR1_ID || motor_id > MOTOR3_ID){
         printf("[RWDRV10987:Error]: Bad id");
         return -1;
     }
-    osDelay(200);
-    //read data regs
-    uint8_t res[2];
-    gs_error_t rc = gs_i2c_master_transaction(2, BIuC_ADDR, NULL, 0, res, 2, 1000);
-    if(rc == GS_OK) {
-        uint16_t speed = (res[0] << 8) | res[1];
-        return speed;
-    }
-    else{
+    uint8_t cmd[3] = {codes[current ? 1 : 0][motor_id - MOTOR1_ID], 0x00, 0x00};
+    return i2c_bus_write_read(SCH_A3200_I2C_BUS, I2C_PRIO_NORMAL, BIuC_ADDR, cmd, 3, NULL, 0, 1000);
+}
+
+/**************************************************************************/
+/*!
+    @brief read the sample requested with rwdrv10987_sample_request
+    @param current: 1 if a current [mA] was requested, 0 for a speed
+    @param value: the sampled value
+*/
+/**************************************************************************/
+int8_t rwdrv10987_sample_read(int current, float *value)
+{
+    uint8_t res[2] = {0, 0};
+    int rc = i2c_bus_write_read(SCH_A3200_I2C_BUS, I2C_PRIO_NORMAL, BIuC_ADDR, NULL, 0, res, 2, 1000);
+    if(rc != 0){
         printf("[RWDRV10987:Error i2c]: %d", rc);
+        return -1;
+    }
+
+    if(!current){
+        *value = (uint16_t)((res[0] << 8) | res[1]);
         return 0;
     }
+    uint16_t current_aux = ((res[0] & 0x07) << 8) | res[1];
+    if(current_aux >= 1023)
+        *value = 3000 * (current_aux - 1023) / 2048.0; //[mA]
+    else
+        *value = 3000 * (current_aux) / 2048.0; //[mA]
+    return 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief get speed of the specified motor from the drv10987 driver
+    @param motor_id:[1-3]
+*/
+/**************************************************************************/
+uint16_t rwdrv10987_get_speed(uint8_t motor_id)
+{
+    float speed = 0;
+    if(rwdrv10987_sample_request(motor_id, 0) != 0)
+        return -1;
+    osDelay(RWDRV10987_SAMPLE_MS);
+    if(rwdrv10987_sample_read(0, &speed) != 0)
+        return 0;
+    return (uint16_t)speed;
 }
 
 /**************************************************************************/
@@ -71,42 +100,13 @@ uint16_t rwdrv10987_get_speed(uint8_t motor_id)
 /**************************************************************************/
 float rwdrv10987_get_current(uint8_t motor_id)
 {
-    //send sample current cmd
-    if(motor_id == MOTOR1_ID){
-        uint8_t cmd[3] = {SAMPLE_CURRENT_CODE_MOTOR1, 0x00, 0x00};
-        gs_i2c_master_transaction(2, BIuC_ADDR, cmd, 3, NULL, 0, 1000);
-    }
-    else if(motor_id == MOTOR2_ID){
-        uint8_t cmd[3] = {SAMPLE_CURRENT_CODE_MOTOR2, 0x00, 0x00};
-        gs_i2c_master_transaction(2, BIuC_ADDR, cmd, 3, NULL, 0, 1000);
-    }
-    else if(motor_id == MOTOR3_ID){
-        uint8_t cmd[3] = {SAMPLE_CURRENT_CODE_MOTOR3, 0x00, 0x00};
-        gs_i2c_master_transaction(2, BIuC_ADDR, cmd, 3, NULL, 0, 1000);
-    }
-    else{
-        printf("[RWDRV10987:Error]: Bad id");
+    float current = 0;
+    if(rwdrv10987_sample_request(motor_id, 1) != 0)
         return -1;
-    }
-    osDelay(200);
-    //read data regs
-    uint8_t res[2] = {0, 0};
-    gs_error_t rc = gs_i2c_master_transaction(2, BIuC_ADDR, NULL, 0, res, 2, 1000);
-
-    if(rc == GS_OK) {
-        uint16_t current_aux = ((res[0] & 0x07) << 8) | res[1];
-        float current = 0;
-        if(current_aux >= 1023)
-            current = 3000 * (current_aux - 1023) / 2048.0; //[mA]
-        else
-            current = 3000 * (current_aux) / 2048.0; //[mA]
-        return current;
-    }
-    else{
-        printf("[RWDRV10987:Error i2c]: %d)", rc);
+    osDelay(RWDRV10987_SAMPLE_MS);
+    if(rwdrv10987_sample_read(1, &current) != 0)
         return -1.0;
-    }
-
+    return current;
 }
 
 /**************************************************************************/
@@ -117,27 +117,42 @@ float rwdrv10987_get_current(uint8_t motor_id)
 /**************************************************************************/
 int8_t rwdrv10987_set_speed(uint8_t motor_id, uint16_t speed)
 {
-    gs_error_t result_cmd;
-    if(motor_id == MOTOR1_ID)
-    {
-        uint8_t cmd[3] = {SET_SPEED_CODE_MOTOR1, speed & 0xff, speed >> 8};
-        result_cmd = gs_i2c_master_transaction(2, BIuC_ADDR, cmd, 3, NULL, 0, 1000);
-    }
-    else if(motor_id == MOTOR2_ID)
-    {
-        uint8_t cmd[3] = {SET_SPEED_CODE_MOTOR2, speed & 0xff, speed >> 8};
-        result_cmd = gs_i2c_master_transaction(2, BIuC_ADDR, cmd, 3, NULL, 0, 1000);
-    }
-    else if(motor_id == MOTOR3_ID)
-    {
-        uint8_t cmd[3] = {SET_SPEED_CODE_MOTOR3, speed & 0xff, speed >> 8};
-        result_cmd = gs_i2c_master_transaction(2, BIuC_ADDR, cmd, 3, NULL, 0, 1000);
-    }
-    else
+    static const uint8_t codes[3] = {SET_SPEED_CODE_MOTOR1, SET_SPEED_CODE_MOTOR2, SET_SPEED_CODE_MOTOR3};
+    if(motor_id < MOTOR1_ID || motor_id > MOTOR3_ID)
     {
         printf("[RWDRV10987:Error]: Bad id");
         return -1;
     }
+    uint8_t cmd[3] = {codes[motor_id - MOTOR1_ID], speed & 0xff, speed >> 8};
+    int8_t result_cmd = (int8_t)i2c_bus_write_read(SCH_A3200_I2C_BUS, I2C_PRIO_HIGH, BIuC_ADDR, cmd, 3, NULL, 0, 1000);
     osDelay(200);  // Avoid activate another motor immediately
     return result_cmd;
 }
+
+/**************************************************************************/
+/*!
+    @brief set the speed of the three motors, the commands are sent back to
+    back in one high priority bus transaction, so the torques change
+    together. Use rwdrv10987_set_speed to spin up the wheels one at a time.
+    @param speed: speed of motor 1, 2 and 3
+*/
+/**************************************************************************/
+int8_t rwdrv10987_set_speed_all(uint16_t speed[3])
+{
+    static const uint8_t codes[3] = {SET_SPEED_CODE_MOTOR1, SET_SPEED_CODE_MOTOR2, SET_SPEED_CODE_MOTOR3};
+    uint8_t cmd[3][3];
+    i2c_bus_xfer_t xfers[3];
+    int i;
+    for(i = 0; i < 3; i++)
+    {
+        cmd[i][0] = codes[i];
+        cmd[i][1] = speed[i] & 0xff;
+        cmd[i][2] = speed[i] >> 8;
+        xfers[i].addr = BIuC_ADDR;
+        xfers[i].tx = cmd[i];
+        xfers[i].tx_len = 3;
+        xfers[i].rx = NULL;
+        xfers[i].rx_len = 0;
+    }
+    return (int8_t)i2c_bus_transaction(SCH_A3200_I2C_BUS, I2C_PRIO_HIGH, xfers, 3, 1000);
+}
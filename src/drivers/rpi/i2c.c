@@ -24,113 +24,150 @@
 
 char *deviceName = (char*)"/dev/i2c-1";
 
+static int i2cHandle = -1;
+static pthread_once_t i2c_once = PTHREAD_ONCE_INIT;
+
+static void i2c_open(void)
+{
+    if ((i2cHandle = open(deviceName, O_RDWR)) < 0)
+        printf("error opening I2C\n");
+}
 
 /**************************************************************************/
 /*!
-    @brief  Write n bytes over I2C
+    @brief  Bus file descriptor. The device is opened once and kept open,
+    transfers use I2C_RDWR with the slave address in each message, so they
+    do not depend on a shared I2C_SLAVE state. Transfers are run by the bus
+    manager (@see taskI2CBus.h).
 */
 /**************************************************************************/
-int8_t i2c_write_n(uint8_t addr, uint8_t reg_addr, uint8_t *reg_data, uint16_t len)
+static int i2c_get_handle(void)
 {
-    int i2cHandle;
-    int res_tmp;
-    if ((i2cHandle = open(deviceName, O_RDWR)) < 0)
+    pthread_once(&i2c_once, i2c_open);
+    return i2cHandle;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Run a set of messages, up to I2C_RDRW_IOCTL_MAX_MSGS, as one
+    transaction (repeated start between messages)
+*/
+/**************************************************************************/
+static int8_t i2c_transfer(struct i2c_msg *msgs, int nmsgs)
+{
+    int handle = i2c_get_handle();
+    if (handle < 0)
+        return 1;
+
+    struct i2c_rdwr_ioctl_data data = {.msgs = msgs, .nmsgs = (uint32_t)nmsgs};
+    if (ioctl(handle, I2C_RDWR, &data) != nmsgs)
     {
-        printf("error opening I2C\n");
+        perror("[rpi i2c] Failed I2C_RDWR transfer");
         return 1;
     }
-    else
+    return 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Bus manager transfer function (@see i2c_bus_init). All the
+    transfers are run as one I2C_RDWR transaction, with a write and a read
+    message each (repeated start between messages). The timeout is the
+    adapter timeout of the kernel driver.
+*/
+/**************************************************************************/
+int i2c_bus_transfer_linux(int bus, i2c_bus_xfer_t *xfers, int n, uint32_t timeout_ms)
+{
+    struct i2c_msg msgs[2*I2C_BUS_XFERS];
+    int i, nmsgs = 0;
+    for (i = 0; i < n && i < I2C_BUS_XFERS; i++)
     {
-        if (ioctl(i2cHandle, I2C_SLAVE, addr) < 0)
+        if (xfers[i].tx_len > 0)
         {
-            printf("Error at ioctl\n");
-            // Close the i2c device bus
-            close(*deviceName);
-            return 1;
+            msgs[nmsgs].addr = xfers[i].addr;
+            msgs[nmsgs].flags = 0;
+            msgs[nmsgs].len = xfers[i].tx_len;
+            msgs[nmsgs].buf = (uint8_t *)xfers[i].tx;
+            nmsgs++;
         }
-        else
+        if (xfers[i].rx_len > 0)
         {
-            uint8_t wbuf[len+1];
-            #ifdef RPI_I2C_DEBUG
-                printf("data to write: [");
-                for (int i = 0; i < len; i++) {
-                    printf("%d,", reg_data[i]);
-                }
-                printf("]\n");
-            #endif
-//            printf("addr = %d\n", addr);
-//            printf("reg_addr = %d\n", reg_addr);
-//            printf("reg_data[0] = %d\n", reg_data[0]);
-            memcpy(wbuf, &reg_addr, sizeof(uint8_t));
-            memcpy(wbuf+1, reg_data, len*sizeof(uint8_t));
-            res_tmp = write(i2cHandle, wbuf, len+1);
-            #ifdef RPI_I2C_DEBUG
-                printf("addr+data to write: [");
-                for (int i = 0; i < len+1; i++) {
-                    printf("%d,", wbuf[i]);
-                }
-                printf("]\n");
-                printf("[rpi i2c_write] res_tmp: %d\n", res_tmp);
-            #endif
-            if (res_tmp != len+1) {
-                printf("[rpi i2c_write]Fail to write %d bytes\n", len+1 - res_tmp);
-                return 1;
-            }
+            msgs[nmsgs].addr = xfers[i].addr;
+            msgs[nmsgs].flags = I2C_M_RD;
+            msgs[nmsgs].len = xfers[i].rx_len;
+            msgs[nmsgs].buf = xfers[i].rx;
+            nmsgs++;
         }
     }
-    // Close the i2c device bus
-    close(*deviceName);
+    if (nmsgs == 0)
+        return -1;
+    return i2c_transfer(msgs, nmsgs) == 0 ? 0 : -1;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Write n bytes over I2C
+*/
+/**************************************************************************/
+int8_t i2c_write_n(uint8_t addr, uint8_t reg_addr, uint8_t *reg_data, uint16_t len)
+{
+    uint8_t wbuf[len+1];
+    #ifdef RPI_I2C_DEBUG
+        printf("data to write: [");
+        for (int i = 0; i < len; i++) {
+            printf("%d,", reg_data[i]);
+        }
+        printf("]\n");
+    #endif
+    wbuf[0] = reg_addr;
+    memcpy(wbuf+1, reg_data, len*sizeof(uint8_t));
+
+    if (i2c_bus_write_read(RPI_I2C_BUS, I2C_PRIO_NORMAL, addr, wbuf, (uint16_t)(len+1), NULL, 0, RPI_I2C_TIMEOUT_MS) != 0) {
+        printf("[rpi i2c_write]Fail to write %d bytes\n", len+1);
+        return 1;
+    }
     return 0;
 }
 
 /**************************************************************************/
 /*!
-    @brief  Reads n bytes over I2C
+    @brief  Reads n bytes over I2C. With delay_ms = 0 the register address
+    write and the read are a single combined transaction (repeated start),
+    otherwise the delay is kept between both transfers for devices that
+    need it.
 */
 /**************************************************************************/
 int8_t i2c_read_n(uint8_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len, uint8_t delay_ms)
 {
-    int i2cHandle;
-    if ((i2cHandle = open(deviceName, O_RDWR)) < 0)
+    memset(reg_data, 0, len);
+
+    int rc;
+    if (delay_ms == 0)
     {
-        printf("error opening I2C\n");
-        return 1;
+        rc = i2c_bus_write_read(RPI_I2C_BUS, I2C_PRIO_NORMAL, dev_id, &reg_addr, 1, reg_data, len, RPI_I2C_TIMEOUT_MS);
     }
     else
     {
-        if (ioctl(i2cHandle, I2C_SLAVE, dev_id) < 0) {
-            printf("Error at ioctl\n");
-            // Close the i2c device bus
-            close(*deviceName);
-            return 1;
-        }
-        else
-        {
-            memset(reg_data, 0, len);
-            char wbuf[1];
-            wbuf[0] = reg_addr;
-            int res_tmp = write(i2cHandle, wbuf, 1);
-            usleep(delay_ms*1000);
-            uint8_t bytes_r = read(i2cHandle, reg_data, len);
-            #ifdef RPI_I2C_DEBUG
-                printf("[rpi i2c_read] res_tmp: %d\n", res_tmp);
-                printf("rpi i2c_read: [");
-                for (int i = 0; i < len; i++) {
-                    printf("%d,", reg_data[i]);
-                }
-                printf("]\n");
-            #endif
-            if (bytes_r != len)
-            {
-                printf("bytes_r = %d, len = %d\n", bytes_r, len);
-                perror("Failed to read from the i2c bus");
-                return 1;
-            }
+        // The bus is free for other transactions during the delay
+        rc = i2c_bus_write_read(RPI_I2C_BUS, I2C_PRIO_NORMAL, dev_id, &reg_addr, 1, NULL, 0, RPI_I2C_TIMEOUT_MS);
+        usleep(delay_ms*1000);
+        if (rc == 0)
+            rc = i2c_bus_write_read(RPI_I2C_BUS, I2C_PRIO_NORMAL, dev_id, NULL, 0, reg_data, len, RPI_I2C_TIMEOUT_MS);
+    }
+
+    #ifdef RPI_I2C_DEBUG
+        printf("rpi i2c_read: [");
+        for (int i = 0; i < len; i++) {
+            printf("%d,", reg_data[i]);
         }
-        // Close the i2c device bus
-        close(*deviceName);
-        return 0;
+        printf("]\n");
+    #endif
+    if (rc != 0)
+    {
+        printf("[rpi i2c_read] Fail to read %d bytes\n", len);
+        return 1;
     }
+    return 0;
 }
 
 /**************************************************************************/
@@ -140,42 +177,55 @@ int8_t i2c_read_n(uint8_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t
 /**************************************************************************/
 int8_t i2c_read_from_n(uint8_t dev_id, uint8_t *reg_data, uint8_t len)
 {
-    int i2cHandle;
-    if ((i2cHandle = open(deviceName, O_RDWR)) < 0)
+    memset(reg_data, 0, len);
+    int rc = i2c_bus_write_read(RPI_I2C_BUS, I2C_PRIO_NORMAL, dev_id, NULL, 0, reg_data, len, RPI_I2C_TIMEOUT_MS);
+    #ifdef RPI_I2C_DEBUG
+        printf("rpi i2c_read_from: [");
+        for (int i = 0; i < len; i++) {
+            printf("%d,", reg_data[i]);
+        }
+        printf("]\n");
+    #endif
+    if (rc != 0)
     {
-        printf("error opening I2C\n");
+        printf("[rpi i2c_read_from] Fail to read %d bytes\n", len);
         return 1;
     }
-    else
+    return 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Reads several registers, possibly of different devices, with
+    I2C_BUS_XFERS registers per bus transaction. Other transactions can run
+    between the batches.
+*/
+/**************************************************************************/
+int8_t i2c_read_regs(i2c_reg_read_t *regs, int n)
+{
+    i2c_bus_xfer_t xfers[I2C_BUS_XFERS];
+    int i, nxfers = 0;
+    for (i = 0; i < n; i++)
     {
-        if (ioctl(i2cHandle, I2C_SLAVE, dev_id) < 0) {
-            printf("Error at ioctl\n");
-            // Close the i2c device bus
-            close(*deviceName);
-            return 1;
-        }
-        else
+        memset(regs[i].data, 0, regs[i].len);
+        xfers[nxfers].addr = regs[i].dev_id;
+        xfers[nxfers].tx = &regs[i].reg_addr;
+        xfers[nxfers].tx_len = 1;
+        xfers[nxfers].rx = regs[i].data;
+        xfers[nxfers].rx_len = regs[i].len;
+        nxfers++;
+
+        if (nxfers == I2C_BUS_XFERS || i == n-1)
         {
-            memset(reg_data, 0, len);
-            uint8_t bytes_r = read(i2cHandle, reg_data, len);
-            #ifdef RPI_I2C_DEBUG
-                printf("rpi i2c_read_from: [");
-                for (int i = 0; i < len; i++) {
-                    printf("%d,", reg_data[i]);
-                }
-                printf("]\n");
-            #endif
-            if (bytes_r != len)
+            if (i2c_bus_transaction(RPI_I2C_BUS, I2C_PRIO_NORMAL, xfers, nxfers, RPI_I2C_TIMEOUT_MS) != 0)
             {
-                printf("bytes_r = %d, len = %d\n", bytes_r, len);
-                perror("Failed to read from the i2c bus");
+                printf("[rpi i2c_read_regs] Fail to read registers\n");
                 return 1;
             }
+            nxfers = 0;
         }
-        // Close the i2c device bus
-        close(*deviceName);
-        return 0;
     }
+    return 0;
 }
 
 /**************************************************************************/
@@ -185,37 +235,12 @@ int8_t i2c_read_from_n(uint8_t dev_id, uint8_t *reg_data, uint8_t len)
 /**************************************************************************/
 int8_t i2c_write_addr(uint8_t addr, uint8_t data)
 {
-    int i2cHandle;
-    int res_tmp;
-    if ((i2cHandle = open(deviceName, O_RDWR)) < 0)
-    {
-        printf("error opening I2C\n");
+    #ifdef RPI_I2C_DEBUG
+        printf("data to write: [%d]", data);
+    #endif
+    if (i2c_bus_write_read(RPI_I2C_BUS, I2C_PRIO_NORMAL, addr, &data, 1, NULL, 0, RPI_I2C_TIMEOUT_MS) != 0) {
+        printf("[rpi i2c_write]Fail to write %d bytes\n", 1);
         return 1;
     }
-    else
-    {
-        if (ioctl(i2cHandle, I2C_SLAVE, addr) < 0)
-        {
-            printf("Error at ioctl\n");
-            // Close the i2c device bus
-            close(*deviceName);
-            return 1;
-        }
-        else
-        {
-            uint8_t wbuf[1];
-            #ifdef RPI_I2C_DEBUG
-                printf("data to write: [%d]", data);
-            #endif
-            wbuf[0] = data;
-            res_tmp = write(i2cHandle, wbuf, 1);
-            if (res_tmp != 1) {
-                printf("[rpi i2c_write]Fail to write %d bytes\n", 1 - res_tmp);
-                return 1;
-            }
-        }
-    }
-    // Close the i2c device bus
-    close(*deviceName);
     return 0;
-}
\ No newline at end of file
+}
@@ -17,11 +17,28 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <linux/i2c-dev.h>
+#include <linux/i2c.h>
+#include <pthread.h>
 #include <errno.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "taskI2CBus.h"
+
+#define RPI_I2C_BUS         (1)     ///< Bus manager number, the bus of /dev/i2c-1
+#define RPI_I2C_TIMEOUT_MS  (1000)  ///< Bus manager transactions timeout
+
+/**
+ * Register read for i2c_read_regs
+ */
+typedef struct i2c_reg_read {
+    uint8_t dev_id;     ///< Device address
+    uint8_t reg_addr;   ///< Register address
+    uint8_t *data;      ///< Buffer of len bytes for the register value
+    uint16_t len;       ///< Bytes to read
+} i2c_reg_read_t;
+
 
 int8_t i2c_write_n(uint8_t addr, uint8_t reg_addr, uint8_t *reg_data, uint16_t len);
 
@@ -49,4 +66,22 @@ int8_t i2c_read_from_n(uint8_t dev_id, uint8_t *reg_data, uint8_t len);
 
 int8_t i2c_write_addr(uint8_t addr, uint8_t data);
 
+/*!
+ *    @brief  Read several registers with combined transactions, a few
+ *    registers per ioctl call
+ *    @param  regs, n
+ *    @return err_code
+ */
+
+int8_t i2c_read_regs(i2c_reg_read_t *regs, int n);
+
+/*!
+ *    @brief  Bus manager transfer function, register it with
+ *    i2c_bus_init(RPI_I2C_BUS, i2c_bus_transfer_linux)
+ *    @param  bus, xfers, n, timeout_ms
+ *    @return 0 if OK, -1 on error
+ */
+
+int i2c_bus_transfer_linux(int bus, i2c_bus_xfer_t *xfers, int n, uint32_t timeout_ms);
+
 #endif /* CMD_RW_H */
\ No newline at end of file
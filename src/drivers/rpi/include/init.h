@@ -19,6 +19,7 @@
 /* system includes */
 #include "repoData.h"
 #include "repoCommand.h"
+#include "i2c.h"
 
 #if SCH_COMM_ENABLE
 #include <csp/csp.h>
@@ -38,4 +38,7 @@ void on_reset(void)
     act.sa_handler = on_close;
     sigaction(SIGINT, &act, NULL);  // Register CTR+C signal handler
     sigaction(SIGTERM, &act, NULL);
+
+    /* I2C bus manager of /dev/i2c-1 */
+    i2c_bus_init(RPI_I2C_BUS, i2c_bus_transfer_linux);
 }
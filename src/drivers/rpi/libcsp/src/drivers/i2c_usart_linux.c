@@ -32,11 +32,11 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include <i2c_usart_linux.h>
 #include <csp_if_i2c_uart.h>
+#include "config.h"
 
 
 static int fd = -1;
 static i2c_usart_callback_t i2c_usart_callback = NULL;
-static csp_bin_sem_handle_t *i2c_uart_ans_lock = NULL;
 
 static void *serial_rx_thread(void *vptr_args);
 
@@ -113,8 +113,6 @@ int i2c_usart_init(const struct i2c_usart_conf * conf) {
 		return CSP_ERR_DRIVER;
 	}
 
-    i2c_uart_ans_lock = conf->uart_ans_lock;
-
 	pthread_t rx_thread;
 	if (pthread_create(&rx_thread, NULL, serial_rx_thread, NULL) != 0) {
 		csp_log_error("%s: pthread_create() failed to create Rx thread for device: [%s], errno: %s", __FUNCTION__, conf->device, strerror(errno));
@@ -149,50 +147,103 @@ char i2c_usart_getc(void) {
 	return c;
 }
 
+/* Find the first sync mark ("OK" frame or "TX" confirmation) in buf. Returns
+ * the mark offset and sets *mark, or the bytes that can be discarded and sets
+ * *mark to 0 if there is no complete mark (a last 'O' or 'T' is kept) */
+static int i2c_usart_find_sync(const uint8_t *buf, int len, uint8_t *mark) {
+	const uint8_t *end = buf + len;
+	const uint8_t *o = memchr(buf, 'O', len);
+	const uint8_t *t = memchr(buf, 'T', len);
+	*mark = 0;
+	while (o != NULL || t != NULL) {
+		const uint8_t *c = (o != NULL && (t == NULL || o < t)) ? o : t;
+		if (c + 1 >= end)
+			return c - buf;
+		if ((c[0] == 'O' && c[1] == 'K') || (c[0] == 'T' && c[1] == 'X')) {
+			*mark = c[0];
+			return c - buf;
+		}
+		if (c == o)
+			o = memchr(o + 1, 'O', end - o - 1);
+		else
+			t = memchr(t + 1, 'T', end - t - 1);
+	}
+	return len;
+}
+
+/* Process the complete frames and confirmations in buf, returns the number of
+ * bytes used. Incomplete frames are left in the buffer */
+static int i2c_usart_parse(uint8_t *buf, int len) {
+	int head = 0;
+	while (head < len) {
+		uint8_t mark;
+		head += i2c_usart_find_sync(buf + head, len - head, &mark);
+		if (mark == 0)
+			break;
+
+		int avail = len - head;
+		int need;
+		if (mark == 'T') {
+#if SCH_I2C_UART_WINDOW > 0
+			/* The confirmation carries the frame sequence number */
+			need = 3;
+			if (avail < need)
+				break;
+			csp_i2c_uart_ack(buf[head + 2]);
+#else
+			need = 2;
+			csp_i2c_uart_ack(-1);
+#endif
+			head += need;
+			continue;
+		}
+
+#if SCH_I2C_UART_WINDOW > 0
+		/* Header, then only the data bytes */
+		if (avail < I2C_UART_HEADER_LEN)
+			break;
+		uint16_t len_tx = ((i2c_uart_frame_t *)(buf + head))->len_tx;
+		if (len_tx > I2C_MTU) {
+			csp_log_error("%s: invalid frame length %d", __FUNCTION__, len_tx);
+			head += 2;
+			continue;
+		}
+		need = I2C_UART_HEADER_LEN + len_tx;
+#else
+		need = sizeof(i2c_uart_frame_t);
+#endif
+		if (avail < need)
+			break;
+		if (i2c_usart_callback) {
+			i2c_usart_callback(buf + head, need, NULL);
+		}
+		head += need;
+	}
+	return head;
+}
+
 static void *serial_rx_thread(void *vptr_args) {
-	uint8_t * cbuf = malloc(sizeof(i2c_uart_frame_t));
+	/* Room for a few frames, so one read() takes all the bytes received */
+	static uint8_t rx_buf[4 * sizeof(i2c_uart_frame_t)];
+	int rx_len = 0;
 
 	// Receive loop
 	while (1) {
-        /** printf("UART READING ...\n"); */
-        memset(cbuf, 0, sizeof(i2c_uart_frame_t));
-		int nbytes = 0;
-
-		/* SYNC */
-        read(fd, cbuf+1, 1); //putchar(cbuf[1]);
-        while(1)
-        {
-            if(cbuf[0] == 'O' && cbuf[1] == 'K')
-                goto new_frame;
-            if(cbuf[0] == 'T' && cbuf[1] == 'X')
-                goto sync_tx;
-            else
-            {
-                cbuf[0] = cbuf[1];
-                read(fd, cbuf+1, 1); //putchar(cbuf[1]);
-            }
-
-        }
-sync_tx:
-        /** printf("[I2C_UART] Releasing lock...\n"); */
-        csp_bin_sem_post(i2c_uart_ans_lock);
-        continue;
-
-new_frame:
-        nbytes += 2;
-        /* Read the rest of the packet */
-		while(nbytes < sizeof(i2c_uart_frame_t))
-        {
-		    nbytes += read(fd, cbuf+nbytes, sizeof(i2c_uart_frame_t)-2);
-        }
-		if (nbytes <= 0) {
-			csp_log_error("%s: read() failed, returned: %d", __FUNCTION__, nbytes);
+		/* Blocks until some bytes arrive (VMIN = 1), then takes all of them */
+		int rc = read(fd, rx_buf + rx_len, sizeof(rx_buf) - rx_len);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc <= 0) {
+			csp_log_error("%s: read() failed, errno: %s", __FUNCTION__, strerror(errno));
 			exit(1);
 		}
-		if (i2c_usart_callback) {
-			i2c_usart_callback(cbuf, nbytes, NULL);
-		}
-        continue;
+		rx_len += rc;
+
+		/* Keep only the incomplete frame at the end */
+		int used = i2c_usart_parse(rx_buf, rx_len);
+		rx_len -= used;
+		if (rx_len > 0 && used > 0)
+			memmove(rx_buf, rx_buf + used, rx_len);
 	}
 	return NULL;
 }
@@ -53,8 +53,6 @@ struct i2c_usart_conf {
     uint8_t paritysetting;
     //! Enable parity checking (Windows only).
     uint8_t checkparity;
-    //! Sync semaphore
-    csp_bin_sem_handle_t *uart_ans_lock;
 };
 
 /**
@@ -22,6 +22,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include <inttypes.h>
 #include <stdint.h>
 #include <assert.h>
+#include <pthread.h>
+#include <time.h>
 
 #include <csp/csp.h>
 #include <csp/csp_endian.h>
@@ -38,6 +40,101 @@ static int i2c_uart_lock_init = 0;
 static csp_bin_sem_handle_t i2c_uart_lock;
 static csp_bin_sem_handle_t i2c_uart_ans_lock;
 
+#if SCH_I2C_UART_WINDOW > 0
+/**
+ * A frame sent and waiting confirmation
+ */
+typedef struct i2c_uart_slot {
+    int busy;               ///< Waiting confirmation
+    uint8_t seq;            ///< Frame sequence number
+    uint32_t t_sent;        ///< Time sent (ms)
+} i2c_uart_slot_t;
+
+static i2c_uart_slot_t i2c_uart_window[SCH_I2C_UART_WINDOW];
+static uint8_t i2c_uart_seq = 0;
+static pthread_mutex_t i2c_uart_win_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t i2c_uart_win_cond;
+
+static uint32_t i2c_uart_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec*1000 + ts.tv_nsec/1000000);
+}
+
+/**
+ * Find a free slot in the window. Frames not confirmed in I2C_UART_TIMEOUT_MS
+ * are counted as errors and their slots released. Call with
+ * i2c_uart_win_mutex locked.
+ * @param now Current time (ms)
+ * @param wait_ms Time until the oldest frame expires, if no slot is free
+ * @return A free slot or NULL
+ */
+static i2c_uart_slot_t *i2c_uart_get_slot(uint32_t now, uint32_t *wait_ms)
+{
+    i2c_uart_slot_t *free_slot = NULL;
+    *wait_ms = I2C_UART_TIMEOUT_MS;
+    int i;
+    for(i = 0; i < SCH_I2C_UART_WINDOW; i++)
+    {
+        i2c_uart_slot_t *slot = &i2c_uart_window[i];
+        if(slot->busy && now - slot->t_sent >= I2C_UART_TIMEOUT_MS)
+        {
+            slot->busy = 0;
+            csp_if_i2c_uart.tx_error++;
+            csp_log_error("Frame %d not confirmed", slot->seq);
+        }
+        if(!slot->busy && free_slot == NULL)
+            free_slot = slot;
+        else if(slot->busy && I2C_UART_TIMEOUT_MS - (now - slot->t_sent) < *wait_ms)
+            *wait_ms = I2C_UART_TIMEOUT_MS - (now - slot->t_sent);
+    }
+    return free_slot;
+}
+
+/**
+ * Send a frame without waiting its confirmation, only the header and len_tx
+ * bytes. Blocks while SCH_I2C_UART_WINDOW frames wait confirmation.
+ * @param frame Frame to send, the sequence number is set here
+ * @return CSP_ERR_NONE or CSP_ERR_TIMEDOUT
+ */
+static int i2c_uart_tx_window(i2c_uart_frame_t *frame)
+{
+    uint32_t start = i2c_uart_now_ms();
+    uint32_t now = start, wait_ms;
+    i2c_uart_slot_t *slot;
+
+    pthread_mutex_lock(&i2c_uart_win_mutex);
+    while((slot = i2c_uart_get_slot(now, &wait_ms)) == NULL)
+    {
+        if(now - start >= I2C_UART_TIMEOUT_MS)
+        {
+            pthread_mutex_unlock(&i2c_uart_win_mutex);
+            return CSP_ERR_TIMEDOUT;
+        }
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec += wait_ms/1000;
+        ts.tv_nsec += (wait_ms%1000)*1000000L;
+        if(ts.tv_nsec >= 1000000000L)
+        {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&i2c_uart_win_cond, &i2c_uart_win_mutex, &ts);
+        now = i2c_uart_now_ms();
+    }
+    slot->busy = 1;
+    slot->seq = i2c_uart_seq++;
+    slot->t_sent = now;
+    frame->padding[0] = slot->seq;
+    pthread_mutex_unlock(&i2c_uart_win_mutex);
+
+    i2c_usart_putstr((char *)frame, I2C_UART_HEADER_LEN + frame->len_tx);
+    return CSP_ERR_NONE;
+}
+#endif
+
 /**
  * Receive a CSP packet and cast to a I2C_UART frame, ready to be transmitted
  * by UART to the I2C-UART controller.
@@ -64,10 +161,15 @@ int csp_i2c_uart_tx(csp_iface_t * interface, csp_packet_t * packet, uint32_t tim
     packet->id.ext = csp_hton32(packet->id.ext);
 
     /* Create a frame and copy data to sent */
-    /* Packet can be size variable, frame is fixed size (filled with zeros) */
+    /* Packet can be size variable, fixed size frames are filled with zeros */
     i2c_uart_frame_t frame;
+#if SCH_I2C_UART_WINDOW > 0
+    memcpy(&frame, packet, csp_padding_len+csp_data_len);
+    memset(frame.padding, 0, sizeof(frame.padding));
+#else
     memset(&frame, 0, sizeof(i2c_uart_frame_t));
     memcpy(&frame, packet, csp_padding_len+csp_data_len);
+#endif
 
     /* Fill extra frame data */
     frame.addr = i2c_addr;
@@ -84,18 +186,27 @@ int csp_i2c_uart_tx(csp_iface_t * interface, csp_packet_t * packet, uint32_t tim
     */
 
     /* enqueue the frame */
-    char *buff = (char *)&frame;
     /** DEBUG **
-    print_buff(buff, sizeof(i2c_uart_frame_t));
+    print_buff((char *)&frame, sizeof(i2c_uart_frame_t));
     print_buff((char *)frame->data, frame->len_tx);
     */
     int rc;
-    rc = csp_bin_sem_wait(&i2c_uart_lock, 2000);
+    rc = csp_bin_sem_wait(&i2c_uart_lock, I2C_UART_TIMEOUT_MS);
     if(rc != CSP_SEMAPHORE_OK)
         return CSP_ERR_DRIVER;
 
+#if SCH_I2C_UART_WINDOW > 0
+    // Transmit, the confirmation is handled by csp_i2c_uart_ack
+    rc = i2c_uart_tx_window(&frame);
+    csp_bin_sem_post(&i2c_uart_lock);
+    if(rc != CSP_ERR_NONE)
+    {
+        csp_log_error("Error sending packet %p, no free window slots", packet);
+        return CSP_ERR_DRIVER;
+    }
+#else
     // Transmmit
-    i2c_usart_putstr(buff, sizeof(i2c_uart_frame_t));
+    i2c_usart_putstr((char *)&frame, sizeof(i2c_uart_frame_t));
 
     // Wait confirmation
     /** printf("[I2C_UART] Waiting lock...\n");*/
@@ -109,12 +220,34 @@ int csp_i2c_uart_tx(csp_iface_t * interface, csp_packet_t * packet, uint32_t tim
         csp_log_error("Error sending packet %p (%d)", packet, rc);
         return CSP_ERR_DRIVER;
     }
+#endif
 
     // Free the packet if the transmission was successful
     csp_buffer_free(packet);
     return CSP_ERR_NONE;
 }
 
+void csp_i2c_uart_ack(int seq)
+{
+#if SCH_I2C_UART_WINDOW > 0
+    // Late confirmations, of frames already counted as errors, are ignored
+    pthread_mutex_lock(&i2c_uart_win_mutex);
+    int i;
+    for(i = 0; i < SCH_I2C_UART_WINDOW; i++)
+    {
+        if(i2c_uart_window[i].busy && i2c_uart_window[i].seq == (uint8_t)seq)
+        {
+            i2c_uart_window[i].busy = 0;
+            pthread_cond_signal(&i2c_uart_win_cond);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&i2c_uart_win_mutex);
+#else
+    csp_bin_sem_post(&i2c_uart_ans_lock);
+#endif
+}
+
 /**
  * When a frame is received, cast it to a csp_packet
  * and send it directly to the CSP new packet function.
@@ -145,7 +278,7 @@ void csp_i2c_uart_rx(uint8_t *buf, int len, void *pxTaskWoken) {
     print_buff(frame->data, frame->len_tx);
     */
 
-    if ((frame->len_tx < 4) || (frame->len_tx > I2C_MTU)) {
+    if ((frame->len_tx < 4) || (frame->len_tx > I2C_MTU) || (I2C_UART_HEADER_LEN + frame->len_tx > len)) {
         csp_if_i2c_uart.frame++;
         csp_buffer_free_isr(frame);
         return;
@@ -170,6 +303,14 @@ int csp_i2c_uart_init(uint8_t addr, int handle, int speed) {
         csp_bin_sem_create(&i2c_uart_lock);
         csp_bin_sem_create(&i2c_uart_ans_lock);
         csp_bin_sem_wait(&i2c_uart_ans_lock, CSP_INFINITY); // Just decrement the semaphore to star locked;
+#if SCH_I2C_UART_WINDOW > 0
+        // Timeouts use the monotonic clock, as i2c_uart_now_ms
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&i2c_uart_win_cond, &attr);
+        pthread_condattr_destroy(&attr);
+#endif
         i2c_uart_lock_init = 1;
     }
 
@@ -177,7 +318,6 @@ int csp_i2c_uart_init(uint8_t addr, int handle, int speed) {
     struct i2c_usart_conf conf;
     conf.baudrate = speed;
     conf.device = "/dev/serial0";
-    conf.uart_ans_lock = &i2c_uart_ans_lock;
     if(i2c_usart_init(&conf) != CSP_ERR_NONE)
     {
         printf("Error initializing USART\n");
@@ -15,11 +15,26 @@ extern csp_iface_t csp_if_i2c_uart;
  * Sync bytes
  */
 #define I2C_UART_SYNC (0x4F4B)
+/**
+ * Max. time waiting for a frame confirmation (ms)
+ */
+#define I2C_UART_TIMEOUT_MS (2000)
 
+/**
+ * UART frames exchanged with the I2C-UART bridge. With SCH_I2C_UART_WINDOW 0
+ * frames are sent with their full size (zero padded) and the bridge confirms
+ * each one with "TX" before the next one is sent.
+ *
+ * With SCH_I2C_UART_WINDOW > 0 only the header and len_tx bytes of data are
+ * sent in both directions (len is the number of bytes on the UART) and every
+ * frame sent carries a sequence number in padding[0]. The bridge confirms a
+ * frame with "TX" followed by its sequence number, and up to
+ * SCH_I2C_UART_WINDOW frames wait for confirmation at a time.
+ */
 typedef struct __attribute__((packed)) i2c_uart_frame_s {
     //! Not used by CSP - sync UART frames
     uint16_t sync;
-    //! Not used by CSP - padding
+    //! Not used by CSP - padding, padding[0] is the sequence number
     uint8_t padding[3];
     //! Not used by CSP - total bytes to send by UART
     uint16_t len;
@@ -31,6 +46,11 @@ typedef struct __attribute__((packed)) i2c_uart_frame_s {
     uint8_t data[I2C_MTU];
 } i2c_uart_frame_t;
 
+/**
+ * Frame header length, the bytes before data
+ */
+#define I2C_UART_HEADER_LEN (sizeof(i2c_uart_frame_t) - I2C_MTU)
+
 /**
  * Capture I2C RX events for CSP
  * @param opt_addr local i2c address
@@ -42,4 +62,10 @@ int csp_i2c_uart_init(uint8_t opt_addr, int handle, int speed);
 
 void csp_i2c_uart_rx(uint8_t *buf, int len, void *pxTaskWoken);
 
+/**
+ * Frame confirmation received from the bridge, called by the UART driver
+ * @param seq Sequence number of the frame, -1 with fixed size frames
+ */
+void csp_i2c_uart_ack(int seq);
+
 #endif //_CSP_IF_I2C_UART_H
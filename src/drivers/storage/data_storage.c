@@ -0,0 +1,790 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *      Copyright 2020, Camilo Rojas Milla, camrojas@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define LOG_TAG_ID LOG_TAG_DATA
+#include "storage_backend.h"
+#include "osSemphr.h"
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+static const char *tag = "data_storage";
+
+#if SCH_STORAGE_MODE == 0
+    #define STORAGE_BACKEND storage_backend_ram
+#elif SCH_STORAGE_MODE == 1
+    #define STORAGE_BACKEND storage_backend_sqlite
+#elif SCH_STORAGE_MODE == 2
+    #define STORAGE_BACKEND storage_backend_postgres
+#elif SCH_STORAGE_MODE == 3
+    #define STORAGE_BACKEND storage_backend_mmap
+#else
+    #error "Unknown SCH_STORAGE_MODE"
+#endif
+
+static const storage_backend_t *const storage = &STORAGE_BACKEND;
+
+#define STORAGE_NODE_TABLES     (64)    ///< Max. payload tables of other nodes
+
+/* Payload tables of other nodes (<payload table>_<node>), used by the ground
+ * station to keep the samples received from each satellite apart. Each table
+ * has its own index, kept here once the table is created. */
+typedef struct storage_node_table {
+    int node;                               ///< Source node
+    int payload;                            ///< Payload id
+    int next;                               ///< Index of the next sample
+} storage_node_table_t;
+
+static storage_node_table_t node_tables[STORAGE_NODE_TABLES];
+static int node_tables_len = 0;
+static osSemaphore node_tables_sem;         ///< Node tables list and their indexes
+static int node_tables_sem_ok = 0;
+
+static uint32_t payload_crc_errors = 0;     ///< Payload samples that failed the CRC check, @see storage_record_check
+
+static int storage_unsupported(const char *op)
+{
+    LOGE(tag, "%s is not supported by the %s storage", op, storage->name);
+    return -1;
+}
+
+static int storage_payload_valid(int payload)
+{
+    if(payload < 0 || payload >= last_sensor)
+    {
+        LOGE(tag, "Payload id: %d out of range, maximum id: %d", payload, last_sensor-1);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Begin a transaction, so consecutive writes are committed together.
+ * Returns 0 OK, -1 Error.
+ */
+static int storage_transaction_begin(void)
+{
+    return storage->begin != NULL ? storage->begin() : 0;
+}
+
+/**
+ * Commit (@commit = 1) or roll back (@commit = 0) the current transaction.
+ * Returns 0 OK, -1 Error.
+ */
+static int storage_transaction_end(int commit)
+{
+    return storage->end != NULL ? storage->end(commit) : 0;
+}
+
+int storage_init(const char *file)
+{
+    // Tables of other nodes are looked up again in the new database
+    if(!node_tables_sem_ok)
+        node_tables_sem_ok = osSemaphoreCreate(&node_tables_sem) == OS_SEMAPHORE_OK;
+    node_tables_len = 0;
+
+    LOGD(tag, "Using the %s storage", storage->name);
+    return storage->init(file);
+}
+
+int storage_table_repo_init(char* table, int drop)
+{
+    if(storage->repo_init == NULL)
+        return storage_unsupported(__func__);
+    return storage->repo_init(table, drop);
+}
+
+int storage_table_flight_plan_init(int drop, int * entries)
+{
+    // Without a flight plan table there is nothing to create, the RAM
+    // storage flight plan is kept by repoData
+    if(storage->fp_init == NULL)
+        return 0;
+    return storage->fp_init(drop, entries);
+}
+
+int storage_table_payload_init(int drop)
+{
+    return storage->payload_init(drop);
+}
+
+int storage_repo_get_value_idx(int index, char *table)
+{
+    if(storage->repo_get_value == NULL)
+        return storage_unsupported(__func__);
+    return storage->repo_get_value(index, table);
+}
+
+int storage_repo_get_values_idx(int index, int n, int *values, char *table)
+{
+    int i;
+    for(i=0; i<n; i++)
+        values[i] = -1;
+    if(n <= 0)
+        return 0;
+    if(storage->repo_get_values == NULL)
+        return storage_unsupported(__func__);
+    return storage->repo_get_values(index, n, values, table);
+}
+
+int storage_repo_set_values_idx(int index, int n, const int *values, char *table)
+{
+    if(n <= 0)
+        return n == 0 ? 0 : -1;
+    if(storage->repo_set_values != NULL)
+        return storage->repo_set_values(index, n, values, table);
+    if(storage->repo_set_value == NULL)
+        return storage_unsupported(__func__);
+
+    int i, rc = 0;
+    if(storage_transaction_begin() != 0)
+        return -1;
+
+    for(i=0; i < n && rc == 0; i++)
+        rc = storage->repo_set_value(index + i, values[i], table);
+
+    if(storage_transaction_end(rc == 0) != 0)
+        rc = -1;
+    return rc;
+}
+
+int storage_repo_get_copies_idx(int index, int n, int *values, char *table)
+{
+    if(n <= 0)
+        return n == 0 ? 0 : -1;
+    if(storage->repo_get_copies != NULL)
+    {
+        int i;
+        for(i=0; i<n*3; i++)
+            values[i] = -1;
+        return storage->repo_get_copies(index, n, values, table);
+    }
+
+    // Each copy is stored dat_status_last_address values after the previous
+    int rc = storage_repo_get_values_idx(index, n, values, table);
+    int rc2 = storage_repo_get_values_idx(index + dat_status_last_address, n, values + n, table);
+    int rc3 = storage_repo_get_values_idx(index + dat_status_last_address*2, n, values + n*2, table);
+    return rc & rc2 & rc3;
+}
+
+int storage_repo_set_copies_idx(int index, int n, const int *values, char *table)
+{
+    if(n <= 0)
+        return n == 0 ? 0 : -1;
+    if(storage->repo_set_copies != NULL)
+        return storage->repo_set_copies(index, n, values, table);
+
+    // Each copy is stored dat_status_last_address values after the previous
+    int rc = storage_repo_set_values_idx(index, n, values, table);
+    int rc2 = storage_repo_set_values_idx(index + dat_status_last_address, n, values, table);
+    int rc3 = storage_repo_set_values_idx(index + dat_status_last_address*2, n, values, table);
+    return rc & rc2 & rc3;
+}
+
+int storage_repo_get_value_str(char *name, char *table)
+{
+    // Resolve the name with the status variables index, then get the value
+    // by index
+    dat_sys_var_t var = dat_get_status_var_def_name(name);
+    if(var.status == -1)
+        return -1;
+    return storage_repo_get_value_idx(var.address, table);
+}
+
+int storage_repo_set_value_idx(int index, int value, char *table)
+{
+    if(storage->repo_set_value == NULL)
+        return storage_unsupported(__func__);
+    return storage->repo_set_value(index, value, table);
+}
+
+int storage_flight_plan_set(int timetodo, char* command, char* args, int executions, int periodical, int ms, int * entries)
+{
+    if(storage->fp_set == NULL)
+        return storage_unsupported(__func__);
+    return storage->fp_set(timetodo, command, args, executions, periodical, ms, entries);
+}
+
+int storage_flight_plan_set_batch(fp_entry_t *fp, int n, int * entries)
+{
+    if(storage->fp_set_batch != NULL)
+        return storage->fp_set_batch(fp, n, entries);
+
+    int i, rc = 0;
+    if(storage_transaction_begin() != 0)
+        return -1;
+
+    for(i=0; i < n && rc == 0; i++)
+        rc = storage_flight_plan_set(fp[i].unixtime, fp[i].cmd, fp[i].args, fp[i].executions, fp[i].periodical, fp[i].ms, entries);
+
+    if(storage_transaction_end(rc == 0) != 0)
+        rc = -1;
+    return rc;
+}
+
+int storage_flight_plan_get(int timetodo, char* command, char* args, int* executions, int* periodical, int* ms, int * entries)
+{
+    if(storage->fp_get == NULL)
+        return storage_unsupported(__func__);
+    if(storage->fp_get(timetodo, command, args, executions, periodical, ms) != 0)
+        return -1;
+
+    // Periodic entries are moved to the next execution, in place
+    if(*periodical > 0 && *executions > 1)
+        return storage_flight_plan_update(timetodo, timetodo+*periodical, *executions-1, entries);
+    return storage_flight_plan_erase(timetodo, entries);
+}
+
+int storage_flight_plan_peek(int timetodo, fp_entry_t *fp, int entries)
+{
+    if(storage->fp_get == NULL)
+        return storage_unsupported(__func__);
+    fp->unixtime = timetodo;
+    return storage->fp_get(timetodo, fp->cmd, fp->args, &fp->executions, &fp->periodical, &fp->ms);
+}
+
+int storage_flight_plan_update(int timetodo, int new_time, int executions, int * entries)
+{
+    if(storage->fp_update == NULL)
+        return storage_unsupported(__func__);
+    return storage->fp_update(timetodo, new_time, executions, entries);
+}
+
+int storage_flight_plan_next(int entries)
+{
+    if(storage->fp_next == NULL)
+        return -1;
+    return storage->fp_next();
+}
+
+int storage_flight_plan_foreach(int from, int to, fp_visit_t visit, void *arg, int entries)
+{
+    if(storage->fp_foreach == NULL)
+        return storage_unsupported(__func__);
+    return storage->fp_foreach(from < 0 ? 0 : from, to < 0 ? INT_MAX : to, visit, arg);
+}
+
+int storage_flight_plan_sorted(void)
+{
+    return storage->fp_sorted;
+}
+
+int storage_flight_plan_erase(int timetodo, int * entries)
+{
+    if(storage->fp_erase == NULL)
+        return storage_unsupported(__func__);
+    return storage->fp_erase(timetodo, entries);
+}
+
+int storage_flight_plan_reset(int * entries)
+{
+    return storage_table_flight_plan_init(1, entries);
+}
+
+static int storage_fp_print(const fp_entry_t *entry, void *arg)
+{
+    int *n = (int *)arg;
+    if((*n)++ == 0)
+    {
+        LOGI(tag, "Flight plan table");
+        printf("When\tCommand\tArguments\tExecutions\tPeriodical\n");
+    }
+    time_t timef = entry->unixtime;
+    printf("%s\t%s\t%s\t%d\t%d\n", strtok(ctime(&timef), "\n"), entry->cmd, entry->args, entry->executions, entry->periodical);
+    return 0;
+}
+
+int storage_flight_plan_show_table(int entries)
+{
+    int n = 0;
+    if(storage_flight_plan_foreach(-1, -1, storage_fp_print, &n, entries) < 0)
+        return -1;
+    if(n == 0)
+        LOGI(tag, "Flight plan table empty");
+    return 0;
+}
+
+int storage_set_payload_data(int index, void* data, int payload)
+{
+    if(!storage_payload_valid(payload))
+        return -1;
+    return storage->payload_set(index, data, payload, 1);
+}
+
+int storage_set_payload_data_batch(int index, void* data, int payload, int n)
+{
+    if(!storage_payload_valid(payload))
+        return -1;
+    if(n <= 0)
+        return 0;
+    return storage->payload_set(index, data, payload, n);
+}
+
+/**
+ * Find the table of the samples of a node, created the first time it is used,
+ * and reserve @n indexes, so writers of different nodes do not wait each other
+ * @param table Returns the table name
+ * @return First index reserved (the next index if @n is 0), -1 on error
+ */
+static int storage_node_table_reserve(int node, int payload, int n, char *table, size_t len)
+{
+    if(storage->node_table_init == NULL)
+    {
+        LOGE(tag, "Payload %d of node %d not available, node tables require a database", payload, node);
+        return -1;
+    }
+    if(!node_tables_sem_ok)
+        return -1;
+
+    snprintf(table, len, "%s_%d", data_map[payload].table, node);
+    int i, index = -1;
+    osSemaphoreTake(&node_tables_sem, portMAX_DELAY);
+    storage_node_table_t *node_table = NULL;
+    for(i=0; i < node_tables_len && node_table == NULL; i++)
+        if(node_tables[i].node == node && node_tables[i].payload == payload)
+            node_table = &node_tables[i];
+
+    if(node_table == NULL)
+    {
+        // The table is created the first time it is used, the next index
+        // continues after the samples already stored
+        int next = -1;
+        if(node_tables_len >= STORAGE_NODE_TABLES)
+        {
+            LOGE(tag, "Too many node tables, payload %d of node %d not available", payload, node);
+        }
+        else
+            next = storage->node_table_init(table, payload);
+        if(next >= 0)
+        {
+            LOGI(tag, "Payload %d of node %d stored in table %s from index %d", payload, node, table, next);
+            node_table = &node_tables[node_tables_len++];
+            node_table->node = node;
+            node_table->payload = payload;
+            node_table->next = next;
+        }
+    }
+    if(node_table != NULL)
+    {
+        index = node_table->next;
+        node_table->next += n;
+    }
+    osSemaphoreGiven(&node_tables_sem);
+    return index;
+}
+
+int storage_set_payload_data_node(int node, void* data, int payload, int n)
+{
+    if(!storage_payload_valid(payload) || n <= 0)
+        return -1;
+
+    char table[STORAGE_TABLE_NAME_LEN*2];
+    int index = storage_node_table_reserve(node, payload, n, table, sizeof(table));
+    if(index < 0)
+        return -1;
+
+    return storage->node_table_set(table, index, data, payload, n) == 0 ? index : -1;
+}
+
+int storage_get_payload_next_node(int node, int payload)
+{
+    if(!storage_payload_valid(payload))
+        return -1;
+
+    char table[STORAGE_TABLE_NAME_LEN*2];
+    return storage_node_table_reserve(node, payload, 0, table, sizeof(table));
+}
+
+int storage_get_payload_data_node(int node, int index, int count, void* data, int payload)
+{
+    if(!storage_payload_valid(payload) || index < 0 || count <= 0)
+        return -1;
+
+    char table[STORAGE_TABLE_NAME_LEN*2];
+    if(storage_node_table_reserve(node, payload, 0, table, sizeof(table)) < 0 || storage->node_table_get == NULL)
+        return -1;
+    return storage->node_table_get(table, index, count, data, payload);
+}
+
+int storage_get_payload_data(int index, void* data, int payload)
+{
+    int rc = storage_get_payload_data_range(index, 1, data, payload);
+    if(rc < 0)
+        return -1;
+    if(rc == 0)
+        LOGE(tag, "Payload %d index %d not found", payload, index);
+    return 0;
+}
+
+int storage_get_payload_data_range(int index, int count, void* data, int payload)
+{
+    if(!storage_payload_valid(payload))
+        return -1;
+    if(count <= 0)
+        return 0;
+    return storage->payload_get_range(index, count, data, payload);
+}
+
+uint32_t storage_payload_crc_errors(int reset)
+{
+    if(reset)
+        return __atomic_exchange_n(&payload_crc_errors, 0, __ATOMIC_RELAXED);
+    return __atomic_load_n(&payload_crc_errors, __ATOMIC_RELAXED);
+}
+
+int storage_get_payload_index_time(uint32_t timestamp, int payload, int next)
+{
+    if(!storage_payload_valid(payload))
+        return -1;
+    const dat_payload_field_t *field = storage_payload_time_field(payload);
+    if(field == NULL)
+    {
+        LOGE(tag, "Payload %d samples have no %s", payload, STORAGE_TIME_FIELD);
+        return -1;
+    }
+    if(next <= 0)
+        return 0;
+    if(storage->payload_find_time != NULL)
+        return storage->payload_find_time(timestamp, payload, next);
+
+    // Binary search, one sample read per step, over the samples still kept
+    char sample[data_map[payload].size];
+    int low = storage->payload_first != NULL ? storage->payload_first(payload, next) : 0;
+    int high = next;
+    if(low < 0)
+        return -1;
+    while(low < high)
+    {
+        int mid = low + (high - low)/2;
+        if(storage->payload_get_range(mid, 1, sample, payload) != 1)
+            return -1;
+        if(storage_field_int(field, sample) < (int64_t)timestamp)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+int storage_trim_payload_data(int payload, int end, int max)
+{
+    if(!storage_payload_valid(payload))
+        return -1;
+    if(end <= 0 || max <= 0 || storage->payload_trim == NULL)
+        return 0;
+    return storage->payload_trim(payload, end, max);
+}
+
+int storage_delete_memory_sections(void)
+{
+    return storage_table_payload_init(1);
+}
+
+int storage_sync(void)
+{
+    return storage->sync != NULL ? storage->sync() : 0;
+}
+
+int storage_read_concurrent(void)
+{
+    return storage->read_concurrent != NULL ? storage->read_concurrent() : 0;
+}
+
+int storage_repo_seal(void)
+{
+    return 0;
+}
+
+int storage_close(void)
+{
+    return storage->close();
+}
+
+int storage_snapshot_write(const char *file, const void *data, int len)
+{
+    // The snapshot is replaced with a new file and rename, so a reset while
+    // writing keeps the previous one
+    char tmp_file[PATH_MAX];
+    snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", file);
+    int fd = open(tmp_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        LOGE(tag, "Unable to create snapshot %s. Error: %s", tmp_file, strerror(errno));
+        return -1;
+    }
+    if(write(fd, data, (size_t)len) != len || fsync(fd) != 0 || rename(tmp_file, file) != 0)
+    {
+        LOGE(tag, "Unable to write snapshot %s. Error: %s", file, strerror(errno));
+        close(fd);
+        unlink(tmp_file);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+int storage_snapshot_read(const char *file, void *data, int len)
+{
+    int fd = open(file, O_RDONLY);
+    if(fd < 0)
+        return -1;
+    ssize_t rc = read(fd, data, (size_t)len);
+    close(fd);
+    return rc < 0 ? -1 : (int)rc;
+}
+
+/*
+ * Helpers shared by the backends
+ */
+
+int64_t storage_field_int(const dat_payload_field_t *field, const char *sample)
+{
+    const char *ptr = sample + field->offset;
+    int64_t val = 0;
+    if(field->type == DAT_FIELD_UINT)
+    {
+        uint64_t u = 0;
+        switch(field->size)
+        {
+            case 1: u = *((uint8_t *)ptr); break;
+            case 2: { uint16_t v; memcpy(&v, ptr, sizeof(v)); u = v; break; }
+            case 4: { uint32_t v; memcpy(&v, ptr, sizeof(v)); u = v; break; }
+            case 8: memcpy(&u, ptr, sizeof(u)); break;
+        }
+        val = (int64_t)u;
+    }
+    else
+    {
+        switch(field->size)
+        {
+            case 1: val = *((int8_t *)ptr); break;
+            case 2: { int16_t v; memcpy(&v, ptr, sizeof(v)); val = v; break; }
+            case 4: { int32_t v; memcpy(&v, ptr, sizeof(v)); val = v; break; }
+            case 8: memcpy(&val, ptr, sizeof(val)); break;
+        }
+    }
+    return val;
+}
+
+void storage_field_set_int(const dat_payload_field_t *field, char *sample, int64_t val)
+{
+    char *ptr = sample + field->offset;
+    switch(field->size)
+    {
+        case 1: { int8_t v = (int8_t)val; memcpy(ptr, &v, sizeof(v)); break; }
+        case 2: { int16_t v = (int16_t)val; memcpy(ptr, &v, sizeof(v)); break; }
+        case 4: { int32_t v = (int32_t)val; memcpy(ptr, &v, sizeof(v)); break; }
+        case 8: memcpy(ptr, &val, sizeof(val)); break;
+    }
+}
+
+int storage_field_is_null(const dat_payload_field_t *field, const char *sample)
+{
+    int32_t bits;
+    if(field->type != DAT_FIELD_FLOAT)
+        return 0;
+    memcpy(&bits, sample + field->offset, sizeof(bits));
+    return bits == -1;
+}
+
+uint32_t storage_record_crc(const void *sample, int size)
+{
+    uint32_t crc = crc32c_update(0, sample, (size_t)size);
+    return crc != 0 ? crc : 0xFFFFFFFF;
+}
+
+int storage_record_check(int payload, int index, void *sample, int size, uint32_t crc)
+{
+    if(crc == 0 || storage_record_crc(sample, size) == crc)
+        return 0;
+    LOGW(tag, "Payload %d index %d failed the CRC check, discarded", payload, index);
+    memset(sample, 0, (size_t)size);
+    __atomic_add_fetch(&payload_crc_errors, 1, __ATOMIC_RELAXED);
+    return -1;
+}
+
+const dat_payload_field_t *storage_payload_time_field(int payload)
+{
+    const dat_payload_schema_t *schema = dat_get_payload_schema(payload);
+    int j;
+    for(j=0; j < schema->nfields; ++j)
+    {
+        if(strcmp(schema->fields[j].name, STORAGE_TIME_FIELD) == 0)
+            return &schema->fields[j];
+    }
+    return NULL;
+}
+
+/**
+ * Translate to sql format a payload field type
+ */
+static const char *storage_sql_type(const dat_payload_field_t *field, const char *float_type)
+{
+    switch(field->type)
+    {
+        case DAT_FIELD_FLOAT:
+            return float_type;
+        case DAT_FIELD_DOUBLE:
+            return "DOUBLE PRECISION";
+        case DAT_FIELD_INT:
+            return field->size > 4 ? "BIGINT" : "INTEGER";
+        case DAT_FIELD_UINT:
+            return field->size >= 4 ? "BIGINT" : "INTEGER";
+        default:
+            return "TEXT";
+    }
+}
+
+int storage_sql_payload_create(int payload, const char *table, const char *float_type, char *sql, size_t len)
+{
+    const dat_payload_schema_t *schema = dat_get_payload_schema(payload);
+    int j, n = snprintf(sql, len, "CREATE TABLE IF NOT EXISTS %s(id INTEGER, tstz TIMESTAMPTZ,", table);
+    for(j=0; j < schema->nfields && n < len; ++j)
+    {
+        const dat_payload_field_t *field = &schema->fields[j];
+        n += snprintf(sql+n, len-n, "%s %s%s", field->name, storage_sql_type(field, float_type),
+                      j != schema->nfields-1 ? "," : "");
+    }
+    if(n < len)
+        n += snprintf(sql+n, len-n, ")");
+    if(n >= len)
+    {
+        LOGE(tag, "Failed to create table %s. Too many fields", table);
+        return -1;
+    }
+    return 0;
+}
+
+int storage_sql_payload_insert(int payload, const char *table, const char *param, char *sql, size_t len)
+{
+    char values[SCH_BUFF_MAX_LEN*2];
+    int n = snprintf(sql, len, "INSERT INTO %s (id, tstz", table);
+    int n_values = snprintf(values, sizeof(values), "VALUES (");
+    n_values += snprintf(values+n_values, sizeof(values)-n_values, param, 1);
+    n_values += snprintf(values+n_values, sizeof(values)-n_values, ", current_timestamp");
+    const dat_payload_schema_t *schema = dat_get_payload_schema(payload);
+    int j;
+    for(j=0; j < schema->nfields; ++j)
+    {
+        n += snprintf(sql+n, len-n, ", %s", schema->fields[j].name);
+        if(n_values < sizeof(values))
+            n_values += snprintf(values+n_values, sizeof(values)-n_values, ", ");
+        if(n_values < sizeof(values))
+            n_values += snprintf(values+n_values, sizeof(values)-n_values, param, j+2);
+        if(n >= len || n_values >= sizeof(values))
+        {
+            LOGE(tag, "Failed to prepare insert for table %s. Too many fields", table);
+            return -1;
+        }
+    }
+    if(snprintf(sql+n, len-n, ") %s)", values) >= len-n)
+    {
+        LOGE(tag, "Failed to prepare insert for table %s. Too many fields", table);
+        return -1;
+    }
+    return 0;
+}
+
+int storage_sql_payload_select(int payload, const char *table, const char *param, char *sql, size_t len)
+{
+    const dat_payload_schema_t *schema = dat_get_payload_schema(payload);
+    int j, n = snprintf(sql, len, "SELECT id");
+    for(j=0; j < schema->nfields && n < len; ++j)
+        n += snprintf(sql+n, len-n, ", %s", schema->fields[j].name);
+    if(n < len)
+        n += snprintf(sql+n, len-n, " FROM %s WHERE id BETWEEN ", table);
+    if(n < len)
+        n += snprintf(sql+n, len-n, param, 1);
+    if(n < len)
+        n += snprintf(sql+n, len-n, " AND ");
+    if(n < len)
+        n += snprintf(sql+n, len-n, param, 2);
+    if(n < len)
+        n += snprintf(sql+n, len-n, " ORDER BY id");
+    if(n >= len)
+    {
+        LOGE(tag, "Failed to prepare select for table %s. Too many fields", table);
+        return -1;
+    }
+    return 0;
+}
+
+int storage_sql_payload_time_index(const char *table, char *sql, size_t len)
+{
+    // Also indexed by id, the first sample of a time is read from the index
+    if(snprintf(sql, len, "CREATE INDEX IF NOT EXISTS %s_%s ON %s(%s, id)",
+                table, STORAGE_TIME_FIELD, table, STORAGE_TIME_FIELD) >= len)
+    {
+        LOGE(tag, "Failed to create time index for table %s", table);
+        return -1;
+    }
+    return 0;
+}
+
+int storage_sql_payload_time(const char *table, const char *param, char *sql, size_t len)
+{
+    int n = snprintf(sql, len, "SELECT id FROM %s WHERE %s >= ", table, STORAGE_TIME_FIELD);
+    if(n < len)
+        n += snprintf(sql+n, len-n, param, 1);
+    if(n < len)
+        n += snprintf(sql+n, len-n, " AND id < ");
+    if(n < len)
+        n += snprintf(sql+n, len-n, param, 2);
+    if(n < len)
+        n += snprintf(sql+n, len-n, " ORDER BY %s, id LIMIT 1", STORAGE_TIME_FIELD);
+    if(n >= len)
+    {
+        LOGE(tag, "Failed to prepare time select for table %s", table);
+        return -1;
+    }
+    return 0;
+}
+
+int storage_sql_payload_id_index(const char *table, char *sql, size_t len)
+{
+    if(snprintf(sql, len, "CREATE INDEX IF NOT EXISTS %s_id ON %s(id)", table, table) >= len)
+    {
+        LOGE(tag, "Failed to create id index for table %s", table);
+        return -1;
+    }
+    return 0;
+}
+
+int storage_sql_payload_trim(const char *table, const char *param, char *sql, size_t len)
+{
+    // The subquery limits the rows deleted by each command
+    int n = snprintf(sql, len, "DELETE FROM %s WHERE id IN (SELECT id FROM %s WHERE id < ", table, table);
+    if(n < len)
+        n += snprintf(sql+n, len-n, param, 1);
+    if(n < len)
+        n += snprintf(sql+n, len-n, " ORDER BY id LIMIT ");
+    if(n < len)
+        n += snprintf(sql+n, len-n, param, 2);
+    if(n < len)
+        n += snprintf(sql+n, len-n, ")");
+    if(n >= len)
+    {
+        LOGE(tag, "Failed to prepare delete for table %s", table);
+        return -1;
+    }
+    return 0;
+}
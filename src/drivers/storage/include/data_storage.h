@@ -0,0 +1,579 @@
+/**
+ * @file data_storage.h
+ * @author Carlos Gonzalez C - carlgonz@uchile.cl
+ * @author Camilo Rojas M - camrojas@uchile.cl
+ * @date 2020
+ * @copyright GNU GPL v3
+ *
+ * Persistent data storage functions, shared by the Linux targets (X86, RPI and
+ * GROUNDSTATION). The functions check the parameters and call the backend
+ * selected with SCH_STORAGE_MODE (see storage_backend.h): RAM (0), SQLite (1),
+ * Postgres (2) or memory mapped files (3).
+ */
+
+#ifndef SCH_PERSISTENT_H
+#define SCH_PERSISTENT_H
+
+#include "log_utils.h"
+#include "crc_utils.h"
+#include <stdio.h>
+#include "config.h"
+#include "repoDataSchema.h"
+#include "repoData.h"
+
+/**
+ * Init data storage system.
+ * In this case we use SQLite, so this function open a database in file. With
+ * memory mapped files (SCH_STORAGE_MODE 3) file is the prefix of the files.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param file Str. File path to SQLite database
+ * @return 0 OK, -1 Error
+ */
+int storage_init(const char *file);
+
+/**
+ * Create new table in the opened database (@relatesalso storage_init) in the
+ * form (index, name, value). If the table exists do nothing. If drop is set to
+ * 1 then drop an existing table and then creates an empty one.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param table Str. Table name
+ * @param drop Int. Set to 1 to drop the existing table before create one
+ * @return 0 OK, -1 Error
+ */
+int storage_table_repo_init(char *table, int drop);
+
+/**
+ * Create new table in the opened database (@relatesalso storage_init) in the
+ * form (time, command, args, repeat). If the table exists do nothing. If drop is set to
+ * 1 then drop an existing table and then creates an empty one.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param drop Int. Set to 1 to drop the existing table before create one
+ * @return 0 OK, -1 Error
+ */
+int storage_table_flight_plan_init(int drop, int * entries);
+
+/**
+ * Create new table in the opened database (@relatesalso storage_init)
+ * for a payload. If the table exists do nothing. If drop is set to
+ * 1 then drop an existing table and then creates an empty one.
+ *
+ * @note: NOT IMPLEMENTED
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param drop Int. Set to 1 to drop the existing table before create one
+ * @return 0 OK, -1 Error
+ */
+int storage_table_payload_init(int drop);
+
+/**
+ * Get an INT (integer) value from table by index
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param index Int. Value index
+ * @param table Str. Table name
+ * @return 0 OK, -1 Error
+ */
+int storage_repo_get_value_idx(int index, char *table);
+
+/**
+ * Get a INT (integer) value from table by name
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param name Str. Value name
+ * @param table Str. Table name
+ * @return 0 OK, -1 Error
+ */
+int storage_repo_get_value_str(char *name, char *table);
+
+/**
+ * Set or update the value of a INT (integer) variable by index.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param index Int. Variable index
+ * @param value Int. Value to set
+ * @param table Str. Table name
+ * @return 0 OK, -1 Error
+ */
+int storage_repo_set_value_idx(int index, int value, char *table);
+
+/**
+ * Get @n consecutive INT (integer) values from table, starting at index,
+ * with one query. Values not found are set to -1.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param index Int. Index of the first value
+ * @param n Int. Number of values to get
+ * @param values Pointer to an array of at least @n integers
+ * @param table Str. Table name
+ * @return 0 OK, -1 Error or some value not found
+ */
+int storage_repo_get_values_idx(int index, int n, int *values, char *table);
+
+/**
+ * Set or update @n consecutive INT (integer) values, starting at index,
+ * inside one transaction.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param index Int. Index of the first variable
+ * @param n Int. Number of values to set
+ * @param values Pointer to an array of @n integers
+ * @param table Str. Table name
+ * @return 0 OK, -1 Error
+ */
+int storage_repo_set_values_idx(int index, int n, const int *values, char *table);
+
+/**
+ * Get @n consecutive status variables, starting at index, with the copies of
+ * tripled writing (SCH_STORAGE_TRIPLE_WR). The copy c of the variable
+ * index + i is returned in values[c*n + i], to be voted by the caller.
+ * The copy c is also accessed by index + c*dat_status_last_address.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param index Int. Index of the first variable
+ * @param n Int. Number of variables to get
+ * @param values Pointer to an array of at least @n*3 integers
+ * @param table Str. Table name
+ * @return 0 OK, -1 Error or some value not found
+ */
+int storage_repo_get_copies_idx(int index, int n, int *values, char *table);
+
+/**
+ * Set or update @n consecutive status variables, starting at index, and
+ * their copies of tripled writing (SCH_STORAGE_TRIPLE_WR). The SQLite storage
+ * keeps the three copies in one row, so they are set with one statement.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param index Int. Index of the first variable
+ * @param n Int. Number of values to set
+ * @param values Pointer to an array of @n integers
+ * @param table Str. Table name
+ * @return 0 OK, -1 Error
+ */
+int storage_repo_set_copies_idx(int index, int n, const int *values, char *table);
+
+/**
+ * Add a row at a certain time. Several rows can have the same time, they are
+ * executed in upload order.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param timetodo Int. time to do the action
+ * @param command Str. Command to set
+ * @param args Str. command's arguments
+ * @param repeat Int. Value of time to run the command
+ * @param ms Int. Milliseconds after timetodo
+ * @return 0 OK, -1 Error
+ */
+int storage_flight_plan_set(int timetodo, char* command, char* args, int repeat, int periodical, int ms, int *entries);
+
+/**
+ * Add @n flight plan entries. With SQL storage the entries are
+ * inserted in one transaction, so all of them or none are stored. Other
+ * storages check there is space for all the entries first.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param fp Pointer to an array of @n entries
+ * @param n Int. Number of entries
+ * @param entries Int. Number of entries in the flight plan
+ * @return 0 OK, -1 Error
+ */
+int storage_flight_plan_set_batch(fp_entry_t *fp, int n, int * entries);
+
+/**
+ * Get the first row of a certain time and set the values in the variables
+ * committed. The entry is removed, unless it is periodical and has more than
+ * one execution left, then it is moved to timetodo + periodical in place
+ * (@relatesalso storage_flight_plan_update).
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param timetodo Int. time to do the action
+ * @param command Str. Command to get
+ * @param args Str. command's arguments
+ * @param repeat Int. Value of times to run the command
+ * @param ms Int. Milliseconds after timetodo
+ * @return 0 OK, -1 Error
+ */
+int storage_flight_plan_get(int timetodo, char* command, char* args, int* repeat, int* periodical, int* ms, int * entries);
+
+/**
+ * Get the first row of a certain time (lowest ms, then upload order) without
+ * removing it.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param timetodo Int. time of the entry
+ * @param fp Returns the entry
+ * @param entries Int. Number of entries in the flight plan
+ * @return 0 OK, -1 not found or Error
+ */
+int storage_flight_plan_peek(int timetodo, fp_entry_t *fp, int entries);
+
+/**
+ * Erase the first row in the table in the opened database (@relatesalso
+ * storage_init) that has the same timetodo.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param timetodo Int. time to do the action
+ * @return 0 OK, -1 Error
+ */
+int storage_flight_plan_erase(int timetodo, int * entries);
+
+/**
+ * Get the execution time of the earliest entry in the flight plan.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param entries Int. Number of entries in the flight plan
+ * @return Time of the earliest entry, -1 if the flight plan is empty or Error
+ */
+int storage_flight_plan_next(int entries);
+
+/**
+ * Visit the entries scheduled from time @from up to time @to, one at a time,
+ * without copying the table to memory. SQL storages visit the entries sorted
+ * by time, other storages in storage order (@see storage_flight_plan_sorted).
+ *
+ * @note: non-reentrant function, use mutex to sync access. @visit must not
+ * modify the flight plan.
+ *
+ * @param from Int. Min. time of the visited entries, -1 to visit all
+ * @param to Int. Max. time of the visited entries, -1 to visit all
+ * @param visit Function called for each entry, returns non zero to stop
+ * @param arg Pointer passed to @visit
+ * @param entries Int. Number of entries in the flight plan
+ * @return Number of visited entries, -1 Error
+ */
+int storage_flight_plan_foreach(int from, int to, fp_visit_t visit, void *arg, int entries);
+
+/**
+ * Check if storage_flight_plan_foreach visits the entries sorted by time,
+ * and entries with the same time in execution order.
+ *
+ * @return 1 if sorted, 0 if visited in storage order
+ */
+int storage_flight_plan_sorted(void);
+
+/**
+ * Move the first entry at timetodo to new_time, after the entries already at
+ * new_time, with executions remaining executions. Used to advance periodic
+ * entries without deleting and inserting them again.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param timetodo Int. Current time of the entry
+ * @param new_time Int. New time of the entry
+ * @param executions Int. Remaining executions
+ * @param entries Int. Number of entries in the flight plan
+ * @return 0 OK, -1 Error
+ */
+int storage_flight_plan_update(int timetodo, int new_time, int executions, int * entries);
+
+/**
+ * Reset the table in the opened database (@relatesalso storage_init) in the
+ * form (time, command, args, repeat).
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @return 0 OK, -1 Error
+ */
+int storage_flight_plan_reset(int * entries);
+
+/**
+ * Show the table in the opened database (@relatesalso storage_init) in the
+ * form (time, command, args, repeat).
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @return 0 OK
+ */
+int storage_flight_plan_show_table(int entries);
+
+/**
+ * Set a value for specific payload with index value
+ * in database
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param index Int. index address
+ * @param data Pointer to struct
+ * @param payload Int. payload to store
+ * @return 0 OK, -1 Error
+ */
+int storage_set_payload_data(int index, void * data, int payload);
+
+/**
+ * Set @n consecutive values for specific payload, starting at index value,
+ * inside one transaction. If a value can not be stored, the transaction is
+ * rolled back.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param index Int. index address of the first value
+ * @param data Pointer to an array of @n structs
+ * @param payload Int. payload to store
+ * @param n Int. number of structs in data
+ * @return 0 OK, -1 Error
+ */
+int storage_set_payload_data_batch(int index, void* data, int payload, int n);
+
+/**
+ * Store @n consecutive samples of a payload received from another @node, in
+ * the node's own table <payload table>_<node>. The table is created the first
+ * time the node sends this payload and has its own index, that continues
+ * after the samples already stored. Samples of different nodes can be stored
+ * concurrently (only with @SCH_STORAGE_MODE 2, the other modes are
+ * non-reentrant). Node tables are only available with a database
+ * (@SCH_STORAGE_MODE 1 or 2).
+ *
+ * @param node Int. source node
+ * @param data Pointer to an array of @n structs
+ * @param payload Int. payload to store
+ * @param n Int. number of structs in data
+ * @return Index of the first sample stored, -1 Error
+ */
+int storage_set_payload_data_node(int node, void* data, int payload, int n);
+
+/**
+ * Get the next index of the table of a payload received from another @node
+ * (@see storage_set_payload_data_node), the table is created if it does not
+ * exist.
+ *
+ * @param node Int. source node
+ * @param payload Int. payload id
+ * @return Next index, -1 Error
+ */
+int storage_get_payload_next_node(int node, int payload);
+
+/**
+ * Get @count consecutive values of a payload received from another @node,
+ * as storage_get_payload_data_range from the node's own table.
+ *
+ * @param node Int. source node
+ * @param index Int. index address of the first value
+ * @param count Int. number of values to get
+ * @param data Pointer to an array of at least @count structs
+ * @param payload Int. payload to get value
+ * @return Number of values found, -1 Error
+ */
+int storage_get_payload_data_node(int node, int index, int count, void* data, int payload);
+
+/**
+ * Get a value for specific payload with index value
+ * in database
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param index Int. index address
+ * @param data Pointer to struct
+ * @param payload Int. payload to get value
+ * @return 0 OK, -1 Error
+ */
+int storage_get_payload_data(int index, void* data, int payload);
+
+/**
+ * Get @count consecutive values for specific payload, starting at index
+ * value, with one query (or one copy per memory section in RAM mode).
+ * Samples are stored in @data in index order, missing samples are zeroed.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param index Int. index address of the first value
+ * @param count Int. number of values to get
+ * @param data Pointer to an array of at least @count structs
+ * @param payload Int. payload to get value
+ * @return Number of values found, -1 Error
+ */
+int storage_get_payload_data_range(int index, int count, void* data, int payload);
+
+/**
+ * Get the number of payload samples that failed the CRC32C check when read.
+ * With SCH_STORAGE_CRC the RAM, memory mapped files and flash storages keep a
+ * CRC per sample, corrupted samples are returned zeroed. The databases check
+ * their own pages, the counter stays at 0.
+ *
+ * @param reset Set to clear the counter
+ * @return Corrupted samples read since the last reset
+ */
+uint32_t storage_payload_crc_errors(int reset);
+
+/**
+ * Find the index of the first payload sample, of the first @next samples,
+ * with a timestamp after or equal to @timestamp. The SQL storages use an
+ * index of the timestamp column, the others a binary search, that assumes
+ * the samples were stored in time order.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param timestamp Unix time
+ * @param payload Int. payload to search
+ * @param next Int. index of the next sample to store
+ * @return The sample index, @next if all samples are older, -1 Error
+ */
+int storage_get_payload_index_time(uint32_t timestamp, int payload, int next);
+
+/**
+ * Delete the oldest samples of a payload, up to @max samples with index lower
+ * than @end, to keep the storage bounded (see dat_trim_payloads). The SQL
+ * storages delete the rows, the RAM storage frees the memory section slots to
+ * store new samples. The memory mapped files storage reuses the oldest slots
+ * anyway, so it deletes nothing.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param payload Int. payload to trim
+ * @param end Int. index of the first sample to keep
+ * @param max Int. max. samples to delete
+ * @return Number of samples deleted, 0 if none is left before @end, -1 Error
+ */
+int storage_trim_payload_data(int payload, int end, int max);
+
+/**
+ * Delete payload databases
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ * @return OK 0, Error -1
+ */
+int storage_delete_memory_sections(void);
+
+/**
+ * Flush buffered writes to the non-volatile storage. Only the memory mapped
+ * files storage (SCH_STORAGE_MODE 3) buffers writes, in other modes it does
+ * nothing.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @return 0 OK, -1 Error
+ */
+int storage_sync(void);
+
+/**
+ * Check if the payload range reads (storage_get_payload_data,
+ * storage_get_payload_data_range) and the flight plan listing
+ * (storage_flight_plan_foreach) can run without the mutex, concurrently with
+ * the other storage functions. Only with SQLite in WAL mode (SCH_STORAGE_MODE
+ * 1 with SCH_STORAGE_SQLITE_PROFILE 1), that uses SCH_STORAGE_SQLITE_READERS
+ * read-only connections.
+ *
+ * @return 1 if the reads are reentrant, 0 otherwise
+ */
+int storage_read_concurrent(void);
+
+/**
+ * Keep the status repository in RAM across a software reset, @see
+ * dat_repo_seal. The databases are not kept in RAM, it does nothing.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @return 0 OK, -1 Error
+ */
+int storage_repo_seal(void);
+
+/**
+ * Replace the snapshot file @file with @len bytes, written through to the
+ * non-volatile storage. The previous snapshot is kept if the write fails or
+ * is interrupted by a reset.
+ *
+ * @param file Str. Snapshot file path
+ * @param data Pointer to the snapshot contents
+ * @param len Int. Number of bytes
+ * @return 0 OK, -1 Error
+ */
+int storage_snapshot_write(const char *file, const void *data, int len);
+
+/**
+ * Read up to @len bytes of the snapshot file @file, in one read.
+ *
+ * @param file Str. Snapshot file path
+ * @param data Pointer to a buffer of at least @len bytes
+ * @param len Int. Max. number of bytes to read
+ * @return Number of bytes read, -1 Error or no snapshot
+ */
+int storage_snapshot_read(const char *file, void *data, int len);
+
+/**
+ * Open the flight plan journal, used to keep the flight plan of the RAM
+ * storage mode (SCH_STORAGE_MODE 0) across resets. The journal is created if
+ * it does not exist.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param file Str. Journal file path
+ * @return 0 OK, -1 Error
+ */
+int storage_fp_journal_init(const char *file);
+
+/**
+ * Read @len bytes of the flight plan journal, starting at @offset.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param offset Int. Journal position
+ * @param data Pointer to a buffer of at least @len bytes
+ * @param len Int. Number of bytes to read
+ * @return Number of bytes read, less than @len at the end of the journal, -1 Error
+ */
+int storage_fp_journal_read(int offset, void *data, int len);
+
+/**
+ * Append @len bytes to the flight plan journal, written through to the
+ * non-volatile storage.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param data Pointer to the data to append
+ * @param len Int. Number of bytes
+ * @return 0 OK, -1 Error or journal full
+ */
+int storage_fp_journal_append(const void *data, int len);
+
+/**
+ * Replace the contents of the flight plan journal with @len bytes, used to
+ * compact it. If the storage fails, the previous contents are kept.
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @param data Pointer to the new journal contents
+ * @param len Int. Number of bytes
+ * @return 0 OK, -1 Error or journal full
+ */
+int storage_fp_journal_rewrite(const void *data, int len);
+
+/**
+ * Close the opened database
+ *
+ * @note: non-reentrant function, use mutex to sync access
+ *
+ * @return 0 OK, -1 Error
+ */
+int storage_close(void);
+
+// TODO: Remove not used function?
+/**
+// * Set or update the value of a INT (integer) variable by name.
+// *
+// * @note: non-reentrant function, use mutex to sync access
+// *
+// * @param name Str. Variable name
+// * @param value Int. Value to set
+// * @param table Str. Table name
+// * @return 0 OK, -1 Error
+// */
+//int storage_repo_set_value_str(char *name, int value, char *table);
+
+#endif //SCH_PERSISTENT_H
@@ -0,0 +1,168 @@
+/**
+ * @file storage_backend.h
+ * @author Carlos Gonzalez C - carlgonz@uchile.cl
+ * @author Camilo Rojas M - camrojas@uchile.cl
+ * @date 2020
+ * @copyright GNU GPL v3
+ *
+ * Storage backends interface. Each storage mode is a module that implements
+ * the operations of storage_backend_t, data_storage.c selects the backend of
+ * SCH_STORAGE_MODE at compile time and implements the storage API over it:
+ * parameters checks, default batch operations (one operation per value inside
+ * a transaction), flight plan entries advance and listing, and the payload
+ * tables of other nodes. Helpers shared by the SQL backends are declared here
+ * too.
+ *
+ * Backends set to NULL the operations they do not support. Operations are
+ * called with the same parameters of the storage API, already checked.
+ */
+
+#ifndef SCH_STORAGE_BACKEND_H
+#define SCH_STORAGE_BACKEND_H
+
+#include "data_storage.h"
+
+#define STORAGE_TABLE_NAME_LEN  (32)    ///< Max. table name length
+#define STORAGE_FP_TABLE        "flightplan"  ///< Flight plan table name
+#define STORAGE_TIME_FIELD      "timestamp"   ///< Payload field with the sample time
+
+typedef struct storage_backend {
+    const char *name;                   ///< Backend name, for logs
+
+    /* Storage */
+    int (*init)(const char *file);      ///< Open the storage (see storage_init)
+    int (*close)(void);                 ///< Close the storage (see storage_close)
+    int (*sync)(void);                  ///< Flush buffered writes, NULL if writes are not buffered
+    int (*begin)(void);                 ///< Begin a transaction, NULL if not supported
+    int (*end)(int commit);             ///< Commit (1) or roll back (0) the transaction
+    int (*read_concurrent)(void);       ///< 1 if payload_get_range and fp_foreach run concurrently with the other operations, NULL if not
+
+    /* Status variables repository, NULL if the status variables are not stored */
+    int (*repo_init)(char *table, int drop);
+    int (*repo_get_value)(int index, char *table);
+    int (*repo_get_values)(int index, int n, int *values, char *table);         ///< @n > 0, @values set to -1
+    int (*repo_set_value)(int index, int value, char *table);
+    int (*repo_set_values)(int index, int n, const int *values, char *table);   ///< NULL to set one value at a time
+    int (*repo_get_copies)(int index, int n, int *values, char *table);        ///< NULL to get each copy with repo_get_values
+    int (*repo_set_copies)(int index, int n, const int *values, char *table);  ///< NULL to set each copy with repo_set_values
+
+    /* Flight plan, NULL if the flight plan is not stored. Several entries can
+     * have the same time, get, update and erase use the first one (lowest ms,
+     * then upload order) and set and update add the entry after the others */
+    int (*fp_init)(int drop, int *entries);
+    int (*fp_set)(int timetodo, char *command, char *args, int executions, int periodical, int ms, int *entries);
+    int (*fp_set_batch)(fp_entry_t *fp, int n, int *entries);                  ///< NULL to set one entry at a time
+    int (*fp_get)(int timetodo, char *command, char *args, int *executions, int *periodical, int *ms); ///< Read only, 0 OK, -1 not found
+    int (*fp_update)(int timetodo, int new_time, int executions, int *entries);
+    int (*fp_erase)(int timetodo, int *entries);
+    int (*fp_next)(void);
+    int (*fp_foreach)(int from, int to, fp_visit_t visit, void *arg);           ///< 0 <= @from, @to
+    int fp_sorted;                      ///< 1 if fp_foreach visits the entries sorted by time
+
+    /* Payloads */
+    int (*payload_init)(int drop);
+    int (*payload_set)(int index, void *data, int payload, int n);              ///< Store @n > 0 samples
+    int (*payload_get_range)(int index, int count, void *data, int payload);   ///< @count > 0, returns samples found
+    int (*payload_find_time)(uint32_t timestamp, int payload, int next);       ///< NULL to binary search with payload_get_range
+    int (*payload_first)(int payload, int next);                               ///< Index of the oldest sample kept, NULL if 0
+    int (*payload_trim)(int payload, int end, int max);                        ///< Delete up to @max > 0 samples with index < @end, NULL if not supported
+
+    /* Payload tables of other nodes, NULL if not supported */
+    int (*node_table_init)(const char *table, int payload);                    ///< Create the table, returns its next index
+    int (*node_table_set)(const char *table, int index, void *data, int payload, int n);
+    int (*node_table_get)(const char *table, int index, int count, void *data, int payload);  ///< As payload_get_range
+} storage_backend_t;
+
+extern const storage_backend_t storage_backend_ram;        ///< SCH_STORAGE_MODE 0, storage_ram.c
+extern const storage_backend_t storage_backend_sqlite;     ///< SCH_STORAGE_MODE 1, storage_sqlite.c
+extern const storage_backend_t storage_backend_postgres;   ///< SCH_STORAGE_MODE 2, storage_postgres.c
+extern const storage_backend_t storage_backend_mmap;       ///< SCH_STORAGE_MODE 3, storage_mmap.c
+
+/**
+ * Read an integer field from the struct as a signed 64 bits value
+ */
+int64_t storage_field_int(const dat_payload_field_t *field, const char *sample);
+
+/**
+ * Write an integer value to a struct field, truncated to the field size
+ */
+void storage_field_set_int(const dat_payload_field_t *field, char *sample, int64_t val);
+
+/**
+ * Float fields set to -1 (as int) are stored as NULL/NaN
+ */
+int storage_field_is_null(const dat_payload_field_t *field, const char *sample);
+
+/**
+ * Get the time field (STORAGE_TIME_FIELD) of a payload, NULL if the payload
+ * samples are not timestamped
+ */
+const dat_payload_field_t *storage_payload_time_field(int payload);
+
+/**
+ * CRC32C of a payload sample, to store with the sample. A stored CRC of 0
+ * marks a sample without CRC (stored before SCH_STORAGE_CRC was set), that is
+ * not checked, so a computed CRC of 0 is returned as 0xFFFFFFFF.
+ */
+uint32_t storage_record_crc(const void *sample, int size);
+
+/**
+ * Check a payload sample read from the storage against its stored CRC (see
+ * storage_record_crc). A corrupted sample is logged, zeroed and counted (see
+ * storage_payload_crc_errors).
+ * @return 0 OK or not checked, -1 the sample was corrupted
+ */
+int storage_record_check(int payload, int index, void *sample, int size, uint32_t crc);
+
+/**
+ * Build the CREATE TABLE command of a payload @table, one column per field.
+ * @param float_type SQL type of the float fields
+ * @return 0 OK, -1 Error
+ */
+int storage_sql_payload_create(int payload, const char *table, const char *float_type, char *sql, size_t len);
+
+/**
+ * Build the INSERT command of a payload @table, with the index and the fields
+ * as parameters.
+ * @param param Parameter format, with the parameter number ("?%d", "$%d")
+ * @return 0 OK, -1 Error
+ */
+int storage_sql_payload_insert(int payload, const char *table, const char *param, char *sql, size_t len);
+
+/**
+ * Build the SELECT command of the payload @table samples with index between
+ * two parameters, columns in the same order of the struct fields.
+ * @param param Parameter format, with the parameter number ("?%d", "$%d")
+ * @return 0 OK, -1 Error
+ */
+int storage_sql_payload_select(int payload, const char *table, const char *param, char *sql, size_t len);
+
+/**
+ * Build the CREATE INDEX command of the time field of a payload @table
+ * @return 0 OK, -1 Error
+ */
+int storage_sql_payload_time_index(const char *table, char *sql, size_t len);
+
+/**
+ * Build the SELECT command of the index of the first sample of a payload
+ * @table with time >= the first parameter and index < the second parameter
+ * @param param Parameter format, with the parameter number ("?%d", "$%d")
+ * @return 0 OK, -1 Error
+ */
+int storage_sql_payload_time(const char *table, const char *param, char *sql, size_t len);
+
+/**
+ * Build the CREATE INDEX command of the id column of a payload @table
+ * @return 0 OK, -1 Error
+ */
+int storage_sql_payload_id_index(const char *table, char *sql, size_t len);
+
+/**
+ * Build the DELETE command of the oldest samples of a payload @table, with
+ * index < the first parameter and at most the second parameter samples
+ * @param param Parameter format, with the parameter number ("?%d", "$%d")
+ * @return 0 OK, -1 Error
+ */
+int storage_sql_payload_trim(const char *table, const char *param, char *sql, size_t len);
+
+#endif //SCH_STORAGE_BACKEND_H
@@ -0,0 +1,583 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *      Copyright 2020, Camilo Rojas Milla, camrojas@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * SCH_STORAGE_MODE == 3. Status repository, flight plan and payloads are
+ * stored in fixed size record files mapped to memory with mmap, so reads and
+ * writes are plain memory accesses and data survives restarts. Payloads use
+ * the same SCH_SECTIONS_PER_PAYLOAD x SCH_SIZE_PER_SECTION layout of the RAM
+ * mode, as a ring buffer. With SCH_STORAGE_CRC the CRC32C of each payload
+ * slot is kept in another file, checked when the sample is read. Pages are
+ * flushed to disk by storage_sync, called periodically from dat_repo_sync, and
+ * by storage_close.
+ */
+#define LOG_TAG_ID LOG_TAG_DATA
+#include "storage_backend.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+static const char *tag = "storage_mmap";
+
+#define STORAGE_REPO_TABLES     (4)     ///< Max. status repo tables
+#define STORAGE_REPO_LEN        (dat_status_last_address*3)  ///< Values per status repo table, including tripled writing copies
+#define STORAGE_PAYLOAD_LEN     (SCH_SECTIONS_PER_PAYLOAD*SCH_SIZE_PER_SECTION*last_sensor)
+
+typedef struct storage_mmap {
+    int fd;                                 ///< Mapped file descriptor
+    uint8_t *addr;                          ///< Mapped memory, NULL if not mapped
+    size_t size;                            ///< Mapped size in bytes
+} storage_mmap_t;
+
+typedef struct storage_repo_map {
+    char table[STORAGE_TABLE_NAME_LEN];     ///< Status repo table name
+    storage_mmap_t map;                     ///< Table values, int32_t[STORAGE_REPO_LEN]
+} storage_repo_map_t;
+
+typedef struct storage_fp_entry {
+    int32_t unixtime;                       ///< Time to execute the command, 0 if the entry is empty
+    int32_t executions;                     ///< Number of executions
+    int32_t periodical;                     ///< Period in seconds
+    int32_t ms;                             ///< Milliseconds after unixtime
+    uint32_t seq;                           ///< Upload order of the entries with the same time
+    char cmd[SCH_CMD_MAX_STR_NAME];         ///< Command name
+    char args[SCH_CMD_MAX_STR_PARAMS];      ///< Command parameters
+} storage_fp_entry_t;
+
+static char storage_file[SCH_BUFF_MAX_LEN];
+static storage_repo_map_t repo_maps[STORAGE_REPO_TABLES];
+static int repo_maps_len = 0;
+static storage_mmap_t fp_map = {-1, NULL, 0};
+static uint32_t fp_seq = 0;             ///< Next flight plan entry seq
+static storage_mmap_t payload_map = {-1, NULL, 0};
+static uint8_t *storage_addresses[SCH_SECTIONS_PER_PAYLOAD*last_sensor];  // Storage pointers to payload memory sections
+#if SCH_STORAGE_CRC
+static storage_mmap_t payload_crc_map = {-1, NULL, 0};
+static uint32_t *storage_crc_addresses[last_sensor];   // CRC of the first slot of each payload
+#endif
+
+static int mmap_close(void);
+
+/**
+ * Close a mapped file, flushing the mapped pages first
+ */
+static void storage_mmap_close(storage_mmap_t *map)
+{
+    if(map->addr != NULL)
+    {
+        msync(map->addr, map->size, MS_SYNC);
+        munmap(map->addr, map->size);
+    }
+    if(map->fd >= 0)
+        close(map->fd);
+    map->fd = -1;
+    map->addr = NULL;
+    map->size = 0;
+}
+
+/**
+ * Map the file <storage_file>.<name> of @size bytes. The file is created, or
+ * cleared if @drop is set or its size does not match (the layout changed).
+ * Returns 1 if the file was created or cleared (zeroed), 0 if an existing
+ * file was mapped, -1 Error.
+ */
+static int storage_mmap_open(storage_mmap_t *map, const char *name, size_t size, int drop)
+{
+    char path[SCH_BUFF_MAX_LEN];
+    snprintf(path, sizeof(path), "%s.%s", storage_file, name);
+    storage_mmap_close(map);
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if(fd < 0)
+    {
+        LOGE(tag, "Unable to open %s. Error: %s", path, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    int clear = drop || fstat(fd, &st) != 0 || st.st_size != size;
+    if(clear)
+    {
+        if(!drop && st.st_size != 0)
+            LOGW(tag, "File %s size does not match (%ld != %lu), clearing it", path, (long)st.st_size, (unsigned long)size);
+        if(ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0)
+        {
+            LOGE(tag, "Unable to resize %s. Error: %s", path, strerror(errno));
+            close(fd);
+            return -1;
+        }
+    }
+
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(addr == MAP_FAILED)
+    {
+        LOGE(tag, "Unable to map %s. Error: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    map->fd = fd;
+    map->addr = (uint8_t *)addr;
+    map->size = size;
+    LOGD(tag, "File %s mapped at %p, %lu bytes", path, addr, (unsigned long)size);
+    return clear;
+}
+
+/**
+ * Get the mapped values of a status repo table, NULL if the table is not
+ * initialized or the values @index to @index + @n - 1 are out of bounds.
+ */
+static int32_t *storage_repo_values(char *table, int index, int n)
+{
+    int i;
+    for(i=0; i<repo_maps_len; i++)
+    {
+        if(strncmp(repo_maps[i].table, table, STORAGE_TABLE_NAME_LEN) == 0)
+        {
+            if(repo_maps[i].map.addr == NULL || index < 0 || n < 0 || index + n > STORAGE_REPO_LEN)
+                break;
+            return (int32_t *)repo_maps[i].map.addr + index;
+        }
+    }
+    LOGE(tag, "Status vars %d-%d not available in %s", index, index + n - 1, table);
+    return NULL;
+}
+
+/**
+ * Get the address of a payload sample. Samples are stored in a ring buffer,
+ * old samples are overwritten once all the payload sections are used.
+ */
+static uint8_t *storage_payload_address(int index, int payload)
+{
+    if(payload_map.addr == NULL || index < 0)
+    {
+        LOGE(tag, "Payload index %d is not valid", index);
+        return NULL;
+    }
+    int payloads_per_section = SCH_SIZE_PER_SECTION/data_map[payload].size;
+    int slot = index % (payloads_per_section*SCH_SECTIONS_PER_PAYLOAD);
+    return storage_addresses[payload*SCH_SECTIONS_PER_PAYLOAD + slot/payloads_per_section] +
+           (slot%payloads_per_section)*data_map[payload].size;
+}
+
+/**
+ * Get the address of the CRC of a payload sample, NULL without SCH_STORAGE_CRC
+ */
+static uint32_t *storage_payload_crc(int index, int payload)
+{
+#if SCH_STORAGE_CRC
+    if(payload_crc_map.addr == NULL || index < 0)
+        return NULL;
+    int capacity = SCH_SIZE_PER_SECTION/data_map[payload].size*SCH_SECTIONS_PER_PAYLOAD;
+    return storage_crc_addresses[payload] + index%capacity;
+#else
+    return NULL;
+#endif
+}
+
+static int mmap_init(const char *file)
+{
+    mmap_close();
+    strncpy(storage_file, file, sizeof(storage_file)-1);
+    storage_file[sizeof(storage_file)-1] = '\0';
+    return 0;
+}
+
+static int mmap_close(void)
+{
+    int i;
+    for(i=0; i<repo_maps_len; i++)
+        storage_mmap_close(&repo_maps[i].map);
+    repo_maps_len = 0;
+    storage_mmap_close(&fp_map);
+    storage_mmap_close(&payload_map);
+#if SCH_STORAGE_CRC
+    storage_mmap_close(&payload_crc_map);
+#endif
+    return 0;
+}
+
+static int mmap_sync(void)
+{
+    int i, rc = 0;
+    for(i=0; i<repo_maps_len; i++)
+        if(repo_maps[i].map.addr != NULL)
+            rc |= msync(repo_maps[i].map.addr, repo_maps[i].map.size, MS_SYNC);
+    if(fp_map.addr != NULL)
+        rc |= msync(fp_map.addr, fp_map.size, MS_SYNC);
+    if(payload_map.addr != NULL)
+        rc |= msync(payload_map.addr, payload_map.size, MS_SYNC);
+#if SCH_STORAGE_CRC
+    if(payload_crc_map.addr != NULL)
+        rc |= msync(payload_crc_map.addr, payload_crc_map.size, MS_SYNC);
+#endif
+    if(rc != 0)
+        LOGE(tag, "Unable to sync storage. Error: %s", strerror(errno));
+    return rc != 0 ? -1 : 0;
+}
+
+static int mmap_repo_init(char *table, int drop)
+{
+    storage_repo_map_t *repo = NULL;
+    int i;
+    for(i=0; i<repo_maps_len; i++)
+        if(strncmp(repo_maps[i].table, table, STORAGE_TABLE_NAME_LEN) == 0)
+            repo = &repo_maps[i];
+
+    if(repo == NULL)
+    {
+        if(repo_maps_len >= STORAGE_REPO_TABLES)
+        {
+            LOGE(tag, "Too many status repo tables, can not create %s", table);
+            return -1;
+        }
+        repo = &repo_maps[repo_maps_len++];
+        strncpy(repo->table, table, STORAGE_TABLE_NAME_LEN-1);
+        repo->map.fd = -1;
+    }
+
+    int rc = storage_mmap_open(&repo->map, table, STORAGE_REPO_LEN*sizeof(int32_t), drop);
+    if(rc == 1)
+    {
+        // New table, set default values
+        int32_t *values = (int32_t *)repo->map.addr;
+        for(i=0; i<STORAGE_REPO_LEN; i++)
+            values[i] = dat_get_status_var_def(i%dat_status_last_address).value.i;
+        LOGD(tag, "Table %s created successfully", table);
+    }
+    return rc < 0 ? -1 : 0;
+}
+
+static int mmap_repo_get_value(int index, char *table)
+{
+    int32_t *values = storage_repo_values(table, index, 1);
+    return values != NULL ? *values : -1;
+}
+
+static int mmap_repo_get_values(int index, int n, int *values, char *table)
+{
+    int32_t *repo = storage_repo_values(table, index, n);
+    if(repo == NULL)
+        return -1;
+    memcpy(values, repo, n * sizeof(int32_t));
+    return 0;
+}
+
+static int mmap_repo_set_value(int index, int value, char *table)
+{
+    int32_t *values = storage_repo_values(table, index, 1);
+    if(values == NULL)
+        return -1;
+    *values = value;
+    return 0;
+}
+
+static int mmap_repo_set_values(int index, int n, const int *values, char *table)
+{
+    int32_t *repo = storage_repo_values(table, index, n);
+    if(repo == NULL)
+        return -1;
+    memcpy(repo, values, n * sizeof(int32_t));
+    return 0;
+}
+
+static int mmap_fp_init(int drop, int *entries)
+{
+    int rc = storage_mmap_open(&fp_map, STORAGE_FP_TABLE, SCH_FP_MAX_ENTRIES*sizeof(storage_fp_entry_t), drop);
+    if(rc < 0)
+        return -1;
+
+    // Count the entries kept in the file, new entries go after them
+    storage_fp_entry_t *fp = (storage_fp_entry_t *)fp_map.addr;
+    int i, n = 0;
+    fp_seq = 0;
+    for(i=0; i<SCH_FP_MAX_ENTRIES; i++)
+    {
+        n += fp[i].unixtime != 0;
+        if(fp[i].unixtime != 0 && fp[i].seq >= fp_seq)
+            fp_seq = fp[i].seq + 1;
+    }
+    *entries = n;
+    return 0;
+}
+
+/**
+ * First entry of a time, the one with the lowest ms and then seq, NULL if
+ * there are no entries at @timetodo
+ */
+static storage_fp_entry_t *storage_fp_first(int timetodo)
+{
+    storage_fp_entry_t *fp = (storage_fp_entry_t *)fp_map.addr;
+    storage_fp_entry_t *first = NULL;
+    int i;
+    for(i=0; i<SCH_FP_MAX_ENTRIES && timetodo != 0; i++)
+    {
+        if(fp[i].unixtime == timetodo && (first == NULL || fp[i].ms < first->ms ||
+           (fp[i].ms == first->ms && fp[i].seq < first->seq)))
+            first = &fp[i];
+    }
+    return first;
+}
+
+static int mmap_fp_set(int timetodo, char *command, char *args, int executions, int periodical, int ms, int *entries)
+{
+    if(fp_map.addr == NULL)
+        return -1;
+
+    // Use the first empty entry, entries with the same time are ordered by seq
+    storage_fp_entry_t *fp = (storage_fp_entry_t *)fp_map.addr;
+    storage_fp_entry_t *entry = NULL;
+    int i;
+    for(i=0; i<SCH_FP_MAX_ENTRIES && entry == NULL; i++)
+    {
+        if(fp[i].unixtime == 0)
+            entry = &fp[i];
+    }
+
+    if(entry == NULL)
+    {
+        LOGE(tag, "Flight plan is full, unable to add %s", command);
+        return -1;
+    }
+
+    (*entries)++;
+    entry->unixtime = timetodo;
+    entry->seq = fp_seq++;
+    entry->executions = executions;
+    entry->periodical = periodical;
+    entry->ms = ms;
+    strncpy(entry->cmd, command, SCH_CMD_MAX_STR_NAME-1);
+    entry->cmd[SCH_CMD_MAX_STR_NAME-1] = '\0';
+    strncpy(entry->args, args, SCH_CMD_MAX_STR_PARAMS-1);
+    entry->args[SCH_CMD_MAX_STR_PARAMS-1] = '\0';
+    LOGV(tag, "Inserted (%d, %s, %s, %d, %d) in %s", timetodo, command, args, executions, periodical, STORAGE_FP_TABLE);
+    return 0;
+}
+
+static int mmap_fp_set_batch(fp_entry_t *fp, int n, int *entries)
+{
+    if(fp_map.addr == NULL)
+        return -1;
+
+    // Without transactions, check there is space for all entries first
+    storage_fp_entry_t *table = (storage_fp_entry_t *)fp_map.addr;
+    int i, empty = 0;
+    for(i=0; i<SCH_FP_MAX_ENTRIES; i++)
+        empty += table[i].unixtime == 0;
+    if(empty < n)
+    {
+        LOGE(tag, "Flight plan is full, unable to add %d entries", n);
+        return -1;
+    }
+
+    for(i=0; i<n; i++)
+        if(mmap_fp_set(fp[i].unixtime, fp[i].cmd, fp[i].args, fp[i].executions, fp[i].periodical, fp[i].ms, entries) != 0)
+            return -1;
+    return 0;
+}
+
+static int mmap_fp_get(int timetodo, char *command, char *args, int *executions, int *periodical, int *ms)
+{
+    if(fp_map.addr == NULL || timetodo == 0)
+        return -1;
+
+    storage_fp_entry_t *entry = storage_fp_first(timetodo);
+    if(entry == NULL)
+        return -1;
+    strcpy(command, entry->cmd);
+    strcpy(args, entry->args);
+    *executions = entry->executions;
+    *periodical = entry->periodical;
+    *ms = entry->ms;
+    return 0;
+}
+
+static int mmap_fp_update(int timetodo, int new_time, int executions, int *entries)
+{
+    if(fp_map.addr == NULL || timetodo == 0 || new_time == 0)
+        return -1;
+
+    // Moved after the entries at new_time
+    storage_fp_entry_t *entry = storage_fp_first(timetodo);
+    if(entry == NULL)
+        return -1;
+    entry->unixtime = new_time;
+    entry->executions = executions;
+    entry->seq = fp_seq++;
+    LOGV(tag, "Command in time %d moved to %d (%d executions)", timetodo, new_time, executions);
+    return 0;
+}
+
+static int mmap_fp_erase(int timetodo, int *entries)
+{
+    if(fp_map.addr == NULL)
+        return -1;
+
+    storage_fp_entry_t *entry = storage_fp_first(timetodo);
+    if(entry != NULL)
+    {
+        memset(entry, 0, sizeof(storage_fp_entry_t));
+        (*entries)--;
+        LOGV(tag, "Command in time %d, table %s was deleted", timetodo, STORAGE_FP_TABLE);
+    }
+    return 0;
+}
+
+static int mmap_fp_next(void)
+{
+    if(fp_map.addr == NULL)
+        return -1;
+
+    storage_fp_entry_t *fp = (storage_fp_entry_t *)fp_map.addr;
+    int i, timetodo = -1;
+    for(i=0; i<SCH_FP_MAX_ENTRIES; i++)
+    {
+        if(fp[i].unixtime != 0 && (timetodo == -1 || fp[i].unixtime < timetodo))
+            timetodo = fp[i].unixtime;
+    }
+    return timetodo;
+}
+
+static int mmap_fp_foreach(int from, int to, fp_visit_t visit, void *arg)
+{
+    if(fp_map.addr == NULL)
+        return -1;
+
+    // Entries are visited in storage order, not sorted by time
+    storage_fp_entry_t *fp = (storage_fp_entry_t *)fp_map.addr;
+    fp_entry_t entry;
+    int i, visited = 0;
+    for(i=0; i<SCH_FP_MAX_ENTRIES; i++)
+    {
+        if(fp[i].unixtime == 0 || fp[i].unixtime < from || fp[i].unixtime > to)
+            continue;
+        entry.unixtime = fp[i].unixtime;
+        entry.executions = fp[i].executions;
+        entry.periodical = fp[i].periodical;
+        entry.ms = fp[i].ms;
+        memcpy(entry.cmd, fp[i].cmd, SCH_CMD_MAX_STR_NAME);
+        memcpy(entry.args, fp[i].args, SCH_CMD_MAX_STR_PARAMS);
+        visited++;
+        if(visit(&entry, arg) != 0)
+            break;
+    }
+    return visited;
+}
+
+static int mmap_payload_init(int drop)
+{
+    int rc = storage_mmap_open(&payload_map, "payload", STORAGE_PAYLOAD_LEN, drop);
+    if(rc < 0)
+        return -1;
+
+    // Save the starting address corresponding to each payload memory section
+    int i;
+    for (i = 0; i < SCH_SECTIONS_PER_PAYLOAD*last_sensor; i++)
+        storage_addresses[i] = payload_map.addr + i * SCH_SIZE_PER_SECTION;
+
+#if SCH_STORAGE_CRC
+    // One CRC per slot of each payload. The CRC of samples written before the
+    // file existed are 0, not checked. Samples cleared are not checked either.
+    size_t slots = 0;
+    for(i = 0; i < last_sensor; i++)
+        slots += SCH_SIZE_PER_SECTION/data_map[i].size*SCH_SECTIONS_PER_PAYLOAD;
+    if(storage_mmap_open(&payload_crc_map, "payload_crc", slots*sizeof(uint32_t), drop || rc == 1) < 0)
+        return -1;
+    slots = 0;
+    for(i = 0; i < last_sensor; i++)
+    {
+        storage_crc_addresses[i] = (uint32_t *)payload_crc_map.addr + slots;
+        slots += SCH_SIZE_PER_SECTION/data_map[i].size*SCH_SECTIONS_PER_PAYLOAD;
+    }
+#endif
+    return 0;
+}
+
+static int mmap_payload_set(int index, void *data, int payload, int n)
+{
+    int i, size = data_map[payload].size;
+    for(i=0; i < n; i++)
+    {
+        uint8_t *add = storage_payload_address(index+i, payload);
+        if(add == NULL)
+            return -1;
+        LOGV(tag, "Writing in address: %p, %d bytes", add, size);
+        memcpy(add, (char *)data + i*size, size);
+        uint32_t *crc = storage_payload_crc(index+i, payload);
+        if(crc != NULL)
+            *crc = storage_record_crc((char *)data + i*size, size);
+    }
+    return 0;
+}
+
+static int mmap_payload_get_range(int index, int count, void *data, int payload)
+{
+    // Copy the consecutive samples of each payload section at once
+    int n = 0, k, size = data_map[payload].size;
+    int payloads_per_section = SCH_SIZE_PER_SECTION/size;
+    while(n < count)
+    {
+        uint8_t *add = storage_payload_address(index+n, payload);
+        if(add == NULL)
+            return n > 0 ? n : -1;
+        int run = payloads_per_section - (index+n)%payloads_per_section;
+        if(run > count - n)
+            run = count - n;
+        memcpy((uint8_t *)data + n*size, add, run*size);
+        uint32_t *crc = storage_payload_crc(index+n, payload);
+        for(k = 0; crc != NULL && k < run; k++)
+            storage_record_check(payload, index+n+k, (uint8_t *)data + (n+k)*size, size, crc[k]);
+        n += run;
+    }
+    return n;
+}
+
+static int mmap_payload_first(int payload, int next)
+{
+    // The oldest samples are overwritten once all sections are used
+    int capacity = SCH_SIZE_PER_SECTION/data_map[payload].size*SCH_SECTIONS_PER_PAYLOAD;
+    return next > capacity ? next - capacity : 0;
+}
+
+const storage_backend_t storage_backend_mmap = {
+    .name = "mmap",
+    .init = mmap_init,
+    .close = mmap_close,
+    .sync = mmap_sync,
+    .repo_init = mmap_repo_init,
+    .repo_get_value = mmap_repo_get_value,
+    .repo_get_values = mmap_repo_get_values,
+    .repo_set_value = mmap_repo_set_value,
+    .repo_set_values = mmap_repo_set_values,
+    .fp_init = mmap_fp_init,
+    .fp_set = mmap_fp_set,
+    .fp_set_batch = mmap_fp_set_batch,
+    .fp_get = mmap_fp_get,
+    .fp_update = mmap_fp_update,
+    .fp_erase = mmap_fp_erase,
+    .fp_next = mmap_fp_next,
+    .fp_foreach = mmap_fp_foreach,
+    .payload_init = mmap_payload_init,
+    .payload_set = mmap_payload_set,
+    .payload_get_range = mmap_payload_get_range,
+    .payload_first = mmap_payload_first,
+};
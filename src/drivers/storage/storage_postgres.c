@@ -0,0 +1,1341 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *      Copyright 2020, Camilo Rojas Milla, camrojas@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * SCH_STORAGE_MODE == 2. Status repository, flight plan and payloads are
+ * stored in the PostgreSQL database fs_db_<node>, created if it does not
+ * exist.
+ */
+#define LOG_TAG_ID LOG_TAG_DATA
+#include "storage_backend.h"
+#include <libpq-fe.h>
+#include <math.h>
+#include <poll.h>
+#include <time.h>
+#include "osQueue.h"
+#include "osSemphr.h"
+
+static const char *tag = "storage_postgres";
+
+static PGconn *conn = NULL;
+
+/* Payload connections pool. Payload reads and writes take a connection of
+ * the pool, so they run concurrently and do not wait for the status repo
+ * and flight plan queries, that use conn */
+typedef struct storage_pg {
+    PGconn *conn;                       ///< Pool connection
+} storage_pg_t;
+static storage_pg_t pg_pool[SCH_STORAGE_PG_POOL];
+static osQueue pg_free = 0;             ///< Free pool connections (storage_pg_t *)
+static osSemaphore pg_prepare_sem;      ///< Serializes taking the whole pool to prepare statements
+
+static char fs_db_name[15];
+static char postgres_conf_s[SCH_BUFF_MAX_LEN];
+
+/* Prepared statements cache. Statements are prepared once, when the tables
+ * are initialized, and reused binding the new values. */
+#define STORAGE_REPO_TABLES     (4)     ///< Max. status repo tables with prepared statements
+#define STORAGE_STMT_NAME_LEN   (16)    ///< Prepared statement name length
+
+typedef struct storage_repo_stmt {
+    char table[STORAGE_TABLE_NAME_LEN];     ///< Status repo table name
+    char get[STORAGE_STMT_NAME_LEN];        ///< Get value by index
+    char get_range[STORAGE_STMT_NAME_LEN];  ///< Get values by index range
+    char set[STORAGE_STMT_NAME_LEN];        ///< Set value by index
+    char set_many[STORAGE_STMT_NAME_LEN];   ///< Set values from index and value arrays
+} storage_repo_stmt_t;
+
+typedef enum storage_fp_op {
+    STORAGE_FP_SET = 0,                     ///< Insert or replace an entry
+    STORAGE_FP_GET,                         ///< Get an entry by time
+    STORAGE_FP_ERASE,                       ///< Delete an entry by time
+    STORAGE_FP_NEXT,                        ///< Get the time of the earliest entry
+    STORAGE_FP_UPDATE,                      ///< Move an entry to a new time
+    STORAGE_FP_ITER,                        ///< Get the entries in a time range, sorted
+    STORAGE_FP_LAST
+} storage_fp_op_t;
+
+static storage_repo_stmt_t repo_stmts[STORAGE_REPO_TABLES];
+static int repo_stmts_len = 0;
+static const char *fp_stmts[STORAGE_FP_LAST] = {"fp_set", "fp_get", "fp_erase", "fp_next", "fp_update", "fp_iter"};
+static int fp_stmts_ok = 0;
+static int payload_stmts_ok[last_sensor];
+
+static int postgres_close(void);
+
+/**
+ * Run a prepared statement asynchronously, waiting for the result at most
+ * SCH_STORAGE_PG_TIMEOUT_MS. A query that takes longer is cancelled.
+ * Returns the last result, or NULL on error. Free it with PQclear.
+ */
+static PGresult *storage_psql_exec(PGconn *pg_conn, const char *stmt, int n, const char **params)
+{
+    if(!PQsendQueryPrepared(pg_conn, stmt, n, params, NULL, NULL, 0))
+        return NULL;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t deadline = (int64_t)now.tv_sec*1000 + now.tv_nsec/1000000 + SCH_STORAGE_PG_TIMEOUT_MS;
+    int timeout = 0;
+    while(PQisBusy(pg_conn) && !timeout)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int64_t left = deadline - ((int64_t)now.tv_sec*1000 + now.tv_nsec/1000000);
+        struct pollfd pfd = {PQsocket(pg_conn), POLLIN, 0};
+        if(left <= 0 || poll(&pfd, 1, (int)left) == 0)
+        {
+            LOGE(tag, "Query %s timed out after %d ms, cancelling", stmt, SCH_STORAGE_PG_TIMEOUT_MS);
+            char err[SCH_BUFF_MAX_LEN];
+            PGcancel *cancel = PQgetCancel(pg_conn);
+            if(cancel != NULL)
+            {
+                PQcancel(cancel, err, sizeof(err));
+                PQfreeCancel(cancel);
+            }
+            timeout = 1;
+        }
+        else if(!PQconsumeInput(pg_conn))
+            break;
+    }
+
+    // Read every result to leave the connection ready for the next query
+    PGresult *res, *last = NULL;
+    while((res = PQgetResult(pg_conn)) != NULL)
+    {
+        PQclear(last);
+        last = res;
+    }
+    if(timeout)
+    {
+        PQclear(last);
+        last = NULL;
+    }
+    return last;
+}
+
+/**
+ * Open the payload connections pool.
+ * Returns 0 OK, -1 Error.
+ */
+static int storage_pg_pool_open(void)
+{
+    if(pg_free == 0)
+    {
+        pg_free = osQueueCreate(SCH_STORAGE_PG_POOL, sizeof(storage_pg_t *));
+        if(pg_free != 0 && osSemaphoreCreate(&pg_prepare_sem) != OS_SEMAPHORE_OK)
+            pg_free = 0;
+    }
+    if(pg_free == 0)
+    {
+        LOGE(tag, "Unable to create the connections pool queue");
+        return -1;
+    }
+
+    int i;
+    for(i=0; i < SCH_STORAGE_PG_POOL; i++)
+    {
+        pg_pool[i].conn = PQconnectdb(postgres_conf_s);
+        if(PQstatus(pg_pool[i].conn) == CONNECTION_BAD)
+        {
+            LOGE(tag, "Pool connection %d failed: %s", i, PQerrorMessage(pg_pool[i].conn));
+            PQfinish(pg_pool[i].conn);
+            pg_pool[i].conn = NULL;
+            return -1;
+        }
+        storage_pg_t *pg = &pg_pool[i];
+        osQueueSend(pg_free, &pg, 0);
+    }
+    LOGD(tag, "Opened %d pool connections", SCH_STORAGE_PG_POOL);
+    return 0;
+}
+
+/**
+ * Close the payload connections pool. The pool connections must be free.
+ */
+static void storage_pg_pool_close(void)
+{
+    storage_pg_t *pg;
+    while(pg_free != 0 && osQueueReceive(pg_free, &pg, 0) == pdPASS)
+        ;
+    int i;
+    for(i=0; i < SCH_STORAGE_PG_POOL; i++)
+    {
+        if(pg_pool[i].conn != NULL)
+            PQfinish(pg_pool[i].conn);
+        pg_pool[i].conn = NULL;
+    }
+}
+
+/**
+ * Take a free connection of the pool, waits until one is available
+ */
+static storage_pg_t *storage_pg_take(void)
+{
+    storage_pg_t *pg = NULL;
+    osQueueReceive(pg_free, &pg, portMAX_DELAY);
+    return pg;
+}
+
+/**
+ * Return a connection to the pool
+ */
+static void storage_pg_give(storage_pg_t *pg)
+{
+    osQueueSend(pg_free, &pg, portMAX_DELAY);
+}
+
+/**
+ * Execute a SQL command without results in @pg_conn. Returns 0 OK, -1 Error.
+ */
+static int storage_psql_command(PGconn *pg_conn, const char *sql)
+{
+    PGresult *res = PQexec(pg_conn, sql);
+    int status = PQresultStatus(res);
+    PQclear(res);
+    if(status != PGRES_COMMAND_OK)
+    {
+        LOGE(tag, "Command failed: %s. SQL: %s", PQerrorMessage(pg_conn), sql);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Get the prepared statements of a status repo table, preparing them the
+ * first time the table is used. Returns NULL if the statements can not be
+ * prepared.
+ */
+static storage_repo_stmt_t *storage_repo_stmt(char *table)
+{
+    int i;
+    for(i=0; i<repo_stmts_len; i++)
+    {
+        if(strncmp(repo_stmts[i].table, table, STORAGE_TABLE_NAME_LEN) == 0)
+            return &repo_stmts[i];
+    }
+
+    if(repo_stmts_len >= STORAGE_REPO_TABLES || strlen(table) >= STORAGE_TABLE_NAME_LEN)
+    {
+        LOGE(tag, "Unable to prepare statements for table %s", table);
+        return NULL;
+    }
+
+    storage_repo_stmt_t *stmts = &repo_stmts[repo_stmts_len];
+    strncpy(stmts->table, table, STORAGE_TABLE_NAME_LEN);
+    char sql_get[SCH_BUFF_MAX_LEN];
+    char sql_range[SCH_BUFF_MAX_LEN];
+    char sql_set[SCH_BUFF_MAX_LEN];
+    char sql_set_many[SCH_BUFF_MAX_LEN];
+    snprintf(sql_get, SCH_BUFF_MAX_LEN, "SELECT value FROM %s WHERE idx=$1;", table);
+    snprintf(sql_range, SCH_BUFF_MAX_LEN, "SELECT idx, value FROM %s WHERE idx BETWEEN $1 AND $2;", table);
+    snprintf(sql_set, SCH_BUFF_MAX_LEN, "INSERT INTO %s (idx, value) VALUES ($1, $2) "
+                                        "ON CONFLICT (idx) DO UPDATE SET value = $2;", table);
+    snprintf(sql_set_many, SCH_BUFF_MAX_LEN, "INSERT INTO %s (idx, value) SELECT * FROM unnest($1::int[], $2::int[]) "
+                                             "ON CONFLICT (idx) DO UPDATE SET value = EXCLUDED.value;", table);
+    snprintf(stmts->get, STORAGE_STMT_NAME_LEN, "repo_get_%d", repo_stmts_len);
+    snprintf(stmts->get_range, STORAGE_STMT_NAME_LEN, "repo_range_%d", repo_stmts_len);
+    snprintf(stmts->set, STORAGE_STMT_NAME_LEN, "repo_set_%d", repo_stmts_len);
+    snprintf(stmts->set_many, STORAGE_STMT_NAME_LEN, "repo_setn_%d", repo_stmts_len);
+    PGresult *res = PQprepare(conn, stmts->get, sql_get, 1, NULL);
+    int ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+    PQclear(res);
+    if(ok)
+    {
+        res = PQprepare(conn, stmts->get_range, sql_range, 2, NULL);
+        ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+        PQclear(res);
+    }
+    if(ok)
+    {
+        res = PQprepare(conn, stmts->set, sql_set, 2, NULL);
+        ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+        PQclear(res);
+    }
+    if(ok)
+    {
+        res = PQprepare(conn, stmts->set_many, sql_set_many, 2, NULL);
+        ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+        PQclear(res);
+    }
+    if(!ok)
+    {
+        LOGE(tag, "Failed to prepare statements for table %s. Error: %s", table, PQerrorMessage(conn));
+        return NULL;
+    }
+    repo_stmts_len++;
+    return stmts;
+}
+
+/**
+ * Prepare the flight plan statements, if not prepared yet.
+ * Returns 0 OK, -1 Error.
+ */
+static int storage_fp_stmt_init(void)
+{
+    if(fp_stmts_ok)
+        return 0;
+
+    char sql[STORAGE_FP_LAST][SCH_BUFF_MAX_LEN];
+    // Entries with the same time are kept in upload order by seq, the first
+    // entry of a time is the one with the lowest ms, then seq
+    snprintf(sql[STORAGE_FP_SET], SCH_BUFF_MAX_LEN, "INSERT INTO %s (time, seq, command, args, executions, periodical, ms) "
+             "VALUES ($1, (SELECT COALESCE(MAX(seq)+1, 0) FROM %s WHERE time = $1), $2, $3, $4, $5, $6);",
+             STORAGE_FP_TABLE, STORAGE_FP_TABLE);
+    snprintf(sql[STORAGE_FP_GET], SCH_BUFF_MAX_LEN, "SELECT command, args, executions, periodical, ms FROM %s "
+             "WHERE time = $1 ORDER BY ms, seq LIMIT 1;", STORAGE_FP_TABLE);
+    snprintf(sql[STORAGE_FP_ERASE], SCH_BUFF_MAX_LEN, "DELETE FROM %s WHERE time = $1 AND seq = "
+             "(SELECT seq FROM %s WHERE time = $1 ORDER BY ms, seq LIMIT 1);", STORAGE_FP_TABLE, STORAGE_FP_TABLE);
+    snprintf(sql[STORAGE_FP_NEXT], SCH_BUFF_MAX_LEN, "SELECT time FROM %s ORDER BY time LIMIT 1;", STORAGE_FP_TABLE);
+    snprintf(sql[STORAGE_FP_UPDATE], SCH_BUFF_MAX_LEN, "UPDATE %s SET time = $2, executions = $3, "
+             "seq = (SELECT COALESCE(MAX(seq)+1, 0) FROM %s WHERE time = $2) "
+             "WHERE time = $1 AND seq = (SELECT seq FROM %s WHERE time = $1 ORDER BY ms, seq LIMIT 1);",
+             STORAGE_FP_TABLE, STORAGE_FP_TABLE, STORAGE_FP_TABLE);
+    snprintf(sql[STORAGE_FP_ITER], SCH_BUFF_MAX_LEN, "SELECT time, command, args, executions, periodical, ms "
+             "FROM %s WHERE time >= $1 AND time <= $2 ORDER BY time, ms, seq;", STORAGE_FP_TABLE);
+
+    int i;
+    for(i=0; i<STORAGE_FP_LAST; i++)
+    {
+        PGresult *res = PQprepare(conn, fp_stmts[i], sql[i], 0, NULL);
+        int ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+        PQclear(res);
+        if(!ok)
+        {
+            LOGE(tag, "Failed to prepare statements for table %s. Error: %s", STORAGE_FP_TABLE, PQerrorMessage(conn));
+            return -1;
+        }
+    }
+    fp_stmts_ok = 1;
+    return 0;
+}
+
+/**
+ * Prepare the insert and range select statements of a payload table in every
+ * pool connection, if not prepared yet. Returns 0 OK, -1 Error.
+ */
+static int storage_payload_stmt_init(int payload)
+{
+    if(payload_stmts_ok[payload])
+        return 0;
+
+    char insert_row[SCH_BUFF_MAX_LEN*4];
+    char select_range[SCH_BUFF_MAX_LEN*4];
+    char select_time[SCH_BUFF_MAX_LEN];
+    int timed = storage_payload_time_field(payload) != NULL;
+    if(storage_sql_payload_insert(payload, data_map[payload].table, "$%d", insert_row, sizeof(insert_row)) != 0 ||
+       storage_sql_payload_select(payload, data_map[payload].table, "$%d", select_range, sizeof(select_range)) != 0 ||
+       (timed && storage_sql_payload_time(data_map[payload].table, "$%d", select_time, sizeof(select_time)) != 0))
+        return -1;
+    LOGD(tag, "Prepared SQL command: %s", insert_row);
+    LOGD(tag, "Prepared SQL command: %s", select_range);
+
+    // Payload statements are used from the pool connections, take all of them
+    // to prepare the statements in each one
+    storage_pg_t *pgs[SCH_STORAGE_PG_POOL];
+    int i, ok = 1;
+    osSemaphoreTake(&pg_prepare_sem, portMAX_DELAY);
+    for(i=0; i < SCH_STORAGE_PG_POOL; i++)
+        pgs[i] = storage_pg_take();
+    for(i=0; i < SCH_STORAGE_PG_POOL && ok; i++)
+    {
+        char stmt_name[STORAGE_STMT_NAME_LEN];
+        snprintf(stmt_name, sizeof(stmt_name), "payload_%d", payload);
+        PGresult *res = PQprepare(pgs[i]->conn, stmt_name, insert_row, 0, NULL);
+        ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+        PQclear(res);
+        if(ok)
+        {
+            snprintf(stmt_name, sizeof(stmt_name), "payload_r_%d", payload);
+            res = PQprepare(pgs[i]->conn, stmt_name, select_range, 0, NULL);
+            ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+            PQclear(res);
+        }
+        if(ok && timed)
+        {
+            snprintf(stmt_name, sizeof(stmt_name), "payload_t_%d", payload);
+            res = PQprepare(pgs[i]->conn, stmt_name, select_time, 0, NULL);
+            ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+            PQclear(res);
+        }
+        if(!ok)
+            LOGE(tag, "Failed to prepare statements for table %s. Error: %s", data_map[payload].table, PQerrorMessage(pgs[i]->conn));
+    }
+    payload_stmts_ok[payload] = ok;
+    for(i=0; i < SCH_STORAGE_PG_POOL; i++)
+        storage_pg_give(pgs[i]);
+    osSemaphoreGiven(&pg_prepare_sem);
+    return ok ? 0 : -1;
+}
+
+/**
+ * Forget all prepared statements, they belong to the closed connections
+ */
+static void storage_stmt_close(void)
+{
+    int i;
+    fp_stmts_ok = 0;
+    for(i=0; i<last_sensor; i++)
+        payload_stmts_ok[i] = 0;
+    memset(repo_stmts, 0, sizeof(repo_stmts));
+    repo_stmts_len = 0;
+}
+
+static void storage_psql_str_value(const dat_payload_field_t *field, const char *sample, char *val, size_t len)
+{
+    float f;
+    double d;
+    switch(field->type)
+    {
+        case DAT_FIELD_FLOAT:
+            memcpy(&f, sample + field->offset, sizeof(f));
+            if(storage_field_is_null(field, sample))
+                snprintf(val, len, "nan");
+            else
+                snprintf(val, len, "%.9g", f);
+            break;
+        case DAT_FIELD_DOUBLE:
+            memcpy(&d, sample + field->offset, sizeof(d));
+            snprintf(val, len, "%.17g", d);
+            break;
+        case DAT_FIELD_UINT:
+            snprintf(val, len, "%llu", (unsigned long long)storage_field_int(field, sample));
+            break;
+        default:
+            snprintf(val, len, "%lld", (long long)storage_field_int(field, sample));
+            break;
+    }
+}
+
+static int storage_psql_get_value(const dat_payload_field_t *field, void* sample, PGresult *res, int row, int j)
+{
+    char * res_str = PQgetvalue(res, row, j);
+
+    if( res_str == NULL || PQgetisnull(res, row, j)) {
+        return -1 ;
+    }
+
+    char *ptr = (char *)sample + field->offset;
+    if(field->type == DAT_FIELD_FLOAT) {
+        float val = (float) strtod(res_str, NULL);
+        if(isnan(val))
+            memset(ptr, 0xFF, sizeof(float));
+        else
+            memcpy(ptr, &val, sizeof(float));
+    }
+    else if(field->type == DAT_FIELD_DOUBLE) {
+        double val = strtod(res_str, NULL);
+        memcpy(ptr, &val, sizeof(double));
+    }
+    else if(field->type == DAT_FIELD_UINT) {
+        storage_field_set_int(field, (char *)sample, (int64_t)strtoull(res_str, NULL, 10));
+    }
+    else {
+        storage_field_set_int(field, (char *)sample, strtoll(res_str, NULL, 10));
+    }
+    return 0;
+}
+
+/**
+ * Store @n consecutive samples of a payload in @table with COPY FROM STDIN,
+ * rows are sent in SCH_STORAGE_COPY_BUFF bytes chunks. The COPY is atomic, if
+ * a row fails none is stored. Samples get the same timestamp.
+ * Returns 0 OK, -1 Error.
+ */
+static int storage_psql_copy_payload(storage_pg_t *pg, const char *table, int index, void *data, int payload, int n)
+{
+    PGconn *conn = pg->conn;
+    const dat_payload_schema_t *schema = dat_get_payload_schema(payload);
+    char sql[SCH_BUFF_MAX_LEN*4];
+    int j, len = snprintf(sql, sizeof(sql), "COPY %s (id, tstz", table);
+    for(j=0; j < schema->nfields && len < sizeof(sql); ++j)
+        len += snprintf(sql+len, sizeof(sql)-len, ", %s", schema->fields[j].name);
+    if(len < sizeof(sql))
+        len += snprintf(sql+len, sizeof(sql)-len, ") FROM STDIN");
+    if(len >= sizeof(sql))
+    {
+        LOGE(tag, "Failed to copy to table %s. Too many fields", table);
+        return -1;
+    }
+
+    PGresult *res = PQexec(conn, sql);
+    int status = PQresultStatus(res);
+    PQclear(res);
+    if(status != PGRES_COPY_IN)
+    {
+        LOGE(tag, "command COPY failed: %s", PQerrorMessage(conn));
+        return -1;
+    }
+
+    char tstz[32];
+    time_t now = time(NULL);
+    strftime(tstz, sizeof(tstz), "%Y-%m-%d %H:%M:%S+00", gmtime(&now));
+
+    // A row is at most nfields values of 32 chars, as storage_psql_str_value
+    char buff[SCH_STORAGE_COPY_BUFF];
+    int i, rc = 0, row_max = (schema->nfields+2)*32 + 1;
+    if(row_max > sizeof(buff))
+        rc = -1;
+    len = 0;
+    for(i=0; i < n && rc == 0; i++)
+    {
+        const char *sample = (char *)data + i*data_map[payload].size;
+        len += snprintf(buff+len, sizeof(buff)-len, "%d\t%s", index+i, tstz);
+        for(j=0; j < schema->nfields; ++j)
+        {
+            buff[len++] = '\t';
+            storage_psql_str_value(&schema->fields[j], sample, buff+len, sizeof(buff)-len);
+            len += strlen(buff+len);
+        }
+        buff[len++] = '\n';
+        if(len + row_max > sizeof(buff) || i == n-1)
+        {
+            rc = PQputCopyData(conn, buff, len) == 1 ? 0 : -1;
+            len = 0;
+        }
+    }
+
+    if(PQputCopyEnd(conn, rc == 0 ? NULL : "client error") != 1)
+        rc = -1;
+    while((res = PQgetResult(conn)) != NULL)
+    {
+        if(PQresultStatus(res) != PGRES_COMMAND_OK)
+            rc = -1;
+        PQclear(res);
+    }
+    if(rc != 0)
+        LOGE(tag, "Failed to copy %d samples to table %s. Error: %s", n, table, PQerrorMessage(conn));
+    return rc;
+}
+
+static int postgres_init(const char *file)
+{
+    if(conn != NULL)
+    {
+        LOGW(tag, "Database already open, closing it");
+        postgres_close();
+    }
+
+    // Connect to the flight software database, create it only if it fails
+    sprintf(fs_db_name, "fs_db_%u", SCH_COMM_ADDRESS);
+    snprintf(postgres_conf_s, SCH_BUFF_MAX_LEN, "host=%s user=%s dbname=%s password=%s sslmode=disable",
+             SCH_STORAGE_PGHOST, SCH_STORAGE_PGUSER, fs_db_name, SCH_STORAGE_PGPASS);
+    conn = PQconnectdb(postgres_conf_s);
+
+    if (PQstatus(conn) == CONNECTION_BAD) {
+        LOGI(tag, "Connection to database %s failed, creating it: %s", fs_db_name, PQerrorMessage(conn));
+        PQfinish(conn);
+
+        char admin_conf_s[SCH_BUFF_MAX_LEN];
+        snprintf(admin_conf_s, SCH_BUFF_MAX_LEN, "host=%s user=%s dbname=%s password=%s sslmode=disable",
+                 SCH_STORAGE_PGHOST, SCH_STORAGE_PGUSER, SCH_STORAGE_PGUSER, SCH_STORAGE_PGPASS);
+        conn = PQconnectdb(admin_conf_s);
+        if (PQstatus(conn) == CONNECTION_BAD) {
+            LOGE(tag, "Connection to database %s failed: %s", SCH_STORAGE_PGUSER, PQerrorMessage(conn));
+            PQfinish(conn);
+            conn = NULL;
+            return -1;
+        }
+
+        char create_db[SCH_BUFF_MAX_LEN];
+        snprintf(create_db, SCH_BUFF_MAX_LEN, "CREATE DATABASE %s;", fs_db_name);
+        LOGD(tag, "SQL command: %s", create_db);
+        int rc = storage_psql_command(conn, create_db);
+        PQfinish(conn);
+        conn = NULL;
+        if(rc != 0)
+            return -1;
+
+        conn = PQconnectdb(postgres_conf_s);
+        if (PQstatus(conn) == CONNECTION_BAD) {
+            LOGE(tag, "Connection to database failed: %s\n", PQerrorMessage(conn));
+            PQfinish(conn);
+            conn = NULL;
+            return -1;
+        }
+    }
+
+    int ver = PQserverVersion(conn);
+    LOGI(tag, "Server version: %d", ver);
+
+    // Prepared statements belong to the connection
+    storage_stmt_close();
+
+    if(storage_pg_pool_open() != 0)
+    {
+        postgres_close();
+        return -1;
+    }
+    return 0;
+}
+
+static int postgres_close(void)
+{
+    storage_pg_pool_close();
+    if(conn != NULL)
+    {
+        LOGD(tag, "Closing database");
+        storage_stmt_close();
+        PQfinish(conn);
+        conn = NULL;
+    }
+    return 0;
+}
+
+static int postgres_begin(void)
+{
+    if(storage_psql_command(conn, "BEGIN;") != 0)
+    {
+        LOGE(tag, "Failed to begin transaction");
+        return -1;
+    }
+    return 0;
+}
+
+static int postgres_end(int commit)
+{
+    if(storage_psql_command(conn, commit ? "COMMIT;" : "ROLLBACK;") != 0)
+    {
+        LOGE(tag, "Failed to end transaction");
+        return -1;
+    }
+    return 0;
+}
+
+static int postgres_repo_init(char *table, int drop)
+{
+    if (PQstatus(conn) == CONNECTION_BAD) {
+        LOGE(tag, "Connection to database failed: %s", PQerrorMessage(conn));
+        return -1;
+    }
+
+    char sql[SCH_BUFF_MAX_LEN];
+    if(drop)
+    {
+        snprintf(sql, SCH_BUFF_MAX_LEN, "DROP TABLE IF EXISTS %s", table);
+        if(storage_psql_command(conn, sql) != 0)
+            return -1;
+        // The prepared statements refer to the dropped table
+        storage_stmt_close();
+    }
+
+    snprintf(sql, SCH_BUFF_MAX_LEN, "CREATE TABLE IF NOT EXISTS %s("
+             "idx INTEGER PRIMARY KEY, "
+             "name TEXT UNIQUE, "
+             "value INT);", table);
+    LOGD(tag, "SQL command: %s", sql);
+    storage_psql_command(conn, sql);
+    return storage_repo_stmt(table) != NULL ? 0 : -1;
+}
+
+static int postgres_repo_get_value(int index, char *table)
+{
+    int value = -1;
+    storage_repo_stmt_t *stmts = storage_repo_stmt(table);
+    if(stmts == NULL)
+        return -1;
+
+    char index_str[12];
+    snprintf(index_str, sizeof(index_str), "%d", index);
+    const char *values[1] = {index_str};
+    PGresult * res = PQexecPrepared(conn, stmts->get, 1, values, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) < 1) {
+        LOGE(tag, "command storage_repo_get_value_idx failed or return 0: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    char * value_str = PQgetvalue(res, 0, 0);
+    if ( value_str != NULL)
+        value = atoi(value_str);
+    else
+    {
+        LOGE(tag, "Value does not for status variable index: %d", index);
+    }
+    PQclear(res);
+    return value;
+}
+
+static int postgres_repo_get_values(int index, int n, int *values, char *table)
+{
+    storage_repo_stmt_t *stmts = storage_repo_stmt(table);
+    if(stmts == NULL)
+        return -1;
+
+    char first_str[12];
+    char last_str[12];
+    snprintf(first_str, sizeof(first_str), "%d", index);
+    snprintf(last_str, sizeof(last_str), "%d", index + n - 1);
+    const char *params[2] = {first_str, last_str};
+    PGresult * res = PQexecPrepared(conn, stmts->get_range, 2, params, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        LOGE(tag, "command storage_repo_get_values_idx failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    int i, row, found = 0;
+    for(row=0; row < PQntuples(res); row++)
+    {
+        i = atoi(PQgetvalue(res, row, 0)) - index;
+        if(i >= 0 && i < n)
+        {
+            values[i] = atoi(PQgetvalue(res, row, 1));
+            found++;
+        }
+    }
+    PQclear(res);
+    return found == n ? 0 : -1;
+}
+
+static int postgres_repo_set_value(int index, int value, char *table)
+{
+    storage_repo_stmt_t *stmts = storage_repo_stmt(table);
+    if(stmts == NULL)
+        return -1;
+
+    char index_str[12];
+    char value_str[12];
+    snprintf(index_str, sizeof(index_str), "%d", index);
+    snprintf(value_str, sizeof(value_str), "%d", value);
+    const char *values[2] = {index_str, value_str};
+    PGresult *res = PQexecPrepared(conn, stmts->set, 2, values, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        LOGE(tag, "command INSERT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    PQclear(res);
+    return 0;
+}
+
+static int postgres_repo_set_values(int index, int n, const int *values, char *table)
+{
+    // One upsert for all the values, indexes and values as array parameters
+    storage_repo_stmt_t *stmts = storage_repo_stmt(table);
+    if(stmts == NULL)
+        return -1;
+
+    char *arrays = sch_malloc(MEM_STORAGE, 2*(n*12+2));
+    if(arrays == NULL)
+        return -1;
+    char *idx_str = arrays, *val_str = arrays + n*12+2;
+    int i, rc = 0, len_idx = 0, len_val = 0;
+    idx_str[len_idx++] = val_str[len_val++] = '{';
+    for(i=0; i < n; i++)
+    {
+        len_idx += sprintf(idx_str+len_idx, "%d%s", index+i, i < n-1 ? "," : "}");
+        len_val += sprintf(val_str+len_val, "%d%s", values[i], i < n-1 ? "," : "}");
+    }
+    const char *params[2] = {idx_str, val_str};
+    PGresult *res = PQexecPrepared(conn, stmts->set_many, 2, params, NULL, NULL, 0);
+    if(PQresultStatus(res) != PGRES_COMMAND_OK)
+    {
+        LOGE(tag, "command INSERT (%d values) failed: %s", n, PQerrorMessage(conn));
+        rc = -1;
+    }
+    PQclear(res);
+    sch_free(arrays);
+    return rc;
+}
+
+static int postgres_fp_init(int drop, int *entries)
+{
+    char sql[SCH_BUFF_MAX_LEN];
+    if (drop) {
+        snprintf(sql, SCH_BUFF_MAX_LEN, "DROP TABLE IF EXISTS %s", STORAGE_FP_TABLE);
+        storage_psql_command(conn, sql);
+    }
+
+    snprintf(sql, SCH_BUFF_MAX_LEN, "CREATE TABLE IF NOT EXISTS %s("
+             "time int , "
+             "seq int DEFAULT 0 , "
+             "command text, args text , "
+             "executions int , "
+             "periodical int , "
+             "ms int DEFAULT 0 , "
+             "PRIMARY KEY (time, seq));", STORAGE_FP_TABLE);
+    if(storage_psql_command(conn, sql) != 0)
+        return -1;
+
+    // Tables created with time as primary key are moved to the (time, seq) key
+    snprintf(sql, SCH_BUFF_MAX_LEN, "SELECT 1 FROM information_schema.columns "
+             "WHERE table_name = '%s' AND column_name = 'seq';", STORAGE_FP_TABLE);
+    PGresult *res = PQexec(conn, sql);
+    int has_seq = PQresultStatus(res) == PGRES_TUPLES_OK && PQntuples(res) > 0;
+    PQclear(res);
+    if(!has_seq)
+    {
+        snprintf(sql, SCH_BUFF_MAX_LEN, "ALTER TABLE %s ADD COLUMN seq int DEFAULT 0 NOT NULL, "
+                 "DROP CONSTRAINT %s_pkey, ADD PRIMARY KEY (time, seq);", STORAGE_FP_TABLE, STORAGE_FP_TABLE);
+        if(storage_psql_command(conn, sql) != 0)
+            return -1;
+        LOGI(tag, "Table %s updated with the (time, seq) key", STORAGE_FP_TABLE);
+    }
+    return storage_fp_stmt_init();
+}
+
+static int postgres_fp_set(int timetodo, char *command, char *args, int executions, int periodical, int ms, int *entries)
+{
+    if(storage_fp_stmt_init() != 0)
+        return -1;
+
+    char time_str[12], executions_str[12], periodical_str[12], ms_str[12];
+    snprintf(time_str, sizeof(time_str), "%d", timetodo);
+    snprintf(executions_str, sizeof(executions_str), "%d", executions);
+    snprintf(periodical_str, sizeof(periodical_str), "%d", periodical);
+    snprintf(ms_str, sizeof(ms_str), "%d", ms);
+    const char *values[6] = {time_str, command, args, executions_str, periodical_str, ms_str};
+    PGresult *res = PQexecPrepared(conn, fp_stmts[STORAGE_FP_SET], 6, values, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        LOGE(tag, "Flight Plan Postgres Command INSERT failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    PQclear(res);
+    return 0;
+}
+
+static int postgres_fp_get(int timetodo, char *command, char *args, int *executions, int *periodical, int *ms)
+{
+    if(storage_fp_stmt_init() != 0)
+        return -1;
+
+    char time_str[12];
+    snprintf(time_str, sizeof(time_str), "%d", timetodo);
+    const char *values[1] = {time_str};
+    PGresult * res = PQexecPrepared(conn, fp_stmts[STORAGE_FP_GET], 1, values, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        LOGE(tag, "command storage_flight_plan_get failed or return 0: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+
+    if(PQntuples(res) == 0 || PQnfields(res) == 0)
+    {
+        PQclear(res);
+        return -1;
+    }
+
+    strcpy(command, PQgetvalue(res, 0, 0));
+    strcpy(args, PQgetvalue(res, 0, 1));
+    *executions = atoi(PQgetvalue(res, 0, 2));
+    *periodical = atoi(PQgetvalue(res, 0, 3));
+    *ms = atoi(PQgetvalue(res, 0, 4));
+    PQclear(res);
+    return 0;
+}
+
+static int postgres_fp_update(int timetodo, int new_time, int executions, int *entries)
+{
+    if(storage_fp_stmt_init() != 0)
+        return -1;
+
+    char time_str[12], new_time_str[12], executions_str[12];
+    snprintf(time_str, sizeof(time_str), "%d", timetodo);
+    snprintf(new_time_str, sizeof(new_time_str), "%d", new_time);
+    snprintf(executions_str, sizeof(executions_str), "%d", executions);
+    const char *values[3] = {time_str, new_time_str, executions_str};
+    PGresult *res = PQexecPrepared(conn, fp_stmts[STORAGE_FP_UPDATE], 3, values, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        LOGE(tag, "Flight Plan Postgres Command UPDATE failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    PQclear(res);
+    return 0;
+}
+
+static int postgres_fp_erase(int timetodo, int *entries)
+{
+    if(storage_fp_stmt_init() != 0)
+        return -1;
+
+    char time_str[12];
+    snprintf(time_str, sizeof(time_str), "%d", timetodo);
+    const char *values[1] = {time_str};
+    PGresult * res = PQexecPrepared(conn, fp_stmts[STORAGE_FP_ERASE], 1, values, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        LOGE(tag, "Error in function storage_flight_plan_erase, postgres failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        return -1;
+    }
+    PQclear(res);
+    return 0;
+}
+
+static int postgres_fp_next(void)
+{
+    int timetodo = -1;
+    if(storage_fp_stmt_init() != 0)
+        return -1;
+
+    PGresult * res = PQexecPrepared(conn, fp_stmts[STORAGE_FP_NEXT], 0, NULL, NULL, NULL, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        LOGE(tag, "command storage_flight_plan_next failed: %s", PQerrorMessage(conn));
+    }
+    else if(PQntuples(res) > 0) {
+        timetodo = atoi(PQgetvalue(res, 0, 0));
+    }
+    PQclear(res);
+    return timetodo;
+}
+
+static int postgres_fp_foreach(int from, int to, fp_visit_t visit, void *arg)
+{
+    if(storage_fp_stmt_init() != 0)
+        return -1;
+
+    // One entry at a time, the table is not copied to memory
+    fp_entry_t entry;
+    int stop = 0, visited = 0;
+    char from_str[12], to_str[12];
+    snprintf(from_str, sizeof(from_str), "%d", from);
+    snprintf(to_str, sizeof(to_str), "%d", to);
+    const char *values[2] = {from_str, to_str};
+    if(!PQsendQueryPrepared(conn, fp_stmts[STORAGE_FP_ITER], 2, values, NULL, NULL, 0) ||
+       !PQsetSingleRowMode(conn))
+    {
+        LOGE(tag, "Flight Plan Postgres Command SELECT failed: %s", PQerrorMessage(conn));
+        while(PQgetResult(conn) != NULL);
+        return -1;
+    }
+
+    // Results must be read until the end, even if the visitor stops
+    PGresult *res;
+    while((res = PQgetResult(conn)) != NULL)
+    {
+        int status = PQresultStatus(res);
+        if(status == PGRES_SINGLE_TUPLE && !stop)
+        {
+            entry.unixtime = atoi(PQgetvalue(res, 0, 0));
+            strncpy(entry.cmd, PQgetvalue(res, 0, 1), SCH_CMD_MAX_STR_NAME-1);
+            entry.cmd[SCH_CMD_MAX_STR_NAME-1] = '\0';
+            strncpy(entry.args, PQgetvalue(res, 0, 2), SCH_CMD_MAX_STR_PARAMS-1);
+            entry.args[SCH_CMD_MAX_STR_PARAMS-1] = '\0';
+            entry.executions = atoi(PQgetvalue(res, 0, 3));
+            entry.periodical = atoi(PQgetvalue(res, 0, 4));
+            entry.ms = atoi(PQgetvalue(res, 0, 5));
+            visited++;
+            stop = visit(&entry, arg);
+        }
+        else if(status != PGRES_SINGLE_TUPLE && status != PGRES_TUPLES_OK)
+        {
+            LOGE(tag, "Flight Plan Postgres Command SELECT failed: %s", PQerrorMessage(conn));
+            visited = -1;
+        }
+        PQclear(res);
+    }
+    return visited;
+}
+
+/* With SCH_STORAGE_PG_PARTITION the payload tables are partitioned by month
+ * of tstz. The partitions of the current and the next month are created at
+ * init and when the month changes, so the inserts never wait for them, rows
+ * out of them go to the default partition. Old partitions are detached, not
+ * dropped, to be archived */
+#if SCH_STORAGE_PG_PARTITION
+static volatile int pg_part_month = -1;    ///< Month of the last partitions check, see storage_psql_month
+
+/**
+ * Current UTC month, as year*12 + month (0-11)
+ */
+static int storage_psql_month(void)
+{
+    time_t now = time(NULL);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    return (tm.tm_year+1900)*12 + tm.tm_mon;
+}
+
+#if SCH_STORAGE_PG_PARTITION_KEEP > 0
+/**
+ * Detach the partitions of @table older than @month.
+ * Returns 0 OK, -1 Error.
+ */
+static int storage_psql_partitions_detach(PGconn *pg_conn, const char *table, int month)
+{
+    // Partition names end with the year and month, they sort by time
+    char first[STORAGE_TABLE_NAME_LEN+16];
+    snprintf(first, sizeof(first), "%s_p%04d%02d", table, month/12, month%12+1);
+    const char *values[2] = {table, first};
+    PGresult *res = PQexecParams(pg_conn, "SELECT c.relname FROM pg_inherits i "
+                                 "JOIN pg_class c ON c.oid = i.inhrelid JOIN pg_class p ON p.oid = i.inhparent "
+                                 "WHERE p.relname = $1 AND left(c.relname, length($1)+2) = $1 || '_p' AND c.relname < $2",
+                                 2, NULL, values, NULL, NULL, 0);
+    if(PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        LOGE(tag, "Failed to list the partitions of table %s. Error: %s", table, PQerrorMessage(pg_conn));
+        PQclear(res);
+        return -1;
+    }
+
+    int i, rc = 0;
+    char sql[SCH_BUFF_MAX_LEN];
+    for(i=0; i < PQntuples(res); i++)
+    {
+        snprintf(sql, sizeof(sql), "ALTER TABLE %s DETACH PARTITION %s", table, PQgetvalue(res, i, 0));
+        LOGI(tag, "SQL command: %s", sql);
+        rc |= storage_psql_command(pg_conn, sql);
+    }
+    PQclear(res);
+    return rc;
+}
+#endif
+
+/**
+ * Create the partitions of @month and the next month, and the default
+ * partition, of every partitioned payload table. Detach the partitions older
+ * than SCH_STORAGE_PG_PARTITION_KEEP months.
+ * Returns 0 OK, -1 Error.
+ */
+static int storage_psql_partitions(PGconn *pg_conn, int month)
+{
+    PGresult *res = PQexec(pg_conn, "SELECT c.relname FROM pg_partitioned_table p JOIN pg_class c ON c.oid = p.partrelid");
+    if(PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        LOGE(tag, "Failed to list the partitioned tables. Error: %s", PQerrorMessage(pg_conn));
+        PQclear(res);
+        return -1;
+    }
+
+    int i, m, rc = 0;
+    char sql[SCH_BUFF_MAX_LEN];
+    for(i=0; i < PQntuples(res); i++)
+    {
+        const char *table = PQgetvalue(res, i, 0);
+        for(m = month; m <= month+1; m++)
+        {
+            snprintf(sql, sizeof(sql), "CREATE TABLE IF NOT EXISTS %s_p%04d%02d PARTITION OF %s "
+                     "FOR VALUES FROM ('%04d-%02d-01 00:00:00+00') TO ('%04d-%02d-01 00:00:00+00')",
+                     table, m/12, m%12+1, table, m/12, m%12+1, (m+1)/12, (m+1)%12+1);
+            rc |= storage_psql_command(pg_conn, sql);
+        }
+        snprintf(sql, sizeof(sql), "CREATE TABLE IF NOT EXISTS %s_default PARTITION OF %s DEFAULT", table, table);
+        rc |= storage_psql_command(pg_conn, sql);
+#if SCH_STORAGE_PG_PARTITION_KEEP > 0
+        rc |= storage_psql_partitions_detach(pg_conn, table, month+1-SCH_STORAGE_PG_PARTITION_KEEP);
+#endif
+    }
+    PQclear(res);
+    return rc;
+}
+#endif
+
+/**
+ * Create the partitions of the new month if it changed since the last check.
+ * Only the first caller of the month creates them.
+ */
+static void storage_psql_partitions_check(PGconn *pg_conn)
+{
+#if SCH_STORAGE_PG_PARTITION
+    int month = storage_psql_month();
+    int last = pg_part_month;
+    if(month != last && __sync_bool_compare_and_swap(&pg_part_month, last, month))
+        storage_psql_partitions(pg_conn, month);
+#endif
+}
+
+/**
+ * Create a payload @table, @indexes also adds the time and id indexes used by
+ * the payload queries. Returns 0 OK, -1 Error.
+ */
+static int storage_psql_payload_create(PGconn *pg_conn, int payload, const char *table, int indexes)
+{
+    char sql[SCH_BUFF_MAX_LEN*4];
+    if(storage_sql_payload_create(payload, table, "DOUBLE PRECISION", sql, sizeof(sql)) != 0)
+        return -1;
+#if SCH_STORAGE_PG_PARTITION
+    // The partition key is part of the primary key, it also indexes the id
+    size_t n = strlen(sql) - 1;
+    if(snprintf(sql+n, sizeof(sql)-n, ", PRIMARY KEY (id, tstz)) PARTITION BY RANGE (tstz)") >= sizeof(sql)-n)
+    {
+        LOGE(tag, "Failed to create table %s. Too many fields", table);
+        return -1;
+    }
+#endif
+    LOGD(tag, "SQL command: %s", sql);
+    if(storage_psql_command(pg_conn, sql) != 0)
+        return -1;
+
+    if(indexes && storage_payload_time_field(payload) != NULL &&
+       storage_sql_payload_time_index(table, sql, sizeof(sql)) == 0)
+        storage_psql_command(pg_conn, sql);
+#if SCH_STORAGE_PG_PARTITION
+    // Rows are appended in tstz order, a BRIN index is a few pages per partition
+    snprintf(sql, sizeof(sql), "CREATE INDEX IF NOT EXISTS %s_tstz ON %s USING BRIN (tstz)", table, table);
+    storage_psql_command(pg_conn, sql);
+#else
+    if(indexes && storage_sql_payload_id_index(table, sql, sizeof(sql)) == 0)
+        storage_psql_command(pg_conn, sql);
+#endif
+    return 0;
+}
+
+/**
+ * Create the partitions of the current month of the new tables
+ */
+static void storage_psql_partitions_init(PGconn *pg_conn)
+{
+#if SCH_STORAGE_PG_PARTITION
+    pg_part_month = storage_psql_month();
+    storage_psql_partitions(pg_conn, pg_part_month);
+#endif
+}
+
+static int postgres_payload_init(int drop)
+{
+    int i;
+    char sql[SCH_BUFF_MAX_LEN*4];
+    if(drop)
+    {
+        for(i=0; i< last_sensor; ++i)
+        {
+            snprintf(sql, sizeof(sql), "DROP TABLE IF EXISTS %s", data_map[i].table);
+            if(storage_psql_command(conn, sql) == 0)
+                LOGD(tag, "Table %s drop successfully", data_map[i].table);
+        }
+    }
+
+    for(i=0; i< last_sensor; ++i)
+    {
+        if(storage_psql_payload_create(conn, i, data_map[i].table, 1) == 0)
+            storage_payload_stmt_init(i);
+    }
+    storage_psql_partitions_init(conn);
+    return 0;
+}
+
+static int postgres_payload_set(int index, void *data, int payload, int n)
+{
+    if(storage_payload_stmt_init(payload) != 0)
+        return -1;
+
+    int rc = 0;
+    storage_pg_t *pg = storage_pg_take();
+    storage_psql_partitions_check(pg->conn);
+    if(n > 1)
+    {
+        // Several rows are loaded with COPY, one round trip for the batch. The
+        // COPY is atomic, no transaction is required
+        rc = storage_psql_copy_payload(pg, data_map[payload].table, index, data, payload, n);
+    }
+    else
+    {
+        const dat_payload_schema_t *schema = dat_get_payload_schema(payload);
+        int j, nparams = schema->nfields;
+        char values_str[nparams+1][32];
+        const char *values[nparams+1];
+        snprintf(values_str[0], sizeof(values_str[0]), "%d", index);
+        values[0] = values_str[0];
+        for(j=0; j < nparams; ++j) {
+            storage_psql_str_value(&schema->fields[j], (char *)data, values_str[j+1], sizeof(values_str[0]));
+            values[j+1] = values_str[j+1];
+        }
+
+        char stmt_name[STORAGE_STMT_NAME_LEN];
+        snprintf(stmt_name, sizeof(stmt_name), "payload_%d", payload);
+        PGresult *res = storage_psql_exec(pg->conn, stmt_name, nparams+1, values);
+        if (PQresultStatus(res) != PGRES_COMMAND_OK)
+        {
+            LOGE(tag, "command INSERT failed: %s", PQerrorMessage(pg->conn));
+            rc = -1;
+        }
+        PQclear(res);
+    }
+    storage_pg_give(pg);
+    return rc;
+}
+
+/**
+ * Copy the rows of a payload range select to their position in @data in index
+ * order, missing rows are zeroed
+ * @return Number of rows found
+ */
+static int storage_psql_get_rows(PGresult *res, int index, int count, void *data, int payload)
+{
+    const dat_payload_schema_t *schema = dat_get_payload_schema(payload);
+    int size = data_map[payload].size;
+    memset(data, 0, count*size);
+
+    int j, n = 0, row, rows = PQntuples(res);
+    for(row=0; row < rows; row++)
+    {
+        int pos = atoi(PQgetvalue(res, row, 0)) - index;
+        if(pos < 0 || pos >= count)
+            continue;
+        char *sample = (char *)data + pos*size;
+        for(j=0; j < schema->nfields; ++j)
+            storage_psql_get_value(&schema->fields[j], sample, res, row, j+1);
+        n++;
+    }
+    return n;
+}
+
+static int postgres_payload_get_range(int index, int count, void *data, int payload)
+{
+    if(storage_payload_stmt_init(payload) != 0)
+        return -1;
+
+    char start_str[12], end_str[12];
+    snprintf(start_str, sizeof(start_str), "%d", index);
+    snprintf(end_str, sizeof(end_str), "%d", index+count-1);
+    const char *values[2] = {start_str, end_str};
+    char stmt_name[STORAGE_STMT_NAME_LEN];
+    snprintf(stmt_name, sizeof(stmt_name), "payload_r_%d", payload);
+    storage_pg_t *pg = storage_pg_take();
+    PGresult *res = storage_psql_exec(pg->conn, stmt_name, 2, values);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        LOGE(tag, "command storage_get_payload_data_range failed: %s", PQerrorMessage(pg->conn));
+        PQclear(res);
+        storage_pg_give(pg);
+        return -1;
+    }
+
+    int n = storage_psql_get_rows(res, index, count, data, payload);
+    PQclear(res);
+    storage_pg_give(pg);
+    return n;
+}
+
+static int postgres_payload_find_time(uint32_t timestamp, int payload, int next)
+{
+    if(storage_payload_stmt_init(payload) != 0 || storage_payload_time_field(payload) == NULL)
+        return -1;
+
+    char time_str[12], next_str[12];
+    snprintf(time_str, sizeof(time_str), "%u", (unsigned int)timestamp);
+    snprintf(next_str, sizeof(next_str), "%d", next);
+    const char *values[2] = {time_str, next_str};
+    char stmt_name[STORAGE_STMT_NAME_LEN];
+    snprintf(stmt_name, sizeof(stmt_name), "payload_t_%d", payload);
+    storage_pg_t *pg = storage_pg_take();
+    PGresult *res = storage_psql_exec(pg->conn, stmt_name, 2, values);
+    int index = -1;
+    if (PQresultStatus(res) == PGRES_TUPLES_OK)
+        index = PQntuples(res) > 0 ? atoi(PQgetvalue(res, 0, 0)) : next;
+    else
+        LOGE(tag, "command storage_get_payload_index_time failed: %s", PQerrorMessage(pg->conn));
+    PQclear(res);
+    storage_pg_give(pg);
+    return index;
+}
+
+static int postgres_payload_trim(int payload, int end, int max)
+{
+    char delete_rows[SCH_BUFF_MAX_LEN];
+    if(storage_sql_payload_trim(data_map[payload].table, "$%d", delete_rows, sizeof(delete_rows)) != 0)
+        return -1;
+
+    // The dead rows are reclaimed by the server autovacuum
+    char end_str[12], max_str[12];
+    snprintf(end_str, sizeof(end_str), "%d", end);
+    snprintf(max_str, sizeof(max_str), "%d", max);
+    const char *values[2] = {end_str, max_str};
+    storage_pg_t *pg = storage_pg_take();
+    PGresult *res = PQexecParams(pg->conn, delete_rows, 2, NULL, values, NULL, NULL, 0);
+    int n = -1;
+    if(PQresultStatus(res) == PGRES_COMMAND_OK)
+        n = atoi(PQcmdTuples(res));
+    else
+        LOGE(tag, "Failed to trim table %s: %s", data_map[payload].table, PQerrorMessage(pg->conn));
+    PQclear(res);
+    storage_pg_give(pg);
+    return n;
+}
+
+static int postgres_node_table_init(const char *table, int payload)
+{
+    char select_next[SCH_BUFF_MAX_LEN];
+    snprintf(select_next, sizeof(select_next), "SELECT COALESCE(MAX(id)+1, 0) FROM %s", table);
+
+    // The next index continues after the samples already stored
+    int next = -1;
+    storage_pg_t *pg = storage_pg_take();
+    if(storage_psql_payload_create(pg->conn, payload, table, 0) == 0)
+    {
+        storage_psql_partitions_init(pg->conn);
+        PGresult *res = PQexec(pg->conn, select_next);
+        if(PQresultStatus(res) == PGRES_TUPLES_OK && PQntuples(res) == 1)
+            next = atoi(PQgetvalue(res, 0, 0));
+        else
+            LOGE(tag, "Failed to get the next index of table %s. Error: %s", table, PQerrorMessage(pg->conn));
+        PQclear(res);
+    }
+    storage_pg_give(pg);
+    return next;
+}
+
+static int postgres_node_table_set(const char *table, int index, void *data, int payload, int n)
+{
+    storage_pg_t *pg = storage_pg_take();
+    storage_psql_partitions_check(pg->conn);
+    int rc = storage_psql_copy_payload(pg, table, index, data, payload, n);
+    storage_pg_give(pg);
+    return rc;
+}
+
+static int postgres_node_table_get(const char *table, int index, int count, void *data, int payload)
+{
+    char select_range[SCH_BUFF_MAX_LEN*4];
+    if(storage_sql_payload_select(payload, table, "$%d", select_range, sizeof(select_range)) != 0)
+        return -1;
+
+    char start_str[12], end_str[12];
+    snprintf(start_str, sizeof(start_str), "%d", index);
+    snprintf(end_str, sizeof(end_str), "%d", index+count-1);
+    const char *values[2] = {start_str, end_str};
+    storage_pg_t *pg = storage_pg_take();
+    PGresult *res = PQexecParams(pg->conn, select_range, 2, NULL, values, NULL, NULL, 0);
+    int n = -1;
+    if(PQresultStatus(res) == PGRES_TUPLES_OK)
+        n = storage_psql_get_rows(res, index, count, data, payload);
+    else
+        LOGE(tag, "Failed to select from table %s. Error: %s", table, PQerrorMessage(pg->conn));
+    PQclear(res);
+    storage_pg_give(pg);
+    return n;
+}
+
+const storage_backend_t storage_backend_postgres = {
+    .name = "PostgreSQL",
+    .init = postgres_init,
+    .close = postgres_close,
+    .begin = postgres_begin,
+    .end = postgres_end,
+    .repo_init = postgres_repo_init,
+    .repo_get_value = postgres_repo_get_value,
+    .repo_get_values = postgres_repo_get_values,
+    .repo_set_value = postgres_repo_set_value,
+    .repo_set_values = postgres_repo_set_values,
+    .fp_init = postgres_fp_init,
+    .fp_set = postgres_fp_set,
+    .fp_get = postgres_fp_get,
+    .fp_update = postgres_fp_update,
+    .fp_erase = postgres_fp_erase,
+    .fp_next = postgres_fp_next,
+    .fp_foreach = postgres_fp_foreach,
+    .fp_sorted = 1,
+    .payload_init = postgres_payload_init,
+    .payload_set = postgres_payload_set,
+    .payload_get_range = postgres_payload_get_range,
+    .payload_find_time = postgres_payload_find_time,
+    .payload_trim = postgres_payload_trim,
+    .node_table_init = postgres_node_table_init,
+    .node_table_set = postgres_node_table_set,
+    .node_table_get = postgres_node_table_get,
+};
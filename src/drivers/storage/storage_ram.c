@@ -0,0 +1,299 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *      Copyright 2020, Camilo Rojas Milla, camrojas@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * SCH_STORAGE_MODE == 0. Payloads are stored in SCH_SECTIONS_PER_PAYLOAD
+ * memory sections of SCH_SIZE_PER_SECTION bytes per payload, used as a ring
+ * once the oldest samples are trimmed (see storage_trim_payload_data).
+ * Sections are allocated when the first sample is written to them and freed
+ * once all their samples are trimmed. Status variables and the flight plan
+ * are kept by repoData, the flight plan is persisted with the journal
+ * functions at the end of this file. With SCH_STORAGE_CRC each section keeps
+ * the CRC32C of its samples after the samples, checked when they are read.
+ */
+#define LOG_TAG_ID LOG_TAG_DATA
+#include "storage_backend.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+static const char *tag = "storage_ram";
+
+static uint8_t **storage_addresses = NULL;  // Payload memory sections, NULL until written
+static int ram_first[last_sensor];          // Index of the oldest sample kept of each payload
+static int ram_next[last_sensor];           // Index after the newest sample written of each payload
+
+#if SCH_STORAGE_CRC
+#define RAM_SECTION_LEN(pps)    (SCH_SIZE_PER_SECTION + (pps)*sizeof(uint32_t))  // Samples and their CRC
+#else
+#define RAM_SECTION_LEN(pps)    (SCH_SIZE_PER_SECTION)
+#endif
+
+/**
+ * Get the address of a payload sample and the number of consecutive samples
+ * that can be accessed from there (until the end of the memory section). A
+ * sample is stored in the slot of a trimmed sample only. The section is
+ * allocated if @alloc, otherwise *add is NULL if it was not written yet.
+ * *crc is set to the CRC of the sample, NULL without SCH_STORAGE_CRC or if
+ * the section was not written yet.
+ * Returns 0 OK, -1 if the index is out of bounds or the allocation failed.
+ */
+static int ram_payload_address(int index, int payload, int alloc, uint8_t **add, uint32_t **crc, int *run)
+{
+    int size = data_map[payload].size;
+    int payloads_per_section = SCH_SIZE_PER_SECTION/size;
+    int capacity = payloads_per_section*SCH_SECTIONS_PER_PAYLOAD;
+    int first = ram_first[payload];
+    if(storage_addresses == NULL || index < first || index - first >= capacity)
+    {
+        LOGE(tag, "Payload index: %d is out of bounds", index);
+        return -1;
+    }
+    int slot = index%capacity;
+    int index_in_section = slot%payloads_per_section;
+    uint8_t **section = &storage_addresses[payload*SCH_SECTIONS_PER_PAYLOAD + slot/payloads_per_section];
+    if(*section == NULL && alloc)
+    {
+        *section = (uint8_t *)sch_calloc(MEM_STORAGE, 1, RAM_SECTION_LEN(payloads_per_section));
+        if(*section == NULL)
+        {
+            LOGE(tag, "Unable to allocate payload %d memory section", payload);
+            return -1;
+        }
+    }
+    *run = payloads_per_section - index_in_section;
+    if(*run > first + capacity - index)
+        *run = first + capacity - index;
+    *add = *section == NULL ? NULL : *section + index_in_section*size;
+#if SCH_STORAGE_CRC
+    *crc = *section == NULL ? NULL : (uint32_t *)(*section + SCH_SIZE_PER_SECTION) + index_in_section;
+#else
+    *crc = NULL;
+#endif
+    return 0;
+}
+
+/**
+ * Free the memory sections of a payload
+ */
+static void ram_payload_free(int payload)
+{
+    int i;
+    for(i = 0; i < SCH_SECTIONS_PER_PAYLOAD; i++)
+    {
+        sch_free(storage_addresses[payload*SCH_SECTIONS_PER_PAYLOAD + i]);
+        storage_addresses[payload*SCH_SECTIONS_PER_PAYLOAD + i] = NULL;
+    }
+    ram_first[payload] = ram_next[payload] = 0;
+}
+
+static int ram_init(const char *file)
+{
+    return 0;
+}
+
+static int ram_close(void)
+{
+    int i;
+    for(i = 0; storage_addresses != NULL && i < last_sensor; i++)
+        ram_payload_free(i);
+    sch_free(storage_addresses);
+    storage_addresses = NULL;
+    return 0;
+}
+
+static int ram_payload_init(int drop)
+{
+    int i;
+    if(storage_addresses == NULL)
+        storage_addresses = (uint8_t **)sch_calloc(MEM_STORAGE, SCH_SECTIONS_PER_PAYLOAD*last_sensor, sizeof(uint8_t *));
+    if(storage_addresses == NULL)
+        return -1;
+    // Sections are allocated by the first write
+    for(i = 0; drop && i < last_sensor; i++)
+        ram_payload_free(i);
+    return 0;
+}
+
+static int ram_payload_set(int index, void *data, int payload, int n)
+{
+    // Copy the consecutive samples of each memory section at once
+    int size = data_map[payload].size;
+    int i = 0, k, run;
+    uint8_t *add;
+    uint32_t *crc;
+    while(i < n)
+    {
+        if(ram_payload_address(index+i, payload, 1, &add, &crc, &run) != 0)
+            return -1;
+        if(run > n - i)
+            run = n - i;
+        LOGV(tag, "Writing in address: %p, %d bytes", add, run*size);
+        memcpy(add, (uint8_t *)data + i*size, run*size);
+        for(k = 0; crc != NULL && k < run; k++)
+            crc[k] = storage_record_crc((uint8_t *)data + (i+k)*size, size);
+        i += run;
+    }
+    if(index + n > ram_next[payload])
+        ram_next[payload] = index + n;
+    return 0;
+}
+
+static int ram_payload_get_range(int index, int count, void *data, int payload)
+{
+    // Copy the consecutive samples of each memory section at once, the
+    // samples of sections not written yet are zeroed
+    int size = data_map[payload].size;
+    int n = 0, k, run;
+    uint8_t *add;
+    uint32_t *crc;
+    while(n < count)
+    {
+        if(ram_payload_address(index+n, payload, 0, &add, &crc, &run) != 0)
+            return n > 0 ? n : -1;
+        if(run > count - n)
+            run = count - n;
+        LOGV(tag, "Reading in address: %p, %d bytes", add, run*size);
+        if(add != NULL)
+        {
+            memcpy((uint8_t *)data + n*size, add, run*size);
+            for(k = 0; crc != NULL && k < run; k++)
+                storage_record_check(payload, index+n+k, (uint8_t *)data + (n+k)*size, size, crc[k]);
+        }
+        else
+            memset((uint8_t *)data + n*size, 0, run*size);
+        n += run;
+    }
+    return n;
+}
+
+static int ram_payload_first(int payload, int next)
+{
+    return ram_first[payload];
+}
+
+static int ram_payload_trim(int payload, int end, int max)
+{
+    // The slots of the trimmed samples store the next samples
+    int n = end - ram_first[payload];
+    if(n <= 0)
+        return 0;
+    if(n > max)
+        n = max;
+    int payloads_per_section = SCH_SIZE_PER_SECTION/data_map[payload].size;
+    int block = ram_first[payload]/payloads_per_section;
+    ram_first[payload] += n;
+
+    // Free the sections of the blocks trimmed, unless they also hold samples
+    // still kept (the blocks from first to next)
+    int first_block = ram_first[payload]/payloads_per_section;
+    int live = ram_next[payload] > ram_first[payload] ?
+               (ram_next[payload]-1)/payloads_per_section - first_block + 1 : 0;
+    for(; block < first_block && live < SCH_SECTIONS_PER_PAYLOAD; block++)
+    {
+        int section = block%SCH_SECTIONS_PER_PAYLOAD;
+        if((section - first_block%SCH_SECTIONS_PER_PAYLOAD + SCH_SECTIONS_PER_PAYLOAD)%SCH_SECTIONS_PER_PAYLOAD < live)
+            continue;
+        sch_free(storage_addresses[payload*SCH_SECTIONS_PER_PAYLOAD + section]);
+        storage_addresses[payload*SCH_SECTIONS_PER_PAYLOAD + section] = NULL;
+    }
+    return n;
+}
+
+const storage_backend_t storage_backend_ram = {
+    .name = "RAM",
+    .init = ram_init,
+    .close = ram_close,
+    .payload_init = ram_payload_init,
+    .payload_set = ram_payload_set,
+    .payload_get_range = ram_payload_get_range,
+    .payload_first = ram_payload_first,
+    .payload_trim = ram_payload_trim,
+};
+
+/*
+ * Flight plan journal of the RAM storage mode (see dat_repo_init). The journal
+ * is a plain file, appended with write and replaced with a new file and
+ * rename, so a reset while compacting keeps the previous journal.
+ */
+static int fp_journal_fd = -1;
+static char fp_journal_file[128];
+
+int storage_fp_journal_init(const char *file)
+{
+    if(fp_journal_fd >= 0)
+        close(fp_journal_fd);
+    strncpy(fp_journal_file, file, sizeof(fp_journal_file)-1);
+    fp_journal_file[sizeof(fp_journal_file)-1] = '\0';
+    fp_journal_fd = open(fp_journal_file, O_RDWR | O_CREAT, 0644);
+    if(fp_journal_fd < 0)
+    {
+        LOGE(tag, "Unable to open flight plan journal %s. Error: %s", fp_journal_file, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int storage_fp_journal_read(int offset, void *data, int len)
+{
+    if(fp_journal_fd < 0)
+        return -1;
+    ssize_t rc = pread(fp_journal_fd, data, (size_t)len, offset);
+    return rc < 0 ? -1 : (int)rc;
+}
+
+int storage_fp_journal_append(const void *data, int len)
+{
+    if(fp_journal_fd < 0)
+        return -1;
+    off_t end = lseek(fp_journal_fd, 0, SEEK_END);
+    if(end < 0 || write(fp_journal_fd, data, (size_t)len) != len || fdatasync(fp_journal_fd) != 0)
+    {
+        LOGE(tag, "Unable to append to flight plan journal. Error: %s", strerror(errno));
+        // Drop a partial record, the journal is compacted next
+        if(end >= 0 && ftruncate(fp_journal_fd, end) != 0)
+            LOGW(tag, "Unable to truncate flight plan journal");
+        return -1;
+    }
+    return 0;
+}
+
+int storage_fp_journal_rewrite(const void *data, int len)
+{
+    char tmp_file[sizeof(fp_journal_file)+4];
+    snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", fp_journal_file);
+    int fd = open(tmp_file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        LOGE(tag, "Unable to create flight plan journal %s. Error: %s", tmp_file, strerror(errno));
+        return -1;
+    }
+    if(write(fd, data, (size_t)len) != len || fsync(fd) != 0 || rename(tmp_file, fp_journal_file) != 0)
+    {
+        LOGE(tag, "Unable to compact flight plan journal. Error: %s", strerror(errno));
+        close(fd);
+        unlink(tmp_file);
+        return -1;
+    }
+    if(fp_journal_fd >= 0)
+        close(fp_journal_fd);
+    fp_journal_fd = fd;
+    return 0;
+}
@@ -0,0 +1,1410 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *      Copyright 2020, Camilo Rojas Milla, camrojas@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * SCH_STORAGE_MODE == 1. Status repository, flight plan and payloads are
+ * stored in a SQLite database file.
+ */
+#define LOG_TAG_ID LOG_TAG_DATA
+#include "storage_backend.h"
+#include <sqlite3.h>
+#include "osQueue.h"
+
+static const char *tag = "storage_sqlite";
+
+static sqlite3 *db = NULL;
+
+/* Read-only connections, only with the Ops (WAL) profile. Payload range reads
+ * and the flight plan listing take one of them, so they read the last commit
+ * while db writes and do not need the repository mutex (see
+ * storage_read_concurrent). Statements are prepared per connection. */
+#if SCH_STORAGE_SQLITE_PROFILE == 1 && SCH_STORAGE_SQLITE_READERS > 0
+    #define STORAGE_SQLITE_READERS  SCH_STORAGE_SQLITE_READERS
+#else
+    #define STORAGE_SQLITE_READERS  (0)
+#endif
+
+#define STORAGE_SQLITE_BUSY_MS      (1000)  ///< Max. time a reader waits for a locked database
+
+typedef struct storage_sqlite_reader {
+    sqlite3 *db;                            ///< Read-only connection
+    sqlite3_stmt *payload_range[last_sensor];
+    sqlite3_stmt *fp_iter;
+} storage_sqlite_reader_t;
+#if STORAGE_SQLITE_READERS > 0
+static storage_sqlite_reader_t sqlite_readers[STORAGE_SQLITE_READERS];
+static osQueue sqlite_readers_free = 0;     ///< Free readers (storage_sqlite_reader_t *)
+static int sqlite_readers_ok = 0;           ///< Readers are open
+#endif
+
+/* Prepared statements cache. Statements are prepared once, when the tables
+ * are initialized, and reused binding the new values. */
+#define STORAGE_REPO_TABLES     (4)     ///< Max. status repo tables with prepared statements
+
+/* Status repo tables keep one row per variable, with the three copies of
+ * tripled writing in the value columns. The copy c of the variable idx is
+ * accessed by index idx + c*dat_status_last_address (see sqlite_repo_cell). */
+#if SCH_STORAGE_TRIPLE_WR == 1
+    #define STORAGE_REPO_COPIES     (3)
+#else
+    #define STORAGE_REPO_COPIES     (1)
+#endif
+
+static const char *repo_columns[3] = {"value", "value_2", "value_3"};
+
+typedef struct storage_repo_stmt {
+    char table[STORAGE_TABLE_NAME_LEN];     ///< Status repo table name
+    sqlite3_stmt *get;                      ///< Get the values of a row by index
+    sqlite3_stmt *get_range;                ///< Get the values of the rows in an index range
+    sqlite3_stmt *set[STORAGE_REPO_COPIES]; ///< Set one value of a row by index
+    sqlite3_stmt *set_copies;               ///< Set all the values of a row by index
+    sqlite3_stmt *add;                      ///< Add an empty row
+} storage_repo_stmt_t;
+
+typedef enum storage_fp_op {
+    STORAGE_FP_SET = 0,                     ///< Insert an entry after the entries with the same time
+    STORAGE_FP_GET,                         ///< Get the first entry of a time
+    STORAGE_FP_ERASE,                       ///< Delete the first entry of a time
+    STORAGE_FP_NEXT,                        ///< Get the time of the earliest entry
+    STORAGE_FP_UPDATE,                      ///< Move the first entry of a time to a new time
+    STORAGE_FP_ITER,                        ///< Get the entries in a time range, sorted
+    STORAGE_FP_LAST
+} storage_fp_op_t;
+
+#define STORAGE_FP_ITER_SQL "SELECT time, command, args, executions, periodical, ms FROM %s WHERE time >= ?1 AND time <= ?2 ORDER BY time, ms, seq;"
+/* Entries with the same time are kept in upload order by seq. The first entry
+ * of a time is the one with the lowest ms, then seq */
+#define STORAGE_FP_FIRST_SQL "(SELECT seq FROM %s WHERE time = ?1 ORDER BY ms, seq LIMIT 1)"
+
+static storage_repo_stmt_t repo_stmts[STORAGE_REPO_TABLES];
+static int repo_stmts_len = 0;
+static sqlite3_stmt *fp_stmts[STORAGE_FP_LAST];
+static sqlite3_stmt *payload_stmts[last_sensor];
+static sqlite3_stmt *payload_range_stmts[last_sensor];
+static sqlite3_stmt *payload_time_stmts[last_sensor];     ///< NULL if the payload is not timestamped
+
+/* Durability profiles (SCH_STORAGE_SQLITE_PROFILE). The journal mode is set
+ * for the database when it is opened, the synchronous level can be changed
+ * per table group (SCH_STORAGE_SQLITE_SYNC_*) before each write. */
+typedef enum storage_sqlite_group {
+    STORAGE_SQLITE_REPO = 0,                ///< Status repo tables
+    STORAGE_SQLITE_FP,                      ///< Flight plan table
+    STORAGE_SQLITE_PAYLOAD,                 ///< Payload tables, including other nodes
+    STORAGE_SQLITE_GROUPS
+} storage_sqlite_group_t;
+
+#if SCH_STORAGE_SQLITE_PROFILE == 1
+    #define STORAGE_SQLITE_SYNC     (1)     ///< NORMAL, commits are durable after the next checkpoint
+#elif SCH_STORAGE_SQLITE_PROFILE == 2
+    #define STORAGE_SQLITE_SYNC     (3)     ///< EXTRA, also syncs the directory after deleting the journal
+#else
+    #define STORAGE_SQLITE_SYNC     (2)     ///< FULL, the SQLite default
+#endif
+
+static const int sqlite_group_sync[STORAGE_SQLITE_GROUPS] = {
+    SCH_STORAGE_SQLITE_SYNC_REPO, SCH_STORAGE_SQLITE_SYNC_FP, SCH_STORAGE_SQLITE_SYNC_PAYLOAD
+};
+static int sqlite_sync_level = -1;          ///< Current synchronous level of the connection
+
+static int sqlite_begin(void);
+static int sqlite_end(int commit);
+
+/**
+ * Execute a SQL command without results. Returns 0 OK, -1 Error.
+ */
+static int sqlite_exec(const char *sql, const char *table)
+{
+    char *err_msg;
+    if(sqlite3_exec(db, sql, 0, 0, &err_msg) != SQLITE_OK)
+    {
+        LOGE(tag, "Failed command in table %s. Error: %s. SQL: %s", table, err_msg, sql);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Set the synchronous level of the writes to a table group. The level can
+ * not change inside a transaction, so it is set before beginning it.
+ */
+static void sqlite_sync_group(storage_sqlite_group_t group)
+{
+    int level = sqlite_group_sync[group] < 0 ? STORAGE_SQLITE_SYNC : sqlite_group_sync[group];
+    if(level == sqlite_sync_level || !sqlite3_get_autocommit(db))
+        return;
+
+    char sql[32];
+    snprintf(sql, sizeof(sql), "PRAGMA synchronous=%d;", level);
+    if(sqlite_exec(sql, "main") == 0)
+        sqlite_sync_level = level;
+}
+
+/**
+ * Apply the durability profile to the opened database. Returns 0 OK, -1 Error.
+ */
+static int sqlite_profile_init(void)
+{
+    sqlite_sync_level = -1;
+#if SCH_STORAGE_SQLITE_PROFILE == 1
+    // Writers append to the WAL, pages are copied to the database by the
+    // checkpoints of storage_sync (drp_sync housekeeping job)
+    char sql[SCH_BUFF_MAX_LEN];
+    snprintf(sql, sizeof(sql), "PRAGMA journal_mode=WAL; PRAGMA wal_autocheckpoint=%d; "
+             "PRAGMA cache_size=-%d; PRAGMA mmap_size=%ld;",
+             SCH_STORAGE_SQLITE_WAL_PAGES, SCH_STORAGE_SQLITE_CACHE_KB, (long)SCH_STORAGE_SQLITE_MMAP);
+    if(sqlite_exec(sql, "main") != 0)
+        return -1;
+#elif SCH_STORAGE_SQLITE_PROFILE == 2
+    // Leave WAL if the database was used with the Ops profile before
+    if(sqlite_exec("PRAGMA journal_mode=DELETE;", "main") != 0)
+        return -1;
+#endif
+    sqlite_sync_group(STORAGE_SQLITE_REPO);
+    LOGD(tag, "Durability profile %d, synchronous %d", SCH_STORAGE_SQLITE_PROFILE, sqlite_sync_level);
+    return 0;
+}
+
+/**
+ * Get the prepared statements of a status repo table, preparing them the
+ * first time the table is used. Returns NULL if the statements can not be
+ * prepared.
+ */
+static storage_repo_stmt_t *storage_repo_stmt(char *table)
+{
+    int i;
+    for(i=0; i<repo_stmts_len; i++)
+    {
+        if(strncmp(repo_stmts[i].table, table, STORAGE_TABLE_NAME_LEN) == 0)
+            return &repo_stmts[i];
+    }
+
+    if(repo_stmts_len >= STORAGE_REPO_TABLES || strlen(table) >= STORAGE_TABLE_NAME_LEN)
+    {
+        LOGE(tag, "Unable to prepare statements for table %s", table);
+        return NULL;
+    }
+
+    storage_repo_stmt_t *stmts = &repo_stmts[repo_stmts_len];
+    memset(stmts, 0, sizeof(storage_repo_stmt_t));
+    strncpy(stmts->table, table, STORAGE_TABLE_NAME_LEN);
+    // Copies never written (a table used without tripled writing) read as
+    // the first value
+    char *sql[STORAGE_REPO_COPIES+4];
+    sql[0] = sqlite3_mprintf("SELECT value, COALESCE(value_2, value), COALESCE(value_3, value) "
+                             "FROM %s WHERE idx=?1;", table);
+    sql[1] = sqlite3_mprintf("SELECT idx, value, COALESCE(value_2, value), COALESCE(value_3, value) "
+                             "FROM %s WHERE idx BETWEEN ?1 AND ?2;", table);
+    sql[2] = sqlite3_mprintf("UPDATE %s SET value=?2, value_2=?2, value_3=?2 WHERE idx=?1;", table);
+    sql[3] = sqlite3_mprintf("INSERT OR IGNORE INTO %s (idx) VALUES (?1);", table);
+    int rc;
+    for(i=0; i<STORAGE_REPO_COPIES; i++)
+        sql[4+i] = sqlite3_mprintf("UPDATE %s SET %s=?2 WHERE idx=?1;", table, repo_columns[i]);
+
+    rc = sqlite3_prepare_v2(db, sql[0], -1, &stmts->get, 0);
+    if(rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(db, sql[1], -1, &stmts->get_range, 0);
+    if(rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(db, sql[2], -1, &stmts->set_copies, 0);
+    if(rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(db, sql[3], -1, &stmts->add, 0);
+    for(i=0; i<STORAGE_REPO_COPIES && rc == SQLITE_OK; i++)
+        rc = sqlite3_prepare_v2(db, sql[4+i], -1, &stmts->set[i], 0);
+    for(i=0; i<STORAGE_REPO_COPIES+4; i++)
+        sqlite3_free(sql[i]);
+    if(rc != SQLITE_OK)
+    {
+        LOGE(tag, "Failed to prepare statements for table %s. Error: %s", table, sqlite3_errmsg(db));
+        sqlite3_finalize(stmts->get);
+        sqlite3_finalize(stmts->get_range);
+        sqlite3_finalize(stmts->set_copies);
+        sqlite3_finalize(stmts->add);
+        for(i=0; i<STORAGE_REPO_COPIES; i++)
+            sqlite3_finalize(stmts->set[i]);
+        memset(stmts, 0, sizeof(storage_repo_stmt_t));
+        return NULL;
+    }
+    repo_stmts_len++;
+    return stmts;
+}
+
+/**
+ * Prepare the flight plan statements, if not prepared yet.
+ * Returns 0 OK, -1 Error.
+ */
+static int storage_fp_stmt_init(void)
+{
+    if(fp_stmts[STORAGE_FP_SET] != NULL)
+        return 0;
+
+    char *sql[STORAGE_FP_LAST];
+    sql[STORAGE_FP_SET] = sqlite3_mprintf("INSERT INTO %s (time, seq, command, args, executions, periodical, ms) "
+                                          "VALUES (?1, (SELECT COALESCE(MAX(seq)+1, 0) FROM %s WHERE time = ?1), "
+                                          "?2, ?3, ?4, ?5, ?6);", STORAGE_FP_TABLE, STORAGE_FP_TABLE);
+    sql[STORAGE_FP_GET] = sqlite3_mprintf("SELECT command, args, executions, periodical, ms FROM %s "
+                                          "WHERE time = ?1 ORDER BY ms, seq LIMIT 1;", STORAGE_FP_TABLE);
+    sql[STORAGE_FP_ERASE] = sqlite3_mprintf("DELETE FROM %s WHERE time = ?1 AND seq = " STORAGE_FP_FIRST_SQL ";",
+                                            STORAGE_FP_TABLE, STORAGE_FP_TABLE);
+    sql[STORAGE_FP_NEXT] = sqlite3_mprintf("SELECT time FROM %s ORDER BY time LIMIT 1;", STORAGE_FP_TABLE);
+    sql[STORAGE_FP_UPDATE] = sqlite3_mprintf("UPDATE %s SET time = ?2, executions = ?3, "
+                                             "seq = (SELECT COALESCE(MAX(seq)+1, 0) FROM %s WHERE time = ?2) "
+                                             "WHERE time = ?1 AND seq = " STORAGE_FP_FIRST_SQL ";",
+                                             STORAGE_FP_TABLE, STORAGE_FP_TABLE, STORAGE_FP_TABLE);
+    sql[STORAGE_FP_ITER] = sqlite3_mprintf(STORAGE_FP_ITER_SQL, STORAGE_FP_TABLE);
+
+    int i, rc = SQLITE_OK;
+    for(i=0; i<STORAGE_FP_LAST; i++)
+    {
+        if(rc == SQLITE_OK)
+            rc = sqlite3_prepare_v2(db, sql[i], -1, &fp_stmts[i], 0);
+        sqlite3_free(sql[i]);
+    }
+
+    if(rc != SQLITE_OK)
+    {
+        LOGE(tag, "Failed to prepare statements for table %s. Error: %s", STORAGE_FP_TABLE, sqlite3_errmsg(db));
+        for(i=0; i<STORAGE_FP_LAST; i++)
+        {
+            sqlite3_finalize(fp_stmts[i]);
+            fp_stmts[i] = NULL;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Prepare the insert and range select statements of a payload table, if not
+ * prepared yet. Returns 0 OK, -1 Error.
+ */
+static int storage_payload_stmt_init(int payload)
+{
+    if(payload_stmts[payload] != NULL)
+        return 0;
+
+    char insert_row[SCH_BUFF_MAX_LEN*4];
+    char select_range[SCH_BUFF_MAX_LEN*4];
+    if(storage_sql_payload_insert(payload, data_map[payload].table, "?%d", insert_row, sizeof(insert_row)) != 0 ||
+       storage_sql_payload_select(payload, data_map[payload].table, "?%d", select_range, sizeof(select_range)) != 0)
+        return -1;
+    LOGD(tag, "Prepared SQL command: %s", insert_row);
+    LOGD(tag, "Prepared SQL command: %s", select_range);
+
+    int rc = sqlite3_prepare_v2(db, insert_row, -1, &payload_stmts[payload], 0);
+    if(rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(db, select_range, -1, &payload_range_stmts[payload], 0);
+    if(rc == SQLITE_OK && storage_payload_time_field(payload) != NULL)
+    {
+        if(storage_sql_payload_time(data_map[payload].table, "?%d", select_range, sizeof(select_range)) != 0)
+            rc = SQLITE_ERROR;
+        else
+            rc = sqlite3_prepare_v2(db, select_range, -1, &payload_time_stmts[payload], 0);
+    }
+    if(rc != SQLITE_OK)
+    {
+        LOGE(tag, "Failed to prepare statements for table %s. Error: %s", data_map[payload].table, sqlite3_errmsg(db));
+        sqlite3_finalize(payload_stmts[payload]);
+        sqlite3_finalize(payload_range_stmts[payload]);
+        payload_stmts[payload] = NULL;
+        payload_range_stmts[payload] = NULL;
+        payload_time_stmts[payload] = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Release all prepared statements
+ */
+static void storage_stmt_close(void)
+{
+    int i, j;
+    for(i=0; i<repo_stmts_len; i++)
+    {
+        sqlite3_finalize(repo_stmts[i].get);
+        sqlite3_finalize(repo_stmts[i].get_range);
+        sqlite3_finalize(repo_stmts[i].set_copies);
+        sqlite3_finalize(repo_stmts[i].add);
+        for(j=0; j<STORAGE_REPO_COPIES; j++)
+            sqlite3_finalize(repo_stmts[i].set[j]);
+    }
+    for(i=0; i<STORAGE_FP_LAST; i++)
+    {
+        sqlite3_finalize(fp_stmts[i]);
+        fp_stmts[i] = NULL;
+    }
+    for(i=0; i<last_sensor; i++)
+    {
+        sqlite3_finalize(payload_stmts[i]);
+        sqlite3_finalize(payload_range_stmts[i]);
+        sqlite3_finalize(payload_time_stmts[i]);
+        payload_stmts[i] = NULL;
+        payload_range_stmts[i] = NULL;
+        payload_time_stmts[i] = NULL;
+    }
+    memset(repo_stmts, 0, sizeof(repo_stmts));
+    repo_stmts_len = 0;
+}
+
+static void storage_bind_sqlite_value(const dat_payload_field_t *field, const char *sample, sqlite3_stmt *stmt, int j)
+{
+    float f;
+    double d;
+    switch(field->type)
+    {
+        case DAT_FIELD_FLOAT:
+            memcpy(&f, sample + field->offset, sizeof(f));
+            if(storage_field_is_null(field, sample))
+                sqlite3_bind_null(stmt, j);
+            else
+                sqlite3_bind_double(stmt, j, f);
+            break;
+        case DAT_FIELD_DOUBLE:
+            memcpy(&d, sample + field->offset, sizeof(d));
+            sqlite3_bind_double(stmt, j, d);
+            break;
+        default:
+            sqlite3_bind_int64(stmt, j, storage_field_int(field, sample));
+            break;
+    }
+}
+
+static void storage_get_sqlite_value(const dat_payload_field_t *field, void* sample, sqlite3_stmt* stmt, int j)
+{
+    char *ptr = (char *)sample + field->offset;
+    if(field->type == DAT_FIELD_FLOAT) {
+        float val = (float) sqlite3_column_double(stmt, j);
+        if(sqlite3_column_type(stmt, j) == SQLITE_NULL)
+            memset(ptr, 0xFF, sizeof(float));
+        else
+            memcpy(ptr, &val, sizeof(float));
+    }
+    else if(field->type == DAT_FIELD_DOUBLE) {
+        double val = sqlite3_column_double(stmt, j);
+        memcpy(ptr, &val, sizeof(double));
+    }
+    else {
+        storage_field_set_int(field, (char *)sample, sqlite3_column_int64(stmt, j));
+    }
+}
+
+/**
+ * Insert @n consecutive samples with a prepared insert statement, inside a
+ * transaction if there are several samples. Returns 0 OK, -1 Error.
+ */
+static int storage_sqlite_insert(sqlite3_stmt *stmt, const char *table, int index, void *data, int payload, int n)
+{
+    sqlite_sync_group(STORAGE_SQLITE_PAYLOAD);
+    if(n > 1 && sqlite_begin() != 0)
+        return -1;
+
+    const dat_payload_schema_t *schema = dat_get_payload_schema(payload);
+    int i, j, rc = 0;
+    for(i=0; i < n && rc == 0; i++)
+    {
+        // Samples are stored consecutively in data
+        const char *sample = (char *)data + i*data_map[payload].size;
+        sqlite3_bind_int(stmt, 1, index+i);
+        for(j=0; j < schema->nfields; ++j)
+            storage_bind_sqlite_value(&schema->fields[j], sample, stmt, j+2);
+        rc = sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
+        sqlite3_reset(stmt);
+    }
+    if(rc != 0)
+        LOGE(tag, "Failed to add value to table %s. Error: %s", table, sqlite3_errmsg(db));
+
+    if(n > 1 && sqlite_end(rc == 0) != 0)
+        rc = -1;
+    return rc;
+}
+
+#if STORAGE_SQLITE_READERS > 0
+/**
+ * Close the read-only connections. The readers must be free.
+ */
+static void sqlite_readers_close(void)
+{
+    storage_sqlite_reader_t *reader;
+    while(sqlite_readers_free != 0 && osQueueReceive(sqlite_readers_free, &reader, 0) == pdPASS)
+        ;
+    int i, j;
+    for(i=0; i < STORAGE_SQLITE_READERS; i++)
+    {
+        for(j=0; j < last_sensor; j++)
+            sqlite3_finalize(sqlite_readers[i].payload_range[j]);
+        sqlite3_finalize(sqlite_readers[i].fp_iter);
+        sqlite3_close(sqlite_readers[i].db);
+    }
+    memset(sqlite_readers, 0, sizeof(sqlite_readers));
+    sqlite_readers_ok = 0;
+}
+
+/**
+ * Open the read-only connections of the database @file, after db set the WAL
+ * journal mode. Returns 0 OK, -1 Error.
+ */
+static int sqlite_readers_open(const char *file)
+{
+    if(sqlite_readers_free == 0)
+        sqlite_readers_free = osQueueCreate(STORAGE_SQLITE_READERS, sizeof(storage_sqlite_reader_t *));
+    if(sqlite_readers_free == 0)
+    {
+        LOGE(tag, "Unable to create the readers queue");
+        return -1;
+    }
+
+    int i;
+    char sql[SCH_BUFF_MAX_LEN];
+    snprintf(sql, sizeof(sql), "PRAGMA mmap_size=%ld;", (long)SCH_STORAGE_SQLITE_MMAP);
+    for(i=0; i < STORAGE_SQLITE_READERS; i++)
+    {
+        storage_sqlite_reader_t *reader = &sqlite_readers[i];
+        if(sqlite3_open_v2(file, &reader->db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK ||
+           sqlite3_exec(reader->db, sql, 0, 0, NULL) != SQLITE_OK)
+        {
+            LOGE(tag, "Can't open reader %d: %s", i, sqlite3_errmsg(reader->db));
+            osQueueSend(sqlite_readers_free, &reader, 0);
+            sqlite_readers_close();
+            return -1;
+        }
+        // Wait for the writer checkpoints instead of failing the read
+        sqlite3_busy_timeout(reader->db, STORAGE_SQLITE_BUSY_MS);
+        osQueueSend(sqlite_readers_free, &reader, 0);
+    }
+    sqlite_readers_ok = 1;
+    LOGD(tag, "Opened %d read-only connections", STORAGE_SQLITE_READERS);
+    return 0;
+}
+
+/**
+ * Take a free reader, waits until one is available. Returns NULL if the
+ * readers are not open, then the reads use db.
+ */
+static storage_sqlite_reader_t *sqlite_reader_take(void)
+{
+    storage_sqlite_reader_t *reader = NULL;
+    if(sqlite_readers_ok)
+        osQueueReceive(sqlite_readers_free, &reader, portMAX_DELAY);
+    return reader;
+}
+
+/**
+ * Return a reader to the pool
+ */
+static void sqlite_reader_give(storage_sqlite_reader_t *reader)
+{
+    if(reader != NULL)
+        osQueueSend(sqlite_readers_free, &reader, portMAX_DELAY);
+}
+
+/**
+ * Prepare a statement of a reader, if not prepared yet. Returns 0 OK, -1 Error.
+ */
+static int sqlite_reader_prepare(storage_sqlite_reader_t *reader, sqlite3_stmt **stmt, const char *sql)
+{
+    if(*stmt != NULL)
+        return 0;
+    if(sqlite3_prepare_v2(reader->db, sql, -1, stmt, 0) != SQLITE_OK)
+    {
+        LOGE(tag, "Failed to prepare reader statement. Error: %s", sqlite3_errmsg(reader->db));
+        *stmt = NULL;
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+static int sqlite_init(const char *file)
+{
+    if(db != NULL)
+    {
+        LOGW(tag, "Database already open, closing it");
+#if STORAGE_SQLITE_READERS > 0
+        sqlite_readers_close();
+#endif
+        storage_stmt_close();
+        sqlite3_close(db);
+    }
+
+    if(sqlite3_open(file, &db) != SQLITE_OK)
+    {
+        LOGE(tag, "Can't open database: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    LOGD(tag, "Opened database successfully");
+    // Trimmed payload rows release their pages (see sqlite_payload_trim),
+    // only new databases change the auto vacuum mode
+    sqlite_exec("PRAGMA auto_vacuum=INCREMENTAL;", "main");
+    int profile_ok = sqlite_profile_init() == 0;
+    if(!profile_ok)
+        LOGW(tag, "Unable to apply durability profile %d, using SQLite defaults", SCH_STORAGE_SQLITE_PROFILE);
+#if STORAGE_SQLITE_READERS > 0
+    // Readers only run concurrently with the writer in WAL mode
+    if(profile_ok && sqlite_readers_open(file) != 0)
+        LOGW(tag, "Unable to open the read-only connections, reads wait for the writes");
+#endif
+    return 0;
+}
+
+static int sqlite_read_concurrent(void)
+{
+#if STORAGE_SQLITE_READERS > 0
+    return sqlite_readers_ok;
+#else
+    return 0;
+#endif
+}
+
+static int sqlite_close(void)
+{
+    if(db == NULL)
+    {
+        LOGW(tag, "Attempting to close a NULL pointer database");
+        return -1;
+    }
+    LOGD(tag, "Closing database");
+#if STORAGE_SQLITE_READERS > 0
+    sqlite_readers_close();
+#endif
+    storage_stmt_close();
+    sqlite3_close(db);
+    db = NULL;
+    return 0;
+}
+
+static int sqlite_sync(void)
+{
+#if SCH_STORAGE_SQLITE_PROFILE == 1
+    // Copy the WAL pages to the database, without waiting for readers
+    int log = 0, ckpt = 0;
+    if(db == NULL)
+        return 0;
+    if(sqlite3_wal_checkpoint_v2(db, NULL, SQLITE_CHECKPOINT_PASSIVE, &log, &ckpt) != SQLITE_OK)
+    {
+        LOGE(tag, "WAL checkpoint failed. Error: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    LOGD(tag, "WAL checkpoint, %d of %d pages", ckpt, log);
+#endif
+    return 0;
+}
+
+static int sqlite_begin(void)
+{
+    char *err_msg;
+    if(sqlite3_exec(db, "BEGIN TRANSACTION;", 0, 0, &err_msg) != SQLITE_OK)
+    {
+        LOGE(tag, "Failed to begin transaction. Error: %s", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+    return 0;
+}
+
+static int sqlite_end(int commit)
+{
+    char *err_msg;
+    if(sqlite3_exec(db, commit ? "COMMIT;" : "ROLLBACK;", 0, 0, &err_msg) != SQLITE_OK)
+    {
+        LOGE(tag, "Failed to end transaction. Error: %s", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Get the row and the value column of a status repo index (see
+ * STORAGE_REPO_COPIES). Returns the column, -1 if the index is out of range.
+ */
+static int sqlite_repo_cell(int index, int *row)
+{
+#if SCH_STORAGE_TRIPLE_WR == 1
+    if(index < 0 || index >= dat_status_last_address*STORAGE_REPO_COPIES)
+    {
+        LOGE(tag, "Status var index %d is out of range", index);
+        return -1;
+    }
+    *row = index % dat_status_last_address;
+    return index / dat_status_last_address;
+#else
+    *row = index;
+    return 0;
+#endif
+}
+
+/**
+ * Update the row with a prepared UPDATE statement, already bound, adding the
+ * row the first time it is written. Returns 0 OK, -1 Error.
+ */
+static int sqlite_repo_update(sqlite3_stmt *stmt, sqlite3_stmt *add, int row)
+{
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if(rc == SQLITE_DONE && sqlite3_changes(db) == 0)
+    {
+        sqlite3_bind_int(add, 1, row);
+        rc = sqlite3_step(add);
+        sqlite3_reset(add);
+        if(rc == SQLITE_DONE)
+        {
+            rc = sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+        }
+    }
+    if(rc != SQLITE_DONE)
+    {
+        LOGE(tag, "SQL error: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Move the copies of a status repo table of previous versions, one row per
+ * copy at idx + c*dat_status_last_address, to the value columns of the
+ * variable row. Returns 0 OK, -1 Error.
+ */
+static int sqlite_repo_migrate(char *table)
+{
+    sqlite3_stmt *stmt = NULL;
+    char *sql = sqlite3_mprintf("SELECT value_2, value_3 FROM %s LIMIT 0;", table);
+    int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
+    sqlite3_finalize(stmt);
+    sqlite3_free(sql);
+    if(rc == SQLITE_OK)
+        return 0;
+
+    // Add the copies columns, then move the copies rows to them
+    LOGI(tag, "Moving table %s to one row per status var", table);
+    if(sqlite_begin() != 0)
+        return -1;
+    sql = sqlite3_mprintf("ALTER TABLE %s ADD COLUMN value_2 INT; "
+                          "ALTER TABLE %s ADD COLUMN value_3 INT;", table, table);
+    rc = sqlite_exec(sql, table);
+    sqlite3_free(sql);
+#if SCH_STORAGE_TRIPLE_WR == 1
+    if(rc == 0)
+    {
+        sql = sqlite3_mprintf("UPDATE %s SET "
+                              "value_2 = (SELECT c.value FROM %s AS c WHERE c.idx = %s.idx + %d), "
+                              "value_3 = (SELECT c.value FROM %s AS c WHERE c.idx = %s.idx + %d) "
+                              "WHERE idx < %d; "
+                              "DELETE FROM %s WHERE idx >= %d;",
+                              table, table, table, dat_status_last_address,
+                              table, table, dat_status_last_address*2,
+                              dat_status_last_address, table, dat_status_last_address);
+        rc = sqlite_exec(sql, table);
+        sqlite3_free(sql);
+    }
+#endif
+    if(sqlite_end(rc == 0) != 0)
+        rc = -1;
+    return rc;
+}
+
+static int sqlite_repo_init(char *table, int drop)
+{
+    int rc = 0;
+    char *sql;
+
+    /* Drop table if selected */
+    if(drop)
+    {
+        sql = sqlite3_mprintf("DROP TABLE %s", table);
+        rc = sqlite_exec(sql, table);
+        sqlite3_free(sql);
+        if(rc != 0)
+            return -1;
+        LOGD(tag, "Table %s drop successfully", table);
+    }
+
+    sql = sqlite3_mprintf("CREATE TABLE IF NOT EXISTS %s("
+                          "idx INTEGER PRIMARY KEY, "
+                          "name TEXT UNIQUE, "
+                          "value INT, "
+                          "value_2 INT, "
+                          "value_3 INT);",
+                          table);
+    rc = sqlite_exec(sql, table);
+    sqlite3_free(sql);
+    if(rc != 0 || sqlite_repo_migrate(table) != 0)
+        return -1;
+    LOGD(tag, "Table %s created successfully", table);
+    return storage_repo_stmt(table) != NULL ? 0 : -1;
+}
+
+static int sqlite_repo_get_value(int index, char *table)
+{
+    int value = -1, row;
+    int col = sqlite_repo_cell(index, &row);
+    storage_repo_stmt_t *stmts = storage_repo_stmt(table);
+    if(col < 0 || stmts == NULL)
+        return -1;
+
+    // execute statement
+    sqlite3_stmt *stmt = stmts->get;
+    sqlite3_bind_int(stmt, 1, row);
+
+    // fetch only one row's status
+    int rc = sqlite3_step(stmt);
+    if(rc == SQLITE_ROW)
+        value = sqlite3_column_int(stmt, col);
+    else
+        LOGE(tag, "Some error encountered (rc=%d) getting status var %d", rc, index);
+
+    sqlite3_reset(stmt);
+    return value;
+}
+
+/**
+ * Get the values of @n consecutive rows, starting at row, in values[c*n + i]
+ * for the copies c from col to col + copies - 1. Returns the rows found.
+ */
+static int sqlite_repo_get_rows(storage_repo_stmt_t *stmts, int row, int n, int col, int copies, int *values)
+{
+    sqlite3_stmt *stmt = stmts->get_range;
+    sqlite3_bind_int(stmt, 1, row);
+    sqlite3_bind_int(stmt, 2, row + n - 1);
+
+    int i, c, rc, found = 0;
+    while((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        i = sqlite3_column_int(stmt, 0) - row;
+        if(i >= 0 && i < n)
+        {
+            for(c=0; c<copies; c++)
+                values[c*n + i] = sqlite3_column_int(stmt, 1 + col + c);
+            found++;
+        }
+    }
+    if(rc != SQLITE_DONE)
+        LOGE(tag, "Some error encountered (rc=%d) getting status vars %d-%d", rc, row, row + n - 1);
+
+    sqlite3_reset(stmt);
+    return found;
+}
+
+static int sqlite_repo_get_values(int index, int n, int *values, char *table)
+{
+    storage_repo_stmt_t *stmts = storage_repo_stmt(table);
+    if(stmts == NULL)
+        return -1;
+
+    // Ranges crossing copies are read one copy at a time
+    int row, col, run, rc = 0;
+    while(n > 0)
+    {
+        col = sqlite_repo_cell(index, &row);
+        if(col < 0)
+            return -1;
+        run = n;
+#if SCH_STORAGE_TRIPLE_WR == 1
+        if(run > dat_status_last_address - row)
+            run = dat_status_last_address - row;
+#endif
+        if(sqlite_repo_get_rows(stmts, row, run, col, 1, values) != run)
+            rc = -1;
+        index += run;
+        values += run;
+        n -= run;
+    }
+    return rc;
+}
+
+#if SCH_STORAGE_TRIPLE_WR == 1
+static int sqlite_repo_get_copies(int index, int n, int *values, char *table)
+{
+    int row;
+    storage_repo_stmt_t *stmts = storage_repo_stmt(table);
+    if(stmts == NULL || sqlite_repo_cell(index, &row) != 0 || sqlite_repo_cell(index + n - 1, &row) != 0)
+        return -1;
+    if(n > 1)
+        return sqlite_repo_get_rows(stmts, index, n, 0, STORAGE_REPO_COPIES, values) == n ? 0 : -1;
+
+    // One variable, looked up by its primary key
+    int c, rc;
+    sqlite3_stmt *stmt = stmts->get;
+    sqlite3_bind_int(stmt, 1, index);
+    rc = sqlite3_step(stmt);
+    if(rc == SQLITE_ROW)
+    {
+        for(c=0; c<STORAGE_REPO_COPIES; c++)
+            values[c] = sqlite3_column_int(stmt, c);
+    }
+    else
+        LOGE(tag, "Some error encountered (rc=%d) getting status var %d", rc, index);
+    sqlite3_reset(stmt);
+    return rc == SQLITE_ROW ? 0 : -1;
+}
+#endif
+
+static int sqlite_repo_set_value(int index, int value, char *table)
+{
+    int row;
+    int col = sqlite_repo_cell(index, &row);
+    storage_repo_stmt_t *stmts = storage_repo_stmt(table);
+    if(col < 0 || stmts == NULL)
+        return -1;
+
+    /* Execute SQL statement */
+    sqlite_sync_group(STORAGE_SQLITE_REPO);
+    sqlite3_stmt *stmt = stmts->set[col];
+    sqlite3_bind_int(stmt, 1, row);
+    sqlite3_bind_int(stmt, 2, value);
+    if(sqlite_repo_update(stmt, stmts->add, row) != 0)
+        return -1;
+    LOGV(tag, "Inserted %d to %d in %s", value, index, table);
+    return 0;
+}
+
+static int sqlite_repo_set_values(int index, int n, const int *values, char *table)
+{
+    int i, rc = 0;
+    sqlite_sync_group(STORAGE_SQLITE_REPO);
+    if(sqlite_begin() != 0)
+        return -1;
+
+    for(i=0; i < n && rc == 0; i++)
+        rc = sqlite_repo_set_value(index + i, values[i], table);
+
+    if(sqlite_end(rc == 0) != 0)
+        rc = -1;
+    return rc;
+}
+
+#if SCH_STORAGE_TRIPLE_WR == 1
+static int sqlite_repo_set_copies(int index, int n, const int *values, char *table)
+{
+    int i, row, rc = 0;
+    storage_repo_stmt_t *stmts = storage_repo_stmt(table);
+    if(stmts == NULL || sqlite_repo_cell(index, &row) != 0 || sqlite_repo_cell(index + n - 1, &row) != 0)
+        return -1;
+
+    // All the copies of a variable are set with one statement
+    sqlite_sync_group(STORAGE_SQLITE_REPO);
+    if(n > 1 && sqlite_begin() != 0)
+        return -1;
+
+    sqlite3_stmt *stmt = stmts->set_copies;
+    for(i=0; i < n && rc == 0; i++)
+    {
+        sqlite3_bind_int(stmt, 1, index + i);
+        sqlite3_bind_int(stmt, 2, values[i]);
+        rc = sqlite_repo_update(stmt, stmts->add, index + i);
+    }
+
+    if(n > 1 && sqlite_end(rc == 0) != 0)
+        rc = -1;
+    return rc;
+}
+#endif
+
+static int sqlite_fp_init(int drop, int *entries)
+{
+    char *sql;
+    int rc;
+
+    /* Drop table if selected */
+    if (drop)
+    {
+        sql = sqlite3_mprintf("DROP TABLE IF EXISTS %s", STORAGE_FP_TABLE);
+        rc = sqlite_exec(sql, STORAGE_FP_TABLE);
+        sqlite3_free(sql);
+        if(rc != 0)
+            return -1;
+        LOGD(tag, "Table %s drop successfully", STORAGE_FP_TABLE);
+    }
+
+    sql = sqlite3_mprintf("CREATE TABLE IF NOT EXISTS %s("
+                          "time int , "
+                          "seq int DEFAULT 0 , "
+                          "command text, "
+                          "args text , "
+                          "executions int , "
+                          "periodical int , "
+                          "ms int DEFAULT 0 , "
+                          "PRIMARY KEY (time, seq));",
+                          STORAGE_FP_TABLE);
+    rc = sqlite_exec(sql, STORAGE_FP_TABLE);
+    sqlite3_free(sql);
+    if(rc != 0)
+        return -1;
+    LOGD(tag, "Table %s created successfully", STORAGE_FP_TABLE);
+
+    // Tables created before the ms column was added, fails if it exists
+    char *err_msg;
+    sql = sqlite3_mprintf("ALTER TABLE %s ADD COLUMN ms int DEFAULT 0;", STORAGE_FP_TABLE);
+    if(sqlite3_exec(db, sql, 0, 0, &err_msg) != SQLITE_OK)
+        sqlite3_free(err_msg);
+    else
+        LOGI(tag, "Table %s updated with the ms column", STORAGE_FP_TABLE);
+    sqlite3_free(sql);
+
+    // Tables created with time as primary key are copied to the (time, seq)
+    // key, the primary key of a SQLite table can not be altered
+    sqlite3_stmt *stmt;
+    sql = sqlite3_mprintf("SELECT seq FROM %s LIMIT 0;", STORAGE_FP_TABLE);
+    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
+    sqlite3_finalize(stmt);
+    sqlite3_free(sql);
+    if(rc != SQLITE_OK)
+    {
+        sql = sqlite3_mprintf("BEGIN; "
+                              "CREATE TABLE %s_seq(time int, seq int DEFAULT 0, command text, args text, "
+                              "executions int, periodical int, ms int DEFAULT 0, PRIMARY KEY (time, seq)); "
+                              "INSERT INTO %s_seq (time, command, args, executions, periodical, ms) "
+                              "SELECT time, command, args, executions, periodical, ms FROM %s; "
+                              "DROP TABLE %s; ALTER TABLE %s_seq RENAME TO %s; COMMIT;",
+                              STORAGE_FP_TABLE, STORAGE_FP_TABLE, STORAGE_FP_TABLE, STORAGE_FP_TABLE,
+                              STORAGE_FP_TABLE, STORAGE_FP_TABLE);
+        rc = sqlite_exec(sql, STORAGE_FP_TABLE);
+        sqlite3_free(sql);
+        if(rc != 0)
+        {
+            if(!sqlite3_get_autocommit(db))
+                sqlite_exec("ROLLBACK;", STORAGE_FP_TABLE);
+            return -1;
+        }
+        LOGI(tag, "Table %s updated with the (time, seq) key", STORAGE_FP_TABLE);
+    }
+    return storage_fp_stmt_init();
+}
+
+static int sqlite_fp_set(int timetodo, char *command, char *args, int executions, int periodical, int ms, int *entries)
+{
+    if(storage_fp_stmt_init() != 0)
+        return -1;
+
+    /* Execute SQL statement */
+    sqlite_sync_group(STORAGE_SQLITE_FP);
+    sqlite3_stmt *stmt = fp_stmts[STORAGE_FP_SET];
+    sqlite3_bind_int(stmt, 1, timetodo);
+    sqlite3_bind_text(stmt, 2, command, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 3, args, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt, 4, executions);
+    sqlite3_bind_int(stmt, 5, periodical);
+    sqlite3_bind_int(stmt, 6, ms);
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+
+    if (rc != SQLITE_DONE)
+    {
+        LOGE(tag, "SQL error: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    LOGV(tag, "Inserted (%d, %s, %s, %d, %d) in %s", timetodo, command, args, executions, periodical, STORAGE_FP_TABLE);
+    return 0;
+}
+
+static int sqlite_fp_set_batch(fp_entry_t *fp, int n, int *entries)
+{
+    int i, rc = 0;
+    sqlite_sync_group(STORAGE_SQLITE_FP);
+    if(sqlite_begin() != 0)
+        return -1;
+
+    for(i=0; i < n && rc == 0; i++)
+        rc = sqlite_fp_set(fp[i].unixtime, fp[i].cmd, fp[i].args, fp[i].executions, fp[i].periodical, fp[i].ms, entries);
+
+    if(sqlite_end(rc == 0) != 0)
+        rc = -1;
+    return rc;
+}
+
+static int sqlite_fp_get(int timetodo, char *command, char *args, int *executions, int *periodical, int *ms)
+{
+    if(storage_fp_stmt_init() != 0)
+        return -1;
+
+    sqlite3_stmt *stmt = fp_stmts[STORAGE_FP_GET];
+    sqlite3_bind_int(stmt, 1, timetodo);
+
+    int rc = sqlite3_step(stmt);
+    if(rc != SQLITE_ROW)
+    {
+        LOGV(tag, "SQL error: %s", sqlite3_errmsg(db));
+        sqlite3_reset(stmt);
+        return -1;
+    }
+
+    const char *cmd_str = (const char *)sqlite3_column_text(stmt, 0);
+    const char *args_str = (const char *)sqlite3_column_text(stmt, 1);
+    strcpy(command, cmd_str != NULL ? cmd_str : "");
+    strcpy(args, args_str != NULL ? args_str : "");
+    *executions = sqlite3_column_int(stmt, 2);
+    *periodical = sqlite3_column_int(stmt, 3);
+    *ms = sqlite3_column_int(stmt, 4);
+    sqlite3_reset(stmt);
+    return 0;
+}
+
+static int sqlite_fp_update(int timetodo, int new_time, int executions, int *entries)
+{
+    if(storage_fp_stmt_init() != 0)
+        return -1;
+
+    sqlite_sync_group(STORAGE_SQLITE_FP);
+    sqlite3_stmt *stmt = fp_stmts[STORAGE_FP_UPDATE];
+    sqlite3_bind_int(stmt, 1, timetodo);
+    sqlite3_bind_int(stmt, 2, new_time);
+    sqlite3_bind_int(stmt, 3, executions);
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+
+    if (rc != SQLITE_DONE)
+    {
+        LOGE(tag, "SQL error: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    LOGV(tag, "Command in time %d moved to %d (%d executions)", timetodo, new_time, executions);
+    return 0;
+}
+
+static int sqlite_fp_erase(int timetodo, int *entries)
+{
+    if(storage_fp_stmt_init() != 0)
+        return -1;
+
+    /* Execute SQL statement */
+    sqlite_sync_group(STORAGE_SQLITE_FP);
+    sqlite3_stmt *stmt = fp_stmts[STORAGE_FP_ERASE];
+    sqlite3_bind_int(stmt, 1, timetodo);
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+
+    if (rc != SQLITE_DONE)
+    {
+        LOGE(tag, "SQL error: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    LOGV(tag, "Command in time %d, table %s was deleted", timetodo, STORAGE_FP_TABLE);
+    return 0;
+}
+
+static int sqlite_fp_next(void)
+{
+    int timetodo = -1;
+    if(storage_fp_stmt_init() != 0)
+        return -1;
+
+    // Time is the first column of the primary key, so this is an index lookup
+    sqlite3_stmt *stmt = fp_stmts[STORAGE_FP_NEXT];
+    if(sqlite3_step(stmt) == SQLITE_ROW)
+        timetodo = sqlite3_column_int(stmt, 0);
+    sqlite3_reset(stmt);
+    return timetodo;
+}
+
+/**
+ * Visit the flight plan entries up to @to with the iteration statement of a
+ * connection (@conn, for the errors)
+ * @return Number of entries visited, -1 on error
+ */
+static int storage_sqlite_fp_iter(sqlite3 *conn, sqlite3_stmt *stmt, int from, int to, fp_visit_t visit, void *arg)
+{
+    // One entry at a time, the table is not copied to memory
+    fp_entry_t entry;
+    int rc, stop = 0, visited = 0;
+    sqlite3_bind_int(stmt, 1, from);
+    sqlite3_bind_int(stmt, 2, to);
+
+    while(!stop && (rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        const char *cmd_str = (const char *)sqlite3_column_text(stmt, 1);
+        const char *args_str = (const char *)sqlite3_column_text(stmt, 2);
+        entry.unixtime = sqlite3_column_int(stmt, 0);
+        strncpy(entry.cmd, cmd_str != NULL ? cmd_str : "", SCH_CMD_MAX_STR_NAME-1);
+        entry.cmd[SCH_CMD_MAX_STR_NAME-1] = '\0';
+        strncpy(entry.args, args_str != NULL ? args_str : "", SCH_CMD_MAX_STR_PARAMS-1);
+        entry.args[SCH_CMD_MAX_STR_PARAMS-1] = '\0';
+        entry.executions = sqlite3_column_int(stmt, 3);
+        entry.periodical = sqlite3_column_int(stmt, 4);
+        entry.ms = sqlite3_column_int(stmt, 5);
+        visited++;
+        stop = visit(&entry, arg);
+    }
+    sqlite3_reset(stmt);
+
+    if(!stop && rc != SQLITE_DONE)
+    {
+        LOGE(tag, "SQL error: %s", sqlite3_errmsg(conn));
+        return -1;
+    }
+    return visited;
+}
+
+static int sqlite_fp_foreach(int from, int to, fp_visit_t visit, void *arg)
+{
+#if STORAGE_SQLITE_READERS > 0
+    storage_sqlite_reader_t *reader = sqlite_reader_take();
+    if(reader != NULL)
+    {
+        char *sql = sqlite3_mprintf(STORAGE_FP_ITER_SQL, STORAGE_FP_TABLE);
+        int rc = sqlite_reader_prepare(reader, &reader->fp_iter, sql);
+        sqlite3_free(sql);
+        if(rc == 0)
+            rc = storage_sqlite_fp_iter(reader->db, reader->fp_iter, from, to, visit, arg);
+        sqlite_reader_give(reader);
+        return rc;
+    }
+#endif
+    if(storage_fp_stmt_init() != 0)
+        return -1;
+    return storage_sqlite_fp_iter(db, fp_stmts[STORAGE_FP_ITER], from, to, visit, arg);
+}
+
+static int sqlite_payload_init(int drop)
+{
+    int i;
+    char *sql;
+    if(drop)
+    {
+        for(i=0; i< last_sensor; ++i)
+        {
+            sql = sqlite3_mprintf("DROP TABLE IF EXISTS %s",  data_map[i].table);
+            if(sqlite_exec(sql, data_map[i].table) == 0)
+                LOGD(tag, "Table %s drop successfully", data_map[i].table);
+            sqlite3_free(sql);
+        }
+    }
+
+    for(i=0; i< last_sensor; ++i)
+    {
+        char create_table[SCH_BUFF_MAX_LEN*4];
+        if(storage_sql_payload_create(i, data_map[i].table, "REAL", create_table, sizeof(create_table)) != 0)
+            continue;
+        LOGD(tag, "SQL command: %s", create_table);
+        if(sqlite_exec(create_table, data_map[i].table) != 0)
+            continue;
+        LOGD(tag, "Table %s created successfully", data_map[i].table);
+        if(storage_payload_time_field(i) != NULL &&
+           storage_sql_payload_time_index(data_map[i].table, create_table, sizeof(create_table)) == 0)
+            sqlite_exec(create_table, data_map[i].table);
+        if(storage_sql_payload_id_index(data_map[i].table, create_table, sizeof(create_table)) == 0)
+            sqlite_exec(create_table, data_map[i].table);
+        storage_payload_stmt_init(i);
+    }
+    return 0;
+}
+
+static int sqlite_payload_set(int index, void *data, int payload, int n)
+{
+    if(storage_payload_stmt_init(payload) != 0)
+        return -1;
+    return storage_sqlite_insert(payload_stmts[payload], data_map[payload].table, index, data, payload, n);
+}
+
+/**
+ * Run a payload range select, rows are copied to their position in @data in
+ * index order, missing rows are zeroed
+ * @return Number of rows found, -1 on error
+ */
+static int storage_sqlite_select(sqlite3_stmt *stmt, int index, int count, void *data, int payload)
+{
+    const dat_payload_schema_t *schema = dat_get_payload_schema(payload);
+    int size = data_map[payload].size;
+    memset(data, 0, count*size);
+    int j, rc, n = 0;
+    sqlite3_bind_int(stmt, 1, index);
+    sqlite3_bind_int(stmt, 2, index+count-1);
+
+    while((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        int pos = sqlite3_column_int(stmt, 0) - index;
+        if(pos < 0 || pos >= count)
+            continue;
+        char *sample = (char *)data + pos*size;
+        for(j=0; j < schema->nfields; ++j)
+            storage_get_sqlite_value(&schema->fields[j], sample, stmt, j+1);
+        n++;
+    }
+    sqlite3_reset(stmt);
+
+    if(rc != SQLITE_DONE)
+    {
+        LOGE(tag, "Some error encountered (rc=%d)", rc);
+        return -1;
+    }
+    return n;
+}
+
+static int sqlite_payload_get_range(int index, int count, void *data, int payload)
+{
+#if STORAGE_SQLITE_READERS > 0
+    storage_sqlite_reader_t *reader = sqlite_reader_take();
+    if(reader != NULL)
+    {
+        char select_range[SCH_BUFF_MAX_LEN*4];
+        int rc = -1;
+        if(reader->payload_range[payload] != NULL ||
+           storage_sql_payload_select(payload, data_map[payload].table, "?%d", select_range, sizeof(select_range)) == 0)
+            rc = sqlite_reader_prepare(reader, &reader->payload_range[payload], select_range);
+        if(rc == 0)
+            rc = storage_sqlite_select(reader->payload_range[payload], index, count, data, payload);
+        sqlite_reader_give(reader);
+        return rc;
+    }
+#endif
+    if(storage_payload_stmt_init(payload) != 0)
+        return -1;
+    return storage_sqlite_select(payload_range_stmts[payload], index, count, data, payload);
+}
+
+static int sqlite_payload_find_time(uint32_t timestamp, int payload, int next)
+{
+    if(storage_payload_stmt_init(payload) != 0 || payload_time_stmts[payload] == NULL)
+        return -1;
+
+    sqlite3_stmt *stmt = payload_time_stmts[payload];
+    sqlite3_bind_int64(stmt, 1, timestamp);
+    sqlite3_bind_int(stmt, 2, next);
+    int index = next;
+    int rc = sqlite3_step(stmt);
+    if(rc == SQLITE_ROW)
+        index = sqlite3_column_int(stmt, 0);
+    else if(rc != SQLITE_DONE)
+    {
+        LOGE(tag, "Some error encountered (rc=%d) finding time %u", rc, (unsigned int)timestamp);
+        index = -1;
+    }
+    sqlite3_reset(stmt);
+    return index;
+}
+
+static int sqlite_payload_trim(int payload, int end, int max)
+{
+    char delete_rows[SCH_BUFF_MAX_LEN];
+    sqlite3_stmt *stmt = NULL;
+    if(storage_sql_payload_trim(data_map[payload].table, "?%d", delete_rows, sizeof(delete_rows)) != 0)
+        return -1;
+    sqlite_sync_group(STORAGE_SQLITE_PAYLOAD);
+    if(sqlite3_prepare_v2(db, delete_rows, -1, &stmt, 0) != SQLITE_OK)
+    {
+        LOGE(tag, "Failed to prepare delete for table %s. Error: %s", data_map[payload].table, sqlite3_errmsg(db));
+        return -1;
+    }
+    sqlite3_bind_int(stmt, 1, end);
+    sqlite3_bind_int(stmt, 2, max);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if(rc != SQLITE_DONE)
+    {
+        LOGE(tag, "Failed to trim table %s. Error: %s", data_map[payload].table, sqlite3_errmsg(db));
+        return -1;
+    }
+
+    // Release the pages freed by this step only, so each step is short
+    int n = sqlite3_changes(db);
+    if(n > 0)
+        sqlite_exec("PRAGMA incremental_vacuum;", data_map[payload].table);
+    LOGD(tag, "Deleted %d samples of table %s before index %d", n, data_map[payload].table, end);
+    return n;
+}
+
+static int sqlite_node_table_init(const char *table, int payload)
+{
+    char create_table[SCH_BUFF_MAX_LEN*4];
+    char select_next[SCH_BUFF_MAX_LEN];
+    if(storage_sql_payload_create(payload, table, "REAL", create_table, sizeof(create_table)) != 0)
+        return -1;
+    LOGD(tag, "SQL command: %s", create_table);
+    if(sqlite_exec(create_table, table) != 0)
+        return -1;
+
+    // The next index continues after the samples already stored
+    int next = -1;
+    sqlite3_stmt *stmt = NULL;
+    snprintf(select_next, sizeof(select_next), "SELECT COALESCE(MAX(id)+1, 0) FROM %s", table);
+    if(sqlite3_prepare_v2(db, select_next, -1, &stmt, 0) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+        next = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    if(next < 0)
+        LOGE(tag, "Failed to get the next index of table %s. Error: %s", table, sqlite3_errmsg(db));
+    return next;
+}
+
+static int sqlite_node_table_set(const char *table, int index, void *data, int payload, int n)
+{
+    char insert_row[SCH_BUFF_MAX_LEN*4];
+    sqlite3_stmt *stmt = NULL;
+    if(storage_sql_payload_insert(payload, table, "?%d", insert_row, sizeof(insert_row)) != 0)
+        return -1;
+    if(sqlite3_prepare_v2(db, insert_row, -1, &stmt, 0) != SQLITE_OK)
+    {
+        LOGE(tag, "Failed to prepare insert for table %s. Error: %s", table, sqlite3_errmsg(db));
+        return -1;
+    }
+    int rc = storage_sqlite_insert(stmt, table, index, data, payload, n);
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+static int sqlite_node_table_get(const char *table, int index, int count, void *data, int payload)
+{
+    char select_range[SCH_BUFF_MAX_LEN*4];
+    sqlite3_stmt *stmt = NULL;
+    if(storage_sql_payload_select(payload, table, "?%d", select_range, sizeof(select_range)) != 0)
+        return -1;
+    if(sqlite3_prepare_v2(db, select_range, -1, &stmt, 0) != SQLITE_OK)
+    {
+        LOGE(tag, "Failed to prepare select for table %s. Error: %s", table, sqlite3_errmsg(db));
+        return -1;
+    }
+    int rc = storage_sqlite_select(stmt, index, count, data, payload);
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+const storage_backend_t storage_backend_sqlite = {
+    .name = "SQLite",
+    .init = sqlite_init,
+    .close = sqlite_close,
+    .sync = sqlite_sync,
+    .read_concurrent = sqlite_read_concurrent,
+    .begin = sqlite_begin,
+    .end = sqlite_end,
+    .repo_init = sqlite_repo_init,
+    .repo_get_value = sqlite_repo_get_value,
+    .repo_get_values = sqlite_repo_get_values,
+    .repo_set_value = sqlite_repo_set_value,
+    .repo_set_values = sqlite_repo_set_values,
+#if SCH_STORAGE_TRIPLE_WR == 1
+    .repo_get_copies = sqlite_repo_get_copies,
+    .repo_set_copies = sqlite_repo_set_copies,
+#endif
+    .fp_init = sqlite_fp_init,
+    .fp_set = sqlite_fp_set,
+    .fp_set_batch = sqlite_fp_set_batch,
+    .fp_get = sqlite_fp_get,
+    .fp_update = sqlite_fp_update,
+    .fp_erase = sqlite_fp_erase,
+    .fp_next = sqlite_fp_next,
+    .fp_foreach = sqlite_fp_foreach,
+    .fp_sorted = 1,
+    .payload_init = sqlite_payload_init,
+    .payload_set = sqlite_payload_set,
+    .payload_get_range = sqlite_payload_get_range,
+    .payload_find_time = sqlite_payload_find_time,
+    .payload_trim = sqlite_payload_trim,
+    .node_table_init = sqlite_node_table_init,
+    .node_table_set = sqlite_node_table_set,
+    .node_table_get = sqlite_node_table_get,
+};
@@ -0,0 +1,225 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench_utils.h"
+#include "log_utils.h"
+#include "osDelay.h"
+#ifdef LINUX
+#include <time.h>
+#endif
+
+static const char *tag = "bench";
+
+#if defined(X86)
+#define BENCH_ARCH "X86"
+#elif defined(RPI)
+#define BENCH_ARCH "RPI"
+#elif defined(GROUNDSTATION)
+#define BENCH_ARCH "GROUNDSTATION"
+#elif defined(ESP32)
+#define BENCH_ARCH "ESP32"
+#elif defined(AVR32)
+#define BENCH_ARCH "AVR32"
+#elif defined(NANOMIND)
+#define BENCH_ARCH "NANOMIND"
+#else
+#define BENCH_ARCH "UNKNOWN"
+#endif
+
+uint64_t bench_now_ns(void)
+{
+#ifdef LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ULL + (uint64_t)ts.tv_nsec;
+#else
+    return (uint64_t)osTaskGetTickCount()*1000000000ULL/osDefineTime(1000);
+#endif
+}
+
+uint64_t bench_cpu_ns(void)
+{
+#ifdef LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ULL + (uint64_t)ts.tv_nsec;
+#else
+    return bench_now_ns();
+#endif
+}
+
+uint64_t bench_resolution_ns(void)
+{
+#ifdef LINUX
+    struct timespec ts;
+    if(clock_getres(CLOCK_MONOTONIC, &ts) != 0)
+        return 1;
+    uint64_t res = (uint64_t)ts.tv_sec*1000000000ULL + (uint64_t)ts.tv_nsec;
+    return res > 0 ? res : 1;
+#else
+    uint64_t res = 1000000000ULL/osDefineTime(1000);
+    return res > 0 ? res : 1;
+#endif
+}
+
+int bench_env(const char *name, int def, int min, int max)
+{
+#ifdef LINUX
+    char *value = getenv(name);
+    int n = value != NULL ? (int)strtol(value, NULL, 10) : def;
+    if(n < min || n > max)
+    {
+        LOGW(tag, "Invalid %s=%d, using %d", name, n, def);
+        n = def;
+    }
+    return n;
+#else
+    return def;
+#endif
+}
+
+static int _bench_cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+void bench_stats_get(uint64_t *samples, int n, bench_stats_t *stats)
+{
+    memset(stats, 0, sizeof(bench_stats_t));
+    if(n < 1)
+        return;
+
+    qsort(samples, (size_t)n, sizeof(uint64_t), _bench_cmp_u64);
+    double sum = 0;
+    int i;
+    for(i=0; i<n; i++)
+        sum += (double)samples[i];
+
+    stats->n = n;
+    stats->min = samples[0];
+    stats->p50 = samples[(n-1)*50/100];
+    stats->p90 = samples[(n-1)*90/100];
+    stats->p99 = samples[(n-1)*99/100];
+    stats->max = samples[n-1];
+    stats->mean = sum/n;
+}
+
+/**
+ * Time @iters iterations of @func
+ * @return Time in nanoseconds
+ */
+static uint64_t _bench_sample(bench_func_t func, void *arg, int iters, int *errors)
+{
+    uint64_t t0 = bench_now_ns();
+    *errors += func(arg, iters) != 0;
+    return bench_now_ns() - t0;
+}
+
+int bench_run(bench_func_t func, void *arg, int samples, bench_stats_t *stats, int *iters)
+{
+    uint64_t times[BENCH_MAX_SAMPLES];
+    int errors = 0;
+    if(samples < 1 || samples > BENCH_MAX_SAMPLES)
+        samples = BENCH_SAMPLES;
+
+    // Without a monotonic clock a sample must last many ticks
+    uint64_t min_sample_ns = 100*bench_resolution_ns();
+    if(min_sample_ns < BENCH_MIN_SAMPLE_NS)
+        min_sample_ns = BENCH_MIN_SAMPLE_NS;
+
+    // Warm up the caches, branch predictors and allocators while doubling the
+    // iterations until a sample is long enough
+    int n = 1;
+    uint64_t t_start = bench_now_ns();
+    while(1)
+    {
+        uint64_t t = _bench_sample(func, arg, n, &errors);
+        if(t < min_sample_ns && n < BENCH_MAX_ITERS)
+            n *= 2;
+        else if(bench_now_ns() - t_start >= BENCH_WARMUP_NS)
+            break;
+    }
+
+    int i;
+    for(i=0; i<samples; i++)
+        times[i] = _bench_sample(func, arg, n, &errors)/(uint64_t)n;
+
+    bench_stats_get(times, samples, stats);
+    if(iters != NULL)
+        *iters = n;
+    return errors;
+}
+
+/**
+ * Append to a JSON line, the line is invalidated if it does not fit
+ */
+static void _bench_json_add(bench_json_t *json, const char *fmt, ...)
+{
+    if(json->len < 0)
+        return;
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(json->buff + json->len, BENCH_JSON_LEN - json->len, fmt, args);
+    va_end(args);
+    json->len = len < 0 || len >= BENCH_JSON_LEN - json->len ? -1 : json->len + len;
+}
+
+void bench_json_begin(bench_json_t *json, const char *bench)
+{
+    json->len = 0;
+    _bench_json_add(json, "{\"bench\": \"%s\", \"arch\": \"%s\"", bench, BENCH_ARCH);
+}
+
+void bench_json_str(bench_json_t *json, const char *key, const char *value)
+{
+    _bench_json_add(json, ", \"%s\": \"%s\"", key, value);
+}
+
+void bench_json_int(bench_json_t *json, const char *key, long long value)
+{
+    _bench_json_add(json, ", \"%s\": %lld", key, value);
+}
+
+void bench_json_num(bench_json_t *json, const char *key, double value, int decimals)
+{
+    _bench_json_add(json, ", \"%s\": %.*f", key, decimals, value);
+}
+
+void bench_json_stats(bench_json_t *json, const char *prefix, const bench_stats_t *stats)
+{
+    _bench_json_add(json, ", \"%s_p50_us\": %.2f, \"%s_p99_us\": %.2f, \"%s_max_us\": %.2f",
+                    prefix, stats->p50/1e3, prefix, stats->p99/1e3, prefix, stats->max/1e3);
+}
+
+int bench_json_print(bench_json_t *json)
+{
+    if(json->len < 0)
+    {
+        LOGE(tag, "Benchmark result too long");
+        return -1;
+    }
+    printf("%s}\n", json->buff);
+    fflush(stdout);
+    return 0;
+}
@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+"""
+Print the IGRF coefficient tables of igrf13.c from a NGDC model file
+
+    python3 igrf13_coeffs.py [IGRF13.COF] [DGRF2015 IGRF2020]
+
+Coefficients are sorted as g(1,0), g(1,1), h(1,1), g(2,0), ... with the
+secular variation of the last model in its own table.
+"""
+import sys
+
+NMAX = 13
+
+
+def read_models(path):
+    models = {}
+    name = None
+    for line in open(path):
+        if line.startswith("   "):
+            fields = line.split()
+            name = fields[0]
+            models[name] = {"epoch": float(fields[1]), "gh": {}, "sv": {}}
+            continue
+        n, m, g, h, gdot, hdot = line.split()[:6]
+        models[name]["gh"][(int(n), int(m))] = (float(g), float(h))
+        models[name]["sv"][(int(n), int(m))] = (float(gdot), float(hdot))
+    return models
+
+
+def table(coeffs):
+    values = []
+    for n in range(1, NMAX+1):
+        for m in range(n+1):
+            g, h = coeffs.get((n, m), (0.0, 0.0))
+            values.append(g)
+            if m > 0:
+                values.append(h)
+    return values
+
+
+def print_table(name, values):
+    print("static const double {}[IGRF_NCOEFF] = {{".format(name))
+    for i in range(0, len(values), 6):
+        row = ", ".join("{:9.2f}".format(v) for v in values[i:i+6])
+        end = "," if i+6 < len(values) else ""
+        print("    " + row + end)
+    print("};")
+
+
+if __name__ == "__main__":
+    path = sys.argv[1] if len(sys.argv) > 1 else "IGRF13.COF"
+    names = sys.argv[2:] if len(sys.argv) > 2 else ["DGRF2015", "IGRF2020"]
+    models = read_models(path)
+    for name in names:
+        print_table("igrf_" + name.lower(), table(models[name]["gh"]))
+        print()
+    print_table("igrf_" + names[-1].lower() + "_sv", table(models[names[-1]]["sv"]))
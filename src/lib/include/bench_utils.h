@@ -0,0 +1,158 @@
+/**
+ * @file bench_utils.h
+ * @author Carlos Gonzalez C - carlgonz@uchile.cl
+ * @date 2020
+ * @copyright GNU GPL v3
+ *
+ * Micro-benchmark helpers shared by the benchmark targets in test/, so the
+ * results of x86, RPi and the FreeRTOS boards are measured and reported the
+ * same way (@see test/run_bench.sh and test/bench_compare.py).
+ *
+ * bench_run warms up a function, scales the iterations of each sample until a
+ * sample is long compared with the clock resolution (one tick without a
+ * monotonic clock) and computes the percentiles of the time per iteration.
+ * Benchmarks that measure their own latencies use bench_stats_get. Results are
+ * printed as one JSON line per result with bench_json_*.
+ *
+ * @code
+ *      bench_stats_t stats;
+ *      int iters;
+ *      bench_run(crc_bench, &data, BENCH_SAMPLES, &stats, &iters);
+ *
+ *      bench_json_t json;
+ *      bench_json_begin(&json, "crc32c");
+ *      bench_json_int(&json, "size", data.size);
+ *      bench_json_stats(&json, "op", &stats);
+ *      bench_json_print(&json);
+ * @endcode
+ */
+
+#ifndef BENCH_UTILS_H
+#define BENCH_UTILS_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+#define BENCH_SAMPLES (31)              ///< Default samples of bench_run
+#define BENCH_MAX_SAMPLES (101)         ///< Max. samples of bench_run
+#define BENCH_WARMUP_NS (50000000ULL)   ///< Warm-up time of bench_run
+#define BENCH_MIN_SAMPLE_NS (1000000ULL)///< Min. time of a sample, at least 100 times the clock resolution
+#define BENCH_MAX_ITERS (1 << 24)       ///< Max. iterations of a sample
+#define BENCH_JSON_LEN (512)            ///< Max. length of a JSON result line
+
+/**
+ * Benchmarked function
+ * @param arg Benchmark argument
+ * @param iters Iterations to run
+ * @return 0 if OK, any other value counts as an error
+ */
+typedef int (*bench_func_t)(void *arg, int iters);
+
+/**
+ * Samples statistics, in nanoseconds. Percentiles are the sample at
+ * (n-1)*p/100 of the sorted samples, as the benchmarks computed them before.
+ */
+typedef struct bench_stats {
+    int n;                  ///< Samples
+    uint64_t min;           ///< Min. sample
+    uint64_t p50;           ///< Median
+    uint64_t p90;           ///< 90th percentile
+    uint64_t p99;           ///< 99th percentile
+    uint64_t max;           ///< Max. sample
+    double mean;            ///< Mean
+} bench_stats_t;
+
+/**
+ * JSON result line being built, @see bench_json_begin
+ */
+typedef struct bench_json {
+    char buff[BENCH_JSON_LEN];  ///< Line, without the closing brace
+    int len;                    ///< Line length, -1 if it did not fit
+} bench_json_t;
+
+/**
+ * Monotonic time. Without a monotonic clock (FreeRTOS) the time advances in
+ * ticks, @see bench_resolution_ns.
+ * @return Time in nanoseconds
+ */
+uint64_t bench_now_ns(void);
+
+/**
+ * CPU time used by the process, to measure work done by several tasks
+ * @return CPU time in nanoseconds, the monotonic time if not available
+ */
+uint64_t bench_cpu_ns(void);
+
+/**
+ * Resolution of bench_now_ns
+ * @return Resolution in nanoseconds
+ */
+uint64_t bench_resolution_ns(void);
+
+/**
+ * Read an integer benchmark parameter from the environment (only GNU/Linux)
+ * @param name Environment variable
+ * @param def Default value, also used if the value is out of [min, max]
+ * @return Parameter value
+ */
+int bench_env(const char *name, int def, int min, int max);
+
+/**
+ * Compute the statistics of a set of samples
+ * @param samples Samples, sorted in place
+ * @param n Number of samples, all statistics are 0 if n < 1
+ * @param stats Statistics
+ */
+void bench_stats_get(uint64_t *samples, int n, bench_stats_t *stats);
+
+/**
+ * Benchmark a function: warm up for BENCH_WARMUP_NS, find the iterations
+ * that take BENCH_MIN_SAMPLE_NS and take @samples samples of that many
+ * iterations
+ * @param func Benchmarked function
+ * @param arg Function argument
+ * @param samples Number of samples [1, BENCH_MAX_SAMPLES], BENCH_SAMPLES if
+ * out of range
+ * @param stats Time per iteration statistics
+ * @param iters Iterations per sample, can be NULL
+ * @return Number of function calls with errors
+ */
+int bench_run(bench_func_t func, void *arg, int samples, bench_stats_t *stats, int *iters);
+
+/**
+ * Start a JSON result line, with the benchmark name and the architecture
+ * @param json Line to build
+ * @param bench Benchmark name (@see bench_compare.py)
+ */
+void bench_json_begin(bench_json_t *json, const char *bench);
+
+/**
+ * Add a string field
+ */
+void bench_json_str(bench_json_t *json, const char *key, const char *value);
+
+/**
+ * Add an integer field
+ */
+void bench_json_int(bench_json_t *json, const char *key, long long value);
+
+/**
+ * Add a number field
+ * @param decimals Decimals to print
+ */
+void bench_json_num(bench_json_t *json, const char *key, double value, int decimals);
+
+/**
+ * Add the statistics as <prefix>_p50_us, <prefix>_p99_us and <prefix>_max_us
+ * fields, in microseconds
+ */
+void bench_json_stats(bench_json_t *json, const char *prefix, const bench_stats_t *stats);
+
+/**
+ * Print a JSON result line and flush the output
+ * @return 0 if OK, -1 if the line was too long (it is not printed)
+ */
+int bench_json_print(bench_json_t *json);
+
+#endif //BENCH_UTILS_H
@@ -0,0 +1,54 @@
+/**
+ * @file crc_utils.h
+ * @author Carlos Gonzalez C - carlgonz@uchile.cl
+ * @date 2020
+ * @copyright GNU GPL v3
+ *
+ * CRC32C (Castagnoli) integrity checks of stored payload records and TM
+ * frames. The CRC is computed with the SSE4.2 crc32 instruction in x86 CPUs
+ * that support it (checked at run time), with the ARMv8 CRC32 instructions if
+ * the compiler targets them (64 bits RPi 3/4 builds), and with a table
+ * otherwise (AVR32 nanomind, 32 bits RPi builds). All the implementations
+ * give the same result.
+ *
+ * The CRC is updated incrementally, as zlib crc32: start with 0 and pass the
+ * previous result to continue with the next bytes.
+ *
+ * @code
+ *      uint32_t crc = crc32c_update(0, header, sizeof(header));
+ *      crc = crc32c_update(crc, data, len);
+ * @endcode
+ */
+
+#ifndef CRC_UTILS_H
+#define CRC_UTILS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Update a CRC32C with @len bytes
+ * @param crc CRC of the previous bytes, 0 to start
+ * @param data Bytes
+ * @param len Number of bytes
+ * @return CRC of the previous bytes and @data
+ */
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t len);
+
+/**
+ * Update a CRC32C with @len bytes using the table, without the hardware
+ * instructions. Gives the same result of crc32c_update.
+ * @param crc CRC of the previous bytes, 0 to start
+ * @param data Bytes
+ * @param len Number of bytes
+ * @return CRC of the previous bytes and @data
+ */
+uint32_t crc32c_update_table(uint32_t crc, const void *data, size_t len);
+
+/**
+ * Get the CRC32C implementation used by crc32c_update
+ * @return Constant name: "sse4.2", "armv8" or "table"
+ */
+const char *crc32c_impl(void);
+
+#endif //CRC_UTILS_H
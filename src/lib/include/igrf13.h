@@ -1,15 +1,85 @@
-
+/**
+ * @file  igrf13.h
+ * @copyright GNU GPL v3
+ *
+ * IGRF13 geomagnetic field model. The coefficients are compiled in and
+ * interpolated to the current date once per day. The igrf_model_* functions
+ * are reentrant, each thread evaluates its own igrf_model_t. igrf_update,
+ * igrf_field and IgrfCalc share one model and must be called from one task.
+ */
 
 #ifndef _IGRF13_H
-int TransMagaxisToECI(const double* mag, double* pos, double lonrad, double thetarad, double gmst);
-void IgrfCalc(double decyear, double latrad, double lonrad, double altm, double* mag);
-void read_model();
-void calc_mag_coords();
-int interpsh(double date, double dte1, int nmax1, double dte2,int nmax2, int gh);
-int   extrapsh(double date, double dte1, int   nmax1, int   nmax2, int   gh);
-int shval3(int igdgc, double flat, double flon, double elev, int nmax, int gh, int iext, double ext1, double ext2, double ext3);
-int   dihf(int gh);
-int getshc(char file[], int iflag, long int strec, int nmax_of_gh, int gh);
 #define _IGRF13_H
 
+#define IGRF_NMAX 13                                ///< Model max. degree
+#define IGRF_NCOEFF (IGRF_NMAX*(IGRF_NMAX+2))       ///< Gauss coefficients
+#define IGRF_NPQ ((IGRF_NMAX*(IGRF_NMAX+3))/2)      ///< Legendre terms
+
+/**
+ * IGRF model state, the coefficients at a date and the Legendre recursion
+ * factors
+ */
+typedef struct igrf_model {
+    double gh[IGRF_NCOEFF];     ///< Coefficients at date
+    double date;                ///< Coefficients date [decimal years]
+    int ok;                     ///< gh is valid
+    double rec_a[IGRF_NPQ+1];   ///< Legendre recursion factors, depend only on n and m
+    double rec_b[IGRF_NPQ+1];
+    double rec_c[IGRF_NPQ+1];
+    int rec_ok;                 ///< The recursion factors are computed
+} igrf_model_t;
+
+/**
+ * Initialize a model, computes the recursion factors. The coefficients are
+ * set by the first igrf_model_update.
+ * @param model Model
+ */
+void igrf_model_init(igrf_model_t *model);
+
+/**
+ * Interpolate the model coefficients to a date. Coefficients are only
+ * updated if @decyear differs more than one day from the current ones.
+ * @param model Model, initialized with igrf_model_init
+ * @param decyear Date [decimal years]
+ */
+void igrf_model_update(igrf_model_t *model, double decyear);
+
+/**
+ * Evaluate the geomagnetic field with the model coefficients
+ * (@see igrf_model_update)
+ * @param model Model
+ * @param latrad Geodetic latitude [rad]
+ * @param lonrad Longitude [rad]
+ * @param altm Altitude above the WGS84 ellipsoid [m]
+ * @param mag Field North, East and Down components [nT]
+ */
+void igrf_model_field(const igrf_model_t *model, double latrad, double lonrad, double altm, double *mag);
+
+/**
+ * Interpolate the model coefficients to a date. Coefficients are only
+ * updated if @decyear differs more than one day from the current ones.
+ * @param decyear Date [decimal years]
+ */
+void igrf_update(double decyear);
+
+/**
+ * Evaluate the geomagnetic field with the current coefficients
+ * (@see igrf_update)
+ * @param latrad Geodetic latitude [rad]
+ * @param lonrad Longitude [rad]
+ * @param altm Altitude above the WGS84 ellipsoid [m]
+ * @param mag Field North, East and Down components [nT]
+ */
+void igrf_field(double latrad, double lonrad, double altm, double *mag);
+
+/**
+ * Geomagnetic field at a date and position, igrf_update and igrf_field
+ * @param decyear Date [decimal years]
+ * @param latrad Geodetic latitude [rad]
+ * @param lonrad Longitude [rad]
+ * @param altm Altitude above the WGS84 ellipsoid [m]
+ * @param mag Field North, East and Down components [nT]
+ */
+void IgrfCalc(double decyear, double latrad, double lonrad, double altm, double* mag);
+
 #endif //_IGRF13_H
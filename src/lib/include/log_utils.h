@@ -24,6 +24,8 @@
 #include "config.h"
 #include "os/os.h"
 #include "osSemphr.h"
+#include "osQueue.h"
+#include "osDelay.h"
 
 #include "csp/csp.h"
 
@@ -46,6 +48,42 @@ typedef enum {
 #define LOG_LEVEL ((log_level_t)LOG_LVL_DEBUG)
 #endif
 
+// Most verbose level compiled in
+#ifndef SCH_LOG_LVL_MAX
+#define SCH_LOG_LVL_MAX LOG_LVL_VERBOSE
+#endif
+
+/**
+ * Log tags with their own log level (@see log_set_tag). A module selects its
+ * tag defining LOG_TAG_ID before including any header, for example:
+ * @code
+ *      #define LOG_TAG_ID LOG_TAG_EXECUTER
+ *      #include "taskExecuter.h"
+ * @endcode
+ * Other modules use LOG_TAG_DEFAULT. Add new tags before LOG_TAG_LAST and
+ * their names in log_utils.c
+ */
+typedef enum log_tag_id {
+    LOG_TAG_DEFAULT = 0,    ///< Modules without their own level
+    LOG_TAG_EXECUTER,       ///< taskExecuter
+    LOG_TAG_DISPATCHER,     ///< taskDispatcher
+    LOG_TAG_CMD,            ///< repoCommand
+    LOG_TAG_DATA,           ///< repoData and data_storage
+    LOG_TAG_COM,            ///< taskCommunications and cmdCOM
+    LOG_TAG_TM,             ///< cmdTM, taskDownlink and taskIngest
+    LOG_TAG_FP,             ///< taskFlightPlan and cmdFP
+    LOG_TAG_HK,             ///< taskHousekeeping
+    LOG_TAG_CONSOLE,        ///< taskConsole and cmdConsole
+    LOG_TAG_OBC,            ///< cmdOBC
+    LOG_TAG_SENSORS,        ///< taskSensors and cmdSensors
+    LOG_TAG_ADCS,           ///< taskADCS and cmdADCS
+    LOG_TAG_LAST            ///< Dummy element, the amount of tags
+} log_tag_id_t;
+
+#ifndef LOG_TAG_ID
+#define LOG_TAG_ID LOG_TAG_DEFAULT
+#endif
+
 #define LOGOUT stdout   ///<! Log to stdout
 //#define LOGOUT stderr   ///<! Log to stderr
 
@@ -66,27 +104,142 @@ int log_init(log_level_t level, int node);
 
 /**
  * Set the log level and node to send logs. If node = -1, then print to stdout,
- * else send logs to another node using CSP
+ * else send logs to another node using CSP. The level of every tag is set to
+ * @level too.
  * @param level Log level
  * @param node CSP node to send logs. Set to -1 to use stdout.
  */
 void log_set(log_level_t level, int node);
 
+/**
+ * Set the log level of a tag, until the next log_set. Levels above
+ * SCH_LOG_LVL_MAX are accepted but those logs are not compiled in.
+ * @param id Tag ID
+ * @param level Log level
+ * @return 0 if OK, -1 if @id is not valid
+ */
+int log_set_tag(int id, log_level_t level);
+
+/**
+ * Get the ID of a tag by name (@see log_tag_id_t)
+ * @param name Tag name, as "executer"
+ * @return Tag ID, -1 if not found
+ */
+int log_get_tag_id(const char *name);
+
+/**
+ * Get the name of a tag
+ * @param id Tag ID
+ * @return Constant name, "" if @id is not valid
+ */
+const char *log_get_tag_name(int id);
+
 void log_print(const char *lvl, const char *tag, const char *msg, ...);
 void log_send(const char *lvl, const char *tag, const char *msg, ...);
 
+/**
+ * Async log message, formatted by the producer (@see SCH_LOG_ASYNC)
+ */
+typedef struct log_record {
+    const char *lvl;                ///< Level name
+    const char *tag;                ///< Module tag, a static string
+    uint32_t time;                  ///< Log time, as dat_get_time
+    uint16_t len;                   ///< Binary record length, 0 if msg is text
+    char msg[SCH_LOG_MSG_LEN];      ///< Formatted message, truncated, or binary record
+} log_record_t;
+
+/**
+ * Format a log message and queue it for log_task without blocking. If the
+ * queue is full the message is dropped and counted, log_task reports how many,
+ * but errors and results are written directly. Before log_init, or if
+ * SCH_LOG_ASYNC is 0, the message is written directly.
+ * @param level Log level, for the rate limit (@see log_rate_check)
+ * @param lvl Level name
+ * @param tag Module tag
+ * @param msg Format string
+ */
+void log_async(log_level_t level, const char *lvl, const char *tag, const char *msg, ...);
+
+/**
+ * Background task that writes the queued log messages using log_function.
+ * Required if SCH_LOG_ASYNC is 1.
+ * @param param Not used
+ */
+void log_task(void *param);
+
+/**
+ * Binary log (@see SCH_LOG_BINARY). If logs are sent to log_node, the message
+ * is not formatted: the record holds the ID of the call site, a hash of the
+ * file name and line, and the raw arguments. Binary records are sent to the
+ * SCH_TRX_PORT_DBG_BIN port, several per packet with SCH_LOG_ASYNC, and
+ * sandbox/log_parser.py renders them from the sources. Otherwise, or if the
+ * format is not a string literal, the message is written as text.
+ *
+ * Record (big endian): uint32 id, uint32 time, uint8 level, uint8 args length,
+ * args. Integers take 4 bytes, or 8 with the l, ll, j, z and t modifiers,
+ * pointers 8 bytes, floating point values are 4 byte floats and strings are
+ * copied with their NUL, truncated to LOG_BIN_STR_MAX bytes.
+ *
+ * @param id Call site ID cache, NULL to write text
+ * @param file Call site file name, only the base name is hashed
+ * @param line Call site line
+ * @param level Log level
+ * @param lvl Level name
+ * @param tag Module tag
+ * @param msg Format string
+ */
+void log_binary(uint32_t *id, const char *file, int line, log_level_t level, const char *lvl, const char *tag, const char *msg, ...);
+
+#if SCH_LOG_RATE_MAX > 0
+/**
+ * Per tag rate limit. Allows up to SCH_LOG_RATE_MAX messages per second of each
+ * tag, errors and results are never limited. When a tag is allowed again, the
+ * number of messages dropped is logged.
+ * @param level Log level
+ * @param tag Module tag
+ * @return 1 if the message can be logged, 0 if it must be dropped
+ */
+int log_rate_check(log_level_t level, const char *tag);
+#else
+#define log_rate_check(level, tag) (1)
+#endif
+
 extern void (*log_function)(const char *lvl, const char *tag, const char *msg, ...);
 extern log_level_t log_lvl;
 extern uint8_t log_node;
+extern uint8_t log_tag_lvl[LOG_TAG_LAST];
+
+/**
+ * Check if a level is logged by the current module (LOG_TAG_ID). Levels above
+ * SCH_LOG_LVL_MAX are constant false, so the compiler removes the log call and
+ * its arguments. Use it to skip work done only to log:
+ * @code
+ *      if(LOG_ENABLED(LOG_LVL_DEBUG))
+ *      {
+ *          trx_cmd = cmd_build_from_str("com_get_config 0 tx_inhibit");
+ *          cmd_send(trx_cmd);
+ *      }
+ * @endcode
+ */
+#define LOG_ENABLED(level)  ((level) <= SCH_LOG_LVL_MAX && log_tag_lvl[LOG_TAG_ID] >= (level))
+
+/// Write a log message, directly or through log_task (@see SCH_LOG_ASYNC)
+#if SCH_LOG_BINARY
+#define LOG_WRITE(level, lvl, tag, msg, ...)  {static uint32_t _log_id = 0; log_binary(__builtin_constant_p(msg) ? &_log_id : NULL, __FILE__, __LINE__, level, lvl, tag, msg, ##__VA_ARGS__);}
+#elif SCH_LOG_ASYNC
+#define LOG_WRITE(level, lvl, tag, msg, ...)  log_async(level, lvl, tag, msg, ##__VA_ARGS__)
+#else
+#define LOG_WRITE(level, lvl, tag, msg, ...)  if(log_rate_check(level, tag)) {osSemaphoreTake(&log_mutex, portMAX_DELAY); log_function(lvl, tag, msg, ##__VA_ARGS__); osSemaphoreGiven(&log_mutex);}
+#endif
 
 /// Logging functions @see log_level_t
-#define LOGE(tag, msg, ...)   if(log_lvl >= LOG_LVL_ERROR)   {osSemaphoreTake(&log_mutex, portMAX_DELAY); log_function("ERROR", tag, msg, ##__VA_ARGS__); osSemaphoreGiven(&log_mutex);}
-#define LOGW(tag, msg, ...)   if(log_lvl >= LOG_LVL_WARN)    {osSemaphoreTake(&log_mutex, portMAX_DELAY); log_function("WARN ", tag, msg, ##__VA_ARGS__); osSemaphoreGiven(&log_mutex);}
-#define LOGI(tag, msg, ...)   if(log_lvl >= LOG_LVL_INFO)    {osSemaphoreTake(&log_mutex, portMAX_DELAY); log_function("INFO ", tag, msg, ##__VA_ARGS__); osSemaphoreGiven(&log_mutex);}
-#define LOGD(tag, msg, ...)   if(log_lvl >= LOG_LVL_DEBUG)   {osSemaphoreTake(&log_mutex, portMAX_DELAY); log_function("DEBUG", tag, msg, ##__VA_ARGS__); osSemaphoreGiven(&log_mutex);}
-#define LOGV(tag, msg, ...)   if(log_lvl >= LOG_LVL_VERBOSE) {osSemaphoreTake(&log_mutex, portMAX_DELAY); log_function("VERB ", tag, msg, ##__VA_ARGS__); osSemaphoreGiven(&log_mutex);}
-#define LOGR(tag, msg, ...)   if(log_lvl >= LOG_LVL_RESULT)  {osSemaphoreTake(&log_mutex, portMAX_DELAY); log_function("RES  ", tag, msg, ##__VA_ARGS__); osSemaphoreGiven(&log_mutex);}
-#define LOGP(tag, msg, ...)                                  {osSemaphoreTake(&log_mutex, portMAX_DELAY); log_print   ("REMOT", tag, msg, ##__VA_ARGS__); osSemaphoreGiven(&log_mutex);}
+#define LOGE(tag, msg, ...)   if(LOG_ENABLED(LOG_LVL_ERROR))   {LOG_WRITE(LOG_LVL_ERROR, "ERROR", tag, msg, ##__VA_ARGS__);}
+#define LOGW(tag, msg, ...)   if(LOG_ENABLED(LOG_LVL_WARN))    {LOG_WRITE(LOG_LVL_WARN, "WARN ", tag, msg, ##__VA_ARGS__);}
+#define LOGI(tag, msg, ...)   if(LOG_ENABLED(LOG_LVL_INFO))    {LOG_WRITE(LOG_LVL_INFO, "INFO ", tag, msg, ##__VA_ARGS__);}
+#define LOGD(tag, msg, ...)   if(LOG_ENABLED(LOG_LVL_DEBUG))   {LOG_WRITE(LOG_LVL_DEBUG, "DEBUG", tag, msg, ##__VA_ARGS__);}
+#define LOGV(tag, msg, ...)   if(LOG_ENABLED(LOG_LVL_VERBOSE)) {LOG_WRITE(LOG_LVL_VERBOSE, "VERB ", tag, msg, ##__VA_ARGS__);}
+#define LOGR(tag, msg, ...)   if(LOG_ENABLED(LOG_LVL_RESULT))  {LOG_WRITE(LOG_LVL_RESULT, "RES  ", tag, msg, ##__VA_ARGS__);}
+#define LOGP(tag, msg, ...)                                    {osSemaphoreTake(&log_mutex, portMAX_DELAY); log_print   ("REMOT", tag, msg, ##__VA_ARGS__); osSemaphoreGiven(&log_mutex);}
 
 /// Assert functions
 #define clean_errno() (errno == 0 ? "None" : strerror(errno))
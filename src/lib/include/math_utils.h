@@ -14,25 +14,52 @@
 #define MATH_UTILS_H
 
 #include <math.h>
+#include <stdint.h>
 #include "config.h"
 #include <assert.h>
 
+/**
+ * Real number type of the ADCS math. Set SCH_ADCS_FLOAT to use single
+ * precision in targets with a single precision FPU, where doubles are
+ * emulated in software. Use REAL() for constants in expressions and the r_*
+ * functions, so the math is not promoted to double.
+ */
+#if SCH_ADCS_FLOAT
+typedef float real_t;
+#define REAL(x)     ((float)(x))
+#define r_sqrt      sqrtf
+#define r_pow       powf
+#define r_sin       sinf
+#define r_cos       cosf
+#define r_acos      acosf
+#define r_fabs      fabsf
+#else
+typedef double real_t;
+#define REAL(x)     ((double)(x))
+#define r_sqrt      sqrt
+#define r_pow       pow
+#define r_sin       sin
+#define r_cos       cos
+#define r_acos      acos
+#define r_fabs      fabs
+#endif
+
 /**
  * Quaternion structure
  * q = q0*i + q1*j + q2*k + q3
  * q = (scalar, vect)
  */
 typedef union quaternion {
-    double q[4];      ///< Quaternion as array
+    real_t q[4];      ///< Quaternion as array
     struct {
-        double q0; ///< Quaternion i
-        double q1; ///< Quaternion j
-        double q2; ///< Quaternion k
-        double q3; ///< Quaternion scalar
+        real_t q0; ///< Quaternion i
+        real_t q1; ///< Quaternion j
+        real_t q2; ///< Quaternion k
+        real_t q3; ///< Quaternion scalar
     };
     struct {
-        double vec[3]; ///< Quaternion vector
-        double scalar;  ///< Quaternion scalar
+        real_t vec[3]; ///< Quaternion vector
+        real_t scalar;  ///< Quaternion scalar
     };
 }quaternion_t;
 
@@ -41,11 +68,11 @@ typedef union quaternion {
  * 3D vector structure
  */
 typedef union vector3 {
-    double v[3];    ///< Vector as array [x, y, z]
+    real_t v[3];    ///< Vector as array [x, y, z]
     struct {
-        double v0;  ///< Vector x
-        double v1;  ///< Vector y
-        double v2;  ///< Vector z
+        real_t v0;  ///< Vector x
+        real_t v1;  ///< Vector y
+        real_t v2;  ///< Vector z
     };
 }vector3_t;
 
@@ -53,14 +80,22 @@ typedef union vector3 {
  * 3x3 matrix structure
  */
 typedef union matrix3 {
-    double m[3][3];    ///< Matrix as array
+    real_t m[3][3];    ///< Matrix as array
     struct {
-        double row0[3];
-        double row1[3];
-        double row2[3];
+        real_t row0[3];
+        real_t row1[3];
+        real_t row2[3];
     };
 }matrix3_t;
 
+/**
+ * Symmetric 6x6 matrix, the ESKF error covariance. Only the upper triangle is
+ * stored, packed by rows: (0,0) (0,1) .. (0,5) (1,1) .. (1,5) .. (5,5)
+ */
+typedef struct sym6 {
+    real_t p[21];
+}sym6_t;
+
 /**
  * Calculates unit quaternion from a pure vector.
  * @param axis vector of dimension 3.
@@ -74,7 +109,7 @@ void vec_to_quat(vector3_t axis, quaternion_t * res);
  * @param rot angle of rotation, in radians.
  * @param res equivalent rotation quaternion.
  */
-void axis_rotation_to_quat(vector3_t axis, double rot, quaternion_t * res);
+void axis_rotation_to_quat(vector3_t axis, real_t rot, quaternion_t * res);
 
 /**
  * Sum. of quaternions
@@ -133,7 +168,7 @@ void quat_inverse(quaternion_t *q, quaternion_t *res);
  * @param vec input vector
  * @return euclidean norm of vec
  */
-double vec_norm(vector3_t vec);
+real_t vec_norm(vector3_t vec);
 
 /**
  * Normalize input vector vec into an unitary vector with norm 1
@@ -147,9 +182,9 @@ int vec_normalize(vector3_t *vec, vector3_t *res);
  * Calculates the inner product between two vectors of dimension 3
  * @param lhs left input vector of dim 3
  * @param rhs right input vector of dim 3
- * @return double with the inner product
+ * @return real_t with the inner product
  */
-double vec_inner_product(vector3_t lhs, vector3_t rhs);
+real_t vec_inner_product(vector3_t lhs, vector3_t rhs);
 
 /**
  * Calculates the other product between two vectors of dimension 3,
@@ -166,7 +201,7 @@ void vec_outer_product(vector3_t lhs, vector3_t rhs, vector3_t * res);
  * @param v2 second input vector of dim 3.
  * @return
  */
-double vec_angle(vector3_t v1, vector3_t v2);
+real_t vec_angle(vector3_t v1, vector3_t v2);
 
 /**
  * Calculates the algebraic sum between two input vector of dim 3.
@@ -183,7 +218,7 @@ void vec_sum(vector3_t lhs, vector3_t rhs, vector3_t * res);
  * @param vec input vector.
  * @param res vector of dimension 3. If NULL, result is stored in vec
  */
-void vec_cons_mult(double a, vector3_t *vec, vector3_t *res);
+void vec_cons_mult(real_t a, vector3_t *vec, vector3_t *res);
 
 /**
  * Calculates the matrix, vector product of dimensions (3,3) and 3.
@@ -223,7 +258,7 @@ void mat_mat_sum(matrix3_t lhs, matrix3_t rhs, matrix3_t* res);
  * @param b diagonal value
  * @param c diagonal value
  */
-void mat_set_diag(matrix3_t *m, double a, double b, double c);
+void mat_set_diag(matrix3_t *m, real_t a, real_t b, real_t c);
 
 /**
  * Calculates skew matrix from a 3 dimension vector
@@ -246,24 +281,243 @@ void mat_inverse(matrix3_t mat, matrix3_t* res);
  */
 void mat_transpose(matrix3_t* mat, matrix3_t* res);
 
-void _mat_cons_mult(double  a, double * mat, double *res, int n_x, int n_y);
+/*
+ * Fixed size kernels. Matrices are row-major real_t arrays, as the
+ * matrix3_t.m field or a real_t[6][6] cast to real_t *. Results must not
+ * overlap the inputs (restrict). These are inlined and fully or partially
+ * unrolled so the compiler can schedule them without loop overhead, the
+ * matrix3_t by value functions above are wrappers of these.
+ */
 
-void _mat_vec_mult(double * mat, double * vec, double * res, int n_x, int n_y);
+/**
+ * Vector sum, res = lhs + rhs (3)
+ */
+static inline void vec3_sum(const real_t *restrict lhs, const real_t *restrict rhs, real_t *restrict res)
+{
+    res[0] = lhs[0] + rhs[0];
+    res[1] = lhs[1] + rhs[1];
+    res[2] = lhs[2] + rhs[2];
+}
 
-void _mat_mat_mult(double * lhs, double * rhs, double * res, int n_x, int n_y, int n_z);
+/**
+ * Matrix vector product, res = mat * vec (3x3 * 3)
+ */
+static inline void mat3_vec_mult(const real_t *restrict mat, const real_t *restrict vec, real_t *restrict res)
+{
+    res[0] = mat[0]*vec[0] + mat[1]*vec[1] + mat[2]*vec[2];
+    res[1] = mat[3]*vec[0] + mat[4]*vec[1] + mat[5]*vec[2];
+    res[2] = mat[6]*vec[0] + mat[7]*vec[1] + mat[8]*vec[2];
+}
 
-void _mat_mat_sum(double * lhs, double * rhs, double * res, int n_x, int n_y);
+/**
+ * Matrix product, res = lhs * rhs (3x3)
+ */
+static inline void mat3_mat_mult(const real_t *restrict lhs, const real_t *restrict rhs, real_t *restrict res)
+{
+    int i;
+    for(i=0; i<9; i+=3)
+    {
+        res[i+0] = lhs[i]*rhs[0] + lhs[i+1]*rhs[3] + lhs[i+2]*rhs[6];
+        res[i+1] = lhs[i]*rhs[1] + lhs[i+1]*rhs[4] + lhs[i+2]*rhs[7];
+        res[i+2] = lhs[i]*rhs[2] + lhs[i+1]*rhs[5] + lhs[i+2]*rhs[8];
+    }
+}
 
-void _mat_set_diag(double * m, double val, int n_x, int n_y);
+/**
+ * Matrix sum, res = lhs + rhs (3x3)
+ */
+static inline void mat3_mat_sum(const real_t *restrict lhs, const real_t *restrict rhs, real_t *restrict res)
+{
+    int i;
+    for(i=0; i<9; i++)
+        res[i] = lhs[i] + rhs[i];
+}
 
-void _mat_transpose(double * mat, double * res, int n_i, int n_j);
+/**
+ * Matrix transpose, res = mat' (3x3)
+ */
+static inline void mat3_transpose(const real_t *restrict mat, real_t *restrict res)
+{
+    res[0] = mat[0]; res[1] = mat[3]; res[2] = mat[6];
+    res[3] = mat[1]; res[4] = mat[4]; res[5] = mat[7];
+    res[6] = mat[2]; res[7] = mat[5]; res[8] = mat[8];
+}
 
-void _mat_copy(double * mat, double * res, int matx, int maty, int resx, int resy, int p_i, int p_j);
+/**
+ * Matrix inverse, res = inv(mat) (3x3)
+ * @return Determinant of @mat, @res is not valid if it is 0
+ */
+static inline real_t mat3_inverse(const real_t *restrict mat, real_t *restrict res)
+{
+    real_t A = mat[4]*mat[8] - mat[5]*mat[7];
+    real_t B = mat[5]*mat[6] - mat[3]*mat[8];
+    real_t C = mat[3]*mat[7] - mat[4]*mat[6];
+    real_t det = mat[0]*A + mat[1]*B + mat[2]*C;
+    if(det == REAL(0.0))
+        return det;
+
+    real_t inv = REAL(1.0)/det;
+    res[0] = A*inv;
+    res[1] = (mat[2]*mat[7] - mat[1]*mat[8])*inv;
+    res[2] = (mat[1]*mat[5] - mat[2]*mat[4])*inv;
+    res[3] = B*inv;
+    res[4] = (mat[0]*mat[8] - mat[2]*mat[6])*inv;
+    res[5] = (mat[2]*mat[3] - mat[0]*mat[5])*inv;
+    res[6] = C*inv;
+    res[7] = (mat[1]*mat[6] - mat[0]*mat[7])*inv;
+    res[8] = (mat[0]*mat[4] - mat[1]*mat[3])*inv;
+    return det;
+}
+
+/**
+ * Matrix product, res = lhs * rhs (6x6)
+ */
+static inline void mat6_mat_mult(const real_t *restrict lhs, const real_t *restrict rhs, real_t *restrict res)
+{
+    int i, k;
+    for(i=0; i<36; i+=6)
+    {
+        for(k=0; k<6; k++)
+        {
+            res[i+k] = lhs[i+0]*rhs[k]    + lhs[i+1]*rhs[6+k]  + lhs[i+2]*rhs[12+k]
+                     + lhs[i+3]*rhs[18+k] + lhs[i+4]*rhs[24+k] + lhs[i+5]*rhs[30+k];
+        }
+    }
+}
+
+/**
+ * Matrix product with the transpose of rhs, res = lhs * rhs' (6x6). Both
+ * operands are read by rows, so no transposed copy is needed.
+ */
+static inline void mat6_mat_mult_t(const real_t *restrict lhs, const real_t *restrict rhs, real_t *restrict res)
+{
+    int i, j;
+    for(i=0; i<36; i+=6)
+    {
+        for(j=0; j<6; j++)
+        {
+            const real_t *r = rhs + 6*j;
+            res[i+j] = lhs[i+0]*r[0] + lhs[i+1]*r[1] + lhs[i+2]*r[2]
+                     + lhs[i+3]*r[3] + lhs[i+4]*r[4] + lhs[i+5]*r[5];
+        }
+    }
+}
 
-void eskf_integrate(quaternion_t q, vector3_t omega, double dt, quaternion_t * res);
+/**
+ * Matrix sum, res = lhs + rhs (6x6)
+ */
+static inline void mat6_mat_sum(const real_t *restrict lhs, const real_t *restrict rhs, real_t *restrict res)
+{
+    int i;
+    for(i=0; i<36; i++)
+        res[i] = lhs[i] + rhs[i];
+}
+
+/**
+ * Set a 6x6 diagonal matrix with @val in the diagonal
+ */
+static inline void mat6_set_diag(real_t *restrict mat, real_t val)
+{
+    int i;
+    for(i=0; i<36; i++)
+        mat[i] = (i % 7 == 0) ? val : REAL(0.0);
+}
 
-void eskf_compute_error(vector3_t omega, double dt, double P[6][6], double Q[6][6]);
+/**
+ * Copy a 3x3 matrix to the (i, j) block of a 6x6 matrix, i, j in [0, 1]
+ */
+static inline void mat6_set_block(const real_t *restrict mat, real_t *restrict res, int i, int j)
+{
+    real_t *restrict r = res + 18*i + 3*j;
+    r[0]  = mat[0]; r[1]  = mat[1]; r[2]  = mat[2];
+    r[6]  = mat[3]; r[7]  = mat[4]; r[8]  = mat[5];
+    r[12] = mat[6]; r[13] = mat[7]; r[14] = mat[8];
+}
 
-void eskf_update_mag(vector3_t mag_sensor, vector3_t mag_i, double P[6][6], matrix3_t * R, quaternion_t * q, vector3_t * wb);
+/**
+ * Set the (i, j) block of a 6x6 matrix to a diagonal 3x3 matrix, i, j in [0, 1]
+ */
+static inline void mat6_set_block_diag(real_t *restrict res, real_t val, int i, int j)
+{
+    real_t *restrict r = res + 18*i + 3*j;
+    r[0]  = val; r[1]  = 0.0; r[2]  = 0.0;
+    r[6]  = 0.0; r[7]  = val; r[8]  = 0.0;
+    r[12] = 0.0; r[13] = 0.0; r[14] = val;
+}
+
+void _mat_cons_mult(real_t  a, real_t * mat, real_t *res, int n_x, int n_y);
+
+void _mat_vec_mult(real_t * mat, real_t * vec, real_t * res, int n_x, int n_y);
+
+void _mat_mat_mult(real_t * lhs, real_t * rhs, real_t * res, int n_x, int n_y, int n_z);
+
+void _mat_mat_sum(real_t * lhs, real_t * rhs, real_t * res, int n_x, int n_y);
+
+void _mat_set_diag(real_t * m, real_t val, int n_x, int n_y);
+
+void _mat_transpose(real_t * mat, real_t * res, int n_i, int n_j);
+
+void _mat_copy(real_t * mat, real_t * res, int matx, int maty, int resx, int resy, int p_i, int p_j);
+
+/**
+ * Get the (i, j) element of a symmetric 6x6 matrix, any i, j in [0, 5]
+ */
+real_t sym6_get(const sym6_t *mat, int i, int j);
+
+/**
+ * Unpack a symmetric 6x6 matrix to a full 6x6 matrix
+ */
+void sym6_to_mat(const sym6_t *mat, real_t *res);
+
+/**
+ * Pack the upper triangle of a 6x6 matrix, the lower triangle is not read
+ */
+void sym6_from_mat(const real_t *mat, sym6_t *res);
+
+/**
+ * ESKF covariance prediction P = F*P*F' + Q, with F = [F11 -dt*I; 0 I] and
+ * Q = diag(q_theta*I, q_bias*I). Only the non trivial blocks are computed and
+ * the result is symmetric by construction.
+ * @param P Error covariance, updated
+ * @param F11 Attitude error transition, the transposed rotation of omega*dt
+ * @param dt Time step
+ * @param q_theta Attitude process noise
+ * @param q_bias Gyro bias process noise
+ */
+void eskf_predict_cov(sym6_t *P, const matrix3_t *F11, real_t dt, real_t q_theta, real_t q_bias);
+
+/**
+ * ESKF covariance update for a measurement that only observes the attitude
+ * error, H = [H1 0], with noise r*I. The covariance is updated in Joseph form,
+ * P = (I-K*H)*P*(I-K*H)' + K*R*K', expanded as P - K*U' - U*K' + K*S*K' with
+ * U = P*H', so it stays symmetric and positive definite with rounding errors.
+ * @param P Error covariance, updated
+ * @param H1 Measurement Jacobian of the attitude error
+ * @param r Measurement noise variance
+ * @param y Innovation
+ * @param dx Error state correction K*y (6 values)
+ * @return 0 if OK, -1 if the innovation covariance is singular (P not updated)
+ */
+int eskf_update_cov(sym6_t *P, const matrix3_t *H1, real_t r, const vector3_t *y, real_t *dx);
+
+void eskf_integrate(quaternion_t q, vector3_t omega, real_t dt, quaternion_t * res);
+
+void eskf_compute_error(vector3_t omega, real_t dt, real_t P[6][6], real_t Q[6][6]);
+
+void eskf_update_mag(vector3_t mag_sensor, vector3_t mag_i, real_t P[6][6], matrix3_t * R, quaternion_t * q, vector3_t * wb);
+
+/**
+ * Julian date of a unix time
+ * @param unix_time Unix time [s]
+ * @return Julian date [days]
+ */
+double unixt_to_jd(uint32_t unix_time);
+
+/**
+ * Decimal year of a Julian date, as used by the IGRF model
+ * @param jd Julian date [days]
+ * @return Decimal year
+ */
+double jd_to_dec(double jd);
 
 #endif //MATH_UTILS_H
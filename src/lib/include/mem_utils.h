@@ -0,0 +1,110 @@
+/**
+ * @file mem_utils.h
+ * @author Carlos Gonzalez C - carlgonz@uchile.cl
+ * @date 2020
+ * @copyright GNU GPL v3
+ *
+ * Heap accounting by subsystem. Dynamic allocations of the flight software go
+ * through sch_malloc/sch_free with a subsystem tag, so the live bytes, the
+ * peak and the number of allocations of each subsystem can be reported on
+ * orbit (obc_mem_stats) and checked for leaks by the fuzz tests. Each block
+ * keeps its size and tag in a small header before the returned pointer, so
+ * a block must be freed with sch_free, never with free. Counters are updated
+ * with atomic operations, without locks. With SCH_MEM_STATS set to 0 the
+ * functions are plain malloc/free.
+ *
+ * @code
+ *      char *name = sch_strdup(MEM_CMD, "obc_ident");
+ *      ...
+ *      sch_free(name);
+ * @endcode
+ */
+
+#ifndef MEM_UTILS_H
+#define MEM_UTILS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+/**
+ * Subsystem tags. Add new tags before MEM_LAST and their names in mem_utils.c
+ */
+typedef enum mem_tag {
+    MEM_CMD = 0,        ///< Commands repository: names, formats and parameters
+    MEM_DATA,           ///< Data repository: payload schemas and recent samples
+    MEM_STORAGE,        ///< Storage driver: tables, queries and buffers
+    MEM_TM,             ///< Telemetry commands: frames and file buffers
+    MEM_COM,            ///< Communication commands: frame buffers
+    MEM_LAST            ///< Dummy element, the amount of tags
+} mem_tag_t;
+
+/**
+ * Subsystem heap counters
+ */
+typedef struct mem_stats {
+    uint32_t live;      ///< Bytes allocated and not yet freed
+    uint32_t peak;      ///< Max. live bytes
+    uint32_t allocs;    ///< Allocations
+    uint32_t frees;     ///< Frees
+} mem_stats_t;
+
+#if SCH_MEM_STATS
+/**
+ * Allocate memory for a subsystem
+ * @param tag Subsystem tag
+ * @param size Bytes
+ * @return Pointer to the block, to be freed with sch_free. NULL if fails
+ */
+void *sch_malloc(mem_tag_t tag, size_t size);
+
+/**
+ * Allocate zeroed memory for a subsystem
+ * @param tag Subsystem tag
+ * @param n Number of elements
+ * @param size Bytes of each element
+ * @return Pointer to the block, to be freed with sch_free. NULL if fails
+ */
+void *sch_calloc(mem_tag_t tag, size_t n, size_t size);
+
+/**
+ * Copy a string to memory of a subsystem
+ * @param tag Subsystem tag
+ * @param str String to copy
+ * @return Pointer to the copy, to be freed with sch_free. NULL if fails
+ */
+char *sch_strdup(mem_tag_t tag, const char *str);
+
+/**
+ * Free a block allocated by sch_malloc, sch_calloc or sch_strdup.
+ * NULL is ignored.
+ * @param ptr Block
+ */
+void sch_free(void *ptr);
+#else
+#define sch_malloc(tag, size)       malloc(size)
+#define sch_calloc(tag, n, size)    calloc(n, size)
+#define sch_strdup(tag, str)        strdup(str)
+#define sch_free(ptr)               free(ptr)
+#endif
+
+/**
+ * Get a copy of the counters of a subsystem
+ * @param tag Subsystem tag
+ * @param stats Counters copy
+ * @param reset Set to clear the peak (to the live bytes) and the allocs
+ * and frees counters. Live bytes are never cleared.
+ * @return 0 if OK, -1 if @tag is not valid
+ */
+int mem_get_stats(int tag, mem_stats_t *stats, int reset);
+
+/**
+ * Get the name of a subsystem tag
+ * @param tag Subsystem tag
+ * @return Constant name, "" if @tag is not valid
+ */
+const char *mem_get_name(int tag);
+
+#endif //MEM_UTILS_H
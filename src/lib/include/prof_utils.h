@@ -0,0 +1,148 @@
+/**
+ * @file prof_utils.h
+ * @author Carlos Gonzalez C - carlgonz@uchile.cl
+ * @date 2020
+ * @copyright GNU GPL v3
+ *
+ * Lightweight profiling counters for hot paths, usable on orbit where perf or
+ * gprof are not available. Each profiling point has a fixed id and counts its
+ * calls and the time spent between SCH_PROF_BEGIN and SCH_PROF_END. Counters
+ * are updated with atomic operations, without locks. With SCH_PROF_ENABLE set
+ * to 0 the macros are compiled out. In GNU/Linux a sampling profiler
+ * (prof_sample_run) gives the hot stacks of every task.
+ *
+ * @code
+ *      SCH_PROF_BEGIN(PROF_STORAGE_PAYLOAD_SET);
+ *      rc = storage_set_payload_data(index, data, payload);
+ *      SCH_PROF_END(PROF_STORAGE_PAYLOAD_SET);
+ * @endcode
+ */
+
+#ifndef PROF_UTILS_H
+#define PROF_UTILS_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+/**
+ * Profiling points. Add new points before PROF_LAST and their names in
+ * prof_utils.c
+ */
+typedef enum prof_id {
+    PROF_STORAGE_STATUS_SET = 0,    ///< Status variables written to storage
+    PROF_STORAGE_STATUS_GET,        ///< Status variables read from storage
+    PROF_STORAGE_PAYLOAD_SET,       ///< Payload samples written to storage
+    PROF_STORAGE_PAYLOAD_GET,       ///< Payload samples read from storage
+    PROF_STORAGE_FP_SET,            ///< Flight plan entries written to storage
+    PROF_STORAGE_FP_GET,            ///< Flight plan entries read from storage
+    PROF_QUEUE_SEND,                ///< Queue sends, including the wait for space (Linux)
+    PROF_QUEUE_RECEIVE,             ///< Queue receives, only counted (Linux)
+    PROF_COM_RECEIVE_TM,            ///< Received telemetry frames
+    PROF_ESKF_PREDICT,              ///< ADCS ESKF predict step
+    PROF_ESKF_UPDATE,               ///< ADCS ESKF magnetometer update
+    PROF_LAST                       ///< Dummy element, the amount of profiling points
+} prof_id_t;
+
+/**
+ * Profiling point counters
+ */
+typedef struct prof_counter {
+    uint32_t count;                 ///< Calls
+    uint32_t time_max_us;           ///< Max. time of a call
+    uint64_t time_sum_us;           ///< Total time
+} prof_counter_t;
+
+#if SCH_PROF_ENABLE
+#define SCH_PROF_BEGIN(id)  uint32_t _prof_start_##id = prof_now_us()           ///< Start timing a profiling point
+#define SCH_PROF_END(id)    prof_add(id, prof_now_us() - _prof_start_##id)      ///< Stop timing a profiling point
+#define SCH_PROF_COUNT(id)  prof_add(id, 0)                                     ///< Count a call without timing it
+#else
+#define SCH_PROF_BEGIN(id)
+#define SCH_PROF_END(id)    do {} while(0)
+#define SCH_PROF_COUNT(id)  do {} while(0)
+#endif
+
+/**
+ * Monotonic time for the profiling timers
+ * @return Time in microseconds, wraps around
+ */
+uint32_t prof_now_us(void);
+
+/**
+ * Add a call to a profiling point
+ * @param id Profiling point
+ * @param time_us Time of the call in microseconds
+ */
+void prof_add(prof_id_t id, uint32_t time_us);
+
+/**
+ * Get a copy of the counters of a profiling point
+ * @param id Profiling point
+ * @param counter Counters copy
+ * @param reset Set to clear the counters
+ * @return 0 if OK, -1 if @id is not valid
+ */
+int prof_get(int id, prof_counter_t *counter, int reset);
+
+/**
+ * Get the name of a profiling point
+ * @param id Profiling point
+ * @return Constant name, "" if @id is not valid
+ */
+const char *prof_get_name(int id);
+
+/**
+ * Clear the counters of all profiling points
+ */
+void prof_reset(void);
+
+#define PROF_SAMPLE_DEPTH (8)               ///< Max. stack frames of a profiler sample
+
+#ifdef LINUX
+/**
+ * Stack of a task sampled by prof_sample_run, with the samples that hit it.
+ * Frames are offsets from the executable load address, to symbolize them
+ * with addr2line; frames outside the executable (shared libraries) are 0.
+ * The first frame is the interrupted instruction, the rest are return
+ * addresses (one past the call).
+ */
+typedef struct prof_stack {
+    uint32_t count;                         ///< Samples with this stack
+    uint16_t task;                          ///< Task index (@see osTaskGetThread)
+    uint16_t depth;                         ///< Frames in pc
+    uint32_t pc[PROF_SAMPLE_DEPTH];         ///< Frames, innermost first
+} prof_stack_t;
+
+/**
+ * Sampling profiler session counters
+ */
+typedef struct prof_sample_stats {
+    uint32_t samples;                       ///< Samples aggregated
+    uint32_t missed;                        ///< Tasks that did not answer the signal in time
+    uint32_t dropped;                       ///< Samples of new stacks with the stacks table full
+    uint32_t tasks;                         ///< Tasks sampled
+} prof_sample_stats_t;
+
+/**
+ * Sampling profiler. Samples the stack of every task created with
+ * osCreateTask, except the caller, @rate_hz times per second for @seconds
+ * seconds and aggregates the samples by task and stack. Each sample sends
+ * SIGPROF to the task, which records its own backtrace in the signal
+ * handler. Tasks are sampled by wall time, so blocked tasks show where they
+ * wait. A blocking call of a sampled task may return EINTR. Stacks are
+ * only complete if the code has unwind tables (-funwind-tables on ARM).
+ * Only one session runs at a time, it blocks the caller until it ends.
+ *
+ * @param rate_hz Samples per second and task, up to SCH_PROF_SAMPLE_MAX_HZ
+ * @param seconds Session length, up to SCH_PROF_SAMPLE_MAX_S
+ * @param stacks Array for saving the stacks
+ * @param max_stacks Size of @stacks
+ * @param stats Pointer for saving the session counters
+ * @return Number of stacks saved, -1 if the parameters are not valid or a
+ * session is in progress
+ */
+int prof_sample_run(int rate_hz, int seconds, prof_stack_t *stacks, int max_stacks, prof_sample_stats_t *stats);
+#endif
+
+#endif //PROF_UTILS_H
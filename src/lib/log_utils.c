@@ -20,17 +20,48 @@
  */
 
 #include "log_utils.h"
+#include "osThread.h"
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+time_t dat_clock_utc(void);     ///< Cached system time, see repoData.h
 
 osSemaphore log_mutex;  ///< Sync logging functions, require initialization
 void (*log_function)(const char *lvl, const char *tag, const char *msg, ...);
 log_level_t log_lvl;
 uint8_t log_node;
+uint8_t log_tag_lvl[LOG_TAG_LAST];  ///< Log level of each tag, set by log_set and log_set_tag
+
+static const char *log_tag_names[LOG_TAG_LAST] = {
+    "default",
+    "executer",
+    "dispatcher",
+    "cmd",
+    "data",
+    "com",
+    "tm",
+    "fp",
+    "hk",
+    "console",
+    "obc",
+    "sensors",
+    "adcs",
+};
+
+#define LOG_TASK_BURST (4)      ///< Messages written per log_mutex take
+#define LOG_RATE_TAGS  (32)     ///< Tags tracked by the rate limit
+#define LOG_BIN_STR_MAX (32)    ///< Max. length of a binary log string argument
+#define LOG_BIN_HEADER (10)     ///< Binary log record header length
+
+static osQueue log_queue = 0;           ///< Async messages, created in log_init
+static uint32_t log_dropped;            ///< Async messages dropped, queue full
 
 void log_print(const char *lvl, const char *tag, const char *msg, ...)
 {
     va_list args;
     va_start(args, msg);
-    fprintf(LOGOUT,"[%s][%lu][%s] ", lvl, (unsigned long)dat_get_time(), tag);
+    fprintf(LOGOUT,"[%s][%lu][%s] ", lvl, (unsigned long)dat_clock_utc(), tag);
     vfprintf(LOGOUT, msg, args);
     fprintf(LOGOUT,CRLF); fflush(LOGOUT);
     va_end(args);
@@ -63,18 +94,405 @@ void log_send(const char *lvl, const char *tag, const char *msg, ...)
         csp_buffer_free((void *)packet);
 }
 
+/* Send binary log records to log_node */
+static void log_send_binary(const void *data, int len)
+{
+    csp_packet_t *packet = csp_buffer_get(SCH_BUFF_MAX_LEN);
+    if(packet == NULL)
+        return;
+
+    memcpy(packet->data, data, len);
+    packet->length = (uint16_t)len;
+    int rc = csp_sendto(CSP_PRIO_NORM, (uint8_t)log_node, SCH_TRX_PORT_DBG_BIN,
+                        SCH_TRX_PORT_DBG_BIN, CSP_O_NONE, packet, 100);
+    if(rc != 0)
+        csp_buffer_free((void *)packet);
+}
+
+/* Write a formatted message, with log_mutex locked */
+static void log_write_record(log_record_t *record)
+{
+    if(record->len > 0)
+    {
+        log_send_binary(record->msg, record->len);
+        return;
+    }
+
+    // log_print adds the current time, use the logging time instead
+    if(log_function == log_print)
+    {
+        fprintf(LOGOUT,"[%s][%lu][%s] %s"CRLF, record->lvl, (unsigned long)record->time, record->tag, record->msg);
+        fflush(LOGOUT);
+    }
+    else
+        log_function(record->lvl, record->tag, "%s", record->msg);
+}
+
+/* Queue a message for log_task, or write it if the queue does not exist. If
+ * the queue is full errors and results are written directly, others dropped */
+static void log_put_record(log_level_t level, log_record_t *record)
+{
+    if(log_queue != 0)
+    {
+        if(osQueueSend(log_queue, record, 0) == pdPASS)
+            return;
+        if(level > LOG_LVL_ERROR)
+        {
+            __sync_add_and_fetch(&log_dropped, 1);
+            return;
+        }
+    }
+
+    osSemaphoreTake(&log_mutex, portMAX_DELAY);
+    log_write_record(record);
+    osSemaphoreGiven(&log_mutex);
+}
+
+void log_async(log_level_t level, const char *lvl, const char *tag, const char *msg, ...)
+{
+    if(!log_rate_check(level, tag))
+        return;
+
+    log_record_t record;
+    record.lvl = lvl;
+    record.tag = tag;
+    record.time = (uint32_t)dat_clock_utc();
+    record.len = 0;
+
+    va_list args;
+    va_start(args, msg);
+    vsnprintf(record.msg, SCH_LOG_MSG_LEN, msg, args);
+    va_end(args);
+
+    log_put_record(level, &record);
+}
+
+/* FNV-1a hash of "<file base name>:<line>" */
+static uint32_t log_hash(const char *file, int line)
+{
+    const char *name = strrchr(file, '/');
+    name = name != NULL ? name + 1 : file;
+
+    char digits[12];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + line % 10);
+        line /= 10;
+    } while(line > 0 && n < (int)sizeof(digits));
+
+    uint32_t hash = 2166136261U;
+    while(*name)
+        hash = (hash ^ (uint8_t)*name++) * 16777619U;
+    hash = (hash ^ (uint8_t)':') * 16777619U;
+    while(n > 0)
+        hash = (hash ^ (uint8_t)digits[--n]) * 16777619U;
+    return hash != 0 ? hash : 1;
+}
+
+static int log_put_u32(uint8_t *buf, int len, int max, uint32_t value)
+{
+    if(len + 4 > max)
+        return -1;
+    buf[len] = (uint8_t)(value >> 24);
+    buf[len+1] = (uint8_t)(value >> 16);
+    buf[len+2] = (uint8_t)(value >> 8);
+    buf[len+3] = (uint8_t)value;
+    return len + 4;
+}
+
+static int log_put_u64(uint8_t *buf, int len, int max, uint64_t value)
+{
+    len = log_put_u32(buf, len, max, (uint32_t)(value >> 32));
+    return len < 0 ? len : log_put_u32(buf, len, max, (uint32_t)value);
+}
+
+/* Copy the arguments of a printf format without formatting them, returns the
+ * bytes written. Stops at the first argument that does not fit */
+static int log_pack_args(uint8_t *buf, int max, const char *fmt, va_list args)
+{
+    int len = 0, next;
+    while(*fmt && len >= 0)
+    {
+        if(*fmt++ != '%')
+            continue;
+        if(*fmt == '%')
+        {
+            fmt++;
+            continue;
+        }
+
+        // Flags, width and precision. A '*' takes an int argument
+        next = len;
+        while(*fmt && next >= 0 && strchr("-+ #0123456789.*", *fmt))
+        {
+            if(*fmt == '*')
+                next = log_put_u32(buf, next, max, (uint32_t)va_arg(args, int));
+            fmt++;
+        }
+
+        // Length modifiers select the type of the argument
+        int longs = 0;
+        char mod = 0;
+        while(*fmt && strchr("hlLqjzt", *fmt))
+        {
+            if(*fmt == 'l')
+                longs++;
+            else
+                mod = *fmt;
+            fmt++;
+        }
+
+        char conv = *fmt ? *fmt++ : 0;
+        if(next < 0)
+            break;
+        len = next;
+        switch(conv)
+        {
+            case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+                if(longs > 1 || mod == 'q')
+                    next = log_put_u64(buf, len, max, (uint64_t)va_arg(args, long long));
+                else if(longs == 1)
+                    next = log_put_u64(buf, len, max, (uint64_t)va_arg(args, long));
+                else if(mod == 'j')
+                    next = log_put_u64(buf, len, max, (uint64_t)va_arg(args, intmax_t));
+                else if(mod == 'z')
+                    next = log_put_u64(buf, len, max, (uint64_t)va_arg(args, size_t));
+                else if(mod == 't')
+                    next = log_put_u64(buf, len, max, (uint64_t)va_arg(args, ptrdiff_t));
+                else
+                    next = log_put_u32(buf, len, max, (uint32_t)va_arg(args, int));
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            {
+                float value = mod == 'L' ? (float)va_arg(args, long double) : (float)va_arg(args, double);
+                uint32_t raw;
+                memcpy(&raw, &value, sizeof(raw));
+                next = log_put_u32(buf, len, max, raw);
+                break;
+            }
+            case 'p':
+                next = log_put_u64(buf, len, max, (uint64_t)(uintptr_t)va_arg(args, void *));
+                break;
+            case 's':
+            {
+                const char *str = va_arg(args, const char *);
+                if(str == NULL)
+                    str = "(null)";
+                int n = (int)strnlen(str, LOG_BIN_STR_MAX);
+                if(len + n + 1 > max)
+                    return len;
+                memcpy(buf + len, str, n);
+                buf[len + n] = '\0';
+                next = len + n + 1;
+                break;
+            }
+            case 'n':
+                (void)va_arg(args, void *);
+                break;
+            default:
+                // Unknown conversion, the remaining arguments can not be read
+                return len;
+        }
+        if(next < 0)
+            break;
+        len = next;
+    }
+    return len;
+}
+
+void log_binary(uint32_t *id, const char *file, int line, log_level_t level, const char *lvl, const char *tag, const char *msg, ...)
+{
+    if(!log_rate_check(level, tag))
+        return;
+
+    log_record_t record;
+    record.lvl = lvl;
+    record.tag = tag;
+    record.time = (uint32_t)dat_clock_utc();
+    record.len = 0;
+
+    va_list args;
+    va_start(args, msg);
+    if(id != NULL && log_function == log_send)
+    {
+        if(*id == 0)
+            *id = log_hash(file, line);
+        uint8_t *buf = (uint8_t *)record.msg;
+        int max = SCH_LOG_MSG_LEN < LOG_BIN_HEADER + 255 ? SCH_LOG_MSG_LEN : LOG_BIN_HEADER + 255;
+        int n = log_pack_args(buf + LOG_BIN_HEADER, max - LOG_BIN_HEADER, msg, args);
+        log_put_u32(buf, 0, LOG_BIN_HEADER, *id);
+        log_put_u32(buf, 4, LOG_BIN_HEADER, record.time);
+        buf[8] = (uint8_t)level;
+        buf[9] = (uint8_t)n;
+        record.len = (uint16_t)(LOG_BIN_HEADER + n);
+    }
+    else
+        vsnprintf(record.msg, SCH_LOG_MSG_LEN, msg, args);
+    va_end(args);
+
+    log_put_record(level, &record);
+}
+
+void log_task(void *param)
+{
+    log_record_t records[LOG_TASK_BURST];
+    uint8_t batch[SCH_BUFF_MAX_LEN];
+    int batch_len = 0;
+    uint32_t reported = 0;
+    int i, n;
+
+    if(log_queue == 0)
+    {
+        LOGW("log", "No log queue, log_task not required");
+        osTaskDelete(NULL);
+        return;
+    }
+
+    while(1)
+    {
+        n = osQueueReceiveMany(log_queue, records, LOG_TASK_BURST, sizeof(log_record_t), portMAX_DELAY);
+        if(n <= 0)
+            continue;
+
+        osSemaphoreTake(&log_mutex, portMAX_DELAY);
+        for(i = 0; i < n; i++)
+        {
+            // Consecutive binary records share a packet
+            log_record_t *record = &records[i];
+            if(record->len > 0 && batch_len + record->len <= SCH_BUFF_MAX_LEN)
+            {
+                memcpy(batch + batch_len, record->msg, record->len);
+                batch_len += record->len;
+                continue;
+            }
+            if(batch_len > 0)
+                log_send_binary(batch, batch_len);
+            batch_len = 0;
+            log_write_record(record);
+        }
+        if(batch_len > 0)
+            log_send_binary(batch, batch_len);
+        batch_len = 0;
+
+        // Report the messages lost since the last report
+        uint32_t dropped = __atomic_load_n(&log_dropped, __ATOMIC_RELAXED);
+        if(dropped != reported)
+        {
+            log_record_t lost = {"WARN ", "log", (uint32_t)dat_clock_utc(), 0, ""};
+            snprintf(lost.msg, SCH_LOG_MSG_LEN, "%u messages dropped, log queue full", (unsigned)(dropped - reported));
+            log_write_record(&lost);
+            reported = dropped;
+        }
+        osSemaphoreGiven(&log_mutex);
+    }
+}
+
+#if SCH_LOG_RATE_MAX > 0
+/* Messages of a tag in the current one second window */
+typedef struct log_rate {
+    const char *tag;
+    uint32_t window;
+    uint32_t count;
+    uint32_t dropped;
+} log_rate_t;
+
+static log_rate_t log_rate[LOG_RATE_TAGS];
+
+int log_rate_check(log_level_t level, const char *tag)
+{
+    if(level <= LOG_LVL_ERROR || tag == NULL)
+        return 1;
+
+    // Find the tag, or claim a free slot for it. Untracked tags are not limited
+    log_rate_t *rate = NULL;
+    unsigned int i, h = (unsigned int)(((uintptr_t)tag >> 3) % LOG_RATE_TAGS);
+    for(i = 0; i < LOG_RATE_TAGS && rate == NULL; i++)
+    {
+        log_rate_t *slot = &log_rate[(h + i) % LOG_RATE_TAGS];
+        const char *owner = slot->tag;
+        if(owner == NULL)
+        {
+            owner = __sync_val_compare_and_swap(&slot->tag, NULL, tag);
+            if(owner == NULL)
+                owner = tag;
+        }
+        if(owner == tag)
+            rate = slot;
+    }
+    if(rate == NULL)
+        return 1;
+
+    // A new window starts, report the messages dropped in the previous ones
+    uint32_t window = (uint32_t)(osTaskGetTickCount()/osDefineTime(1000));
+    uint32_t last = __atomic_load_n(&rate->window, __ATOMIC_RELAXED);
+    if(last != window && __sync_bool_compare_and_swap(&rate->window, last, window))
+    {
+        __sync_lock_test_and_set(&rate->count, 0);
+        uint32_t dropped = __sync_lock_test_and_set(&rate->dropped, 0);
+        if(dropped > 0)
+        {
+            log_record_t lost = {"WARN ", tag, (uint32_t)dat_clock_utc(), 0, ""};
+            snprintf(lost.msg, SCH_LOG_MSG_LEN, "%u messages dropped, rate limit", (unsigned)dropped);
+            log_put_record(LOG_LVL_WARN, &lost);
+        }
+    }
+
+    if(__sync_add_and_fetch(&rate->count, 1) <= SCH_LOG_RATE_MAX)
+        return 1;
+    __sync_add_and_fetch(&rate->dropped, 1);
+    return 0;
+}
+#endif
+
 void log_set(log_level_t level, int node)
 {
     osSemaphoreTake(&log_mutex, portMAX_DELAY);
     log_lvl = level;
     log_node = (uint8_t)node;
     log_function = node > 0 ? log_send : log_print;
+    int i;
+    for(i = 0; i < LOG_TAG_LAST; i++)
+        log_tag_lvl[i] = (uint8_t)level;
     osSemaphoreGiven(&log_mutex);
 }
 
+int log_set_tag(int id, log_level_t level)
+{
+    if(id < 0 || id >= LOG_TAG_LAST)
+        return -1;
+    log_tag_lvl[id] = (uint8_t)level;
+    return 0;
+}
+
+int log_get_tag_id(const char *name)
+{
+    int i;
+    for(i = 0; i < LOG_TAG_LAST; i++)
+    {
+        if(strcmp(name, log_tag_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+const char *log_get_tag_name(int id)
+{
+    if(id < 0 || id >= LOG_TAG_LAST)
+        return "";
+    return log_tag_names[id];
+}
+
 int log_init(log_level_t level, int node)
 {
     int rc = osSemaphoreCreate(&log_mutex);
+    osSemaphoreSetName(&log_mutex, "log_mutex");
     log_set(level, node);
+#if SCH_LOG_ASYNC
+    // Producers never wait, there are many of them and only log_task reads
+    log_queue = osQueueCreateType(SCH_LOG_QUEUE_LEN, sizeof(log_record_t), OS_QUEUE_MPSC);
+    if(log_queue == 0)
+        printf("[WARN] Unable to create the log queue, logging synchronously\n");
+    osQueueSetName(log_queue, "log");
+#endif
     return rc;
 }
\ No newline at end of file
@@ -1,9 +1,9 @@
 
 #include "math_utils.h"
 
-const double std_rw_w = 0.001;
-const double std_rn_w = 0.001;
-const double std_rn_mag = 0.001;
+const real_t std_rw_w = 0.001;
+const real_t std_rn_w = 0.001;
+const real_t std_rn_mag = 0.001;
 
 void quat_sum(quaternion_t *q1, quaternion_t *q2, quaternion_t *res)
 {
@@ -21,14 +21,14 @@ void quat_mult(quaternion_t *lhs, quaternion_t *rhs, quaternion_t *res) {
 
 void quat_normalize(quaternion_t *q, quaternion_t *res)
 {
-    double n = 0.0;
+    real_t n = 0.0;
     for(int i=0; i<4 ; i++)
-        n += pow(q->q[i], 2.0);
+        n += (q->q[i]*q->q[i]);
 
-    if (n == 0.0)
+    if (n == REAL(0.0))
         return;
 
-    n = 1.0/sqrt(n);
+    n = REAL(1.0)/r_sqrt(n);
     for(int i=0; i<4; i++)
         if(res != NULL)
             res->q[i] = q->q[i]*n;
@@ -53,69 +53,69 @@ void quat_conjugate(quaternion_t *q, quaternion_t *res)
 
 void quat_frame_conv(quaternion_t *q_rot_a2b, vector3_t *v_a, vector3_t *v_b)
 {
-    double q0 = q_rot_a2b->q3; // real part
-    double q1 = q_rot_a2b->q0; // i
-    double q2 = q_rot_a2b->q1; // j
-    double q3 = q_rot_a2b->q2; // k
+    real_t q0 = q_rot_a2b->q3; // real part
+    real_t q1 = q_rot_a2b->q0; // i
+    real_t q2 = q_rot_a2b->q1; // j
+    real_t q3 = q_rot_a2b->q2; // k
 
-    v_b->v[0] = (2.0 * pow(q0, 2.0) - 1.0 + 2.0 * pow(q1, 2.0)) * v_a->v[0] + (2 * q1 * q2 + 2.0 * q0 * q3) * v_a->v[1] + (2.0 * q1 * q3 - 2.0 * q0 * q2) * v_a->v[2];
-    v_b->v[1] = (2.0 * q1 * q2 - 2.0 * q0 * q3) * v_a->v[0] + (2 * pow(q2, 2.0) + 2.0 * pow(q0, 2.0) - 1.0) * v_a->v[1] + (2.0 * q2 * q3 + 2.0 * q0 * q1) * v_a->v[2];
-    v_b->v[2] = (2.0 * q1 * q3 + 2.0 * q0 * q2) * v_a->v[0] + (2 * q2 * q3 - 2.0 * q0 * q1) * v_a->v[1] + (2.0 * pow(q3, 2.0) + 2.0 * pow(q0, 2.0) - 1.0) * v_a->v[2];
+    v_b->v[0] = (REAL(2.0) * (q0*q0) - REAL(1.0) + REAL(2.0) * (q1*q1)) * v_a->v[0] + (REAL(2.0) * q1 * q2 + REAL(2.0) * q0 * q3) * v_a->v[1] + (REAL(2.0) * q1 * q3 - REAL(2.0) * q0 * q2) * v_a->v[2];
+    v_b->v[1] = (REAL(2.0) * q1 * q2 - REAL(2.0) * q0 * q3) * v_a->v[0] + (REAL(2.0) * (q2*q2) + REAL(2.0) * (q0*q0) - REAL(1.0)) * v_a->v[1] + (REAL(2.0) * q2 * q3 + REAL(2.0) * q0 * q1) * v_a->v[2];
+    v_b->v[2] = (REAL(2.0) * q1 * q3 + REAL(2.0) * q0 * q2) * v_a->v[0] + (REAL(2.0) * q2 * q3 - REAL(2.0) * q0 * q1) * v_a->v[1] + (REAL(2.0) * (q3*q3) + REAL(2.0) * (q0*q0) - REAL(1.0)) * v_a->v[2];
 }
 
 void quat_to_dcm(quaternion_t * q, matrix3_t * res)
 {
-    double q1 = q->q[0];
-    double q2 = q->q[1];
-    double q3 = q->q[2];
-    double q4 = q->q[3];
+    real_t q1 = q->q[0];
+    real_t q2 = q->q[1];
+    real_t q3 = q->q[2];
+    real_t q4 = q->q[3];
 
-    res->m[0][0] = pow(q1, 2) - pow(q2, 2) - pow(q3, 2) + pow(q4, 2);
-    res->m[0][1] = 2 * (q1 * q2 + q3 * q4);
-    res->m[0][2] = 2 * (q1 * q3 - q2 * q4);
+    res->m[0][0] = (q1*q1) - (q2*q2) - (q3*q3) + (q4*q4);
+    res->m[0][1] = REAL(2.0) * (q1 * q2 + q3 * q4);
+    res->m[0][2] = REAL(2.0) * (q1 * q3 - q2 * q4);
 
-    res->m[1][0] = 2 * (q1 * q2 - q3 * q4);
-    res->m[1][1] = -1.0 * pow(q1, 2) + pow(q2, 2) - pow(q3, 2) + pow(q4, 2);
-    res->m[1][2] =  2 * (q2 * q3 + q1 * q4);
+    res->m[1][0] = REAL(2.0) * (q1 * q2 - q3 * q4);
+    res->m[1][1] = -(q1*q1) + (q2*q2) - (q3*q3) + (q4*q4);
+    res->m[1][2] = REAL(2.0) * (q2 * q3 + q1 * q4);
 
-    res->m[2][0] = 2 * (q1 * q3 + q2 * q4);
-    res->m[2][1] = 2 * (q2 * q3 - q1 * q4);
-    res->m[2][2] = -1.0 * pow(q1, 2) - pow(q2, 2) + pow(q3, 2) + pow(q4, 2);
+    res->m[2][0] = REAL(2.0) * (q1 * q3 + q2 * q4);
+    res->m[2][1] = REAL(2.0) * (q2 * q3 - q1 * q4);
+    res->m[2][2] = -(q1*q1) - (q2*q2) + (q3*q3) + (q4*q4);
 }
 
-void axis_rotation_to_quat(vector3_t axis, double rot, quaternion_t * res )
+void axis_rotation_to_quat(vector3_t axis, real_t rot, quaternion_t * res )
 {
-    rot *= 0.5;
-    res->scalar = cos(rot);
+    rot *= REAL(0.5);
+    res->scalar = r_cos(rot);
 
     for(int i=0; i < 3; ++i) {
-        res->vec[i] = axis.v[i] * sin(rot);
+        res->vec[i] = axis.v[i] * r_sin(rot);
     }
 }
 
 void vec_to_quat(vector3_t axis, quaternion_t * res)
 {
-    double rot = vec_norm(axis);
+    real_t rot = vec_norm(axis);
     vector3_t u;
-    vec_cons_mult(1.0 / rot, &axis, &u);
+    vec_cons_mult(REAL(1.0) / rot, &axis, &u);
     axis_rotation_to_quat(u, rot, res);
 }
 
-double vec_norm(vector3_t vec)
+real_t vec_norm(vector3_t vec)
 {
-    double res = 0.0;
+    real_t res = 0.0;
     for(size_t i=0; i<3; ++i){
-        res += pow(vec.v[i], 2.0);
+        res += (vec.v[i]*vec.v[i]);
     }
-    return sqrt(res);
+    return r_sqrt(res);
 }
 
 int vec_normalize(vector3_t *vec, vector3_t *res)
 {
-    double n = vec_norm(*vec);
-    if(n == 0.0) { return 0; }
+    real_t n = vec_norm(*vec);
+    if(n == REAL(0.0)) { return 0; }
 
-    n = 1.0/n;
+    n = REAL(1.0)/n;
     for(int i=0; i<3; ++i){
         if(res != NULL)
             res->v[i] = vec->v[i]*n;
@@ -125,10 +125,10 @@ int vec_normalize(vector3_t *vec, vector3_t *res)
     return 1;
 }
 
-double vec_inner_product(vector3_t lhs, vector3_t rhs)
+real_t vec_inner_product(vector3_t lhs, vector3_t rhs)
 {
-    double res = 0;
-    for(int i=1; i<3; ++i) {
+    real_t res = 0;
+    for(int i=0; i<3; ++i) {
         res += lhs.v[i] * rhs.v[i];
     }
     return res;
@@ -141,20 +141,18 @@ void vec_outer_product(vector3_t lhs, vector3_t rhs, vector3_t * res)
     res->v[2] = lhs.v[0]*rhs.v[1]-lhs.v[1]*rhs.v[0];
 }
 
-double vec_angle(vector3_t v1, vector3_t v2)
+real_t vec_angle(vector3_t v1, vector3_t v2)
 {
-    double cos = vec_inner_product(v1, v2) / (vec_norm(v1)*vec_norm(v2));
-    return acos(cos);
+    real_t cos = vec_inner_product(v1, v2) / (vec_norm(v1)*vec_norm(v2));
+    return r_acos(cos);
 }
 
 void vec_sum(vector3_t lhs, vector3_t rhs, vector3_t * res)
 {
-    for(int i=0; i<3; ++i) {
-        res->v[i] = lhs.v[i]+rhs.v[i];
-    }
+    vec3_sum(lhs.v, rhs.v, res->v);
 }
 
-void vec_cons_mult(double a, vector3_t *vec, vector3_t *res)
+void vec_cons_mult(real_t a, vector3_t *vec, vector3_t *res)
 {
     for(int i=0; i<3; ++i){
         if(res != NULL)
@@ -166,20 +164,20 @@ void vec_cons_mult(double a, vector3_t *vec, vector3_t *res)
 
 void mat_vec_mult(matrix3_t mat, vector3_t vec, vector3_t * res)
 {
-    _mat_vec_mult((double *) mat.m, (double *) vec.v, (double *) res->v,3, 3);
+    mat3_vec_mult((real_t *) mat.m, vec.v, res->v);
 }
 
 void mat_mat_mult(matrix3_t lhs, matrix3_t rhs, matrix3_t* res)
 {
-    _mat_mat_mult((double *) lhs.m, (double *) rhs.m, (double *) res->m, 3, 3, 3);
+    mat3_mat_mult((real_t *) lhs.m, (real_t *) rhs.m, (real_t *) res->m);
 }
 
 void mat_mat_sum(matrix3_t lhs, matrix3_t rhs, matrix3_t* res)
 {
-    _mat_mat_sum((double *) lhs.m, (double *) rhs.m, (double *) res->m, 3, 3);
+    mat3_mat_sum((real_t *) lhs.m, (real_t *) rhs.m, (real_t *) res->m);
 }
 
-void mat_set_diag(matrix3_t *m, double a, double b, double c)
+void mat_set_diag(matrix3_t *m, real_t a, real_t b, real_t c)
 {
     m->row0[0] = a; m->row0[1] = 0; m->row0[2] = 0;
     m->row1[0] = 0; m->row1[1] = b; m->row1[2] = 0;
@@ -188,47 +186,28 @@ void mat_set_diag(matrix3_t *m, double a, double b, double c)
 
 void mat_transpose(matrix3_t* mat, matrix3_t* res)
 {
-    _mat_transpose((double *) mat->m, (double *) res->m, 3, 3);
+    mat3_transpose((real_t *) mat->m, (real_t *) res->m);
 }
 
 void mat_skew(vector3_t vec, matrix3_t * res)
 {
     res->m[1][0] = vec.v[2];
-    res->m[2][0] = -1.0 * vec.v[1];
+    res->m[2][0] = -vec.v[1];
 
-    res->m[0][1] = -1.0 * vec.v[2];
+    res->m[0][1] = -vec.v[2];
     res->m[0][2] = vec.v[1];
 
     res->m[2][1] = vec.v[0];
-    res->m[1][2] = -1.0 * vec.v[0];
+    res->m[1][2] = -vec.v[0];
 }
 
 void mat_inverse(matrix3_t mat, matrix3_t* res)
 {
-    double a, b, c, d, e, f, g, h, i;
-    a = mat.m[0][0]; b = mat.m[0][1], c = mat.m[0][2];
-    d = mat.m[1][0]; e = mat.m[1][1], f = mat.m[1][2];
-    g = mat.m[2][0]; h = mat.m[2][1], i = mat.m[2][2];
-
-    double A = (e*i - f*h);
-    double B = -1.0 * (d*i - f*g);
-    double C = (d*h -e*g);
-    double D = -1.0* (b*i - c*h);
-    double E = (a*i - c*g);
-    double F = -1.0 * (a*h -b*g);
-    double G = (b*f -c*e);
-    double H = -1.0 * (a*f - c*d);
-    double I = (a*e -b*d);
-    double detmat = a*A + b*B + c*C;
-
-    assert(fabs(detmat) >= 1E-25);
-
-    res->m[0][0] = A/detmat; res->m[0][1] = D/detmat, res->m[0][2] = G/detmat;
-    res->m[1][0] = B/detmat; res->m[1][1] = E/detmat, res->m[1][2] = H/detmat;
-    res->m[2][0] = C/detmat; res->m[2][1] = F/detmat, res->m[2][2] = I/detmat;
+    real_t detmat = mat3_inverse((real_t *) mat.m, (real_t *) res->m);
+    assert(r_fabs(detmat) >= REAL(1E-25));
 }
 
-void _mat_cons_mult(double  a, double * mat, double *res, int n_x, int n_y)
+void _mat_cons_mult(real_t  a, real_t * mat, real_t *res, int n_x, int n_y)
 {
     for(int i=0; i < n_x*n_y; ++i) {
         if(res != NULL)
@@ -238,8 +217,13 @@ void _mat_cons_mult(double  a, double * mat, double *res, int n_x, int n_y)
     }
 }
 
-void _mat_vec_mult(double * mat, double * vec, double * res, int n_x, int n_y)
+void _mat_vec_mult(real_t * mat, real_t * vec, real_t * res, int n_x, int n_y)
 {
+    if(n_x == 3 && n_y == 3)
+    {
+        mat3_vec_mult(mat, vec, res);
+        return;
+    }
     int mati = 0;
     for(int i=0; i< n_x; ++i)
     {
@@ -252,8 +236,16 @@ void _mat_vec_mult(double * mat, double * vec, double * res, int n_x, int n_y)
     }
 }
 
-void _mat_mat_mult(double * lhs, double * rhs, double * res, int n_x, int n_y, int n_z)
+void _mat_mat_mult(real_t * lhs, real_t * rhs, real_t * res, int n_x, int n_y, int n_z)
 {
+    if(n_x == n_y && n_y == n_z && (n_x == 3 || n_x == 6))
+    {
+        if(n_x == 3)
+            mat3_mat_mult(lhs, rhs, res);
+        else
+            mat6_mat_mult(lhs, rhs, res);
+        return;
+    }
     int ires=0, il=0, ir=0;
     for(int i=0; i < n_x; ++i) {
         for(int k=0; k < n_z; ++k) {
@@ -268,14 +260,19 @@ void _mat_mat_mult(double * lhs, double * rhs, double * res, int n_x, int n_y, i
     }
 }
 
-void _mat_mat_sum(double * lhs, double * rhs, double * res, int n_x, int n_y)
+void _mat_mat_sum(real_t * lhs, real_t * rhs, real_t * res, int n_x, int n_y)
 {
+    if(n_x == 6 && n_y == 6)
+    {
+        mat6_mat_sum(lhs, rhs, res);
+        return;
+    }
     for(int i=0; i < n_x *n_y; ++i) {
         res[i] = lhs[i] + rhs[i];
     }
 }
 
-void _mat_transpose(double * mat, double * res, int n_x, int n_y)
+void _mat_transpose(real_t * mat, real_t * res, int n_x, int n_y)
 {
     int index=0, index_t=0;
     for(int i=0; i < n_x; ++i) {
@@ -287,20 +284,25 @@ void _mat_transpose(double * mat, double * res, int n_x, int n_y)
     }
 }
 
-void _mat_copy(double * mat, double * res, int matx, int maty, int resx, int resy, int p_i, int p_j)
+void _mat_copy(real_t * mat, real_t * res, int matx, int maty, int resx, int resy, int p_i, int p_j)
 {
     int i_mat=0, i_res=0;
     for(int i=0; i < matx; ++i) {
         for(int j=0; j < maty; ++j) {
-            i_mat = (matx*i) + j;
-            i_res = ((resx)*(i+p_i)) + j + p_j;
+            i_mat = (maty*i) + j;
+            i_res = (resy*(i+p_i)) + j + p_j;
             res[i_res] = mat[i_mat];
         }
     }
 }
 
-void _mat_set_diag(double * m, double val, int n_x, int n_y)
+void _mat_set_diag(real_t * m, real_t val, int n_x, int n_y)
 {
+    if(n_x == 6 && n_y == 6)
+    {
+        mat6_set_diag(m, val);
+        return;
+    }
     int mi = 0;
     for(int i=0; i < n_x; ++i) {
         for(int j=0; j < n_y; ++j) {
@@ -313,7 +315,7 @@ void _mat_set_diag(double * m, double val, int n_x, int n_y)
     }
 }
 
-void eskf_integrate(quaternion_t q, vector3_t omega, double dt, quaternion_t * res)
+void eskf_integrate(quaternion_t q, vector3_t omega, real_t dt, quaternion_t * res)
 {
     vector3_t omega_dt;
     vec_cons_mult(dt, &omega, &omega_dt);
@@ -322,103 +324,170 @@ void eskf_integrate(quaternion_t q, vector3_t omega, double dt, quaternion_t * r
     quat_mult(&q, &q_omega_dt, res);
 }
 
-void eskf_compute_error(vector3_t omega, double dt, double P[6][6], double Q[6][6])
+/**
+ * Position of each (i, j) element in the packed upper triangle of a sym6_t
+ */
+static const unsigned char sym6_idx[6][6] = {
+    { 0,  1,  2,  3,  4,  5},
+    { 1,  6,  7,  8,  9, 10},
+    { 2,  7, 11, 12, 13, 14},
+    { 3,  8, 12, 15, 16, 17},
+    { 4,  9, 13, 16, 18, 19},
+    { 5, 10, 14, 17, 19, 20}
+};
+
+real_t sym6_get(const sym6_t *mat, int i, int j)
+{
+    return mat->p[sym6_idx[i][j]];
+}
+
+void sym6_to_mat(const sym6_t *mat, real_t *res)
+{
+    for(int i=0; i < 6; ++i)
+        for(int j=0; j < 6; ++j)
+            res[i*6 + j] = mat->p[sym6_idx[i][j]];
+}
+
+void sym6_from_mat(const real_t *mat, sym6_t *res)
+{
+    for(int i=0; i < 6; ++i)
+        for(int j=i; j < 6; ++j)
+            res->p[sym6_idx[i][j]] = mat[i*6 + j];
+}
+
+void eskf_predict_cov(sym6_t *P, const matrix3_t *F11, real_t dt, real_t q_theta, real_t q_bias)
+{
+    // P = [A B; B' C], F = [F11 -dt*I; 0 I]
+    // P11 = (F11*A - dt*B')*F11' - dt*(F11*B - dt*C) + q_theta*I
+    // P12 = F11*B - dt*C
+    // P22 = C + q_bias*I
+    real_t A[3][3], B[3][3], C[3][3], X[3][3], Y[3][3];
+    int i, j;
+    for(i=0; i < 3; ++i) {
+        for(j=0; j < 3; ++j) {
+            A[i][j] = P->p[sym6_idx[i][j]];
+            B[i][j] = P->p[sym6_idx[i][j+3]];
+            C[i][j] = P->p[sym6_idx[i+3][j+3]];
+        }
+    }
+
+    const real_t (*F)[3] = F11->m;
+    for(i=0; i < 3; ++i) {
+        for(j=0; j < 3; ++j) {
+            X[i][j] = F[i][0]*B[0][j] + F[i][1]*B[1][j] + F[i][2]*B[2][j] - dt*C[i][j];
+            Y[i][j] = F[i][0]*A[0][j] + F[i][1]*A[1][j] + F[i][2]*A[2][j] - dt*B[j][i];
+        }
+    }
+
+    for(i=0; i < 3; ++i) {
+        for(j=i; j < 3; ++j) {
+            P->p[sym6_idx[i][j]] = Y[i][0]*F[j][0] + Y[i][1]*F[j][1] + Y[i][2]*F[j][2] - dt*X[i][j];
+            P->p[sym6_idx[i+3][j+3]] = C[i][j];
+        }
+        P->p[sym6_idx[i][i]] += q_theta;
+        P->p[sym6_idx[i+3][i+3]] += q_bias;
+        for(j=0; j < 3; ++j)
+            P->p[sym6_idx[i][j+3]] = X[i][j];
+    }
+}
+
+int eskf_update_cov(sym6_t *P, const matrix3_t *H1, real_t r, const vector3_t *y, real_t *dx)
+{
+    real_t U[6][3], K[6][3], KS[6][3];
+    matrix3_t S, SI;
+    int i, j;
+
+    // U = P*H', only the first three columns of P are used since H = [H1 0]
+    const real_t (*H)[3] = H1->m;
+    for(i=0; i < 6; ++i) {
+        const real_t p0 = P->p[sym6_idx[i][0]], p1 = P->p[sym6_idx[i][1]], p2 = P->p[sym6_idx[i][2]];
+        for(j=0; j < 3; ++j)
+            U[i][j] = p0*H[j][0] + p1*H[j][1] + p2*H[j][2];
+    }
+
+    // S = H*P*H' + r*I = H1*U1 + r*I, symmetric
+    for(i=0; i < 3; ++i) {
+        for(j=i; j < 3; ++j) {
+            S.m[i][j] = H[i][0]*U[0][j] + H[i][1]*U[1][j] + H[i][2]*U[2][j];
+            S.m[j][i] = S.m[i][j];
+        }
+        S.m[i][i] += r;
+    }
+    if(mat3_inverse((real_t *)S.m, (real_t *)SI.m) == REAL(0.0))
+        return -1;
+
+    // K = U*S^-1, KS = K*S, dx = K*y
+    for(i=0; i < 6; ++i) {
+        for(j=0; j < 3; ++j)
+            K[i][j] = U[i][0]*SI.m[0][j] + U[i][1]*SI.m[1][j] + U[i][2]*SI.m[2][j];
+        for(j=0; j < 3; ++j)
+            KS[i][j] = K[i][0]*S.m[0][j] + K[i][1]*S.m[1][j] + K[i][2]*S.m[2][j];
+        dx[i] = K[i][0]*y->v[0] + K[i][1]*y->v[1] + K[i][2]*y->v[2];
+    }
+
+    // Joseph form P = P - K*U' - U*K' + K*S*K', upper triangle only
+    for(i=0; i < 6; ++i) {
+        for(j=i; j < 6; ++j) {
+            real_t ku = K[i][0]*U[j][0] + K[i][1]*U[j][1] + K[i][2]*U[j][2];
+            real_t uk = U[i][0]*K[j][0] + U[i][1]*K[j][1] + U[i][2]*K[j][2];
+            real_t ksk = KS[i][0]*K[j][0] + KS[i][1]*K[j][1] + KS[i][2]*K[j][2];
+            P->p[sym6_idx[i][j]] += ksk - ku - uk;
+        }
+    }
+    return 0;
+}
+
+void eskf_compute_error(vector3_t omega, real_t dt, real_t P[6][6], real_t Q[6][6])
 {
-//    matrix3_t  F[2][2];
-    double  F[6][6];
     // F11
     vector3_t omega_dt;
     vec_cons_mult(dt, &omega, &omega_dt);
     quaternion_t dq_omegadt;
     vec_to_quat(omega_dt, &dq_omegadt);
-    matrix3_t rwb, temp;
+    matrix3_t rwb, F11;
     quat_to_dcm(&dq_omegadt, &rwb);
-    mat_transpose(&rwb, &temp);
-    _mat_copy((double*) temp.m, (double*) F, 3, 3, 6, 6, 0, 0);
-    // F12
-    double diag_val = -1.0*dt;
-    mat_set_diag(&temp, diag_val, diag_val, diag_val);
-    _mat_copy((double*) temp.m, (double*) F, 3, 3, 6, 6, 0, 3);
-//    //F21
-    mat_set_diag(&temp, 0.0, 0.0, 0.0);
-    _mat_copy((double*) temp.m, (double*) F, 3,3,6,6, 3, 0);
-//    //F22
-    mat_set_diag(&temp, 1.0, 1.0, 1.0);
-    _mat_copy((double*) temp.m, (double*) F,3,3,6,6, 3, 3);
+    mat_transpose(&rwb, &F11);
 
     // update Q
-    for(int i=0; i<2; ++i) {
-        for (int j = 0; j < 2; ++j) {
-            if (i == 0 && j == 0) {
-                double val = pow(std_rn_w, 2) * pow(dt, 2);
-                mat_set_diag(&temp, val, val, val);
-                _mat_copy((double*) temp.m, (double*) Q, 3,3,6,6, 0, 0);
-            } else if (i == 1 && j == 1) {
-                double val = pow(std_rw_w, 2) * dt;
-                mat_set_diag(&temp, val, val, val);
-                _mat_copy((double*) temp.m, (double*) Q, 3,3,6,6, 3, 3);
-            } else {
-                mat_set_diag(&temp, 0.0, 0.0, 0.0);
-                _mat_copy((double*) temp.m, (double*) Q, 3,3,6,6, i*3, j*3);
-            }
-        }
-    }
+    real_t q_theta = (std_rn_w*std_rn_w) * (dt*dt);
+    real_t q_bias = (std_rw_w*std_rw_w) * dt;
+    mat6_set_block_diag((real_t*) Q, q_theta, 0, 0);
+    mat6_set_block_diag((real_t*) Q, 0.0, 0, 1);
+    mat6_set_block_diag((real_t*) Q, 0.0, 1, 0);
+    mat6_set_block_diag((real_t*) Q, q_bias, 1, 1);
 
-    // update P
-    double  Ft[6][6];
-    _mat_transpose((double*) F, (double*) Ft, 6,6 );
-    double FP[6][6];
-    _mat_mat_mult((double*) F, (double*) P, (double*) FP,6,6,6);
-    double FPFt[6][6];
-    _mat_mat_mult((double*) FP, (double*) Ft, (double*) FPFt, 6,6,6);
-    _mat_mat_sum((double*) FPFt, (double*) Q, (double*) P, 6, 6);
+    // update P = F*P*F' + Q
+    sym6_t Ps;
+    sym6_from_mat((real_t*) P, &Ps);
+    eskf_predict_cov(&Ps, &F11, dt, q_theta, q_bias);
+    sym6_to_mat(&Ps, (real_t*) P);
 }
 
-void eskf_update_mag(vector3_t mag_sensor, vector3_t mag_i, double P[6][6], matrix3_t *R, quaternion_t * q, vector3_t * wb)
+void eskf_update_mag(vector3_t mag_sensor, vector3_t mag_i, real_t P[6][6], matrix3_t *R, quaternion_t * q, vector3_t * wb)
 {
-    // Magnetic Jacobian
+    // Magnetic Jacobian, H = [skew(mag_b) 0]
     vec_normalize(&mag_i, NULL);
     matrix3_t rwb;
     quat_to_dcm(q, &rwb);
     vector3_t mag_b;
     mat_vec_mult(rwb, mag_i, &mag_b);
-    double H[3][6];
-    matrix3_t temp;
-
-    mat_skew(mag_b, &temp);
-    _mat_copy((double*) temp.m, (double*) H, 3, 3, 3, 6,0,0);
-    mat_set_diag(&temp, 0.0, 0.0, 0.0);
-    _mat_copy((double*) temp.m, (double*) H, 3, 3, 3, 6,0,3);
-
-    // Kalman Gain
-    double Ht[6][3];
-    _mat_transpose((double*) H, (double*) Ht, 3, 6);
-    double PHt[6][3];
-    _mat_mat_mult((double*) P, (double*) Ht, (double*) PHt, 6, 6, 3);
-    matrix3_t S1, S, SI;
-    _mat_mat_mult((double *)H, (double *) PHt, (double *) S1.m, 3, 6, 3);
-    double rval = pow(std_rn_mag,2);
+    matrix3_t H1;
+    mat_set_diag(&H1, 0.0, 0.0, 0.0);
+    mat_skew(mag_b, &H1);
+
+    real_t rval = std_rn_mag*std_rn_mag;
     mat_set_diag(R, rval, rval, rval);
-    mat_mat_sum(S1, *R, &S);
-    mat_inverse(S, &SI);
-    double K[6][3];
-    _mat_mat_mult((double*) PHt, (double*) SI.m, (double*) K, 6, 3, 3);
 
-    // Error state update
+    // Error state and error covariance update
     vector3_t y, nmag_b;
     vec_cons_mult(-1.0, &mag_b, &nmag_b);
     vec_sum(mag_sensor, nmag_b, &y);
-    double dx[6];
-    _mat_mat_mult((double*) K, (double*) y.v, (double*)dx, 6 ,3 ,1);
-
-
-    // Error covariance update
-    double KH[6][6], I6[6][6], IKH[6][6], P1[6][6];
-    _mat_set_diag((double*) I6, 1.0, 6,6 );
-    _mat_mat_mult((double*) K, (double*) H, (double*) KH, 6 ,3, 6);
-    _mat_cons_mult(-1.0, (double *) KH, NULL,6, 6);
-    _mat_mat_sum((double*) I6, (double*) KH, (double*) IKH, 6, 6);
-    _mat_mat_mult((double*) IKH, (double*) P, (double*) P1, 6 ,6, 6);
+    real_t dx[6];
+    sym6_t Ps;
+    sym6_from_mat((real_t*) P, &Ps);
+    if(eskf_update_cov(&Ps, &H1, rval, &y, dx) != 0)
+        return;
+    sym6_to_mat(&Ps, (real_t*) P);
 
     // Auxiliar error state variables
     vector3_t dtheta, dwb;
@@ -438,4 +507,35 @@ void eskf_update_mag(vector3_t mag_sensor, vector3_t mag_i, double P[6][6], matr
         if (i > 2) continue;
         wb->v[i] = wb1.v[i];
     }
-}
\ No newline at end of file
+}
+
+double unixt_to_jd(uint32_t unix_time) {
+    return ( unix_time / 86400.0 ) + 2440587.5;
+}
+
+double jd_to_dec(double jd)
+{
+    double decyear;
+    int leapyrs, year;
+    double    days, tu, temp;
+
+    /* --------------- find year and days of the year --------------- */
+    temp    = jd - 2415019.5;
+    tu      = temp / 365.25;
+    year    = 1900 + (int)floor(tu);
+    leapyrs = (int)floor((year - 1901) * 0.25);
+
+    // optional nudge by 8.64x10-7 sec to get even outputs
+    days    = temp - ((year - 1900) * 365.0 + leapyrs) + 0.00000000001;
+
+    /* ------------ check for case of beginning of a year ----------- */
+    if (days < 1.0)
+    {
+        year    = year - 1;
+        leapyrs = (int)floor((year - 1901) * 0.25);
+        days    = temp - ((year - 1900) * 365.0 + leapyrs);
+    }
+
+    decyear = year + days/365.25;
+    return decyear;
+}
@@ -0,0 +1,126 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mem_utils.h"
+
+static mem_stats_t mem_stats[MEM_LAST];
+
+static const char *mem_names[MEM_LAST] = {
+    "cmd",
+    "data",
+    "storage",
+    "tm",
+    "com",
+};
+
+#if SCH_MEM_STATS
+/**
+ * Block header, keeps the block size and tag. The union keeps the returned
+ * pointer aligned for any type.
+ */
+typedef union mem_header {
+    struct {
+        uint32_t size;
+        uint32_t tag;
+    } block;
+    long double align_ld;
+    void *align_ptr;
+    uint64_t align_u64;
+} mem_header_t;
+
+static void _mem_add(mem_tag_t tag, uint32_t size)
+{
+    mem_stats_t *stats = &mem_stats[tag];
+    __atomic_add_fetch(&stats->allocs, 1, __ATOMIC_RELAXED);
+    uint32_t live = __atomic_add_fetch(&stats->live, size, __ATOMIC_RELAXED);
+    uint32_t peak = __atomic_load_n(&stats->peak, __ATOMIC_RELAXED);
+    while(live > peak && !__atomic_compare_exchange_n(&stats->peak, &peak, live, 0,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void *sch_malloc(mem_tag_t tag, size_t size)
+{
+    if((int)tag < 0 || tag >= MEM_LAST || size > UINT32_MAX - sizeof(mem_header_t))
+        return NULL;
+    mem_header_t *header = malloc(sizeof(mem_header_t) + size);
+    if(header == NULL)
+        return NULL;
+    header->block.size = (uint32_t)size;
+    header->block.tag = (uint32_t)tag;
+    _mem_add(tag, (uint32_t)size);
+    return header + 1;
+}
+
+void *sch_calloc(mem_tag_t tag, size_t n, size_t size)
+{
+    if(size != 0 && n > SIZE_MAX / size)
+        return NULL;
+    void *ptr = sch_malloc(tag, n * size);
+    if(ptr != NULL)
+        memset(ptr, 0, n * size);
+    return ptr;
+}
+
+char *sch_strdup(mem_tag_t tag, const char *str)
+{
+    size_t len = strlen(str) + 1;
+    char *copy = sch_malloc(tag, len);
+    if(copy != NULL)
+        memcpy(copy, str, len);
+    return copy;
+}
+
+void sch_free(void *ptr)
+{
+    if(ptr == NULL)
+        return;
+    mem_header_t *header = (mem_header_t *)ptr - 1;
+    mem_stats_t *stats = &mem_stats[header->block.tag];
+    __atomic_sub_fetch(&stats->live, header->block.size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats->frees, 1, __ATOMIC_RELAXED);
+    free(header);
+}
+#endif
+
+int mem_get_stats(int tag, mem_stats_t *stats, int reset)
+{
+    if(tag < 0 || tag >= MEM_LAST)
+        return -1;
+    stats->live = __atomic_load_n(&mem_stats[tag].live, __ATOMIC_RELAXED);
+    if(reset)
+    {
+        stats->peak = __atomic_exchange_n(&mem_stats[tag].peak, stats->live, __ATOMIC_RELAXED);
+        stats->allocs = __atomic_exchange_n(&mem_stats[tag].allocs, 0, __ATOMIC_RELAXED);
+        stats->frees = __atomic_exchange_n(&mem_stats[tag].frees, 0, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        stats->peak = __atomic_load_n(&mem_stats[tag].peak, __ATOMIC_RELAXED);
+        stats->allocs = __atomic_load_n(&mem_stats[tag].allocs, __ATOMIC_RELAXED);
+        stats->frees = __atomic_load_n(&mem_stats[tag].frees, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+const char *mem_get_name(int tag)
+{
+    if(tag < 0 || tag >= MEM_LAST)
+        return "";
+    return mem_names[tag];
+}
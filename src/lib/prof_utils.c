@@ -0,0 +1,349 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "prof_utils.h"
+#include "osDelay.h"
+#ifdef LINUX
+#include <time.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <semaphore.h>
+#include <execinfo.h>
+#include <ucontext.h>
+#include "osThread.h"
+#endif
+
+static prof_counter_t prof_counters[PROF_LAST];
+
+static const char *prof_names[PROF_LAST] = {
+    "storage_status_set",
+    "storage_status_get",
+    "storage_payload_set",
+    "storage_payload_get",
+    "storage_fp_set",
+    "storage_fp_get",
+    "queue_send",
+    "queue_receive",
+    "com_receive_tm",
+    "eskf_predict",
+    "eskf_update",
+};
+
+uint32_t prof_now_us(void)
+{
+#ifdef LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec*1000000ULL + (uint64_t)ts.tv_nsec/1000ULL);
+#else
+    return (uint32_t)((uint64_t)osTaskGetTickCount()*1000000ULL/osDefineTime(1000));
+#endif
+}
+
+void prof_add(prof_id_t id, uint32_t time_us)
+{
+    if((int)id < 0 || id >= PROF_LAST)
+        return;
+    prof_counter_t *counter = &prof_counters[id];
+    __atomic_add_fetch(&counter->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&counter->time_sum_us, (uint64_t)time_us, __ATOMIC_RELAXED);
+    uint32_t max = __atomic_load_n(&counter->time_max_us, __ATOMIC_RELAXED);
+    while(time_us > max && !__atomic_compare_exchange_n(&counter->time_max_us, &max, time_us, 0,
+                                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+int prof_get(int id, prof_counter_t *counter, int reset)
+{
+    if(id < 0 || id >= PROF_LAST)
+        return -1;
+    // Counters of calls in progress may be lost by the reset
+    if(reset)
+    {
+        counter->count = __atomic_exchange_n(&prof_counters[id].count, 0, __ATOMIC_RELAXED);
+        counter->time_sum_us = __atomic_exchange_n(&prof_counters[id].time_sum_us, 0, __ATOMIC_RELAXED);
+        counter->time_max_us = __atomic_exchange_n(&prof_counters[id].time_max_us, 0, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        counter->count = __atomic_load_n(&prof_counters[id].count, __ATOMIC_RELAXED);
+        counter->time_sum_us = __atomic_load_n(&prof_counters[id].time_sum_us, __ATOMIC_RELAXED);
+        counter->time_max_us = __atomic_load_n(&prof_counters[id].time_max_us, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+const char *prof_get_name(int id)
+{
+    if(id < 0 || id >= PROF_LAST)
+        return "";
+    return prof_names[id];
+}
+
+void prof_reset(void)
+{
+    int i;
+    prof_counter_t counter;
+    for(i=0; i<PROF_LAST; i++)
+        prof_get(i, &counter, 1);
+}
+
+#ifdef LINUX
+#define PROF_SAMPLE_WAIT_MS (20)    ///< Max. wait for a task to take its sample
+#define PROF_SLOT_IDLE      (0)     ///< No sample requested
+#define PROF_SLOT_WAIT      (1)     ///< Sample requested, the task was signaled
+#define PROF_SLOT_BUSY      (2)     ///< The task is taking the sample
+
+/**
+ * Sample of the task being sampled, taken by its SIGPROF handler. The state
+ * is claimed with atomic exchanges, so a task answering after the sampler
+ * gave up never writes a sample that is being read.
+ */
+static struct {
+    pthread_t thread;               ///< Task being sampled
+    volatile int state;             ///< PROF_SLOT_*
+    int depth;                      ///< Frames in pc
+    void *pc[PROF_SAMPLE_DEPTH];    ///< Frames, innermost first
+} prof_slot;
+static sem_t prof_slot_sem;         ///< Posted by the handler when the sample is taken
+static int prof_handler_ok = 0;     ///< The SIGPROF handler is installed
+static pthread_mutex_t prof_session_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Interrupted instruction of a signal context, NULL if the architecture is
+ * not supported
+ */
+static void *_prof_context_pc(void *context)
+{
+    ucontext_t *uc = (ucontext_t *)context;
+#if defined(__x86_64__)
+    return (void *)uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__i386__)
+    return (void *)uc->uc_mcontext.gregs[REG_EIP];
+#elif defined(__aarch64__)
+    return (void *)uc->uc_mcontext.pc;
+#elif defined(__arm__)
+    return (void *)uc->uc_mcontext.arm_pc;
+#else
+    (void)uc;
+    return NULL;
+#endif
+}
+
+static void _prof_sample_handler(int sig, siginfo_t *info, void *context)
+{
+    int saved_errno = errno;
+    if(pthread_equal(pthread_self(), prof_slot.thread) &&
+       __sync_bool_compare_and_swap(&prof_slot.state, PROF_SLOT_WAIT, PROF_SLOT_BUSY))
+    {
+        // The backtrace starts in this handler and the signal trampoline,
+        // the sample starts at the interrupted instruction. Without unwind
+        // tables only the interrupted instruction is known
+        void *frames[PROF_SAMPLE_DEPTH+4];
+        void *pc = _prof_context_pc(context);
+        int n = backtrace(frames, PROF_SAMPLE_DEPTH+4);
+        int first;
+        for(first=0; first<n && frames[first] != pc; first++);
+        if(first < n)
+        {
+            prof_slot.depth = n-first < PROF_SAMPLE_DEPTH ? n-first : PROF_SAMPLE_DEPTH;
+            memcpy(prof_slot.pc, &frames[first], prof_slot.depth*sizeof(void *));
+        }
+        else
+        {
+            prof_slot.pc[0] = pc;
+            prof_slot.depth = pc != NULL ? 1 : 0;
+        }
+        __sync_synchronize();
+        prof_slot.state = PROF_SLOT_IDLE;
+        sem_post(&prof_slot_sem);
+    }
+    errno = saved_errno;
+}
+
+/**
+ * Address range of the executable mappings, from /proc/self/maps
+ */
+static int _prof_exe_range(uintptr_t *lo, uintptr_t *hi)
+{
+    char exe[256], line[512];
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe)-1);
+    FILE *maps = fopen("/proc/self/maps", "r");
+    if(len <= 0 || maps == NULL)
+    {
+        if(maps != NULL)
+            fclose(maps);
+        return -1;
+    }
+    exe[len] = '\0';
+
+    *lo = UINTPTR_MAX;
+    *hi = 0;
+    while(fgets(line, sizeof(line), maps) != NULL)
+    {
+        unsigned long start, end;
+        int path = 0;
+        if(sscanf(line, "%lx-%lx %*s %*s %*s %*s %n", &start, &end, &path) < 2 || path == 0)
+            continue;
+        line[strcspn(line, "\n")] = '\0';
+        if(strcmp(&line[path], exe) != 0)
+            continue;
+        if(start < *lo)
+            *lo = start;
+        if(end > *hi)
+            *hi = end;
+    }
+    fclose(maps);
+    return *hi > *lo ? 0 : -1;
+}
+
+/**
+ * Add the sample in prof_slot to the stacks of @task
+ * @return 0 if OK, -1 if @stacks is full
+ */
+static int _prof_sample_add(uint16_t task, uintptr_t lo, uintptr_t hi, prof_stack_t *stacks, int *n, int max_stacks)
+{
+    prof_stack_t sample;
+    memset(&sample, 0, sizeof(sample));
+    sample.task = task;
+    sample.depth = (uint16_t)prof_slot.depth;
+    int i;
+    for(i=0; i<sample.depth; i++)
+    {
+        uintptr_t pc = (uintptr_t)prof_slot.pc[i];
+        sample.pc[i] = pc >= lo && pc < hi ? (uint32_t)(pc - lo) : 0;
+    }
+
+    for(i=0; i<*n; i++)
+    {
+        if(stacks[i].task == sample.task && stacks[i].depth == sample.depth &&
+           memcmp(stacks[i].pc, sample.pc, sample.depth*sizeof(uint32_t)) == 0)
+        {
+            stacks[i].count++;
+            return 0;
+        }
+    }
+    if(*n >= max_stacks)
+        return -1;
+    sample.count = 1;
+    stacks[(*n)++] = sample;
+    return 0;
+}
+
+int prof_sample_run(int rate_hz, int seconds, prof_stack_t *stacks, int max_stacks, prof_sample_stats_t *stats)
+{
+    if(rate_hz <= 0 || rate_hz > SCH_PROF_SAMPLE_MAX_HZ || seconds <= 0 ||
+       seconds > SCH_PROF_SAMPLE_MAX_S || stacks == NULL || max_stacks <= 0)
+        return -1;
+    if(pthread_mutex_trylock(&prof_session_mutex) != 0)
+        return -1;
+
+    memset(stats, 0, sizeof(prof_sample_stats_t));
+    int n = 0;
+
+    // The handler stays installed, a late signal must not kill a task.
+    // backtrace is called once here, its first call may load libgcc
+    if(!prof_handler_ok)
+    {
+        void *frames[PROF_SAMPLE_DEPTH];
+        backtrace(frames, PROF_SAMPLE_DEPTH);
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = _prof_sample_handler;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        prof_handler_ok = sem_init(&prof_slot_sem, 0, 0) == 0 && sigaction(SIGPROF, &sa, NULL) == 0;
+        if(!prof_handler_ok)
+        {
+            pthread_mutex_unlock(&prof_session_mutex);
+            return -1;
+        }
+    }
+
+    uintptr_t lo = 0, hi = 0;
+    _prof_exe_range(&lo, &hi);
+
+    // Tasks, without the caller
+    os_thread threads[OS_TASK_MAX];
+    uint16_t tasks[OS_TASK_MAX];
+    int i, n_tasks = 0;
+    for(i=0; i<OS_TASK_MAX; i++)
+    {
+        if(osTaskGetThread(i, &threads[n_tasks], NULL) != 0)
+            break;
+        if(pthread_equal(threads[n_tasks], pthread_self()))
+            continue;
+        tasks[n_tasks++] = (uint16_t)i;
+    }
+    stats->tasks = (uint32_t)n_tasks;
+
+    long period_ns = 1000000000L/rate_hz;
+    long rounds = (long)rate_hz*seconds;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while(rounds-- > 0)
+    {
+        for(i=0; i<n_tasks; i++)
+        {
+            prof_slot.thread = threads[i];
+            __sync_synchronize();
+            prof_slot.state = PROF_SLOT_WAIT;
+            if(pthread_kill(threads[i], SIGPROF) != 0)
+            {
+                prof_slot.state = PROF_SLOT_IDLE;
+                stats->missed++;
+                continue;
+            }
+
+            struct timespec timeout;
+            clock_gettime(CLOCK_REALTIME, &timeout);
+            timeout.tv_nsec += PROF_SAMPLE_WAIT_MS*1000000L;
+            timeout.tv_sec += timeout.tv_nsec/1000000000L;
+            timeout.tv_nsec %= 1000000000L;
+            int rc;
+            while((rc = sem_timedwait(&prof_slot_sem, &timeout)) != 0 && errno == EINTR);
+            if(rc != 0)
+            {
+                // Give up, unless the task is taking the sample right now
+                if(__sync_bool_compare_and_swap(&prof_slot.state, PROF_SLOT_WAIT, PROF_SLOT_IDLE))
+                {
+                    stats->missed++;
+                    continue;
+                }
+                while(sem_wait(&prof_slot_sem) != 0 && errno == EINTR);
+            }
+            __sync_synchronize();
+
+            if(_prof_sample_add(tasks[i], lo, hi, stacks, &n, max_stacks) == 0)
+                stats->samples++;
+            else
+                stats->dropped++;
+        }
+
+        next.tv_nsec += period_ns;
+        next.tv_sec += next.tv_nsec/1000000000L;
+        next.tv_nsec %= 1000000000L;
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR);
+    }
+
+    pthread_mutex_unlock(&prof_session_mutex);
+    return n;
+}
+#endif
@@ -20,6 +20,8 @@
 
 
 #include "osDelay.h"
+#include <string.h>
+#include <stddef.h>
 
 void osDelay(uint32_t mseconds){
     portTick ticks = mseconds/portTICK_RATE_MS;
@@ -37,4 +39,73 @@ portTick osTaskGetTickCount(void){
 void osTaskDelayUntil(portTick *lastTime, uint32_t mseconds){
     portTick ticks = osDefineTime(mseconds);
 	vTaskDelayUntil(lastTime, ticks);
-}
\ No newline at end of file
+}
+
+/**
+ * Translate ticks to microseconds
+ */
+static uint32_t os_ticks_us(portTick ticks)
+{
+    return (uint32_t)ticks*portTICK_RATE_MS*1000;
+}
+static osPeriod *os_periods[OS_PERIOD_MAX];   ///< Registered periodic loops
+static int os_periods_len = 0;
+
+void osPeriodInit(osPeriod *period, const char *name, uint32_t mseconds)
+{
+    memset(period, 0, sizeof(osPeriod));
+    period->stats.name = name;
+    period->stats.period_ms = mseconds;
+    period->last = osTaskGetTickCount();
+    period->wake = period->last;
+
+    taskENTER_CRITICAL();
+    if(os_periods_len < OS_PERIOD_MAX)
+        os_periods[os_periods_len++] = period;
+    taskEXIT_CRITICAL();
+}
+
+void osPeriodDelay(osPeriod *period)
+{
+    osPeriodStats *stats = &period->stats;
+    if(period->reset)
+    {
+        memset(&stats->loops, 0, sizeof(osPeriodStats) - offsetof(osPeriodStats, loops));
+        period->reset = 0;
+    }
+
+    // Work of the loop that ends
+    portTick now = osTaskGetTickCount();
+    portTick due = period->last + osDefineTime(stats->period_ms);
+    uint32_t work_us = os_ticks_us(now - period->wake);
+    stats->loops++;
+    stats->work_last_us = work_us;
+    stats->work_sum_us += work_us;
+    if(work_us > stats->work_max_us)
+        stats->work_max_us = work_us;
+    if((int32_t)(now - due) > 0)
+        stats->overruns++;
+
+    osTaskDelayUntil(&period->last, stats->period_ms);
+
+    // Wake up lateness
+    period->wake = osTaskGetTickCount();
+    int32_t late = (int32_t)(period->wake - due);
+    if(late > 0 && os_ticks_us((portTick)late) > stats->late_max_us)
+        stats->late_max_us = os_ticks_us((portTick)late);
+}
+
+void osPeriodSet(osPeriod *period, uint32_t mseconds)
+{
+    period->stats.period_ms = mseconds;
+}
+
+int osPeriodGetStats(int index, osPeriodStats *stats, int reset)
+{
+    if(index < 0 || index >= os_periods_len)
+        return -1;
+    *stats = os_periods[index]->stats;
+    if(reset)
+        os_periods[index]->reset = 1;
+    return 0;
+}
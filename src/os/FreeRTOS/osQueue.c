@@ -18,16 +18,194 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
 #include "osQueue.h"
+#include "task.h"
 
-osQueue osQueueCreate(int length, size_t item_size) {
+/**
+ * Registered queue and its statistics counters. FreeRTOS queues have no room
+ * for them, sends look up the queue in the registry.
+ */
+typedef struct os_queue_entry {
+	osQueue queue;
+	const char *name;
+	uint32_t sent;
+	uint32_t full;
+	uint32_t depth_max;
+	uint64_t block_us;
+} os_queue_entry_t;
+
+static os_queue_entry_t os_queues[OS_QUEUE_MAX];    ///< Registered queues
+static int os_queues_len = 0;
+
+/**
+ * Registered queue entry, NULL if the queue is not registered
+ */
+static os_queue_entry_t *os_queue_entry(osQueue queue) {
+	int i;
+	for(i=0; i<os_queues_len; i++) {
+		if(os_queues[i].queue == queue)
+			return &os_queues[i];
+	}
+	return NULL;
+}
+
+/**
+ * Count a send of @n items, that started at tick @start with @spaces free
+ * slots, and sent @sent of them
+ */
+static void os_queue_count(osQueue queue, int n, int sent, UBaseType_t spaces, portTickType start) {
+#if SCH_OS_QUEUE_STATS
+	os_queue_entry_t *entry = os_queue_entry(queue);
+	if(entry == NULL)
+		return;
+	uint32_t depth = (uint32_t)uxQueueMessagesWaiting(queue);
+	taskENTER_CRITICAL();
+	entry->sent += sent;
+	if(sent < n)
+		entry->full++;
+	if(spaces < (UBaseType_t)n)
+		entry->block_us += (uint64_t)(xTaskGetTickCount() - start)*portTICK_RATE_MS*1000;
+	if(depth > entry->depth_max)
+		entry->depth_max = depth;
+	taskEXIT_CRITICAL();
+#endif
+}
+
+#if configSUPPORT_STATIC_ALLOCATION
+static StaticQueue_t os_queue_buffers[SCH_OS_STATIC_QUEUES];
+static uint8_t os_queue_storage[SCH_OS_STATIC_QUEUE_BYTES];
+static int os_queue_buffers_used = 0;
+static size_t os_queue_storage_used = 0;
+#endif
+
+/**
+ * Create a queue from the static buffers if there is room left, queues are
+ * never deleted so they are not reused. Otherwise use the FreeRTOS heap.
+ */
+static osQueue os_queue_create(int length, size_t item_size) {
+#if configSUPPORT_STATIC_ALLOCATION
+	StaticQueue_t *buffer = NULL;
+	uint8_t *storage = NULL;
+	size_t size = ((size_t)length*item_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	taskENTER_CRITICAL();
+	if(os_queue_buffers_used < SCH_OS_STATIC_QUEUES && os_queue_storage_used + size <= SCH_OS_STATIC_QUEUE_BYTES) {
+		buffer = &os_queue_buffers[os_queue_buffers_used++];
+		storage = &os_queue_storage[os_queue_storage_used];
+		os_queue_storage_used += size;
+	}
+	taskEXIT_CRITICAL();
+	if(buffer != NULL)
+		return xQueueCreateStatic(length, item_size, storage, buffer);
+#endif
 	return xQueueCreate(length, item_size);
 }
 
+osQueue osQueueCreate(int length, size_t item_size) {
+	return os_queue_create(length, item_size);
+}
+
+osQueue osQueueCreateType(int length, size_t item_size, osQueueType type) {
+	return os_queue_create(length, item_size);
+}
+
 int osQueueSend(osQueue queue, void * value, uint32_t timeout) {
-	return xQueueSend(queue, value, timeout);
+	UBaseType_t spaces = uxQueueSpacesAvailable(queue);
+	portTickType start = xTaskGetTickCount();
+	int rc = xQueueSend(queue, value, timeout);
+	os_queue_count(queue, 1, rc == pdPASS, spaces, start);
+	return rc;
+}
+
+int osQueueSendToFront(osQueue queue, void * value, uint32_t timeout) {
+	UBaseType_t spaces = uxQueueSpacesAvailable(queue);
+	portTickType start = xTaskGetTickCount();
+	int rc = xQueueSendToFront(queue, value, timeout);
+	os_queue_count(queue, 1, rc == pdPASS, spaces, start);
+	return rc;
+}
+
+int osQueueSendBatch(osQueue queue, void * values, int n, size_t item_size, uint32_t timeout, int all) {
+	int i;
+	UBaseType_t spaces = uxQueueSpacesAvailable(queue);
+	portTickType start = xTaskGetTickCount();
+	if(all && spaces < (UBaseType_t)n) {
+		os_queue_count(queue, n, 0, (UBaseType_t)n, start);
+		return 0;
+	}
+	for(i=0; i<n; i++) {
+		if(xQueueSend(queue, (char *)values + i*item_size, timeout) != pdPASS)
+			break;
+	}
+	os_queue_count(queue, n, i, spaces, start);
+	return i;
+}
+
+int osQueueSendFromISR(osQueue queue, void * value, int *task_woken) {
+	portBASE_TYPE woken = pdFALSE;
+	int rc = xQueueSendFromISR(queue, value, &woken);
+	*task_woken = woken == pdTRUE;
+	return rc;
+}
+
+int osQueueSendToFrontFromISR(osQueue queue, void * value, int *task_woken) {
+	portBASE_TYPE woken = pdFALSE;
+	int rc = xQueueSendToFrontFromISR(queue, value, &woken);
+	*task_woken = woken == pdTRUE;
+	return rc;
 }
 
 int osQueueReceive(osQueue queue, void * buf, uint32_t timeout){
     return xQueueReceive(queue, buf, timeout);
-}
\ No newline at end of file
+}
+
+int osQueueReceiveMany(osQueue queue, void * buf, int max, size_t item_size, uint32_t timeout) {
+	int i;
+	if(max <= 0 || xQueueReceive(queue, buf, timeout) != pdPASS)
+		return 0;
+	for(i=1; i<max; i++) {
+		if(xQueueReceive(queue, (char *)buf + i*item_size, 0) != pdPASS)
+			break;
+	}
+	return i;
+}
+
+int osQueueGetDepth(osQueue queue) {
+	return (int)uxQueueMessagesWaiting(queue);
+}
+
+void osQueueSetName(osQueue queue, const char *name) {
+	if(queue == NULL)
+		return;
+	taskENTER_CRITICAL();
+	if(os_queues_len < OS_QUEUE_MAX) {
+		memset(&os_queues[os_queues_len], 0, sizeof(os_queue_entry_t));
+		os_queues[os_queues_len].queue = queue;
+		os_queues[os_queues_len].name = name;
+		os_queues_len++;
+	}
+	taskEXIT_CRITICAL();
+}
+
+int osQueueGetStats(int index, osQueueStats *stats, int reset) {
+	if(index < 0 || index >= os_queues_len)
+		return -1;
+	os_queue_entry_t *entry = &os_queues[index];
+	UBaseType_t depth = uxQueueMessagesWaiting(entry->queue);
+	stats->name = entry->name;
+	stats->size = (uint32_t)(depth + uxQueueSpacesAvailable(entry->queue));
+	stats->depth = (uint32_t)depth;
+	taskENTER_CRITICAL();
+	stats->depth_max = entry->depth_max;
+	stats->sent = entry->sent;
+	stats->full = entry->full;
+	stats->block_us = entry->block_us;
+	if(reset) {
+		entry->sent = 0;
+		entry->full = 0;
+		entry->block_us = 0;
+		entry->depth_max = (uint32_t)depth;
+	}
+	taskEXIT_CRITICAL();
+	return 0;
+}
@@ -33,3 +33,12 @@ void osScheduler(os_thread* thread_id, int n_thread)
     	  printf("[ERROR] FreeRTOS scheduler stopped!\n");
     }
 }
+
+void osYieldFromISR(int task_woken)
+{
+#ifdef portYIELD_FROM_ISR
+    portYIELD_FROM_ISR(task_woken);
+#else
+    portEND_SWITCHING_ISR(task_woken);
+#endif
+}
@@ -21,8 +21,56 @@
 
 #include "osSemphr.h"
 
+#if configSUPPORT_STATIC_ALLOCATION
+static StaticSemaphore_t os_sem_buffers[SCH_OS_STATIC_SEMAPHORES];
+static int os_sem_buffers_used = 0;
+
+/**
+ * Next static semaphore buffer, NULL if all of them are used
+ */
+static StaticSemaphore_t *os_sem_buffer(void){
+	StaticSemaphore_t *buffer = NULL;
+	taskENTER_CRITICAL();
+	if (os_sem_buffers_used < SCH_OS_STATIC_SEMAPHORES)
+		buffer = &os_sem_buffers[os_sem_buffers_used++];
+	taskEXIT_CRITICAL();
+	return buffer;
+}
+#endif
+
+/**
+ * Create a mutex from the static buffers if there is one left, otherwise
+ * from the FreeRTOS heap
+ */
+static xSemaphoreHandle os_mutex_create(void){
+#if configSUPPORT_STATIC_ALLOCATION
+	StaticSemaphore_t *buffer = os_sem_buffer();
+	if (buffer != NULL)
+		return xSemaphoreCreateMutexStatic(buffer);
+#endif
+	return xSemaphoreCreateMutex();
+}
+
+/**
+ * Create a binary semaphore, initially given as vSemaphoreCreateBinary does,
+ * from the static buffers if there is one left
+ */
+static xSemaphoreHandle os_binary_create(void){
+	xSemaphoreHandle sem;
+#if configSUPPORT_STATIC_ALLOCATION
+	StaticSemaphore_t *buffer = os_sem_buffer();
+	if (buffer != NULL) {
+		sem = xSemaphoreCreateBinaryStatic(buffer);
+		xSemaphoreGive(sem);
+		return sem;
+	}
+#endif
+	vSemaphoreCreateBinary(sem);
+	return sem;
+}
+
 int osSemaphoreCreate(osSemaphore* mutex){
-	*mutex = xSemaphoreCreateMutex();
+	*mutex = os_mutex_create();
 	if (*mutex) {
 		return OS_SEMAPHORE_OK;
 	} else {
@@ -47,3 +95,105 @@ int osSemaphoreGiven(osSemaphore *mutex){
 		return OS_SEMAPHORE_ERROR;
 	}
 }
+
+int osRWLockCreate(osRWLock *lock){
+	lock->readers = 0;
+	lock->mutex = os_mutex_create();
+	// Binary, the last reader may not be the task that took it
+	lock->write = os_binary_create();
+	if (lock->mutex && lock->write) {
+		return OS_SEMAPHORE_OK;
+	} else {
+		return OS_SEMAPHORE_ERROR;
+	}
+}
+
+int osRWLockReadTake(osRWLock *lock){
+	if (xSemaphoreTake(lock->mutex, portMAX_DELAY) != pdPASS)
+		return OS_SEMAPHORE_ERROR;
+	// The first reader holds the write lock for all of them
+	if (++lock->readers == 1)
+		xSemaphoreTake(lock->write, portMAX_DELAY);
+	xSemaphoreGive(lock->mutex);
+	return OS_SEMAPHORE_OK;
+}
+
+int osRWLockReadGiven(osRWLock *lock){
+	if (xSemaphoreTake(lock->mutex, portMAX_DELAY) != pdPASS)
+		return OS_SEMAPHORE_ERROR;
+	if (--lock->readers == 0)
+		xSemaphoreGive(lock->write);
+	xSemaphoreGive(lock->mutex);
+	return OS_SEMAPHORE_OK;
+}
+
+int osRWLockWriteTake(osRWLock *lock){
+	if (xSemaphoreTake(lock->write, portMAX_DELAY) == pdPASS) {
+		return OS_SEMAPHORE_OK;
+	} else {
+		return OS_SEMAPHORE_ERROR;
+	}
+}
+
+int osRWLockWriteGiven(osRWLock *lock){
+	if (xSemaphoreGive(lock->write) == pdPASS) {
+		return OS_SEMAPHORE_OK;
+	} else {
+		return OS_SEMAPHORE_ERROR;
+	}
+}
+
+int osEventCreate(osEvent *event){
+	event->bits = 0;
+	event->sem = os_binary_create();
+	if (event->sem) {
+		return OS_SEMAPHORE_OK;
+	} else {
+		return OS_SEMAPHORE_ERROR;
+	}
+}
+
+int osEventSet(osEvent *event, uint32_t bits){
+	taskENTER_CRITICAL();
+	event->bits |= bits;
+	taskEXIT_CRITICAL();
+	xSemaphoreGive(event->sem);
+	return OS_SEMAPHORE_OK;
+}
+
+uint32_t osEventWait(osEvent *event, uint32_t bits, uint32_t timeout){
+	uint32_t got;
+	portTickType ticks = timeout;
+	portTickType left = timeout;
+	portTickType start = xTaskGetTickCount();
+	if (timeout != portMAX_DELAY)
+		ticks = timeout / portTICK_RATE_MS;
+
+	/* The binary semaphore only wakes the task, the bits are checked again */
+	while (1) {
+		taskENTER_CRITICAL();
+		got = event->bits & bits;
+		event->bits &= ~got;
+		taskEXIT_CRITICAL();
+		if (got)
+			return got;
+		if (ticks != portMAX_DELAY) {
+			portTickType elapsed = xTaskGetTickCount() - start;
+			if (elapsed >= ticks)
+				return 0;
+			left = ticks - elapsed;
+		}
+		xSemaphoreTake(event->sem, left);
+	}
+}
+
+/* Lock contention statistics are only counted in GNU/Linux */
+void osSemaphoreSetName(osSemaphore *mutex, const char *name){
+}
+
+void osRWLockSetName(osRWLock *lock, const char *name){
+}
+
+int osLockGetStats(int index, osLockStats *stats, int reset){
+	return -1;
+}
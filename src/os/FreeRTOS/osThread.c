@@ -20,22 +20,184 @@
 
 #include "osThread.h"
 
+/* Tasks created with osCreateTask, for osTaskGetStack */
+static struct {
+    const char *name;
+    xTaskHandle handle;
+    unsigned short size;
+} os_tasks[OS_TASK_MAX];
+static int os_tasks_len = 0;
+
+/* Only the ESP32 is dual core, other ports ignore the task core */
+#ifdef ESP32
+#define OS_TASK_ANY_CORE tskNO_AFFINITY
+#define os_task_create(f, n, s, p, pr, h, c) xTaskCreatePinnedToCore(f, n, s, p, pr, h, c)
+#define os_task_create_st(f, n, s, p, pr, st, b, c) xTaskCreateStaticPinnedToCore(f, n, s, p, pr, st, b, c)
+#else
+#define OS_TASK_ANY_CORE (-1)
+#define os_task_create(f, n, s, p, pr, h, c) xTaskCreate(f, n, s, p, pr, h)
+#define os_task_create_st(f, n, s, p, pr, st, b, c) xTaskCreateStatic(f, n, s, p, pr, st, b)
+#endif
+
+#if configSUPPORT_STATIC_ALLOCATION
+/* Static tasks control blocks and stacks. Stacks are taken in creation order
+ * and not reused, tasks are only deleted at startup (eg. taskInit) */
+static StaticTask_t os_task_buffers[OS_TASK_MAX];
+static StackType_t os_task_stacks[SCH_OS_STATIC_STACK_WORDS];
+static int os_task_buffers_used = 0;
+static uint32_t os_task_stacks_used = 0;
+
+/* Idle and timer tasks memory, required by FreeRTOS with static allocation */
+static StaticTask_t os_idle_buffer;
+static StackType_t os_idle_stack[configMINIMAL_STACK_SIZE];
+
+void vApplicationGetIdleTaskMemory(StaticTask_t **buffer, StackType_t **stack, uint32_t *size)
+{
+    *buffer = &os_idle_buffer;
+    *stack = os_idle_stack;
+    *size = configMINIMAL_STACK_SIZE;
+}
+
+#if configUSE_TIMERS
+static StaticTask_t os_timer_buffer;
+static StackType_t os_timer_stack[configTIMER_TASK_STACK_DEPTH];
+
+void vApplicationGetTimerTaskMemory(StaticTask_t **buffer, StackType_t **stack, uint32_t *size)
+{
+    *buffer = &os_timer_buffer;
+    *stack = os_timer_stack;
+    *size = configTIMER_TASK_STACK_DEPTH;
+}
+#endif
+
 /**
- * create a task in FreeRTOS
+ * Create a task with a static stack if there is room left
+ * @return Task handle, NULL if there is no room
  */
-int osCreateTask(void (*functionTask)(void *), char* name, unsigned short size, void * parameters, unsigned int priority, os_thread *thread)
+static xTaskHandle os_task_create_static(void (*functionTask)(void *), char* name, unsigned short size, void * parameters, unsigned int priority, int core)
 {
-#ifdef AVR32
+    StaticTask_t *buffer = NULL;
+    StackType_t *stack = NULL;
+    taskENTER_CRITICAL();
+    if(os_task_buffers_used < OS_TASK_MAX && os_task_stacks_used + size <= SCH_OS_STATIC_STACK_WORDS)
+    {
+        buffer = &os_task_buffers[os_task_buffers_used++];
+        stack = &os_task_stacks[os_task_stacks_used];
+        os_task_stacks_used += size;
+    }
+    taskEXIT_CRITICAL();
+    if(buffer == NULL)
+        return NULL;
+    return os_task_create_st(functionTask, name, size, parameters, priority, stack, buffer, core);
+}
+#endif
+
+/**
+ * create a task in FreeRTOS, on @core if the port is dual core. With
+ * configSUPPORT_STATIC_ALLOCATION the stack is taken from the static stacks,
+ * and from the heap once they are used.
+ */
+static int os_task_create_core(void (*functionTask)(void *), char* name, unsigned short size, void * parameters, unsigned int priority, int core)
+{
+    xTaskHandle handle = NULL;
+#if configSUPPORT_STATIC_ALLOCATION
+    handle = os_task_create_static(functionTask, name, size, parameters, priority, core);
+    BaseType_t created = handle != NULL ? pdPASS : os_task_create((*functionTask), name, size, parameters, priority, &handle, core);
+#elif defined(AVR32)
     // FreeRTOS 7.0.0
-    portBASE_TYPE created = xTaskCreate((*functionTask), (signed char*)name, size, parameters, priority, NULL);
+    portBASE_TYPE created = xTaskCreate((*functionTask), (signed char*)name, size, parameters, priority, &handle);
 #else
     // FreeRTOS > 8.0.0
-    BaseType_t created = xTaskCreate((*functionTask), name, size, parameters, priority, NULL);
+    BaseType_t created = os_task_create((*functionTask), name, size, parameters, priority, &handle, core);
 #endif
+    if(created == pdPASS)
+    {
+        taskENTER_CRITICAL();
+        if(os_tasks_len < OS_TASK_MAX)
+        {
+            os_tasks[os_tasks_len].name = name;
+            os_tasks[os_tasks_len].handle = handle;
+            os_tasks[os_tasks_len].size = size;
+            os_tasks_len++;
+        }
+        taskEXIT_CRITICAL();
+    }
     return created == pdPASS ? 0 : 1;
 }
 
+int osCreateTask(void (*functionTask)(void *), char* name, unsigned short size, void * parameters, unsigned int priority, os_thread *thread)
+{
+    return os_task_create_core(functionTask, name, size, parameters, priority, OS_TASK_ANY_CORE);
+}
+
+int osCreateTaskProfile(void (*functionTask)(void *), char* name, unsigned short size, void * parameters, const osTaskProfile *profile, os_thread *thread)
+{
+    // The policy does not apply. In the ESP32 a mask with one of its two
+    // cores pins the task to it, other masks let it run on any core
+    int core = OS_TASK_ANY_CORE;
+#ifdef ESP32
+    if(profile->cpus == 0x1)
+        core = 0;
+    else if(profile->cpus == 0x2)
+        core = 1;
+#endif
+    return os_task_create_core(functionTask, name, size, parameters, profile->priority, core);
+}
+
+int osTaskSetProfile(os_thread *thread, const osTaskProfile *profile)
+{
+    if(thread != NULL)
+        return -1;
+    vTaskPrioritySet(NULL, profile->priority);
+    return 0;
+}
+
+int osTaskLockMemory(void)
+{
+    return 0;
+}
+
+int osTaskGetStack(int index, osTaskStack *stack)
+{
+#if INCLUDE_uxTaskGetStackHighWaterMark
+    if(index < 0 || index >= os_tasks_len)
+        return -1;
+    // Stack sizes and the high-water mark are in words
+    uint32_t free_words = (uint32_t)uxTaskGetStackHighWaterMark(os_tasks[index].handle);
+    stack->name = os_tasks[index].name;
+    stack->size = (uint32_t)os_tasks[index].size * sizeof(portSTACK_TYPE);
+    stack->used_max = stack->size - free_words * sizeof(portSTACK_TYPE);
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+int osTaskGetThread(int index, os_thread *thread, const char **name)
+{
+    // Task handlers are not os_thread values in FreeRTOS
+    return -1;
+}
+
 void osTaskDelete(void *task_handle)
 {
+    // Stop listing it in osTaskGetStack
+    xTaskHandle handle = (xTaskHandle)task_handle;
+#if INCLUDE_xTaskGetCurrentTaskHandle
+    if(handle == NULL)
+        handle = xTaskGetCurrentTaskHandle();
+#endif
+    int i;
+    taskENTER_CRITICAL();
+    for(i=0; i<os_tasks_len; i++)
+    {
+        if(os_tasks[i].handle == handle)
+        {
+            os_tasks[i] = os_tasks[--os_tasks_len];
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+
     vTaskDelete(task_handle);
 }
@@ -19,6 +19,9 @@
  */
 
 #include "osDelay.h"
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
 
 portTick osDefineTime(uint32_t mseconds)
 {
@@ -35,10 +38,20 @@ portTick osTaskGetTickCount(void)
     return (portTick)(time.tv_sec*1000000+time.tv_nsec/1000);
 }
 
+/**
+ * Sleep @usec microseconds, resuming the sleep if a signal interrupts it
+ * (e.g. the sampling profiler, @see prof_sample_run)
+ */
+static void _os_sleep_us(portTick usec)
+{
+    struct timespec left = {(time_t)(usec/1000000), (long)(usec%1000000)*1000};
+    while(nanosleep(&left, &left) != 0 && errno == EINTR);
+}
+
 void osDelay(uint32_t mseconds)
 {
     //transform to microseconds
-    usleep(mseconds*1000);
+    _os_sleep_us((portTick)mseconds*1000);
 }
 
 void osTaskDelayUntil(portTick *lastTime, uint32_t mseconds)
@@ -48,18 +61,86 @@ void osTaskDelayUntil(portTick *lastTime, uint32_t mseconds)
     portTick d_usec = c_usec - *lastTime;     // Delta ticks
     portTick s_usec = osDefineTime(mseconds); // Sleep ticks
 
-    // Return if more than desired milli seconds have passed
-    if(d_usec > s_usec)
+    // Delay left ticks, unless more than desired milli seconds have passed
+    if(d_usec < s_usec)
+        _os_sleep_us(s_usec - d_usec);
+
+    // Tag last delay ticks, the next period starts where this one ends
+    *lastTime += s_usec;
+}
+
+static pthread_mutex_t os_periods_mutex = PTHREAD_MUTEX_INITIALIZER;
+static osPeriod *os_periods[OS_PERIOD_MAX];   ///< Registered periodic loops
+static int os_periods_len = 0;
+
+void osPeriodInit(osPeriod *period, const char *name, uint32_t mseconds)
+{
+    memset(period, 0, sizeof(osPeriod));
+    period->stats.name = name;
+    period->stats.period_ms = mseconds;
+    period->last = osTaskGetTickCount();
+    period->wake = period->last;
+    clock_gettime(CLOCK_MONOTONIC, &period->next);
+
+    pthread_mutex_lock(&os_periods_mutex);
+    if(os_periods_len < OS_PERIOD_MAX)
+        os_periods[os_periods_len++] = period;
+    pthread_mutex_unlock(&os_periods_mutex);
+}
+
+void osPeriodDelay(osPeriod *period)
+{
+    osPeriodStats *stats = &period->stats;
+    if(period->reset)
+    {
+        memset(&stats->loops, 0, sizeof(osPeriodStats) - offsetof(osPeriodStats, loops));
+        period->reset = 0;
+    }
+
+    // Work of the loop that ends
+    portTick now = osTaskGetTickCount();
+    portTick due = period->last + osDefineTime(stats->period_ms);
+    uint32_t work_us = (uint32_t)(now - period->wake);
+    stats->loops++;
+    stats->work_last_us = work_us;
+    stats->work_sum_us += work_us;
+    if(work_us > stats->work_max_us)
+        stats->work_max_us = work_us;
+    if((int32_t)(now - due) > 0)
+        stats->overruns++;
+
+    // Sleep until the absolute deadline, it returns at once if it passed
+    struct timespec *next = &period->next;
+    next->tv_sec += stats->period_ms/1000;
+    next->tv_nsec += (long)(stats->period_ms%1000)*1000000L;
+    if(next->tv_nsec >= 1000000000L)
     {
-        // Tag last delay ticks
-        *lastTime = osTaskGetTickCount()-(d_usec-s_usec);
-        return;
+        next->tv_sec++;
+        next->tv_nsec -= 1000000000L;
     }
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, next, NULL) == EINTR);
+    period->last = due;
 
-    // Delay left ticks
-    uint32_t s_msec = (s_usec - d_usec)/1000;
-    osDelay(s_msec);
+    // Wake up lateness, on the clock of the deadline
+    struct timespec wake;
+    period->wake = osTaskGetTickCount();
+    clock_gettime(CLOCK_MONOTONIC, &wake);
+    int64_t late = (int64_t)(wake.tv_sec - next->tv_sec)*1000000 + (wake.tv_nsec - next->tv_nsec)/1000;
+    if(late > 0 && (uint64_t)late > stats->late_max_us)
+        stats->late_max_us = late > UINT32_MAX ? UINT32_MAX : (uint32_t)late;
+}
 
-    // Tag last delay ticks
-    *lastTime = osTaskGetTickCount();
-}
\ No newline at end of file
+void osPeriodSet(osPeriod *period, uint32_t mseconds)
+{
+    period->stats.period_ms = mseconds;
+}
+
+int osPeriodGetStats(int index, osPeriodStats *stats, int reset)
+{
+    if(index < 0 || index >= os_periods_len)
+        return -1;
+    *stats = os_periods[index]->stats;
+    if(reset)
+        os_periods[index]->reset = 1;
+    return 0;
+}
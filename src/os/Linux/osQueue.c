@@ -18,19 +18,143 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <pthread.h>
 #include "osQueue.h"
+#include "prof_utils.h"
 
 osQueue osQueueCreate(int length, size_t item_size)
 {
 	return os_pthread_queue_create(length, item_size);
 }
 
+osQueue osQueueCreateType(int length, size_t item_size, osQueueType type)
+{
+	if (type == OS_QUEUE_SPSC)
+		return os_ring_queue_create(length, item_size, PTHREAD_QUEUE_SPSC);
+	if (type == OS_QUEUE_MPSC)
+		return os_ring_queue_create(length, item_size, PTHREAD_QUEUE_MPSC);
+	return os_pthread_queue_create(length, item_size);
+}
+
 int osQueueSend(osQueue queue, void * value, uint32_t timeout)
 {
-	return os_pthread_queue_send(queue, value, timeout);
+	int rc;
+	SCH_PROF_BEGIN(PROF_QUEUE_SEND);
+	if (os_pthread_queue_type(queue) != PTHREAD_QUEUE_LOCKED)
+		rc = os_ring_queue_send(queue, value, timeout);
+	else
+		rc = os_pthread_queue_send(queue, value, timeout);
+	SCH_PROF_END(PROF_QUEUE_SEND);
+	return rc;
+}
+
+int osQueueSendToFront(osQueue queue, void * value, uint32_t timeout)
+{
+	int rc;
+	SCH_PROF_BEGIN(PROF_QUEUE_SEND);
+	if (os_pthread_queue_type(queue) != PTHREAD_QUEUE_LOCKED)
+		rc = os_ring_queue_send_front(queue, value, timeout);
+	else
+		rc = os_pthread_queue_send_front(queue, value, timeout);
+	SCH_PROF_END(PROF_QUEUE_SEND);
+	return rc;
+}
+
+int osQueueSendBatch(osQueue queue, void * values, int n, size_t item_size, uint32_t timeout, int all)
+{
+	int sent;
+	SCH_PROF_BEGIN(PROF_QUEUE_SEND);
+	if (os_pthread_queue_type(queue) != PTHREAD_QUEUE_LOCKED)
+		sent = os_ring_queue_send_n(queue, values, n, timeout, all);
+	else
+		sent = os_pthread_queue_send_n(queue, values, n, timeout, all);
+	SCH_PROF_END(PROF_QUEUE_SEND);
+	return sent;
+}
+
+int osQueueSendFromISR(osQueue queue, void * value, int *task_woken)
+{
+	*task_woken = 0;
+	return osQueueSend(queue, value, 0);
+}
+
+int osQueueSendToFrontFromISR(osQueue queue, void * value, int *task_woken)
+{
+	*task_woken = 0;
+	return osQueueSendToFront(queue, value, 0);
 }
 
 int osQueueReceive(osQueue queue, void * buf, uint32_t timeout){
-    return os_pthread_queue_receive(queue, buf, timeout);
+	int rc;
+	if (os_pthread_queue_type(queue) != PTHREAD_QUEUE_LOCKED)
+		rc = os_ring_queue_receive(queue, buf, timeout);
+	else
+		rc = os_pthread_queue_receive(queue, buf, timeout);
+	// Only counted, the time is mostly waiting for items
+	if (rc == PTHREAD_QUEUE_OK)
+		SCH_PROF_COUNT(PROF_QUEUE_RECEIVE);
+	return rc;
+}
+
+int osQueueReceiveMany(osQueue queue, void * buf, int max, size_t item_size, uint32_t timeout)
+{
+	if (os_pthread_queue_type(queue) != PTHREAD_QUEUE_LOCKED)
+		return os_ring_queue_receive_n(queue, buf, max, timeout);
+	return os_pthread_queue_receive_n(queue, buf, max, timeout);
+}
+
+int osQueueGetDepth(osQueue queue)
+{
+	os_queue_stats_t counters;
+	int items;
+	if (os_pthread_queue_type(queue) != PTHREAD_QUEUE_LOCKED)
+		os_ring_queue_get_stats(queue, &counters, &items, 0);
+	else
+		os_pthread_queue_get_stats(queue, &counters, &items, 0);
+	return items;
 }
 
+static pthread_mutex_t os_queues_mutex = PTHREAD_MUTEX_INITIALIZER;
+static osQueue os_queues[OS_QUEUE_MAX];             ///< Registered queues
+static const char *os_queues_name[OS_QUEUE_MAX];
+static int os_queues_len = 0;
+
+void osQueueSetName(osQueue queue, const char *name)
+{
+	if (queue == NULL)
+		return;
+	pthread_mutex_lock(&os_queues_mutex);
+	if (os_queues_len < OS_QUEUE_MAX) {
+		os_queues[os_queues_len] = queue;
+		os_queues_name[os_queues_len] = name;
+		os_queues_len++;
+	}
+	pthread_mutex_unlock(&os_queues_mutex);
+}
+
+int osQueueGetStats(int index, osQueueStats *stats, int reset)
+{
+	pthread_mutex_lock(&os_queues_mutex);
+	osQueue queue = index >= 0 && index < os_queues_len ? os_queues[index] : NULL;
+	const char *name = queue != NULL ? os_queues_name[index] : NULL;
+	pthread_mutex_unlock(&os_queues_mutex);
+	if (queue == NULL)
+		return -1;
+
+	os_queue_stats_t counters;
+	int items;
+	if (os_pthread_queue_type(queue) != PTHREAD_QUEUE_LOCKED) {
+		os_ring_queue_get_stats(queue, &counters, &items, reset);
+		stats->size = (uint32_t)((os_ring_queue_t *)queue)->size;
+	} else {
+		os_pthread_queue_get_stats(queue, &counters, &items, reset);
+		stats->size = (uint32_t)((os_pthread_queue_t *)queue)->size;
+	}
+	stats->name = name;
+	stats->depth = (uint32_t)items;
+	stats->depth_max = counters.depth_max;
+	stats->sent = counters.sent;
+	stats->full = counters.full;
+	stats->block_us = counters.block_us;
+	return 0;
+}
@@ -36,3 +36,8 @@ void osScheduler(os_thread* threads_id, int n_threads)
 
     exit(0);
 }
+
+void osYieldFromISR(int task_woken)
+{
+    // No interrupts in Linux, threads are scheduled by the kernel
+}
@@ -19,6 +19,149 @@
  */
 
 #include "osSemphr.h"
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/* Absolute deadline timeout ms from now in the monotonic clock, not changed
+ * by dat_set_time */
+static int os_deadline(struct timespec *ts, uint32_t timeout)
+{
+	uint32_t sec, nsec;
+
+	if (clock_gettime(CLOCK_MONOTONIC, ts))
+		return -1;
+
+	sec = timeout / 1000;
+	nsec = (timeout - 1000 * sec) * 1000000;
+
+	ts->tv_sec += sec;
+
+	if (ts->tv_nsec + nsec >= 1000000000)
+		ts->tv_sec++;
+
+	ts->tv_nsec = (ts->tv_nsec + nsec) % 1000000000;
+	return 0;
+}
+
+/* Locks registered with osSemaphoreSetName or osRWLockSetName. Entries are
+ * only appended, lookups do not take os_locks_mutex */
+typedef struct os_lock_entry {
+	const void *lock;
+	const char *name;
+	uint32_t taken;
+	uint32_t contended;
+	uint64_t wait_us;
+	uint32_t hold_max_us;
+	uint64_t hold_start_us;     ///< Start of the current exclusive hold
+	char holder[OS_LOCK_NAME_LEN];
+} os_lock_entry_t;
+
+static os_lock_entry_t os_locks[OS_LOCK_MAX];
+static int os_locks_len = 0;
+static pthread_mutex_t os_locks_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void os_lock_register(const void *lock, const char *name)
+{
+	int i;
+	pthread_mutex_lock(&os_locks_mutex);
+	// A lock created again (repository init) keeps its entry
+	for (i = 0; i < os_locks_len && os_locks[i].lock != lock; i++);
+	if (i < os_locks_len)
+		os_locks[i].name = name;
+	else if (os_locks_len < OS_LOCK_MAX)
+	{
+		memset(&os_locks[os_locks_len], 0, sizeof(os_lock_entry_t));
+		os_locks[os_locks_len].lock = lock;
+		os_locks[os_locks_len].name = name;
+		__atomic_store_n(&os_locks_len, os_locks_len + 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&os_locks_mutex);
+}
+
+void osSemaphoreSetName(osSemaphore *mutex, const char *name)
+{
+	os_lock_register(mutex, name);
+}
+
+void osRWLockSetName(osRWLock *lock, const char *name)
+{
+	os_lock_register(lock, name);
+}
+
+int osLockGetStats(int index, osLockStats *stats, int reset)
+{
+	if (index < 0 || index >= __atomic_load_n(&os_locks_len, __ATOMIC_ACQUIRE))
+		return -1;
+
+	os_lock_entry_t *entry = &os_locks[index];
+	stats->name = entry->name;
+	if (reset)
+	{
+		stats->taken = __atomic_exchange_n(&entry->taken, 0, __ATOMIC_RELAXED);
+		stats->contended = __atomic_exchange_n(&entry->contended, 0, __ATOMIC_RELAXED);
+		stats->wait_us = __atomic_exchange_n(&entry->wait_us, 0, __ATOMIC_RELAXED);
+		stats->hold_max_us = __atomic_exchange_n(&entry->hold_max_us, 0, __ATOMIC_RELAXED);
+	}
+	else
+	{
+		stats->taken = __atomic_load_n(&entry->taken, __ATOMIC_RELAXED);
+		stats->contended = __atomic_load_n(&entry->contended, __ATOMIC_RELAXED);
+		stats->wait_us = __atomic_load_n(&entry->wait_us, __ATOMIC_RELAXED);
+		stats->hold_max_us = __atomic_load_n(&entry->hold_max_us, __ATOMIC_RELAXED);
+	}
+	memcpy(stats->holder, entry->holder, OS_LOCK_NAME_LEN);
+	stats->holder[OS_LOCK_NAME_LEN-1] = '\0';
+	return 0;
+}
+
+#if SCH_OS_LOCK_STATS
+/* Time for the lock statistics [us] */
+static uint64_t os_lock_now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static os_lock_entry_t *os_lock_find(const void *lock)
+{
+	int i, n = __atomic_load_n(&os_locks_len, __ATOMIC_ACQUIRE);
+	for (i = 0; i < n; i++)
+	{
+		if (os_locks[i].lock == lock)
+			return &os_locks[i];
+	}
+	return NULL;
+}
+
+/* Count an acquisition. @wait_start is 0 if the lock was free. Exclusive
+ * holders start their hold time, updated by os_lock_given */
+static void os_lock_taken(os_lock_entry_t *entry, uint64_t wait_start, int exclusive)
+{
+	uint64_t now = os_lock_now_us();
+	__atomic_add_fetch(&entry->taken, 1, __ATOMIC_RELAXED);
+	if (wait_start != 0)
+	{
+		__atomic_add_fetch(&entry->contended, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&entry->wait_us, now - wait_start, __ATOMIC_RELAXED);
+	}
+	if (exclusive)
+		entry->hold_start_us = now;
+}
+
+/* End an exclusive hold, before releasing the lock. The task name is only
+ * read for a new max. hold time */
+static void os_lock_given(os_lock_entry_t *entry)
+{
+	uint32_t hold = (uint32_t)(os_lock_now_us() - entry->hold_start_us);
+	if (hold > __atomic_load_n(&entry->hold_max_us, __ATOMIC_RELAXED))
+	{
+		__atomic_store_n(&entry->hold_max_us, hold, __ATOMIC_RELAXED);
+		pthread_getname_np(pthread_self(), entry->holder, OS_LOCK_NAME_LEN);
+	}
+}
+#endif
 
 int osSemaphoreCreate(osSemaphore* mutex)
 {
@@ -34,8 +177,20 @@ int osSemaphoreCreate(osSemaphore* mutex)
 int osSemaphoreTake(osSemaphore *mutex, uint32_t timeout)
 {
 	int ret;
+#if SCH_OS_LOCK_STATS
+	os_lock_entry_t *entry = os_lock_find(mutex);
+	uint64_t wait_start = 0;
+	if (entry != NULL)
+	{
+		if (pthread_mutex_trylock(mutex) == 0)
+		{
+			os_lock_taken(entry, 0, 1);
+			return OS_SEMAPHORE_OK;
+		}
+		wait_start = os_lock_now_us();
+	}
+#endif
 	struct timespec ts;
-	uint32_t sec, nsec;
 
 	//csp_log_lock("Wait: %p timeout PRIu32\r\n", mutex, timeout);
 
@@ -45,30 +200,42 @@ int osSemaphoreTake(osSemaphore *mutex, uint32_t timeout)
 	}
 	else
 	{
-		if (clock_gettime(CLOCK_REALTIME, &ts))
+		if (os_deadline(&ts, timeout))
 			return OS_SEMAPHORE_ERROR;
 
-		sec = timeout / 1000;
-		nsec = (timeout - 1000 * sec) * 1000000;
-
-		ts.tv_sec += sec;
-
-		if (ts.tv_nsec + nsec >= 1000000000)
-			ts.tv_sec++;
-
-		ts.tv_nsec = (ts.tv_nsec + nsec) % 1000000000;
-
-		ret = pthread_mutex_timedlock(mutex, &ts);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 30))
+		ret = pthread_mutex_clocklock(mutex, CLOCK_MONOTONIC, &ts);
+#else
+		// pthread_mutex_timedlock only waits on CLOCK_REALTIME, poll instead
+		struct timespec now;
+		const struct timespec poll = {0, 1000000};
+		while ((ret = pthread_mutex_trylock(mutex)) == EBUSY)
+		{
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (now.tv_sec > ts.tv_sec || (now.tv_sec == ts.tv_sec && now.tv_nsec >= ts.tv_nsec))
+				break;
+			nanosleep(&poll, NULL);
+		}
+#endif
 	}
 
 	if (ret != 0)
 		return OS_SEMAPHORE_ERROR;
 
+#if SCH_OS_LOCK_STATS
+	if (entry != NULL)
+		os_lock_taken(entry, wait_start, 1);
+#endif
 	return OS_SEMAPHORE_OK;
 }
 
 int osSemaphoreGiven(osSemaphore *mutex)
 {
+#if SCH_OS_LOCK_STATS
+	os_lock_entry_t *entry = os_lock_find(mutex);
+	if (entry != NULL)
+		os_lock_given(entry);
+#endif
 	if (pthread_mutex_unlock(mutex) == 0)
 	{
 		return OS_SEMAPHORE_OK;
@@ -77,4 +244,134 @@ int osSemaphoreGiven(osSemaphore *mutex)
 	{
 		return OS_SEMAPHORE_ERROR;
 	}
-}
\ No newline at end of file
+}
+
+int osRWLockCreate(osRWLock *lock)
+{
+	pthread_rwlockattr_t attr;
+	int ret;
+
+	if (pthread_rwlockattr_init(&attr) != 0)
+		return OS_SEMAPHORE_ERROR;
+#ifdef __GLIBC__
+	// Writers are rare, do not let a stream of readers starve them
+	pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+	ret = pthread_rwlock_init(lock, &attr);
+	pthread_rwlockattr_destroy(&attr);
+
+	return ret == 0 ? OS_SEMAPHORE_OK : OS_SEMAPHORE_ERROR;
+}
+
+int osRWLockReadTake(osRWLock *lock)
+{
+#if SCH_OS_LOCK_STATS
+	os_lock_entry_t *entry = os_lock_find(lock);
+	if (entry != NULL)
+	{
+		uint64_t wait_start = 0;
+		if (pthread_rwlock_tryrdlock(lock) != 0)
+		{
+			wait_start = os_lock_now_us();
+			if (pthread_rwlock_rdlock(lock) != 0)
+				return OS_SEMAPHORE_ERROR;
+		}
+		os_lock_taken(entry, wait_start, 0);
+		return OS_SEMAPHORE_OK;
+	}
+#endif
+	return pthread_rwlock_rdlock(lock) == 0 ? OS_SEMAPHORE_OK : OS_SEMAPHORE_ERROR;
+}
+
+int osRWLockReadGiven(osRWLock *lock)
+{
+	return pthread_rwlock_unlock(lock) == 0 ? OS_SEMAPHORE_OK : OS_SEMAPHORE_ERROR;
+}
+
+int osRWLockWriteTake(osRWLock *lock)
+{
+#if SCH_OS_LOCK_STATS
+	os_lock_entry_t *entry = os_lock_find(lock);
+	if (entry != NULL)
+	{
+		uint64_t wait_start = 0;
+		if (pthread_rwlock_trywrlock(lock) != 0)
+		{
+			wait_start = os_lock_now_us();
+			if (pthread_rwlock_wrlock(lock) != 0)
+				return OS_SEMAPHORE_ERROR;
+		}
+		os_lock_taken(entry, wait_start, 1);
+		return OS_SEMAPHORE_OK;
+	}
+#endif
+	return pthread_rwlock_wrlock(lock) == 0 ? OS_SEMAPHORE_OK : OS_SEMAPHORE_ERROR;
+}
+
+int osRWLockWriteGiven(osRWLock *lock)
+{
+#if SCH_OS_LOCK_STATS
+	os_lock_entry_t *entry = os_lock_find(lock);
+	if (entry != NULL)
+		os_lock_given(entry);
+#endif
+	return pthread_rwlock_unlock(lock) == 0 ? OS_SEMAPHORE_OK : OS_SEMAPHORE_ERROR;
+}
+
+int osEventCreate(osEvent *event)
+{
+	pthread_condattr_t attr;
+	int ret;
+
+	event->bits = 0;
+	if (pthread_condattr_init(&attr) != 0)
+		return OS_SEMAPHORE_ERROR;
+	// Timeouts wait on the monotonic clock, see osEventWait
+	ret = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) || pthread_mutex_init(&event->mutex, NULL) ||
+	      pthread_cond_init(&event->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	return ret == 0 ? OS_SEMAPHORE_OK : OS_SEMAPHORE_ERROR;
+}
+
+int osEventSet(osEvent *event, uint32_t bits)
+{
+	if (pthread_mutex_lock(&event->mutex) != 0)
+		return OS_SEMAPHORE_ERROR;
+	event->bits |= bits;
+	pthread_cond_signal(&event->cond);
+	pthread_mutex_unlock(&event->mutex);
+	return OS_SEMAPHORE_OK;
+}
+
+uint32_t osEventWait(osEvent *event, uint32_t bits, uint32_t timeout)
+{
+	uint32_t got;
+	struct timespec ts;
+	int has_ts = 0;
+
+	pthread_mutex_lock(&event->mutex);
+	while ((got = event->bits & bits) == 0 && timeout != 0)
+	{
+		if (timeout == portMAX_DELAY)
+		{
+			pthread_cond_wait(&event->cond, &event->mutex);
+			continue;
+		}
+		if (!has_ts)
+		{
+			if (os_deadline(&ts, timeout))
+				break;
+			has_ts = 1;
+		}
+		if (pthread_cond_timedwait(&event->cond, &event->mutex, &ts) != 0)
+		{
+			got = event->bits & bits;
+			break;
+		}
+	}
+	event->bits &= ~got;
+	pthread_mutex_unlock(&event->mutex);
+
+	return got;
+}
@@ -26,6 +26,36 @@ http://code.google.com/p/c-pthread-queue/
 #include <pthread.h>
 /* CSP includes */
 #include "pthread_queue.h"
+#include "config.h"
+
+/* Absolute deadline timeout ms from now. Deadlines use the monotonic clock, so
+ * changes of the system time (dat_set_time) do not shorten or extend them */
+static int os_pthread_queue_deadline(struct timespec *ts, uint32_t timeout) {
+
+	if (clock_gettime(CLOCK_MONOTONIC, ts))
+		return -1;
+
+	uint32_t sec = timeout / 1000;
+	uint32_t nsec = (timeout - 1000 * sec) * 1000000;
+
+	ts->tv_sec += sec;
+
+	if (ts->tv_nsec + nsec >= 1000000000)
+		ts->tv_sec++;
+
+	ts->tv_nsec = (ts->tv_nsec + nsec) % 1000000000;
+	return 0;
+
+}
+
+#if SCH_OS_QUEUE_STATS
+/* Time for the producers block time statistics [us] */
+static uint64_t os_pthread_queue_now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+#endif
 
 os_pthread_queue_t * os_pthread_queue_create(int length, size_t item_size) {
 	
@@ -34,16 +64,25 @@ os_pthread_queue_t * os_pthread_queue_create(int length, size_t item_size) {
 	if (q != NULL) {
 		q->buffer = malloc(length*item_size);
 		if (q->buffer != NULL) {
+			q->type = PTHREAD_QUEUE_LOCKED;
 			q->size = length;
 			q->item_size = item_size;
 			q->items = 0;
 			q->in = 0;
 			q->out = 0;
-			if (pthread_mutex_init(&(q->mutex), NULL) || pthread_cond_init(&(q->cond_full), NULL) || pthread_cond_init(&(q->cond_empty), NULL)) {
+			q->wait_send = 0;
+			q->wait_recv = 0;
+			q->wait_batch = 0;
+			memset(&(q->stats), 0, sizeof(os_queue_stats_t));
+			/* Condition variables wait on the monotonic clock */
+			pthread_condattr_t attr;
+			if (pthread_condattr_init(&attr) || pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) ||
+			    pthread_mutex_init(&(q->mutex), NULL) || pthread_cond_init(&(q->cond_full), &attr) || pthread_cond_init(&(q->cond_empty), &attr)) {
 				free(q->buffer);
 				free(q);
 				q = NULL;
 			}
+			pthread_condattr_destroy(&attr);
 		} else {
 			free(q);
 			q = NULL;
@@ -55,74 +94,185 @@ os_pthread_queue_t * os_pthread_queue_create(int length, size_t item_size) {
 }
 	
 
-int os_pthread_queue_send(os_pthread_queue_t *queue, void *value,
-                          uint32_t timeout) {
-	
+/* Wait on cond with the queue locked, counting the caller in waiters. The
+ * deadline is only calculated the first time the caller has to wait, so calls
+ * that find the queue ready, or do not block, never read the clock */
+static int os_pthread_queue_wait(os_pthread_queue_t *queue, pthread_cond_t *cond, int *waiters,
+                                 struct timespec *ts, int *has_ts, uint32_t timeout) {
+
 	int ret;
 
-	/* Calculate timeout */
-	struct timespec ts;
-	if (clock_gettime(CLOCK_REALTIME, &ts))
-		return PTHREAD_QUEUE_ERROR;
+	if (timeout == 0)
+		return -1;
+	if (!*has_ts) {
+		if (os_pthread_queue_deadline(ts, timeout))
+			return -1;
+		*has_ts = 1;
+	}
 
-	uint32_t sec = timeout / 1000;
-	uint32_t nsec = (timeout - 1000 * sec) * 1000000;
+#if SCH_OS_QUEUE_STATS
+	uint64_t start = cond == &(queue->cond_full) ? os_pthread_queue_now_us() : 0;
+#endif
+	(*waiters)++;
+	ret = pthread_cond_timedwait(cond, &(queue->mutex), ts);
+	(*waiters)--;
+#if SCH_OS_QUEUE_STATS
+	if (cond == &(queue->cond_full))
+		queue->stats.block_us += os_pthread_queue_now_us() - start;
+#endif
+
+	return ret;
 
-	ts.tv_sec += sec;
+}
 
-	if (ts.tv_nsec + nsec > 1000000000)
-		ts.tv_sec++;
+/* Wake up to n threads waiting on cond, if any, with the queue locked */
+static void os_pthread_queue_wake(pthread_cond_t *cond, int waiters, int n) {
 
-	ts.tv_nsec = (ts.tv_nsec + nsec) % 1000000000;
+	if (waiters <= 0 || n <= 0)
+		return;
+	if (n > 1 && waiters > 1)
+		pthread_cond_broadcast(cond);
+	else
+		pthread_cond_signal(cond);
 
-	/* Get queue lock */
+}
+
+/* Count n items sent, with the queue locked */
+static void os_pthread_queue_count(os_pthread_queue_t *queue, int n) {
+
+#if SCH_OS_QUEUE_STATS
+	queue->stats.sent += n;
+	if ((uint32_t)queue->items > queue->stats.depth_max)
+		queue->stats.depth_max = queue->items;
+#endif
+
+}
+
+static int os_pthread_queue_put(os_pthread_queue_t *queue, void *value,
+                                uint32_t timeout, int front) {
+
+	struct timespec ts;
+	int has_ts = 0;
+
+	/* Get queue lock. A timed out wait still succeeds if space was freed,
+	 * so a wake up is never lost */
 	pthread_mutex_lock(&(queue->mutex));
 	while (queue->items == queue->size) {
-		ret = pthread_cond_timedwait(&(queue->cond_full), &(queue->mutex), &ts);
-		if (ret != 0) {
+		if (os_pthread_queue_wait(queue, &(queue->cond_full), &(queue->wait_send), &ts, &has_ts, timeout) != 0 &&
+		    queue->items == queue->size) {
+#if SCH_OS_QUEUE_STATS
+			queue->stats.full++;
+#endif
 			pthread_mutex_unlock(&(queue->mutex));
 			return PTHREAD_QUEUE_FULL;
 		}
 	}
 
-	/* Coby object from input buffer */
-	memcpy(queue->buffer+(queue->in * queue->item_size), value, queue->item_size);
+	/* Coby object from input buffer, at the back or at the front */
+	if (front) {
+		queue->out = (queue->out - 1 + queue->size) % queue->size;
+		memcpy(queue->buffer+(queue->out * queue->item_size), value, queue->item_size);
+	} else {
+		memcpy(queue->buffer+(queue->in * queue->item_size), value, queue->item_size);
+		queue->in = (queue->in + 1) % queue->size;
+	}
 	queue->items++;
-	queue->in = (queue->in + 1) % queue->size;
+	os_pthread_queue_count(queue, 1);
+
+	/* Nofify one blocked consumer */
+	os_pthread_queue_wake(&(queue->cond_empty), queue->wait_recv, 1);
 	pthread_mutex_unlock(&(queue->mutex));
-	
-	/* Nofify blocked threads */
-	pthread_cond_broadcast(&(queue->cond_empty));
-	
+
 	return PTHREAD_QUEUE_OK;
-	
+
+}
+
+int os_pthread_queue_send(os_pthread_queue_t *queue, void *value,
+                          uint32_t timeout) {
+	return os_pthread_queue_put(queue, value, timeout, 0);
+}
+
+int os_pthread_queue_send_front(os_pthread_queue_t *queue, void *value,
+                                uint32_t timeout) {
+	return os_pthread_queue_put(queue, value, timeout, 1);
+}
+
+int os_pthread_queue_send_n(os_pthread_queue_t *queue, void *values, int n,
+                            uint32_t timeout, int all) {
+
+	struct timespec ts;
+	int has_ts = 0;
+	int sent = 0;
+	int notified = 0;
+
+	/* The full batch never fits */
+	if (all && n > queue->size)
+		return 0;
+
+	/* Get queue lock */
+	pthread_mutex_lock(&(queue->mutex));
+
+	/* Wait for space for the full batch. Batch waiters need more than one
+	 * free slot, so consumers wake all producers while there is one */
+	if (all) {
+		queue->wait_batch++;
+		while (queue->size - queue->items < n) {
+			if (os_pthread_queue_wait(queue, &(queue->cond_full), &(queue->wait_send), &ts, &has_ts, timeout) != 0 &&
+			    queue->size - queue->items < n) {
+#if SCH_OS_QUEUE_STATS
+				queue->stats.full++;
+#endif
+				queue->wait_batch--;
+				pthread_mutex_unlock(&(queue->mutex));
+				return 0;
+			}
+		}
+		queue->wait_batch--;
+	}
+
+	while (sent < n) {
+		if (queue->items == queue->size) {
+			/* Let consumers drain the items already sent */
+			os_pthread_queue_wake(&(queue->cond_empty), queue->wait_recv, sent - notified);
+			os_pthread_queue_count(queue, sent - notified);
+			notified = sent;
+			if (os_pthread_queue_wait(queue, &(queue->cond_full), &(queue->wait_send), &ts, &has_ts, timeout) != 0 &&
+			    queue->items == queue->size) {
+#if SCH_OS_QUEUE_STATS
+				queue->stats.full++;
+#endif
+				break;
+			}
+			continue;
+		}
+
+		/* Coby object from input buffer */
+		memcpy(queue->buffer+(queue->in * queue->item_size), (char *)values + sent * queue->item_size, queue->item_size);
+		queue->items++;
+		queue->in = (queue->in + 1) % queue->size;
+		sent++;
+	}
+
+	/* Nofify blocked consumers once */
+	os_pthread_queue_wake(&(queue->cond_empty), queue->wait_recv, sent - notified);
+	os_pthread_queue_count(queue, sent - notified);
+	pthread_mutex_unlock(&(queue->mutex));
+
+	return sent;
+
 }
 
 int os_pthread_queue_receive(os_pthread_queue_t *queue, void *buf,
                              uint32_t timeout) {
 
-	int ret;
-	
-	/* Calculate timeout */
 	struct timespec ts;
-    if (clock_gettime(CLOCK_REALTIME, &ts))
-        return PTHREAD_QUEUE_ERROR;
-	
-	uint32_t sec = timeout / 1000;
-	uint32_t nsec = (timeout - 1000 * sec) * 1000000;
+	int has_ts = 0;
 
-	ts.tv_sec += sec;
-	
-	if (ts.tv_nsec + nsec > 1000000000)
-		ts.tv_sec++;
-
-	ts.tv_nsec = (ts.tv_nsec + nsec) % 1000000000;
-	
 	/* Get queue lock */
 	pthread_mutex_lock(&(queue->mutex));
 	while (queue->items == 0) {
-		ret = pthread_cond_timedwait(&(queue->cond_empty), &(queue->mutex), &ts);
-		if (ret != 0) {
+		if (os_pthread_queue_wait(queue, &(queue->cond_empty), &(queue->wait_recv), &ts, &has_ts, timeout) != 0 &&
+		    queue->items == 0) {
 			pthread_mutex_unlock(&(queue->mutex));
 			return PTHREAD_QUEUE_EMPTY;
 		}
@@ -132,12 +282,376 @@ int os_pthread_queue_receive(os_pthread_queue_t *queue, void *buf,
 	memcpy(buf, queue->buffer+(queue->out * queue->item_size), queue->item_size);
 	queue->items--;
 	queue->out = (queue->out + 1) % queue->size;
+
+	/* Nofify one blocked producer, or all of them if a batch is waiting */
+	if (queue->wait_batch > 0)
+		pthread_cond_broadcast(&(queue->cond_full));
+	else
+		os_pthread_queue_wake(&(queue->cond_full), queue->wait_send, 1);
 	pthread_mutex_unlock(&(queue->mutex));
-	
-	/* Nofify blocked threads */
-	pthread_cond_broadcast(&(queue->cond_full));
 
 	return PTHREAD_QUEUE_OK;
-	
+
+}
+
+int os_pthread_queue_receive_n(os_pthread_queue_t *queue, void *buf, int max,
+                               uint32_t timeout) {
+
+	struct timespec ts;
+	int has_ts = 0;
+	int got = 0;
+
+	if (max <= 0)
+		return 0;
+
+	/* Get queue lock */
+	pthread_mutex_lock(&(queue->mutex));
+	while (queue->items == 0) {
+		if (os_pthread_queue_wait(queue, &(queue->cond_empty), &(queue->wait_recv), &ts, &has_ts, timeout) != 0 &&
+		    queue->items == 0) {
+			pthread_mutex_unlock(&(queue->mutex));
+			return 0;
+		}
+	}
+
+	/* Coby every available object to output buffer */
+	while (got < max && queue->items > 0) {
+		memcpy((char *)buf + got * queue->item_size, queue->buffer+(queue->out * queue->item_size), queue->item_size);
+		queue->items--;
+		queue->out = (queue->out + 1) % queue->size;
+		got++;
+	}
+
+	/* Nofify blocked producers once */
+	if (queue->wait_batch > 0)
+		pthread_cond_broadcast(&(queue->cond_full));
+	else
+		os_pthread_queue_wake(&(queue->cond_full), queue->wait_send, got);
+	pthread_mutex_unlock(&(queue->mutex));
+
+	return got;
+
+}
+
+int os_pthread_queue_get_stats(os_pthread_queue_t *queue, os_queue_stats_t *stats, int *items, int reset) {
+
+	pthread_mutex_lock(&(queue->mutex));
+	*stats = queue->stats;
+	*items = queue->items;
+	if (reset) {
+		memset(&(queue->stats), 0, sizeof(os_queue_stats_t));
+		queue->stats.depth_max = queue->items;
+	}
+	pthread_mutex_unlock(&(queue->mutex));
+
+	return 0;
+
+}
+
+os_ring_queue_t * os_ring_queue_create(int length, size_t item_size, int type) {
+
+	if (length <= 0 || (type != PTHREAD_QUEUE_SPSC && type != PTHREAD_QUEUE_MPSC))
+		return NULL;
+
+	/* Slots are a power of two so free running positions wrap cleanly, the
+	 * queue still holds at most length items per lane */
+	uint32_t slots = 1;
+	while (slots < (uint32_t)length)
+		slots <<= 1;
+
+	os_ring_queue_t * q = calloc(1, sizeof(os_ring_queue_t));
+	if (q == NULL)
+		return NULL;
+
+	q->type = type;
+	q->size = length;
+	q->item_size = item_size;
+	q->mask = slots - 1;
+
+	int ok = 1;
+	int i;
+	uint32_t j;
+	for (i = 0; i < 2; i++) {
+		q->lane[i].buffer = malloc(slots * item_size);
+		q->lane[i].seq = malloc(slots * sizeof(uint32_t));
+		if (q->lane[i].buffer == NULL || q->lane[i].seq == NULL) {
+			ok = 0;
+			continue;
+		}
+		for (j = 0; j < slots; j++)
+			q->lane[i].seq[j] = j;
+	}
+
+	/* Condition variables wait on the monotonic clock */
+	pthread_condattr_t attr;
+	if (ok && pthread_condattr_init(&attr) == 0) {
+		if (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) || pthread_mutex_init(&(q->mutex), NULL) ||
+		    pthread_cond_init(&(q->cond_full), &attr) || pthread_cond_init(&(q->cond_empty), &attr))
+			ok = 0;
+		pthread_condattr_destroy(&attr);
+	} else {
+		ok = 0;
+	}
+
+	if (!ok) {
+		for (i = 0; i < 2; i++) {
+			free(q->lane[i].buffer);
+			free(q->lane[i].seq);
+		}
+		free(q);
+		q = NULL;
+	}
+
+	return q;
+
+}
+
+/* Copy n items into the lane if all of them fit, without blocking */
+static int os_ring_lane_put(os_ring_queue_t *queue, os_ring_lane_t *lane, void *values, int n) {
+
+	uint32_t tail = __atomic_load_n(&(lane->tail), __ATOMIC_RELAXED);
+	uint32_t head;
+
+	/* Reserve n positions. The acquire on head orders our writes after the
+	 * consumer is done with the slots we reuse */
+	do {
+		head = __atomic_load_n(&(lane->head), __ATOMIC_ACQUIRE);
+		if (tail - head + n > (uint32_t)queue->size)
+			return 0;
+		if (queue->type == PTHREAD_QUEUE_SPSC) {
+			__atomic_store_n(&(lane->tail), tail + n, __ATOMIC_RELAXED);
+			break;
+		}
+	} while (!__atomic_compare_exchange_n(&(lane->tail), &tail, tail + n, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	/* Copy objects from input buffer and publish them in order */
+	int i;
+	for (i = 0; i < n; i++) {
+		uint32_t slot = (tail + i) & queue->mask;
+		memcpy(lane->buffer + slot * queue->item_size, (char *)values + i * queue->item_size, queue->item_size);
+		__atomic_store_n(&(lane->seq[slot]), tail + i + 1, __ATOMIC_RELEASE);
+	}
+
+	return 1;
+
+}
+
+/* Take the next item, front lane first, without blocking */
+static int os_ring_queue_pop(os_ring_queue_t *queue, void *buf) {
+
+	int i;
+	for (i = 0; i < 2; i++) {
+		os_ring_lane_t *lane = &(queue->lane[i]);
+		uint32_t head = lane->head;
+		uint32_t slot = head & queue->mask;
+		if (__atomic_load_n(&(lane->seq[slot]), __ATOMIC_ACQUIRE) != head + 1)
+			continue;
+
+		/* Copy object to output buffer, then release the slot */
+		memcpy(buf, lane->buffer + slot * queue->item_size, queue->item_size);
+		__atomic_store_n(&(lane->head), head + 1, __ATOMIC_RELEASE);
+		return 1;
+	}
+
+	return 0;
+
+}
+
+/* Items in both lanes, including reserved but not yet published ones. Heads
+ * are read first, so a lane never looks like it has a negative size */
+static uint32_t os_ring_queue_items(os_ring_queue_t *queue) {
+
+	uint32_t items = 0;
+	int i;
+	for (i = 0; i < 2; i++) {
+		uint32_t head = __atomic_load_n(&(queue->lane[i].head), __ATOMIC_ACQUIRE);
+		items += __atomic_load_n(&(queue->lane[i].tail), __ATOMIC_ACQUIRE) - head;
+	}
+
+	return items;
+
+}
+
+/* Count n items sent. Producers do not share a lock, counters are atomic */
+static void os_ring_queue_count(os_ring_queue_t *queue, int n) {
+
+#if SCH_OS_QUEUE_STATS
+	__atomic_add_fetch(&(queue->stats.sent), n, __ATOMIC_RELAXED);
+	uint32_t items = os_ring_queue_items(queue);
+	uint32_t max = __atomic_load_n(&(queue->stats.depth_max), __ATOMIC_RELAXED);
+	while (items > max && !__atomic_compare_exchange_n(&(queue->stats.depth_max), &max, items, 1,
+	                                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+#endif
+
+}
+
+/* Wake the other side, only if it is sleeping. The fence pairs with the one in
+ * os_ring_queue_wait, so either the waiter sees our change or we see it */
+static void os_ring_queue_notify(os_ring_queue_t *queue, int *waiters, pthread_cond_t *cond) {
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(waiters, __ATOMIC_RELAXED) > 0) {
+		pthread_mutex_lock(&(queue->mutex));
+		pthread_cond_broadcast(cond);
+		pthread_mutex_unlock(&(queue->mutex));
+	}
+
+}
+
+/* Sleep on cond until try(queue, lane, data, n) succeeds or the deadline */
+static int os_ring_queue_wait(os_ring_queue_t *queue, int *waiters, pthread_cond_t *cond,
+                              const struct timespec *ts, os_ring_lane_t *lane, void *data, int n) {
+
+	int ok = 0;
+#if SCH_OS_QUEUE_STATS
+	uint64_t start = lane != NULL ? os_pthread_queue_now_us() : 0;
+#endif
+	pthread_mutex_lock(&(queue->mutex));
+	__atomic_add_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	while (1) {
+		ok = lane != NULL ? os_ring_lane_put(queue, lane, data, n) : os_ring_queue_pop(queue, data);
+		if (ok || pthread_cond_timedwait(cond, &(queue->mutex), ts) != 0)
+			break;
+	}
+	if (!ok)
+		ok = lane != NULL ? os_ring_lane_put(queue, lane, data, n) : os_ring_queue_pop(queue, data);
+	__atomic_sub_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&(queue->mutex));
+#if SCH_OS_QUEUE_STATS
+	if (lane != NULL)
+		__atomic_add_fetch(&(queue->stats.block_us), os_pthread_queue_now_us() - start, __ATOMIC_RELAXED);
+#endif
+
+	return ok;
+
+}
+
+static int os_ring_queue_put(os_ring_queue_t *queue, os_ring_lane_t *lane, void *values, int n,
+                             const struct timespec *ts) {
+
+	if (!os_ring_lane_put(queue, lane, values, n)) {
+		if (ts == NULL || !os_ring_queue_wait(queue, &(queue->wait_send), &(queue->cond_full), ts, lane, values, n)) {
+#if SCH_OS_QUEUE_STATS
+			__atomic_add_fetch(&(queue->stats.full), 1, __ATOMIC_RELAXED);
+#endif
+			return PTHREAD_QUEUE_FULL;
+		}
+	}
+	os_ring_queue_count(queue, n);
+
+	/* Notify blocked consumer */
+	os_ring_queue_notify(queue, &(queue->wait_recv), &(queue->cond_empty));
+
+	return PTHREAD_QUEUE_OK;
+
+}
+
+int os_ring_queue_send(os_ring_queue_t *queue, void *value, uint32_t timeout) {
+
+	struct timespec ts;
+	if (timeout > 0 && os_pthread_queue_deadline(&ts, timeout))
+		return PTHREAD_QUEUE_ERROR;
+	return os_ring_queue_put(queue, &(queue->lane[1]), value, 1, timeout > 0 ? &ts : NULL);
+
+}
+
+int os_ring_queue_send_front(os_ring_queue_t *queue, void *value, uint32_t timeout) {
+
+	struct timespec ts;
+	if (timeout > 0 && os_pthread_queue_deadline(&ts, timeout))
+		return PTHREAD_QUEUE_ERROR;
+	return os_ring_queue_put(queue, &(queue->lane[0]), value, 1, timeout > 0 ? &ts : NULL);
+
+}
+
+int os_ring_queue_send_n(os_ring_queue_t *queue, void *values, int n, uint32_t timeout, int all) {
+
+	int sent = 0;
+
+	/* The full batch never fits */
+	if (n <= 0 || (all && n > queue->size))
+		return 0;
+
+	struct timespec ts;
+	if (timeout > 0 && os_pthread_queue_deadline(&ts, timeout))
+		return 0;
+	const struct timespec *deadline = timeout > 0 ? &ts : NULL;
+
+	/* A full batch is reserved at once, so items from other producers do not
+	 * interleave with it */
+	if (all)
+		return os_ring_queue_put(queue, &(queue->lane[1]), values, n, deadline) == PTHREAD_QUEUE_OK ? n : 0;
+
+	while (sent < n && os_ring_queue_put(queue, &(queue->lane[1]), (char *)values + sent * queue->item_size, 1, deadline) == PTHREAD_QUEUE_OK)
+		sent++;
+
+	return sent;
+
+}
+
+/* Take one item, sleeping up to timeout if the ring is empty */
+static int os_ring_queue_receive_one(os_ring_queue_t *queue, void *buf, uint32_t timeout) {
+
+	if (!os_ring_queue_pop(queue, buf)) {
+		struct timespec ts;
+		if (timeout == 0 || os_pthread_queue_deadline(&ts, timeout))
+			return PTHREAD_QUEUE_EMPTY;
+		if (!os_ring_queue_wait(queue, &(queue->wait_recv), &(queue->cond_empty), &ts, NULL, buf, 0))
+			return PTHREAD_QUEUE_EMPTY;
+	}
+
+	return PTHREAD_QUEUE_OK;
+
+}
+
+int os_ring_queue_receive(os_ring_queue_t *queue, void *buf, uint32_t timeout) {
+
+	if (os_ring_queue_receive_one(queue, buf, timeout) != PTHREAD_QUEUE_OK)
+		return PTHREAD_QUEUE_EMPTY;
+
+	/* Notify blocked producers */
+	os_ring_queue_notify(queue, &(queue->wait_send), &(queue->cond_full));
+
+	return PTHREAD_QUEUE_OK;
+
 }
 
+int os_ring_queue_receive_n(os_ring_queue_t *queue, void *buf, int max, uint32_t timeout) {
+
+	int got;
+
+	if (max <= 0 || os_ring_queue_receive_one(queue, buf, timeout) != PTHREAD_QUEUE_OK)
+		return 0;
+
+	/* Drain what is already published, without blocking */
+	for (got = 1; got < max; got++) {
+		if (!os_ring_queue_pop(queue, (char *)buf + got * queue->item_size))
+			break;
+	}
+
+	/* Notify blocked producers */
+	os_ring_queue_notify(queue, &(queue->wait_send), &(queue->cond_full));
+
+	return got;
+
+}
+
+int os_ring_queue_get_stats(os_ring_queue_t *queue, os_queue_stats_t *stats, int *items, int reset) {
+
+	*items = (int)os_ring_queue_items(queue);
+	if (reset) {
+		stats->sent = __atomic_exchange_n(&(queue->stats.sent), 0, __ATOMIC_RELAXED);
+		stats->full = __atomic_exchange_n(&(queue->stats.full), 0, __ATOMIC_RELAXED);
+		stats->depth_max = __atomic_exchange_n(&(queue->stats.depth_max), (uint32_t)*items, __ATOMIC_RELAXED);
+		stats->block_us = __atomic_exchange_n(&(queue->stats.block_us), 0, __ATOMIC_RELAXED);
+	} else {
+		stats->sent = __atomic_load_n(&(queue->stats.sent), __ATOMIC_RELAXED);
+		stats->full = __atomic_load_n(&(queue->stats.full), __ATOMIC_RELAXED);
+		stats->depth_max = __atomic_load_n(&(queue->stats.depth_max), __ATOMIC_RELAXED);
+		stats->block_us = __atomic_load_n(&(queue->stats.block_us), __ATOMIC_RELAXED);
+	}
+
+	return 0;
+
+}
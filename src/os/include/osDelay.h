@@ -48,6 +48,64 @@ portTick osTaskGetTickCount(void);
  */
 void osTaskSetTickCount(portTick new_tick_us);
 
+#ifdef LINUX
+/**
+ * Virtual clock, only implemented by the sim OS backend (src/os/sim).
+ *
+ * The system tick, osDelay and all queue, semaphore and event timeouts follow
+ * a simulated clock. Once started, the clock advances @speed times faster than
+ * real time while any task runs, and jumps to the earliest deadline when every
+ * task created with osCreateTask is waiting, so idle time costs nothing. Tasks
+ * blocked outside the OS layer (e.g. sockets) are seen as running. If the
+ * clock is not started the tick only changes with osTaskSetTickCount.
+ *
+ * @param speed uint32_t. Times real time while tasks run, 0 stops the clock
+ * @return 0 if OK, -1 if the clock thread can not be created
+ */
+int osTaskClockRun(uint32_t speed);
+
+/**
+ * Get the virtual wall clock time: the real time when the program started plus
+ * the virtual time elapsed since then.
+ * @param ts Pointer for saving the time
+ * @return 0 if OK
+ */
+int osTaskClockGettime(struct timespec *ts);
+
+/**
+ * Absolute virtual deadline @timeout milliseconds from now, for
+ * osTaskClockWait. A portMAX_DELAY timeout never expires.
+ * @param ts Pointer for saving the deadline
+ * @param timeout uint32_t. Timeout in milliseconds
+ * @return 0 if OK
+ */
+int osTaskClockDeadline(struct timespec *ts, uint32_t timeout);
+
+/**
+ * Replaces pthread_cond_timedwait in the sim OS backend. Waits on @cond with
+ * @mutex locked until woken up or the virtual deadline @ts (osTaskClockDeadline)
+ * passes. Wake up the waiters with osTaskClockWake, so the clock knows they
+ * are running again.
+ * @param cond Condition variable
+ * @param mutex Locked mutex
+ * @param ts Virtual deadline, NULL waits forever
+ * @return 0 if woken up, ETIMEDOUT if the deadline passed
+ */
+int osTaskClockWait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *ts);
+
+/**
+ * Wake up all the threads waiting on @cond in osTaskClockWait.
+ * @param cond Condition variable
+ */
+void osTaskClockWake(pthread_cond_t *cond);
+
+/**
+ * Count tasks that the clock waits for before jumping, called by osCreateTask.
+ * @param n Int. Tasks started (> 0) or finished (< 0)
+ */
+void osTaskClockAddTask(int n);
+#endif
+
 /**
  * Delay task execution
  * @param milliseconds uint32_t. Milliseconds to sleep
@@ -62,4 +120,81 @@ void osDelay(uint32_t mseconds);
  */
 void osTaskDelayUntil(portTick *lastTime, uint32_t mseconds);
 
+#define OS_PERIOD_MAX (8)   ///< Max. number of registered periodic tasks
+
+/**
+ * Periodic task loop statistics. Work is the time from the task wake up (or
+ * osPeriodInit, for the first loop) to its next delay, a loop overruns if its work ends after the start of the
+ * next period. Lateness is the delay between the scheduled and the actual
+ * wake up.
+ */
+typedef struct os_period_stats {
+    const char *name;       ///< Task name
+    uint32_t period_ms;     ///< Loop period [ms]
+    uint32_t loops;         ///< Measured loops
+    uint32_t overruns;      ///< Loops longer than the period
+    uint32_t work_last_us;  ///< Last loop work time [us]
+    uint32_t work_max_us;   ///< Max. loop work time [us]
+    uint64_t work_sum_us;   ///< Sum of work times, for the mean [us]
+    uint32_t late_max_us;   ///< Max. wake up lateness [us]
+} osPeriodStats;
+
+/**
+ * Periodic task loop, replaces the lastTime variable of osTaskDelayUntil
+ * loops (@see osPeriodInit)
+ */
+typedef struct os_period {
+    osPeriodStats stats;    ///< Loop statistics, written by the task only
+    portTick last;          ///< Scheduled wake up tick, as osTaskDelayUntil
+    portTick wake;          ///< Actual wake up tick
+    volatile int reset;     ///< Reset the statistics in the next loop
+#ifdef LINUX
+    struct timespec next;   ///< Scheduled wake up on CLOCK_MONOTONIC (Linux backend)
+#endif
+} osPeriod;
+
+/**
+ * Register a periodic task loop. The loop is measured when it calls
+ * osPeriodDelay instead of osTaskDelayUntil. @period must be valid while the
+ * task runs (static). At most OS_PERIOD_MAX loops are registered, others are
+ * delayed but not listed by osPeriodGetStats.
+ *
+ * @param period osPeriod. Loop to register
+ * @param name Str. Task name
+ * @param mseconds uint32_t. Loop period in milliseconds
+ */
+void osPeriodInit(osPeriod *period, const char *name, uint32_t mseconds);
+
+/**
+ * Delay the task until the next period, as osTaskDelayUntil, and record the
+ * work time of the loop that ends and the wake up lateness. Periods are
+ * scheduled from the previous one, not from the wake up, so they do not drift
+ * and a late loop is followed by shorter ones until it catches up. In Linux
+ * the task sleeps until an absolute CLOCK_MONOTONIC deadline with
+ * clock_nanosleep, FreeRTOS uses vTaskDelayUntil.
+ *
+ * @param period osPeriod. Loop registered with osPeriodInit
+ */
+void osPeriodDelay(osPeriod *period);
+
+/**
+ * Change the period of a registered loop. The next wake up is scheduled from
+ * the previous one with the new period. Called by the task of the loop.
+ *
+ * @param period osPeriod. Loop registered with osPeriodInit
+ * @param mseconds uint32_t. New loop period in milliseconds
+ */
+void osPeriodSet(osPeriod *period, uint32_t mseconds);
+
+/**
+ * Get the statistics of a registered periodic task loop. The statistics are
+ * updated by the task without locks, so a copy may mix two loops.
+ *
+ * @param index Int. Registered loop index, from 0 to OS_PERIOD_MAX-1
+ * @param stats Pointer for saving the statistics
+ * @param reset Int. Set to 1 to reset the statistics in the next loop
+ * @return 0 if OK, -1 if there is no loop with this index
+ */
+int osPeriodGetStats(int index, osPeriodStats *stats, int reset);
+
 #endif
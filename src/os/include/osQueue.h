@@ -21,9 +21,104 @@
 
 typedef void* osQueue;
 
+/**
+ * Queue access patterns, see osQueueCreateType
+ */
+typedef enum {
+    OS_QUEUE_MPMC = 0,  ///< Any number of producer and consumer tasks
+    OS_QUEUE_SPSC,      ///< One producer task and one consumer task
+    OS_QUEUE_MPSC,      ///< Many producer tasks and one consumer task
+} osQueueType;
+
+/**
+ * Create a queue of @length items of @item_size bytes. In FreeRTOS with
+ * configSUPPORT_STATIC_ALLOCATION queues are created from static buffers
+ * (SCH_OS_STATIC_QUEUES queues and SCH_OS_STATIC_QUEUE_BYTES for their items)
+ * and then from the FreeRTOS heap.
+ */
 osQueue osQueueCreate(int length, size_t item_size);
+/**
+ * Create a queue for a known access pattern. In Linux, SPSC and MPSC queues
+ * are lock-free rings that only take a lock to sleep when they are empty or
+ * full. Items sent to the front of a ring are received before the rest, but in
+ * the order they were sent. FreeRTOS queues ignore @type.
+ */
+osQueue osQueueCreateType(int length, size_t item_size, osQueueType type);
 int osQueueSend(osQueue queues, void *value, uint32_t timeout);
+int osQueueSendToFront(osQueue queue, void *value, uint32_t timeout);
+/**
+ * Send @n items of @item_size bytes to the queue, in order. In Linux the queue
+ * is locked once and consumers are notified once for the whole batch.
+ * If @all is set, no item is sent unless the queue has space for all of them.
+ * @return Number of items sent
+ */
+int osQueueSendBatch(osQueue queue, void *values, int n, size_t item_size, uint32_t timeout, int all);
+/**
+ * Send an item from an interrupt service routine, never blocks. In FreeRTOS
+ * @task_woken is set if the send unblocked a task with higher priority than
+ * the interrupted one, the ISR should end with osYieldFromISR(*task_woken).
+ * ISR sends are not counted in the queue statistics. In Linux there are no
+ * ISRs, it is a send with timeout 0 and @task_woken is always 0.
+ * @return pdPASS if sent, else the queue is full
+ */
+int osQueueSendFromISR(osQueue queue, void *value, int *task_woken);
+/**
+ * Send an item to the front of the queue from an interrupt service routine,
+ * see osQueueSendFromISR
+ */
+int osQueueSendToFrontFromISR(osQueue queue, void *value, int *task_woken);
 int osQueueReceive(osQueue queue, void *buf, uint32_t timeout);
+/**
+ * Receive up to @max items of @item_size bytes into @buf, in order. Blocks up
+ * to @timeout for the first item, then takes every item already available
+ * without blocking. In Linux the queue is locked once and producers are
+ * notified once for the whole batch.
+ * @return Number of items received
+ */
+int osQueueReceiveMany(osQueue queue, void *buf, int max, size_t item_size, uint32_t timeout);
+/**
+ * Number of items waiting in the queue. The queue may change right after
+ * the call, so it is only a hint (eg. to estimate the load of a consumer).
+ * @return Number of items in the queue
+ */
+int osQueueGetDepth(osQueue queue);
+
+#define OS_QUEUE_MAX (16)   ///< Max. number of named queues, listed by osQueueGetStats
+
+/**
+ * Queue usage statistics, counted if SCH_OS_QUEUE_STATS is set. Block time is
+ * the time producers waited for space, full events are sends that failed
+ * because the queue was still full after the timeout.
+ */
+typedef struct os_queue_info {
+    const char *name;       ///< Queue name
+    uint32_t size;          ///< Queue length
+    uint32_t depth;         ///< Items in the queue
+    uint32_t depth_max;     ///< Max. items in the queue (high-water mark)
+    uint32_t sent;          ///< Items sent
+    uint32_t full;          ///< Sends failed because the queue was full
+    uint64_t block_us;      ///< Time producers blocked waiting for space [us]
+} osQueueStats;
+
+/**
+ * Name a queue and register it for osQueueGetStats. At most OS_QUEUE_MAX
+ * queues are registered, others keep working but are not listed.
+ *
+ * @param queue osQueue. Queue to register
+ * @param name Str. Queue name, must be valid while the queue exists (static)
+ */
+void osQueueSetName(osQueue queue, const char *name);
+
+/**
+ * Get the usage statistics of a registered queue (@see osQueueSetName)
+ *
+ * @param index Int. Registered queue index, from 0 to OS_QUEUE_MAX-1
+ * @param stats Pointer for saving the statistics
+ * @param reset Int. Set to 1 to clear the counters, the high-water mark is
+ * reset to the current depth
+ * @return 0 if OK, -1 if there is no queue registered at @index
+ */
+int osQueueGetStats(int index, osQueueStats *stats, int reset);
 //void os_queue_remove(csp_queue_handle_t queue);
 //int os_queue_enqueue(csp_queue_handle_t handle, void *value, uint32_t timeout);
 //int os_queue_enqueue_isr(csp_queue_handle_t handle, void * value, CSP_BASE_TYPE * task_woken);
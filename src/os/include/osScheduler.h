@@ -27,4 +27,11 @@
 
 void osScheduler(os_thread* threads_id, int n_threads);
 
+/**
+ * Request a context switch at the end of an interrupt service routine if
+ * @task_woken is set by a FromISR call (see osQueueSendFromISR), so the
+ * unblocked task runs as soon as the ISR returns. Does nothing in Linux.
+ */
+void osYieldFromISR(int task_woken);
+
 #endif
@@ -16,6 +16,12 @@
 	#include <pthread.h>
 	#include <stdint.h>
 	typedef pthread_mutex_t osSemaphore;
+	typedef struct os_event {
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+		uint32_t bits;
+	} osEvent;
+	typedef pthread_rwlock_t osRWLock;
 
 	#define OS_SEMAPHORE_OK     1
 	#define OS_SEMAPHORE_ERROR  2
@@ -26,6 +32,15 @@
 	#include "queue.h"
 	#include "semphr.h"
 	typedef xSemaphoreHandle osSemaphore;
+	typedef struct os_event {
+		xSemaphoreHandle sem;
+		volatile uint32_t bits;
+	} osEvent;
+	typedef struct os_rwlock {
+		xSemaphoreHandle mutex;		///< Protects readers
+		xSemaphoreHandle write;		///< Held by a writer, or by the readers
+		int readers;
+	} osRWLock;
 
 	#define OS_SEMAPHORE_OK 	pdPASS
     #define OS_SEMAPHORE_ERROR	pdFAIL
@@ -33,8 +48,85 @@
     #define CSP_MUTEX_ERROR		CSP_SEMAPHORE_ERROR
 #endif
 
+/**
+ * Create a mutex. In FreeRTOS with configSUPPORT_STATIC_ALLOCATION mutexes,
+ * read-write locks and events are created from SCH_OS_STATIC_SEMAPHORES
+ * static buffers (two per read-write lock) and then from the FreeRTOS heap.
+ * @return OS_SEMAPHORE_OK or OS_SEMAPHORE_ERROR
+ */
 int osSemaphoreCreate(osSemaphore* mutex);
 int osSemaphoreTake(osSemaphore* mutex, uint32_t timeout);
 int osSemaphoreGiven(osSemaphore* mutex);
 
+/**
+ * Reader-writer lock, for read-mostly data. Many tasks can hold the read lock
+ * at once, the write lock is exclusive. In GNU/Linux waiting writers go
+ * before new readers. Locks are not recursive.
+ * @return OS_SEMAPHORE_OK or OS_SEMAPHORE_ERROR
+ */
+int osRWLockCreate(osRWLock *lock);
+int osRWLockReadTake(osRWLock *lock);
+int osRWLockReadGiven(osRWLock *lock);
+int osRWLockWriteTake(osRWLock *lock);
+int osRWLockWriteGiven(osRWLock *lock);
+
+/**
+ * Event flags. A task blocks in osEventWait until other tasks signal
+ * something with osEventSet (a new flight plan entry, etc.), instead of
+ * polling. Bits stay set until the waiting task receives them, so a signal is
+ * not lost if the task is busy. Only one task should wait on an event. In
+ * FreeRTOS only the lower 24 bits should be used.
+ */
+int osEventCreate(osEvent *event);
+/**
+ * Set @bits of the event and wake up the waiting task
+ * @return OS_SEMAPHORE_OK or OS_SEMAPHORE_ERROR
+ */
+int osEventSet(osEvent *event, uint32_t bits);
+/**
+ * Wait up to @timeout milliseconds (portMAX_DELAY for ever) until any of
+ * @bits is set. The received bits are cleared.
+ * @return The received bits, 0 if the timeout expired
+ */
+uint32_t osEventWait(osEvent *event, uint32_t bits, uint32_t timeout);
+
+#define OS_LOCK_MAX (16)        ///< Max. number of named locks, listed by osLockGetStats
+#define OS_LOCK_NAME_LEN (16)   ///< Holder task name length
+
+/**
+ * Lock contention statistics, counted if SCH_OS_LOCK_STATS is set (GNU/Linux
+ * only). An acquisition is contended if the lock was not free. Hold times
+ * are only measured for exclusive holders (semaphores and write locks).
+ */
+typedef struct os_lock_stats {
+    const char *name;               ///< Lock name
+    uint32_t taken;                 ///< Acquisitions
+    uint32_t contended;             ///< Acquisitions that had to wait
+    uint64_t wait_us;               ///< Total wait time of contended acquisitions [us]
+    uint32_t hold_max_us;           ///< Max. exclusive hold time [us]
+    char holder[OS_LOCK_NAME_LEN];  ///< Task that held the lock for hold_max_us
+} osLockStats;
+
+/**
+ * Name a lock and register it for osLockGetStats. At most OS_LOCK_MAX locks
+ * are registered, others keep working but are not listed. Only registered
+ * locks are tracked, at the cost of a lookup and two clock reads per
+ * acquisition.
+ *
+ * @param mutex Lock to register, created with osSemaphoreCreate
+ * @param name Str. Lock name, must be valid while the lock exists (static)
+ */
+void osSemaphoreSetName(osSemaphore *mutex, const char *name);
+void osRWLockSetName(osRWLock *lock, const char *name);
+
+/**
+ * Get the contention statistics of a registered lock
+ *
+ * @param index Int. Registered lock index, from 0 to OS_LOCK_MAX-1
+ * @param stats Pointer for saving the statistics
+ * @param reset Int. Set to 1 to clear the counters
+ * @return 0 if OK, -1 if there is no lock registered at @index
+ */
+int osLockGetStats(int index, osLockStats *stats, int reset);
+
 #endif
\ No newline at end of file
@@ -26,6 +26,35 @@
     typedef portBASE_TYPE os_thread;
 #endif
 
+#include <stdint.h>
+
+/* Scheduling policies (@see osTaskProfile) */
+#define OS_SCHED_FIFO   0   ///< Real time, first in first out (default)
+#define OS_SCHED_RR     1   ///< Real time, round robin
+#define OS_SCHED_OTHER  2   ///< Normal time sharing, priority is ignored
+
+/**
+ * Task scheduling profile. In FreeRTOS the policy is not used, and the
+ * affinity only in the dual core ESP32: a mask with one core (0x1 or 0x2)
+ * pins the task to it when created (xTaskCreatePinnedToCore).
+ */
+typedef struct os_task_profile {
+    unsigned int priority;  ///< Task priority, as in osCreateTask
+    int policy;             ///< Scheduling policy, OS_SCHED_*
+    uint32_t cpus;          ///< CPU affinity mask (bit n is CPU n), 0 for any CPU
+} osTaskProfile;
+
+#define OS_TASK_MAX (16)    ///< Max. number of tasks listed by osTaskGetStack
+
+/**
+ * Task stack usage (@see osTaskGetStack)
+ */
+typedef struct os_task_stack {
+    const char *name;       ///< Task name
+    uint32_t size;          ///< Stack size [bytes]
+    uint32_t used_max;      ///< Max. stack used, the high-water mark [bytes]
+} osTaskStack;
+
 /**
  * Create a new task.
  * In GNU/Linux a new thread is created and started inmediately. In FreeRTOS
@@ -44,8 +73,76 @@
  *
  * @return Returns 0 on success, error code if the task can not be created.
  */
+/**
+ * Create a task with a stack of @size words. In FreeRTOS with
+ * configSUPPORT_STATIC_ALLOCATION the task and its stack are taken from
+ * static buffers (SCH_OS_STATIC_STACK_WORDS words for all tasks) and then
+ * from the FreeRTOS heap. The static stacks are not reused.
+ * @return 0 if OK, 1 if the task was not created
+ */
 int osCreateTask(void (*functionTask)(void *), char* name, unsigned short size, void * parameters, unsigned int priority, os_thread* thread);
 
+/**
+ * Create a new task with a scheduling profile, as osCreateTask. If the
+ * profile can not be applied (no permissions, CPU not available) the task is
+ * created anyway and a warning is printed.
+ *
+ * @param functionTask Pointer to the target function task
+ * @param name Task name. In GNU/Linux max 16 chars.
+ * @param size Task stack size.
+ * @param parameters Pointer to stack parameters
+ * @param profile Task priority, policy and CPU affinity
+ * @param thread Pointer to store the task handler
+ *
+ * @return Returns 0 on success, error code if the task can not be created.
+ */
+int osCreateTaskProfile(void (*functionTask)(void *), char* name, unsigned short size, void * parameters, const osTaskProfile *profile, os_thread* thread);
+
+/**
+ * Change the scheduling profile of a running task. In FreeRTOS only the
+ * priority of the calling task (@thread NULL) can be changed.
+ *
+ * @param thread Pointer to the task handler, NULL for the calling task
+ * @param profile Task priority, policy and CPU affinity
+ * @return 0 if OK, -1 if the profile could not be fully applied
+ */
+int osTaskSetProfile(os_thread *thread, const osTaskProfile *profile);
+
+/**
+ * Lock the current and future process memory in RAM (mlockall), so real time
+ * tasks do not wait for page faults. Does nothing in FreeRTOS.
+ *
+ * @return 0 if OK, -1 on error
+ */
+int osTaskLockMemory(void);
+
+/**
+ * Get the stack usage of a task created with osCreateTask. At most
+ * OS_TASK_MAX tasks are listed.
+ * In FreeRTOS it uses uxTaskGetStackHighWaterMark, so it needs
+ * INCLUDE_uxTaskGetStackHighWaterMark. In GNU/Linux thread stacks are mapped
+ * zeroed, so the high-water mark is the lowest non zero byte of the stack
+ * (only resident pages are read). The stack size is the one used by the
+ * thread, not @size in osCreateTask when it is below PTHREAD_STACK_MIN, and
+ * the usage includes the thread local storage.
+ *
+ * @param index Int. Task index, from 0 to OS_TASK_MAX-1
+ * @param stack Pointer for saving the stack usage
+ * @return 0 if OK, -1 if there is no task with this index
+ */
+int osTaskGetStack(int index, osTaskStack *stack);
+
+/**
+ * Get the handler and name of a task created with osCreateTask, as listed by
+ * osTaskGetStack. Only in GNU/Linux.
+ *
+ * @param index Int. Task index, from 0 to OS_TASK_MAX-1
+ * @param thread Pointer for saving the task handler
+ * @param name Pointer for saving the task name, can be NULL
+ * @return 0 if OK, -1 if there is no task with this index
+ */
+int osTaskGetThread(int index, os_thread *thread, const char **name);
+
 /**
  * Delete a task. Only in FreeRTOS, not implemented for GNU/Linux
  * @param task_handle Pinter to a task handler
@@ -31,18 +31,68 @@ http://code.google.com/p/c-pthread-queue/
 #include <sys/time.h>
 #include <string.h>
 
+/* Queue kinds. The kind is the first member of every queue, so osQueue calls
+ * can tell a locked queue from a ring */
+#define PTHREAD_QUEUE_LOCKED 0
+#define PTHREAD_QUEUE_SPSC 1
+#define PTHREAD_QUEUE_MPSC 2
+
+#define os_pthread_queue_type(queue) (*(int *)(queue))
+
+/* Queue usage statistics, only updated if SCH_OS_QUEUE_STATS is set */
+typedef struct os_queue_stats_s {
+	uint32_t sent;          ///< Items sent
+	uint32_t full;          ///< Sends that failed because the queue was full, after the timeout
+	uint32_t depth_max;     ///< Max. items in the queue (high-water mark)
+	uint64_t block_us;      ///< Time producers blocked waiting for space [us]
+} os_queue_stats_t;
+
 typedef struct os_thread_queue_s {
+	int type;
 	void * buffer;
 	int size;
 	int item_size;
 	int items;
 	int in;
 	int out;
+	int wait_send;          ///< Producers waiting for space
+	int wait_recv;          ///< Consumers waiting for items
+	int wait_batch;         ///< Producers waiting for space for a full batch
 	pthread_mutex_t mutex;
 	pthread_cond_t cond_full;
 	pthread_cond_t cond_empty;
+	os_queue_stats_t stats;
 } os_pthread_queue_t;
 
+/* Lock-free ring lane. Positions are free running counters, the slot of a
+ * position is pos & mask. seq[slot] is pos + 1 once the item at pos is
+ * published, so the consumer never reads a reserved but unwritten slot */
+typedef struct os_ring_lane_s {
+	uint32_t head;          ///< Next position to read, written by the consumer
+	uint32_t tail;          ///< Next position to reserve, written by producers
+	uint32_t *seq;
+	char *buffer;
+} os_ring_lane_t;
+
+/* Ring queue for one consumer and one (SPSC) or many (MPSC) producers. The
+ * mutex and condition variables are only used to sleep when the ring is empty
+ * or full, and only taken by producers or the consumer if the other side is
+ * waiting. Items sent to the front go to their own lane, which the consumer
+ * drains first */
+typedef struct os_ring_queue_s {
+	int type;
+	int size;
+	int item_size;
+	uint32_t mask;
+	os_ring_lane_t lane[2]; ///< [0] front, [1] back
+	int wait_send;          ///< Producers waiting for space
+	int wait_recv;          ///< Consumer waiting for items
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_full;
+	pthread_cond_t cond_empty;
+	os_queue_stats_t stats;
+} os_ring_queue_t;
+
 #define PTHREAD_QUEUE_ERROR 0
 #define PTHREAD_QUEUE_EMPTY 0
 #define PTHREAD_QUEUE_FULL 0
@@ -50,7 +100,19 @@ typedef struct os_thread_queue_s {
 
 os_pthread_queue_t * os_pthread_queue_create(int length, size_t item_size);
 int os_pthread_queue_send(os_pthread_queue_t *queue, void *value, uint32_t timeout);
+int os_pthread_queue_send_front(os_pthread_queue_t *queue, void *value, uint32_t timeout);
+int os_pthread_queue_send_n(os_pthread_queue_t *queue, void *values, int n, uint32_t timeout, int all);
 int os_pthread_queue_receive(os_pthread_queue_t *queue, void *buf, uint32_t timeout);
+int os_pthread_queue_receive_n(os_pthread_queue_t *queue, void *buf, int max, uint32_t timeout);
+int os_pthread_queue_get_stats(os_pthread_queue_t *queue, os_queue_stats_t *stats, int *items, int reset);
+
+os_ring_queue_t * os_ring_queue_create(int length, size_t item_size, int type);
+int os_ring_queue_send(os_ring_queue_t *queue, void *value, uint32_t timeout);
+int os_ring_queue_send_front(os_ring_queue_t *queue, void *value, uint32_t timeout);
+int os_ring_queue_send_n(os_ring_queue_t *queue, void *values, int n, uint32_t timeout, int all);
+int os_ring_queue_receive(os_ring_queue_t *queue, void *buf, uint32_t timeout);
+int os_ring_queue_receive_n(os_ring_queue_t *queue, void *buf, int max, uint32_t timeout);
+int os_ring_queue_get_stats(os_ring_queue_t *queue, os_queue_stats_t *stats, int *items, int reset);
 
 #endif 
 
@@ -18,10 +18,260 @@
  */
 
 #include "osDelay.h"
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
 
-static portTick ticks_us;
-pthread_cond_t delay_cond = PTHREAD_COND_INITIALIZER;
-pthread_mutex_t tick_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define OS_CLOCK_STEP_US  (200)  ///< Clock thread period, real time [us]
+#define OS_CLOCK_WAKE_MAX (32)   ///< Max. expired waiters woken per step
+
+/* A thread waiting in osTaskClockWait */
+typedef struct os_clock_waiter {
+    pthread_cond_t *cond;
+    pthread_mutex_t *mutex;
+    uint64_t deadline;                  ///< Virtual deadline [us]
+    int timed;                          ///< 0 waits forever
+    int ready;                          ///< Woken, not counted as blocked
+    int woken;                          ///< Expired, already woken up
+    struct os_clock_waiter *next;
+} os_clock_waiter_t;
+
+/* Virtual clock. All fields are protected by tick_mutex, which is always
+ * taken after the mutex of a waiter, never before */
+static pthread_mutex_t tick_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t clock_us = 0;           ///< Virtual time since start [us]
+static struct timespec clock_base;      ///< Wall time at start
+static pthread_once_t clock_once = PTHREAD_ONCE_INIT;
+static os_clock_waiter_t *clock_waiters = NULL;
+static int clock_tasks = 0;             ///< Tasks created with osCreateTask
+static int clock_blocked = 0;           ///< Threads blocked in osTaskClockWait
+static unsigned clock_changes = 0;      ///< Blocked or woken up events
+static uint32_t clock_speed = 0;
+
+/* osDelay sleepers */
+static pthread_mutex_t delay_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t delay_cond;
+
+static void os_clock_init(void)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&delay_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    clock_gettime(CLOCK_REALTIME, &clock_base);
+}
+
+/* Broadcast the condition of the waiters whose deadline has passed. Called
+ * with tick_mutex locked, which is released to take the waiters mutexes */
+static void os_clock_wake_expired(void)
+{
+    pthread_cond_t *conds[OS_CLOCK_WAKE_MAX];
+    pthread_mutex_t *mutexes[OS_CLOCK_WAKE_MAX];
+    int i, n = 0;
+    os_clock_waiter_t *w;
+
+    for(w = clock_waiters; w != NULL && n < OS_CLOCK_WAKE_MAX; w = w->next)
+    {
+        if(w->timed && !w->woken && w->deadline <= clock_us)
+        {
+            w->woken = 1;
+            if(!w->ready)
+            {
+                w->ready = 1;
+                clock_blocked--;
+            }
+            conds[n] = w->cond;
+            mutexes[n] = w->mutex;
+            n++;
+        }
+    }
+    if(n == 0)
+        return;
+
+    clock_changes++;
+    pthread_mutex_unlock(&tick_mutex);
+    for(i = 0; i < n; i++)
+    {
+        // Taking the mutex means the waiter is already sleeping on cond
+        pthread_mutex_lock(mutexes[i]);
+        pthread_cond_broadcast(conds[i]);
+        pthread_mutex_unlock(mutexes[i]);
+    }
+    pthread_mutex_lock(&tick_mutex);
+}
+
+/* Earliest deadline of the blocked waiters, 0 if none */
+static uint64_t os_clock_next(void)
+{
+    uint64_t next = 0;
+    os_clock_waiter_t *w;
+    for(w = clock_waiters; w != NULL; w = w->next)
+        if(w->timed && !w->ready && (next == 0 || w->deadline < next))
+            next = w->deadline;
+    return next;
+}
+
+static void *os_clock_run(void *arg)
+{
+    struct timespec last, now;
+    unsigned seen = 0;
+    clock_gettime(CLOCK_MONOTONIC, &last);
+
+    pthread_mutex_lock(&tick_mutex);
+    while(1)
+    {
+        pthread_mutex_unlock(&tick_mutex);
+        usleep(OS_CLOCK_STEP_US);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t real_us = (uint64_t)(now.tv_sec - last.tv_sec)*1000000 + now.tv_nsec/1000 - last.tv_nsec/1000;
+        last = now;
+        pthread_mutex_lock(&tick_mutex);
+
+        // Tasks are running, follow the real time
+        clock_us += real_us*clock_speed;
+
+        // Every task waits and nothing changed since the last step, the
+        // next event is the earliest deadline
+        if(clock_tasks > 0 && clock_blocked >= clock_tasks && clock_changes == seen)
+        {
+            uint64_t next = os_clock_next();
+            if(next > clock_us)
+                clock_us = next;
+        }
+        os_clock_wake_expired();
+        seen = clock_changes;
+    }
+    return NULL;
+}
+
+/* Remove a waiter from the list, also if the thread is canceled */
+static void os_clock_leave(void *arg)
+{
+    os_clock_waiter_t *w = (os_clock_waiter_t *)arg;
+    os_clock_waiter_t **p;
+    pthread_mutex_lock(&tick_mutex);
+    for(p = &clock_waiters; *p != NULL; p = &(*p)->next)
+    {
+        if(*p == w)
+        {
+            *p = w->next;
+            break;
+        }
+    }
+    if(!w->ready)
+        clock_blocked--;
+    clock_changes++;
+    pthread_mutex_unlock(&tick_mutex);
+}
+
+int osTaskClockRun(uint32_t speed)
+{
+    pthread_t thread;
+    pthread_once(&clock_once, os_clock_init);
+    pthread_mutex_lock(&tick_mutex);
+    int running = clock_speed != 0;
+    clock_speed = speed;
+    pthread_mutex_unlock(&tick_mutex);
+    if(running || speed == 0)
+        return 0;
+    if(pthread_create(&thread, NULL, os_clock_run, NULL) != 0)
+        return -1;
+    pthread_detach(thread);
+    return 0;
+}
+
+int osTaskClockGettime(struct timespec *ts)
+{
+    pthread_once(&clock_once, os_clock_init);
+    pthread_mutex_lock(&tick_mutex);
+    uint64_t now = clock_us;
+    pthread_mutex_unlock(&tick_mutex);
+    uint64_t nsec = (uint64_t)clock_base.tv_nsec + (now%1000000)*1000;
+    ts->tv_sec = clock_base.tv_sec + (time_t)(now/1000000) + (time_t)(nsec/1000000000);
+    ts->tv_nsec = (long)(nsec%1000000000);
+    return 0;
+}
+
+int osTaskClockDeadline(struct timespec *ts, uint32_t timeout)
+{
+    if(timeout == portMAX_DELAY)
+    {
+        ts->tv_sec = -1;
+        ts->tv_nsec = 0;
+        return 0;
+    }
+    osTaskClockGettime(ts);
+    uint64_t nsec = (uint64_t)ts->tv_nsec + (uint64_t)(timeout%1000)*1000000;
+    ts->tv_sec += (time_t)(timeout/1000) + (time_t)(nsec/1000000000);
+    ts->tv_nsec = (long)(nsec%1000000000);
+    return 0;
+}
+
+int osTaskClockWait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *ts)
+{
+    os_clock_waiter_t w = {cond, mutex, 0, 0, 0, 0, NULL};
+    int rc = 0;
+
+    pthread_once(&clock_once, os_clock_init);
+    if(ts != NULL && ts->tv_sec >= 0)
+    {
+        int64_t sec = (int64_t)(ts->tv_sec - clock_base.tv_sec);
+        int64_t usec = sec*1000000 + ts->tv_nsec/1000 - clock_base.tv_nsec/1000;
+        w.deadline = usec > 0 ? (uint64_t)usec : 0;
+        w.timed = 1;
+    }
+
+    pthread_mutex_lock(&tick_mutex);
+    if(w.timed && w.deadline <= clock_us)
+    {
+        pthread_mutex_unlock(&tick_mutex);
+        return ETIMEDOUT;
+    }
+    w.next = clock_waiters;
+    clock_waiters = &w;
+    clock_blocked++;
+    clock_changes++;
+    pthread_mutex_unlock(&tick_mutex);
+
+    // Deadlines are virtual, the clock wakes us up when ours has passed
+    pthread_cleanup_push(os_clock_leave, &w);
+    pthread_cond_wait(cond, mutex);
+    pthread_cleanup_pop(1);
+
+    if(w.timed)
+    {
+        pthread_mutex_lock(&tick_mutex);
+        rc = w.deadline <= clock_us ? ETIMEDOUT : 0;
+        pthread_mutex_unlock(&tick_mutex);
+    }
+    return rc;
+}
+
+void osTaskClockWake(pthread_cond_t *cond)
+{
+    os_clock_waiter_t *w;
+    pthread_mutex_lock(&tick_mutex);
+    for(w = clock_waiters; w != NULL; w = w->next)
+    {
+        if(w->cond == cond && !w->ready)
+        {
+            w->ready = 1;
+            clock_blocked--;
+            clock_changes++;
+        }
+    }
+    pthread_mutex_unlock(&tick_mutex);
+    pthread_cond_broadcast(cond);
+}
+
+void osTaskClockAddTask(int n)
+{
+    pthread_mutex_lock(&tick_mutex);
+    clock_tasks += n;
+    clock_changes++;
+    pthread_mutex_unlock(&tick_mutex);
+}
 
 portTick osDefineTime(uint32_t mseconds)
 {
@@ -31,27 +281,31 @@ portTick osDefineTime(uint32_t mseconds)
 
 portTick osTaskGetTickCount(void)
 {
-    // Return current system ticks (us)
-    return (portTick)(ticks_us);
+    // Return current system ticks (us), the virtual time truncated
+    pthread_mutex_lock(&tick_mutex);
+    portTick ticks = (portTick)clock_us;
+    pthread_mutex_unlock(&tick_mutex);
+    return ticks;
 }
 
 void osTaskSetTickCount(portTick new_tick_us)
 {
-    // Set current tick (us) and signal the change to waiting threads
+    // Set current tick (us) and wake up the waiters whose deadline has passed
+    pthread_once(&clock_once, os_clock_init);
     pthread_mutex_lock(&tick_mutex);
-    ticks_us = new_tick_us;
-    pthread_cond_broadcast(&delay_cond);
+    clock_us = new_tick_us;
+    os_clock_wake_expired();
     pthread_mutex_unlock(&tick_mutex);
 }
 
 void osDelay(uint32_t mseconds)
 {
-    // Use the conditional variable to block the thread for the necessary ticks.
-    pthread_mutex_lock(&tick_mutex);
-    portTick max_ticks_us = mseconds*1000 + ticks_us;
-    while(ticks_us < max_ticks_us)
-        pthread_cond_wait(&delay_cond, &tick_mutex);
-    pthread_mutex_unlock(&tick_mutex);
+    // Block the thread until the virtual clock reaches the deadline
+    struct timespec ts;
+    osTaskClockDeadline(&ts, mseconds);
+    pthread_mutex_lock(&delay_mutex);
+    while(osTaskClockWait(&delay_cond, &delay_mutex, &ts) == 0);
+    pthread_mutex_unlock(&delay_mutex);
 }
 
 void osTaskDelayUntil(portTick *lastTime, uint32_t mseconds)
@@ -76,3 +330,66 @@ void osTaskDelayUntil(portTick *lastTime, uint32_t mseconds)
     // Tag last delay ticks
     *lastTime = osTaskGetTickCount();
 }
+
+static pthread_mutex_t os_periods_mutex = PTHREAD_MUTEX_INITIALIZER;
+static osPeriod *os_periods[OS_PERIOD_MAX];   ///< Registered periodic loops
+static int os_periods_len = 0;
+
+void osPeriodInit(osPeriod *period, const char *name, uint32_t mseconds)
+{
+    memset(period, 0, sizeof(osPeriod));
+    period->stats.name = name;
+    period->stats.period_ms = mseconds;
+    period->last = osTaskGetTickCount();
+    period->wake = period->last;
+
+    pthread_mutex_lock(&os_periods_mutex);
+    if(os_periods_len < OS_PERIOD_MAX)
+        os_periods[os_periods_len++] = period;
+    pthread_mutex_unlock(&os_periods_mutex);
+}
+
+void osPeriodDelay(osPeriod *period)
+{
+    osPeriodStats *stats = &period->stats;
+    if(period->reset)
+    {
+        memset(&stats->loops, 0, sizeof(osPeriodStats) - offsetof(osPeriodStats, loops));
+        period->reset = 0;
+    }
+
+    // Work of the loop that ends
+    portTick now = osTaskGetTickCount();
+    portTick due = period->last + osDefineTime(stats->period_ms);
+    uint32_t work_us = (uint32_t)(now - period->wake);
+    stats->loops++;
+    stats->work_last_us = work_us;
+    stats->work_sum_us += work_us;
+    if(work_us > stats->work_max_us)
+        stats->work_max_us = work_us;
+    if((int32_t)(now - due) > 0)
+        stats->overruns++;
+
+    osTaskDelayUntil(&period->last, stats->period_ms);
+
+    // Wake up lateness
+    period->wake = osTaskGetTickCount();
+    int32_t late = (int32_t)(period->wake - due);
+    if(late > 0 && (uint32_t)late > stats->late_max_us)
+        stats->late_max_us = (uint32_t)late;
+}
+
+void osPeriodSet(osPeriod *period, uint32_t mseconds)
+{
+    period->stats.period_ms = mseconds;
+}
+
+int osPeriodGetStats(int index, osPeriodStats *stats, int reset)
+{
+    if(index < 0 || index >= os_periods_len)
+        return -1;
+    *stats = os_periods[index]->stats;
+    if(reset)
+        os_periods[index]->reset = 1;
+    return 0;
+}
@@ -19,6 +19,7 @@
  */
 
 #include "osScheduler.h"
+#include "osDelay.h"
 
 const static char *tag = "osScheduler";
 
@@ -27,7 +28,13 @@ const static char *tag = "osScheduler";
  */
 void osScheduler(os_thread* threads_id, int n_threads)
 {
-    LOGI(tag, "Linux scheduler: waiting threads")
+    LOGI(tag, "Sim scheduler: waiting threads")
+
+#if SCH_OS_SIM_SPEED > 0
+    // Start the virtual clock, tasks created so far wait for it at time 0
+    if(osTaskClockRun(SCH_OS_SIM_SPEED) != 0)
+        LOGE(tag, "Unable to start the virtual clock");
+#endif
 
     int i;
     for(i = 0; i < n_threads; i++){
@@ -36,3 +43,8 @@ void osScheduler(os_thread* threads_id, int n_threads)
 
     exit(0);
 }
+
+void osYieldFromISR(int task_woken)
+{
+    // No interrupts in Linux, threads are scheduled by the kernel
+}
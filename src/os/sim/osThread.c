@@ -19,28 +19,188 @@
  */
 
 #include "osThread.h"
+#include "osDelay.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Tasks created with osCreateTask, for osTaskGetStack */
+static struct {
+    const char *name;
+    pthread_t thread;
+} os_tasks[OS_TASK_MAX];
+static int os_tasks_len = 0;
+static pthread_mutex_t os_tasks_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Task function and parameters, for os_task_run */
+typedef struct os_task_start {
+    void (*function)(void *);
+    void *parameters;
+} os_task_start_t;
+
+static void os_task_end(void *arg)
+{
+    osTaskClockAddTask(-1);
+}
+
+/* Run a task, counted by the virtual clock until it returns or is canceled */
+static void *os_task_run(void *arg)
+{
+    os_task_start_t start = *(os_task_start_t *)arg;
+    free(arg);
+    pthread_cleanup_push(os_task_end, NULL);
+    start.function(start.parameters);
+    pthread_cleanup_pop(1);
+    return NULL;
+}
 
 /**
  * create a task in Linux as thread
  */
 int osCreateTask(void (*functionTask)(void *), char* name, unsigned short size, void * parameters, unsigned int priority, os_thread* thread){
+    const osTaskProfile profile = {priority, OS_SCHED_FIFO, 0};
+    return osCreateTaskProfile(functionTask, name, size, parameters, &profile, thread);
+}
+
+int osCreateTaskProfile(void (*functionTask)(void *), char* name, unsigned short size, void * parameters, const osTaskProfile *profile, os_thread* thread){
 
     pthread_attr_t attr;
     pthread_attr_init(&attr);
     pthread_attr_setstacksize(&attr, size);
 
-    int created = pthread_create(thread , &attr , (void *)(*functionTask) , parameters);
+    os_task_start_t *start = malloc(sizeof(os_task_start_t));
+    if(start == NULL)
+    {
+        pthread_attr_destroy(&attr);
+        return -1;
+    }
+    start->function = functionTask;
+    start->parameters = parameters;
+
+    // Count the task before it runs, so the clock does not jump meanwhile
+    osTaskClockAddTask(1);
+    int created = pthread_create(thread , &attr , os_task_run , start);
+    pthread_attr_destroy(&attr);
+    if(created != 0)
+    {
+        osTaskClockAddTask(-1);
+        free(start);
+        return created;
+    }
+
     pthread_setname_np(*thread, name);
 
-    // Set Real Time scheduling and thread priority
+    pthread_mutex_lock(&os_tasks_mutex);
+    if(os_tasks_len < OS_TASK_MAX)
+    {
+        os_tasks[os_tasks_len].name = name;
+        os_tasks[os_tasks_len].thread = *thread;
+        os_tasks_len++;
+    }
+    pthread_mutex_unlock(&os_tasks_mutex);
+
+    // Set Real Time scheduling, thread priority and CPU affinity
     // Only with proper permissions
-    const struct sched_param _priority = {(int) priority};
-    if(pthread_setschedparam(*thread, SCHED_FIFO, &_priority) != 0)
-        printf("[WARN] (%s) Failed to assign task priority, try as root\n", name);
+    if(osTaskSetProfile(thread, profile) != 0)
+        printf("[WARN] (%s) Failed to assign task priority or affinity, try as root\n", name);
+
+    return created;
+}
+
+int osTaskSetProfile(os_thread *thread, const osTaskProfile *profile){
+    pthread_t th = thread != NULL ? *thread : pthread_self();
+    int rc = 0;
+
+    if(profile->cpus != 0)
+    {
+        cpu_set_t cpus;
+        int cpu;
+        CPU_ZERO(&cpus);
+        for(cpu=0; cpu<32; cpu++)
+            if(profile->cpus & (1U << cpu))
+                CPU_SET(cpu, &cpus);
+        if(pthread_setaffinity_np(th, sizeof(cpus), &cpus) != 0)
+            rc = -1;
+    }
+
+    int policy = profile->policy == OS_SCHED_RR ? SCHED_RR : SCHED_FIFO;
+    struct sched_param param = {(int) profile->priority};
+    if(profile->policy == OS_SCHED_OTHER)
+    {
+        policy = SCHED_OTHER;
+        param.sched_priority = 0;
+    }
+    if(pthread_setschedparam(th, policy, &param) != 0)
+        rc = -1;
+
+    return rc;
+}
+
+int osTaskLockMemory(void){
+    return mlockall(MCL_CURRENT | MCL_FUTURE) == 0 ? 0 : -1;
+}
+
+int osTaskGetStack(int index, osTaskStack *stack)
+{
+    pthread_mutex_lock(&os_tasks_mutex);
+    int ok = index >= 0 && index < os_tasks_len;
+    pthread_t thread = ok ? os_tasks[index].thread : 0;
+    const char *name = ok ? os_tasks[index].name : NULL;
+    pthread_mutex_unlock(&os_tasks_mutex);
+    if(!ok)
+        return -1;
 
+    pthread_attr_t attr;
+    void *addr;
+    size_t size;
+    if(pthread_getattr_np(thread, &attr) != 0)
+        return -1;
+    pthread_attr_getstack(&attr, &addr, &size);
     pthread_attr_destroy(&attr);
 
-    return created;
+    stack->name = name;
+    stack->size = (uint32_t)size;
+    stack->used_max = 0;
+
+    // The stack grows down from addr+size. Pages never touched are not
+    // resident, the first resident page holds the high-water mark
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t npages = size / page;
+    unsigned char *resident = malloc(npages);
+    if(resident == NULL || mincore(addr, npages*page, resident) != 0)
+    {
+        free(resident);
+        return -1;
+    }
+
+    size_t i;
+    for(i=0; i<npages && !(resident[i] & 1); i++);
+    if(i < npages)
+    {
+        volatile unsigned char *low = (unsigned char *)addr + i*page;
+        volatile unsigned char *top = (unsigned char *)addr + size;
+        while(low < top && *low == 0)
+            low++;
+        stack->used_max = (uint32_t)(top - low);
+    }
+    free(resident);
+    return 0;
+}
+
+int osTaskGetThread(int index, os_thread *thread, const char **name)
+{
+    pthread_mutex_lock(&os_tasks_mutex);
+    int ok = index >= 0 && index < os_tasks_len;
+    if(ok)
+    {
+        *thread = os_tasks[index].thread;
+        if(name != NULL)
+            *name = os_tasks[index].name;
+    }
+    pthread_mutex_unlock(&os_tasks_mutex);
+    return ok ? 0 : -1;
 }
 
 void osTaskDelete(void *task_handle)
@@ -51,6 +211,19 @@ void osTaskDelete(void *task_handle)
     else
         thread = *(pthread_t *)task_handle;
 
+    // Stop listing it in osTaskGetStack
+    int i;
+    pthread_mutex_lock(&os_tasks_mutex);
+    for(i=0; i<os_tasks_len; i++)
+    {
+        if(pthread_equal(os_tasks[i].thread, thread))
+        {
+            os_tasks[i] = os_tasks[--os_tasks_len];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&os_tasks_mutex);
+
     printf("[INFO] Canceling thread %lu\n", thread);
     int s = pthread_cancel(thread);
     if (s != 0) printf("[WARN] Failed to cancel thread %lu\n", thread);
@@ -0,0 +1,157 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "bootSeq.h"
+#ifdef LINUX
+#include <pthread.h>
+#include <time.h>
+#endif
+
+static const char *tag = "boot";
+
+/**
+ * Boot step record, for the boot times report
+ */
+typedef struct boot_record {
+    const boot_step_t *step;    ///< Step run
+    uint32_t start_us;          ///< Start time since boot
+    uint32_t time_us;           ///< Step duration
+    int rc;                     ///< Step return code
+} boot_record_t;
+
+static boot_record_t boot_records[BOOT_MAX_STEPS];
+static int boot_n_records = 0;
+
+uint32_t boot_time_us(void)
+{
+    static uint64_t base = 0;
+    static int base_ok = 0;
+#ifdef LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec*1000000ULL + (uint64_t)ts.tv_nsec/1000ULL;
+#else
+    uint64_t now = (uint64_t)osTaskGetTickCount()*1000000ULL/osDefineTime(1000);
+#endif
+    if(!base_ok)
+    {
+        base = now;
+        base_ok = 1;
+    }
+    return (uint32_t)(now - base);
+}
+
+/**
+ * Run a step and fill its record. Has the thread function signature.
+ */
+static void *_boot_step_worker(void *param)
+{
+    boot_record_t *record = (boot_record_t *)param;
+    record->start_us = boot_time_us();
+    record->rc = record->step->init != NULL ? record->step->init() : 0;
+    record->time_us = boot_time_us() - record->start_us;
+    if(record->rc != 0)
+        LOGE(tag, "Boot step %s failed (%d)", record->step->name, record->rc);
+    return NULL;
+}
+
+/**
+ * Get a record for a new step. Steps beyond BOOT_MAX_STEPS still run, with
+ * the @spare record, but are not reported
+ */
+static boot_record_t *_boot_new_record(const boot_step_t *step, boot_record_t *spare)
+{
+    boot_record_t *record = boot_n_records < BOOT_MAX_STEPS ? &boot_records[boot_n_records++] : spare;
+    memset(record, 0, sizeof(boot_record_t));
+    record->step = step;
+    return record;
+}
+
+int boot_run(const boot_step_t *steps, int n)
+{
+    if(n < 0 || n > 32)
+        return -1;
+
+    uint32_t all = n == 32 ? 0xFFFFFFFFU : (1U<<n)-1;
+    uint32_t done = 0;
+    int i, errors = 0;
+    boot_time_us();
+
+    while(done != all)
+    {
+        // Steps whose dependencies are done
+        boot_record_t *wave[32];
+        boot_record_t spare[32];
+        uint32_t wave_mask = 0;
+        int n_wave = 0;
+        for(i=0; i<n; i++)
+        {
+            if(!(done & BOOT_DEP(i)) && (steps[i].deps & ~done & all) == 0)
+            {
+                wave[n_wave] = _boot_new_record(&steps[i], &spare[n_wave]);
+                n_wave++;
+                wave_mask |= BOOT_DEP(i);
+            }
+        }
+        if(n_wave == 0)
+        {
+            LOGE(tag, "Boot steps dependencies can not be satisfied (done: 0x%X)", done);
+            return -1;
+        }
+
+#if defined(LINUX) && SCH_BOOT_PARALLEL
+        // The caller runs the first step, steps without a thread too
+        pthread_t threads[32];
+        int started[32];
+        for(i=1; i<n_wave; i++)
+            started[i] = pthread_create(&threads[i], NULL, _boot_step_worker, wave[i]) == 0;
+        _boot_step_worker(wave[0]);
+        for(i=1; i<n_wave; i++)
+        {
+            if(started[i])
+                pthread_join(threads[i], NULL);
+            else
+                _boot_step_worker(wave[i]);
+        }
+#else
+        for(i=0; i<n_wave; i++)
+            _boot_step_worker(wave[i]);
+#endif
+
+        for(i=0; i<n_wave; i++)
+            errors += wave[i]->rc != 0;
+        done |= wave_mask;
+    }
+    return errors;
+}
+
+void boot_print_times(void)
+{
+    int i;
+    LOGR(tag, "Boot times (ms):");
+    LOGR(tag, "%-16s %10s %10s %4s", "step", "start", "time", "rc");
+    for(i=0; i<boot_n_records; i++)
+    {
+        boot_record_t *record = &boot_records[i];
+        LOGR(tag, "%-16s %10.3f %10.3f %4d", record->step->name, record->start_us/1000.0,
+             record->time_us/1000.0, record->rc);
+    }
+    LOGR(tag, "%-16s %10s %10.3f", "total", "", boot_time_us()/1000.0);
+}
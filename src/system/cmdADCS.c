@@ -22,14 +22,34 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_TAG_ID LOG_TAG_ADCS
 #include "cmdADCS.h"
+#include "taskADCS.h"
+#ifdef LINUX
+#include <pthread.h>
+#endif
 
 static const char* tag = "cmdADCS";
 
 #define ADCS_PORT 7
 
+static adcs_ctrl_t adcs_cmd_ctrl;   ///< Controller context of the control commands
+
+/**
+ * ADCS state block, kept in memory at full precision. The status variables
+ * are only a telemetry mirror (@see adcs_state_publish). The sequence is odd
+ * while the block is written, readers retry if it changed while they copied
+ * the block. While it is 0 the block was never stored and loads read the
+ * status variables.
+ */
+static adcs_state_t adcs_block;
+static volatile uint32_t adcs_block_seq = 0;
+static osSemaphore adcs_block_sem;      ///< Serializes the block writers
+static int adcs_block_sem_ok = 0;
+
 void cmd_adcs_init(void)
 {
+    adcs_block_sem_ok = osSemaphoreCreate(&adcs_block_sem) == OS_SEMAPHORE_OK;
 //    cmd_add("adcs_point", adcs_point, "", 0);
     cmd_add("adcs_quat", adcs_get_quaternion, "", 0);
     cmd_add("adcs_omega", adcs_get_omega, "", 0);
@@ -40,20 +60,24 @@ void cmd_adcs_init(void)
     cmd_add("adcs_set_to_nadir", adcs_target_nadir, "", 0);
     cmd_add("adcs_detumbling_mag", adcs_detumbling_mag, "", 0);
     cmd_add("adcs_send_attitude", adcs_send_attitude, "", 0);
+    cmd_add("adcs_sun", adcs_sun, "", 0);
+    cmd_add("adcs_env_range", adcs_env_range_cmd, "%d %d %d", 3);
+    cmd_set_class("adcs_env_range", CMD_CLASS_CPU);
+    cmd_set_shed("adcs_send_attitude", CMD_LOAD_HIGH);
 }
 
 int adcs_point(char* fmt, char* params, int nparams)
 {
-    csp_packet_t *packet = csp_buffer_get(COM_FRAME_MAX_LEN);
+    csp_packet_t *packet = com_buffer_get(COM_FRAME_MAX_LEN, 0);
     if(packet == NULL)
         return CMD_SYNTAX_ERROR;
     memset(packet->data, 0, COM_FRAME_MAX_LEN);
 
-    vector3_t r;
-    _get_sat_vector(&r, dat_ads_pos_x);
+    adcs_state_t st;
+    adcs_state_load(&st);
 
     int len = snprintf(packet->data, COM_FRAME_MAX_LEN,
-                       "adcs_point_to %lf %lf %lf", r.v0, r.v1, r.v2);
+                       "adcs_point_to %lf %lf %lf", st.pos_i.v0, st.pos_i.v1, st.pos_i.v2);
     packet->length = len;
     LOGI(tag, "ADCS CMD: (%d) %s", packet->length, packet->data);
 
@@ -69,348 +93,359 @@ int adcs_point(char* fmt, char* params, int nparams)
     return CMD_OK;
 }
 
-int adcs_get_quaternion(char* fmt, char* params, int nparams)
+/**
+ * Load the ADCS state from the status variables, used until the state block
+ * is stored for the first time
+ */
+static void _adcs_state_restore(adcs_state_t *st)
 {
-    char *out_buff = (char *)malloc(COM_FRAME_MAX_LEN);
-    char *in_buff = (char *)malloc(COM_FRAME_MAX_LEN);
-    memset(out_buff, 0, COM_FRAME_MAX_LEN);
-    memset(in_buff, 0, COM_FRAME_MAX_LEN);
-
-    int len = snprintf(out_buff, COM_FRAME_MAX_LEN, "adcs_get_quaternion 0");
-    int rc = csp_transaction(CSP_PRIO_NORM, ADCS_PORT, SCH_TRX_PORT_CMD, 100,
-                             out_buff, COM_FRAME_MAX_LEN, in_buff, COM_FRAME_MAX_LEN);
+    // Vars from dat_ads_omega_x to dat_tgt_q3 are consecutive
+    value32_t v[dat_tgt_q3-dat_ads_omega_x+1];
+    dat_get_status_vars(dat_ads_omega_x, dat_tgt_q3-dat_ads_omega_x+1, v);
+    int i;
+    memset(st, 0, sizeof(adcs_state_t));
+    for(i=0; i<3; i++)
+    {
+        st->omega_est.v[i] = (real_t)v[dat_ads_omega_x-dat_ads_omega_x+i].f;
+        st->omega_tgt.v[i] = (real_t)v[dat_tgt_omega_x-dat_ads_omega_x+i].f;
+        st->mag_est.v[i] = (real_t)v[dat_ads_mag_x-dat_ads_omega_x+i].f;
+        st->pos_i.v[i] = (real_t)v[dat_ads_pos_x-dat_ads_omega_x+i].f;
+    }
+    for(i=0; i<4; i++)
+    {
+        st->q_est.q[i] = (real_t)v[dat_ads_q0-dat_ads_omega_x+i].f;
+        st->q_tgt.q[i] = (real_t)v[dat_tgt_q0-dat_ads_omega_x+i].f;
+    }
+    st->tle_last = v[dat_ads_tle_last-dat_ads_omega_x].i;
+}
 
-    if(rc == COM_FRAME_MAX_LEN)
+void adcs_state_load(adcs_state_t *st)
+{
+    uint32_t seq;
+    do
     {
-        LOGI(tag, "QUAT: %s", in_buff);
-        quaternion_t q;
-        rc = sscanf(in_buff, "%lf %lf %lf %lf", &q.q0, &q.q1, &q.q2, &q.q3);
-        if(rc == 4)
-        {
-            _set_sat_quaterion(&q, dat_ads_q0);
-            quaternion_t tmp;
-            _get_sat_quaterion(&tmp, dat_ads_q0);
-            LOGI(tag, "SAT_QUAT: %.04f, %.04f, %.04f, %.04f", tmp.q0, tmp.q1, tmp.q2, tmp.q3);
-            free(out_buff);
-            free(in_buff);
-            return CMD_OK;
-        }
-        LOGE(tag, "Error reading values!")
+        seq = adcs_block_seq;
+        __sync_synchronize();
+        *st = adcs_block;
+        __sync_synchronize();
     }
-    LOGE(tag, "csp_transaction failed! (%d)", rc);
+    while((seq & 1U) || seq != adcs_block_seq);
 
-    free(out_buff);
-    free(in_buff);
-    return CMD_SYNTAX_ERROR;
+    if(seq == 0)
+        _adcs_state_restore(st);
+    st->mode = dat_get_system_var(dat_obc_opmode);
 }
 
-int adcs_get_omega(char* fmt, char* params, int nparams)
+void adcs_state_store(const adcs_state_t *st)
 {
-#ifdef NANOMIND
-    int result;
-    gs_mpu3300_gyro_t gyro_reading;
-    result = gs_mpu3300_read_gyro(&gyro_reading);
+    if(adcs_block_sem_ok)
+        osSemaphoreTake(&adcs_block_sem, portMAX_DELAY);
+    adcs_block_seq++;
+    __sync_synchronize();
+    adcs_block = *st;
+    __sync_synchronize();
+    adcs_block_seq++;
+    if(adcs_block_sem_ok)
+        osSemaphoreGiven(&adcs_block_sem);
+}
 
-    if(result == 0)
+void adcs_state_publish(const adcs_state_t *st)
+{
+    // Two writes, dat_ads_tle_epoch in between belongs to obc_update_tle
+    value32_t v[dat_tgt_q3-dat_ads_omega_x+1];
+    int i;
+    for(i=0; i<3; i++)
     {
-        vector3_t omega;
-        omega.v0 = gyro_reading.gyro_x;
-        omega.v1 = gyro_reading.gyro_y;
-        omega.v2 = gyro_reading.gyro_z;
-        _set_sat_vector(&omega, dat_ads_omega_x);
-        return CMD_OK;
+        v[dat_ads_omega_x-dat_ads_omega_x+i].f = (float)st->omega_est.v[i];
+        v[dat_tgt_omega_x-dat_ads_omega_x+i].f = (float)st->omega_tgt.v[i];
+        v[dat_ads_mag_x-dat_ads_omega_x+i].f = (float)st->mag_est.v[i];
+        v[dat_ads_pos_x-dat_ads_omega_x+i].f = (float)st->pos_i.v[i];
     }
-    return CMD_ERROR;
-#endif
-    return CMD_OK;
+    for(i=0; i<4; i++)
+    {
+        v[dat_ads_q0-dat_ads_omega_x+i].f = (float)st->q_est.q[i];
+        v[dat_tgt_q0-dat_ads_omega_x+i].f = (float)st->q_tgt.q[i];
+    }
+    v[dat_ads_tle_last-dat_ads_omega_x].i = st->tle_last;
+    dat_set_status_vars(dat_ads_omega_x, dat_ads_pos_z-dat_ads_omega_x+1, v);
+    dat_set_status_vars(dat_ads_tle_last, dat_tgt_q3-dat_ads_tle_last+1, &v[dat_ads_tle_last-dat_ads_omega_x]);
 }
 
-int adcs_get_mag(char* fmt, char* params, int nparams)
+double calc_sun_pos_i(double jd, vector3_t * sun_dir)
 {
-#ifdef NANOMIND
-    gs_error_t result;
-    gs_hmc5843_data_t hmc_reading;
-    result = gs_hmc5843_read_single(&hmc_reading);
+    // all in degree
+    double au = 149597870.691;
+    double n = jd - 2451545.0;
+    double l = (280.459 + 0.98564736 * n); //% 360
+    double m = (357.529 + 0.98560023 * n); //% 360.0
+    m *= M_PI/180.0;
+    double lam = (l + 1.915 * sin(m) + 0.0200 * sin(2 * m)); // % 360.0
+    lam *= M_PI/180.0;
+    double e = 23.439 - 3.56e-7 * n;
+    e *= M_PI/180.0;
+
+    sun_dir->v0 = cos(lam);
+    sun_dir->v1 = cos(e) * sin(lam);
+    sun_dir->v2 = sin(lam) * sin(e);
+    return (1.00014 - 0.01671 * cos(m) - 0.000140 * cos(2 * m)) * au;
+}
 
-    if(result == GS_OK)
+int adcs_sun_update(adcs_sun_t *sun, int ts, const vector3_t *pos_i)
+{
+    const double r_earth = 6378.137;    // km
+    const double r_sol = 696000.0;      // km
+
+    if(sun->eph_time == 0 || abs(ts - sun->eph_time) >= SCH_ADCS_SUN_EPH_S)
     {
-        vector3_t mag;
-        mag.v0 = hmc_reading.x;
-        mag.v1 = hmc_reading.y;
-        mag.v2 = hmc_reading.z;
-        _set_sat_vector(&mag, dat_ads_mag_x);
-        return CMD_OK;
+        sun->r_sun = calc_sun_pos_i(ts/86400.0 + 2440587.5, &sun->sun_i);
+        sun->eph_time = ts;
     }
-    return CMD_ERROR;
-#endif
-    return CMD_OK;
+
+    // Apparent radius of the sun (a) and the Earth (b) and their separation (c)
+    double r = sqrt(pos_i->v0*pos_i->v0 + pos_i->v1*pos_i->v1 + pos_i->v2*pos_i->v2);
+    if(!(r > r_earth))
+        return -1;
+    double d[3] = {sun->r_sun*sun->sun_i.v0 - pos_i->v0,
+                   sun->r_sun*sun->sun_i.v1 - pos_i->v1,
+                   sun->r_sun*sun->sun_i.v2 - pos_i->v2};
+    double s = sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+    double a = asin(r_sol/s);
+    double b = asin(r_earth/r);
+    double cos_c = -(pos_i->v0*d[0] + pos_i->v1*d[1] + pos_i->v2*d[2])/(r*s);
+    double c = acos(cos_c > 1.0 ? 1.0 : (cos_c < -1.0 ? -1.0 : cos_c));
+
+    if(c >= a + b)
+    {
+        sun->eclipse = ADCS_SUNLIT;
+        sun->sunlit = REAL(1.0);
+    }
+    else if(c <= b - a)
+    {
+        sun->eclipse = ADCS_UMBRA;
+        sun->sunlit = REAL(0.0);
+    }
+    else
+    {
+        // Area of the solar disk covered by the Earth disk
+        double x = (c*c + a*a - b*b)/(2*c);
+        double y = sqrt(fmax(a*a - x*x, 0.0));
+        double area = a*a*acos(fmax(-1.0, fmin(1.0, x/a))) + b*b*acos(fmax(-1.0, fmin(1.0, (c-x)/b))) - c*y;
+        sun->eclipse = ADCS_PENUMBRA;
+        sun->sunlit = (real_t)(1.0 - area/(M_PI*a*a));
+    }
+    return 0;
 }
 
-int adcs_control_torque(char* fmt, char* params, int nparams)
+void adcs_sun_publish(const adcs_sun_t *sun)
 {
-    // GLOBALS
-    double ctrl_cycle;
-    matrix3_t I_quat;
-    mat_set_diag(&I_quat, 0.00, 0.00, 0.00);
-    matrix3_t P_quat;
-    mat_set_diag(&P_quat, 0.001, 0.001, 0.001);
-    matrix3_t P_omega;
-    mat_set_diag(&P_omega, 0.003, 0.003, 0.003);
-
-    if(params == NULL || sscanf(params, fmt, &ctrl_cycle) != nparams)
-        return CMD_SYNTAX_ERROR;
-
-    // PARAMETERS
-    quaternion_t q_i2b_est; // Current quaternion. Read as from ADCS
-    quaternion_t q_i2b_tar; // Target quaternion. Read as parameter
-    _get_sat_quaterion(&q_i2b_est, dat_ads_q0);
-    _get_sat_quaterion(&q_i2b_tar, dat_tgt_q0);
-    vector3_t omega_b_est;  // Current GYRO. Read from ADCS
-    _get_sat_vector(&omega_b_est, dat_ads_omega_x);
-    vector3_t omega_b_tar;
-    _get_sat_vector(&omega_b_tar, dat_tgt_omega_x);
+    value32_t v[dat_ads_sunlit-dat_ads_sun_x+1];
+    v[0].f = (float)sun->sun_i.v0;
+    v[1].f = (float)sun->sun_i.v1;
+    v[2].f = (float)sun->sun_i.v2;
+    v[dat_ads_eclipse-dat_ads_sun_x].u = (uint32_t)sun->eclipse;
+    v[dat_ads_sunlit-dat_ads_sun_x].f = (float)sun->sunlit;
+    dat_set_status_vars(dat_ads_sun_x, dat_ads_sunlit-dat_ads_sun_x+1, v);
+}
 
-//    libra::Quaternion q_b2i_est = q_i2b_est_.conjugate(); //body frame to inertial frame
-//    libra::Quaternion q_i2b_now2tar = q_b2i_est * q_i2b_tar_;//q_i2b_tar_ = qi2b_est * qi2b_now2tar：クオータニオンによる2回転は積であらわされる。
-//    q_i2b_now2tar.normalize();
-    quaternion_t q_b2i_est;
-    quat_conjugate(&q_i2b_est, &q_b2i_est);
-    quaternion_t q_i2b_now2tar;
-    quat_mult(&q_b2i_est, &q_i2b_tar, &q_i2b_now2tar);
-    quat_normalize(&q_i2b_now2tar, NULL);
-
-//    Vector<3> TorqueDirection;
-//    TorqueDirection[0] = q_i2b_now2tar[0];
-//    TorqueDirection[1] = q_i2b_now2tar[1];
-//    TorqueDirection[2] = q_i2b_now2tar[2];
-//    TorqueDirection = normalize(TorqueDirection);//q1,q2,q3を標準化している。つまり、p=(l,m,n)Tを求めている。
-    vector3_t torq_dir;
-    memcpy(torq_dir.v, q_i2b_now2tar.vec, sizeof(vector3_t));
-    assert(torq_dir.v0 == q_i2b_now2tar.q0 && torq_dir.v1 == q_i2b_now2tar.q1 && torq_dir.v2 == q_i2b_now2tar.q2);
-    vec_normalize(&torq_dir, NULL);
-
-//    double AttitudeRotation = 2 * acos(q_i2b_now2tar[3]) * 180 / M_PI; //回転角θ。q_i2b_now2tar[3]は授業ではq0として扱った。
-//    error_integral = ctrl_cycle_ * AttitudeRotation * TorqueDirection;
-    double att_rot = 2*acos(q_i2b_now2tar.q[3]);
-    vector3_t error_integral;
-    vec_cons_mult(att_rot*ctrl_cycle, &torq_dir, &error_integral);
-
-//    Vector<3> ControlTorque = (P_quat_ * (AttitudeRotation * TorqueDirection)) + (I_quat_ * error_integral) + (P_omega_ * (omega_b_tar_ - omega_b_est_));
-    vector3_t torque_rot;
-    vec_cons_mult(att_rot, &torq_dir, &torque_rot); //(AttitudeRotation * TorqueDirection)
-    vector3_t P;
-    mat_vec_mult(P_quat, torque_rot, &P);  //P_quat_ * (AttitudeRotation * TorqueDirection)
-    vector3_t I;
-    mat_vec_mult(I_quat, error_integral, &I); //I_quat_ * error_integral
-    vector3_t omega_b;
-    vector3_t P_o;
-    vec_cons_mult(-1.0, &omega_b_est, NULL);
-    vec_sum(omega_b_tar, omega_b_est, &omega_b);
-    mat_vec_mult(P_omega, omega_b, &P_o); //P_omega_ * (omega_b_tar_ - omega_b_est_);
-
-    vector3_t control_torque_tmp, control_torque;
-    vec_sum(P, I, &control_torque_tmp);
-    vec_sum(P_o, control_torque_tmp, &control_torque);
-
-    LOGI(tag, "CTRL_TORQUE: %f, %f, %f", control_torque.v0, control_torque.v1, control_torque.v2);
-
-    csp_packet_t *packet = csp_buffer_get(COM_FRAME_MAX_LEN);
-    if(packet == NULL)
-        return CMD_ERROR;
+int adcs_env_array_alloc(adcs_env_array_t *env, int n)
+{
+    memset(env, 0, sizeof(adcs_env_array_t));
+    if(n <= 0)
+        return -1;
+    // Doubles first, then the ints, keeps every array aligned
+    size_t nd = (size_t)n*sizeof(double), ni = (size_t)n*sizeof(int);
+    uint8_t *block = malloc(9*nd + ni);
+    if(block == NULL)
+        return -1;
+    env->lat = (double *)block;
+    env->lon = (double *)(block + nd);
+    env->alt = (double *)(block + 2*nd);
+    env->mag_n = (double *)(block + 3*nd);
+    env->mag_e = (double *)(block + 4*nd);
+    env->mag_d = (double *)(block + 5*nd);
+    env->sun_x = (double *)(block + 6*nd);
+    env->sun_y = (double *)(block + 7*nd);
+    env->sun_z = (double *)(block + 8*nd);
+    env->ts = (int *)(block + 9*nd);
+    env->n = n;
+    return 0;
+}
 
-    int len = snprintf(packet->data, COM_FRAME_MAX_LEN,
-                       "adcs_set_torque %.06f %.06f %.06f",
-                       control_torque.v0, control_torque.v1, control_torque.v2);
-    packet->length = len;
-    LOGI(tag, "ADCS CMD: (%d) %s", packet->length, packet->data);
+void adcs_env_array_free(adcs_env_array_t *env)
+{
+    free(env->lat);
+    memset(env, 0, sizeof(adcs_env_array_t));
+}
 
-    int rc = csp_sendto(CSP_PRIO_NORM, ADCS_PORT, SCH_TRX_PORT_CMD,
-                        SCH_TRX_PORT_CMD, CSP_O_NONE, packet, 100);
+/**
+ * adcs_env_range work, a slice of the points
+ */
+typedef struct adcs_env_job {
+    adcs_env_array_t *env;  ///< Points
+    int first;              ///< First point
+    int last;               ///< Last point (not included)
+} adcs_env_job_t;
 
-    if(rc != 0)
+static void *_adcs_env_worker(void *arg)
+{
+    adcs_env_job_t *job = (adcs_env_job_t *)arg;
+    adcs_env_array_t *env = job->env;
+    igrf_model_t model;
+    double mag[3];
+    vector3_t sun;
+    int i;
+
+    igrf_model_init(&model);
+    for(i=job->first; i<job->last; i++)
     {
-        csp_buffer_free((void *)packet);
-        return CMD_ERROR;
+        double jd = unixt_to_jd((uint32_t)env->ts[i]);
+        igrf_model_update(&model, jd_to_dec(jd));
+        igrf_model_field(&model, env->lat[i], env->lon[i], env->alt[i], mag);
+        env->mag_n[i] = mag[0]; env->mag_e[i] = mag[1]; env->mag_d[i] = mag[2];
+        calc_sun_pos_i(jd, &sun);
+        env->sun_x[i] = sun.v0; env->sun_y[i] = sun.v1; env->sun_z[i] = sun.v2;
     }
-
-    return CMD_OK;
+    return NULL;
 }
 
-int adcs_mag_moment(char* fmt, char* params, int nparams)
+void adcs_env_range(adcs_env_array_t *env)
 {
-    // GLOBALS
-    vector3_t rw_lower_limit;
-    rw_lower_limit.v[0] = 0.0;
-    rw_lower_limit.v[1] = 0.0;
-    rw_lower_limit.v[2] = 0.0;
-    vector3_t select_mag_dir_torque;
-    select_mag_dir_torque.v[0] = 1.0;
-    select_mag_dir_torque.v[1] = 1.0;
-    select_mag_dir_torque.v[2] = 1.0;
-    vector3_t max_mag_am2;
-    max_mag_am2.v[0] = 0.35;
-    max_mag_am2.v[1] = 0.35;
-    max_mag_am2.v[2] = 0.35;
-    matrix3_t I_c;
-    mat_set_diag(&I_c, 0.035, 0.035, 0.007);
-    double nT2T = 1.0e-9;
-
-    // PARAMETERS
-    vector3_t mag_earth_b_est;
-    _get_sat_vector(&mag_earth_b_est, dat_ads_mag_x);
-    vector3_t omega_b_est;  // Current GYRO. Read from ADCS
-    _get_sat_vector(&omega_b_est, dat_ads_omega_x);
-    vector3_t omega_b_tar;
-    _get_sat_vector(&omega_b_tar, dat_tgt_omega_x);
+    adcs_env_job_t jobs[SCH_ADCS_ENV_THREADS];
+    int nthreads = SCH_ADCS_ENV_THREADS;
+    int i;
+    if(nthreads > env->n)
+        nthreads = env->n > 0 ? env->n : 1;
 
-    select_mag_dir_torque.v[0] = fabs(omega_b_est.v[0]) < rw_lower_limit.v[0];
-    select_mag_dir_torque.v[1] = fabs(omega_b_est.v[1]) < rw_lower_limit.v[1];
-    select_mag_dir_torque.v[2] = fabs(omega_b_est.v[2]) < rw_lower_limit.v[2];
-    int mode = dat_get_system_var(dat_obc_opmode);
-    if (mode == DAT_OBC_OPMODE_DETUMB_MAG)
+    for(i=0; i<nthreads; i++)
     {
-        select_mag_dir_torque.v[0] = 1.0;
-        select_mag_dir_torque.v[1] = 1.0;
-        select_mag_dir_torque.v[2] = 1.0;
+        jobs[i].env = env;
+        jobs[i].first = (int)((long)env->n*i/nthreads);
+        jobs[i].last = (int)((long)env->n*(i+1)/nthreads);
     }
-    vec_cons_mult(-1.0, &omega_b_tar, NULL);
-    vector3_t error_angular_vel;
-    vec_sum(omega_b_est, omega_b_tar, &error_angular_vel); //dw = w_b_est - w_b_tar
-    vector3_t control_torque;
-    vec_cons_mult(-1.0, &error_angular_vel, NULL);
-    mat_vec_mult(I_c, error_angular_vel, &control_torque); //t = -I * dw
-    double inv_norm_torque = 1.0;
-    double norm_torque = vec_norm(control_torque);
-    if (norm_torque >= pow(10.0, -9.0))
+
+#ifdef LINUX
+    // The caller evaluates the first slice, slices without a thread too
+    pthread_t threads[SCH_ADCS_ENV_THREADS];
+    int started[SCH_ADCS_ENV_THREADS];
+    for(i=1; i<nthreads; i++)
+        started[i] = pthread_create(&threads[i], NULL, _adcs_env_worker, &jobs[i]) == 0;
+    _adcs_env_worker(&jobs[0]);
+    for(i=1; i<nthreads; i++)
     {
-        inv_norm_torque = 1.0 / norm_torque;
+        if(started[i])
+            pthread_join(threads[i], NULL);
+        else
+            _adcs_env_worker(&jobs[i]);
     }
-    vec_cons_mult(inv_norm_torque, &control_torque, NULL); //t = t/||t|| = -I*dw / ||I*dw||
-
-    vector3_t nT2T_mag_earth_b_est;
-    vec_cons_mult(nT2T, &mag_earth_b_est, &nT2T_mag_earth_b_est);
-    vector3_t max_torque;
-    //bellow method should be named cross product
-    vec_outer_product(max_mag_am2, nT2T_mag_earth_b_est, &max_torque);// t_max = m_max x B_est
-    control_torque.v[0] *= select_mag_dir_torque.v[0] * fabs(max_torque.v[0]);//tx = tx*dirx*|t_max_x|
-    control_torque.v[1] *= select_mag_dir_torque.v[1] * fabs(max_torque.v[1]);
-    control_torque.v[2] *= select_mag_dir_torque.v[2] * fabs(max_torque.v[2]);
-
-    double inv_b_norm2 = 1.0 / pow(nT2T * vec_norm(mag_earth_b_est), 2.0);//=1/||B_est||**2
-    vector3_t control_mag_moment_temp, control_mag_moment;
-    vec_outer_product(nT2T_mag_earth_b_est, control_torque, &control_mag_moment_temp);//mc* = Bxt
-    vec_cons_mult(inv_b_norm2, &control_mag_moment_temp, &control_mag_moment); //mc =  Bxt / ||B_est||**2
+#else
+    for(i=0; i<nthreads; i++)
+        _adcs_env_worker(&jobs[i]);
+#endif
+}
 
-    LOGI(tag, "CTRL_MAG_MOMENT: %f, %f, %f", control_mag_moment.v0, control_mag_moment.v1, control_mag_moment.v2);
+int adcs_read_quaternion(quaternion_t *q)
+{
+    char out_buff[COM_FRAME_MAX_LEN];
+    char in_buff[COM_FRAME_MAX_LEN];
+    memset(out_buff, 0, COM_FRAME_MAX_LEN);
+    memset(in_buff, 0, COM_FRAME_MAX_LEN);
 
-    csp_packet_t *packet = csp_buffer_get(COM_FRAME_MAX_LEN);
-    if(packet == NULL)
-        return CMD_ERROR;
+    snprintf(out_buff, COM_FRAME_MAX_LEN, "adcs_get_quaternion 0");
+    int rc = csp_transaction(CSP_PRIO_NORM, ADCS_PORT, SCH_TRX_PORT_CMD, 100,
+                             out_buff, COM_FRAME_MAX_LEN, in_buff, COM_FRAME_MAX_LEN);
 
-    int len = snprintf(packet->data, COM_FRAME_MAX_LEN,
-                       "adcs_set_mag_moment %.06f %.06f %.06f",
-                       control_mag_moment.v0, control_mag_moment.v1, control_mag_moment.v2);
-    //Calc PWM duty cycle from magnetic moment
-    uint8_t mtq_duty[3];
-    //Todo: calc based on model
-    double magMoment_control_norm = vec_norm(control_mag_moment);
-    vector3_t magMoment_control_unit;
-    if (magMoment_control_norm >= pow(10.0, -9.0))
-    {
-        vec_cons_mult(100.0 / magMoment_control_norm, &magMoment_control_unit, NULL); //m_hat = m/||m||
-    } else
+    if(rc == COM_FRAME_MAX_LEN)
     {
-        magMoment_control_unit.v[0] = 0.0;
-        magMoment_control_unit.v[1] = 0.0;
-        magMoment_control_unit.v[2] = 0.0;
+        LOGD(tag, "QUAT: %s", in_buff);
+        double tmp[4];
+        rc = sscanf(in_buff, "%lf %lf %lf %lf", &tmp[0], &tmp[1], &tmp[2], &tmp[3]);
+        if(rc == 4)
+        {
+            q->q0 = tmp[0]; q->q1 = tmp[1]; q->q2 = tmp[2]; q->q3 = tmp[3];
+            return 0;
+        }
+        LOGE(tag, "Error reading values!")
+        return -1;
     }
-    mtq_duty[0] = (uint8_t) control_mag_moment.v[0]; //Todo:Check that this value is in the range [0, 100]
-    mtq_duty[1] = (uint8_t) control_mag_moment.v[1];
-    mtq_duty[2] = (uint8_t) control_mag_moment.v[2];
-
-    //Enable MTQ's through PWM commands
-    //Check when the power on cmd should be call
-    cmd_t *cmd_pwm_pwr = cmd_get_str("obc_pwm_pwr");
-    cmd_add_params_str(cmd_pwm_pwr, "1");
-    cmd_send(cmd_pwm_pwr);
-
-    cmd_t *cmd_set_pwm_x = cmd_get_str("obc_set_pwm_duty");
-    cmd_add_params_var(cmd_set_pwm_x, mtq_duty[0], 0);//TODO:Check cmd parameters order
-    cmd_send(cmd_set_pwm_x);
-
-    cmd_t *cmd_set_pwm_y = cmd_get_str("obc_set_pwm_duty");
-    cmd_add_params_var(cmd_set_pwm_y, mtq_duty[1], 1);
-    cmd_send(cmd_set_pwm_y);
+    LOGE(tag, "csp_transaction failed! (%d)", rc);
+    return -1;
+}
 
-    cmd_t *cmd_set_pwm_z = cmd_get_str("obc_set_pwm_duty");
-    cmd_add_params_var(cmd_set_pwm_z, mtq_duty[2], 2);
-    cmd_send(cmd_set_pwm_z);
+int adcs_read_omega(vector3_t *omega)
+{
+#ifdef NANOMIND
+    int result;
+    gs_mpu3300_gyro_t gyro_reading;
+    int bus = i2c_bus_acquire(SCH_A3200_I2C_BUS, I2C_PRIO_NORMAL) == 0;
+    result = gs_mpu3300_read_gyro(&gyro_reading);
+    if(bus)
+        i2c_bus_release(SCH_A3200_I2C_BUS);
 
-    packet->length = len;
-    LOGI(tag, "ADCS CMD: (%d) %s", packet->length, packet->data);
+    if(result == 0)
+    {
+        omega->v0 = gyro_reading.gyro_x;
+        omega->v1 = gyro_reading.gyro_y;
+        omega->v2 = gyro_reading.gyro_z;
+        return 0;
+    }
+    return -1;
+#endif
+    return 0;
+}
 
-    int rc = csp_sendto(CSP_PRIO_NORM, ADCS_PORT, SCH_TRX_PORT_CMD,
-                        SCH_TRX_PORT_CMD, CSP_O_NONE, packet, 100);
+int adcs_read_mag(vector3_t *mag)
+{
+#ifdef NANOMIND
+    gs_error_t result;
+    gs_hmc5843_data_t hmc_reading;
+    int bus = i2c_bus_acquire(SCH_A3200_I2C_BUS, I2C_PRIO_NORMAL) == 0;
+    result = gs_hmc5843_read_single(&hmc_reading);
+    if(bus)
+        i2c_bus_release(SCH_A3200_I2C_BUS);
 
-    if(rc != 0)
+    if(result == GS_OK)
     {
-        csp_buffer_free((void *)packet);
-        return CMD_ERROR;
+        mag->v0 = hmc_reading.x;
+        mag->v1 = hmc_reading.y;
+        mag->v2 = hmc_reading.z;
+        return 0;
     }
-
-    return CMD_OK;
+    return -1;
+#endif
+    return 0;
 }
 
-int adcs_set_target(char* fmt, char* params, int nparams)
+void adcs_calc_target(adcs_state_t *st, vector3_t i_tar, vector3_t omega_tar)
 {
-    double rot;
-    vector3_t i_tar;  // Target vector, intertial frame, read as parameter
+    real_t rot;
     vector3_t b_tar;
     vector3_t b_dir;  // Face to point to, body frame
     vector3_t b_lambda;
-    vector3_t omega_tar;  // Target velocity vector, body frame, read as parameter
-    quaternion_t q_i2b_est;
     quaternion_t q_b2b_now2tar;
-    quaternion_t q_i2b_tar; // Target quaternion, inertial to body frame. Calculate
 
-    if(params == NULL || sscanf(params, fmt, &i_tar.v0, &i_tar.v1, &i_tar.v2, &omega_tar.v0, &omega_tar.v1, &omega_tar.v2) != nparams)
-        return CMD_ERROR;
-//    int p = sscanf(params, fmt, &i_tar.v0, &i_tar.v1, &i_tar.v2, &omega_tar.v0, &omega_tar.v1, &omega_tar.v2);
-    LOGW(tag, fmt, i_tar.v0, i_tar.v1, i_tar.v2, omega_tar.v0, omega_tar.v1, omega_tar.v2);
     // Set Z+ [0, 0, 1] as the face to point to
     b_dir.v0 = 0.0; b_dir.v1 = 0.0; b_dir.v2 = 1.0;
     vec_normalize(&b_dir, NULL);
 
     // Get target vector in body frame
-    _get_sat_quaterion(&q_i2b_est, dat_ads_q0);
     vec_normalize(&i_tar, NULL);
-    quat_frame_conv(&q_i2b_est, &i_tar, &b_tar);
+    quat_frame_conv(&st->q_est, &i_tar, &b_tar);
     vec_normalize(&b_tar, NULL);
 
     // Get I2B target quaternion
     vec_outer_product(b_dir, b_tar, &b_lambda);
     vec_normalize(&b_lambda, NULL);
-    rot = acos(vec_inner_product(b_dir, b_tar));
+    rot = r_acos(vec_inner_product(b_dir, b_tar));
     axis_rotation_to_quat(b_lambda, rot, &q_b2b_now2tar); //Calculate quaternion of shaft rotation
     quat_normalize(&q_b2b_now2tar, NULL);
-    quat_mult(&q_i2b_est, &q_b2b_now2tar, &q_i2b_tar); //Calculate quaternion after rotation
-
-    _set_sat_quaterion(&q_i2b_tar, dat_tgt_q0);
-    _set_sat_vector(&omega_tar, dat_tgt_omega_x);
-
-    //TODO: Remove this print
-    quaternion_t _q;
-    _get_sat_quaterion(&_q, dat_tgt_q0);
-    LOGI(tag, "TGT QUAT: %lf %lf %lf %lf", _q.q0, _q.q1, _q.q2, _q.q3);
-
-    return CMD_OK;
+    quat_mult(&st->q_est, &q_b2b_now2tar, &st->q_tgt); //Calculate quaternion after rotation
+    st->omega_tgt = omega_tar;
 }
 
-int adcs_target_nadir(char* fmt, char* params, int nparams)
+void adcs_calc_nadir(adcs_state_t *st)
 {
     // Get Nadir vector
-    vector3_t i_tar;
-    _get_sat_vector(&i_tar, dat_ads_pos_x);
+    vector3_t i_tar = st->pos_i;
     vec_cons_mult(-1.0, &i_tar, NULL);
     vec_normalize(&i_tar, NULL);
 
@@ -421,58 +456,116 @@ int adcs_target_nadir(char* fmt, char* params, int nparams)
     omega_i_tar.v[1] = -0.0010289117582512489;
     omega_i_tar.v[2] = -0.00014131086334682821;
     vector3_t omega_b_tar;
-    quaternion_t q_i2b_est;
-    _get_sat_quaterion(&q_i2b_est, dat_ads_q0);
-    quat_frame_conv(&q_i2b_est, &omega_i_tar, &omega_b_tar);
-
-    char *_fmt = "%lf %lf %lf %lf %lf %lf";
-    char _params[SCH_CMD_MAX_STR_PARAMS];
-    memset(_params, 0, SCH_CMD_MAX_STR_PARAMS);
-    snprintf(_params, SCH_CMD_MAX_STR_PARAMS, _fmt, i_tar.v0, i_tar.v1, i_tar.v2,
-             omega_b_tar.v0, omega_b_tar.v1, omega_b_tar.v2);
-    int ret = adcs_set_target(_fmt, _params, 6);
+    quat_frame_conv(&st->q_est, &omega_i_tar, &omega_b_tar);
 
-    return ret;
+    adcs_calc_target(st, i_tar, omega_b_tar);
 }
 
-int adcs_detumbling_mag(char* fmt, char* params, int nparams)
+void adcs_calc_detumbling(adcs_state_t *st)
 {
-    vector3_t i_tar;
-    _get_sat_vector(&i_tar, dat_ads_pos_x);
+    vector3_t i_tar = st->pos_i;
     vec_cons_mult(-1.0, &i_tar, NULL);
     vec_normalize(&i_tar, NULL);
 
     vector3_t omega_b_tar;
     omega_b_tar.v[0] = 0.0;
-    omega_b_tar.v[0] = 0.0;
-    omega_b_tar.v[0] = 0.0;
+    omega_b_tar.v[1] = 0.0;
+    omega_b_tar.v[2] = 0.0;
+
+    adcs_calc_target(st, i_tar, omega_b_tar);
+}
+
+void adcs_ctrl_update(adcs_ctrl_t *ctrl, int mode)
+{
+    if(ctrl->ok && ctrl->mode == mode)
+        return;
 
-    char *_fmt = "%lf %lf %lf %lf %lf %lf";
-    char _params[SCH_CMD_MAX_STR_PARAMS];
-    memset(_params, 0, SCH_CMD_MAX_STR_PARAMS);
-    snprintf(_params, SCH_CMD_MAX_STR_PARAMS, _fmt, i_tar.v0, i_tar.v1, i_tar.v2,
-             omega_b_tar.v0, omega_b_tar.v1, omega_b_tar.v2);
-    int ret = adcs_set_target(_fmt, _params, 6);
+    int i;
+    for(i=0; i<3; i++)
+    {
+        ctrl->p_quat.v[i] = REAL(0.001);
+        ctrl->i_quat.v[i] = REAL(0.0);
+        ctrl->p_omega.v[i] = REAL(0.003);
+        ctrl->max_mag.v[i] = REAL(0.35e-9);  // 0.35 Am2, B in nT
+        ctrl->rw_lower_limit.v[i] = REAL(0.0);
+    }
+    ctrl->inertia_neg.v0 = REAL(-0.035);
+    ctrl->inertia_neg.v1 = REAL(-0.035);
+    ctrl->inertia_neg.v2 = REAL(-0.007);
+    ctrl->inv_nT2T = REAL(1.0e9);
+    ctrl->mag_all_axes = mode == DAT_OBC_OPMODE_DETUMB_MAG;
+    ctrl->mode = mode;
+    ctrl->ok = 1;
+    LOGD(tag, "Controller context, mode %d", mode);
+}
 
-    return ret;
+void adcs_calc_torque(adcs_state_t *st, const adcs_ctrl_t *ctrl, real_t ctrl_cycle)
+{
+    // Rotation to the target, q_now2tar = conj(q_est) * q_tgt
+    quaternion_t q_b2i_est;
+    quaternion_t q_now2tar;
+    quat_conjugate(&st->q_est, &q_b2i_est);
+    quat_mult(&q_b2i_est, &st->q_tgt, &q_now2tar);
+    quat_normalize(&q_now2tar, NULL);
+
+    // Attitude error, rotation angle times the rotation axis. The integral
+    // error is the attitude error times the control cycle
+    vector3_t att_err;
+    memcpy(att_err.v, q_now2tar.vec, sizeof(vector3_t));
+    vec_normalize(&att_err, NULL);
+    vec_cons_mult(2*r_acos(q_now2tar.q[3]), &att_err, NULL);
+
+    // T = P_quat*err + I_quat*err*cycle + P_omega*(omega_tgt - omega_est)
+    int i;
+    for(i=0; i<3; i++)
+        st->torque.v[i] = (ctrl->p_quat.v[i] + ctrl->i_quat.v[i]*ctrl_cycle)*att_err.v[i] +
+                          ctrl->p_omega.v[i]*(st->omega_tgt.v[i] - st->omega_est.v[i]);
+
+    LOGD(tag, "CTRL_TORQUE: %f, %f, %f", st->torque.v0, st->torque.v1, st->torque.v2);
 }
 
-int adcs_send_attitude(char* fmt, char* params, int nparams)
+void adcs_calc_mag_moment(adcs_state_t *st, const adcs_ctrl_t *ctrl)
 {
-    quaternion_t q_est, q_tgt;
-    _get_sat_quaterion(&q_est, dat_ads_q0);
-    _get_sat_quaterion(&q_tgt, dat_tgt_q0);
+    // t = -I*dw / ||I*dw||, dw = w_b_est - w_b_tar
+    vector3_t control_torque;
+    int i;
+    for(i=0; i<3; i++)
+        control_torque.v[i] = ctrl->inertia_neg.v[i]*(st->omega_est.v[i] - st->omega_tgt.v[i]);
+    real_t inv_norm_torque = REAL(1.0);
+    real_t norm_torque = vec_norm(control_torque);
+    if (norm_torque >= REAL(1.0e-9))
+        inv_norm_torque = REAL(1.0) / norm_torque;
+
+    // t_max = m_max x B_est, tx = tx*dirx*|t_max_x| on the selected axes
+    vector3_t max_torque;
+    vec_outer_product(ctrl->max_mag, st->mag_est, &max_torque);
+    for(i=0; i<3; i++)
+    {
+        real_t select = (ctrl->mag_all_axes || r_fabs(st->omega_est.v[i]) < ctrl->rw_lower_limit.v[i]) ? REAL(1.0) : REAL(0.0);
+        control_torque.v[i] *= inv_norm_torque * select * r_fabs(max_torque.v[i]);
+    }
 
-    csp_packet_t *packet = csp_buffer_get(COM_FRAME_MAX_LEN);
+    // mc = Bxt / ||B_est||**2, with B in nT
+    vector3_t control_mag_moment_temp;
+    vec_outer_product(st->mag_est, control_torque, &control_mag_moment_temp);
+    real_t inv_b_norm2 = ctrl->inv_nT2T / vec_inner_product(st->mag_est, st->mag_est);
+    vec_cons_mult(inv_b_norm2, &control_mag_moment_temp, &st->mag_moment);
+
+    LOGD(tag, "CTRL_MAG_MOMENT: %f, %f, %f", st->mag_moment.v0, st->mag_moment.v1, st->mag_moment.v2);
+}
+
+/**
+ * Send a string command to the ADCS system
+ */
+static int _adcs_send_cmd(const char *cmd)
+{
+    csp_packet_t *packet = com_buffer_get(COM_FRAME_MAX_LEN, 0);
     if(packet == NULL)
-        return CMD_ERROR;
+        return -1;
 
-    int len = snprintf(packet->data, COM_FRAME_MAX_LEN,
-                       "adcs_set_attitude %lf %lf %lf %lf %lf %lf %lf %lf",
-                       q_est.q0, q_est.q1, q_est.q2, q_est.q3,
-                       q_tgt.q0, q_tgt.q1, q_tgt.q2, q_tgt.q3);
+    int len = snprintf((char *)packet->data, COM_FRAME_MAX_LEN, "%s", cmd);
     packet->length = len;
-    LOGI(tag, "OBC ATT: (%d) %s", packet->length, packet->data);
+    LOGD(tag, "ADCS CMD: (%d) %s", packet->length, packet->data);
 
     int rc = csp_sendto(CSP_PRIO_NORM, ADCS_PORT, SCH_TRX_PORT_CMD,
                         SCH_TRX_PORT_CMD, CSP_O_NONE, packet, 100);
@@ -480,8 +573,237 @@ int adcs_send_attitude(char* fmt, char* params, int nparams)
     if(rc != 0)
     {
         csp_buffer_free((void *)packet);
-        return CMD_ERROR;
+        return -1;
     }
+    return 0;
+}
+
+int adcs_send_torque(const vector3_t *torque)
+{
+    char cmd[COM_FRAME_MAX_LEN];
+    snprintf(cmd, COM_FRAME_MAX_LEN, "adcs_set_torque %.06f %.06f %.06f",
+             torque->v0, torque->v1, torque->v2);
+    return _adcs_send_cmd(cmd);
+}
+
+int adcs_send_mag_moment(const vector3_t *mag_moment)
+{
+    char cmd[COM_FRAME_MAX_LEN];
+    snprintf(cmd, COM_FRAME_MAX_LEN, "adcs_set_mag_moment %.06f %.06f %.06f",
+             mag_moment->v0, mag_moment->v1, mag_moment->v2);
+
+#ifdef NANOMIND
+    //Calc PWM duty cycle from magnetic moment
+    //Todo: calc based on model
+    int mtq_duty[3];
+    mtq_duty[0] = (uint8_t) mag_moment->v[0]; //Todo:Check that this value is in the range [0, 100]
+    mtq_duty[1] = (uint8_t) mag_moment->v[1];
+    mtq_duty[2] = (uint8_t) mag_moment->v[2];
+
+    //Enable MTQ's through PWM commands, called directly to not queue three
+    //commands each control cycle
+    //Check when the power on cmd should be call
+    char pwm_params[SCH_CMD_MAX_STR_PARAMS];
+    int i;
+    obc_pwm_pwr("%d", "1", 1);
+    for(i=0; i<3; i++)
+    {
+        snprintf(pwm_params, SCH_CMD_MAX_STR_PARAMS, "%d %d", i, mtq_duty[i]);
+        obc_set_pwm_duty("%d %d", pwm_params, 2);
+    }
+#endif
+
+    return _adcs_send_cmd(cmd);
+}
 
+int adcs_send_attitude_q(const quaternion_t *q_est, const quaternion_t *q_tgt)
+{
+    char cmd[COM_FRAME_MAX_LEN];
+    snprintf(cmd, COM_FRAME_MAX_LEN,
+             "adcs_set_attitude %lf %lf %lf %lf %lf %lf %lf %lf",
+             q_est->q0, q_est->q1, q_est->q2, q_est->q3,
+             q_tgt->q0, q_tgt->q1, q_tgt->q2, q_tgt->q3);
+    return _adcs_send_cmd(cmd);
+}
+
+int adcs_get_quaternion(char* fmt, char* params, int nparams)
+{
+    quaternion_t q;
+    if(adcs_read_quaternion(&q) != 0)
+        return CMD_SYNTAX_ERROR;
+
+    adcs_state_t st;
+    adcs_state_load(&st);
+    st.q_est = q;
+    adcs_state_store(&st);
+    LOGI(tag, "SAT_QUAT: %.04f, %.04f, %.04f, %.04f", q.q0, q.q1, q.q2, q.q3);
     return CMD_OK;
 }
+
+int adcs_get_omega(char* fmt, char* params, int nparams)
+{
+    adcs_state_t st;
+    adcs_state_load(&st);
+    if(adcs_read_omega(&st.omega_est) != 0)
+        return CMD_ERROR;
+    adcs_state_store(&st);
+    return CMD_OK;
+}
+
+int adcs_get_mag(char* fmt, char* params, int nparams)
+{
+    adcs_state_t st;
+    adcs_state_load(&st);
+    if(adcs_read_mag(&st.mag_est) != 0)
+        return CMD_ERROR;
+    adcs_state_store(&st);
+    return CMD_OK;
+}
+
+int adcs_control_torque(char* fmt, char* params, int nparams)
+{
+    double ctrl_cycle;
+    if(params == NULL || cmd_scan_params(fmt, params, &ctrl_cycle) != nparams)
+        return CMD_SYNTAX_ERROR;
+
+    adcs_state_t st;
+    adcs_state_load(&st);
+    adcs_ctrl_update(&adcs_cmd_ctrl, st.mode);
+    adcs_calc_torque(&st, &adcs_cmd_ctrl, ctrl_cycle);
+    LOGI(tag, "CTRL_TORQUE: %f, %f, %f", st.torque.v0, st.torque.v1, st.torque.v2);
+
+    return adcs_send_torque(&st.torque) == 0 ? CMD_OK : CMD_ERROR;
+}
+
+int adcs_mag_moment(char* fmt, char* params, int nparams)
+{
+    adcs_state_t st;
+    adcs_state_load(&st);
+    adcs_ctrl_update(&adcs_cmd_ctrl, st.mode);
+    adcs_calc_mag_moment(&st, &adcs_cmd_ctrl);
+    LOGI(tag, "CTRL_MAG_MOMENT: %f, %f, %f", st.mag_moment.v0, st.mag_moment.v1, st.mag_moment.v2);
+
+    return adcs_send_mag_moment(&st.mag_moment) == 0 ? CMD_OK : CMD_ERROR;
+}
+
+/**
+ * Store @st with its new target attitude
+ */
+static void _adcs_set_target_vars(adcs_state_t *st)
+{
+    adcs_state_store(st);
+    LOGI(tag, "TGT QUAT: %lf %lf %lf %lf", st->q_tgt.q0, st->q_tgt.q1, st->q_tgt.q2, st->q_tgt.q3);
+}
+
+int adcs_set_target(char* fmt, char* params, int nparams)
+{
+    double p[6];
+    vector3_t i_tar;  // Target vector, intertial frame, read as parameter
+    vector3_t omega_tar;  // Target velocity vector, body frame, read as parameter
+
+    if(params == NULL || cmd_scan_params(fmt, params, &p[0], &p[1], &p[2], &p[3], &p[4], &p[5]) != nparams)
+        return CMD_ERROR;
+    i_tar.v0 = p[0]; i_tar.v1 = p[1]; i_tar.v2 = p[2];
+    omega_tar.v0 = p[3]; omega_tar.v1 = p[4]; omega_tar.v2 = p[5];
+
+    adcs_state_t st;
+    adcs_state_load(&st);
+    adcs_calc_target(&st, i_tar, omega_tar);
+    _adcs_set_target_vars(&st);
+    return CMD_OK;
+}
+
+int adcs_target_nadir(char* fmt, char* params, int nparams)
+{
+    adcs_state_t st;
+    adcs_state_load(&st);
+    adcs_calc_nadir(&st);
+    _adcs_set_target_vars(&st);
+    return CMD_OK;
+}
+
+int adcs_detumbling_mag(char* fmt, char* params, int nparams)
+{
+    adcs_state_t st;
+    adcs_state_load(&st);
+    adcs_calc_detumbling(&st);
+    _adcs_set_target_vars(&st);
+    return CMD_OK;
+}
+
+int adcs_send_attitude(char* fmt, char* params, int nparams)
+{
+    adcs_state_t st;
+    adcs_state_load(&st);
+    return adcs_send_attitude_q(&st.q_est, &st.q_tgt) == 0 ? CMD_OK : CMD_ERROR;
+}
+
+int adcs_sun(char* fmt, char* params, int nparams)
+{
+    static adcs_sun_t sun = {.sunlit = REAL(1.0)};
+    adcs_state_t st;
+    adcs_state_load(&st);
+    int rc = adcs_sun_update(&sun, (int)dat_clock_utc(), &st.pos_i);
+    adcs_sun_publish(&sun);
+    if(rc != 0)
+    {
+        LOGW(tag, "Invalid orbit position, eclipse not updated");
+        return CMD_ERROR;
+    }
+    LOGI(tag, "Sun (%f, %f, %f), eclipse %d (%.3f)", sun.sun_i.v0, sun.sun_i.v1, sun.sun_i.v2,
+         sun.eclipse, sun.sunlit);
+    return CMD_OK;
+}
+
+int adcs_env_range_cmd(char *fmt, char *params, int nparams)
+{
+    int start, step, n, i;
+    if(params == NULL || cmd_scan_params(fmt, params, &start, &step, &n) != nparams || n <= 0)
+        return CMD_SYNTAX_ERROR;
+    if(start == 0)
+        start = dat_get_time();
+
+    obc_rv_array_t rv;
+    adcs_env_array_t env;
+    if(obc_rv_array_alloc(&rv, n) != 0)
+    {
+        LOGE(tag, "Unable to allocate %d states", n);
+        return CMD_ERROR;
+    }
+    if(adcs_env_array_alloc(&env, n) != 0)
+    {
+        LOGE(tag, "Unable to allocate %d points", n);
+        obc_rv_array_free(&rv);
+        return CMD_ERROR;
+    }
+    for(i=0; i<n; i++)
+        rv.ts[i] = start + i*step;
+
+    portTick t0 = osTaskGetTickCount();
+    int errors = obc_prop_tle_range(NULL, &rv);
+    env.n = 0;
+    for(i=0; i<n; i++)
+    {
+        if(rv.error[i] != 0)
+            continue;
+        vector3_t pos_i = {.v = {rv.rx[i], rv.ry[i], rv.rz[i]}};
+        vector3_t lat_lon_alt;
+        eci_to_geo(pos_i, unixt_to_jd((uint32_t)rv.ts[i]), &lat_lon_alt);
+        env.ts[env.n] = rv.ts[i];
+        env.lat[env.n] = lat_lon_alt.v0;
+        env.lon[env.n] = lat_lon_alt.v1;
+        env.alt[env.n] = lat_lon_alt.v2;
+        env.n++;
+    }
+    adcs_env_range(&env);
+    portTick t1 = osTaskGetTickCount();
+
+    for(i=0; i<env.n; i++)
+        LOGR(tag, "%d,%.8f,%.8f,%.1f,%.2f,%.2f,%.2f,%.8f,%.8f,%.8f", env.ts[i], env.lat[i], env.lon[i], env.alt[i],
+             env.mag_n[i], env.mag_e[i], env.mag_d[i], env.sun_x[i], env.sun_y[i], env.sun_z[i]);
+    LOGI(tag, "Evaluated %d points, %d propagation errors (%u ticks)", env.n, errors, (unsigned int)(t1-t0));
+
+    adcs_env_array_free(&env);
+    obc_rv_array_free(&rv);
+    return errors == 0 ? CMD_OK : CMD_ERROR;
+}
@@ -17,32 +17,119 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_TAG_ID LOG_TAG_COM
 #include "cmdCOM.h"
+#include "taskRepeater.h"
+#if SCH_TASK_TRK_ENABLED
+#include "taskTracking.h"
+#endif
 
 static const char *tag = "cmdCOM";
 static char trx_node = SCH_COMM_ADDRESS;
 
+/* TX pacer token bucket (see com_tx_pace), in milli-bytes */
+#define COM_TX_OVERHEAD (8)     ///< CSP header and CRC bytes per packet
+#define COM_TX_BURST ((int64_t)SCH_COM_MAX_PACKETS*(sizeof(com_frame_t)+COM_TX_OVERHEAD)*1000)
+static osSemaphore com_tx_sem;
+static int com_tx_sem_ok = 0;
+static int64_t com_tx_tokens = COM_TX_BURST;
+static portTick com_tx_last;
+
+/* CSP buffer pool counters (see com_buffer_get) */
+static osSemaphore com_buf_sem;
+static int com_buf_sem_ok = 0;
+static com_buffer_stats_t com_buf_stats;
+
+static uint32_t com_crc_errors = 0;     ///< TM frames dropped by the CRC check (see com_frame_check)
+
+/* Links transfer modes (see com_link_set), entry 0 is the default link */
+static com_link_t com_links[SCH_COM_LINKS+1];
+static osSemaphore com_link_sem;
+static int com_link_sem_ok = 0;
+
 #ifdef SCH_USE_NANOCOM
 static void _com_config_help(void);
 static void _com_config_find(char *param_name, int table, param_table_t **param);
+static int _com_config_get(param_table_t *param, int table, void *out);
+static int _com_config_set(param_table_t *param, int table, void *in);
+static void _com_config_store(param_table_t *param, int table, const void *value);
+
+/* TRX parameters cache (see _com_config_get) */
+#define COM_CONFIG_CACHE_LEN    (64)    ///< Cached parameters
+#define COM_CONFIG_VALUE_MAX    (32)    ///< Max. size of a cached value, larger ones are not cached
+
+typedef struct com_config_entry {
+    param_table_t *param;               ///< Parameter, NULL if the entry is free
+    int table;                          ///< Parameter table
+    portTick time;                      ///< Time the value was read or set
+    uint8_t value[COM_CONFIG_VALUE_MAX];///< Last known value in the TRX
+} com_config_entry_t;
+
+static com_config_entry_t com_config_cache[COM_CONFIG_CACHE_LEN];
+static osSemaphore com_config_sem;
+static int com_config_sem_ok = 0;
 #endif
 
 void cmd_com_init(void)
 {
+    com_tx_sem_ok = osSemaphoreCreate(&com_tx_sem) == OS_SEMAPHORE_OK;
+    osSemaphoreSetName(&com_tx_sem, "com_tx");
+    if(!com_tx_sem_ok)
+        LOGE(tag, "Unable to create TX pacer mutex");
+    com_tx_last = osTaskGetTickCount();
+    com_buf_sem_ok = osSemaphoreCreate(&com_buf_sem) == OS_SEMAPHORE_OK;
+    osSemaphoreSetName(&com_buf_sem, "com_buf");
+    if(!com_buf_sem_ok)
+        LOGE(tag, "Unable to create CSP buffers mutex");
+    com_buf_stats.min_free = UINT32_MAX;
+    com_link_sem_ok = osSemaphoreCreate(&com_link_sem) == OS_SEMAPHORE_OK;
+    osSemaphoreSetName(&com_link_sem, "com_link");
+    int i;
+    for(i=0; i <= SCH_COM_LINKS; i++)
+        com_links[i].node = -2;
+    com_links[0].node = -1;
+    com_links[0].rdp = SCH_COM_LINK_RDP;
+    com_links[0].window = SCH_COM_LINK_WINDOW;
+    com_links[0].mtu = SCH_COM_LINK_MTU;
+    // The repeater queue is ready before the communications task starts
+    rpt_init();
+#ifdef SCH_USE_NANOCOM
+    com_config_sem_ok = osSemaphoreCreate(&com_config_sem) == OS_SEMAPHORE_OK;
+    osSemaphoreSetName(&com_config_sem, "com_config");
+#endif
+
     cmd_add("com_ping", com_ping, "%d", 1);
     cmd_add("com_send_rpt", com_send_rpt, "%d %s", 2);
     cmd_add("com_send_cmd", com_send_cmd, "%d %n", 2);
     cmd_add("com_send_tc", com_send_tc_frame, "%d %n", 2);
+    cmd_add("com_send_prof", com_send_prof, "%d %d %d", 3);
+    cmd_add("com_send_tm_ack", com_send_tm_ack, "%d %d %u %n", 4);
     cmd_add("com_send_data", com_send_data, "%d %d %n", 3);
     cmd_add("com_debug", com_debug, "", 0);
+    cmd_add("com_buffer_stats", com_buffer_stats, "%d", 1);
+    cmd_add("com_crc_stats", com_crc_stats, "%d", 1);
+    cmd_add("com_rpt_stats", com_rpt_stats, "%d", 1);
     cmd_add("com_set_node", com_set_node, "%d", 1);
     cmd_add("com_get_node", com_get_node, "", 0);
     cmd_add("com_set_time_node", com_set_time_node, "%d", 1);
     cmd_add("com_set_tle_node", com_set_tle_node, "%d %s", 2);
+    cmd_add("com_set_link", com_set_link, "%d %d %d %d", 4);
+    cmd_add("com_get_link", com_get_link, "", 0);
+#if SCH_TASK_TRK_ENABLED
+    cmd_add("com_track_status", com_track_status, "%d", 1);
+    cmd_add("com_track_freq", com_track_freq, "%u %u", 2);
+#endif
+    // Blocking network requests do not block the main executer
+    cmd_set_class("com_ping", CMD_CLASS_SHARED_IO);
+    cmd_set_shed("com_debug", CMD_LOAD_HIGH);
 #ifdef SCH_USE_NANOCOM
     cmd_add("com_reset_wdt", com_reset_wdt, "%d", 1);
+    cmd_set_priority("com_reset_wdt", CMD_PRIO_HIGH);
     cmd_add("com_get_config", com_get_config, "%d %s", 2);
+    cmd_set_class("com_get_config", CMD_CLASS_SHARED_IO);
     cmd_add("com_set_config", com_set_config, "%d %s %s", 3);
+    cmd_add("com_load_config", com_load_config, "%d", 1);
+    cmd_add("com_clear_config", com_clear_config, "", 0);
     cmd_add("com_update_status", com_update_status_vars, "", 0);
     cmd_add("com_set_beacon", com_set_beacon, "%d %d", 2);
 #endif
@@ -57,7 +144,7 @@ int com_ping(char *fmt, char *params, int nparams)
     }
 
     int node;
-    if(sscanf(params, fmt, &node) == nparams)
+    if(cmd_scan_params(fmt, params, &node) == nparams)
     {
         int rc = csp_ping((uint8_t)node, 3000, 10, CSP_O_NONE);
         LOGR(tag, "Ping to %d took %d", node, rc);
@@ -82,11 +169,11 @@ int com_send_rpt(char *fmt, char *params, int nparams)
     memset(msg, '\0', SCH_CMD_MAX_STR_PARAMS);
 
     // format: <node> <string>
-    if(sscanf(params, fmt, &node, msg) == nparams)
+    if(cmd_scan_params(fmt, params, &node, msg) == nparams)
     {
         // Create a packet with the message
         size_t msg_len = strlen(msg);
-        csp_packet_t *packet = csp_buffer_get(msg_len+1);
+        csp_packet_t *packet = com_buffer_get(msg_len+1, 0);
         if(packet == NULL)
         {
             LOGE(tag, "Could not allocate packet!");
@@ -130,7 +217,7 @@ int com_send_cmd(char *fmt, char *params, int nparams)
     memset(msg, '\0', SCH_CMD_MAX_STR_PARAMS);
 
     //format: <node> <command> [parameters]
-    n_args = sscanf(params, fmt, &node, &next);
+    n_args = cmd_scan_params(fmt, params, &node, &next);
     if(n_args == nparams-1 && next > 1)
     {
         strncpy(msg, params+next, (size_t)SCH_CMD_MAX_STR_PARAMS);
@@ -140,7 +227,7 @@ int com_send_cmd(char *fmt, char *params, int nparams)
         int rc = csp_transaction(1, (uint8_t)node, SCH_TRX_PORT_TC, 1000,
                                  (void *)msg, (int)strlen(msg), rep, 1);
 
-        if(rc > 0 && rep[0] == 200)
+        if(rc > 0 && (rep[0] == COM_ACK_OK || rep[0] == COM_ACK_ACCEPTED))
         {
             LOGV(tag, "Command sent successfully. (rc: %d, re: %d)", rc, rep[0]);
             return CMD_OK;
@@ -170,7 +257,7 @@ int com_send_tc_frame(char *fmt, char *params, int nparams)
     memset(tc_frame, '\0', COM_FRAME_MAX_LEN);
 
     //format: <node> <command> [parameters];...;<command> [parameters]
-    n_args = sscanf(params, fmt, &node, &next);
+    n_args = cmd_scan_params(fmt, params, &node, &next);
     if(n_args == nparams-1 && next > 1)
     {
         strncpy(tc_frame, params+next, (size_t)COM_FRAME_MAX_LEN-1);
@@ -179,7 +266,7 @@ int com_send_tc_frame(char *fmt, char *params, int nparams)
         int rc = csp_transaction(1, (uint8_t)node, SCH_TRX_PORT_TC, 1000,
                                  (void *)tc_frame, (int)strlen(tc_frame), rep, 1);
 
-        if(rc > 0 && rep[0] == 200)
+        if(rc > 0 && (rep[0] == COM_ACK_OK || rep[0] == COM_ACK_ACCEPTED))
         {
             LOGV(tag, "TC sent successfully. (rc: %d, re: %d)", rc, rep[0]);
             return CMD_OK;
@@ -195,10 +282,76 @@ int com_send_tc_frame(char *fmt, char *params, int nparams)
     return CMD_SYNTAX_ERROR;
 }
 
+int com_send_prof(char *fmt, char *params, int nparams)
+{
+    int node, rate, seconds;
+    if(params == NULL || cmd_scan_params(fmt, params, &node, &rate, &seconds) != nparams)
+    {
+        LOGE(tag, "Error parsing parameters!");
+        return CMD_SYNTAX_ERROR;
+    }
+
+    // Request: samples per second and seconds, uint16 in network byte order
+    uint8_t rep[1] = {0};
+    uint16_t request[2] = {csp_hton16((uint16_t)rate), csp_hton16((uint16_t)seconds)};
+    int rc = csp_transaction(1, (uint8_t)node, SCH_TRX_PORT_PROF, 1000,
+                             (void *)request, (int)sizeof(request), rep, 1);
+
+    if(rc > 0 && (rep[0] == COM_ACK_OK || rep[0] == COM_ACK_ACCEPTED))
+    {
+        LOGI(tag, "Profiler session started in node %d, stacks in %d s", node, seconds);
+        return CMD_OK;
+    }
+    LOGE(tag, "Error starting the profiler session. (rc: %d, re: %d)", rc, rep[0]);
+    return CMD_ERROR;
+}
+
+int com_send_tm_ack(char *fmt, char *params, int nparams)
+{
+    int node, payload, next;
+    unsigned int base;
+    if(params == NULL || cmd_scan_params(fmt, params, &node, &payload, &base, &next) != nparams - 1 || next <= 0)
+    {
+        LOGE(tag, "Error parsing parameters!");
+        return CMD_SYNTAX_ERROR;
+    }
+
+    com_ack_frame_t frame;
+    char *runs = params + next, *end;
+    int n = 0;
+    long run;
+    while(n < (int)COM_ACK_MAX_RUNS && (run = strtol(runs, &end, 10), end != runs))
+    {
+        if(run < 0 || run > UINT16_MAX)
+        {
+            LOGE(tag, "Invalid run length %ld", run);
+            return CMD_SYNTAX_ERROR;
+        }
+        frame.runs[n++] = csp_hton16((uint16_t)run);
+        runs = end;
+    }
+    if(payload < 0 || payload >= last_sensor || n == 0)
+    {
+        LOGE(tag, "Invalid acks, payload %d, %d runs", payload, n);
+        return CMD_SYNTAX_ERROR;
+    }
+    frame.payload = (uint8_t)payload;
+    frame.n_runs = (uint8_t)n;
+    frame.base = csp_hton32((uint32_t)base);
+
+    uint8_t rep[1] = {0};
+    int len = (int)(COM_ACK_HEADER_LEN + n*sizeof(uint16_t));
+    int rc = csp_transaction(CSP_PRIO_NORM, (uint8_t)node, SCH_TRX_PORT_ACK, 1000, &frame, len, rep, 1);
+    if(rc > 0 && rep[0] == COM_ACK_OK)
+        return CMD_OK;
+    LOGE(tag, "Error sending acks to node %d. (rc: %d, re: %d)", node, rc, rep[0]);
+    return CMD_ERROR;
+}
+
 int com_send_data(char *fmt, char *params, int nparams)
 {
     int node, port, next;
-    if(params == NULL || sscanf(params, fmt, &node, &port, &next) != nparams - 1)
+    if(params == NULL || cmd_scan_params(fmt, params, &node, &port, &next) != nparams - 1)
     {
         LOGE(tag, "Invalid arguments!");
         return CMD_SYNTAX_ERROR;
@@ -224,18 +377,24 @@ int _com_send_data(int node, void *data, size_t len, int type, int n_data, int n
 
     // New connection
     csp_conn_t *conn;
-    conn = csp_connect(CSP_PRIO_NORM, node, SCH_TRX_PORT_TM, 500, CSP_O_NONE);
+    conn = com_connect(node, SCH_TRX_PORT_TM, 500);
     assert(conn != NULL);
 
     // Send one or more frames
     while(len > 0)
     {
-        // Create packet and frame
-        csp_packet_t *packet = csp_buffer_get(sizeof(com_frame_t));
+        // Create packet and frame, once the pacer lets the frame go
+        com_tx_pace(sizeof(com_frame_t));
+        csp_packet_t *packet = com_buffer_get(sizeof(com_frame_t), 0);
+        if(packet == NULL)
+        {
+            rc_send = 0;
+            break;
+        }
         packet->length = sizeof(com_frame_t);
         com_frame_t *frame = (com_frame_t *)(packet->data);
         frame->node = SCH_COMM_ADDRESS;
-        frame->nframe = csp_hton16((uint16_t)nframe++);
+        frame->nframe = com_frame_hton_nframe(nframe++);
         frame->type = (uint8_t)type;
         size_t sent = len < COM_FRAME_MAX_LEN ? len : COM_FRAME_MAX_LEN;
         int data_sent = n_data < COM_FRAME_MAX_LEN/size_data ? n_data : (int)sent/size_data;
@@ -245,6 +404,7 @@ int _com_send_data(int node, void *data, size_t len, int type, int n_data, int n
         memcpy(frame->data.data8, data, sent);
 
         // Send packet
+        com_frame_seal(packet);
         rc_send = csp_send(conn, packet, 500);
         if(rc_send == 0)
         {
@@ -259,9 +419,6 @@ int _com_send_data(int node, void *data, size_t len, int type, int n_data, int n
             n_data -= data_sent;
         }
         data += sent;
-
-        if(nframe%SCH_COM_MAX_PACKETS == 0)
-            osDelay(SCH_COM_TX_DELAY_MS);
     }
 
     // Close connection
@@ -282,7 +439,7 @@ int com_send_telemetry(int node, int port, int type, void *data, size_t n_bytes,
 
     // New connection
     csp_conn_t *conn;
-    conn = csp_connect(CSP_PRIO_NORM, node, port, 500, CSP_O_NONE);
+    conn = com_connect(node, port, 500);
     if(conn == NULL)
         return CMD_ERROR;
 
@@ -292,17 +449,24 @@ int com_send_telemetry(int node, int port, int type, void *data, size_t n_bytes,
         int structs_sent = n_structs < structs_per_frame ? n_structs : structs_per_frame;
         size_t bytes_sent = structs_sent * size_data;
 
-        // Create packet and frame
-        csp_packet_t *packet = csp_buffer_get(sizeof(com_frame_t));
+        // Create packet and frame, once the pacer lets the frame go
+        com_tx_pace(sizeof(com_frame_t));
+        csp_packet_t *packet = com_buffer_get(sizeof(com_frame_t), 0);
+        if(packet == NULL)
+        {
+            rc_send = 0;
+            break;
+        }
         packet->length = sizeof(com_frame_t);
         com_frame_t *frame = (com_frame_t *)(packet->data);
         frame->node = SCH_COMM_ADDRESS;
-        frame->nframe = csp_hton16((uint16_t)nframe++);
+        frame->nframe = com_frame_hton_nframe(nframe++);
         frame->type = (uint8_t)type;
         frame->ndata = csp_hton32((uint32_t)structs_sent);
         memcpy(frame->data.data8, data, bytes_sent);
 
         // Send packet
+        com_frame_seal(packet);
         rc_send = csp_send(conn, packet, 500);
         if(rc_send == 0)
         {
@@ -315,9 +479,6 @@ int com_send_telemetry(int node, int port, int type, void *data, size_t n_bytes,
         n_bytes -= bytes_sent;
         n_structs -= structs_sent;
         data += bytes_sent;
-
-        if(nframe%SCH_COM_MAX_PACKETS == 0)
-            osDelay(SCH_COM_TX_DELAY_MS);
     }
 
     // Close connection
@@ -333,123 +494,437 @@ int com_send_debug(int node, char *data, size_t len)
     com_send_telemetry(node, SCH_TRX_PORT_DBG_TM, 0, data, len, (int)len, 0);
 }
 
-int com_send_file(int node, char *name, void *data, size_t n_bytes)
+uint16_t com_file_id(const char *name, size_t n_bytes)
 {
-    if(name == NULL || data == NULL)
-        return CMD_ERROR;
-
-    int rc_conn = 0;
-    int rc_send = 0;
-    int nframe = 0;
-    int total_frames = (int)n_bytes % COM_FRAME_MAX_LEN ? 1 : 0;
-    total_frames += (int)n_bytes / COM_FRAME_MAX_LEN;
-    uint16_t fileid = (uint16_t)(rand() % USHRT_MAX);
+    // FNV-1a of the name and the size
+    uint32_t hash = 2166136261u;
+    const char *c;
+    for(c = name; *c; c++)
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    int i;
+    for(i = 0; i < 4; i++)
+        hash = (hash ^ (uint8_t)(n_bytes >> 8*i)) * 16777619u;
+    return (uint16_t)(hash ^ (hash >> 16));
+}
 
-    // New connection
-    csp_conn_t *conn;
-    conn = csp_connect(CSP_PRIO_NORM, node, SCH_TRX_PORT_FILE, 500, CSP_O_NONE);
-    if(conn == NULL)
-        return CMD_ERROR;
+/**
+ * Parse the next frame range of a "0-3,7,9-12" list
+ * @param parts Pointer to the list, moved to the next range
+ * @param first Pointer for saving the first frame of the range
+ * @param last Pointer for saving the last frame of the range
+ * @return 1 if a range was parsed, 0 at the end of the list
+ */
+static int _com_file_next_part(const char **parts, int *first, int *last)
+{
+    char *end;
+    while(**parts == ',' || **parts == ' ')
+        (*parts)++;
+    long a = strtol(*parts, &end, 10);
+    if(end == *parts || a < 0)
+        return 0;
+    long b = a;
+    if(*end == '-')
+    {
+        const char *next = end + 1;
+        b = strtol(next, &end, 10);
+        if(end == next || b < a)
+            return 0;
+    }
+    *parts = end;
+    *first = (int)a;
+    *last = (int)(b < INT_MAX ? b : INT_MAX);
+    return 1;
+}
 
-    // Send the first packet with the file name
-    csp_packet_t *packet = csp_buffer_get(sizeof(com_frame_file_t));
-    packet->length = sizeof(com_frame_file_t);
+/**
+ * Send one file frame, with the packet trimmed to @len data bytes
+ */
+static int _com_send_file_frame(csp_conn_t *conn, int type, uint16_t fileid, int nframe, int total, void *data, size_t len)
+{
+    csp_packet_t *packet = com_buffer_get(sizeof(com_frame_file_t), 0);
+    if(packet == NULL)
+        return 0;
     com_frame_file_t *frame = (com_frame_file_t *)(packet->data);
     frame->node = SCH_COMM_ADDRESS;
-    frame->nframe = nframe++;
-    frame->type = TM_TYPE_FILE_START;
+    frame->nframe = csp_hton16((uint16_t)nframe);
+    frame->type = (uint8_t)type;
     frame->fileid = csp_hton16(fileid);
-    frame->total = csp_hton16(total_frames);
-    memset(frame->data, 0, COM_FRAME_MAX_LEN);
-    strncpy((char *)(frame->data), name, COM_FRAME_MAX_LEN);
+    frame->total = csp_hton16((uint16_t)total);
+    memcpy(frame->data, data, len);
+    packet->length = (uint16_t)(offsetof(com_frame_file_t, data) + len);
+
     // Send packet
-    rc_send = csp_send(conn, packet, 500);
+    com_tx_pace(packet->length);
+    int rc_send = csp_send(conn, packet, 500);
     if(rc_send == 0)
     {
-        LOGE(tag, "Error sending frame! (%d)", rc_send);
+        LOGE(tag, "Error sending file frame %d! (%d)", nframe, rc_send);
         csp_buffer_free(packet);
-        rc_conn = csp_close(conn);
+    }
+    return rc_send;
+}
+
+/**
+ * Send @count consecutive data frames from @nframe as one frame, fragmented
+ * with SFP if it does not fit in a CSP buffer
+ */
+static int _com_send_file_frames(csp_conn_t *conn, int type, uint16_t fileid, int nframe, int count, int total,
+                                 uint8_t *data, size_t n_bytes)
+{
+    size_t offset = (size_t)nframe * COM_FRAME_MAX_LEN;
+    size_t len = n_bytes - offset;
+    if(len > (size_t)count * COM_FRAME_MAX_LEN)
+        len = (size_t)count * COM_FRAME_MAX_LEN;
+    if(len <= COM_FRAME_MAX_LEN)
+        return _com_send_file_frame(conn, type, fileid, nframe, total, data + offset, len);
+
+    size_t size = offsetof(com_frame_file_t, data) + len;
+    com_frame_file_t *frame = (com_frame_file_t *)sch_malloc(MEM_COM, size);
+    if(frame == NULL)
+        return 0;
+    frame->node = SCH_COMM_ADDRESS;
+    frame->nframe = csp_hton16((uint16_t)nframe);
+    frame->type = (uint8_t)type;
+    frame->fileid = csp_hton16(fileid);
+    frame->total = csp_hton16((uint16_t)total);
+    memcpy((uint8_t *)frame + offsetof(com_frame_file_t, data), data + offset, len);
+
+    // Send fragments, paced as one packet
+    com_tx_pace(size);
+    int rc_send = csp_sfp_send(conn, frame, (int)size, (int)COM_SFP_MTU, 500) == 0;
+    if(rc_send == 0)
+        LOGE(tag, "Error sending file frames %d-%d!", nframe, nframe + count - 1);
+    sch_free(frame);
+    return rc_send;
+}
+
+int com_send_file(int node, char *name, void *data, size_t n_bytes)
+{
+    return com_send_file_parts(node, name, data, n_bytes, NULL);
+}
+
+int com_send_file_parts(int node, char *name, void *data, size_t n_bytes, const char *parts)
+{
+    if(name == NULL || data == NULL)
+        return CMD_ERROR;
+
+    int total = (int)((n_bytes + COM_FRAME_MAX_LEN - 1) / COM_FRAME_MAX_LEN);
+    if(total > UINT16_MAX)
+    {
+        LOGE(tag, "File %s too large (%d frames)", name, total);
         return CMD_ERROR;
     }
+    uint16_t fileid = com_file_id(name, n_bytes);
+
+    // Links with a large MTU send several data frames in one SFP frame
+    com_link_t link;
+    com_link_get(node, &link);
+    int per_frame = link.mtu > COM_FRAME_MAX_LEN ? link.mtu / COM_FRAME_MAX_LEN : 1;
 
-    // Send the file data
-    while(n_bytes >= COM_FRAME_MAX_LEN)
+    // New connection
+    csp_conn_t *conn;
+    conn = com_connect(node, SCH_TRX_PORT_FILE, 500);
+    if(conn == NULL)
+        return CMD_ERROR;
+
+    // Start with the file name and size, so every pass can create or resume
+    // the file in the receiver
+    uint8_t start[COM_FRAME_MAX_LEN];
+    size_t name_len = strnlen(name, COM_FRAME_MAX_LEN - sizeof(uint32_t) - 1);
+    uint32_t size = csp_hton32((uint32_t)n_bytes);
+    memcpy(start, name, name_len);
+    start[name_len] = '\0';
+    memcpy(start + name_len + 1, &size, sizeof(size));
+    int rc_send = _com_send_file_frame(conn, TM_TYPE_FILE_START, fileid, 0, total,
+                                       start, name_len + 1 + sizeof(size));
+
+    // Send all the frames, or the requested ones, up to per_frame
+    // consecutive frames at once. The last frame sent is marked as FILE_END,
+    // so the receiver requests the missing frames
+    const char *next_part = parts;
+    int first = 0, last = total - 1;
+    int pending = -1, n_pending = 0;
+    while(rc_send != 0 && (parts == NULL || _com_file_next_part(&next_part, &first, &last)))
     {
-        size_t bytes_sent = COM_FRAME_MAX_LEN;
-        // Create packet and frame
-        csp_packet_t *packet = csp_buffer_get(sizeof(com_frame_file_t));
-        packet->length = sizeof(com_frame_file_t);
-        com_frame_file_t *frame = (com_frame_file_t *)(packet->data);
-        frame->node = SCH_COMM_ADDRESS;
-        frame->nframe = csp_hton16((uint16_t)nframe++);
-        frame->type = TM_TYPE_FILE_DATA;
-        frame->fileid = csp_hton16(fileid);
-        frame->total = csp_hton16(total_frames);
-        memcpy(frame->data, data, bytes_sent);
-        // Send packet
-        rc_send = csp_send(conn, packet, 500);
-        if(rc_send == 0)
+        int i, n;
+        for(i = first; i <= last && i < total && rc_send != 0; i += n)
         {
-            LOGE(tag, "Error sending frame! (%d)", rc_send);
-            csp_buffer_free(packet);
-            rc_conn = csp_close(conn);
-            return CMD_ERROR;
+            n = per_frame;
+            if(n > last - i + 1)
+                n = last - i + 1;
+            if(n > total - i)
+                n = total - i;
+            if(pending >= 0)
+                rc_send = _com_send_file_frames(conn, TM_TYPE_FILE_DATA, fileid, pending, n_pending, total,
+                                                (uint8_t *)data, n_bytes);
+            pending = i;
+            n_pending = n;
         }
+        if(parts == NULL)
+            break;
+    }
+    if(rc_send != 0 && pending >= 0)
+        rc_send = _com_send_file_frames(conn, TM_TYPE_FILE_END, fileid, pending, n_pending, total,
+                                        (uint8_t *)data, n_bytes);
+    LOGI(tag, "File %s (id %d, %d frames) sent to node %d", name, fileid, total, node);
 
-        // Process more data
-        n_bytes -= bytes_sent;
-        data += bytes_sent;
+    // Close connection
+    int rc_conn = csp_close(conn);
+    if(rc_conn != CSP_ERR_NONE)
+        LOGE(tag, "Error closing connection! (%d)", rc_conn);
+
+    return rc_send != 0 && rc_conn == CSP_ERR_NONE ? CMD_OK : CMD_ERROR;
+}
 
-        if(nframe%SCH_COM_MAX_PACKETS == 0)
-            osDelay(SCH_COM_TX_DELAY_MS);
+csp_conn_t *com_connect(int node, int port, uint32_t timeout)
+{
+    com_link_t link;
+    com_link_get(node, &link);
+    if(!link.rdp || !com_link_sem_ok)
+        return csp_connect(CSP_PRIO_NORM, (uint8_t)node, (uint8_t)port, timeout, CSP_O_NONE);
+
+#ifdef CSP_USE_RDP
+    // The window is read when the connection opens, the link mutex keeps
+    // the options until then
+    unsigned int window, conn_timeout, packet_timeout, delayed_acks, ack_timeout, ack_count;
+    osSemaphoreTake(&com_link_sem, portMAX_DELAY);
+    csp_rdp_get_opt(&window, &conn_timeout, &packet_timeout, &delayed_acks, &ack_timeout, &ack_count);
+    csp_rdp_set_opt((unsigned int)link.window, conn_timeout, packet_timeout, delayed_acks, ack_timeout, ack_count);
+    csp_conn_t *conn = csp_connect(CSP_PRIO_NORM, (uint8_t)node, (uint8_t)port, timeout, CSP_O_RDP);
+    csp_rdp_set_opt(window, conn_timeout, packet_timeout, delayed_acks, ack_timeout, ack_count);
+    osSemaphoreGiven(&com_link_sem);
+    return conn;
+#else
+    LOGW(tag, "No RDP support, node %d link uses a plain connection", node);
+    return csp_connect(CSP_PRIO_NORM, (uint8_t)node, (uint8_t)port, timeout, CSP_O_NONE);
+#endif
+}
+
+/**
+ * Find the links table entry of a node. Call with com_link_sem taken.
+ * @return Entry index, 0 if the node uses the default link
+ */
+static int _com_link_find(int node)
+{
+    int i;
+    for(i=1; node >= 0 && i <= SCH_COM_LINKS; i++)
+    {
+        if(com_links[i].node == node)
+            return i;
     }
+    return 0;
+}
 
-    // Send last frame
-    size_t bytes_sent = n_bytes;
-    packet = csp_buffer_get(sizeof(com_frame_file_t));
-    packet->length = sizeof(com_frame_file_t);
-    frame = (com_frame_file_t *)(packet->data);
-    frame->node = SCH_COMM_ADDRESS;
-    frame->nframe = csp_hton16((uint16_t)nframe++);
-    frame->type = TM_TYPE_FILE_END;
-    frame->fileid = csp_hton16(fileid);
-    frame->total = csp_hton16(total_frames);
-    memcpy(frame->data, data, bytes_sent);
-    // Fill frame
-    LOGI(tag, "Last frame include %d bytes!", bytes_sent);
-    if(bytes_sent < COM_FRAME_MAX_LEN)
-        memset(frame->data+bytes_sent, 0xAA, COM_FRAME_MAX_LEN-bytes_sent);
-    // Send packet
-    rc_send = csp_send(conn, packet, 500);
-    if(rc_send == 0)
+int com_link_set(int node, int rdp, int window, int mtu)
+{
+#ifdef CSP_RDP_MAX_WINDOW
+    int max_window = CSP_RDP_MAX_WINDOW;
+#else
+    int max_window = INT_MAX;
+#endif
+    if(!com_link_sem_ok || node < -1 || node > 255 || (rdp != 0 && rdp != 1) || window < 1 ||
+       window > max_window || mtu < 0 || mtu > COM_LINK_MTU_MAX)
+        return -1;
+
+    int rc = 0;
+    osSemaphoreTake(&com_link_sem, portMAX_DELAY);
+    int i = _com_link_find(node);
+    const com_link_t *dft = &com_links[0];
+    int is_default = node >= 0 && rdp == dft->rdp && window == dft->window && mtu == dft->mtu;
+    if(node >= 0 && i == 0 && !is_default)
     {
-        LOGE(tag, "Error sending frame! (%d)", rc_send);
-        csp_buffer_free(packet);
-        rc_conn = csp_close(conn);
-        return CMD_ERROR;
+        // New entry
+        for(i=1; i <= SCH_COM_LINKS && com_links[i].node >= 0; i++);
+        if(i > SCH_COM_LINKS)
+            rc = -1;
     }
+    if(rc == 0 && (i > 0 || node < 0))
+    {
+        com_links[i].node = is_default ? -2 : node;
+        com_links[i].rdp = rdp;
+        com_links[i].window = window;
+        com_links[i].mtu = mtu;
+    }
+    osSemaphoreGiven(&com_link_sem);
+    return rc;
+}
 
-    // Close connection
-    rc_conn = csp_close(conn);
-    if(rc_conn != CSP_ERR_NONE)
-        LOGE(tag, "Error closing connection! (%d)", rc_conn);
+void com_link_get(int node, com_link_t *link)
+{
+    if(!com_link_sem_ok)
+    {
+        link->node = -1;
+        link->rdp = SCH_COM_LINK_RDP;
+        link->window = SCH_COM_LINK_WINDOW;
+        link->mtu = SCH_COM_LINK_MTU;
+        return;
+    }
+    osSemaphoreTake(&com_link_sem, portMAX_DELAY);
+    *link = com_links[_com_link_find(node)];
+    osSemaphoreGiven(&com_link_sem);
+}
 
-    return rc_send == 1 && rc_conn == CSP_ERR_NONE ? CMD_OK : CMD_ERROR;
+void com_tx_pace(size_t len)
+{
+    if(!com_tx_sem_ok)
+        return;
+
+    int64_t ticks_per_s = osDefineTime(1000);
+    int64_t need = ((int64_t)len + COM_TX_OVERHEAD)*1000;
+    int64_t wait_ms;
+    do
+    {
+        // Link rate in bytes/s, that is milli-bytes per millisecond
+        int64_t baud = dat_get_system_var(dat_com_baud);
+        int64_t rate = (baud > 0 ? baud : SCH_TX_BAUD)*SCH_COM_TX_LOAD/800;
+        if(rate < 1)
+            rate = 1;
+
+        osSemaphoreTake(&com_tx_sem, portMAX_DELAY);
+        int64_t elapsed_ms = (int64_t)(portTick)(osTaskGetTickCount() - com_tx_last)*1000/ticks_per_s;
+        if(elapsed_ms > 0)
+        {
+            com_tx_last += (portTick)(elapsed_ms*ticks_per_s/1000);
+            com_tx_tokens += elapsed_ms*rate;
+            if(com_tx_tokens > COM_TX_BURST)
+                com_tx_tokens = COM_TX_BURST;
+        }
+        // A packet goes if there are tokens left, larger packets leave a debt
+        wait_ms = 0;
+        if(com_tx_tokens > 0)
+            com_tx_tokens -= need;
+        else
+            wait_ms = -com_tx_tokens/rate + 1;
+        osSemaphoreGiven(&com_tx_sem);
+
+        if(wait_ms > 0)
+            osDelay((uint32_t)wait_ms);
+    } while(wait_ms > 0);
+
+    // The radio queue holds the CSP buffers until the packets are sent
+    int waited_ms = 0;
+    while(csp_buffer_remaining() < SCH_COM_TX_MIN_BUFFERS + SCH_COM_ACK_BUFFERS && waited_ms < SCH_COM_TX_DELAY_MS)
+    {
+        osDelay(10);
+        waited_ms += 10;
+    }
+    if(waited_ms >= SCH_COM_TX_DELAY_MS)
+        LOGW(tag, "TX pacer: only %d CSP buffers free", csp_buffer_remaining());
 }
 
+csp_packet_t *com_buffer_get(size_t size, int reply)
+{
+    // The reserve is only checked, not taken, the pool is shared with LibCSP
+    int remaining = csp_buffer_remaining();
+    csp_packet_t *packet = NULL;
+    if(reply || remaining > SCH_COM_ACK_BUFFERS)
+        packet = csp_buffer_get(size);
+
+    if(!com_buf_sem_ok)
+        return packet;
+    osSemaphoreTake(&com_buf_sem, portMAX_DELAY);
+    if(packet != NULL)
+    {
+        com_buf_stats.gets++;
+        remaining--;
+    }
+    else if(reply || remaining > SCH_COM_ACK_BUFFERS)
+        com_buf_stats.fails++;
+    else
+        com_buf_stats.reserved++;
+    if(remaining >= 0 && (uint32_t)remaining < com_buf_stats.min_free)
+        com_buf_stats.min_free = (uint32_t)remaining;
+    osSemaphoreGiven(&com_buf_sem);
+
+    if(packet == NULL)
+        LOGW(tag, "No CSP buffers (%d free, %s)", remaining, reply ? "reply" : "reserved for replies");
+    return packet;
+}
 
-void _hton32_buff(uint32_t *buff, int len)
+void com_buffer_get_stats(com_buffer_stats_t *stats, int reset)
+{
+    memset(stats, 0, sizeof(com_buffer_stats_t));
+    if(!com_buf_sem_ok)
+        return;
+    int remaining = csp_buffer_remaining();
+    osSemaphoreTake(&com_buf_sem, portMAX_DELAY);
+    *stats = com_buf_stats;
+    if(reset)
+    {
+        memset(&com_buf_stats, 0, sizeof(com_buf_stats));
+        com_buf_stats.min_free = (uint32_t)remaining;
+    }
+    osSemaphoreGiven(&com_buf_sem);
+    stats->size = SCH_BUFFERS_CSP;
+    stats->free = (uint32_t)remaining;
+    if(stats->min_free > stats->free)
+        stats->min_free = stats->free;
+}
+
+/**
+ * Swap the bytes of 32bit values in place. A plain loop over bswap, so the
+ * compiler can vectorize it
+ */
+static void _bswap32_buff(uint32_t *buff, int len)
 {
     int i;
     for(i=0; i<len; i++)
-        buff[i] = csp_hton32(buff[i]);
+        buff[i] = __builtin_bswap32(buff[i]);
+}
+
+void _hton32_buff(uint32_t *buff, int len)
+{
+#if COM_HOST_LE
+    _bswap32_buff(buff, len);
+#endif
 }
 
 void _ntoh32_buff(uint32_t *buff, int len)
 {
-    int i;
-    for(i=0; i<len; i++)
-        buff[i] = csp_ntoh32(buff[i]);
+#if COM_HOST_LE
+    _bswap32_buff(buff, len);
+#endif
+}
+
+uint16_t com_tm_hton16(uint16_t value)
+{
+    return COM_FRAME_ORDER ? value : csp_hton16(value);
+}
+
+uint32_t com_tm_hton32(uint32_t value)
+{
+    return COM_FRAME_ORDER ? value : csp_hton32(value);
+}
+
+void com_tm_hton32_buff(uint32_t *buff, int len)
+{
+    if(!COM_FRAME_ORDER)
+        _hton32_buff(buff, len);
+}
+
+/**
+ * Check if the data of a received frame needs a byte swap to host order
+ */
+static int com_frame_swapped(const com_frame_t *frame)
+{
+    int frame_le = (frame->nframe & COM_FRAME_LE) != 0;
+    return frame_le != COM_HOST_LE;
+}
+
+uint16_t com_frame_ntoh16(const com_frame_t *frame, uint16_t value)
+{
+    return com_frame_swapped(frame) ? __builtin_bswap16(value) : value;
+}
+
+uint32_t com_frame_ntoh32(const com_frame_t *frame, uint32_t value)
+{
+    return com_frame_swapped(frame) ? __builtin_bswap32(value) : value;
+}
+
+void com_frame_ntoh32_buff(const com_frame_t *frame, uint32_t *buff, int len)
+{
+    if(com_frame_swapped(frame))
+        _bswap32_buff(buff, len);
 }
 
 int com_debug(char *fmt, char *params, int nparams)
@@ -464,6 +939,116 @@ int com_debug(char *fmt, char *params, int nparams)
     return CMD_OK;
 }
 
+int com_buffer_stats(char *fmt, char *params, int nparams)
+{
+    int reset = 0;
+    if(params != NULL && cmd_scan_params(fmt, params, &reset) == 0)
+        return CMD_SYNTAX_ERROR;
+
+    com_buffer_stats_t stats;
+    com_buffer_get_stats(&stats, reset);
+    LOGR(tag, "CSP buffers: size %u, free %u, min free %u, gets %u, fails %u, reserved %u",
+         stats.size, stats.free, stats.min_free, stats.gets, stats.fails, stats.reserved);
+    return CMD_OK;
+}
+
+void com_frame_seal(csp_packet_t *packet)
+{
+#if SCH_COM_FRAME_CRC
+    if(packet->length + COM_FRAME_CRC_LEN > (size_t)csp_buffer_size())
+        return;
+    com_frame_t *frame = (com_frame_t *)packet->data;
+    frame->nframe |= csp_hton16(COM_FRAME_CRC);
+    uint32_t crc = csp_hton32(crc32c_update(0, packet->data, packet->length));
+    memcpy(packet->data + packet->length, &crc, sizeof(crc));
+    packet->length += COM_FRAME_CRC_LEN;
+#endif
+}
+
+int com_frame_check(csp_packet_t *packet)
+{
+    com_frame_t *frame = (com_frame_t *)packet->data;
+    if(packet->length < sizeof(frame->nframe) || !(csp_ntoh16(frame->nframe) & COM_FRAME_CRC))
+        return 0;
+
+    uint32_t crc = 0;
+    int len = (int)packet->length - (int)COM_FRAME_CRC_LEN;
+    if(len >= (int)offsetof(com_frame_t, data))
+        memcpy(&crc, packet->data + len, sizeof(crc));
+    if(len < (int)offsetof(com_frame_t, data) || crc32c_update(0, packet->data, (size_t)len) != csp_ntoh32(crc))
+    {
+        __atomic_add_fetch(&com_crc_errors, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    frame->nframe &= ~csp_hton16(COM_FRAME_CRC);
+    packet->length = (uint16_t)len;
+    return 0;
+}
+
+uint32_t com_frame_crc_errors(int reset)
+{
+    if(reset)
+        return __atomic_exchange_n(&com_crc_errors, 0, __ATOMIC_RELAXED);
+    return __atomic_load_n(&com_crc_errors, __ATOMIC_RELAXED);
+}
+
+int com_crc_stats(char *fmt, char *params, int nparams)
+{
+    int reset = 0;
+    if(params != NULL && cmd_scan_params(fmt, params, &reset) == 0)
+        return CMD_SYNTAX_ERROR;
+
+    uint32_t frames = com_frame_crc_errors(reset);
+    uint32_t samples = dat_get_payload_crc_errors(reset);
+    LOGR(tag, "CRC errors: TM frames %u, payload samples %u (%s)", frames, samples, crc32c_impl());
+    return CMD_OK;
+}
+
+int com_rpt_stats(char *fmt, char *params, int nparams)
+{
+    int reset = 0;
+    if(params != NULL && cmd_scan_params(fmt, params, &reset) == 0)
+        return CMD_SYNTAX_ERROR;
+
+    rpt_stats_t st;
+    rpt_get_stats(&st, reset);
+    LOGR(tag, "Repeater: queued %u, forwarded %u, rate limited %u, queue full %u, errors %u",
+         (unsigned int)st.queued, (unsigned int)st.forwarded, (unsigned int)st.limited,
+         (unsigned int)st.full, (unsigned int)st.errors);
+    LOGR(tag, "Repeater store: held %u, stored %u, overwritten %u", (unsigned int)st.held,
+         (unsigned int)st.stored, (unsigned int)st.overwritten);
+    return CMD_OK;
+}
+
+#if SCH_TASK_TRK_ENABLED
+int com_track_status(char *fmt, char *params, int nparams)
+{
+    int reset = 0;
+    if(params != NULL && cmd_scan_params(fmt, params, &reset) == 0)
+        return CMD_SYNTAX_ERROR;
+
+    trk_state_t st;
+    trk_get_state(&st, reset);
+    LOGR(tag, "Tracking %d at %ld.%03d: az %.2f el %.2f, range %.3f km, range rate %.4f km/s, rx %u tx %u Hz",
+         st.tracking, (long)st.ts, st.ms, st.look.az, st.look.el, st.look.range, st.look.range_rate,
+         (unsigned int)st.rx_freq, (unsigned int)st.tx_freq);
+    LOGR(tag, "Updates %u, no orbit %u, frequencies sent %u, dropped %u", (unsigned int)st.updates,
+         (unsigned int)st.no_orbit, (unsigned int)st.sent, (unsigned int)st.dropped);
+    return CMD_OK;
+}
+
+int com_track_freq(char *fmt, char *params, int nparams)
+{
+    unsigned int rx_freq, tx_freq;
+    if(params == NULL || cmd_scan_params(fmt, params, &rx_freq, &tx_freq) != nparams)
+        return CMD_SYNTAX_ERROR;
+
+    trk_set_freq((uint32_t)rx_freq, (uint32_t)tx_freq);
+    LOGR(tag, "Tracking nominal frequencies: rx %u tx %u Hz", rx_freq, tx_freq);
+    return CMD_OK;
+}
+#endif
+
 int com_set_node(char *fmt, char *params, int nparams)
 {
     if(params == NULL)
@@ -473,7 +1058,7 @@ int com_set_node(char *fmt, char *params, int nparams)
     }
 
     int node;
-    if(sscanf(params, fmt, &node) == nparams)
+    if(cmd_scan_params(fmt, params, &node) == nparams)
     {
         trx_node = node;
         LOGR(tag, "TRX node set to %d", node);
@@ -491,7 +1076,7 @@ int com_get_node(char *fmt, char *params, int nparams)
 int com_set_time_node(char *fmt, char *params, int nparams)
 {
     int node;
-    if(params == NULL || sscanf(params, fmt, &node) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &node) != nparams)
     {
         LOGE(tag, "Error parsing params!");
         return CMD_SYNTAX_ERROR;
@@ -503,13 +1088,47 @@ int com_set_time_node(char *fmt, char *params, int nparams)
     com_send_cmd("%d %n", cmd, 2);
 }
 
+int com_set_link(char *fmt, char *params, int nparams)
+{
+    int node, rdp, window, mtu;
+    if(params == NULL || cmd_scan_params(fmt, params, &node, &rdp, &window, &mtu) != nparams)
+        return CMD_SYNTAX_ERROR;
+    if(com_link_set(node, rdp, window, mtu) != 0)
+    {
+        LOGE(tag, "Invalid link or links table full (node %d, rdp %d, window %d, mtu %d)", node, rdp, window, mtu);
+        return CMD_ERROR;
+    }
+    return CMD_OK;
+}
+
+int com_get_link(char *fmt, char *params, int nparams)
+{
+    if(!com_link_sem_ok)
+        return CMD_ERROR;
+    com_link_t links[SCH_COM_LINKS+1];
+    osSemaphoreTake(&com_link_sem, portMAX_DELAY);
+    memcpy(links, com_links, sizeof(links));
+    osSemaphoreGiven(&com_link_sem);
+
+    int i;
+    LOGR(tag, "Node RDP Window MTU");
+    for(i=0; i <= SCH_COM_LINKS; i++)
+    {
+        if(i == 0 || links[i].node >= 0)
+        {
+            LOGR(tag, "%4d %3d %6d %4d", links[i].node, links[i].rdp, links[i].window, links[i].mtu);
+        }
+    }
+    return CMD_OK;
+}
+
 int com_set_tle_node(char *fmt, char *params, int nparams)
 {
     char sat[50]; // TLE sat max name is 24
     int rc, node;
     memset(sat, 0, 50);
     // fmt: %s
-    if(params == NULL || sscanf(params, fmt, &node, sat) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &node, sat) != nparams)
     {
         LOGE(tag, "Error parsing params!");
         return CMD_SYNTAX_ERROR;
@@ -605,7 +1224,7 @@ int com_reset_wdt(char *fmt, char *params, int nparams)
     int rc, node, n_args = 0;
 
     // If no params received, try to reset the default trx_node node
-    if(params == NULL || sscanf(params, fmt, &node) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &node) != nparams)
         node = (int)trx_node;
 
     // Send and empty message to GNDWDT_RESET (9) port
@@ -643,7 +1262,7 @@ int com_get_config(char *fmt, char *params, int nparams)
     }
 
     // Format: <table> <param_name>
-    n_args = sscanf(params, fmt, &table, &param);
+    n_args = cmd_scan_params(fmt, params, &table, &param);
     if(n_args == nparams)
     {
         param_table_t *param_i;
@@ -666,10 +1285,9 @@ int com_get_config(char *fmt, char *params, int nparams)
             return CMD_ERROR;
         }
 
-        // Actually get the parameter value
-        void *out = malloc(param_i->size);
-        rc = rparam_get_single(out, param_i->addr, param_i->type, param_i->size,
-                table, trx_node, AX100_PORT_RPARAM, 1000);
+        // Actually get the parameter value, from the cache if recent
+        void *out = sch_malloc(MEM_COM, param_i->size);
+        rc = _com_config_get(param_i, table, out);
 
         // Process the answer
         if(rc > 0)
@@ -677,13 +1295,13 @@ int com_get_config(char *fmt, char *params, int nparams)
             char param_str[SCH_CMD_MAX_STR_PARAMS];
             param_to_string(param_i, param_str, 0, out, 1, SCH_CMD_MAX_STR_PARAMS) ;
             LOGR(tag, "Param %s (table %d): %s", param_i->name, table, param_str);
-            free(out);
+            sch_free(out);
             return CMD_OK;
         }
         else
         {
             LOGE(tag, "Error getting parameter %s! (rc: %d)", param, rc);
-            free(out);
+            sch_free(out);
             return CMD_ERROR;
         }
     }
@@ -706,7 +1324,7 @@ int com_set_config(char *fmt, char *params, int nparams)
     }
 
     // Format: <param_name> <value>
-    n_args = sscanf(params, fmt, &table, &param, &value);
+    n_args = cmd_scan_params(fmt, params, &table, &param, &value);
     if(n_args == nparams)
     {
         param_table_t *param_i;
@@ -730,10 +1348,9 @@ int com_set_config(char *fmt, char *params, int nparams)
         }
 
         // Actually get the parameter value
-        void *out = malloc(param_i->size);
+        void *out = sch_malloc(MEM_COM, param_i->size);
         param_from_string(param_i, value, out);
-        rc = rparam_set_single(out, param_i->addr, param_i->type, param_i->size,
-                               table, trx_node, AX100_PORT_RPARAM, 1000);
+        rc = _com_config_set(param_i, table, out);
 
         // Process the answer
         if(rc > 0)
@@ -741,13 +1358,13 @@ int com_set_config(char *fmt, char *params, int nparams)
             char param_str[SCH_CMD_MAX_STR_PARAMS];
             param_to_string(param_i, param_str, 0, out, 1, SCH_CMD_MAX_STR_PARAMS);
             LOGR(tag, "Param %s (table %d) set to: %s", param_i->name, table, param_str);
-            free(out);
+            sch_free(out);
             return CMD_OK;
         }
         else
         {
             LOGE(tag, "Error setting parameter %s! (rc: %d)", param, rc);
-            free(out);
+            sch_free(out);
             return CMD_ERROR;
         }
     }
@@ -775,12 +1392,14 @@ int com_update_status_vars(char *fmt, char *params, int nparams)
 
         // Warning if the parameter name was not found
         if(param_i == NULL)
+        {
             LOGE(tag, "Parameter (%d) %s not found!", table, names[i]);
+            continue;
+        }
 
-        // Actually get the parameter value
-        void *out = malloc(param_i->size);
-        rc = rparam_get_single(out, param_i->addr, param_i->type, param_i->size,
-                               table, trx_node, AX100_PORT_RPARAM, 1000);
+        // Actually get the parameter value, from the cache if recent
+        void *out = sch_malloc(MEM_COM, param_i->size);
+        rc = _com_config_get(param_i, table, out);
 
         // Process the answer, save value to status variables
         if(rc > 0)
@@ -793,10 +1412,68 @@ int com_update_status_vars(char *fmt, char *params, int nparams)
                 LOGE(tag, "Error casting status variable");
 
             LOGR(tag, "Param %s (table %d) %d", param_i->name, table, dat_get_system_var(vars[i]));
-            free(out);
         }
+        sch_free(out);
+    }
+
+    return CMD_OK;
+}
+
+int com_load_config(char *fmt, char *params, int nparams)
+{
+    int table;
+    if(params == NULL || cmd_scan_params(fmt, params, &table) != nparams)
+        return CMD_SYNTAX_ERROR;
+
+    param_table_t *list;
+    int count;
+    if(table == AX100_PARAM_RUNNING)
+    {
+        list = ax100_config;
+        count = ax100_config_count;
+    }
+    else if(table == AX100_PARAM_RX)
+    {
+        list = ax100_rx_config;
+        count = ax100_config_rx_count;
     }
+    else if(table == AX100_PARAM_TX(0))
+    {
+        list = ax100_tx_config;
+        count = ax100_config_tx_count;
+    }
+    else
+    {
+        LOGE(tag, "Unknown table %d", table);
+        return CMD_SYNTAX_ERROR;
+    }
+
+    // Refresh the whole table, later gets are answered from the cache
+    int i, errors = 0;
+    for(i=0; i<count; i++)
+    {
+        if(list[i].size > COM_CONFIG_VALUE_MAX)
+            continue;
+        uint8_t out[COM_CONFIG_VALUE_MAX];
+        int rc = rparam_get_single(out, list[i].addr, list[i].type, list[i].size,
+                                   table, trx_node, AX100_PORT_RPARAM, 1000);
+        if(rc > 0)
+            _com_config_store(&list[i], table, out);
+        else
+            errors++;
+    }
+
+    LOGR(tag, "Loaded table %d: %d parameters, %d errors", table, count, errors);
+    return errors == 0 ? CMD_OK : CMD_ERROR;
+}
 
+int com_clear_config(char *fmt, char *params, int nparams)
+{
+    if(com_config_sem_ok)
+        osSemaphoreTake(&com_config_sem, portMAX_DELAY);
+    memset(com_config_cache, 0, sizeof(com_config_cache));
+    if(com_config_sem_ok)
+        osSemaphoreGiven(&com_config_sem);
     return CMD_OK;
 }
 
@@ -892,11 +1569,131 @@ void _com_config_find(char *param_name, int table, param_table_t **param)
     return;
 }
 
+/**
+ * Cache entry of a parameter, NULL if it is not cached. Call with
+ * com_config_sem taken.
+ */
+static com_config_entry_t *_com_config_entry(param_table_t *param, int table)
+{
+    int i;
+    for(i = 0; i < COM_CONFIG_CACHE_LEN; i++)
+    {
+        if(com_config_cache[i].param == param && com_config_cache[i].table == table)
+            return &com_config_cache[i];
+    }
+    return NULL;
+}
+
+/**
+ * Save the last known value of a parameter in the cache, replacing the oldest
+ * entry if the cache is full.
+ */
+static void _com_config_store(param_table_t *param, int table, const void *value)
+{
+    if(param->size > COM_CONFIG_VALUE_MAX)
+        return;
+
+    if(com_config_sem_ok)
+        osSemaphoreTake(&com_config_sem, portMAX_DELAY);
+    portTick now = osTaskGetTickCount();
+    com_config_entry_t *entry = _com_config_entry(param, table);
+    int i;
+    for(i = 0; entry == NULL && i < COM_CONFIG_CACHE_LEN; i++)
+    {
+        if(com_config_cache[i].param == NULL)
+            entry = &com_config_cache[i];
+    }
+    if(entry == NULL)
+    {
+        entry = &com_config_cache[0];
+        for(i = 1; i < COM_CONFIG_CACHE_LEN; i++)
+        {
+            if((portTick)(now - com_config_cache[i].time) > (portTick)(now - entry->time))
+                entry = &com_config_cache[i];
+        }
+    }
+    entry->param = param;
+    entry->table = table;
+    entry->time = now;
+    memcpy(entry->value, value, param->size);
+    if(com_config_sem_ok)
+        osSemaphoreGiven(&com_config_sem);
+}
+
+/**
+ * Get a TRX parameter. The value is answered from the cache if it was read or
+ * set in the last SCH_COM_CONFIG_CACHE_S seconds, otherwise it is read from
+ * the TRX and cached.
+ *
+ * @param param Parameter, see _com_config_find
+ * @param table Parameter table
+ * @param out Buffer of param->size bytes for the value
+ * @return > 0 if OK, as rparam_get_single
+ */
+static int _com_config_get(param_table_t *param, int table, void *out)
+{
+    int cached = 0;
+    if(com_config_sem_ok)
+        osSemaphoreTake(&com_config_sem, portMAX_DELAY);
+    com_config_entry_t *entry = _com_config_entry(param, table);
+    if(entry != NULL && SCH_COM_CONFIG_CACHE_S > 0 &&
+       (portTick)(osTaskGetTickCount() - entry->time) <= osDefineTime(SCH_COM_CONFIG_CACHE_S*1000))
+    {
+        memcpy(out, entry->value, param->size);
+        cached = 1;
+    }
+    if(com_config_sem_ok)
+        osSemaphoreGiven(&com_config_sem);
+    if(cached)
+        return 1;
+
+    int rc = rparam_get_single(out, param->addr, param->type, param->size,
+                               table, trx_node, AX100_PORT_RPARAM, 1000);
+    if(rc > 0)
+        _com_config_store(param, table, out);
+    return rc;
+}
+
+/**
+ * Set a TRX parameter. The request is not sent if the cache is recent and
+ * already has the same value.
+ *
+ * @param param Parameter, see _com_config_find
+ * @param table Parameter table
+ * @param in New value, param->size bytes
+ * @return > 0 if OK, as rparam_set_single
+ */
+static int _com_config_set(param_table_t *param, int table, void *in)
+{
+    int same = 0;
+    if(com_config_sem_ok)
+        osSemaphoreTake(&com_config_sem, portMAX_DELAY);
+    com_config_entry_t *entry = _com_config_entry(param, table);
+    if(entry != NULL && SCH_COM_CONFIG_CACHE_S > 0 &&
+       (portTick)(osTaskGetTickCount() - entry->time) <= osDefineTime(SCH_COM_CONFIG_CACHE_S*1000))
+        same = memcmp(entry->value, in, param->size) == 0;
+    if(entry != NULL && !same)
+        entry->param = NULL;  // Unknown value until the TRX answers
+    if(com_config_sem_ok)
+        osSemaphoreGiven(&com_config_sem);
+    if(same)
+    {
+        LOGD(tag, "Param %s (table %d) unchanged", param->name, table);
+        return 1;
+    }
+
+    int rc = rparam_set_single(in, param->addr, param->type, param->size,
+                               table, trx_node, AX100_PORT_RPARAM, 1000);
+    if(rc > 0)
+        _com_config_store(param, table, in);
+    return rc;
+}
+
 int com_set_beacon(char *fmt, char *params, int nparams)
 {
     int period;
     int offset;
-    if(params == NULL || sscanf(params, fmt, &period, &offset) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &period, &offset) != nparams)
     {
         LOGE(tag, "Error parsing params!");
         return CMD_SYNTAX_ERROR;
@@ -18,6 +18,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_TAG_ID LOG_TAG_CONSOLE
 #include "cmdConsole.h"
 
 static const char *tag = "cmdConsole";
@@ -27,6 +28,7 @@ void cmd_console_init(void)
     cmd_add("test", con_debug_msg, "%s", 1);
     cmd_add("help", con_help, "", 0);
     cmd_add("log_set", con_set_logger, "%d %d", 2);
+    cmd_add("log_set_tag", con_set_tag_logger, "%s %d", 2);
 }
 
 /**
@@ -58,7 +60,7 @@ int con_set_logger(char *fmt, char *params, int nparams)
     int lvl;
     int node;
 
-    if(params == NULL || (sscanf(params, fmt, &lvl, &node) != nparams))
+    if(params == NULL || (cmd_scan_params(fmt, params, &lvl, &node) != nparams))
         return CMD_SYNTAX_ERROR;
 
     if(lvl > LOG_LVL_VERBOSE)
@@ -67,4 +69,26 @@ int con_set_logger(char *fmt, char *params, int nparams)
     log_set((log_level_t)lvl, node);
     LOGR(tag, "Log level %d to node %d", log_lvl, log_node);
     return CMD_OK;
-}
\ No newline at end of file
+}
+
+int con_set_tag_logger(char *fmt, char *params, int nparams)
+{
+    char name[SCH_CMD_MAX_STR_NAME];
+    int lvl;
+
+    if(params == NULL || strlen(params) >= SCH_CMD_MAX_STR_NAME || (cmd_scan_params(fmt, params, name, &lvl) != nparams))
+        return CMD_SYNTAX_ERROR;
+
+    int id = log_get_tag_id(name);
+    if(id < 0 || lvl < LOG_LVL_NONE || lvl > LOG_LVL_VERBOSE)
+    {
+        LOGE(tag, "log_set_tag used with invalid params: %s", params);
+        return CMD_ERROR;
+    }
+
+    log_set_tag(id, (log_level_t)lvl);
+    if(lvl > SCH_LOG_LVL_MAX)
+        LOGW(tag, "Log level %d of %s is above the compiled in level %d", lvl, name, SCH_LOG_LVL_MAX);
+    LOGR(tag, "Log level %d to tag %s", lvl, name);
+    return CMD_OK;
+}
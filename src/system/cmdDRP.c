@@ -36,6 +36,10 @@ void cmd_drp_init(void)
     cmd_add("drp_add_hrs_alive", drp_update_hours_alive, "%d", 1);
     cmd_add("drp_clear_gnd_wdt", drp_clear_gnd_wdt, "", 0);
     cmd_add("drp_set_deployed", drp_set_deployed, "%d", 1);
+    cmd_add_coalesce("drp_sync", drp_sync, "", 0);
+    cmd_add_coalesce("drp_trim", drp_trim, "", 0);
+    cmd_add("drp_export", drp_export, "%d %d %d %d %s", 5);
+    cmd_set_class("drp_export", CMD_CLASS_SHARED_IO);
 }
 
 int drp_execute_before_flight(char *fmt, char *params, int nparams)
@@ -44,7 +48,7 @@ int drp_execute_before_flight(char *fmt, char *params, int nparams)
         return CMD_SYNTAX_ERROR;
 
     int magic;
-    if(nparams == sscanf(params, fmt, &magic))
+    if(nparams == cmd_scan_params(fmt, params, &magic))
     {
         if(magic == SCH_DRP_MAGIC)
         {
@@ -56,9 +60,6 @@ int drp_execute_before_flight(char *fmt, char *params, int nparams)
                 rc += dat_set_status_var(index, dat_get_status_var_def(index).value);
             }
 
-            // Update relevant status variables
-            rc += dat_set_system_var(dat_rtc_date_time, (int) time(NULL));
-
             // Delete memory sections
             rc += dat_delete_memory_sections();
 
@@ -89,13 +90,17 @@ int drp_execute_before_flight(char *fmt, char *params, int nparams)
 int drp_print_system_vars(char *fmt, char *params, int nparams)
 {
     LOGD(tag, "Displaying system variables list");
+    // Print a consistent snapshot, read with one repository access
+    value32_t values[dat_status_last_address];
+    if(dat_get_status_vars(0, dat_status_last_address, values) != 0)
+        return CMD_ERROR;
+
     printf("idx, %-20s, value, type\n", "name");
     int i;
     for(i=0; i<dat_status_last_var; i++)
     {
         dat_sys_var_t var = dat_status_list[i];
-        value32_t value = dat_get_status_var(var.address);
-        var.value = value;
+        var.value = values[var.address];
         dat_print_system_var(&var);
     }
     return CMD_OK;
@@ -105,7 +110,7 @@ int drp_update_sys_var_idx(char *fmt, char *params, int nparams)
 {
     int address;
     float value;
-    if(params == NULL || sscanf(params, fmt, &address, &value) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &address, &value) != nparams)
     {
         LOGE(tag, "Error parsing arguments!");
         return CMD_SYNTAX_ERROR;
@@ -146,7 +151,7 @@ int drp_update_sys_var_idx(char *fmt, char *params, int nparams)
 
 int drp_update_sys_var_name(char *fmt, char *params, int nparams)
 {
-    char name[MAX_VAR_NAME];
+    char name[MAX_VAR_NAME+1];  // Room for the null terminator
     float value;
 
     if(params == NULL)
@@ -157,11 +162,11 @@ int drp_update_sys_var_name(char *fmt, char *params, int nparams)
 
     if(strlen(&params[0]) > MAX_VAR_NAME)
     {
-        LOGE(tag, "drp_update_sys_var_name used with invalid name: %s", name);
+        LOGE(tag, "drp_update_sys_var_name used with invalid name: %s", params);
         return CMD_SYNTAX_ERROR;
     }
 
-    if(sscanf(params, fmt, name, &value) != nparams)
+    if(cmd_scan_params(fmt, params, name, &value) != nparams)
     {
         LOGE(tag, "Error parsing arguments!");
         return CMD_SYNTAX_ERROR;
@@ -210,9 +215,9 @@ int drp_get_sys_var_name(char *fmt, char *params, int nparams)
         return CMD_SYNTAX_ERROR;
     }
 
-    char name[MAX_VAR_NAME];
+    char name[MAX_VAR_NAME+1];  // Room for the null terminator
 
-    if(sscanf(params, fmt, name) != nparams)
+    if(cmd_scan_params(fmt, params, name) != nparams)
     {
         LOGE(tag, "Error parsing arguments!");
         return CMD_SYNTAX_ERROR;
@@ -245,16 +250,18 @@ int drp_update_hours_alive(char *fmt, char *params, int nparams)
     int current;  // Current value to update
     int rc;
 
-    if(sscanf(params, fmt, &value) == nparams)
+    if(cmd_scan_params(fmt, params, &value) == nparams)
     {
         // Adds <value> to current hours alive
         current = dat_get_system_var(dat_obc_hrs_alive);
-        current += value;
+        if(__builtin_add_overflow(current, value, &current))
+            return CMD_SYNTAX_ERROR;
         rc = dat_set_system_var(dat_obc_hrs_alive, current);
 
         // Adds <value> to current hours without reset
         current = dat_get_system_var(dat_obc_hrs_wo_reset);
-        current += value;
+        if(__builtin_add_overflow(current, value, &current))
+            return CMD_SYNTAX_ERROR;
         rc += dat_set_system_var(dat_obc_hrs_wo_reset, current);
         if(rc == 0)
             return CMD_OK;
@@ -274,10 +281,22 @@ int drp_clear_gnd_wdt(char *fmt, char *params, int nparams)
     return CMD_OK;
 }
 
+int drp_sync(char *fmt, char *params, int nparams)
+{
+    int rc = dat_repo_sync();
+    return rc == 0 ? CMD_OK : CMD_ERROR;
+}
+
+int drp_trim(char *fmt, char *params, int nparams)
+{
+    int rc = dat_trim_payloads();
+    return rc >= 0 ? CMD_OK : CMD_ERROR;
+}
+
 int drp_set_deployed(char *fmt, char *params, int nparams)
 {
     int deployed;
-    if(params == NULL || sscanf(params, fmt, &deployed) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &deployed) != nparams)
     {
         return CMD_SYNTAX_ERROR;
     }
@@ -285,3 +304,100 @@ int drp_set_deployed(char *fmt, char *params, int nparams)
     int rc = dat_set_system_var(dat_dep_deployed, deployed);
     return rc == 0 ? CMD_OK : CMD_ERROR;
 }
+
+/**
+ * Write the header of a payload export file, @see drp_export
+ * @return 0 if OK, -1 if an error occurred
+ */
+static int _drp_export_header(FILE *fptr, int payload, int node, const dat_payload_schema_t *schema)
+{
+    uint16_t payload_u16 = (uint16_t)payload;
+    uint16_t nfields = (uint16_t)schema->nfields;
+    int32_t node_i32 = node;
+    int ok = fwrite(SCH_DRP_EXPORT_MAGIC, 1, 8, fptr) == 8;
+    ok = ok && fwrite(&payload_u16, sizeof(payload_u16), 1, fptr) == 1;
+    ok = ok && fwrite(&nfields, sizeof(nfields), 1, fptr) == 1;
+    ok = ok && fwrite(&node_i32, sizeof(node_i32), 1, fptr) == 1;
+
+    int j;
+    for(j=0; ok && j < schema->nfields; j++)
+    {
+        const dat_payload_field_t *field = &schema->fields[j];
+        size_t name_len = strlen(field->name);
+        uint8_t desc[3] = {(uint8_t)field->type, (uint8_t)field->size, (uint8_t)name_len};
+        ok = name_len <= UINT8_MAX && fwrite(desc, 1, 3, fptr) == 3;
+        ok = ok && fwrite(field->name, 1, name_len, fptr) == name_len;
+    }
+    return ok ? 0 : -1;
+}
+
+int drp_export(char *fmt, char *params, int nparams)
+{
+    int payload, node, start, end;
+    char path[SCH_CMD_MAX_STR_PARAMS];
+    if(params == NULL || cmd_scan_params(fmt, params, &payload, &node, &start, &end, path) != nparams)
+        return CMD_SYNTAX_ERROR;
+
+    const dat_payload_schema_t *schema = dat_get_payload_schema(payload);
+    if(schema == NULL || start < 0)
+        return CMD_SYNTAX_ERROR;
+    if(node < 0)
+        node = SCH_COMM_ADDRESS;
+    if(end < 0)
+        end = dat_get_payload_index_node(payload, node);
+    if(end < start)
+    {
+        LOGE(tag, "Invalid export range %d - %d of payload %d", start, end, payload);
+        return CMD_ERROR;
+    }
+
+    // Rows are read and written in chunks, so memory stays bounded by the
+    // chunk size whatever the number of samples exported
+    int size = data_map[payload].size;
+    char *rows = malloc(SCH_DRP_EXPORT_CHUNK*size);
+    char *column = malloc(SCH_DRP_EXPORT_CHUNK*sizeof(uint64_t));
+    FILE *fptr = fopen(path, "wb");
+    int rc = (rows && column && fptr) ? _drp_export_header(fptr, payload, node, schema) : -1;
+
+    int index, total = 0;
+    for(index = start; rc == 0 && index < end; index += SCH_DRP_EXPORT_CHUNK)
+    {
+        uint32_t chunk[2];
+        chunk[0] = (uint32_t)(end - index < SCH_DRP_EXPORT_CHUNK ? end - index : SCH_DRP_EXPORT_CHUNK);
+        chunk[1] = (uint32_t)index;
+        int found = dat_get_payload_samples_node(rows, payload, index, (int)chunk[0], node);
+        if(found < 0 || fwrite(chunk, sizeof(chunk), 1, fptr) != 1)
+        {
+            rc = -1;
+            break;
+        }
+        total += found;
+
+        int i, j;
+        for(j=0; rc == 0 && j < schema->nfields; j++)
+        {
+            const dat_payload_field_t *field = &schema->fields[j];
+            for(i=0; i < chunk[0]; i++)
+                memcpy(column + i*field->size, rows + i*size + field->offset, field->size);
+            if(fwrite(column, field->size, chunk[0], fptr) != chunk[0])
+                rc = -1;
+        }
+    }
+
+    // An empty chunk ends the file
+    uint32_t last[2] = {0, (uint32_t)end};
+    if(rc == 0 && fwrite(last, sizeof(last), 1, fptr) != 1)
+        rc = -1;
+    if(fptr != NULL && fclose(fptr) != 0)
+        rc = -1;
+    free(rows);
+    free(column);
+
+    if(rc != 0)
+    {
+        LOGE(tag, "Error exporting payload %d of node %d to %s", payload, node, path);
+        return CMD_ERROR;
+    }
+    LOGI(tag, "Exported %d samples (%d - %d) of payload %d of node %d to %s", total, start, end, payload, node, path);
+    return CMD_OK;
+}
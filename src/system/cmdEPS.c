@@ -22,9 +22,20 @@
 
 static const char *tag = "cmdEPS";
 
+#ifdef SCH_USE_NANOPOWER
+static eps_hk_t eps_hk_cache;       ///< Last EPS housekeeping
+static portTick eps_hk_time;        ///< Time of @eps_hk_cache
+static int eps_hk_valid = 0;        ///< @eps_hk_cache was ever read
+static osSemaphore eps_hk_sem;      ///< Protects the cache, one request at a time
+static int eps_hk_sem_ok = 0;
+#endif
+
 void cmd_eps_init(void)
 {
 #ifdef SCH_USE_NANOPOWER
+    eps_hk_sem_ok = osSemaphoreCreate(&eps_hk_sem) == OS_SEMAPHORE_OK;
+    osSemaphoreSetName(&eps_hk_sem, "eps_hk");
+
     //EPS io driver requires some initialization
     eps_set_node(SCH_EPS_ADDRESS);
     eps_set_timeout(1000);
@@ -40,10 +51,59 @@ void cmd_eps_init(void)
     cmd_add("eps_set_mppt", eps_set_pptmode, "%d", 1);
     cmd_add("eps_reset_wdt", eps_reset_wdt, "", 0);
     cmd_add("eps_update_status", eps_update_status_vars, "", 0);
+
+    // Safety commands preempt queued commands
+    cmd_set_priority("eps_hard_reset", CMD_PRIO_HIGH);
+    cmd_set_priority("eps_reset_wdt", CMD_PRIO_HIGH);
 #endif
 }
 
 #ifdef SCH_USE_NANOPOWER
+int eps_hk_get_cached(eps_hk_t *hk, unsigned int max_age_ms)
+{
+    int rc = 0;
+    if(eps_hk_sem_ok)
+        osSemaphoreTake(&eps_hk_sem, portMAX_DELAY);
+
+    portTick now = osTaskGetTickCount();
+    if(!eps_hk_valid || (portTick)(now - eps_hk_time) > osDefineTime(max_age_ms))
+    {
+        // Callers waiting meanwhile get this same sample
+        eps_hk_t fresh = {};
+        if(eps_hk_get(&fresh) > 0)
+        {
+            eps_hk_cache = fresh;
+            eps_hk_time = osTaskGetTickCount();
+            eps_hk_valid = 1;
+        }
+        else
+        {
+            rc = -1;
+        }
+    }
+    if(rc == 0)
+        *hk = eps_hk_cache;
+
+    if(eps_hk_sem_ok)
+        osSemaphoreGiven(&eps_hk_sem);
+    return rc;
+}
+
+int eps_update_status(unsigned int max_age_ms)
+{
+    eps_hk_t hk;
+    if(eps_hk_get_cached(&hk, max_age_ms) != 0)
+        return -1;
+
+    // From dat_eps_vbatt to dat_eps_temp_bat0 are consecutive
+    value32_t values[dat_eps_temp_bat0-dat_eps_vbatt+1];
+    values[dat_eps_vbatt-dat_eps_vbatt].i = hk.vbatt;
+    values[dat_eps_cur_sun-dat_eps_vbatt].i = hk.cursun;
+    values[dat_eps_cur_sys-dat_eps_vbatt].i = hk.cursys;
+    values[dat_eps_temp_bat0-dat_eps_vbatt].i = hk.temp[4];
+    return dat_set_status_vars(dat_eps_vbatt, dat_eps_temp_bat0-dat_eps_vbatt+1, values);
+}
+
 int eps_hard_reset(char *fmt, char *params, int nparams)
 {
     if(eps_hardreset() > 0)
@@ -56,7 +116,7 @@ int eps_hard_reset(char *fmt, char *params, int nparams)
 int eps_get_hk(char *fmt, char *params, int nparams)
 {
     eps_hk_t hk = {};
-    if(eps_hk_get(&hk) > 0)
+    if(eps_hk_get_cached(&hk, SCH_EPS_HK_MAX_AGE_MS) == 0)
     {
         eps_hk_print(&hk);
 
@@ -115,7 +175,7 @@ int eps_set_heater(char *fmt, char *params, int nparams)
     int heater, on_off;
     uint8_t state[2];
 
-    if(sscanf(params, fmt, &heater, &on_off) == nparams)
+    if(cmd_scan_params(fmt, params, &heater, &on_off) == nparams)
     {
         LOGI(tag, "Setting heater %d to state %d", heater, on_off);
         eps_heater((uint8_t) heater, (uint8_t) on_off, state);
@@ -131,26 +191,14 @@ int eps_set_heater(char *fmt, char *params, int nparams)
 
 int eps_update_status_vars(char *fmt, char *params, int nparams)
 {
-    eps_hk_t hk = {};
-    if(eps_hk_get(&hk) > 0)
-    {
-        dat_set_system_var(dat_eps_vbatt, hk.vbatt);
-        dat_set_system_var(dat_eps_cur_sun, hk.cursun);
-        dat_set_system_var(dat_eps_cur_sys, hk.cursys);
-        dat_set_system_var(dat_eps_temp_bat0, hk.temp[4]);
-    }
-    else
-    {
-        return CMD_ERROR;
-    }
-    return CMD_OK;
+    return eps_update_status(SCH_EPS_HK_MAX_AGE_MS) == 0 ? CMD_OK : CMD_ERROR;
 }
 
 int eps_set_output(char *fmt, char *params, int nparams)
 {
     unsigned int channel, mode;
     // "<channel> <mode>"
-    if(params == NULL || sscanf(params, fmt, &channel, &mode) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &channel, &mode) != nparams)
     {
         LOGE(tag, "Error parsing parameters!");
         return CMD_SYNTAX_ERROR;
@@ -173,7 +221,7 @@ int eps_set_output_all(char *fmt, char *params, int nparams)
     unsigned int mode;
     uint8_t mask;
     // "<on/off>"
-    if(params == NULL || sscanf(params, fmt, &mode) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &mode) != nparams)
     {
         LOGE(tag, "Error parsing parameters!");
         return CMD_SYNTAX_ERROR;
@@ -192,7 +240,7 @@ int eps_set_output_all(char *fmt, char *params, int nparams)
 int eps_set_vboost(char *fmt, char *params, int nparams)
 {
     int vboost;
-    if(params == NULL || sscanf(params, fmt, &vboost) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &vboost) != nparams)
     {
         LOGE(tag, "Error parsing parameters!");
         return CMD_SYNTAX_ERROR;
@@ -205,7 +253,7 @@ int eps_set_vboost(char *fmt, char *params, int nparams)
 int eps_set_pptmode(char *fmt, char *params, int nparams)
 {
     int pptmode;
-    if(params == NULL || sscanf(params, fmt, &pptmode) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &pptmode) != nparams)
     {
         LOGE(tag, "Error parsing parameters!");
         return CMD_SYNTAX_ERROR;
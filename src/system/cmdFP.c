@@ -17,21 +17,64 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#define LOG_TAG_ID LOG_TAG_FP
 #include "cmdFP.h"
 
 static const char* tag = "cmdFlightPlan";
 
+#define FP_BATCH_MAX (16)                           ///< Max. entries per fp_set_batch
+static fp_entry_t fp_batch[FP_BATCH_MAX];           ///< fp_set_batch entries buffer
+
+#define FP_SIM_BINS (60)                            ///< fp_simulate timeline length
+
+/**
+ * fp_simulate timeline. The window is split in FP_SIM_BINS bins of @width
+ * seconds, each one counts the commands and their expected execution time.
+ */
+typedef struct fp_sim {
+    int from;                                       ///< Window start, unix-time
+    int to;                                         ///< Window end, unix-time
+    int width;                                      ///< Bin width in seconds
+    uint32_t cmds[FP_SIM_BINS];                     ///< Commands per bin
+    uint64_t busy_us[FP_SIM_BINS];                  ///< Expected execution time per bin
+    int no_stats;                                   ///< Entries without timing statistics
+} fp_sim_t;
+
 void cmd_fp_init(void)
 {
     cmd_add("fp_set_cmd", fp_set, "%d %d %d %d %d %d %d %d %s %n", 10);
     cmd_add("fp_set_cmd_unix", fp_set_unix, "%d %d %d %s %n ", 5);
+    cmd_add("fp_set_cmd_unix_ms", fp_set_unix_ms, "%d %d %d %d %s %n", 6);
     cmd_add("fp_set_cmd_dt", fp_set_dt, "%d %d %d %s %n", 5);
+    cmd_add("fp_set_cmd_batch", fp_set_batch, "%d %d %d %s %n", 5);
     cmd_add("fp_del_cmd", fp_delete, "%d %d %d %d %d %d", 6);
     cmd_add("fp_del_cmd_unix", fp_delete_unix, "%d", 1);
     cmd_add("fp_show", fp_show, "", 0);
+    cmd_add("fp_simulate", fp_simulate, "%d %d", 2);
+    cmd_add("fp_jitter", fp_jitter, "%d", 1);
     cmd_add("fp_reset", fp_reset,"", 0);
 }
 
+/**
+ * Check that a flight plan command exists and its parameters match its
+ * format, so errors are found at upload time and not at execution time.
+ */
+static int fp_check_cmd(char *command, char *args)
+{
+    int idx = cmd_resolve(command);
+    if(idx < 0)
+    {
+        LOGW(tag, "Flight plan command not found: %s", command);
+        return CMD_SYNTAX_ERROR;
+    }
+    if(cmd_check_params(idx, args) != CMD_OK)
+    {
+        LOGW(tag, "Flight plan command %s used with invalid params: %s", command, args);
+        return CMD_SYNTAX_ERROR;
+    }
+    return CMD_OK;
+}
+
 int fp_set(char *fmt, char *params, int nparams)
 {
     struct tm str_time;
@@ -43,7 +86,7 @@ int fp_set(char *fmt, char *params, int nparams)
     memset(command, 0, SCH_CMD_MAX_STR_PARAMS);
     memset(args, 0, SCH_CMD_MAX_STR_PARAMS);
 
-    if(params == NULL || sscanf(params, fmt, &day, &month, &year, &hour, &min, &sec, &executions, &period, &command, &next) != nparams-1)
+    if(params == NULL || cmd_scan_params(fmt, params, &day, &month, &year, &hour, &min, &sec, &executions, &period, &command, &next) != nparams-1)
     {
         LOGW(tag, "fp_set_cmd used with invalid params: %s", params);
         return CMD_SYNTAX_ERROR;
@@ -58,7 +101,10 @@ int fp_set(char *fmt, char *params, int nparams)
     str_time.tm_isdst = 0;
 
     unixtime = mktime(&str_time);
-    strncpy(args, params+next, (size_t)SCH_CMD_MAX_STR_PARAMS);
+    strncpy(args, params+next, (size_t)SCH_CMD_MAX_STR_PARAMS-1);
+    if(fp_check_cmd(command, args) != CMD_OK)
+        return CMD_SYNTAX_ERROR;
+
     int rc = dat_set_fp((int)unixtime, command, args, executions, period);
 
     if (rc == 0)
@@ -76,13 +122,16 @@ int fp_set_unix(char *fmt, char *params, int nparams)
     memset(command, 0, SCH_CMD_MAX_STR_PARAMS);
     memset(args, 0, SCH_CMD_MAX_STR_PARAMS);
 
-    if(params == NULL || sscanf(params, fmt, &unixtime, &executions, &periodical, &command, &next) != nparams-1)
+    if(params == NULL || cmd_scan_params(fmt, params, &unixtime, &executions, &periodical, &command, &next) != nparams-1)
     {
         LOGW(tag, "fp_set_cmd used with invalid params: %s", params);
         return CMD_SYNTAX_ERROR;
     }
 
-    strncpy(args, params+next, (size_t)SCH_CMD_MAX_STR_PARAMS);
+    strncpy(args, params+next, (size_t)SCH_CMD_MAX_STR_PARAMS-1);
+    if(fp_check_cmd(command, args) != CMD_OK)
+        return CMD_SYNTAX_ERROR;
+
     int rc = dat_set_fp(unixtime, command, args, executions, periodical);
 
     if (rc == 0)
@@ -92,6 +141,39 @@ int fp_set_unix(char *fmt, char *params, int nparams)
 
 }
 
+int fp_set_unix_ms(char *fmt, char *params, int nparams)
+{
+    fp_entry_t entry;
+    int next;
+    char command[SCH_CMD_MAX_STR_PARAMS];
+    memset(&entry, 0, sizeof(entry));
+    memset(command, 0, SCH_CMD_MAX_STR_PARAMS);
+
+    if(params == NULL || cmd_scan_params(fmt, params, &entry.unixtime, &entry.ms, &entry.executions, &entry.periodical,
+                                &command, &next) != nparams-1)
+    {
+        LOGW(tag, "fp_set_cmd_unix_ms used with invalid params: %s", params);
+        return CMD_SYNTAX_ERROR;
+    }
+    if(entry.ms < 0 || entry.ms > 999 || strlen(command) >= SCH_CMD_MAX_STR_NAME)
+    {
+        LOGW(tag, "fp_set_cmd_unix_ms used with invalid params: %s", params);
+        return CMD_SYNTAX_ERROR;
+    }
+
+    strncpy(entry.cmd, command, SCH_CMD_MAX_STR_NAME-1);
+    strncpy(entry.args, params+next, (size_t)SCH_CMD_MAX_STR_PARAMS-1);
+    if(fp_check_cmd(entry.cmd, entry.args) != CMD_OK)
+        return CMD_SYNTAX_ERROR;
+
+    int rc = dat_set_fp_batch(&entry, 1);
+
+    if (rc == 0)
+        return CMD_OK;
+    else
+        return CMD_ERROR;
+}
+
 int fp_set_dt(char *fmt, char *params, int nparams)
 {
     int seconds, executions, periodical, next;
@@ -100,14 +182,17 @@ int fp_set_dt(char *fmt, char *params, int nparams)
     memset(command, 0, SCH_CMD_MAX_STR_PARAMS);
     memset(args, 0, SCH_CMD_MAX_STR_PARAMS);
 
-    if(params == NULL || sscanf(params, fmt, &seconds, &executions, &periodical, &command, &next) != nparams-1)
+    if(params == NULL || cmd_scan_params(fmt, params, &seconds, &executions, &periodical, &command, &next) != nparams-1)
     {
         LOGW(tag, "fp_set_cmd used with invalid params: %s", params);
         return CMD_SYNTAX_ERROR;
     }
 
     time_t current = dat_get_time();
-    strncpy(args, params+next, (size_t)SCH_CMD_MAX_STR_PARAMS);
+    strncpy(args, params+next, (size_t)SCH_CMD_MAX_STR_PARAMS-1);
+    if(fp_check_cmd(command, args) != CMD_OK)
+        return CMD_SYNTAX_ERROR;
+
     int rc = dat_set_fp((int)current+seconds, command, args, executions, periodical);
 
     if (rc == 0)
@@ -116,6 +201,60 @@ int fp_set_dt(char *fmt, char *params, int nparams)
         return CMD_ERROR;
 }
 
+int fp_set_batch(char *fmt, char *params, int nparams)
+{
+    char buff[SCH_CMD_MAX_STR_PARAMS];
+    char *entry, *save;
+    int n = 0, next;
+
+    if(params == NULL)
+    {
+        LOGW(tag, "fp_set_cmd_batch used with invalid params: %s", params);
+        return CMD_SYNTAX_ERROR;
+    }
+    strncpy(buff, params, SCH_CMD_MAX_STR_PARAMS-1);
+    buff[SCH_CMD_MAX_STR_PARAMS-1] = '\0';
+
+    // Parse and check every entry before adding any of them
+    entry = strtok_r(buff, "|\n", &save);
+    while(entry != NULL)
+    {
+        if(n >= FP_BATCH_MAX)
+        {
+            LOGW(tag, "fp_set_cmd_batch supports up to %d entries", FP_BATCH_MAX);
+            return CMD_SYNTAX_ERROR;
+        }
+
+        fp_entry_t *fp = &fp_batch[n];
+        memset(fp, 0, sizeof(fp_entry_t));
+        if(sscanf(entry, fmt, &fp->unixtime, &fp->executions, &fp->periodical, fp->cmd, &next) != nparams-1)
+        {
+            LOGW(tag, "fp_set_cmd_batch used with invalid entry: %s", entry);
+            return CMD_SYNTAX_ERROR;
+        }
+        strncpy(fp->args, entry+next, (size_t)SCH_CMD_MAX_STR_PARAMS-1);
+        if(fp_check_cmd(fp->cmd, fp->args) != CMD_OK)
+            return CMD_SYNTAX_ERROR;
+
+        n++;
+        entry = strtok_r(NULL, "|\n", &save);
+    }
+
+    if(n == 0)
+    {
+        LOGW(tag, "fp_set_cmd_batch used without entries");
+        return CMD_SYNTAX_ERROR;
+    }
+
+    int rc = dat_set_fp_batch(fp_batch, n);
+    LOGD(tag, "Added %d flight plan entries (rc: %d)", n, rc);
+
+    if (rc == 0)
+        return CMD_OK;
+    else
+        return CMD_ERROR;
+}
+
 int fp_delete(char* fmt, char* params, int nparams)
 {
 
@@ -123,7 +262,7 @@ int fp_delete(char* fmt, char* params, int nparams)
     time_t unixtime;
     int day, month, year, hour, min, sec;
 
-    if(params == NULL || sscanf(params, fmt, &day, &month, &year, &hour, &min, &sec) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &day, &month, &year, &hour, &min, &sec) != nparams)
     {
         LOGW(tag, "fp_del_cmd used with invalid params: %s", params);
         return CMD_SYNTAX_ERROR;
@@ -152,7 +291,7 @@ int fp_delete_unix(char* fmt, char* params, int nparams)
     time_t unixtime;
     int tmptime;
 
-    if(params == NULL || sscanf(params, fmt, &tmptime) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &tmptime) != nparams)
     {
         LOGW(tag, "fp_del_cmd_unix used with invalid params! (%s)", params);
         return CMD_SYNTAX_ERROR;
@@ -178,6 +317,96 @@ int fp_show(char* fmt, char* params, int nparams)
         return CMD_ERROR;
 }
 
+/**
+ * Add the executions of a flight plan entry inside the simulation window to the
+ * timeline, using the mean execution time of the command.
+ */
+static int fp_simulate_visit(const fp_entry_t *entry, void *arg)
+{
+    fp_sim_t *sim = (fp_sim_t *)arg;
+    int period = entry->periodical;
+    int executions = (period > 0 && entry->executions > 1) ? entry->executions : 1;
+
+    uint32_t cost_us = 0;
+    cmd_stats_t stats;
+    int idx = cmd_resolve(entry->cmd);
+    if(idx >= 0 && cmd_stats_get(idx, &stats) == CMD_OK && stats.count > 0)
+        cost_us = (uint32_t)(stats.exec_sum/stats.count);
+    else
+        sim->no_stats++;
+
+    // Skip the executions before the window
+    int k = 0;
+    if(period > 0 && entry->unixtime < sim->from)
+        k = (sim->from - entry->unixtime + period - 1)/period;
+
+    for(; k < executions; k++)
+    {
+        int64_t t = (int64_t)entry->unixtime + (int64_t)k*period;
+        if(t > sim->to)
+            break;
+        if(t < sim->from)
+            continue;
+        int bin = (int)((t - sim->from)/sim->width);
+        sim->cmds[bin]++;
+        sim->busy_us[bin] += cost_us;
+    }
+    return 0;
+}
+
+int fp_simulate(char* fmt, char* params, int nparams)
+{
+    int start, duration;
+    if(params == NULL || cmd_scan_params(fmt, params, &start, &duration) != nparams || duration <= 0)
+    {
+        LOGW(tag, "fp_simulate used with invalid params: %s", params);
+        return CMD_SYNTAX_ERROR;
+    }
+
+    fp_sim_t sim;
+    memset(&sim, 0, sizeof(sim));
+    sim.from = start > 0 ? start : (int)dat_get_time();
+    sim.to = sim.from + duration - 1;
+    sim.width = (duration + FP_SIM_BINS - 1)/FP_SIM_BINS;
+
+    int visited = dat_foreach_fp(sim.to, fp_simulate_visit, &sim);
+    if(visited < 0)
+        return CMD_ERROR;
+
+    LOGR(tag, "Flight plan from %d to %d, %d entries, %d s per row (%d without timing stats)",
+         sim.from, sim.to, visited, sim.width, sim.no_stats);
+    LOGR(tag, "%10s %8s %10s %10s", "Time", "Cmds", "Cmds/s", "Busy[%]");
+
+    int i, overloaded = 0;
+    for(i = 0; i < FP_SIM_BINS; i++)
+    {
+        if(sim.cmds[i] == 0)
+            continue;
+        double busy = (double)sim.busy_us[i]/(sim.width*1e4);
+        overloaded += busy > 100.0;
+        LOGR(tag, "%10d %8u %10.2f %10.1f%s", sim.from + i*sim.width, (unsigned int)sim.cmds[i],
+             (double)sim.cmds[i]/sim.width, busy, busy > 100.0 ? " !" : "");
+    }
+
+    if(overloaded)
+        LOGW(tag, "Flight plan executer oversubscribed in %d rows", overloaded);
+    return CMD_OK;
+}
+
+int fp_jitter(char* fmt, char* params, int nparams)
+{
+    int reset = 0;
+    if(params != NULL)
+        cmd_scan_params(fmt, params, &reset);
+
+    fp_jitter_t jitter;
+    dat_get_fp_jitter(&jitter, reset);
+    LOGR(tag, "%8s %10s %10s %10s", "Count", "Last[us]", "Mean[us]", "Max[us]");
+    LOGR(tag, "%8u %10d %10d %10d", (unsigned int)jitter.count, (int)jitter.last_us,
+         jitter.count > 0 ? (int)(jitter.sum_us/jitter.count) : 0, (int)jitter.max_us);
+    return CMD_OK;
+}
+
 int fp_reset(char* fmt, char* params, int nparams)
 {
 
@@ -29,12 +29,30 @@ static const char* tag = "cmdGSSB";
 static uint8_t i2c_addr = 5;            ///< Selected I2C device
 static uint16_t i2c_timeout_ms = 1000;  ///< I2C timeout
 
+/**
+ * Take the TWI bus from the bus manager for one GSSB library call, so the
+ * sun sensors sweeps are serialized with the other bus transactions and do
+ * not delay the reaction wheels commands (@see taskI2CBus.h)
+ * @return 1 if the bus was taken, release it with _gssb_bus_give
+ */
+static int _gssb_bus_take(void)
+{
+    return i2c_bus_acquire(SCH_A3200_I2C_BUS, I2C_PRIO_NORMAL) == 0;
+}
+
+static void _gssb_bus_give(int taken)
+{
+    if(taken)
+        i2c_bus_release(SCH_A3200_I2C_BUS);
+}
+
 void cmd_gssb_init(void)
 {
     cmd_add("gssb_pwr", gssb_pwr, "%d %d", 2);
     cmd_add("gssb_select", gssb_select_addr, "%i", 1);
     cmd_add("gssb_scan", gssb_bus_scan, "%i %i", 2);
     cmd_add("gssb_fss_get_sun", gssb_read_sunsensor, "", 0);
+    cmd_add("gssb_fss_get_sun_all", gssb_read_all_sunsensors_cmd, "", 0);
     cmd_add("gssb_fss_get_temp", gssb_get_temp, "", 0);
     cmd_add("gssb_fss_set_config", gssb_sunsensor_conf, "%d", 1);
     cmd_add("gssb_fss_commit_config", gssb_sunsensor_conf_save, "", 0);
@@ -67,7 +85,7 @@ int gssb_pwr(char *fmt, char *params, int nparams)
         return CMD_ERROR_SYNTAX;
 
     int vcc_on, vcc2_on;
-    if(sscanf(params, fmt, &vcc_on, &vcc2_on) != nparams)
+    if(cmd_scan_params(fmt, params, &vcc_on, &vcc2_on) != nparams)
         return CMD_ERROR_SYNTAX;
 
     if (vcc_on > 0)
@@ -94,7 +112,7 @@ int gssb_select_addr(char *fmt, char *params, int nparams)
     if (params == NULL)
         return CMD_ERROR_SYNTAX;
 
-    if(sscanf(params, fmt, &addr) == nparams)
+    if(cmd_scan_params(fmt, params, &addr) == nparams)
     {
         if(addr > 0)
             i2c_addr = addr;
@@ -113,7 +131,7 @@ int gssb_bus_scan(char *fmt, char *params, int nparams)
     int start;
     int end;
 
-    if(params == NULL || (sscanf(params, fmt, &start, &end) != nparams))
+    if(params == NULL || (cmd_scan_params(fmt, params, &start, &end) != nparams))
     {
         start = 1;
         end = 100;
@@ -123,7 +141,9 @@ int gssb_bus_scan(char *fmt, char *params, int nparams)
     if(start > 128 || end > 128)
         return CMD_ERROR_SYNTAX;
 
+    int bus = _gssb_bus_take();
     gs_gssb_bus_scan((uint8_t)start, (uint8_t)end, 100, devices);
+    _gssb_bus_give(bus);
 
     for (addr = (uint8_t)start; addr < (uint8_t)end; addr++) {
         if (devices[addr] == GS_OK) {
@@ -134,18 +154,95 @@ int gssb_bus_scan(char *fmt, char *params, int nparams)
     return CMD_ERROR_NONE;
 }
 
-int gssb_read_sunsensor(char *fmt, char *params, int nparams)
+int gssb_sample_sunsensor(uint16_t sun[4])
 {
-    uint16_t sun[4];
-    int i;
+    int bus, rc;
 
     /* Start sampling */
-    if (gs_gssb_sun_sample_sensor(i2c_addr, i2c_timeout_ms) != GS_OK)
-        return CMD_ERROR_FAIL;
+    bus = _gssb_bus_take();
+    rc = gs_gssb_sun_sample_sensor(i2c_addr, i2c_timeout_ms);
+    _gssb_bus_give(bus);
+    if (rc != GS_OK)
+        return -1;
 
     /* Wait for result to be ready */
     osDelay(30);
-    if (gs_gssb_sun_read_sensor_samples(i2c_addr, i2c_timeout_ms, sun) != GS_OK)
+    bus = _gssb_bus_take();
+    rc = gs_gssb_sun_read_sensor_samples(i2c_addr, i2c_timeout_ms, sun);
+    _gssb_bus_give(bus);
+    if (rc != GS_OK)
+        return -1;
+
+    return 0;
+}
+
+int gssb_read_all_sunsensors(gssb_sun_sample_t *sample)
+{
+    static const uint8_t addrs[] = SCH_GSSB_SUN_ADDRS;
+    int n = sizeof(addrs)/sizeof(addrs[0]);
+    int i, bus, rc, started = 0, sampled = 0;
+
+    sample->n = n > GSSB_SUN_MAX ? GSSB_SUN_MAX : n;
+    memset(sample->ok, 0, sizeof(sample->ok));
+
+    /* Start all conversions */
+    for (i = 0; i < sample->n; i++) {
+        sample->addr[i] = addrs[i];
+        bus = _gssb_bus_take();
+        rc = gs_gssb_sun_sample_sensor(addrs[i], i2c_timeout_ms);
+        _gssb_bus_give(bus);
+        if (rc == GS_OK) {
+            sample->ok[i] = 1;
+            started++;
+        }
+    }
+    if (started == 0)
+        return -1;
+
+    /* Wait for the results once, then read all of them */
+    osDelay(30);
+    for (i = 0; i < sample->n; i++) {
+        if (!sample->ok[i])
+            continue;
+        bus = _gssb_bus_take();
+        rc = gs_gssb_sun_read_sensor_samples(addrs[i], i2c_timeout_ms, sample->sun[i]);
+        _gssb_bus_give(bus);
+        if (rc == GS_OK)
+            sampled++;
+        else
+            sample->ok[i] = 0;
+    }
+
+    return sampled > 0 ? sampled : -1;
+}
+
+int gssb_read_all_sunsensors_cmd(char *fmt, char *params, int nparams)
+{
+    gssb_sun_sample_t sample;
+    int i;
+
+    if (gssb_read_all_sunsensors(&sample) < 0)
+        return CMD_ERROR_FAIL;
+
+    for (i = 0; i < sample.n; i++) {
+        if (sample.ok[i]) {
+            LOGR(tag, "GSSB %d sun sensor: %d, %d, %d, %d", sample.addr[i],
+                 sample.sun[i][0], sample.sun[i][1], sample.sun[i][2], sample.sun[i][3]);
+        }
+        else {
+            LOGW(tag, "GSSB %d sun sensor failed", sample.addr[i]);
+        }
+    }
+
+    return CMD_ERROR_NONE;
+}
+
+int gssb_read_sunsensor(char *fmt, char *params, int nparams)
+{
+    uint16_t sun[4];
+    int i;
+
+    if (gssb_sample_sunsensor(sun) != 0)
         return CMD_ERROR_FAIL;
 
     for (i = 0; i < 4; i++) {
@@ -158,14 +255,21 @@ int gssb_read_sunsensor(char *fmt, char *params, int nparams)
 int gssb_get_temp(char *fmt, char *params, int nparams)
 {
     float temp;
+    int bus, rc;
 
     /* Command ADC to sample temp */
-    if (gs_gssb_sun_sample_temp(i2c_addr, i2c_timeout_ms) != GS_OK)
+    bus = _gssb_bus_take();
+    rc = gs_gssb_sun_sample_temp(i2c_addr, i2c_timeout_ms);
+    _gssb_bus_give(bus);
+    if (rc != GS_OK)
         return CMD_ERROR_FAIL;
 
     /* Wait for conversion to finish and then read result */
     osDelay(20);
-    if (gs_gssb_sun_get_temp(i2c_addr, i2c_timeout_ms, &temp) != GS_OK)
+    bus = _gssb_bus_take();
+    rc = gs_gssb_sun_get_temp(i2c_addr, i2c_timeout_ms, &temp);
+    _gssb_bus_give(bus);
+    if (rc != GS_OK)
         return CMD_ERROR_FAIL;
 
     LOGR(tag, "GSSB %d temp: %.4f °C", i2c_addr, temp);
@@ -181,7 +285,7 @@ int gssb_sunsensor_conf(char *fmt, char *params, int nparams)
         return CMD_ERROR_SYNTAX;
 
     //conf = atoi(ctx->argv[1]);
-    if(sscanf(params, fmt, &conf) == nparams) {
+    if(cmd_scan_params(fmt, params, &conf) == nparams) {
         if (gs_gssb_sun_sensor_conf(i2c_addr, i2c_timeout_ms, (uint16_t)conf) != GS_OK)
             return CMD_ERROR_FAIL;
         return CMD_ERROR_NONE;
@@ -206,7 +310,7 @@ int gssb_set_i2c_addr(char *fmt, char *params, int nparams)
         return CMD_ERROR_SYNTAX;
 
     //new_i2c_addr = atoi(ctx->argv[1]);
-    if(sscanf(params, fmt, &new_i2c_addr) != nparams)
+    if(cmd_scan_params(fmt, params, &new_i2c_addr) != nparams)
         return CMD_ERROR_SYNTAX;
 
     // Set new i2c address
@@ -319,7 +423,7 @@ int gssb_msp_outside_temp_calibrate(char *fmt, char *params, int nparams)
     if (params == NULL)
         return CMD_ERROR_SYNTAX;
 
-    if(sscanf(params, fmt, &curr, &res) != nparams)
+    if(cmd_scan_params(fmt, params, &curr, &res) != nparams)
         return CMD_ERROR_SYNTAX;
 
     if ((curr > 400000) || (curr < 100000)) {
@@ -420,7 +524,7 @@ int gssb_interstage_set_burn_settings(char *fmt, char *params, int nparams)
     int std_time, increment_ms, short_cnt_down, max_repeat, rep_time_s;
     int switch_polarity, reboot_deploy_cnt;
 
-    if (sscanf(params, fmt, &std_time, &increment_ms, &short_cnt_down,
+    if (cmd_scan_params(fmt, params, &std_time, &increment_ms, &short_cnt_down,
                       &max_repeat, &rep_time_s, &switch_polarity, &reboot_deploy_cnt) == nparams) {
         /* First fetch settings and check that the interstage is unlocked and if it
          * is not then print warning about the settings cannot be changed */
@@ -524,7 +628,7 @@ int gssb_interstage_arm(char *fmt, char *params, int nparams)
     if (params == NULL)
         return CMD_ERROR_SYNTAX;
 
-    if(sscanf(params, fmt, &arm_auto) != nparams)
+    if(cmd_scan_params(fmt, params, &arm_auto) != nparams)
         return CMD_ERROR_SYNTAX;
 
     if (arm_auto)
@@ -555,7 +659,7 @@ int gssb_interstage_state(char *fmt, char *params, int nparams)
         return CMD_ERROR_SYNTAX;
 
     //armed_manual = atoi(ctx->argv[1]);
-    if(sscanf(params, fmt, &armed_manual) != nparams)
+    if(cmd_scan_params(fmt, params, &armed_manual) != nparams)
         return CMD_ERROR_SYNTAX;
 
     if (gs_gssb_istage_settings_unlock(i2c_addr, i2c_timeout_ms) != GS_OK) {
@@ -580,7 +684,7 @@ int gssb_interstage_state(char *fmt, char *params, int nparams)
 int gssb_interstage_settings_unlock(char *fmt, char *params, int nparams)
 {
     int unlock;
-    if (sscanf(params, fmt, &unlock) != nparams)
+    if (cmd_scan_params(fmt, params, &unlock) != nparams)
         return CMD_ERROR_SYNTAX;
 
     if (unlock) {
@@ -655,7 +759,7 @@ int gssb_ar6_burn(char *fmt, char *params, int nparams)
     int duration;
     if (params == NULL)
         return CMD_ERROR_SYNTAX;
-    if (sscanf(params, fmt, &duration) != nparams)
+    if (cmd_scan_params(fmt, params, &duration) != nparams)
         return CMD_ERROR_SYNTAX;
 
     if ((duration > 20) || (duration < 0)) {
@@ -731,7 +835,7 @@ int gssb_common_burn_channel(char *fmt, char *params, int nparams)
     if (params == NULL)
         return CMD_ERROR_SYNTAX;
 
-    if(sscanf(params, fmt, &channel, &duration) != nparams)
+    if(cmd_scan_params(fmt, params, &channel, &duration) != nparams)
         return CMD_ERROR_SYNTAX;
 
     if ((channel > 10) || (channel < 0)) {
@@ -951,7 +1055,7 @@ int gssb_common_backup_settings(char *fmt, char *params, int nparams)
     gs_gssb_backup_settings_t settings;
     int minutes, backup_active, max_burn_duration;
 
-    if (sscanf(params, fmt, &minutes, &backup_active, &max_burn_duration) == nparams) {
+    if (cmd_scan_params(fmt, params, &minutes, &backup_active, &max_burn_duration) == nparams) {
         if ((minutes > 5000) || (minutes < 0)) {
             LOGE(tag, "Minutes until deploy out of range [0 - 5000]");
             return CMD_ERROR_SYNTAX;
@@ -1040,7 +1144,7 @@ int gssb_antenna_release(char *fmt, char *params, int nparams)
     int rc = 1;
     gs_gssb_istage_burn_settings_t settings;
 
-    if(sscanf(params, fmt, &addr, &knife_on, &knife_off, &repeats) == nparams)
+    if(cmd_scan_params(fmt, params, &addr, &knife_on, &knife_off, &repeats) == nparams)
     {
         //Get current config
         if (gs_gssb_istage_get_burn_settings(addr, i2c_timeout_ms, &settings) != GS_OK)
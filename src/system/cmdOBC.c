@@ -19,23 +19,131 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_TAG_ID LOG_TAG_OBC
 #include <math.h>
 #include "cmdOBC.h"
 #include "TLE.h"
+#include "taskHousekeeping.h"
+#include "cmdADCS.h"
+#ifdef LINUX
+#include <pthread.h>
+#endif
 
 static const char* tag = "cmdOBC";
 
 #define TLE_BUFF_LEN 70
-TLE tle;
 static char tle1[TLE_BUFF_LEN]; //"1 42788U 17036Z   20054.20928660  .00001463  00000-0  64143-4 0  9996";
 static char tle2[TLE_BUFF_LEN]; //"2 42788  97.3188 111.6825 0013081  74.6084 285.6598 15.23469130148339";
+static osSemaphore tle_sem;     ///< Serializes the orbit writers and eph_pending
+static int tle_sem_ok = 0;
+
+#if SCH_OBC_EPH_LEN > 0
+/**
+ * Orbit ephemeris point, SGP4 state at eph_start + i*SCH_OBC_EPH_STEP
+ */
+typedef struct obc_eph_point {
+    double r[3];    ///< Position, ECI [km]
+    double v[3];    ///< Velocity, ECI [km/s]
+} obc_eph_point_t;
+
+static int eph_pending = 0;     ///< An obc_eph_update command is queued, with tle_sem
+#endif
+
+/**
+ * Published orbit, the parsed TLE and its ephemeris cache. Writers fill the
+ * slot not in use and switch orbit_cur, so readers never wait for a TLE
+ * update or a propagation. The slot sequence is odd while it is written,
+ * readers copy what they need and retry if it changed. The TLE is only
+ * propagated on copies, SGP4 updates the TLE it propagates.
+ */
+typedef struct obc_orbit {
+    volatile uint32_t seq;  ///< Odd while the slot is written
+    TLE tle;                ///< TLE set by obc_update_tle
+#if SCH_OBC_EPH_LEN > 0
+    obc_eph_point_t eph[SCH_OBC_EPH_LEN];  ///< Ephemeris cache (@see obc_eph_update)
+    int eph_start;          ///< Timestamp of the first point
+    int eph_len;            ///< Valid points, 0 if the cache is empty
+#endif
+} obc_orbit_t;
+
+static obc_orbit_t orbit[2];
+static volatile int orbit_cur = 0;  ///< Published slot
+
+static void _obc_tle_lock(void)
+{
+    if(tle_sem_ok)
+        osSemaphoreTake(&tle_sem, portMAX_DELAY);
+}
+
+static void _obc_tle_unlock(void)
+{
+    if(tle_sem_ok)
+        osSemaphoreGiven(&tle_sem);
+}
+
+/**
+ * Start writing the slot not in use, called with tle_sem
+ */
+static obc_orbit_t *_obc_orbit_begin(void)
+{
+    obc_orbit_t *next = &orbit[!orbit_cur];
+    next->seq++;
+    __sync_synchronize();
+    return next;
+}
+
+/**
+ * Publish the slot written after _obc_orbit_begin, called with tle_sem
+ */
+static void _obc_orbit_publish(obc_orbit_t *next)
+{
+    __sync_synchronize();
+    next->seq++;
+    __sync_synchronize();
+    orbit_cur = (int)(next - orbit);
+}
+
+static int _obc_tle_valid(const TLE *src)
+{
+    return src->epoch != 0 && src->sgp4Error == 0;
+}
+
+int obc_tle_get(TLE *dst)
+{
+    const obc_orbit_t *cur;
+    uint32_t seq;
+    do
+    {
+        cur = &orbit[orbit_cur];
+        seq = cur->seq;
+        __sync_synchronize();
+        memcpy(dst, &cur->tle, sizeof(TLE));
+        __sync_synchronize();
+    }
+    while((seq & 1U) || seq != cur->seq);
+    return _obc_tle_valid(dst) ? 0 : -1;
+}
 
 void cmd_obc_init(void)
 {
+    tle_sem_ok = osSemaphoreCreate(&tle_sem) == OS_SEMAPHORE_OK;
+    hk_jobs_init();
     cmd_add("obc_ident", obc_ident, "", 0);
     cmd_add("obc_debug", obc_debug, "%d", 1);
     cmd_add("obc_reset", obc_reset, "", 0);
     cmd_add("obc_get_mem", obc_get_os_memory, "", 0);
+    cmd_add("obc_cmd_stats", obc_cmd_stats, "%d", 1);
+    cmd_add("obc_cmd_lat", obc_cmd_lat, "%d", 1);
+    cmd_add("obc_task_stats", obc_task_stats, "%d", 1);
+    cmd_add("obc_prof", obc_prof, "%d", 1);
+    cmd_add("obc_queue_stats", obc_queue_stats, "%d", 1);
+    cmd_add("obc_lock_stats", obc_lock_stats, "%d", 1);
+    cmd_add("obc_cmd_trace", obc_cmd_trace, "%d", 1);
+    cmd_add("obc_mem_stats", obc_mem_stats, "%d", 1);
+    cmd_add("obc_hk_set", obc_hk_set, "%d %u %u %s %n", 5);
+    cmd_add("obc_hk_del", obc_hk_del, "%d", 1);
+    cmd_add("obc_hk_show", obc_hk_show, "", 0);
+    cmd_add("obc_hk_reset", obc_hk_reset, "", 0);
     cmd_add("obc_set_time", obc_set_time,"%d",1);
     cmd_add("obc_get_time", obc_get_time, "%d", 1);
     cmd_add("obc_reset_wdt", obc_reset_wdt, "", 0);
@@ -45,7 +153,18 @@ void cmd_obc_init(void)
     cmd_add("obc_get_tle", obc_get_tle, "", 0);
     cmd_add("obc_set_tle", obc_set_tle, "%d %n", 2);
     cmd_add("obc_update_tle", obc_update_tle, "", 0);
-    cmd_add("obc_prop_tle", obc_prop_tle, "%ld", 1);
+    cmd_add_coalesce("obc_prop_tle", obc_prop_tle, "%ld", 1);
+    cmd_set_class("obc_prop_tle", CMD_CLASS_CPU);
+    cmd_add_coalesce("obc_eph_update", obc_eph_update, "%d", 1);
+    cmd_set_class("obc_eph_update", CMD_CLASS_CPU);
+    cmd_add("obc_prop_tle_range", obc_prop_tle_range_cmd, "%d %d %d", 3);
+    cmd_set_class("obc_prop_tle_range", CMD_CLASS_CPU);
+    cmd_add("obc_get_pass", obc_get_pass, "%d", 1);
+    cmd_set_class("obc_get_pass", CMD_CLASS_CPU);
+    cmd_set_priority("obc_reset", CMD_PRIO_HIGH);
+    cmd_set_priority("obc_reset_wdt", CMD_PRIO_HIGH);
+    // Optional under load (see cmd_set_shed)
+    cmd_set_shed("obc_debug", CMD_LOAD_HIGH);
     cmd_add("mtt_set_duty", obc_set_pwm_duty, "%d %d", 2);
     cmd_add("mtt_set_freq", obc_set_pwm_freq, "%d %f", 2);
     cmd_add("mtt_set_pwr", obc_pwm_pwr, "%d", 1);
@@ -61,7 +180,7 @@ int obc_ident(char* fmt, char* params, int nparams)
 int obc_debug(char *fmt, char *params, int nparams)
 {
     int dbg_type;
-    if(params == NULL || sscanf(params, fmt, &dbg_type) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &dbg_type) != nparams)
     {
         LOGE(tag, "Parameter null");
         return CMD_SYNTAX_ERROR;
@@ -107,6 +226,8 @@ int obc_reset_wdt(char *fmt, char *params, int nparams)
 int obc_reset(char *fmt, char *params, int nparams)
 {
     printf("Resetting system NOW!!\n");
+    // Keep the status variables if the RAM survives the reset
+    dat_repo_seal();
 
     #ifdef LINUX
         if(params != NULL && strcmp(params, "reboot")==0)
@@ -127,6 +248,16 @@ int obc_reset(char *fmt, char *params, int nparams)
 
 int obc_get_os_memory(char *fmt, char *params, int nparams)
 {
+    cmd_pool_stats_t pool;
+    cmd_pool_get_stats(&pool);
+    LOGR(tag, "Command pool size (used/max/total):    %d/%d/%d", pool.used, pool.max_used, pool.size);
+    LOGR(tag, "Command pool misses (cmds/params):     %d/%d", pool.misses, pool.params_misses);
+
+    int i;
+    osTaskStack stack;
+    for(i=0; osTaskGetStack(i, &stack) == 0; i++)
+        LOGR(tag, "Task %-14s stack (used/size):    %u/%u", stack.name,
+             (unsigned int)stack.used_max, (unsigned int)stack.size);
 
     #if defined(LINUX) || defined(NANOMIND) || defined(AVR32)
         struct mallinfo mi;
@@ -152,10 +283,237 @@ int obc_get_os_memory(char *fmt, char *params, int nparams)
     #endif
 }
 
+int obc_cmd_stats(char *fmt, char *params, int nparams)
+{
+    int reset = 0;
+    if(params != NULL)
+        cmd_scan_params(fmt, params, &reset);
+
+    LOGR(tag, "%5s %-25s %8s %10s %10s %10s %10s %10s %6s %6s %6s  %s", "Index", "Name", "Count",
+         "Min[us]", "Mean[us]", "Max[us]", "Wait[us]", "MaxW[us]", "Overr", "Shed", "Full", "Hist[<100us..>=10s]");
+
+    int i, j;
+    cmd_stats_t stats;
+    for(i=0; i<SCH_CMD_MAX_ENTRIES; i++)
+    {
+        // Commands only dropped under load are also listed
+        if(cmd_stats_get(i, &stats) != CMD_OK || (stats.count == 0 && stats.shed == 0 && stats.full == 0))
+            continue;
+        uint32_t count = stats.count > 0 ? stats.count : 1;
+
+        char hist[CMD_STATS_BUCKETS*11+1];
+        int len = 0;
+        for(j=0; j<CMD_STATS_BUCKETS; j++)
+            len += snprintf(hist+len, sizeof(hist)-len, "%u ", (unsigned int)stats.hist[j]);
+
+        LOGR(tag, "%5d %-25s %8u %10u %10u %10u %10u %10u %6u %6u %6u  %s", i, cmd_get_name(i), (unsigned int)stats.count,
+             (unsigned int)stats.exec_min, (unsigned int)(stats.exec_sum/count),
+             (unsigned int)stats.exec_max, (unsigned int)(stats.wait_sum/count),
+             (unsigned int)stats.wait_max, (unsigned int)stats.overruns, (unsigned int)stats.shed,
+             (unsigned int)stats.full, hist);
+    }
+
+    if(reset)
+        cmd_stats_reset();
+    return CMD_OK;
+}
+
+int obc_cmd_lat(char *fmt, char *params, int nparams)
+{
+    int reset = 0;
+    if(params != NULL)
+        cmd_scan_params(fmt, params, &reset);
+
+    cmd_lat_stats_t stats[CMD_LAT_STAGES];
+    uint32_t last_id = cmd_lat_get(stats);
+    LOGR(tag, "Last TC trace: %u", (unsigned int)last_id);
+    LOGR(tag, "%-8s %8s %10s %10s  %s", "Stage", "Count", "Mean[us]", "Max[us]", "Hist[<16us..>=262ms]");
+
+    int i, j;
+    for(i=0; i<CMD_LAT_STAGES; i++)
+    {
+        uint32_t count = stats[i].count > 0 ? stats[i].count : 1;
+        char hist[CMD_LAT_BUCKETS*11+1];
+        int len = 0;
+        for(j=0; j<CMD_LAT_BUCKETS; j++)
+            len += snprintf(hist+len, sizeof(hist)-len, "%u ", (unsigned int)stats[i].hist[j]);
+
+        LOGR(tag, "%-8s %8u %10u %10u  %s", cmd_lat_get_name(i), (unsigned int)stats[i].count,
+             (unsigned int)(stats[i].sum/count), (unsigned int)stats[i].max, hist);
+    }
+
+    if(reset)
+        cmd_lat_reset();
+    return CMD_OK;
+}
+
+int obc_task_stats(char *fmt, char *params, int nparams)
+{
+    int reset = 0;
+    if(params != NULL)
+        cmd_scan_params(fmt, params, &reset);
+
+    LOGR(tag, "%-14s %10s %8s %8s %10s %10s %10s %10s", "Name", "Period[ms]", "Loops", "Overrun",
+         "Work[us]", "Mean[us]", "Max[us]", "Late[us]");
+
+    int i;
+    osPeriodStats stats;
+    for(i=0; osPeriodGetStats(i, &stats, reset) == 0; i++)
+    {
+        LOGR(tag, "%-14s %10u %8u %8u %10u %10u %10u %10u", stats.name, (unsigned int)stats.period_ms,
+             (unsigned int)stats.loops, (unsigned int)stats.overruns, (unsigned int)stats.work_last_us,
+             (unsigned int)(stats.loops > 0 ? stats.work_sum_us/stats.loops : 0),
+             (unsigned int)stats.work_max_us, (unsigned int)stats.late_max_us);
+    }
+    return CMD_OK;
+}
+
+int obc_prof(char *fmt, char *params, int nparams)
+{
+    int reset = 0;
+    if(params != NULL)
+        cmd_scan_params(fmt, params, &reset);
+
+    LOGR(tag, "%-20s %10s %10s %10s %12s", "Name", "Count", "Mean[us]", "Max[us]", "Total[us]");
+
+    int i;
+    prof_counter_t counter;
+    for(i=0; prof_get(i, &counter, reset) == 0; i++)
+    {
+        LOGR(tag, "%-20s %10u %10u %10u %12llu", prof_get_name(i), (unsigned int)counter.count,
+             (unsigned int)(counter.count > 0 ? counter.time_sum_us/counter.count : 0),
+             (unsigned int)counter.time_max_us, (unsigned long long)counter.time_sum_us);
+    }
+    return CMD_OK;
+}
+
+int obc_queue_stats(char *fmt, char *params, int nparams)
+{
+    int reset = 0;
+    if(params != NULL)
+        cmd_scan_params(fmt, params, &reset);
+
+    LOGR(tag, "%-14s %6s %6s %6s %10s %8s %12s", "Name", "Size", "Depth", "Max", "Sent", "Full", "Block[us]");
+
+    int i;
+    osQueueStats stats;
+    for(i=0; osQueueGetStats(i, &stats, reset) == 0; i++)
+    {
+        LOGR(tag, "%-14s %6u %6u %6u %10u %8u %12llu", stats.name, (unsigned int)stats.size,
+             (unsigned int)stats.depth, (unsigned int)stats.depth_max, (unsigned int)stats.sent,
+             (unsigned int)stats.full, (unsigned long long)stats.block_us);
+    }
+    return CMD_OK;
+}
+
+int obc_lock_stats(char *fmt, char *params, int nparams)
+{
+    int reset = 0;
+    if(params != NULL)
+        cmd_scan_params(fmt, params, &reset);
+
+    LOGR(tag, "%-14s %10s %10s %12s %10s %-16s", "Name", "Taken", "Contended", "Wait[us]", "Hold[us]", "Holder");
+
+    int i;
+    osLockStats stats;
+    for(i=0; osLockGetStats(i, &stats, reset) == 0; i++)
+    {
+        LOGR(tag, "%-14s %10u %10u %12llu %10u %-16s", stats.name, (unsigned int)stats.taken,
+             (unsigned int)stats.contended, (unsigned long long)stats.wait_us,
+             (unsigned int)stats.hold_max_us, stats.holder);
+    }
+    return CMD_OK;
+}
+
+int obc_cmd_trace(char *fmt, char *params, int nparams)
+{
+    int seconds;
+    if(params == NULL || cmd_scan_params(fmt, params, &seconds) != nparams)
+    {
+        LOGE(tag, "Invalid params");
+        return CMD_SYNTAX_ERROR;
+    }
+
+    if(seconds < 0)
+    {
+        LOGR(tag, "Commands recorded: %d", cmd_trace_stop());
+        return CMD_OK;
+    }
+    return cmd_trace_start(SCH_CMD_TRACE_FILE, seconds);
+}
+
+int obc_mem_stats(char *fmt, char *params, int nparams)
+{
+    int reset = 0;
+    if(params != NULL)
+        cmd_scan_params(fmt, params, &reset);
+
+    LOGR(tag, "%-10s %10s %10s %10s %10s", "Subsystem", "Live[B]", "Peak[B]", "Allocs", "Frees");
+
+    int i;
+    mem_stats_t stats;
+    for(i=0; mem_get_stats(i, &stats, reset) == 0; i++)
+    {
+        LOGR(tag, "%-10s %10u %10u %10u %10u", mem_get_name(i), (unsigned int)stats.live,
+             (unsigned int)stats.peak, (unsigned int)stats.allocs, (unsigned int)stats.frees);
+    }
+    return CMD_OK;
+}
+
+int obc_hk_set(char *fmt, char *params, int nparams)
+{
+    int slot, next;
+    unsigned int period, phase;
+    char command[SCH_CMD_MAX_STR_PARAMS];
+    memset(command, 0, SCH_CMD_MAX_STR_PARAMS);
+
+    if(params == NULL || cmd_scan_params(fmt, params, &slot, &period, &phase, command, &next) != nparams-1)
+        return CMD_SYNTAX_ERROR;
+    if(slot < 0 || slot >= SCH_HK_JOBS_MAX || period == 0)
+        return CMD_SYNTAX_ERROR;
+
+    char *args = params + next;
+    while(*args == ' ')
+        args++;
+    if(hk_job_set(slot, period, phase, command, args) != 0)
+    {
+        LOGE(tag, "Invalid housekeeping job command %s", command);
+        return CMD_ERROR;
+    }
+    return CMD_OK;
+}
+
+int obc_hk_del(char *fmt, char *params, int nparams)
+{
+    int slot;
+    if(params == NULL || cmd_scan_params(fmt, params, &slot) != nparams)
+        return CMD_SYNTAX_ERROR;
+    return hk_job_delete(slot) == 0 ? CMD_OK : CMD_SYNTAX_ERROR;
+}
+
+int obc_hk_show(char *fmt, char *params, int nparams)
+{
+    LOGR(tag, "%4s %8s %8s %-20s %s", "Slot", "Period", "Phase", "Command", "Params");
+    int i;
+    hk_job_t job;
+    for(i = 0; i < SCH_HK_JOBS_MAX; i++)
+    {
+        if(hk_job_get(i, &job) != 0)
+            continue;
+        LOGR(tag, "%4d %8u %8u %-20s %s", i, job.period, job.phase, cmd_get_name(job.cmd_id), job.params);
+    }
+    return CMD_OK;
+}
+
+int obc_hk_reset(char *fmt, char *params, int nparams)
+{
+    return hk_jobs_reset() >= 0 ? CMD_OK : CMD_ERROR;
+}
+
 int obc_set_time(char* fmt, char* params,int nparams)
 {
     int time_to_set;
-    if(params == NULL || sscanf(params, fmt, &time_to_set) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &time_to_set) != nparams)
     {
         LOGE(tag, "Invalid params");
         return CMD_SYNTAX_ERROR;
@@ -171,7 +529,7 @@ int obc_set_time(char* fmt, char* params,int nparams)
 int obc_get_time(char *fmt, char *params, int nparams)
 {
     int format = 0;
-    if((params == NULL) || (sscanf(params, fmt, &format) < nparams))
+    if((params == NULL) || (cmd_scan_params(fmt, params, &format) < nparams))
     {
         format = 0;
     }
@@ -213,7 +571,7 @@ int obc_set_pwm_duty(char* fmt, char* params, int nparams)
 #ifdef NANOMIND
     int channel;
     int duty;
-    if(params == NULL || sscanf(params, fmt, &channel, &duty) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &channel, &duty) != nparams)
     {
         LOGW(tag, "set_pwm_duty used with invalid params!");
         return CMD_SYNTAX_ERROR;
@@ -242,7 +600,7 @@ int obc_set_pwm_freq(char* fmt, char* params, int nparams)
     int channel;
     float freq;
     
-    if(params == NULL || sscanf(params, fmt, &channel, &freq) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &channel, &freq) != nparams)
         return CMD_SYNTAX_ERROR;
     
     /* The pwm cant handle frequencies above 433 Hz or below 0.1 Hz */
@@ -265,7 +623,7 @@ int obc_pwm_pwr(char *fmt, char *params, int nparams)
 {
 #ifdef NANOMIND
     int enable;
-    if(params == NULL || sscanf(params, fmt, &enable) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &enable) != nparams)
         return CMD_SYNTAX_ERROR;
     
     /* Turn on/off power channel */
@@ -296,12 +654,13 @@ int obc_get_sensors(char *fmt, char *params, int nparams)
     result = gs_lm71_read_temp(GS_A3200_SPI_SLAVE_LM71_0, 100, &sensor1); //sensor1 = lm70_read_temp(1);
     result = gs_lm71_read_temp(GS_A3200_SPI_SLAVE_LM71_1, 100, &sensor2); //sensor2 = lm70_read_temp(2);
 
-    /* Read gyroscope temperature and rate */
+    /* Read gyroscope temperature and rate, and the magnetometer */
+    int bus = i2c_bus_acquire(SCH_A3200_I2C_BUS, I2C_PRIO_NORMAL) == 0;
     gs_mpu3300_read_temp(&gyro_temp);
     gs_mpu3300_read_gyro(&gyro_reading);
-
-    /* Read magnetometer */
     gs_hmc5843_read_single(&hmc_reading);
+    if(bus)
+        i2c_bus_release(SCH_A3200_I2C_BUS);
 
     /* Get sample time */
     int curr_time =  (int)time(NULL);
@@ -352,6 +711,8 @@ int obc_get_sensors(char *fmt, char *params, int nparams)
     LOGD(tag, "Reading obc data in Linux \n timestamp: %d", curr_time);
     // Reading temp
     thermal = fopen("/sys/class/thermal/thermal_zone0/temp","r");
+    if(thermal == NULL)
+        return CMD_ERROR;
     n = fscanf(thermal,"%f",&millideg);
     fclose(thermal);
     if(n!= 1)
@@ -381,49 +742,33 @@ int obc_update_status(char *fmt, char *params, int nparams)
     result = gs_lm71_read_temp(GS_A3200_SPI_SLAVE_LM71_0, 100, &sensor1); //sensor1 = lm70_read_temp(1);
     result = gs_lm71_read_temp(GS_A3200_SPI_SLAVE_LM71_1, 100, &sensor2); //sensor2 = lm70_read_temp(2);
 
-    /* Read gyroscope temperature and rate */
+    /* Read gyroscope temperature and rate, and the magnetometer */
+    int bus = i2c_bus_acquire(SCH_A3200_I2C_BUS, I2C_PRIO_NORMAL) == 0;
     gs_mpu3300_read_temp(&gyro_temp);
     gs_mpu3300_read_gyro(&gyro_reading);
-
-    /* Read magnetometer */
     gs_hmc5843_read_single(&hmc_reading);
-
-    /* Set sensors status variables (fix type) */
-    value temp_1;
-    temp_1.f = (float)(sensor1/10.0);
-    dat_set_system_var(dat_obc_temp_1, temp_1.i);
-
-    value temp_2;
-    temp_2.f = (float)(sensor2/10.0);
-    dat_set_system_var(dat_obc_temp_2, temp_2.i);
-
-    value temp_3;
-    temp_3.f = gyro_temp;
-    dat_set_system_var(dat_obc_temp_3, temp_3.i);
-
-    value acc_x;
-    acc_x.f = gyro_reading.gyro_x;
-    dat_set_system_var(dat_ads_omega_x, acc_x.i);
-
-    value acc_y;
-    acc_y.f = gyro_reading.gyro_y;
-    dat_set_system_var(dat_ads_omega_y, acc_y.i);
-
-    value acc_z;
-    acc_z.f = gyro_reading.gyro_z;
-    dat_set_system_var(dat_ads_omega_z, acc_z.i);
-
-    value mag_x;
-    mag_x.f = hmc_reading.x;
-    dat_set_system_var(dat_ads_mag_x, mag_x.i);
-
-    value mag_y;
-    mag_y.f = hmc_reading.y;
-    dat_set_system_var(dat_ads_mag_y, mag_y.i);
-
-    value mag_z;
-    mag_z.f = hmc_reading.z;
-    dat_set_system_var(dat_ads_mag_z, mag_z.i);
+    if(bus)
+        i2c_bus_release(SCH_A3200_I2C_BUS);
+
+    /* Set sensors status variables (fix type), one update per group */
+    value32_t temps[3];
+    temps[0].f = (float)(sensor1/10.0);
+    temps[1].f = (float)(sensor2/10.0);
+    temps[2].f = gyro_temp;
+    dat_set_status_vars(dat_obc_temp_1, 3, temps);
+
+    vector3_t omega = {.v = {gyro_reading.gyro_x, gyro_reading.gyro_y, gyro_reading.gyro_z}};
+    vector3_t mag = {.v = {hmc_reading.x, hmc_reading.y, hmc_reading.z}};
+#if SCH_ADCS_ENABLED
+    adcs_state_t st;
+    adcs_state_load(&st);
+    st.omega_est = omega;
+    st.mag_est = mag;
+    adcs_state_store(&st);
+#else
+    _set_sat_vector(&omega, dat_ads_omega_x);
+    _set_sat_vector(&mag, dat_ads_mag_x);
+#endif
 
 #if LOG_LEVEL >= LOG_LVL_INFO
     LOGR(tag, "Temp1: %.1f, Temp2 %.1f, Gyro temp: %.2f", sensor1/10., sensor2/10., gyro_temp);
@@ -439,6 +784,8 @@ int obc_update_status(char *fmt, char *params, int nparams)
     LOGD(tag, "Reading obc data in Linux \n timestamp: %d", curr_time);
     // Reading temp
     thermal = fopen("/sys/class/thermal/thermal_zone0/temp","r");
+    if(thermal == NULL)
+        return CMD_ERROR;
     n = fscanf(thermal,"%f",&millideg);
     fclose(thermal);
     if(n!= 1)
@@ -479,7 +826,7 @@ int obc_set_tle(char *fmt, char *params, int nparams)
     //----------------------------------------------------------------------
     //1 42788U 17036Z   20054.20928660  .00001463  00000-0  64143-4 0  9996
     //2 42788  97.3188 111.6825 0013081  74.6084 285.6598 15.23469130148339
-    if(params == NULL || sscanf(params, fmt, &line_n, &next) != nparams-1)
+    if(params == NULL || cmd_scan_params(fmt, params, &line_n, &next) != nparams-1)
     {
         LOGE(tag, "Error parsing parameters!");
         return CMD_SYNTAX_ERROR;
@@ -510,54 +857,536 @@ int obc_set_tle(char *fmt, char *params, int nparams)
     return CMD_OK;
 }
 
+#if SCH_OBC_EPH_LEN > 0
+/**
+ * Queue an ephemeris update from @ts, only one at a time
+ */
+static void _obc_eph_request(int ts)
+{
+    _obc_tle_lock();
+    int pending = eph_pending;
+    eph_pending = 1;
+    _obc_tle_unlock();
+    if(pending)
+        return;
+
+    cmd_t *cmd_eph = cmd_get_str("obc_eph_update");
+    if(cmd_eph == NULL)
+    {
+        _obc_tle_lock();
+        eph_pending = 0;
+        _obc_tle_unlock();
+        return;
+    }
+    cmd_add_params_var(cmd_eph, ts);
+    cmd_send(cmd_eph);
+}
+
+/**
+ * Cubic Hermite interpolation of the ephemeris cache of an orbit slot
+ * @return 0 if OK, -1 if @ts is not cached
+ */
+static int _obc_eph_interp(const obc_orbit_t *o, int ts, double *r, double *v)
+{
+    if(o->eph_len < 2)
+        return -1;
+    int dt = ts - o->eph_start;
+    if(dt < 0 || dt > (o->eph_len-1)*SCH_OBC_EPH_STEP)
+        return -1;
+
+    int k = dt/SCH_OBC_EPH_STEP;
+    if(k == o->eph_len-1)
+        k--;
+    const double h = SCH_OBC_EPH_STEP;
+    double s = (dt - k*SCH_OBC_EPH_STEP)/h;
+    double s2 = s*s, s3 = s2*s;
+    // Position basis and their derivatives (scaled by h)
+    double h00 = 2*s3 - 3*s2 + 1, h10 = s3 - 2*s2 + s, h01 = -2*s3 + 3*s2, h11 = s3 - s2;
+    double d00 = 6*s2 - 6*s, d10 = 3*s2 - 4*s + 1, d01 = -6*s2 + 6*s, d11 = 3*s2 - 2*s;
+    const obc_eph_point_t *p0 = &o->eph[k], *p1 = &o->eph[k+1];
+    int i;
+    for(i=0; i<3; i++)
+    {
+        r[i] = h00*p0->r[i] + h10*h*p0->v[i] + h01*p1->r[i] + h11*h*p1->v[i];
+        v[i] = (d00*p0->r[i] + d01*p1->r[i])/h + d10*p0->v[i] + d11*p1->v[i];
+    }
+    return 0;
+}
+#endif
+
+/**
+ * Read the published orbit at @ts. Cached datetimes are interpolated to @r
+ * and @v, otherwise the TLE is copied to @prop to be propagated.
+ * @param renew Set to 1 if the ephemeris cache should be renewed
+ * @return 1 if @ts was cached, 0 if the TLE was copied
+ */
+static int _obc_orbit_read(int ts, TLE *prop, double *r, double *v, int *renew)
+{
+    const obc_orbit_t *cur;
+    uint32_t seq;
+    int cached;
+    do
+    {
+        cur = &orbit[orbit_cur];
+        seq = cur->seq;
+        __sync_synchronize();
+        cached = 0;
+        *renew = 0;
+#if SCH_OBC_EPH_LEN > 0
+        // Renew the cache once 3/4 of it is in the past. Queries before the
+        // cache do not renew it.
+        cached = _obc_eph_interp(cur, ts, r, v) == 0;
+        *renew = _obc_tle_valid(&cur->tle) && (cur->eph_len == 0 ||
+                 ts - cur->eph_start > (cur->eph_len-1)*SCH_OBC_EPH_STEP*3/4);
+#endif
+        if(!cached)
+            memcpy(prop, &cur->tle, sizeof(TLE));
+        __sync_synchronize();
+    }
+    while((seq & 1U) || seq != cur->seq);
+    return cached;
+}
+
 int obc_update_tle(char *fmt, char *params, int nparams)
 {
-    parseLines(&tle, tle1, tle2);
+    _obc_tle_lock();
+    obc_orbit_t *next = _obc_orbit_begin();
+    parseLines(&next->tle, tle1, tle2);
+    int error = next->tle.sgp4Error;
+    double epoch = next->tle.epoch;
+#if SCH_OBC_EPH_LEN > 0
+    next->eph_len = 0;
+#endif
+    _obc_orbit_publish(next);
+    _obc_tle_unlock();
     //TODO: Check errors
-    if(tle.sgp4Error != 0)
+    if(error != 0)
     {
         dat_set_system_var(dat_ads_tle_epoch, 0);
         return CMD_ERROR;
     }
 
-    LOGR(tag, "TLE updated to epoch %.8f (%d)", tle.epoch, (int)(tle.epoch/1000.0));
-    dat_set_system_var(dat_ads_tle_epoch, (int)(tle.epoch/1000.0));
+    LOGR(tag, "TLE updated to epoch %.8f (%d)", epoch, (int)(epoch/1000.0));
+    dat_set_system_var(dat_ads_tle_epoch, (int)(epoch/1000.0));
+#if SCH_OBC_EPH_LEN > 0
+    _obc_eph_request(0);
+#endif
 
     return CMD_OK;
 }
 
-int obc_prop_tle(char *fmt, char *params, int nparams)
+int obc_eph_update(char *fmt, char *params, int nparams)
 {
-    double r[3];  // Sat position in ECI frame
-    double v[3];  // Sat velocity in ECI frame
-    int ts=0;
+    int ts = 0;
+    int rc = CMD_OK;
+    if(params != NULL && cmd_scan_params(fmt, params, &ts) != nparams)
+        rc = CMD_SYNTAX_ERROR;
+    if(ts == 0)
+        ts = dat_get_time();
 
-    if(params != NULL && sscanf(params, fmt, &ts) != nparams)
-        return CMD_SYNTAX_ERROR;
+#if SCH_OBC_EPH_LEN > 0
+    size_t eph_size = SCH_OBC_EPH_LEN*sizeof(obc_eph_point_t);
+    obc_eph_point_t *points = rc == CMD_OK ? malloc(eph_size) : NULL;
+    if(points == NULL)
+    {
+        _obc_tle_lock();
+        eph_pending = 0;
+        _obc_tle_unlock();
+        return rc == CMD_OK ? CMD_ERROR : rc;
+    }
 
+    // Propagate a TLE copy without locks, queries use the current cache
+    TLE prop;
+    int i, error = obc_tle_get(&prop) != 0;  // TLE not set
+    double epoch = prop.epoch;
+    for(i=0; i<SCH_OBC_EPH_LEN && !error; i++)
+    {
+        getRVForDate(&prop, 1000.0*((double)ts + i*SCH_OBC_EPH_STEP), points[i].r, points[i].v);
+        error = prop.sgp4Error != 0;
+    }
+
+    _obc_tle_lock();
+    const obc_orbit_t *cur = &orbit[orbit_cur];
+    if(cur->tle.epoch != epoch)
+        error = 1;  // TLE changed
+    if(!error)
+    {
+        obc_orbit_t *next = _obc_orbit_begin();
+        memcpy(&next->tle, &cur->tle, sizeof(TLE));
+        memcpy(next->eph, points, eph_size);
+        next->eph_start = ts;
+        next->eph_len = SCH_OBC_EPH_LEN;
+        _obc_orbit_publish(next);
+    }
+    eph_pending = 0;
+    _obc_tle_unlock();
+    free(points);
+
+    if(error)
+    {
+        LOGW(tag, "Ephemeris not updated, TLE not valid or changed");
+        return CMD_ERROR;
+    }
+    LOGI(tag, "Ephemeris updated from %d to %d", ts, ts + (SCH_OBC_EPH_LEN-1)*SCH_OBC_EPH_STEP);
+    return CMD_OK;
+#else
+    LOGW(tag, "Ephemeris cache disabled (SCH_OBC_EPH_LEN)");
+    return CMD_ERROR;
+#endif
+}
+
+int obc_prop_tle_rv(int ts, double *r, double *v)
+{
     if(ts == 0)
         ts = dat_get_time();
 
     double ts_mili = 1000.0 * (double) ts;
+    int error = 0, renew;
+    TLE prop;
 
-    double diff = (double)ts - (double)tle.epoch/1000.0;
-    diff /= 60.0;
+    if(!_obc_orbit_read(ts, &prop, r, v, &renew))
+    {
+        double diff = (double)ts - (double)prop.epoch/1000.0;
+        diff /= 60.0;
 
-    getRVForDate(&tle, ts_mili, r, v);
+        getRVForDate(&prop, ts_mili, r, v);
 
-    LOGD(tag, "T : %.8f - %.8f = %.8f", ts_mili/1000.0, tle.epoch/1000.0, diff);
-    LOGD(tag, "R : (%.8f, %.8f, %.8f)", r[0], r[1], r[2]);
-    LOGD(tag, "V : (%.8f, %.8f, %.8f)", v[0], v[1], v[2]);
-    LOGD(tag, "Er: %d", tle.rec.error);
+        LOGD(tag, "T : %.8f - %.8f = %.8f", ts_mili/1000.0, prop.epoch/1000.0, diff);
+        LOGD(tag, "R : (%.8f, %.8f, %.8f)", r[0], r[1], r[2]);
+        LOGD(tag, "V : (%.8f, %.8f, %.8f)", v[0], v[1], v[2]);
+        LOGD(tag, "Er: %d", prop.rec.error);
+        error = prop.sgp4Error;
+    }
+#if SCH_OBC_EPH_LEN > 0
+    if(renew && error == 0)
+        _obc_eph_request(ts - SCH_OBC_EPH_STEP);
+#endif
+
+    return error != 0 ? -1 : 0;
+}
+
+int obc_rv_array_alloc(obc_rv_array_t *rv, int n)
+{
+    memset(rv, 0, sizeof(obc_rv_array_t));
+    if(n <= 0)
+        return -1;
+    // Doubles first, then the ints, keeps every array aligned
+    size_t nd = (size_t)n*sizeof(double), ni = (size_t)n*sizeof(int);
+    uint8_t *block = malloc(6*nd + 2*ni);
+    if(block == NULL)
+        return -1;
+    rv->rx = (double *)block;
+    rv->ry = (double *)(block + nd);
+    rv->rz = (double *)(block + 2*nd);
+    rv->vx = (double *)(block + 3*nd);
+    rv->vy = (double *)(block + 4*nd);
+    rv->vz = (double *)(block + 5*nd);
+    rv->ts = (int *)(block + 6*nd);
+    rv->error = (int *)(block + 6*nd + ni);
+    rv->n = n;
+    return 0;
+}
+
+void obc_rv_array_free(obc_rv_array_t *rv)
+{
+    free(rv->rx);
+    memset(rv, 0, sizeof(obc_rv_array_t));
+}
 
-    if(tle.sgp4Error != 0)
+/**
+ * obc_prop_tle_range work, a slice of the states and a TLE copy
+ */
+typedef struct obc_prop_job {
+    TLE tle;                ///< TLE copy, propagation updates it
+    obc_rv_array_t *rv;     ///< States
+    int first;              ///< First state
+    int last;               ///< Last state (not included)
+    int errors;             ///< States with errors
+} obc_prop_job_t;
+
+static void *_obc_prop_worker(void *arg)
+{
+    obc_prop_job_t *job = (obc_prop_job_t *)arg;
+    obc_rv_array_t *rv = job->rv;
+    double r[3], v[3];
+    int i;
+    for(i=job->first; i<job->last; i++)
+    {
+        getRVForDate(&job->tle, 1000.0*(double)rv->ts[i], r, v);
+        rv->rx[i] = r[0]; rv->ry[i] = r[1]; rv->rz[i] = r[2];
+        rv->vx[i] = v[0]; rv->vy[i] = v[1]; rv->vz[i] = v[2];
+        rv->error[i] = job->tle.sgp4Error;
+        if(rv->error[i] != 0)
+            job->errors++;
+    }
+    return NULL;
+}
+
+int obc_prop_tle_range(const TLE *src, obc_rv_array_t *rv)
+{
+    obc_prop_job_t jobs[SCH_OBC_PROP_THREADS];
+    int nthreads = SCH_OBC_PROP_THREADS;
+    int i, errors = 0;
+    if(nthreads > rv->n)
+        nthreads = rv->n > 0 ? rv->n : 1;
+
+    if(src == NULL)
+        obc_tle_get(&jobs[0].tle);
+    else
+        jobs[0].tle = *src;
+
+    for(i=0; i<nthreads; i++)
+    {
+        jobs[i].tle = jobs[0].tle;
+        jobs[i].rv = rv;
+        jobs[i].first = (int)((long)rv->n*i/nthreads);
+        jobs[i].last = (int)((long)rv->n*(i+1)/nthreads);
+        jobs[i].errors = 0;
+    }
+
+#ifdef LINUX
+    // The caller propagates the first slice, slices without a thread too
+    pthread_t threads[SCH_OBC_PROP_THREADS];
+    int started[SCH_OBC_PROP_THREADS];
+    for(i=1; i<nthreads; i++)
+        started[i] = pthread_create(&threads[i], NULL, _obc_prop_worker, &jobs[i]) == 0;
+    _obc_prop_worker(&jobs[0]);
+    for(i=1; i<nthreads; i++)
+    {
+        if(started[i])
+            pthread_join(threads[i], NULL);
+        else
+            _obc_prop_worker(&jobs[i]);
+    }
+#else
+    for(i=0; i<nthreads; i++)
+        _obc_prop_worker(&jobs[i]);
+#endif
+
+    for(i=0; i<nthreads; i++)
+        errors += jobs[i].errors;
+    return errors;
+}
+
+int obc_prop_tle_range_cmd(char *fmt, char *params, int nparams)
+{
+    int start, step, n, i;
+    if(params == NULL || cmd_scan_params(fmt, params, &start, &step, &n) != nparams || n <= 0)
+        return CMD_SYNTAX_ERROR;
+    if(start == 0)
+        start = dat_get_time();
+
+    obc_rv_array_t rv;
+    if(obc_rv_array_alloc(&rv, n) != 0)
+    {
+        LOGE(tag, "Unable to allocate %d states", n);
         return CMD_ERROR;
+    }
+    for(i=0; i<n; i++)
+        rv.ts[i] = start + i*step;
+
+    portTick t0 = osTaskGetTickCount();
+    int errors = obc_prop_tle_range(NULL, &rv);
+    portTick t1 = osTaskGetTickCount();
+
+    for(i=0; i<n; i++)
+        LOGR(tag, "%d,%.8f,%.8f,%.8f,%.8f,%.8f,%.8f", rv.ts[i], rv.rx[i], rv.ry[i], rv.rz[i],
+             rv.vx[i], rv.vy[i], rv.vz[i]);
+    LOGI(tag, "Propagated %d states, %d errors (%u ticks)", n, errors, (unsigned int)(t1-t0));
+
+    obc_rv_array_free(&rv);
+    return errors == 0 ? CMD_OK : CMD_ERROR;
+}
+
+int obc_prop_tle(char *fmt, char *params, int nparams)
+{
+    double r[3];  // Sat position in ECI frame
+    double v[3];  // Sat velocity in ECI frame
+    long ts=0;    // Format is "%ld"
+
+    if(params != NULL && cmd_scan_params(fmt, params, &ts) != nparams)
+        return CMD_SYNTAX_ERROR;
 
+    if(ts == 0)
+        ts = dat_get_time();
+
+    if(obc_prop_tle_rv((int)ts, r, v) != 0)
+        return CMD_ERROR;
+
+#if SCH_ADCS_ENABLED
+    // The ADCS state block is mirrored to the status variables by taskADCS
+    adcs_state_t st;
+    adcs_state_load(&st);
+    st.pos_i.v0 = r[0]; st.pos_i.v1 = r[1]; st.pos_i.v2 = r[2];
+    st.tle_last = (int)ts;
+    adcs_state_store(&st);
+#else
     value32_t pos[3] = {{.f=(float)r[0]},{.f=(float)r[1]}, {.f=(float)r[2]}};
-    dat_set_status_var(dat_ads_pos_x, pos[0]);
-    dat_set_status_var(dat_ads_pos_y, pos[1]);
-    dat_set_status_var(dat_ads_pos_z, pos[2]);
+    dat_set_status_vars(dat_ads_pos_x, 3, pos);
     dat_set_system_var(dat_ads_tle_last, (int)ts);
+#endif
+
+    return CMD_OK;
+}
+
+/**
+ * Ground station position and zenith in the ECI frame, WGS84 ellipsoid
+ * @param ts Unix timestamp
+ * @param gs Position [km], array of 3 doubles
+ * @param up Zenith, array of 3 doubles
+ * @return Sidereal angle of the ground station meridian [rad]
+ */
+static double _obc_gs_eci(double ts, double *gs, double *up)
+{
+    const double a = 6378.137, f = 1.0/298.257223563;
+    double e2 = f*(2.0 - f);
+    double lat = SCH_GS_LAT_DEG*M_PI/180.0;
+    double theta = SCH_GS_LON_DEG*M_PI/180.0 + gstime(ts/86400.0 + 2440587.5);
+    double n = a/sqrt(1.0 - e2*sin(lat)*sin(lat));
+    double h = SCH_GS_ALT_M/1000.0;
+    up[0] = cos(lat)*cos(theta); up[1] = cos(lat)*sin(theta); up[2] = sin(lat);
+    gs[0] = (n+h)*up[0]; gs[1] = (n+h)*up[1]; gs[2] = (n*(1.0-e2)+h)*up[2];
+    return theta;
+}
+
+double obc_pass_elevation(const double *r, int ts)
+{
+    double gs[3], up[3];
+    _obc_gs_eci(ts, gs, up);
+    double rho[3] = {r[0] - gs[0], r[1] - gs[1], r[2] - gs[2]};
+
+    double range = sqrt(rho[0]*rho[0] + rho[1]*rho[1] + rho[2]*rho[2]);
+    if(range <= 0)
+        return 90.0;
+    return asin((rho[0]*up[0] + rho[1]*up[1] + rho[2]*up[2])/range)*180.0/M_PI;
+}
+
+void obc_pass_look(const double *r, const double *v, double ts, obc_look_t *look)
+{
+    const double w_earth = 7.292115e-5;     // Earth rotation [rad/s]
+    double gs[3], up[3];
+    double theta = _obc_gs_eci(ts, gs, up);
+    double rho[3] = {r[0] - gs[0], r[1] - gs[1], r[2] - gs[2]};
+    // Relative velocity, the ground station rotates with the Earth
+    double rho_v[3] = {v[0] + w_earth*gs[1], v[1] - w_earth*gs[0], v[2]};
+
+    look->range = sqrt(rho[0]*rho[0] + rho[1]*rho[1] + rho[2]*rho[2]);
+    if(look->range <= 0)
+    {
+        look->az = 0.0; look->el = 90.0; look->range_rate = 0.0;
+        return;
+    }
+
+    // Local East-North-Up frame
+    double east[3] = {-sin(theta), cos(theta), 0.0};
+    double north[3] = {up[1]*east[2] - up[2]*east[1], up[2]*east[0] - up[0]*east[2], up[0]*east[1] - up[1]*east[0]};
+    double e = rho[0]*east[0] + rho[1]*east[1] + rho[2]*east[2];
+    double n = rho[0]*north[0] + rho[1]*north[1] + rho[2]*north[2];
+    double u = rho[0]*up[0] + rho[1]*up[1] + rho[2]*up[2];
+
+    look->el = asin(fmax(-1.0, fmin(1.0, u/look->range)))*180.0/M_PI;
+    look->az = atan2(e, n)*180.0/M_PI;
+    if(look->az < 0)
+        look->az += 360.0;
+    look->range_rate = (rho[0]*rho_v[0] + rho[1]*rho_v[1] + rho[2]*rho_v[2])/look->range;
+}
 
+/**
+ * Satellite elevation over the ground station at a datetime
+ * @return 0 if OK, -1 if the propagator failed
+ */
+static int _obc_pass_el(int ts, double *el)
+{
+    double r[3], v[3];
+    if(obc_prop_tle_rv(ts, r, v) != 0)
+        return -1;
+    *el = obc_pass_elevation(r, ts);
+    return 0;
+}
+
+/**
+ * Bisect the elevation mask crossing in (t0, t1], above the mask at t1 if
+ * @rising, below it otherwise
+ * @return First second of t1's side of the crossing, -1 on error
+ */
+static int _obc_pass_cross(int t0, int t1, int rising)
+{
+    double el;
+    while(t1 - t0 > 1)
+    {
+        int t = t0 + (t1 - t0)/2;
+        if(_obc_pass_el(t, &el) != 0)
+            return -1;
+        if((el >= SCH_GS_MIN_EL_DEG) == rising)
+            t1 = t;
+        else
+            t0 = t;
+    }
+    return t1;
+}
+
+int obc_next_pass(int ts, int horizon, obc_pass_t *pass)
+{
+    if(ts == 0)
+        ts = dat_get_time();
+
+    TLE cur;
+    if(obc_tle_get(&cur) != 0)
+        return -1;
+
+    // Scan for the AOS, the pass in progress starts now
+    double el;
+    int t = ts, prev = ts;
+    if(_obc_pass_el(t, &el) != 0)
+        return -1;
+    while(el < SCH_GS_MIN_EL_DEG)
+    {
+        if(t - ts >= horizon)
+            return 1;
+        prev = t;
+        t += SCH_OBC_EPH_STEP;
+        if(_obc_pass_el(t, &el) != 0)
+            return -1;
+    }
+    pass->aos = t == ts ? ts : _obc_pass_cross(prev, t, 1);
+    pass->max_el = el;
+
+    // Scan for the LOS, the satellite is above the mask for less than an orbit
+    int t_max = t + 2*3600;
+    while(el >= SCH_GS_MIN_EL_DEG && t < t_max)
+    {
+        prev = t;
+        t += SCH_OBC_EPH_STEP;
+        if(_obc_pass_el(t, &el) != 0)
+            return -1;
+        if(el > pass->max_el)
+            pass->max_el = el;
+    }
+    pass->los = el < SCH_GS_MIN_EL_DEG ? _obc_pass_cross(prev, t, 0) : t;
+    if(pass->aos < 0 || pass->los < 0)
+        return -1;
+    return 0;
+}
+
+int obc_get_pass(char *fmt, char *params, int nparams)
+{
+    int horizon;
+    if(params == NULL || cmd_scan_params(fmt, params, &horizon) != nparams || horizon <= 0)
+        return CMD_SYNTAX_ERROR;
+
+    obc_pass_t pass;
+    int rc = obc_next_pass(0, horizon, &pass);
+    if(rc < 0)
+    {
+        LOGW(tag, "Unable to predict passes, invalid TLE");
+        return CMD_ERROR;
+    }
+    if(rc > 0)
+    {
+        LOGR(tag, "No pass in the next %d s", horizon);
+        return CMD_ERROR;
+    }
+    LOGR(tag, "AOS: %d, LOS: %d (%d s), max. elevation %.1f deg", pass.aos, pass.los,
+         pass.los - pass.aos, pass.max_el);
     return CMD_OK;
 }
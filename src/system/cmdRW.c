@@ -31,6 +31,7 @@ void cmd_rw_init(void)
     cmd_add("rw_get_speed", rw_get_speed, "%d", 1);
     cmd_add("rw_get_current", rw_get_current, "%d", 1);
     cmd_add("rw_set_speed", rw_set_speed, "%d %d", 2);
+    cmd_add("rw_set_speed_all", rw_set_speed_all, "%d %d %d", 3);
     /** UPPER ISTAGE COMMANDS **/
 #ifdef SCH_USE_ISTAGE2
     cmd_add("is2_get_temp", istage2_get_temp, "", 0);
@@ -43,7 +44,7 @@ void cmd_rw_init(void)
 int rw_get_speed(char *fmt, char *params, int nparams)
 {
     int motorid;
-    if(params == NULL || sscanf(params, fmt, &motorid) != nparams) {
+    if(params == NULL || cmd_scan_params(fmt, params, &motorid) != nparams) {
         motorid = -1;
     }
 
@@ -68,7 +69,7 @@ int rw_get_speed(char *fmt, char *params, int nparams)
 int rw_get_current(char *fmt, char *params, int nparams)
 {
     int motorid;
-    if(params == NULL || sscanf(params, fmt, &motorid) != nparams) {
+    if(params == NULL || cmd_scan_params(fmt, params, &motorid) != nparams) {
         motorid = -1;
     }
 
@@ -96,7 +97,7 @@ int rw_set_speed(char *fmt, char *params, int nparams)
     int motor_id;
     int speed;
 
-    if(params == NULL || sscanf(params, fmt, &motor_id, &speed) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &motor_id, &speed) != nparams)
         return CMD_SYNTAX_ERROR;
 
     int rc = rwdrv10987_set_speed(motor_id, speed);
@@ -104,6 +105,42 @@ int rw_set_speed(char *fmt, char *params, int nparams)
     return rc == GS_OK ? CMD_OK : CMD_ERROR;
 }
 
+int rw_set_speed_all(char *fmt, char *params, int nparams)
+{
+    int speed[3];
+    if(params == NULL || cmd_scan_params(fmt, params, &speed[0], &speed[1], &speed[2]) != nparams)
+        return CMD_SYNTAX_ERROR;
+
+    uint16_t speeds[3] = {(uint16_t)speed[0], (uint16_t)speed[1], (uint16_t)speed[2]};
+    int rc = rwdrv10987_set_speed_all(speeds);
+    LOGR(tag, "Setting speeds: %d, %d, %d (%d)", speed[0], speed[1], speed[2], rc);
+    return rc == GS_OK ? CMD_OK : CMD_ERROR;
+}
+
+/**
+ * Measurement requested by the last rw_sample_step call: speed of motor 1-3
+ * (0-2) or current of motor 1-3 (3-5), -1 if none
+ */
+static int rw_tm_pending = -1;
+
+int rw_sample_step(float speed[3], float current[3])
+{
+    int rc = 0;
+    if(rw_tm_pending >= 0)
+    {
+        int is_current = rw_tm_pending / 3;
+        float *values = is_current ? current : speed;
+        rc = rwdrv10987_sample_read(is_current, &values[rw_tm_pending % 3]);
+    }
+
+    int next = (rw_tm_pending + 1) % 6;
+    rw_tm_pending = -1;
+    if(rwdrv10987_sample_request(MOTOR1_ID + next % 3, next / 3) != 0)
+        return -1;
+    rw_tm_pending = next;
+    return rc;
+}
+
 /** UPPER ISTAGE COMMANDS **/
 #ifdef SCH_USE_ISTAGE2
 int istage2_get_temp(char *fmt, char *params, int nparams)
@@ -113,7 +150,7 @@ int istage2_get_temp(char *fmt, char *params, int nparams)
     char istage_ans[1];
 
     istage_cmd[0] = IS2_START_SENSORS_TEMP;
-    rc = gs_i2c_master_transaction(ISTAGE_GSSB_TWI_HANDLER, ISTAGE_UPPER_ADD, istage_cmd, 2, istage_ans, 1, 500);
+    rc = i2c_bus_write_read(ISTAGE_GSSB_TWI_HANDLER, I2C_PRIO_NORMAL, ISTAGE_UPPER_ADD, istage_cmd, 2, istage_ans, 1, 500);
     LOGI(tag2, "START_SENSORS_TEMP %d (%d)", istage_ans[0], rc);
     if(rc != GS_OK)
         return CMD_ERROR;
@@ -121,7 +158,7 @@ int istage2_get_temp(char *fmt, char *params, int nparams)
     osDelay(100);
 
     istage_cmd[0] = I2S_SAMPLE_TEMP;
-    rc = gs_i2c_master_transaction(ISTAGE_GSSB_TWI_HANDLER, ISTAGE_UPPER_ADD, istage_cmd, 2, istage_ans, 1, 500);
+    rc = i2c_bus_write_read(ISTAGE_GSSB_TWI_HANDLER, I2C_PRIO_NORMAL, ISTAGE_UPPER_ADD, istage_cmd, 2, istage_ans, 1, 500);
     LOGI(tag2, "SAMPLE_TEMP %d (%d)", istage_ans[0], rc);
     if(rc != GS_OK)
         return CMD_ERROR;
@@ -130,13 +167,13 @@ int istage2_get_temp(char *fmt, char *params, int nparams)
 
     istage_cmd[0] = IS2_GET_TEMP;
     uint32_t temps[8];
-    rc = gs_i2c_master_transaction(ISTAGE_GSSB_TWI_HANDLER, ISTAGE_UPPER_ADD, istage_cmd, 2, (char *)temps, sizeof(temps), 500);
+    rc = i2c_bus_write_read(ISTAGE_GSSB_TWI_HANDLER, I2C_PRIO_NORMAL, ISTAGE_UPPER_ADD, istage_cmd, 2, (char *)temps, sizeof(temps), 500);
     LOGR(tag2, "IS2_GET_TEMP %f, %f, %f, %f, %f, %f, %f, %f (%d)", temps[0], temps[1], temps[2], temps[3], temps[4], temps[5], temps[6], temps[7], rc);
     if(rc != GS_OK)
         return CMD_ERROR;
 
     istage_cmd[0] = IS2_STOP_SENSORS_TEMP;
-    rc = gs_i2c_master_transaction(ISTAGE_GSSB_TWI_HANDLER, ISTAGE_UPPER_ADD, istage_cmd, 2, istage_ans, 1, 500);
+    rc = i2c_bus_write_read(ISTAGE_GSSB_TWI_HANDLER, I2C_PRIO_NORMAL, ISTAGE_UPPER_ADD, istage_cmd, 2, istage_ans, 1, 500);
     LOGI(tag2, "STOP_SENSORS_TEMP (%d)", rc);
     if(rc != GS_OK)
         return CMD_ERROR;
@@ -149,7 +186,7 @@ int istage2_get_state_panel(char *fmt, char *params, int nparams)
 {
     int rc, panel;
 
-    if(params == NULL || sscanf(params, fmt, &panel) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &panel) != nparams)
     {
         LOGW(tag2, "get_state_panel used with invalid params!");
         return CMD_SYNTAX_ERROR;
@@ -157,7 +194,7 @@ int istage2_get_state_panel(char *fmt, char *params, int nparams)
 
     char istage_cmd[2] = {IS2_READ_SW_FACE, (char)panel};
     char istage_ans[2] = {-1, -1};
-    rc = gs_i2c_master_transaction(ISTAGE_GSSB_TWI_HANDLER, ISTAGE_UPPER_ADD, istage_cmd, 2, istage_ans, 2, 500);
+    rc = i2c_bus_write_read(ISTAGE_GSSB_TWI_HANDLER, I2C_PRIO_NORMAL, ISTAGE_UPPER_ADD, istage_cmd, 2, istage_ans, 2, 500);
     LOGR(tag2, "IS2_READ_SW_FACE %d=%d (%d)", panel, istage_ans[1], rc);
 
     if(rc != GS_OK)
@@ -170,14 +207,14 @@ int istage2_deploy_panel(char *fmt, char *params, int nparams)
 {
     int rc, panel;
 
-    if(params == NULL || sscanf(params, fmt, &panel) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &panel) != nparams)
     {
         LOGW(tag2, "deploy_panel used with invalid params!");
         return CMD_SYNTAX_ERROR;
     }
 
     char istage_cmd[2] = {IS2_BURN_FACE, (char)panel};
-    rc = gs_i2c_master_transaction(ISTAGE_GSSB_TWI_HANDLER, ISTAGE_UPPER_ADD, istage_cmd, 2, NULL, 0, 500);
+    rc = i2c_bus_write_read(ISTAGE_GSSB_TWI_HANDLER, I2C_PRIO_NORMAL, ISTAGE_UPPER_ADD, istage_cmd, 2, NULL, 0, 500);
     LOGR(tag2, "IS2_BURN_FACE %d (%d)", panel, rc);
 
     if(rc != GS_OK)
@@ -190,14 +227,14 @@ int istage2_set_deploy(char *fmt, char *params, int nparams)
 {
     int rc, config;
 
-    if(params == NULL || sscanf(params, fmt, &config) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &config) != nparams)
     {
         LOGW(tag2, "deploy_panel used with invalid params!");
         return CMD_SYNTAX_ERROR;
     }
 
     char istage_cmd[2] = {IS2_SET_BURN, (char)config};
-    rc = gs_i2c_master_transaction(ISTAGE_GSSB_TWI_HANDLER, ISTAGE_UPPER_ADD, istage_cmd, 2, NULL, 0, 500);
+    rc = i2c_bus_write_read(ISTAGE_GSSB_TWI_HANDLER, I2C_PRIO_NORMAL, ISTAGE_UPPER_ADD, istage_cmd, 2, NULL, 0, 500);
     LOGR(tag2, "IS2_SET_BURN %d (%d)", config, rc);
 
     if(rc != GS_OK)
@@ -20,6 +20,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_TAG_ID LOG_TAG_SENSORS
 #include "cmdSensors.h"
 
 static const char* tag = "cmdSens";
@@ -27,9 +28,15 @@ static const char* tag = "cmdSens";
 void cmd_sensors_init(void)
 {
     cmd_add("sen_set_machine", set_state, "%u %u %d", 3);
+    cmd_add("sen_set_machine_ms", set_state_ms, "%u %u %d", 3);
     cmd_add("sen_activate", activate_sensor, "%d %d", 2);
     cmd_add("sen_take_sample", take_sample, "%u", 1);
     cmd_add("sen_init_dummy", init_dummy_sensor, "", 0);
+    cmd_add("sen_reduce_set", reduce_set, "%d %d %d %u", 4);
+    cmd_add("sen_reduce_trig", reduce_trig, "%d %d %f %d %d %d", 6);
+    cmd_add("sen_delta_set", delta_set, "%d", 1);
+    // Periodic samples are dropped under load, the next ones are taken
+    cmd_set_shed("sen_take_sample", CMD_LOAD_HIGH);
 }
 
 int set_state(char *fmt, char *params, int nparams)
@@ -40,13 +47,28 @@ int set_state(char *fmt, char *params, int nparams)
     unsigned int action;
     unsigned int step;
     int nsamples;
-    if(nparams == sscanf(params, fmt, &action, &step, &nsamples)){
+    if(nparams == cmd_scan_params(fmt, params, &action, &step, &nsamples)){
         int rc = dat_set_stmachine_state(action, step, nsamples);
         return rc ? CMD_OK : CMD_ERROR;
     }
     return CMD_SYNTAX_ERROR;
 }
 
+int set_state_ms(char *fmt, char *params, int nparams)
+{
+    if(params == NULL)
+        return CMD_SYNTAX_ERROR;
+
+    unsigned int action;
+    unsigned int step_ms;
+    int nsamples;
+    if(nparams == cmd_scan_params(fmt, params, &action, &step_ms, &nsamples)){
+        int rc = dat_set_stmachine_state_ms(action, step_ms, nsamples);
+        return rc ? CMD_OK : CMD_ERROR;
+    }
+    return CMD_SYNTAX_ERROR;
+}
+
 int activate_sensor(char *fmt, char *params, int nparams)
 {
     if(params == NULL)
@@ -54,7 +76,7 @@ int activate_sensor(char *fmt, char *params, int nparams)
 
     int payload;
     int activate;
-    if(nparams == sscanf(params, fmt, &payload, &activate))
+    if(nparams == cmd_scan_params(fmt, params, &payload, &activate))
     {
         if(payload < 0 ) {
             if (activate == 0) {
@@ -97,128 +119,816 @@ int activate_sensor(char *fmt, char *params, int nparams)
     return CMD_SYNTAX_ERROR;
 }
 
-int take_sample(char *fmt, char *params, int nparams)
+/**
+ * Board temperature sensors
+ */
+static int _sen_sample_temp(void *data)
 {
-    //TODO: SEPARATE EACH TAKE SAMPLE IN A FUNCTION
-    if(params == NULL)
-        return CMD_SYNTAX_ERROR;
+    temp_data_t *temp = (temp_data_t *)data;
+    int16_t sensor1=1, sensor2=2;
+    float gyro_temp=1.0;
+#ifdef NANOMIND
+    /* Read board temperature sensors */
+    gs_lm71_read_temp(GS_A3200_SPI_SLAVE_LM71_0, 100, &sensor1); //sensor1 = lm70_read_temp(1);
+    gs_lm71_read_temp(GS_A3200_SPI_SLAVE_LM71_1, 100, &sensor2); //sensor2 = lm70_read_temp(2);
+    int bus = i2c_bus_acquire(SCH_A3200_I2C_BUS, I2C_PRIO_NORMAL) == 0;
+    gs_mpu3300_read_temp(&gyro_temp);
+    if(bus)
+        i2c_bus_release(SCH_A3200_I2C_BUS);
+#endif
+    temp->obc_temp_1 = (float)(sensor1/10.0);
+    temp->obc_temp_2 = (float)(sensor2/10.0);
+    temp->obc_temp_3 = gyro_temp;
+    return 0;
+}
 
-    int payload;
-    if(nparams == sscanf(params, fmt, &payload)) {
+/**
+ * Gyroscope and magnetometer
+ */
+static int _sen_sample_ads(void *data)
+{
+    ads_data_t *ads = (ads_data_t *)data;
+    float gyro_x=1.0, gyro_y=2.0, gyro_z=3.0, mag_x=4.0, mag_y=5.0, mag_z=6.0;
+#ifdef NANOMIND
+    gs_mpu3300_gyro_t gyro_reading;
+    gs_hmc5843_data_t hmc_reading;
+    int bus = i2c_bus_acquire(SCH_A3200_I2C_BUS, I2C_PRIO_NORMAL) == 0;
+    gs_mpu3300_read_gyro(&gyro_reading);
+    gs_hmc5843_read_single(&hmc_reading);
+    if(bus)
+        i2c_bus_release(SCH_A3200_I2C_BUS);
 
-        int ret;
+    gyro_x = gyro_reading.gyro_x;
+    gyro_y = gyro_reading.gyro_y;
+    gyro_z = gyro_reading.gyro_z;
+    mag_x = hmc_reading.x;
+    mag_y = hmc_reading.y;
+    mag_z = hmc_reading.z;
+#endif
+    ads->acc_x = gyro_x; ads->acc_y = gyro_y; ads->acc_z = gyro_z;
+    ads->mag_x = mag_x; ads->mag_y = mag_y; ads->mag_z = mag_z;
+    return 0;
+}
 
-        if( payload >= last_sensor) {
-            return CMD_SYNTAX_ERROR;
-        }
+/**
+ * EPS housekeeping
+ */
+static int _sen_sample_eps(void *data)
+{
+    eps_data_t *eps = (eps_data_t *)data;
+    eps->cursun = 1; eps->cursys = 2; eps->vbatt = 3;
+    eps->temp1 = 4; eps->temp2 = 5; eps->temp3 = 6;
+    eps->temp4 = 7; eps->temp5 = 8; eps->temp6 = 9;
+#ifdef SCH_USE_NANOPOWER
+    eps_hk_t hk = {};
+    if(eps_hk_get_cached(&hk, SCH_EPS_HK_MAX_AGE_MS) != 0)
+        return -1;
+    eps->cursun = hk.cursun;
+    eps->cursys = hk.cursys;
+    eps->vbatt = hk.vbatt;
+    eps->temp1 = hk.temp[0];
+    eps->temp2 = hk.temp[1];
+    eps->temp3 = hk.temp[2];
+    eps->temp4 = hk.temp[3];
+    eps->temp5 = hk.temp[4];
+    eps->temp6 = hk.temp[5];
+#endif
+    return 0;
+}
+
+/**
+ * Status variables, in dat_status_list order, from one snapshot
+ */
+static int _sen_sample_sta(void *data)
+{
+    sta_data_t *sta = (sta_data_t *)data;
+    value32_t status_vars[dat_status_last_address];
+    if(dat_get_status_vars(0, dat_status_last_address, status_vars) != 0)
+        return -1;
+    int i;
+    for(i = 0; i<dat_status_last_var; i++)
+        sta->sta_buff[i] = status_vars[dat_status_list[i].address].u;
+    return 0;
+}
+
+static int _sen_init_dummy(void)
+{
+    LOGD(tag, "Initializing dummy sensor");
+    return 0;
+}
+
+/**
+ * Sensor drivers by payload id, one per data_map entry. The STT payloads are
+ * stored by the STT commands.
+ */
+static const sen_driver_t sen_drivers[] = {
+    [temp_sensors] = {_sen_init_dummy, _sen_sample_temp},
+    [ads_sensors] = {_sen_init_dummy, _sen_sample_ads},
+    [eps_sensors] = {_sen_init_dummy, _sen_sample_eps},
+    [sta_sensors] = {_sen_init_dummy, _sen_sample_sta},
+    [stt_sensors] = {NULL, NULL},
+    [stt_exp_time_sensors] = {NULL, NULL},
+};
+
+const sen_driver_t *sen_get_driver(int payload)
+{
+    if(payload < 0 || payload >= last_sensor || payload >= (int)(sizeof(sen_drivers)/sizeof(sen_drivers[0])))
+        return NULL;
+    if(sen_drivers[payload].init == NULL && sen_drivers[payload].sample == NULL)
+        return NULL;
+    return &sen_drivers[payload];
+}
+
+/**
+ * Burst mode RAM ring of one payload, the samples are stored in order from
+ * head, data_map[payload].size bytes each
+ */
+typedef struct sen_burst {
+    uint8_t *buff;          ///< Samples buffer, a slice of sen_burst_pool
+    int len;                ///< Buffer size in samples
+    int head;               ///< Oldest sample
+    int count;              ///< Samples in the buffer
+} sen_burst_t;
+
+static uint8_t sen_burst_pool[SCH_SEN_BURST_BUFF] __attribute__((aligned(4)));
+static sen_burst_t sen_burst[last_sensor];
+
+/**
+ * Split the burst pool among the sampled payloads, in equal parts. Each ring
+ * holds an even number of samples so half full flushes are contiguous.
+ */
+static void _sen_burst_init(void)
+{
+    int i, n = 0;
+    memset(sen_burst, 0, sizeof(sen_burst));
+    for(i = 0; i < last_sensor; i++)
+    {
+        const sen_driver_t *driver = sen_get_driver(i);
+        if(driver != NULL && driver->sample != NULL)
+            n++;
+    }
+    if(n == 0)
+        return;
+
+    size_t part = (SCH_SEN_BURST_BUFF/n) & ~(size_t)3;
+    uint8_t *buff = sen_burst_pool;
+    for(i = 0; i < last_sensor; i++)
+    {
+        const sen_driver_t *driver = sen_get_driver(i);
+        if(driver == NULL || driver->sample == NULL)
+            continue;
+        sen_burst[i].buff = buff;
+        sen_burst[i].len = (int)(part/data_map[i].size) & ~1;
+        if(sen_burst[i].len < 2)
+            LOGW(tag, "Burst buffer too small for payload %d (%s)", i, data_map[i].table);
+        buff += part;
+    }
+}
+
+/**
+ * Store the burst samples of one payload. The ring is written in one
+ * dat_add_payload_samples call, or two if the samples wrap around the end.
+ * @return 0 if OK, -1 on error (the samples not stored are kept)
+ */
+static int _sen_burst_flush(int payload)
+{
+    sen_burst_t *burst = &sen_burst[payload];
+    while(burst->count > 0)
+    {
+        int n = burst->len - burst->head;
+        if(n > burst->count)
+            n = burst->count;
+        if(dat_add_payload_samples(burst->buff + burst->head*data_map[payload].size, payload, n) < 0)
+            return -1;
+        burst->head = (burst->head + n) % burst->len;
+        burst->count -= n;
+    }
+    burst->head = 0;
+    return 0;
+}
+
+static void _sen_reduce_init(void);
 
-        int curr_time =  (int)time(NULL);
-        if( payload == 0 ) // Temperature
+int sen_init_drivers(void)
+{
+    int i, failed = 0;
+    for(i = 0; i < last_sensor; i++)
+    {
+        const sen_driver_t *driver = sen_get_driver(i);
+        if(driver != NULL && driver->init != NULL && driver->init() != 0)
         {
-            int16_t sensor1=1, sensor2=2;
-            float gyro_temp=1.0;
-#ifdef NANOMIND
-            /* Read board temperature sensors */
-            gs_lm71_read_temp(GS_A3200_SPI_SLAVE_LM71_0, 100, &sensor1); //sensor1 = lm70_read_temp(1);
-            gs_lm71_read_temp(GS_A3200_SPI_SLAVE_LM71_1, 100, &sensor2); //sensor2 = lm70_read_temp(2);
-            gs_mpu3300_read_temp(&gyro_temp);
-#endif
-            /* Save temperature data */
-            int index_temp = dat_get_system_var(data_map[temp_sensors].sys_index);
-            struct temp_data data_temp = {index_temp, curr_time, (float)(sensor1/10.0), (float)(sensor2/10.0), gyro_temp};
-            ret = dat_add_payload_sample(&data_temp, temp_sensors);
+            LOGE(tag, "Unable to initialize sensor %d (%s)", i, data_map[i].table);
+            failed++;
+        }
+    }
+    _sen_burst_init();
+    _sen_reduce_init();
+    return failed;
+}
+
+/**
+ * Read one sample of a payload with its driver
+ * @param payload Payload id
+ * @param data Buffer, data_map[payload].size bytes
+ * @param index Sample index
+ * @param timestamp Sample timestamp
+ * @return 0 if OK, -1 on error
+ */
+static int _sen_sample(int payload, void *data, uint32_t index, uint32_t timestamp)
+{
+    const sen_driver_t *driver = sen_get_driver(payload);
+    memset(data, 0, data_map[payload].size);
+    if(driver->sample(data) != 0)
+    {
+        LOGW(tag, "Unable to sample payload %d (%s)", payload, data_map[payload].table);
+        return -1;
+    }
+    // Payload structs start with the index and timestamp
+    ((uint32_t *)data)[0] = index;
+    ((uint32_t *)data)[1] = timestamp;
+    return 0;
+}
+
+/**
+ * Check if a payload is selected in @payloads and has a sample driver
+ */
+static int _sen_is_sampled(unsigned int payloads, int payload)
+{
+    const sen_driver_t *driver = sen_get_driver(payload);
+    return driver != NULL && driver->sample != NULL && (payloads & (1U << payload));
+}
+
+/**
+ * Running statistics of a payload field (Welford)
+ */
+typedef struct sen_stat {
+    uint32_t n;
+    float min;
+    float max;
+    double mean;
+    double m2;              ///< Sum of squared differences from the mean
+} sen_stat_t;
+
+/**
+ * On-board data reduction of one payload, @see sen_reduce_set and
+ * sen_reduce_trig
+ */
+typedef struct sen_reduce {
+    int decimate;           ///< Store one of every @decimate samples, 1 stores all, 0 none
+    int window;             ///< Statistics window in samples, 0 disables the statistics
+    uint32_t fields;        ///< Statistics fields (bit i = field i)
+    int trig_field;         ///< Trigger field, -1 disables the trigger
+    float trig_level;       ///< Trigger threshold
+    int trig_dir;           ///< Fires when the field rises over (1) or falls under (-1) the level
+    int post;               ///< Samples stored after the trigger
+    uint32_t count;         ///< Samples reduced, for the decimation
+    int n_win;              ///< Samples in the current window
+    sen_stat_t stat[SCH_SEN_REDUCE_FIELDS];
+    float last;             ///< Previous value of the trigger field
+    int has_last;           ///< Set if last is valid
+    int capture_left;       ///< Post-trigger samples left
+    trig_data_t event;      ///< Current trigger event, stored when the capture ends
+    uint8_t *ring;          ///< Pre-trigger samples, a slice of sen_reduce_pool
+    int ring_max;           ///< Ring capacity in samples
+    int ring_len;           ///< Pre-trigger samples to keep, up to ring_max
+    int ring_head;          ///< Oldest sample
+    int ring_count;         ///< Samples in the ring
+} sen_reduce_t;
+
+static uint8_t sen_reduce_pool[SCH_SEN_REDUCE_BUFF] __attribute__((aligned(4)));
+static sen_reduce_t sen_reduce[last_sensor];
+static osSemaphore sen_reduce_sem;
+static int sen_reduce_sem_ok = 0;
+
+/**
+ * Status variables delta storage, @see sen_delta_set
+ */
+typedef struct sen_delta {
+    int keyframe;           ///< Samples between sta_data keyframes, 0 stores every sample in full
+    int since;              ///< Deltas stored since the last keyframe
+    uint32_t key;           ///< Index of the last keyframe
+    int has_prev;           ///< Set if prev is valid
+    sta_data_t prev;        ///< Previous status sample
+} sen_delta_t;
+
+static sen_delta_t sen_delta;
+
+/**
+ * Reset the reduction of a payload, without changing its settings
+ */
+static void _sen_reduce_reset(sen_reduce_t *red)
+{
+    red->count = 0;
+    red->n_win = 0;
+    memset(red->stat, 0, sizeof(red->stat));
+    red->has_last = 0;
+    red->capture_left = 0;
+    red->ring_head = 0;
+    red->ring_count = 0;
+}
+
+/**
+ * Set the reduction defaults, every sample stored and no products, and split
+ * the pre-trigger pool among the sampled payloads
+ */
+static void _sen_reduce_init(void)
+{
+    int i, n = 0;
+    memset(sen_reduce, 0, sizeof(sen_reduce));
+    memset(&sen_delta, 0, sizeof(sen_delta));
+    for(i = 0; i < last_sensor; i++)
+    {
+        sen_reduce[i].decimate = 1;
+        sen_reduce[i].trig_field = -1;
+        const sen_driver_t *driver = sen_get_driver(i);
+        if(driver != NULL && driver->sample != NULL)
+            n++;
+    }
 
-            if (ret != 0) {
-                return CMD_ERROR;
+    size_t part = n > 0 ? (SCH_SEN_REDUCE_BUFF/n) & ~(size_t)3 : 0;
+    uint8_t *buff = sen_reduce_pool;
+    for(i = 0; i < last_sensor && part > 0; i++)
+    {
+        const sen_driver_t *driver = sen_get_driver(i);
+        if(driver == NULL || driver->sample == NULL)
+            continue;
+        sen_reduce[i].ring = buff;
+        sen_reduce[i].ring_max = (int)(part/data_map[i].size);
+        buff += part;
+    }
+
+    sen_reduce_sem_ok = osSemaphoreCreate(&sen_reduce_sem) == OS_SEMAPHORE_OK;
+    if(!sen_reduce_sem_ok)
+        LOGE(tag, "Unable to create data reduction mutex, samples are not reduced");
+}
+
+/**
+ * Get a payload struct field as float
+ */
+static float _sen_field_value(const dat_payload_field_t *field, const void *data)
+{
+    const uint8_t *p = (const uint8_t *)data + field->offset;
+    switch(field->type)
+    {
+        case DAT_FIELD_FLOAT: { float v; memcpy(&v, p, sizeof(v)); return v; }
+        case DAT_FIELD_DOUBLE: { double v; memcpy(&v, p, sizeof(v)); return (float)v; }
+        case DAT_FIELD_INT:
+            switch(field->size)
+            {
+                case 1: { int8_t v; memcpy(&v, p, sizeof(v)); return (float)v; }
+                case 2: { int16_t v; memcpy(&v, p, sizeof(v)); return (float)v; }
+                case 8: { int64_t v; memcpy(&v, p, sizeof(v)); return (float)v; }
+                default: { int32_t v; memcpy(&v, p, sizeof(v)); return (float)v; }
             }
-            return CMD_OK;
+        case DAT_FIELD_UINT:
+            switch(field->size)
+            {
+                case 1: { uint8_t v; memcpy(&v, p, sizeof(v)); return (float)v; }
+                case 2: { uint16_t v; memcpy(&v, p, sizeof(v)); return (float)v; }
+                case 8: { uint64_t v; memcpy(&v, p, sizeof(v)); return (float)v; }
+                default: { uint32_t v; memcpy(&v, p, sizeof(v)); return (float)v; }
+            }
+    }
+    return 0;
+}
+
+static void _sen_stat_add(sen_stat_t *stat, float value)
+{
+    if(stat->n == 0 || value < stat->min)
+        stat->min = value;
+    if(stat->n == 0 || value > stat->max)
+        stat->max = value;
+    stat->n++;
+    double delta = value - stat->mean;
+    stat->mean += delta/stat->n;
+    stat->m2 += delta*(value - stat->mean);
+}
+
+/**
+ * Store the statistics of the window, one stat_data per field with one
+ * dat_add_payload_samples call, and start a new window
+ */
+static void _sen_stat_store(int payload, sen_reduce_t *red, uint32_t timestamp)
+{
+    stat_data_t rows[SCH_SEN_REDUCE_FIELDS];
+    uint32_t index = (uint32_t)dat_get_system_var(data_map[stat_sensors].sys_index);
+    int f, n = 0;
+    for(f = 0; f < SCH_SEN_REDUCE_FIELDS; f++)
+    {
+        sen_stat_t *stat = &red->stat[f];
+        if(!(red->fields & (1U << f)) || stat->n == 0)
+            continue;
+        rows[n].index = index + n;
+        rows[n].timestamp = timestamp;
+        rows[n].payload = (uint32_t)payload;
+        rows[n].field = (uint32_t)f;
+        rows[n].n = stat->n;
+        rows[n].min = stat->min;
+        rows[n].max = stat->max;
+        rows[n].mean = (float)stat->mean;
+        rows[n].std = (float)sqrt(stat->m2/stat->n);
+        n++;
+    }
+    if(n > 0 && dat_add_payload_samples(rows, stat_sensors, n) < 0)
+        LOGE(tag, "Unable to store the statistics of payload %d", payload);
+    red->n_win = 0;
+    memset(red->stat, 0, sizeof(red->stat));
+}
+
+static void _sen_trig_store(sen_reduce_t *red)
+{
+    red->event.index = (uint32_t)dat_get_system_var(data_map[trig_sensors].sys_index);
+    if(dat_add_payload_samples(&red->event, trig_sensors, 1) < 0)
+        LOGE(tag, "Unable to store the trigger event of payload %d", red->event.payload);
+}
+
+/**
+ * Store the pre-trigger samples, in order, with the next payload indexes
+ * @return Number of samples stored
+ */
+static int _sen_trig_store_ring(int payload, sen_reduce_t *red, uint32_t first)
+{
+    int size = data_map[payload].size;
+    int k, stored = 0;
+    for(k = 0; k < red->ring_count; k++)
+        ((uint32_t *)(red->ring + ((red->ring_head + k) % red->ring_len)*size))[0] = first + k;
+
+    while(red->ring_count > 0)
+    {
+        int n = red->ring_len - red->ring_head;
+        if(n > red->ring_count)
+            n = red->ring_count;
+        if(dat_add_payload_samples(red->ring + red->ring_head*size, payload, n) < 0)
+        {
+            LOGE(tag, "Unable to store %d pre-trigger samples of payload %d", red->ring_count, payload);
+            break;
+        }
+        red->ring_head = (red->ring_head + n) % red->ring_len;
+        red->ring_count -= n;
+        stored += n;
+    }
+    red->ring_head = 0;
+    red->ring_count = 0;
+    return stored;
+}
+
+/**
+ * Data reduction stage, between sampling and storage. Decimates the payload
+ * samples, updates the statistics and the trigger, and stores the reduction
+ * products (stat_data, trig_data and the pre-trigger samples).
+ * @param payload Payload id
+ * @param sample Sample. Its index is updated if pre-trigger samples are stored
+ * before it.
+ * @param burst Set in burst mode, the burst buffer is stored before the
+ * pre-trigger samples so the payload samples keep their order
+ * @return 1 if the sample must be stored, 0 if it is discarded
+ */
+static int _sen_reduce(int payload, void *sample, int burst)
+{
+    if(!sen_reduce_sem_ok)
+        return 1;
+
+    osSemaphoreTake(&sen_reduce_sem, portMAX_DELAY);
+    sen_reduce_t *red = &sen_reduce[payload];
+    const dat_payload_schema_t *schema = dat_get_payload_schema(payload);
+    uint32_t timestamp = ((uint32_t *)sample)[1];
+    int store = red->decimate > 0 && red->count % red->decimate == 0;
+    red->count++;
+
+    if(red->window > 0 && schema != NULL)
+    {
+        int f;
+        for(f = 0; f < schema->nfields && f < SCH_SEN_REDUCE_FIELDS; f++)
+            if(red->fields & (1U << f))
+                _sen_stat_add(&red->stat[f], _sen_field_value(&schema->fields[f], sample));
+        if(++red->n_win >= red->window)
+            _sen_stat_store(payload, red, timestamp);
+    }
+
+    if(red->trig_field >= 0 && schema != NULL && red->trig_field < schema->nfields)
+    {
+        float value = _sen_field_value(&schema->fields[red->trig_field], sample);
+        int fire = red->has_last && ((red->trig_dir >= 0 && red->last < red->trig_level && value >= red->trig_level)
+                                     || (red->trig_dir < 0 && red->last > red->trig_level && value <= red->trig_level));
+        if(red->capture_left > 0)
+        {
+            store = 1;
+            red->event.count++;
+            if(--red->capture_left == 0)
+                _sen_trig_store(red);
         }
-        else if ( payload == 1) // ADS
+        else if(fire)
         {
-            float gyro_x=1.0, gyro_y=2.0, gyro_z=3.0, mag_x=4.0, mag_y=5.0, mag_z=6.0;
-#ifdef NANOMIND
+            if(burst)
+                _sen_burst_flush(payload);
+            uint32_t first = (uint32_t)dat_get_system_var(data_map[payload].sys_index);
+            int n_pre = _sen_trig_store_ring(payload, red, first);
+            ((uint32_t *)sample)[0] = first + n_pre;
 
-            gs_mpu3300_gyro_t gyro_reading;
-            gs_hmc5843_data_t hmc_reading;
-            gs_mpu3300_read_gyro(&gyro_reading);
-            gs_hmc5843_read_single(&hmc_reading);
-
-            gyro_x = gyro_reading.gyro_x;
-            gyro_y = gyro_reading.gyro_y;
-            gyro_z = gyro_reading.gyro_z;
-            mag_x = hmc_reading.x;
-            mag_y = hmc_reading.y;
-            mag_z = hmc_reading.z;
-#endif
-            /* Save ADCS data */
-            int index_ads = dat_get_system_var(data_map[ads_sensors].sys_index);
-            struct ads_data data_ads = {index_ads, curr_time,
-                                        gyro_x, gyro_y, gyro_z,
-                                        mag_x, mag_y, mag_z};
-            ret = dat_add_payload_sample(&data_ads, ads_sensors);
-            if (ret != 0) {
-                return CMD_ERROR;
-            }
-            return CMD_OK;
+            red->event.timestamp = timestamp;
+            red->event.payload = (uint32_t)payload;
+            red->event.field = (uint32_t)red->trig_field;
+            red->event.value = value;
+            red->event.first = first;
+            red->event.count = (uint32_t)n_pre + 1;
+            LOGI(tag, "Payload %d trigger, field %d value %f", payload, red->trig_field, value);
+            store = 1;
+            red->capture_left = red->post;
+            if(red->capture_left == 0)
+                _sen_trig_store(red);
         }
-        else if (payload == 2) // EPS
+        else if(!store && red->ring_len > 0)
         {
-            uint32_t cursun=1;
-            uint32_t cursys=2;
-            uint32_t vbatt=3;
-            int32_t temp1=4;
-            int32_t temp2=5;
-            int32_t temp3=6;
-            int32_t temp4=7;
-            int32_t temp5=8;
-            int32_t temp6=9;
+            // Keep the discarded samples as pre-trigger samples, the oldest is replaced
+            int slot = (red->ring_head + red->ring_count) % red->ring_len;
+            memcpy(red->ring + slot*data_map[payload].size, sample, data_map[payload].size);
+            if(red->ring_count < red->ring_len)
+                red->ring_count++;
+            else
+                red->ring_head = (red->ring_head + 1) % red->ring_len;
+        }
+        red->last = value;
+        red->has_last = 1;
+    }
 
-#ifdef NANOMIND
-            eps_hk_t hk = {};
-            eps_hk_get(&hk);
-            cursun = hk.cursun;
-            cursys = hk.cursys;
-            vbatt = hk.vbatt;
-            temp1 =  hk.temp[0];
-            temp2 = hk.temp[1];
-            temp3 = hk.temp[2];
-            temp4 = hk.temp[3];
-            temp5 = hk.temp[4];
-            temp6 = hk.temp[5];
-#endif
-            int index_eps = dat_get_system_var(data_map[eps_sensors].sys_index);
-            struct eps_data data_eps = {index_eps, curr_time, cursun, cursys, vbatt,
-                                        temp1, temp2, temp3, temp4, temp5, temp6};
-            ret = dat_add_payload_sample(&data_eps, eps_sensors);
-            if (ret != 0) {
-                return CMD_ERROR;
-            }
-            return CMD_OK;
-        } else if (payload == 3) {
+    osSemaphoreGiven(&sen_reduce_sem);
+    return store;
+}
+
+/**
+ * Delta storage stage, after the data reduction. Stores the status sample as
+ * a stz_data record with the vars that changed since the previous sample,
+ * or as a sta_data keyframe every sen_delta.keyframe samples and when too
+ * many vars changed. Only the status payload is delta coded.
+ * @param payload Payload id
+ * @param sample Sample
+ * @return 1 if the sample must be stored in full, 0 if a delta was stored
+ */
+static int _sen_delta(int payload, void *sample)
+{
+    if(payload != sta_sensors || sen_delta.keyframe <= 0 || !sen_reduce_sem_ok)
+        return 1;
 
-            // Pack status variables to a structure
-            int i;
-            uint32_t status_buff[dat_status_last_var];
-            for(i = 0; i<dat_status_last_var; i++)
+    osSemaphoreTake(&sen_reduce_sem, portMAX_DELAY);
+    sta_data_t *sta = (sta_data_t *)sample;
+    stz_data_t rec;
+    memset(&rec, 0, sizeof(rec));
+    int i, n = -1;
+    if(sen_delta.has_prev && sen_delta.since + 1 < sen_delta.keyframe)
+    {
+        for(i = 0, n = 0; i < dat_status_last_var && n >= 0; i++)
+        {
+            uint32_t delta = sta->sta_buff[i] ^ sen_delta.prev.sta_buff[i];
+            if(delta == 0)
+                continue;
+            if(n == DAT_STZ_VALUES)
+                n = -1;
+            else
             {
-                status_buff[i] = dat_get_status_var(dat_status_list[i].address).u;
+                rec.mask[i/32] |= 1U << (i%32);
+                rec.values[n++] = delta;
             }
+        }
+    }
+    memcpy(&sen_delta.prev, sta, sizeof(sen_delta.prev));
+    sen_delta.has_prev = 1;
 
-            int index_sta = dat_get_system_var(data_map[sta_sensors].sys_index);
-            struct sta_data data_sta = {index_sta, curr_time};
-            memcpy(data_sta.sta_buff, status_buff, sizeof(status_buff));
-            ret = dat_add_payload_sample(&data_sta, sta_sensors);
-            if (ret == -1) {
-                return CMD_ERROR;
-            }
-            return CMD_OK;
+    int store = 1;
+    if(n >= 0)
+    {
+        rec.index = (uint32_t)dat_get_system_var(data_map[stz_sensors].sys_index);
+        rec.timestamp = sta->timestamp;
+        rec.key = sen_delta.key;
+        // A lost delta breaks the chain, the sample becomes a keyframe
+        if(dat_add_payload_samples(&rec, stz_sensors, 1) < 0)
+        {
+            LOGW(tag, "Unable to store the status delta, storing a keyframe");
+        }
+        else
+        {
+            sen_delta.since++;
+            store = 0;
         }
     }
-    return CMD_SYNTAX_ERROR;
+    if(store)
+    {
+        sen_delta.key = sta->index;
+        sen_delta.since = 0;
+    }
+    osSemaphoreGiven(&sen_reduce_sem);
+    return store;
+}
+
+int sen_delta_apply(sta_data_t *sta, const stz_data_t *rec)
+{
+    int i, n = 0;
+    for(i = 0; i < DAT_STZ_MASK*32; i++)
+    {
+        if(!(rec->mask[i/32] & (1U << (i%32))))
+            continue;
+        if(i >= dat_status_last_var || n == DAT_STZ_VALUES)
+            return -1;
+        sta->sta_buff[i] ^= rec->values[n++];
+    }
+    sta->timestamp = rec->timestamp;
+    return 0;
+}
+
+/**
+ * Sample buffer, large enough for any sampled payload struct. The index and
+ * timestamp go first.
+ */
+typedef union sen_sample {
+    struct __attribute__((__packed__)) { uint32_t index; uint32_t timestamp; } head;
+    temp_data_t temp;
+    ads_data_t ads;
+    eps_data_t eps;
+    sta_data_t sta;
+} sen_sample_t;
+
+int sen_take_samples(unsigned int payloads, uint32_t timestamp)
+{
+    // Payload indexes, from dat_drp_temp, are consecutive
+    value32_t indexes[last_sensor];
+    if(dat_get_status_vars(data_map[0].sys_index, last_sensor, indexes) != 0)
+        return -1;
+
+    sen_sample_t sample;
+    int i, n = 0, rc = 0;
+    for(i = 0; i < last_sensor; i++)
+    {
+        if(!_sen_is_sampled(payloads, i))
+            continue;
+        if(data_map[i].size > sizeof(sample))
+        {
+            LOGE(tag, "Payload %d struct is larger than the sample buffer", i);
+            rc = -1;
+            continue;
+        }
+
+        uint32_t index = indexes[data_map[i].sys_index - data_map[0].sys_index].u;
+        if(_sen_sample(i, &sample, index, timestamp) != 0)
+        {
+            rc = -1;
+            continue;
+        }
+        if(_sen_reduce(i, &sample, 0) && _sen_delta(i, &sample) && dat_add_payload_samples(&sample, i, 1) < 0)
+        {
+            rc = -1;
+            continue;
+        }
+        n++;
+    }
+    return rc == 0 ? n : -1;
+}
+
+int sen_burst_take_samples(unsigned int payloads, uint32_t timestamp)
+{
+    value32_t indexes[last_sensor];
+    if(dat_get_status_vars(data_map[0].sys_index, last_sensor, indexes) != 0)
+        return -1;
+
+    sen_sample_t sample;
+    int i, n = 0, rc = 0;
+    for(i = 0; i < last_sensor; i++)
+    {
+        sen_burst_t *burst = &sen_burst[i];
+        if(!_sen_is_sampled(payloads, i) || burst->len < 2 || data_map[i].size > sizeof(sample))
+            continue;
+
+        // Buffered samples are not stored yet, they follow the stored index
+        uint32_t index = indexes[data_map[i].sys_index - data_map[0].sys_index].u + burst->count;
+        if(_sen_sample(i, &sample, index, timestamp) != 0)
+        {
+            rc = -1;
+            continue;
+        }
+        n++;
+        if(!_sen_reduce(i, &sample, 1) || !_sen_delta(i, &sample))
+            continue;
+
+        // The ring only fills up if a flush failed, retry before dropping
+        if(burst->count == burst->len && _sen_burst_flush(i) != 0)
+        {
+            LOGW(tag, "Burst buffer of payload %d full, sample dropped", i);
+            rc = -1;
+            continue;
+        }
+        int slot = (burst->head + burst->count) % burst->len;
+        memcpy(burst->buff + slot*data_map[i].size, &sample, data_map[i].size);
+        burst->count++;
+
+        if(burst->count >= burst->len/2 && _sen_burst_flush(i) != 0)
+            rc = -1;
+    }
+    return rc == 0 ? n : -1;
+}
+
+int sen_burst_flush(unsigned int payloads)
+{
+    int i, rc = 0;
+    for(i = 0; i < last_sensor; i++)
+    {
+        if((payloads & (1U << i)) && sen_burst[i].count > 0 && _sen_burst_flush(i) != 0)
+        {
+            LOGE(tag, "Unable to store %d burst samples of payload %d", sen_burst[i].count, i);
+            rc = -1;
+        }
+    }
+    return rc;
+}
+
+int take_sample(char *fmt, char *params, int nparams)
+{
+    int payload;
+    if(params == NULL || cmd_scan_params(fmt, params, &payload) != nparams)
+        return CMD_SYNTAX_ERROR;
+    if(payload < 0 || payload >= last_sensor)
+        return CMD_SYNTAX_ERROR;
+
+    int rc = sen_take_samples(1U << payload, (uint32_t)dat_clock_utc());
+    return rc == 1 ? CMD_OK : CMD_ERROR;
 }
 
 int init_dummy_sensor(char *fmt, char *params, int nparams)
 {
-    LOGD(tag, "Initializing dummy sensor");
+    return _sen_init_dummy() == 0 ? CMD_OK : CMD_ERROR;
+}
+
+int reduce_set(char *fmt, char *params, int nparams)
+{
+    int payload, decimate, window;
+    unsigned int fields;
+    if(params == NULL || cmd_scan_params(fmt, params, &payload, &decimate, &window, &fields) != nparams)
+        return CMD_SYNTAX_ERROR;
+    const dat_payload_schema_t *schema = dat_get_payload_schema(payload);
+    if(!_sen_is_sampled(~0U, payload) || schema == NULL || decimate < 0 || window < 0)
+        return CMD_SYNTAX_ERROR;
+    if(!sen_reduce_sem_ok)
+        return CMD_ERROR;
+
+    // By default all the fields but the index and timestamp
+    int nfields = schema->nfields < SCH_SEN_REDUCE_FIELDS ? schema->nfields : SCH_SEN_REDUCE_FIELDS;
+    uint32_t all = nfields < 32 ? (1U << nfields) - 1 : ~0U;
+    fields = fields == 0 ? all & ~3U : fields & all;
+
+    osSemaphoreTake(&sen_reduce_sem, portMAX_DELAY);
+    sen_reduce_t *red = &sen_reduce[payload];
+    red->decimate = decimate;
+    red->window = window;
+    red->fields = fields;
+    _sen_reduce_reset(red);
+    osSemaphoreGiven(&sen_reduce_sem);
+    LOGR(tag, "Payload %d reduction: decimate %d, window %d, fields 0x%X", payload, decimate, window, fields);
+    return CMD_OK;
+}
+
+int reduce_trig(char *fmt, char *params, int nparams)
+{
+    int payload, field, dir, pre, post;
+    float level;
+    if(params == NULL || cmd_scan_params(fmt, params, &payload, &field, &level, &dir, &pre, &post) != nparams)
+        return CMD_SYNTAX_ERROR;
+    const dat_payload_schema_t *schema = dat_get_payload_schema(payload);
+    if(!_sen_is_sampled(~0U, payload) || schema == NULL || field >= schema->nfields || pre < 0 || post < 0)
+        return CMD_SYNTAX_ERROR;
+    if(!sen_reduce_sem_ok)
+        return CMD_ERROR;
+    if(pre > sen_reduce[payload].ring_max)
+    {
+        LOGE(tag, "Payload %d keeps up to %d pre-trigger samples", payload, sen_reduce[payload].ring_max);
+        return CMD_ERROR;
+    }
+
+    osSemaphoreTake(&sen_reduce_sem, portMAX_DELAY);
+    sen_reduce_t *red = &sen_reduce[payload];
+    red->trig_field = field < 0 ? -1 : field;
+    red->trig_level = level;
+    red->trig_dir = dir < 0 ? -1 : 1;
+    red->ring_len = pre;
+    red->post = post;
+    _sen_reduce_reset(red);
+    osSemaphoreGiven(&sen_reduce_sem);
+    LOGR(tag, "Payload %d trigger: field %d, level %f, dir %d, pre %d, post %d", payload, red->trig_field,
+         level, red->trig_dir, pre, post);
+    return CMD_OK;
+}
+
+int delta_set(char *fmt, char *params, int nparams)
+{
+    int keyframe;
+    if(params == NULL || cmd_scan_params(fmt, params, &keyframe) != nparams)
+        return CMD_SYNTAX_ERROR;
+    if(keyframe < 0)
+        return CMD_SYNTAX_ERROR;
+    if(!sen_reduce_sem_ok || dat_status_last_var > DAT_STZ_MASK*32)
+        return CMD_ERROR;
+
+    osSemaphoreTake(&sen_reduce_sem, portMAX_DELAY);
+    sen_delta.keyframe = keyframe;
+    sen_delta.since = 0;
+    sen_delta.has_prev = 0;
+    osSemaphoreGiven(&sen_reduce_sem);
+    LOGR(tag, "Status delta storage: keyframe every %d samples", keyframe);
     return CMD_OK;
 }
@@ -17,10 +17,71 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_TAG_ID LOG_TAG_TM
 #include "cmdTM.h"
+#include "taskDownlink.h"
+#include "taskIngest.h"
 
 static const char *tag = "cmdTM";
 
+/* Status beacon state, @see tm_send_status_node */
+static osSemaphore bcn_sem;
+static int bcn_sem_ok = 0;
+static int bcn_delta = SCH_TM_BCN_DELTA;                    ///< Send delta beacons (0 | 1)
+static int bcn_keyframe = SCH_TM_BCN_KEYFRAME;              ///< Beacons between keyframes
+static int bcn_count = 0;                                   ///< Beacons since the last keyframe
+static uint16_t bcn_seq = 0;                                ///< Sequence of the last keyframe sent
+static int bcn_ref_seq = -1;                                ///< Sequence of the acknowledged keyframe, -1 if none
+static value32_t bcn_sent[dat_status_last_address];         ///< Values of the last keyframe sent
+static value32_t bcn_ref[dat_status_last_address];          ///< Values of the acknowledged keyframe
+static float bcn_deadband[dat_status_last_address];         ///< Change required to send a variable in a delta beacon
+static uint32_t bcn_gen = 0;                                ///< Changes when a beacon is sent or the beacon settings change
+
+/* Prebuilt status beacons, @see tm_bcn_build. The next beacon is built in the
+ * back buffer while the front one can be sent */
+#define TM_BCN_PER_FRAME ((int)(COM_FRAME_MAX_LEN/sizeof(dat_sys_var_short_t)) - 1)   ///< Variables per frame, after the header record
+#define TM_BCN_MAX_VARS (sizeof(dat_status_list)/sizeof(dat_status_list[0]))           ///< dat_status_last_var, as a constant
+#define TM_BCN_MAX_RECORDS (TM_BCN_MAX_VARS + TM_BCN_MAX_VARS/TM_BCN_PER_FRAME + 1)
+typedef struct tm_bcn_buff{
+    uint32_t gen;                                   ///< bcn_gen when it was built
+    int built;                                      ///< The buffer holds a beacon
+    int users;                                      ///< Tasks sending the buffer
+    int keyframe;                                   ///< Keyframe (TM_TYPE_STATUS) or delta beacon
+    uint16_t seq;                                   ///< Keyframe sequence
+    int n_vars;                                     ///< Variables in the beacon
+    int n_records;                                  ///< Records, including the frame headers
+    time_t ts;                                      ///< Build time
+    value32_t values[dat_status_last_address];      ///< Variables snapshot, by address
+    dat_sys_var_short_t records[TM_BCN_MAX_RECORDS];///< Frames content, in network byte order
+} tm_bcn_buff_t;
+static tm_bcn_buff_t bcn_buff[2];
+static int bcn_front = 0;                                   ///< Buffer sent by the next beacon
+static int bcn_building = 0;                                ///< The back buffer is being built
+
+/**
+ * Check if a status variable changed beyond its deadband since the
+ * acknowledged keyframe. Call with bcn_sem taken.
+ * @param var Index in dat_status_list
+ * @param values Current values, by address
+ */
+static int _tm_bcn_changed(int var, const value32_t *values)
+{
+    int address = dat_status_list[var].address;
+    value32_t now = values[address], ref = bcn_ref[address];
+    double delta;
+    if(dat_status_list[var].type == 'f')
+    {
+        if(isnan(now.f) || isnan(ref.f))
+            return now.u != ref.u;
+        delta = (double)now.f - (double)ref.f;
+    }
+    else if(dat_status_list[var].type == 'i')
+        delta = (double)now.i - (double)ref.i;
+    else
+        delta = (double)now.u - (double)ref.u;
+    return fabs(delta) > bcn_deadband[address];
+}
+
 /**
  * Helper function to read and send a range of telemetry
  * @param start Starting index
@@ -31,45 +92,365 @@ static const char *tag = "cmdTM";
  */
 static int _send_tel_from_to(int start, int end, int payload, int dest_node);
 
+#if SCH_TM_COMPRESS
+/**
+ * Helper function to read and send a range of telemetry in compressed frames
+ * (TM_TYPE_PAYLOAD_Z), each frame with as many samples as fit
+ * @param start Starting index
+ * @param end Stop index
+ * @param payload Payload id
+ * @param dest_node Node to send TM
+ * @return CMD_OK or CMD_ERROR
+ */
+static int _send_tel_compressed(int start, int end, int payload, int dest_node);
+#endif
+
 void cmd_tm_init(void)
 {
+    dl_init();
+    bcn_sem_ok = osSemaphoreCreate(&bcn_sem) == OS_SEMAPHORE_OK;
+    ingest_init();
+
     cmd_add("tm_parse_status", tm_parse_status, "", 0);
     cmd_add("tm_parse_string", tm_parse_string, "", 0);
     cmd_add("tm_send_status", tm_send_status, "%d", 1);
+    cmd_add("tm_bcn_mode", tm_bcn_mode, "%d %d", 2);
+    cmd_add("tm_bcn_deadband", tm_bcn_deadband, "%s %f", 2);
+    cmd_add("tm_bcn_ack", tm_bcn_ack, "%d", 1);
     cmd_add("tm_send_var", tm_send_var, "%d %s", 2);
+    cmd_add("tm_send_vars", tm_send_vars, "%d %n", 2);
     cmd_add("tm_get_last", tm_get_last, "%u", 1);
     cmd_add("tm_get_single", tm_get_single, "%u %u", 2);
     cmd_add("tm_send_last", tm_send_last, "%u %u", 2);
     cmd_add("tm_send_all", tm_send_all, "%u %u", 2);
     cmd_add("tm_send_from", tm_send_from, "%u %u %u", 3);
+    cmd_add("tm_send_range_time", tm_send_range_time, "%u %u %u %u", 4);
     cmd_add("tm_set_ack", tm_set_ack, "%u %u", 2);
+    cmd_add("tm_dl_start", tm_dl_start, "%d %d", 2);
+    cmd_add("tm_dl_stop", tm_dl_stop, "", 0);
+    cmd_add("tm_dl_weight", tm_dl_weight, "%d %u", 2);
+    cmd_add("tm_dl_ack", tm_dl_ack, "%u %u %u", 3);
+    cmd_add("tm_dl_status", tm_dl_status, "", 0);
+    cmd_add("tm_ingest_stats", tm_ingest_stats, "%d", 1);
     cmd_add("tm_send_cmds", tm_send_cmds, "%d", 1);
+    cmd_add("tm_send_cmd_catalog", tm_send_cmd_catalog, "%d %u", 2);
+    cmd_add("tm_parse_cmd_catalog", tm_parse_cmd_catalog, "", 0);
+    cmd_add("tm_send_cmd_names", tm_send_cmd_names, "%d %d %d", 3);
+    cmd_add("tm_send_fp", tm_send_fp, "%d %d %d %d", 4);
+    cmd_add("tm_parse_fp", tm_parse_fp, "", 0);
+    cmd_add("tm_send_cmd_stats", tm_send_cmd_stats, "%d", 1);
+    cmd_add("tm_parse_cmd_stats", tm_parse_cmd_stats, "", 0);
+    cmd_add("tm_send_cmd_lat", tm_send_cmd_lat, "%d", 1);
+    cmd_add("tm_parse_cmd_lat", tm_parse_cmd_lat, "", 0);
+    cmd_add("tm_send_task_stats", tm_send_task_stats, "%d", 1);
+    cmd_add("tm_parse_task_stats", tm_parse_task_stats, "", 0);
+    cmd_add("tm_send_task_stack", tm_send_task_stack, "%d", 1);
+    cmd_add("tm_parse_task_stack", tm_parse_task_stack, "", 0);
+    cmd_add("tm_send_prof", tm_send_prof, "%d %d", 2);
+    cmd_add("tm_parse_prof", tm_parse_prof, "", 0);
+    cmd_add("tm_parse_prof_stacks", tm_parse_prof_stacks, "", 0);
 #ifdef LINUX
+    cmd_add("tm_send_prof_stacks", tm_send_prof_stacks, "%d %d %d", 3);
+    cmd_set_class("tm_send_prof_stacks", CMD_CLASS_SHARED_IO);
+    cmd_set_max_time("tm_send_prof_stacks", (SCH_PROF_SAMPLE_MAX_S+60)*1000);
     cmd_add("tm_send_file", tm_send_file, "%s %u", 2);
+    cmd_add("tm_send_file_parts", tm_send_file_parts, "%s %u %s", 3);
     cmd_add("tm_parse_file", tm_parse_file, "", 0);
+    cmd_add("tm_request_file", tm_request_file, "%u", 1);
+    cmd_set_class("tm_send_file", CMD_CLASS_SHARED_IO);
+    cmd_set_class("tm_send_file_parts", CMD_CLASS_SHARED_IO);
+    cmd_set_max_time("tm_send_file", 10*60*1000);
+    cmd_set_max_time("tm_send_file_parts", 10*60*1000);
 #endif
+
+    // Long running telemetry commands do not block the main executer
+    cmd_set_class("tm_parse_status", CMD_CLASS_SHARED_IO);
+    cmd_set_class("tm_parse_string", CMD_CLASS_SHARED_IO);
+    cmd_set_class("tm_send_status", CMD_CLASS_SHARED_IO);
+    cmd_set_class("tm_send_last", CMD_CLASS_SHARED_IO);
+    cmd_set_class("tm_send_all", CMD_CLASS_SHARED_IO);
+    cmd_set_class("tm_send_from", CMD_CLASS_SHARED_IO);
+    cmd_set_class("tm_send_range_time", CMD_CLASS_SHARED_IO);
+    cmd_set_class("tm_send_var", CMD_CLASS_SHARED_IO);
+    cmd_set_class("tm_send_vars", CMD_CLASS_SHARED_IO);
+    cmd_set_class("tm_send_cmds", CMD_CLASS_SHARED_IO);
+    cmd_set_class("tm_send_cmd_catalog", CMD_CLASS_SHARED_IO);
+    cmd_set_class("tm_send_cmd_names", CMD_CLASS_SHARED_IO);
+    cmd_set_class("tm_send_fp", CMD_CLASS_SHARED_IO);
+    cmd_set_class("tm_send_cmd_stats", CMD_CLASS_SHARED_IO);
+    cmd_set_class("tm_send_cmd_lat", CMD_CLASS_SHARED_IO);
+    cmd_set_class("tm_send_task_stats", CMD_CLASS_SHARED_IO);
+    cmd_set_class("tm_send_task_stack", CMD_CLASS_SHARED_IO);
+    cmd_set_class("tm_send_prof", CMD_CLASS_SHARED_IO);
+    // The beacon is sent periodically, skip it only if overloaded
+    cmd_set_shed("tm_send_status", CMD_LOAD_OVERLOAD);
 }
 
 int tm_send_status(char *fmt, char *params, int nparams)
 {
     //Format: <node>
     int dest_node;
-    if(params == NULL || sscanf(params, fmt, &dest_node) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &dest_node) != nparams)
     {
         return CMD_SYNTAX_ERROR;
     }
 
-    // Pack status variables to a structure
-    int i;
-    dat_sys_var_short_t status_buff[dat_status_last_var];
+    return tm_send_status_node(dest_node);
+}
+
+/**
+ * Update the beacon state with a beacon that is being sent. The prebuilt
+ * beacons become outdated. Call with bcn_sem taken.
+ */
+static void _tm_bcn_sent(const tm_bcn_buff_t *b)
+{
+    if(b->keyframe)
+    {
+        bcn_seq = b->seq;
+        memcpy(bcn_sent, b->values, sizeof(bcn_sent));
+        bcn_count = 0;
+    }
+    else
+    {
+        bcn_count++;
+    }
+    bcn_gen++;
+}
+
+/**
+ * Build a beacon from a snapshot of the status variables: a keyframe, or the
+ * variables changed since the acknowledged one.
+ * @param b Buffer to build
+ * @param sent Update the beacon state as if the beacon was sent now, otherwise
+ * the state is updated when it is sent (@see _tm_bcn_take)
+ * @return 0 if OK, -1 if some variables could not be read
+ */
+static int _tm_bcn_build(tm_bcn_buff_t *b, int sent)
+{
+    // Take a consistent snapshot of the status variables with one read
+    int rc = dat_get_status_vars(0, dat_status_last_address, b->values);
+    if(rc != 0)
+        LOGW(tag, "Unable to read all status variables");
+
+    // Select a keyframe or the variables changed since the acknowledged one
+    int i, n = 0;
+    int vars[dat_status_last_var];
+    if(bcn_sem_ok)
+        osSemaphoreTake(&bcn_sem, portMAX_DELAY);
+    b->gen = bcn_gen;
+    b->keyframe = !bcn_delta || bcn_ref_seq < 0 || bcn_count >= bcn_keyframe;
+    b->seq = b->keyframe ? (uint16_t)(bcn_seq + 1) : (uint16_t)bcn_ref_seq;
     for(i = 0; i<dat_status_last_var; i++)
     {
-        status_buff[i].address = csp_hton16(dat_status_list[i].address);
-        status_buff[i].value.u = csp_hton32(dat_get_status_var(dat_status_list[i].address).u);
+        if(b->keyframe || _tm_bcn_changed(i, b->values))
+            vars[n++] = i;
+    }
+    if(sent)
+        _tm_bcn_sent(b);
+    if(bcn_sem_ok)
+        osSemaphoreGiven(&bcn_sem);
+
+    // Pack status variables to a structure, each frame starts with a header
+    // record with the number of variables and the keyframe sequence
+    int rec = 0;
+    for(i = 0; i<n || rec == 0; i++)
+    {
+        if(i % TM_BCN_PER_FRAME == 0)
+        {
+            b->records[rec].address = com_tm_hton16(TM_STATUS_HEADER_ADDR);
+            b->records[rec++].value.u = com_tm_hton32(((uint32_t)n << 16) | b->seq);
+        }
+        if(i == n)
+            break;
+        dat_status_address_t address = dat_status_list[vars[i]].address;
+        b->records[rec].address = com_tm_hton16(address);
+        b->records[rec++].value.u = com_tm_hton32(b->values[address].u);
+    }
+    b->n_vars = n;
+    b->n_records = rec;
+    b->ts = dat_get_time();
+    b->built = 1;
+    return rc != 0 ? -1 : 0;
+}
+
+/**
+ * Take the prebuilt beacon to send it, if it is up to date
+ * @return Buffer to send and release with _tm_bcn_release, NULL if there is no
+ * prebuilt beacon
+ */
+static tm_bcn_buff_t *_tm_bcn_take(void)
+{
+    if(!bcn_sem_ok)
+        return NULL;
+    tm_bcn_buff_t *b = &bcn_buff[bcn_front];
+    osSemaphoreTake(&bcn_sem, portMAX_DELAY);
+    if(b->built && b->gen == bcn_gen)
+    {
+        _tm_bcn_sent(b);
+        b->users++;
+    }
+    else
+        b = NULL;
+    osSemaphoreGiven(&bcn_sem);
+    return b;
+}
+
+/**
+ * Release a beacon taken with _tm_bcn_take
+ */
+static void _tm_bcn_release(tm_bcn_buff_t *b)
+{
+    osSemaphoreTake(&bcn_sem, portMAX_DELAY);
+    b->users--;
+    osSemaphoreGiven(&bcn_sem);
+}
+
+/**
+ * Send a beacon as TM_TYPE_STATUS or TM_TYPE_STATUS_DELTA telemetry
+ */
+static int _tm_bcn_send(tm_bcn_buff_t *b, int dest_node)
+{
+    LOGD(tag, "Beacon %s %u: %d variables", b->keyframe ? "keyframe" : "delta", b->seq, b->n_vars);
+    return com_send_telemetry(dest_node, SCH_TRX_PORT_TM, b->keyframe ? TM_TYPE_STATUS : TM_TYPE_STATUS_DELTA,
+                              b->records, b->n_records*sizeof(dat_sys_var_short_t), b->n_records, 0);
+}
+
+int tm_send_status_node(int dest_node)
+{
+    // Send the prebuilt beacon, without reading the status variables
+    tm_bcn_buff_t *b = _tm_bcn_take();
+    if(b != NULL)
+    {
+        int rc = _tm_bcn_send(b, dest_node);
+        _tm_bcn_release(b);
+        return rc;
+    }
+
+    // No prebuilt beacon (without the beacon task, or it is outdated)
+    tm_bcn_buff_t bcn;
+    _tm_bcn_build(&bcn, 1);
+    return _tm_bcn_send(&bcn, dest_node);
+}
+
+int tm_bcn_build(int max_age)
+{
+    if(!bcn_sem_ok)
+        return -1;
+
+    osSemaphoreTake(&bcn_sem, portMAX_DELAY);
+    tm_bcn_buff_t *front = &bcn_buff[bcn_front];
+    tm_bcn_buff_t *back = &bcn_buff[!bcn_front];
+    int fresh = front->built && front->gen == bcn_gen && dat_get_time() - front->ts < max_age;
+    int busy = bcn_building || back->users > 0;
+    if(!fresh && !busy)
+        bcn_building = 1;
+    osSemaphoreGiven(&bcn_sem);
+    if(fresh)
+        return 0;
+    if(busy)
+        return -1;  // Still sending the previous beacon, retry later
+
+    // The back buffer is only used here, build it without the lock
+    int rc = _tm_bcn_build(back, 0);
+
+    osSemaphoreTake(&bcn_sem, portMAX_DELAY);
+    // Swap the buffers, unless a beacon was sent meanwhile
+    if(back->gen == bcn_gen)
+        bcn_front = !bcn_front;
+    bcn_building = 0;
+    osSemaphoreGiven(&bcn_sem);
+    return rc == 0 ? 1 : -1;
+}
+
+int tm_bcn_mode(char *fmt, char *params, int nparams)
+{
+    int delta, keyframe;
+    if(params == NULL || cmd_scan_params(fmt, params, &delta, &keyframe) != nparams || keyframe < 1)
+        return CMD_SYNTAX_ERROR;
+
+    if(bcn_sem_ok)
+        osSemaphoreTake(&bcn_sem, portMAX_DELAY);
+    bcn_delta = delta != 0;
+    bcn_keyframe = keyframe;
+    bcn_count = keyframe;   // Start with a keyframe
+    bcn_gen++;
+    if(bcn_sem_ok)
+        osSemaphoreGiven(&bcn_sem);
+    return CMD_OK;
+}
+
+int tm_bcn_deadband(char *fmt, char *params, int nparams)
+{
+    char name[MAX_VAR_NAME+1];
+    float deadband;
+    if(params == NULL || sscanf(params, "%24s %f", name, &deadband) != nparams || deadband < 0)
+        return CMD_SYNTAX_ERROR;
+
+    dat_sys_var_t var = dat_get_status_var_def_name(name);
+    if(var.status == -1)
+    {
+        LOGE(tag, "Status variable %s not found", name);
+        return CMD_ERROR;
+    }
+
+    if(bcn_sem_ok)
+        osSemaphoreTake(&bcn_sem, portMAX_DELAY);
+    bcn_deadband[var.address] = deadband;
+    bcn_gen++;
+    if(bcn_sem_ok)
+        osSemaphoreGiven(&bcn_sem);
+    return CMD_OK;
+}
+
+int tm_bcn_ack(char *fmt, char *params, int nparams)
+{
+    int seq;
+    if(params == NULL || cmd_scan_params(fmt, params, &seq) != nparams)
+        return CMD_SYNTAX_ERROR;
+
+    int rc = CMD_OK;
+    if(bcn_sem_ok)
+        osSemaphoreTake(&bcn_sem, portMAX_DELAY);
+    // Only the last keyframe sent is kept
+    if(seq == bcn_seq)
+    {
+        memcpy(bcn_ref, bcn_sent, sizeof(bcn_ref));
+        bcn_ref_seq = seq;
+        bcn_gen++;
     }
+    else
+        rc = CMD_ERROR;
+    if(bcn_sem_ok)
+        osSemaphoreGiven(&bcn_sem);
+
+    if(rc != CMD_OK)
+        LOGW(tag, "Beacon keyframe %d is not the last one sent (%u)", seq, bcn_seq);
+    return rc;
+}
+
+/**
+ * Send the current value of some status variables, read with one snapshot,
+ * as TM_TYPE_STATUS_VARS telemetry
+ * @param dest_node Node to send TM
+ * @param vars Positions in dat_status_list of the variables
+ * @param n Number of variables
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures
+ */
+static int _tm_send_vars(int dest_node, const int *vars, int n)
+{
+    value32_t status_vars[dat_status_last_address];
+    if(n <= 0 || dat_get_status_vars(0, dat_status_last_address, status_vars) != 0)
+        return CMD_ERROR;
 
-    // Send telemetry
-    return _com_send_data(dest_node, status_buff, sizeof(status_buff), TM_TYPE_STATUS, dat_status_last_var, 0);
+    dat_sys_var_short_t status_buff[n];
+    int i;
+    for(i = 0; i<n; i++)
+    {
+        dat_status_address_t address = dat_status_list[vars[i]].address;
+        status_buff[i].address = com_tm_hton16(address);
+        status_buff[i].value.u = com_tm_hton32(status_vars[address].u);
+    }
+    return com_send_telemetry(dest_node, SCH_TRX_PORT_TM, TM_TYPE_STATUS_VARS, status_buff, sizeof(status_buff), n, 0);
 }
 
 int tm_send_var(char *fmt, char *params, int nparams)
@@ -78,20 +459,37 @@ int tm_send_var(char *fmt, char *params, int nparams)
     int dest_node;
     char var_name[SCH_CMD_MAX_STR_PARAMS];
 
-    if(params == NULL || sscanf(params, fmt, &dest_node, var_name) != nparams)
+    if(params == NULL || cmd_scan_params(fmt, params, &dest_node, var_name) != nparams)
     {
         return CMD_SYNTAX_ERROR;
     }
 
-    // Pack status variable to a structure
-    dat_sys_var_short_t status_buff[1];
-    dat_sys_var_t system_var = dat_get_status_var_def_name(var_name);
-    uint16_t address = system_var.address;
-    status_buff[0].address = csp_hton16(address);
-    status_buff[0].value.u = csp_hton32(dat_get_status_var(address).u);
+    int var;
+    if(dat_select_status_vars(var_name, &var, 1) != 1 || strcmp(dat_status_list[var].name, var_name) != 0)
+    {
+        LOGE(tag, "Status variable %s not found", var_name);
+        return CMD_ERROR;
+    }
+    return _tm_send_vars(dest_node, &var, 1);
+}
+
+int tm_send_vars(char *fmt, char *params, int nparams)
+{
+    int dest_node, next;
+    if(params == NULL || cmd_scan_params(fmt, params, &dest_node, &next) != nparams - 1 || next <= 0)
+    {
+        return CMD_SYNTAX_ERROR;
+    }
 
-    // Send telemetry
-    return _com_send_data(dest_node, status_buff, sizeof(status_buff), TM_TYPE_GENERIC, 1, 0);
+    int vars[dat_status_last_var];
+    int n = dat_select_status_vars(params + next, vars, dat_status_last_var);
+    if(n <= 0)
+    {
+        LOGE(tag, "No status variables selected (%s)", params + next);
+        return CMD_SYNTAX_ERROR;
+    }
+    LOGD(tag, "Sending %d status variables to node %d", n, dest_node);
+    return _tm_send_vars(dest_node, vars, n);
 }
 
 int tm_parse_status(char *fmt, char *params, int nparams)
@@ -104,18 +502,71 @@ int tm_parse_status(char *fmt, char *params, int nparams)
 
     // Sanity check to params. Detect if params do not come from tm_send_status.
     // Avoid using this command from command line, or tele-command
-    if(frame->type != TM_TYPE_STATUS || frame->ndata > sizeof(frame->data)/sizeof(dat_sys_var_short_t))
+    if((frame->type != TM_TYPE_STATUS && frame->type != TM_TYPE_STATUS_DELTA && frame->type != TM_TYPE_STATUS_VARS) ||
+       frame->ndata > sizeof(frame->data)/sizeof(dat_sys_var_short_t))
         return CMD_SYNTAX_ERROR;
 
-    int i;
+    // Decode all the records first, then print them in one block
+    dat_sys_var_t vars[sizeof(frame->data)/sizeof(dat_sys_var_short_t)];
+    int i, n_vars = 0, n_bad = 0;
+    uint32_t header = 0;
     for(i = 0; i<frame->ndata; i++)
     {
-        uint16_t address = csp_ntoh16(status_buff[i].address);
-        value32_t value = {.u = csp_ntoh32(status_buff[i].value.u)};
-        dat_sys_var_t system_var = dat_get_status_var_def(address);
-        system_var.value = value;
-        dat_print_system_var(&system_var);
+        uint16_t address = com_frame_ntoh16(frame, status_buff[i].address);
+        value32_t value = {.u = com_frame_ntoh32(frame, status_buff[i].value.u)};
+        if(address == TM_STATUS_HEADER_ADDR)
+        {
+            header = value.u;
+            continue;
+        }
+        vars[n_vars] = dat_get_status_var_def(address);
+        if(vars[n_vars].name[0] == '\0')
+        {
+            n_bad++;
+            continue;
+        }
+        vars[n_vars++].value = value;
+    }
+
+    if(n_bad > 0)
+        LOGW(tag, "Beacon from node %d: %d unknown variables", frame->node, n_bad);
+    if(LOG_ENABLED(LOG_LVL_INFO) && n_vars > 0)
+    {
+        osSemaphoreTake(&log_mutex, portMAX_DELAY);
+        for(i = 0; i < n_vars; i++)
+            dat_print_system_var(&vars[i]);
+        osSemaphoreGiven(&log_mutex);
+    }
+
+    if(frame->type == TM_TYPE_STATUS_VARS)
+        return CMD_OK;
+    if(frame->type == TM_TYPE_STATUS_DELTA)
+    {
+        LOGI(tag, "Beacon delta from keyframe %u: %d variables changed", header & 0xFFFF, n_vars);
+        return CMD_OK;
+    }
+
+#ifdef GROUNDSTATION
+    // Acknowledge the keyframe when all its variables are received, then the
+    // node can send delta beacons
+    static int kf_node = -1, kf_seq = -1, kf_vars = 0;
+    int seq = (int)(header & 0xFFFF), total = (int)(header >> 16);
+    if(frame->node != kf_node || seq != kf_seq)
+    {
+        kf_node = frame->node;
+        kf_seq = seq;
+        kf_vars = 0;
+    }
+    kf_vars += n_vars;
+    if(total > 0 && kf_vars == total)
+    {
+        char ack[SCH_CMD_MAX_STR_PARAMS];
+        snprintf(ack, sizeof(ack), "%d tm_bcn_ack %d", frame->node, seq);
+        cmd_t *cmd_ack = cmd_get_str("com_send_cmd");
+        cmd_add_params_str(cmd_ack, ack);
+        cmd_send(cmd_ack);
     }
+#endif
 
     return CMD_OK;
 }
@@ -126,21 +577,43 @@ int tm_parse_string(char *fmt, char *params, int nparams)
         return CMD_SYNTAX_ERROR;
 
     com_frame_t *frame = (com_frame_t *)params;
-    char *cmds_list;
-    cmds_list = (char *)malloc(strlen((char *)frame->data.data8));
-    memset(cmds_list, '\0', strlen((char *)frame->data.data8 + 1));
-    cmds_list = (char *)frame->data.data8;
-    //char *cmds_list = (char *)params;
-    printf("Available commands list: %s", cmds_list);
+    char *cmds_list = (char *)frame->data.data8;
+    // The text is split in frames, without the null terminator
+    printf("Available commands list: %.*s", (int)sizeof(frame->data), cmds_list);
 
     return CMD_OK;
 }
 
+/**
+ * Fill a payload frame with @n_structs samples from @index. Storage fills the
+ * frame data in place, only the unused tail is cleared and only the words
+ * holding samples are converted.
+ * @return Samples read
+ */
+static int _tm_fill_payload_frame(com_frame_t *frame, int nframe, int index, int n_structs, int payload)
+{
+    frame->node = SCH_COMM_ADDRESS;
+    frame->nframe = com_frame_hton_nframe(nframe);
+    frame->type = (uint8_t)(TM_TYPE_PAYLOAD + payload);
+    frame->ndata = csp_hton32((uint32_t)n_structs);
+    int n_read = dat_get_payload_samples(frame->data.data8, payload, index, n_structs);
+    size_t n_bytes = n_read > 0 ? (size_t)n_read*data_map[payload].size : 0;
+    memset(frame->data.data8 + n_bytes, 0, sizeof(frame->data) - n_bytes);
+
+    com_tm_hton32_buff(frame->data.data32, (int)((n_bytes + sizeof(uint32_t) - 1)/sizeof(uint32_t)));
+    return n_read > 0 ? n_read : 0;
+}
+
 int _send_tel_from_to(int start, int end, int payload, int dest_node)
 {
     int rc_send = 0;
     int structs_per_frame = (COM_FRAME_MAX_LEN) / data_map[payload].size;
-    uint16_t payload_size = data_map[payload].size;
+
+#if SCH_TM_COMPRESS
+    const dat_payload_schema_t *schema = dat_get_payload_schema(payload);
+    if(schema != NULL && schema->size == data_map[payload].size)
+        return _send_tel_compressed(start, end, payload, dest_node);
+#endif
 
     int n_samples = end - start;
     int n_frames = (n_samples)/structs_per_frame;
@@ -148,13 +621,9 @@ int _send_tel_from_to(int start, int end, int payload, int dest_node)
         n_frames += 1;
     }
 
-    int index_pay = dat_get_system_var(data_map[payload].sys_index);
-//    int index_ack = dat_get_system_var(data_map[payload].sys_ack);
-//    int delay = index_pay - index_ack;
-
     // New connection
     csp_conn_t *conn;
-    conn = csp_connect(CSP_PRIO_NORM, dest_node, SCH_TRX_PORT_TM, 500, CSP_O_NONE);
+    conn = com_connect(dest_node, SCH_TRX_PORT_TM, 500);
     if(conn == NULL)
     {
         LOGE(tag, "Cannot create connection!");
@@ -164,39 +633,125 @@ int _send_tel_from_to(int start, int end, int payload, int dest_node)
     int i;
     for(i=0; i < n_frames; ++i) {
 
-        csp_packet_t *packet = csp_buffer_get(sizeof(com_frame_t));
+        csp_packet_t *packet = com_buffer_get(sizeof(com_frame_t), 0);
+        if(packet == NULL)
+        {
+            LOGE(tag, "Cannot get a buffer for frame %d!", i);
+            rc_send = 0;
+            break;
+        }
         packet->length = sizeof(com_frame_t);
+        com_frame_t *frame = (com_frame_t *)(packet->data);
+        int n_structs = n_samples - i*structs_per_frame;
+        if(n_structs > structs_per_frame)
+            n_structs = structs_per_frame;
+        _tm_fill_payload_frame(frame, i, start + i*structs_per_frame, n_structs, payload);
+
+        LOGI(tag, "Node    : %d", frame->node);
+        LOGI(tag, "Frame   : %d", i);
+        LOGI(tag, "Type    : %d", frame->type);
+        LOGI(tag, "Samples : %d", n_structs);
+        //print_buff(frame->data.data8, data_map[payload].size*structs_per_frame);
+
+        // Send packet
+        com_frame_seal(packet);
+        com_tx_pace(packet->length);
+        rc_send = csp_send(conn, packet, 500);
+        if(rc_send == 0)
+        {
+            csp_buffer_free(packet);
+            LOGE(tag, "Error sending frame %d! (%d)", i, rc_send);
+            break; // Exit with error
+        }
+    }
+
+    // Close connection
+    int rc_conn = csp_close(conn);
+    if(rc_conn != CSP_ERR_NONE) {
+        LOGE(tag, "Error closing connection! (%d)", rc_conn);
+        return CMD_ERROR;
+    }
+    else if(rc_send == 0)
+        return CMD_ERROR;
+    else
+        return CMD_OK;
+}
+
+#if SCH_TM_COMPRESS
+int _send_tel_compressed(int start, int end, int payload, int dest_node)
+{
+    int rc_send = 1;
+    int payload_size = data_map[payload].size;
+    uint8_t *samples = (uint8_t *)sch_malloc(MEM_TM, SCH_TM_COMPRESS_MAX*payload_size);
+    if(samples == NULL)
+    {
+        LOGE(tag, "Unable to allocate %d samples!", SCH_TM_COMPRESS_MAX);
+        return CMD_ERROR;
+    }
+
+    // New connection
+    csp_conn_t *conn;
+    conn = com_connect(dest_node, SCH_TRX_PORT_TM, 500);
+    if(conn == NULL)
+    {
+        LOGE(tag, "Cannot create connection!");
+        sch_free(samples);
+        return CMD_ERROR;
+    }
+
+    int i = 0;
+    while(start < end)
+    {
+        int n_read = end - start < SCH_TM_COMPRESS_MAX ? end - start : SCH_TM_COMPRESS_MAX;
+        n_read = dat_get_payload_samples(samples, payload, start, n_read);
+        if(n_read < 1)
+        {
+            LOGE(tag, "Error reading payload %d samples from %d", payload, start);
+            rc_send = 0;
+            break;
+        }
+
+        csp_packet_t *packet = com_buffer_get(sizeof(com_frame_t), 0);
+        if(packet == NULL)
+        {
+            rc_send = 0;
+            break;
+        }
         memset(packet->data, 0, sizeof(com_frame_t));
         com_frame_t *frame = (com_frame_t *)(packet->data);
         frame->node = SCH_COMM_ADDRESS;
-        frame->nframe = csp_hton16((uint16_t) i);
-        frame->type = (uint8_t)(TM_TYPE_PAYLOAD + payload);
-        frame->ndata = csp_hton32((uint32_t)structs_per_frame);
-
-        int j;
-        for(j=0; j < structs_per_frame; ++j) {
-            if( (i*structs_per_frame) +j >= n_samples ) {
-                frame->ndata = csp_hton32((uint32_t) j);
-                break;
-            }
+        frame->nframe = csp_hton16((uint16_t)(i & COM_FRAME_NUM_MASK));
+        frame->type = (uint8_t)(TM_TYPE_PAYLOAD_Z + payload);
 
-            char buff[payload_size];
-            dat_get_recent_payload_sample(buff, payload, (n_samples+(index_pay - end)) - (i * structs_per_frame + j + 1));
-            int mem_offset = (j * payload_size);
-            memcpy(frame->data.data8 + mem_offset, buff, payload_size);
+        // Largest number of samples that fits in the frame, the compressed
+        // length grows with the number of samples
+        int lo = 0, hi = n_read;
+        while(lo < hi)
+        {
+            int mid = (lo + hi + 1)/2;
+            if(dat_compress_payload_samples(samples, payload, mid, frame->data.data8, COM_FRAME_MAX_LEN) >= 0)
+                lo = mid;
+            else
+                hi = mid - 1;
         }
+        int len = dat_compress_payload_samples(samples, payload, lo, frame->data.data8, COM_FRAME_MAX_LEN);
+        if(len < 0)
+        {
+            csp_buffer_free(packet);
+            LOGE(tag, "Payload %d sample does not fit in a frame!", payload);
+            rc_send = 0;
+            break;
+        }
+        frame->ndata = csp_hton32((uint32_t)lo);
+        packet->length = (uint16_t)(offsetof(com_frame_t, data) + len);
 
-        int k;
-        for(k=0; k<sizeof(frame->data.data32); k++)
-            frame->data.data32[k] = csp_hton32(frame->data.data32[k]);
-
-        LOGI(tag, "Node    : %d", frame->node);
-        LOGI(tag, "Frame   : %d", csp_ntoh16(frame->nframe));
+        LOGI(tag, "Frame   : %d", i);
         LOGI(tag, "Type    : %d", frame->type);
-        LOGI(tag, "Samples : %d", csp_ntoh16(frame->ndata));
-        //print_buff(frame->data.data8, payload_size*structs_per_frame);
+        LOGI(tag, "Samples : %d (%d bytes, %d raw)", lo, len, lo*payload_size);
 
         // Send packet
+        com_frame_seal(packet);
+        com_tx_pace(packet->length);
         rc_send = csp_send(conn, packet, 500);
         if(rc_send == 0)
         {
@@ -205,9 +760,10 @@ int _send_tel_from_to(int start, int end, int payload, int dest_node)
             break; // Exit with error
         }
 
-        if((i+1)%SCH_COM_MAX_PACKETS == 0)
-            osDelay(SCH_COM_TX_DELAY_MS);
+        start += lo;
+        i++;
     }
+    sch_free(samples);
 
     // Close connection
     int rc_conn = csp_close(conn);
@@ -220,6 +776,7 @@ int _send_tel_from_to(int start, int end, int payload, int dest_node)
     else
         return CMD_OK;
 }
+#endif
 
 int tm_get_single(char *fmt, char *params, int nparams)
 {
@@ -232,7 +789,7 @@ int tm_get_single(char *fmt, char *params, int nparams)
     uint32_t payload;
     uint32_t index;
 
-    if(nparams == sscanf(params, fmt, &payload, &index))
+    if(nparams == cmd_scan_params(fmt, params, &payload, &index))
     {
         if(payload >= last_sensor) {
             return CMD_SYNTAX_ERROR;
@@ -261,7 +818,7 @@ int tm_get_last(char *fmt, char *params, int nparams)
     }
 
     uint32_t payload;
-    if(nparams == sscanf(params, fmt, &payload))
+    if(nparams == cmd_scan_params(fmt, params, &payload))
     {
         if(payload >= last_sensor) {
             return CMD_SYNTAX_ERROR;
@@ -302,7 +859,7 @@ int tm_send_last(char *fmt, char *params, int nparams)
 
     uint32_t dest_node;
     uint32_t payload;
-    if(nparams == sscanf(params, fmt, &payload, &dest_node))
+    if(nparams == cmd_scan_params(fmt, params, &payload, &dest_node))
     {
         if(payload >= last_sensor) {
             return CMD_SYNTAX_ERROR;
@@ -328,6 +885,33 @@ int tm_send_last(char *fmt, char *params, int nparams)
     }
 }
 
+/**
+ * Send the payload samples [start, end) in chunks of SCH_TM_CHUNK_FRAMES
+ * frames. The next sample is saved as the command cursor (plus one) and
+ * CMD_CONTINUE returned, so other commands run between chunks (@see
+ * cmd_set_cursor). The range is computed again for every chunk, only the
+ * first chunk starts at @start.
+ */
+static int _send_tel_chunked(char *params, int start, int end, int payload, int dest_node)
+{
+    uint32_t cursor = cmd_get_cursor(params);
+    if(cursor > 0)
+        start = (int)cursor - 1;
+    int chunk = SCH_TM_CHUNK_FRAMES*((COM_FRAME_MAX_LEN)/data_map[payload].size);
+    while(chunk > 0 && end - start > chunk)
+    {
+        int rc = _send_tel_from_to(start, start + chunk, payload, dest_node);
+        start += chunk;
+        if(rc != CMD_OK)
+            return rc;
+        if(cmd_set_cursor(params, (uint32_t)start + 1) == 0)
+            return CMD_CONTINUE;
+    }
+    if(end <= start)
+        return CMD_OK;
+    return _send_tel_from_to(start, end, payload, dest_node);
+}
+
 int tm_send_all(char *fmt, char *params, int nparams)
 {
     if(params == NULL)
@@ -339,14 +923,14 @@ int tm_send_all(char *fmt, char *params, int nparams)
     uint32_t dest_node;
     uint32_t payload;
 
-    if(nparams == sscanf(params, fmt, &payload, &dest_node)) {
+    if(nparams == cmd_scan_params(fmt, params, &payload, &dest_node)) {
 
         if(payload >= last_sensor) {
             return CMD_SYNTAX_ERROR;
         }
         int index_pay = dat_get_system_var(data_map[payload].sys_index);
         int index_ack = dat_get_system_var(data_map[payload].sys_ack);
-        int rc = _send_tel_from_to(index_ack, index_pay, payload, dest_node);
+        int rc = _send_tel_chunked(params, index_ack, index_pay, payload, dest_node);
         return rc;
     }
     else
@@ -367,7 +951,7 @@ int tm_send_from(char *fmt, char *params, int nparams)
     uint32_t payload;
     uint32_t samples;
 
-    if(nparams == sscanf(params, fmt, &payload, &dest_node, &samples)) {
+    if(nparams == cmd_scan_params(fmt, params, &payload, &dest_node, &samples)) {
 
         if(payload >= last_sensor) {
             return CMD_SYNTAX_ERROR;
@@ -385,7 +969,50 @@ int tm_send_from(char *fmt, char *params, int nparams)
             des = index_pay;
         }
 
-        int rc = _send_tel_from_to(index_ack, des, payload, dest_node);
+        int rc = _send_tel_chunked(params, index_ack, des, payload, dest_node);
+        return rc;
+    }
+    else
+    {
+        return CMD_SYNTAX_ERROR;
+    }
+}
+
+int tm_send_range_time(char *fmt, char *params, int nparams)
+{
+    if(params == NULL)
+    {
+        LOGE(tag, "params is null!");
+        return CMD_SYNTAX_ERROR;
+    }
+
+    uint32_t dest_node;
+    uint32_t payload;
+    uint32_t time_start;
+    uint32_t time_end;
+
+    if(nparams == cmd_scan_params(fmt, params, &payload, &dest_node, &time_start, &time_end)) {
+
+        if(payload >= last_sensor || time_end < time_start) {
+            return CMD_SYNTAX_ERROR;
+        }
+
+        // Samples in [time_start, time_end], the end index is the first
+        // sample after time_end
+        int start = dat_get_payload_index_time(payload, time_start);
+        int end = time_end == UINT32_MAX ? dat_get_system_var(data_map[payload].sys_index) :
+                  dat_get_payload_index_time(payload, time_end + 1);
+        if(start < 0 || end < 0) {
+            LOGE(tag, "Unable to find payload %d samples between %u and %u", payload, time_start, time_end);
+            return CMD_ERROR;
+        }
+        if(end <= start) {
+            LOGW(tag, "No payload %d samples between %u and %u", payload, time_start, time_end);
+            return CMD_OK;
+        }
+
+        LOGI(tag, "Sending payload %d samples %d to %d", payload, start, end-1);
+        int rc = _send_tel_chunked(params, start, end, payload, dest_node);
         return rc;
     }
     else
@@ -404,7 +1031,7 @@ int tm_set_ack(char *fmt, char *params, int nparams) {
     uint32_t payload;
     uint32_t k_samples;
 
-    if(nparams == sscanf(params, fmt, &payload, &k_samples)) {
+    if(nparams == cmd_scan_params(fmt, params, &payload, &k_samples)) {
 
         if(payload >= last_sensor) {
             LOGE(tag, "payload not found")
@@ -443,133 +1070,1233 @@ int tm_set_ack(char *fmt, char *params, int nparams) {
     }
 }
 
-int tm_send_cmds(char *fmt, char *params, int nparams)
+int tm_send_payload_range(int start, int end, int payload, int dest_node)
 {
-    int node;
-    if(params == NULL || sscanf(params, fmt, &node) != nparams)
-        return CMD_SYNTAX_ERROR;
+    if(payload < 0 || payload >= last_sensor || start < 0 || end < start)
+        return CMD_ERROR;
+    return _send_tel_from_to(start, end, payload, dest_node);
+}
 
-    return _com_send_data(node, cmd_save_all(), strlen(cmd_save_all()), TM_TYPE_HELP, 1, 0);
+int tm_build_payload_frame(struct com_frame *frame, int start, int end, int payload)
+{
+    if(payload < 0 || payload >= last_sensor || start < 0 || end <= start ||
+       end - start > COM_FRAME_MAX_LEN/data_map[payload].size)
+        return -1;
+    return _tm_fill_payload_frame(frame, 0, start, end - start, payload) == end - start ? 0 : -1;
 }
 
-#ifdef LINUX
-int tm_send_file(char *fmt, char *params, int nparams)
+int tm_send_frames(const struct com_frame *frames, int n, int dest_node)
 {
-    if(params == NULL)
+    // New connection
+    csp_conn_t *conn;
+    conn = com_connect(dest_node, SCH_TRX_PORT_TM, 500);
+    if(conn == NULL)
     {
-        LOGE(tag, "params is null!");
-        return CMD_SYNTAX_ERROR;
+        LOGE(tag, "Cannot create connection!");
+        return CMD_ERROR;
     }
 
-    char file_name[100];
-    int node;
-    if(nparams == sscanf(params, fmt, file_name, &node))
+    int rc_send = 1;
+    int i;
+    for(i=0; i < n; i++)
     {
-        // Open file
-        FILE *fptr;
-        fptr = fopen(file_name,"rb");  // r for read, b for binary
-        if(fptr == NULL)
+        csp_packet_t *packet = com_buffer_get(sizeof(com_frame_t), 0);
+        if(packet == NULL)
         {
-            LOGE(tag, "Error reading file %s", file_name);
-            return CMD_ERROR;
+            LOGE(tag, "Cannot get a buffer for frame %d!", i);
+            rc_send = 0;
+            break;
+        }
+        packet->length = sizeof(com_frame_t);
+        memcpy(packet->data, &frames[i], sizeof(com_frame_t));
+        ((com_frame_t *)(packet->data))->nframe = com_frame_hton_nframe(i);
+
+        // Send packet
+        com_frame_seal(packet);
+        com_tx_pace(packet->length);
+        if(csp_send(conn, packet, 500) == 0)
+        {
+            csp_buffer_free(packet);
+            LOGE(tag, "Error sending frame %d!", i);
+            rc_send = 0;
+            break; // Exit with error
         }
-        // Determine file size
-        fseek(fptr, 0L, SEEK_END);
-        long sz = ftell(fptr);
-        fseek(fptr, 0L, SEEK_SET);
-        // Read file
-        char *buffer = malloc((int)sz);
-        if(buffer == NULL)
-            return CMD_ERROR;
-        fread(buffer, (int)sz,1, fptr);
-        fclose(fptr);
-        // Send file using CSP
-        char *bname = basename(file_name);
-        int rc = com_send_file(node, bname, buffer, sz);
-        // Clean and return
-        free(buffer);
-        return rc;
     }
+
+    // Close connection
+    int rc_conn = csp_close(conn);
+    if(rc_conn != CSP_ERR_NONE) {
+        LOGE(tag, "Error closing connection! (%d)", rc_conn);
+        return CMD_ERROR;
+    }
+    else if(rc_send == 0)
+        return CMD_ERROR;
     else
+        return CMD_OK;
+}
+
+int tm_send_payload_mux(const tm_payload_range_t *ranges, int n, int dest_node)
+{
+    int i;
+    for(i=0; i < n; i++)
+    {
+        if(ranges[i].payload < 0 || ranges[i].payload >= last_sensor || ranges[i].start < 0 ||
+           ranges[i].end < ranges[i].start)
+            return CMD_ERROR;
+    }
+
+    // New connection
+    csp_conn_t *conn;
+    conn = com_connect(dest_node, SCH_TRX_PORT_TM, 500);
+    if(conn == NULL)
+    {
+        LOGE(tag, "Cannot create connection!");
+        return CMD_ERROR;
+    }
+
+    int rc_send = 1;
+    int nframe = 0;
+    int index = n > 0 ? ranges[0].start : 0;
+    i = 0;
+    while(i < n && rc_send)
+    {
+        csp_packet_t *packet = com_buffer_get(sizeof(com_frame_t), 0);
+        if(packet == NULL)
+        {
+            LOGE(tag, "Cannot get a buffer for frame %d!", nframe);
+            rc_send = 0;
+            break;
+        }
+        com_frame_t *frame = (com_frame_t *)(packet->data);
+        frame->node = SCH_COMM_ADDRESS;
+        frame->nframe = com_frame_hton_nframe(nframe);
+        frame->type = TM_TYPE_PAYLOAD_MUX;
+
+        // Records of the ranges, or the part of a range, that fit in the frame
+        int used = 0, records = 0;
+        while(i < n)
+        {
+            int payload = ranges[i].payload;
+            int size = data_map[payload].size;
+            int count = ranges[i].end - index;
+            int fit = (COM_FRAME_MAX_LEN - used - TM_MUX_HEADER_LEN)/size;
+            if(count > fit)
+                count = fit;
+            if(count > 0xFFFF)
+                count = 0xFFFF;
+            if(count > 0)
+            {
+                uint32_t *record = (uint32_t *)(frame->data.data8 + used);
+                count = dat_get_payload_samples(record+1, payload, index, count);
+                if(count < 1)
+                {
+                    LOGE(tag, "Error reading payload %d samples from %d", payload, index);
+                    rc_send = 0;
+                    break;
+                }
+                record[0] = com_tm_hton32(((uint32_t)payload << 16) | (uint32_t)count);
+                com_tm_hton32_buff(record+1, count*size/(int)sizeof(uint32_t));
+                used += TM_MUX_HEADER_LEN + count*size;
+                records++;
+                index += count;
+            }
+            if(index < ranges[i].end)
+                break;  // Frame full
+            if(++i < n)
+                index = ranges[i].start;
+        }
+        if(records == 0)
+        {
+            // Only empty ranges were left, or a sample does not fit in a frame
+            csp_buffer_free(packet);
+            if(rc_send && i < n)
+            {
+                LOGE(tag, "Payload %d sample does not fit in a frame!", ranges[i].payload);
+                rc_send = 0;
+            }
+            break;
+        }
+        frame->ndata = csp_hton32((uint32_t)records);
+        packet->length = (uint16_t)(offsetof(com_frame_t, data) + used);
+
+        LOGI(tag, "Frame   : %d", nframe);
+        LOGI(tag, "Type    : %d", frame->type);
+        LOGI(tag, "Records : %d (%d bytes)", records, used);
+
+        // Send packet
+        com_frame_seal(packet);
+        com_tx_pace(packet->length);
+        if(csp_send(conn, packet, 500) == 0)
+        {
+            csp_buffer_free(packet);
+            LOGE(tag, "Error sending frame %d!", nframe);
+            rc_send = 0;
+            break; // Exit with error
+        }
+        nframe++;
+    }
+
+    // Close connection
+    int rc_conn = csp_close(conn);
+    if(rc_conn != CSP_ERR_NONE) {
+        LOGE(tag, "Error closing connection! (%d)", rc_conn);
+        return CMD_ERROR;
+    }
+    else if(rc_send == 0)
+        return CMD_ERROR;
+    else
+        return CMD_OK;
+}
+
+int tm_dl_start(char *fmt, char *params, int nparams)
+{
+    int node, seconds;
+    if(params == NULL || cmd_scan_params(fmt, params, &node, &seconds) != nparams)
         return CMD_SYNTAX_ERROR;
 
+    if(dl_start(node, seconds) != 0)
+    {
+        LOGE(tag, "Unable to start a downlink session to node %d (%d s)", node, seconds);
+        return CMD_ERROR;
+    }
+    return CMD_OK;
 }
 
-int tm_parse_file(char *fmt, char *params, int nparams)
+int tm_dl_stop(char *fmt, char *params, int nparams)
+{
+    return dl_stop() == 0 ? CMD_OK : CMD_ERROR;
+}
+
+int tm_dl_weight(char *fmt, char *params, int nparams)
+{
+    int source;
+    unsigned int weight;
+    if(params == NULL || cmd_scan_params(fmt, params, &source, &weight) != nparams)
+        return CMD_SYNTAX_ERROR;
+
+    if(dl_set_weight(source, weight) != 0)
+    {
+        LOGE(tag, "Invalid downlink source %d", source);
+        return CMD_ERROR;
+    }
+    return CMD_OK;
+}
+
+int tm_dl_ack(char *fmt, char *params, int nparams)
+{
+    unsigned int payload, start, end;
+    if(params == NULL || cmd_scan_params(fmt, params, &payload, &start, &end) != nparams)
+        return CMD_SYNTAX_ERROR;
+
+    if(payload >= last_sensor || end <= start)
+    {
+        LOGE(tag, "Invalid ack range %u [%u, %u)", payload, start, end);
+        return CMD_SYNTAX_ERROR;
+    }
+    return dl_ack((int)payload, (int)start, (int)end) == 0 ? CMD_OK : CMD_ERROR;
+}
+
+int tm_dl_status(char *fmt, char *params, int nparams)
+{
+    dl_print_status();
+    return CMD_OK;
+}
+
+int tm_ingest_stats(char *fmt, char *params, int nparams)
+{
+    int reset = 0;
+    if(params != NULL && cmd_scan_params(fmt, params, &reset) == 0)
+        return CMD_SYNTAX_ERROR;
+
+    ingest_stats_t stats;
+    ingest_get_stats(&stats, reset);
+    LOGR(tag, "Ingest: queued %u, waited %u, dropped %u, stored %u, errors %u, batches %u, max batch %u, published %u",
+         stats.queued, stats.waited, stats.dropped, stats.stored, stats.errors, stats.batches, stats.max_batch,
+         stats.published);
+    return CMD_OK;
+}
+
+int tm_send_cmds(char *fmt, char *params, int nparams)
+{
+    int node;
+    if(params == NULL || cmd_scan_params(fmt, params, &node) != nparams)
+        return CMD_SYNTAX_ERROR;
+
+    char *cmds_list = cmd_save_all();
+    if(cmds_list == NULL)
+        return CMD_ERROR;
+    int rc = _com_send_data(node, cmds_list, strlen(cmds_list), TM_TYPE_HELP, 1, 0);
+    sch_free(cmds_list);
+    return rc;
+}
+
+int tm_send_cmd_catalog(char *fmt, char *params, int nparams)
+{
+    int node;
+    unsigned int version;
+    if(params == NULL || cmd_scan_params(fmt, params, &node, &version) != nparams)
+        return CMD_SYNTAX_ERROR;
+
+    // The header goes first, then the commands only if the version changed
+    int n = 0;
+    uint32_t current = cmd_catalog_version(&n);
+    int len = current == version ? 1 : n + 1;
+    tm_cmd_catalog_t *buff = (tm_cmd_catalog_t *)sch_malloc(MEM_TM, sizeof(tm_cmd_catalog_t)*len);
+    if(buff == NULL)
+        return CMD_ERROR;
+    buff[0].id = TM_CMD_CATALOG_HEADER;
+    buff[0].nparams = (uint32_t)n;
+    buff[0].name_hash = current;
+    buff[0].fmt_hash = 0;
+
+    int i;
+    n = 1;
+    cmd_catalog_t entry;
+    for(i = 0; i < SCH_CMD_MAX_ENTRIES && n < len; i++)
+    {
+        if(cmd_catalog_get(i, &entry) != CMD_OK)
+            continue;
+        buff[n].id = (uint32_t)entry.id;
+        buff[n].nparams = (uint32_t)entry.nparams;
+        buff[n].name_hash = entry.name_hash;
+        buff[n].fmt_hash = entry.fmt_hash;
+        n++;
+    }
+    com_tm_hton32_buff((uint32_t *)buff, n*sizeof(tm_cmd_catalog_t)/sizeof(uint32_t));
+
+    int rc = com_send_telemetry(node, SCH_TRX_PORT_TM, TM_TYPE_CMD_CATALOG, buff, n*sizeof(tm_cmd_catalog_t), n, 0);
+    sch_free(buff);
+    return rc;
+}
+
+int tm_parse_cmd_catalog(char *fmt, char *params, int nparams)
 {
     if(params == NULL)
         return CMD_SYNTAX_ERROR;
 
-    com_frame_file_t *frame = (com_frame_file_t *)params;
-    int type = frame->type;
+    com_frame_t *frame = (com_frame_t *)params;
+    tm_cmd_catalog_t *catalog = (tm_cmd_catalog_t *)frame->data.data8;
 
-    char *bname = "recv_files/";
-    static char *fname = NULL;
-    static int last_id = 0;
-    static int last_frame = 0;
+    // Sanity check to params. Detect if params do not come from tm_send_cmd_catalog.
+    if(frame->type != TM_TYPE_CMD_CATALOG || frame->ndata > sizeof(frame->data)/sizeof(tm_cmd_catalog_t))
+        return CMD_SYNTAX_ERROR;
 
-    if(type == TM_TYPE_FILE_START)
+    int i;
+    for(i = 0; i<frame->ndata; i++)
+    {
+        com_frame_ntoh32_buff(frame, (uint32_t *)&catalog[i], sizeof(tm_cmd_catalog_t)/sizeof(uint32_t));
+        if(catalog[i].id == TM_CMD_CATALOG_HEADER)
+        {
+            LOGR(tag, "Commands catalog version 0x%08X, %u commands", (unsigned int)catalog[i].name_hash,
+                 (unsigned int)catalog[i].nparams);
+        }
+        else
+        {
+            LOGR(tag, "%5u %2u 0x%08X 0x%08X", (unsigned int)catalog[i].id, (unsigned int)catalog[i].nparams,
+                 (unsigned int)catalog[i].name_hash, (unsigned int)catalog[i].fmt_hash);
+        }
+    }
+    return CMD_OK;
+}
+
+int tm_send_cmd_names(char *fmt, char *params, int nparams)
+{
+    int node, first, count;
+    if(params == NULL || cmd_scan_params(fmt, params, &node, &first, &count) != nparams ||
+       first < 0 || count < 1)
+        return CMD_SYNTAX_ERROR;
+    if(count > SCH_CMD_MAX_ENTRIES - first)
+        count = SCH_CMD_MAX_ENTRIES - first;
+
+    // Size the text first, names and formats are shared by the repository
+    int i, len = 0;
+    cmd_catalog_t entry;
+    for(i = first; i < first + count; i++)
     {
-        char *rname = (char *)frame->data;
-        char idname[10];
-        snprintf(idname, 10, "%d_", frame->fileid);
-        size_t path_len = strlen(bname) + strlen(idname) + strlen(rname) + 1;
-        fname = calloc(path_len, 1);
-        assert(fname != NULL);
-        strncat(fname, bname, path_len);
-        strncat(fname, idname, path_len);
-        strncat(fname, rname, path_len);
-        last_id = frame->fileid;
-        last_frame = frame->nframe;
-        LOGI(tag, "New file! Id: %d. Frame: %d/%d. Name: %s", frame->fileid, frame->nframe, frame->total, fname);
+        const char *name = cmd_get_name(i);
+        if(cmd_catalog_get(i, &entry) == CMD_OK)
+            len += snprintf(NULL, 0, "%d %s %s\n", i, name, cmd_get_fmt(name));
     }
+    if(len == 0)
+        return CMD_ERROR;
 
-    if(type == TM_TYPE_FILE_DATA || type == TM_TYPE_FILE_END)
+    char *names = (char *)sch_malloc(MEM_TM, (size_t)len + 1);
+    if(names == NULL)
+        return CMD_ERROR;
+    int n = 0;
+    for(i = first; i < first + count && n < len; i++)
     {
-        LOGI(tag, "Id: %d. Frame: %d/%d", frame->fileid, frame->nframe, frame->total, fname);
-        if(fname == NULL || last_id != frame->fileid || last_frame != frame->nframe-1)
+        const char *name = cmd_get_name(i);
+        if(cmd_catalog_get(i, &entry) == CMD_OK)
+            n += snprintf(names + n, (size_t)(len + 1 - n), "%d %s %s\n", i, name, cmd_get_fmt(name));
+    }
+    int rc = _com_send_data(node, names, (size_t)n, TM_TYPE_HELP, 1, 0);
+    sch_free(names);
+    return rc;
+}
+
+int tm_send_fp(char *fmt, char *params, int nparams)
+{
+    int node, pages;
+    fp_cursor_t cursor;
+    if(params == NULL || cmd_scan_params(fmt, params, &node, &cursor.time, &cursor.skip, &pages) != nparams ||
+       cursor.skip < 0 || pages < 0)
+        return CMD_SYNTAX_ERROR;
+
+    // A page of commands and its text, padded to whole frames
+    size_t text_len = SCH_FP_PAGE*(SCH_CMD_MAX_STR_NAME+SCH_CMD_MAX_STR_PARAMS+64) + COM_FRAME_MAX_LEN;
+    fp_entry_t *page = (fp_entry_t *)sch_malloc(MEM_TM, sizeof(fp_entry_t)*SCH_FP_PAGE);
+    char *text = (char *)sch_malloc(MEM_TM, text_len);
+    if(page == NULL || text == NULL)
+    {
+        sch_free(page);
+        sch_free(text);
+        return CMD_ERROR;
+    }
+
+    int rc = CMD_OK;
+    int i, n, sent = 0, nframe = 0;
+    do
+    {
+        // The flight plan is only locked while reading the page
+        n = dat_get_fp_page(&cursor, page, SCH_FP_PAGE);
+        if(n < 0)
         {
-            LOGE(tag, "Invalid file frame! Last Id: %d. Last frame: %d", last_id, last_frame);
+            rc = CMD_ERROR;
+            break;
+        }
+
+        size_t len = 0;
+        for(i = 0; i < n; i++)
+            len += snprintf(text + len, text_len - len, "%d %d %d %d %s %s\n", page[i].unixtime, page[i].ms,
+                            page[i].executions, page[i].periodical, page[i].cmd, page[i].args);
+        sent++;
+        if(n == SCH_FP_PAGE)
+            len += snprintf(text + len, text_len - len, "next %d %d\n", cursor.time, cursor.skip);
+        else
+            len += snprintf(text + len, text_len - len, "end\n");
+
+        size_t frames = (len + COM_FRAME_MAX_LEN - 1)/COM_FRAME_MAX_LEN;
+        memset(text + len, 0, frames*COM_FRAME_MAX_LEN - len);
+        rc = _com_send_data(node, text, frames*COM_FRAME_MAX_LEN, TM_TYPE_FP, 1, nframe);
+        nframe += (int)frames;
+    }
+    while(rc == CMD_OK && n == SCH_FP_PAGE && (pages == 0 || sent < pages));
+
+    sch_free(page);
+    sch_free(text);
+    return rc;
+}
+
+int tm_parse_fp(char *fmt, char *params, int nparams)
+{
+    if(params == NULL)
+        return CMD_SYNTAX_ERROR;
+
+    com_frame_t *frame = (com_frame_t *)params;
+    if(frame->type != TM_TYPE_FP)
+        return CMD_SYNTAX_ERROR;
+
+    // The text is split in frames, padded with zeros
+    printf("%.*s", (int)sizeof(frame->data), (char *)frame->data.data8);
+    return CMD_OK;
+}
+
+int tm_send_cmd_stats(char *fmt, char *params, int nparams)
+{
+    int node;
+    if(params == NULL || cmd_scan_params(fmt, params, &node) != nparams)
+        return CMD_SYNTAX_ERROR;
+
+    // Pack the statistics of executed commands
+    tm_cmd_stats_t *buff = (tm_cmd_stats_t *)sch_malloc(MEM_TM, sizeof(tm_cmd_stats_t)*SCH_CMD_MAX_ENTRIES);
+    if(buff == NULL)
+        return CMD_ERROR;
+
+    int i, j, n = 0;
+    cmd_stats_t stats;
+    for(i=0; i<SCH_CMD_MAX_ENTRIES; i++)
+    {
+        if(cmd_stats_get(i, &stats) != CMD_OK || stats.count == 0)
+            continue;
+        buff[n].id = (uint32_t)i;
+        buff[n].count = stats.count;
+        buff[n].exec_min = stats.exec_min;
+        buff[n].exec_mean = (uint32_t)(stats.exec_sum/stats.count);
+        buff[n].exec_max = stats.exec_max;
+        buff[n].wait_mean = (uint32_t)(stats.wait_sum/stats.count);
+        buff[n].wait_max = stats.wait_max;
+        for(j=0; j<CMD_STATS_BUCKETS; j++)
+            buff[n].hist[j] = stats.hist[j];
+        com_tm_hton32_buff((uint32_t *)&buff[n], sizeof(tm_cmd_stats_t)/sizeof(uint32_t));
+        n++;
+    }
+
+    int rc = CMD_OK;
+    if(n > 0)
+        rc = com_send_telemetry(node, SCH_TRX_PORT_TM, TM_TYPE_CMD_STATS, buff, n*sizeof(tm_cmd_stats_t), n, 0);
+    sch_free(buff);
+    return rc;
+}
+
+int tm_parse_cmd_stats(char *fmt, char *params, int nparams)
+{
+    if(params == NULL)
+        return CMD_SYNTAX_ERROR;
+
+    com_frame_t *frame = (com_frame_t *)params;
+    tm_cmd_stats_t *stats = (tm_cmd_stats_t *)frame->data.data8;
+
+    // Sanity check to params. Detect if params do not come from tm_send_cmd_stats.
+    if(frame->type != TM_TYPE_CMD_STATS || frame->ndata > sizeof(frame->data)/sizeof(tm_cmd_stats_t))
+        return CMD_SYNTAX_ERROR;
+
+    int i, j;
+    for(i = 0; i<frame->ndata; i++)
+    {
+        com_frame_ntoh32_buff(frame, (uint32_t *)&stats[i], sizeof(tm_cmd_stats_t)/sizeof(uint32_t));
+        char hist[CMD_STATS_BUCKETS*11+1];
+        int len = 0;
+        for(j=0; j<CMD_STATS_BUCKETS; j++)
+            len += snprintf(hist+len, sizeof(hist)-len, "%u ", (unsigned int)stats[i].hist[j]);
+        LOGR(tag, "%5u %8u %10u %10u %10u %10u %10u  %s", (unsigned int)stats[i].id,
+             (unsigned int)stats[i].count, (unsigned int)stats[i].exec_min,
+             (unsigned int)stats[i].exec_mean, (unsigned int)stats[i].exec_max,
+             (unsigned int)stats[i].wait_mean, (unsigned int)stats[i].wait_max, hist);
+    }
+    return CMD_OK;
+}
+
+int tm_send_cmd_lat(char *fmt, char *params, int nparams)
+{
+    int node;
+    if(params == NULL || cmd_scan_params(fmt, params, &node) != nparams)
+        return CMD_SYNTAX_ERROR;
+
+    cmd_lat_stats_t stats[CMD_LAT_STAGES];
+    tm_cmd_lat_t buff[CMD_LAT_STAGES];
+    uint32_t last_id = cmd_lat_get(stats);
+
+    int i, j;
+    for(i=0; i<CMD_LAT_STAGES; i++)
+    {
+        buff[i].stage = (uint32_t)i;
+        buff[i].last_id = last_id;
+        buff[i].count = stats[i].count;
+        buff[i].mean = stats[i].count > 0 ? (uint32_t)(stats[i].sum/stats[i].count) : 0;
+        buff[i].max = stats[i].max;
+        for(j=0; j<CMD_LAT_BUCKETS; j++)
+            buff[i].hist[j] = stats[i].hist[j];
+        com_tm_hton32_buff((uint32_t *)&buff[i], sizeof(tm_cmd_lat_t)/sizeof(uint32_t));
+    }
+
+    return com_send_telemetry(node, SCH_TRX_PORT_TM, TM_TYPE_CMD_LAT, buff, sizeof(buff), CMD_LAT_STAGES, 0);
+}
+
+int tm_parse_cmd_lat(char *fmt, char *params, int nparams)
+{
+    if(params == NULL)
+        return CMD_SYNTAX_ERROR;
+
+    com_frame_t *frame = (com_frame_t *)params;
+    tm_cmd_lat_t *stats = (tm_cmd_lat_t *)frame->data.data8;
+
+    // Sanity check to params. Detect if params do not come from tm_send_cmd_lat.
+    if(frame->type != TM_TYPE_CMD_LAT || frame->ndata > sizeof(frame->data)/sizeof(tm_cmd_lat_t))
+        return CMD_SYNTAX_ERROR;
+
+    int i, j;
+    for(i = 0; i<frame->ndata; i++)
+    {
+        com_frame_ntoh32_buff(frame, (uint32_t *)&stats[i], sizeof(tm_cmd_lat_t)/sizeof(uint32_t));
+        char hist[CMD_LAT_BUCKETS*11+1];
+        int len = 0;
+        for(j=0; j<CMD_LAT_BUCKETS; j++)
+            len += snprintf(hist+len, sizeof(hist)-len, "%u ", (unsigned int)stats[i].hist[j]);
+        LOGR(tag, "%-8s %8u %8u %10u %10u  %s", cmd_lat_get_name((int)stats[i].stage),
+             (unsigned int)stats[i].last_id, (unsigned int)stats[i].count,
+             (unsigned int)stats[i].mean, (unsigned int)stats[i].max, hist);
+    }
+    return CMD_OK;
+}
+
+int tm_send_task_stats(char *fmt, char *params, int nparams)
+{
+    int node;
+    if(params == NULL || cmd_scan_params(fmt, params, &node) != nparams)
+        return CMD_SYNTAX_ERROR;
+
+    // Pack the statistics of the registered loops
+    tm_task_stats_t buff[OS_PERIOD_MAX];
+    memset(buff, 0, sizeof(buff));
+    int n;
+    osPeriodStats stats;
+    for(n=0; n<OS_PERIOD_MAX && osPeriodGetStats(n, &stats, 0) == 0; n++)
+    {
+        buff[n].id = (uint32_t)n;
+        buff[n].period_ms = stats.period_ms;
+        buff[n].loops = stats.loops;
+        buff[n].overruns = stats.overruns;
+        buff[n].work_last = stats.work_last_us;
+        buff[n].work_mean = (uint32_t)(stats.loops > 0 ? stats.work_sum_us/stats.loops : 0);
+        buff[n].work_max = stats.work_max_us;
+        buff[n].late_max = stats.late_max_us;
+        strncpy(buff[n].name, stats.name, TM_TASK_NAME_LEN-1);
+        com_tm_hton32_buff((uint32_t *)&buff[n], offsetof(tm_task_stats_t, name)/sizeof(uint32_t));
+    }
+
+    int rc = CMD_OK;
+    if(n > 0)
+        rc = com_send_telemetry(node, SCH_TRX_PORT_TM, TM_TYPE_TASK_STATS, buff, n*sizeof(tm_task_stats_t), n, 0);
+    return rc;
+}
+
+int tm_parse_task_stats(char *fmt, char *params, int nparams)
+{
+    if(params == NULL)
+        return CMD_SYNTAX_ERROR;
+
+    com_frame_t *frame = (com_frame_t *)params;
+    tm_task_stats_t *stats = (tm_task_stats_t *)frame->data.data8;
+
+    // Sanity check to params. Detect if params do not come from tm_send_task_stats.
+    if(frame->type != TM_TYPE_TASK_STATS || frame->ndata > sizeof(frame->data)/sizeof(tm_task_stats_t))
+        return CMD_SYNTAX_ERROR;
+
+    int i;
+    for(i = 0; i<frame->ndata; i++)
+    {
+        com_frame_ntoh32_buff(frame, (uint32_t *)&stats[i], offsetof(tm_task_stats_t, name)/sizeof(uint32_t));
+        stats[i].name[TM_TASK_NAME_LEN-1] = '\0';
+        LOGR(tag, "%5u %-14s %10u %8u %8u %10u %10u %10u %10u", (unsigned int)stats[i].id, stats[i].name,
+             (unsigned int)stats[i].period_ms, (unsigned int)stats[i].loops, (unsigned int)stats[i].overruns,
+             (unsigned int)stats[i].work_last, (unsigned int)stats[i].work_mean,
+             (unsigned int)stats[i].work_max, (unsigned int)stats[i].late_max);
+    }
+    return CMD_OK;
+}
+
+int tm_send_task_stack(char *fmt, char *params, int nparams)
+{
+    int node;
+    if(params == NULL || cmd_scan_params(fmt, params, &node) != nparams)
+        return CMD_SYNTAX_ERROR;
+
+    // Pack the stack usage of the registered tasks
+    tm_task_stack_t buff[OS_TASK_MAX];
+    memset(buff, 0, sizeof(buff));
+    int n;
+    osTaskStack stack;
+    for(n=0; n<OS_TASK_MAX && osTaskGetStack(n, &stack) == 0; n++)
+    {
+        buff[n].id = (uint32_t)n;
+        buff[n].size = stack.size;
+        buff[n].used_max = stack.used_max;
+        strncpy(buff[n].name, stack.name, TM_TASK_NAME_LEN-1);
+        com_tm_hton32_buff((uint32_t *)&buff[n], offsetof(tm_task_stack_t, name)/sizeof(uint32_t));
+    }
+
+    int rc = CMD_OK;
+    if(n > 0)
+        rc = com_send_telemetry(node, SCH_TRX_PORT_TM, TM_TYPE_TASK_STACK, buff, n*sizeof(tm_task_stack_t), n, 0);
+    return rc;
+}
+
+int tm_parse_task_stack(char *fmt, char *params, int nparams)
+{
+    if(params == NULL)
+        return CMD_SYNTAX_ERROR;
+
+    com_frame_t *frame = (com_frame_t *)params;
+    tm_task_stack_t *stack = (tm_task_stack_t *)frame->data.data8;
+
+    // Sanity check to params. Detect if params do not come from tm_send_task_stack.
+    if(frame->type != TM_TYPE_TASK_STACK || frame->ndata > sizeof(frame->data)/sizeof(tm_task_stack_t))
+        return CMD_SYNTAX_ERROR;
+
+    int i;
+    for(i = 0; i<frame->ndata; i++)
+    {
+        com_frame_ntoh32_buff(frame, (uint32_t *)&stack[i], offsetof(tm_task_stack_t, name)/sizeof(uint32_t));
+        stack[i].name[TM_TASK_NAME_LEN-1] = '\0';
+        LOGR(tag, "%5u %-14s %10u %10u", (unsigned int)stack[i].id, stack[i].name,
+             (unsigned int)stack[i].used_max, (unsigned int)stack[i].size);
+    }
+    return CMD_OK;
+}
+
+int tm_send_prof(char *fmt, char *params, int nparams)
+{
+    int node, reset;
+    if(params == NULL || cmd_scan_params(fmt, params, &node, &reset) != nparams)
+        return CMD_SYNTAX_ERROR;
+
+    // Pack the counters of every profiling point
+    tm_prof_t buff[PROF_LAST];
+    memset(buff, 0, sizeof(buff));
+    int n;
+    prof_counter_t counter;
+    for(n=0; n<PROF_LAST && prof_get(n, &counter, reset) == 0; n++)
+    {
+        buff[n].id = (uint32_t)n;
+        buff[n].count = counter.count;
+        buff[n].time_mean = (uint32_t)(counter.count > 0 ? counter.time_sum_us/counter.count : 0);
+        buff[n].time_max = counter.time_max_us;
+        strncpy(buff[n].name, prof_get_name(n), TM_PROF_NAME_LEN-1);
+        com_tm_hton32_buff((uint32_t *)&buff[n], offsetof(tm_prof_t, name)/sizeof(uint32_t));
+    }
+
+    return com_send_telemetry(node, SCH_TRX_PORT_TM, TM_TYPE_PROF, buff, n*sizeof(tm_prof_t), n, 0);
+}
+
+int tm_parse_prof(char *fmt, char *params, int nparams)
+{
+    if(params == NULL)
+        return CMD_SYNTAX_ERROR;
+
+    com_frame_t *frame = (com_frame_t *)params;
+    tm_prof_t *prof = (tm_prof_t *)frame->data.data8;
+
+    // Sanity check to params. Detect if params do not come from tm_send_prof.
+    if(frame->type != TM_TYPE_PROF || frame->ndata > sizeof(frame->data)/sizeof(tm_prof_t))
+        return CMD_SYNTAX_ERROR;
+
+    int i;
+    for(i = 0; i<frame->ndata; i++)
+    {
+        com_frame_ntoh32_buff(frame, (uint32_t *)&prof[i], offsetof(tm_prof_t, name)/sizeof(uint32_t));
+        prof[i].name[TM_PROF_NAME_LEN-1] = '\0';
+        LOGR(tag, "%5u %-20s %10u %10u %10u", (unsigned int)prof[i].id, prof[i].name,
+             (unsigned int)prof[i].count, (unsigned int)prof[i].time_mean, (unsigned int)prof[i].time_max);
+    }
+    return CMD_OK;
+}
+
+int tm_parse_prof_stacks(char *fmt, char *params, int nparams)
+{
+    if(params == NULL)
+        return CMD_SYNTAX_ERROR;
+
+    com_frame_t *frame = (com_frame_t *)params;
+    tm_prof_stack_t *stacks = (tm_prof_stack_t *)frame->data.data8;
+
+    // Sanity check to params. Detect if params do not come from tm_send_prof_stacks.
+    if(frame->type != TM_TYPE_PROF_STACKS || frame->ndata > sizeof(frame->data)/sizeof(tm_prof_stack_t))
+        return CMD_SYNTAX_ERROR;
+
+    int i, j;
+    for(i = 0; i<frame->ndata; i++)
+    {
+        com_frame_ntoh32_buff(frame, (uint32_t *)&stacks[i], offsetof(tm_prof_stack_t, task)/sizeof(uint32_t));
+        stacks[i].task[TM_PROF_TASK_LEN-1] = '\0';
+        if(stacks[i].depth > PROF_SAMPLE_DEPTH)
+            stacks[i].depth = PROF_SAMPLE_DEPTH;
+
+        // Collapsed stack: task;outermost;...;innermost samples
+        char line[TM_PROF_TASK_LEN + PROF_SAMPLE_DEPTH*12];
+        int len = snprintf(line, sizeof(line), "%s", stacks[i].task);
+        for(j = (int)stacks[i].depth-1; j >= 0; j--)
+            len += snprintf(line+len, sizeof(line)-len, ";0x%x", (unsigned int)stacks[i].pc[j]);
+        LOGR(tag, "%s %u", line, (unsigned int)stacks[i].count);
+    }
+    return CMD_OK;
+}
+
+#ifdef LINUX
+int tm_send_prof_stacks(char *fmt, char *params, int nparams)
+{
+    int node, rate, seconds;
+    if(params == NULL || cmd_scan_params(fmt, params, &node, &rate, &seconds) != nparams)
+        return CMD_SYNTAX_ERROR;
+
+    prof_stack_t *stacks = (prof_stack_t *)sch_malloc(MEM_TM, SCH_PROF_SAMPLE_STACKS*sizeof(prof_stack_t));
+    if(stacks == NULL)
+        return CMD_ERROR;
+
+    prof_sample_stats_t stats;
+    int n = prof_sample_run(rate, seconds, stacks, SCH_PROF_SAMPLE_STACKS, &stats);
+    if(n < 0)
+    {
+        LOGE(tag, "Profiler session not started (rate %d, %d s), invalid or in progress", rate, seconds);
+        sch_free(stacks);
+        return CMD_ERROR;
+    }
+    LOGI(tag, "Profiler session: %d tasks, %u samples, %u missed, %u dropped, %d stacks", (int)stats.tasks,
+         (unsigned int)stats.samples, (unsigned int)stats.missed, (unsigned int)stats.dropped, n);
+    if(n == 0)
+    {
+        sch_free(stacks);
+        return CMD_OK;
+    }
+
+    // Telemetry entries, with the task name instead of its index
+    tm_prof_stack_t *buff = (tm_prof_stack_t *)sch_malloc(MEM_TM, n*sizeof(tm_prof_stack_t));
+    if(buff == NULL)
+    {
+        sch_free(stacks);
+        return CMD_ERROR;
+    }
+    memset(buff, 0, n*sizeof(tm_prof_stack_t));
+    int i;
+    for(i=0; i<n; i++)
+    {
+        os_thread thread;
+        const char *name = NULL;
+        buff[i].count = stacks[i].count;
+        buff[i].depth = stacks[i].depth;
+        memcpy(buff[i].pc, stacks[i].pc, sizeof(buff[i].pc));
+        if(osTaskGetThread(stacks[i].task, &thread, &name) == 0 && name != NULL)
+            strncpy(buff[i].task, name, TM_PROF_TASK_LEN-1);
+        else
+            snprintf(buff[i].task, TM_PROF_TASK_LEN, "task%d", (int)stacks[i].task);
+        com_tm_hton32_buff((uint32_t *)&buff[i], offsetof(tm_prof_stack_t, task)/sizeof(uint32_t));
+    }
+    sch_free(stacks);
+
+    int rc = com_send_telemetry(node, SCH_TRX_PORT_TM, TM_TYPE_PROF_STACKS, buff, n*sizeof(tm_prof_stack_t), n, 0);
+    sch_free(buff);
+    return rc;
+}
+
+/**
+ * Read a whole file to a new buffer, free it with sch_free after use
+ * @param file_name File path
+ * @param size Pointer for saving the file size
+ * @return Buffer with the file data, NULL if the file can not be read
+ */
+static char *_tm_read_file(char *file_name, long *size)
+{
+    // Open file
+    FILE *fptr;
+    fptr = fopen(file_name,"rb");  // r for read, b for binary
+    if(fptr == NULL)
+    {
+        LOGE(tag, "Error reading file %s", file_name);
+        return NULL;
+    }
+    // Determine file size
+    fseek(fptr, 0L, SEEK_END);
+    long sz = ftell(fptr);
+    fseek(fptr, 0L, SEEK_SET);
+    // Read file
+    char *buffer = sch_malloc(MEM_TM, sz > 0 ? (size_t)sz : 1);
+    if(buffer != NULL && sz > 0 && fread(buffer, (size_t)sz, 1, fptr) != 1)
+    {
+        LOGE(tag, "Error reading file %s", file_name);
+        sch_free(buffer);
+        buffer = NULL;
+    }
+    fclose(fptr);
+    *size = sz;
+    return buffer;
+}
+
+int tm_send_file(char *fmt, char *params, int nparams)
+{
+    if(params == NULL)
+    {
+        LOGE(tag, "params is null!");
+        return CMD_SYNTAX_ERROR;
+    }
+
+    char file_name[100];
+    int node;
+    if(nparams == cmd_scan_params(fmt, params, file_name, &node))
+    {
+        long sz;
+        char *buffer = _tm_read_file(file_name, &sz);
+        if(buffer == NULL)
             return CMD_ERROR;
+        // Send file using CSP, with the full path so the receiver can request
+        // the missing frames
+        int rc = com_send_file(node, file_name, buffer, (size_t)sz);
+        // Clean and return
+        sch_free(buffer);
+        return rc;
+    }
+    else
+        return CMD_SYNTAX_ERROR;
+
+}
+
+int tm_send_file_parts(char *fmt, char *params, int nparams)
+{
+    if(params == NULL)
+    {
+        LOGE(tag, "params is null!");
+        return CMD_SYNTAX_ERROR;
+    }
+
+    char file_name[100];
+    char parts[SCH_CMD_MAX_STR_PARAMS];
+    int node;
+    if(nparams == cmd_scan_params(fmt, params, file_name, &node, parts))
+    {
+        long sz;
+        char *buffer = _tm_read_file(file_name, &sz);
+        if(buffer == NULL)
+            return CMD_ERROR;
+        int rc = com_send_file_parts(node, file_name, buffer, (size_t)sz, parts);
+        sch_free(buffer);
+        return rc;
+    }
+    else
+        return CMD_SYNTAX_ERROR;
+}
+
+#define TM_FILE_DIR "recv_files/"   ///< Received files directory
+#define TM_FILE_RECV_MAX (4)        ///< Files received at the same time
+#define TM_FILE_RETRIES (5)         ///< Requests for missing frames without new frames
+#define TM_FILE_SAVE_FRAMES (8)     ///< Save the file state every some new frames
+
+/**
+ * Received file state, saved as TM_FILE_DIR/<fileid>.part followed by the
+ * received frames bitmap, so transfers resume after a restart. The data is
+ * written to TM_FILE_DIR/<fileid>.data, and renamed to <fileid>_<name> once
+ * complete.
+ */
+typedef struct tm_file_state {
+    uint16_t fileid;            ///< File id
+    uint16_t total;             ///< Total data frames
+    uint32_t size;              ///< File size, once FILE_START is received
+    uint8_t node;               ///< Sender node
+    uint8_t has_start;          ///< FILE_START received
+    char name[COM_FRAME_MAX_LEN];   ///< File path in the sender
+} tm_file_state_t;
+
+typedef struct tm_file_recv {
+    tm_file_state_t state;
+    uint8_t *bitmap;            ///< Received data frames, NULL if the slot is free
+    int received;               ///< Received data frames
+    int requests;               ///< Requests since the last new frame
+    FILE *fptr;                 ///< Data file, kept open during the transfer
+    portTick used;              ///< Last frame tick, to reuse the oldest slot
+} tm_file_recv_t;
+
+static tm_file_recv_t tm_files[TM_FILE_RECV_MAX];
+
+static void _tm_file_path(char *path, size_t len, uint16_t fileid, const char *ext)
+{
+    snprintf(path, len, TM_FILE_DIR "%u.%s", fileid, ext);
+}
+
+static void _tm_file_save(tm_file_recv_t *file)
+{
+    char path[64];
+    _tm_file_path(path, sizeof(path), file->state.fileid, "part");
+    FILE *fptr = fopen(path, "wb");
+    if(fptr == NULL)
+    {
+        LOGE(tag, "Error saving file state %s", path);
+        return;
+    }
+    fwrite(&file->state, sizeof(file->state), 1, fptr);
+    fwrite(file->bitmap, 1, (file->state.total + 7)/8, fptr);
+    fclose(fptr);
+    if(file->fptr != NULL)
+        fflush(file->fptr);
+}
+
+static void _tm_file_close(tm_file_recv_t *file, int save)
+{
+    if(file->bitmap == NULL)
+        return;
+    if(save)
+        _tm_file_save(file);
+    if(file->fptr != NULL)
+        fclose(file->fptr);
+    sch_free(file->bitmap);
+    memset(file, 0, sizeof(tm_file_recv_t));
+}
+
+/**
+ * Get the state of a file being received. Resumes the transfer from its saved
+ * state or starts a new one, reusing the oldest slot if all are in use.
+ * @param fileid File id
+ * @param total Total data frames, 0 to only resume a saved transfer
+ * @param node Sender node
+ * @return File state, NULL if the file can not be created
+ */
+static tm_file_recv_t *_tm_file_get(uint16_t fileid, uint16_t total, uint8_t node)
+{
+    int i;
+    tm_file_recv_t *file = NULL;
+    for(i = 0; i < TM_FILE_RECV_MAX; i++)
+    {
+        tm_file_recv_t *slot = &tm_files[i];
+        if(slot->bitmap != NULL && slot->state.fileid == fileid)
+        {
+            if(total == 0 || slot->state.total == total)
+            {
+                slot->used = osTaskGetTickCount();
+                return slot;
+            }
+            // Other file with the same id, start again
+            _tm_file_close(slot, 0);
         }
+        if(file == NULL || (file->bitmap != NULL && (slot->bitmap == NULL ||
+           (portTick)(osTaskGetTickCount() - slot->used) > (portTick)(osTaskGetTickCount() - file->used))))
+            file = slot;
+    }
+    _tm_file_close(file, 1);
+    mkdir(TM_FILE_DIR, 0775);
+
+    // Resume a saved transfer
+    char path[64];
+    _tm_file_path(path, sizeof(path), fileid, "part");
+    FILE *fptr = fopen(path, "rb");
+    if(fptr != NULL)
+    {
+        if(fread(&file->state, sizeof(file->state), 1, fptr) == 1 && file->state.fileid == fileid &&
+           (total == 0 || file->state.total == total))
+        {
+            file->bitmap = sch_calloc(MEM_TM, (file->state.total + 7)/8 + 1, 1);
+            if(file->bitmap != NULL)
+                fread(file->bitmap, 1, (file->state.total + 7)/8, fptr);
+        }
+        fclose(fptr);
+    }
+    if(file->bitmap == NULL)
+    {
+        if(total == 0)
+        {
+            memset(file, 0, sizeof(tm_file_recv_t));
+            return NULL;
+        }
+        memset(&file->state, 0, sizeof(file->state));
+        file->state.fileid = fileid;
+        file->state.total = total;
+        file->state.node = node;
+        file->bitmap = sch_calloc(MEM_TM, (total + 7)/8 + 1, 1);
+        if(file->bitmap == NULL)
+            return NULL;
+    }
+    for(i = 0, file->received = 0; i < file->state.total; i++)
+        file->received += (file->bitmap[i/8] >> (i%8)) & 1;
+
+    _tm_file_path(path, sizeof(path), fileid, "data");
+    file->fptr = fopen(path, "r+b");
+    if(file->fptr == NULL)
+        file->fptr = fopen(path, "w+b");
+    if(file->fptr == NULL)
+    {
+        LOGE(tag, "Error opening file %s", path);
+        sch_free(file->bitmap);
+        memset(file, 0, sizeof(tm_file_recv_t));
+        return NULL;
+    }
+    file->requests = 0;
+    file->used = osTaskGetTickCount();
+    LOGI(tag, "File %d: %d/%d frames received", fileid, file->received, file->state.total);
+    return file;
+}
 
-        int nbytes = COM_FRAME_MAX_LEN;
-        if(type == TM_TYPE_FILE_END)
+/**
+ * List the missing data frames as "0-3,7,9-12" ranges
+ * @return Number of missing frames
+ */
+static int _tm_file_missing(tm_file_recv_t *file, char *parts, size_t len)
+{
+    int i, missing = 0, first = -1;
+    size_t used = 0;
+    parts[0] = '\0';
+    for(i = 0; i <= file->state.total; i++)
+    {
+        int have = i == file->state.total || ((file->bitmap[i/8] >> (i%8)) & 1);
+        if(!have)
         {
-            // Remove file tail
-            int i;
-            for(i=COM_FRAME_MAX_LEN-1; i>0; i--)
-                if(frame->data[i] != 0xAA)
-                    break;
-            nbytes = i+1;
+            missing++;
+            if(first < 0)
+                first = i;
+        }
+        else if(first >= 0)
+        {
+            // Ranges that do not fit are requested in the next round
+            char range[16];
+            int n = first == i-1 ? snprintf(range, sizeof(range), "%s%d", used ? "," : "", first)
+                                 : snprintf(range, sizeof(range), "%s%d-%d", used ? "," : "", first, i-1);
+            if(used + n < len)
+            {
+                strcpy(parts + used, range);
+                used += n;
+            }
+            first = -1;
         }
+    }
+    return missing;
+}
+
+/**
+ * Request the missing frames to the sender (tm_send_file_parts command)
+ */
+static int _tm_file_request(tm_file_recv_t *file)
+{
+    if(!file->state.has_start)
+    {
+        LOGW(tag, "File %d: name unknown, send it again with tm_send_file", file->state.fileid);
+        return CMD_ERROR;
+    }
+
+    char parts[SCH_CMD_MAX_STR_PARAMS/2];
+    int missing = _tm_file_missing(file, parts, sizeof(parts));
+    if(missing == 0)
+        return CMD_OK;
+
+    char cmd_str[SCH_CMD_MAX_STR_PARAMS];
+    int len = snprintf(cmd_str, sizeof(cmd_str), "com_send_cmd %d tm_send_file_parts %s %d %s",
+                       file->state.node, file->state.name, SCH_COMM_ADDRESS, parts);
+    if(len >= sizeof(cmd_str))
+    {
+        LOGE(tag, "File %d: name too long to request frames", file->state.fileid);
+        return CMD_ERROR;
+    }
+    LOGI(tag, "File %d: requesting %d missing frames (%s)", file->state.fileid, missing, parts);
+    cmd_t *cmd = cmd_build_from_str(cmd_str);
+    if(cmd == NULL)
+        return CMD_ERROR;
+    cmd_send(cmd);
+    return CMD_OK;
+}
+
+/**
+ * Rename the file once all the frames and FILE_START are received
+ */
+static void _tm_file_done(tm_file_recv_t *file)
+{
+    if(!file->state.has_start || file->received < file->state.total)
+        return;
+
+    uint16_t fileid = file->state.fileid;
+    const char *bname = strrchr(file->state.name, '/');
+    bname = bname ? bname + 1 : file->state.name;
+    char data_path[64], part_path[64], path[sizeof(TM_FILE_DIR) + 8 + COM_FRAME_MAX_LEN];
+    _tm_file_path(data_path, sizeof(data_path), fileid, "data");
+    _tm_file_path(part_path, sizeof(part_path), fileid, "part");
+    snprintf(path, sizeof(path), TM_FILE_DIR "%u_%s", fileid, bname);
+
+    fflush(file->fptr);
+    if(ftruncate(fileno(file->fptr), file->state.size) != 0)
+        LOGW(tag, "Error truncating file %s", data_path);
+    _tm_file_close(file, 0);
+    if(rename(data_path, path) != 0)
+        LOGE(tag, "Error renaming file %s to %s", data_path, path);
+    remove(part_path);
+    LOGR(tag, "File %d received: %s", fileid, path);
+}
+
+int tm_receive_file_frame(struct com_frame_file *frame, int len)
+{
+    int data_len = len - (int)offsetof(com_frame_file_t, data);
+    if(frame == NULL || data_len < 0)
+        return -1;
+
+    int type = frame->type;
+    int nframe = csp_ntoh16(frame->nframe);
+    uint16_t fileid = csp_ntoh16(frame->fileid);
+    uint16_t total = csp_ntoh16(frame->total);
+    if(type != TM_TYPE_FILE_START && type != TM_TYPE_FILE_DATA && type != TM_TYPE_FILE_END)
+        return -1;
+
+    tm_file_recv_t *file = _tm_file_get(fileid, total, frame->node);
+    if(file == NULL)
+        return -1;
 
-        FILE *fptr;
-        fptr = fopen(fname,"ab");
-        if(fptr == NULL)
+    if(type == TM_TYPE_FILE_START)
+    {
+        // File name and size
+        size_t name_len = strnlen((char *)frame->data, (size_t)data_len);
+        uint32_t size;
+        if(name_len + 1 + sizeof(size) > data_len)
         {
-            LOGE(tag, "Error opening file! %s", fname);
-            return CMD_ERROR;
+            LOGE(tag, "File %d: invalid start frame", fileid);
+            return -1;
+        }
+        memcpy(&size, frame->data + name_len + 1, sizeof(size));
+        memcpy(file->state.name, frame->data, name_len + 1);
+        file->state.size = csp_ntoh32(size);
+        file->state.has_start = 1;
+        file->state.node = frame->node;
+        LOGI(tag, "New file! Id: %d. Frames: %d/%d. Name: %s (%d bytes)", fileid, file->received,
+             total, file->state.name, file->state.size);
+        _tm_file_save(file);
+    }
+    else
+    {
+        // Large frames (SFP) hold consecutive COM_FRAME_MAX_LEN data frames
+        int k, n_frames = data_len > COM_FRAME_MAX_LEN ? (data_len + COM_FRAME_MAX_LEN - 1)/COM_FRAME_MAX_LEN : 1;
+        if(nframe + n_frames > total)
+        {
+            LOGE(tag, "File %d: invalid frame %d/%d", fileid, nframe + n_frames - 1, total);
+            return -1;
         }
+        for(k = 0; k < n_frames; k++, nframe++)
+        {
+            if((file->bitmap[nframe/8] >> (nframe%8)) & 1)
+                continue;
+            int len_k = data_len - k*COM_FRAME_MAX_LEN;
+            if(len_k > COM_FRAME_MAX_LEN)
+                len_k = COM_FRAME_MAX_LEN;
+            fseek(file->fptr, (long)nframe * COM_FRAME_MAX_LEN, SEEK_SET);
+            const uint8_t *data = (const uint8_t *)frame + offsetof(com_frame_file_t, data) + k*COM_FRAME_MAX_LEN;
+            if(fwrite(data, 1, (size_t)len_k, file->fptr) != (size_t)len_k)
+            {
+                LOGE(tag, "File %d: error writing frame %d", fileid, nframe);
+                return -1;
+            }
+            file->bitmap[nframe/8] |= (uint8_t)(1 << (nframe%8));
+            file->received++;
+            file->requests = 0;
+            if(file->received % TM_FILE_SAVE_FRAMES == 0)
+                _tm_file_save(file);
+        }
+        LOGV(tag, "File %d: frame %d/%d", fileid, nframe - 1, total);
+    }
 
-        last_id = frame->fileid;
-        last_frame = frame->nframe;
-        int cur_size = (int)ftell(fptr);
-        int written = fwrite(frame->data, 1, nbytes, fptr);
-        LOGI(tag, "Written %d. Current file size: %d.", written, cur_size);
-        fclose(fptr);
+    if(file->received == file->state.total)
+    {
+        _tm_file_done(file);
+        if(file->bitmap == NULL)
+            return 0;
     }
 
+    // End of a transmission, request the missing frames
     if(type == TM_TYPE_FILE_END)
     {
-        LOGR(tag, "Closing file! Id: %d. Frames: %d/%d. Name: %s", frame->fileid, frame->nframe, frame->total, fname);
-        if(fname != NULL)
-            free(fname);
-        fname = NULL;
-        last_id = 0;
-        last_frame = 0;
+        _tm_file_save(file);
+        if(file->requests++ < TM_FILE_RETRIES)
+            _tm_file_request(file);
+        else
+            LOGW(tag, "File %d: %d frames missing, resume with tm_request_file", fileid,
+                 file->state.total - file->received);
     }
+    return 0;
+}
 
-    return CMD_OK;
+int tm_request_file(char *fmt, char *params, int nparams)
+{
+    unsigned int fileid;
+    if(params == NULL || cmd_scan_params(fmt, params, &fileid) != nparams)
+        return CMD_SYNTAX_ERROR;
+
+    tm_file_recv_t *file = _tm_file_get((uint16_t)fileid, 0, 0);
+    if(file == NULL)
+    {
+        LOGE(tag, "File %d not found", fileid);
+        return CMD_ERROR;
+    }
+    LOGR(tag, "File %d: %d/%d frames received", fileid, file->received, file->state.total);
+    file->requests = 0;
+    return _tm_file_request(file);
+}
+
+int tm_parse_file(char *fmt, char *params, int nparams)
+{
+    if(params == NULL)
+        return CMD_SYNTAX_ERROR;
+
+    // Raw frames, without the packet length, so the data length is the frame
+    // size (the file is truncated to the size in FILE_START)
+    int rc = tm_receive_file_frame((com_frame_file_t *)params, sizeof(com_frame_file_t));
+    return rc == 0 ? CMD_OK : CMD_ERROR;
 }
 #endif
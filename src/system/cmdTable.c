@@ -0,0 +1,478 @@
+/* Generated by src/system/include/cmdtable.py, do not edit. */
+
+#include "cmdTable.h"
+
+#if SCH_CMD_STATIC
+
+#define CMD_TABLE_NONE(name) {0, "", name, NULL, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL}
+
+const cmd_list_t cmd_table[CMD_TABLE_LEN] = {
+#if SCH_ADCS_ENABLED
+    {0, "", "adcs_detumbling_mag", adcs_detumbling_mag, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%lf", "adcs_do_control", adcs_control_torque, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {3, "%d %d %d", "adcs_env_range", adcs_env_range_cmd, CMD_CLASS_CPU, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "adcs_mag", adcs_get_mag, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "adcs_mag_moment", adcs_mag_moment, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "adcs_omega", adcs_get_omega, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "adcs_point", adcs_point, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "adcs_quat", adcs_get_quaternion, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "adcs_send_attitude", adcs_send_attitude, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_HIGH},
+    {6, "%lf %lf %lf %lf %lf %lf", "adcs_set_target", adcs_set_target, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "adcs_set_to_nadir", adcs_target_nadir, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "adcs_sun", adcs_sun, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("adcs_detumbling_mag"),
+    CMD_TABLE_NONE("adcs_do_control"),
+    CMD_TABLE_NONE("adcs_env_range"),
+    CMD_TABLE_NONE("adcs_mag"),
+    CMD_TABLE_NONE("adcs_mag_moment"),
+    CMD_TABLE_NONE("adcs_omega"),
+    CMD_TABLE_NONE("adcs_point"),
+    CMD_TABLE_NONE("adcs_quat"),
+    CMD_TABLE_NONE("adcs_send_attitude"),
+    CMD_TABLE_NONE("adcs_set_target"),
+    CMD_TABLE_NONE("adcs_set_to_nadir"),
+    CMD_TABLE_NONE("adcs_sun"),
+#endif
+#if SCH_COMM_ENABLE
+    {1, "%d", "com_buffer_stats", com_buffer_stats, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("com_buffer_stats"),
+#endif
+#if (SCH_COMM_ENABLE) && (defined(SCH_USE_NANOCOM))
+    {0, "", "com_clear_config", com_clear_config, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("com_clear_config"),
+#endif
+#if SCH_COMM_ENABLE
+    {1, "%d", "com_crc_stats", com_crc_stats, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "com_debug", com_debug, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_HIGH},
+#else
+    CMD_TABLE_NONE("com_crc_stats"),
+    CMD_TABLE_NONE("com_debug"),
+#endif
+#if (SCH_COMM_ENABLE) && (defined(SCH_USE_NANOCOM))
+    {2, "%d %s", "com_get_config", com_get_config, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("com_get_config"),
+#endif
+#if SCH_COMM_ENABLE
+    {0, "", "com_get_link", com_get_link, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "com_get_node", com_get_node, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("com_get_link"),
+    CMD_TABLE_NONE("com_get_node"),
+#endif
+#if (SCH_COMM_ENABLE) && (defined(SCH_USE_NANOCOM))
+    {1, "%d", "com_load_config", com_load_config, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("com_load_config"),
+#endif
+#if SCH_COMM_ENABLE
+    {1, "%d", "com_ping", com_ping, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("com_ping"),
+#endif
+#if (SCH_COMM_ENABLE) && (defined(SCH_USE_NANOCOM))
+    {1, "%d", "com_reset_wdt", com_reset_wdt, CMD_CLASS_EXCLUSIVE, CMD_PRIO_HIGH, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("com_reset_wdt"),
+#endif
+#if SCH_COMM_ENABLE
+    {1, "%d", "com_rpt_stats", com_rpt_stats, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %n", "com_send_cmd", com_send_cmd, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {3, "%d %d %n", "com_send_data", com_send_data, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {3, "%d %d %d", "com_send_prof", com_send_prof, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %s", "com_send_rpt", com_send_rpt, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %n", "com_send_tc", com_send_tc_frame, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {4, "%d %d %u %n", "com_send_tm_ack", com_send_tm_ack, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("com_rpt_stats"),
+    CMD_TABLE_NONE("com_send_cmd"),
+    CMD_TABLE_NONE("com_send_data"),
+    CMD_TABLE_NONE("com_send_prof"),
+    CMD_TABLE_NONE("com_send_rpt"),
+    CMD_TABLE_NONE("com_send_tc"),
+    CMD_TABLE_NONE("com_send_tm_ack"),
+#endif
+#if (SCH_COMM_ENABLE) && (defined(SCH_USE_NANOCOM))
+    {2, "%d %d", "com_set_beacon", com_set_beacon, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {3, "%d %s %s", "com_set_config", com_set_config, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("com_set_beacon"),
+    CMD_TABLE_NONE("com_set_config"),
+#endif
+#if SCH_COMM_ENABLE
+    {4, "%d %d %d %d", "com_set_link", com_set_link, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "com_set_node", com_set_node, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "com_set_time_node", com_set_time_node, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %s", "com_set_tle_node", com_set_tle_node, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("com_set_link"),
+    CMD_TABLE_NONE("com_set_node"),
+    CMD_TABLE_NONE("com_set_time_node"),
+    CMD_TABLE_NONE("com_set_tle_node"),
+#endif
+#if (SCH_COMM_ENABLE) && (SCH_TASK_TRK_ENABLED)
+    {2, "%u %u", "com_track_freq", com_track_freq, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "com_track_status", com_track_status, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("com_track_freq"),
+    CMD_TABLE_NONE("com_track_status"),
+#endif
+#if (SCH_COMM_ENABLE) && (defined(SCH_USE_NANOCOM))
+    {0, "", "com_update_status", com_update_status_vars, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("com_update_status"),
+#endif
+    {1, "%d", "drp_add_hrs_alive", drp_update_hours_alive, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "drp_clear_gnd_wdt", drp_clear_gnd_wdt, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "drp_ebf", drp_execute_before_flight, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {5, "%d %d %d %d %s", "drp_export", drp_export, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%s", "drp_get_var_name", drp_get_sys_var_name, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "drp_print_vars", drp_print_system_vars, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "drp_set_deployed", drp_set_deployed, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %f", "drp_set_var", drp_update_sys_var_idx, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%s %f", "drp_set_var_name", drp_update_sys_var_name, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "drp_sync", drp_sync, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 1, 0, CMD_LOAD_NORMAL},
+    {0, "", "drp_trim", drp_trim, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 1, 0, CMD_LOAD_NORMAL},
+#if defined(SCH_USE_NANOPOWER)
+    {0, "", "eps_get_config", eps_get_config, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "eps_get_hk", eps_get_hk, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "eps_hard_reset", eps_hard_reset, CMD_CLASS_EXCLUSIVE, CMD_PRIO_HIGH, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "eps_reset_wdt", eps_reset_wdt, CMD_CLASS_EXCLUSIVE, CMD_PRIO_HIGH, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %d", "eps_set_heater", eps_set_heater, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "eps_set_mppt", eps_set_pptmode, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %d", "eps_set_output", eps_set_output, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "eps_set_output_all", eps_set_output_all, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "eps_set_vboost", eps_set_vboost, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "eps_update_status", eps_update_status_vars, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("eps_get_config"),
+    CMD_TABLE_NONE("eps_get_hk"),
+    CMD_TABLE_NONE("eps_hard_reset"),
+    CMD_TABLE_NONE("eps_reset_wdt"),
+    CMD_TABLE_NONE("eps_set_heater"),
+    CMD_TABLE_NONE("eps_set_mppt"),
+    CMD_TABLE_NONE("eps_set_output"),
+    CMD_TABLE_NONE("eps_set_output_all"),
+    CMD_TABLE_NONE("eps_set_vboost"),
+    CMD_TABLE_NONE("eps_update_status"),
+#endif
+#if SCH_FP_ENABLED
+    {6, "%d %d %d %d %d %d", "fp_del_cmd", fp_delete, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "fp_del_cmd_unix", fp_delete_unix, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "fp_jitter", fp_jitter, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "fp_reset", fp_reset, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {10, "%d %d %d %d %d %d %d %d %s %n", "fp_set_cmd", fp_set, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {5, "%d %d %d %s %n", "fp_set_cmd_batch", fp_set_batch, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {5, "%d %d %d %s %n", "fp_set_cmd_dt", fp_set_dt, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {5, "%d %d %d %s %n ", "fp_set_cmd_unix", fp_set_unix, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {6, "%d %d %d %d %s %n", "fp_set_cmd_unix_ms", fp_set_unix_ms, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "fp_show", fp_show, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %d", "fp_simulate", fp_simulate, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("fp_del_cmd"),
+    CMD_TABLE_NONE("fp_del_cmd_unix"),
+    CMD_TABLE_NONE("fp_jitter"),
+    CMD_TABLE_NONE("fp_reset"),
+    CMD_TABLE_NONE("fp_set_cmd"),
+    CMD_TABLE_NONE("fp_set_cmd_batch"),
+    CMD_TABLE_NONE("fp_set_cmd_dt"),
+    CMD_TABLE_NONE("fp_set_cmd_unix"),
+    CMD_TABLE_NONE("fp_set_cmd_unix_ms"),
+    CMD_TABLE_NONE("fp_show"),
+    CMD_TABLE_NONE("fp_simulate"),
+#endif
+#if defined(SCH_USE_GSSB)
+    {4, "%d %d %d %d", "gssb_antenna_release", gssb_antenna_release, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "gssb_arm_auto", gssb_interstage_arm, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "gssb_arm_manual", gssb_interstage_state, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "gssb_burn", gssb_interstage_burn, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "gssb_commit_addr", gssb_commit_i2c_addr, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "gssb_fss_commit_config", gssb_sunsensor_conf_save, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "gssb_fss_get_sun", gssb_read_sunsensor, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "gssb_fss_get_sun_all", gssb_read_all_sunsensors_cmd, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "gssb_fss_get_temp", gssb_get_temp, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "gssb_fss_set_config", gssb_sunsensor_conf, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "gssb_get_burn_config", gssb_interstage_get_burn_settings, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "gssb_get_model", gssb_get_model, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "gssb_get_status", gssb_interstage_get_status, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "gssb_get_sun", gssb_common_sun_voltage, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "gssb_get_temp", gssb_interstage_temp, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "gssb_get_temp_int", gssb_internal_temp, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "gssb_get_uuid", gssb_get_uuid, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "gssb_get_version", gssb_get_version, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %d", "gssb_msp_cal_temp", gssb_msp_outside_temp_calibrate, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "gssb_msp_get_temp", gssb_msp_outside_temp, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %d", "gssb_pwr", gssb_pwr, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "gssb_reset", gssb_soft_reset, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%i %i", "gssb_scan", gssb_bus_scan, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%i", "gssb_select", gssb_select_addr, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%i", "gssb_set_addr", gssb_set_i2c_addr, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {7, "%d %d %d %d %d %d %d", "gssb_set_burn_config", gssb_interstage_set_burn_settings, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "gssb_unlock_config", gssb_interstage_settings_unlock, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "gssb_update_status", gssb_update_status, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("gssb_antenna_release"),
+    CMD_TABLE_NONE("gssb_arm_auto"),
+    CMD_TABLE_NONE("gssb_arm_manual"),
+    CMD_TABLE_NONE("gssb_burn"),
+    CMD_TABLE_NONE("gssb_commit_addr"),
+    CMD_TABLE_NONE("gssb_fss_commit_config"),
+    CMD_TABLE_NONE("gssb_fss_get_sun"),
+    CMD_TABLE_NONE("gssb_fss_get_sun_all"),
+    CMD_TABLE_NONE("gssb_fss_get_temp"),
+    CMD_TABLE_NONE("gssb_fss_set_config"),
+    CMD_TABLE_NONE("gssb_get_burn_config"),
+    CMD_TABLE_NONE("gssb_get_model"),
+    CMD_TABLE_NONE("gssb_get_status"),
+    CMD_TABLE_NONE("gssb_get_sun"),
+    CMD_TABLE_NONE("gssb_get_temp"),
+    CMD_TABLE_NONE("gssb_get_temp_int"),
+    CMD_TABLE_NONE("gssb_get_uuid"),
+    CMD_TABLE_NONE("gssb_get_version"),
+    CMD_TABLE_NONE("gssb_msp_cal_temp"),
+    CMD_TABLE_NONE("gssb_msp_get_temp"),
+    CMD_TABLE_NONE("gssb_pwr"),
+    CMD_TABLE_NONE("gssb_reset"),
+    CMD_TABLE_NONE("gssb_scan"),
+    CMD_TABLE_NONE("gssb_select"),
+    CMD_TABLE_NONE("gssb_set_addr"),
+    CMD_TABLE_NONE("gssb_set_burn_config"),
+    CMD_TABLE_NONE("gssb_unlock_config"),
+    CMD_TABLE_NONE("gssb_update_status"),
+#endif
+    {0, "", "help", con_help, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#if (defined(SCH_USE_RW)) && (defined(SCH_USE_ISTAGE2))
+    {1, "%d", "is2_deploy", istage2_deploy_panel, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "is2_get_state", istage2_get_state_panel, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "is2_get_temp", istage2_get_temp, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "is2_set_deploy", istage2_set_deploy, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("is2_deploy"),
+    CMD_TABLE_NONE("is2_get_state"),
+    CMD_TABLE_NONE("is2_get_temp"),
+    CMD_TABLE_NONE("is2_set_deploy"),
+#endif
+    {2, "%d %d", "log_set", con_set_logger, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%s %d", "log_set_tag", con_set_tag_logger, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %d", "mtt_set_duty", obc_set_pwm_duty, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %f", "mtt_set_freq", obc_set_pwm_freq, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "mtt_set_pwr", obc_pwm_pwr, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "obc_cmd_lat", obc_cmd_lat, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "obc_cmd_stats", obc_cmd_stats, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "obc_cmd_trace", obc_cmd_trace, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "obc_debug", obc_debug, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_HIGH},
+    {1, "%d", "obc_eph_update", obc_eph_update, CMD_CLASS_CPU, CMD_PRIO_NORMAL, 1, 0, CMD_LOAD_NORMAL},
+    {0, "", "obc_get_mem", obc_get_os_memory, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "obc_get_pass", obc_get_pass, CMD_CLASS_CPU, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "obc_get_sensors", obc_get_sensors, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "obc_get_time", obc_get_time, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "obc_get_tle", obc_get_tle, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "obc_hk_del", obc_hk_del, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "obc_hk_reset", obc_hk_reset, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {5, "%d %u %u %s %n", "obc_hk_set", obc_hk_set, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "obc_hk_show", obc_hk_show, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "obc_ident", obc_ident, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "obc_lock_stats", obc_lock_stats, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "obc_mem_stats", obc_mem_stats, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "obc_prof", obc_prof, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%ld", "obc_prop_tle", obc_prop_tle, CMD_CLASS_CPU, CMD_PRIO_NORMAL, 1, 0, CMD_LOAD_NORMAL},
+    {3, "%d %d %d", "obc_prop_tle_range", obc_prop_tle_range_cmd, CMD_CLASS_CPU, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "obc_queue_stats", obc_queue_stats, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "obc_reset", obc_reset, CMD_CLASS_EXCLUSIVE, CMD_PRIO_HIGH, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "obc_reset_wdt", obc_reset_wdt, CMD_CLASS_EXCLUSIVE, CMD_PRIO_HIGH, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "obc_set_time", obc_set_time, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %n", "obc_set_tle", obc_set_tle, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%s", "obc_system", obc_system, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "obc_task_stats", obc_task_stats, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "obc_update_status", obc_update_status, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "obc_update_tle", obc_update_tle, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#if defined(SCH_USE_RW)
+    {1, "%d", "rw_get_current", rw_get_current, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "rw_get_speed", rw_get_speed, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %d", "rw_set_speed", rw_set_speed, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {3, "%d %d %d", "rw_set_speed_all", rw_set_speed_all, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("rw_get_current"),
+    CMD_TABLE_NONE("rw_get_speed"),
+    CMD_TABLE_NONE("rw_set_speed"),
+    CMD_TABLE_NONE("rw_set_speed_all"),
+#endif
+#if SCH_SEN_ENABLED
+    {2, "%d %d", "sen_activate", activate_sensor, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "sen_delta_set", delta_set, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "sen_init_dummy", init_dummy_sensor, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {4, "%d %d %d %u", "sen_reduce_set", reduce_set, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {6, "%d %d %f %d %d %d", "sen_reduce_trig", reduce_trig, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {3, "%u %u %d", "sen_set_machine", set_state, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {3, "%u %u %d", "sen_set_machine_ms", set_state_ms, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%u", "sen_take_sample", take_sample, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_HIGH},
+#else
+    CMD_TABLE_NONE("sen_activate"),
+    CMD_TABLE_NONE("sen_delta_set"),
+    CMD_TABLE_NONE("sen_init_dummy"),
+    CMD_TABLE_NONE("sen_reduce_set"),
+    CMD_TABLE_NONE("sen_reduce_trig"),
+    CMD_TABLE_NONE("sen_set_machine"),
+    CMD_TABLE_NONE("sen_set_machine_ms"),
+    CMD_TABLE_NONE("sen_take_sample"),
+#endif
+    {1, "%s", "test", con_debug_msg, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#if SCH_COMM_ENABLE
+    {1, "%d", "tm_bcn_ack", tm_bcn_ack, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%s %f", "tm_bcn_deadband", tm_bcn_deadband, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %d", "tm_bcn_mode", tm_bcn_mode, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {3, "%u %u %u", "tm_dl_ack", tm_dl_ack, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %d", "tm_dl_start", tm_dl_start, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "tm_dl_status", tm_dl_status, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "tm_dl_stop", tm_dl_stop, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %u", "tm_dl_weight", tm_dl_weight, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%u", "tm_get_last", tm_get_last, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%u %u", "tm_get_single", tm_get_single, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "tm_ingest_stats", tm_ingest_stats, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "tm_parse_cmd_catalog", tm_parse_cmd_catalog, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "tm_parse_cmd_lat", tm_parse_cmd_lat, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "tm_parse_cmd_stats", tm_parse_cmd_stats, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("tm_bcn_ack"),
+    CMD_TABLE_NONE("tm_bcn_deadband"),
+    CMD_TABLE_NONE("tm_bcn_mode"),
+    CMD_TABLE_NONE("tm_dl_ack"),
+    CMD_TABLE_NONE("tm_dl_start"),
+    CMD_TABLE_NONE("tm_dl_status"),
+    CMD_TABLE_NONE("tm_dl_stop"),
+    CMD_TABLE_NONE("tm_dl_weight"),
+    CMD_TABLE_NONE("tm_get_last"),
+    CMD_TABLE_NONE("tm_get_single"),
+    CMD_TABLE_NONE("tm_ingest_stats"),
+    CMD_TABLE_NONE("tm_parse_cmd_catalog"),
+    CMD_TABLE_NONE("tm_parse_cmd_lat"),
+    CMD_TABLE_NONE("tm_parse_cmd_stats"),
+#endif
+#if (SCH_COMM_ENABLE) && (defined(LINUX))
+    {0, "", "tm_parse_file", tm_parse_file, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("tm_parse_file"),
+#endif
+#if SCH_COMM_ENABLE
+    {0, "", "tm_parse_fp", tm_parse_fp, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "tm_parse_prof", tm_parse_prof, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "tm_parse_prof_stacks", tm_parse_prof_stacks, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "tm_parse_status", tm_parse_status, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "tm_parse_string", tm_parse_string, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "tm_parse_task_stack", tm_parse_task_stack, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {0, "", "tm_parse_task_stats", tm_parse_task_stats, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("tm_parse_fp"),
+    CMD_TABLE_NONE("tm_parse_prof"),
+    CMD_TABLE_NONE("tm_parse_prof_stacks"),
+    CMD_TABLE_NONE("tm_parse_status"),
+    CMD_TABLE_NONE("tm_parse_string"),
+    CMD_TABLE_NONE("tm_parse_task_stack"),
+    CMD_TABLE_NONE("tm_parse_task_stats"),
+#endif
+#if (SCH_COMM_ENABLE) && (defined(LINUX))
+    {1, "%u", "tm_request_file", tm_request_file, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("tm_request_file"),
+#endif
+#if SCH_COMM_ENABLE
+    {2, "%u %u", "tm_send_all", tm_send_all, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %u", "tm_send_cmd_catalog", tm_send_cmd_catalog, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "tm_send_cmd_lat", tm_send_cmd_lat, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {3, "%d %d %d", "tm_send_cmd_names", tm_send_cmd_names, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "tm_send_cmd_stats", tm_send_cmd_stats, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "tm_send_cmds", tm_send_cmds, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("tm_send_all"),
+    CMD_TABLE_NONE("tm_send_cmd_catalog"),
+    CMD_TABLE_NONE("tm_send_cmd_lat"),
+    CMD_TABLE_NONE("tm_send_cmd_names"),
+    CMD_TABLE_NONE("tm_send_cmd_stats"),
+    CMD_TABLE_NONE("tm_send_cmds"),
+#endif
+#if (SCH_COMM_ENABLE) && (defined(LINUX))
+    {2, "%s %u", "tm_send_file", tm_send_file, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, (10*60*1000), CMD_LOAD_NORMAL},
+    {3, "%s %u %s", "tm_send_file_parts", tm_send_file_parts, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, (10*60*1000), CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("tm_send_file"),
+    CMD_TABLE_NONE("tm_send_file_parts"),
+#endif
+#if SCH_COMM_ENABLE
+    {4, "%d %d %d %d", "tm_send_fp", tm_send_fp, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {3, "%u %u %u", "tm_send_from", tm_send_from, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%u %u", "tm_send_last", tm_send_last, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %d", "tm_send_prof", tm_send_prof, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("tm_send_fp"),
+    CMD_TABLE_NONE("tm_send_from"),
+    CMD_TABLE_NONE("tm_send_last"),
+    CMD_TABLE_NONE("tm_send_prof"),
+#endif
+#if (SCH_COMM_ENABLE) && (defined(LINUX))
+    {3, "%d %d %d", "tm_send_prof_stacks", tm_send_prof_stacks, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, ((SCH_PROF_SAMPLE_MAX_S+60)*1000), CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("tm_send_prof_stacks"),
+#endif
+#if SCH_COMM_ENABLE
+    {4, "%u %u %u %u", "tm_send_range_time", tm_send_range_time, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "tm_send_status", tm_send_status, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_OVERLOAD},
+    {1, "%d", "tm_send_task_stack", tm_send_task_stack, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {1, "%d", "tm_send_task_stats", tm_send_task_stats, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %s", "tm_send_var", tm_send_var, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%d %n", "tm_send_vars", tm_send_vars, CMD_CLASS_SHARED_IO, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+    {2, "%u %u", "tm_set_ack", tm_set_ack, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL},
+#else
+    CMD_TABLE_NONE("tm_send_range_time"),
+    CMD_TABLE_NONE("tm_send_status"),
+    CMD_TABLE_NONE("tm_send_task_stack"),
+    CMD_TABLE_NONE("tm_send_task_stats"),
+    CMD_TABLE_NONE("tm_send_var"),
+    CMD_TABLE_NONE("tm_send_vars"),
+    CMD_TABLE_NONE("tm_set_ack"),
+#endif
+};
+
+const int16_t cmd_table_disp[CMD_TABLE_LEN] = {
+    -193, -191, 0, 0, 1, 2, 0, -186, -183, 0, -180, 0,
+    1, -179, -178, 0, 0, 0, 0, 1, -177, -176, 0, 0,
+    2, -168, 0, 0, -166, 3, -164, 0, 0, 0, 2, -163,
+    -162, 1, -160, 4, 0, -158, -157, 4, 1, -156, 2, -152,
+    -143, 1, 1, -140, -139, 0, 2, -137, 0, 4, -135, -129,
+    0, -127, 0, -126, -124, 0, 0, -122, 0, 1, 8, -117,
+    1, -114, 0, 0, -113, 0, 1, -112, 0, 0, -110, -109,
+    0, -107, 0, 3, 2, 5, 0, 0, 0, 0, 0, 0,
+    -106, -105, 0, -103, -101, -97, -96, -95, 4, -91, 0, 0,
+    -90, 0, -89, 0, -85, -79, -78, -76, 1, 0, -72, 2,
+    -70, -69, 0, 9, 0, 0, -68, 1, 1, 4, 3, -62,
+    -60, 0, -59, 1, 0, -56, -54, 0, -53, 1, 1, 0,
+    -52, 0, 1, 6, -51, 0, 3, 0, 1, -49, -48, -47,
+    -43, -41, 9, 0, 1, 2, -39, -35, -34, -33, -31, 0,
+    0, 0, -30, -22, 1, 3, -18, 1, 5, 0, -17, 1,
+    0, 0, 1, -16, 4, -13, -10, -9, -8, -7, 2, 0,
+    0,
+};
+
+const int16_t cmd_table_slot[CMD_TABLE_LEN] = {
+    153, 78, 43, 26, 89, 188, 50, 47, 148, 114, 77, 133,
+    93, 87, 42, 102, 176, 173, 122, 7, 165, 141, 183, 9,
+    60, 11, 159, 21, 166, 30, 154, 24, 76, 52, 46, 107,
+    51, 36, 14, 13, 41, 134, 16, 189, 150, 22, 112, 124,
+    28, 152, 97, 161, 164, 125, 1, 34, 10, 98, 82, 67,
+    38, 91, 55, 109, 170, 126, 45, 27, 106, 178, 54, 116,
+    149, 39, 6, 181, 191, 129, 99, 187, 58, 25, 31, 113,
+    190, 138, 192, 37, 143, 168, 184, 155, 5, 79, 128, 56,
+    171, 131, 177, 72, 123, 186, 90, 8, 163, 0, 167, 95,
+    18, 130, 15, 132, 63, 185, 19, 64, 32, 151, 156, 120,
+    135, 137, 2, 3, 29, 96, 118, 115, 75, 81, 35, 48,
+    110, 86, 160, 23, 111, 68, 66, 136, 121, 180, 103, 33,
+    20, 83, 12, 146, 4, 175, 158, 17, 144, 62, 174, 162,
+    49, 71, 140, 104, 182, 142, 145, 53, 70, 108, 157, 80,
+    101, 105, 179, 100, 139, 59, 119, 172, 73, 169, 65, 84,
+    61, 127, 94, 57, 44, 92, 40, 147, 85, 117, 74, 69,
+    88,
+};
+
+#endif //SCH_CMD_STATIC
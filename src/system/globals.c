@@ -21,8 +21,10 @@
 
 osQueue dispatcher_queue;         ///< Commands queue
 osQueue executer_cmd_queue;       ///< Executer commands queue
-osQueue executer_stat_queue;      ///< Executer result queue
-osSemaphore repo_data_sem;        ///< Data repository mutex
+osQueue executer_io_queue;        ///< Executer shared-io workers commands queue
+osQueue executer_cpu_queue;       ///< Executer cpu workers commands queue
+osSemaphore executer_stat_sem;    ///< Executer results counters mutex
+osRWLock repo_data_sem;           ///< Data repository lock
 osSemaphore repo_data_fp_sem;     ///< Flight plan repository mutex
 osSemaphore repo_machine_sem;     ///< State status_machine repository mutex
-osSemaphore repo_cmd_sem;         ///< Command repository mutex
+osRWLock repo_cmd_sem;            ///< Command repository lock, read-mostly
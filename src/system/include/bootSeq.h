@@ -0,0 +1,56 @@
+/**
+ * @file  bootSeq.h
+ * @author Carlos Gonzalez C - carlgonz@uchile.cl
+ * @date 2020
+ * @copyright GNU GPL v3
+ *
+ * Boot sequence helpers. The boot is described as a table of init steps and
+ * their dependencies, steps with no pending dependencies run in parallel
+ * threads (Linux only, @see SCH_BOOT_PARALLEL) and the rest in order. The
+ * time of each step is recorded and can be reported with boot_print_times.
+ */
+
+#ifndef SUCHAI_FLIGHT_SOFTWARE_BOOTSEQ_H
+#define SUCHAI_FLIGHT_SOFTWARE_BOOTSEQ_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "log_utils.h"
+#include "osDelay.h"
+
+#define BOOT_MAX_STEPS  (16)    ///< Max number of steps recorded for the boot times report
+#define BOOT_DEP(i)     (1U<<(i))   ///< Dependency mask of step @i (index in the steps table)
+
+/**
+ * Boot step
+ */
+typedef struct boot_step {
+    const char *name;       ///< Step name, for the boot times report
+    int (*init)(void);      ///< Init function, returns 0 if OK
+    uint32_t deps;          ///< Steps that must finish first, BOOT_DEP of their index in the table
+} boot_step_t;
+
+/**
+ * Run the boot steps. Each wave runs every step whose dependencies are done,
+ * in parallel threads if SCH_BOOT_PARALLEL is set, then waits for them.
+ * @param steps Steps table, at most 32 steps
+ * @param n Number of steps
+ * @return Number of steps that failed, or -1 if the dependencies can not be
+ * satisfied (the remaining steps are not run)
+ */
+int boot_run(const boot_step_t *steps, int n);
+
+/**
+ * Time since the first boot time query, the boot start
+ * @return Time in microseconds
+ */
+uint32_t boot_time_us(void);
+
+/**
+ * Log the start and duration of every boot step run so far, and the boot
+ * time up to now
+ */
+void boot_print_times(void);
+
+#endif //SUCHAI_FLIGHT_SOFTWARE_BOOTSEQ_H
@@ -24,14 +24,252 @@
 #include "repoData.h"
 #include "repoCommand.h"
 #include "cmdCOM.h"
+#include "cmdOBC.h"
 #include "math_utils.h"
 #include "log_utils.h"
 
+/**
+ * ADCS state. The shared copy is a state block in memory at full precision
+ * (@see adcs_state_load, adcs_state_store), the status variables only mirror
+ * it for telemetry. taskADCS keeps its own copy and stores it every cycle.
+ */
+typedef struct adcs_state {
+    quaternion_t q_est;     ///< Attitude quaternion (Inertial to body)
+    quaternion_t q_tgt;     ///< Target quaternion (Inertial to body)
+    vector3_t omega_est;    ///< Gyroscope, body frame
+    vector3_t omega_tgt;    ///< Target angular velocity, body frame
+    vector3_t mag_est;      ///< Magnetometer, body frame [nT]
+    vector3_t pos_i;        ///< Satellite orbit position (ECI) [km]
+    vector3_t torque;       ///< Last control torque
+    vector3_t mag_moment;   ///< Last control magnetic moment
+    vector3_t rw_speed;     ///< Reaction wheels speed, updated by taskADCS
+    vector3_t rw_current;   ///< Reaction wheels current [mA], updated by taskADCS
+    int tle_last;           ///< Last time position was propagated
+    int mode;               ///< OBC operation mode (dat_obc_opmode)
+} adcs_state_t;
+
+/**
+ * Controller context, the constants of adcs_calc_torque and
+ * adcs_calc_mag_moment. The gains and the inertia are diagonal, so they are
+ * kept as vectors and a control step is a few element-wise products. Built
+ * by adcs_ctrl_update for an operation mode.
+ */
+typedef struct adcs_ctrl {
+    vector3_t p_quat;       ///< Attitude proportional gain
+    vector3_t i_quat;       ///< Attitude integral gain
+    vector3_t p_omega;      ///< Angular velocity proportional gain
+    vector3_t inertia_neg;  ///< Minus the inertia, detumbling torque [kg m2]
+    vector3_t max_mag;      ///< Magnetorquers max. moment, scaled to nT [Am2 T/nT]
+    vector3_t rw_lower_limit; ///< Magnetorquers act on the axes slower than this
+    real_t inv_nT2T;        ///< 1/(nT to T)
+    int mag_all_axes;       ///< Magnetorquers act on all axes (detumbling)
+    int mode;               ///< Operation mode of the context
+    int ok;                 ///< The context is built
+} adcs_ctrl_t;
+
+#define ADCS_SUNLIT     0   ///< The sun is fully visible
+#define ADCS_PENUMBRA   1   ///< The sun is partially hidden by the Earth
+#define ADCS_UMBRA      2   ///< The sun is hidden by the Earth
+
+/**
+ * Sun and eclipse model. The sun ephemeris is cached and only recomputed every
+ * SCH_ADCS_SUN_EPH_S, the eclipse is computed from the cached ephemeris.
+ */
+typedef struct adcs_sun {
+    vector3_t sun_i;        ///< Sun direction, inertial frame
+    double r_sun;           ///< Sun distance [km]
+    int eph_time;           ///< Time of the sun ephemeris, 0 if not computed
+    int eclipse;            ///< ADCS_SUNLIT, ADCS_PENUMBRA or ADCS_UMBRA
+    real_t sunlit;          ///< Visible fraction of the solar disk
+} adcs_sun_t;
+
 /**
  * Register ADCS commands
  */
 void cmd_adcs_init(void);
 
+/**
+ * Copy the ADCS state block, never waits for a writer. Until the block is
+ * stored for the first time the state is loaded from the status variables.
+ * The mode is read from dat_obc_opmode.
+ * @param st State to fill
+ */
+void adcs_state_load(adcs_state_t *st);
+
+/**
+ * Store the ADCS state block. The status variables are not updated, @see
+ * adcs_state_publish.
+ * @param st State
+ */
+void adcs_state_store(const adcs_state_t *st);
+
+/**
+ * Mirror the ADCS state in the status variables, for telemetry. The values
+ * are narrowed to float and the TLE epoch is not written.
+ * @param st State
+ */
+void adcs_state_publish(const adcs_state_t *st);
+
+/**
+ * Sun direction and distance from a low precision solar ephemeris
+ * @param jd Julian day
+ * @param sun_dir Sun direction, inertial frame
+ * @return Sun distance [km]
+ */
+double calc_sun_pos_i(double jd, vector3_t * sun_dir);
+
+/**
+ * Update the sun model at time @ts. The sun ephemeris is recomputed if it is
+ * older than SCH_ADCS_SUN_EPH_S, the eclipse uses a conical Earth shadow.
+ * @param sun Sun model, updated
+ * @param ts Unix time
+ * @param pos_i Satellite orbit position (ECI) [km]
+ * @return 0 if OK, -1 if the position is not valid (the eclipse is not updated)
+ */
+int adcs_sun_update(adcs_sun_t *sun, int ts, const vector3_t *pos_i);
+
+/**
+ * Store the sun model in the status variables (dat_ads_sun_x to dat_ads_sunlit)
+ * @param sun Sun model
+ */
+void adcs_sun_publish(const adcs_sun_t *sun);
+
+/**
+ * Magnetic field and sun direction along an orbit, struct of arrays
+ * (@see adcs_env_range)
+ */
+typedef struct adcs_env_array {
+    int n;                  ///< Number of points
+    int *ts;                ///< Unix timestamps
+    double *lat, *lon;      ///< Geodetic latitude and longitude [rad]
+    double *alt;            ///< Altitude above the WGS84 ellipsoid [m]
+    double *mag_n, *mag_e, *mag_d;  ///< Magnetic field, North, East and Down [nT]
+    double *sun_x, *sun_y, *sun_z;  ///< Sun direction, inertial frame
+} adcs_env_array_t;
+
+/**
+ * Allocate the arrays of @env for @n points, in one block
+ * @return 0 if OK, -1 on error
+ */
+int adcs_env_array_alloc(adcs_env_array_t *env, int n);
+
+/**
+ * Free the arrays allocated by adcs_env_array_alloc
+ */
+void adcs_env_array_free(adcs_env_array_t *env);
+
+/**
+ * Evaluate the IGRF model and the sun ephemeris at every point of @env, for
+ * ground planning. Linux builds split the points across SCH_ADCS_ENV_THREADS
+ * threads, each one evaluates its own IGRF model. As in IgrfCalc, the model
+ * coefficients are refreshed once per day of the points dates.
+ *
+ * @param env Points, @env->ts, lat, lon, alt and n are inputs
+ */
+void adcs_env_range(adcs_env_array_t *env);
+
+/**
+ * Propagate the TLE to a range of datetimes and log the magnetic field and
+ * the sun direction as "<timestamp>,<lat>,<lon>,<alt>,<mag_n>,<mag_e>,<mag_d>,
+ * <sun_x>,<sun_y>,<sun_z>" lines (@see adcs_env_range). States with
+ * propagation errors are skipped.
+ *
+ * @param fmt Str. Parameters format "%d %d %d"
+ * @param params Str. Parameters as string "<start> <step> <n>", start 0 for
+ * the current datetime, step in seconds
+ * @param nparams Int. Number of parameters 3
+ * @return CMD_OK if executed correctly, CMD_ERROR if any propagation failed,
+ * CMD_SYNTAX_ERROR in case of parameters errors
+ *
+ * @code
+ * adcs_env_range 0 60 90
+ * @endcode
+ */
+int adcs_env_range_cmd(char *fmt, char *params, int nparams);
+
+/**
+ * Read current spacecraft quaternion from the ADCS/STT
+ * @param q Quaternion, not modified on errors
+ * @return 0 if OK, -1 on errors
+ */
+int adcs_read_quaternion(quaternion_t *q);
+
+/**
+ * Read gyroscopes. Without sensors @omega is not modified.
+ * @param omega Angular velocity, body frame
+ * @return 0 if OK, -1 on errors
+ */
+int adcs_read_omega(vector3_t *omega);
+
+/**
+ * Read magnetic sensors. Without sensors @mag is not modified.
+ * @param mag Magnetic field, body frame
+ * @return 0 if OK, -1 on errors
+ */
+int adcs_read_mag(vector3_t *mag);
+
+/**
+ * Calculate the target attitude to point the Z+ face to a vector
+ * @param st State, updates q_tgt and omega_tgt
+ * @param i_tar Target vector, inertial frame
+ * @param omega_tar Target angular velocity, body frame
+ */
+void adcs_calc_target(adcs_state_t *st, vector3_t i_tar, vector3_t omega_tar);
+
+/**
+ * Calculate the target attitude to point to Nadir
+ * @param st State, updates q_tgt and omega_tgt
+ */
+void adcs_calc_nadir(adcs_state_t *st);
+
+/**
+ * Calculate the detumbling target, Nadir with zero angular velocity
+ * @param st State, updates q_tgt and omega_tgt
+ */
+void adcs_calc_detumbling(adcs_state_t *st);
+
+/**
+ * Build the controller context for an operation mode, if it was not built
+ * for @mode yet. Cheap to call every control cycle.
+ * @param ctrl Controller context
+ * @param mode OBC operation mode (dat_obc_opmode)
+ */
+void adcs_ctrl_update(adcs_ctrl_t *ctrl, int mode);
+
+/**
+ * Calculate the control torque to reach the target attitude
+ * @param st State, updates torque
+ * @param ctrl Controller context
+ * @param ctrl_cycle Control cycle
+ */
+void adcs_calc_torque(adcs_state_t *st, const adcs_ctrl_t *ctrl, real_t ctrl_cycle);
+
+/**
+ * Calculate the magnetorquers moment to reach the target angular velocity
+ * @param st State, updates mag_moment
+ * @param ctrl Controller context
+ */
+void adcs_calc_mag_moment(adcs_state_t *st, const adcs_ctrl_t *ctrl);
+
+/**
+ * Send "adcs_set_torque <x> <y> <z>" to the ADCS system
+ * @return 0 if OK, -1 on errors
+ */
+int adcs_send_torque(const vector3_t *torque);
+
+/**
+ * Set the magnetorquers duty cycle and send "adcs_set_mag_moment <x> <y> <z>"
+ * to the ADCS system
+ * @return 0 if OK, -1 on errors
+ */
+int adcs_send_mag_moment(const vector3_t *mag_moment);
+
+/**
+ * Send "adcs_set_attitude <q_est> <q_tgt>" to the ADCS system
+ * @return 0 if OK, -1 on errors
+ */
+int adcs_send_attitude_q(const quaternion_t *q_est, const quaternion_t *q_tgt);
+
 /**
  * Send "adcs_point_to <x> <y> <z>" command to the ADCS system with current
  * position vector.
@@ -116,6 +354,16 @@ int adcs_target_nadir(char* fmt, char* params, int nparams);
  */
 int adcs_detumbling_mag(char* fmt, char* params, int nparams);
 
+/**
+ * Update the sun direction and eclipse status variables from the current time
+ * and orbit position. The sun ephemeris is cached between calls.
+ * @param fmt ""
+ * @param params ""
+ * @param nparams 0
+ * @return CMD_OK | CMD_ERROR | CMD_ERROR_SYNTAX
+ */
+int adcs_sun(char* fmt, char* params, int nparams);
+
 /**
  * Send current attitude variables to ADCS system. For testing purposes.
  * @param fmt ""
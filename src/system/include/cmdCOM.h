@@ -11,6 +11,7 @@
 #define CMD_COM_H
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdint.h>
 #include <limits.h>
@@ -18,6 +19,7 @@
 #include "config.h"
 
 #include "drivers.h"
+#include "crc_utils.h"
 #include "repoCommand.h"
 #include "cmdTM.h"
 
@@ -31,6 +33,50 @@
  */
 #define COM_FRAME_MAX_LEN (200 - 2*sizeof(uint16_t) - sizeof(uint32_t))
 
+/**
+ * Reply codes of the TC and CMD ports, sent once the commands are done or
+ * after SCH_COM_TC_WAIT_MS (@see taskCommunications)
+ */
+#define COM_ACK_OK        (200)  ///< All commands executed successfully
+#define COM_ACK_ACCEPTED  (202)  ///< Commands queued, not done before the timeout
+#define COM_ACK_ERROR     (250)  ///< A command failed, or was not parsed or admitted
+
+/**
+ * Byte order of the TM frames data. The header is always in network order,
+ * the data words are in network order unless the frame number has the
+ * COM_FRAME_LE flag. With SCH_COM_NATIVE_ORDER little-endian nodes send their
+ * data in host order with the flag, so only a big-endian peer swaps it (@see
+ * com_tm_hton32 and com_frame_ntoh32).
+ */
+#define COM_FRAME_LE (0x8000)   ///< nframe flag, the frame data words are little-endian
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define COM_HOST_LE (1)
+#else
+#define COM_HOST_LE (0)         ///< Big-endian host, or a compiler without __BYTE_ORDER__ (AVR32)
+#endif
+#if SCH_COM_NATIVE_ORDER && COM_HOST_LE
+#define COM_FRAME_ORDER COM_FRAME_LE
+#else
+#define COM_FRAME_ORDER (0)     ///< Byte order flag of the frames sent by this node
+#endif
+
+/**
+ * Integrity of the TM frames. With SCH_COM_FRAME_CRC the frames sent by this
+ * node carry the CRC32C of the frame after the data, flagged with
+ * COM_FRAME_CRC in the frame number (@see com_frame_seal). Received frames
+ * with the flag are checked whatever the setting of this node, corrupted
+ * frames are dropped (@see com_frame_check).
+ */
+#define COM_FRAME_CRC (0x4000)          ///< nframe flag, a CRC32C follows the frame data
+#define COM_FRAME_CRC_LEN (sizeof(uint32_t))
+#define COM_FRAME_NUM_MASK (0x3FFF)     ///< nframe bits of the frame number, below the flags
+
+/**
+ * Frame number field, in network order and with the byte order flag of the
+ * frames sent by this node. Frame numbers wrap at COM_FRAME_NUM_MASK.
+ */
+#define com_frame_hton_nframe(n) csp_hton16((uint16_t)(((n) & COM_FRAME_NUM_MASK) | COM_FRAME_ORDER))
+
 /**
  * A CSP frame structure. It contains data buffer and information about the data
  * such as the frame number, the telemetry type and the number of data samples
@@ -78,6 +124,48 @@ typedef struct __attribute__((__packed__)) com_data{
     com_frame_t frame;
 }com_data_t;
 
+/**
+ * Telemetry acknowledgement frame, sent by the ground station to
+ * SCH_TRX_PORT_ACK (@see com_send_tm_ack, dl_ack_rle). It is a run-length
+ * encoded list of the samples of a payload: runs alternate received and
+ * missing samples, starting with received samples at @base. Fields are in network
+ * order, the frame is sent up to the last run.
+ */
+#define COM_ACK_MAX_RUNS ((COM_FRAME_MAX_LEN - sizeof(uint32_t) - 2)/sizeof(uint16_t))
+#define COM_ACK_HEADER_LEN (sizeof(uint32_t) + 2)
+typedef struct __attribute__((__packed__)) com_ack_frame{
+    uint8_t payload;                    ///< Payload id
+    uint8_t n_runs;                     ///< Number of runs
+    uint32_t base;                      ///< First sample of the first run
+    uint16_t runs[COM_ACK_MAX_RUNS];    ///< Samples of each run, received and missing alternately
+}com_ack_frame_t;
+
+/**
+ * CSP buffer pool counters, @see com_buffer_get_stats
+ */
+typedef struct com_buffer_stats {
+    uint32_t size;          ///< Pool size, SCH_BUFFERS_CSP buffers
+    uint32_t free;          ///< Free buffers now
+    uint32_t min_free;      ///< Low-water mark, min free buffers seen by com_buffer_get
+    uint32_t gets;          ///< Buffers taken with com_buffer_get
+    uint32_t fails;         ///< com_buffer_get calls without a free buffer
+    uint32_t reserved;      ///< Packets not sent to keep the SCH_COM_ACK_BUFFERS replies buffers
+} com_buffer_stats_t;
+
+#define COM_LINK_MTU_MAX (64*COM_FRAME_MAX_LEN)                 ///< Max. file frames data length of a link
+#define COM_SFP_MTU (SCH_BUFF_MAX_LEN - 2*sizeof(uint32_t))     ///< SFP fragment data length, a CSP buffer without the SFP header
+
+/**
+ * Transfer mode of the connections to a node, @see com_link_set. The default
+ * link (SCH_COM_LINK_*) applies to the nodes without their own.
+ */
+typedef struct com_link {
+    int node;               ///< Node, -1 for the default link
+    int rdp;                ///< Connect with CSP RDP (0 | 1)
+    int window;             ///< RDP window, packets sent before waiting for an ack
+    int mtu;                ///< File frames data length, frames larger than COM_FRAME_MAX_LEN are sent with SFP
+} com_link_t;
+
 /**
  * Registers communications commands in the system
  */
@@ -147,6 +235,34 @@ int com_send_cmd(char *fmt, char *param, int nparams);
  */
 int com_send_tc_frame(char *fmt, char *params, int nparams);
 
+/**
+ * Request a sampling profiler session to a node (Linux), through the
+ * SCH_TRX_PORT_PROF port. The node samples the stacks of its tasks for
+ * @seconds and sends the histogram back as TM_TYPE_PROF_STACKS telemetry
+ * (@see tm_send_prof_stacks, tm_parse_prof_stacks).
+ *
+ * @param fmt Str. Parameters format "%d %d %d"
+ * @param param Str. Parameters as string: "<node> <rate> <seconds>". Ex: "1 50 10"
+ * @param nparams Int. Number of parameters 3
+ * @return CMD_OK if the session was started or CMD_ERROR in case of errors
+ */
+int com_send_prof(char *fmt, char *param, int nparams);
+
+/**
+ * Acknowledge the payload samples received from a node (@see taskDownlink),
+ * through the SCH_TRX_PORT_ACK port. The runs alternate received and missing
+ * samples, starting with received samples at @base, and are sent in one
+ * com_ack_frame_t, up to COM_ACK_MAX_RUNS runs of 65535 samples.
+ *
+ * @param fmt Str. Parameters format "%d %d %u %n"
+ * @param param Str. Parameters as string: "<node> <payload> <base> <runs...>".
+ * Ex: "1 2 100 40 5 20" acknowledges samples [100, 140) and [145, 165) of
+ * payload 2, and reports [140, 145) lost
+ * @param nparams Int. Number of parameters 4
+ * @return CMD_OK if the node received the acks, CMD_ERROR in case of errors
+ */
+int com_send_tm_ack(char *fmt, char *param, int nparams);
+
 /**
  * Sends telemetry data using CSP. Data is received in @params as binary, packed
  * in a @com_data_t structure that contains the destination node and the data.
@@ -189,7 +305,17 @@ int com_send_telemetry(int node, int port, int type, void *data, size_t n_bytes,
 int com_send_debug(int node, char *data, size_t len);
 
 /**
- * Split and send a file using CSP packets
+ * Split and send a file using CSP packets to the SCH_TRX_PORT_FILE port.
+ *
+ * The file is sent as a FILE_START frame, with the file name and size, and
+ * COM_FRAME_MAX_LEN bytes data frames. Data frame @nframe holds the bytes at
+ * offset nframe*COM_FRAME_MAX_LEN; the last frame sent is a FILE_END frame.
+ * All frames carry the file id (@see com_file_id) and the total number of
+ * data frames, so the receiver keeps track of each file and requests the
+ * missing frames with com_send_file_parts (tm_send_file_parts). Links with a
+ * large MTU (@see com_link_set) send consecutive data frames together, as one
+ * frame fragmented with SFP.
+ *
  * @param node Destination node
  * @param name File name
  * @param data File data
@@ -198,6 +324,122 @@ int com_send_debug(int node, char *data, size_t len);
  */
 int com_send_file(int node, char *name, void *data, size_t n_bytes);
 
+/**
+ * Send the FILE_START frame and only the listed data frames of a file
+ * (@see com_send_file)
+ * @param node Destination node
+ * @param name File name
+ * @param data File data
+ * @param n_bytes File size in bytes
+ * @param parts Frames ranges, as "0-3,7,9-12". NULL to send all the frames
+ * @return CMD_OK | CMD_ERROR
+ */
+int com_send_file_parts(int node, char *name, void *data, size_t n_bytes, const char *parts);
+
+/**
+ * File transfer id, a hash of the file name and size. Sending the same file
+ * again uses the same id, so the receiver resumes the transfer.
+ * @param name File name
+ * @param n_bytes File size in bytes
+ * @return File id
+ */
+uint16_t com_file_id(const char *name, size_t n_bytes);
+
+/**
+ * TX pacer shared by all the telemetry senders, call it before each csp_send.
+ * A token bucket, refilled at SCH_COM_TX_LOAD percent of the com_baud status
+ * variable, lets a burst of SCH_COM_MAX_PACKETS frames go at once and then
+ * paces the packets at the link rate, so fast links do not wait and slow
+ * links are not flooded. Also waits, at most SCH_COM_TX_DELAY_MS, until
+ * SCH_COM_TX_MIN_BUFFERS CSP buffers are free (the radio queue drained).
+ *
+ * @param len Packet length in bytes
+ */
+void com_tx_pace(size_t len);
+
+/**
+ * Get a CSP buffer, keeping the pool counters (@see com_buffer_get_stats).
+ * The last SCH_COM_ACK_BUFFERS free buffers are reserved for the TC replies
+ * (@reply = 1), so a telemetry burst that drains the pool does not leave the
+ * ground without its 200 OK and retrying the TC.
+ *
+ * @param size Data size in bytes
+ * @param reply 1 to use the reserved buffers (command replies), 0 otherwise
+ * @return CSP packet, free it with csp_buffer_free or send it. NULL if the
+ *         pool is empty.
+ */
+csp_packet_t *com_buffer_get(size_t size, int reply);
+
+/**
+ * Append the CRC32C of a TM frame to the packet and set the COM_FRAME_CRC
+ * flag, only with SCH_COM_FRAME_CRC. Call it once the frame is complete, just
+ * before sending it, with the frame header in network order. The frame is
+ * sent without CRC if the CSP buffer has no room for it.
+ *
+ * @param packet Packet with a com_frame_t of packet->length bytes
+ */
+void com_frame_seal(csp_packet_t *packet);
+
+/**
+ * Check and remove the CRC32C of a received TM frame, if the frame has the
+ * COM_FRAME_CRC flag. The flag is cleared and the packet length excludes the
+ * CRC. Frames that fail the check are counted, @see com_frame_crc_errors.
+ *
+ * @param packet Received packet with a com_frame_t, header in network order
+ * @return 0 if OK or the frame has no CRC, -1 if the frame is corrupted
+ */
+int com_frame_check(csp_packet_t *packet);
+
+/**
+ * Get the number of received TM frames that failed the CRC check
+ * @param reset Set to clear the counter
+ * @return Corrupted frames since the last reset
+ */
+uint32_t com_frame_crc_errors(int reset);
+
+/**
+ * Get the CSP buffer pool counters
+ * @param stats Counters copy
+ * @param reset Set to clear the counters, the low-water mark starts again
+ *              from the free buffers now
+ */
+void com_buffer_get_stats(com_buffer_stats_t *stats, int reset);
+
+/**
+ * Open a connection to a node port with the transfer mode of the node link.
+ * RDP links set the RDP window before connecting (RDP options are global in
+ * CSP and read when the connection opens). Without RDP support in CSP the
+ * connection is a plain one.
+ *
+ * @param node Destination node
+ * @param port Destination port
+ * @param timeout Connection timeout in ms
+ * @return Connection, NULL on error
+ */
+csp_conn_t *com_connect(int node, int port, uint32_t timeout);
+
+/**
+ * Set the transfer mode of a node link, replacing its previous mode. Links
+ * with the default mode are removed. At most SCH_COM_LINKS nodes have their
+ * own link.
+ *
+ * @param node Node, -1 to set the default link
+ * @param rdp Connect with CSP RDP (0 | 1)
+ * @param window RDP window [1, CSP_RDP_MAX_WINDOW]
+ * @param mtu File frames data length in bytes, 0 for COM_FRAME_MAX_LEN, up to
+ * COM_LINK_MTU_MAX
+ * @return 0 if OK, -1 on invalid arguments or if the links table is full
+ */
+int com_link_set(int node, int rdp, int window, int mtu);
+
+/**
+ * Get the transfer mode of a node link, or the default one
+ *
+ * @param node Node, -1 for the default link
+ * @param link Link copy
+ */
+void com_link_get(int node, com_link_t *link);
+
 /**
  * Auxiliary function to convert an array of 32bit values to network (big) endian.
  * Applies htonl (csp_hton32) to each element of the array. This function
@@ -220,6 +462,48 @@ void _hton32_buff(uint32_t *buff, int len);
  */
 void _ntoh32_buff(uint32_t *buff, int len);
 
+/**
+ * Convert values from host to the byte order of the TM frames sent by this
+ * node (@see COM_FRAME_ORDER): the host order with SCH_COM_NATIVE_ORDER in
+ * little-endian nodes, otherwise network order.
+ *
+ * @param value Value in host order
+ * @return Value in frame order
+ */
+uint16_t com_tm_hton16(uint16_t value);
+uint32_t com_tm_hton32(uint32_t value);
+
+/**
+ * Convert an array of 32bit values from host to the byte order of the TM
+ * frames sent by this node, in place (@see com_tm_hton32)
+ *
+ * @param buff Pointer to a 32 bit values array
+ * @param len Number of elements in buff
+ */
+void com_tm_hton32_buff(uint32_t *buff, int len);
+
+/**
+ * Convert values of a received TM frame data to host byte order, according to
+ * the COM_FRAME_LE flag of the frame. The frame header must be in host order
+ * (as com_receive_tm leaves it).
+ *
+ * @param frame Received frame
+ * @param value Value in the frame order
+ * @return Value in host order
+ */
+uint16_t com_frame_ntoh16(const com_frame_t *frame, uint16_t value);
+uint32_t com_frame_ntoh32(const com_frame_t *frame, uint32_t value);
+
+/**
+ * Convert an array of 32bit values of a received TM frame data to host byte
+ * order, in place (@see com_frame_ntoh32)
+ *
+ * @param frame Received frame
+ * @param buff Pointer to a 32 bit values array
+ * @param len Number of elements in buff
+ */
+void com_frame_ntoh32_buff(const com_frame_t *frame, uint32_t *buff, int len);
+
 
 /**
  * Show CSP debug information, currently the route table and interfaces
@@ -230,6 +514,66 @@ void _ntoh32_buff(uint32_t *buff, int len);
  */
 int com_debug(char *fmt, char *params, int nparams);
 
+/**
+ * Print the CSP buffer pool counters: free buffers, low-water mark, buffers
+ * taken and allocation failures (@see com_buffer_get). A low-water mark near
+ * zero or failures show the pool (SCH_BUFFERS_CSP) is too small for the
+ * traffic bursts.
+ * @param fmt "%d"
+ * @param params "[reset]", 1 to clear the counters
+ * @param nparams 1
+ * @return CMD_OK or CMD_ERROR_SYNTAX
+ */
+int com_buffer_stats(char *fmt, char *params, int nparams);
+
+/**
+ * Print the failed integrity checks: received TM frames dropped by the CRC32C
+ * check (@see com_frame_check) and payload samples read from the storage that
+ * failed their CRC32C (@see dat_get_payload_crc_errors).
+ * @param fmt "%d"
+ * @param params "[reset]", 1 to clear the counters
+ * @param nparams 1
+ * @return CMD_OK or CMD_ERROR_SYNTAX
+ */
+int com_crc_stats(char *fmt, char *params, int nparams);
+
+/**
+ * Print the repeater counters: packets resent, dropped by the rate limit of
+ * their source or by the queue, and held until the next pass (@see
+ * taskRepeater.h)
+ * @param fmt "%d"
+ * @param params "[reset]", 1 to clear the counters
+ * @param nparams 1
+ * @return CMD_OK or CMD_ERROR_SYNTAX
+ */
+int com_rpt_stats(char *fmt, char *params, int nparams);
+
+/**
+ * Print the ground station tracking state: satellite azimuth, elevation,
+ * range and range rate, and the TRX frequencies corrected by the Doppler
+ * shift (@see taskTracking.h). Ground station builds, SCH_TASK_TRK_ENABLED.
+ * @param fmt "%d"
+ * @param params "[reset]", 1 to clear the counters
+ * @param nparams 1
+ * @return CMD_OK or CMD_ERROR_SYNTAX
+ */
+int com_track_status(char *fmt, char *params, int nparams);
+
+/**
+ * Set the nominal TRX frequencies of the tracked satellite, without Doppler
+ * (@see trk_set_freq). The tracking task sends the corrected frequencies to
+ * the TRX. Ground station builds, SCH_TASK_TRK_ENABLED.
+ * @param fmt "%u %u"
+ * @param params "<rx_freq> <tx_freq>", in Hz
+ * @param nparams 2
+ * @return CMD_OK or CMD_ERROR_SYNTAX
+ *
+ * @code
+ * com_track_freq 437250000 437250000
+ * @endcode
+ */
+int com_track_freq(char *fmt, char *params, int nparams);
+
 /**
  * Set module global variable trx_node. Future command calls will use this node
  *
@@ -268,6 +612,26 @@ int com_set_time_node(char *fmt, char *params, int nparams);
  */
 int com_set_tle_node(char *fmt, char *params, int nparams);
 
+/**
+ * Set the transfer mode of a link (@see com_link_set). The radio links usually
+ * keep the default, testbed links (ZMQ) can use RDP with a large window and
+ * large file frames.
+ * @param fmt "%d %d %d %d"
+ * @param params <node> <rdp> <window> <mtu>, node -1 for the default link
+ * @param nparams 4
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors.
+ */
+int com_set_link(char *fmt, char *params, int nparams);
+
+/**
+ * Print the transfer mode of the links
+ * @param fmt ""
+ * @param params ""
+ * @param nparams 0
+ * @return CMD_OK
+ */
+int com_get_link(char *fmt, char *params, int nparams);
+
 /**
  * Reset the TRX GND Watchdog timer at @node node by sending a CSP command to the
  * AX100_PORT_GNDWDT_RESET (9) port. This command targets the AX100 TRX.
@@ -367,6 +731,30 @@ int com_get_config(char *fmt, char *params, int nparams);
  */
 int com_set_config(char *fmt, char *params, int nparams);
 
+/**
+ * Read all the parameters of a TRX table into the parameters cache, so the
+ * following com_get_config calls do not query the TRX. Values read or set
+ * are cached for SCH_COM_CONFIG_CACHE_S seconds, and com_set_config does not
+ * send values the cache already has.
+ *
+ * @param fmt Str. Parameters format: "%d"
+ * @param params Str. Parameters as string: "<table>"
+ * @param nparams Int. Number of parameters: 1
+ * @return CMD_OK if executed correctly, CMD_ERROR if some parameter failed
+ */
+int com_load_config(char *fmt, char *params, int nparams);
+
+/**
+ * Clear the TRX parameters cache, use it if the TRX was reset or configured
+ * by other node.
+ *
+ * @param fmt Str. Parameters format: ""
+ * @param params Str. Parameters as string: ""
+ * @param nparams Int. Number of parameters: 0
+ * @return CMD_OK
+ */
+int com_clear_config(char *fmt, char *params, int nparams);
+
 /* TODO: Add documentation */
 int com_update_status_vars(char *fmt, char *params, int nparams);
 
@@ -63,5 +63,24 @@ int con_help(char *fmt, char *params, int nparams);
  */
 int con_set_logger(char *fmt, char *params, int nparams);
 
+/**
+ * Set the log verbosity level of one tag (module), until the next log_set
+ *  - tag is a name of log_tag_id_t, as "executer" @see log_get_tag_id
+ *  - level can be 0 to 6 @see log_level_t
+ *
+ * @param fmt Str. Parameters format "%s %d"
+ * @param params Str. Parameters as string "<tag> <level>"
+ * @param nparams Int. Number of parameters 2
+ * @return  CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ *
+ * Example
+ * @code
+ * //Set the log level of the flight plan modules to DEBUG
+ * log_set_tag fp 5
+ * con_set_tag_logger("%s %d", "fp 5", 2);
+ * @endcode
+ */
+int con_set_tag_logger(char *fmt, char *params, int nparams);
+
 
 #endif /* CMD_CONSOLE_H */
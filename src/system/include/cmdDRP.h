@@ -18,6 +18,7 @@
 #include "repoCommand.h"
 
 #define SCH_DRP_MAGIC (1010)    ///< Magic number to execute critical commands
+#define SCH_DRP_EXPORT_MAGIC "SCHCOL1"  ///< Payload export file magic, 8 bytes with the null
 
 /**
  * Register data repository (DRP) commands in the system
@@ -135,6 +136,30 @@ int drp_update_hours_alive(char *fmt, char *params, int nparams);
  */
 int drp_clear_gnd_wdt(char *fmt, char *params, int nparams);
 
+/**
+ * Write back the cached status variables to the storage, @seealso
+ * dat_repo_sync. The housekeeping task executes this command every
+ * SCH_STORAGE_CACHE_SYNC seconds.
+ *
+ * @param fmt Str. Parameters format ""
+ * @param params Str. Parameters as string ""
+ * @param nparams Int. Number of parameters 0
+ * @return  CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int drp_sync(char *fmt, char *params, int nparams);
+
+/**
+ * Delete the oldest payload samples over the retention limits, one step per
+ * payload, @seealso dat_trim_payloads. The housekeeping task executes this
+ * command every SCH_STORAGE_RETAIN_PERIOD seconds.
+ *
+ * @param fmt Str. Parameters format ""
+ * @param params Str. Parameters as string ""
+ * @param nparams Int. Number of parameters 0
+ * @return  CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int drp_trim(char *fmt, char *params, int nparams);
+
 /**
  * Set the variable `dat_dep_deployed` to a given value. This variable is used
  * to determine if the satellite was deployed. If not, then the satellite
@@ -150,4 +175,29 @@ int drp_clear_gnd_wdt(char *fmt, char *params, int nparams);
  */
 int drp_set_deployed(char *fmt, char *params, int nparams);
 
+/**
+ * Export the payload samples of the index range [start, end) to a columnar
+ * binary file, for analysis tools that read one field of many samples. Ground
+ * station nodes tables are exported with node >= 0 (@see
+ * dat_add_payload_samples_node), -1 exports this node tables. With end -1
+ * the range ends at the payload index.
+ *
+ * The samples are read and written in chunks of SCH_DRP_EXPORT_CHUNK, so the
+ * memory used does not depend on the range. File layout, all values in host
+ * byte order:
+ *  - Header: magic SCH_DRP_EXPORT_MAGIC (8 bytes), uint16 payload, uint16
+ *    number of fields, int32 node.
+ *  - Per field (@see dat_payload_schema_t): uint8 type (dat_field_type_t),
+ *    uint8 size, uint8 name length, name (without null).
+ *  - Chunks: uint32 count, uint32 first index, then per field a column of
+ *    count values. Missing samples are exported as zeros.
+ *  - A chunk with count 0 ends the file.
+ *
+ * @param fmt Str. Parameters format "%d %d %d %d %s"
+ * @param params Str. Parameters as string "<payload> <node> <start> <end> <file>"
+ * @param nparams Int. Number of parameters 5
+ * @return  CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int drp_export(char *fmt, char *params, int nparams);
+
 #endif /* CMD_DRP_H */
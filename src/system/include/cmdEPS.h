@@ -22,6 +22,29 @@
  */
 void cmd_eps_init(void);
 
+#ifdef SCH_USE_NANOPOWER
+/**
+ * Get the EPS housekeeping, no older than @max_age_ms. The last sample is
+ * cached, a new one is requested to the EPS only if the cached one is older.
+ * Concurrent callers wait for the same request instead of sending their own.
+ * Thread safe.
+ *
+ * @param hk EPS housekeeping
+ * @param max_age_ms Max. age of the sample in ms, 0 to always request a new one
+ * @return 0 if OK, -1 if the EPS did not answer
+ */
+int eps_hk_get_cached(eps_hk_t *hk, unsigned int max_age_ms);
+
+/**
+ * Update the EPS status variables (dat_eps_vbatt to dat_eps_temp_bat0) in one
+ * write from the EPS housekeeping, no older than @max_age_ms
+ *
+ * @param max_age_ms Max. age of the sample in ms, see eps_hk_get_cached
+ * @return 0 if OK, -1 in case of errors
+ */
+int eps_update_status(unsigned int max_age_ms);
+#endif
+
 /**
  * Send the hard reset command to the EPS
  *
@@ -45,6 +45,19 @@ int fp_set(char *fmt, char *params, int nparams);
  */
 int fp_set_unix(char *fmt, char *params, int nparams);
 
+/**
+ * Add a command to the flight plan by unix time with millisecond resolution.
+ * Entries in the same second are executed in ms order. SQL storages keep one
+ * entry per second, the flash storage ignores the milliseconds.
+ *
+ * @param fmt Str. Parameters format "%d %d %d %d %s %n"
+ * @param params Str. Parameters as string
+ *  "<unixtime> <ms> <executions> <period> <command> [args]", ms in 0-999
+ * @param nparams Int. Number of parameters 6
+ * @return  CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int fp_set_unix_ms(char *fmt, char *params, int nparams);
+
 /**
  * Add a command to the flight plan to be executed <seconds> seconds after
  * current unix time.
@@ -58,7 +71,21 @@ int fp_set_unix(char *fmt, char *params, int nparams);
 int fp_set_dt(char *fmt, char *params, int nparams);
 
 /**
- * Delete a command in the flight plan by the execution time
+ * Add a batch of commands to the flight plan by unix time, in one storage
+ * transaction. Entries are separated by "|" (or new lines) and are all added
+ * or none of them. At most FP_BATCH_MAX entries per batch.
+ *
+ * @param fmt Str. Parameters format of each entry "%d %d %d %s %n"
+ * @param params Str. Parameters as string
+ *  "<unixtime> <executions> <period> <command> [args]|<unixtime> ..."
+ * @param nparams Int. Number of parameters of each entry 5
+ * @return  CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int fp_set_batch(char *fmt, char *params, int nparams);
+
+/**
+ * Delete a command in the flight plan by the execution time, the first one
+ * uploaded if several commands have the same time
  *
  * @param fmt Str. Parameters format "%d %d %d %d %d %d"
  * @param params Str. Parameters as string "<day> <month> <year> <hour> <min> <sec>"
@@ -68,7 +95,8 @@ int fp_set_dt(char *fmt, char *params, int nparams);
 int fp_delete(char* fmt, char* params, int nparams);
 
 /**
- * Delete a command in the flight plan by the execution unix time
+ * Delete a command in the flight plan by the execution unix time, the first
+ * one uploaded if several commands have the same time
  *
  * @param fmt Str. Parameters format "%d"
  * @param params Str. Parameters as string "<unix_time>"
@@ -87,6 +115,34 @@ int fp_delete_unix(char* fmt, char* params, int nparams);
  */
 int fp_show(char* fmt, char* params, int nparams);
 
+/**
+ * Dry-run the flight plan over a time window, without executing any command.
+ * Prints a timeline of the number of commands and the expected executer
+ * occupancy, estimated with the mean execution time of each command (see
+ * obc_cmd_stats). Rows with an occupancy above 100% are marked with "!". The
+ * window is split in up to 60 rows, so windows up to 60 s show the per second
+ * commands density.
+ *
+ * @param fmt Str. Parameters format "%d %d"
+ * @param params Str. Parameters as string "<start> <duration>", start in
+ * unix-time (0 to start now) and duration in seconds
+ * @param nparams Int. Number of parameters 2
+ * @return  CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int fp_simulate(char* fmt, char* params, int nparams);
+
+/**
+ * Show the flight plan execution jitter, the delay between the scheduled time
+ * (unixtime and ms) of the commands and the time they were sent to execution.
+ * Commands sent more than a second late (missed entries) are not counted.
+ *
+ * @param fmt Str. Parameters format "%d"
+ * @param params Str. Parameters as string "[reset]", 1 to reset the statistics
+ * @param nparams Int. Number of parameters 1
+ * @return  CMD_OK if executed correctly
+ */
+int fp_jitter(char* fmt, char* params, int nparams);
+
 /**
  * Reset the current flight plan, in other words, create a new empty flight plan
  *
@@ -17,6 +17,22 @@
 #include "osDelay.h"
 #include "repoCommand.h"
 
+#ifndef SCH_GSSB_SUN_ADDRS
+#define SCH_GSSB_SUN_ADDRS {5}  ///< I2C addresses of the sun sensors read by gssb_read_all_sunsensors
+#endif
+
+#define GSSB_SUN_MAX 8          ///< Max. sun sensors in SCH_GSSB_SUN_ADDRS
+
+/**
+ * One sample of all the sun sensors in SCH_GSSB_SUN_ADDRS
+ */
+typedef struct gssb_sun_sample {
+    int n;                          ///< Number of sun sensors
+    uint8_t addr[GSSB_SUN_MAX];     ///< Sensor I2C address
+    uint8_t ok[GSSB_SUN_MAX];       ///< 1 if the sensor was sampled
+    uint16_t sun[GSSB_SUN_MAX][4];  ///< Sensor four measurements
+} gssb_sun_sample_t;
+
 /**
  * Register GSSB related commands
  */
@@ -50,6 +66,23 @@ int gssb_select_addr(char *fmt, char *params, int nparams);
  */
 int gssb_bus_scan(char *fmt, char *params, int nparams);
 
+/**
+ * Sample the selected sun sensor, takes about 30 ms.
+ * @param sun Sun sensor four measurements
+ * @return 0 if OK, -1 in case of errors
+ */
+int gssb_sample_sunsensor(uint16_t sun[4]);
+
+/**
+ * Sample all the sun sensors in SCH_GSSB_SUN_ADDRS. The conversions of all
+ * sensors are started first, then the results are read after a single wait,
+ * so it takes about 30 ms plus the bus time instead of 30 ms per sensor.
+ * Does not change the selected device.
+ * @param sample All sensors measurements, see gssb_sun_sample_t.ok
+ * @return Number of sensors sampled, -1 if none
+ */
+int gssb_read_all_sunsensors(gssb_sun_sample_t *sample);
+
 /**
  * Read sun sensor.
    Reads the sun sensors four measurements (4 * uint16).
@@ -60,6 +93,17 @@ int gssb_bus_scan(char *fmt, char *params, int nparams);
  */
 int gssb_read_sunsensor(char *fmt, char *params, int nparams);
 
+/**
+ * Read all sun sensors.
+   Reads the four measurements of every sun sensor in SCH_GSSB_SUN_ADDRS, see
+   gssb_read_all_sunsensors.
+ * @param fmt Str. ""
+ * @param param Str. ""
+ * @param nparams Int. Number of parameters 0
+ * @return CMD_OK if at least one sensor was read, CMD_ERROR otherwise
+ */
+int gssb_read_all_sunsensors_cmd(char *fmt, char *params, int nparams);
+
 /**
  * Get sun sensor temperature.
  * @param fmt Str. Parameters format ""
@@ -19,6 +19,8 @@
 #include "config.h"
 
 #include "osDelay.h"
+#include "osThread.h"
+#include "osSemphr.h"
 #include "repoCommand.h"
 #include "repoData.h"
 
@@ -75,7 +77,9 @@ int obc_reset_wdt(char *fmt, char *params, int nparams);
 int obc_reset(char *fmt, char *params, int nparams);
 
 /**
- * Debug system memory
+ * Debug system memory: command pool, tasks stack usage (high-water mark, to
+ * size SCH_TASK_*_STACK) and heap. To downlink the stack usage
+ * @seealso tm_send_task_stack
  * @note: In POSIX just cat /proc/<id>/status file
  *
  * @param fmt Str. Parameters format ""
@@ -85,6 +89,170 @@ int obc_reset(char *fmt, char *params, int nparams);
  */
 int obc_get_os_memory(char *fmt, char *params, int nparams);
 
+/**
+ * Print the commands execution timing statistics: number of executions, min,
+ * mean and max execution time, mean and max time waiting from dispatch to
+ * execution, and the execution time histogram. Only executed commands are
+ * listed. To downlink the statistics @seealso tm_send_cmd_stats
+ *
+ * @param fmt Str. Parameters format "%d"
+ * @param params Str. Parameters as string: <reset>. Set reset to 1 to clear
+ * the statistics after printing. Ex: "0"
+ * @param nparams Int. Number of parameters 1
+ * @return  CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int obc_cmd_stats(char *fmt, char *params, int nparams);
+
+/**
+ * Print the TC latency statistics: for each stage of the TC commands, from
+ * the TC reception to the result (see cmd_lat_stage_t), the number of traced
+ * commands, mean and max latency from the previous stage, and the latency
+ * histogram. The "total" row is the whole turnaround. To downlink the
+ * statistics @seealso tm_send_cmd_lat
+ *
+ * @param fmt Str. Parameters format "%d"
+ * @param params Str. Parameters as string: <reset>. Set reset to 1 to clear
+ * the statistics after printing. Ex: "0"
+ * @param nparams Int. Number of parameters 1
+ * @return  CMD_OK if executed correctly
+ */
+int obc_cmd_lat(char *fmt, char *params, int nparams);
+
+/**
+ * Print the periodic tasks loop timing statistics: period, number of loops,
+ * loops that overrun their period, last, mean and max work time, and max wake
+ * up lateness (@seealso osPeriodDelay). Use it to check that the loops (as the
+ * 100 ms ADCS loop) stay within their period. To downlink the statistics
+ * @seealso tm_send_task_stats
+ *
+ * @param fmt Str. Parameters format "%d"
+ * @param params Str. Parameters as string: <reset>. Set reset to 1 to clear
+ * the statistics after printing. Ex: "0"
+ * @param nparams Int. Number of parameters 1
+ * @return  CMD_OK if executed correctly
+ */
+int obc_task_stats(char *fmt, char *params, int nparams);
+
+/**
+ * Print the hot paths profiling counters: calls, mean, max and total time of
+ * each profiling point (@seealso prof_utils.h). Counting points, as queue
+ * receives, have no time. All zero if SCH_PROF_ENABLE is not set. To
+ * downlink the counters @seealso tm_send_prof
+ *
+ * @param fmt Str. Parameters format "%d"
+ * @param params Str. Parameters as string: <reset>. Set reset to 1 to clear
+ * the counters after printing. Ex: "0"
+ * @param nparams Int. Number of parameters 1
+ * @return  CMD_OK if executed correctly
+ */
+int obc_prof(char *fmt, char *params, int nparams);
+
+/**
+ * Print the usage statistics of the named queues (dispatcher, executers,
+ * ingest, etc. @seealso osQueueSetName): size, current depth, high-water mark,
+ * items sent, sends failed because the queue was full, and the total time
+ * producers were blocked waiting for space. Use it to size the queues.
+ * Counters are zero if SCH_OS_QUEUE_STATS is not set.
+ *
+ * @param fmt Str. Parameters format "%d"
+ * @param params Str. Parameters as string: <reset>. Set reset to 1 to clear
+ * the counters after printing. Ex: "0"
+ * @param nparams Int. Number of parameters 1
+ * @return  CMD_OK if executed correctly
+ */
+int obc_queue_stats(char *fmt, char *params, int nparams);
+
+/**
+ * Print the contention statistics of the named locks (repo_data, repo_cmd,
+ * log_mutex, etc. @seealso osSemaphoreSetName): acquisitions, acquisitions
+ * that had to wait, total wait time, and the max. exclusive hold time with the
+ * task that held the lock. Only counted in builds with SCH_OS_LOCK_STATS set.
+ *
+ * @param fmt Str. Parameters format "%d"
+ * @param params Str. Parameters as string: <reset>. Set reset to 1 to clear
+ * the counters after printing. Ex: "0"
+ * @param nparams Int. Number of parameters 1
+ * @return  CMD_OK if executed correctly
+ */
+int obc_lock_stats(char *fmt, char *params, int nparams);
+
+/**
+ * Start or stop recording the commands sent to the dispatcher in
+ * SCH_CMD_TRACE_FILE (@seealso cmd_trace_start). Download the trace with the
+ * files port to replay it in the test_replay benchmark. Only in GNU/Linux
+ * builds with SCH_CMD_TRACE set.
+ *
+ * @param fmt Str. Parameters format "%d"
+ * @param params Str. Parameters as string: <seconds>. Record for these
+ * seconds, 0 until stopped, or -1 to stop the trace. Ex: "86400"
+ * @param nparams Int. Number of parameters 1
+ * @return  CMD_OK if executed correctly, CMD_ERROR if the trace can not be
+ * started
+ */
+int obc_cmd_trace(char *fmt, char *params, int nparams);
+
+/**
+ * Print the heap usage of each subsystem (commands, data, storage, etc.
+ * @seealso mem_utils.h): live bytes, peak bytes, and number of allocations
+ * and frees. Live bytes growing between two calls with the system idle show a
+ * leak. Counters are zero if SCH_MEM_STATS is not set.
+ *
+ * @param fmt Str. Parameters format "%d"
+ * @param params Str. Parameters as string: <reset>. Set reset to 1 to clear
+ * the peak (to the live bytes) and the counters after printing. Ex: "0"
+ * @param nparams Int. Number of parameters 1
+ * @return  CMD_OK if executed correctly
+ */
+int obc_mem_stats(char *fmt, char *params, int nparams);
+
+/**
+ * Set a housekeeping periodic job (@seealso hk_job_t). The job sends the
+ * command at phase + k*period seconds after taskHousekeeping starts. Use
+ * different phases to spread jobs with the same period. Jobs are kept in RAM,
+ * the default jobs are loaded after a reset.
+ *
+ * @param fmt Str. Parameters format "%d %u %u %s %n"
+ * @param params Str. Parameters as string: <slot> <period> <phase> <command> [params]
+ * @param nparams Int. Number of parameters 5
+ * @code
+ *      // Send tm_send_status 10 every 5 minutes, 2 minutes after the 5 min mark
+ *      obc_hk_set 8 300 120 tm_send_status 10
+ * @endcode
+ * @return  CMD_OK if executed correctly, CMD_ERROR if the command does not
+ * exist, or CMD_SYNTAX_ERROR in case of parameters errors
+ */
+int obc_hk_set(char *fmt, char *params, int nparams);
+
+/**
+ * Delete a housekeeping periodic job
+ *
+ * @param fmt Str. Parameters format "%d"
+ * @param params Str. Parameters as string: <slot>
+ * @param nparams Int. Number of parameters 1
+ * @return  CMD_OK if executed correctly, or CMD_SYNTAX_ERROR if the slot is not valid
+ */
+int obc_hk_del(char *fmt, char *params, int nparams);
+
+/**
+ * Print the housekeeping periodic jobs
+ *
+ * @param fmt Str. Parameters format ""
+ * @param params Str. Parameters as string ""
+ * @param nparams Int. Number of parameters 0
+ * @return  CMD_OK
+ */
+int obc_hk_show(char *fmt, char *params, int nparams);
+
+/**
+ * Replace the housekeeping periodic jobs with the default jobs
+ *
+ * @param fmt Str. Parameters format ""
+ * @param params Str. Parameters as string ""
+ * @param nparams Int. Number of parameters 0
+ * @return  CMD_OK if executed correctly, CMD_ERROR in case of failures
+ */
+int obc_hk_reset(char *fmt, char *params, int nparams);
+
 /**
  * Set the system time only if is not running Linux
  *
@@ -255,6 +423,16 @@ int obc_set_tle(char *fmt, char *params, int nparams);
  */
 int obc_update_tle(char *fmt, char *params, int nparams);
 
+/**
+ * Copy the TLE set by obc_update_tle. The TLE is published without locks, so
+ * the copy never waits for an update or a propagation. Propagate the copy,
+ * SGP4 modifies the TLE it propagates.
+ *
+ * @param dst TLE copy
+ * @return 0 if the TLE is valid, -1 if it is not set or not valid
+ */
+int obc_tle_get(TLE *dst);
+
 /**
  * Propagate the TLE to the given datetime to update satellite position in ECI
  * reference. The result is stored in the system variables. The command receives
@@ -287,4 +465,161 @@ int obc_update_tle(char *fmt, char *params, int nparams);
  */
 int obc_prop_tle(char *fmt, char *params, int nparams);
 
+/**
+ * Update the orbit ephemeris cache. The TLE is propagated to
+ * SCH_OBC_EPH_LEN points every SCH_OBC_EPH_STEP seconds from the given
+ * datetime, then obc_prop_tle and obc_prop_tle_rv interpolate the cached
+ * points (cubic Hermite of position and velocity) instead of running SGP4.
+ * The update is queued by obc_update_tle and, once 3/4 of the cache is in the
+ * past, by obc_prop_tle_rv.
+ *
+ * @param fmt Str. Parameters format "%d"
+ * @param params Str. Parameters as string "<timestamp>", 0 or empty for the
+ * current datetime
+ * @param nparams Int. Number of parameters 1
+ * @return CMD_OK if executed correctly, CMD_ERROR if the TLE is not valid or
+ * changed during the update, CMD_SYNTAX_ERROR in case of parameters errors
+ *
+ * @code
+ * obc_eph_update 0
+ * @endcode
+ */
+int obc_eph_update(char *fmt, char *params, int nparams);
+
+/**
+ * Propagate the TLE to the given datetime. Same as obc_prop_tle but the result
+ * is returned instead of stored in the status variables, to be called from
+ * a task loop (@see taskADCS). Datetimes in the ephemeris cache are
+ * interpolated (@see obc_eph_update).
+ *
+ * @param ts Unix timestamp, or 0 to use the current datetime
+ * @param r Sat position in ECI frame [km], array of 3 doubles
+ * @param v Sat velocity in ECI frame [km/s], array of 3 doubles
+ * @return 0 if OK, -1 if the propagator failed
+ */
+int obc_prop_tle_rv(int ts, double *r, double *v);
+
+/**
+ * Orbit states, struct of arrays (@see obc_prop_tle_range)
+ */
+typedef struct obc_rv_array {
+    int n;                  ///< Number of states
+    int *ts;                ///< Unix timestamps
+    double *rx, *ry, *rz;   ///< Position in ECI frame [km]
+    double *vx, *vy, *vz;   ///< Velocity in ECI frame [km/s]
+    int *error;             ///< SGP4 error code, 0 if OK
+} obc_rv_array_t;
+
+/**
+ * Allocate the arrays of @rv for @n states, in one block
+ * @return 0 if OK, -1 on error
+ */
+int obc_rv_array_alloc(obc_rv_array_t *rv, int n);
+
+/**
+ * Free the arrays allocated by obc_rv_array_alloc
+ */
+void obc_rv_array_free(obc_rv_array_t *rv);
+
+/**
+ * Propagate a TLE to every timestamp of @rv->ts. Linux builds split the
+ * timestamps across SCH_OBC_PROP_THREADS threads, each one propagates its
+ * own copy of the TLE.
+ *
+ * @param src TLE to propagate, or NULL to use the TLE set by obc_update_tle.
+ * It is not modified.
+ * @param rv States, @rv->ts and @rv->n are inputs
+ * @return Number of states with propagation errors
+ */
+int obc_prop_tle_range(const TLE *src, obc_rv_array_t *rv);
+
+/**
+ * Propagate the TLE to a range of datetimes and log the results as
+ * "<timestamp>,<rx>,<ry>,<rz>,<vx>,<vy>,<vz>" lines (@see obc_prop_tle_range)
+ *
+ * @param fmt Str. Parameters format "%d %d %d"
+ * @param params Str. Parameters as string "<start> <step> <n>", start 0 for
+ * the current datetime, step in seconds
+ * @param nparams Int. Number of parameters 3
+ * @return CMD_OK if executed correctly, CMD_ERROR if any propagation failed,
+ * CMD_SYNTAX_ERROR in case of parameters errors
+ *
+ * @code
+ * obc_prop_tle_range 0 60 90
+ * @endcode
+ */
+int obc_prop_tle_range_cmd(char *fmt, char *params, int nparams);
+
+/**
+ * Ground station pass, the satellite elevation over the ground station
+ * (SCH_GS_LAT_DEG, SCH_GS_LON_DEG, SCH_GS_ALT_M) is above SCH_GS_MIN_EL_DEG
+ * from the AOS to the LOS
+ */
+typedef struct obc_pass {
+    int aos;                ///< Acquisition of signal, unix timestamp
+    int los;                ///< Loss of signal, unix timestamp
+    double max_el;          ///< Max. elevation [deg]
+} obc_pass_t;
+
+/**
+ * Elevation of the satellite over the ground station
+ *
+ * @param r Sat position in ECI frame [km], array of 3 doubles
+ * @param ts Unix timestamp of the position
+ * @return Elevation [deg]
+ */
+double obc_pass_elevation(const double *r, int ts);
+
+/**
+ * Satellite seen from the ground station (@see obc_pass_look)
+ */
+typedef struct obc_look {
+    double az;              ///< Azimuth [deg], from the north to the east [0, 360)
+    double el;              ///< Elevation [deg]
+    double range;           ///< Range [km]
+    double range_rate;      ///< Range rate [km/s], positive if the satellite moves away
+} obc_look_t;
+
+/**
+ * Azimuth, elevation, range and range rate of the satellite from the ground
+ * station (SCH_GS_LAT_DEG, SCH_GS_LON_DEG, SCH_GS_ALT_M). The range rate
+ * includes the ground station velocity due to the Earth rotation.
+ *
+ * @param r Sat position in ECI frame [km], array of 3 doubles
+ * @param v Sat velocity in ECI frame [km/s], array of 3 doubles
+ * @param ts Unix timestamp of the state, with the fraction of second
+ * @param look Satellite seen from the ground station
+ */
+void obc_pass_look(const double *r, const double *v, double ts, obc_look_t *look);
+
+/**
+ * Predict the next ground station pass. The orbit is sampled every
+ * SCH_OBC_EPH_STEP seconds (@see obc_prop_tle_rv), the AOS and LOS are then
+ * refined to one second. A pass in progress at @ts has its AOS at @ts.
+ *
+ * @param ts Unix timestamp to start the search, or 0 to use the current datetime
+ * @param horizon Max. seconds from @ts to the AOS
+ * @param pass Next pass
+ * @return 0 if OK, 1 if there is no pass within the horizon, -1 if there is
+ * no TLE or the propagator failed
+ */
+int obc_next_pass(int ts, int horizon, obc_pass_t *pass);
+
+/**
+ * Print the next ground station pass (@see obc_next_pass)
+ *
+ * @param fmt Str. Parameters format "%d"
+ * @param params Str. Parameters as string "<horizon>", prediction horizon in
+ * seconds
+ * @param nparams Int. Number of parameters 1
+ * @return CMD_OK if executed correctly, CMD_ERROR if there is no pass within
+ * the horizon or the TLE is not valid, CMD_SYNTAX_ERROR in case of parameters
+ * errors
+ *
+ * @code
+ * obc_get_pass 86400
+ * @endcode
+ */
+int obc_get_pass(char *fmt, char *params, int nparams);
+
 #endif /* CMD_OBC_H */
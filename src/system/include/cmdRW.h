@@ -79,6 +79,29 @@ int rw_get_current(char *fmt, char *params, int nparams);
  */
 int rw_set_speed(char *fmt, char *params, int nparams);
 
+/**
+ * Set the speed of the three RW with back to back commands, to change the
+ * torques together.
+ * @param fmt Str. Parameters format "%d %d %d"
+ * @param param Str. Parameters as string: "<speed1> <speed2> <speed3>"
+ * @param nparams Int. Number of parameters 3
+ * @return CMD_OK if executed correctly
+ */
+int rw_set_speed_all(char *fmt, char *params, int nparams);
+
+/**
+ * RW telemetry service, to be called periodically (at least
+ * RWDRV10987_SAMPLE_MS apart) from one task. Each call reads the measurement
+ * requested by the previous call and requests the next one, so it does not
+ * wait for the driver. The speed and current of the three wheels are
+ * updated every six calls.
+ *
+ * @param speed Speed of motors 1, 2 and 3, one of them is updated
+ * @param current Current of motors 1, 2 and 3 [mA], one of them is updated
+ * @return 0 if ok, -1 if the driver failed
+ */
+int rw_sample_step(float speed[3], float current[3]);
+
 
 /** UPPER ISTAGE COMMANDS **/
 #ifdef SCH_USE_ISTAGE2
@@ -15,6 +15,7 @@
 
 #include <stdint.h>
 #include <unistd.h>
+#include <math.h>
 
 #include "config.h"
 
@@ -22,14 +23,84 @@
 #include "osDelay.h"
 
 #include "repoCommand.h"
+#include "repoData.h"
+
+/**
+ * Payload sensor driver, @see sen_drivers in cmdSensors.c. Drivers are listed
+ * by payload id, next to each data_map entry.
+ */
+typedef struct sen_driver {
+    int (*init)(void);          ///< Initialize the sensor, NULL if not required. Returns 0 if OK
+    int (*sample)(void *data);  ///< Read one sample into a data_map[payload] struct, the index and
+                                ///< timestamp are set by the caller. Returns 0 if OK. NULL if the
+                                ///< payload is not sampled by taskSensors.
+} sen_driver_t;
 
 void cmd_sensors_init(void);
 
+/**
+ * Get the driver of a payload
+ * @param payload Payload id (payload_id_t)
+ * @return Driver or NULL if the payload has no sensor driver
+ */
+const sen_driver_t *sen_get_driver(int payload);
+
+/**
+ * Initialize the sensor drivers, the burst mode buffers and the data reduction
+ * @return Number of drivers that failed
+ */
+int sen_init_drivers(void);
+
+/**
+ * Rebuild the next status sample applying a status delta record to the
+ * previous one. Start from the sta_data keyframe with index rec->key and apply
+ * the stz_data records with that key in index order.
+ * @param sta Previous status sample, updated in place
+ * @param rec Status delta record
+ * @return 0 if OK, -1 if the record mask is not valid
+ */
+int sen_delta_apply(sta_data_t *sta, const stz_data_t *rec);
+
+/**
+ * Sample the selected payloads calling their drivers directly and store the
+ * samples, one dat_add_payload_samples per payload. The payload indexes are
+ * read with one dat_get_status_vars call. Samples go through the payload data
+ * reduction, @see reduce_set and reduce_trig, and the status delta storage,
+ * @see delta_set.
+ * @param payloads Bit mask of payloads to sample (bit i = payload i)
+ * @param timestamp Samples timestamp
+ * @return Number of payloads sampled and stored, -1 if any driver or storage
+ * operation failed
+ */
+int sen_take_samples(unsigned int payloads, uint32_t timestamp);
+
+/**
+ * Burst mode sampling. Sample the selected payloads into their RAM ring
+ * buffers (SCH_SEN_BURST_BUFF bytes for all payloads), instead of one storage
+ * write per sample. A payload ring is stored with one dat_add_payload_samples
+ * call, that also updates its index once, when it is half full.
+ * Call sen_burst_flush when the burst ends. Not thread safe, only taskSensors
+ * uses the burst buffers.
+ * @param payloads Bit mask of payloads to sample (bit i = payload i)
+ * @param timestamp Samples timestamp
+ * @return Number of payloads sampled, -1 if any driver or storage operation
+ * failed
+ */
+int sen_burst_take_samples(unsigned int payloads, uint32_t timestamp);
+
+/**
+ * Store the samples buffered in burst mode
+ * @param payloads Bit mask of payloads to store (bit i = payload i)
+ * @return 0 if OK, -1 if any payload was not stored (its samples are kept)
+ */
+int sen_burst_flush(unsigned int payloads);
+
 /**
  * Control sensors state status_machine task
  * @param fmt "%u %u %d"
  * @param params <action> <step> <nsamples>
- * action: Next action ACT_PAUSE= 0, ACT_START=1, ACT_STAND_BY=2,
+ * action: Next action ACT_PAUSE= 0, ACT_START=1, ACT_STAND_BY=2, ACT_BURST=3
+ *         (sample to RAM and store in chunks, @see sen_burst_take_samples)
  * step: Seconds between sates update (or samples)
  * nsamples: Number of samples to take before go to ACT_STAND_BY. Use -1
  *           to run for ever.
@@ -47,6 +118,21 @@ void cmd_sensors_init(void);
  */
 int set_state(char *fmt, char *params, int nparams);
 
+/**
+ * Control sensors state status_machine task, with the step in milliseconds.
+ * Samples are taken by taskSensors at the scheduled instant (with
+ * SCH_SEN_TICK_MS resolution) and stamped with the trigger time.
+ * @param fmt "%u %u %d"
+ * @param params <action> <step_ms> <nsamples>
+ * @param nparams 3
+ * @code
+ * //Start status_machine, every 100 ms (10 Hz), 600 samples max.
+ * sen_set_machine_ms 1 100 600
+ * @endcode
+ * @return CMD_OK | CMD_ERROR | CMD_SYNTAX_ERROR
+ */
+int set_state_ms(char *fmt, char *params, int nparams);
+
 /**
  *
  * @param fmt "%u"
@@ -62,11 +148,11 @@ int set_state(char *fmt, char *params, int nparams);
 int activate_sensor(char *fmt, char *params, int nparams);
 
 /**
- *
+ * Take and store one sample of a payload, @see sen_take_samples
  * @param fmt %u
  * @param params <payload>
  * @param nparams 1
- * @return
+ * @return CMD_OK | CMD_ERROR | CMD_SYNTAX_ERROR
  */
 int take_sample(char *fmt, char *params, int nparams);
 
@@ -79,4 +165,71 @@ int take_sample(char *fmt, char *params, int nparams);
  */
 int init_dummy_sensor(char *fmt, char *params, int nparams);
 
+/**
+ * Configure the on-board data reduction of a sampled payload, applied by
+ * sen_take_samples and sen_burst_take_samples before storing the samples.
+ * Samples can be decimated, and the min, max, mean and standard deviation of
+ * the payload fields are stored every window samples in stat_data, one row
+ * per field, even for the samples discarded by the decimation. The
+ * reduction is in RAM, it starts over after a reset with every sample
+ * stored and no statistics.
+ * @param fmt "%d %d %d %u"
+ * @param params <payload> <decimate> <window> <fields>
+ * payload: Payload id (temp_sensors, ads_sensors, eps_sensors, sta_sensors)
+ * decimate: Store one of every <decimate> samples, 1 stores all, 0 none
+ * window: Statistics window in samples, 0 disables the statistics
+ * fields: Fields with statistics, bit i = field i in data_map var_names (up to
+ *         SCH_SEN_REDUCE_FIELDS). 0 selects all but sat_index and timestamp.
+ * @param nparams 4
+ * @code
+ * // Store one of 60 EPS samples, and statistics of all fields every 60 samples
+ * sen_reduce_set 2 60 60 0
+ * // Only statistics of obc_temp_1 (field 2) every 600 samples
+ * sen_reduce_set 0 0 600 4
+ * @endcode
+ * @return CMD_OK | CMD_ERROR | CMD_SYNTAX_ERROR
+ */
+int reduce_set(char *fmt, char *params, int nparams);
+
+/**
+ * Configure the threshold trigger of a sampled payload. When the field
+ * crosses the level, the samples discarded by the decimation in the last
+ * <pre> samples, the trigger sample and the next <post> samples are stored in
+ * the payload table, and the event is stored in trig_data.
+ * @param fmt "%d %d %f %d %d %d"
+ * @param params <payload> <field> <level> <dir> <pre> <post>
+ * payload: Payload id
+ * field: Trigger field, position in data_map var_names. -1 disables the trigger
+ * level: Threshold
+ * dir: 1 fires when the field rises over the level, -1 when it falls under
+ * pre: Pre-trigger samples to keep in RAM (SCH_SEN_REDUCE_BUFF bytes for all payloads)
+ * post: Samples to store after the trigger
+ * @param nparams 6
+ * @code
+ * // Capture 20 + 1 + 40 EPS samples when vbatt (field 4) falls under 7000 mV
+ * sen_reduce_trig 2 4 7000 -1 20 40
+ * @endcode
+ * @return CMD_OK | CMD_ERROR | CMD_SYNTAX_ERROR
+ */
+int reduce_trig(char *fmt, char *params, int nparams);
+
+/**
+ * Configure the delta storage of the status variables payload (sta_sensors),
+ * applied after the data reduction. A sample is stored in full in sta_data as
+ * a keyframe every <keyframe> samples, the other samples are stored in
+ * stz_data with only the vars that changed since the previous sample (up to
+ * DAT_STZ_VALUES, more changes store a keyframe). The setting is in RAM, after
+ * a reset every sample is stored in full.
+ * @param fmt "%d"
+ * @param params <keyframe>
+ * keyframe: Samples between keyframes, 0 or 1 store every sample in full
+ * @param nparams 1
+ * @code
+ * // One full status sample every 60 samples
+ * sen_delta_set 60
+ * @endcode
+ * @return CMD_OK | CMD_ERROR | CMD_SYNTAX_ERROR
+ */
+int delta_set(char *fmt, char *params, int nparams);
+
 #endif /* _CMD_SENS_H */
@@ -17,15 +17,143 @@
 #include "repoCommand.h"
 #include "repoData.h"
 #include "cmdCOM.h"
+#include "osThread.h"
+#include "prof_utils.h"
+
+#ifdef LINUX
+#include <sys/stat.h>
+#endif
 
 #define TM_TYPE_GENERIC 0
 #define TM_TYPE_STATUS  1
 #define TM_TYPE_HELP    2
+#define TM_TYPE_CMD_STATS 3
+#define TM_TYPE_TASK_STATS 4
+#define TM_TYPE_TASK_STACK 5
+#define TM_TYPE_STATUS_DELTA 6  ///< Status variables changed since the last acknowledged keyframe, @see tm_send_status
+#define TM_TYPE_PROF 7          ///< Profiling counters, @see tm_send_prof
+#define TM_TYPE_CMD_CATALOG 8   ///< Commands catalog, @see tm_send_cmd_catalog
+#define TM_TYPE_PAYLOAD_MUX 9   ///< Samples of several payloads, @see tm_send_payload_mux
 #define TM_TYPE_PAYLOAD 10
+#define TM_TYPE_PAYLOAD_Z 40    ///< Compressed payload (+ payload id), @see dat_compress_payload_samples
+#define TM_TYPE_PROF_STACKS 90   ///< Sampled stacks histogram, @see tm_send_prof_stacks
+#define TM_TYPE_STATUS_VARS 91   ///< Requested status variables, @see tm_send_vars
+#define TM_TYPE_FP 92            ///< Flight plan page, @see tm_send_fp
+#define TM_TYPE_CMD_LAT 93       ///< TC latency statistics, @see tm_send_cmd_lat
 #define TM_TYPE_FILE_START 100
 #define TM_TYPE_FILE_DATA 101
 #define TM_TYPE_FILE_END 102
 
+#define TM_STATUS_HEADER_ADDR 0xFFFF    ///< Status beacon header record address, value is (variables << 16 | keyframe sequence)
+#define TM_CMD_CATALOG_HEADER 0xFFFFFFFF ///< Commands catalog header id, name_hash is the version and nparams the number of commands
+#define TM_MUX_HEADER_LEN 4     ///< TM_TYPE_PAYLOAD_MUX record header, a uint32 (payload << 16 | samples)
+
+/**
+ * Range of payload samples [start, end), @see tm_send_payload_mux
+ */
+typedef struct tm_payload_range{
+    int payload;                            ///< Payload id
+    int start;                              ///< First sample
+    int end;                                ///< Last sample + 1
+} tm_payload_range_t;
+
+/**
+ * Commands catalog telemetry (@seealso tm_send_cmd_catalog), one per command
+ * after a TM_CMD_CATALOG_HEADER entry. All fields are uint32 in network byte
+ * order.
+ */
+typedef struct tm_cmd_catalog{
+    uint32_t id;                            ///< Command id
+    uint32_t nparams;                       ///< Number of parameters
+    uint32_t name_hash;                     ///< Command name hash
+    uint32_t fmt_hash;                      ///< Parameters format hash
+} tm_cmd_catalog_t;
+
+/**
+ * Commands execution statistics telemetry (@seealso tm_send_cmd_stats).
+ * All fields are uint32 in network byte order, times in microseconds.
+ */
+typedef struct tm_cmd_stats{
+    uint32_t id;                            ///< Command id
+    uint32_t count;                         ///< Number of executions
+    uint32_t exec_min;                      ///< Min. execution time
+    uint32_t exec_mean;                     ///< Mean execution time
+    uint32_t exec_max;                      ///< Max. execution time
+    uint32_t wait_mean;                     ///< Mean time from dispatch to start
+    uint32_t wait_max;                      ///< Max. time from dispatch to start
+    uint32_t hist[CMD_STATS_BUCKETS];       ///< Execution time histogram
+} tm_cmd_stats_t;
+
+/**
+ * TC latency statistics telemetry (@seealso tm_send_cmd_lat), one per stage.
+ * All fields are uint32 in network byte order, times in microseconds.
+ */
+typedef struct tm_cmd_lat{
+    uint32_t stage;                         ///< Stage (cmd_lat_stage_t), CMD_LAT_RX is the total
+    uint32_t last_id;                       ///< Last trace id assigned
+    uint32_t count;                         ///< Number of traced commands
+    uint32_t mean;                          ///< Mean latency from the previous stage
+    uint32_t max;                           ///< Max. latency from the previous stage
+    uint32_t hist[CMD_LAT_BUCKETS];         ///< Latency histogram
+} tm_cmd_lat_t;
+
+#define TM_TASK_NAME_LEN (16)               ///< Task name length in tm_task_stats_t
+
+/**
+ * Periodic tasks loop statistics telemetry (@seealso tm_send_task_stats).
+ * Numeric fields are uint32 in network byte order, times in microseconds.
+ */
+typedef struct tm_task_stats{
+    uint32_t id;                            ///< Periodic loop index
+    uint32_t period_ms;                     ///< Loop period [ms]
+    uint32_t loops;                         ///< Measured loops
+    uint32_t overruns;                      ///< Loops longer than the period
+    uint32_t work_last;                     ///< Last loop work time
+    uint32_t work_mean;                     ///< Mean loop work time
+    uint32_t work_max;                      ///< Max. loop work time
+    uint32_t late_max;                      ///< Max. wake up lateness
+    char name[TM_TASK_NAME_LEN];            ///< Task name
+} tm_task_stats_t;
+
+/**
+ * Tasks stack usage telemetry (@seealso tm_send_task_stack).
+ * Numeric fields are uint32 in network byte order, sizes in bytes.
+ */
+typedef struct tm_task_stack{
+    uint32_t id;                            ///< Task index
+    uint32_t size;                          ///< Stack size
+    uint32_t used_max;                      ///< Max. stack used (high-water mark)
+    char name[TM_TASK_NAME_LEN];            ///< Task name
+} tm_task_stack_t;
+
+#define TM_PROF_NAME_LEN (20)               ///< Profiling point name length in tm_prof_t
+
+/**
+ * Profiling counters telemetry (@seealso tm_send_prof).
+ * Numeric fields are uint32 in network byte order, times in microseconds.
+ */
+typedef struct tm_prof{
+    uint32_t id;                            ///< Profiling point, prof_id_t
+    uint32_t count;                         ///< Calls
+    uint32_t time_mean;                     ///< Mean time of a call
+    uint32_t time_max;                      ///< Max. time of a call
+    char name[TM_PROF_NAME_LEN];            ///< Profiling point name
+} tm_prof_t;
+
+#define TM_PROF_TASK_LEN (12)               ///< Task name length in tm_prof_stack_t
+
+/**
+ * Sampled stacks telemetry (@seealso tm_send_prof_stacks), one entry per
+ * task and stack. Numeric fields are uint32 in network byte order, frames
+ * as in prof_stack_t.
+ */
+typedef struct tm_prof_stack{
+    uint32_t count;                         ///< Samples with this stack
+    uint32_t depth;                         ///< Frames in pc
+    uint32_t pc[PROF_SAMPLE_DEPTH];         ///< Frames, innermost first, offsets in the executable
+    char task[TM_PROF_TASK_LEN];            ///< Task name
+} tm_prof_stack_t;
+
 /**
  * Register TM commands
  */
@@ -36,6 +164,15 @@ void cmd_tm_init(void);
  * of all status variables, builds a frame and downloads telemetry to the
  * specified node. To parse the data @seealso tm_parse_status
  *
+ * Every frame starts with a header record (TM_STATUS_HEADER_ADDR). If delta
+ * beacons are enabled (tm_bcn_mode) and the ground acknowledged a keyframe
+ * (tm_bcn_ack), only the variables that changed beyond their deadband
+ * (tm_bcn_deadband) are sent as TM_TYPE_STATUS_DELTA. A full TM_TYPE_STATUS
+ * keyframe is sent every SCH_TM_BCN_KEYFRAME beacons.
+ *
+ * If the beacon task prebuilt the beacon (@see tm_bcn_build), it is sent
+ * without reading the status variables.
+ *
  * @param fmt Str. Parameters format: "%d"
  * @param param Str. Parameters as string, node to send TM: <node>. Ex: "10"
  * @param nparams Int. Number of parameters: 1
@@ -45,8 +182,8 @@ int tm_send_status(char *fmt, char *params, int nparams);
 
 /**
  * Send specific status variable as telemetry. This command collects the current value
- * of the status variable, builds a frame and downloads telemetry to the
- * specified node. To parse the data @seealso tm_parse_status
+ * of the status variable, builds a TM_TYPE_STATUS_VARS frame and downloads
+ * telemetry to the specified node. To parse the data @seealso tm_parse_status
  *
  * @param fmt Str. Parameters format: "%d %s"
  * @param param Str. Parameters as string, node to send TM and variable name: <node> <variable name>. Ex: "10 obc_last_reset"
@@ -55,6 +192,20 @@ int tm_send_status(char *fmt, char *params, int nparams);
  */
 int tm_send_var(char *fmt, char *params, int nparams);
 
+/**
+ * Send a selection of status variables as telemetry. The variables are read
+ * with one snapshot of the status repository and sent as TM_TYPE_STATUS_VARS
+ * dat_sys_var_short_t records, a frame holds 32 variables.
+ * To parse the data @seealso tm_parse_status
+ *
+ * @param fmt Str. Parameters format: "%d %n"
+ * @param param Str. Parameters as string, node to send TM and variables
+ * selection (@see dat_select_status_vars): <node> <selection>. Ex: "10 ads eps 0-3"
+ * @param nparams Int. Number of parameters: 2
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_send_vars(char *fmt, char *params, int nparams);
+
 /**
  * Parses a status variables telemetry, @seealso tm_send_status.
  * @warning Avoid using this command from command line, or tele-command
@@ -67,6 +218,39 @@ int tm_send_var(char *fmt, char *params, int nparams);
  */
 int tm_parse_status(char *fmt, char *params, int nparams);
 
+/**
+ * Configure the status beacon content, @seealso tm_send_status
+ *
+ * @param fmt Str. Parameters format: "%d %d"
+ * @param param Str. Parameters as string: <delta> <keyframe>. Set delta to 1 to
+ * send only changed variables, and a keyframe every <keyframe> beacons. Ex: "1 10"
+ * @param nparams Int. Number of parameters: 2
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_bcn_mode(char *fmt, char *params, int nparams);
+
+/**
+ * Set the change required to include a status variable in a delta beacon.
+ * By default any change is sent.
+ *
+ * @param fmt Str. Parameters format: "%s %f"
+ * @param param Str. Parameters as string: <variable> <deadband>. Ex: "obc_temp_1 0.5"
+ * @param nparams Int. Number of parameters: 2
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_bcn_deadband(char *fmt, char *params, int nparams);
+
+/**
+ * Acknowledge a status beacon keyframe. Following delta beacons are relative to
+ * this keyframe. Sent by the ground station when it receives a full keyframe.
+ *
+ * @param fmt Str. Parameters format: "%d"
+ * @param param Str. Parameters as string: <sequence>. Ex: "12"
+ * @param nparams Int. Number of parameters: 1
+ * @return CMD_OK if executed correctly, CMD_ERROR if it is not the last keyframe sent, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_bcn_ack(char *fmt, char *params, int nparams);
+
 /**
  * Parses a commands list as string, @seealso tm_send_cmds.
  *
@@ -101,7 +285,8 @@ int tm_send_last(char *fmt, char *params, int nparams);
  * @param fmt "%u %u"
  * @param params "<destination node> <payload>"
  * @param nparams 2
- * @return CMD_OK, CMD_ERROR, or CMD_ERROR_SYNTAX
+ * @return CMD_OK, CMD_ERROR, CMD_ERROR_SYNTAX or CMD_CONTINUE if the next
+ * chunk of SCH_TM_CHUNK_FRAMES frames is pending (@see cmd_set_cursor)
  */
 int tm_send_all(char *fmt, char *params, int nparams);
 
@@ -110,10 +295,23 @@ int tm_send_all(char *fmt, char *params, int nparams);
  * @param fmt "%u %u %u"
  * @param params "<destination node> <payload> <k samples>"
  * @param nparams 3
- * @return CMD_OK, CMD_ERROR, or CMD_ERROR_SYNTAX
+ * @return CMD_OK, CMD_ERROR, CMD_ERROR_SYNTAX or CMD_CONTINUE if the next
+ * chunk of SCH_TM_CHUNK_FRAMES frames is pending (@see cmd_set_cursor)
  */
 int tm_send_from(char *fmt, char *params, int nparams);
 
+/**
+ * Send the structs data stored as payload with a timestamp between two unix
+ * times (inclusive), in multiple csp frames. The first and last structs are
+ * found by time (@see dat_get_payload_index_time).
+ * @param fmt "%u %u %u %u"
+ * @param params "<payload> <destination node> <start time> <end time>"
+ * @param nparams 4
+ * @return CMD_OK, CMD_ERROR, CMD_ERROR_SYNTAX or CMD_CONTINUE if the next
+ * chunk of SCH_TM_CHUNK_FRAMES frames is pending (@see cmd_set_cursor)
+ */
+int tm_send_range_time(char *fmt, char *params, int nparams);
+
 /**
  * Acknowledge k samples of a payload.
  * @param fmt "%u %u"
@@ -123,6 +321,132 @@ int tm_send_from(char *fmt, char *params, int nparams);
  */
 int tm_set_ack(char *fmt, char *params, int nparams);
 
+/**
+ * Send status variables as telemetry to a node, as tm_send_status does.
+ * @param dest_node Node to send TM
+ * @return CMD_OK or CMD_ERROR
+ */
+int tm_send_status_node(int dest_node);
+
+/**
+ * Build the next status beacon in the background, so tm_send_status_node sends
+ * it without reading the status variables. The beacon is built in a back
+ * buffer and swapped with the one sent by the next beacon, while it can be
+ * still sending the last beacon. The beacon state (keyframe sequence, delta
+ * counter) is updated when the beacon is sent, the prebuilt beacon is rebuilt
+ * after each beacon and after tm_bcn_mode, tm_bcn_deadband or tm_bcn_ack.
+ * @param max_age Rebuild the beacon if it is older than @max_age seconds, 0 to
+ * always rebuild it
+ * @return 1 if built, 0 if the beacon is up to date, -1 on error (retry later)
+ */
+int tm_bcn_build(int max_age);
+
+/**
+ * Send the payload samples [start, end) to a node, as tm_send_from does.
+ * @param start Starting index
+ * @param end Stop index
+ * @param payload Payload id
+ * @param dest_node Node to send TM
+ * @return CMD_OK or CMD_ERROR
+ */
+int tm_send_payload_range(int start, int end, int payload, int dest_node);
+
+/**
+ * Send ranges of samples of several payloads to a node in TM_TYPE_PAYLOAD_MUX
+ * frames. Each frame holds ndata records of a TM_MUX_HEADER_LEN header, with
+ * the payload id and the number of samples, followed by the samples. Records
+ * are packed one after the other, splitting a range between frames when it
+ * does not fit, and frames are sent with the used length only, so partial
+ * frames are not padded.
+ * @param ranges Ranges to send, in order
+ * @param n Number of ranges
+ * @param dest_node Node to send TM
+ * @return CMD_OK or CMD_ERROR
+ */
+int tm_send_payload_mux(const tm_payload_range_t *ranges, int n, int dest_node);
+
+/**
+ * Build a TM_TYPE_PAYLOAD frame with the payload samples [start, end), to be
+ * sent later with tm_send_frames.
+ * @param frame Frame to fill
+ * @param start Starting index
+ * @param end Stop index, at most one frame of samples from @start
+ * @param payload Payload id
+ * @return 0 if OK, -1 if the range is not valid or the samples can't be read
+ */
+struct com_frame;
+int tm_build_payload_frame(struct com_frame *frame, int start, int end, int payload);
+
+/**
+ * Send frames already built (@see tm_build_payload_frame) to a node in one
+ * connection, numbered in order.
+ * @param frames Frames to send
+ * @param n Number of frames
+ * @param dest_node Node to send TM
+ * @return CMD_OK or CMD_ERROR
+ */
+int tm_send_frames(const struct com_frame *frames, int n, int dest_node);
+
+/**
+ * Start a downlink session, the downlink manager (@see taskDownlink) sends
+ * status and payload telemetry to the node until it ends. The executer is not
+ * blocked during the session.
+ * @param fmt "%d %d"
+ * @param params "<destination node> <seconds>"
+ * @param nparams 2
+ * @return CMD_OK, CMD_ERROR, or CMD_ERROR_SYNTAX
+ */
+int tm_dl_start(char *fmt, char *params, int nparams);
+
+/**
+ * Stop the current downlink session
+ * @param fmt ""
+ * @param params ""
+ * @param nparams 0
+ * @return CMD_OK or CMD_ERROR
+ */
+int tm_dl_stop(char *fmt, char *params, int nparams);
+
+/**
+ * Set the weight of a downlink source, the share of frames it receives during
+ * a session. Weight 0 disables the source.
+ * @param fmt "%d %u"
+ * @param params "<payload, or -1 for the status beacons> <weight>"
+ * @param nparams 2
+ * @return CMD_OK, CMD_ERROR, or CMD_ERROR_SYNTAX
+ */
+int tm_dl_weight(char *fmt, char *params, int nparams);
+
+/**
+ * Acknowledge a range of payload samples received by the ground station, they
+ * are not retransmitted. Unlike tm_set_ack the range does not need to start at
+ * the last acknowledged sample.
+ * @param fmt "%u %u %u"
+ * @param params "<payload> <start index> <end index + 1>"
+ * @param nparams 3
+ * @return CMD_OK, CMD_ERROR, or CMD_ERROR_SYNTAX
+ */
+int tm_dl_ack(char *fmt, char *params, int nparams);
+
+/**
+ * Print the downlink manager status
+ * @param fmt ""
+ * @param params ""
+ * @param nparams 0
+ * @return CMD_OK
+ */
+int tm_dl_status(char *fmt, char *params, int nparams);
+
+/**
+ * Print the payload TM ingest counters (@see taskIngest). Waits and drops
+ * show the ingest queue is full, the storage is slower than the downlink.
+ * @param fmt "%d"
+ * @param params "[reset]", 1 to clear the counters
+ * @param nparams 1
+ * @return CMD_OK or CMD_ERROR_SYNTAX
+ */
+int tm_ingest_stats(char *fmt, char *params, int nparams);
+
 
 /**
  *
@@ -135,8 +459,225 @@ int tm_get_single(char *fmt, char *params, int nparams);
 
 int tm_send_cmds(char *fmt, char *params, int nparms);
 
+/**
+ * Send the commands catalog as telemetry: a TM_CMD_CATALOG_HEADER entry with
+ * the catalog version (@seealso cmd_catalog_version), then one
+ * tm_cmd_catalog_t per command. If the ground already has this version only
+ * the header is sent. The ground then fetches the names of the unknown hashes
+ * with tm_send_cmd_names, and can send tele-commands by id. To parse the data
+ * @seealso tm_parse_cmd_catalog
+ *
+ * @param fmt Str. Parameters format: "%d %u"
+ * @param param Str. Parameters as string: <node> <ground version>. Ex: "10 0"
+ * @param nparams Int. Number of parameters: 2
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_send_cmd_catalog(char *fmt, char *params, int nparams);
+
+/**
+ * Parses a commands catalog telemetry, @seealso tm_send_cmd_catalog.
+ * @warning Avoid using this command from command line, or tele-command
+ *
+ * @param fmt Str. Not used.
+ * @param param char *. Parameters as pointer to raw data. Receives a com_frame_t structure with an array of
+ * tm_cmd_catalog_t structs in frame->data
+ * @param nparams Int. Not used.
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_parse_cmd_catalog(char *fmt, char *params, int nparams);
+
+/**
+ * Send the names and formats of a range of commands ids as a text telemetry,
+ * one "<id> <name> <fmt>" line per command. Used by the ground to fetch the
+ * commands changed in the catalog (@seealso tm_send_cmd_catalog). To parse the
+ * data @seealso tm_parse_string
+ *
+ * @param fmt Str. Parameters format: "%d %d %d"
+ * @param param Str. Parameters as string: <node> <first id> <number of ids>. Ex: "10 20 5"
+ * @param nparams Int. Number of parameters: 3
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_send_cmd_names(char *fmt, char *params, int nparams);
+
+/**
+ * Send the flight plan as telemetry, one page of SCH_FP_PAGE commands at a
+ * time (@seealso dat_get_fp_page), so a large flight plan is verified without
+ * locking it for the whole download. Each page is a TM_TYPE_FP text, one
+ * "<time> <ms> <executions> <periodical> <command> <args>" line per command,
+ * ended by a "next <time> <skip>" line with the cursor of the next page or by
+ * "end". The text of a page is padded with zeros to whole frames. To parse
+ * the data @seealso tm_parse_fp
+ *
+ * @param fmt Str. Parameters format: "%d %d %d %d"
+ * @param param Str. Parameters as string: <node> <time> <skip> <pages>, the
+ * cursor to start (-1 0 to send all) and the max. pages to send (0 for all).
+ * Ex: "10 -1 0 4"
+ * @param nparams Int. Number of parameters: 4
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_send_fp(char *fmt, char *params, int nparams);
+
+/**
+ * Parses a flight plan telemetry, @seealso tm_send_fp. Prints the text.
+ * @warning Avoid using this command from command line, or tele-command
+ *
+ * @param fmt Str. Not used.
+ * @param param char *. Parameters as pointer to raw data. Receives a com_frame_t structure with the
+ * text in frame->data
+ * @param nparams Int. Not used.
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_parse_fp(char *fmt, char *params, int nparams);
+
+/**
+ * Send the commands execution timing statistics as telemetry, one
+ * tm_cmd_stats_t per executed command (@seealso obc_cmd_stats). To parse the
+ * data @seealso tm_parse_cmd_stats
+ *
+ * @param fmt Str. Parameters format: "%d"
+ * @param param Str. Parameters as string, node to send TM: <node>. Ex: "10"
+ * @param nparams Int. Number of parameters: 1
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_send_cmd_stats(char *fmt, char *params, int nparams);
+
+/**
+ * Parses a commands statistics telemetry, @seealso tm_send_cmd_stats.
+ * @warning Avoid using this command from command line, or tele-command
+ *
+ * @param fmt Str. Not used.
+ * @param param char *. Parameters as pointer to raw data. Receives a com_frame_t structure with an array of
+ * tm_cmd_stats_t structs in frame->data
+ * @param nparams Int. Not used.
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_parse_cmd_stats(char *fmt, char *params, int nparams);
+
+/**
+ * Send the TC latency statistics as telemetry, one tm_cmd_lat_t per stage
+ * (@seealso obc_cmd_lat). To parse the data @seealso tm_parse_cmd_lat
+ *
+ * @param fmt Str. Parameters format: "%d"
+ * @param param Str. Parameters as string, node to send TM: <node>. Ex: "10"
+ * @param nparams Int. Number of parameters: 1
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_send_cmd_lat(char *fmt, char *params, int nparams);
+
+/**
+ * Parses a TC latency statistics telemetry, @seealso tm_send_cmd_lat.
+ * @warning Avoid using this command from command line, or tele-command
+ *
+ * @param fmt Str. Not used.
+ * @param param char *. Parameters as pointer to raw data. Receives a com_frame_t structure with an array of
+ * tm_cmd_lat_t structs in frame->data
+ * @param nparams Int. Not used.
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_parse_cmd_lat(char *fmt, char *params, int nparams);
+
+/**
+ * Send the periodic tasks loop timing statistics as telemetry, one
+ * tm_task_stats_t per registered loop (@seealso obc_task_stats). To parse the
+ * data @seealso tm_parse_task_stats
+ *
+ * @param fmt Str. Parameters format: "%d"
+ * @param param Str. Parameters as string, node to send TM: <node>. Ex: "10"
+ * @param nparams Int. Number of parameters: 1
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_send_task_stats(char *fmt, char *params, int nparams);
+
+/**
+ * Parses a periodic tasks statistics telemetry, @seealso tm_send_task_stats.
+ * @warning Avoid using this command from command line, or tele-command
+ *
+ * @param fmt Str. Not used.
+ * @param param char *. Parameters as pointer to raw data. Receives a com_frame_t structure with an array of
+ * tm_task_stats_t structs in frame->data
+ * @param nparams Int. Not used.
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_parse_task_stats(char *fmt, char *params, int nparams);
+
+/**
+ * Send the tasks stack usage as telemetry, one tm_task_stack_t per task
+ * (@seealso osTaskGetStack). To parse the data @seealso tm_parse_task_stack
+ *
+ * @param fmt Str. Parameters format: "%d"
+ * @param param Str. Parameters as string, node to send TM: <node>. Ex: "10"
+ * @param nparams Int. Number of parameters: 1
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_send_task_stack(char *fmt, char *params, int nparams);
+
+/**
+ * Parses a tasks stack usage telemetry, @seealso tm_send_task_stack.
+ * @warning Avoid using this command from command line, or tele-command
+ *
+ * @param fmt Str. Not used.
+ * @param param char *. Parameters as pointer to raw data. Receives a com_frame_t structure with an array of
+ * tm_task_stack_t structs in frame->data
+ * @param nparams Int. Not used.
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_parse_task_stack(char *fmt, char *params, int nparams);
+
+/**
+ * Send the hot paths profiling counters as telemetry, one tm_prof_t per
+ * profiling point (@seealso obc_prof). To parse the data @seealso tm_parse_prof
+ *
+ * @param fmt Str. Parameters format: "%d %d"
+ * @param param Str. Parameters as string, node to send TM and reset the
+ * counters after sending: <node> <reset>. Ex: "10 0"
+ * @param nparams Int. Number of parameters: 2
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_send_prof(char *fmt, char *params, int nparams);
+
+/**
+ * Parses a profiling counters telemetry, @seealso tm_send_prof.
+ * @warning Avoid using this command from command line, or tele-command
+ *
+ * @param fmt Str. Not used.
+ * @param param char *. Parameters as pointer to raw data. Receives a com_frame_t structure with an array of
+ * tm_prof_t structs in frame->data
+ * @param nparams Int. Not used.
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_parse_prof(char *fmt, char *params, int nparams);
+
+/**
+ * Parses a sampled stacks telemetry, @seealso tm_send_prof_stacks. Prints
+ * one line per stack in the collapsed stacks format of flame graph tools:
+ * the task and the frames from the outermost, separated by ';', and the
+ * samples. Frames are symbolized on ground with addr2line.
+ * @warning Avoid using this command from command line, or tele-command
+ *
+ * @param fmt Str. Not used.
+ * @param param char *. Parameters as pointer to raw data. Receives a com_frame_t structure with an array of
+ * tm_prof_stack_t structs in frame->data
+ * @param nparams Int. Not used.
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_parse_prof_stacks(char *fmt, char *params, int nparams);
+
 #ifdef LINUX
 
+/**
+ * Run a sampling profiler session (@see prof_sample_run) and send the
+ * sampled stacks histogram as telemetry, one tm_prof_stack_t per task and
+ * stack. The command blocks for the session length. Also requested through
+ * the SCH_TRX_PORT_PROF port. To parse the data @seealso tm_parse_prof_stacks
+ *
+ * @param fmt Str. Parameters format: "%d %d %d"
+ * @param param Str. Parameters as string, node to send TM, samples per
+ * second and session length in seconds: <node> <rate> <seconds>. Ex: "10 50 10"
+ * @param nparams Int. Number of parameters: 3
+ * @return CMD_OK if executed correctly, CMD_ERROR in case of failures, or CMD_ERROR_SYNTAX in case of parameters errors
+ */
+int tm_send_prof_stacks(char *fmt, char *params, int nparams);
+
 /**
  * Send a file using CSP
  *
@@ -148,14 +689,54 @@ int tm_send_cmds(char *fmt, char *params, int nparms);
 int tm_send_file(char *fmt, char *params, int nparams);
 
 /**
- * Parse a file from CSP packets
+ * Send only some frames of a file, to complete a transfer. The receiver
+ * requests its missing frames with this command.
+ * @see com_send_file_parts
+ *
+ * @param fmt %s %u %s
+ * @param params "<filename> <node> <frames>", frames as "0-3,7,9-12"
+ * @param nparams 3
+ * @return CMD_OK, CMD_ERROR, or CMD_ERROR_SYNTAX
+ */
+int tm_send_file_parts(char *fmt, char *params, int nparams);
+
+/**
+ * Parse a file frame from CSP packets (@see tm_receive_file_frame)
  *
  * @param fmt ""
- * @param params "<binary_blob>"
+ * @param params "<binary_blob>" A com_frame_file_t frame
  * @param nparams 0
  * @return CMD_OK, CMD_ERROR, or CMD_ERROR_SYNTAX
  */
 int tm_parse_file(char *fmt, char *params, int nparams);
+
+/**
+ * Request the missing frames of a partially received file to its sender,
+ * for example to resume the transfer in the next pass.
+ *
+ * @param fmt %u
+ * @param params "<fileid>"
+ * @param nparams 1
+ * @return CMD_OK, CMD_ERROR, or CMD_ERROR_SYNTAX
+ */
+int tm_request_file(char *fmt, char *params, int nparams);
+
+/**
+ * Receive a file frame (@see com_send_file). Frames are written at their
+ * offset in the file, in any order, and the received frames are tracked per
+ * file id in a bitmap saved to recv_files/, so transfers resume across passes
+ * and restarts. After a FILE_END frame the missing frames are requested to
+ * the sender with tm_send_file_parts, at most 5 times without progress.
+ * Complete files are saved as recv_files/<fileid>_<name>.
+ *
+ * @param frame File frame
+ * @param len Frame length in bytes, the frame data may be shorter than
+ * COM_FRAME_MAX_LEN, or longer for the large frames of SFP links holding
+ * consecutive data frames from @nframe
+ * @return 0 if OK, -1 if the frame is not valid
+ */
+struct com_frame_file;
+int tm_receive_file_frame(struct com_frame_file *frame, int len);
 #endif
 
 #endif //CMDTM_H
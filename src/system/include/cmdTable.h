@@ -0,0 +1,31 @@
+/**
+ * @file  cmdTable.h
+ * @date 2020
+ * @copyright GNU GPL v3
+ *
+ * Static command table, generated by src/system/include/cmdtable.py from the
+ * cmd_add calls of the command modules. Do not edit, run cmdtable.py (or
+ * compile.py) after adding commands. Only used if SCH_CMD_STATIC is set.
+ */
+
+#ifndef SUCHAI_FLIGHT_SOFTWARE_CMDTABLE_H
+#define SUCHAI_FLIGHT_SOFTWARE_CMDTABLE_H
+
+#include "repoCommand.h"
+
+#define CMD_TABLE_LEN (193)  ///< Commands in the static table
+
+/**
+ * Commands sorted by name. Disabled commands have no function.
+ */
+extern const cmd_list_t cmd_table[CMD_TABLE_LEN];
+
+/**
+ * Names perfect hash. The command at hash slot cmd_hash_name(name) % CMD_TABLE_LEN
+ * is cmd_table_slot[-d-1] if d = cmd_table_disp[slot] is negative or
+ * cmd_table_slot[cmd_hash_seed(name, d) % CMD_TABLE_LEN] otherwise.
+ */
+extern const int16_t cmd_table_disp[CMD_TABLE_LEN];
+extern const int16_t cmd_table_slot[CMD_TABLE_LEN];
+
+#endif //SUCHAI_FLIGHT_SOFTWARE_CMDTABLE_H
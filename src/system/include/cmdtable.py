@@ -0,0 +1,349 @@
+#!/usr/bin/env python
+"""
+Generate the static command table (cmdTable.c and cmdTable.h) from the
+cmd_add calls of the src/system/cmd*.c modules. Used when SCH_CMD_STATIC is
+set, @see repoCommand.h.
+
+Commands are sorted by name, so the table is also the sorted index used by
+the binary search, and a minimal perfect hash maps names to table indexes.
+Commands inside #if blocks, of the module file or of its cmd_*_init call in
+cmd_repo_init, keep the same conditions in the table. A disabled command
+keeps its name in the table but not its function.
+"""
+import argparse
+import glob
+import os
+import re
+
+HASH_BASIS = 2166136261
+HASH_PRIME = 16777619
+
+CMD_ADD_RE = re.compile(r'\bcmd_add(_coalesce)?\(\s*"([^"]+)"\s*,\s*(\w+)\s*,\s*"([^"]*)"\s*,\s*(\d+)\s*\)')
+CMD_CLASS_RE = re.compile(r'\bcmd_set_class\(\s*"([^"]+)"\s*,\s*(\w+)\s*\)')
+CMD_PRIO_RE = re.compile(r'\bcmd_set_priority\(\s*"([^"]+)"\s*,\s*(\w+)\s*\)')
+CMD_MAX_TIME_RE = re.compile(r'\bcmd_set_max_time\(\s*"([^"]+)"\s*,\s*([^;]+?)\s*\)\s*;')
+CMD_SHED_RE = re.compile(r'\bcmd_set_shed\(\s*"([^"]+)"\s*,\s*(\w+)\s*\)')
+CMD_INIT_CALL_RE = re.compile(r'^\s*(cmd_\w+_init)\(\s*\)\s*;')
+CMD_INIT_DEF_RE = re.compile(r'^\s*void\s+(cmd_\w+_init)\s*\(\s*void\s*\)')
+DIRECTIVE_RE = re.compile(r'^\s*#\s*(if|ifdef|ifndef|elif|else|endif)\b(.*)$')
+
+
+def cmd_hash(name, seed=0):
+    """
+    FNV-1a hash of a command name, same as cmd_hash_name in repoCommand.c
+    """
+    h = HASH_BASIS ^ seed
+    for c in name.encode():
+        h ^= c
+        h = (h * HASH_PRIME) & 0xFFFFFFFF
+    return h
+
+
+def _strip_comment(line):
+    line = re.sub(r'/\*.*?\*/', '', line)
+    return line.split('//')[0].strip()
+
+
+def _join(conds):
+    conds = [c for i, c in enumerate(conds) if c and c not in conds[:i]]
+    if not conds:
+        return ''
+    if len(conds) == 1:
+        return conds[0]
+    return ' && '.join('({})'.format(c) for c in conds)
+
+
+class Guards(object):
+    """
+    Track the preprocessor conditions of each line of a file
+    """
+    def __init__(self):
+        self.stack = []     # [previous conditions, current condition]
+
+    def feed(self, line):
+        """
+        :return: True if the line is a conditional directive
+        """
+        m = DIRECTIVE_RE.match(line)
+        if m is None:
+            return False
+        kind, expr = m.group(1), _strip_comment(m.group(2))
+        if kind == 'if':
+            self.stack.append([[], expr])
+        elif kind == 'ifdef':
+            self.stack.append([[], 'defined({})'.format(expr)])
+        elif kind == 'ifndef':
+            self.stack.append([[], '!defined({})'.format(expr)])
+        elif kind == 'elif':
+            prev, cur = self.stack[-1]
+            self.stack[-1] = [prev + [cur], expr]
+        elif kind == 'else':
+            prev, cur = self.stack[-1]
+            self.stack[-1] = [prev + [cur], '']
+        elif kind == 'endif':
+            self.stack.pop()
+        return True
+
+    def current(self):
+        conds = []
+        for prev, cur in self.stack:
+            conds += ['!({})'.format(p) for p in prev]
+            if cur:
+                conds.append(cur)
+        return _join(conds)
+
+
+def _init_guards(repo_cmd_file):
+    """
+    Conditions of the cmd_*_init calls in cmd_repo_init
+    """
+    guards = Guards()
+    inits = {}
+    with open(repo_cmd_file, 'r') as f:
+        for line in f:
+            if guards.feed(line):
+                continue
+            m = CMD_INIT_CALL_RE.match(line)
+            if m:
+                inits[m.group(1)] = guards.current()
+    return inits
+
+
+def parse_commands(system_dir):
+    """
+    Find the commands registered by the cmd*.c modules
+    :param system_dir: src/system directory
+    :return: dict name -> command (list of dicts, one per condition)
+    """
+    inits = _init_guards(os.path.join(system_dir, 'repoCommand.c'))
+    commands = {}
+    classes = {}
+    priorities = {}
+    max_times = {}
+    sheds = {}
+    for path in sorted(glob.glob(os.path.join(system_dir, 'cmd*.c'))):
+        with open(path, 'r') as f:
+            lines = f.readlines()
+        module = ''
+        for line in lines:
+            m = CMD_INIT_DEF_RE.match(line)
+            if m:
+                if m.group(1) not in inits:
+                    module = None   # Not registered by cmd_repo_init
+                else:
+                    module = inits[m.group(1)]
+                break
+        if module is None:
+            continue
+
+        guards = Guards()
+        for line in lines:
+            if guards.feed(line):
+                continue
+            for m in CMD_ADD_RE.finditer(line):
+                cmd = {'name': m.group(2), 'function': m.group(3), 'fmt': m.group(4),
+                       'nparams': int(m.group(5)), 'coalesce': 1 if m.group(1) else 0,
+                       'guard': _join([module, guards.current()])}
+                commands.setdefault(cmd['name'], []).append(cmd)
+            for m in CMD_CLASS_RE.finditer(line):
+                classes[m.group(1)] = (m.group(2), _join([module, guards.current()]))
+            for m in CMD_PRIO_RE.finditer(line):
+                priorities[m.group(1)] = (m.group(2), _join([module, guards.current()]))
+            for m in CMD_MAX_TIME_RE.finditer(line):
+                max_times[m.group(1)] = ('({})'.format(m.group(2)), _join([module, guards.current()]))
+            for m in CMD_SHED_RE.finditer(line):
+                sheds[m.group(1)] = (m.group(2), _join([module, guards.current()]))
+
+    for name, cmds in commands.items():
+        for cmd in cmds:
+            cmd['cls'] = classes.get(name, ('CMD_CLASS_EXCLUSIVE', ''))
+            cmd['priority'] = priorities.get(name, ('CMD_PRIO_NORMAL', ''))
+            cmd['max_ms'] = max_times.get(name, ('0', ''))
+            cmd['shed'] = sheds.get(name, ('CMD_LOAD_NORMAL', ''))
+    return commands
+
+
+def perfect_hash(names):
+    """
+    Minimal perfect hash (hash and displace). A name is at slot
+    cmd_hash(name, d) % n, with d = disp[cmd_hash(name) % n], or at slot -d-1
+    if d is negative.
+    :return: (disp, slot) lists, slot maps hash slots to names indexes
+    """
+    n = len(names)
+    buckets = [[] for _ in range(n)]
+    for i, name in enumerate(names):
+        buckets[cmd_hash(name) % n].append(i)
+
+    disp = [0] * n
+    slot = [-1] * n
+    for b in sorted(range(n), key=lambda b: -len(buckets[b])):
+        items = buckets[b]
+        if len(items) <= 1:
+            break
+        d = 1
+        while True:
+            slots = [cmd_hash(names[i], d) % n for i in items]
+            if len(set(slots)) == len(slots) and all(slot[s] < 0 for s in slots):
+                break
+            d += 1
+        disp[b] = d
+        for i, s in zip(items, slots):
+            slot[s] = i
+
+    free = [s for s in range(n) if slot[s] < 0]
+    for b in range(n):
+        if len(buckets[b]) == 1:
+            s = free.pop()
+            disp[b] = -s - 1
+            slot[s] = buckets[b][0]
+    return disp, slot
+
+
+def _cond_value(guard, conds):
+    """
+    Constant expression macro of a condition used by a class, priority,
+    max. time or shed load
+    """
+    if guard not in conds:
+        conds[guard] = 'CMD_TABLE_COND_{}'.format(len(conds))
+    return conds[guard]
+
+
+def _attr(value, default, guard, cmd_guard, conds):
+    if not guard or guard == cmd_guard:
+        return value
+    return '({} ? {} : {})'.format(_cond_value(guard, conds), value, default)
+
+
+def make_table(system_dir, fsource, fheader):
+    """
+    Write the command table files
+    :param system_dir: src/system directory
+    :param fsource: cmdTable.c path
+    :param fheader: cmdTable.h path
+    """
+    commands = parse_commands(system_dir)
+    names = sorted(commands.keys())
+    disp, slot = perfect_hash(names)
+
+    conds = {}
+    groups = []     # [guard, entries, disabled entries], consecutive commands with the same condition
+    for name in names:
+        alts = []
+        for cmd in commands[name]:
+            cls = _attr(cmd['cls'][0], 'CMD_CLASS_EXCLUSIVE', cmd['cls'][1], cmd['guard'], conds)
+            prio = _attr(cmd['priority'][0], 'CMD_PRIO_NORMAL', cmd['priority'][1], cmd['guard'], conds)
+            max_ms = _attr(cmd['max_ms'][0], '0', cmd['max_ms'][1], cmd['guard'], conds)
+            shed = _attr(cmd['shed'][0], 'CMD_LOAD_NORMAL', cmd['shed'][1], cmd['guard'], conds)
+            entry = '    {{{}, "{}", "{}", {}, {}, {}, {}, {}, {}}},'.format(
+                cmd['nparams'], cmd['fmt'], name, cmd['function'], cls, prio, cmd['coalesce'], max_ms, shed)
+            alts.append((cmd['guard'], entry))
+        none = '    CMD_TABLE_NONE("{}"),'.format(name)
+        if len(alts) == 1:
+            guard, entry = alts[0]
+            if groups and groups[-1][0] == guard:
+                groups[-1][1].append(entry)
+                groups[-1][2].append(none)
+            else:
+                groups.append([guard, [entry], [none]])
+            continue
+        # Same name registered under different conditions
+        lines = []
+        for i, (guard, entry) in enumerate(alts):
+            lines += ['#{} {}'.format('if' if i == 0 else 'elif', guard or '1'), entry]
+        groups.append([None, lines + ['#else', none, '#endif'], []])
+
+    entries = []
+    for guard, lines, nones in groups:
+        if not guard:
+            entries += lines
+        else:
+            entries += ['#if {}'.format(guard)] + lines + ['#else'] + nones + ['#endif']
+
+    def _rows(values):
+        rows = []
+        for i in range(0, len(values), 12):
+            rows.append('    ' + ', '.join(str(v) for v in values[i:i+12]) + ',')
+        return '\n'.join(rows)
+
+    cond_defs = []
+    for guard, macro in conds.items():
+        cond_defs += ['#if {}'.format(guard), '#define {} (1)'.format(macro),
+                      '#else', '#define {} (0)'.format(macro), '#endif']
+
+    header = HEADER_TEMPLATE.format(n=len(names))
+    source = SOURCE_TEMPLATE.format(conds='\n'.join(cond_defs) + ('\n\n' if cond_defs else ''),
+                                    entries='\n'.join(entries),
+                                    disp=_rows(disp), slot=_rows(slot))
+    with open(fheader, 'w') as f:
+        f.write(header)
+    with open(fsource, 'w') as f:
+        f.write(source)
+
+
+HEADER_TEMPLATE = '''/**
+ * @file  cmdTable.h
+ * @date 2020
+ * @copyright GNU GPL v3
+ *
+ * Static command table, generated by src/system/include/cmdtable.py from the
+ * cmd_add calls of the command modules. Do not edit, run cmdtable.py (or
+ * compile.py) after adding commands. Only used if SCH_CMD_STATIC is set.
+ */
+
+#ifndef SUCHAI_FLIGHT_SOFTWARE_CMDTABLE_H
+#define SUCHAI_FLIGHT_SOFTWARE_CMDTABLE_H
+
+#include "repoCommand.h"
+
+#define CMD_TABLE_LEN ({n})  ///< Commands in the static table
+
+/**
+ * Commands sorted by name. Disabled commands have no function.
+ */
+extern const cmd_list_t cmd_table[CMD_TABLE_LEN];
+
+/**
+ * Names perfect hash. The command at hash slot cmd_hash_name(name) % CMD_TABLE_LEN
+ * is cmd_table_slot[-d-1] if d = cmd_table_disp[slot] is negative or
+ * cmd_table_slot[cmd_hash_seed(name, d) % CMD_TABLE_LEN] otherwise.
+ */
+extern const int16_t cmd_table_disp[CMD_TABLE_LEN];
+extern const int16_t cmd_table_slot[CMD_TABLE_LEN];
+
+#endif //SUCHAI_FLIGHT_SOFTWARE_CMDTABLE_H
+'''
+
+SOURCE_TEMPLATE = '''/* Generated by src/system/include/cmdtable.py, do not edit. */
+
+#include "cmdTable.h"
+
+#if SCH_CMD_STATIC
+
+#define CMD_TABLE_NONE(name) {{0, "", name, NULL, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL}}
+
+{conds}const cmd_list_t cmd_table[CMD_TABLE_LEN] = {{
+{entries}
+}};
+
+const int16_t cmd_table_disp[CMD_TABLE_LEN] = {{
+{disp}
+}};
+
+const int16_t cmd_table_slot[CMD_TABLE_LEN] = {{
+{slot}
+}};
+
+#endif //SCH_CMD_STATIC
+'''
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(prog='cmdtable.py')
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    parser.add_argument('--system', type=str, default=root, help="src/system directory")
+    args = parser.parse_args()
+    make_table(args.system,
+               os.path.join(args.system, 'cmdTable.c'),
+               os.path.join(args.system, 'include', 'cmdTable.h'))
@@ -33,19 +33,34 @@ def parse_args():
     parser.add_argument('--hk', type=str, default="1")
     parser.add_argument('--sen', type=str, default="0")
     parser.add_argument('--adcs', type=str, default="0")
+    parser.add_argument('--dl', type=str, default="1")
     parser.add_argument('--test', type=str, default="0")
     parser.add_argument('--node', type=str, default="1")
     parser.add_argument('--zmq_in', type=str, default="tcp://127.0.0.1:8001")
     parser.add_argument('--zmq_out', type=str, default="tcp://127.0.0.1:8002")
+    parser.add_argument('--zmq_ipc', action="store_true", help="Use ZMQ IPC sockets, for nodes in the same host")
     parser.add_argument('--st_mode', type=str, default="1")
     parser.add_argument('--st_triple_wr', type=str, default="1")
     parser.add_argument('--buffers_csp', type=str, default="100")
     parser.add_argument('--socket_len', type=str, default="100")
+    parser.add_argument('--sim_nodes', type=str, default="0", help="Simulated nodes in this process (see taskSimNodes.h)")
 
     args = parser.parse_args()
     return args
 
 
+def zmq_ipc_endpoint(endpoint):
+    """
+    Convert a ZMQ TCP endpoint into the IPC (Unix socket) endpoint of the same
+    port, as named by the zmqhub.py --proto ipc option.
+    :param endpoint: ZMQ endpoint, ex: tcp://127.0.0.1:8001
+    :return: IPC endpoint, ex: ipc:///tmp/suchai_zmq_8001
+    """
+    if endpoint.startswith("ipc://"):
+        return endpoint
+    return "ipc:///tmp/suchai_zmq_{}".format(endpoint.split(":")[-1])
+
+
 def make_config(args, ftemp="config_template.h", fconfig="config.h"):
     """
     Write config file from template
@@ -69,15 +84,20 @@ def make_config(args, ftemp="config_template.h", fconfig="config.h"):
     config = config.replace("{{SCH_EN_HK}}", args.hk)
     config = config.replace("{{SCH_EN_SEN}}", args.sen)
     config = config.replace("{{SCH_EN_ADCS}}", args.adcs)
+    config = config.replace("{{SCH_EN_DL}}", args.dl)
     config = config.replace("{{SCH_EN_TEST}}", args.test)
     config = config.replace("{{SCH_COMM_NODE}}", args.node)
-    config = config.replace("{{SCH_ZMQ_OUT}}", args.zmq_out)
-    config = config.replace("{{SCH_ZMQ_IN}}", args.zmq_in)
+    zmq_out, zmq_in = args.zmq_out, args.zmq_in
+    if getattr(args, "zmq_ipc", False):
+        zmq_out, zmq_in = zmq_ipc_endpoint(zmq_out), zmq_ipc_endpoint(zmq_in)
+    config = config.replace("{{SCH_ZMQ_OUT}}", zmq_out)
+    config = config.replace("{{SCH_ZMQ_IN}}", zmq_in)
     config = config.replace("{{SCH_STORAGE}}", args.st_mode)
     config = config.replace("{{SCH_STORAGE_TRIPLE_WR}}", args.st_triple_wr)
     config = config.replace("{{SCH_STORAGE_PGUSER}}", "spel")
     config = config.replace("{{SCH_BUFFERS_CSP}}", args.buffers_csp)
     config = config.replace("{{SCH_CSP_SOCK_LEN}}", args.socket_len)
+    config = config.replace("{{SCH_SIM_NODES}}", args.sim_nodes)
 
     with open(fconfig, 'w') as new_config:
         new_config.write(config)
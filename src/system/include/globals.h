@@ -15,10 +15,12 @@
 
 extern osQueue dispatcher_queue;         ///< Commands queue
 extern osQueue executer_cmd_queue;       ///< Executer commands queue
-extern osQueue executer_stat_queue;      ///< Executer result queue
-extern osSemaphore repo_data_sem;        ///< Data repository mutex
+extern osQueue executer_io_queue;        ///< Executer shared-io workers commands queue
+extern osQueue executer_cpu_queue;       ///< Executer cpu workers commands queue
+extern osSemaphore executer_stat_sem;    ///< Executer results counters mutex
+extern osRWLock repo_data_sem;           ///< Data repository lock
 extern osSemaphore repo_data_fp_sem;     ///< Flight plan repository mutex
 extern osSemaphore repo_machine_sem;     ///< State status_machine repository mutex
-extern osSemaphore repo_cmd_sem;         ///< Command repository mutex
+extern osRWLock repo_cmd_sem;            ///< Command repository lock, read-mostly
 
 #endif //GLOBALS_H
@@ -42,6 +42,7 @@
 /* system includes */
 #include "repoData.h"
 #include "repoCommand.h"
+#include "bootSeq.h"
 
 /* Task includes */
 #include "taskInit.h"
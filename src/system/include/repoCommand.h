@@ -14,7 +14,21 @@
 #include <stdarg.h>
 
 #include "log_utils.h"
+#include "mem_utils.h"
 #include "globals.h"
+#include "osDelay.h"
+
+/**
+ * Number of buckets of the execution time histogram. Buckets are decades of
+ * microseconds: <100us, <1ms, <10ms, <100ms, <1s, <10s, >=10s
+ */
+#define CMD_STATS_BUCKETS (7)
+
+/**
+ * Number of buckets of the TC latency histograms (see cmd_lat_get). Buckets
+ * are powers of two of microseconds: <16us, <32us, ... <262ms, >=262ms
+ */
+#define CMD_LAT_BUCKETS (16)
 
 /* Add files with commands */
 #include "cmdOBC.h"
@@ -47,26 +61,111 @@
 /* Macros */
 /**
  * Send command to execution using dispatcherQueue (must be initialized). Blocks
- * if the queue is full
+ * if the queue is full, periodic and real-time tasks should use cmd_try_send
+ *
+ * @param cmd *cmd_type, pointer to command
+ */
+#define cmd_send(cmd) cmd_send_timeout(cmd, portMAX_DELAY)
+
+/**
+ * Send command to execution without blocking. If the dispatcher queue is full
+ * the command is dropped (see cmd_send_timeout)
  *
  * @param cmd *cmd_type, pointer to command
+ * @return Int. CMD_OK if sent, CMD_DROPPED if dropped or CMD_ERROR if NULL
  */
-#define cmd_send(cmd) if(cmd != NULL){osQueueSend(dispatcher_queue, &cmd, portMAX_DELAY);}
+#define cmd_try_send(cmd) cmd_send_timeout(cmd, 0)
+
+/**
+ * Send command to execution with a given priority, overriding the priority
+ * registered with the command (see cmd_set_priority).
+ *
+ * @param cmd *cmd_type, pointer to command
+ * @param prio cmd_priority_t, command priority
+ */
+#define cmd_send_prio(cmd, prio) if(cmd != NULL){(cmd)->priority = prio; cmd_send_timeout(cmd, portMAX_DELAY);}
+
+/**
+ * Binary parameters (see cmd_add_params_bin) start with this byte, followed by
+ * CMD_PARAMS_BIN_HEADER-1 padding bytes and the parameters struct.
+ */
+#define CMD_PARAMS_BIN_MAGIC ('\x1F')
+#define CMD_PARAMS_BIN_HEADER (8)
 
 /* Command definitions */
 /**
  * Define commands return values
  */
+#define CMD_CONTINUE 2       ///< Command not finished, the executer runs it again (see cmd_set_cursor)
 #define CMD_OK 1             ///< Command executed successfully
 #define CMD_ERROR 0          ///< Command not executed as expected
 #define CMD_SYNTAX_ERROR -1  ///< Command parameters syntax error
+#define CMD_DROPPED -2       ///< Command freed without execution (only reported to done callbacks)
+#define CMD_TIMEOUT -3       ///< Command not done before the timeout (only returned by cmd_future_wait)
 
 /**
  *  Defines the prototype of a command
  */
 typedef int (*cmdFunction)(char *fmt, char *params, int nparams);
 
-#define IF_PARSE_PARAMS(...) if(sscanf(params, fmt, ##__VA_ARGS) == nparams)
+struct cmd_type;
+/**
+ * Defines the prototype of a command done callback, @see cmd_set_done
+ */
+typedef void (*cmdDoneFunction)(struct cmd_type *cmd, int result, void *arg);
+
+/**
+ * Defines the prototype of a parameters release function, @see cmd_add_params_owned
+ */
+typedef void (*cmdReleaseFunction)(void *ref);
+
+#define IF_PARSE_PARAMS(...) if(cmd_scan_params(fmt, params, ##__VA_ARGS__) == nparams)
+
+/**
+ * Commands concurrency classes. Used by taskDispatcher to select the executer
+ * worker that runs the command (see cmd_set_class).
+ */
+typedef enum cmd_class{
+    CMD_CLASS_EXCLUSIVE = 0,    ///< Serialized in the main executer (default)
+    CMD_CLASS_SHARED_IO,        ///< IO bound, can run in parallel to exclusive commands
+    CMD_CLASS_CPU,              ///< CPU bound, can run in parallel to exclusive and IO commands
+} cmd_class_t;
+
+/**
+ * Commands priorities. High priority commands preempt the queued commands of
+ * the dispatcher and executer queues, and keep their FIFO order among them
+ * (see cmd_queue_add_lane).
+ */
+typedef enum cmd_priority{
+    CMD_PRIO_NORMAL = 0,        ///< FIFO order (default)
+    CMD_PRIO_HIGH,              ///< Before the normal commands, FIFO order
+} cmd_priority_t;
+
+/**
+ * Executers load levels, estimated by taskDispatcher from the executer queue
+ * depth and lag. Commands can be dropped from a load level on, so the queues
+ * do not grow unbounded latency under overload (see cmd_set_shed).
+ */
+typedef enum cmd_load{
+    CMD_LOAD_NORMAL = 0,        ///< Executers keep up with the commands
+    CMD_LOAD_HIGH,              ///< Executer queue depth or lag over the limits
+    CMD_LOAD_OVERLOAD,          ///< Executer queue depth or lag over twice the limits
+} cmd_load_t;
+
+/**
+ * Stages of the TC latency traces, from the TC reception to the result
+ * (see cmd_lat_begin)
+ */
+typedef enum cmd_lat_stage{
+    CMD_LAT_RX = 0,             ///< TC packet read by the communications task
+    CMD_LAT_BUILD,              ///< Command built from the TC
+    CMD_LAT_QUEUE,              ///< Command sent to the dispatcher queue
+    CMD_LAT_DISPATCH,           ///< Command sent to an executer queue
+    CMD_LAT_START,              ///< Handler started
+    CMD_LAT_END,                ///< Handler returned, last chunk of chunked commands
+    CMD_LAT_DONE,               ///< Result delivered to the TC reply (see cmd_done)
+    CMD_LAT_STAGES
+} cmd_lat_stage_t;
 
 /**
  * Structure to store a command sent to
@@ -77,25 +176,139 @@ typedef struct cmd_type{
     int nparams;                ///< Number of parameters
     char *fmt;                  ///< Format of parameters
     char *params;               ///< List of parameters (use malloc)
+    cmdReleaseFunction release; ///< Releases the parameters owned by another module (NULL if allocated here)
+    void *release_ref;          ///< Buffer released by the release function
     cmdFunction function;       ///< Command function
+    cmd_class_t cls;            ///< Command concurrency class
+    cmd_priority_t priority;    ///< Command priority
+    portTick t_dispatch;        ///< Tick count when the command was dispatched
+    uint8_t coalesce;           ///< Merge with identical queued commands
+    cmdDoneFunction done;       ///< Called with the result when the command is done (optional)
+    void *done_arg;             ///< Argument of the done callback
+    uint32_t max_ms;            ///< Max. runtime in ms, 0 for SCH_CMD_MAX_TIME_MS
+    uint32_t cursor;            ///< Progress saved by chunked commands (see cmd_set_cursor)
+    uint32_t exec_us;           ///< Execution time of the previous chunks of a chunked command
+    uint32_t wait_us;           ///< Queued time of the previous chunks of a chunked command
+    cmd_load_t shed;            ///< Load from which the command is dropped, CMD_LOAD_NORMAL to never drop it
+    uint32_t trace_id;          ///< TC latency trace id, 0 if not traced (see cmd_lat_begin)
+    portTick t_trace[CMD_LAT_STAGES];   ///< Tick count at each traced stage, 0 if not reached
 } cmd_t;
 
 /**
- * Structure to store the list of
- * available commands by name
+ * Command descriptor, used by the static command table (cmdTable.h). The
+ * repository copies it to its registry, split into the entries read by the
+ * dispatcher and executers and the names.
  */
 typedef struct cmd_list_type{
     int nparams;                ///< Number of parameters
-    char *fmt;                  ///< Format of parameters
-    char *name;                 ///< Command name (use malloc)
+    const char *fmt;            ///< Format of parameters (interned, constant in the static table)
+    const char *name;           ///< Command name (interned, constant in the static table)
     cmdFunction function;       ///< Command function
+    cmd_class_t cls;            ///< Command concurrency class
+    cmd_priority_t priority;    ///< Command default priority
+    uint8_t coalesce;           ///< Merge with identical queued commands
+    uint32_t max_ms;            ///< Max. runtime in ms, 0 for SCH_CMD_MAX_TIME_MS
+    cmd_load_t shed;            ///< Load from which the command is dropped, CMD_LOAD_NORMAL to never drop it
 } cmd_list_t;
 
+/**
+ * Command catalog descriptor (see cmd_catalog_get). The ground keeps the
+ * names of the known hashes, so it only fetches the changed commands.
+ */
+typedef struct cmd_catalog{
+    int id;                     ///< Command id
+    int nparams;                ///< Number of parameters
+    uint32_t name_hash;         ///< Command name hash (see cmd_catalog_hash)
+    uint32_t fmt_hash;          ///< Parameters format hash (see cmd_catalog_hash)
+} cmd_catalog_t;
+
+/**
+ * Command pool usage counters (see cmd_pool_get_stats)
+ */
+typedef struct cmd_pool_stats{
+    int size;                   ///< Number of pooled commands
+    int params_len;             ///< Inline parameters buffer length
+    int used;                   ///< Pooled commands in use
+    int max_used;               ///< Pooled commands in use high-water mark
+    int misses;                 ///< Commands allocated with malloc (pool exhausted)
+    int params_misses;          ///< Parameters allocated with malloc (too large)
+} cmd_pool_stats_t;
+
+/**
+ * Command execution timing statistics (see cmd_stats_get). Times are
+ * measured in microseconds.
+ */
+typedef struct cmd_stats{
+    uint32_t count;                         ///< Number of executions
+    uint32_t exec_min;                      ///< Min. execution time
+    uint32_t exec_max;                      ///< Max. execution time
+    uint64_t exec_sum;                      ///< Total execution time
+    uint32_t wait_max;                      ///< Max. time from dispatch to start
+    uint64_t wait_sum;                      ///< Total time from dispatch to start
+    uint32_t hist[CMD_STATS_BUCKETS];       ///< Execution time histogram
+    uint32_t overruns;                      ///< Executions longer than the max. runtime
+    uint32_t shed;                          ///< Commands dropped by the dispatcher under load
+    uint32_t full;                          ///< Commands dropped because the dispatcher queue was full
+} cmd_stats_t;
+
+/**
+ * TC latency statistics of a stage (see cmd_lat_get). Times are measured in
+ * microseconds from the previous stage, or from CMD_LAT_RX to CMD_LAT_DONE
+ * for the CMD_LAT_RX entry (the whole turnaround).
+ */
+typedef struct cmd_lat_stats{
+    uint32_t count;                         ///< Number of traced commands
+    uint32_t max;                           ///< Max. latency
+    uint64_t sum;                           ///< Total latency
+    uint32_t hist[CMD_LAT_BUCKETS];         ///< Latency histogram
+} cmd_lat_stats_t;
+
+/**
+ * Commands trace file format (see cmd_trace_start). The file starts with a
+ * cmd_trace_header_t followed by records, each one a cmd_trace_rec_t and @len
+ * bytes of data. Numbers are in the byte order of the OBC.
+ */
+#define CMD_TRACE_MAGIC   (0x54484353)  ///< "SCHT"
+#define CMD_TRACE_VERSION (1)
+
+/**
+ * Commands trace records types
+ */
+typedef enum cmd_trace_type{
+    CMD_TRACE_CMD = 0,          ///< Command sent, data are its parameters (none if @len is 0)
+    CMD_TRACE_NAME,             ///< Command @id name, data are "<name>\0<fmt>\0"
+    CMD_TRACE_ORIGIN,           ///< Task @origin name, data are "<name>\0"
+} cmd_trace_type_t;
+
+typedef struct __attribute__((__packed__)) cmd_trace_header{
+    uint32_t magic;             ///< CMD_TRACE_MAGIC
+    uint16_t version;           ///< CMD_TRACE_VERSION
+    uint16_t reserved;
+    uint32_t start;             ///< Unix time when the trace started
+} cmd_trace_header_t;
+
+typedef struct __attribute__((__packed__)) cmd_trace_rec{
+    uint32_t t_ms;              ///< Milliseconds since the trace started
+    uint16_t id;                ///< Command id, names are recorded the first time an id is seen
+    uint16_t len;               ///< Data bytes after the record
+    uint8_t type;               ///< Record type (cmd_trace_type_t)
+    uint8_t origin;             ///< Index of the task that sent the command
+} cmd_trace_rec_t;
+
 /* Function definitions */
 
 /**
  * Registers a command in the system
  *
+ * @note With SCH_CMD_STATIC the commands of the generated table (see
+ * cmdTable.h) are already registered and keep their table id, so the call
+ * only checks them. Other commands are added as usual, after the table.
+ *
+ * @note Formats made only of numeric conversions separated by spaces (ie.
+ * "%d %u %lf") are compiled here, then their text parameters are parsed once
+ * by @cmd_add_params_str. Handlers must read the parameters with
+ * @cmd_scan_params instead of sscanf.
+ *
  * @param function Pointer to command function
  * @param fparams Str. defines format of parameters, separated by spaces
  * @param nparam Int. number of parameters, according to @fparams
@@ -109,7 +322,486 @@ typedef struct cmd_list_type{
  *      cmd_add("bar", bar, "&d %d %f", 3);
  * @endcode
  */
-int cmd_add(char *name, cmdFunction function, char *fmt, int nparams);
+int cmd_add(const char *name, cmdFunction function, const char *fmt, int nparams);
+
+/**
+ * Registers a coalescing command in the system, @seealso cmd_add. If an
+ * identical command (same id and parameters) is already queued for execution,
+ * the dispatcher drops the new one instead of enqueuing it. Use it for
+ * idempotent commands sent periodically by several tasks.
+ *
+ * @note Parameters are compared as string or binary parameters, so do not use
+ * cmd_add_params_raw with coalescing commands.
+ *
+ * @param function Pointer to command function
+ * @param fparams Str. defines format of parameters, separated by spaces
+ * @param nparam Int. number of parameters, according to @fparams
+ * @return Int. Length of command list in case of success or CMD_ERROR (-1) if
+ * an error occurred.
+ *
+ * @code
+ *      cmd_add_coalesce("obc_prop_tle", obc_prop_tle, "%ld", 1);
+ * @endcode
+ */
+int cmd_add_coalesce(const char *name, cmdFunction function, const char *fmt, int nparams);
+
+/**
+ * Register a coalescing command as queued. Called by taskDispatcher before
+ * sending a command to the executer queues.
+ *
+ * @param cmd cmd_t *. Command to send
+ * @return Int. 1 if an identical command is already queued and @cmd has to be
+ * dropped, 0 if @cmd has to be sent.
+ */
+int cmd_coalesce_check(cmd_t *cmd);
+
+/**
+ * Unregister a queued coalescing command. Called by taskExecuter before
+ * executing a command, from this point identical commands are enqueued again.
+ *
+ * @param cmd cmd_t *. Command to execute
+ */
+void cmd_coalesce_done(cmd_t *cmd);
+
+/**
+ * Set the concurrency class of a registered command. Commands are added as
+ * CMD_CLASS_EXCLUSIVE, so they run serialized in the main executer. Commands
+ * that do not depend on other commands side effects can be tagged as
+ * CMD_CLASS_SHARED_IO or CMD_CLASS_CPU to run in parallel executer workers
+ * (see SCH_TASK_EXE_IO_WORKERS and SCH_TASK_EXE_CPU_WORKERS).
+ *
+ * @param name Str. Command name
+ * @param cls cmd_class_t. Concurrency class
+ * @return Int. CMD_OK or CMD_ERROR if the command does not exists, or it is
+ * in the static table with another class
+ *
+ * @code
+ *      cmd_add("obc_prop_tle", obc_prop_tle, "%ld", 1);
+ *      cmd_set_class("obc_prop_tle", CMD_CLASS_CPU);
+ * @endcode
+ */
+int cmd_set_class(char *name, cmd_class_t cls);
+
+/**
+ * Set the default priority of a registered command. Commands are added with
+ * CMD_PRIO_NORMAL priority. Use CMD_PRIO_HIGH for safety related commands such
+ * as watchdog resets that must not wait behind bulk telemetry or sampling.
+ *
+ * @param name Str. Command name
+ * @param prio cmd_priority_t. Command priority
+ * @return Int. CMD_OK or CMD_ERROR if the command does not exists, or it is
+ * in the static table with another priority
+ */
+int cmd_set_priority(char *name, cmd_priority_t prio);
+
+/**
+ * Set the max. runtime of a registered command. Commands are added with the
+ * SCH_CMD_MAX_TIME_MS budget. An execution that exceeds it is reported once,
+ * while it is still running (see cmd_check_overruns) or when it ends, and
+ * counted in the command statistics. The command is not interrupted, so
+ * commands that may block for long (IO with long timeouts) should also be
+ * offloaded to the workers with CMD_CLASS_SHARED_IO (see cmd_set_class).
+ *
+ * @param name Str. Command name
+ * @param max_ms Uint. Max. runtime in ms
+ * @return Int. CMD_OK or CMD_ERROR if the command does not exists, or it is
+ * in the static table with another max. runtime
+ *
+ * @code
+ *      cmd_add("tm_send_file", tm_send_file, "%s %d", 2);
+ *      cmd_set_max_time("tm_send_file", 10*60*1000);
+ * @endcode
+ */
+int cmd_set_max_time(char *name, uint32_t max_ms);
+
+/**
+ * Set the load level from which a registered command is dropped by the
+ * dispatcher instead of queued for execution (see cmd_shed_check). Commands
+ * are added with CMD_LOAD_NORMAL and are never dropped, so only optional work
+ * (debug, sampling, beacons) should be marked, never safety commands.
+ *
+ * @param name Str. Command name
+ * @param load cmd_load_t. Min. load level to drop the command
+ * @return Int. CMD_OK or CMD_ERROR if the command does not exists, or it is
+ * in the static table with another load level
+ *
+ * @code
+ *      cmd_add("obc_debug", obc_debug, "%d", 1);
+ *      cmd_set_shed("obc_debug", CMD_LOAD_HIGH);
+ * @endcode
+ */
+int cmd_set_shed(char *name, cmd_load_t load);
+
+/**
+ * Check if a command is dropped at the current executers load. Dropped
+ * commands are counted in the command statistics, the caller frees them.
+ *
+ * @param cmd cmd_t *. Command to check
+ * @param load cmd_load_t. Current load of the executer of the command
+ * @return Int. 1 if the command must be dropped, 0 otherwise
+ */
+int cmd_shed_check(cmd_t *cmd, cmd_load_t load);
+
+/**
+ * Get the executer lag of a commands class, the time from dispatch to start
+ * of the last command of the class that started.
+ *
+ * @param cls cmd_class_t. Commands class
+ * @return Uint. Lag in ms
+ */
+uint32_t cmd_get_lag(cmd_class_t cls);
+
+/**
+ * Add a high priority lane to a commands queue of @length commands read by
+ * @consumers tasks. High priority commands are then queued in the lane in FIFO
+ * order and a NULL marker is sent to the front of @queue. A consumer that
+ * receives the marker takes the oldest high priority command with
+ * @cmd_queue_high. Without a lane, high priority commands are sent to the
+ * front of the queue, in LIFO order in FreeRTOS. Called at start-up.
+ *
+ * @param queue osQueue. Dispatcher or executer queue
+ * @param length Int. Length of @queue
+ * @param consumers Int. Number of tasks receiving from @queue
+ * @return Int. CMD_OK, CMD_ERROR if the lane was not created
+ */
+int cmd_queue_add_lane(osQueue queue, int length, int consumers);
+
+/**
+ * Send a command to @queue according to its priority. High priority commands
+ * go to the lane of the queue (see cmd_queue_add_lane), or to its front.
+ *
+ * @param queue osQueue. Dispatcher or executer queue
+ * @param cmd cmd_t *. Command to send
+ * @param timeout Timeout in ticks
+ * @return Int. osQueueSend or osQueueSendToFront return value
+ */
+int cmd_queue_send(osQueue queue, cmd_t *cmd, uint32_t timeout);
+
+/**
+ * Take the oldest high priority command of @queue, after receiving a NULL
+ * marker from it (see cmd_queue_add_lane).
+ *
+ * @param queue osQueue. Queue the marker was received from
+ * @return cmd_t *. High priority command, NULL if @queue has no lane
+ */
+cmd_t *cmd_queue_high(osQueue queue);
+
+/**
+ * Send a command to the dispatcher queue, waiting up to @timeout for space.
+ * If the queue is still full the new command is dropped: it is freed (its
+ * done callback gets CMD_DROPPED) and counted in the command statistics, so
+ * the caller never keeps a command that was not sent.
+ *
+ * @param cmd cmd_t *. Command to send
+ * @param timeout Max. time to wait for space in ms, 0 to not block or
+ * portMAX_DELAY to wait forever
+ * @return Int. CMD_OK if sent, CMD_DROPPED if dropped or CMD_ERROR if @cmd is
+ * NULL
+ *
+ * @code
+ *      // Periodic tasks do not block on a full queue
+ *      cmd_t *cmd = cmd_get_idx(cmd_sample_id);
+ *      if(cmd_try_send(cmd) != CMD_OK)
+ *          LOGD(tag, "Sample skipped");
+ * @endcode
+ */
+int cmd_send_timeout(cmd_t *cmd, uint32_t timeout);
+
+/**
+ * Send a list of commands to the dispatcher queue in order, using a single
+ * queue operation (see osQueueSendBatch). Commands are sent in FIFO order,
+ * their priority is ignored. Commands that were not admitted are freed and
+ * counted as cmd_send_timeout drops.
+ *
+ * @param cmds cmd_t **. Array of commands to send
+ * @param n Int. Number of commands in @cmds
+ * @param all Int. If 1, send all commands or none of them if the queue does
+ * not have enough space (all-or-nothing admission)
+ * @param timeout Max. time to wait for space in ms, portMAX_DELAY to wait
+ * forever
+ * @return Int. Number of commands sent
+ *
+ * @code
+ *      cmd_t *cmds[2];
+ *      cmds[0] = cmd_build_from_str("obc_debug 1");
+ *      cmds[1] = cmd_build_from_str("obc_get_mem");
+ *      int sent = cmd_send_batch(cmds, 2, 1, portMAX_DELAY);
+ * @endcode
+ */
+int cmd_send_batch(cmd_t **cmds, int n, int all, uint32_t timeout);
+
+/**
+ * Send a command to the dispatcher queue from an interrupt service routine,
+ * according to its priority and without blocking. Commands can not be
+ * allocated, freed or logged from an ISR, so @cmd must be built in advance by
+ * a task (eg. with cmd_get_str and cmd_add_params_var) and if the queue is
+ * full the caller keeps it, to retry in the next interrupt or to free it from
+ * a task. Drops are not counted in the command statistics.
+ *
+ * @param cmd cmd_t *. Command to send, built by a task
+ * @param task_woken Int *. Set if the ISR should end with
+ * osYieldFromISR(*task_woken), see osQueueSendFromISR
+ * @return Int. CMD_OK if sent, CMD_DROPPED if the queue is full or CMD_ERROR
+ * if @cmd is NULL
+ *
+ * @code
+ *      static cmd_t *ready_cmd; // Built by the driver task
+ *      void drdy_isr(void)
+ *      {
+ *          int woken = 0;
+ *          if(ready_cmd != NULL && cmd_send_from_isr(ready_cmd, &woken) == CMD_OK)
+ *              ready_cmd = NULL;
+ *          osYieldFromISR(woken);
+ *      }
+ * @endcode
+ */
+int cmd_send_from_isr(cmd_t *cmd, int *task_woken);
+
+/**
+ * Start recording the commands sent with cmd_send_timeout and cmd_send_batch
+ * in a trace file, to replay them later as a benchmark (see test/test_replay).
+ * Records have the time, command, parameters and the task that sent the
+ * command. Only string and binary parameters are recorded whole, raw buffers
+ * (e.g. received TM frames) are cut at the first zero byte. Commands sent
+ * from interrupts are not recorded. A running trace is stopped first.
+ * Only with SCH_CMD_TRACE in GNU/Linux.
+ *
+ * @param path Str. Trace file, it is overwritten
+ * @param seconds Int. Stop the trace after these seconds, 0 to record until
+ * cmd_trace_stop
+ * @return Int. CMD_OK if started, CMD_ERROR if the file can not be created or
+ * SCH_CMD_TRACE is not set
+ *
+ * @code
+ *      // Record one day of commands
+ *      cmd_trace_start(SCH_CMD_TRACE_FILE, 24*3600);
+ * @endcode
+ */
+int cmd_trace_start(const char *path, int seconds);
+
+/**
+ * Stop recording the commands trace and close the file
+ * @return Int. Number of commands recorded, 0 if no trace was running
+ */
+int cmd_trace_stop(void);
+
+/**
+ * Set a callback called once the command is done, with the command result. It
+ * is called by taskExecuter after the execution, or with CMD_DROPPED if the
+ * command is freed before, because it was coalesced or not admitted. The
+ * callback runs in the executer task, so it should be short. The command is
+ * freed after the callback returns.
+ *
+ * @param cmd cmd_t *. Command to send
+ * @param done cmdDoneFunction. Callback, NULL to remove it
+ * @param arg void *. Argument passed to the callback
+ *
+ * @code
+ *      cmd_t *cmd = cmd_build_from_str("obc_get_mem");
+ *      cmd_set_done(cmd, my_done_callback, &my_state);
+ *      cmd_send(cmd);
+ * @endcode
+ */
+void cmd_set_done(cmd_t *cmd, cmdDoneFunction done, void *arg);
+
+/**
+ * Get a future to wait for the result of a command, once sent with cmd_send,
+ * cmd_send_prio or cmd_send_batch. It sets the done callback of the command
+ * (@see cmd_set_done). The future is released by cmd_future_wait when it
+ * returns the result, or by cmd_future_cancel.
+ *
+ * @note Do not wait for a command from a command function, the command may be
+ * queued behind the waiting one.
+ *
+ * @param cmd cmd_t *. Command to wait, not sent yet
+ * @return Int. Future id, -1 if there are already SCH_CMD_FUTURES futures
+ *
+ * @code
+ *      cmd_t *cmd = cmd_get_str("eps_update_status");
+ *      int future = cmd_future_get(cmd);
+ *      cmd_send(cmd);
+ *      // Do something else, then wait for the result
+ *      int result = cmd_future_wait(future, 1000);
+ *      if(result == CMD_TIMEOUT)
+ *          cmd_future_cancel(future);
+ * @endcode
+ */
+int cmd_future_get(cmd_t *cmd);
+
+/**
+ * Wait up to @timeout milliseconds for the result of a command. If the
+ * command is done the future is released, otherwise it can be waited again.
+ *
+ * @param future Int. Future id, @see cmd_future_get
+ * @param timeout Uint. Timeout in ms, 0 to only check the result
+ * @return Int. Command result, CMD_DROPPED if the command was freed without
+ * execution or CMD_TIMEOUT if it is not done yet
+ */
+int cmd_future_wait(int future, uint32_t timeout);
+
+/**
+ * Release a future without waiting for the command result
+ *
+ * @param future Int. Future id, @see cmd_future_get
+ */
+void cmd_future_cancel(int future);
+
+/**
+ * Send a command to execution and wait up to @timeout milliseconds for its
+ * result, @see cmd_future_get.
+ *
+ * @param cmd cmd_t *. Command to send
+ * @param timeout Uint. Timeout in ms
+ * @return Int. Command result, CMD_DROPPED if the command was freed without
+ * execution or CMD_TIMEOUT if it was not done before the timeout (or there are
+ * no futures, then the command is sent without waiting)
+ *
+ * @code
+ *      cmd_t *cmd = cmd_build_from_str("obc_set_tle 1 42788U ...");
+ *      if(cmd_send_wait(cmd, 1000) != CMD_OK)
+ *          LOGW(tag, "TLE not set");
+ * @endcode
+ */
+int cmd_send_wait(cmd_t *cmd, uint32_t timeout);
+
+/**
+ * Call and clear the done callback of a command, if any, and add its latency
+ * trace to the statistics (see cmd_lat_begin). Called by taskExecuter after
+ * the command execution.
+ *
+ * @param cmd cmd_t *. Executed command
+ * @param result Int. Command result
+ */
+void cmd_done(cmd_t *cmd, int result);
+
+/**
+ * Register a command as running, to check its runtime (see
+ * cmd_check_overruns). Called by taskExecuter before the execution, the
+ * command is unregistered by cmd_stats_add.
+ *
+ * @param cmd cmd_t *. Command to execute
+ * @return portTick. Tick count when the execution starts
+ */
+portTick cmd_exec_begin(cmd_t *cmd);
+
+/**
+ * Get the progress saved by a chunked command in its previous chunk, @see
+ * cmd_set_cursor
+ *
+ * @param params char *. Parameters received by the command function
+ * @return Uint. Saved cursor, 0 in the first chunk or if the command is not
+ * run by an executer
+ */
+uint32_t cmd_get_cursor(char *params);
+
+/**
+ * Save the progress of a chunked command. Commands that take long (eg. bulk
+ * downlinks) do a bounded amount of work, save where they stopped and return
+ * CMD_CONTINUE. The executer queues the command again behind the commands
+ * waiting for execution and runs it again with the same parameters, until it
+ * returns another result. The command is identified by its parameters
+ * pointer, so it must have parameters.
+ *
+ * @param params char *. Parameters received by the command function
+ * @param cursor Uint. Progress to save, returned by cmd_get_cursor
+ * @return Int. 0 if OK, -1 if the command is not run by an executer (eg. the
+ * function is called directly), then it must finish in one call
+ *
+ * @code
+ *      int send_samples(char *fmt, char *params, int nparams)
+ *      {
+ *          uint32_t next = cmd_get_cursor(params);
+ *          do {
+ *              next = send_some(next);
+ *              if(next == DONE)
+ *                  return CMD_OK;
+ *          } while(cmd_set_cursor(params, next) != 0);
+ *          return CMD_CONTINUE;
+ *      }
+ * @endcode
+ */
+int cmd_set_cursor(char *params, uint32_t cursor);
+
+/**
+ * Report the running commands that exceeded their max. runtime, once per
+ * execution. Called periodically by taskHousekeeping, so a hung command is
+ * detected while the executer is blocked.
+ *
+ * @return Int. Number of running commands over their max. runtime
+ */
+int cmd_check_overruns(void);
+
+/**
+ * Add a command execution to the timing statistics and unregister it as
+ * running (see cmd_exec_begin). Called by taskExecuter. The chunks of a
+ * command that returns CMD_CONTINUE are added up and counted as one execution
+ * with the last chunk.
+ *
+ * @param cmd cmd_t *. Executed command, cmd->t_dispatch must be set
+ * @param t_start portTick. Tick count when the execution started
+ * @param t_end portTick. Tick count when the execution ended
+ * @param last Int. 1 if the command is done, 0 if another chunk follows
+ */
+void cmd_stats_add(cmd_t *cmd, portTick t_start, portTick t_end, int last);
+
+/**
+ * Get a copy of the timing statistics of a command
+ *
+ * @param idx Int. Command index or id
+ * @param stats cmd_stats_t *. Structure to fill
+ * @return Int. CMD_OK or CMD_ERROR if the index is not valid
+ */
+int cmd_stats_get(int idx, cmd_stats_t *stats);
+
+/**
+ * Clear the timing statistics of all commands
+ */
+void cmd_stats_reset(void);
+
+/**
+ * Start the latency trace of a command built from a TC. The commands of a
+ * TC share the trace id, assigned with @trace_id 0 to the first one. The
+ * command stages are then marked by the repository, the dispatcher and the
+ * executers, and the trace is added to the latency statistics when the
+ * command is done (see cmd_done). Without SCH_CMD_LATENCY it does nothing.
+ *
+ * @param cmd cmd_t *. Command built from the TC, can be NULL
+ * @param trace_id Uint32. Trace id of the TC, 0 to assign a new one
+ * @param t_rx portTick. Tick count when the TC packet was read
+ * @return Uint32. Trace id of the TC, 0 if not traced
+ */
+uint32_t cmd_lat_begin(cmd_t *cmd, uint32_t trace_id, portTick t_rx);
+
+/**
+ * Mark a stage of a traced command, only the first time it is reached.
+ * Untraced commands are ignored.
+ *
+ * @param cmd cmd_t *. Command
+ * @param stage cmd_lat_stage_t. Stage reached now
+ */
+void cmd_lat_mark(cmd_t *cmd, cmd_lat_stage_t stage);
+
+/**
+ * Get a copy of the TC latency statistics, one per stage
+ *
+ * @param stats cmd_lat_stats_t[CMD_LAT_STAGES]. Statistics to fill
+ * @return Uint32. Last trace id assigned
+ */
+uint32_t cmd_lat_get(cmd_lat_stats_t *stats);
+
+/**
+ * Short name of the latency measured at a stage (see cmd_lat_stats_t), ie.
+ * "exec" for CMD_LAT_END and "total" for CMD_LAT_RX
+ *
+ * @param stage Int. Stage
+ * @return Str. Name, "" if not valid
+ */
+const char *cmd_lat_get_name(int stage);
+
+/**
+ * Clear the TC latency statistics
+ */
+void cmd_lat_reset(void);
 
 /**
  * Create a new command by name
@@ -119,24 +811,44 @@ int cmd_add(char *name, cmdFunction function, char *fmt, int nparams);
  *                 command does not exists. Use @cmd_free to free allocated
  *                 memory.
  */
-cmd_t * cmd_get_str(char *name);
+cmd_t * cmd_get_str(const char *name);
+
+/**
+ * Resolve a command name to its index or id. The index is stable after
+ * cmd_repo_init, so tasks that send the same commands periodically can resolve
+ * them once at start-up and then use @cmd_get_idx, avoiding the name lookup.
+ *
+ * @param name Str. Command name
+ * @return Int. Command index, -1 if the command does not exists.
+ *
+ * @code
+ *      int cmd_dbg_id = cmd_resolve("obc_debug");
+ *      while(1)
+ *      {
+ *          cmd_t *cmd_dbg = cmd_get_idx(cmd_dbg_id);
+ *          cmd_add_params_var(cmd_dbg, 0);
+ *          cmd_send(cmd_dbg);
+ *      }
+ * @endcode
+ */
+int cmd_resolve(const char *name);
 
 /**
  * Create a new command by index or id
  *
- * @param idx Int command index or Id.
+ * @param idx Int command index or Id (see @cmd_resolve).
  * @return cmd_t Command structure. Null if command does not exists.
  */
 cmd_t * cmd_get_idx(int idx);
 
 /**
- * Find the name of a command by id. This function allocates memory for the
- * string so the user must free the array.
+ * Find the name of a command by id. The name is shared by the repository and
+ * is valid until cmd_repo_close, do not modify or free it.
  *
  * @param idx Int. Command index or id
- * @return Str. Command name.
+ * @return Str. Command name, NULL if the index is not valid.
  */
-char * cmd_get_name(int idx);
+const char *cmd_get_name(int idx);
 
 /**
  * Fills command parameters as raw data using memcpy.@len bytes will be copied
@@ -156,9 +868,34 @@ char * cmd_get_name(int idx);
  */
 void cmd_add_params_raw(cmd_t *cmd, void *params, int len);
 
+/**
+ * Fills command parameters with a buffer owned by another module, without a
+ * copy. The command takes the ownership of the buffer: @release is called with
+ * @ref when the command is freed (after the execution or if it is dropped).
+ * Use it to pass large received buffers, such as CSP packets, to the handler.
+ *
+ * @note the ownership is transferred even if @cmd is NULL, in that case
+ * @release is called immediately.
+ *
+ * @param cmd cmd_t *. Command to fill parameters
+ * @param params void *. Parameters, must be valid until @release is called
+ * @param ref void *. Buffer to release, usually the one containing @params
+ * @param release cmdReleaseFunction. Function to release @ref
+ *
+ * @code
+ *      cmd_t *parse = cmd_get_str("tm_parse_status");
+ *      cmd_add_params_owned(parse, packet->data, packet, csp_buffer_free);
+ *      cmd_send(parse);
+ * @endcode
+ */
+void cmd_add_params_owned(cmd_t *cmd, void *params, void *ref, cmdReleaseFunction release);
+
 /**
  * Fills command parameters as string
  * @note does not check the parameters format or if the command requires param.
+ * @note if the command format was compiled (see @cmd_add) the parameters are
+ * parsed and filled as binary parameters. If the parsing fails the string is
+ * kept, so the handler reports the syntax error.
  *
  * @param cmd cmd_t. Command to fill parameters
  * @param params Str. String with parameters
@@ -194,10 +931,108 @@ void cmd_add_params_str(cmd_t *cmd, char *params);
  */
 void cmd_add_params_var(cmd_t *cmd, ...);
 
+/**
+ * Fills command parameters by variables as binary data, avoiding the string
+ * conversion. Variables are packed as the fields of a C struct, according to
+ * the registered parameters format (ie. "%d %lf" packs as struct{int; double}).
+ * Handlers can read the fields with @cmd_scan_params or casting
+ * @cmd_params_bin. Formats with %s or %n are filled as string instead.
+ *
+ * @note the types follow the scanf conversions used by the handler: %f is
+ * packed as a float and %lf as a double.
+ *
+ * @param cmd cmd_t. Command to fill parameters
+ * @param ... List of variables to fill as parameters
+ *
+ * @code
+ *      cmd_t *bar = cmd_get_str("bar"); // bar.fmt is '%d %d %lf'
+ *      cmd_add_params_bin(bar, 1, 2, 3.4);
+ * @endcode
+ */
+void cmd_add_params_bin(cmd_t *cmd, ...);
+
+/**
+ * Fills command parameters from packed binary data, as received in binary
+ * tele-commands. If the command format was compiled (see @cmd_add) the data
+ * are the parameters in network byte order and without padding: 2 bytes for
+ * %hd, 8 bytes for %lld and %lf, and 4 bytes for the other conversions
+ * (including %ld). Otherwise the data is the parameters string, without the
+ * null terminator. Empty data leaves the command without parameters.
+ *
+ * @param cmd cmd_t. Command to fill parameters
+ * @param data Packed parameters
+ * @param len Packed parameters length in bytes
+ * @return CMD_OK, CMD_SYNTAX_ERROR if the length does not match the format,
+ * or CMD_ERROR for invalid arguments
+ *
+ * @code
+ *      cmd_t *bar = cmd_get_str("bar"); // bar.fmt is '%d %hd'
+ *      uint8_t data[] = {0, 0, 0, 1, 0xFF, 0xFE}; // 1, -2
+ *      cmd_add_params_packed(bar, data, sizeof(data));
+ * @endcode
+ */
+int cmd_add_params_packed(cmd_t *cmd, const void *data, int len);
+
+/**
+ * Check if the command parameters were filled as binary data
+ *
+ * @param params Str. Command parameters
+ * @return 1 if binary, 0 otherwise
+ */
+int cmd_params_is_bin(char *params);
+
+/**
+ * Get the parameters struct of binary parameters
+ *
+ * @param params Str. Command parameters
+ * @return Pointer to the parameters struct or NULL if not binary parameters
+ *
+ * @code
+ *      typedef struct { int a; int b; double c; } bar_params_t;
+ *      bar_params_t *p = (bar_params_t *)cmd_params_bin(params);
+ *      if(p != NULL) printf("%lf", p->c);
+ * @endcode
+ */
+void *cmd_params_bin(char *params);
+
+/**
+ * Read the command parameters as sscanf does, but also accepts binary
+ * parameters (see cmd_add_params_bin and cmd_add_params_str). Use inside
+ * command handlers in place of sscanf(params, fmt, ...) to support text and
+ * binary parameters.
+ *
+ * @param fmt Str. Parameters format
+ * @param params Str. Command parameters
+ * @param ... Pointers to variables to fill
+ * @return Number of parameters read, -1 if params is NULL
+ */
+int cmd_scan_params(char *fmt, char *params, ...);
+
+/**
+ * Check that a parameters string matches the registered parameters format of a
+ * command, without executing it. The string is parsed as the handler would do
+ * with sscanf(params, fmt, ...), so it is valid if every conversion (except %n
+ * and suppressed ones) is read. Used to reject bad parameters when commands
+ * are stored for later execution, like flight plan entries.
+ * @param idx Int. Command index or id (see @cmd_resolve)
+ * @param params Str. Command parameters, can be NULL for commands without
+ * parameters. Binary parameters are not checked.
+ * @return Int. CMD_OK, CMD_SYNTAX_ERROR if the parameters do not match the
+ * format or CMD_ERROR if the command does not exists
+ * @code
+ *      int idx = cmd_resolve("obc_debug"); // fmt is "%d"
+ *      assert(cmd_check_params(idx, "1") == CMD_OK);
+ *      assert(cmd_check_params(idx, "abc") == CMD_SYNTAX_ERROR);
+ * @endcode
+ */
+int cmd_check_params(int idx, char *params);
+
 /**
  * Returns a new command with parameters form a string with the format:
  * <command> [parameters]. The [parameters] field is optional. Returns NULL if
- * the command is not found or in case of errors.
+ * the command is not found or in case of errors. The command can also be given
+ * by its numeric id (see cmd_catalog_get), ie. "12 1", saving the name in
+ * tele-commands.
  *
  * @param buff str. A null terminated string with the format <command> [parameters]
  * @return cmd_t. A new command (uses malloc) or NULL in case of errors.
@@ -211,21 +1046,77 @@ void cmd_add_params_var(cmd_t *cmd, ...);
 cmd_t *cmd_build_from_str(char *buff);
 
 /**
- * Destroys a command and frees the allocated memory
+ * Destroys a command and frees the allocated memory. Pooled commands are
+ * returned to the command pool. A pending done callback is called with
+ * CMD_DROPPED.
  */
 void cmd_free(cmd_t *cmd);
 
+/**
+ * Get the command pool usage counters. Commands are taken from a pool of
+ * SCH_CMD_POOL_SIZE entries with SCH_CMD_POOL_PARAMS_LEN bytes of inline
+ * parameters, and fall back to malloc when the pool is exhausted.
+ *
+ * @param stats cmd_pool_stats_t *. Structure to fill
+ */
+void cmd_pool_get_stats(cmd_pool_stats_t *stats);
+
 /**
 * Print the list of registered commands
 */
 void cmd_print_all(void);
 
+/**
+ * List the commands whose name starts with @prefix, in name order, using the
+ * sorted command index. Used by the console to complete command names.
+ *
+ * @param prefix Str. Name prefix, "" to list all commands
+ * @param callback Function called with each name, return 0 to stop
+ * @param arg Callback argument
+ * @return Int. Number of commands listed
+ *
+ * @code
+ *      // Completes "obc_g" to obc_get_mem, obc_get_sensors, ...
+ *      cmd_complete("obc_g", add_completion, completions);
+ * @endcode
+ */
+int cmd_complete(const char *prefix, int (*callback)(const char *name, void *arg), void *arg);
+
 /**
  * Saves and returns list of available commands
- * @return char *. List of commands.
+ * @return char *. List of commands, free with sch_free. NULL if fails.
  */
 char *cmd_save_all(void);
 
+/**
+ * FNV-1a hash of a string, used for the command names and formats of the
+ * catalog. Same as cmd_hash in cmdtable.py.
+ *
+ * @param str Str. String to hash
+ * @return Hash
+ */
+uint32_t cmd_catalog_hash(const char *str);
+
+/**
+ * Get the catalog descriptor of a command
+ *
+ * @param idx Int. Command index or id
+ * @param entry Descriptor to fill
+ * @return CMD_OK, or CMD_ERROR if there is no command with this id
+ */
+int cmd_catalog_get(int idx, cmd_catalog_t *entry);
+
+/**
+ * Get the catalog version, the FNV-1a hash of the descriptors of all the
+ * commands by id. Each descriptor is hashed as the uint32 id, nparams,
+ * name_hash and fmt_hash, least significant byte first. The ground compares
+ * it with the version of its catalog to skip the catalog download.
+ *
+ * @param count Set to the number of commands, if not NULL
+ * @return Catalog version
+ */
+uint32_t cmd_catalog_version(int *count);
+
 /**
  * Initializes the command buffer adding null_cmd
  *
@@ -258,13 +1149,12 @@ int cmd_null(char *fmt, char *params, int nparams);
 int cmd_print(cmd_t* cmd);
 
 /**
- * Find the format of a command by name. This function allocates memory for the
- * string so the user must free the array.
+ * Find the format of a command by name. The format is shared by the repository
+ * and is valid until cmd_repo_close, do not modify or free it.
  *
- * @param name *char. Pointer to char variable. The function allocates memory so
- * make sure to free the array after use.
- * @return char* with the command's format
+ * @param name Str. Command name
+ * @return Str. Command format, empty if the command does not exist
  */
-char* cmd_get_fmt(char* name);
+const char *cmd_get_fmt(const char *name);
 
 #endif /* CMD_REPO_H */
@@ -26,8 +26,11 @@
 #include "globals.h"
 #include "log_utils.h"
 #include "math_utils.h"
+#include "prof_utils.h"
+#include "mem_utils.h"
 #include "data_storage.h"
 #include "osSemphr.h"
+#include "osDelay.h"
 #include "repoDataSchema.h"
 
 //TODO: Delete
@@ -40,12 +43,14 @@ typedef enum dat_stmachine_action_emum {
     ACT_PAUSE= 0,
     ACT_START,
     ACT_STAND_BY,
+    ACT_BURST,
     ACT_LAST
 } dat_stmachine_action_t;
 
 typedef enum dat_stmachine_state_enum {
     ST_PAUSE = 0,
     ST_SAMPLING,
+    ST_BURST,       ///< Sampling to the RAM buffers, @see sen_burst_take_samples
     ST_LAST
 } dat_stmachine_state_t;
 
@@ -56,6 +61,7 @@ typedef struct dat_stmachine_s{
     unsigned int step;
     int samples_left;
     unsigned int total_sensors;
+    unsigned int step_ms;       ///< Sampling period in ms, used instead of step if not 0
 } dat_stmachine_t;
 
 extern dat_stmachine_t status_machine;
@@ -69,6 +75,16 @@ extern dat_stmachine_t status_machine;
  */
 int dat_set_stmachine_state(dat_stmachine_action_t action, unsigned int step, int nsamples);
 
+/**
+ * Change sample status_machine state, with the sampling period in milliseconds.
+ * The period resolution is SCH_SEN_TICK_MS.
+ *
+ * @param action action to take (ACT_PAUSE, ACT_START, ACT_STAND_BY, ACT_BURST)
+ * @param step_ms sampling period in milliseconds
+ * @param nsamples maximum samples to take, if value is-1 the status_machine will take unlimited samples
+ */
+int dat_set_stmachine_state_ms(dat_stmachine_action_t action, unsigned int step_ms, int nsamples);
+
 /**
  * Return if sensor is active in sensor sampling
  * @param payload
@@ -83,7 +99,9 @@ int dat_stmachine_is_sensor_active(int payload, int active_payloads, int n_paylo
  *      Both repo's mutexes.
  *      The storage system (if permanent memory is being used).
  *      The system status repo, on default values.
- *      The flight plan repo, on default values.
+ *      The flight plan repo, on default values. In RAM mode
+ *      (@SCH_STORAGE_MODE 0) with @SCH_FP_JOURNAL enabled, the flight plan
+ *      is restored from its journal.
  *
  * @see dat_repo_close
  */
@@ -92,12 +110,38 @@ void dat_repo_init(void);
 /**
  * Performs a cleanup and closes repository resources.
  *
- * Closes the storage system (if permanent memory is being used).
+ * Writes back the status variables cache and closes the storage system (if
+ * permanent memory is being used).
  *
  * @see dat_repo_init
  */
 void dat_repo_close(void);
 
+/**
+ * Prepare the status repository for a software reset (see obc_reset). With
+ * SCH_STORAGE_NOINIT the status variables kept in RAM are sealed, so the next
+ * boot uses them without reading the storage. Any other reset, or a change in
+ * the RAM after the seal, discards them. Pending writes are flushed in any
+ * case.
+ *
+ * @return 0 OK, -1 Error
+ */
+int dat_repo_seal(void);
+
+/**
+ * Write back the cached status variables that were modified since the last
+ * sync. Only if @SCH_STORAGE_MODE > 0 and @SCH_STORAGE_CACHE is enabled,
+ * otherwise variables are always written through. It also flushes the
+ * writes buffered by the storage driver (see storage_sync).
+ *
+ * In RAM mode (@SCH_STORAGE_MODE 0) it writes the flight plan changes to the
+ * flight plan journal, compacting the journal when it is larger than
+ * @SCH_FP_JOURNAL_SIZE. Changes made after the last sync are lost on a reset.
+ *
+ * @return 0 OK, -1 Error
+ */
+int dat_repo_sync(void);
+
 /**
  * Sets a status/config variable by index
  *
@@ -137,15 +181,82 @@ value32_t dat_get_status_var(dat_status_address_t index);
  */
 value32_t dat_get_status_var_name(char *name);
 
+/**
+ * Sets @n consecutive status/config variables, starting at index, inside one
+ * critical zone. Readers using @c dat_get_status_vars do not see a partially
+ * updated group (eg. a quaternion).
+ *
+ * @param index Index or address of the first variable to set
+ * @param n Number of variables to set
+ * @param values Array of @n values to set
+ * @return 0 if OK, -1 in case of error
+ */
+int dat_set_status_vars(dat_status_address_t index, int n, const value32_t *values);
+
+/**
+ * Gets @n consecutive status/config variables, starting at index, inside one
+ * critical zone. External storage is read with one range query per copy.
+ *
+ * @param index Index or address of the first variable to get
+ * @param n Number of variables to get
+ * @param values Array of at least @n values to store the result
+ * @return 0 if OK, -1 in case of error
+ */
+int dat_get_status_vars(dat_status_address_t index, int n, value32_t *values);
+
+/**
+ * Check if a status variable is derived. Derived variables are computed when
+ * read (eg. dat_rtc_date_time is the current time) and writing them has no
+ * effect, so they are not written periodically to the storage.
+ *
+ * @param index Index of the variable
+ * @return 1 if the variable is derived, 0 otherwise
+ */
+int dat_status_var_is_derived(dat_status_address_t index);
+
+/**
+ * Status variable change callback, @see dat_subscribe
+ */
+typedef void (*dat_status_notify_t)(dat_status_address_t index, value32_t value, void *arg);
+
+/**
+ * Subscribe to the changes of a status variable, instead of polling it. When
+ * @c dat_set_status_var or @c dat_set_status_vars set a value different from
+ * the last one notified, @callback is called with the new value by the task
+ * that set it, out of the repository critical zone, so it must be short (eg.
+ * copy the value or set a flag). If @callback is NULL, @bits of @event are set
+ * instead (@see osEventWait). Derived variables are never notified.
+ *
+ * @param index Index of the variable
+ * @param callback Function to call, or NULL to set the event bits
+ * @param arg Argument passed to @callback
+ * @param event Event to set if @callback is NULL
+ * @param bits Event bits to set
+ * @return Subscription id, -1 if the variable is not valid or there are
+ * already SCH_DAT_SUBS_MAX subscriptions
+ */
+int dat_subscribe(dat_status_address_t index, dat_status_notify_t callback, void *arg, osEvent *event, uint32_t bits);
+
+/**
+ * Cancel a subscription
+ *
+ * @param id Subscription id returned by @c dat_subscribe
+ * @return 0 if OK, -1 if the subscription does not exist
+ */
+int dat_unsubscribe(int id);
+
 
 /**
  * Gets an executable command from the flight plan repo.
  *
  * Given an elapsed seconds counter (assumed to be system time), sets the other parameter pointers to the values
- * of the first command found in the repo that is eligible for execution.
+ * of the earliest command in the repo that is eligible for execution (its time is less than or equal to
+ * elapsed_sec, so commands are not lost if the time is skipped). Commands with the same time are returned in
+ * upload order.
  *
- * Deletes the command from the repo before returning. If the command is periodic, the function saves a copy with
- * updated execution time (the period is added to the time of the next execution execution).
+ * Deletes the command from the repo before returning. If the command is periodic and has executions left, the
+ * same entry is moved to its next execution time (the period is added to its time) instead. Executions missed
+ * while the system was off are skipped and count as executed.
  *
  * @param elapsed_sec Time for finding executable commands
  * @param command Pointer for saving the command name
@@ -157,17 +268,58 @@ value32_t dat_get_status_var_name(char *name);
 int dat_get_fp(int elapsed_sec, char* command, char* args, int* executions, int* period);
 
 /**
- * Saves a new command into the flight plan repo.
+ * Gets an executable command from the flight plan repo, as @c dat_get_fp, with
+ * all the entry fields. The entry unixtime and ms are the time the command was
+ * scheduled to execute.
+ *
+ * @param elapsed_sec Time for finding executable commands
+ * @param entry Pointer for saving the entry
+ * @return 0 if OK, -1 if no command was found
+ */
+int dat_get_fp_entry(int elapsed_sec, fp_entry_t *entry);
+
+/**
+ * Gets the execution time of the earliest command in the flight plan repo.
+ *
+ * @return Unix-time of the next command, -1 if the flight plan is empty
+ */
+int dat_get_fp_next(void);
+
+/**
+ * Waits until a command is added to the flight plan repo (@c dat_set_fp) or
+ * the timeout expires. Used by the flight plan task to sleep until the next
+ * command is due.
+ *
+ * @param timeout_ms Max. time to wait in milliseconds
+ * @return 1 if a command was added, 0 if the timeout expired
+ */
+int dat_wait_fp(uint32_t timeout_ms);
+
+/**
+ * Saves a new command into the flight plan repo. Several commands can be scheduled at the same time, they are
+ * executed in upload order.
  *
  * @param timetodo Future time when the command should execute
  * @param command Command name
  * @param args Command arguments
- * @param executions Amount of times the command has to execute pero periodic cycle
+ * @param executions Amount of times the command has to execute. A periodic command uses one entry for all its
+ * executions
  * @param periodical Period of periodical execution of the command, in unix-time
  * @return 0 if OK, 1 if no available space was found //
  */
 int dat_set_fp(int timetodo, char* command, char* args, int executions, int periodical);
 
+/**
+ * Saves @n new commands into the flight plan repo, taking the repo lock once.
+ * With SQL storage the commands are inserted in one transaction, in RAM they
+ * are sorted into the flight plan index once. All commands are saved or none.
+ *
+ * @param entries Pointer to an array of @n flight plan entries
+ * @param n Number of entries
+ * @return 0 if OK, otherwise no command was saved (not enough space or error)
+ */
+int dat_set_fp_batch(fp_entry_t *entries, int n);
+
 /**
  * Deletes the first command in the flight plan repo that's eligible for execution at the specified time.
  *
@@ -184,7 +336,8 @@ int dat_del_fp(int timetodo);
 int dat_reset_fp(void);
 
 /**
- * Prints all values in the flight plan repo.
+ * Prints all values in the flight plan repo, SCH_FP_PAGE commands at a time
+ * (@see dat_get_fp_page) so the repo is not locked while printing.
  *
  * An example of the printed data is:
  *
@@ -195,6 +348,69 @@ int dat_reset_fp(void);
  */
 int dat_show_fp (void);
 
+/**
+ * Visit the flight plan commands scheduled up to time @to, one at a time and
+ * without copying the flight plan to memory. Commands are visited sorted by
+ * time, except with memory mapped or flash storage.
+ *
+ * @note The flight plan repo is locked while visiting, so @visit must not call
+ * other flight plan functions.
+ *
+ * @param to Max. time of the visited commands, -1 to visit all
+ * @param visit Function called for each command, returns non zero to stop
+ * @param arg Pointer passed to @visit
+ * @return Number of visited commands, -1 in case of errors
+ */
+int dat_foreach_fp(int to, fp_visit_t visit, void *arg);
+
+/**
+ * Position in the flight plan listing, @see dat_get_fp_page. Set @time to the
+ * first time to list (-1 for all) and @skip to 0 to start.
+ */
+typedef struct fp_cursor {
+    int time;                       ///< Time of the next commands to list
+    int skip;                       ///< Commands at @time already listed
+} fp_cursor_t;
+
+/**
+ * Copy the next page of flight plan commands, sorted by time, and move the
+ * cursor after them. The repo is only locked while reading one page, so a
+ * large flight plan can be listed or downloaded page by page while it keeps
+ * executing. Commands added or deleted between pages are listed if they are
+ * after the cursor.
+ *
+ * @code
+ *      fp_cursor_t cursor = {-1, 0};
+ *      fp_entry_t page[SCH_FP_PAGE];
+ *      int n;
+ *      while((n = dat_get_fp_page(&cursor, page, SCH_FP_PAGE)) > 0)
+ *          ...
+ * @endcode
+ *
+ * @param cursor Listing position, moved to the next page
+ * @param page Buffer of @max commands
+ * @param max Page size
+ * @return Number of commands copied, 0 at the end of the flight plan, -1 in
+ * case of errors
+ */
+int dat_get_fp_page(fp_cursor_t *cursor, fp_entry_t *page, int max);
+
+/**
+ * Adds a flight plan execution jitter sample, the delay between the scheduled
+ * time of a command and the time it was sent to execution.
+ *
+ * @param jitter_us Jitter in microseconds
+ */
+void dat_add_fp_jitter(int32_t jitter_us);
+
+/**
+ * Gets the flight plan execution jitter statistics.
+ *
+ * @param jitter Pointer for saving the statistics
+ * @param reset Set to 1 to reset the statistics after reading them
+ */
+void dat_get_fp_jitter(fp_jitter_t *jitter, int reset);
+
 /**
  * Gets the current system time in seconds.
  *
@@ -202,6 +418,50 @@ int dat_show_fp (void);
  */
 time_t dat_get_time(void);
 
+/**
+ * Gets the current system time in seconds and the milliseconds after it.
+ * Platforms without a sub-second clock always set ms to 0.
+ *
+ * @param ms Pointer for saving the milliseconds (0-999)
+ * @return time_t Current system unix-time
+ */
+time_t dat_get_time_ms(int *ms);
+
+/**
+ * Cached system clock. The housekeeping task samples the clock once per period
+ * with dat_clock_tick(), so tasks share the same timebase without reading the
+ * clock at every call. The cache is up to one housekeeping period old, use
+ * dat_get_time_ms() for precise waits.
+ */
+typedef struct dat_clock {
+    time_t utc;         ///< Unix time [s]
+    int ms;             ///< Milliseconds after utc (0-999)
+    portTick tick;      ///< System tick count when sampled (see osTaskGetTickCount)
+    double jd;          ///< Julian date of utc
+    double dec_year;    ///< Decimal year of utc, for the IGRF model
+} dat_clock_t;
+
+/**
+ * Samples the system clock into the cache. Called every housekeeping period
+ * and after dat_set_time().
+ */
+void dat_clock_tick(void);
+
+/**
+ * Gets the cached system clock. Before the first dat_clock_tick() the clock
+ * is read directly.
+ *
+ * @param clock Pointer for saving the clock
+ */
+void dat_clock_get(dat_clock_t *clock);
+
+/**
+ * Gets the cached unix time, a cheap dat_get_time() for timestamps.
+ *
+ * @return time_t Cached system unix-time
+ */
+time_t dat_clock_utc(void);
+
 /**
  * Updates the system time, adding one second to it.
  *
@@ -238,6 +498,60 @@ int dat_show_time(int format);
  */
 int dat_add_payload_sample(void* data, int payload);
 
+/**
+ * Queue a data struct from an interrupt service routine (eg. a sensor data
+ * ready interrupt), to be stored by a task with dat_flush_isr_samples. It does
+ * not block, allocate or take locks: samples go to a lock-free ring with
+ * SCH_SEN_ISR_RING_LEN slots. Only one ISR (or ISRs that do not nest) should
+ * add samples.
+ *
+ * @param data Pointer to the struct to add, up to SCH_SEN_ISR_SAMPLE_MAX bytes
+ * @param payload Payload id to store
+ * @return 0 if OK, -1 if the ring is full (the sample is dropped and counted)
+ * or the sample is too large
+ */
+int dat_add_payload_sample_from_isr(void* data, int payload);
+
+/**
+ * Store the samples queued with dat_add_payload_sample_from_isr, in order.
+ * Called by one task, taskSensors every SCH_SEN_TICK_MS.
+ *
+ * @param max Max. number of samples to store
+ * @return Number of samples stored
+ */
+int dat_flush_isr_samples(int max);
+
+/**
+ * Adds an array of data structs to the payload table in one storage
+ * transaction. The payload index is updated once with the total.
+ *
+ * The payload index is counted in RAM and the slots are reserved atomically,
+ * so several tasks can add samples of the same payload. The index status
+ * variable is published once the samples and the previous ones are stored,
+ * and is persisted as the other status variables (@see dat_repo_sync).
+ *
+ * @param data Pointer to an array of @n structs to add
+ * @param payload Payload id to store
+ * @param n Number of structs to add
+ * @return The new payload index if OK, -1 if an error occurred
+ */
+int dat_add_payload_samples(void* data, int payload, int n);
+
+/**
+ * Adds an array of data structs received from another node. In the ground
+ * station each source node has its own payload tables and index (@see
+ * storage_set_payload_data_node), so the samples of several satellites are
+ * kept apart and stored concurrently. Samples of this node, or any node in
+ * the flight software, are added as dat_add_payload_samples.
+ *
+ * @param data Pointer to an array of @n structs to add
+ * @param payload Payload id to store
+ * @param n Number of structs to add
+ * @param node Source node
+ * @return The new payload index of the node if OK, -1 if an error occurred
+ */
+int dat_add_payload_samples_node(void* data, int payload, int n, int node);
+
 /**
  *
  * @param data
@@ -248,7 +562,65 @@ int dat_add_payload_sample(void* data, int payload);
 int dat_get_payload_sample(void*data, int payload, int index);
 
 /**
- * Gets a data struct from the payload table.
+ * Gets @count consecutive data structs from the payload table, starting at
+ * index @start, with a single storage query.
+ *
+ * @param data Pointer to an array of at least @count structs
+ * @param payload Payload id to get
+ * @param start Index of the first struct
+ * @param count Number of structs to get
+ * @return Number of structs found, -1 if an error occurred
+ */
+int dat_get_payload_samples(void* data, int payload, int start, int count);
+
+/**
+ * Gets @count consecutive data structs received from another node, starting
+ * at index @start of the node tables (@see dat_add_payload_samples_node).
+ * Missing structs are zeroed. Samples of this node are read as
+ * dat_get_payload_samples.
+ *
+ * @param data Pointer to an array of at least @count structs
+ * @param payload Payload id to get
+ * @param start Index of the first struct
+ * @param count Number of structs to get
+ * @param node Source node
+ * @return Number of structs found, -1 if an error occurred
+ */
+int dat_get_payload_samples_node(void* data, int payload, int start, int count, int node);
+
+/**
+ * Gets the payload index of a node, the index of the next struct to add.
+ *
+ * @param payload Payload id
+ * @param node Source node
+ * @return The payload index, -1 if an error occurred
+ */
+int dat_get_payload_index_node(int payload, int node);
+
+/**
+ * Gets the index of the first struct of the payload table with a timestamp
+ * after or equal to @timestamp, without reading the samples one by one
+ * (@see storage_get_payload_index_time).
+ *
+ * @param payload Payload id to search
+ * @param timestamp Unix time
+ * @return The struct index, the payload index if all the structs are older,
+ * -1 if an error occurred
+ */
+int dat_get_payload_index_time(int payload, uint32_t timestamp);
+
+/**
+ * Gets the number of payload samples read from the storage that failed their
+ * CRC32C check and were returned zeroed (@see storage_payload_crc_errors).
+ *
+ * @param reset Set to clear the counter
+ * @return Corrupted samples read since the last reset
+ */
+uint32_t dat_get_payload_crc_errors(int reset);
+
+/**
+ * Gets a data struct from the payload table. The last @SCH_STORAGE_RECENT
+ * structs added are read from RAM, without accessing the storage.
  *
  * @param data Pointer to the struct where the values will be stored
  * @param payload Payload id to get
@@ -257,6 +629,20 @@ int dat_get_payload_sample(void*data, int payload, int index);
  */
 int dat_get_recent_payload_sample(void* data, int payload, int offset);
 
+/**
+ * Deletes the oldest payload samples over the retention limits, at most
+ * @SCH_STORAGE_RETAIN_STEP samples per payload, taking the payload lock once
+ * per payload, so it can run often without long pauses. Each payload keeps
+ * the last @SCH_STORAGE_RETAIN_ROWS samples, and the acknowledged samples
+ * (drp_ack_* variables) older than @SCH_STORAGE_RETAIN_AGE seconds are
+ * deleted. Samples are deleted oldest first, so the acknowledged samples are
+ * deleted before the others. The housekeeping task runs it every
+ * @SCH_STORAGE_RETAIN_PERIOD seconds (see drp_trim).
+ *
+ * @return Number of samples deleted, -1 if an error occurred
+ */
+int dat_trim_payloads(void);
+
 /**
  * Deletes all memory sections in NOR FLASH.
  *
@@ -273,6 +659,45 @@ int dat_delete_memory_sections(void);
  */
 int dat_print_payload_struct(void* data, unsigned int payload);
 
+/**
+ * Get the fields descriptor of a payload struct. Descriptors are built once
+ * (see dat_repo_init) parsing data_map data_order and var_names, so payload
+ * storage, binding and print functions only loop over the fields.
+ *
+ * @param payload Payload id
+ * @return Pointer to the descriptor, or NULL if the payload is not valid
+ */
+const dat_payload_schema_t *dat_get_payload_schema(int payload);
+
+/**
+ * Compress an array of payload structs for downlink. Fields are stored column
+ * by column, each value as the zigzag LEB128 varint of its difference with the
+ * previous sample (the first sample against 0), and runs of zero bytes as a
+ * zero followed by the run length - 1. Constant and slowly varying fields
+ * (sat_index, timestamp, temperatures) take one or two bytes per sample.
+ *
+ * @param samples Pointer to an array of @n structs
+ * @param payload Payload id
+ * @param n Number of structs
+ * @param out Buffer for the compressed data
+ * @param max Size of @out in bytes
+ * @return Compressed length in bytes, -1 if it does not fit in @max or the
+ * payload descriptor does not match its struct
+ */
+int dat_compress_payload_samples(const void *samples, int payload, int n, uint8_t *out, int max);
+
+/**
+ * Reverse dat_compress_payload_samples
+ *
+ * @param in Compressed data
+ * @param len Compressed data length in bytes
+ * @param payload Payload id
+ * @param n Number of structs to decode
+ * @param samples Pointer to an array of at least @n structs
+ * @return 0 if OK, -1 if the data is corrupted or the payload is not valid
+ */
+int dat_decompress_payload_samples(const uint8_t *in, int len, int payload, int n, void *samples);
+
 /**
  * Helper function to get var results in payload struct
  *
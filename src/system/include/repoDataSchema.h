@@ -16,14 +16,32 @@
 /**
  * Struct for storing a single timed command, set to execute in the future.
  */
-typedef struct __attribute__((packed)) fp_entry {
-    int unixtime;               ///< Unix-time, sets when the command should next execute
-    char* cmd;                  ///< Command to execute
-    char* args;                 ///< Command's arguments
-    int executions;             ///< Amount of times the command will be executed per periodic cycle
-    int periodical;             ///< Period of time between executions
+typedef struct fp_entry {
+    int unixtime;                           ///< Unix-time, sets when the command should next execute
+    int ms;                                 ///< Milliseconds after unixtime (0-999)
+    int executions;                         ///< Amount of times the command will be executed per periodic cycle
+    int periodical;                         ///< Period of time between executions
+    char cmd[SCH_CMD_MAX_STR_NAME];         ///< Command to execute
+    char args[SCH_CMD_MAX_STR_PARAMS];      ///< Command's arguments
 } fp_entry_t;
 
+/**
+ * Flight plan entries visitor (see dat_foreach_fp). Returns 0 to continue with
+ * the next entry, other value to stop.
+ */
+typedef int (*fp_visit_t)(const fp_entry_t *entry, void *arg);
+
+/**
+ * Flight plan execution jitter, the delay between the time an entry was
+ * scheduled (unixtime and ms) and the time it was sent to execution
+ */
+typedef struct fp_jitter{
+    uint32_t count;                         ///< Measured executions
+    int32_t last_us;                        ///< Last jitter in microseconds
+    int32_t max_us;                         ///< Max. jitter in microseconds
+    int64_t sum_us;                         ///< Sum of jitters, for the mean
+} fp_jitter_t;
+
 /**
  * Enum constants for dynamically identifying system status fields at execution time.
  *
@@ -104,6 +122,14 @@ typedef enum dat_status_address_enum {
     dat_tgt_q1,                   ///< Target quaternion (Inertial to body)
     dat_tgt_q2,                   ///< Target quaternion (Inertial to body)
     dat_tgt_q3,                   ///< Target quaternion (Inertial to body)
+    dat_ads_sun_x,                ///< Sun direction model x (ECI)
+    dat_ads_sun_y,                ///< Sun direction model y (ECI)
+    dat_ads_sun_z,                ///< Sun direction model z (ECI)
+    dat_ads_eclipse,              ///< Eclipse state (0: sunlit, 1: penumbra, 2: umbra)
+    dat_ads_sunlit,               ///< Visible fraction of the solar disk (0: umbra, 1: sunlit)
+    dat_ads_est_ms,               ///< ADCS estimate period in use [ms]
+    dat_ads_ctrl_ms,              ///< ADCS control period in use [ms]
+    dat_ads_load,                 ///< ADCS loop CPU utilization [%]
 
     /// EPS: Energy power system
     dat_eps_vbatt,                ///< Voltage of the battery [mV]
@@ -118,6 +144,9 @@ typedef enum dat_status_address_enum {
     dat_drp_sta,                 ///< Status data index
     dat_drp_stt,
     dat_drp_stt_exp_time,
+    dat_drp_stat,                 ///< Payload statistics data index
+    dat_drp_trig,                 ///< Payload trigger events data index
+    dat_drp_stz,                  ///< Status delta data index
 
     /// Memory: Current send acknowledge data
     dat_drp_ack_temp,             ///< Temperature data acknowledge
@@ -126,6 +155,9 @@ typedef enum dat_status_address_enum {
     dat_drp_ack_sta,             ///< Status data index acknowledge
     dat_drp_ack_stt,
     dat_drp_ack_stt_exp_time,
+    dat_drp_ack_stat,             ///< Payload statistics data acknowledge
+    dat_drp_ack_trig,             ///< Payload trigger events data acknowledge
+    dat_drp_ack_stz,              ///< Status delta data acknowledge
 
     /// Sample Machine: Current state of sample status_machine
     dat_drp_mach_action,          ///< Current action of sampling state machine
@@ -133,6 +165,7 @@ typedef enum dat_status_address_enum {
     dat_drp_mach_step,            ///< Step in seconds of sampling state machine
     dat_drp_mach_payloads,        ///< Binary data storing active payload being sampled
     dat_drp_mach_left,            ///< Samples left for sampling state machine
+    dat_drp_mach_step_ms,         ///< Step in milliseconds of sampling state machine, used instead of the step if not 0
 
     /// Add a new status variables address here
     //dat_custom,                 ///< Variable description
@@ -222,6 +255,14 @@ static const dat_sys_var_t dat_status_list[] = {
         {dat_ads_q1,            "ads_q1",            'f', DAT_IS_STATUS, -1},         ///< Attitude quaternion (Inertial to body)
         {dat_ads_q2,            "ads_q2",            'f', DAT_IS_STATUS, -1},         ///< Attitude quaternion (Inertial to body)
         {dat_ads_q3,            "ads_q3",            'f', DAT_IS_STATUS, -1},         ///< Attitude quaternion (Inertial to body)
+        {dat_ads_sun_x,         "ads_sun_x",         'f', DAT_IS_STATUS, 0},          ///< Sun direction model x (ECI)
+        {dat_ads_sun_y,         "ads_sun_y",         'f', DAT_IS_STATUS, 0},          ///< Sun direction model y (ECI)
+        {dat_ads_sun_z,         "ads_sun_z",         'f', DAT_IS_STATUS, 0},          ///< Sun direction model z (ECI)
+        {dat_ads_eclipse,       "ads_eclipse",       'u', DAT_IS_STATUS, 0},          ///< Eclipse state (0: sunlit, 1: penumbra, 2: umbra)
+        {dat_ads_sunlit,        "ads_sunlit",        'f', DAT_IS_STATUS, {.f=1}},     ///< Visible fraction of the solar disk (0: umbra, 1: sunlit)
+        {dat_ads_est_ms,        "ads_est_ms",        'u', DAT_IS_STATUS, 0},          ///< ADCS estimate period in use [ms]
+        {dat_ads_ctrl_ms,       "ads_ctrl_ms",       'u', DAT_IS_STATUS, 0},          ///< ADCS control period in use [ms]
+        {dat_ads_load,          "ads_load",          'f', DAT_IS_STATUS, 0},          ///< ADCS loop CPU utilization [%]
         {dat_eps_vbatt,         "eps_vbatt",         'u', DAT_IS_STATUS, 0},         ///< Voltage of the battery [mV]
         {dat_eps_cur_sun,       "eps_cur_sun",       'u', DAT_IS_STATUS, 0},         ///< Current from boost converters [mA]
         {dat_eps_cur_sys,       "eps_cur_sys",       'u', DAT_IS_STATUS, 0},         ///< Current from the battery [mA]
@@ -232,6 +273,9 @@ static const dat_sys_var_t dat_status_list[] = {
         {dat_drp_sta,           "drp_sta",           'u', DAT_IS_STATUS, 0},          ///< Status data index
         {dat_drp_stt,           "drp_stt",           'u', DAT_IS_STATUS, 0},          ///< STT data index
         {dat_drp_stt_exp_time,  "drp_stt_exp_time",  'u', DAT_IS_STATUS, 0},          ///< STT data exposure time index
+        {dat_drp_stat,          "drp_stat",          'u', DAT_IS_STATUS, 0},          ///< Payload statistics data index
+        {dat_drp_trig,          "drp_trig",          'u', DAT_IS_STATUS, 0},          ///< Payload trigger events data index
+        {dat_drp_stz,           "drp_stz",           'u', DAT_IS_STATUS, 0},          ///< Status delta data index
         {dat_drp_mach_action,   "drp_mach_action",   'u', DAT_IS_STATUS, 0},          ///<
         {dat_drp_mach_state,    "drp_mach_state",    'u', DAT_IS_STATUS, 0},          ///<
         {dat_drp_mach_left,     "drp_mach_left",     'u', DAT_IS_STATUS, 0},          ///<
@@ -256,8 +300,12 @@ static const dat_sys_var_t dat_status_list[] = {
         {dat_drp_ack_sta,       "drp_ack_sta",       'u', DAT_IS_CONFIG, 0},          ///< Status data index acknowledge
         {dat_drp_ack_stt,       "drp_ack_stt",       'u', DAT_IS_CONFIG, 0},          ///< Stt data index acknowledge
         {dat_drp_ack_stt_exp_time, "drp_ack_stt_exp_time",'u', DAT_IS_CONFIG, 0},     ///< Stt data exp time index acknowledge
+        {dat_drp_ack_stat,      "drp_ack_stat",      'u', DAT_IS_CONFIG, 0},          ///< Payload statistics data acknowledge
+        {dat_drp_ack_trig,      "drp_ack_trig",      'u', DAT_IS_CONFIG, 0},          ///< Payload trigger events data acknowledge
+        {dat_drp_ack_stz,       "drp_ack_stz",       'u', DAT_IS_CONFIG, 0},          ///< Status delta data acknowledge
         {dat_drp_mach_step,     "drp_mach_step",     'd', DAT_IS_CONFIG, 0},          ///<
-        {dat_drp_mach_payloads, "drp_mach_payloads", 'u', DAT_IS_CONFIG, 0}           ///<
+        {dat_drp_mach_payloads, "drp_mach_payloads", 'u', DAT_IS_CONFIG, 0},          ///<
+        {dat_drp_mach_step_ms,  "drp_mach_step_ms",  'u', DAT_IS_CONFIG, 0}           ///< Step in milliseconds of sampling state machine
 };
 ///< The dat_status_last_var constant serves for looping through all status variables
 static const int dat_status_last_var = sizeof(dat_status_list) / sizeof(dat_status_list[0]);
@@ -285,51 +333,77 @@ typedef enum payload_id {
     sta_sensors,            ///< Status Variables
     stt_sensors,
     stt_exp_time_sensors,
+    stat_sensors,           ///< Payload statistics, @see sen_reduce_set
+    trig_sensors,           ///< Payload trigger events, @see sen_reduce_trig
+    stz_sensors,            ///< Status variables deltas, @see sen_delta_set
     //custom_sensor,           ///< Add custom sensors here
     last_sensor             ///< Dummy element, the amount of payload variables
 } payload_id_t;
 
+/**
+ * Payload fields X-macro lists. Each payload is defined once, as a list of
+ * F(type, name, fmt, kind) entries for the fields after the index and
+ * timestamp that start every payload struct. The name is the struct member
+ * and the table column, fmt the data_map format and kind the field type
+ * (dat_field_type_t). A list generates the packed struct
+ * (DAT_PAYLOAD_STRUCT), the data_map strings (DAT_PAYLOAD_ORDER and
+ * DAT_PAYLOAD_NAMES) and the field descriptors (DAT_PAYLOAD_FIELDS), so they
+ * can not get out of step. To add a payload define its list, its struct and
+ * its data_map entry from the list.
+ */
+#define DAT_FIELD_MEMBER(type, name, fmt, kind)     type name;
+#define DAT_FIELD_ORDER(type, name, fmt, kind)      " " fmt
+#define DAT_FIELD_NAME(type, name, fmt, kind)       " " #name
+#define DAT_FIELD_DESC(type, name, fmt, kind)       {#name, fmt, kind, sizeof(type), 0},
+
+#define DAT_PAYLOAD_STRUCT(tag, FIELDS) \
+    typedef struct __attribute__((__packed__)) tag { \
+        uint32_t index; \
+        uint32_t timestamp; \
+        FIELDS(DAT_FIELD_MEMBER) \
+    } tag##_t;
+#define DAT_PAYLOAD_ORDER(FIELDS)   ("%u %u" FIELDS(DAT_FIELD_ORDER))
+#define DAT_PAYLOAD_NAMES(FIELDS)   ("sat_index timestamp" FIELDS(DAT_FIELD_NAME))
+/// Field descriptors initializer, the offsets are set by dat_get_payload_schema
+#define DAT_PAYLOAD_FIELDS(FIELDS)  {{"sat_index", "%u", DAT_FIELD_UINT, sizeof(uint32_t), 0}, \
+                                     {"timestamp", "%u", DAT_FIELD_UINT, sizeof(uint32_t), 0}, \
+                                     FIELDS(DAT_FIELD_DESC)}
+
 /**
  * Struct for storing temperature data.
  */
-typedef struct __attribute__((__packed__)) temp_data {
-    uint32_t index;
-    uint32_t timestamp;
-    float obc_temp_1;
-    float obc_temp_2;
-    float obc_temp_3;
-} temp_data_t;
+#define DAT_TEMP_FIELDS(F) \
+    F(float, obc_temp_1, "%f", DAT_FIELD_FLOAT) \
+    F(float, obc_temp_2, "%f", DAT_FIELD_FLOAT) \
+    F(float, obc_temp_3, "%f", DAT_FIELD_FLOAT)
+DAT_PAYLOAD_STRUCT(temp_data, DAT_TEMP_FIELDS)
 
 /**
  * Struct for storing data collected by ads sensors.
  */
-typedef struct __attribute__((__packed__)) ads_data {
-    uint32_t index;
-    uint32_t timestamp;
-    float acc_x;            ///< Gyroscope acceleration value along the x axis
-    float acc_y;            ///< Gyroscope acceleration value along the y axis
-    float acc_z;            ///< Gyroscope acceleration value along the z axis
-    float mag_x;            ///< Magnetometer x axis
-    float mag_y;            ///< Magnetometer y axis
-    float mag_z;            ///< Magnetometer z axis
-} ads_data_t;
+#define DAT_ADS_FIELDS(F) \
+    F(float, acc_x, "%f", DAT_FIELD_FLOAT)      /* Gyroscope acceleration value along the x axis */ \
+    F(float, acc_y, "%f", DAT_FIELD_FLOAT)      /* Gyroscope acceleration value along the y axis */ \
+    F(float, acc_z, "%f", DAT_FIELD_FLOAT)      /* Gyroscope acceleration value along the z axis */ \
+    F(float, mag_x, "%f", DAT_FIELD_FLOAT)      /* Magnetometer x axis */ \
+    F(float, mag_y, "%f", DAT_FIELD_FLOAT)      /* Magnetometer y axis */ \
+    F(float, mag_z, "%f", DAT_FIELD_FLOAT)      /* Magnetometer z axis */
+DAT_PAYLOAD_STRUCT(ads_data, DAT_ADS_FIELDS)
 
 /**
  * Struct for storing data collected by eps housekeeping.
  */
-typedef struct __attribute__((__packed__)) eps_data {
-    uint32_t index;
-    uint32_t timestamp;
-    uint32_t cursun;            ///< Current from boost converters [mA]
-    uint32_t cursys;            ///< Current out of battery [mA]
-    uint32_t vbatt;            ///< Voltage of battery [mV]
-    int32_t temp1;
-    int32_t temp2;
-    int32_t temp3;
-    int32_t temp4;
-    int32_t temp5;
-    int32_t temp6;              ///< Temperature sensors [0 = TEMP1, TEMP2, TEMP3, TEMP4, BATT0, BATT1]
-} eps_data_t;
+#define DAT_EPS_FIELDS(F) \
+    F(uint32_t, cursun, "%u", DAT_FIELD_UINT)   /* Current from boost converters [mA] */ \
+    F(uint32_t, cursys, "%u", DAT_FIELD_UINT)   /* Current out of battery [mA] */ \
+    F(uint32_t, vbatt, "%u", DAT_FIELD_UINT)    /* Voltage of battery [mV] */ \
+    F(int32_t, temp1, "%d", DAT_FIELD_INT)      /* Temperature sensors [TEMP1, TEMP2, TEMP3, TEMP4, BATT0, BATT1] */ \
+    F(int32_t, temp2, "%d", DAT_FIELD_INT) \
+    F(int32_t, temp3, "%d", DAT_FIELD_INT) \
+    F(int32_t, temp4, "%d", DAT_FIELD_INT) \
+    F(int32_t, temp5, "%d", DAT_FIELD_INT) \
+    F(int32_t, temp6, "%d", DAT_FIELD_INT)
+DAT_PAYLOAD_STRUCT(eps_data, DAT_EPS_FIELDS)
 
 
 /**
@@ -345,22 +419,63 @@ typedef struct __attribute__((__packed__)) sta_data {
 /**
  * Struct for storing data collected by stt.
  */
-typedef struct __attribute__((__packed__)) stt_data {
-    uint32_t index;
-    uint32_t timestamp;
-    float ra;
-    float dec;
-    float roll;
-    int time;
-    float exec_time;
-} stt_data_t;
-
-typedef struct __attribute__((__packed__)) stt_exp_time_data{
+#define DAT_STT_FIELDS(F) \
+    F(float, ra, "%f", DAT_FIELD_FLOAT) \
+    F(float, dec, "%f", DAT_FIELD_FLOAT) \
+    F(float, roll, "%f", DAT_FIELD_FLOAT) \
+    F(int, time, "%d", DAT_FIELD_INT) \
+    F(float, exec_time, "%f", DAT_FIELD_FLOAT)
+DAT_PAYLOAD_STRUCT(stt_data, DAT_STT_FIELDS)
+
+#define DAT_STT_EXP_TIME_FIELDS(F) \
+    F(int, exp_time, "%d", DAT_FIELD_INT) \
+    F(int, n_stars, "%d", DAT_FIELD_INT)
+DAT_PAYLOAD_STRUCT(stt_exp_time_data, DAT_STT_EXP_TIME_FIELDS)
+
+/**
+ * Struct for storing the statistics of a payload field over a window of
+ * samples (on-board data reduction). The timestamp is the one of the last
+ * sample in the window.
+ */
+#define DAT_STAT_FIELDS(F) \
+    F(uint32_t, payload, "%u", DAT_FIELD_UINT)  /* Reduced payload id */ \
+    F(uint32_t, field, "%u", DAT_FIELD_UINT)    /* Field position in the payload struct (see data_map var_names) */ \
+    F(uint32_t, n, "%u", DAT_FIELD_UINT)        /* Samples in the window */ \
+    F(float, min, "%f", DAT_FIELD_FLOAT) \
+    F(float, max, "%f", DAT_FIELD_FLOAT) \
+    F(float, mean, "%f", DAT_FIELD_FLOAT) \
+    F(float, std, "%f", DAT_FIELD_FLOAT)        /* Population standard deviation */
+DAT_PAYLOAD_STRUCT(stat_data, DAT_STAT_FIELDS)
+
+/**
+ * Struct for storing a payload trigger event (on-board data reduction). The
+ * captured samples are stored in the payload table. The timestamp is the one
+ * of the sample that fired the trigger.
+ */
+#define DAT_TRIG_FIELDS(F) \
+    F(uint32_t, payload, "%u", DAT_FIELD_UINT)  /* Payload id */ \
+    F(uint32_t, field, "%u", DAT_FIELD_UINT)    /* Trigger field position in the payload struct */ \
+    F(float, value, "%f", DAT_FIELD_FLOAT)      /* Field value that fired the trigger */ \
+    F(uint32_t, first, "%u", DAT_FIELD_UINT)    /* Payload index of the first captured sample */ \
+    F(uint32_t, count, "%u", DAT_FIELD_UINT)    /* Captured samples, pre-trigger, trigger and post-trigger */
+DAT_PAYLOAD_STRUCT(trig_data, DAT_TRIG_FIELDS)
+
+#define DAT_STZ_MASK    (3)     ///< Status delta changed vars mask words, one bit per dat_status_list entry
+#define DAT_STZ_VALUES  (16)    ///< Status delta values, more changed vars are stored as a sta_data keyframe
+
+/**
+ * Struct for storing the status variables that changed since the previous
+ * status sample (on-board delta storage, @see sen_delta_set). The values are
+ * XOR-ed with the previous sample, so a sample is rebuilt from its sta_data
+ * keyframe applying the deltas in index order (@see sen_delta_apply).
+ */
+typedef struct __attribute__((__packed__)) stz_data {
     uint32_t index;
     uint32_t timestamp;
-    int exp_time;
-    int n_stars;
-}stt_exp_time_data_t;
+    uint32_t key;                       ///< sta_data index of the keyframe
+    uint32_t mask[DAT_STZ_MASK];        ///< Changed vars (bit i%32 of word i/32 = sta_buff[i])
+    uint32_t values[DAT_STZ_VALUES];    ///< Changed vars XOR the previous sample, in mask order, 0 padded
+} stz_data_t;
 
 /**
  * Data Map Struct for data schema definition.
@@ -374,33 +489,84 @@ typedef struct __attribute__((__packed__)) map {
     char *  var_names;
 } data_map_t;
 
-static char status_var_string[] = "sat_index timestamp obc_last_reset obc_hrs_alive obc_hrs_wo_reset obc_reset_counter "
-                                  "obc_sw_wdt obc_temp_1 obc_temp_2 obc_temp_3 obc_executed_cmds obc_failed_cmds "
-                                  "dep_deployed dep_ant_deployed dep_date_time com_count_tm com_count_tc com_last_tc "
-                                  "fpl_last fpl_queue ads_omega_x ads_omega_y ads_omega_z ads_mag_x ads_mag_y ads_mag_z "
-                                  "ads_pos_x ads_pos_y ads_pos_z ads_tle_epoch ads_tle_last ads_q0 ads_q1 ads_q2 ads_q3"
-                                  " eps_vbatt eps_cur_sun eps_cur_sys eps_temp_bat0 drp_temp drp_ads drp_eps drp_sta drp_stt drp_stt_exp_time"
-                                  "drp_mach_action drp_mach_state drp_mach_left obc_opmode rtc_date_time com_freq "
-                                  "com_tx_pwr com_baud com_mode com_bcn_period obc_bcn_offset tgt_omega_x tgt_omega_y "
-                                  "tgt_omega_z tgt_q0 tgt_q1 tgt_q2 tgt_q3 drp_ack_temp drp_ack_ads drp_ack_eps "
-                                  "drp_ack_sta drp_ack_stt dr_ack_stt_exp_time drp_mach_step drp_mach_payloads";
-
-static char status_var_types[] = "%u %u %u %u %u %u %u %f %f %f %u %u %u %u %u %u %u %u %u %u %f %f %f %f %f %f %f %f "
-                                 "%f %u %u %f %f %f %f %u %u %u %u %u %u %u %u %u %u %u %u %i %i %u %u %u %u %u %u %u %u %f "
-                                 "%f %f %f %f %f %f %u %u %u %u %u %u %u %i %u";
+/**
+ * Payload struct field types (see dat_payload_field_t)
+ */
+typedef enum dat_field_type {
+    DAT_FIELD_INT = 0,          ///< Signed integer: %d %i %hd %hhd %lld
+    DAT_FIELD_UINT,             ///< Unsigned integer: %u %hu %hhu %llu
+    DAT_FIELD_FLOAT,            ///< Single precision: %f
+    DAT_FIELD_DOUBLE,           ///< Double precision: %lf
+} dat_field_type_t;
+
+/**
+ * Payload struct field descriptor. Built once from data_map data_order and
+ * var_names, @seealso dat_get_payload_schema
+ */
+typedef struct dat_payload_field {
+    const char *name;           ///< Field (and table column) name
+    const char *fmt;            ///< Field format, as in data_order
+    dat_field_type_t type;      ///< Field type
+    uint16_t size;              ///< Field size in bytes
+    uint16_t offset;            ///< Field offset in the packed struct
+} dat_payload_field_t;
+
+/**
+ * Payload struct descriptor
+ */
+typedef struct dat_payload_schema {
+    int nfields;                    ///< Number of fields
+    uint16_t size;                  ///< Sum of the fields sizes
+    dat_payload_field_t *fields;    ///< Fields descriptors
+} dat_payload_schema_t;
+
+static char status_var_string[] = "sat_index timestamp obc_last_reset obc_hrs_alive obc_hrs_wo_reset "
+                                  "obc_reset_counter obc_sw_wdt obc_temp_1 obc_temp_2 obc_temp_3 "
+                                  "obc_executed_cmds obc_failed_cmds dep_deployed dep_ant_deployed "
+                                  "dep_date_time com_count_tm com_count_tc com_last_tc fpl_last fpl_queue "
+                                  "ads_omega_x ads_omega_y ads_omega_z ads_mag_x ads_mag_y ads_mag_z ads_pos_x "
+                                  "ads_pos_y ads_pos_z ads_tle_epoch ads_tle_last ads_q0 ads_q1 ads_q2 ads_q3 "
+                                  "ads_sun_x ads_sun_y ads_sun_z ads_eclipse ads_sunlit ads_est_ms ads_ctrl_ms "
+                                  "ads_load eps_vbatt eps_cur_sun eps_cur_sys eps_temp_bat0 drp_temp drp_ads "
+                                  "drp_eps drp_sta drp_stt drp_stt_exp_time drp_stat drp_trig drp_stz "
+                                  "drp_mach_action drp_mach_state drp_mach_left obc_opmode rtc_date_time "
+                                  "com_freq com_tx_pwr com_baud com_mode com_bcn_period obc_bcn_offset "
+                                  "tgt_omega_x tgt_omega_y tgt_omega_z tgt_q0 tgt_q1 tgt_q2 tgt_q3 drp_ack_temp "
+                                  "drp_ack_ads drp_ack_eps drp_ack_sta drp_ack_stt drp_ack_stt_exp_time "
+                                  "drp_ack_stat drp_ack_trig drp_ack_stz drp_mach_step drp_mach_payloads "
+                                  "drp_mach_step_ms";
+
+static char status_var_types[] = "%u %u %u %u %u %u %u %f %f %f %u %u %u %u %u %u %u %u %u %u %f %f %f %f %f %f "
+                                 "%f %f %f %u %u %f %f %f %f %f %f %f %u %f %u %u %f %u %u %u %u %u %u %u %u %u "
+                                 "%u %u %u %u %u %u %u %d %d %u %u %u %u %u %u %f %f %f %f %f %f %f %u %u %u %u "
+                                 "%u %u %u %u %u %d %u %u";
 
 static data_map_t data_map[] = {
-{"temp_data",      (uint16_t) (sizeof(temp_data_t)),dat_drp_temp,dat_drp_ack_temp, "%u %u %f %f %f",                   "sat_index timestamp obc_temp_1 obc_temp_2 obc_temp_3"},
-{ "ads_data",      (uint16_t) (sizeof(ads_data_t)), dat_drp_ads, dat_drp_ack_ads,  "%u %u %f %f %f %f %f %f",          "sat_index timestamp acc_x acc_y acc_z mag_x mag_y mag_z"},
-{ "eps_data",      (uint16_t) (sizeof(eps_data_t)), dat_drp_eps, dat_drp_ack_eps,  "%u %u %u %u %u %d %d %d %d %d %d", "sat_index timestamp cursun cursys vbatt temp1 temp2 temp3 temp4 temp5 temp6"},
+{"temp_data",      (uint16_t) (sizeof(temp_data_t)), dat_drp_temp, dat_drp_ack_temp, DAT_PAYLOAD_ORDER(DAT_TEMP_FIELDS), DAT_PAYLOAD_NAMES(DAT_TEMP_FIELDS)},
+{"ads_data",       (uint16_t) (sizeof(ads_data_t)), dat_drp_ads, dat_drp_ack_ads, DAT_PAYLOAD_ORDER(DAT_ADS_FIELDS), DAT_PAYLOAD_NAMES(DAT_ADS_FIELDS)},
+{"eps_data",       (uint16_t) (sizeof(eps_data_t)), dat_drp_eps, dat_drp_ack_eps, DAT_PAYLOAD_ORDER(DAT_EPS_FIELDS), DAT_PAYLOAD_NAMES(DAT_EPS_FIELDS)},
 {"sta_data",       (uint16_t) (sizeof(sta_data_t)), dat_drp_sta, dat_drp_ack_sta, status_var_types, status_var_string},
-{"stt_data",       (uint16_t) (sizeof(stt_data_t)), dat_drp_stt, dat_drp_ack_stt, "%u %u %f %f %f %d %f", "sat_index timestamp ra dec roll time exec_time"},
-{"stt_exp_time",   (uint16_t) (sizeof(stt_exp_time_data_t)), dat_drp_stt_exp_time, dat_drp_ack_stt_exp_time, "%u %u %d %d", "sat_index timestamp exp_time n_stars"}
+{"stt_data",       (uint16_t) (sizeof(stt_data_t)), dat_drp_stt, dat_drp_ack_stt, DAT_PAYLOAD_ORDER(DAT_STT_FIELDS), DAT_PAYLOAD_NAMES(DAT_STT_FIELDS)},
+{"stt_exp_time",   (uint16_t) (sizeof(stt_exp_time_data_t)), dat_drp_stt_exp_time, dat_drp_ack_stt_exp_time,
+                   DAT_PAYLOAD_ORDER(DAT_STT_EXP_TIME_FIELDS), DAT_PAYLOAD_NAMES(DAT_STT_EXP_TIME_FIELDS)},
+{"stat_data",      (uint16_t) (sizeof(stat_data_t)), dat_drp_stat, dat_drp_ack_stat, DAT_PAYLOAD_ORDER(DAT_STAT_FIELDS), DAT_PAYLOAD_NAMES(DAT_STAT_FIELDS)},
+{"trig_data",      (uint16_t) (sizeof(trig_data_t)), dat_drp_trig, dat_drp_ack_trig, DAT_PAYLOAD_ORDER(DAT_TRIG_FIELDS), DAT_PAYLOAD_NAMES(DAT_TRIG_FIELDS)},
+{"stz_data",       (uint16_t) (sizeof(stz_data_t)), dat_drp_stz, dat_drp_ack_stz,
+                   "%u %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u",
+                   "sat_index timestamp key mask0 mask1 mask2 d0 d1 d2 d3 d4 d5 d6 d7 d8 d9 d10 d11 d12 d13 d14 d15"}
 };
 
 /** The repository's name */
 #define DAT_REPO_SYSTEM "dat_system"    ///< Status variables table name
 
+/**
+ * Build the address and name lookup tables of dat_status_list, so
+ * @c dat_get_status_var_def is O(1) and @c dat_get_status_var_def_name is
+ * O(log n). Before this call both functions scan the list. Call it once at
+ * startup, before other tasks are created.
+ */
+void dat_status_index_init(void);
+
 /**
  * Search and return a status variable definition from dat_status_list by index or by name
  * @param address Variable index
@@ -410,6 +576,20 @@ static data_map_t data_map[] = {
 dat_sys_var_t dat_get_status_var_def(dat_status_address_t address);
 dat_sys_var_t dat_get_status_var_def_name(char *name);
 
+/**
+ * Select status variables by address, range of addresses, name or group. The
+ * selection is a list of items separated by spaces or commas, an item is an
+ * address ("12"), a range of addresses ("12-20"), a variable name
+ * ("obc_temp_1") or a group, the prefix of the variables names ("ads" selects
+ * the "ads_..." variables).
+ * @param selection Selection string. Ex: "0-3 ads eps_vbatt"
+ * @param vars Positions in dat_status_list of the selected variables, sorted
+ * and without repetitions
+ * @param max Max. variables to select
+ * @return Number of variables selected, -1 if an item is invalid
+ */
+int dat_select_status_vars(const char *selection, int *vars, int max);
+
 /**
  * Print the names and values of a system status variable list.
  * @param status Pointer to a status variables list
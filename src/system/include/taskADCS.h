@@ -15,20 +15,42 @@
 #include "osDelay.h"
 
 #include "math_utils.h"
+#include "prof_utils.h"
 
 #include "repoCommand.h"
+#include "cmdADCS.h"
+#include "cmdOBC.h"
+#ifdef SCH_USE_RW
+#include "cmdRW.h"
+#endif
 #include "igrf13.h"
 
 void taskADCS(void *param);
 
-void eskf_predict_state(double* P, double dt);
-
-void calc_sun_pos_i(double jd, vector3_t * sun_dir);
-
-double unixt_to_jd(uint32_t unix_time);
-
-void calc_magnetic_model(double decyear, double latrad, double lonrad, double altm, double* mag);
-
-double jd_to_dec(double jd);
+void eskf_predict_state(real_t* P, real_t dt);
+
+/**
+ * Evaluate the IGRF model. The model is evaluated in double precision, the
+ * result is returned as real_t
+ */
+void calc_magnetic_model(double decyear, double latrad, double lonrad, double altm, real_t* mag);
+
+/**
+ * Geodetic coordinates of an inertial position
+ * @param sat_pos Position, ECI [km]
+ * @param current_jd Julian day
+ * @param lat_lon_alt Latitude [rad], longitude [rad] and altitude [m]
+ * @return 0
+ */
+int eci_to_geo(vector3_t sat_pos, double current_jd, vector3_t * lat_lon_alt);
+
+/**
+ * Rotate a vector from the local North-East-Down frame to the inertial frame
+ * @param ned Vector, NED frame
+ * @param latrad Geodetic latitude [rad]
+ * @param lonrad Inertial longitude, longitude plus sidereal time [rad]
+ * @param eci Vector, ECI frame
+ */
+void ned_to_eci(const real_t *ned, double latrad, double lonrad, vector3_t *eci);
 
 #endif //T_ADCS_H
@@ -0,0 +1,38 @@
+/**
+ * @file  taskBeacon.h
+ * @author Carlos Gonzalez C - carlgonz@uchile.cl
+ * @date 2020
+ * @copyright GNU GPL v3
+ *
+ * This task sends the status beacon every dat_com_bcn_period seconds, instead
+ * of the housekeeping task queuing tm_send_status to the executers.
+ *
+ * The beacon is built in the background (@see tm_bcn_build) one second before
+ * it is due, and also every SCH_TM_BCN_BUILD_S seconds so the beacons
+ * requested with tm_send_status find it ready. When the beacon is due it is
+ * sent from the prebuilt buffer, without reading the status variables, so the
+ * beacons take constant time and the executers stay free for the ground
+ * commands during the passes.
+ */
+
+#ifndef T_BEACON_H
+#define T_BEACON_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "globals.h"
+
+#include "osDelay.h"
+
+#include "repoData.h"
+#include "cmdTM.h"
+
+/**
+ * Status beacon task
+ * @param param Not used
+ */
+void taskBeacon(void *param);
+
+#endif //T_BEACON_H
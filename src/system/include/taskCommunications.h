@@ -6,6 +6,9 @@
  *
  * This task implements a client that reads remote commands from TRX. Also
  * works as the CSP server to process common services and custom ports.
+ * Connections to the TC, CMD and DBG ports are read by this task, the rest
+ * (TM, files, repeater, profiler requests, services) are handed to a pool of
+ * SCH_TASK_COM_WORKERS workers so bulk traffic does not delay commands.
  *
  */
 
@@ -23,10 +26,36 @@
 
 #include "osQueue.h"
 #include "osDelay.h"
+#include "osSemphr.h"
+#include "osThread.h"
+#include "prof_utils.h"
 
 #include "repoCommand.h"
 #include "cmdTM.h"
+#include "taskIngest.h"
+#include "taskDownlink.h"
+#include "taskRepeater.h"
 
 void taskCommunications(void *param);
 
+/**
+ * Bulk connections worker, reads the connections queued by taskCommunications
+ * @param param Not used
+ */
+void taskCommunicationsWorker(void *param);
+
+/**
+ * Process a packet received on the TC, binary TC, CMD or TM port as taskCommunications
+ * does, but without a connection: no ack is sent and the TC counters are not
+ * updated. Commands are sent to the dispatcher queue. Used to feed frames
+ * without CSP, as the in-process fuzz target does (test/test_fuzz_target).
+ *
+ * @param packet Received packet, its buffer must hold one byte more than
+ * packet->length and at least a com_frame_t for the TM port. It is not freed.
+ * @param port Destination port: SCH_TRX_PORT_TC, SCH_TRX_PORT_TC_BIN,
+ * SCH_TRX_PORT_CMD or SCH_TRX_PORT_TM
+ * @return 0 if OK, -1 if the port is not supported
+ */
+int com_receive_packet(csp_packet_t *packet, uint8_t port);
+
 #endif //T_COMMUNICATIONS_H
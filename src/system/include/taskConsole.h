@@ -12,6 +12,9 @@
 #define T_CONSOLE_H
 
 #include <stdio.h>
+#ifdef LINUX
+#include <time.h>
+#endif
 
 #include "config.h"
 #include "globals.h"
@@ -22,6 +25,7 @@
 
 #include "osQueue.h"
 #include "osDelay.h"
+#include "osSemphr.h"
 
 #include "repoCommand.h"
 
@@ -29,4 +33,19 @@ void taskConsole(void *param);
 int console_init(void);
 int console_read(char *buffer, int len);
 
+/**
+ * Run a command script in batch mode. Every line of the script is a console
+ * command, empty lines and lines starting with # are skipped. The commands
+ * are submitted in batches (@see cmd_send_batch) and the function waits until
+ * the executer reports all of them done, then logs the result and latency of
+ * each command and the total wall time.
+ * Use "/batch <file>" in the console, or "/batch -" to read the script from
+ * stdin until EOF or a "/end" line.
+ *
+ * @param path Script file path, "-" for stdin
+ * @return Number of commands that failed or were not executed, -1 if the
+ * script can not be read
+ */
+int console_batch(const char *path);
+
 #endif //T_CONSOLE_H
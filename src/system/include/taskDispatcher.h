@@ -22,6 +22,37 @@
 #include "repoData.h"
 
 void taskDispatcher(void *param);
+
+/**
+ * Admission policy of the dispatcher. Commands marked with cmd_set_shed are
+ * dropped when the load of their executer reaches their level, so under
+ * overload the optional work gives way to the rest of the commands. The drops
+ * are counted in the command statistics (see cmd_shed_check).
+ *
+ * @param newCmd cmd_t *. Command to execute
+ * @return Int. 1 if the command can be executed, 0 if it must be dropped
+ */
 int check_if_executable(cmd_t *newCmd);
 
+/**
+ * Estimate the load of an executer from its queue depth and lag (see
+ * SCH_CMD_SHED_DEPTH and SCH_CMD_SHED_LAG_MS). Over twice the limits the
+ * executer is overloaded. In the fail safe operation modes a high load is
+ * handled as overload.
+ *
+ * @param queue osQueue. Executer queue (see dispatcher_select_queue)
+ * @param cls cmd_class_t. Class of the commands sent to the queue
+ * @return cmd_load_t. Executer load
+ */
+cmd_load_t dispatcher_get_load(osQueue queue, cmd_class_t cls);
+
+/**
+ * Select the executer queue according to the command concurrency class.
+ * Exclusive commands, or classes without workers, go to executer_cmd_queue.
+ *
+ * @param newCmd cmd_t *. Command to execute
+ * @return osQueue. Executer queue
+ */
+osQueue dispatcher_select_queue(cmd_t *newCmd);
+
 #endif
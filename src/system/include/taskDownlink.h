@@ -0,0 +1,108 @@
+/**
+ * @file  taskDownlink.h
+ * @author Carlos Gonzalez C - carlgonz@uchile.cl
+ * @date 2020
+ * @copyright GNU GPL v3
+ *
+ * This task implements the downlink manager. During a contact, started with
+ * tm_dl_start, it sends status beacons and payload telemetry to the ground
+ * station interleaved by operator-set weights. The ground station acknowledges
+ * the payload sample ranges it receives (tm_dl_ack, or a run-length encoded
+ * list to SCH_TRX_PORT_ACK) and only the ranges not acknowledged are
+ * retransmitted, after SCH_DL_ACK_TIMEOUT_MS or as soon as the ground station
+ * reports them missing.
+ */
+
+#ifndef T_DOWNLINK_H
+#define T_DOWNLINK_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "globals.h"
+
+#include "osDelay.h"
+#include "osSemphr.h"
+
+#include "repoData.h"
+#include "cmdTM.h"
+#include "cmdOBC.h"
+
+#define DL_SOURCE_STATUS (-1)   ///< Source id of the status beacons, payloads use their payload id
+
+/**
+ * Initialize the downlink manager state. Default weights are 1 for the status
+ * beacons and for every payload.
+ * @return 0 if OK, -1 if the mutex can't be created
+ */
+int dl_init(void);
+
+/**
+ * Start a downlink session to a node. The session ends after @seconds or with
+ * dl_stop. Starting a session rewinds the payloads to the first sample not
+ * acknowledged and drops the frames staged for the next pass.
+ *
+ * With SCH_DL_PASS_AUTO, taskDownlink also starts a session to
+ * SCH_DL_PASS_NODE at the AOS of each ground station pass (@see
+ * obc_next_pass). SCH_DL_STAGE_LEAD seconds before the AOS the first
+ * SCH_DL_STAGE_FRAMES payload frames of the session are built in RAM, and
+ * sent at the AOS before the regular selection resumes.
+ * @param node Ground station node
+ * @param seconds Session duration, usually the contact length
+ * @return 0 if OK, -1 on error
+ */
+int dl_start(int node, int seconds);
+
+/**
+ * Stop the current downlink session
+ * @return 0 if OK, -1 on error
+ */
+int dl_stop(void);
+
+/**
+ * Set the weight of a downlink source. A source with weight w receives w
+ * frames for each frame of another source with weight 1, weight 0 disables
+ * the source.
+ * @param source Payload id or DL_SOURCE_STATUS
+ * @param weight Source weight
+ * @return 0 if OK, -1 on error
+ */
+int dl_set_weight(int source, unsigned int weight);
+
+/**
+ * Acknowledge the payload samples [start, end) received by the ground station.
+ * Contiguous acknowledged samples advance the payload drp_ack status variable,
+ * the rest are kept as ranges not to be retransmitted.
+ * @param payload Payload id
+ * @param start First acknowledged sample
+ * @param end Last acknowledged sample + 1
+ * @return 0 if OK, -1 on error
+ */
+int dl_ack(int payload, int start, int end);
+
+/**
+ * Acknowledge a run-length encoded list of payload samples, as received in the
+ * SCH_TRX_PORT_ACK frames (@see com_ack_frame_t). Runs alternate received and
+ * missing samples, starting with received samples at @base. The received runs
+ * are acknowledged as with dl_ack, and the payload is rewound to the first
+ * missing run followed by received samples, so the lost samples are resent
+ * without waiting for SCH_DL_ACK_TIMEOUT_MS. Acknowledged samples are skipped.
+ * @param payload Payload id
+ * @param base First sample of the first run
+ * @param runs Number of samples of each run
+ * @param n_runs Number of runs
+ * @return 0 if OK, -1 on error or if some runs did not fit in the
+ * SCH_DL_MAX_RANGES acked ranges (they will be retransmitted)
+ */
+int dl_ack_rle(int payload, int base, const uint16_t *runs, int n_runs);
+
+/**
+ * Print the downlink manager status: session, weights, send cursors and
+ * acknowledged ranges
+ */
+void dl_print_status(void);
+
+void taskDownlink(void *param);
+
+#endif //T_DOWNLINK_H
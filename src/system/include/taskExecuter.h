@@ -6,8 +6,8 @@
  * @copyright GNU GPL v3
  *
  * This task implements the executer module. Waits a message from dispatcher to
- * obtain the function and parameter to execute. When the function ends, send a
- * message to dispatcher with the result of the execution
+ * obtain the function and parameter to execute. When the function ends, update
+ * the executed and failed commands counters with the result of the execution
  */
 
 #ifndef T_EXECUTER_H
@@ -20,6 +20,7 @@
 #include "osQueue.h"
 
 #include "repoCommand.h"
+#include "repoData.h"
 
 void taskExecuter(void *param);
 
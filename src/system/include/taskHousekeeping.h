@@ -6,6 +6,8 @@
  * @copyright GNU GPL v3
  *
  * This task implements a listener, that sends commands at periodical times.
+ * The periodic commands are a table of jobs (@see hk_job_t) that ground can
+ * edit at runtime (@see obc_hk_set).
  */
 
 #ifndef T_HOUSEKEEPING_H
@@ -20,7 +22,62 @@
 #include "osQueue.h"
 #include "osDelay.h"
 
+#include "osSemphr.h"
+
 #include "repoCommand.h"
+#include "repoData.h"
+
+/**
+ * Housekeeping periodic job. The job runs at phase + k*period seconds after
+ * the task starts (k >= 1), so jobs with the same period can be spread using
+ * different phases.
+ */
+typedef struct hk_job {
+    int cmd_id;                             ///< Command id (see cmd_resolve), -1 if the slot is free
+    unsigned int period;                    ///< Period in seconds
+    unsigned int phase;                     ///< Phase offset in seconds
+    int enable_var;                         ///< Status variable that enables the job if > 0, -1 for none
+    char params[SCH_CMD_MAX_STR_PARAMS];    ///< Command parameters, empty for none
+} hk_job_t;
+
+/**
+ * Initialize the jobs table mutex. The jobs are loaded with hk_jobs_reset
+ * when the task starts, after all commands are registered.
+ * @return 0 if OK, -1 on error
+ */
+int hk_jobs_init(void);
+
+/**
+ * Replace the jobs table with the default jobs
+ * @return Number of default jobs loaded, -1 on error
+ */
+int hk_jobs_reset(void);
+
+/**
+ * Set a job
+ * @param slot Job slot, 0 to SCH_HK_JOBS_MAX-1
+ * @param period Period in seconds, > 0
+ * @param phase Phase offset in seconds
+ * @param cmd Command name
+ * @param params Command parameters, NULL or empty for none
+ * @return 0 if OK, -1 if the slot or the command are not valid
+ */
+int hk_job_set(int slot, unsigned int period, unsigned int phase, char *cmd, char *params);
+
+/**
+ * Free a job slot
+ * @param slot Job slot, 0 to SCH_HK_JOBS_MAX-1
+ * @return 0 if OK, -1 if the slot is not valid
+ */
+int hk_job_delete(int slot);
+
+/**
+ * Get a copy of a job
+ * @param slot Job slot, 0 to SCH_HK_JOBS_MAX-1
+ * @param job Job copy
+ * @return 0 if the slot has a job, -1 if it is free or not valid
+ */
+int hk_job_get(int slot, hk_job_t *job);
 
 void taskHousekeeping(void *param);
 
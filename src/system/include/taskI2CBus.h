@@ -0,0 +1,189 @@
+/**
+ * @file  taskI2CBus.h
+ * @author Carlos Gonzalez C - carlgonz@uchile.cl
+ * @date 2020
+ * @copyright GNU GPL v3
+ *
+ * This task manages an I2C bus. Device drivers queue their transactions to the
+ * bus manager instead of using the bus from the commands and tasks that read
+ * the devices, so the transfers of the executers, communications and ADCS
+ * tasks are serialized in a known order, with priorities.
+ *
+ * A transaction is a batch of up to I2C_BUS_XFERS transfers. Each transfer
+ * writes and then reads a device, combined with a repeated start. The platform
+ * driver registered with i2c_bus_init runs the whole batch at once (in Linux
+ * with one I2C_RDWR ioctl). High priority transactions, the reaction wheels
+ * commands, are queued before the normal ones, so they only wait for the
+ * transaction in progress, even during a sensors sweep. Transactions are
+ * completed with a callback (i2c_bus_submit) or waited by the caller
+ * (i2c_bus_transaction).
+ *
+ * Driver libraries that use the bus by themselves (GSSB) take it with
+ * i2c_bus_acquire, in turn with the queued transactions.
+ *
+ * One task runs per registered bus. Before the task starts, or if it is
+ * disabled (SCH_TASK_I2C_ENABLED), transactions run in the caller with the bus
+ * locked.
+ */
+
+#ifndef T_I2C_BUS_H
+#define T_I2C_BUS_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "globals.h"
+#include "log_utils.h"
+
+#include "osQueue.h"
+#include "osSemphr.h"
+#include "osDelay.h"
+
+#define I2C_BUS_XFERS (4)   ///< Max. transfers per transaction
+
+/**
+ * Transaction priorities
+ */
+typedef enum i2c_bus_prio {
+    I2C_PRIO_NORMAL = 0,    ///< Sensors, housekeeping and configuration
+    I2C_PRIO_HIGH,          ///< Actuators commands, queued before the normal transactions
+} i2c_bus_prio_t;
+
+/**
+ * Transfer, write @tx_len bytes and then read @rx_len bytes with a repeated
+ * start. Any of both parts can be empty.
+ */
+typedef struct i2c_bus_xfer {
+    uint8_t addr;           ///< 7 bits device address
+    const uint8_t *tx;      ///< Bytes to write
+    uint16_t tx_len;        ///< Bytes to write, 0 to only read
+    uint8_t *rx;            ///< Buffer for the bytes read
+    uint16_t rx_len;        ///< Bytes to read, 0 to only write
+} i2c_bus_xfer_t;
+
+typedef struct i2c_bus_trans i2c_bus_trans_t;
+
+/**
+ * Transaction completion callback, called from the bus task
+ * @param trans Transaction, it can be reused or released from here
+ * @param rc 0 if OK, -1 if a transfer failed
+ * @param arg Callback argument, @see i2c_bus_trans_t
+ */
+typedef void (*i2c_bus_done_f)(i2c_bus_trans_t *trans, int rc, void *arg);
+
+/**
+ * Transaction descriptor. It is queued by reference, it must be valid until
+ * the completion callback is called.
+ */
+struct i2c_bus_trans {
+    int prio;                           ///< Priority, @see i2c_bus_prio_t
+    int n;                              ///< Number of transfers
+    i2c_bus_xfer_t xfers[I2C_BUS_XFERS];///< Transfers, run in order
+    uint32_t timeout_ms;                ///< Timeout of each transfer
+    i2c_bus_done_f done;                ///< Completion callback, can be NULL
+    void *done_arg;                     ///< Completion callback argument
+    int lock;                           ///< Bus acquire request, set by i2c_bus_acquire
+    portTick queued;                    ///< Time the transaction was queued
+};
+
+/**
+ * Platform transfer function, runs a batch of transfers in the bus
+ * @param bus Bus number
+ * @param xfers Transfers
+ * @param n Number of transfers
+ * @param timeout_ms Timeout of each transfer
+ * @return 0 if OK, -1 if a transfer failed
+ */
+typedef int (*i2c_bus_transfer_f)(int bus, i2c_bus_xfer_t *xfers, int n, uint32_t timeout_ms);
+
+/**
+ * Bus manager counters, @see i2c_bus_get_stats
+ */
+typedef struct i2c_bus_stats {
+    uint32_t done;          ///< Transactions completed, including the failed ones
+    uint32_t errors;        ///< Transactions failed
+    uint32_t full;          ///< Transactions not queued, the queue was full
+    uint32_t acquired;      ///< Bus acquired by driver libraries
+    uint32_t max_wait_ms[2];///< Max. time in the queue, by priority
+} i2c_bus_stats_t;
+
+/**
+ * Register a bus and initialize its queue. Called by the platform drivers,
+ * before the tasks are created (@see init_create_task).
+ * @param bus Bus number, the platform bus handle [0, SCH_I2C_BUSES)
+ * @param transfer Platform transfer function
+ * @return 0 if OK, -1 on error
+ */
+int i2c_bus_init(int bus, i2c_bus_transfer_f transfer);
+
+/**
+ * Check if a bus is registered
+ * @param bus Bus number
+ * @return 1 if the bus is registered, 0 if not
+ */
+int i2c_bus_registered(int bus);
+
+/**
+ * Queue a transaction, high priority transactions are queued before the
+ * normal ones. Waits up to @trans->timeout_ms if the queue is full.
+ * @param bus Bus number
+ * @param trans Transaction, valid until its completion callback is called
+ * @return 0 if queued, -1 if the bus is not registered or the queue is full,
+ * the callback is not called then
+ */
+int i2c_bus_submit(int bus, i2c_bus_trans_t *trans);
+
+/**
+ * Run a transaction and wait for the result
+ * @param bus Bus number
+ * @param prio Priority, @see i2c_bus_prio_t
+ * @param xfers Transfers
+ * @param n Number of transfers [1, I2C_BUS_XFERS]
+ * @param timeout_ms Timeout of each transfer
+ * @return 0 if OK, -1 on error
+ */
+int i2c_bus_transaction(int bus, int prio, i2c_bus_xfer_t *xfers, int n, uint32_t timeout_ms);
+
+/**
+ * Write and then read a device, @see i2c_bus_transaction
+ * @return 0 if OK, -1 on error
+ */
+int i2c_bus_write_read(int bus, int prio, uint8_t addr, const void *tx, uint16_t tx_len, void *rx,
+                       uint16_t rx_len, uint32_t timeout_ms);
+
+/**
+ * Take the bus, for drivers libraries that access the bus by themselves.
+ * Waits until the transactions queued before are completed, the bus is not
+ * used by other tasks until i2c_bus_release is called. Keep the bus for a
+ * short time (one device access), to not delay the high priority
+ * transactions.
+ * @param bus Bus number
+ * @param prio Priority, @see i2c_bus_prio_t
+ * @return 0 if OK, -1 on error (do not call i2c_bus_release then)
+ */
+int i2c_bus_acquire(int bus, int prio);
+
+/**
+ * Release the bus taken with i2c_bus_acquire
+ * @param bus Bus number
+ */
+void i2c_bus_release(int bus);
+
+/**
+ * Get the bus manager counters
+ * @param bus Bus number
+ * @param stats Counters copy
+ * @param reset Set to clear the counters
+ */
+void i2c_bus_get_stats(int bus, i2c_bus_stats_t *stats, int reset);
+
+/**
+ * I2C bus manager task
+ * @param param Bus number, cast to a pointer
+ */
+void taskI2CBus(void *param);
+
+#endif //T_I2C_BUS_H
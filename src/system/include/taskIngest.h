@@ -0,0 +1,100 @@
+/**
+ * @file  taskIngest.h
+ * @author Carlos Gonzalez C - carlgonz@uchile.cl
+ * @date 2020
+ * @copyright GNU GPL v3
+ *
+ * This task implements the payload telemetry ingest pipeline. The
+ * communications task queues the received payload frames (ingest_put) and
+ * this task stores them, several frames per storage transaction, so a busy
+ * database does not delay the CSP receive thread. If the task is disabled
+ * (SCH_TASK_INGEST_ENABLED) frames are stored by the caller.
+ *
+ * SCH_INGEST_WORKERS tasks (writers) run in parallel, each one with its own
+ * queue. Frames are assigned to a writer by source node, so the frames of a
+ * node are stored in order and several satellites received by the ground
+ * station are stored concurrently, each one in its own tables.
+ */
+
+#ifndef T_INGEST_H
+#define T_INGEST_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "globals.h"
+
+#include "osQueue.h"
+#include "osSemphr.h"
+
+#include "repoData.h"
+#include "cmdCOM.h"
+
+/**
+ * Ingest pipeline counters, @see ingest_get_stats
+ */
+typedef struct ingest_stats {
+    uint32_t queued;        ///< Frames queued by the receive tasks
+    uint32_t waited;        ///< Frames that found the queue full, the receive task waited
+    uint32_t dropped;       ///< Frames dropped, the queue was full for SCH_INGEST_PUT_MS
+    uint32_t stored;        ///< Frames stored
+    uint32_t errors;        ///< Frames not stored, invalid frames or storage errors
+    uint32_t batches;       ///< Storage transactions
+    uint32_t max_batch;     ///< Max frames received by the writer at once, the max queue depth seen
+    uint32_t published;     ///< Samples messages published, @see SCH_INGEST_PUB_URI
+} ingest_stats_t;
+
+/**
+ * Header of the decoded samples published by the ingest writers, if
+ * SCH_INGEST_PUB_URI is defined. Samples are published as stored, on a ZMQ
+ * PUB socket, in messages of five parts:
+ *  1. Topic, the payload table name (data_map[payload].table)
+ *  2. This header
+ *  3. Fields format, data_map[payload].data_order
+ *  4. Fields names, data_map[payload].var_names
+ *  5. Samples, @count structs of @size bytes in the host byte order
+ * Subscribers filter the payloads by topic and decode the samples with the
+ * fields, without polling the database.
+ */
+typedef struct __attribute__((packed)) ingest_pub_header {
+    uint16_t node;          ///< Source node
+    uint16_t payload;       ///< Payload id
+    uint32_t count;         ///< Number of samples
+    uint16_t size;          ///< Sample size in bytes
+} ingest_pub_header_t;
+
+/**
+ * Initialize the ingest queue and counters, and bind the samples publisher to
+ * SCH_INGEST_PUB_URI if it is defined
+ * @return 0 if OK, -1 on error
+ */
+int ingest_init(void);
+
+/**
+ * Store a received payload frame (TM_TYPE_PAYLOAD, TM_TYPE_PAYLOAD_Z or
+ * TM_TYPE_PAYLOAD_MUX, queued as one payload frame per record). The
+ * frame is copied to the queue of the node writer, waiting up to
+ * SCH_INGEST_PUT_MS if the queue is full, or stored right away if the ingest
+ * task is disabled.
+ * @param node Source node, @see dat_add_payload_samples_node
+ * @param frame Frame, with the header already in host byte order
+ * @param len Frame length in bytes
+ * @return 0 if OK, -1 if the frame was dropped or not stored
+ */
+int ingest_put(int node, com_frame_t *frame, int len);
+
+/**
+ * Get the ingest pipeline counters
+ * @param stats Counters copy
+ * @param reset Set to clear the counters
+ */
+void ingest_get_stats(ingest_stats_t *stats, int reset);
+
+/**
+ * Ingest writer task
+ * @param param Writer number [0, SCH_INGEST_WORKERS), cast to a pointer
+ */
+void taskIngest(void *param);
+
+#endif //T_INGEST_H
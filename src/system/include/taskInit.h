@@ -20,6 +20,8 @@
 #include "osQueue.h"
 #include "osDelay.h"
 
+#include "bootSeq.h"
+
 /* Task includes */
 #include "taskConsole.h"
 #if SCH_HK_ENABLED
@@ -37,6 +39,30 @@
 #if SCH_ADCS_ENABLED
 #include "taskADCS.h"
 #endif
+#if SCH_DL_ENABLED
+#include "taskDownlink.h"
+#endif
+#if SCH_TASK_INGEST_ENABLED
+#include "taskIngest.h"
+#endif
+#if SCH_SIM_NODES > 0
+#include "taskSimNodes.h"
+#endif
+#if SCH_TASK_I2C_ENABLED
+#include "taskI2CBus.h"
+#endif
+#if SCH_TASK_TRK_ENABLED
+#include "taskTracking.h"
+#endif
+#if SCH_TASK_RPT_ENABLED
+#include "taskRepeater.h"
+#endif
+#if SCH_TASK_BCN_ENABLED
+#include "taskBeacon.h"
+#endif
+#if SCH_COMM_ENABLE && SCH_COMM_ZMQ_BATCH > 1 && (defined(X86) || defined(GROUNDSTATION))
+#include "taskZmqHub.h"
+#endif
 
 void taskInit(void *param);
 
@@ -0,0 +1,92 @@
+/**
+ * @file  taskRepeater.h
+ * @author Carlos Gonzalez C - carlgonz@uchile.cl
+ * @date 2020
+ * @copyright GNU GPL v3
+ *
+ * This task implements the digital repeater (SCH_TRX_PORT_RPT). The
+ * communications task queues the packets to repeat (rpt_put) and this task
+ * resends them to the broadcast address, with low priority and through the TX
+ * pacer, so the repeater traffic never delays the TC replies or the
+ * telemetry. Packets are queued and resent in the same CSP buffer, without
+ * copies.
+ *
+ * Each source node has a token bucket of SCH_RPT_BURST bytes refilled at
+ * SCH_RPT_RATE_BPS bytes per second. Packets above the rate of their source,
+ * or that find the queue full, are dropped, so a ground user can't flood the
+ * repeater or the CSP buffers pool.
+ *
+ * With SCH_RPT_STORE_MSGS > 0 the repeater works as store-and-forward: the
+ * packets received out of the ground station passes (@see
+ * obc_pass_elevation) are copied to RAM, and their CSP buffers released, until
+ * the next pass. If the store is full the oldest messages are dropped.
+ *
+ * If the task is disabled (SCH_TASK_RPT_ENABLED) packets are resent by the
+ * caller, still limited by the token buckets.
+ */
+
+#ifndef T_REPEATER_H
+#define T_REPEATER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+#include "globals.h"
+
+#include <csp/csp.h>
+
+#include "osQueue.h"
+#include "osSemphr.h"
+#include "osDelay.h"
+
+#include "repoData.h"
+#include "cmdCOM.h"
+#include "cmdOBC.h"
+
+/**
+ * Repeater counters, @see rpt_get_stats
+ */
+typedef struct rpt_stats {
+    uint32_t queued;        ///< Packets accepted
+    uint32_t limited;       ///< Packets dropped, their source exceeded SCH_RPT_RATE_BPS
+    uint32_t full;          ///< Packets dropped, the queue was full
+    uint32_t forwarded;     ///< Packets resent
+    uint32_t errors;        ///< Packets not resent, CSP errors
+    uint32_t stored;        ///< Packets held out of the passes
+    uint32_t overwritten;   ///< Held packets dropped, the store was full
+    uint32_t held;          ///< Packets held now
+} rpt_stats_t;
+
+/**
+ * Initialize the repeater queue, token buckets and counters. Called by the
+ * communications task before it receives packets.
+ * @return 0 if OK, -1 on error
+ */
+int rpt_init(void);
+
+/**
+ * Repeat a packet. The packet is queued to the repeater task, or resent now if
+ * the task is disabled.
+ * @param packet Packet received in SCH_TRX_PORT_RPT, released by the repeater
+ * if accepted
+ * @return 0 if the packet was accepted, -1 if it was dropped (the caller frees
+ * the packet)
+ */
+int rpt_put(csp_packet_t *packet);
+
+/**
+ * Get the repeater counters
+ * @param stats Counters copy
+ * @param reset Set to clear the counters
+ */
+void rpt_get_stats(rpt_stats_t *stats, int reset);
+
+/**
+ * Repeater task
+ * @param param Not used
+ */
+void taskRepeater(void *param);
+
+#endif //T_REPEATER_H
@@ -17,6 +17,7 @@
 #include "osDelay.h"
 
 #include "repoCommand.h"
+#include "cmdSensors.h"
 
 
 void taskSensors(void *param);
@@ -0,0 +1,79 @@
+/**
+ * @file  taskSimNodes.h
+ * @author Carlos Gonzalez C - carlgonz@uchile.cl
+ * @date 2020
+ * @copyright GNU GPL v3
+ *
+ * This task simulates a constellation of SCH_SIM_NODES nodes inside this
+ * process, to test the ground station ingest and routing with many satellites
+ * without running a flight software process (and database) per node.
+ *
+ * The simulated nodes are attached to the in-memory CSP interface "SIM", with
+ * addresses SCH_SIM_FIRST_NODE to SCH_SIM_FIRST_NODE + SCH_SIM_NODES - 1 (below
+ * the CSP broadcast address, so at most 30 nodes). Each node keeps its own frame
+ * counter and sends a payload frame (SCH_SIM_PAYLOAD) every
+ * SCH_SIM_PERIOD_MS to the telemetry port of this node, so the frames are
+ * received by the communications task and stored by the ingest pipeline as
+ * the frames of real satellites. Packets routed to the simulated nodes are
+ * counted and dropped, except pings, which are answered.
+ *
+ * The nodes are shared by SCH_SIM_WORKERS tasks, node i is driven by worker
+ * i % SCH_SIM_WORKERS. Each worker spreads the frames of its nodes along the
+ * period.
+ */
+
+#ifndef T_SIM_NODES_H
+#define T_SIM_NODES_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <csp/csp.h>
+#include <csp/csp_interface.h>
+
+#include "config.h"
+#include "globals.h"
+
+#include "osDelay.h"
+#include "osSemphr.h"
+
+#include "repoData.h"
+#include "cmdCOM.h"
+
+/**
+ * Simulated nodes counters, @see sim_nodes_get_stats
+ */
+typedef struct sim_nodes_stats {
+    uint32_t sent;          ///< Frames sent by the simulated nodes
+    uint32_t samples;       ///< Payload samples in the frames sent
+    uint32_t no_buffer;     ///< Frames not sent, no CSP buffer available
+    uint32_t dropped;       ///< Packets dropped by the SIM interface, the router input queue was full
+    uint32_t received;      ///< Packets routed to the simulated nodes
+    uint32_t pings;         ///< Pings answered by the simulated nodes
+} sim_nodes_stats_t;
+
+/**
+ * Initialize the simulated nodes, add the SIM interface and route the
+ * simulated nodes addresses to it. Call it after csp_init, before the router
+ * task starts.
+ * @return 0 if OK, -1 if the nodes do not fit in the CSP address space or
+ * overlap this node address
+ */
+int sim_nodes_init(void);
+
+/**
+ * Get the simulated nodes counters
+ * @param stats Counters copy
+ * @param reset Set to clear the counters
+ */
+void sim_nodes_get_stats(sim_nodes_stats_t *stats, int reset);
+
+/**
+ * Simulated nodes worker task, sends a frame from each node of the worker
+ * every SCH_SIM_PERIOD_MS
+ * @param param Worker number [0, SCH_SIM_WORKERS), cast to a pointer
+ */
+void taskSimNodes(void *param);
+
+#endif //T_SIM_NODES_H
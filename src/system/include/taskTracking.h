@@ -0,0 +1,91 @@
+/**
+ * @file  taskTracking.h
+ * @author Carlos Gonzalez C - carlgonz@uchile.cl
+ * @date 2020
+ * @copyright GNU GPL v3
+ *
+ * This task tracks the satellite of the TLE set by obc_update_tle from the
+ * ground station, to correct the Doppler shift of the TRX frequencies during
+ * the passes.
+ *
+ * Every SCH_TRK_PERIOD_MS the task computes the satellite azimuth, elevation,
+ * range and range rate (@see obc_pass_look). The orbit is read from the
+ * ephemeris cache once per second (@see obc_prop_tle_rv) and extrapolated to
+ * the milliseconds of the current time with the two body acceleration, so the
+ * loop does not run SGP4. While the satellite is above SCH_TRK_MIN_EL_DEG, the
+ * RX frequency is set to the downlink frequency shifted by the range rate and
+ * the TX frequency is pre-compensated so the satellite receives the nominal
+ * uplink frequency. Below it the nominal frequencies are set.
+ *
+ * Frequencies are rounded to SCH_TRK_FREQ_STEP_HZ and sent to the TRX only
+ * when they change, with com_set_config commands, so the TRX parameters cache
+ * skips the values the TRX already has and the loop never waits for the TRX.
+ */
+
+#ifndef T_TRACKING_H
+#define T_TRACKING_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "config.h"
+#include "globals.h"
+
+#include "osDelay.h"
+#include "osSemphr.h"
+
+#include "repoData.h"
+#include "repoCommand.h"
+#include "cmdOBC.h"
+
+/**
+ * Tracking state, @see trk_get_state
+ */
+typedef struct trk_state {
+    time_t ts;              ///< Unix timestamp of the last update
+    int ms;                 ///< Milliseconds after ts
+    obc_look_t look;        ///< Satellite seen from the ground station
+    int tracking;           ///< The satellite is above SCH_TRK_MIN_EL_DEG
+    uint32_t rx_freq;       ///< Last RX frequency sent to the TRX [Hz], 0 if none
+    uint32_t tx_freq;       ///< Last TX frequency sent to the TRX [Hz], 0 if none
+    uint32_t updates;       ///< Loops with a valid orbit
+    uint32_t no_orbit;      ///< Loops without TLE or with propagator errors
+    uint32_t sent;          ///< Frequency corrections sent to the TRX
+    uint32_t dropped;       ///< Frequency corrections not sent, the commands queue was full
+} trk_state_t;
+
+/**
+ * Set the nominal TRX frequencies of the tracked satellite, without Doppler.
+ * The corrections are recomputed in the next loop.
+ * @param rx_freq RX (downlink) frequency [Hz]
+ * @param tx_freq TX (uplink) frequency [Hz]
+ */
+void trk_set_freq(uint32_t rx_freq, uint32_t tx_freq);
+
+/**
+ * Frequency shifted by the Doppler effect, rounded to SCH_TRK_FREQ_STEP_HZ
+ * @param freq Nominal frequency [Hz]
+ * @param range_rate Range rate [km/s], positive if the satellite moves away
+ * @param uplink 0 for the frequency received from the satellite, 1 for the
+ * frequency to send so the satellite receives @freq
+ * @return Corrected frequency [Hz]
+ */
+uint32_t trk_doppler(uint32_t freq, double range_rate, int uplink);
+
+/**
+ * Get the tracking state
+ * @param state State copy
+ * @param reset Set to clear the counters
+ */
+void trk_get_state(trk_state_t *state, int reset);
+
+/**
+ * Ground station tracking task
+ * @param param Not used
+ */
+void taskTracking(void *param);
+
+#endif //T_TRACKING_H
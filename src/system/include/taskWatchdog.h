@@ -4,7 +4,10 @@
  * @date 2020
  * @copyright GNU GPL v3
  *
- * This task implements a client that controls watchdog timers.
+ * This task implements a client that controls watchdog timers. The OBC
+ * watchdog is cleared calling obc_reset_wdt directly. The ground watchdog
+ * counter (obc_sw_wdt) is kept in RAM and stored every SCH_GND_WDT_SYNC
+ * seconds.
  */
 
 #ifndef T_WDT_H
@@ -0,0 +1,68 @@
+/**
+ * @file  taskZmqHub.h
+ * @author Carlos Gonzalez C - carlgonz@uchile.cl
+ * @date 2020
+ * @copyright GNU GPL v3
+ *
+ * CSP interface to the ZMQ hub (@see sandbox/csp_zmq/zmqhub.py) that batches
+ * the packets, used instead of the libcsp zmqhub interface in X86 and
+ * GROUNDSTATION if SCH_COMM_ZMQ_BATCH > 1.
+ *
+ * The libcsp interface sends each packet as a ZMQ message from the sending
+ * task, with its own syscalls and I/O thread wake-up, which dominates the CPU
+ * during the TM bursts and the ground ingest. Here the packets routed to the
+ * interface are queued, without copies, to the TX task. It takes the queued
+ * packets, waits up to SCH_COMM_ZMQ_BATCH_MS for up to SCH_COMM_ZMQ_BATCH
+ * packets, and sends the consecutive packets to the same hop as the parts of
+ * one multipart message. The RX task blocks for the first message and then
+ * drains the messages already received without blocking.
+ *
+ * Each message part keeps the libcsp zmqhub format: the next hop address (the
+ * hub subscription filter), the CSP id in network order and the data. The hub
+ * forwards the multipart messages whole, and the nodes using the libcsp
+ * interface read each part as a single message.
+ */
+
+#ifndef T_ZMQ_HUB_H
+#define T_ZMQ_HUB_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <csp/csp.h>
+#include <csp/csp_interface.h>
+#include <csp/csp_endian.h>
+#include <zmq.h>
+
+#include "config.h"
+#include "globals.h"
+#include "log_utils.h"
+
+#include "osQueue.h"
+
+/**
+ * Create the ZMQ sockets and the TX queue, and add the interface. Call it
+ * after csp_init, the interface sends and receives once the TX and RX tasks
+ * start.
+ * @param addr Address of this node, only the messages to it are received
+ * @param pub_uri Hub input (XSUB) endpoint, @see SCH_COMM_ZMQ_OUT
+ * @param sub_uri Hub output (XPUB) endpoint, @see SCH_COMM_ZMQ_IN
+ * @param ifc Pointer for saving the interface
+ * @return 0 if OK, -1 on error
+ */
+int zmq_hub_init(uint8_t addr, const char *pub_uri, const char *sub_uri, csp_iface_t **ifc);
+
+/**
+ * ZMQ hub TX task, sends the packets queued to the interface in batches
+ * @param param Not used
+ */
+void taskZmqHubTx(void *param);
+
+/**
+ * ZMQ hub RX task, receives the hub messages to this node
+ * @param param Not used
+ */
+void taskZmqHubRx(void *param);
+
+#endif //T_ZMQ_HUB_H
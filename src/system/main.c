@@ -30,6 +30,42 @@
 
 const char *tag = "main";
 
+#define MAIN_DISPATCHER_QUEUE_LEN (25)
+
+static int main_init_cmd_repo(void)
+{
+    return cmd_repo_init() == CMD_OK ? 0 : -1;
+}
+
+static int main_init_dat_repo(void)
+{
+    dat_repo_init();
+    return 0;
+}
+
+/**
+ * Initializing shared Queues. Any task sends to the dispatcher, the dispatcher
+ * and the executer itself (the next chunk of a chunked command) send to the
+ * executer
+ */
+static int main_init_queues(void)
+{
+    int rc = 0;
+    dispatcher_queue = osQueueCreateType(MAIN_DISPATCHER_QUEUE_LEN,sizeof(cmd_t *), OS_QUEUE_MPSC);
+    executer_cmd_queue = osQueueCreateType(SCH_CMD_EXE_QUEUE_LEN,sizeof(cmd_t *), OS_QUEUE_MPSC);
+
+    if(dispatcher_queue == 0) { LOGE(tag, "Error creating dispatcher queue"); rc = -1; }
+    if(executer_cmd_queue == 0) { LOGE(tag, "Error creating executer cmd queue"); rc = -1; }
+    // High priority commands keep their order in their own lanes
+    if(cmd_queue_add_lane(dispatcher_queue, MAIN_DISPATCHER_QUEUE_LEN, 1) != CMD_OK) { LOGE(tag, "Error creating dispatcher lane"); rc = -1; }
+    if(cmd_queue_add_lane(executer_cmd_queue, SCH_CMD_EXE_QUEUE_LEN, 1) != CMD_OK) { LOGE(tag, "Error creating executer cmd lane"); rc = -1; }
+    osQueueSetName(dispatcher_queue, "dispatcher");
+    osQueueSetName(executer_cmd_queue, "executer_cmd");
+    if(osSemaphoreCreate(&executer_stat_sem) != OS_SEMAPHORE_OK) { LOGE(tag, "Error creating executer mutex"); rc = -1; }
+    osSemaphoreSetName(&executer_stat_sem, "executer_stat");
+    return rc;
+}
+
 #ifdef ESP32
 void app_main()
 #else
@@ -43,29 +79,38 @@ int main(void)
     printf("\t Device : %d (%s)\n", SCH_DEVICE_ID, SCH_NAME);
     printf("-----------------------------------------\n\n");
 
-    /* Init software subsystems */
+    /* Init software subsystems. The command and data repositories do not
+     * depend on each other, they are initialized in parallel (see bootSeq.h) */
+    boot_time_us();
     log_init(LOG_LEVEL, -1);      // Logging system
-    cmd_repo_init(); // Command repository initialization
-    dat_repo_init(); // Update status repository
-
-    /* Initializing shared Queues */
-    dispatcher_queue = osQueueCreate(25,sizeof(cmd_t *));
-    executer_stat_queue = osQueueCreate(1,sizeof(int));
-    executer_cmd_queue = osQueueCreate(1,sizeof(cmd_t *));
-
-    if(dispatcher_queue == 0) LOGE(tag, "Error creating dispatcher queue");
-    if(executer_stat_queue == 0) LOGE(tag, "Error creating executer stat queue");
-    if(executer_cmd_queue == 0) LOGE(tag, "Error creating executer cmd queue");
+    const boot_step_t boot_steps[] = {
+        {"cmd_repo", main_init_cmd_repo, 0},    // Command repository initialization
+        {"dat_repo", main_init_dat_repo, 0},    // Update status repository
+        {"queues", main_init_queues, 0},        // Shared queues
+    };
+    boot_run(boot_steps, sizeof(boot_steps)/sizeof(boot_steps[0]));
 
     int n_threads = 4;
     os_thread threads_id[n_threads];
 
     LOGI(tag, "Creating basic tasks...");
+#if SCH_TASK_MLOCKALL
+    if(osTaskLockMemory() != 0) LOGW(tag, "Unable to lock memory");
+#endif
+    /* Real time tasks and the rest can run in different CPUs (Linux only) */
+    const osTaskProfile rt_profile[] = {{3, OS_SCHED_FIFO, SCH_TASK_RT_CPUS}, {4, OS_SCHED_FIFO, SCH_TASK_RT_CPUS}};
+    const osTaskProfile bg_profile[] = {{2, OS_SCHED_FIFO, SCH_TASK_BG_CPUS}, {3, OS_SCHED_FIFO, SCH_TASK_BG_CPUS}};
     /* Crating system task (the others are created inside taskInit) */
-    int t_inv_ok = osCreateTask(taskDispatcher,"invoker", SCH_TASK_DIS_STACK, NULL, 3, &threads_id[1]);
-    int t_exe_ok = osCreateTask(taskExecuter, "receiver", SCH_TASK_EXE_STACK, NULL, 4, &threads_id[2]);
-    int t_wdt_ok = osCreateTask(taskWatchdog, "watchdog", SCH_TASK_WDT_STACK, NULL, 2, &threads_id[0]);
-    int t_ini_ok = osCreateTask(taskInit, "init", SCH_TASK_INI_STACK, NULL, 3, &threads_id[3]);
+    int t_inv_ok = osCreateTaskProfile(taskDispatcher,"invoker", SCH_TASK_DIS_STACK, NULL, &rt_profile[0], &threads_id[1]);
+    int t_exe_ok = osCreateTaskProfile(taskExecuter, "receiver", SCH_TASK_EXE_STACK, NULL, &rt_profile[1], &threads_id[2]);
+    int t_wdt_ok = osCreateTaskProfile(taskWatchdog, "watchdog", SCH_TASK_WDT_STACK, NULL, &bg_profile[0], &threads_id[0]);
+    int t_ini_ok = osCreateTaskProfile(taskInit, "init", SCH_TASK_INI_STACK, NULL, &bg_profile[1], &threads_id[3]);
+
+#if SCH_LOG_ASYNC
+    os_thread log_id;
+    int t_log_ok = osCreateTaskProfile(log_task, "log", SCH_TASK_LOG_STACK, NULL, &bg_profile[0], &log_id);
+    if(t_log_ok != 0) LOGE(tag, "Task log not created!");
+#endif
 
     /* Check if the task were created */
     if(t_inv_ok != 0) LOGE(tag, "Task invoker not created!");
@@ -73,6 +118,35 @@ int main(void)
     if(t_wdt_ok != 0) LOGE(tag, "Task watchdog not created!");
     if(t_ini_ok != 0) LOGE(tag, "Task init not created!");
 
+    /* Executer workers for non exclusive commands */
+#if SCH_TASK_EXE_IO_WORKERS > 0 || SCH_TASK_EXE_CPU_WORKERS > 0
+    int i;
+#endif
+#if SCH_TASK_EXE_IO_WORKERS > 0
+    os_thread io_workers_id[SCH_TASK_EXE_IO_WORKERS];
+    executer_io_queue = osQueueCreate(SCH_CMD_EXE_QUEUE_LEN,sizeof(cmd_t *));
+    if(executer_io_queue == 0) LOGE(tag, "Error creating executer io queue");
+    osQueueSetName(executer_io_queue, "executer_io");
+    if(cmd_queue_add_lane(executer_io_queue, SCH_CMD_EXE_QUEUE_LEN, SCH_TASK_EXE_IO_WORKERS) != CMD_OK) LOGE(tag, "Error creating executer io lane");
+    for(i=0; i<SCH_TASK_EXE_IO_WORKERS; i++)
+    {
+        int t_io_ok = osCreateTaskProfile(taskExecuter, "exe_io", SCH_TASK_EXE_STACK, &executer_io_queue, &rt_profile[1], &io_workers_id[i]);
+        if(t_io_ok != 0) LOGE(tag, "Task exe_io %d not created!", i);
+    }
+#endif
+#if SCH_TASK_EXE_CPU_WORKERS > 0
+    os_thread cpu_workers_id[SCH_TASK_EXE_CPU_WORKERS];
+    executer_cpu_queue = osQueueCreate(SCH_CMD_EXE_QUEUE_LEN,sizeof(cmd_t *));
+    if(executer_cpu_queue == 0) LOGE(tag, "Error creating executer cpu queue");
+    osQueueSetName(executer_cpu_queue, "executer_cpu");
+    if(cmd_queue_add_lane(executer_cpu_queue, SCH_CMD_EXE_QUEUE_LEN, SCH_TASK_EXE_CPU_WORKERS) != CMD_OK) LOGE(tag, "Error creating executer cpu lane");
+    for(i=0; i<SCH_TASK_EXE_CPU_WORKERS; i++)
+    {
+        int t_cpu_ok = osCreateTaskProfile(taskExecuter, "exe_cpu", SCH_TASK_EXE_STACK, &executer_cpu_queue, &rt_profile[1], &cpu_workers_id[i]);
+        if(t_cpu_ok != 0) LOGE(tag, "Task exe_cpu %d not created!", i);
+    }
+#endif
+
 #ifndef ESP32
     /* Start the scheduler. Should never return */
     osScheduler(threads_id, n_threads);
@@ -18,309 +18,2323 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_TAG_ID LOG_TAG_CMD
 #include "repoCommand.h"
+#include <ctype.h>
+#if SCH_CMD_STATIC
+#include "cmdTable.h"
+#endif
+#if SCH_CMD_TRACE
+#ifndef LINUX
+#error "SCH_CMD_TRACE is only supported in GNU/Linux"
+#endif
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#endif
 
 const static char *tag = "repoCmd";
 
+/* Commands ids: the static table (see cmdTable.h) goes first, then the
+ * commands added at runtime */
+#if SCH_CMD_STATIC
+#define CMD_STATIC_LEN CMD_TABLE_LEN    ///< Commands in the static table
+#else
+#define CMD_STATIC_LEN 0
+#endif
+#define CMD_LIST_LEN (SCH_CMD_MAX_ENTRIES-CMD_STATIC_LEN)  ///< Commands that can be added at runtime
+#if CMD_LIST_LEN < 1
+#error "SCH_CMD_MAX_ENTRIES must be larger than the static command table"
+#endif
+
 /* Global variables */
-cmd_list_t cmd_list[SCH_CMD_MAX_ENTRIES];
-int cmd_index = 0;
+int cmd_index = 0;                  ///< Commands added at runtime, id is CMD_STATIC_LEN+index
 char cmd_is_sorted = 1;
 
-int cmd_add(char *name, cmdFunction function, char *fparams, int nparam)
-{
-    if (cmd_index < SCH_CMD_MAX_ENTRIES)
+/*
+ * Commands registry, indexed by id and split by use. The dispatcher and the
+ * executers only read the hot entries (cmd_get_idx, cmd_add_params_str), so
+ * they are small and contiguous. Names are cold, only read by the lookups and
+ * listings. The static table is copied to the hot entries by cmd_repo_init.
+ * The timing statistics of each id are kept apart (cmd_stats), they are
+ * written by every execution while the entries are read-mostly.
+ */
+typedef struct cmd_hot{
+    cmdFunction function;       ///< Command function
+    const char *fmt;            ///< Format of parameters (interned, constant in the static table)
+    int16_t nparams;            ///< Number of parameters
+    uint8_t fmt_idx;            ///< Compiled format plus one, 0 if not compiled
+    uint8_t cls;                ///< Command concurrency class (cmd_class_t)
+    uint8_t priority;           ///< Command default priority (cmd_priority_t)
+    uint8_t coalesce;           ///< Merge with identical queued commands
+    uint8_t shed;               ///< Load from which the command is dropped (cmd_load_t)
+    uint32_t max_ms;            ///< Max. runtime in ms, 0 for SCH_CMD_MAX_TIME_MS
+} cmd_hot_t;
+static cmd_hot_t cmd_hot[SCH_CMD_MAX_ENTRIES];      ///< Hot entries, by command id
+static const char *cmd_names[SCH_CMD_MAX_ENTRIES];  ///< Cold entries, names by command id
+#define cmd_list_name(i) (cmd_names[CMD_STATIC_LEN+(i)])  ///< Name of the i-th command added at runtime
+
+/*
+ * Compiled parameters formats. Formats made only of numeric conversions
+ * (%d %i %u %x %o %f %e %g, with the h, l and ll modifiers) separated by
+ * spaces are compiled when the command is registered, then text parameters
+ * are parsed once by cmd_add_params_str into binary parameters. Other formats
+ * (%s, %c, %n, widths or literals) are parsed by the handler with sscanf.
+ */
+#define CMD_FMT_OPS_MAX (8)     ///< Max. conversions of a compiled format
+#define CMD_FMT_MAX (32)        ///< Max. different compiled formats
+static uint8_t cmd_fmt_ops[CMD_FMT_MAX][CMD_FMT_OPS_MAX];   ///< Compiled formats, ended by a 0 opcode
+static int cmd_fmt_count = 0;                               ///< Compiled formats in use
+
+/* Names and formats of the commands added at runtime are interned in this
+ * arena (see cmd_intern). Equal formats are stored once and the strings do
+ * not move until cmd_repo_close, so the entries keep plain pointers */
+#define CMD_ARENA_LEN (CMD_LIST_LEN*24)
+static char cmd_arena[CMD_ARENA_LEN];
+static size_t cmd_arena_used = 0;
+
+/* Entry of the ids without a command */
+static const cmd_list_t cmd_null_entry = {0, "", "null", cmd_null, CMD_CLASS_EXCLUSIVE, CMD_PRIO_NORMAL, 0, 0, CMD_LOAD_NORMAL};
+
+/* Command name lookup tables (see cmd_get_str) */
+#define CMD_HASH_SIZE (512)     ///< Hash table slots, power of two > 2*SCH_CMD_MAX_ENTRIES
+#define CMD_HASH_EMPTY (-1)     ///< Empty hash table slot
+#if SCH_CMD_MAX_ENTRIES*2 > CMD_HASH_SIZE
+#error "CMD_HASH_SIZE must be at least twice SCH_CMD_MAX_ENTRIES"
+#endif
+static int16_t cmd_hash_table[CMD_HASH_SIZE];   ///< Name hash -> runtime command index
+static char cmd_hash_ok = 0;                    ///< Hash table is valid
+static int16_t cmd_sorted_idx[CMD_LIST_LEN];    ///< Runtime command indexes sorted by name
+static int cmd_sorted_len = 0;                  ///< Valid entries in cmd_sorted_idx
+
+/* Command pool (see cmd_get_idx and cmd_free) */
+typedef struct cmd_pool_entry{
+    cmd_t cmd;                              ///< Pooled command
+    union {
+        char params[SCH_CMD_POOL_PARAMS_LEN];   ///< Inline parameters buffer
+        double align;                           ///< Align binary parameters
+    } buff;
+    volatile uint8_t used;                  ///< Entry in use flag
+} cmd_pool_entry_t;
+static cmd_pool_entry_t cmd_pool[SCH_CMD_POOL_SIZE];
+static volatile int cmd_pool_hint = 0;      ///< Next entry to try
+static volatile int cmd_pool_used = 0;      ///< Entries in use
+static volatile int cmd_pool_max = 0;       ///< Entries in use high-water mark
+static volatile int cmd_pool_misses = 0;    ///< Commands allocated with malloc
+static volatile int cmd_params_misses = 0;  ///< Parameters allocated with malloc
+
+/* Queued coalescing commands (see cmd_coalesce_check) */
+static cmd_t *cmd_coalesce_queued[SCH_CMD_COALESCE_MAX];
+
+/* Commands execution timing statistics */
+static cmd_stats_t cmd_stats[SCH_CMD_MAX_ENTRIES];
+
+/* Last dispatch to start time of each commands class [us] (see cmd_get_lag) */
+static uint32_t cmd_lag_us[CMD_CLASS_CPU+1];
+
+#if SCH_CMD_LATENCY
+/* TC latency statistics, by stage (see cmd_lat_begin) */
+static cmd_lat_stats_t cmd_lat_stats[CMD_LAT_STAGES];
+static uint32_t cmd_lat_last_id = 0;    ///< Last trace id assigned
+#endif
+
+/* Running commands, one per executer task (see cmd_exec_begin) */
+#define CMD_RUNNING_LEN (1 + SCH_TASK_EXE_IO_WORKERS + SCH_TASK_EXE_CPU_WORKERS)
+typedef struct cmd_running{
+    cmd_t *cmd;                             ///< Running command, NULL if free
+    portTick t_start;                       ///< Tick count when it started
+    uint8_t reported;                       ///< Overrun already reported
+} cmd_running_t;
+static cmd_running_t cmd_running[CMD_RUNNING_LEN];
+
+/* Commands results waited by other tasks (see cmd_future_get). A future
+ * cancelled before the command is done is released by the done callback */
+#define CMD_FUTURE_FREE      (0)
+#define CMD_FUTURE_PENDING   (1)
+#define CMD_FUTURE_DONE      (2)
+#define CMD_FUTURE_CANCELLED (3)
+typedef struct cmd_future{
+    uint8_t state;                          ///< CMD_FUTURE_* state
+    int result;                             ///< Command result, once done
+    osEvent event;                          ///< Set when the command is done
+} cmd_future_t;
+static cmd_future_t cmd_futures[SCH_CMD_FUTURES];
+
+/* High priority lanes of the commands queues (see cmd_queue_add_lane). Lanes
+ * are added at start-up and never removed, readers do not lock */
+#define CMD_LANES_MAX (4)
+typedef struct cmd_lane{
+    osQueue queue;                          ///< Commands queue
+    osQueue high;                           ///< High priority commands, FIFO
+} cmd_lane_t;
+static cmd_lane_t cmd_lanes[CMD_LANES_MAX];
+static volatile int cmd_lanes_len = 0;
+
+/* Protects the coalescing table, the futures and the statistics, that change
+ * with every command. repo_cmd_sem only protects the command list, which is
+ * read-mostly */
+static osSemaphore cmd_state_sem;
+
+#if SCH_CMD_TRACE
+/* Commands trace (see cmd_trace_start) */
+#define CMD_TRACE_ORIGINS (32)          ///< Max. tasks named in a trace
+#define CMD_TRACE_ORIGIN_LEN (16)       ///< Task names length, as pthread_getname_np
+#define CMD_TRACE_NO_ORIGIN (0xFF)      ///< Origin of the commands of not named tasks
+static osSemaphore cmd_trace_sem;       ///< Protects the trace state and file
+static FILE *cmd_trace_file = NULL;     ///< Trace file, NULL if not recording
+static portTick cmd_trace_tick;         ///< Tick count of the last record
+static uint64_t cmd_trace_us;           ///< Trace time of the last record
+static uint64_t cmd_trace_end_us;       ///< Trace time to stop recording, 0 to not stop
+static uint64_t cmd_trace_flush_us;     ///< Trace time of the last flush
+static int cmd_trace_count;             ///< Commands recorded
+static uint8_t cmd_trace_named[SCH_CMD_MAX_ENTRIES];    ///< Command name recorded
+static char cmd_trace_origins[CMD_TRACE_ORIGINS][CMD_TRACE_ORIGIN_LEN];
+static int cmd_trace_norigins;
+#endif
+
+static cmd_t *cmd_pool_get(void);
+static void cmd_pool_put(cmd_t *cmd);
+static char *cmd_params_alloc(cmd_t *cmd, size_t len);
+static void cmd_params_free(cmd_t *cmd);
+static int cmd_bin_size(const char *fmt);
+static const char *cmd_intern(const char *str);
+static uint8_t cmd_fmt_compile(const char *fmt);
+static int cmd_fmt_parse(const uint8_t *ops, const char *str, char *data);
+static int cmd_fmt_unpack(const uint8_t *ops, const uint8_t *buff, int len, char *data);
+static uint32_t cmd_hash_seed(const char *name, uint32_t seed);
+#define cmd_hash_name(name) cmd_hash_seed(name, 0)
+static void cmd_hash_clear(void);
+static void cmd_hash_insert(int idx);
+static void sort_cmd_list(void);
+static int cmd_find_idx(const char *name);
+#if SCH_CMD_STATIC
+static int cmd_static_find(const char *name);
+#endif
+#if SCH_CMD_LATENCY
+static void cmd_lat_add(cmd_t *cmd);
+#endif
+
+/**
+ * Set the hot and cold entries of a command id
+ * @note call with repo_cmd_sem taken for write
+ * @param fmt_idx Compiled format plus one, 0 if not compiled
+ */
+static void cmd_set_entry(int idx, const cmd_list_t *entry, uint8_t fmt_idx)
+{
+    cmd_hot_t *hot = &cmd_hot[idx];
+    hot->function = entry->function;
+    hot->fmt = entry->fmt;
+    hot->nparams = (int16_t)entry->nparams;
+    hot->fmt_idx = fmt_idx;
+    hot->cls = (uint8_t)entry->cls;
+    hot->priority = (uint8_t)entry->priority;
+    hot->coalesce = entry->coalesce;
+    hot->shed = (uint8_t)entry->shed;
+    hot->max_ms = entry->max_ms;
+    cmd_names[idx] = entry->name;
+}
+
+/**
+ * Check if a command id has no command, a free entry or a disabled command of
+ * the static table
+ * @note call with repo_cmd_sem taken, for read or write
+ */
+static int cmd_is_null(int idx)
+{
+    return cmd_names[idx] == cmd_null_entry.name;
+}
+
+int cmd_add(const char *name, cmdFunction function, const char *fparams, int nparam)
+{
+#if SCH_CMD_STATIC
+    // Commands of the static table are already registered
+    int static_idx = cmd_static_find(name);
+    if(static_idx >= 0 && cmd_table[static_idx].function != NULL)
+    {
+        if(cmd_table[static_idx].function != function || cmd_table[static_idx].nparams != nparam)
+            LOGW(tag, "Command %s does not match the static table, run cmdtable.py", name);
+        return static_idx + 1;
+    }
+#endif
+    if (cmd_index < CMD_LIST_LEN)
+    {
+        // Create new command
+        cmd_list_t cmd_new;
+        cmd_new.function = function;
+        cmd_new.nparams = nparam;
+        cmd_new.cls = CMD_CLASS_EXCLUSIVE;
+        cmd_new.priority = CMD_PRIO_NORMAL;
+        cmd_new.coalesce = 0;
+        cmd_new.max_ms = 0;
+        cmd_new.shed = CMD_LOAD_NORMAL;
+
+        // Copy to command buffer
+        osRWLockWriteTake(&repo_cmd_sem);
+        cmd_new.fmt = cmd_intern(fparams);
+        cmd_new.name = cmd_intern(name);
+        if(cmd_new.fmt == NULL || cmd_new.name == NULL)
+        {
+            osRWLockWriteGiven(&repo_cmd_sem);
+            LOGW(tag, "Unable to add cmd: %s. Names buffer full (%d)", name, (int)cmd_arena_used);
+            return -1;
+        }
+        cmd_set_entry(CMD_STATIC_LEN + cmd_index, &cmd_new, cmd_fmt_compile(fparams));
+        // Keep the name lookup tables updated. The sorted index is
+        // rebuilt on demand, see cmd_find_idx
+        cmd_hash_insert(cmd_index);
+        cmd_is_sorted = 0;
+        // Lookups only read, keep the fallback sorted list ready
+        if(!cmd_hash_ok)
+            sort_cmd_list();
+        cmd_index++;
+        osRWLockWriteGiven(&repo_cmd_sem);
+        return CMD_STATIC_LEN + cmd_index;
+    }
+    else
+    {
+        LOGW(tag, "Unable to add cmd: %s. Buffer full (%d)", name, cmd_index);
+        return -1;
+    }
+}
+
+/**
+ * Get the interned copy of a string, adding it to the arena if needed
+ * @note call with repo_cmd_sem taken for write
+ * @param str Str. String to intern
+ * @return Pointer to the string in the arena, NULL if the arena is full
+ */
+static const char *cmd_intern(const char *str)
+{
+    size_t i, len = strlen(str);
+    for(i = 0; i < cmd_arena_used; i += strlen(cmd_arena + i) + 1)
+    {
+        if(strcmp(cmd_arena + i, str) == 0)
+            return cmd_arena + i;
+    }
+    if(cmd_arena_used + len + 1 > CMD_ARENA_LEN)
+        return NULL;
+    char *interned = cmd_arena + cmd_arena_used;
+    memcpy(interned, str, len + 1);
+    cmd_arena_used += len + 1;
+    return interned;
+}
+
+int cmd_add_coalesce(const char *name, cmdFunction function, const char *fparams, int nparam)
+{
+    int rc = cmd_add(name, function, fparams, nparam);
+    // Static table commands already have the coalesce flag
+    if(rc > CMD_STATIC_LEN)
+    {
+        osRWLockWriteTake(&repo_cmd_sem);
+        cmd_hot[rc-1].coalesce = 1;
+        osRWLockWriteGiven(&repo_cmd_sem);
+    }
+    return rc;
+}
+
+cmd_t * cmd_get_str(const char *name)
+{
+    cmd_t *cmd_new = NULL;
+
+    //Find inside command buffer
+    osRWLockReadTake(&repo_cmd_sem);
+    int idx = cmd_find_idx(name);
+    osRWLockReadGiven(&repo_cmd_sem);
+
+    // Create the command by index
+    if(idx >= 0)
+        cmd_new = cmd_get_idx(idx);
+
+    if(cmd_new == NULL)
+    {
+        LOGW(tag, "Command not found: %s", name);
+    }
+    return cmd_new;
+}
+
+int cmd_set_class(char *name, cmd_class_t cls)
+{
+    osRWLockWriteTake(&repo_cmd_sem);
+    int idx = cmd_find_idx(name);
+    // Static table commands can not change, only check them
+    int ok = idx >= CMD_STATIC_LEN || (idx >= 0 && cmd_hot[idx].cls == cls);
+    if(idx >= CMD_STATIC_LEN)
+        cmd_hot[idx].cls = cls;
+    osRWLockWriteGiven(&repo_cmd_sem);
+
+    if(!ok)
+    {
+        LOGW(tag, "Unable to set class. Command not found or static: %s", name);
+        return CMD_ERROR;
+    }
+    return CMD_OK;
+}
+
+int cmd_set_priority(char *name, cmd_priority_t prio)
+{
+    osRWLockWriteTake(&repo_cmd_sem);
+    int idx = cmd_find_idx(name);
+    // Static table commands can not change, only check them
+    int ok = idx >= CMD_STATIC_LEN || (idx >= 0 && cmd_hot[idx].priority == prio);
+    if(idx >= CMD_STATIC_LEN)
+        cmd_hot[idx].priority = prio;
+    osRWLockWriteGiven(&repo_cmd_sem);
+
+    if(!ok)
+    {
+        LOGW(tag, "Unable to set priority. Command not found or static: %s", name);
+        return CMD_ERROR;
+    }
+    return CMD_OK;
+}
+
+int cmd_set_max_time(char *name, uint32_t max_ms)
+{
+    osRWLockWriteTake(&repo_cmd_sem);
+    int idx = cmd_find_idx(name);
+    // Static table commands can not change, only check them
+    int ok = idx >= CMD_STATIC_LEN || (idx >= 0 && cmd_hot[idx].max_ms == max_ms);
+    if(idx >= CMD_STATIC_LEN)
+        cmd_hot[idx].max_ms = max_ms;
+    osRWLockWriteGiven(&repo_cmd_sem);
+
+    if(!ok)
+    {
+        LOGW(tag, "Unable to set max. time. Command not found or static: %s", name);
+        return CMD_ERROR;
+    }
+    return CMD_OK;
+}
+
+int cmd_set_shed(char *name, cmd_load_t load)
+{
+    osRWLockWriteTake(&repo_cmd_sem);
+    int idx = cmd_find_idx(name);
+    // Static table commands can not change, only check them
+    int ok = idx >= CMD_STATIC_LEN || (idx >= 0 && cmd_hot[idx].shed == load);
+    if(idx >= CMD_STATIC_LEN)
+        cmd_hot[idx].shed = load;
+    osRWLockWriteGiven(&repo_cmd_sem);
+
+    if(!ok)
+    {
+        LOGW(tag, "Unable to set shed load. Command not found or static: %s", name);
+        return CMD_ERROR;
+    }
+    return CMD_OK;
+}
+
+/**
+ * High priority lane of a commands queue, 0 if it has none
+ */
+static osQueue cmd_queue_lane(osQueue queue)
+{
+    int i;
+    for(i = 0; i < cmd_lanes_len; i++)
+    {
+        if(cmd_lanes[i].queue == queue)
+            return cmd_lanes[i].high;
+    }
+    return 0;
+}
+
+int cmd_queue_add_lane(osQueue queue, int length, int consumers)
+{
+    if(queue == 0 || cmd_lanes_len >= CMD_LANES_MAX)
+        return CMD_ERROR;
+
+    // Each command in the lane has a marker in the queue or taken by one of
+    // the consumers, so the lane is never full
+    osQueue high = osQueueCreate(length + consumers, sizeof(cmd_t *));
+    if(high == 0)
+        return CMD_ERROR;
+
+    cmd_lanes[cmd_lanes_len].queue = queue;
+    cmd_lanes[cmd_lanes_len].high = high;
+    // Publish the lane once it is written, consumers may be running
+    __sync_synchronize();
+    cmd_lanes_len++;
+    return CMD_OK;
+}
+
+int cmd_queue_send(osQueue queue, cmd_t *cmd, uint32_t timeout)
+{
+    if(cmd->priority == CMD_PRIO_NORMAL)
+        return osQueueSend(queue, &cmd, timeout);
+
+    osQueue high = cmd_queue_lane(queue);
+    if(high == 0)
+        return osQueueSendToFront(queue, &cmd, timeout);
+
+    // The marker goes first, so the command is never left in the lane
+    cmd_t *marker = NULL;
+    int rc = osQueueSendToFront(queue, &marker, timeout);
+    if(rc == pdPASS)
+        osQueueSend(high, &cmd, portMAX_DELAY);
+    return rc;
+}
+
+cmd_t *cmd_queue_high(osQueue queue)
+{
+    cmd_t *cmd = NULL;
+    osQueue high = cmd_queue_lane(queue);
+    // The marker may arrive before its command, which is being sent
+    if(high != 0 && osQueueReceive(high, &cmd, portMAX_DELAY) != pdPASS)
+        cmd = NULL;
+    return cmd;
+}
+
+/**
+ * Count and free a command dropped because the dispatcher queue was full
+ */
+static void cmd_drop_full(cmd_t *cmd)
+{
+    if(cmd->id >= 0 && cmd->id < SCH_CMD_MAX_ENTRIES)
+    {
+        osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+        cmd_stats[cmd->id].full++;
+        osSemaphoreGiven(&cmd_state_sem);
+    }
+    cmd_free(cmd);
+}
+
+#if SCH_CMD_TRACE
+/**
+ * Write a trace record and its data
+ * @note call with cmd_trace_sem taken and the trace running
+ */
+static int cmd_trace_write(cmd_trace_type_t type, int id, int origin, const void *data, size_t len)
+{
+    cmd_trace_rec_t rec;
+    rec.t_ms = (uint32_t)(cmd_trace_us/1000);
+    rec.id = (uint16_t)id;
+    rec.len = (uint16_t)len;
+    rec.type = (uint8_t)type;
+    rec.origin = (uint8_t)origin;
+    if(fwrite(&rec, sizeof(rec), 1, cmd_trace_file) != 1)
+        return -1;
+    if(len > 0 && fwrite(data, len, 1, cmd_trace_file) != 1)
+        return -1;
+    return 0;
+}
+
+/**
+ * Index of the task that runs this function in the trace, its name is
+ * recorded the first time
+ * @note call with cmd_trace_sem taken and the trace running
+ */
+static int cmd_trace_origin(void)
+{
+    char name[CMD_TRACE_ORIGIN_LEN] = "";
+    pthread_getname_np(pthread_self(), name, sizeof(name));
+
+    int i;
+    for(i=0; i<cmd_trace_norigins; i++)
+    {
+        if(strncmp(cmd_trace_origins[i], name, CMD_TRACE_ORIGIN_LEN) == 0)
+            return i;
+    }
+    if(cmd_trace_norigins == CMD_TRACE_ORIGINS)
+        return CMD_TRACE_NO_ORIGIN;
+    memcpy(cmd_trace_origins[i], name, CMD_TRACE_ORIGIN_LEN);
+    cmd_trace_norigins++;
+    if(cmd_trace_write(CMD_TRACE_ORIGIN, 0, i, name, strnlen(name, CMD_TRACE_ORIGIN_LEN-1)+1) != 0)
+        return -1;
+    return i;
+}
+
+/**
+ * Close the trace file
+ * @note call with cmd_trace_sem taken
+ */
+static int cmd_trace_close(void)
+{
+    if(cmd_trace_file == NULL)
+        return 0;
+    if(fclose(cmd_trace_file) != 0)
+        LOGE(tag, "Error closing the commands trace");
+    cmd_trace_file = NULL;
+    LOGI(tag, "Commands trace stopped, %d commands recorded", cmd_trace_count);
+    return cmd_trace_count;
+}
+
+/**
+ * Record a command sent to the dispatcher
+ */
+static void cmd_trace_add(cmd_t *cmd)
+{
+    if(cmd_trace_file == NULL || cmd->id < 0 || cmd->id >= SCH_CMD_MAX_ENTRIES)
+        return;
+
+    size_t len = 0;
+    if(cmd_params_is_bin(cmd->params))
+        len = (size_t)cmd_bin_size(cmd->fmt) + CMD_PARAMS_BIN_HEADER;
+    else if(cmd->params != NULL)
+        len = strnlen(cmd->params, SCH_CMD_MAX_STR_PARAMS-1) + 1;
+
+    osSemaphoreTake(&cmd_trace_sem, portMAX_DELAY);
+    if(cmd_trace_file == NULL)
+    {
+        osSemaphoreGiven(&cmd_trace_sem);
+        return;
+    }
+
+    // Ticks wrap around, the trace time is accumulated
+    portTick now = osTaskGetTickCount();
+    cmd_trace_us += (uint64_t)(portTick)(now - cmd_trace_tick)*1000/osDefineTime(1);
+    cmd_trace_tick = now;
+
+    int rc = 0;
+    if(!cmd_trace_named[cmd->id])
+    {
+        const char *name = cmd_get_name(cmd->id);
+        char data[SCH_CMD_MAX_STR_NAME+SCH_CMD_MAX_STR_FORMAT];
+        int n = snprintf(data, sizeof(data), "%s%c%s", name != NULL ? name : "", 0, cmd->fmt != NULL ? cmd->fmt : "");
+        if(n >= (int)sizeof(data))
+            n = (int)sizeof(data) - 1;
+        rc = cmd_trace_write(CMD_TRACE_NAME, cmd->id, 0, data, (size_t)n + 1);
+        cmd_trace_named[cmd->id] = 1;
+    }
+    int origin = cmd_trace_origin();
+    if(rc == 0 && origin >= 0)
+        rc = cmd_trace_write(CMD_TRACE_CMD, cmd->id, origin, cmd->params, len);
+    cmd_trace_count++;
+
+    if(rc != 0 || origin < 0)
+    {
+        LOGE(tag, "Error writing the commands trace");
+        cmd_trace_close();
+    }
+    else if(cmd_trace_end_us > 0 && cmd_trace_us >= cmd_trace_end_us)
+    {
+        cmd_trace_close();
+    }
+    else if(cmd_trace_us - cmd_trace_flush_us >= 1000000)
+    {
+        // Keep most of the trace if the OBC resets
+        fflush(cmd_trace_file);
+        cmd_trace_flush_us = cmd_trace_us;
+    }
+    osSemaphoreGiven(&cmd_trace_sem);
+}
+#endif
+
+int cmd_trace_start(const char *path, int seconds)
+{
+#if SCH_CMD_TRACE
+    osSemaphoreTake(&cmd_trace_sem, portMAX_DELAY);
+    cmd_trace_close();
+    cmd_trace_file = fopen(path, "wb");
+    if(cmd_trace_file == NULL)
+    {
+        osSemaphoreGiven(&cmd_trace_sem);
+        LOGE(tag, "Unable to create the commands trace %s", path);
+        return CMD_ERROR;
+    }
+
+    cmd_trace_header_t header = {CMD_TRACE_MAGIC, CMD_TRACE_VERSION, 0, (uint32_t)time(NULL)};
+    fwrite(&header, sizeof(header), 1, cmd_trace_file);
+    cmd_trace_tick = osTaskGetTickCount();
+    cmd_trace_us = 0;
+    cmd_trace_flush_us = 0;
+    cmd_trace_end_us = seconds > 0 ? (uint64_t)seconds*1000000 : 0;
+    cmd_trace_count = 0;
+    cmd_trace_norigins = 0;
+    memset(cmd_trace_named, 0, sizeof(cmd_trace_named));
+    osSemaphoreGiven(&cmd_trace_sem);
+
+    LOGI(tag, "Commands trace started in %s", path);
+    return CMD_OK;
+#else
+    LOGW(tag, "Commands trace not available, set SCH_CMD_TRACE");
+    return CMD_ERROR;
+#endif
+}
+
+int cmd_trace_stop(void)
+{
+#if SCH_CMD_TRACE
+    osSemaphoreTake(&cmd_trace_sem, portMAX_DELAY);
+    int count = cmd_trace_close();
+    osSemaphoreGiven(&cmd_trace_sem);
+    return count;
+#else
+    return 0;
+#endif
+}
+
+int cmd_send_timeout(cmd_t *cmd, uint32_t timeout)
+{
+    if(cmd == NULL)
+        return CMD_ERROR;
+
+#if SCH_CMD_TRACE
+    cmd_trace_add(cmd);
+#endif
+    // Marked before sending, the command belongs to the dispatcher then
+    cmd_lat_mark(cmd, CMD_LAT_QUEUE);
+    if(cmd_queue_send(dispatcher_queue, cmd, timeout) == pdPASS)
+        return CMD_OK;
+    LOGW(tag, "Cmd %d dropped, dispatcher queue full", cmd->id);
+    cmd_drop_full(cmd);
+    return CMD_DROPPED;
+}
+
+int cmd_send_batch(cmd_t **cmds, int n, int all, uint32_t timeout)
+{
+    if(cmds == NULL || n <= 0)
+        return 0;
+
+    int i, sent;
+#if SCH_CMD_TRACE
+    for(i=0; i<n; i++)
+        cmd_trace_add(cmds[i]);
+#endif
+    for(i=0; i<n; i++)
+        cmd_lat_mark(cmds[i], CMD_LAT_QUEUE);
+    sent = osQueueSendBatch(dispatcher_queue, cmds, n, sizeof(cmd_t *), timeout, all);
+    if(sent < n)
+    {
+        LOGW(tag, "Only %d of %d commands sent", sent, n);
+        for(i=sent; i<n; i++)
+            cmd_drop_full(cmds[i]);
+    }
+    return sent;
+}
+
+int cmd_send_from_isr(cmd_t *cmd, int *task_woken)
+{
+    *task_woken = 0;
+    if(cmd == NULL)
+        return CMD_ERROR;
+
+    int rc;
+    osQueue high = cmd_queue_lane(dispatcher_queue);
+    if(cmd->priority == CMD_PRIO_NORMAL)
+    {
+        rc = osQueueSendFromISR(dispatcher_queue, &cmd, task_woken);
+    }
+    else if(high == 0)
+    {
+        rc = osQueueSendToFrontFromISR(dispatcher_queue, &cmd, task_woken);
+    }
+    else
+    {
+        // As cmd_queue_send, the lane has space if the marker was sent
+        cmd_t *marker = NULL;
+        int woken = 0;
+        rc = osQueueSendToFrontFromISR(dispatcher_queue, &marker, task_woken);
+        if(rc == pdPASS)
+            osQueueSendFromISR(high, &cmd, &woken);
+        *task_woken |= woken;
+    }
+    return rc == pdPASS ? CMD_OK : CMD_DROPPED;
+}
+
+void cmd_set_done(cmd_t *cmd, cmdDoneFunction done, void *arg)
+{
+    if(cmd == NULL)
+        return;
+    cmd->done = done;
+    cmd->done_arg = arg;
+}
+
+void cmd_done(cmd_t *cmd, int result)
+{
+    if(cmd == NULL)
+        return;
+    if(cmd->done != NULL)
+    {
+        // Cleared first, so the callback is called only once
+        cmdDoneFunction done = cmd->done;
+        cmd->done = NULL;
+        done(cmd, result, cmd->done_arg);
+    }
+#if SCH_CMD_LATENCY
+    if(cmd->trace_id != 0)
+        cmd_lat_add(cmd);
+#endif
+}
+
+/**
+ * Done callback of the commands with a future, @see cmd_future_get
+ */
+static void cmd_future_done(cmd_t *cmd, int result, void *arg)
+{
+    cmd_future_t *future = (cmd_future_t *)arg;
+    osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+    if(future->state == CMD_FUTURE_CANCELLED)
+        future->state = CMD_FUTURE_FREE;
+    else
+    {
+        future->result = result;
+        future->state = CMD_FUTURE_DONE;
+        osEventSet(&future->event, 1);
+    }
+    osSemaphoreGiven(&cmd_state_sem);
+}
+
+int cmd_future_get(cmd_t *cmd)
+{
+    if(cmd == NULL)
+        return -1;
+
+    int i;
+    osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+    for(i = 0; i < SCH_CMD_FUTURES && cmd_futures[i].state != CMD_FUTURE_FREE; i++);
+    if(i < SCH_CMD_FUTURES)
+        cmd_futures[i].state = CMD_FUTURE_PENDING;
+    osSemaphoreGiven(&cmd_state_sem);
+
+    if(i == SCH_CMD_FUTURES)
+    {
+        LOGW(tag, "No futures to wait command %d", cmd->id);
+        return -1;
+    }
+    // Clear the event of a previous future cancelled once done
+    osEventWait(&cmd_futures[i].event, 1, 0);
+    cmd_set_done(cmd, cmd_future_done, &cmd_futures[i]);
+    return i;
+}
+
+int cmd_future_wait(int future, uint32_t timeout)
+{
+    if(future < 0 || future >= SCH_CMD_FUTURES)
+        return CMD_ERROR;
+
+    osEventWait(&cmd_futures[future].event, 1, timeout);
+    int result = CMD_TIMEOUT;
+    osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+    if(cmd_futures[future].state == CMD_FUTURE_DONE)
+    {
+        result = cmd_futures[future].result;
+        cmd_futures[future].state = CMD_FUTURE_FREE;
+    }
+    osSemaphoreGiven(&cmd_state_sem);
+    return result;
+}
+
+void cmd_future_cancel(int future)
+{
+    if(future < 0 || future >= SCH_CMD_FUTURES)
+        return;
+
+    osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+    if(cmd_futures[future].state == CMD_FUTURE_DONE)
+        cmd_futures[future].state = CMD_FUTURE_FREE;
+    else if(cmd_futures[future].state == CMD_FUTURE_PENDING)
+        cmd_futures[future].state = CMD_FUTURE_CANCELLED;
+    osSemaphoreGiven(&cmd_state_sem);
+}
+
+int cmd_send_wait(cmd_t *cmd, uint32_t timeout)
+{
+    if(cmd == NULL)
+        return CMD_ERROR;
+
+    int future = cmd_future_get(cmd);
+    cmd_send(cmd);
+    if(future < 0)
+        return CMD_TIMEOUT;
+    int result = cmd_future_wait(future, timeout);
+    if(result == CMD_TIMEOUT)
+        cmd_future_cancel(future);
+    return result;
+}
+
+/**
+ * Compare two commands parameters, as string or binary parameters
+ */
+static int cmd_params_equal(cmd_t *a, cmd_t *b)
+{
+    if(a->params == NULL || b->params == NULL)
+        return a->params == b->params;
+    if(cmd_params_is_bin(a->params) != cmd_params_is_bin(b->params))
+        return 0;
+    if(cmd_params_is_bin(a->params))
+        return memcmp(a->params, b->params, (size_t)cmd_bin_size(a->fmt) + CMD_PARAMS_BIN_HEADER) == 0;
+    return strcmp(a->params, b->params) == 0;
+}
+
+int cmd_coalesce_check(cmd_t *cmd)
+{
+    if(cmd == NULL || !cmd->coalesce)
+        return 0;
+
+    int i, free_slot = -1, found = 0;
+    osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+    for(i=0; i<SCH_CMD_COALESCE_MAX && !found; i++)
+    {
+        cmd_t *queued = cmd_coalesce_queued[i];
+        if(queued == NULL)
+        {
+            if(free_slot < 0)
+                free_slot = i;
+        }
+        else if(queued->id == cmd->id && cmd_params_equal(queued, cmd))
+            found = 1;
+    }
+    // If the table is full the command is just not tracked
+    if(!found && free_slot >= 0)
+        cmd_coalesce_queued[free_slot] = cmd;
+    osSemaphoreGiven(&cmd_state_sem);
+
+    if(found)
+        LOGD(tag, "Cmd %d coalesced with a queued one", cmd->id);
+    return found;
+}
+
+void cmd_coalesce_done(cmd_t *cmd)
+{
+    if(cmd == NULL || !cmd->coalesce)
+        return;
+
+    int i;
+    osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+    for(i=0; i<SCH_CMD_COALESCE_MAX; i++)
+    {
+        if(cmd_coalesce_queued[i] == cmd)
+        {
+            cmd_coalesce_queued[i] = NULL;
+            break;
+        }
+    }
+    osSemaphoreGiven(&cmd_state_sem);
+}
+
+/**
+ * Convert a tick count to microseconds
+ */
+static uint32_t cmd_ticks_to_us(portTick ticks)
+{
+    return (uint32_t)((uint64_t)ticks * 1000 / osDefineTime(1));
+}
+
+/**
+ * Max. runtime of a command in us, 0 if it is not checked
+ */
+static uint32_t cmd_max_us(cmd_t *cmd)
+{
+    uint32_t max_ms = cmd->max_ms ? cmd->max_ms : SCH_CMD_MAX_TIME_MS;
+    return max_ms < UINT32_MAX/1000 ? max_ms*1000 : UINT32_MAX;
+}
+
+portTick cmd_exec_begin(cmd_t *cmd)
+{
+    portTick now = osTaskGetTickCount();
+    if(cmd == NULL)
+        return now;
+
+    int i;
+    osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+    for(i = 0; i < CMD_RUNNING_LEN && cmd_running[i].cmd != NULL; i++);
+    if(i < CMD_RUNNING_LEN)
+        cmd_running[i] = (cmd_running_t){cmd, now, 0};
+    osSemaphoreGiven(&cmd_state_sem);
+    return now;
+}
+
+/**
+ * Running command with the given parameters. Call with cmd_state_sem taken.
+ */
+static cmd_t *cmd_running_find(char *params)
+{
+    int i;
+    for(i = 0; params != NULL && i < CMD_RUNNING_LEN; i++)
+    {
+        if(cmd_running[i].cmd != NULL && cmd_running[i].cmd->params == params)
+            return cmd_running[i].cmd;
+    }
+    return NULL;
+}
+
+uint32_t cmd_get_cursor(char *params)
+{
+    osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+    cmd_t *cmd = cmd_running_find(params);
+    uint32_t cursor = cmd != NULL ? cmd->cursor : 0;
+    osSemaphoreGiven(&cmd_state_sem);
+    return cursor;
+}
+
+int cmd_set_cursor(char *params, uint32_t cursor)
+{
+    osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+    cmd_t *cmd = cmd_running_find(params);
+    if(cmd != NULL)
+        cmd->cursor = cursor;
+    osSemaphoreGiven(&cmd_state_sem);
+    return cmd != NULL ? 0 : -1;
+}
+
+int cmd_check_overruns(void)
+{
+    int i, n = 0, n_new = 0;
+    int ids[CMD_RUNNING_LEN];
+    uint32_t execs[CMD_RUNNING_LEN], maxs[CMD_RUNNING_LEN];
+    portTick now = osTaskGetTickCount();
+
+    osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+    for(i = 0; i < CMD_RUNNING_LEN; i++)
+    {
+        cmd_t *cmd = cmd_running[i].cmd;
+        uint32_t max = cmd == NULL ? 0 : cmd_max_us(cmd);
+        uint32_t exec = cmd_ticks_to_us(now - cmd_running[i].t_start);
+        if(max == 0 || exec <= max)
+            continue;
+        n++;
+        if(cmd_running[i].reported)
+            continue;
+        // Report each execution once, counted here as it may never end
+        cmd_running[i].reported = 1;
+        if(cmd->id >= 0 && cmd->id < SCH_CMD_MAX_ENTRIES)
+            cmd_stats[cmd->id].overruns++;
+        ids[n_new] = cmd->id;
+        execs[n_new] = exec;
+        maxs[n_new++] = max;
+    }
+    osSemaphoreGiven(&cmd_state_sem);
+
+    for(i = 0; i < n_new; i++)
+    {
+        LOGE(tag, "Command %d running for %u ms, over its max. time (%u ms)", ids[i],
+             (unsigned int)(execs[i]/1000), (unsigned int)(maxs[i]/1000));
+    }
+    return n;
+}
+
+void cmd_stats_add(cmd_t *cmd, portTick t_start, portTick t_end, int last)
+{
+    if(cmd == NULL || cmd->id < 0 || cmd->id >= SCH_CMD_MAX_ENTRIES)
+        return;
+
+    uint32_t exec = cmd_ticks_to_us(t_end - t_start);
+    uint32_t wait = cmd->t_dispatch ? cmd_ticks_to_us(t_start - cmd->t_dispatch) : 0;
+    uint32_t max = cmd_max_us(cmd);
+    int i, overrun = max > 0 && exec > max;
+
+    osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+    for(i = 0; i < CMD_RUNNING_LEN; i++)
+    {
+        if(cmd_running[i].cmd != cmd)
+            continue;
+        if(cmd_running[i].reported)
+            overrun = 0;
+        cmd_running[i].cmd = NULL;
+        break;
+    }
+    if(cmd->cls <= CMD_CLASS_CPU)
+        cmd_lag_us[cmd->cls] = wait;
+    cmd_stats_t *stats = &cmd_stats[cmd->id];
+    if(overrun)
+        stats->overruns++;
+
+    // The chunks of a command are added up and counted once, with the last
+    cmd->exec_us += exec;
+    cmd->wait_us += wait;
+    if(last)
+    {
+        uint32_t total = cmd->exec_us;
+        int bucket = 0;
+        uint32_t limit = 100;
+        while(bucket < CMD_STATS_BUCKETS-1 && total >= limit)
+        {
+            bucket++;
+            limit *= 10;
+        }
+
+        if(stats->count == 0 || total < stats->exec_min)
+            stats->exec_min = total;
+        if(total > stats->exec_max)
+            stats->exec_max = total;
+        if(cmd->wait_us > stats->wait_max)
+            stats->wait_max = cmd->wait_us;
+        stats->exec_sum += total;
+        stats->wait_sum += cmd->wait_us;
+        stats->hist[bucket]++;
+        stats->count++;
+    }
+    osSemaphoreGiven(&cmd_state_sem);
+
+    if(overrun)
+    {
+        LOGW(tag, "Command %d ran for %u ms, over its max. time (%u ms)", cmd->id,
+             (unsigned int)(exec/1000), (unsigned int)(max/1000));
+    }
+}
+
+int cmd_shed_check(cmd_t *cmd, cmd_load_t load)
+{
+    if(cmd == NULL || cmd->shed == CMD_LOAD_NORMAL || load < cmd->shed)
+        return 0;
+
+    if(cmd->id >= 0 && cmd->id < SCH_CMD_MAX_ENTRIES)
+    {
+        osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+        cmd_stats[cmd->id].shed++;
+        osSemaphoreGiven(&cmd_state_sem);
+    }
+    LOGD(tag, "Cmd %d dropped, executers load %d", cmd->id, load);
+    return 1;
+}
+
+uint32_t cmd_get_lag(cmd_class_t cls)
+{
+    if(cls > CMD_CLASS_CPU)
+        return 0;
+    osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+    uint32_t lag = cmd_lag_us[cls];
+    osSemaphoreGiven(&cmd_state_sem);
+    return lag/1000;
+}
+
+int cmd_stats_get(int idx, cmd_stats_t *stats)
+{
+    if(stats == NULL || idx < 0 || idx >= SCH_CMD_MAX_ENTRIES)
+        return CMD_ERROR;
+
+    osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+    *stats = cmd_stats[idx];
+    osSemaphoreGiven(&cmd_state_sem);
+    return CMD_OK;
+}
+
+void cmd_stats_reset(void)
+{
+    osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+    memset(cmd_stats, 0, sizeof(cmd_stats));
+    osSemaphoreGiven(&cmd_state_sem);
+}
+
+uint32_t cmd_lat_begin(cmd_t *cmd, uint32_t trace_id, portTick t_rx)
+{
+#if SCH_CMD_LATENCY
+    if(cmd == NULL)
+        return trace_id;
+    // 0 means not traced, it is skipped when the ids wrap around
+    while(trace_id == 0)
+        trace_id = __atomic_add_fetch(&cmd_lat_last_id, 1, __ATOMIC_RELAXED);
+
+    memset(cmd->t_trace, 0, sizeof(cmd->t_trace));
+    cmd->trace_id = trace_id;
+    cmd->t_trace[CMD_LAT_RX] = t_rx;
+    cmd->t_trace[CMD_LAT_BUILD] = osTaskGetTickCount();
+    return trace_id;
+#else
+    return 0;
+#endif
+}
+
+void cmd_lat_mark(cmd_t *cmd, cmd_lat_stage_t stage)
+{
+#if SCH_CMD_LATENCY
+    if(cmd != NULL && cmd->trace_id != 0 && stage < CMD_LAT_STAGES && cmd->t_trace[stage] == 0)
+        cmd->t_trace[stage] = osTaskGetTickCount();
+#endif
+}
+
+#if SCH_CMD_LATENCY
+/**
+ * Add the latency of each stage of a traced command to the statistics and
+ * end its trace. Commands dropped before the execution end is marked are not
+ * added. Called by cmd_done.
+ */
+static void cmd_lat_add(cmd_t *cmd)
+{
+    cmd_lat_mark(cmd, CMD_LAT_DONE);
+    uint32_t trace_id = cmd->trace_id;
+    cmd->trace_id = 0;
+    if(cmd->t_trace[CMD_LAT_END] == 0)
+        return;
+
+    // Latency from the previous stage, the CMD_LAT_RX entry is the total
+    uint32_t lat[CMD_LAT_STAGES];
+    int s;
+    lat[CMD_LAT_RX] = cmd_ticks_to_us(cmd->t_trace[CMD_LAT_DONE] - cmd->t_trace[CMD_LAT_RX]);
+    for(s = 1; s < CMD_LAT_STAGES; s++)
+    {
+        int valid = cmd->t_trace[s] != 0 && cmd->t_trace[s-1] != 0;
+        lat[s] = valid ? cmd_ticks_to_us(cmd->t_trace[s] - cmd->t_trace[s-1]) : UINT32_MAX;
+    }
+
+    osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+    for(s = 0; s < CMD_LAT_STAGES; s++)
+    {
+        // Stages skipped by the command (not sent by cmd_send) are not added
+        if(lat[s] == UINT32_MAX)
+            continue;
+        int bucket = 0;
+        uint32_t limit = 16;
+        while(bucket < CMD_LAT_BUCKETS-1 && lat[s] >= limit)
+        {
+            bucket++;
+            limit *= 2;
+        }
+        cmd_lat_stats_t *stats = &cmd_lat_stats[s];
+        if(lat[s] > stats->max)
+            stats->max = lat[s];
+        stats->sum += lat[s];
+        stats->hist[bucket]++;
+        stats->count++;
+    }
+    osSemaphoreGiven(&cmd_state_sem);
+
+    LOGD(tag, "TC trace %u: cmd %d done in %u us", (unsigned int)trace_id, cmd->id, (unsigned int)lat[CMD_LAT_RX]);
+}
+#endif
+
+uint32_t cmd_lat_get(cmd_lat_stats_t *stats)
+{
+#if SCH_CMD_LATENCY
+    osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+    memcpy(stats, cmd_lat_stats, sizeof(cmd_lat_stats));
+    osSemaphoreGiven(&cmd_state_sem);
+    return __atomic_load_n(&cmd_lat_last_id, __ATOMIC_RELAXED);
+#else
+    memset(stats, 0, sizeof(cmd_lat_stats_t)*CMD_LAT_STAGES);
+    return 0;
+#endif
+}
+
+const char *cmd_lat_get_name(int stage)
+{
+    static const char *names[CMD_LAT_STAGES] = {"total", "build", "send", "dispatch", "wait", "exec", "result"};
+    return stage >= 0 && stage < CMD_LAT_STAGES ? names[stage] : "";
+}
+
+void cmd_lat_reset(void)
+{
+#if SCH_CMD_LATENCY
+    osSemaphoreTake(&cmd_state_sem, portMAX_DELAY);
+    memset(cmd_lat_stats, 0, sizeof(cmd_lat_stats));
+    osSemaphoreGiven(&cmd_state_sem);
+#endif
+}
+
+int cmd_resolve(const char *name)
+{
+    osRWLockReadTake(&repo_cmd_sem);
+    int idx = cmd_find_idx(name);
+    osRWLockReadGiven(&repo_cmd_sem);
+
+    if(idx < 0)
+    {
+        LOGW(tag, "Command not found: %s", name);
+    }
+    return idx;
+}
+
+cmd_t * cmd_get_idx(int idx)
+{
+    cmd_t *cmd_new = NULL;
+
+    if (idx >= 0 && idx < SCH_CMD_MAX_ENTRIES)
+    {
+        // Get found command
+        osRWLockReadTake(&repo_cmd_sem);
+        cmd_hot_t cmd_found = cmd_hot[idx];
+        osRWLockReadGiven(&repo_cmd_sem);
+
+        // Creates a new command
+        cmd_new = cmd_pool_get();
+        if(cmd_new == NULL)
+            return NULL;
+
+        // Fill parameters
+        cmd_new->id = idx;
+        cmd_new->fmt = (char *)cmd_found.fmt; // Shared, handlers only read it
+        cmd_new->function = cmd_found.function;
+        cmd_new->nparams = cmd_found.nparams;
+        cmd_new->params = NULL;
+        cmd_new->release = NULL;
+        cmd_new->release_ref = NULL;
+        cmd_new->cls = (cmd_class_t)cmd_found.cls;
+        cmd_new->priority = (cmd_priority_t)cmd_found.priority;
+        cmd_new->t_dispatch = 0;
+        cmd_new->coalesce = cmd_found.coalesce;
+        cmd_new->max_ms = cmd_found.max_ms;
+        cmd_new->shed = (cmd_load_t)cmd_found.shed;
+        cmd_new->cursor = 0;
+        cmd_new->exec_us = 0;
+        cmd_new->wait_us = 0;
+        cmd_new->done = NULL;
+        cmd_new->done_arg = NULL;
+        cmd_new->trace_id = 0;
+    }
+    else
+    {
+        LOGW(tag, "Command index found: %d", idx);
+    }
+
+    return cmd_new;
+}
+
+const char *cmd_get_name(int idx)
+{
+    const char *name = NULL;
+    if (idx >= 0 && idx < SCH_CMD_MAX_ENTRIES)
+    {
+        // Names are constant or interned, they are valid until cmd_repo_close
+        osRWLockReadTake(&repo_cmd_sem);
+        name = cmd_names[idx];
+        osRWLockReadGiven(&repo_cmd_sem);
+        LOGV(tag, "Cmd name found: %s", name);
+    }
+    else
+    {
+        LOGW(tag, "Command index not found: %d", idx);
+    }
+
+    return name;
+}
+
+void cmd_add_params_raw(cmd_t *cmd, void *params, int len)
+{
+    // Check pointers
+    if(cmd != NULL && params != NULL)
+    {
+        LOGD(tag, "Copying %d bytes as parameters", len);
+        cmd->params = cmd_params_alloc(cmd, (size_t)len);
+        if(cmd->params != NULL)
+            memcpy(cmd->params, params, (size_t)len);
+    }
+}
+
+void cmd_add_params_owned(cmd_t *cmd, void *params, void *ref, cmdReleaseFunction release)
+{
+    if(cmd == NULL)
+    {
+        // The buffer is released anyway, callers always give up the ownership
+        if(release != NULL)
+            release(ref);
+        return;
+    }
+
+    cmd_params_free(cmd);
+    cmd->params = (char *)params;
+    cmd->release = release;
+    cmd->release_ref = ref;
+}
+
+/**
+ * Fill the binary parameters of a command with a parameters struct
+ */
+static void cmd_params_set_bin(cmd_t *cmd, const void *data, size_t size)
+{
+    cmd->params = cmd_params_alloc(cmd, size + CMD_PARAMS_BIN_HEADER);
+    if(cmd->params != NULL)
+    {
+        memset(cmd->params, 0, CMD_PARAMS_BIN_HEADER);
+        cmd->params[0] = CMD_PARAMS_BIN_MAGIC;
+        memcpy(cmd->params + CMD_PARAMS_BIN_HEADER, data, size);
+    }
+}
+
+void cmd_add_params_str(cmd_t *cmd, char *params)
+{
+    // Text parameters can not be confused with binary parameters
+    if(*params == CMD_PARAMS_BIN_MAGIC)
+        params++;
+
+    size_t len_param = strlen(params);
+    if(len_param > SCH_CMD_MAX_STR_PARAMS)
+    {
+        LOGW(tag, "Parameters larger than CMD_MAX_STR_PARAMS will be shorted!( (%d > %d)",
+             (int)len_param, SCH_CMD_MAX_STR_PARAMS);
+        len_param = SCH_CMD_MAX_STR_PARAMS;
+    }
+
+    // Check pointers
+    if(cmd != NULL && len_param)
+    {
+        // Numeric parameters are parsed once here and handlers get the binary
+        // parameters (see cmd_scan_params). If the parsing fails the text is
+        // kept, so the handler reports the error as usual.
+        uint8_t fmt_idx = cmd->id >= 0 && cmd->id < SCH_CMD_MAX_ENTRIES ? cmd_hot[cmd->id].fmt_idx : 0;
+        if(fmt_idx != 0)
+        {
+            long long data[CMD_FMT_OPS_MAX];
+            int size = cmd_fmt_parse(cmd_fmt_ops[fmt_idx-1], params, (char *)data);
+            if(size >= 0)
+            {
+                cmd_params_set_bin(cmd, data, (size_t)size);
+                return;
+            }
+        }
+
+        cmd->params = cmd_params_alloc(cmd, sizeof(char)*(len_param+1));
+        if(cmd->params != NULL)
+        {
+            strncpy(cmd->params, params, len_param);
+            cmd->params[len_param] = '\0';
+        }
+    }
+}
+
+void cmd_add_params_var(cmd_t *cmd, ...)
+{
+    if(cmd != NULL)
+    {
+        va_list args;
+        va_start(args, cmd);
+
+        //Parsing arguments to string
+        char str_params[SCH_CMD_MAX_STR_PARAMS];
+        vsprintf(str_params, cmd->fmt, args);
+
+        va_end(args);
+
+        //Fill parameters as string
+        cmd_add_params_str(cmd, str_params);
+    }
+}
+
+/* Binary parameters field types */
+typedef enum cmd_bin_type{
+    CMD_BIN_END = 0,    ///< End of format
+    CMD_BIN_CHAR,       ///< %c
+    CMD_BIN_SHORT,      ///< %hd %hu
+    CMD_BIN_INT,        ///< %d %i %u %x %o
+    CMD_BIN_LONG,       ///< %ld %lu
+    CMD_BIN_LLONG,      ///< %lld %llu
+    CMD_BIN_FLOAT,      ///< %f %e %g
+    CMD_BIN_DOUBLE,     ///< %lf %le %lg
+    CMD_BIN_UNSUPPORTED ///< %s %n and others
+} cmd_bin_type_t;
+
+/**
+ * Parse the next conversion of a parameters format string
+ * @param fmt Pointer to the format string, updated to the next conversion
+ * @param size Set to the field size in bytes
+ * @return cmd_bin_type_t. Field type
+ */
+static cmd_bin_type_t cmd_bin_next_field(const char **fmt, size_t *size)
+{
+    const char *f = *fmt;
+    int longs = 0, shorts = 0;
+
+    // Find next conversion, skipping literal %%
+    while(*f != '\0')
+    {
+        if(*f == '%' && *(f+1) == '%')
+            f += 2;
+        else if(*f == '%')
+            break;
+        else
+            f++;
+    }
+    if(*f == '\0')
+    {
+        *fmt = f;
+        return CMD_BIN_END;
+    }
+
+    f++;
+    while(*f >= '0' && *f <= '9') f++; // Skip width
+    while(*f == 'l' || *f == 'h')
+    {
+        if(*f == 'l') longs++; else shorts++;
+        f++;
+    }
+    char conv = *f;
+    *fmt = (*f != '\0') ? f + 1 : f;
+
+    switch(conv)
+    {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+            if(shorts) { *size = sizeof(short); return CMD_BIN_SHORT; }
+            if(longs == 1) { *size = sizeof(long); return CMD_BIN_LONG; }
+            if(longs > 1) { *size = sizeof(long long); return CMD_BIN_LLONG; }
+            *size = sizeof(int);
+            return CMD_BIN_INT;
+        case 'f': case 'e': case 'g': case 'E': case 'G':
+            if(longs) { *size = sizeof(double); return CMD_BIN_DOUBLE; }
+            *size = sizeof(float);
+            return CMD_BIN_FLOAT;
+        case 'c':
+            *size = sizeof(char);
+            return CMD_BIN_CHAR;
+        default:
+            *size = 0;
+            return CMD_BIN_UNSUPPORTED;
+    }
+}
+
+/**
+ * Calculates the binary parameters size for a format, using the C struct
+ * alignment rules. Returns -1 if the format can not be packed.
+ */
+static int cmd_bin_size(const char *fmt)
+{
+    size_t offset = 0, size = 0;
+    cmd_bin_type_t type;
+    while((type = cmd_bin_next_field(&fmt, &size)) != CMD_BIN_END)
+    {
+        if(type == CMD_BIN_UNSUPPORTED)
+            return -1;
+        offset = (offset + size - 1) / size * size;
+        offset += size;
+    }
+    return (int)offset;
+}
+
+/*
+ * Compiled parameters formats opcodes (see cmd_fmt_compile). Each conversion
+ * is an opcode byte, with the field type (cmd_bin_type_t) in the low nibble
+ * and the integer conversion (cmd_fmt_conv_t) in the high one.
+ */
+#define CMD_FMT_OP(type, conv) ((uint8_t)((type) | ((conv) << 4)))
+
+typedef enum cmd_fmt_conv{
+    CMD_FMT_DEC = 0,    ///< %d, and floating point conversions
+    CMD_FMT_AUTO,       ///< %i
+    CMD_FMT_UDEC,       ///< %u
+    CMD_FMT_HEX,        ///< %x
+    CMD_FMT_OCT         ///< %o
+} cmd_fmt_conv_t;
+
+static const int cmd_fmt_base[] = {10, 0, 10, 16, 8};
+static const size_t cmd_bin_sizes[] = {0, sizeof(char), sizeof(short), sizeof(int),
+    sizeof(long), sizeof(long long), sizeof(float), sizeof(double)};
+
+/**
+ * Compile a parameters format and get its compiled format index, the
+ * commands with the same conversions share the compiled format.
+ * @param fmt Str. Parameters format
+ * @return Compiled format index plus one, 0 if the format is parsed by sscanf
+ */
+static uint8_t cmd_fmt_compile(const char *fmt)
+{
+    uint8_t ops[CMD_FMT_OPS_MAX];
+    int n = 0, i;
+    memset(ops, 0, sizeof(ops));
+
+    while(*fmt != '\0')
+    {
+        if(isspace((unsigned char)*fmt))
+        {
+            fmt++;
+            continue;
+        }
+        if(*fmt != '%' || n == CMD_FMT_OPS_MAX)
+            return 0;
+
+        int longs = 0, shorts = 0;
+        for(fmt++; *fmt == 'l'; fmt++) longs++;
+        for(; *fmt == 'h'; fmt++) shorts++;
+        if(longs > 2 || shorts > 1 || (longs && shorts))
+            return 0;
+
+        cmd_fmt_conv_t conv = CMD_FMT_DEC;
+        cmd_bin_type_t type = shorts ? CMD_BIN_SHORT : longs == 1 ? CMD_BIN_LONG :
+                              longs ? CMD_BIN_LLONG : CMD_BIN_INT;
+        switch(*fmt)
+        {
+            case 'd': conv = CMD_FMT_DEC; break;
+            case 'i': conv = CMD_FMT_AUTO; break;
+            case 'u': conv = CMD_FMT_UDEC; break;
+            case 'x': case 'X': conv = CMD_FMT_HEX; break;
+            case 'o': conv = CMD_FMT_OCT; break;
+            case 'f': case 'e': case 'g': case 'E': case 'G':
+                if(shorts || longs > 1)
+                    return 0;
+                type = longs ? CMD_BIN_DOUBLE : CMD_BIN_FLOAT;
+                break;
+            default:
+                return 0;
+        }
+        ops[n++] = CMD_FMT_OP(type, conv);
+        fmt++;
+    }
+
+    // Formats without conversions have nothing to parse
+    if(n == 0)
+        return 0;
+    for(i = 0; i < cmd_fmt_count; i++)
+    {
+        if(memcmp(cmd_fmt_ops[i], ops, sizeof(ops)) == 0)
+            return (uint8_t)(i + 1);
+    }
+    if(cmd_fmt_count == CMD_FMT_MAX)
+    {
+        LOGD(tag, "Compiled formats full, parameters parsed by the handler");
+        return 0;
+    }
+    memcpy(cmd_fmt_ops[cmd_fmt_count], ops, sizeof(ops));
+    return (uint8_t)(++cmd_fmt_count);
+}
+
+/**
+ * Parse text parameters with a compiled format into the binary parameters
+ * struct (see cmd_add_params_bin). As sscanf does, spaces before the numbers
+ * are skipped, text after the last number is ignored and integers wrap to the
+ * field size.
+ * @param ops Compiled format
+ * @param str Str. Text parameters
+ * @param data Struct to fill, large enough for CMD_FMT_OPS_MAX long long fields
+ * @return Struct size, -1 if a conversion fails
+ */
+static int cmd_fmt_parse(const uint8_t *ops, const char *str, char *data)
+{
+    size_t offset = 0;
+    int i;
+    for(i = 0; i < CMD_FMT_OPS_MAX && ops[i] != 0; i++)
+    {
+        cmd_bin_type_t type = (cmd_bin_type_t)(ops[i] & 0x0F);
+        cmd_fmt_conv_t conv = (cmd_fmt_conv_t)(ops[i] >> 4);
+        size_t size = cmd_bin_sizes[type];
+        offset = (offset + size - 1) / size * size;
+        void *field = data + offset;
+        char *end;
+
+        if(type == CMD_BIN_FLOAT)
+            *(float *)field = strtof(str, &end);
+        else if(type == CMD_BIN_DOUBLE)
+            *(double *)field = strtod(str, &end);
+        else
+        {
+            unsigned long long value = conv <= CMD_FMT_AUTO ?
+                (unsigned long long)strtoll(str, &end, cmd_fmt_base[conv]) :
+                strtoull(str, &end, cmd_fmt_base[conv]);
+            switch(type)
+            {
+                case CMD_BIN_SHORT: *(short *)field = (short)value; break;
+                case CMD_BIN_INT: *(int *)field = (int)value; break;
+                case CMD_BIN_LONG: *(long *)field = (long)value; break;
+                default: *(long long *)field = (long long)value; break;
+            }
+        }
+
+        if(end == str)
+            return -1;
+        str = end;
+        offset += size;
+    }
+    return (int)offset;
+}
+
+/* Packed parameters field sizes by cmd_bin_type_t (see cmd_add_params_packed) */
+static const uint8_t cmd_packed_sizes[] = {0, 0, 2, 4, 4, 8, 4, 8};
+
+/**
+ * Unpack packed parameters with a compiled format into the binary parameters
+ * struct (see cmd_add_params_packed)
+ * @param ops Compiled format
+ * @param buff Packed parameters, in network byte order
+ * @param len Packed parameters length
+ * @param data Struct to fill, large enough for CMD_FMT_OPS_MAX long long fields
+ * @return Struct size, -1 if the length does not match the format
+ */
+static int cmd_fmt_unpack(const uint8_t *ops, const uint8_t *buff, int len, char *data)
+{
+    size_t offset = 0;
+    int i, j, pos = 0;
+    for(i = 0; i < CMD_FMT_OPS_MAX && ops[i] != 0; i++)
+    {
+        cmd_bin_type_t type = (cmd_bin_type_t)(ops[i] & 0x0F);
+        cmd_fmt_conv_t conv = (cmd_fmt_conv_t)(ops[i] >> 4);
+        int wire = cmd_packed_sizes[type];
+        if(pos + wire > len)
+            return -1;
+        uint64_t value = 0;
+        for(j = 0; j < wire; j++)
+            value = (value << 8) | buff[pos++];
+
+        size_t size = cmd_bin_sizes[type];
+        offset = (offset + size - 1) / size * size;
+        void *field = data + offset;
+        int is_signed = conv <= CMD_FMT_AUTO;
+        switch(type)
+        {
+            case CMD_BIN_SHORT: *(short *)field = (short)(uint16_t)value; break;
+            case CMD_BIN_INT: *(int *)field = (int)(uint32_t)value; break;
+            case CMD_BIN_LONG: *(long *)field = is_signed ? (long)(int32_t)value : (long)(uint32_t)value; break;
+            case CMD_BIN_LLONG: *(long long *)field = (long long)value; break;
+            case CMD_BIN_FLOAT: { uint32_t bits = (uint32_t)value; memcpy(field, &bits, sizeof(float)); break; }
+            case CMD_BIN_DOUBLE: memcpy(field, &value, sizeof(double)); break;
+            default: return -1;
+        }
+        offset += size;
+    }
+    return pos == len ? (int)offset : -1;
+}
+
+int cmd_add_params_packed(cmd_t *cmd, const void *data, int len)
+{
+    if(cmd == NULL || data == NULL || len < 0)
+        return CMD_ERROR;
+    if(len == 0)
+        return CMD_OK;
+
+    uint8_t fmt_idx = cmd->id >= 0 && cmd->id < SCH_CMD_MAX_ENTRIES ? cmd_hot[cmd->id].fmt_idx : 0;
+    if(fmt_idx == 0)
+    {
+        // Other formats are packed as the parameters string
+        char str[SCH_CMD_MAX_STR_PARAMS+1];
+        if(len > SCH_CMD_MAX_STR_PARAMS)
+            return CMD_SYNTAX_ERROR;
+        memcpy(str, data, (size_t)len);
+        str[len] = '\0';
+        cmd_add_params_str(cmd, str);
+        return CMD_OK;
+    }
+
+    long long fields[CMD_FMT_OPS_MAX];
+    int size = cmd_fmt_unpack(cmd_fmt_ops[fmt_idx-1], (const uint8_t *)data, len, (char *)fields);
+    if(size < 0)
+        return CMD_SYNTAX_ERROR;
+    cmd_params_set_bin(cmd, fields, (size_t)size);
+    return CMD_OK;
+}
+
+void cmd_add_params_bin(cmd_t *cmd, ...)
+{
+    if(cmd == NULL)
+        return;
+
+    va_list args;
+    va_start(args, cmd);
+
+    int size = cmd_bin_size(cmd->fmt);
+    if(size < 0 || size + CMD_PARAMS_BIN_HEADER > SCH_CMD_MAX_STR_PARAMS)
+    {
+        // Not supported, fill parameters as string
+        LOGD(tag, "Binary parameters not supported for format %s", cmd->fmt);
+        char str_params[SCH_CMD_MAX_STR_PARAMS];
+        vsnprintf(str_params, SCH_CMD_MAX_STR_PARAMS, cmd->fmt, args);
+        va_end(args);
+        cmd_add_params_str(cmd, str_params);
+        return;
+    }
+
+    char *params = cmd_params_alloc(cmd, (size_t)size + CMD_PARAMS_BIN_HEADER);
+    cmd->params = params;
+    if(params == NULL)
+    {
+        va_end(args);
+        return;
+    }
+    memset(params, 0, (size_t)size + CMD_PARAMS_BIN_HEADER);
+    params[0] = CMD_PARAMS_BIN_MAGIC;
+
+    // Pack arguments (promoted by va_arg) as struct fields
+    char *data = params + CMD_PARAMS_BIN_HEADER;
+    const char *fmt = cmd->fmt;
+    size_t offset = 0, fsize = 0;
+    cmd_bin_type_t type;
+    while((type = cmd_bin_next_field(&fmt, &fsize)) != CMD_BIN_END)
     {
-        // Create new command
-        size_t l_name = strlen(name);
-        size_t l_fparams = strlen(fparams);
-        cmd_list_t cmd_new;
-        cmd_new.fmt = (char *)malloc(sizeof(char)*(l_fparams+1));
-        strncpy(cmd_new.fmt, fparams, l_fparams+1);
-        cmd_new.function = function;
-        cmd_new.name = (char *)malloc(sizeof(char)*(l_name+1));
-        strncpy(cmd_new.name, name, l_name+1);
-        cmd_new.nparams = nparam;
-
-        // Copy to command buffer
-        osSemaphoreTake(&repo_cmd_sem, portMAX_DELAY);
+        offset = (offset + fsize - 1) / fsize * fsize;
+        void *field = data + offset;
+        switch(type)
         {
-            cmd_list[cmd_index] = cmd_new;
-            if (strcmp(name, "null") != 0 && cmd_is_sorted && cmd_index > 1)
-            {
-                if (strcmp(cmd_list[cmd_index - 1].name, cmd_list[cmd_index].name) > 0)
-                    cmd_is_sorted = 0;
-            }
-            cmd_index++;
+            case CMD_BIN_CHAR: *(char *)field = (char)va_arg(args, int); break;
+            case CMD_BIN_SHORT: *(short *)field = (short)va_arg(args, int); break;
+            case CMD_BIN_INT: *(int *)field = va_arg(args, int); break;
+            case CMD_BIN_LONG: *(long *)field = va_arg(args, long); break;
+            case CMD_BIN_LLONG: *(long long *)field = va_arg(args, long long); break;
+            case CMD_BIN_FLOAT: *(float *)field = (float)va_arg(args, double); break;
+            case CMD_BIN_DOUBLE: *(double *)field = va_arg(args, double); break;
+            default: break;
         }
-        osSemaphoreGiven(&repo_cmd_sem);
-        return cmd_index;
-    }
-    else
-    {
-        LOGW(tag, "Unable to add cmd: %s. Buffer full (%d)", name, cmd_index);
-        return -1;
+        offset += fsize;
     }
+    va_end(args);
 }
 
-cmd_t * cmd_get_str(char *name)
+int cmd_params_is_bin(char *params)
 {
-    cmd_t *cmd_new = NULL;
+    return params != NULL && params[0] == CMD_PARAMS_BIN_MAGIC;
+}
 
-    //Find inside command buffer
-    int i, ok;
-    for(i=0; i<SCH_CMD_MAX_ENTRIES; i++)
-    {
-        osSemaphoreTake(&repo_cmd_sem, portMAX_DELAY);
-        ok = strcmp(name, cmd_list[i].name);
-        osSemaphoreGiven(&repo_cmd_sem);
+void *cmd_params_bin(char *params)
+{
+    return cmd_params_is_bin(params) ? params + CMD_PARAMS_BIN_HEADER : NULL;
+}
 
-        if(ok == 0)
-        {
-            // Create the command by index
-            cmd_new = cmd_get_idx(i);
-            break;
-        }
+int cmd_scan_params(char *fmt, char *params, ...)
+{
+    if(params == NULL || fmt == NULL)
+        return -1;
+
+    va_list args;
+    va_start(args, params);
+    int n = 0;
+
+    if(!cmd_params_is_bin(params))
+    {
+        // Text parameters
+        n = vsscanf(params, fmt, args);
+        va_end(args);
+        return n;
     }
 
-    if(cmd_new == NULL)
+    // Binary parameters, copy struct fields to the arguments
+    char *data = params + CMD_PARAMS_BIN_HEADER;
+    const char *f = fmt;
+    size_t offset = 0, fsize = 0;
+    cmd_bin_type_t type;
+    while((type = cmd_bin_next_field(&f, &fsize)) != CMD_BIN_END)
     {
-        LOGW(tag, "Command not found: %s", name);
+        if(type == CMD_BIN_UNSUPPORTED)
+            break;
+        offset = (offset + fsize - 1) / fsize * fsize;
+        memcpy(va_arg(args, void *), data + offset, fsize);
+        offset += fsize;
+        n++;
     }
-    return cmd_new;
+    va_end(args);
+    return n;
 }
 
-cmd_t * cmd_get_idx(int idx)
+/* Max. number of parameters checked by cmd_check_params */
+#define CMD_CHECK_MAX_PARAMS (16)
+
+int cmd_check_params(int idx, char *params)
 {
-    cmd_t *cmd_new = NULL;
+    if(idx < 0 || idx >= CMD_STATIC_LEN + cmd_index)
+        return CMD_ERROR;
 
-    if (idx < SCH_CMD_MAX_ENTRIES)
-    {
-        // Get found command
-        osSemaphoreTake(&repo_cmd_sem, portMAX_DELAY);
-        cmd_list_t cmd_found = cmd_list[idx];
-        osSemaphoreGiven(&repo_cmd_sem);
+    osRWLockReadTake(&repo_cmd_sem);
+    const char *fmt = cmd_hot[idx].fmt;
+    osRWLockReadGiven(&repo_cmd_sem);
 
-        // Creates a new command
-        cmd_new = (cmd_t *)malloc(sizeof(cmd_t));
+    if(params == NULL)
+        params = "";
+    if(strlen(params) > SCH_CMD_MAX_STR_PARAMS)
+        return CMD_SYNTAX_ERROR;
+    if(cmd_params_is_bin(params))
+        return CMD_OK;
 
-        // Fill parameters
-        cmd_new->id = idx;
-        cmd_new->fmt = cmd_found.fmt;
-        cmd_new->function = cmd_found.function;
-        cmd_new->nparams = cmd_found.nparams;
-        cmd_new->params = NULL;
-    }
-    else
+    // Scratch storage for the converted values. Strings are never longer than
+    // params, so every %s, %c and %[ share the same buffer.
+    union { long long ll; long double ld; void *p; } values[CMD_CHECK_MAX_PARAMS];
+    char str[SCH_CMD_MAX_STR_PARAMS+1];
+    void *ptrs[CMD_CHECK_MAX_PARAMS];
+    int nptrs = 0, nconv = 0, i;
+    for(i = 0; i < CMD_CHECK_MAX_PARAMS; i++)
+        ptrs[i] = &values[i];
+
+    const char *f = fmt;
+    while(*f != '\0')
     {
-        LOGW(tag, "Command index found: %d", idx);
+        if(*f++ != '%')
+            continue;
+        if(*f == '%')
+        {
+            f++;
+            continue;
+        }
+
+        int suppress = (*f == '*');
+        if(suppress) f++;
+        while(*f != '\0' && ((*f >= '0' && *f <= '9') || strchr("hlLjzt", *f) != NULL))
+            f++;
+
+        char conv = *f;
+        if(conv == '\0')
+            break;
+        f++;
+        if(conv == '[')
+        {
+            // Skip the scan set, a leading ] or ^] is part of the set
+            if(*f == '^') f++;
+            if(*f == ']') f++;
+            while(*f != '\0' && *f != ']') f++;
+            if(*f == ']') f++;
+        }
+
+        if(suppress)
+            continue;
+        if(nptrs >= CMD_CHECK_MAX_PARAMS)
+        {
+            LOGD(tag, "Too many parameters to check in format %s", fmt);
+            return CMD_OK;
+        }
+        if(conv == 's' || conv == 'c' || conv == '[')
+            ptrs[nptrs] = str;
+        else
+            ptrs[nptrs] = &values[nptrs];
+        nptrs++;
+        if(conv != 'n')
+            nconv++;
     }
 
-    return cmd_new;
+    if(nconv == 0)
+        return CMD_OK;
+
+    int n = sscanf(params, fmt, ptrs[0], ptrs[1], ptrs[2], ptrs[3], ptrs[4], ptrs[5],
+                   ptrs[6], ptrs[7], ptrs[8], ptrs[9], ptrs[10], ptrs[11], ptrs[12],
+                   ptrs[13], ptrs[14], ptrs[15]);
+    return n == nconv ? CMD_OK : CMD_SYNTAX_ERROR;
 }
 
-char * cmd_get_name(int idx)
+cmd_t *cmd_build_from_str(char *buff)
 {
-    char *name = NULL;
-    if (idx < SCH_CMD_MAX_ENTRIES)
+    cmd_t *new_cmd = NULL;
+    char name[SCH_CMD_MAX_STR_NAME];
+    int ok = 0;
+
+    // Scan a command and parameter string: <command> [parameters]
+    LOGV(tag, "New TC: %s (%d)", buff, (int)strlen(buff));
+    while(isspace((unsigned char)*buff))
+        buff++;
+    size_t len = 0;
+    while(buff[len] != '\0' && !isspace((unsigned char)buff[len]))
+        len++;
+
+    // Check that the command name was found
+    if(len > 0 && len < SCH_CMD_MAX_STR_NAME)
     {
-        // Get found command
-        osSemaphoreTake(&repo_cmd_sem, portMAX_DELAY);
-        cmd_list_t cmd_found = cmd_list[idx];
-        osSemaphoreGiven(&repo_cmd_sem);
+        memcpy(name, buff, len);
+        name[len] = '\0';
+        buff += len;
+        while(isspace((unsigned char)*buff))
+            buff++;
+        LOGV(tag, "Parsed cmd: %s, args: %s", name, buff);
 
-        LOGV(tag, "Cmd name found: %s", cmd_found.name);
-        name = (char *)malloc(strlen(cmd_found.name)+1);
-        if(name == NULL)
+        // Commands are given by name or by id
+        if(isdigit((unsigned char)name[0]))
         {
-            LOGW(tag, "Error allocating memory in cmd_get_name");
+            char *end;
+            long id = strtol(name, &end, 10);
+            cmd_catalog_t entry;
+            if(*end == '\0' && id < SCH_CMD_MAX_ENTRIES && cmd_catalog_get((int)id, &entry) == CMD_OK)
+                new_cmd = cmd_get_idx((int)id);
         }
         else
+            new_cmd = cmd_get_str(name);
+        // Check if the command exist, the parameters are optional
+        if(new_cmd != NULL)
         {
-            strcpy(name, cmd_found.name);
+            ok = 1;
+            cmd_add_params_str(new_cmd, buff);
         }
     }
-    else
+
+    if(!ok)
     {
-        LOGW(tag, "Command index not found: %d", idx);
+        LOGE(tag, "Error parsing command!");
     }
 
-    return name;
+    // Return the command filled with parameters or a NULL pointer
+    return new_cmd;
 }
 
-void cmd_add_params_raw(cmd_t *cmd, void *params, int len)
+void cmd_free(cmd_t *cmd)
 {
-    // Check pointers
-    if(cmd != NULL && params != NULL)
+    if(cmd != NULL)
     {
-        LOGD(tag, "Copying %d bytes as parameters", len);
-        cmd->params = (char *)malloc((size_t)len);
-        memcpy(cmd->params, params, (size_t)len);
+        // Commands freed before the execution are reported as dropped
+        cmd_done(cmd, CMD_DROPPED);
+        // Free the params if allocated, we don't need free cmd->fmt because
+        // it has not been copied with sch_malloc (see cmd_get_idx)
+        cmd_params_free(cmd);
+        cmd_pool_entry_t *entry = (cmd_pool_entry_t *)cmd;
+        int pooled = entry >= cmd_pool && entry < cmd_pool + SCH_CMD_POOL_SIZE;
+        // Return the structure to the pool or free it
+        if(pooled)
+            cmd_pool_put(cmd);
+        else
+            sch_free(cmd);
     }
 }
 
-void cmd_add_params_str(cmd_t *cmd, char *params)
+void cmd_pool_get_stats(cmd_pool_stats_t *stats)
 {
-    size_t len_param = strlen(params);
-    if(len_param > SCH_CMD_MAX_STR_PARAMS)
-    {
-        LOGW(tag, "Parameters larger than CMD_MAX_STR_PARAMS will be shorted!( (%d > %d)",
-             (int)len_param, SCH_CMD_MAX_STR_PARAMS);
-        len_param = SCH_CMD_MAX_STR_PARAMS;
-    }
+    if(stats == NULL)
+        return;
+    stats->size = SCH_CMD_POOL_SIZE;
+    stats->params_len = SCH_CMD_POOL_PARAMS_LEN;
+    stats->used = cmd_pool_used;
+    stats->max_used = cmd_pool_max;
+    stats->misses = cmd_pool_misses;
+    stats->params_misses = cmd_params_misses;
+}
 
-    // Check pointers
-    if(cmd != NULL && len_param)
+/**
+ * Take a free command from the pool. Entries are claimed with an atomic
+ * test-and-set so producers and taskExecuter do not need a lock. If the pool
+ * is exhausted the command is allocated with sch_malloc.
+ */
+static cmd_t *cmd_pool_get(void)
+{
+    int i;
+    int start = cmd_pool_hint;
+    for(i=0; i<SCH_CMD_POOL_SIZE; i++)
     {
-        cmd->params = (char *)malloc(sizeof(char)*(len_param+1));
-        strncpy(cmd->params, params, len_param+1);
+        int n = (start + i) % SCH_CMD_POOL_SIZE;
+        if(cmd_pool[n].used == 0 && __sync_lock_test_and_set(&cmd_pool[n].used, 1) == 0)
+        {
+            cmd_pool_hint = (n + 1) % SCH_CMD_POOL_SIZE;
+            int used = __sync_add_and_fetch(&cmd_pool_used, 1);
+            int max = cmd_pool_max;
+            while(used > max && !__sync_bool_compare_and_swap(&cmd_pool_max, max, used))
+                max = cmd_pool_max;
+            return &cmd_pool[n].cmd;
+        }
     }
+
+    __sync_add_and_fetch(&cmd_pool_misses, 1);
+    cmd_t *cmd = (cmd_t *)sch_malloc(MEM_CMD, sizeof(cmd_t));
+    if(cmd == NULL)
+        LOGE(tag, "Error allocating memory for a new command");
+    return cmd;
 }
 
-void cmd_add_params_var(cmd_t *cmd, ...)
+static void cmd_pool_put(cmd_t *cmd)
 {
-    if(cmd != NULL)
+    cmd_pool_entry_t *entry = (cmd_pool_entry_t *)cmd;
+    __sync_sub_and_fetch(&cmd_pool_used, 1);
+    __sync_lock_release(&entry->used);
+}
+
+/**
+ * Release the command parameters: call the release function of the owner of
+ * the buffer (see cmd_add_params_owned) or free them if they were allocated
+ * with sch_malloc.
+ */
+static void cmd_params_free(cmd_t *cmd)
+{
+    cmd_pool_entry_t *entry = (cmd_pool_entry_t *)cmd;
+    int pooled = entry >= cmd_pool && entry < cmd_pool + SCH_CMD_POOL_SIZE;
+
+    if(cmd->release != NULL)
+        cmd->release(cmd->release_ref);
+    else if(cmd->params != NULL && (!pooled || cmd->params != entry->buff.params))
+        sch_free(cmd->params);
+    cmd->release = NULL;
+    cmd->release_ref = NULL;
+    cmd->params = NULL;
+}
+
+/**
+ * Get a buffer of @len bytes for the command parameters. Small parameters use
+ * the inline buffer of pooled commands, larger ones use sch_malloc.
+ */
+static char *cmd_params_alloc(cmd_t *cmd, size_t len)
+{
+    cmd_pool_entry_t *entry = (cmd_pool_entry_t *)cmd;
+    int pooled = entry >= cmd_pool && entry < cmd_pool + SCH_CMD_POOL_SIZE;
+
+    // Release previous parameters, if any
+    cmd_params_free(cmd);
+
+    if(pooled && len <= SCH_CMD_POOL_PARAMS_LEN)
+        return entry->buff.params;
+
+    __sync_add_and_fetch(&cmd_params_misses, 1);
+    char *params = (char *)sch_malloc(MEM_CMD, len);
+    if(params == NULL)
+        LOGE(tag, "Error allocating memory for command parameters");
+    return params;
+}
+
+/**
+ * FNV-1a hash of a command name, with the offset basis changed by @seed. Must
+ * match cmd_hash in cmdtable.py
+ */
+static uint32_t cmd_hash_seed(const char *name, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ seed;
+    while(*name != '\0')
     {
-        va_list args;
-        va_start(args, cmd);
+        hash ^= (uint8_t)(*name++);
+        hash *= 16777619u;
+    }
+    return hash;
+}
 
-        //Parsing arguments to string
-        char str_params[SCH_CMD_MAX_STR_PARAMS];
-        vsprintf(str_params, cmd->fmt, args);
+static void cmd_hash_clear(void)
+{
+    int i;
+    for(i=0; i<CMD_HASH_SIZE; i++)
+        cmd_hash_table[i] = CMD_HASH_EMPTY;
+    cmd_sorted_len = 0;
+    cmd_is_sorted = 0;
+    cmd_hash_ok = 1;
+}
 
-        va_end(args);
+/**
+ * Add the runtime command @idx to the hash table using linear probing. If the name is
+ * already registered the first command is kept, as the linear search did.
+ * @note call with repo_cmd_sem taken for write
+ */
+static void cmd_hash_insert(int idx)
+{
+    if(!cmd_hash_ok)
+        return;
 
-        //Fill parameters as string
-        cmd_add_params_str(cmd, str_params);
+    uint32_t slot = cmd_hash_name(cmd_list_name(idx)) & (CMD_HASH_SIZE-1);
+    int n;
+    for(n=0; n<CMD_HASH_SIZE; n++)
+    {
+        int16_t cur = cmd_hash_table[slot];
+        if(cur == CMD_HASH_EMPTY)
+        {
+            cmd_hash_table[slot] = (int16_t)idx;
+            return;
+        }
+        if(strcmp(cmd_list_name(cur), cmd_list_name(idx)) == 0)
+            return;
+        slot = (slot + 1) & (CMD_HASH_SIZE-1);
     }
+
+    // Table full, should not happen. Use the sorted list instead.
+    LOGW(tag, "Command hash table full, using binary search");
+    cmd_hash_ok = 0;
 }
 
-cmd_t *cmd_build_from_str(char *buff)
+static void quicksort_by_name(int16_t *idxs, int start, int end)
 {
-    cmd_t *new_cmd = NULL;
-    size_t len = strlen(buff);
-    int ok = 0;
+    if (start >= end)
+        return;
 
-    // Do not use sscanf in empty string
-    if(len > 0)
+    // Lomuto partition using the last element as pivot
+    int16_t pivot = idxs[end];
+    int i, j = start;
+    for (i = start; i < end; i++)
     {
-        int next;
-        char tmp_cmd[len + 1];
-        memset(tmp_cmd, '\0', (size_t)len+1);
+        if (strcmp(cmd_list_name(idxs[i]), cmd_list_name(pivot)) < 0)
+        {
+            int16_t aux = idxs[i];
+            idxs[i] = idxs[j];
+            idxs[j] = aux;
+            j++;
+        }
+    }
+    idxs[end] = idxs[j];
+    idxs[j] = pivot;
 
-        // Scan a command and parameter string: <command> [parameters]
-        LOGV(tag, "New TC: %s (%d)", buff, (int)len);
-        ok = sscanf(buff, "%s %n", tmp_cmd, &next);
-        LOGV(tag, "Parsed cmd: %s (a: %d, n: %d)", tmp_cmd, ok, next);
+    quicksort_by_name(idxs, start, j-1);
+    quicksort_by_name(idxs, j+1, end);
+}
+
+/**
+ * Build a list of command indexes sorted by name. The command list itself is
+ * not reordered, so commands ids remain stable. Repeated names ("null") are
+ * reduced to the lowest index.
+ * @note call with repo_cmd_sem taken for write
+ */
+static void sort_cmd_list(void)
+{
+    if (!cmd_is_sorted)
+    {
+        LOGD(tag, "Sorting Command List");
 
-        // Check that at least one str was found (the command name)
-        if (ok > 0)
+        int i, n = 0;
+        for(i=0; i<CMD_LIST_LEN; i++)
         {
-            new_cmd = cmd_get_str(tmp_cmd);
+            if(cmd_list_name(i) != NULL)
+                cmd_sorted_idx[n++] = (int16_t)i;
+        }
+        quicksort_by_name(cmd_sorted_idx, 0, n-1);
 
-            // Check if the command exist
-            if (new_cmd != NULL)
+        // Remove duplicates keeping the first registered command
+        int len = 0;
+        for(i=0; i<n; i++)
+        {
+            int16_t cur = cmd_sorted_idx[i];
+            if(len > 0 && strcmp(cmd_list_name(cmd_sorted_idx[len-1]), cmd_list_name(cur)) == 0)
             {
-                // Check if a parameter was found too (optional)
-                if (next < len)
-                {
-                    memset(tmp_cmd, '\0', (size_t)len+1);
-                    strncpy(tmp_cmd, buff + next, (size_t) (len - next));
-                    LOGV(tag, "Parsed args: %s", tmp_cmd);
-                    cmd_add_params_str(new_cmd, tmp_cmd);
-                }
-                else
-                {
-                    cmd_add_params_str(new_cmd, "");
-                }
+                if(cur < cmd_sorted_idx[len-1])
+                    cmd_sorted_idx[len-1] = cur;
             }
             else
-            {
-                ok = 0;
-            }
+                cmd_sorted_idx[len++] = cur;
         }
-    }
 
-    if(ok <= 0)
-    {
-        LOGE(tag, "Error parsing command!");
+        cmd_sorted_len = len;
+        cmd_is_sorted = 1;
+        LOGD(tag, "Command List Sorted");
     }
+}
 
-    // Return the command filled with parameters or a NULL pointer
-    return new_cmd;
+#if SCH_CMD_STATIC
+/**
+ * Find a command of the static table using its perfect hash
+ * @return Index in cmd_table, -1 if not found
+ */
+static int cmd_static_find(const char *name)
+{
+    int16_t d = cmd_table_disp[cmd_hash_name(name) % CMD_TABLE_LEN];
+    uint32_t slot = d < 0 ? (uint32_t)(-d-1) : cmd_hash_seed(name, (uint32_t)d) % CMD_TABLE_LEN;
+    int idx = cmd_table_slot[slot];
+    return strcmp(cmd_table[idx].name, name) == 0 ? idx : -1;
 }
+#endif
 
-void cmd_free(cmd_t *cmd)
+/**
+ * Find the id of a command by name. Looks up the static table first, then the
+ * commands added at runtime using the hash table, or a binary search in the
+ * sorted list as fallback (kept sorted by cmd_add).
+ * @note call with repo_cmd_sem taken, for read or write
+ * @return Command id, -1 if not found
+ */
+static int cmd_find_idx(const char *name)
 {
-    if(cmd != NULL)
+    if(name == NULL)
+        return -1;
+
+#if SCH_CMD_STATIC
+    int static_idx = cmd_static_find(name);
+    if(static_idx >= 0 && cmd_table[static_idx].function != NULL)
+        return static_idx;
+#endif
+
+    if(cmd_hash_ok)
     {
-        // Free the params if allocated, we don't need free cmd->fmt because
-        // it has not been copied with malloc (see cmd_get_idx)
-        free(cmd->params);
-        // Free the structure itself
-        free(cmd);
-    }
-}
-
-//static void quicksort_by_name(cmd_list_t* commands, int start, int end)
-//{
-//    if (start >= end)
-//        return;
-//
-//    int pivot = start;
-//
-//    for (int i = pivot+1; i <= end; i++)
-//    {
-//        if (strcmp(commands[i].name, commands[pivot].name) < 0)
-//        {
-//            cmd_list_t aux = commands[i];
-//            for (int j = i; j > pivot; j--)
-//                commands[j] = commands[j-1];
-//            commands[pivot] = aux;
-//            pivot++;
-//        }
-//    }
-//
-//    quicksort_by_name(commands, start, pivot);
-//    quicksort_by_name(commands, pivot+1, end);
-//}
-//
-//static void sort_cmd_list()
-//{
-//    if (!cmd_is_sorted)
-//    {
-//        LOGD(tag, "Sorting Command List");
-//
-//        quicksort_by_name(cmd_list, 0, cmd_index-1);
-//        cmd_is_sorted = 1;
-//
-//        LOGD(tag, "Command List Sorted");
-//    }
-//}
+        uint32_t slot = cmd_hash_name(name) & (CMD_HASH_SIZE-1);
+        int n;
+        for(n=0; n<CMD_HASH_SIZE; n++)
+        {
+            int16_t cur = cmd_hash_table[slot];
+            if(cur == CMD_HASH_EMPTY)
+                return -1;
+            if(strcmp(cmd_list_name(cur), name) == 0)
+                return CMD_STATIC_LEN + cur;
+            slot = (slot + 1) & (CMD_HASH_SIZE-1);
+        }
+        return -1;
+    }
+
+    int low = 0, high = cmd_sorted_len - 1;
+    while(low <= high)
+    {
+        int mid = low + (high - low) / 2;
+        int cmp = strcmp(name, cmd_list_name(cmd_sorted_idx[mid]));
+        if(cmp == 0)
+            return CMD_STATIC_LEN + cmd_sorted_idx[mid];
+        else if(cmp < 0)
+            high = mid - 1;
+        else
+            low = mid + 1;
+    }
+    return -1;
+}
 
 void cmd_print_all(void)
 {
-
     LOGD(tag, "Command list");
-    osSemaphoreTake(&repo_cmd_sem, portMAX_DELAY);
 
-    //Make sure no LOG functions are used in this zone
+    // Print line by line, so other tasks can log or add commands meanwhile
     osSemaphoreTake(&log_mutex, portMAX_DELAY);
     printf("%5s %s %25s\n", "Index", "Name", "Params");
+    osSemaphoreGiven(&log_mutex);
+
     int i;
-    for(i=0; i<cmd_index; i++)
+    for(i=0; i<SCH_CMD_MAX_ENTRIES; i++)
     {
-        int printed = printf("%5d %s", i, cmd_list[i].name);
-        if (*cmd_list[i].fmt != '\0')
-            printf(" %s\n", cmd_list[i].fmt);
+        osRWLockReadTake(&repo_cmd_sem);
+        int found = i < CMD_STATIC_LEN + cmd_index && !cmd_is_null(i);
+        int end = i >= CMD_STATIC_LEN + cmd_index;
+        const char *name = found ? cmd_names[i] : NULL;
+        const char *fmt = found ? cmd_hot[i].fmt : NULL;
+        osRWLockReadGiven(&repo_cmd_sem);
+
+        if(end)
+            break;
+        if(!found)
+            continue;
+
+        // Make sure no LOG functions are used in this zone
+        osSemaphoreTake(&log_mutex, portMAX_DELAY);
+        printf("%5d %s", i, name);
+        if (*fmt != '\0')
+            printf(" %s\n", fmt);
         else
             printf("\n");
+        osSemaphoreGiven(&log_mutex);
     }
-    osSemaphoreGiven(&log_mutex);
-    //End log_mutex, can use LOG functions
+}
+
+/**
+ * Find the first position of the runtime sorted list not less than @prefix
+ * @note call with repo_cmd_sem taken, for read or write
+ */
+static int cmd_sorted_lower(const char *prefix)
+{
+    int low = 0, high = cmd_sorted_len;
+    while(low < high)
+    {
+        int mid = low + (high - low) / 2;
+        if(strcmp(cmd_list_name(cmd_sorted_idx[mid]), prefix) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+#if SCH_CMD_STATIC
+/**
+ * Find the first position of the static table not less than @prefix
+ */
+static int cmd_static_lower(const char *prefix)
+{
+    int low = 0, high = CMD_TABLE_LEN;
+    while(low < high)
+    {
+        int mid = low + (high - low) / 2;
+        if(strcmp(cmd_table[mid].name, prefix) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+#endif
+
+int cmd_complete(const char *prefix, int (*callback)(const char *name, void *arg), void *arg)
+{
+    if(prefix == NULL || callback == NULL)
+        return 0;
+
+    size_t len = strlen(prefix);
+    int n = 0;
+    osRWLockWriteTake(&repo_cmd_sem);
+    sort_cmd_list();
 
-    osSemaphoreGiven(&repo_cmd_sem);
+    // Merge the static table and the runtime list, both sorted by name
+    int i = cmd_sorted_lower(prefix);
+#if SCH_CMD_STATIC
+    int j = cmd_static_lower(prefix);
+#endif
+    while(1)
+    {
+        const char *name = NULL;
+        const char *runtime = i < cmd_sorted_len ? cmd_list_name(cmd_sorted_idx[i]) : NULL;
+        if(runtime != NULL && strncmp(runtime, prefix, len) != 0)
+            runtime = NULL;
+#if SCH_CMD_STATIC
+        const char *fixed = j < CMD_TABLE_LEN ? cmd_table[j].name : NULL;
+        if(fixed != NULL && strncmp(fixed, prefix, len) != 0)
+            fixed = NULL;
+        if(fixed != NULL && (runtime == NULL || strcmp(fixed, runtime) <= 0))
+        {
+            name = cmd_table[j].function != NULL ? fixed : NULL;
+            j++;
+            if(name == NULL)
+                continue;
+        }
+#endif
+        if(name == NULL)
+        {
+            if(runtime == NULL)
+                break;
+            name = runtime;
+            i++;
+            // Free entries
+            if(strcmp(name, cmd_null_entry.name) == 0)
+                continue;
+        }
 
+        n++;
+        if(!callback(name, arg))
+            break;
+    }
+    osRWLockWriteGiven(&repo_cmd_sem);
+    return n;
 }
 
 char *cmd_save_all(void)
@@ -331,30 +2345,119 @@ char *cmd_save_all(void)
     char *cmds_list;
 
     //Count space to allocate
-    for(i=0; i<cmd_index; i++)
+    for(i=0; i<CMD_STATIC_LEN+cmd_index; i++)
     {
-        names_len = names_len + (int)strlen(cmd_list[i].name) + 1;
+        if(!cmd_is_null(i))
+            names_len = names_len + (int)strlen(cmd_names[i]) + 1;
     }
 
     //Initialize list of commands
-    cmds_list = (char *)malloc(names_len + 1);
+    cmds_list = (char *)sch_malloc(MEM_CMD, names_len + 1);
+    if(cmds_list == NULL)
+        return NULL;
     memset(cmds_list, '\0', names_len + 1);
 
     //Copy commands name on the list
-    for(i=0; i<cmd_index; i++) {
-        strncpy(cmds_list + len_cnt, cmd_list[i].name, strlen(cmd_list[i].name));
-        strncpy(cmds_list + len_cnt + strlen(cmd_list[i].name), "\n", 1);
-        len_cnt = len_cnt + (int)strlen(cmd_list[i].name) + 1;
+    for(i=0; i<CMD_STATIC_LEN+cmd_index; i++) {
+        const char *name = cmd_names[i];
+        if(cmd_is_null(i))
+            continue;
+        strncpy(cmds_list + len_cnt, name, strlen(name));
+        strncpy(cmds_list + len_cnt + strlen(name), "\n", 1);
+        len_cnt = len_cnt + (int)strlen(name) + 1;
     }
 
     return cmds_list;
 }
 
+uint32_t cmd_catalog_hash(const char *str)
+{
+    return cmd_hash_seed(str, 0);
+}
+
+int cmd_catalog_get(int idx, cmd_catalog_t *entry)
+{
+    int rc = CMD_ERROR;
+    osRWLockReadTake(&repo_cmd_sem);
+    if(idx >= 0 && idx < CMD_STATIC_LEN + cmd_index && !cmd_is_null(idx))
+    {
+        entry->id = idx;
+        entry->nparams = cmd_hot[idx].nparams;
+        entry->name_hash = cmd_hash_name(cmd_names[idx]);
+        entry->fmt_hash = cmd_hash_name(cmd_hot[idx].fmt);
+        rc = CMD_OK;
+    }
+    osRWLockReadGiven(&repo_cmd_sem);
+    return rc;
+}
+
+/**
+ * Add a uint32 to a FNV-1a hash, least significant byte first
+ */
+static uint32_t cmd_hash_word(uint32_t hash, uint32_t word)
+{
+    int i;
+    for(i = 0; i < 4; i++, word >>= 8)
+    {
+        hash ^= word & 0xFF;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+uint32_t cmd_catalog_version(int *count)
+{
+    uint32_t version = cmd_hash_seed("", 0);
+    int i, n = 0;
+    cmd_catalog_t entry;
+    for(i = 0; i < SCH_CMD_MAX_ENTRIES; i++)
+    {
+        if(cmd_catalog_get(i, &entry) != CMD_OK)
+            continue;
+        version = cmd_hash_word(version, (uint32_t)entry.id);
+        version = cmd_hash_word(version, (uint32_t)entry.nparams);
+        version = cmd_hash_word(version, entry.name_hash);
+        version = cmd_hash_word(version, entry.fmt_hash);
+        n++;
+    }
+    if(count != NULL)
+        *count = n;
+    return version;
+}
+
 int cmd_repo_init(void)
 {
     // Init repository mutex
-    osSemaphoreCreate(&repo_cmd_sem);
+    osRWLockCreate(&repo_cmd_sem);
+    osSemaphoreCreate(&cmd_state_sem);
+    osRWLockSetName(&repo_cmd_sem, "repo_cmd");
+    osSemaphoreSetName(&cmd_state_sem, "cmd_state");
+#if SCH_CMD_TRACE
+    osSemaphoreCreate(&cmd_trace_sem);
+    osSemaphoreSetName(&cmd_trace_sem, "cmd_trace");
+#endif
+    int i;
+    for(i = 0; i < SCH_CMD_FUTURES; i++)
+    {
+        cmd_futures[i].state = CMD_FUTURE_FREE;
+        osEventCreate(&cmd_futures[i].event);
+    }
     cmd_index = 0;  // Reset registered command counter
+    cmd_arena_used = 0;
+    cmd_hash_clear();
+    cmd_fmt_count = 0;
+#if SCH_CMD_STATIC
+    // Copy the static table to the hot entries
+    osRWLockWriteTake(&repo_cmd_sem);
+    for(i = 0; i < CMD_STATIC_LEN; i++)
+    {
+        if(cmd_table[i].function != NULL)
+            cmd_set_entry(i, &cmd_table[i], cmd_fmt_compile(cmd_table[i].fmt));
+        else
+            cmd_set_entry(i, &cmd_null_entry, 0);
+    }
+    osRWLockWriteGiven(&repo_cmd_sem);
+#endif
 
     // Init repos
     cmd_obc_init();
@@ -383,18 +2486,17 @@ int cmd_repo_init(void)
     cmd_rw_init();
 #endif
 
-    int n_cmd;
-    int last_cmd_index = cmd_index;
+    // Fill the free command entries with the cmd_null command
+    osRWLockWriteTake(&repo_cmd_sem);
+    for(i=cmd_index; i<CMD_LIST_LEN; i++)
+        cmd_set_entry(CMD_STATIC_LEN + i, &cmd_null_entry, 0);
+    if(cmd_index < CMD_LIST_LEN)
+        cmd_hash_insert(cmd_index);
 
-    // Fill command buffer with cmd_null command
-    do
-    {
-        n_cmd = cmd_add("null", cmd_null, "", 0);
-    }
-    while(n_cmd < SCH_CMD_MAX_ENTRIES);
-
-    // Restore the number of not null commands
-    cmd_index = last_cmd_index;
+    // Build the sorted list used as lookup fallback
+    cmd_is_sorted = 0;
+    sort_cmd_list();
+    osRWLockWriteGiven(&repo_cmd_sem);
 
     return CMD_OK;
 }
@@ -402,13 +2504,19 @@ int cmd_repo_init(void)
 void cmd_repo_close(void)
 {
     int i;
-    for(i=0; i<SCH_CMD_MAX_ENTRIES; i++)
+    for(i=0; i<CMD_LIST_LEN; i++)
     {
-        free(cmd_list[i].name);
-        free(cmd_list[i].fmt);
+        // Names and formats are in the arena or the cmd_null_entry
+        cmd_list_name(i) = NULL;
+        cmd_hot[CMD_STATIC_LEN + i].fmt = NULL;
     }
+    for(i=0; i<SCH_CMD_MAX_ENTRIES; i++)
+        cmd_hot[i].fmt_idx = 0;
 
     cmd_index = 0;
+    cmd_arena_used = 0;
+    cmd_hash_clear();
+    cmd_fmt_count = 0;
 }
 
 int cmd_null(char *fparams, char *params, int nparam)
@@ -419,26 +2527,18 @@ int cmd_null(char *fparams, char *params, int nparam)
 
 int cmd_print(cmd_t* cmd)
 {
-    LOGV(tag, "Command Name:%s\n",cmd_get_name(cmd->id));
+    LOGV(tag, "Command Name:%s\n", cmd_get_name(cmd->id));
     LOGV(tag, "\tid: %d\n\tnparams: %d\n\tfmt: %s\n\tparams: %s\n\tfunction: %p\n", cmd->id, cmd->nparams, cmd->fmt, cmd->params, cmd->function);
     return 0;
 }
 
-char* cmd_get_fmt(char* name)
+const char *cmd_get_fmt(const char *name)
 {
-    char* format = malloc(sizeof(char)*30);
-    int i, ok;
-    for(i=0; i<SCH_CMD_MAX_ENTRIES; i++)
-    {
-        osSemaphoreTake(&repo_cmd_sem, portMAX_DELAY);
-        ok = strcmp(name, cmd_list[i].name);
-        osSemaphoreGiven(&repo_cmd_sem);
-
-        if(ok == 0)
-        {
-            strcpy(format,cmd_list[i].fmt);
-            break;
-        }
-    }
+    const char *format = "";
+    osRWLockReadTake(&repo_cmd_sem);
+    int idx = cmd_find_idx(name);
+    if(idx >= 0)
+        format = cmd_hot[idx].fmt;
+    osRWLockReadGiven(&repo_cmd_sem);
     return format;
 }
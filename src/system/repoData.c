@@ -23,6 +23,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_TAG_ID LOG_TAG_DATA
 #include "repoData.h"
 
 static const char *tag = "repoData";
@@ -33,47 +34,239 @@ time_t sec = 0;
 
 
 #if SCH_STORAGE_MODE == 0
+    #if SCH_STORAGE_NOINIT == 1
+        /* Status variables are kept in RAM not cleared at boot, they are
+         * restored after a sealed software reset (see dat_repo_seal) */
+        #define DAT_STATUS_NOINIT 1
+        #define DAT_NOINIT_MAGIC (0x4E4F494E)  ///< Sealed status variables magic
+        #define DAT_NOINIT __attribute__((section(".noinit")))
+    #else
+        #define DAT_NOINIT
+    #endif
+    /* Status variables are accessed without locks (see _dat_store_status_var) */
     #if SCH_STORAGE_TRIPLE_WR == 1
-        static value32_t DAT_SYSTEM_VAR_BUFF[dat_status_last_address * 3];
+        static volatile value32_t DAT_SYSTEM_VAR_BUFF[dat_status_last_address * 3] DAT_NOINIT;
     #else
-        int DAT_SYSTEM_VAR_BUFF[dat_status_last_address];
+        static volatile value32_t DAT_SYSTEM_VAR_BUFF[dat_status_last_address] DAT_NOINIT;
+    #endif
+    #ifdef DAT_STATUS_NOINIT
+        /* Magic, status variables layout and hash of the sealed variables */
+        static volatile uint32_t dat_noinit_seal[3] DAT_NOINIT;
+        static int _dat_noinit_restore(void);
+        static void _dat_noinit_seal(void);
+    #endif
+    static fp_entry_t data_base [SCH_FP_MAX_ENTRIES];  ///< Flight plan records
+    static int data_base_idx[SCH_FP_MAX_ENTRIES];     ///< Used records, sorted by unixtime
+    static int data_base_free[SCH_FP_MAX_ENTRIES];    ///< Free records stack
+    static int data_base_len = 0;                     ///< Used records in data_base_idx
+    static int data_base_free_len = 0;                ///< Free records in data_base_free
+#elif SCH_STORAGE_CACHE == 1
+    static value32_t dat_status_cache[dat_status_last_address];  ///< RAM copy of the status table
+    static uint8_t dat_status_dirty[dat_status_last_address];    ///< Cached values not yet written
+    static int dat_status_cache_ok = 0;                         ///< Cache is populated
+    /**
+     * Critical status variables are always written through to the storage,
+     * they must survive an unexpected reset
+     */
+    static const dat_status_address_t dat_status_critical[] = {
+        dat_obc_last_reset,
+        dat_obc_reset_counter,
+        dat_dep_deployed,
+        dat_dep_ant_deployed,
+        dat_dep_date_time,
+        dat_fpl_queue,
+    };
+    #if SCH_STORAGE_SNAPSHOT == 1 && !defined(NANOMIND)
+        #define DAT_SNAPSHOT 1
+        #define DAT_SNAPSHOT_MAGIC (0x53434853)  ///< Status snapshot magic
+        /**
+         * Status variables snapshot, the cache as it was stored by the last
+         * dat_repo_sync (see _dat_snapshot_load)
+         */
+        typedef struct {
+            uint32_t magic;
+            uint32_t layout;    ///< Hash of the status variables names
+            uint32_t hash;      ///< Hash of the values
+            uint32_t n;         ///< Number of status variables
+            value32_t values[dat_status_last_address];
+        } dat_snapshot_t;
+        static dat_snapshot_t dat_snapshot;
+        static int dat_snapshot_dirty = 1;      ///< The cache changed since the last snapshot
+        static int dat_snapshot_pending = 0;    ///< The cache was restored, not yet reconciled with the storage
+        static int _dat_snapshot_load(void);
+        static void _dat_snapshot_reconcile(void);
+        static void _dat_snapshot_sync(void);
     #endif
-    static fp_entry_t data_base [SCH_FP_MAX_ENTRIES];
 #endif
 
 dat_stmachine_t status_machine;
 
+/**
+ * Derived status variables are computed when read instead of stored, writes
+ * to them are ignored. Returns 1 and sets @value if @index is derived.
+ */
+static int _dat_status_derived(dat_status_address_t index, value32_t *value)
+{
+    switch(index)
+    {
+        case dat_rtc_date_time:
+            value->i = (int)dat_get_time();
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* The RAM flight plan can be read concurrently, the storage drivers are always
+ * used exclusively */
+#if SCH_STORAGE_MODE == 0
+    #define _dat_fp_read_take()  osRWLockReadTake(&repo_data_sem)
+    #define _dat_fp_read_given() osRWLockReadGiven(&repo_data_sem)
+#else
+    #define _dat_fp_read_take()  osRWLockWriteTake(&repo_data_sem)
+    #define _dat_fp_read_given() osRWLockWriteGiven(&repo_data_sem)
+#endif
+
+/* PostgreSQL payload queries take a connection of the storage pool, so they
+ * can run concurrently, the other drivers are used exclusively. With
+ * SCH_STORAGE_LAZY the payload tables are created by the first payload access
+ * instead of at boot */
+#if SCH_STORAGE_MODE == 2
+    #define _dat_payload_lock()  osRWLockReadTake(&repo_data_sem)
+    #define _dat_payload_given() osRWLockReadGiven(&repo_data_sem)
+#else
+    #define _dat_payload_lock()  osRWLockWriteTake(&repo_data_sem)
+    #define _dat_payload_given() osRWLockWriteGiven(&repo_data_sem)
+#endif
+#if SCH_STORAGE_LAZY
+    static volatile int dat_payload_tables_ok = 0;
+    static void _dat_payload_tables_init(void);
+    #define _dat_payload_take()  do{ _dat_payload_tables_init(); _dat_payload_lock(); }while(0)
+#else
+    #define _dat_payload_tables_init()
+    #define _dat_payload_take()  _dat_payload_lock()
+#endif
+
+/* Payload range reads and the flight plan listing do not take the mutex if
+ * the storage reads are reentrant (see storage_read_concurrent). @locked
+ * keeps the choice for the matching given */
+#define _dat_payload_read_take(locked)  do{ _dat_payload_tables_init(); if((locked = !storage_read_concurrent())) _dat_payload_lock(); }while(0)
+#define _dat_payload_read_given(locked) do{ if(locked) _dat_payload_given(); }while(0)
+#define _dat_fp_list_take(locked)       do{ if((locked = !storage_read_concurrent())) _dat_fp_read_take(); }while(0)
+#define _dat_fp_list_given(locked)      do{ if(locked) _dat_fp_read_given(); }while(0)
+
+/* Payload indexes (see dat_add_payload_samples). The next index to reserve
+ * and the next index to publish, samples below dat_payload_done are stored.
+ * The status variables are published copies, written after the samples and
+ * persisted with the other variables. Appends hold the payload lock from the
+ * reservation to the commit, so an index set with dat_set_status_var (inside
+ * the write lock) never races with them */
+static volatile int dat_payload_head[last_sensor];
+static volatile int dat_payload_done[last_sensor];
+static int _dat_payload_of_index(dat_status_address_t index);
+static void _dat_payload_index_set(dat_status_address_t index, value32_t value);
+
+/* Status variable change subscriptions (see dat_subscribe). dat_subs_count
+ * counts the subscriptions of each variable, so the variables without
+ * subscriptions are set without taking dat_subs_sem */
+typedef struct {
+    int used;
+    dat_status_address_t index;
+    value32_t last;                 ///< Last value notified
+    dat_status_notify_t callback;
+    void *arg;
+    osEvent *event;
+    uint32_t bits;
+} dat_sub_t;
+static dat_sub_t dat_subs[SCH_DAT_SUBS_MAX];
+static volatile uint8_t dat_subs_count[dat_status_last_address];
+static osSemaphore dat_subs_sem;
+static int dat_subs_ok = 0;
+static void _dat_notify_status_vars(dat_status_address_t index, int n, const value32_t *values);
+
+/* Wakes up the flight plan task when an entry is added (see dat_wait_fp) */
+static osEvent fp_event;
+static int fp_event_ok = 0;
+#define FP_EVENT_SET 0x01
+/* Flight plan execution jitter (see dat_add_fp_jitter) */
+static fp_jitter_t fp_jitter;
+/* Cached system clock (see dat_clock_tick). Readers only lock after
+ * DAT_CLOCK_TRIES torn reads, the sequence is odd while a tick writes the cache
+ * and 0 before the first tick */
+static dat_clock_t dat_clock;
+static volatile uint32_t dat_clock_seq = 0;
+#define DAT_CLOCK_TRIES 4
+
+/* Payload structs descriptors (see dat_get_payload_schema) */
+static dat_payload_schema_t payload_schema[last_sensor];
+static int payload_schema_ok = 0;
+static void dat_payload_schema_init(void);
+
+/* Last SCH_STORAGE_RECENT samples of each payload, reads of the recent
+ * samples are served from RAM without the storage. The ring slot of a sample
+ * is its index modulo SCH_STORAGE_RECENT. */
+#define DAT_RECENT_LEN (SCH_STORAGE_RECENT > 0 ? SCH_STORAGE_RECENT : 1)
+typedef struct {
+    uint8_t *data;      ///< Samples ring, NULL if not allocated
+    int first;          ///< Index of the oldest sample cached
+    int next;           ///< Index after the newest sample cached
+} dat_recent_t;
+static dat_recent_t dat_recent[last_sensor];
+static osSemaphore dat_recent_sem;
+static int dat_recent_ok = 0;
+static void _dat_recent_init(void);
+static void _dat_recent_add(int payload, int index, const void *data, int n);
+static int _dat_recent_get(int payload, int index, void *data, int n);
+static void _dat_recent_drop(int payload, int end);
+#if SCH_STORAGE_MODE == 0
+static void _dat_fp_clear(void);
+static int _dat_fp_journal_init(void);
+static int _dat_fp_journal_sync(void);
+#endif
+
 void dat_repo_init(void)
 {
     // Init repository mutex
-    if(osSemaphoreCreate(&repo_data_sem) != OS_SEMAPHORE_OK)
+    if(osRWLockCreate(&repo_data_sem) != OS_SEMAPHORE_OK)
         LOGE(tag, "Unable to create system status repository mutex");
+    osRWLockSetName(&repo_data_sem, "repo_data");
 
 
     LOGD(tag, "Initializing data repositories buffers...")
+    dat_status_index_init();
+    dat_payload_schema_init();
+    _dat_recent_init();
+    osSemaphoreSetName(&dat_subs_sem, "dat_subs");
+    dat_subs_ok = osSemaphoreCreate(&dat_subs_sem) == OS_SEMAPHORE_OK;
+    if(!dat_subs_ok)
+        LOGE(tag, "Unable to create status subscriptions mutex");
+    fp_event_ok = osEventCreate(&fp_event) == OS_SEMAPHORE_OK;
+    if(!fp_event_ok)
+        LOGE(tag, "Unable to create flight plan wake up event");
 #if (SCH_STORAGE_MODE == 0)
     {
-        // Reset variables (we do not have persistent storage here)
-        int index;
-        for(index=0; index < dat_status_last_address; index++)
+        // Reset variables (we do not have persistent storage here), unless
+        // they were kept in RAM across a software reset
+#ifdef DAT_STATUS_NOINIT
+        if(_dat_noinit_restore() != 0)
+#endif
         {
-            dat_set_status_var(index, dat_get_status_var_def(index).value);
+            int index;
+            for(index=0; index < dat_status_last_address; index++)
+            {
+                dat_set_status_var(index, dat_get_status_var_def(index).value);
+            }
         }
 
-        //Init internal flight plan table
-        int i;
-        for(i=0;i<SCH_FP_MAX_ENTRIES;i++)
-        {
-            data_base[i].unixtime = 0;
-            data_base[i].cmd = NULL;
-            data_base[i].args = NULL;
-            data_base[i].executions = 0;
-            data_base[i].periodical = 0;
-        }
+        //Init internal flight plan table, restored from the journal
+        _dat_fp_clear();
+        _dat_fp_journal_init();
 
+#if !SCH_STORAGE_LAZY
         //Init payloads repo
         int rc = storage_table_payload_init(0);
         assertf(rc==0, tag, "Unable to create payload repo");
+#endif
     }
 #elif (SCH_STORAGE_MODE > 0)
     {
@@ -88,9 +281,23 @@ void dat_repo_init(void)
         rc = storage_table_repo_init(DAT_REPO_SYSTEM, 0);
         assertf(rc==0, tag, "Unable to create system variables repository");
 
+#if SCH_STORAGE_CACHE == 1
+        //Init status variables cache, from now on reads are served from RAM.
+        //The cache is restored from the snapshot if possible, instead of
+        //reading the status table
+#ifdef DAT_SNAPSHOT
+        if(_dat_snapshot_load() != 0)
+#endif
+            dat_get_status_vars(0, dat_status_last_address, dat_status_cache);
+        memset(dat_status_dirty, 0, sizeof(dat_status_dirty));
+        dat_status_cache_ok = 1;
+#endif
+
+#if !SCH_STORAGE_LAZY
         //Init payloads repo
         rc = storage_table_payload_init(0);
         assertf(rc==0, tag, "Unable to create payload repo");
+#endif
 
         //Init system flight plan table
         int entries = dat_get_system_var(dat_fpl_queue);
@@ -99,16 +306,403 @@ void dat_repo_init(void)
         assertf(rc==0, tag, "Unable to create flight plan table");
     }
 #endif
+
+    //Payload indexes are counted in RAM from now on
+    int payload;
+    for(payload=0; payload < last_sensor; payload++)
+        dat_payload_head[payload] = dat_payload_done[payload] = dat_get_system_var(data_map[payload].sys_index);
+}
+
+#if SCH_STORAGE_LAZY
+/**
+ * Create the payload tables if they were not created yet. Called by every
+ * payload access before taking the repository mutex.
+ */
+static void _dat_payload_tables_init(void)
+{
+    if(dat_payload_tables_ok)
+        return;
+    osRWLockWriteTake(&repo_data_sem);
+    if(!dat_payload_tables_ok)
+    {
+        int rc = storage_table_payload_init(0);
+        if(rc == 0)
+            dat_payload_tables_ok = 1;
+        else
+            LOGE(tag, "Unable to create payload repo");
+    }
+    osRWLockWriteGiven(&repo_data_sem);
 }
+#endif
 
 void dat_repo_close(void)
 {
 #if SCH_STORAGE_MODE != 0
     {
+        dat_repo_sync();
         storage_close();
     }
+#else
+    _dat_fp_journal_sync();
+#endif
+}
+
+int dat_repo_seal(void)
+{
+#ifdef DAT_STATUS_NOINIT
+    osRWLockWriteTake(&repo_data_sem);
+    _dat_noinit_seal();
+    osRWLockWriteGiven(&repo_data_sem);
+    return _dat_fp_journal_sync();
+#elif SCH_STORAGE_MODE > 0
+    // Pending status variables are written, then the storage keeps its
+    // status repository in RAM if it can
+    int rc = dat_repo_sync();
+    osRWLockWriteTake(&repo_data_sem);
+    if(storage_repo_seal() != 0)
+        rc = -1;
+    osRWLockWriteGiven(&repo_data_sem);
+    return rc;
+#else
+    return _dat_fp_journal_sync();
+#endif
+}
+
+#if SCH_STORAGE_MODE > 0
+/**
+ * Write a status variable to the storage, and its copies if tripled writing
+ * is enabled. Must be called inside the repo_data_sem critical zone.
+ */
+static int _dat_write_status_var(dat_status_address_t index, value32_t value)
+{
+    SCH_PROF_BEGIN(PROF_STORAGE_STATUS_SET);
+    //Uses tripled writing, the storage sets all the copies
+    #if SCH_STORAGE_TRIPLE_WR == 1
+        int rc = storage_repo_set_copies_idx(index, 1, &value.i, DAT_REPO_SYSTEM);
+    #else
+        int rc = storage_repo_set_value_idx(index, value.i, DAT_REPO_SYSTEM);
+    #endif
+    SCH_PROF_END(PROF_STORAGE_STATUS_SET);
+    return rc;
+}
+#endif
+
+#if SCH_STORAGE_MODE > 0
+/**
+ * Write @n consecutive status variables to the storage, and their copies if
+ * tripled writing is enabled. Must be called inside the repo_data_sem
+ * critical zone.
+ */
+static int _dat_write_status_vars(dat_status_address_t index, int n, const value32_t *values)
+{
+    SCH_PROF_BEGIN(PROF_STORAGE_STATUS_SET);
+    //Uses tripled writing, the storage sets all the copies
+    #if SCH_STORAGE_TRIPLE_WR == 1
+        int rc = storage_repo_set_copies_idx(index, n, (const int *)values, DAT_REPO_SYSTEM);
+    #else
+        int rc = storage_repo_set_values_idx(index, n, (const int *)values, DAT_REPO_SYSTEM);
+    #endif
+    SCH_PROF_END(PROF_STORAGE_STATUS_SET);
+    return rc;
+}
+
+#if SCH_STORAGE_TRIPLE_WR == 1
+static value32_t _dat_vote_status_var(dat_status_address_t index, value32_t value_1, value32_t value_2, value32_t value_3);
+#endif
+
+/**
+ * Read @n consecutive status variables from the storage, voting the copies if
+ * tripled writing is enabled. Must be called inside the repo_data_sem
+ * critical zone.
+ */
+static int _dat_read_status_vars(dat_status_address_t index, int n, value32_t *values)
+{
+    SCH_PROF_BEGIN(PROF_STORAGE_STATUS_GET);
+    //Uses tripled writing, the storage gets all the copies in one query
+    #if SCH_STORAGE_TRIPLE_WR == 1
+        //Copies are only used here, inside the critical zone
+        static value32_t copies[dat_status_last_address * 3];
+        int i, rc = storage_repo_get_copies_idx(index, n, (int *)copies, DAT_REPO_SYSTEM);
+        for(i=0; i<n; i++)
+            values[i] = _dat_vote_status_var(index + i, copies[i], copies[n + i], copies[n*2 + i]);
+    #else
+        int rc = storage_repo_get_values_idx(index, n, (int *)values, DAT_REPO_SYSTEM);
+    #endif
+    SCH_PROF_END(PROF_STORAGE_STATUS_GET);
+    return rc;
+}
+#endif
+
+#if SCH_STORAGE_MODE > 0 && SCH_STORAGE_CACHE == 1
+static int _dat_status_is_critical(dat_status_address_t index)
+{
+    int i;
+    for(i=0; i < sizeof(dat_status_critical)/sizeof(dat_status_critical[0]); i++)
+    {
+        if(dat_status_critical[i] == index)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Update a status variable in the cache if the value changed, critical
+ * variables are written through to the storage. Must be called inside the
+ * repo_data_sem critical zone.
+ */
+static int _dat_cache_status_var(dat_status_address_t index, value32_t value)
+{
+    int rc = 0;
+    // Unchanged values are not written again, a failed write-through is
+    // still dirty and retried by dat_repo_sync
+    if(dat_status_cache[index].u == value.u)
+        return 0;
+    dat_status_cache[index] = value;
+    dat_status_dirty[index] = 1;
+#ifdef DAT_SNAPSHOT
+    dat_snapshot_dirty = 1;
+#endif
+    if(_dat_status_is_critical(index))
+    {
+        rc = _dat_write_status_var(index, value);
+        dat_status_dirty[index] = (uint8_t)(rc != 0);
+    }
+    return rc;
+}
+#endif
+
+#if SCH_STORAGE_TRIPLE_WR == 1
+/**
+ * Vote a status variable from its three copies
+ */
+static value32_t _dat_vote_status_var(dat_status_address_t index, value32_t value_1, value32_t value_2, value32_t value_3)
+{
+    if (value_1.u == value_2.u || value_1.u == value_3.u)
+        return value_1;
+    else if (value_2.u == value_3.u)
+        return value_2;
+    LOGE(tag, "Unable to get a correct value for index %d", index);
+    return value_1;
+}
+#endif
+
+int dat_repo_sync(void)
+{
+    int rc = 0;
+#if SCH_STORAGE_MODE == 0
+    //Write the flight plan journal
+    if(_dat_fp_journal_sync() != 0)
+        rc = -1;
+#endif
+#if SCH_STORAGE_MODE > 0 && SCH_STORAGE_CACHE == 1
+    if(!dat_status_cache_ok)
+        return 0;
+
+    // Consecutive dirty variables are written together, one storage write
+    // (one FRAM burst in the nanomind) per run and copy
+    int index, run, n = 0;
+    osRWLockWriteTake(&repo_data_sem);
+#ifdef DAT_SNAPSHOT
+    if(dat_snapshot_pending)
+        _dat_snapshot_reconcile();
+#endif
+    for(index=0; index < dat_status_last_address; index += run)
+    {
+        run = 1;
+        if(!dat_status_dirty[index])
+            continue;
+        while(index + run < dat_status_last_address && dat_status_dirty[index + run])
+            run++;
+        if(_dat_write_status_vars(index, run, &dat_status_cache[index]) != 0)
+            rc = -1;
+        else
+            memset(&dat_status_dirty[index], 0, run);
+        n += run;
+    }
+#ifdef DAT_SNAPSHOT
+    //The snapshot matches the storage only if all the variables were written
+    if(rc == 0)
+        _dat_snapshot_sync();
+#endif
+    osRWLockWriteGiven(&repo_data_sem);
+    LOGD(tag, "%d status variables synced", n);
+#endif
+    //Flush writes buffered by the storage driver
+    osRWLockWriteTake(&repo_data_sem);
+    if(storage_sync() != 0)
+        rc = -1;
+    osRWLockWriteGiven(&repo_data_sem);
+    return rc;
+}
+
+#if defined(DAT_SNAPSHOT) || defined(DAT_STATUS_NOINIT)
+#define DAT_HASH_INIT (2166136261u)
+
+/**
+ * FNV-1a hash, used to check the status variables kept across resets
+ */
+static uint32_t _dat_hash(uint32_t hash, const volatile void *data, size_t len)
+{
+    const volatile uint8_t *bytes = data;
+    size_t i;
+    for(i=0; i<len; i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+/**
+ * Hash of the status variables names, values kept by a different status
+ * table are discarded
+ */
+static uint32_t _dat_status_layout(void)
+{
+    uint32_t hash = DAT_HASH_INIT;
+    int index;
+    for(index=0; index < dat_status_last_address; index++)
+    {
+        dat_sys_var_t var = dat_get_status_var_def(index);
+        hash = _dat_hash(hash, var.name, strnlen(var.name, MAX_VAR_NAME));
+    }
+    return hash;
+}
+#endif
+
+#ifdef DAT_STATUS_NOINIT
+/**
+ * Keep the RAM status variables if they were sealed before a software reset.
+ * The seal is removed, so they are reset after any other reset.
+ * @return 0 if the variables were kept, -1 if they must be reset
+ */
+static int _dat_noinit_restore(void)
+{
+    int sealed = dat_noinit_seal[0] == DAT_NOINIT_MAGIC && dat_noinit_seal[1] == _dat_status_layout() &&
+                 dat_noinit_seal[2] == _dat_hash(DAT_HASH_INIT, DAT_SYSTEM_VAR_BUFF, sizeof(DAT_SYSTEM_VAR_BUFF));
+    dat_noinit_seal[0] = 0;
+    if(!sealed)
+        return -1;
+    LOGI(tag, "Status variables kept across the software reset");
+    return 0;
+}
+
+/**
+ * Seal the RAM status variables, see _dat_noinit_restore. Must be called
+ * inside the repo_data_sem critical zone.
+ */
+static void _dat_noinit_seal(void)
+{
+    dat_noinit_seal[1] = _dat_status_layout();
+    dat_noinit_seal[2] = _dat_hash(DAT_HASH_INIT, DAT_SYSTEM_VAR_BUFF, sizeof(DAT_SYSTEM_VAR_BUFF));
+    dat_noinit_seal[0] = DAT_NOINIT_MAGIC;
+}
+#endif
+
+#ifdef DAT_SNAPSHOT
+static void _dat_snapshot_file(char *file, size_t len)
+{
+    snprintf(file, len, "%s.%u.snap", SCH_STORAGE_FILE, SCH_COMM_ADDRESS);
+}
+
+/**
+ * Restore the status variables cache from the snapshot with one read. Critical
+ * variables are written through after the snapshot, they are read from the
+ * storage. The other variables are reconciled with the storage by the next
+ * dat_repo_sync. Called at boot, before the cache is enabled.
+ * @return 0 if the cache was restored, -1 if there is no valid snapshot
+ */
+static int _dat_snapshot_load(void)
+{
+    char file[sizeof(SCH_STORAGE_FILE) + 16];
+    _dat_snapshot_file(file, sizeof(file));
+    int len = storage_snapshot_read(file, &dat_snapshot, sizeof(dat_snapshot));
+    if(len != sizeof(dat_snapshot) || dat_snapshot.magic != DAT_SNAPSHOT_MAGIC ||
+       dat_snapshot.n != dat_status_last_address || dat_snapshot.layout != _dat_status_layout() ||
+       dat_snapshot.hash != _dat_hash(DAT_HASH_INIT, dat_snapshot.values, sizeof(dat_snapshot.values)))
+    {
+        LOGW(tag, "No valid status snapshot, reading the status variables from the storage");
+        return -1;
+    }
+
+    memcpy(dat_status_cache, dat_snapshot.values, sizeof(dat_status_cache));
+    int i;
+    for(i=0; i < sizeof(dat_status_critical)/sizeof(dat_status_critical[0]); i++)
+        dat_status_cache[dat_status_critical[i]] = dat_get_status_var(dat_status_critical[i]);
+    dat_snapshot_pending = 1;
+    dat_snapshot_dirty = 0;
+    LOGI(tag, "Status variables restored from the snapshot");
+    return 0;
+}
+
+/**
+ * Compare the restored cache with the storage, in one read. The storage wins
+ * for the variables not written since the boot, it is newer if a reset
+ * happened between a sync and its snapshot. Must be called inside the
+ * repo_data_sem critical zone.
+ */
+static void _dat_snapshot_reconcile(void)
+{
+    // The snapshot buffer is free until the next _dat_snapshot_sync. The
+    // variables never stored, or not read, are -1 and keep the restored value
+    value32_t *stored = dat_snapshot.values;
+    _dat_read_status_vars(0, dat_status_last_address, stored);
+
+    int index, n = 0;
+    for(index=0; index < dat_status_last_address; index++)
+    {
+        if(!dat_status_dirty[index] && stored[index].i != -1 && dat_status_cache[index].u != stored[index].u &&
+           !dat_status_var_is_derived(index))
+        {
+            dat_status_cache[index] = stored[index];
+            _dat_payload_index_set(index, stored[index]);
+            n++;
+        }
+    }
+    if(n > 0)
+    {
+        LOGW(tag, "%d status variables reconciled with the storage", n);
+        dat_snapshot_dirty = 1;
+    }
+    dat_snapshot_pending = 0;
+}
+
+/**
+ * Write the cache to the snapshot if it changed, after all the variables were
+ * written back. Must be called inside the repo_data_sem critical zone.
+ */
+static void _dat_snapshot_sync(void)
+{
+    if(!dat_snapshot_dirty || dat_snapshot_pending)
+        return;
+
+    char file[sizeof(SCH_STORAGE_FILE) + 16];
+    _dat_snapshot_file(file, sizeof(file));
+    dat_snapshot.magic = DAT_SNAPSHOT_MAGIC;
+    dat_snapshot.layout = _dat_status_layout();
+    dat_snapshot.n = dat_status_last_address;
+    memcpy(dat_snapshot.values, dat_status_cache, sizeof(dat_snapshot.values));
+    dat_snapshot.hash = _dat_hash(DAT_HASH_INIT, dat_snapshot.values, sizeof(dat_snapshot.values));
+    if(storage_snapshot_write(file, &dat_snapshot, sizeof(dat_snapshot)) == 0)
+        dat_snapshot_dirty = 0;
+}
 #endif
+
+#if SCH_STORAGE_MODE == 0
+/**
+ * Lock-free write of a RAM status variable and its copies. Aligned 32-bit
+ * loads and stores are atomic in the supported targets, so single variables
+ * do not require the repository mutex. Concurrent writers of the same
+ * variable may leave one stale copy, that is out-voted when reading.
+ * Multi-variable updates (quaternions, vectors) still take repo_data_sem.
+ */
+static void _dat_store_status_var(dat_status_address_t index, value32_t value)
+{
+    DAT_SYSTEM_VAR_BUFF[index].u = value.u;
+    #if SCH_STORAGE_TRIPLE_WR == 1
+        DAT_SYSTEM_VAR_BUFF[index + dat_status_last_address].u = value.u;
+        DAT_SYSTEM_VAR_BUFF[index + dat_status_last_address * 2].u = value.u;
+    #endif
+    __sync_synchronize();
 }
+#endif
 
 /**
  * Function for testing triple writing.
@@ -121,20 +715,18 @@ void dat_repo_close(void)
 int _dat_set_system_var(dat_status_address_t index, int value)
 {
     int rc = 0;
-    //Enter critical zone
-    osSemaphoreTake(&repo_data_sem, portMAX_DELAY);
-
-    //Uses internal memory
+    //Uses internal memory, lock-free
 #if SCH_STORAGE_MODE == 0
-    value32_t var = {.i=value};
-    DAT_SYSTEM_VAR_BUFF[index] = var;
+    DAT_SYSTEM_VAR_BUFF[index].i = value;
+    __sync_synchronize();
     //Uses external memory
 #else
+    //Enter critical zone
+    osRWLockWriteTake(&repo_data_sem);
     rc = storage_repo_set_value_idx(index, value, DAT_REPO_SYSTEM);
-#endif
-
     //Exit critical zone
-    osSemaphoreGiven(&repo_data_sem);
+    osRWLockWriteGiven(&repo_data_sem);
+#endif
 
     return rc;
 }
@@ -151,23 +743,72 @@ int _dat_get_system_var(dat_status_address_t index)
 {
     value32_t value;
 
-    //Enter critical zone
-    osSemaphoreTake(&repo_data_sem, portMAX_DELAY);
-
-    //Use internal (volatile) memory
+    //Use internal (volatile) memory, lock-free
 #if SCH_STORAGE_MODE == 0
-    value = DAT_SYSTEM_VAR_BUFF[index];
+    __sync_synchronize();
+    value.u = DAT_SYSTEM_VAR_BUFF[index].u;
     //Uses external (non-volatile) memory
 #else
+    //Enter critical zone
+    osRWLockWriteTake(&repo_data_sem);
     value.i = storage_repo_get_value_idx(index, DAT_REPO_SYSTEM);
-#endif
-
     //Exit critical zone
-    osSemaphoreGiven(&repo_data_sem);
+    osRWLockWriteGiven(&repo_data_sem);
+#endif
 
     return value.i;
 }
 
+/**
+ * Payload whose index is stored in the status variable @index
+ * @return Payload id, -1 if @index is not a payload index
+ */
+static int _dat_payload_of_index(dat_status_address_t index)
+{
+    int payload;
+    for(payload=0; payload < last_sensor; payload++)
+    {
+        if(data_map[payload].sys_index == index)
+            return payload;
+    }
+    return -1;
+}
+
+/**
+ * Move the payload index counters if @index is a payload index. Must be called
+ * inside the repo_data_sem write critical zone, so no sample is being added.
+ */
+static void _dat_payload_index_set(dat_status_address_t index, value32_t value)
+{
+    int payload = _dat_payload_of_index(index);
+    if(payload >= 0)
+    {
+        dat_payload_head[payload] = value.i;
+        dat_payload_done[payload] = value.i;
+    }
+}
+
+/**
+ * Write a status variable to the RAM buffer, the cache or the storage. Must
+ * be called inside the repo_data_sem write critical zone, except with
+ * SCH_STORAGE_MODE 0.
+ */
+static int _dat_update_status_var(dat_status_address_t index, value32_t value)
+{
+#if SCH_STORAGE_MODE == 0
+    _dat_store_status_var(index, value);
+    return 0;
+    //Uses external memory, write-back cached
+#elif SCH_STORAGE_CACHE == 1
+    if(dat_status_cache_ok)
+        return _dat_cache_status_var(index, value);
+    return _dat_write_status_var(index, value);
+    //Uses external memory
+#else
+    return _dat_write_status_var(index, value);
+#endif
+}
+
 ///< Compatibility function
 int dat_set_system_var(dat_status_address_t index, int value)
 {
@@ -178,32 +819,31 @@ int dat_set_system_var(dat_status_address_t index, int value)
 
 int dat_set_status_var(dat_status_address_t index, value32_t value)
 {
-    int rc = 0;
-    //Enter critical zone
-    osSemaphoreTake(&repo_data_sem, portMAX_DELAY);
+    value32_t derived;
+    if(_dat_status_derived(index, &derived))
+        return 0;
 
-    //Uses internal memory
+    int rc;
+    int payload = _dat_payload_of_index(index);
+    //Uses internal memory, lock-free. Payload indexes wait for the samples
+    //being added
 #if SCH_STORAGE_MODE == 0
-    DAT_SYSTEM_VAR_BUFF[index] = value;
-    //Uses tripled writing
-    #if SCH_STORAGE_TRIPLE_WR == 1
-        DAT_SYSTEM_VAR_BUFF[index + dat_status_last_address] = value;
-        DAT_SYSTEM_VAR_BUFF[index + dat_status_last_address * 2] = value;
-    #endif
-    //Uses external memory
-#else
-    rc = storage_repo_set_value_idx(index, value.i, DAT_REPO_SYSTEM);
-    //Uses tripled writing
-    #if SCH_STORAGE_TRIPLE_WR == 1
-        int rc2 = storage_repo_set_value_idx(index + dat_status_last_address, value.i, DAT_REPO_SYSTEM);
-        int rc3 = storage_repo_set_value_idx(index + dat_status_last_address*2, value.i, DAT_REPO_SYSTEM);
-        rc = rc & rc2 & rc3;
-    #endif
+    if(payload < 0)
+        rc = _dat_update_status_var(index, value);
+    else
 #endif
+    {
+        //Enter critical zone
+        osRWLockWriteTake(&repo_data_sem);
+        rc = _dat_update_status_var(index, value);
+        if(payload >= 0)
+            _dat_payload_index_set(index, value);
+        //Exit critical zone
+        osRWLockWriteGiven(&repo_data_sem);
+    }
 
-    //Exit critical zone
-    osSemaphoreGiven(&repo_data_sem);
-
+    if(rc == 0 && dat_subs_count[index])
+        _dat_notify_status_vars(index, 1, &value);
     return rc;
 }
 
@@ -230,41 +870,58 @@ value32_t dat_get_status_var(dat_status_address_t index)
     value32_t value_3;
 #endif
 
-    //Enter critical zone
-    osSemaphoreTake(&repo_data_sem, portMAX_DELAY);
+    if(_dat_status_derived(index, &value_1))
+        return value_1;
 
-    //Use internal (volatile) memory
-#if SCH_STORAGE_MODE == 0
-    value_1 = DAT_SYSTEM_VAR_BUFF[index];
-    //Uses tripled writing
-    #if SCH_STORAGE_TRIPLE_WR == 1
-        value_2 = DAT_SYSTEM_VAR_BUFF[index + dat_status_last_address];
-        value_3 = DAT_SYSTEM_VAR_BUFF[index + dat_status_last_address * 2];
+#if SCH_STORAGE_MODE > 0 && SCH_STORAGE_CACHE == 1
+    //Use the status variables cache, already voted when populated
+    if(dat_status_cache_ok)
+    {
+        osRWLockReadTake(&repo_data_sem);
+        value_1 = dat_status_cache[index];
+        osRWLockReadGiven(&repo_data_sem);
+        return value_1;
+    }
+#endif
+
+    //Use internal (volatile) memory, lock-free. Copies are voted below,
+    //outside any critical zone
+#if SCH_STORAGE_MODE == 0
+    __sync_synchronize();
+    value_1.u = DAT_SYSTEM_VAR_BUFF[index].u;
+    //Uses tripled writing
+    #if SCH_STORAGE_TRIPLE_WR == 1
+        value_2.u = DAT_SYSTEM_VAR_BUFF[index + dat_status_last_address].u;
+        value_3.u = DAT_SYSTEM_VAR_BUFF[index + dat_status_last_address * 2].u;
     #endif
     //Uses external (non-volatile) memory
 #else
-    value_1.i = storage_repo_get_value_idx(index, DAT_REPO_SYSTEM);
-    //Uses tripled writing
+    //Enter critical zone
+    osRWLockWriteTake(&repo_data_sem);
+
+    SCH_PROF_BEGIN(PROF_STORAGE_STATUS_GET);
+    //Uses tripled writing, the storage gets all the copies
     #if SCH_STORAGE_TRIPLE_WR == 1
-        value_2.i = storage_repo_get_value_idx(index + dat_status_last_address, DAT_REPO_SYSTEM);
-        value_3.i = storage_repo_get_value_idx(index + dat_status_last_address * 2, DAT_REPO_SYSTEM);
+        int copies[3];
+        storage_repo_get_copies_idx(index, 1, copies, DAT_REPO_SYSTEM);
+        value_1.i = copies[0];
+        value_2.i = copies[1];
+        value_3.i = copies[2];
+    #else
+        value_1.i = storage_repo_get_value_idx(index, DAT_REPO_SYSTEM);
     #endif
-#endif
+    SCH_PROF_END(PROF_STORAGE_STATUS_GET);
 
     //Exit critical zone
-    osSemaphoreGiven(&repo_data_sem);
-    
+    osRWLockWriteGiven(&repo_data_sem);
+#endif
+
     // Compare values in tripled reading
 #if SCH_STORAGE_TRIPLE_WR == 1
-    //Compare value and its copies
-    if (value_1.u == value_2.u || value_1.u == value_3.u)
-        return value_1;
-    else if (value_2.u == value_3.u)
-        return value_2;
-    else
-        LOGE(tag, "Unable to get a correct value for index %d", index);
-#endif
+    return _dat_vote_status_var(index, value_1, value_2, value_3);
+#else
     return value_1;
+#endif
 }
 
 value32_t dat_get_status_var_name(char *name)
@@ -273,118 +930,785 @@ value32_t dat_get_status_var_name(char *name)
     return dat_get_status_var(var.address);
 }
 
+int dat_set_status_vars(dat_status_address_t index, int n, const value32_t *values)
+{
+    if(index < 0 || n < 0 || index + n > dat_status_last_address)
+    {
+        LOGE(tag, "Invalid status variables range %d-%d", index, index + n - 1);
+        return -1;
+    }
+
+    int i, rc = 0;
+    //Enter critical zone
+    osRWLockWriteTake(&repo_data_sem);
+    for(i=0; i<n; i++)
+        _dat_payload_index_set(index + i, values[i]);
+
+    //Uses internal memory
+#if SCH_STORAGE_MODE == 0
+    for(i=0; i<n; i++)
+        _dat_store_status_var(index + i, values[i]);
+    //Uses external memory, write-back cached
+#elif SCH_STORAGE_CACHE == 1
+    if(dat_status_cache_ok)
+    {
+        for(i=0; i<n; i++)
+            if(_dat_cache_status_var(index + i, values[i]) != 0)
+                rc = -1;
+    }
+    else
+        rc = _dat_write_status_vars(index, n, values);
+    //Uses external memory
+#else
+    rc = _dat_write_status_vars(index, n, values);
+#endif
+
+    //Exit critical zone
+    osRWLockWriteGiven(&repo_data_sem);
+
+    if(rc == 0)
+        _dat_notify_status_vars(index, n, values);
+    return rc;
+}
+
+int dat_get_status_vars(dat_status_address_t index, int n, value32_t *values)
+{
+    if(index < 0 || n < 0 || index + n > dat_status_last_address)
+    {
+        LOGE(tag, "Invalid status variables range %d-%d", index, index + n - 1);
+        return -1;
+    }
+
+    int i, rc = 0;
+
+    //Use internal (volatile) memory, readers do not block each other
+#if SCH_STORAGE_MODE == 0
+    osRWLockReadTake(&repo_data_sem);
+    __sync_synchronize();
+    for(i=0; i<n; i++)
+    {
+    #if SCH_STORAGE_TRIPLE_WR == 1
+        value32_t value_1, value_2, value_3;
+        value_1.u = DAT_SYSTEM_VAR_BUFF[index + i].u;
+        value_2.u = DAT_SYSTEM_VAR_BUFF[index + i + dat_status_last_address].u;
+        value_3.u = DAT_SYSTEM_VAR_BUFF[index + i + dat_status_last_address * 2].u;
+        values[i] = _dat_vote_status_var(index + i, value_1, value_2, value_3);
+    #else
+        values[i].u = DAT_SYSTEM_VAR_BUFF[index + i].u;
+    #endif
+    }
+    osRWLockReadGiven(&repo_data_sem);
+#else
+    #if SCH_STORAGE_CACHE == 1
+    //Use the status variables cache, already voted when populated
+    if(dat_status_cache_ok)
+    {
+        osRWLockReadTake(&repo_data_sem);
+        for(i=0; i<n; i++)
+            values[i] = dat_status_cache[index + i];
+        osRWLockReadGiven(&repo_data_sem);
+        for(i=0; i<n; i++)
+            _dat_status_derived(index + i, &values[i]);
+        return 0;
+    }
+    #endif
+    //Enter critical zone, the storage driver is used exclusively
+    osRWLockWriteTake(&repo_data_sem);
+    //Uses external (non-volatile) memory, with the copies in one query
+    rc = _dat_read_status_vars(index, n, values);
+    //Exit critical zone
+    osRWLockWriteGiven(&repo_data_sem);
+#endif
+
+    for(i=0; i<n; i++)
+        _dat_status_derived(index + i, &values[i]);
+    return rc;
+}
+
+int dat_status_var_is_derived(dat_status_address_t index)
+{
+    value32_t value;
+    return _dat_status_derived(index, &value);
+}
+
+/**
+ * Notify the subscribers of the variables that changed. The subscriptions are
+ * updated inside dat_subs_sem, the callbacks are called after releasing it.
+ */
+static void _dat_notify_status_vars(dat_status_address_t index, int n, const value32_t *values)
+{
+    dat_sub_t fired[SCH_DAT_SUBS_MAX];
+    int i, j, nfired = 0;
+    for(i = 0; i < n && !dat_subs_count[index + i]; i++);
+    if(i == n || !dat_subs_ok)
+        return;
+
+    osSemaphoreTake(&dat_subs_sem, portMAX_DELAY);
+    for(j = 0; j < SCH_DAT_SUBS_MAX; j++)
+    {
+        dat_sub_t *sub = &dat_subs[j];
+        if(!sub->used || sub->index < index || sub->index >= index + n)
+            continue;
+        value32_t value = values[sub->index - index];
+        if(value.u == sub->last.u)
+            continue;
+        sub->last = value;
+        fired[nfired++] = *sub;
+    }
+    osSemaphoreGiven(&dat_subs_sem);
+
+    for(j = 0; j < nfired; j++)
+    {
+        if(fired[j].callback != NULL)
+            fired[j].callback(fired[j].index, fired[j].last, fired[j].arg);
+        else
+            osEventSet(fired[j].event, fired[j].bits);
+    }
+}
+
+int dat_subscribe(dat_status_address_t index, dat_status_notify_t callback, void *arg, osEvent *event, uint32_t bits)
+{
+    if(index < 0 || index >= dat_status_last_address || dat_status_var_is_derived(index) ||
+       (callback == NULL && event == NULL) || !dat_subs_ok)
+        return -1;
+
+    int id;
+    value32_t value = dat_get_status_var(index);
+    osSemaphoreTake(&dat_subs_sem, portMAX_DELAY);
+    for(id = 0; id < SCH_DAT_SUBS_MAX && dat_subs[id].used; id++);
+    if(id < SCH_DAT_SUBS_MAX)
+    {
+        dat_subs[id] = (dat_sub_t){1, index, value, callback, arg, event, bits};
+        dat_subs_count[index]++;
+    }
+    osSemaphoreGiven(&dat_subs_sem);
+
+    if(id == SCH_DAT_SUBS_MAX)
+    {
+        LOGE(tag, "Unable to subscribe to status variable %d, %d subscriptions", index, SCH_DAT_SUBS_MAX);
+        return -1;
+    }
+    return id;
+}
+
+int dat_unsubscribe(int id)
+{
+    if(id < 0 || id >= SCH_DAT_SUBS_MAX || !dat_subs_ok)
+        return -1;
+
+    int rc = -1;
+    osSemaphoreTake(&dat_subs_sem, portMAX_DELAY);
+    if(dat_subs[id].used)
+    {
+        dat_subs_count[dat_subs[id].index]--;
+        dat_subs[id].used = 0;
+        rc = 0;
+    }
+    osSemaphoreGiven(&dat_subs_sem);
+    return rc;
+}
+
 #if SCH_STORAGE_MODE == 0
-static int _dat_set_fp_async(int timetodo, char* command, char* args, int executions, int periodical)
+/*
+ * The RAM flight plan stores fixed size records in data_base. Free records
+ * are kept in a stack and used records are indexed in data_base_idx, sorted
+ * by unixtime and ms, so the next entry is always data_base_idx[0] and entries
+ * are found by time with a binary search.
+ */
+static void _dat_fp_clear(void)
 {
     int i;
-    for(i = 0;i < SCH_FP_MAX_ENTRIES;i++)
+    for(i=0;i<SCH_FP_MAX_ENTRIES;i++)
     {
-        if(data_base[i].unixtime == -1)
-        {
-            data_base[i].unixtime = timetodo;
-            data_base[i].executions = executions;
-            data_base[i].periodical = periodical;
+        data_base[i].unixtime = -1;
+        data_base[i].executions = 0;
+        data_base[i].periodical = 0;
+        data_base[i].ms = 0;
+        data_base_free[i] = SCH_FP_MAX_ENTRIES - 1 - i;
+    }
+    data_base_len = 0;
+    data_base_free_len = SCH_FP_MAX_ENTRIES;
+}
 
-            data_base[i].cmd = malloc(sizeof(char)*SCH_CMD_MAX_STR_NAME);
-            data_base[i].args = malloc(sizeof(char)*SCH_CMD_MAX_STR_PARAMS);
+/**
+ * Sort key of a record, its execution time in milliseconds
+ */
+static int64_t _dat_fp_key(int rec)
+{
+    return (int64_t)data_base[rec].unixtime*1000 + data_base[rec].ms;
+}
 
-            strncpy(data_base[i].cmd, command, SCH_CMD_MAX_STR_NAME);
-            strncpy(data_base[i].args,args, SCH_CMD_MAX_STR_FORMAT);
+/**
+ * Position in data_base_idx of the first entry with key (unixtime*1000 + ms)
+ * >= key
+ */
+static int _dat_fp_lower_bound(int64_t key)
+{
+    int lo = 0, hi = data_base_len;
+    while(lo < hi)
+    {
+        int mid = (lo + hi)/2;
+        if(_dat_fp_key(data_base_idx[mid]) < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
 
-            return 0;
+/**
+ * Remove the entry at data_base_idx position pos, releasing its record
+ */
+static void _dat_fp_remove(int pos)
+{
+    int rec = data_base_idx[pos];
+    data_base[rec].unixtime = -1;
+    data_base_free[data_base_free_len++] = rec;
+    data_base_len--;
+    memmove(&data_base_idx[pos], &data_base_idx[pos+1], (data_base_len - pos)*sizeof(data_base_idx[0]));
+}
+
+static int _dat_set_fp_async(int timetodo, char* command, char* args, int executions, int periodical, int ms)
+{
+    if(data_base_free_len == 0)
+        return 1;
+
+    int rec = data_base_free[--data_base_free_len];
+    data_base[rec].unixtime = timetodo;
+    data_base[rec].executions = executions;
+    data_base[rec].periodical = periodical;
+    data_base[rec].ms = ms;
+    strncpy(data_base[rec].cmd, command, SCH_CMD_MAX_STR_NAME);
+    data_base[rec].cmd[SCH_CMD_MAX_STR_NAME-1] = '\0';
+    strncpy(data_base[rec].args, args, SCH_CMD_MAX_STR_PARAMS);
+    data_base[rec].args[SCH_CMD_MAX_STR_PARAMS-1] = '\0';
+
+    // Insert after the entries with the same time, they keep the upload order
+    int pos = _dat_fp_lower_bound(_dat_fp_key(rec) + 1);
+    memmove(&data_base_idx[pos+1], &data_base_idx[pos], (data_base_len - pos)*sizeof(data_base_idx[0]));
+    data_base_idx[pos] = rec;
+    data_base_len++;
+    return 0;
+}
+
+/**
+ * Move the entry at data_base_idx position 0 to new_time, keeping its record
+ * and its ms
+ */
+static void _dat_fp_reschedule(int new_time, int executions)
+{
+    int rec = data_base_idx[0];
+    data_base_len--;
+    memmove(&data_base_idx[0], &data_base_idx[1], data_base_len*sizeof(data_base_idx[0]));
+    data_base[rec].unixtime = new_time;
+    data_base[rec].executions = executions;
+
+    int pos = _dat_fp_lower_bound(_dat_fp_key(rec) + 1);
+    memmove(&data_base_idx[pos+1], &data_base_idx[pos], (data_base_len - pos)*sizeof(data_base_idx[0]));
+    data_base_idx[pos] = rec;
+    data_base_len++;
+}
+
+static int _dat_del_fp_async(int timetodo)
+{
+    int pos = _dat_fp_lower_bound((int64_t)timetodo*1000);
+    if(pos < data_base_len && data_base[data_base_idx[pos]].unixtime == timetodo)
+    {
+        _dat_fp_remove(pos);
+        return 0;
+    }
+    return 1;
+}
+
+static int _dat_set_fp_batch_async(fp_entry_t *entries, int n)
+{
+    if(data_base_free_len < n)
+        return 1;
+
+    // Append the new records to the index, then sort it once. The insertion
+    // sort is stable, so entries with the same time and ms keep the upload
+    // order.
+    int i, j;
+    for(i=0; i<n; i++)
+    {
+        int rec = data_base_free[--data_base_free_len];
+        data_base[rec] = entries[i];
+        data_base[rec].cmd[SCH_CMD_MAX_STR_NAME-1] = '\0';
+        data_base[rec].args[SCH_CMD_MAX_STR_PARAMS-1] = '\0';
+        data_base_idx[data_base_len++] = rec;
+    }
+    for(i=data_base_len-n; i<data_base_len; i++)
+    {
+        int rec = data_base_idx[i];
+        for(j=i; j>0 && _dat_fp_key(data_base_idx[j-1]) > _dat_fp_key(rec); j--)
+            data_base_idx[j] = data_base_idx[j-1];
+        data_base_idx[j] = rec;
+    }
+    return 0;
+}
+
+typedef enum fp_journal_op {
+    FP_JOURNAL_SET = 1,     ///< Entry added: unixtime, ms, executions, periodical, command, args
+    FP_JOURNAL_DEL,         ///< Entry deleted: unixtime
+    FP_JOURNAL_POP,         ///< Next entry executed and removed
+    FP_JOURNAL_MOVE,        ///< Next entry executed and moved: unixtime, executions
+} fp_journal_op_t;
+
+#if SCH_FP_JOURNAL == 1
+/*
+ * The RAM flight plan changes are recorded in a journal to keep the flight
+ * plan across resets. Records are added to fp_journal_buf inside the flight
+ * plan critical zone and written to the storage by dat_repo_sync, out of the
+ * flight plan functions. When the journal grows beyond SCH_FP_JOURNAL_SIZE, or
+ * the buffer is full, it is compacted: replaced by one set record per entry.
+ *
+ * Records are a fp_journal_hdr_t followed by len bytes of arguments. Replay
+ * stops at the first record that does not match its crc, torn by a reset
+ * while writing it.
+ */
+#define FP_JOURNAL_BUFF_LEN (2048)  ///< Bytes of records buffered between syncs
+#define FP_JOURNAL_REC_MAX  (sizeof(fp_journal_hdr_t) + 4*sizeof(int32_t) + SCH_CMD_MAX_STR_NAME + SCH_CMD_MAX_STR_PARAMS)
+#define FP_JOURNAL_SNAP_LEN (SCH_FP_MAX_ENTRIES*FP_JOURNAL_REC_MAX)
+#define FP_JOURNAL_OUT_LEN  (FP_JOURNAL_SNAP_LEN > FP_JOURNAL_BUFF_LEN ? FP_JOURNAL_SNAP_LEN : FP_JOURNAL_BUFF_LEN)
+
+typedef struct fp_journal_hdr {
+    uint8_t op;             ///< Record type, fp_journal_op_t
+    uint8_t crc;            ///< CRC-8 of the type and arguments
+    uint16_t len;           ///< Arguments length
+} fp_journal_hdr_t;
+
+static uint8_t fp_journal_buf[FP_JOURNAL_BUFF_LEN];  ///< Records not written yet
+static uint8_t fp_journal_out[FP_JOURNAL_OUT_LEN];   ///< Records being written or replayed
+static int fp_journal_len = 0;                       ///< Bytes in fp_journal_buf
+static int fp_journal_size = 0;                      ///< Bytes in the stored journal
+static int fp_journal_compact = 0;                   ///< Compact the journal in the next sync
+static int fp_journal_ok = 0;                        ///< The journal storage is open
+static osSemaphore fp_journal_sem;                   ///< Serializes the journal writes
+
+static uint8_t _dat_fp_journal_crc(uint8_t op, const uint8_t *data, int len)
+{
+    uint8_t crc = op;
+    int i, j;
+    for(i=0; i<len; i++)
+    {
+        crc ^= data[i];
+        for(j=0; j<8; j++)
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+/**
+ * Encode a record in buf, that must have FP_JOURNAL_REC_MAX bytes
+ * @return Record length
+ */
+static int _dat_fp_journal_encode(uint8_t *buf, uint8_t op, int unixtime, int ms, int executions,
+                                  int periodical, const char *command, const char *args)
+{
+    int32_t nums[4] = {unixtime, ms, executions, periodical};
+    int nnums = 0;
+    if(op == FP_JOURNAL_SET)
+        nnums = 4;
+    else if(op == FP_JOURNAL_DEL)
+        nnums = 1;
+    else if(op == FP_JOURNAL_MOVE)
+    {
+        nums[1] = executions;
+        nnums = 2;
+    }
+
+    int len = sizeof(fp_journal_hdr_t);
+    memcpy(buf + len, nums, nnums*sizeof(int32_t));
+    len += nnums*sizeof(int32_t);
+    if(op == FP_JOURNAL_SET)
+    {
+        // Same limits of the flight plan records
+        size_t n = strnlen(command, SCH_CMD_MAX_STR_NAME-1);
+        memcpy(buf + len, command, n);
+        buf[len + n] = '\0';
+        len += n + 1;
+        n = strnlen(args, SCH_CMD_MAX_STR_PARAMS-1);
+        memcpy(buf + len, args, n);
+        buf[len + n] = '\0';
+        len += n + 1;
+    }
+
+    fp_journal_hdr_t hdr = {op, 0, (uint16_t)(len - sizeof(hdr))};
+    hdr.crc = _dat_fp_journal_crc(op, buf + sizeof(hdr), hdr.len);
+    memcpy(buf, &hdr, sizeof(hdr));
+    return len;
+}
+
+/**
+ * Add a record to the journal buffer. Must be called inside the repo_data_sem
+ * critical zone, after the change was applied.
+ */
+static void _dat_fp_journal_add(uint8_t op, int unixtime, int ms, int executions, int periodical,
+                                const char *command, const char *args)
+{
+    if(!fp_journal_ok || fp_journal_compact)
+        return;  // A compaction stores the current flight plan anyway
+    if(fp_journal_len + FP_JOURNAL_REC_MAX > FP_JOURNAL_BUFF_LEN)
+    {
+        fp_journal_compact = 1;
+        return;
+    }
+    fp_journal_len += _dat_fp_journal_encode(fp_journal_buf + fp_journal_len, op, unixtime, ms, executions,
+                                             periodical, command, args);
+}
+
+/**
+ * Discard the journal records, the next sync stores the current flight plan.
+ * Must be called inside the repo_data_sem critical zone.
+ */
+static void _dat_fp_journal_reset(void)
+{
+    fp_journal_len = 0;
+    fp_journal_compact = 1;
+}
+
+/**
+ * Apply a journal record to the flight plan
+ * @return 0 OK, -1 if the record is not valid
+ */
+static int _dat_fp_journal_apply(uint8_t op, const uint8_t *args, int len)
+{
+    int32_t nums[4];
+    if(op == FP_JOURNAL_SET)
+    {
+        if(len < (int)(4*sizeof(int32_t)) + 2 || args[len-1] != '\0')
+            return -1;
+        memcpy(nums, args, sizeof(nums));
+        char *command = (char *)args + sizeof(nums);
+        char *cmd_args = command + strnlen(command, len - sizeof(nums)) + 1;
+        if(cmd_args >= (char *)args + len)
+            return -1;
+        return _dat_set_fp_async(nums[0], command, cmd_args, nums[2], nums[3], nums[1]) == 0 ? 0 : -1;
+    }
+    if(op == FP_JOURNAL_DEL && len == sizeof(int32_t))
+    {
+        memcpy(nums, args, sizeof(int32_t));
+        _dat_del_fp_async(nums[0]);
+        return 0;
+    }
+    if(op == FP_JOURNAL_POP && len == 0 && data_base_len > 0)
+    {
+        _dat_fp_remove(0);
+        return 0;
+    }
+    if(op == FP_JOURNAL_MOVE && len == 2*sizeof(int32_t) && data_base_len > 0)
+    {
+        memcpy(nums, args, 2*sizeof(int32_t));
+        _dat_fp_reschedule(nums[0], nums[1]);
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * Restore the flight plan from the stored journal
+ * @return Number of records replayed
+ */
+static int _dat_fp_journal_replay(void)
+{
+    fp_journal_hdr_t hdr;
+    int offset = 0, n = 0, rc;
+    while((rc = storage_fp_journal_read(offset, &hdr, sizeof(hdr))) != 0)
+    {
+        if(rc != sizeof(hdr) || hdr.len > FP_JOURNAL_REC_MAX ||
+           storage_fp_journal_read(offset + sizeof(hdr), fp_journal_out, hdr.len) != hdr.len ||
+           _dat_fp_journal_crc(hdr.op, fp_journal_out, hdr.len) != hdr.crc ||
+           _dat_fp_journal_apply(hdr.op, fp_journal_out, hdr.len) != 0)
+        {
+            // New records can not be appended after a torn one
+            LOGW(tag, "Flight plan journal truncated at %d bytes", offset);
+            fp_journal_compact = 1;
+            break;
         }
+        offset += sizeof(hdr) + hdr.len;
+        n++;
     }
+    fp_journal_size = offset;
+    return n;
+}
 
-    return 1;
+static int _dat_fp_journal_init(void)
+{
+    char file[sizeof(SCH_STORAGE_FILE) + 16];
+    sprintf(file, "%s.%u.fpj", SCH_STORAGE_FILE, SCH_COMM_ADDRESS);
+    osSemaphoreSetName(&fp_journal_sem, "fp_journal");
+    if(osSemaphoreCreate(&fp_journal_sem) != OS_SEMAPHORE_OK || storage_fp_journal_init(file) != 0)
+    {
+        LOGE(tag, "Unable to open the flight plan journal, the flight plan will not be kept");
+        return -1;
+    }
+
+    int n = _dat_fp_journal_replay();
+    fp_journal_ok = 1;
+    LOGI(tag, "Flight plan restored, %d entries (%d journal records)", data_base_len, n);
+    return 0;
 }
 
-static int _dat_del_fp_async(int timetodo)
+/**
+ * Write the buffered records, or the current flight plan if the journal has to
+ * be compacted. The flight plan is only locked to copy the records.
+ */
+static int _dat_fp_journal_sync(void)
 {
-    int i;
-    for(i = 0;i < SCH_FP_MAX_ENTRIES;i++)
+    if(!fp_journal_ok)
+        return 0;
+
+    int i, len = 0, rc = 0;
+    osSemaphoreTake(&fp_journal_sem, portMAX_DELAY);
+    osRWLockWriteTake(&repo_data_sem);
+    int compact = fp_journal_compact || fp_journal_size + fp_journal_len > SCH_FP_JOURNAL_SIZE;
+    if(compact)
     {
-        if(timetodo == data_base[i].unixtime)
+        for(i=0; i<data_base_len; i++)
         {
-            data_base[i].unixtime = -1;
-            data_base[i].executions = 0;
-            data_base[i].periodical = 0;
-            free(data_base[i].args);
-            free(data_base[i].cmd);
-            return 0;
+            fp_entry_t *entry = &data_base[data_base_idx[i]];
+            len += _dat_fp_journal_encode(fp_journal_out + len, FP_JOURNAL_SET, entry->unixtime, entry->ms,
+                                          entry->executions, entry->periodical, entry->cmd, entry->args);
         }
     }
-    return 1;
+    else
+    {
+        len = fp_journal_len;
+        memcpy(fp_journal_out, fp_journal_buf, len);
+    }
+    fp_journal_len = 0;
+    fp_journal_compact = 0;
+    osRWLockWriteGiven(&repo_data_sem);
+
+    if(compact)
+    {
+        rc = storage_fp_journal_rewrite(fp_journal_out, len);
+        if(rc == 0)
+        {
+            LOGD(tag, "Flight plan journal compacted, %d to %d bytes", fp_journal_size, len);
+            fp_journal_size = len;
+        }
+    }
+    else if(len > 0)
+    {
+        rc = storage_fp_journal_append(fp_journal_out, len);
+        if(rc == 0)
+            fp_journal_size += len;
+    }
+
+    if(rc != 0)
+    {
+        // The records were not written, store the whole flight plan next time
+        LOGW(tag, "Unable to write the flight plan journal");
+        osRWLockWriteTake(&repo_data_sem);
+        fp_journal_compact = 1;
+        osRWLockWriteGiven(&repo_data_sem);
+    }
+    osSemaphoreGiven(&fp_journal_sem);
+    return rc;
 }
+#else
+static int _dat_fp_journal_init(void) { return 0; }
+static int _dat_fp_journal_sync(void) { return 0; }
+static void _dat_fp_journal_add(uint8_t op, int unixtime, int ms, int executions, int periodical,
+                                const char *command, const char *args) {}
+static void _dat_fp_journal_reset(void) {}
+#endif
 #endif
 
 int dat_set_fp(int timetodo, char* command, char* args, int executions, int periodical)
 {
     int entries = dat_get_system_var(dat_fpl_queue);
 
-    osSemaphoreTake(&repo_data_sem, portMAX_DELAY);
+    osRWLockWriteTake(&repo_data_sem);
     //Enter critical zone
 #if SCH_STORAGE_MODE == 0
     //TODO : agregar signal de segment para responder falla
-    int rc = _dat_set_fp_async(timetodo, command, args, executions, periodical);
+    int rc = _dat_set_fp_async(timetodo, command, args, executions, periodical, 0);
+    if(rc == 0)
+        _dat_fp_journal_add(FP_JOURNAL_SET, timetodo, 0, executions, periodical, command, args);
 #else
-    int rc = storage_flight_plan_set(timetodo, command, args, executions, periodical, &entries);
+    SCH_PROF_BEGIN(PROF_STORAGE_FP_SET);
+    int rc = storage_flight_plan_set(timetodo, command, args, executions, periodical, 0, &entries);
+    SCH_PROF_END(PROF_STORAGE_FP_SET);
 #endif
     //Exit critical zone
-    osSemaphoreGiven(&repo_data_sem);
+    osRWLockWriteGiven(&repo_data_sem);
 
     dat_set_system_var(dat_fpl_queue, entries);
+
+    //The new entry may be earlier than the one the flight plan task waits for
+    if(rc == 0 && fp_event_ok)
+        osEventSet(&fp_event, FP_EVENT_SET);
     return rc;
 }
 
+int dat_set_fp_batch(fp_entry_t *entries, int n)
+{
+    if(n <= 0)
+        return 0;
+
+    int entries_len = dat_get_system_var(dat_fpl_queue);
+
+    osRWLockWriteTake(&repo_data_sem);
+    //Enter critical zone
+#if SCH_STORAGE_MODE == 0
+    int rc = _dat_set_fp_batch_async(entries, n);
+    int i;
+    for(i=0; rc == 0 && i<n; i++)
+        _dat_fp_journal_add(FP_JOURNAL_SET, entries[i].unixtime, entries[i].ms, entries[i].executions,
+                            entries[i].periodical, entries[i].cmd, entries[i].args);
+#else
+    SCH_PROF_BEGIN(PROF_STORAGE_FP_SET);
+    int rc = storage_flight_plan_set_batch(entries, n, &entries_len);
+    SCH_PROF_END(PROF_STORAGE_FP_SET);
+#endif
+    //Exit critical zone
+    osRWLockWriteGiven(&repo_data_sem);
+
+    dat_set_system_var(dat_fpl_queue, entries_len);
+
+    //Wake up the flight plan task once for all the new entries
+    if(rc == 0 && fp_event_ok)
+        osEventSet(&fp_event, FP_EVENT_SET);
+    return rc;
+}
+
+/**
+ * Next execution time of a periodic entry executed at elapsed_sec. Executions
+ * already missed (the system was off or busy) are skipped, not run in a burst.
+ * @param executions Executions left including this one, set to the executions
+ * left after it
+ */
+static int _dat_fp_advance(int timetodo, int period, int *executions, int elapsed_sec)
+{
+    int next = timetodo + period;
+    int remaining = *executions - 1;
+    if(next <= elapsed_sec)
+    {
+        int skip = (elapsed_sec - next)/period + 1;
+        next += skip*period;
+        remaining -= skip;
+    }
+    *executions = remaining;
+    return next;
+}
+
 int dat_get_fp(int elapsed_sec, char* command, char* args, int* executions, int* period)
+{
+    fp_entry_t entry;
+    int rc = dat_get_fp_entry(elapsed_sec, &entry);
+    if(rc == 0)
+    {
+        strcpy(command, entry.cmd);
+        strcpy(args, entry.args);
+        *executions = entry.executions;
+        *period = entry.periodical;
+    }
+    return rc;
+}
+
+int dat_get_fp_entry(int elapsed_sec, fp_entry_t *fp)
 {
     int rc;
     int entries = dat_get_system_var(dat_fpl_queue);
-    osSemaphoreTake(&repo_data_sem, portMAX_DELAY);
+    osRWLockWriteTake(&repo_data_sem);
     //Enter critical zone
 #if SCH_STORAGE_MODE == 0
-    int i;
     rc = -1;  // not found by default
-    for(i = 0;i < SCH_FP_MAX_ENTRIES;i++)
+    fp_entry_t *entry = data_base_len > 0 ? &data_base[data_base_idx[0]] : NULL;
+    if(entry != NULL && entry->unixtime <= elapsed_sec)
     {
-        if(elapsed_sec == data_base[i].unixtime)
+        *fp = *entry;
+        rc = 0;
+
+        // Periodic entries stay in the plan, moved to their next execution
+        int left = fp->executions;
+        int next = 0;
+        if(fp->periodical > 0)
+            next = _dat_fp_advance(entry->unixtime, fp->periodical, &left, elapsed_sec);
+        if(fp->periodical > 0 && left > 0)
         {
-            strcpy(command, data_base[i].cmd);
-            strcpy(args,data_base[i].args);
-            *executions = data_base[i].executions;
-            *period = data_base[i].periodical;
-
-//            if (data_base[i].periodical > 0)
-//                _dat_set_fp_async(elapsed_sec+*period, data_base[i].cmd, data_base[i].args, *executions, *period);
-
-            _dat_del_fp_async(elapsed_sec);
-            rc = 0;  // found, then break!
-            break;
+            _dat_fp_reschedule(next, left);
+            _dat_fp_journal_add(FP_JOURNAL_MOVE, next, 0, left, 0, NULL, NULL);
+        }
+        else
+        {
+            _dat_fp_remove(0);
+            _dat_fp_journal_add(FP_JOURNAL_POP, 0, 0, 0, 0, NULL, NULL);
         }
     }
 #else
-    rc =storage_flight_plan_get(elapsed_sec, command, args, executions, period, &entries);
+    rc = -1;  // not found by default
+    int timetodo = storage_flight_plan_next(entries);
+    if(timetodo != -1 && timetodo <= elapsed_sec)
+    {
+        // Other entries may have the same time, the first one is moved or
+        // removed in one step, as the RAM flight plan
+        SCH_PROF_BEGIN(PROF_STORAGE_FP_GET);
+        rc = storage_flight_plan_peek(timetodo, fp, entries);
+        if(rc == 0)
+        {
+            int left = fp->executions;
+            int next = 0;
+            if(fp->periodical > 0)
+                next = _dat_fp_advance(timetodo, fp->periodical, &left, elapsed_sec);
+            if(fp->periodical > 0 && left > 0)
+                rc = storage_flight_plan_update(timetodo, next, left, &entries);
+            else
+                rc = storage_flight_plan_erase(timetodo, &entries);
+        }
+        SCH_PROF_END(PROF_STORAGE_FP_GET);
+    }
 #endif
     //Exit critical zone
-    osSemaphoreGiven(&repo_data_sem);
+    osRWLockWriteGiven(&repo_data_sem);
 
     dat_set_system_var(dat_fpl_queue, entries);
 
     return rc;
 }
 
+int dat_get_fp_next(void)
+{
+    int timetodo;
+    int entries = dat_get_system_var(dat_fpl_queue);
+    _dat_fp_read_take();
+    //Enter critical zone
+#if SCH_STORAGE_MODE == 0
+    timetodo = data_base_len > 0 ? data_base[data_base_idx[0]].unixtime : -1;
+#else
+    timetodo = storage_flight_plan_next(entries);
+#endif
+    //Exit critical zone
+    _dat_fp_read_given();
+    return timetodo;
+}
+
+int dat_wait_fp(uint32_t timeout_ms)
+{
+    if(!fp_event_ok)
+    {
+        osDelay(timeout_ms);
+        return 0;
+    }
+    return osEventWait(&fp_event, FP_EVENT_SET, timeout_ms) != 0;
+}
+
 int dat_del_fp(int timetodo)
 {
     int entries = dat_get_system_var(dat_fpl_queue);
-    osSemaphoreTake(&repo_data_sem, portMAX_DELAY);
+    osRWLockWriteTake(&repo_data_sem);
     //Enter critical zone
 #if SCH_STORAGE_MODE ==0
     int rc = _dat_del_fp_async(timetodo);
+    if(rc == 0)
+        _dat_fp_journal_add(FP_JOURNAL_DEL, timetodo, 0, 0, 0, NULL, NULL);
 #else
     int rc = storage_flight_plan_erase(timetodo, &entries);
 #endif
     //Exit critical zone
-    osSemaphoreGiven(&repo_data_sem);
+    osRWLockWriteGiven(&repo_data_sem);
 
     dat_set_system_var(dat_fpl_queue, entries);
 
@@ -395,24 +1719,17 @@ int dat_reset_fp(void)
 {
     int rc;
     int entries = dat_get_system_var(dat_fpl_queue);
-    osSemaphoreTake(&repo_data_sem, portMAX_DELAY);
+    osRWLockWriteTake(&repo_data_sem);
     //Enter critical zone
 #if SCH_STORAGE_MODE == 0
-    int i;
-    for(i=0;i<SCH_FP_MAX_ENTRIES;i++)
-    {
-        data_base[i].unixtime = -1;
-        data_base[i].cmd = NULL;
-        data_base[i].args = NULL;
-        data_base[i].executions = 0;
-        data_base[i].periodical = 0;
-    }
+    _dat_fp_clear();
+    _dat_fp_journal_reset();
     rc = 0;
 #else
     rc = storage_table_flight_plan_init(1, &entries);
 #endif
     //Exit critical zone
-    osSemaphoreGiven(&repo_data_sem);
+    osRWLockWriteGiven(&repo_data_sem);
 
     dat_set_system_var(dat_fpl_queue, entries);
     return rc;
@@ -420,52 +1737,256 @@ int dat_reset_fp(void)
 
 int dat_show_fp (void)
 {
-    int rc;
+    fp_entry_t *page = (fp_entry_t *)sch_malloc(MEM_DATA, sizeof(fp_entry_t)*SCH_FP_PAGE);
+    if(page == NULL)
+        return -1;
 
-    int entries = dat_get_system_var(dat_fpl_queue);
-    osSemaphoreTake(&repo_data_sem, portMAX_DELAY);
-    //Enter critical zone
-#if SCH_STORAGE_MODE ==0
-    int cont = 0;
-    int i;
+    // One page at a time, the repo is not locked while printing
+    fp_cursor_t cursor = {-1, 0};
+    int i, n, listed = 0;
     char buffer[80];
-
-    for(i = 0;i < SCH_FP_MAX_ENTRIES; i++)
+    while((n = dat_get_fp_page(&cursor, page, SCH_FP_PAGE)) > 0)
     {
-        if(data_base[i].unixtime!=-1)
+        if(listed == 0)
+            printf("When\tms\tCommand\tArguments\tExecutions\tPeriodical\n");
+        for(i = 0; i < n; i++)
         {
-            if(cont == 0)
-            {
-                printf("When\tCommand\tArguments\tExecutions\tPeriodical\n");
-                cont++;
-            }
-            time_t time_to_show = data_base[i].unixtime;
-            strftime(buffer, 80, "%Y-%m-%d %H:%M:%S UTC\n", gmtime(&time_to_show));
-            printf("%s\t%s\t%s\t%d\t%d\n",buffer,data_base[i].cmd,data_base[i].args,data_base[i].executions,data_base[i].periodical);
+            fp_entry_t *entry = &page[i];
+            time_t time_to_show = entry->unixtime;
+            strftime(buffer, 80, "%Y-%m-%d %H:%M:%S UTC", gmtime(&time_to_show));
+            printf("%s\t%03d\t%s\t%s\t%d\t%d\n",buffer,entry->ms,entry->cmd,entry->args,entry->executions,entry->periodical);
         }
+        listed += n;
     }
-    if(cont == 0)
+    if(n == 0 && listed == 0)
     {
         LOGI(tag, "Flight plan table empty");
     }
+    sch_free(page);
+    return n < 0 ? -1 : 0;
+}
+
+/**
+ * Visit the flight plan commands scheduled from time @from up to time @to,
+ * @see dat_foreach_fp
+ */
+static int _dat_foreach_fp(int from, int to, fp_visit_t visit, void *arg)
+{
+    int rc, locked;
+
+    int entries = dat_get_system_var(dat_fpl_queue);
+    _dat_fp_list_take(locked);
+    //Enter critical zone
+#if SCH_STORAGE_MODE == 0
+    int i;
     rc = 0;
+    for(i = from > 0 ? _dat_fp_lower_bound((int64_t)from*1000) : 0; i < data_base_len; i++)
+    {
+        fp_entry_t *entry = &data_base[data_base_idx[i]];
+        if(to >= 0 && entry->unixtime > to)
+            break;
+        rc++;
+        if(visit(entry, arg) != 0)
+            break;
+    }
 #else
-    rc = storage_flight_plan_show_table(entries);
+    rc = storage_flight_plan_foreach(from, to, visit, arg, entries);
 #endif
     //Exit critical zone
-    osSemaphoreGiven(&repo_data_sem);
+    _dat_fp_list_given(locked);
     return rc;
 }
 
+int dat_foreach_fp(int to, fp_visit_t visit, void *arg)
+{
+    return _dat_foreach_fp(-1, to, visit, arg);
+}
+
+/**
+ * Flight plan page being read, @see dat_get_fp_page
+ */
+typedef struct dat_fp_page {
+    const fp_cursor_t *cursor;
+    fp_entry_t *page;
+    int max;                        ///< Page size
+    int n;                          ///< Commands in the page
+    int skipped;                    ///< Commands at cursor->time skipped
+    int sorted;                     ///< Commands are visited sorted by time
+} dat_fp_page_t;
+
+static int _dat_fp_page_visit(const fp_entry_t *entry, void *arg)
+{
+    dat_fp_page_t *page = (dat_fp_page_t *)arg;
+
+    // Skip the commands at the cursor time already listed
+    if(entry->unixtime == page->cursor->time && page->skipped < page->cursor->skip)
+    {
+        page->skipped++;
+        return 0;
+    }
+
+    // Keep the first commands by time, the same time ones in visit order
+    int i = page->n;
+    if(i == page->max)
+    {
+        if(entry->unixtime >= page->page[i-1].unixtime)
+            return 0;
+        i--;
+    }
+    else
+        page->n++;
+    for(; i > 0 && page->page[i-1].unixtime > entry->unixtime; i--)
+        page->page[i] = page->page[i-1];
+    page->page[i] = *entry;
+
+    // Unsorted storages are read until the end
+    return page->sorted && page->n == page->max;
+}
+
+int dat_get_fp_page(fp_cursor_t *cursor, fp_entry_t *page, int max)
+{
+    if(cursor == NULL || page == NULL || max < 1)
+        return -1;
+
+#if SCH_STORAGE_MODE == 0
+    dat_fp_page_t fp_page = {cursor, page, max, 0, 0, 1};
+#else
+    dat_fp_page_t fp_page = {cursor, page, max, 0, 0, storage_flight_plan_sorted()};
+#endif
+    if(_dat_foreach_fp(cursor->time, -1, _dat_fp_page_visit, &fp_page) < 0)
+        return -1;
+    if(fp_page.n == 0)
+        return 0;
+
+    // Next page after the commands at the last time of this one
+    int last = page[fp_page.n-1].unixtime;
+    int i, same = 0;
+    for(i = fp_page.n-1; i >= 0 && page[i].unixtime == last; i--)
+        same++;
+    cursor->skip = last == cursor->time ? cursor->skip + same : same;
+    cursor->time = last;
+    return fp_page.n;
+}
+
+void dat_add_fp_jitter(int32_t jitter_us)
+{
+    osRWLockWriteTake(&repo_data_sem);
+    fp_jitter.count++;
+    fp_jitter.last_us = jitter_us;
+    if(fp_jitter.count == 1 || jitter_us > fp_jitter.max_us)
+        fp_jitter.max_us = jitter_us;
+    fp_jitter.sum_us += jitter_us;
+    osRWLockWriteGiven(&repo_data_sem);
+}
+
+void dat_get_fp_jitter(fp_jitter_t *jitter, int reset)
+{
+    osRWLockWriteTake(&repo_data_sem);
+    *jitter = fp_jitter;
+    if(reset)
+        memset(&fp_jitter, 0, sizeof(fp_jitter));
+    osRWLockWriteGiven(&repo_data_sem);
+}
+
 time_t dat_get_time(void)
 {
 #ifdef AVR32
     return sec;
+#elif defined(OS_SIM)
+    struct timespec now;
+    osTaskClockGettime(&now);
+    return now.tv_sec;
 #else
     return time(NULL);
 #endif
 }
 
+time_t dat_get_time_ms(int *ms)
+{
+#if defined(NANOMIND)
+    timestamp_t timestamp;
+    clock_get_time(&timestamp);
+    *ms = (int)(timestamp.tv_nsec/1000000);
+    return (time_t)timestamp.tv_sec;
+#elif defined(OS_SIM)
+    struct timespec now;
+    osTaskClockGettime(&now);
+    *ms = (int)(now.tv_nsec/1000000);
+    return now.tv_sec;
+#elif defined(LINUX)
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    *ms = (int)(now.tv_nsec/1000000);
+    return now.tv_sec;
+#else
+    *ms = 0;
+    return dat_get_time();
+#endif
+}
+
+void dat_clock_tick(void)
+{
+    dat_clock_t now;
+    now.utc = dat_get_time_ms(&now.ms);
+    now.tick = osTaskGetTickCount();
+    now.jd = unixt_to_jd((uint32_t)now.utc);
+    now.dec_year = jd_to_dec(now.jd);
+
+    osRWLockWriteTake(&repo_data_sem);
+    dat_clock_seq++;
+    __sync_synchronize();
+    dat_clock = now;
+    __sync_synchronize();
+    dat_clock_seq++;
+    osRWLockWriteGiven(&repo_data_sem);
+}
+
+/**
+ * Copies the cached clock without locking. After DAT_CLOCK_TRIES torn reads
+ * (the writer was preempted mid tick by this reader) it takes the read side of
+ * repo_data_sem so a higher priority reader waits for the tick to finish
+ * instead of spinning on a single core.
+ * @param clock Copy of the cached clock
+ * @return Sequence of the copy, 0 if the clock was never ticked
+ */
+static uint32_t _dat_clock_read(dat_clock_t *clock)
+{
+    uint32_t seq;
+    int tries;
+    for(tries = 0; tries < DAT_CLOCK_TRIES; tries++)
+    {
+        seq = dat_clock_seq;
+        __sync_synchronize();
+        *clock = dat_clock;
+        __sync_synchronize();
+        if(!(seq & 1U) && seq == dat_clock_seq)
+            return seq;
+    }
+
+    osRWLockReadTake(&repo_data_sem);
+    seq = dat_clock_seq;
+    *clock = dat_clock;
+    osRWLockReadGiven(&repo_data_sem);
+    return seq;
+}
+
+void dat_clock_get(dat_clock_t *clock)
+{
+    if(_dat_clock_read(clock) == 0)
+    {
+        clock->utc = dat_get_time_ms(&clock->ms);
+        clock->tick = osTaskGetTickCount();
+        clock->jd = unixt_to_jd((uint32_t)clock->utc);
+        clock->dec_year = jd_to_dec(clock->jd);
+    }
+}
+
+time_t dat_clock_utc(void)
+{
+    dat_clock_t clock;
+    return _dat_clock_read(&clock) == 0 ? dat_get_time() : clock.utc;
+}
+
 int dat_update_time(void)
 {
 #ifdef AVR32
@@ -476,7 +1997,7 @@ int dat_update_time(void)
 #endif
 }
 
-int dat_set_time(int new_time)
+static int _dat_set_time(int new_time)
 {
 #if defined(AVR32)
     sec = (time_t)new_time;
@@ -494,97 +2015,327 @@ int dat_set_time(int new_time)
     memset(cmd, 0, 64);
     snprintf(cmd, 64, "%s%d", "sudo date +%s -s @", new_time);
 
-    int rc = system(cmd);
+    int rc = system(cmd);
+
+    if (rc == -1)
+    {
+        LOGE(tag, "Failed attempt at creating a child process for setting the status_machine clock");
+        return 1;
+    }
+    else if (rc == 127)
+    {
+        LOGE(tag, "Failed attempt at starting a shell for setting status_machine clock");
+        return 1;
+    }
+    else
+    {
+        return rc != 0 ? 1 : 0;
+    }
+#else
+    LOGE(tag, "dat_set_time NOT suported in this platform!")
+    return 0;
+#endif
+}
+
+int dat_set_time(int new_time)
+{
+    int rc = _dat_set_time(new_time);
+    if(rc == 0)
+        dat_clock_tick();
+    return rc;
+}
+
+int dat_show_time(int format)
+{
+    time_t time_to_show = dat_get_time();
+
+    if(format == 0 || format > 1)
+    {
+        char buffer[80];
+        strftime(buffer, 80, "%Y-%m-%d %H:%M:%S UTC\n", gmtime(&time_to_show));
+        LOGR("%s", buffer);
+    }
+    if(format >= 1)
+    {
+        LOGR(tag, "%u\n", (unsigned int)time_to_show);
+    }
+
+    return 0;
+}
+
+/**
+ * Publish the payload index to its status variable. The value is read inside
+ * the critical zone, so concurrent publishers and dat_set_status_var leave the
+ * latest index.
+ */
+static void _dat_payload_publish(int payload)
+{
+    dat_status_address_t index = data_map[payload].sys_index;
+    value32_t value;
+
+    osRWLockWriteTake(&repo_data_sem);
+    value.i = dat_payload_done[payload];
+    int rc = _dat_update_status_var(index, value);
+    osRWLockWriteGiven(&repo_data_sem);
+
+    if(rc == 0 && dat_subs_count[index])
+        _dat_notify_status_vars(index, 1, &value);
+}
+
+/**
+ * Add @n samples of a payload. The slots are reserved atomically, so several
+ * producers can add samples of the same payload, and the index is committed
+ * in order: a sample is visible only once the previous ones are stored.
+ * @return The new payload index if OK, -1 if an error occurred
+ */
+static int _dat_add_payload_samples(void *data, int payload, int n)
+{
+    int ret;
+
+    //Enter critical zone
+    _dat_payload_take();
+
+    int index = __sync_fetch_and_add(&dat_payload_head[payload], n);
+    LOGI(tag, "Adding %d samples for payload %d in index %d", n, payload, index);
+
+    // The storage backend (see SCH_STORAGE_MODE) writes one or more samples
+    SCH_PROF_BEGIN(PROF_STORAGE_PAYLOAD_SET);
+    ret = storage_set_payload_data_batch(index, data, payload, n);
+    SCH_PROF_END(PROF_STORAGE_PAYLOAD_SET);
+
+    // Release the slots if they are the last reserved, otherwise they are
+    // committed empty to not block the next samples
+    if(ret < 0 && __sync_bool_compare_and_swap(&dat_payload_head[payload], index+n, index))
+    {
+        _dat_payload_given();
+        LOGE(tag, "Couldn't set data payload %d", payload);
+        return -1;
+    }
+
+    // Storage writers run concurrently only with SCH_STORAGE_MODE 2, wait for
+    // the previous samples there
+    while(dat_payload_done[payload] != index)
+        osDelay(1);
+    if(ret >= 0)
+        _dat_recent_add(payload, index, data, n);
+    __sync_synchronize();
+    dat_payload_done[payload] = index+n;
+
+    //Exit critical zone
+    _dat_payload_given();
+
+    _dat_payload_publish(payload);
+    if(ret < 0)
+    {
+        LOGE(tag, "Couldn't set data payload %d, %d empty samples", payload, n);
+        return -1;
+    }
+    return index+n;
+}
+
+int dat_add_payload_sample(void* data, int payload)
+{
+    return _dat_add_payload_samples(data, payload, 1);
+}
+
+#if (SCH_SEN_ISR_RING_LEN & (SCH_SEN_ISR_RING_LEN-1)) != 0
+#error "SCH_SEN_ISR_RING_LEN must be a power of 2"
+#endif
 
-    if (rc == -1)
+/*
+ * Samples queued from an ISR (see dat_add_payload_sample_from_isr). The ring
+ * has one producer, the ISR, and one consumer, the task calling
+ * dat_flush_isr_samples, so each side only writes its own position and no
+ * lock is needed. Positions are free running counters.
+ */
+typedef struct {
+    int payload;
+    uint8_t data[SCH_SEN_ISR_SAMPLE_MAX];
+} dat_isr_sample_t;
+
+static dat_isr_sample_t dat_isr_ring[SCH_SEN_ISR_RING_LEN];
+static volatile uint32_t dat_isr_head = 0;      ///< Next sample to store, written by the task
+static volatile uint32_t dat_isr_tail = 0;      ///< Next slot to fill, written by the ISR
+static volatile uint32_t dat_isr_dropped = 0;   ///< Samples dropped, written by the ISR
+
+int dat_add_payload_sample_from_isr(void* data, int payload)
+{
+    if(payload < 0 || payload >= last_sensor || data_map[payload].size > SCH_SEN_ISR_SAMPLE_MAX)
+        return -1;
+
+    uint32_t tail = dat_isr_tail;
+    if(tail - dat_isr_head >= SCH_SEN_ISR_RING_LEN)
     {
-        LOGE(tag, "Failed attempt at creating a child process for setting the status_machine clock");
-        return 1;
+        dat_isr_dropped++;
+        return -1;
     }
-    else if (rc == 127)
+    dat_isr_sample_t *slot = &dat_isr_ring[tail & (SCH_SEN_ISR_RING_LEN-1)];
+    slot->payload = payload;
+    memcpy(slot->data, data, data_map[payload].size);
+    // Publish the slot once it is written
+    __sync_synchronize();
+    dat_isr_tail = tail + 1;
+    return 0;
+}
+
+int dat_flush_isr_samples(int max)
+{
+    static uint32_t dropped = 0;
+    int n = 0;
+    uint32_t head = dat_isr_head;
+    while(n < max && head != dat_isr_tail)
     {
-        LOGE(tag, "Failed attempt at starting a shell for setting status_machine clock");
-        return 1;
+        // Read the slot after its position, and release it after storing
+        __sync_synchronize();
+        dat_isr_sample_t *slot = &dat_isr_ring[head & (SCH_SEN_ISR_RING_LEN-1)];
+        dat_add_payload_sample(slot->data, slot->payload);
+        __sync_synchronize();
+        dat_isr_head = ++head;
+        n++;
     }
-    else
+
+    uint32_t total = dat_isr_dropped;
+    if(total != dropped)
     {
-        return rc != 0 ? 1 : 0;
+        LOGW(tag, "%u samples from interrupts dropped, the ring was full", (unsigned int)(total - dropped));
+        dropped = total;
     }
-#else
-    LOGE(tag, "dat_set_time NOT suported in this platform!")
-    return 0;
-#endif
+    return n;
 }
 
-int dat_show_time(int format)
+int dat_add_payload_samples(void* data, int payload, int n)
 {
-    time_t time_to_show = dat_get_time();
+    if(n <= 0)
+        return -1;
+    return _dat_add_payload_samples(data, payload, n);
+}
 
-    if(format == 0 || format > 1)
-    {
-        char buffer[80];
-        strftime(buffer, 80, "%Y-%m-%d %H:%M:%S UTC\n", gmtime(&time_to_show));
-        LOGR("%s", buffer);
-    }
-    if(format >= 1)
+int dat_add_payload_samples_node(void* data, int payload, int n, int node)
+{
+#ifdef GROUNDSTATION
+    if(node != SCH_COMM_ADDRESS)
     {
-        LOGR(tag, "%u\n", (unsigned int)time_to_show);
+        if(n <= 0)
+            return -1;
+        LOGI(tag, "Adding %d samples for payload %d of node %d", n, payload, node);
+
+        // Node tables keep their own index, the payload lock only serializes
+        // the storage if it is not reentrant
+        _dat_payload_take();
+        SCH_PROF_BEGIN(PROF_STORAGE_PAYLOAD_SET);
+        int index = storage_set_payload_data_node(node, data, payload, n);
+        SCH_PROF_END(PROF_STORAGE_PAYLOAD_SET);
+        _dat_payload_given();
+
+        if(index < 0)
+        {
+            LOGE(tag, "Couldn't set data payload %d of node %d", payload, node);
+            return -1;
+        }
+        return index+n;
     }
+#endif
+    return dat_add_payload_samples(data, payload, n);
+}
 
-    return 0;
+int dat_get_payload_sample(void*data, int payload, int index)
+{
+    int ret, locked;
+    if(_dat_recent_get(payload, index, data, 1) == 0)
+        return 0;
+
+    _dat_payload_read_take(locked);
+
+    SCH_PROF_BEGIN(PROF_STORAGE_PAYLOAD_GET);
+    ret = storage_get_payload_data(index, data, payload);
+    SCH_PROF_END(PROF_STORAGE_PAYLOAD_GET);
+    _dat_payload_read_given(locked);
+
+    return ret;
 }
 
-int dat_add_payload_sample(void* data, int payload)
+int dat_get_payload_samples(void* data, int payload, int start, int count)
 {
-    int ret;
+    int ret, locked;
+    if(start < 0 || count < 0)
+        return -1;
+    if(count > 0 && _dat_recent_get(payload, start, data, count) == 0)
+        return count;
 
-    int index = dat_get_system_var(data_map[payload].sys_index);
-    LOGI(tag, "Adding data for payload %d in index %d", payload, index);
+    _dat_payload_read_take(locked);
+    SCH_PROF_BEGIN(PROF_STORAGE_PAYLOAD_GET);
+    ret = storage_get_payload_data_range(start, count, data, payload);
+    SCH_PROF_END(PROF_STORAGE_PAYLOAD_GET);
+    _dat_payload_read_given(locked);
 
-    //Enter critical zone
-    osSemaphoreTake(&repo_data_sem, portMAX_DELAY);
+    return ret;
+}
 
-//FIXME: use STORAGE_MODE
-#if defined(LINUX) || defined(NANOMIND)
-    ret = storage_set_payload_data(index, data, payload);
-#else
-    ret=0;
+int dat_get_payload_samples_node(void* data, int payload, int start, int count, int node)
+{
+#ifdef GROUNDSTATION
+    if(node != SCH_COMM_ADDRESS)
+    {
+        if(start < 0 || count < 0)
+            return -1;
+        _dat_payload_take();
+        SCH_PROF_BEGIN(PROF_STORAGE_PAYLOAD_GET);
+        int ret = storage_get_payload_data_node(node, start, count, data, payload);
+        SCH_PROF_END(PROF_STORAGE_PAYLOAD_GET);
+        _dat_payload_given();
+        return ret;
+    }
 #endif
-    //Exit critical zone
-    osSemaphoreGiven(&repo_data_sem);
+    return dat_get_payload_samples(data, payload, start, count);
+}
 
-    // Update address
-    if (ret >= 0) {
-        dat_set_system_var(data_map[payload].sys_index, index+1+ret);
-        return index+1+ret;
-    } else {
-        LOGE(tag, "Couldn't set data payload %d", payload);
-        return -1;
+int dat_get_payload_index_node(int payload, int node)
+{
+#ifdef GROUNDSTATION
+    if(node != SCH_COMM_ADDRESS)
+    {
+        _dat_payload_take();
+        int next = storage_get_payload_next_node(node, payload);
+        _dat_payload_given();
+        return next;
     }
+#endif
+    return dat_payload_done[payload];
 }
 
-int dat_get_payload_sample(void*data, int payload, int index)
+int dat_get_payload_index_time(int payload, uint32_t timestamp)
 {
     int ret;
+    if(payload < 0 || payload >= last_sensor)
+        return -1;
 
-    osSemaphoreTake(&repo_data_sem, portMAX_DELAY);
-
-    ret = storage_get_payload_data(index, data, payload);
-    osSemaphoreGiven(&repo_data_sem);
+    int next = dat_payload_done[payload];
+    _dat_payload_take();
+    SCH_PROF_BEGIN(PROF_STORAGE_PAYLOAD_GET);
+    ret = storage_get_payload_index_time(timestamp, payload, next);
+    SCH_PROF_END(PROF_STORAGE_PAYLOAD_GET);
+    _dat_payload_given();
 
     return ret;
 }
 
+uint32_t dat_get_payload_crc_errors(int reset)
+{
+    // A plain counter of the storage, read without the payload lock
+    return storage_payload_crc_errors(reset);
+}
 
 int dat_get_recent_payload_sample(void* data, int payload, int offset)
 {
-    int ret;
+    int ret, locked;
 
-    int index = dat_get_system_var(data_map[payload].sys_index);
+    int index = dat_payload_done[payload];
     LOGV(tag, "Obtaining data of payload %d, in index %d, sys_var: %d", payload, index,data_map[payload].sys_index );
+    if(index-1-offset >= 0 && _dat_recent_get(payload, index-1-offset, data, 1) == 0)
+        return 0;
 
     //Enter critical zone
-    osSemaphoreTake(&repo_data_sem, portMAX_DELAY);
+    _dat_payload_read_take(locked);
 //FIXME: Is this conditional required?
 //FIXME: Use STORAGE_MODE
 #if defined(LINUX) || defined(NANOMIND)
@@ -599,10 +2350,52 @@ int dat_get_recent_payload_sample(void* data, int payload, int offset)
     ret=0;
 #endif
     //Exit critical zone
-    osSemaphoreGiven(&repo_data_sem);
+    _dat_payload_read_given(locked);
     return ret;
 }
 
+int dat_trim_payloads(void)
+{
+    int payload, deleted = 0, rc = 0;
+    for(payload = 0; payload < last_sensor; payload++)
+    {
+        int next = dat_payload_done[payload];
+        int end = 0;
+#if SCH_STORAGE_RETAIN_ROWS > 0
+        end = next - SCH_STORAGE_RETAIN_ROWS;
+#endif
+#if SCH_STORAGE_RETAIN_AGE > 0
+        // Old samples are deleted only once acknowledged
+        int ack = dat_get_system_var(data_map[payload].sys_ack);
+        int old = dat_get_payload_index_time(payload, (uint32_t)(dat_get_time() - SCH_STORAGE_RETAIN_AGE));
+        if(old > ack)
+            old = ack;
+        if(old > end)
+            end = old;
+#endif
+        if(end <= 0 || end > next)
+            continue;
+
+        _dat_payload_take();
+        int n = storage_trim_payload_data(payload, end, SCH_STORAGE_RETAIN_STEP);
+        _dat_payload_given();
+        if(n > 0)
+            _dat_recent_drop(payload, end);
+        if(n < 0)
+        {
+            LOGE(tag, "Couldn't trim payload %d", payload);
+            rc = -1;
+        }
+        else
+        {
+            deleted += n;
+        }
+    }
+    if(deleted > 0)
+        LOGI(tag, "Deleted %d payload samples", deleted);
+    return rc == 0 ? deleted : -1;
+}
+
 int dat_delete_memory_sections(void)
 {
     int ret;
@@ -614,23 +2407,421 @@ int dat_delete_memory_sections(void)
     }
 
     //Enter critical zone
-    osSemaphoreTake(&repo_data_sem, portMAX_DELAY);
+    osRWLockWriteTake(&repo_data_sem);
     //Free memory or drop databases
     ret = storage_delete_memory_sections();
+    for(int i = 0; i < last_sensor; ++i)
+        _dat_recent_drop(i, -1);
     //Exit critical zone
-    osSemaphoreGiven(&repo_data_sem);
+    osRWLockWriteGiven(&repo_data_sem);
 #if SCH_FP_ENABLED
 
     int entries = dat_get_system_var(dat_fpl_queue);
-    osSemaphoreTake(&repo_data_sem, portMAX_DELAY);
+    osRWLockWriteTake(&repo_data_sem);
     storage_flight_plan_reset(&entries);
-    osSemaphoreGiven(&repo_data_sem);
+    osRWLockWriteGiven(&repo_data_sem);
     dat_set_system_var(dat_fpl_queue, entries >= 0 ? entries : 0);
 #endif
     return ret;
 }
 
 
+/**
+ * Allocate the recent samples rings, if SCH_STORAGE_RECENT > 0. Without the
+ * rings every read goes to the storage.
+ */
+static void _dat_recent_init(void)
+{
+    if(dat_recent_ok || SCH_STORAGE_RECENT <= 0)
+        return;
+    osSemaphoreSetName(&dat_recent_sem, "dat_recent");
+    if(osSemaphoreCreate(&dat_recent_sem) != OS_SEMAPHORE_OK)
+    {
+        LOGE(tag, "Unable to create recent samples mutex");
+        return;
+    }
+    int payload;
+    for(payload=0; payload < last_sensor; payload++)
+    {
+        dat_recent[payload].data = (uint8_t *)sch_calloc(MEM_DATA, DAT_RECENT_LEN, data_map[payload].size);
+        dat_recent[payload].first = dat_recent[payload].next = 0;
+        if(dat_recent[payload].data == NULL)
+            LOGW(tag, "Unable to allocate payload %d recent samples", payload);
+    }
+    dat_recent_ok = 1;
+}
+
+/**
+ * Copy @n samples stored from @index to the payload ring. Samples that do not
+ * follow the ones cached replace them.
+ */
+static void _dat_recent_add(int payload, int index, const void *data, int n)
+{
+    if(!dat_recent_ok || dat_recent[payload].data == NULL)
+        return;
+    dat_recent_t *recent = &dat_recent[payload];
+    int size = data_map[payload].size;
+    int i = n > DAT_RECENT_LEN ? n - DAT_RECENT_LEN : 0;
+
+    osSemaphoreTake(&dat_recent_sem, portMAX_DELAY);
+    if(index != recent->next)
+        recent->first = index;
+    for(; i < n; i++)
+        memcpy(recent->data + ((index+i)%DAT_RECENT_LEN)*size, (const uint8_t *)data + i*size, size);
+    recent->next = index + n;
+    if(recent->next - recent->first > DAT_RECENT_LEN)
+        recent->first = recent->next - DAT_RECENT_LEN;
+    osSemaphoreGiven(&dat_recent_sem);
+}
+
+/**
+ * Copy @n samples from @index out of the payload ring.
+ * @return 0 if all the samples were cached, -1 otherwise
+ */
+static int _dat_recent_get(int payload, int index, void *data, int n)
+{
+    if(!dat_recent_ok || payload < 0 || payload >= last_sensor || dat_recent[payload].data == NULL)
+        return -1;
+    dat_recent_t *recent = &dat_recent[payload];
+    int size = data_map[payload].size;
+    int i, rc = -1;
+
+    osSemaphoreTake(&dat_recent_sem, portMAX_DELAY);
+    if(index >= recent->first && n <= recent->next - index)
+    {
+        for(i = 0; i < n; i++)
+            memcpy((uint8_t *)data + i*size, recent->data + ((index+i)%DAT_RECENT_LEN)*size, size);
+        rc = 0;
+    }
+    osSemaphoreGiven(&dat_recent_sem);
+    return rc;
+}
+
+/**
+ * Drop the cached samples with index lower than @end, all if @end < 0
+ */
+static void _dat_recent_drop(int payload, int end)
+{
+    if(!dat_recent_ok)
+        return;
+    dat_recent_t *recent = &dat_recent[payload];
+    osSemaphoreTake(&dat_recent_sem, portMAX_DELAY);
+    if(end < 0)
+        recent->first = recent->next = 0;
+    else if(recent->first < end)
+        recent->first = end < recent->next ? end : recent->next;
+    osSemaphoreGiven(&dat_recent_sem);
+}
+
+/**
+ * Parse a payload field format into the field type and size
+ */
+static int dat_parse_field_type(const char *fmt, dat_payload_field_t *field)
+{
+    static const struct {
+        const char *fmt;
+        dat_field_type_t type;
+        uint16_t size;
+    } types[] = {
+        {"%f", DAT_FIELD_FLOAT, sizeof(float)}, {"%lf", DAT_FIELD_DOUBLE, sizeof(double)},
+        {"%d", DAT_FIELD_INT, sizeof(int32_t)}, {"%i", DAT_FIELD_INT, sizeof(int32_t)},
+        {"%u", DAT_FIELD_UINT, sizeof(uint32_t)},
+        {"%hd", DAT_FIELD_INT, sizeof(int16_t)}, {"%hi", DAT_FIELD_INT, sizeof(int16_t)},
+        {"%hu", DAT_FIELD_UINT, sizeof(uint16_t)},
+        {"%hhd", DAT_FIELD_INT, sizeof(int8_t)}, {"%hhi", DAT_FIELD_INT, sizeof(int8_t)},
+        {"%hhu", DAT_FIELD_UINT, sizeof(uint8_t)},
+        {"%lld", DAT_FIELD_INT, sizeof(int64_t)}, {"%lli", DAT_FIELD_INT, sizeof(int64_t)},
+        {"%llu", DAT_FIELD_UINT, sizeof(uint64_t)},
+    };
+
+    int i;
+    for(i=0; i < sizeof(types)/sizeof(types[0]); i++)
+    {
+        if(strcmp(fmt, types[i].fmt) == 0)
+        {
+            field->type = types[i].type;
+            field->size = types[i].size;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Field descriptors of the payloads defined with X-macro lists, @see
+ * DAT_PAYLOAD_FIELDS. The offsets are set once by dat_payload_schema_init. */
+static dat_payload_field_t dat_temp_fields[] = DAT_PAYLOAD_FIELDS(DAT_TEMP_FIELDS);
+static dat_payload_field_t dat_ads_fields[] = DAT_PAYLOAD_FIELDS(DAT_ADS_FIELDS);
+static dat_payload_field_t dat_eps_fields[] = DAT_PAYLOAD_FIELDS(DAT_EPS_FIELDS);
+static dat_payload_field_t dat_stt_fields[] = DAT_PAYLOAD_FIELDS(DAT_STT_FIELDS);
+static dat_payload_field_t dat_stt_exp_time_fields[] = DAT_PAYLOAD_FIELDS(DAT_STT_EXP_TIME_FIELDS);
+static dat_payload_field_t dat_stat_fields[] = DAT_PAYLOAD_FIELDS(DAT_STAT_FIELDS);
+static dat_payload_field_t dat_trig_fields[] = DAT_PAYLOAD_FIELDS(DAT_TRIG_FIELDS);
+
+#define DAT_FIELDS_ENTRY(fields) {fields, (int)(sizeof(fields)/sizeof(fields[0]))}
+static const struct {
+    dat_payload_field_t *fields;
+    int nfields;
+} dat_payload_fields[last_sensor] = {
+    [temp_sensors] = DAT_FIELDS_ENTRY(dat_temp_fields),
+    [ads_sensors] = DAT_FIELDS_ENTRY(dat_ads_fields),
+    [eps_sensors] = DAT_FIELDS_ENTRY(dat_eps_fields),
+    [stt_sensors] = DAT_FIELDS_ENTRY(dat_stt_fields),
+    [stt_exp_time_sensors] = DAT_FIELDS_ENTRY(dat_stt_exp_time_fields),
+    [stat_sensors] = DAT_FIELDS_ENTRY(dat_stat_fields),
+    [trig_sensors] = DAT_FIELDS_ENTRY(dat_trig_fields),
+};
+
+/**
+ * Build a payload struct descriptor parsing its data_map strings, for the
+ * payloads without a X-macro list. Token buffers are allocated once and kept,
+ * fields names and formats point inside them.
+ * @return 0 if OK, -1 if the descriptor can not be allocated
+ */
+static int dat_payload_schema_parse(int payload, dat_payload_schema_t *schema)
+{
+    char *order = sch_strdup(MEM_DATA, data_map[payload].data_order);
+    char *names = sch_strdup(MEM_DATA, data_map[payload].var_names);
+    char *fmt_save, *name_save;
+
+    // Count fields, the descriptor is allocated once
+    int n = 0;
+    const char *c;
+    for(c = data_map[payload].var_names; *c; c++)
+        n += (*c != ' ' && (c == data_map[payload].var_names || *(c-1) == ' '));
+    schema->fields = (dat_payload_field_t *)sch_calloc(MEM_DATA, n > 0 ? n : 1, sizeof(dat_payload_field_t));
+    schema->nfields = 0;
+    schema->size = 0;
+    if(order == NULL || names == NULL || schema->fields == NULL)
+    {
+        LOGE(tag, "Unable to allocate payload %d descriptor", payload);
+        sch_free(order);
+        sch_free(names);
+        sch_free(schema->fields);
+        schema->fields = NULL;
+        return -1;
+    }
+
+    char *fmt = strtok_r(order, " ", &fmt_save);
+    char *name = strtok_r(names, " ", &name_save);
+    while(fmt != NULL && name != NULL && schema->nfields < n)
+    {
+        dat_payload_field_t *field = &schema->fields[schema->nfields];
+        if(dat_parse_field_type(fmt, field) != 0)
+        {
+            LOGE(tag, "Payload %d field %s has unsupported type %s", payload, name, fmt);
+            break;
+        }
+        field->name = name;
+        field->fmt = fmt;
+        field->offset = schema->size;
+        schema->size += field->size;
+        schema->nfields++;
+        fmt = strtok_r(NULL, " ", &fmt_save);
+        name = strtok_r(NULL, " ", &name_save);
+    }
+
+    return 0;
+}
+
+/**
+ * Build the payload structs descriptors. The payloads defined with X-macro
+ * lists use their static descriptors, only the offsets are set, the others
+ * are parsed from data_map.
+ */
+static void dat_payload_schema_init(void)
+{
+    if(payload_schema_ok)
+        return;
+
+    int payload;
+    for(payload=0; payload < last_sensor; payload++)
+    {
+        dat_payload_schema_t *schema = &payload_schema[payload];
+        if(dat_payload_fields[payload].fields != NULL)
+        {
+            int f;
+            schema->fields = dat_payload_fields[payload].fields;
+            schema->nfields = dat_payload_fields[payload].nfields;
+            schema->size = 0;
+            for(f = 0; f < schema->nfields; f++)
+            {
+                schema->fields[f].offset = schema->size;
+                schema->size += schema->fields[f].size;
+            }
+        }
+        else if(dat_payload_schema_parse(payload, schema) != 0)
+            continue;
+
+        if(schema->size != data_map[payload].size)
+            LOGW(tag, "Payload %d descriptor size (%d) does not match the struct size (%d)",
+                 payload, schema->size, data_map[payload].size);
+    }
+    payload_schema_ok = 1;
+}
+
+const dat_payload_schema_t *dat_get_payload_schema(int payload)
+{
+    if(payload < 0 || payload >= last_sensor)
+        return NULL;
+    if(!payload_schema_ok)
+        dat_payload_schema_init();
+    return &payload_schema[payload];
+}
+
+/* Compressed payload samples writer and reader (see dat_compress_payload_samples) */
+typedef struct dat_z_buff {
+    uint8_t *data;
+    int len;        ///< Bytes used, -1 if the buffer overflowed
+    int max;
+    int zeros;      ///< Pending (writer) or remaining (reader) run of zeros
+} dat_z_buff_t;
+
+static void _dat_z_put(dat_z_buff_t *z, uint8_t byte)
+{
+    if(z->len < 0)
+        return;
+    if(z->len >= z->max)
+    {
+        z->len = -1;
+        return;
+    }
+    z->data[z->len++] = byte;
+}
+
+static void _dat_z_flush(dat_z_buff_t *z)
+{
+    if(z->zeros > 0)
+    {
+        _dat_z_put(z, 0);
+        _dat_z_put(z, (uint8_t)(z->zeros - 1));
+        z->zeros = 0;
+    }
+}
+
+static void _dat_z_write(dat_z_buff_t *z, uint8_t byte)
+{
+    if(byte == 0)
+    {
+        if(++z->zeros == 256)
+            _dat_z_flush(z);
+        return;
+    }
+    _dat_z_flush(z);
+    _dat_z_put(z, byte);
+}
+
+static int _dat_z_read(dat_z_buff_t *z)
+{
+    if(z->zeros > 0)
+    {
+        z->zeros--;
+        return 0;
+    }
+    if(z->len >= z->max)
+        return -1;
+    uint8_t byte = z->data[z->len++];
+    if(byte == 0)
+    {
+        if(z->len >= z->max)
+            return -1;
+        z->zeros = z->data[z->len++];
+    }
+    return byte;
+}
+
+static uint64_t _dat_field_get(const uint8_t *data, int size)
+{
+    uint8_t v8; uint16_t v16; uint32_t v32; uint64_t v64;
+    switch(size)
+    {
+        case 1: memcpy(&v8, data, 1); return v8;
+        case 2: memcpy(&v16, data, 2); return v16;
+        case 4: memcpy(&v32, data, 4); return v32;
+        default: memcpy(&v64, data, 8); return v64;
+    }
+}
+
+static void _dat_field_set(uint8_t *data, int size, uint64_t value)
+{
+    uint8_t v8 = (uint8_t)value;
+    uint16_t v16 = (uint16_t)value;
+    uint32_t v32 = (uint32_t)value;
+    switch(size)
+    {
+        case 1: memcpy(data, &v8, 1); break;
+        case 2: memcpy(data, &v16, 2); break;
+        case 4: memcpy(data, &v32, 4); break;
+        default: memcpy(data, &value, 8); break;
+    }
+}
+
+int dat_compress_payload_samples(const void *samples, int payload, int n, uint8_t *out, int max)
+{
+    const dat_payload_schema_t *schema = dat_get_payload_schema(payload);
+    if(schema == NULL || schema->nfields == 0 || schema->size != data_map[payload].size || n < 1)
+        return -1;
+
+    dat_z_buff_t z = {out, 0, max, 0};
+    int f, i;
+    for(f=0; f < schema->nfields; f++)
+    {
+        const dat_payload_field_t *field = &schema->fields[f];
+        int shift = 64 - 8*field->size;
+        uint64_t prev = 0;
+        for(i=0; i < n; i++)
+        {
+            const uint8_t *sample = (const uint8_t *)samples + i*schema->size;
+            uint64_t value = _dat_field_get(sample + field->offset, field->size);
+            // Delta at the field width, as a signed value, zigzag and LEB128 encoded
+            int64_t delta = (int64_t)((value - prev) << shift) >> shift;
+            uint64_t zz = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+            prev = value;
+            do {
+                uint8_t byte = (uint8_t)(zz & 0x7F);
+                zz >>= 7;
+                _dat_z_write(&z, zz ? (uint8_t)(byte | 0x80) : byte);
+            } while(zz);
+        }
+    }
+    _dat_z_flush(&z);
+    return z.len;
+}
+
+int dat_decompress_payload_samples(const uint8_t *in, int len, int payload, int n, void *samples)
+{
+    const dat_payload_schema_t *schema = dat_get_payload_schema(payload);
+    if(schema == NULL || schema->nfields == 0 || schema->size != data_map[payload].size || n < 1)
+        return -1;
+
+    dat_z_buff_t z = {(uint8_t *)in, 0, len, 0};
+    int f, i;
+    for(f=0; f < schema->nfields; f++)
+    {
+        const dat_payload_field_t *field = &schema->fields[f];
+        uint64_t prev = 0;
+        for(i=0; i < n; i++)
+        {
+            uint64_t zz = 0;
+            int bits = 0, byte;
+            do {
+                byte = _dat_z_read(&z);
+                if(byte < 0 || bits >= 64)
+                {
+                    LOGE(tag, "Corrupted compressed payload %d data (field %d, sample %d)", payload, f, i);
+                    return -1;
+                }
+                zz |= (uint64_t)(byte & 0x7F) << bits;
+                bits += 7;
+            } while(byte & 0x80);
+            int64_t delta = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+            prev += (uint64_t)delta;
+            uint8_t *sample = (uint8_t *)samples + i*schema->size;
+            _dat_field_set(sample + field->offset, field->size, prev);
+        }
+    }
+    return 0;
+}
+
 int get_payloads_tokens(char** tok_sym, char** tok_var, char* order, char* var_names, int i)
 {
     const char s[2] = " ";
@@ -688,56 +2879,96 @@ int get_sizeof_type(char* c_type)
     }
 }
 
+/**
+ * Loads an integer field with its own type, so it is widened in the host byte
+ * order (AVR32 is big endian)
+ * @param field Field descriptor
+ * @param ptr Field address in the payload struct
+ * @param ival Signed value, or NULL
+ * @param uval Unsigned value, or NULL
+ */
+static void _dat_load_field(const dat_payload_field_t *field, const char *ptr,
+                            int64_t *ival, uint64_t *uval)
+{
+    uint8_t u8;
+    uint16_t u16;
+    uint32_t u32;
+    uint64_t u64 = 0;
+    int64_t i64 = 0;
+    switch(field->size)
+    {
+        case 1:
+            memcpy(&u8, ptr, sizeof(u8));
+            u64 = u8;
+            i64 = (int8_t)u8;
+            break;
+        case 2:
+            memcpy(&u16, ptr, sizeof(u16));
+            u64 = u16;
+            i64 = (int16_t)u16;
+            break;
+        case 4:
+            memcpy(&u32, ptr, sizeof(u32));
+            u64 = u32;
+            i64 = (int32_t)u32;
+            break;
+        case 8:
+            memcpy(&u64, ptr, sizeof(u64));
+            i64 = (int64_t)u64;
+            break;
+        default:
+            break;
+    }
+    if(ival != NULL)
+        *ival = i64;
+    if(uval != NULL)
+        *uval = u64;
+}
+
 int dat_print_payload_struct(void* data, unsigned int payload)
 {
-    //FIXME: Buffers allocated in stack with magical numbers! Use defined values
-    //FIXME: Use malloc to allocate large buffers, here 1280  bytes allocated!
-    //FIXME: Task stack size: 5*256 = 1280 bytes!
-
-    char* tok_sym[300];
-    char* tok_var[300];
-//    char** tok_sym = (char**)malloc(300);
-//    char** tok_var = (char**)malloc(300);
-    char *order = (char *)malloc(300);
-    strcpy(order, data_map[payload].data_order);
-    char *var_names = (char *)malloc(1000);
-    strcpy(var_names, data_map[payload].var_names);
-    int nparams = get_payloads_tokens(tok_sym, tok_var, order, var_names, (int)payload);
-
-    char *values = (char *)malloc(1000);
-    char *names = (char *)malloc(1000);
-    strcpy(names, "");
-    strcpy(values, "");
+    const dat_payload_schema_t *schema = dat_get_payload_schema((int)payload);
+    if(schema == NULL)
+        return -1;
 
     int j;
-    for(j=0; j < nparams; ++j) {
-        int param_size = get_sizeof_type(tok_sym[j]);
-        char buff[param_size];
-        memcpy(buff, data+(j*param_size), param_size);
-
-        char name[20];
-        sprintf(name, " %s", tok_var[j]);
-        strcat(names, name);
-
-        char val[20];
-        get_value_string(val, tok_sym[j], buff);
-        strcat(values, val);
-
-        if(j != nparams-1){
-            strcat(names, ",");
-            strcat(values, ",");
+    for(j=0; j < schema->nfields; ++j)
+        printf(" %s%s", schema->fields[j].name, j != schema->nfields-1 ? "," : ":");
+
+    for(j=0; j < schema->nfields; ++j)
+    {
+        const dat_payload_field_t *field = &schema->fields[j];
+        const char *ptr = (const char *)data + field->offset;
+        int64_t ival = 0;
+        uint64_t uval = 0;
+        float fval;
+        double dval;
+        switch(field->type)
+        {
+            case DAT_FIELD_FLOAT:
+                memcpy(&fval, ptr, sizeof(fval));
+                if(*((int32_t *)&fval) == -1)
+                    printf(" 'nan'");
+                else
+                    printf(" %f", fval);
+                break;
+            case DAT_FIELD_DOUBLE:
+                memcpy(&dval, ptr, sizeof(dval));
+                printf(" %f", dval);
+                break;
+            case DAT_FIELD_UINT:
+                _dat_load_field(field, ptr, NULL, &uval);
+                printf(" %llu", (unsigned long long)uval);
+                break;
+            default:
+                _dat_load_field(field, ptr, &ival, NULL);
+                printf(" %lld", (long long)ival);
+                break;
         }
+        if(j != schema->nfields-1)
+            printf(",");
     }
-    strcat(names, ":");
-    printf( "%s %s\n", names, values);
-
-    free(order);
-    free(var_names);
-    free(values);
-    free(names);
-//    free(tok_sym);
-//    free(tok_var);
-
+    printf("\n");
     return 0;
 }
 
@@ -748,6 +2979,22 @@ int dat_set_stmachine_state(dat_stmachine_action_t action, unsigned int step, in
         osSemaphoreTake(&repo_machine_sem, portMAX_DELAY);
         status_machine.action = action;
         status_machine.step = step;
+        status_machine.step_ms = 0;
+        status_machine.samples_left = nsamples;
+        osSemaphoreGiven(&repo_machine_sem);
+        return 1;
+    }
+    return 0;
+}
+
+int dat_set_stmachine_state_ms(dat_stmachine_action_t action, unsigned int step_ms, int nsamples)
+{
+    LOGI(tag, "Changing state to  %d %u ms %d", action, step_ms, nsamples);
+    if (action >= 0 && action < ACT_LAST && step_ms > 0 && nsamples > -2) {
+        osSemaphoreTake(&repo_machine_sem, portMAX_DELAY);
+        status_machine.action = action;
+        status_machine.step = step_ms/1000 > 0 ? step_ms/1000 : 1;
+        status_machine.step_ms = step_ms;
         status_machine.samples_left = nsamples;
         osSemaphoreGiven(&repo_machine_sem);
         return 1;
@@ -767,44 +3014,38 @@ void _get_sat_quaterion(quaternion_t *q,  dat_status_address_t index)
 {
     assert(index+4 < dat_status_last_address);
     int i;
+    value32_t v[4];
+    dat_get_status_vars(index, 4, v);
     for(i=0; i<4; i++)
-    {
-        value32_t v = dat_get_status_var(index+i);
-        q->q[i] = (double)v.f;
-    }
+        q->q[i] = (real_t)v[i].f;
 }
 
 void _set_sat_quaterion(quaternion_t *q,  dat_status_address_t index)
 {
     assert(index+4 < dat_status_last_address);
     int i;
+    value32_t v[4];
     for(i=0; i<4; i++)
-    {
-        value32_t v;
-        v.f = (float)q->q[i];
-        dat_set_status_var(index + i, v);
-    }
+        v[i].f = (float)q->q[i];
+    dat_set_status_vars(index, 4, v);
 }
 
 void _get_sat_vector(vector3_t *r, dat_status_address_t index)
 {
     assert(index+3 < dat_status_last_address);
     int i;
+    value32_t v[3];
+    dat_get_status_vars(index, 3, v);
     for(i=0; i<3; i++)
-    {
-        value32_t v= dat_get_status_var(index+i);
-        r->v[i] = (double)v.f;
-    }
+        r->v[i] = (real_t)v[i].f;
 }
 
 void _set_sat_vector(vector3_t *r, dat_status_address_t index)
 {
     assert(index+3 < dat_status_last_address);
     int i;
+    value32_t v[3];
     for(i=0; i<3; i++)
-    {
-        value32_t v;
-        v.f = (float)r->v[i];
-        dat_set_status_var(index + i, v);
-    }
+        v[i].f = (float)r->v[i];
+    dat_set_status_vars(index, 3, v);
 }
\ No newline at end of file
@@ -7,9 +7,48 @@
  * This file initilize some structs needed for data schema.
  */
 
+#include <stdlib.h>
 #include "repoDataSchema.h"
 static const char *tag = "repoDataSchema";
 
+#define DAT_STATUS_LIST_LEN (sizeof(dat_status_list) / sizeof(dat_status_list[0]))
+
+/* Status variables lookup tables (see dat_status_index_init) */
+static int16_t dat_status_pos[dat_status_last_address];     ///< Position in dat_status_list by address, -1 if not listed
+static int16_t dat_status_name_pos[DAT_STATUS_LIST_LEN];   ///< Positions in dat_status_list sorted by name
+static volatile int dat_status_index_ok = 0;
+
+static int dat_status_name_cmp(const void *a, const void *b)
+{
+    return strcmp(dat_status_list[*(const int16_t *)a].name, dat_status_list[*(const int16_t *)b].name);
+}
+
+static int dat_status_name_key_cmp(const void *key, const void *b)
+{
+    return strcmp((const char *)key, dat_status_list[*(const int16_t *)b].name);
+}
+
+void dat_status_index_init(void)
+{
+    if(dat_status_index_ok)
+        return;
+
+    int i;
+    for(i = 0; i < dat_status_last_address; i++)
+        dat_status_pos[i] = -1;
+    for(i = 0; i < dat_status_last_var; i++)
+    {
+        if(dat_status_list[i].address < dat_status_last_address)
+            dat_status_pos[dat_status_list[i].address] = (int16_t)i;
+        dat_status_name_pos[i] = (int16_t)i;
+    }
+    qsort(dat_status_name_pos, DAT_STATUS_LIST_LEN, sizeof(dat_status_name_pos[0]), dat_status_name_cmp);
+
+    // Publish the tables only once they are complete
+    __sync_synchronize();
+    dat_status_index_ok = 1;
+}
+
 dat_sys_var_t dat_get_status_var_def(dat_status_address_t address)
 {
     dat_sys_var_t var = {0};
@@ -17,10 +56,18 @@ dat_sys_var_t dat_get_status_var_def(dat_status_address_t address)
 
     if(address < dat_status_last_address)
     {
-        for (i = 0; i < dat_status_last_var; i++)
+        if(dat_status_index_ok)
+        {
+            if(dat_status_pos[address] >= 0)
+                return dat_status_list[dat_status_pos[address]];
+        }
+        else
         {
-            if (dat_status_list[i].address == address)
-                return dat_status_list[i];
+            for (i = 0; i < dat_status_last_var; i++)
+            {
+                if (dat_status_list[i].address == address)
+                    return dat_status_list[i];
+            }
         }
     }
 
@@ -36,10 +83,20 @@ dat_sys_var_t dat_get_status_var_def_name(char *name)
 
     if(name != NULL)
     {
-        for (i = 0; i < dat_status_last_var; i++)
+        if(dat_status_index_ok)
         {
-            if (strcmp(dat_status_list[i].name, name) == 0)
-                return dat_status_list[i];
+            int16_t *pos = bsearch(name, dat_status_name_pos, DAT_STATUS_LIST_LEN,
+                                   sizeof(dat_status_name_pos[0]), dat_status_name_key_cmp);
+            if(pos != NULL)
+                return dat_status_list[*pos];
+        }
+        else
+        {
+            for (i = 0; i < dat_status_last_var; i++)
+            {
+                if (strcmp(dat_status_list[i].name, name) == 0)
+                    return dat_status_list[i];
+            }
         }
     }
 
@@ -47,6 +104,75 @@ dat_sys_var_t dat_get_status_var_def_name(char *name)
     return var;
 }
 
+/**
+ * Select the variables of one item of a selection, @see dat_select_status_vars
+ * @return Number of variables matched, -1 if the item is invalid
+ */
+static int _dat_select_item(const char *item, int len, char *selected)
+{
+    int i, n = 0;
+    char *end;
+    if(item[0] >= '0' && item[0] <= '9')
+    {
+        // Address or range of addresses "<first>-<last>"
+        long first = strtol(item, &end, 10), last = first;
+        if(*end == '-')
+            last = strtol(end+1, &end, 10);
+        if(end != item + len || first > last || last >= dat_status_last_address)
+            return -1;
+        for(i = 0; i < dat_status_last_var; i++)
+        {
+            if(dat_status_list[i].address >= first && dat_status_list[i].address <= last)
+            {
+                selected[i] = 1;
+                n++;
+            }
+        }
+        return n;
+    }
+
+    // Variable name or group, the variables named "<group>_..."
+    for(i = 0; i < dat_status_last_var; i++)
+    {
+        const char *name = dat_status_list[i].name;
+        if(strncmp(name, item, len) == 0 && (name[len] == '\0' || name[len] == '_'))
+        {
+            selected[i] = 1;
+            n++;
+        }
+    }
+    return n > 0 ? n : -1;
+}
+
+int dat_select_status_vars(const char *selection, int *vars, int max)
+{
+    char selected[DAT_STATUS_LIST_LEN];
+    memset(selected, 0, sizeof(selected));
+    if(selection == NULL || vars == NULL)
+        return -1;
+
+    const char *item = selection;
+    while(*item != '\0')
+    {
+        int len = (int)strcspn(item, " ,");
+        if(len > 0 && _dat_select_item(item, len, selected) < 0)
+        {
+            LOGE(tag, "Invalid status variables selection: %.*s", len, item);
+            return -1;
+        }
+        item += len;
+        item += strspn(item, " ,");
+    }
+
+    int i, n = 0;
+    for(i = 0; i < dat_status_last_var && n < max; i++)
+    {
+        if(selected[i])
+            vars[n++] = i;
+    }
+    return n;
+}
+
 void dat_print_system_var(dat_sys_var_t *status)
 {
     assert(status != NULL);
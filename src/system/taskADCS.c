@@ -18,14 +18,513 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_TAG_ID LOG_TAG_ADCS
 #include "taskADCS.h"
 
 static const char *tag = "ADCS";
+static osPeriod adcs_period;  ///< Loop timing (see obc_task_stats)
+
+static void _adcs_cmd_loop(void);
+static void _adcs_engine_loop(void);
+
+/* Operation mode, updated when dat_obc_opmode changes (see dat_subscribe) */
+static volatile int adcs_opmode;
+static int adcs_opmode_sub = -1;
+
+static void _adcs_opmode_changed(dat_status_address_t index, value32_t value, void *arg)
+{
+    adcs_opmode = value.i;
+}
+
+/**
+ * Current operation mode, read from the status repository only if the
+ * subscription failed
+ */
+static int _adcs_opmode(void)
+{
+    return adcs_opmode_sub >= 0 ? adcs_opmode : (int)dat_get_system_var(dat_obc_opmode);
+}
+
+/**
+ * ADCS in-process estimator state, owned by the engine loop
+ */
+typedef struct adcs_fusion {
+    real_t P[6][6];         ///< ESKF error covariance
+    vector3_t bias;         ///< Gyroscope bias estimate
+    vector3_t mag_i;        ///< Magnetic model, inertial frame
+    adcs_sun_t sun;         ///< Sun direction and eclipse model
+#ifdef SCH_USE_GSSB
+    gssb_sun_sample_t sun_raw; ///< Last sun sensors sample
+#endif
+    portTick t_predict;     ///< Time of the current estimate
+    int mag_i_ok;           ///< The magnetic model is valid
+} adcs_fusion_t;
+
+/**
+ * ADCS sensor schedule entry. The sample function takes the measurement
+ * and runs its estimator step at time @now.
+ */
+typedef struct adcs_sensor {
+    const char *name;       ///< Sensor name
+    unsigned int period_ms; ///< Sample period in ms, 0 if disabled
+    int (*sample)(adcs_state_t *st, adcs_fusion_t *fu, portTick now);
+    portTick next;          ///< Time of the next sample
+    portTick last;          ///< Time of the last valid sample
+} adcs_sensor_t;
 
 void taskADCS(void *param)
 {
     LOGI(tag, "Started");
 
+    /**
+     * Set-up SGP4 propagator, each step waits for the previous one
+     */
+    cmd_t *tle1 = cmd_get_str("obc_set_tle");
+    cmd_add_params_str(tle1, "1 42788U 17036Z   20027.14771603  .00000881  00000-0  39896-4 0  9992");
+    int rc = cmd_send_wait(tle1, 1000);
+    if(rc == CMD_OK)
+    {
+        cmd_t *tle2 = cmd_get_str("obc_set_tle");
+        cmd_add_params_str(tle2, "2 42788  97.3234  85.2817 0012095 159.3521 200.8207 15.23399088144212");
+        rc = cmd_send_wait(tle2, 1000);
+    }
+    if(rc == CMD_OK)
+        rc = cmd_send_wait(cmd_get_str("obc_update_tle"), 1000);
+    if(rc != CMD_OK)
+    {
+        LOGW(tag, "Unable to set-up the TLE (%d)", rc);
+    }
+    cmd_t *tle_u = cmd_get_str("obc_get_tle");
+    cmd_send(tle_u);
+    dat_set_system_var(dat_obc_opmode, DAT_OBC_OPMODE_DETUMB_MAG);
+    adcs_opmode_sub = dat_subscribe(dat_obc_opmode, _adcs_opmode_changed, NULL, NULL, 0);
+    adcs_opmode = dat_get_system_var(dat_obc_opmode);
+
+#if SCH_ADCS_ENGINE
+    _adcs_engine_loop();
+#else
+    _adcs_cmd_loop();
+#endif
+}
+
+/**
+ * Seconds between two task tick counts
+ */
+static real_t _adcs_dt(portTick from, portTick to)
+{
+    return (real_t)(portTick)(to - from) / (real_t)osDefineTime(1000);
+}
+
+/**
+ * ESKF predict, integrates the attitude and the error covariance from the
+ * time of the current estimate to @now with the last gyroscope sample
+ */
+static void _adcs_predict(adcs_state_t *st, adcs_fusion_t *fu, portTick now)
+{
+    real_t dt = _adcs_dt(fu->t_predict, now);
+    fu->t_predict = now;
+    if(dt <= REAL(0.0))
+        return;
+
+    SCH_PROF_BEGIN(PROF_ESKF_PREDICT);
+    vector3_t w, nbias;
+    quaternion_t q;
+    real_t Q[6][6];
+    vec_cons_mult(REAL(-1.0), &fu->bias, &nbias);
+    vec_sum(st->omega_est, nbias, &w);
+    eskf_integrate(st->q_est, w, dt, &q);
+    quat_normalize(&q, &st->q_est);
+    eskf_compute_error(w, dt, fu->P, Q);
+    SCH_PROF_END(PROF_ESKF_PREDICT);
+}
+
+/**
+ * Gyroscope, the estimate is predicted with the previous sample up to now
+ */
+static int _adcs_sample_gyro(adcs_state_t *st, adcs_fusion_t *fu, portTick now)
+{
+    _adcs_predict(st, fu, now);
+    return adcs_read_omega(&st->omega_est);
+}
+
+/**
+ * Magnetometer, ESKF update against the magnetic model
+ */
+static int _adcs_sample_mag(adcs_state_t *st, adcs_fusion_t *fu, portTick now)
+{
+    if(adcs_read_mag(&st->mag_est) != 0)
+        return -1;
+    if(!fu->mag_i_ok)
+        return 0;
+
+    vector3_t mag_b;
+    matrix3_t R;
+    if(!vec_normalize(&st->mag_est, &mag_b))
+        return -1;
+    _adcs_predict(st, fu, now);
+    SCH_PROF_BEGIN(PROF_ESKF_UPDATE);
+    eskf_update_mag(mag_b, fu->mag_i, fu->P, &R, &st->q_est, &fu->bias);
+    SCH_PROF_END(PROF_ESKF_UPDATE);
+    return 0;
+}
+
+/**
+ * Attitude quaternion from the ADCS/STT, resets the estimate
+ */
+static int _adcs_sample_stt(adcs_state_t *st, adcs_fusion_t *fu, portTick now)
+{
+    if(adcs_read_quaternion(&st->q_est) != 0)
+        return -1;
+    fu->t_predict = now;
+    return 0;
+}
+
+/**
+ * Sun direction and eclipse model, sun sensor
+ */
+static int _adcs_sample_sun(adcs_state_t *st, adcs_fusion_t *fu, portTick now)
+{
+    if(adcs_sun_update(&fu->sun, (int)dat_clock_utc(), &st->pos_i) == 0)
+        adcs_sun_publish(&fu->sun);
+#ifdef SCH_USE_GSSB
+    return gssb_read_all_sunsensors(&fu->sun_raw) < 0 ? -1 : 0;
+#endif
+    return 0;
+}
+
+#ifdef SCH_USE_RW
+/**
+ * Reaction wheels speed and current, one measurement each time
+ */
+static int _adcs_sample_rw(adcs_state_t *st, adcs_fusion_t *fu, portTick now)
+{
+    float speed[3], current[3];
+    int i;
+    for(i=0; i<3; i++)
+    {
+        speed[i] = (float)st->rw_speed.v[i];
+        current[i] = (float)st->rw_current.v[i];
+    }
+    int rc = rw_sample_step(speed, current);
+    for(i=0; i<3; i++)
+    {
+        st->rw_speed.v[i] = (real_t)speed[i];
+        st->rw_current.v[i] = (real_t)current[i];
+    }
+    return rc;
+}
+#endif
+
+/**
+ * Orbit position and magnetic model, inertial frame
+ */
+static int _adcs_sample_tle(adcs_state_t *st, adcs_fusion_t *fu, portTick now)
+{
+    dat_clock_t clock;
+    dat_clock_get(&clock);
+    int ts = (int)clock.utc;
+    double r[3], v[3];
+    if(ts == st->tle_last)
+        return 0;
+    if(obc_prop_tle_rv(ts, r, v) != 0)
+        return -1;
+    st->pos_i.v0 = r[0]; st->pos_i.v1 = r[1]; st->pos_i.v2 = r[2];
+    st->tle_last = ts;
+
+    if(SCH_ADCS_MAG_MS == 0)
+        return 0;
+    double jd = clock.jd;
+    vector3_t lat_lon_alt;
+    real_t mag_ned[3];
+    eci_to_geo(st->pos_i, jd, &lat_lon_alt);
+    calc_magnetic_model(clock.dec_year, lat_lon_alt.v0, lat_lon_alt.v1, lat_lon_alt.v2, mag_ned);
+    ned_to_eci(mag_ned, lat_lon_alt.v0, lat_lon_alt.v1 + gstime(jd), &fu->mag_i);
+    fu->mag_i_ok = 1;
+    return 0;
+}
+
+/**
+ * Take a sensor sample if it is due. Samples are scheduled every period from
+ * the previous schedule, a late sensor skips the lost samples.
+ */
+static void _adcs_sensor_run(adcs_sensor_t *sensor, adcs_state_t *st, adcs_fusion_t *fu)
+{
+    portTick now = osTaskGetTickCount();
+    portTick period = osDefineTime(sensor->period_ms);
+    if(sensor->period_ms == 0 || (int32_t)(now - sensor->next) < 0)
+        return;
+
+    sensor->next += period;
+    if((int32_t)(now - sensor->next) >= 0)
+        sensor->next = now + period;
+
+    if(sensor->sample(st, fu, now) == 0)
+        sensor->last = now;
+    else
+        LOGW(tag, "Sensor %s sample failed", sensor->name);
+}
+
+/**
+ * ADCS rates self-calibration (SCH_ADCS_BUDGET). The loop runs the estimate
+ * every est_ms and the control every ctrl_ms, the work time of both steps is
+ * measured over a SCH_ADCS_CALIB_MS window.
+ */
+typedef struct adcs_rate {
+    uint32_t est_ms;        ///< Estimate period, the loop period [ms]
+    uint32_t ctrl_ms;       ///< Control period, multiple of est_ms [ms]
+    uint32_t load;          ///< Utilization in the last window [0.1 %]
+    uint64_t est_sum_us;    ///< Estimate work time in the window [us]
+    uint64_t ctrl_sum_us;   ///< Control work time in the window [us]
+    uint32_t est_n;         ///< Estimate steps in the window
+    uint32_t ctrl_n;        ///< Control steps in the window
+    unsigned int window;    ///< Window start, loop time [ms]
+} adcs_rate_t;
+
+#if SCH_ADCS_BUDGET > 0
+/**
+ * Loop utilization with the given mean steps work times and periods, in
+ * 0.1 % (us of work per ms)
+ */
+static uint32_t _adcs_rate_load(uint32_t est_us, uint32_t ctrl_us, uint32_t est_ms, uint32_t ctrl_ms)
+{
+    return (est_us + est_ms - 1)/est_ms + (ctrl_us + ctrl_ms - 1)/ctrl_ms;
+}
+
+/**
+ * Find the fastest rates with a utilization under @budget (0.1 %). The
+ * control rate is chosen first, from SCH_ADCS_CTRL_MS in steps of
+ * SCH_ADCS_CTRL_MS, then the fastest estimate rate that divides it.
+ * @return 0 if found, -1 if the budget can't be met and the slowest rates are
+ * set
+ */
+static int _adcs_rate_choose(uint32_t est_us, uint32_t ctrl_us, uint32_t budget, uint32_t *est_ms, uint32_t *ctrl_ms)
+{
+    uint32_t ctrl, div;
+    for(ctrl = SCH_ADCS_CTRL_MS; ctrl <= SCH_ADCS_CTRL_MAX_MS; ctrl += SCH_ADCS_CTRL_MS)
+    {
+        for(div = ctrl/SCH_ADCS_EST_MIN_MS; div >= 1; div--)
+        {
+            if(ctrl % div != 0 || _adcs_rate_load(est_us, ctrl_us, ctrl/div, ctrl) > budget)
+                continue;
+            *est_ms = ctrl/div;
+            *ctrl_ms = ctrl;
+            return 0;
+        }
+    }
+    *est_ms = *ctrl_ms = SCH_ADCS_CTRL_MAX_MS;
+    return -1;
+}
+
+#endif
+
+/**
+ * Publish the rates in use and the utilization
+ */
+static void _adcs_rate_publish(const adcs_rate_t *rt)
+{
+    value32_t v[dat_ads_load-dat_ads_est_ms+1];
+    v[dat_ads_est_ms-dat_ads_est_ms].u = rt->est_ms;
+    v[dat_ads_ctrl_ms-dat_ads_est_ms].u = rt->ctrl_ms;
+    v[dat_ads_load-dat_ads_est_ms].f = (float)rt->load/10.0f;
+    dat_set_status_vars(dat_ads_est_ms, dat_ads_load-dat_ads_est_ms+1, v);
+}
+
+#if SCH_ADCS_BUDGET > 0
+/**
+ * Choose the rates for the work times measured in the window, then start a
+ * new window. Rates are slowed down at once if the utilization is over the
+ * budget, as when other tasks preempt the loop, but only sped up if the faster
+ * rates keep a margin of a quarter of the budget, so they do not oscillate.
+ * @return 1 if the rates changed, 0 if not
+ */
+static int _adcs_rate_update(adcs_rate_t *rt, unsigned int now_ms)
+{
+    uint32_t est_us = rt->est_n > 0 ? (uint32_t)(rt->est_sum_us/rt->est_n) : 0;
+    uint32_t ctrl_us = rt->ctrl_n > 0 ? (uint32_t)(rt->ctrl_sum_us/rt->ctrl_n) : 0;
+    uint32_t budget = SCH_ADCS_BUDGET*10;
+    uint32_t est_ms = rt->est_ms, ctrl_ms = rt->ctrl_ms;
+    rt->load = _adcs_rate_load(est_us, ctrl_us, rt->est_ms, rt->ctrl_ms);
+
+    if(rt->load > budget)
+    {
+        if(_adcs_rate_choose(est_us, ctrl_us, budget, &est_ms, &ctrl_ms) != 0 && ctrl_ms != rt->ctrl_ms)
+            LOGW(tag, "Over the CPU budget (%u.%u %%), using the slowest rates", rt->load/10, rt->load%10);
+    }
+    else if(_adcs_rate_choose(est_us, ctrl_us, budget*3/4, &est_ms, &ctrl_ms) != 0 ||
+            ctrl_ms > rt->ctrl_ms || (ctrl_ms == rt->ctrl_ms && est_ms >= rt->est_ms))
+    {
+        est_ms = rt->est_ms;
+        ctrl_ms = rt->ctrl_ms;
+    }
+
+    int changed = est_ms != rt->est_ms || ctrl_ms != rt->ctrl_ms;
+    if(changed)
+    {
+        LOGI(tag, "Estimate %u us, control %u us: periods %u/%u ms to %u/%u ms", est_us, ctrl_us,
+             rt->est_ms, rt->ctrl_ms, est_ms, ctrl_ms);
+        rt->est_ms = est_ms;
+        rt->ctrl_ms = ctrl_ms;
+    }
+    rt->est_sum_us = rt->ctrl_sum_us = 0;
+    rt->est_n = rt->ctrl_n = 0;
+    rt->window = now_ms;
+    return changed;
+}
+#endif
+
+/**
+ * ADCS in-process loop. Estimation, guidance and control are direct calls
+ * over the adcs_state_t owned by this task. It is stored in the ADCS state
+ * block every cycle and mirrored to the status variables every
+ * SCH_ADCS_PUBLISH_MS. Each sensor is sampled at its own rate
+ * (SCH_ADCS_*_MS) and the estimate is predicted to every sample time.
+ * Commands are sent with cmd_try_send, so a full dispatcher queue never
+ * blocks the loop.
+ *
+ * The estimate runs every loop and the control every few loops. With
+ * SCH_ADCS_BUDGET both periods start at SCH_ADCS_CTRL_MS and are adapted to
+ * the measured cost of each step (@see _adcs_rate_update), so the same build
+ * runs at the fastest rates that the hardware and the current load allow.
+ */
+static void _adcs_engine_loop(void)
+{
+    adcs_rate_t rt;
+    memset(&rt, 0, sizeof(rt));
+    rt.est_ms = rt.ctrl_ms = SCH_ADCS_CTRL_MS;
+    unsigned int elapsed_msec = 0;
+    unsigned int ctrl_msec = 0;                 // Time since the last control
+    unsigned int next_publish = SCH_ADCS_PUBLISH_MS;
+    unsigned int _1hour_check = 60*60*1000;     // 01[h] condition
+    unsigned int next_1hour = _1hour_check;
+    int cmd_1h_id = cmd_resolve("drp_add_hrs_alive");
+    int i;
+
+    adcs_state_t st;
+    adcs_state_load(&st);
+    adcs_ctrl_t ctrl;
+    memset(&ctrl, 0, sizeof(ctrl));
+
+    adcs_fusion_t fu;
+    memset(&fu, 0, sizeof(fu));
+    fu.sun.sunlit = REAL(1.0);
+    _mat_set_diag((real_t*)fu.P, REAL(1.0), 6, 6);
+
+    // Position first, it is used by the magnetic model
+    adcs_sensor_t sensors[] = {
+        {"tle", SCH_ADCS_TLE_MS, _adcs_sample_tle},
+        {"stt", SCH_ADCS_STT_MS, _adcs_sample_stt},
+        {"gyro", SCH_ADCS_GYRO_MS, _adcs_sample_gyro},
+        {"mag", SCH_ADCS_MAG_MS, _adcs_sample_mag},
+        {"sun", SCH_ADCS_SUN_MS, _adcs_sample_sun},
+#ifdef SCH_USE_RW
+        {"rw", SCH_ADCS_RW_MS, _adcs_sample_rw}
+#endif
+    };
+    int n_sensors = sizeof(sensors)/sizeof(sensors[0]);
+
+    portTick now = osTaskGetTickCount();
+    portTick t_ctrl = now;
+    fu.t_predict = now;
+    for(i=0; i<n_sensors; i++)
+        sensors[i].next = sensors[i].last = now;
+
+    osPeriodInit(&adcs_period, "ADCS", rt.est_ms);
+    _adcs_rate_publish(&rt);
+
+    while(1)
+    {
+        osPeriodDelay(&adcs_period); //Suspend task
+        elapsed_msec += rt.est_ms;
+        ctrl_msec += rt.est_ms;
+
+        /**
+         * Estimate: sensors due this cycle, then predict to the current time
+         */
+        uint32_t t_est = prof_now_us();
+        for(i=0; i<n_sensors; i++)
+            _adcs_sensor_run(&sensors[i], &st, &fu);
+        now = osTaskGetTickCount();
+        _adcs_predict(&st, &fu, now);
+        uint32_t t_ctrl_us = prof_now_us();
+        rt.est_sum_us += t_ctrl_us - t_est;
+        rt.est_n++;
+
+        if(ctrl_msec >= rt.ctrl_ms)
+        {
+            ctrl_msec = 0;
+
+            /**
+             * Guidance
+             */
+            st.mode = _adcs_opmode();
+            if(st.mode == DAT_OBC_OPMODE_REF_POINT)
+            {
+                vector3_t i_tar = {1.0, 1.0, 1.0};
+                vector3_t omega_tar = {0.01, 0.01, 0.01};
+                adcs_calc_target(&st, i_tar, omega_tar);
+            }
+            else if(st.mode == DAT_OBC_OPMODE_NAD_POINT)
+                adcs_calc_nadir(&st);
+            else if(st.mode == DAT_OBC_OPMODE_DETUMB_MAG)
+                adcs_calc_detumbling(&st);
+
+            /**
+             * Control
+             */
+            adcs_ctrl_update(&ctrl, st.mode);
+            if(st.mode == DAT_OBC_OPMODE_DETUMB_MAG)
+            {
+                adcs_calc_mag_moment(&st, &ctrl);
+                adcs_send_mag_moment(&st.mag_moment);
+            }
+            else
+            {
+                adcs_calc_torque(&st, &ctrl, _adcs_dt(t_ctrl, now));
+                adcs_send_torque(&st.torque);
+            }
+            t_ctrl = now;
+            adcs_send_attitude_q(&st.q_est, &st.q_tgt);
+            rt.ctrl_sum_us += prof_now_us() - t_ctrl_us;
+            rt.ctrl_n++;
+        }
+
+        /* Store the state block, mirror it to the status variables */
+        adcs_state_store(&st);
+        if((int)(elapsed_msec - next_publish) >= 0)
+        {
+            adcs_state_publish(&st);
+            next_publish += SCH_ADCS_PUBLISH_MS;
+        }
+
+#if SCH_ADCS_BUDGET > 0
+        /* Adapt the rates to the work times measured in the window */
+        if(elapsed_msec - rt.window >= SCH_ADCS_CALIB_MS)
+        {
+            if(_adcs_rate_update(&rt, elapsed_msec))
+                osPeriodSet(&adcs_period, rt.est_ms);
+            _adcs_rate_publish(&rt);
+        }
+#endif
+
+        /* 1 hours actions */
+        if((int)(elapsed_msec - next_1hour) >= 0)
+        {
+            LOGD(tag, "1 hour check");
+            cmd_t *cmd_1h = cmd_get_idx(cmd_1h_id);
+            cmd_add_params_var(cmd_1h, 1); // Add 1hr
+            cmd_try_send(cmd_1h);
+            next_1hour += _1hour_check;
+        }
+    }
+}
+
+/**
+ * ADCS loop sending the ADCS commands each control cycle. Commands are sent
+ * with cmd_try_send, a command dropped because the dispatcher queue is full
+ * is sent again the next cycle.
+ */
+static void _adcs_cmd_loop(void)
+{
     portTick delay_ms  = 100;            //Task period in [ms]
 
 //    unsigned int elapsed_sec = 0;           // Seconds counter
@@ -36,29 +535,28 @@ void taskADCS(void *param)
     unsigned int _05min_check = 5*60*1000;       // 05[m] condition
     unsigned int _1hour_check = 60*60*1000;      // 01[h] condition
 
-    portTick xLastWakeTime = osTaskGetTickCount();
-
-    /**
-     * Set-up SGP4 propagator
-     */
-    cmd_t *tle1 = cmd_get_str("obc_set_tle");
-    cmd_add_params_str(tle1, "1 42788U 17036Z   20027.14771603  .00000881  00000-0  39896-4 0  9992");
-    cmd_send(tle1);
-    cmd_t *tle2 = cmd_get_str("obc_set_tle");
-    cmd_add_params_str(tle2, "2 42788  97.3234  85.2817 0012095 159.3521 200.8207 15.23399088144212");
-    cmd_send(tle2);
-    cmd_t *tle_u = cmd_get_str("obc_update_tle");
-    cmd_send(tle_u);
-    tle_u = cmd_get_str("obc_get_tle");
-    cmd_send(tle_u);
-    dat_set_system_var(dat_obc_opmode, DAT_OBC_OPMODE_DETUMB_MAG);
-
-    double P[6][6];
-    _mat_set_diag((double*)P, 1.0,6, 6);
+    osPeriodInit(&adcs_period, "ADCS", delay_ms);
+
+    /* Resolve periodic commands once */
+    int cmd_tle_prop_id = cmd_resolve("obc_prop_tle");
+    int cmd_stt_id = cmd_resolve("adcs_quat");
+    int cmd_acc_id = cmd_resolve("adcs_acc");
+    int cmd_mag_id = cmd_resolve("adcs_mag");
+    int cmd_target_id = cmd_resolve("adcs_set_target");
+    int cmd_nadir_id = cmd_resolve("adcs_set_to_nadir");
+    int cmd_detumb_id = cmd_resolve("adcs_detumbling_mag");
+    int cmd_mag_moment_id = cmd_resolve("adcs_mag_moment");
+    int cmd_ctrl_id = cmd_resolve("adcs_do_control");
+    int cmd_att_id = cmd_resolve("adcs_send_attitude");
+    int cmd_sun_id = cmd_resolve("adcs_sun");
+    int cmd_1h_id = cmd_resolve("drp_add_hrs_alive");
+
+    real_t P[6][6];
+    _mat_set_diag((real_t*)P, 1.0,6, 6);
 
     while(1)
     {
-        osTaskDelayUntil(&xLastWakeTime, delay_ms); //Suspend task
+        osPeriodDelay(&adcs_period); //Suspend task
         elapsed_msec += delay_ms;
 
         /**
@@ -71,13 +569,12 @@ void taskADCS(void *param)
             if(elapsed_msec % 500 == 0)
             {
 
-                cmd_t *cmd_tle_prop = cmd_get_str("obc_prop_tle");
+                cmd_t *cmd_tle_prop = cmd_get_idx(cmd_tle_prop_id);
                 cmd_add_params_str(cmd_tle_prop, "0");
-                cmd_send(cmd_tle_prop);
-
-                vector3_t r;
-                _get_sat_vector(&r, dat_ads_pos_x);
+                cmd_try_send(cmd_tle_prop);
 
+                adcs_state_t st;
+                adcs_state_load(&st);
 
                 // Update magnetic
                 matrix3_t R;
@@ -86,94 +583,100 @@ void taskADCS(void *param)
                 // TODO: get value from magnetic model
                 vector3_t mag_i = {6723.12366721, 10229.07189747, 15710.68799647};
 
-                quaternion_t q_est;
-                _get_sat_quaterion(&q_est, dat_ads_q0);
-
-                vector3_t w;
-                _get_sat_vector(&w, dat_ads_omega_x);
+                quaternion_t q_est = st.q_est;
+                vector3_t w = st.omega_est;
 
                 // Calculate sun direction
-                uint32_t curr_time = (uint32_t) time(NULL);
-                double jd = unixt_to_jd(curr_time);
-                LOGD(tag, "julian day: %f", jd);
-                vector3_t  sun_dir;
-                calc_sun_pos_i(jd, &sun_dir);
-                LOGD(tag, "sun direction: (%f, %f, %f)", sun_dir.v0, sun_dir.v1, sun_dir.v2);
+                dat_clock_t clock;
+                dat_clock_get(&clock);
+                LOGD(tag, "julian day: %f", clock.jd);
+
+                // Update sun direction and eclipse, the sun ephemeris is cached
+                cmd_t *cmd_sun = cmd_get_idx(cmd_sun_id);
+                cmd_try_send(cmd_sun);
 
                 //  Calculate Magnetic Model
-                double dec_year = jd_to_dec(jd);
+                double dec_year = clock.dec_year;
 //                calc_magnetic_model(dec_year, )
 
                 // TODO: call function separately with its own mesuerement freq
 //                eskf_update_mag(mag_sensor, mag_i, P, &R, &q_est, &w);
-                _set_sat_quaterion(&q_est, dat_ads_q0);
-                _set_sat_vector(&w, dat_ads_omega_x);
+                adcs_state_load(&st);
+                st.q_est = q_est;
+                st.omega_est = w;
+                adcs_state_store(&st);
             }
         }
 
-        /* 1 second actions */
-        dat_set_system_var(dat_rtc_date_time, (int) time(NULL));
         /**
          * Control LOOP
          */
         if ((elapsed_msec % _adcs_ctrl_period) == 0)
         {
-            cmd_t *cmd_tle_prop = cmd_get_str("obc_prop_tle");
+            cmd_t *cmd_tle_prop = cmd_get_idx(cmd_tle_prop_id);
             cmd_add_params_str(cmd_tle_prop, "0");
-            cmd_send(cmd_tle_prop);
+            cmd_try_send(cmd_tle_prop);
             // Update attitude
-            cmd_t *cmd_stt = cmd_get_str("adcs_quat");
-            cmd_send(cmd_stt);
-            cmd_t *cmd_acc = cmd_get_str("adcs_acc");
-            cmd_send(cmd_acc);
-            cmd_t *cmd_mag = cmd_get_str("adcs_mag");
-            cmd_send(cmd_mag);
+            cmd_t *cmd_stt = cmd_get_idx(cmd_stt_id);
+            cmd_try_send(cmd_stt);
+            cmd_t *cmd_acc = cmd_get_idx(cmd_acc_id);
+            cmd_try_send(cmd_acc);
+            cmd_t *cmd_mag = cmd_get_idx(cmd_mag_id);
+            cmd_try_send(cmd_mag);
             // Set target attitude
             //cmd_t *cmd_point = cmd_get_str("sim_adcs_set_target");
             //cmd_add_params_var(cmd_point, 1.0, 1.0, 1.0, 0.01, 0.01, 0.01);
             int mode;
-            mode = dat_get_system_var(dat_obc_opmode);
-            cmd_t *cmd_point;
+            mode = _adcs_opmode();
+            cmd_t *cmd_point = NULL;
             if(mode == DAT_OBC_OPMODE_REF_POINT)
             {
-                cmd_point = cmd_get_str("adcs_set_target");
-                cmd_add_params_var(cmd_point, 1.0, 1.0, 1.0, 0.01, 0.01, 0.01);
+                cmd_point = cmd_get_idx(cmd_target_id);
+                cmd_add_params_bin(cmd_point, 1.0, 1.0, 1.0, 0.01, 0.01, 0.01);
             } else if(mode == DAT_OBC_OPMODE_NAD_POINT)
             {
-                cmd_point = cmd_get_str("adcs_set_to_nadir");
+                cmd_point = cmd_get_idx(cmd_nadir_id);
             } else if(mode == DAT_OBC_OPMODE_DETUMB_MAG)
             {
-                cmd_point = cmd_get_str("adcs_detumbling_mag");
+                cmd_point = cmd_get_idx(cmd_detumb_id);
             }
-            cmd_send(cmd_point);
+            cmd_try_send(cmd_point);
             // Do control loop
             cmd_t *cmd_ctrl;
             if(mode == DAT_OBC_OPMODE_DETUMB_MAG)
             {
-                cmd_ctrl = cmd_get_str("adcs_mag_moment");
+                cmd_ctrl = cmd_get_idx(cmd_mag_moment_id);
             } else
             {
-                cmd_ctrl = cmd_get_str("adcs_do_control");
-                cmd_add_params_var(cmd_ctrl, _adcs_ctrl_period * 1000);
+                cmd_ctrl = cmd_get_idx(cmd_ctrl_id);
+                cmd_add_params_bin(cmd_ctrl, (double)_adcs_ctrl_period * 1000);
             }
-            cmd_send(cmd_ctrl);
+            cmd_try_send(cmd_ctrl);
             // Send telemetry to ADCS subsystem
-            cmd_t *cmd_att = cmd_get_str("adcs_send_attitude");
-            cmd_send(cmd_att);
+            cmd_t *cmd_att = cmd_get_idx(cmd_att_id);
+            cmd_try_send(cmd_att);
+        }
+
+        /* Mirror the state block, updated by the commands, to the status variables */
+        if((elapsed_msec % SCH_ADCS_PUBLISH_MS) == 0)
+        {
+            adcs_state_t st;
+            adcs_state_load(&st);
+            adcs_state_publish(&st);
         }
 
         /* 1 hours actions */
         if((elapsed_msec % _1hour_check) == 0)
         {
             LOGD(tag, "1 hour check");
-            cmd_t *cmd_1h = cmd_get_str("drp_add_hrs_alive");
+            cmd_t *cmd_1h = cmd_get_idx(cmd_1h_id);
             cmd_add_params_var(cmd_1h, 1); // Add 1hr
-            cmd_send(cmd_1h);
+            cmd_try_send(cmd_1h);
         }
     }
 }
 
-void eskf_predict_state(double* P, double dt)
+void eskf_predict_state(real_t* P, real_t dt)
 {
     LOGD(tag, "Kalman Estimate")
     // Predict Nominal
@@ -182,53 +685,31 @@ void eskf_predict_state(double* P, double dt)
     vector3_t w;
     vector3_t wb = {0.0, 0.0, 0.0};
     vector3_t diffw;
-    _get_sat_quaterion(&q, dat_ads_q0);
-    _get_sat_vector(&w, dat_ads_omega_x);
+    adcs_state_t st;
+    adcs_state_load(&st);
+    q = st.q_est;
+    w = st.omega_est;
 
     quaternion_t q_est;
     vec_cons_mult(-1.0, &wb, NULL);
     vec_sum(w, wb, &diffw);
     eskf_integrate(q, diffw, dt, &q_est);
-    _set_sat_quaterion(&q_est, dat_ads_q0);
-//    _set_sat_vector(&w, dat_ads_omega_x);
+    st.q_est = q_est;
+    adcs_state_store(&st);
 
     // Predict Error
-    double Q[6][6];
-    _mat_set_diag(Q, 1.0,6, 6);
-    eskf_compute_error(diffw, dt, P, Q);
-}
-
-void calc_magnetic_model(double decyear, double latrad, double lonrad, double altm, double* mag) {
-    IgrfCalc(decyear, latrad, lonrad, altm, mag);
-    LOGI(tag, "Magnetic field is (%f, %f, %f)", mag[0], mag[1], mag[2]);
+    real_t Q[6][6];
+    _mat_set_diag((real_t*)Q, 1.0,6, 6);
+    eskf_compute_error(diffw, dt, (real_t (*)[6])P, Q);
 }
 
-void calc_sun_pos_i(double jd, vector3_t * sun_dir) {
-
-    // all in degree
-//    jd = 2459346.3905324074;
-    double au = 149597870.691e3;
-    double n = jd - 2451545.0;
-    double l = (280.459 + 0.98564736 * n); //% 360
-    double m = (357.529 + 0.98560023 * n); //% 360.0
-    m *= deg2rad;
-    double lam = (l + 1.915 * sin(m) + 0.0200 * sin(2 * m)); // % 360.0
-    lam *= deg2rad;
-    double e = 23.439 - 3.56e-7 * n;
-    e *= deg2rad;
-
-    double r_sun = (1.00014 - 0.01671 * cos(m) - 0.000140 * cos(2 * m)) * au;
-
-    sun_dir->v0 = cos(lam);
-    sun_dir->v1 =  cos(e) * sin(lam);
-    sun_dir->v2 = sin(lam) * sin(e);
-//    float u_v = np.array([np.cos(lam), np.cos(e) * np.sin(lam), np.sin(lam) * np.sin(e)])
-//    vec_cons_mult(r_sun, &u_v, sun_dir);
+void calc_magnetic_model(double decyear, double latrad, double lonrad, double altm, real_t* mag) {
+    double _mag[3];
+    IgrfCalc(decyear, latrad, lonrad, altm, _mag);
+    mag[0] = _mag[0]; mag[1] = _mag[1]; mag[2] = _mag[2];
+    LOGD(tag, "Magnetic field is (%f, %f, %f)", mag[0], mag[1], mag[2]);
 }
 
-
-
-
 double fmod2p(double x)
 {
     /* Returns mod 2PI of argument */
@@ -246,34 +727,6 @@ double fmod2p(double x)
     return ret_val;
 }
 
-double jd_to_dec(double jd)
-{
-    double decyear;
-    int leapyrs, year;
-    double    days, tu, temp;
-
-    /* --------------- find year and days of the year --------------- */
-    temp    = jd - 2415019.5;
-    tu      = temp / 365.25;
-    year    = 1900 + (int)floor(tu);
-    leapyrs = (int)floor((year - 1901) * 0.25);
-
-    // optional nudge by 8.64x10-7 sec to get even outputs
-    days    = temp - ((year - 1900) * 365.0 + leapyrs) + 0.00000000001;
-
-    /* ------------ check for case of beginning of a year ----------- */
-    if (days < 1.0)
-    {
-        year    = year - 1;
-        leapyrs = (int)floor((year - 1901) * 0.25);
-        days    = temp - ((year - 1900) * 365.0 + leapyrs);
-    }
-
-    decyear = year + days/365.25;
-    return decyear;
-}
-
-
 int eci_to_geo(vector3_t sat_pos, double current_jd, vector3_t * lat_lon_alt) {
     double radiusearthkm = 6378.137;     // km
     double f = 1.0 / 298.257223563;
@@ -293,10 +746,10 @@ int eci_to_geo(vector3_t sat_pos, double current_jd, vector3_t * lat_lon_alt) {
     {
         phi = lat_rad_;
         c = 1 / sqrt(1 - e2*sin(phi)*sin(phi));
-        lat_rad_ = atan2(sat_pos.v2 + radiusearthkm*c*e2*sin(phi) * 1000, r);
+        lat_rad_ = atan2(sat_pos.v2 + radiusearthkm*c*e2*sin(phi), r);
 
     } while (fabs(lat_rad_ - phi) >= 1E-10);
-    double alt_m_ = r / cos(lat_rad_) - radiusearthkm*c * 1000; /* kilometers */	//楕円体高さ
+    double alt_m_ = (r / cos(lat_rad_) - radiusearthkm*c) * 1000; /* meters */
 
     if (lat_rad_ > pi/2.0)
         lat_rad_ -= twopi;
@@ -304,11 +757,17 @@ int eci_to_geo(vector3_t sat_pos, double current_jd, vector3_t * lat_lon_alt) {
     lat_lon_alt->v0 = lat_rad_;
     lat_lon_alt->v1 = lon_rad_;
     lat_lon_alt->v2 = alt_m_;
+    return 0;
 }
 
-
-double unixt_to_jd(uint32_t unix_time) {
-    return ( unix_time / 86400.0 ) + 2440587.5;
+void ned_to_eci(const real_t *ned, double latrad, double lonrad, vector3_t *eci)
+{
+    double slat = sin(latrad), clat = cos(latrad);
+    double slon = sin(lonrad), clon = cos(lonrad);
+    // Columns are the north, east and down directions
+    eci->v0 = -slat*clon*ned[0] - slon*ned[1] - clat*clon*ned[2];
+    eci->v1 = -slat*slon*ned[0] + clon*ned[1] - clat*slon*ned[2];
+    eci->v2 = clat*ned[0] - slat*ned[2];
 }
 
 
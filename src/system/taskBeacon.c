@@ -0,0 +1,70 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define LOG_TAG_ID LOG_TAG_TM
+#include "taskBeacon.h"
+
+static const char *tag = "Beacon";
+static osPeriod bcn_period;     ///< Loop timing (see obc_task_stats)
+
+#define BCN_NODE (10)           ///< Beacon destination node
+
+/* Beacon period, updated when dat_com_bcn_period changes (see dat_subscribe) */
+static volatile int bcn_period_s;
+
+static void _bcn_period_changed(dat_status_address_t index, value32_t value, void *arg)
+{
+    bcn_period_s = value.i;
+}
+
+void taskBeacon(void *param)
+{
+    LOGI(tag, "Started");
+
+    /* Get the beacon period, then follow its changes instead of polling it */
+    int bcn_sub = dat_subscribe(dat_com_bcn_period, _bcn_period_changed, NULL, NULL, 0);
+    bcn_period_s = dat_get_system_var(dat_com_bcn_period);
+    int last_period = bcn_period_s;
+    int countdown = last_period;
+
+    osPeriodInit(&bcn_period, "Beacon", 1000);
+    while(1)
+    {
+        osPeriodDelay(&bcn_period);
+
+        /* Send the prebuilt beacon */
+        int curr_period = bcn_sub >= 0 ? bcn_period_s : (int)dat_get_system_var(dat_com_bcn_period);
+        if(curr_period != last_period)
+        {
+            countdown = curr_period;
+            last_period = curr_period;
+        }
+        countdown--;
+        if(countdown < 0)
+        {
+            if(tm_send_status_node(BCN_NODE) != CMD_OK)
+                LOGW(tag, "Unable to send the beacon");
+            countdown = curr_period;
+        }
+
+        /* Build the next beacon, just before it is due or every
+         * SCH_TM_BCN_BUILD_S for the beacons requested with tm_send_status */
+        tm_bcn_build(countdown <= 0 ? 0 : SCH_TM_BCN_BUILD_S);
+    }
+}
@@ -17,26 +17,46 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_TAG_ID LOG_TAG_COM
 #include "taskCommunications.h"
 
 static const char *tag = "Communications";
 
-static void com_receive_tc(csp_packet_t *packet);
-static void com_receive_cmd(csp_packet_t *packet);
-static void com_receive_tm(csp_packet_t *packet);
+static uint8_t com_receive_tc(csp_packet_t *packet, uint32_t timeout, portTick t_rx);
+static uint8_t com_receive_tc_bin(csp_packet_t *packet, uint32_t timeout, portTick t_rx);
+static uint8_t com_receive_cmd(csp_packet_t *packet, uint32_t timeout, portTick t_rx);
+static int com_receive_tm(csp_packet_t *packet, int own);
+static void com_print_binary_log(csp_packet_t *packet);
+static void com_handle_conn(csp_conn_t *conn, uint32_t timeout);
+static void com_send_ack(csp_conn_t *conn, uint8_t code);
+#ifdef LINUX
+static uint8_t com_receive_prof(csp_packet_t *packet, uint8_t node);
+static uint8_t com_receive_ack(csp_packet_t *packet);
+#endif
+
+static osQueue com_bulk_queue;     ///< Bulk connections waiting for a worker
+static osSemaphore com_count_sem;  ///< Protects the TC counters updated by every worker
+
+/**
+ * Check if a connection carries commands from the ground. These connections
+ * are handled by taskCommunications, bulk traffic (TM, files, repeater,
+ * services) is handed to the taskCommunicationsWorker pool so a slow stream
+ * never delays a TC.
+ */
+static int com_is_control_port(uint8_t port)
+{
+    return port == SCH_TRX_PORT_TC || port == SCH_TRX_PORT_TC_BIN ||
+           port == SCH_TRX_PORT_CMD || port == SCH_TRX_PORT_DBG ||
+           port == SCH_TRX_PORT_ACK;
+}
 
 void taskCommunications(void *param)
 {
     LOGI(tag, "Started");
     int rc;
 
-    /* Pointer to current connection, packet and socket */
+    /* Pointer to current connection and socket */
     csp_conn_t *conn;
-    csp_packet_t *packet;
-    csp_packet_t *tmp_packet;
-    csp_packet_t *rep_ok_tmp;
-    csp_packet_t *rep_ok;
-    com_frame_t *rcv_frame;
 
     csp_socket_t *sock = csp_socket(CSP_SO_NONE);
     if((rc = csp_bind(sock, CSP_ANY)) != CSP_ERR_NONE)
@@ -50,11 +70,24 @@ void taskCommunications(void *param)
         return;
     }
 
-    rep_ok_tmp = csp_buffer_get(1);
-    rep_ok_tmp->data[0] = 200;
-    rep_ok_tmp->length = 1;
-
-    int count_tc;
+    if(osSemaphoreCreate(&com_count_sem) != OS_SEMAPHORE_OK)
+        LOGE(tag, "Error creating the TC counters mutex");
+
+    /* Bulk connections workers, without workers every port is handled here */
+#if SCH_TASK_COM_WORKERS > 0
+    com_bulk_queue = osQueueCreateType(SCH_COM_BULK_QUEUE_LEN, sizeof(csp_conn_t *), OS_QUEUE_MPMC);
+    if(com_bulk_queue == 0)
+        LOGE(tag, "Error creating the bulk connections queue");
+    osQueueSetName(com_bulk_queue, "com_bulk");
+    int i;
+    os_thread workers_id[SCH_TASK_COM_WORKERS];
+    const osTaskProfile bg_profile = {2, OS_SCHED_FIFO, SCH_TASK_BG_CPUS};
+    for(i=0; i<SCH_TASK_COM_WORKERS && com_bulk_queue != 0; i++)
+    {
+        if(osCreateTaskProfile(taskCommunicationsWorker, "comm_bulk", SCH_TASK_COM_STACK, NULL, &bg_profile, &workers_id[i]) != 0)
+            LOGE(tag, "Task comm_bulk %d not created!", i);
+    }
+#endif
 
     while(1)
     {
@@ -63,97 +96,332 @@ void taskCommunications(void *param)
         if((conn = csp_accept(sock, 1000)) == NULL)
             continue; /* Try again later */
 
-        /* Read packets. Timeout is 500 ms */
-        while ((packet = csp_read(conn, 500)) != NULL)
+        /* Commands are read here, the rest go to the workers. If the workers
+         * are busy the connection is handled here as before */
+        if(com_bulk_queue != 0 && !com_is_control_port(csp_conn_dport(conn)))
         {
-            count_tc = dat_get_system_var(dat_com_count_tc) + 1;
-            dat_set_system_var(dat_com_count_tc, count_tc);
-            dat_set_system_var(dat_com_last_tc, (int) time(NULL));
-
-            switch (csp_conn_dport(conn))
-            {
-                case SCH_TRX_PORT_TC:
-                    // Create a response packet and send
-                    rep_ok = csp_buffer_clone(rep_ok_tmp);
-                    csp_send(conn, rep_ok, 1000);
-                    /* Process incoming TC */
-                    com_receive_tc(packet);
+            if(osQueueSend(com_bulk_queue, &conn, 0) == pdPASS)
+                continue;
+            LOGW(tag, "Communication workers busy, port %d handled inline", csp_conn_dport(conn));
+        }
+
+        com_handle_conn(conn, SCH_COM_TC_READ_MS);
+    }
+}
+
+void taskCommunicationsWorker(void *param)
+{
+    LOGI(tag, "Worker started");
+    csp_conn_t *conn;
+
+    while(1)
+    {
+        if(osQueueReceive(com_bulk_queue, &conn, portMAX_DELAY) == pdPASS)
+            com_handle_conn(conn, SCH_COM_BULK_READ_MS);
+    }
+}
+
+int com_receive_packet(csp_packet_t *packet, uint8_t port)
+{
+    switch(port)
+    {
+        case SCH_TRX_PORT_TC:
+            com_receive_tc(packet, 0, osTaskGetTickCount());
+            return 0;
+        case SCH_TRX_PORT_TC_BIN:
+            com_receive_tc_bin(packet, 0, osTaskGetTickCount());
+            return 0;
+        case SCH_TRX_PORT_CMD:
+            com_receive_cmd(packet, 0, osTaskGetTickCount());
+            return 0;
+        case SCH_TRX_PORT_TM:
+            com_receive_tm(packet, 0);
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+/**
+ * Read the packets of a connection until @timeout ms pass without new packets,
+ * process them according to the destination port and close the connection.
+ *
+ * @param conn Accepted CSP connection
+ * @param timeout Read timeout in ms
+ */
+static void com_handle_conn(csp_conn_t *conn, uint32_t timeout)
+{
+#ifdef SCH_RESEND_TM_NODE
+    int rc;
+#endif
+    csp_packet_t *packet;
+    com_frame_t *rcv_frame;
+
+    /* Read packets */
+    while ((packet = csp_read(conn, timeout)) != NULL)
+    {
+        portTick t_rx = osTaskGetTickCount(); // Start of the TC latency traces
+        osSemaphoreTake(&com_count_sem, portMAX_DELAY);
+        int count_tc = dat_get_system_var(dat_com_count_tc) + 1;
+        dat_set_system_var(dat_com_count_tc, count_tc);
+        dat_set_system_var(dat_com_last_tc, (int)dat_clock_utc());
+        osSemaphoreGiven(&com_count_sem);
+
+        switch (csp_conn_dport(conn))
+        {
+            case SCH_TRX_PORT_TC:
+                // Process incoming TC and reply the results
+                com_send_ack(conn, com_receive_tc(packet, SCH_COM_TC_WAIT_MS, t_rx));
+                csp_buffer_free(packet);
+                break;
+
+            case SCH_TRX_PORT_TC_BIN:
+                // Process incoming binary TC and reply the results
+                com_send_ack(conn, com_receive_tc_bin(packet, SCH_COM_TC_WAIT_MS, t_rx));
+                csp_buffer_free(packet);
+                break;
+
+            case SCH_TRX_PORT_RPT:
+                // Digital repeater port, the repeater resends the packet
+                if(csp_conn_dst(conn) == SCH_COMM_ADDRESS)
+                {
+                    if(rpt_put(packet) != 0)
+                        csp_buffer_free(packet); // Dropped by the rate limit or the queue
+                }
+                // If i am receiving a broadcast packet just print
+                else
+                {
+                    LOGI(tag, "RPT: %s", (char *)(packet->data));
                     csp_buffer_free(packet);
-                    break;
+                }
+                break;
+
+            case SCH_TRX_PORT_CMD:
+                // Execute console commands and reply the result
+                com_send_ack(conn, com_receive_cmd(packet, SCH_COM_TC_WAIT_MS, t_rx));
+                csp_buffer_free(packet);
+                break;
+
+            case SCH_TRX_PORT_DBG:
+                /* Debug port, print to console */
+                LOGP(tag, "[%d] %s", packet->id.src, (char *)(packet->data));
+                csp_buffer_free(packet);
+                break;
+
+            case SCH_TRX_PORT_DBG_BIN:
+                /* Binary logs, print them as hex for sandbox/log_parser.py */
+                com_print_binary_log(packet);
+                csp_buffer_free(packet);
+                break;
+
+            case SCH_TRX_PORT_DBG_TM:
+                /* Debug port, print frames to console */
+                rcv_frame = (com_frame_t *)packet->data;
+                LOGP(tag, "[%d][%d]\r\n%s", rcv_frame->node, rcv_frame->nframe & COM_FRAME_NUM_MASK, rcv_frame->data.data8);
+                csp_buffer_free(packet);
+                break;
 
-                case SCH_TRX_PORT_RPT:
-                    // Digital repeater port, resend the received packet
-                    if(csp_conn_dst(conn) == SCH_COMM_ADDRESS)
+#ifdef LINUX
+            case SCH_TRX_PORT_PROF:
+                /* Sampling profiler session, the histogram is sent as TM */
+                com_send_ack(conn, com_receive_prof(packet, csp_conn_src(conn)));
+                csp_buffer_free(packet);
+                break;
+
+            case SCH_TRX_PORT_ACK:
+                /* Telemetry acknowledgements, @see dl_ack_rle */
+                com_send_ack(conn, com_receive_ack(packet));
+                csp_buffer_free(packet);
+                break;
+
+            case SCH_TRX_PORT_FILE:
+                /* File transfer frames, @see tm_receive_file_frame */
+                if(packet->id.flags & CSP_FFRAG)
+                {
+                    // Large frame, fragmented with SFP. The fragments are freed
+                    // while they are copied to the frame (allocated by CSP)
+                    void *sfp_data = NULL;
+                    int sfp_len = 0;
+                    if(csp_sfp_recv_fp(conn, &sfp_data, &sfp_len, SCH_COM_BULK_READ_MS, packet) == 0)
                     {
-                        rc = csp_sendto(CSP_PRIO_NORM, CSP_BROADCAST_ADDR,
-                                        SCH_TRX_PORT_RPT, SCH_TRX_PORT_RPT,
-                                        CSP_O_NONE, packet, 1000);
-                        LOGD(tag, "Repeating message to %d (rc: %d)", CSP_BROADCAST_ADDR, rc);
-                        if (rc != 0)
-                            csp_buffer_free(packet); // Free the packet in case of errors
+                        tm_receive_file_frame((com_frame_file_t *)sfp_data, sfp_len);
+                        free(sfp_data);
                     }
-                    // If i am receiving a broadcast packet just print
                     else
                     {
-                        LOGI(tag, "RPT: %s", (char *)(packet->data));
-                        csp_buffer_free(packet);
+                        LOGW(tag, "Incomplete file frame from node %d", csp_conn_src(conn));
                     }
                     break;
+                }
+                tm_receive_file_frame((com_frame_file_t *)packet->data, packet->length);
+                csp_buffer_free(packet);
+                break;
+#endif
 
-                case SCH_TRX_PORT_CMD:
-                    // Create a response packet and send
-                    rep_ok = csp_buffer_clone(rep_ok_tmp);
-                    csp_send(conn, rep_ok, 1000);
-                    /* Command port, executes console commands */
-                    com_receive_cmd(packet);
-                    csp_buffer_free(packet);
-                    break;
-
-                case SCH_TRX_PORT_DBG:
-                    /* Debug port, print to console */
-                    LOGP(tag, "[%d] %s", packet->id.src, (char *)(packet->data));
+            case SCH_TRX_PORT_TM:
+                // Process TM packet
+                SCH_PROF_BEGIN(PROF_COM_RECEIVE_TM);
+                #ifndef SCH_RESEND_TM_NODE
+                // The packet is passed to the parsing command without a copy
+                com_receive_tm(packet, 1);
+                #else
+                rc = com_receive_tm(packet, 0);
+                #endif
+                SCH_PROF_END(PROF_COM_RECEIVE_TM);
+
+                #ifdef SCH_RESEND_TM_NODE
+                // Resend the same packet to another node, without a copy. The
+                // TM was already copied where needed, restore the header
+                // byte order changed by com_receive_tm. Corrupted frames are
+                // not resent.
+                if(rc != 0)
+                {
                     csp_buffer_free(packet);
                     break;
-
-                case SCH_TRX_PORT_DBG_TM:
-                    /* Debug port, print frames to console */
-                    rcv_frame = (com_frame_t *)packet->data;
-                    LOGP(tag, "[%d][%d]\r\n%s", rcv_frame->node, rcv_frame->nframe, rcv_frame->data.data8);
-                    csp_buffer_free(packet);
+                }
+                rcv_frame = (com_frame_t *)packet->data;
+                rcv_frame->nframe = csp_hton16(rcv_frame->nframe);
+                rcv_frame->ndata = csp_hton32(rcv_frame->ndata);
+                rc = csp_sendto(CSP_PRIO_NORM, SCH_RESEND_TM_NODE, SCH_TRX_PORT_TM, csp_conn_sport(conn), CSP_O_NONE, packet, 1000);
+                if(rc == CSP_ERR_NONE)
                     break;
+                csp_buffer_free(packet);
+                #endif
+                break;
+
+            default:
+                #ifdef SCH_HOOK_COMM
+                /* Let user application handle a packet */
+                if(csp_conn_dport(conn) >= SCH_TRX_PORT_APP)
+                    taskCommunicationsHook(conn, packet);
+                #endif
+                /* Let the service handler reply pings, buffer use, etc. */
+                csp_service_handler(conn, packet);
+                break;
+        }
+    }
+    /* Close current connection */
+    csp_close(conn);
+}
 
-                case SCH_TRX_PORT_TM:
-                    #ifdef SCH_RESEND_TM_NODE
-                    // Resend a copy of the packet to another node
-                    tmp_packet = (csp_packet_t *)csp_buffer_clone(packet);
-                    assert(tmp_packet != NULL);
-                    assert(tmp_packet != packet);
-                    rc = csp_sendto(CSP_PRIO_NORM, SCH_RESEND_TM_NODE, SCH_TRX_PORT_TM, csp_conn_sport(conn), CSP_O_NONE, tmp_packet, 1000);
-                    if(rc == -1)
-                        csp_buffer_free(tmp_packet);
-                    #endif
-
-                    // Process TM packet
-                    com_receive_tm(packet);
-                    csp_buffer_free(packet);
-                    break;
+/**
+ * Reply a command packet with a COM_ACK_* code. The reply does not wait more
+ * than SCH_COM_ACK_TIMEOUT_MS for the TX queue, the ground retries the TC if
+ * the reply is lost.
+ *
+ * @param conn Connection to reply
+ * @param code Reply code
+ */
+static void com_send_ack(csp_conn_t *conn, uint8_t code)
+{
+    csp_packet_t *rep_ok = com_buffer_get(1, 1);
+    if(rep_ok == NULL)
+    {
+        LOGW(tag, "No buffers to reply port %d", csp_conn_dport(conn));
+        return;
+    }
+    rep_ok->data[0] = code;
+    rep_ok->length = 1;
+    if(!csp_send(conn, rep_ok, SCH_COM_ACK_TIMEOUT_MS))
+        csp_buffer_free(rep_ok);
+}
 
-                default:
-                    #ifdef SCH_HOOK_COMM
-                    /* Let user application handle a packet */
-                    if(csp_conn_dport(conn) >= SCH_TRX_PORT_APP)
-                        taskCommunicationsHook(conn, packet);
-                    #endif
-                    /* Let the service handler reply pings, buffer use, etc. */
-                    csp_service_handler(conn, packet);
-                    break;
-            }
+/**
+ * Wait for the results of the commands sent with a future, sharing @timeout
+ * ms among them, and summarize them as a COM_ACK_* code.
+ *
+ * @param futures Futures of the commands, -1 if a command is not waited
+ * @param n Number of commands
+ * @param ack Reply code of the commands not waited
+ * @param timeout Timeout in ms
+ * @return COM_ACK_ERROR if any command failed, else COM_ACK_ACCEPTED if any
+ * command is not done, else COM_ACK_OK
+ */
+static uint8_t com_wait_cmds(const int *futures, int n, uint8_t ack, uint32_t timeout)
+{
+    portTick start = osTaskGetTickCount();
+    portTick max = osDefineTime(timeout);
+    int i;
+    for(i = 0; i < n; i++)
+    {
+        if(futures[i] < 0)
+        {
+            if(ack == COM_ACK_OK)
+                ack = COM_ACK_ACCEPTED;
+            continue;
         }
-        /* Close current connection, and handle next */
-        csp_close(conn);
+        portTick elapsed = osTaskGetTickCount() - start;
+        uint32_t left = elapsed < max ? (uint32_t)((uint64_t)timeout*(max - elapsed)/max) : 0;
+        int result = cmd_future_wait(futures[i], left);
+        if(result == CMD_TIMEOUT)
+        {
+            cmd_future_cancel(futures[i]);
+            if(ack == COM_ACK_OK)
+                ack = COM_ACK_ACCEPTED;
+        }
+        else if(result != CMD_OK)
+            ack = COM_ACK_ERROR;
+    }
+    return ack;
+}
+
+/**
+ * Commands of a TC frame, sent for execution in batches
+ */
+typedef struct com_tc_batch{
+    cmd_t *cmds[SCH_CMD_BATCH_MAX];  ///< Commands not sent yet
+    int n_cmds;                      ///< Number of commands not sent yet
+    int futures[SCH_CMD_FUTURES];    ///< Futures of the commands waited
+    int n_futures;                   ///< Number of commands waited
+    uint8_t ack;                     ///< COM_ACK_* code of the commands not waited
+    uint32_t timeout;                ///< Max. time (ms) waiting for the results
+    portTick t_rx;                   ///< Tick count when the TC was read
+    uint32_t trace_id;               ///< Latency trace id of the TC, 0 until assigned (see cmd_lat_begin)
+} com_tc_batch_t;
+
+/**
+ * Add a command to the batch, the first commands are waited to reply their
+ * results. The batch is sent for execution when full. The commands latency is
+ * traced from the TC reception.
+ *
+ * @param batch TC batch
+ * @param cmd Command to execute, NULL if the command was not valid
+ */
+static void com_tc_batch_add(com_tc_batch_t *batch, cmd_t *cmd)
+{
+    if(cmd == NULL)
+    {
+        batch->ack = COM_ACK_ERROR;
+        return;
+    }
+
+    batch->trace_id = cmd_lat_begin(cmd, batch->trace_id, batch->t_rx);
+    if(batch->timeout > 0 && batch->n_futures < SCH_CMD_FUTURES)
+        batch->futures[batch->n_futures++] = cmd_future_get(cmd);
+    else if(batch->ack == COM_ACK_OK)
+        batch->ack = COM_ACK_ACCEPTED;
+    batch->cmds[batch->n_cmds++] = cmd;
+
+    if(batch->n_cmds == SCH_CMD_BATCH_MAX)
+    {
+        cmd_send_batch(batch->cmds, batch->n_cmds, 0, SCH_CMD_SEND_TIMEOUT_MS);
+        batch->n_cmds = 0;
     }
 }
 
+/**
+ * Send the remaining commands of the batch for execution and wait for the
+ * results of the first commands
+ *
+ * @param batch TC batch
+ * @return COM_ACK_* reply code
+ */
+static uint8_t com_tc_batch_end(com_tc_batch_t *batch)
+{
+    cmd_send_batch(batch->cmds, batch->n_cmds, 0, SCH_CMD_SEND_TIMEOUT_MS);
+    return com_wait_cmds(batch->futures, batch->n_futures, batch->ack, batch->timeout);
+}
+
 /**
  * Parse TC frames and generates corresponding commands. A TC frame contains
  * a list of <command> [parameter] pairs separated by ";" (semicolon). For
@@ -163,27 +431,81 @@ void taskCommunications(void *param)
  *
  * @param packet A csp buffer containing a null terminated string with the
  *               format <command> [parameters];<command> [parameters];...
+ * @param timeout Max. time (ms) waiting for the commands results, 0 to not
+ *               wait
+ * @param t_rx Tick count when the packet was read
+ * @return COM_ACK_* reply code
  */
-static void com_receive_tc(csp_packet_t *packet)
+static uint8_t com_receive_tc(csp_packet_t *packet, uint32_t timeout, portTick t_rx)
 {
     // Make sure the buffer is a null terminated string
     packet->data[packet->length] = '\0';
 
-    // Search for the first ";" separated command
-    char *cmd_str;
-    cmd_str = strtok((char *)(packet->data), ";");
-
+    com_tc_batch_t batch = {.n_cmds = 0, .n_futures = 0, .ack = COM_ACK_OK, .timeout = timeout,
+                            .t_rx = t_rx, .trace_id = 0};
+    char *cmd_str = strtok((char *)(packet->data), ";");
     while(cmd_str != NULL)
     {
-        // Parse and send command for execution
         LOGI(tag, "TC: %s", cmd_str);
-        cmd_t *new_cmd = cmd_build_from_str(cmd_str);
-        if (new_cmd != NULL)
-            cmd_send(new_cmd);
-
+        com_tc_batch_add(&batch, cmd_build_from_str(cmd_str));
         // Search for the next ";" separated command
         cmd_str = strtok(NULL, ";");
     }
+    return com_tc_batch_end(&batch);
+}
+
+/**
+ * Decode binary TC frames and generates corresponding commands. A binary TC
+ * frame contains a list of records, each one with the command id (uint16_t,
+ * big-endian, see cmd_catalog_get), the parameters length (uint8_t) and the
+ * packed parameters (see cmd_add_params_packed). Commands are looked up by id,
+ * so the frame skips the name lookup and parameters parsing of text TC.
+ *
+ * @param packet A csp buffer containing the binary TC records
+ * @param timeout Max. time (ms) waiting for the commands results, 0 to not
+ *               wait
+ * @param t_rx Tick count when the packet was read
+ * @return COM_ACK_* reply code
+ */
+static uint8_t com_receive_tc_bin(csp_packet_t *packet, uint32_t timeout, portTick t_rx)
+{
+    com_tc_batch_t batch = {.n_cmds = 0, .n_futures = 0, .ack = COM_ACK_OK, .timeout = timeout,
+                            .t_rx = t_rx, .trace_id = 0};
+    const uint8_t *data = packet->data;
+    int pos = 0;
+    while(pos < packet->length)
+    {
+        if(packet->length - pos < 3 || packet->length - pos - 3 < data[pos+2])
+        {
+            LOGW(tag, "Truncated binary TC record at %d", pos);
+            batch.ack = COM_ACK_ERROR;
+            break;
+        }
+        int id = (data[pos] << 8) | data[pos+1];
+        int len = data[pos+2];
+        pos += 3;
+
+        cmd_catalog_t entry;
+        cmd_t *new_cmd = NULL;
+        if(cmd_catalog_get(id, &entry) == CMD_OK)
+            new_cmd = cmd_get_idx(id);
+        if(new_cmd != NULL && cmd_add_params_packed(new_cmd, data + pos, len) != CMD_OK)
+        {
+            cmd_free(new_cmd);
+            new_cmd = NULL;
+        }
+        if(new_cmd == NULL)
+        {
+            LOGW(tag, "Invalid binary TC: %d (%d bytes)", id, len);
+        }
+        else
+        {
+            LOGI(tag, "TC: %d (%d bytes)", id, len);
+        }
+        com_tc_batch_add(&batch, new_cmd);
+        pos += len;
+    }
+    return com_tc_batch_end(&batch);
 }
 
 /**
@@ -191,102 +513,222 @@ static void com_receive_tc(csp_packet_t *packet)
  *
  * @param packet A csp buffer containing a null terminated string with the
  *               format <command> [parameters]
+ * @param timeout Max. time (ms) waiting for the command result, 0 to not wait
+ * @param t_rx Tick count when the packet was read
+ * @return COM_ACK_* reply code
  */
-static void com_receive_cmd(csp_packet_t *packet)
+static uint8_t com_receive_cmd(csp_packet_t *packet, uint32_t timeout, portTick t_rx)
 {
     // Make sure the buffer is a null terminated string
     packet->data[packet->length] = '\0';
     cmd_t *new_cmd = cmd_build_from_str((char *)(packet->data));
+    if(new_cmd == NULL)
+        return COM_ACK_ERROR;
+    cmd_lat_begin(new_cmd, 0, t_rx);
+
+    // Send command to execution and wait for the result. A command dropped
+    // because the dispatcher queue is full is replied as an error
+    int future = timeout > 0 ? cmd_future_get(new_cmd) : -1;
+    if(cmd_send_timeout(new_cmd, SCH_CMD_SEND_TIMEOUT_MS) != CMD_OK)
+    {
+        cmd_future_cancel(future);
+        return COM_ACK_ERROR;
+    }
+    return com_wait_cmds(&future, 1, COM_ACK_OK, timeout);
+}
 
-    // Send command to execution if not null
-    if(new_cmd != NULL)
-        cmd_send(new_cmd);
+#ifdef LINUX
+/**
+ * Start a sampling profiler session requested to SCH_TRX_PORT_PROF. The
+ * session runs as the tm_send_prof_stacks command, so it does not hold this
+ * task, and its histogram is sent to the requesting node.
+ *
+ * @param packet A csp buffer with the samples per second and the session
+ *               length in seconds, two uint16 in network byte order
+ * @param node Requesting node
+ * @return COM_ACK_ACCEPTED if the session was queued, COM_ACK_ERROR otherwise
+ */
+static uint8_t com_receive_prof(csp_packet_t *packet, uint8_t node)
+{
+    if(packet->length < 2*sizeof(uint16_t))
+        return COM_ACK_ERROR;
+    uint16_t request[2];
+    memcpy(request, packet->data, sizeof(request));
+    int rate = csp_ntoh16(request[0]);
+    int seconds = csp_ntoh16(request[1]);
+    if(rate <= 0 || rate > SCH_PROF_SAMPLE_MAX_HZ || seconds <= 0 || seconds > SCH_PROF_SAMPLE_MAX_S)
+        return COM_ACK_ERROR;
+
+    cmd_t *cmd_prof = cmd_get_str("tm_send_prof_stacks");
+    if(cmd_prof == NULL)
+        return COM_ACK_ERROR;
+    cmd_add_params_var(cmd_prof, (int)node, rate, seconds);
+    LOGI(tag, "Profiler session requested by node %d: %d Hz, %d s", node, rate, seconds);
+    return cmd_send_timeout(cmd_prof, SCH_CMD_SEND_TIMEOUT_MS) == CMD_OK ? COM_ACK_ACCEPTED : COM_ACK_ERROR;
+}
+
+/**
+ * Acknowledge the payload samples received by the ground station, reported to
+ * SCH_TRX_PORT_ACK as a run-length encoded list (@see com_ack_frame_t)
+ *
+ * @param packet A csp buffer with a com_ack_frame_t, up to its last run
+ * @return COM_ACK_OK if the acks were stored, COM_ACK_ERROR otherwise
+ */
+static uint8_t com_receive_ack(csp_packet_t *packet)
+{
+    com_ack_frame_t frame;
+    if(packet->length < COM_ACK_HEADER_LEN || packet->length > sizeof(frame))
+        return COM_ACK_ERROR;
+    memcpy(&frame, packet->data, packet->length);
+    if(frame.n_runs > COM_ACK_MAX_RUNS || packet->length != COM_ACK_HEADER_LEN + frame.n_runs*sizeof(uint16_t))
+        return COM_ACK_ERROR;
+
+    uint16_t runs[COM_ACK_MAX_RUNS];
+    int i;
+    for(i=0; i < frame.n_runs; i++)
+        runs[i] = csp_ntoh16(frame.runs[i]);
+    uint32_t base = csp_ntoh32(frame.base);
+    LOGD(tag, "Acks of payload %d from %u, %d runs", frame.payload, (unsigned int)base, frame.n_runs);
+    if(base > INT32_MAX || dl_ack_rle(frame.payload, (int)base, runs, frame.n_runs) != 0)
+        return COM_ACK_ERROR;
+    return COM_ACK_OK;
+}
+#endif
+
+/**
+ * Print binary log records as one hex line, the text is rendered by
+ * sandbox/log_parser.py (@see log_binary)
+ *
+ * @param packet A csp buffer containing one or more binary log records
+ */
+static void com_print_binary_log(csp_packet_t *packet)
+{
+    static const char hex[] = "0123456789abcdef";
+    char line[2*SCH_BUFF_MAX_LEN+1];
+    int i, len = packet->length < SCH_BUFF_MAX_LEN ? packet->length : SCH_BUFF_MAX_LEN;
+    for(i = 0; i < len; i++)
+    {
+        line[2*i] = hex[packet->data[i] >> 4];
+        line[2*i+1] = hex[packet->data[i] & 0x0F];
+    }
+    line[2*len] = '\0';
+    LOGP(tag, "[%d] BIN %s", packet->id.src, line);
+}
+
+/**
+ * Send the command @name to parse a TM frame. If @own is set the packet is
+ * passed to the command without a copy and freed with it, otherwise the frame
+ * is copied. Queued commands hold their packets, so the frame is also copied
+ * when few CSP buffers are left for the radio.
+ */
+static void com_parse_tm(const char *name, csp_packet_t *packet, int own)
+{
+    cmd_t *cmd_parse_tm = cmd_get_str(name);
+    if(own && csp_buffer_remaining() > SCH_BUFFERS_CSP/4)
+    {
+        cmd_add_params_owned(cmd_parse_tm, packet->data, packet, csp_buffer_free);
+    }
+    else
+    {
+        cmd_add_params_raw(cmd_parse_tm, packet->data, sizeof(com_frame_t));
+        if(own)
+            csp_buffer_free(packet);
+    }
+    cmd_send_timeout(cmd_parse_tm, SCH_CMD_SEND_TIMEOUT_MS);
 }
 
 /**
  * Process a TM frame, determine TM type and call corresponding parsing command
- * @param packet a csp buffer containing a com_frame_t structure.
+ * @param packet a csp buffer containing a com_frame_t structure. The frame
+ *               CRC is checked and removed (@see com_frame_check) and the
+ *               header is converted to host byte order in place.
+ * @param own if set, the function takes the ownership of the packet: it is
+ *            passed to the parsing command or freed. Otherwise the caller
+ *            keeps the packet and the frame is copied.
+ * @return 0 if OK, -1 if the frame was corrupted and dropped
  */
-static void com_receive_tm(csp_packet_t *packet)
+static int com_receive_tm(csp_packet_t *packet, int own)
 {
-    cmd_t *cmd_parse_tm;
     com_frame_t *frame = (com_frame_t *)packet->data;
 
+    if(com_frame_check(packet) != 0)
+    {
+        LOGW(tag, "Corrupted frame from node %d dropped, CRC check failed", packet->id.src);
+        if(own)
+            csp_buffer_free(packet);
+        return -1;
+    }
+
     frame->nframe = csp_ntoh16(frame->nframe);
     frame->ndata = csp_ntoh32(frame->ndata);
 
-    LOGI(tag, "Received: %d bytes", packet->length);
-    LOGI(tag, "Node    : %d", frame->node);
-    LOGI(tag, "Frame   : %d", frame->nframe);
-    LOGI(tag, "Type    : %d", frame->type);
-    LOGI(tag, "Samples : %d", frame->ndata);
+    LOGD(tag, "Received: %d bytes, node %d, frame %d, type %d, samples %d", packet->length,
+         frame->node, frame->nframe & COM_FRAME_NUM_MASK, frame->type, frame->ndata);
 
-    if(frame->type == TM_TYPE_STATUS)
+    if(frame->type == TM_TYPE_STATUS || frame->type == TM_TYPE_STATUS_DELTA || frame->type == TM_TYPE_STATUS_VARS)
     {
-        cmd_parse_tm = cmd_get_str("tm_parse_status");
-        cmd_add_params_raw(cmd_parse_tm, frame, sizeof(com_frame_t));
-        cmd_send(cmd_parse_tm);
+        com_parse_tm("tm_parse_status", packet, own);
     }
     else if(frame->type == TM_TYPE_HELP)
     {
-        cmd_parse_tm = cmd_get_str("tm_parse_string");
-        cmd_add_params_raw(cmd_parse_tm, frame, sizeof(com_frame_t));
-        cmd_send(cmd_parse_tm);
+        com_parse_tm("tm_parse_string", packet, own);
     }
-    else if(frame->type >= TM_TYPE_PAYLOAD && frame->type < TM_TYPE_PAYLOAD+last_sensor)
+    else if(frame->type == TM_TYPE_CMD_STATS)
     {
-        int payload = frame->type - TM_TYPE_PAYLOAD; // Payload type
-        print_buff16(packet->data16, packet->length/2);
-        int j, delay = 0;
-
-        //FIXME: Use a command to add payloads to database
-        //Save ndata payload samples to data storage
-
-        _ntoh32_buff(frame->data.data32, sizeof(frame->data.data8)/ sizeof(uint32_t));
-
-        assert(frame->ndata*data_map[payload].size <= COM_FRAME_MAX_LEN);
-        for(j=0; j < frame->ndata; j++)
-        {
-            delay = j*data_map[payload].size; // Select next struct
-            dat_add_payload_sample((frame->data.data8)+delay, payload); //Save next struct
-        }
+        com_parse_tm("tm_parse_cmd_stats", packet, own);
     }
-    else if(frame->type == TM_TYPE_FILE_START)
+    else if(frame->type == TM_TYPE_CMD_LAT)
     {
-        print_buff(frame->data.data8, COM_FRAME_MAX_LEN);
-#ifdef LINUX
-        FILE *fptr;
-        char fname[100] = "testfile.jpg";
-
-
-        fptr = fopen(fname,"rb");
-
-        if(fptr == NULL) {
-            fptr = fopen(fname,"wb");
-        } else {
-            if (frame->nframe != 1) {
-                fclose(fptr);
-                fptr = fopen(fname,"ab");
-            }
-        }
-
-        int cur_size = (int) ftell(fptr);
-        int written = fwrite(frame->data.data8, 1, COM_FRAME_MAX_LEN, fptr);
-
-        LOGI(tag, "current file size: %d, %d", cur_size, written);
-
-        fclose(fptr);
-#endif
+        com_parse_tm("tm_parse_cmd_lat", packet, own);
+    }
+    else if(frame->type == TM_TYPE_CMD_CATALOG)
+    {
+        com_parse_tm("tm_parse_cmd_catalog", packet, own);
+    }
+    else if(frame->type == TM_TYPE_FP)
+    {
+        com_parse_tm("tm_parse_fp", packet, own);
+    }
+    else if(frame->type == TM_TYPE_TASK_STATS)
+    {
+        com_parse_tm("tm_parse_task_stats", packet, own);
+    }
+    else if(frame->type == TM_TYPE_TASK_STACK)
+    {
+        com_parse_tm("tm_parse_task_stack", packet, own);
+    }
+    else if(frame->type == TM_TYPE_PROF)
+    {
+        com_parse_tm("tm_parse_prof", packet, own);
+    }
+    else if(frame->type == TM_TYPE_PROF_STACKS)
+    {
+        com_parse_tm("tm_parse_prof_stacks", packet, own);
+    }
+    else if((frame->type >= TM_TYPE_PAYLOAD && frame->type < TM_TYPE_PAYLOAD+last_sensor) ||
+            (frame->type >= TM_TYPE_PAYLOAD_Z && frame->type < TM_TYPE_PAYLOAD_Z+last_sensor) ||
+            frame->type == TM_TYPE_PAYLOAD_MUX)
+    {
+        // Payload samples are stored by the ingest task, @see ingest_put
+        ingest_put(packet->id.src, frame, packet->length);
+        if(own)
+            csp_buffer_free(packet);
     }
     else
     {
         LOGW(tag, "Undefined telemetry type %d!", frame->type);
-        //Print raw data as bytes, int16, and ascii.
-        //Do not use LOG functions after this line
-        osSemaphoreTake(&log_mutex, portMAX_DELAY);
-        print_buff(packet->data, packet->length);
-        print_buff_fmt(packet->data32, packet->length/sizeof(uint32_t), "%d, ");
-        print_buff_ascii(packet->data, packet->length);
-        osSemaphoreGiven(&log_mutex);
+        //Print raw data as bytes, int32, and ascii, only when debugging.
+        //Do not use LOG functions inside this block
+        if(LOG_ENABLED(LOG_LVL_DEBUG))
+        {
+            osSemaphoreTake(&log_mutex, portMAX_DELAY);
+            print_buff(packet->data, packet->length);
+            print_buff_fmt(packet->data32, packet->length/sizeof(uint32_t), "%d, ");
+            print_buff_ascii(packet->data, packet->length);
+            osSemaphoreGiven(&log_mutex);
+        }
+        if(own)
+            csp_buffer_free(packet);
     }
+    return 0;
 }
@@ -18,6 +18,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_TAG_ID LOG_TAG_CONSOLE
 #include "taskConsole.h"
 
 static const char *tag = "Console";
@@ -34,6 +35,55 @@ ______________________________________________________________________________\n
 
 //"\n\n====== WELCOME TO THE SUCHAI CONSOLE - PRESS ANY KEY TO START ======\n\r";
 
+/* Commands submitted to the dispatcher at once in batch mode */
+#define CONSOLE_BATCH_CHUNK 16
+
+/**
+ * Batch mode command record
+ */
+typedef struct console_batch_cmd {
+    int line;               ///< Script line number
+    char *text;             ///< Command line (use malloc)
+    int sent;               ///< Command built and submitted
+    int result;             ///< Command result, set by the done callback
+    uint64_t t_sent_us;     ///< Submission time
+    uint32_t time_us;       ///< Time from submission to done
+} console_batch_cmd_t;
+
+static osEvent batch_event;
+static int batch_event_ok = 0;
+static volatile int batch_pending = 0;   ///< Submitted commands not done yet, plus one while submitting
+
+static uint64_t console_now_us(void)
+{
+#ifdef LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000ULL + (uint64_t)ts.tv_nsec/1000ULL;
+#else
+    return (uint64_t)osTaskGetTickCount()*1000000ULL/osDefineTime(1000);
+#endif
+}
+
+#ifdef LINUX
+static int console_add_completion(const char *name, void *arg)
+{
+    linenoiseAddCompletion((linenoiseCompletions *)arg, name);
+    return 1;
+}
+
+/**
+ * Linenoise completion callback, completes command names (TAB key)
+ */
+static void console_completion(const char *buf, linenoiseCompletions *lc)
+{
+    // Only the command name is completed, not the parameters
+    if(strchr(buf, ' ') != NULL)
+        return;
+    cmd_complete(buf, console_add_completion, lc);
+}
+#endif
+
 void taskConsole(void *param)
 {
     LOGI(tag, "Started");
@@ -49,23 +99,31 @@ void taskConsole(void *param)
 
     while(1)
     {
-        osDelay(delay_ms);
-
-        /* Read console and parse commands (blocking, except in ESP32) */
+        /* Read console and parse commands (blocking, except in ESP32). Lines
+         * are processed as soon as they are read, so pasted scripts are not
+         * delayed. Only wait if there is nothing to read */
         memset(buffer, '\0', SCH_BUFF_MAX_LEN);
         if(console_read(buffer, SCH_BUFF_MAX_LEN-1) != 0)
+        {
+            osDelay(delay_ms);
             continue;
+        }
+
+        /* Batch mode, "/batch <file>" or "/batch -" to read stdin */
+        if(!strncmp(buffer, "/batch", 6))
+        {
+            char *path = buffer + 6;
+            while(*path == ' ')
+                path++;
+            console_batch(*path != '\0' ? path : "-");
+            continue;
+        }
 
         new_cmd = cmd_build_from_str(buffer);
 
         if(new_cmd != NULL)
         {
-            if(log_lvl >= LOG_LVL_DEBUG)
-            {
-                char *name = cmd_get_name(new_cmd->id);
-                LOGD(tag, "Command sent: %d (%s)", new_cmd->id, name);
-                free(name);
-            }
+            LOGD(tag, "Command sent: %d (%s)", new_cmd->id, cmd_get_name(new_cmd->id));
             /* Queue NewCmd - Blocking */
             cmd_send(new_cmd);
         }
@@ -82,8 +140,10 @@ int console_init(void)
 
 #ifdef LINUX
     linenoiseHistoryLoad(cmd_hist); /* Load the history at startup */
+    linenoiseSetCompletionCallback(console_completion);
 #endif
 
+    batch_event_ok = osEventCreate(&batch_event) == OS_SEMAPHORE_OK;
     cmd_print_all();
     return 0;
 }
@@ -139,3 +199,143 @@ int console_read(char *buffer, int len)
     }
     return 0;
 }
+
+/**
+ * Done callback of the batch mode commands, called by the executer
+ */
+static void console_batch_done(cmd_t *cmd, int result, void *arg)
+{
+    console_batch_cmd_t *bcmd = (console_batch_cmd_t *)arg;
+    bcmd->result = result;
+    bcmd->time_us = (uint32_t)(console_now_us() - bcmd->t_sent_us);
+    if(__sync_sub_and_fetch(&batch_pending, 1) == 0)
+        osEventSet(&batch_event, 1);
+}
+
+/**
+ * Read the batch script lines, skipping empty lines and # comments. Reading
+ * stdin stops at EOF or at a "/end" line.
+ * @return Number of commands read, the array is returned in @cmds
+ */
+static int console_batch_read(FILE *file, console_batch_cmd_t **cmds)
+{
+    char line[SCH_BUFF_MAX_LEN];
+    int n = 0, size = 0, n_line = 0;
+    *cmds = NULL;
+
+    while(fgets(line, sizeof(line), file) != NULL)
+    {
+        n_line++;
+        line[strcspn(line, "\r\n")] = '\0';
+        char *text = line;
+        while(*text == ' ' || *text == '\t')
+            text++;
+        if(*text == '\0' || *text == '#')
+            continue;
+        if(!strncmp(text, "/end", 4))
+            break;
+
+        if(n == size)
+        {
+            size = size > 0 ? size*2 : 64;
+            console_batch_cmd_t *tmp = realloc(*cmds, size*sizeof(console_batch_cmd_t));
+            if(tmp == NULL)
+            {
+                LOGE(tag, "Batch script too long, read %d commands", n);
+                break;
+            }
+            *cmds = tmp;
+        }
+        console_batch_cmd_t *bcmd = &(*cmds)[n++];
+        memset(bcmd, 0, sizeof(console_batch_cmd_t));
+        bcmd->line = n_line;
+        bcmd->text = strdup(text);
+        bcmd->result = CMD_DROPPED;
+    }
+    return n;
+}
+
+static const char *console_batch_result(console_batch_cmd_t *bcmd)
+{
+    if(!bcmd->sent)
+        return "invalid";
+    switch(bcmd->result)
+    {
+        case CMD_OK: return "ok";
+        case CMD_ERROR: return "error";
+        case CMD_SYNTAX_ERROR: return "syntax";
+        case CMD_DROPPED: return "dropped";
+        default: return "unknown";
+    }
+}
+
+int console_batch(const char *path)
+{
+    if(!batch_event_ok)
+    {
+        LOGE(tag, "Batch mode not available");
+        return -1;
+    }
+
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if(file == NULL)
+    {
+        LOGE(tag, "Unable to open the batch script %s", path);
+        return -1;
+    }
+    console_batch_cmd_t *cmds;
+    int n = console_batch_read(file, &cmds);
+    if(file != stdin)
+        fclose(file);
+    LOGI(tag, "Batch: %d commands from %s", n, path);
+
+    /* Submit the commands in chunks, the done callbacks count the pending
+     * ones. The extra pending count avoids signaling the end while
+     * commands are still being submitted. */
+    int i, n_chunk = 0;
+    cmd_t *chunk[CONSOLE_BATCH_CHUNK];
+    uint64_t t_start = console_now_us();
+    batch_pending = 1;
+    for(i=0; i<n; i++)
+    {
+        cmd_t *new_cmd = cmd_build_from_str(cmds[i].text);
+        if(new_cmd == NULL)
+        {
+            LOGW(tag, "Batch line %d: invalid command: %s", cmds[i].line, cmds[i].text);
+            continue;
+        }
+        cmds[i].sent = 1;
+        cmds[i].t_sent_us = console_now_us();
+        __sync_add_and_fetch(&batch_pending, 1);
+        cmd_set_done(new_cmd, console_batch_done, &cmds[i]);
+        chunk[n_chunk++] = new_cmd;
+        if(n_chunk == CONSOLE_BATCH_CHUNK)
+        {
+            cmd_send_batch(chunk, n_chunk, 0, portMAX_DELAY);
+            n_chunk = 0;
+        }
+    }
+    cmd_send_batch(chunk, n_chunk, 0, portMAX_DELAY);
+
+    /* Wait until the executer reports every command */
+    if(__sync_sub_and_fetch(&batch_pending, 1) != 0)
+        osEventWait(&batch_event, 1, portMAX_DELAY);
+    uint32_t wall_us = (uint32_t)(console_now_us() - t_start);
+
+    int n_ok = 0, n_failed = 0;
+    LOGR(tag, "%6s %-8s %10s  %s", "line", "result", "time (ms)", "command");
+    for(i=0; i<n; i++)
+    {
+        console_batch_cmd_t *bcmd = &cmds[i];
+        LOGR(tag, "%6d %-8s %10.3f  %s", bcmd->line, console_batch_result(bcmd),
+             bcmd->time_us/1000.0, bcmd->text);
+        if(bcmd->sent && bcmd->result == CMD_OK)
+            n_ok++;
+        else
+            n_failed++;
+        free(bcmd->text);
+    }
+    LOGR(tag, "Batch: %d commands, %d ok, %d failed, wall time %.3f ms", n, n_ok, n_failed, wall_us/1000.0);
+    free(cmds);
+    return n_failed;
+}
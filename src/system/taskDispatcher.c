@@ -18,53 +18,126 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_TAG_ID LOG_TAG_DISPATCHER
 #include "taskDispatcher.h"
 
 static const char *tag = "Dispatcher";
 
+/* Commands taken from the dispatcher queue at once */
+#define DISPATCHER_BURST_LEN 8
+
+/* OBC operation mode, updated when dat_obc_opmode changes (see dat_subscribe) */
+static volatile int dispatcher_opmode = DAT_OBC_OPMODE_NORMAL;
+
+static void _dispatcher_opmode_changed(dat_status_address_t index, value32_t value, void *arg)
+{
+    dispatcher_opmode = value.i;
+}
+
 void taskDispatcher(void *param)
 {
 	LOGI(tag, "Started");
 
-    int status; /* Status of cmd reading operation */
+    /* Follow the operation mode used by the load shedding policy */
+    dat_subscribe(dat_obc_opmode, _dispatcher_opmode_changed, NULL, NULL, 0);
+    dispatcher_opmode = dat_get_system_var(dat_obc_opmode);
+
+    int n_cmds; /* Number of commands read */
+    int n_batch; /* Commands waiting to be sent to batch_queue */
+    int i;
 
-    cmd_t *new_cmd = NULL; /* The new cmd read */
-    int cmd_result;
+    cmd_t *new_cmds[DISPATCHER_BURST_LEN]; /* The new cmds read */
+    cmd_t *batch[DISPATCHER_BURST_LEN];
+    osQueue batch_queue = 0;
 
     while(1)
     {
-        /* Read new_cmd from Queue - Blocking */
-        status = osQueueReceive(dispatcher_queue, &new_cmd, portMAX_DELAY);
+        /* Read a burst of commands from Queue - Blocking */
+        n_cmds = osQueueReceiveMany(dispatcher_queue, new_cmds, DISPATCHER_BURST_LEN, sizeof(cmd_t *), portMAX_DELAY);
+        n_batch = 0;
 
-        if(status == pdPASS)
+        for(i=0; i<n_cmds; i++)
         {
-            /* Check if command is executable */
-            if (check_if_executable(new_cmd))
+            cmd_t *new_cmd = new_cmds[i];
+            /* High priority commands are taken from their lane, in order */
+            if(new_cmd == NULL && (new_cmd = cmd_queue_high(dispatcher_queue)) == NULL)
+                continue;
+            /* Check if command is executable and not already queued */
+            if (check_if_executable(new_cmd) && !cmd_coalesce_check(new_cmd))
             {
-
-                /* Send the command to executer Queue - BLOCKING */
-                int executed_cmds = dat_get_system_var(dat_obc_executed_cmds); //Count executed commands
-                executed_cmds = executed_cmds + 1; //Add last command executed to count
-                dat_set_system_var(dat_obc_executed_cmds, executed_cmds); //Set new count
-                osQueueSend(executer_cmd_queue, &new_cmd, portMAX_DELAY);
+                /* Send the command to executer Queue. Only blocks if there
+                 * are SCH_CMD_EXE_QUEUE_LEN commands waiting for execution,
+                 * the result is accounted by taskExecuter */
                 LOGD(tag, "Cmd: %X, Param: %p, Orig: %X", new_cmd->id, &(new_cmd->params), -1);
+                new_cmd->t_dispatch = osTaskGetTickCount();
+                cmd_lat_mark(new_cmd, CMD_LAT_DISPATCH);
+                osQueue queue = dispatcher_select_queue(new_cmd);
 
-                /* Get the result from Executer Stat Queue - BLOCKING */
-                osQueueReceive(executer_stat_queue, &cmd_result, portMAX_DELAY);
-                if (cmd_result != CMD_OK)
+                /* High priority commands go to the executer lane right away,
+                 * the rest are sent in runs to the same executer queue */
+                if(new_cmd->priority > CMD_PRIO_NORMAL)
                 {
-                    int failed_cmds = dat_get_system_var(dat_obc_failed_cmds);
-                    failed_cmds = failed_cmds + 1;
-                    dat_set_system_var(dat_obc_failed_cmds, failed_cmds);
+                    cmd_queue_send(queue, new_cmd, portMAX_DELAY);
+                    continue;
                 }
-
-
+                if(n_batch > 0 && queue != batch_queue)
+                {
+                    osQueueSendBatch(batch_queue, batch, n_batch, sizeof(cmd_t *), portMAX_DELAY, 0);
+                    n_batch = 0;
+                }
+                batch_queue = queue;
+                batch[n_batch++] = new_cmd;
+            }
+            else
+            {
+                cmd_free(new_cmd);
             }
         }
+
+        if(n_batch > 0)
+            osQueueSendBatch(batch_queue, batch, n_batch, sizeof(cmd_t *), portMAX_DELAY, 0);
     }
 }
 
+osQueue dispatcher_select_queue(cmd_t *new_cmd)
+{
+    // Workers queues are only created if SCH_TASK_EXE_*_WORKERS > 0
+    if(new_cmd->cls == CMD_CLASS_SHARED_IO && executer_io_queue != 0)
+        return executer_io_queue;
+    if(new_cmd->cls == CMD_CLASS_CPU && executer_cpu_queue != 0)
+        return executer_cpu_queue;
+    return executer_cmd_queue;
+}
+
+cmd_load_t dispatcher_get_load(osQueue queue, cmd_class_t cls)
+{
+#if SCH_CMD_SHED_DEPTH > 0
+    int depth = osQueueGetDepth(queue);
+    // The lag is only updated when commands start, an idle executer keeps
+    // the lag of its last command, so it only counts if commands are waiting
+    uint32_t lag = depth > 0 ? cmd_get_lag(cls) : 0;
+
+    cmd_load_t load = CMD_LOAD_NORMAL;
+    if(depth >= 2*SCH_CMD_SHED_DEPTH || lag >= 2*SCH_CMD_SHED_LAG_MS)
+        load = CMD_LOAD_OVERLOAD;
+    else if(depth >= SCH_CMD_SHED_DEPTH || lag >= SCH_CMD_SHED_LAG_MS)
+        load = CMD_LOAD_HIGH;
+
+    // In the fail safe modes the optional commands give way sooner
+    if(load == CMD_LOAD_HIGH && (dispatcher_opmode == DAT_OBC_OPMODE_WARN ||
+                                 dispatcher_opmode == DAT_OBC_OPMODE_FAIL))
+        load = CMD_LOAD_OVERLOAD;
+    return load;
+#else
+    return CMD_LOAD_NORMAL;
+#endif
+}
+
 int check_if_executable(cmd_t *new_cmd)
 {
-    return 1;
+    // Commands that are never dropped skip the load estimation
+    if(new_cmd->shed == CMD_LOAD_NORMAL)
+        return 1;
+    cmd_load_t load = dispatcher_get_load(dispatcher_select_queue(new_cmd), new_cmd->cls);
+    return !cmd_shed_check(new_cmd, load);
 }
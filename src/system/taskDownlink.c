@@ -0,0 +1,650 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define LOG_TAG_ID LOG_TAG_TM
+#include "taskDownlink.h"
+
+static const char *tag = "Downlink";
+
+/*
+ * Partial payload frames are filled with the next sources selected, in
+ * TM_TYPE_PAYLOAD_MUX frames. Compressed frames already hold as many samples
+ * as fit.
+ */
+#define DL_MUX (SCH_TM_MUX && !SCH_TM_COMPRESS)
+#define DL_MUX_MAX_RANGES (COM_FRAME_MAX_LEN/(TM_MUX_HEADER_LEN+sizeof(uint32_t)))
+
+typedef struct dl_range {
+    int start;                              ///< First sample
+    int end;                                ///< Last sample + 1
+} dl_range_t;
+
+typedef struct dl_source {
+    unsigned int weight;                    ///< Operator-set weight, 0 disables the source
+    int64_t credit;                         ///< Weighted round robin credit
+    int cursor;                             ///< Next sample to send
+    portTick last_sent;                     ///< Last frame sent, to time out acks
+    int n_acked;                            ///< Number of acked ranges
+    dl_range_t acked[SCH_DL_MAX_RANGES];    ///< Ranges acked above the drp_ack mark, sorted
+} dl_source_t;
+
+static osSemaphore dl_sem;
+static int dl_sem_ok = 0;
+static int dl_node = -1;                    ///< Session node, -1 if not active
+static portTick dl_session_start;
+static uint32_t dl_session_ms;
+static dl_source_t dl_status;
+static dl_source_t dl_payloads[last_sensor];
+static int dl_stage_n = 0;                  ///< Frames staged for the next pass, dropped by dl_start
+
+#if SCH_DL_PASS_AUTO
+static obc_pass_t dl_pass;                  ///< Next pass, aos 0 if unknown (taskDownlink only)
+static int dl_pass_checked = 0;             ///< Last pass prediction, 0 to predict now
+static int dl_pass_staged = 0;              ///< The next pass frames were staged
+static int dl_pass_los = 0;                 ///< LOS of the last pass started
+#if SCH_DL_STAGE_FRAMES > 0
+static tm_payload_range_t dl_stage[SCH_DL_STAGE_FRAMES];    ///< Ranges of the staged frames
+static com_frame_t dl_stage_frames[SCH_DL_STAGE_FRAMES];    ///< Staged frames, ready to send
+#endif
+#endif
+
+/**
+ * Milliseconds elapsed since a tick count
+ */
+static int64_t _dl_elapsed_ms(portTick since)
+{
+    return (int64_t)(portTick)(osTaskGetTickCount() - since)*1000/osDefineTime(1000);
+}
+
+/**
+ * Drop the acked ranges below the drp_ack mark and advance the mark over the
+ * ranges that became contiguous to it. Call with dl_sem taken.
+ * @return The updated drp_ack mark of the payload
+ */
+static int _dl_update_mark(int payload)
+{
+    dl_source_t *src = &dl_payloads[payload];
+    int mark = dat_get_system_var(data_map[payload].sys_ack);
+    int mark_0 = mark;
+    int i = 0;
+    while(i < src->n_acked && src->acked[i].start <= mark)
+    {
+        if(src->acked[i].end > mark)
+            mark = src->acked[i].end;
+        i++;
+    }
+    if(i > 0)
+    {
+        memmove(src->acked, src->acked+i, (src->n_acked-i)*sizeof(dl_range_t));
+        src->n_acked -= i;
+    }
+    if(mark != mark_0)
+        dat_set_system_var(data_map[payload].sys_ack, mark);
+    return mark;
+}
+
+/**
+ * Find the next range of samples not acked, of at most one frame, from the
+ * payload cursor. Call with dl_sem taken.
+ * @param payload Payload id
+ * @param range Next range to send
+ * @return 1 if there are samples to send, 0 if not
+ */
+static int _dl_next_range(int payload, dl_range_t *range)
+{
+    dl_source_t *src = &dl_payloads[payload];
+    int mark = _dl_update_mark(payload);
+    int index = dat_get_system_var(data_map[payload].sys_index);
+    int start = src->cursor > mark ? src->cursor : mark;
+
+    // Skip the acked ranges, the first one ending after the start limits the range
+    int i;
+    for(i=0; i < src->n_acked; i++)
+    {
+        if(src->acked[i].end <= start)
+            continue;
+        if(src->acked[i].start <= start)
+        {
+            start = src->acked[i].end;
+            continue;
+        }
+        break;
+    }
+
+    int end = start + COM_FRAME_MAX_LEN/data_map[payload].size;
+    if(i < src->n_acked && end > src->acked[i].start)
+        end = src->acked[i].start;
+    if(end > index)
+        end = index;
+
+    range->start = start;
+    range->end = end;
+    return end > start;
+}
+
+/**
+ * Select the next source to send with a smooth weighted round robin among the
+ * sources with data to send. Rewinds the payloads whose samples were all sent
+ * but not acked after SCH_DL_ACK_TIMEOUT_MS. Call with dl_sem taken.
+ * @param range Range to send if a payload is selected
+ * @param room Max. bytes of the range, payloads without room for a sample
+ * are not selected
+ * @return Selected payload id, DL_SOURCE_STATUS or last_sensor if there is
+ * nothing to send
+ */
+static int _dl_select(dl_range_t *range, int room)
+{
+    dl_range_t ranges[last_sensor];
+    int pending[last_sensor];
+    int64_t total = 0;
+    int best = last_sensor;
+    int payload;
+
+    for(payload=0; payload < last_sensor; payload++)
+    {
+        dl_source_t *src = &dl_payloads[payload];
+        pending[payload] = 0;
+        if(src->weight == 0)
+            continue;
+        pending[payload] = _dl_next_range(payload, &ranges[payload]);
+        if(!pending[payload] && _dl_elapsed_ms(src->last_sent) >= SCH_DL_ACK_TIMEOUT_MS)
+        {
+            int mark = dat_get_system_var(data_map[payload].sys_ack);
+            if(src->cursor > mark)
+            {
+                src->cursor = mark;
+                pending[payload] = _dl_next_range(payload, &ranges[payload]);
+                if(pending[payload])
+                    LOGI(tag, "Payload %d: retransmitting from %d", payload, ranges[payload].start);
+            }
+        }
+        if(!pending[payload])
+            continue;
+        int fit = room/data_map[payload].size;
+        if(fit < 1)
+        {
+            pending[payload] = 0;
+            continue;
+        }
+        if(ranges[payload].end - ranges[payload].start > fit)
+            ranges[payload].end = ranges[payload].start + fit;
+
+        src->credit += src->weight;
+        total += src->weight;
+        if(best == last_sensor || src->credit > dl_payloads[best].credit)
+            best = payload;
+    }
+
+    // Beacons are interleaved with the payloads, a contact without payload
+    // data relies on the housekeeping beacons
+    if(best == last_sensor)
+        return last_sensor;
+    if(dl_status.weight > 0)
+    {
+        dl_status.credit += dl_status.weight;
+        total += dl_status.weight;
+        if(dl_status.credit > dl_payloads[best].credit)
+        {
+            dl_status.credit -= total;
+            return DL_SOURCE_STATUS;
+        }
+    }
+
+    dl_payloads[best].credit -= total;
+    *range = ranges[best];
+    return best;
+}
+
+/**
+ * Rewind the payloads to the first sample not acked and reset the round robin
+ * credits. Call with dl_sem taken.
+ */
+static void _dl_rewind(void)
+{
+    int payload;
+    for(payload=0; payload < last_sensor; payload++)
+    {
+        dl_payloads[payload].cursor = _dl_update_mark(payload);
+        dl_payloads[payload].credit = 0;
+    }
+    dl_status.credit = 0;
+}
+
+/**
+ * Start a session from the current cursors. Call with dl_sem taken.
+ */
+static void _dl_session_begin(int node, int seconds)
+{
+    dl_session_start = osTaskGetTickCount();
+    dl_session_ms = (uint32_t)seconds*1000;
+    dl_node = node;
+}
+
+#if SCH_DL_PASS_AUTO
+#if SCH_DL_STAGE_FRAMES > 0
+/**
+ * Stage the first frames of the next pass. The sources are selected as by a
+ * session started now and their frames are built in RAM, so the AOS does not
+ * wait for the storage reads. The cursors are left after the staged ranges.
+ */
+static void _dl_stage(void)
+{
+    int n = 0, tries;
+    osSemaphoreTake(&dl_sem, portMAX_DELAY);
+    _dl_rewind();
+    // Beacons are not staged, the status is sent as of the pass
+    for(tries=0; n < SCH_DL_STAGE_FRAMES && tries < 2*SCH_DL_STAGE_FRAMES; tries++)
+    {
+        dl_range_t range;
+        int source = _dl_select(&range, COM_FRAME_MAX_LEN);
+        if(source == DL_SOURCE_STATUS)
+            continue;
+        if(source < 0 || source >= last_sensor)
+            break;
+        dl_payloads[source].cursor = range.end;
+        dl_payloads[source].last_sent = osTaskGetTickCount();
+        dl_stage[n].payload = source;
+        dl_stage[n].start = range.start;
+        dl_stage[n++].end = range.end;
+    }
+    dl_stage_n = n;
+    osSemaphoreGiven(&dl_sem);
+
+    // Frames are built without the lock, only this task sends them. Ranges
+    // not built are retransmitted after the ack timeout.
+    int i;
+    for(i=0; i < n; i++)
+    {
+        if(tm_build_payload_frame(&dl_stage_frames[i], dl_stage[i].start, dl_stage[i].end, dl_stage[i].payload) != 0)
+        {
+            LOGW(tag, "Payload %d: unable to stage [%d, %d)", dl_stage[i].payload, dl_stage[i].start, dl_stage[i].end);
+            osSemaphoreTake(&dl_sem, portMAX_DELAY);
+            if(dl_stage_n > i)
+                dl_stage_n = i;
+            osSemaphoreGiven(&dl_sem);
+            break;
+        }
+    }
+    LOGI(tag, "Staged %d frames for the pass at %d", i, dl_pass.aos);
+}
+#endif
+
+/**
+ * Start the session of a pass, unless a session was started meanwhile, and
+ * send the staged frames first
+ */
+static void _dl_pass_start(int seconds)
+{
+    int node = -1, n = 0;
+    osSemaphoreTake(&dl_sem, portMAX_DELAY);
+    if(dl_node < 0)
+    {
+        _dl_session_begin(SCH_DL_PASS_NODE, seconds);
+        node = dl_node;
+        n = dl_stage_n;
+    }
+    dl_stage_n = 0;
+    osSemaphoreGiven(&dl_sem);
+    if(node < 0)
+        return;
+
+    LOGR(tag, "Pass session to node %d started (%d s, %d frames staged)", node, seconds, n);
+#if SCH_DL_STAGE_FRAMES > 0
+    if(n > 0)
+    {
+        if(tm_send_frames(dl_stage_frames, n, node) != CMD_OK)
+            LOGW(tag, "Error sending %d staged frames to node %d", n, node);
+        // Acks of the staged ranges are timed from now
+        int i;
+        osSemaphoreTake(&dl_sem, portMAX_DELAY);
+        for(i=0; i < n; i++)
+            dl_payloads[dl_stage[i].payload].last_sent = osTaskGetTickCount();
+        osSemaphoreGiven(&dl_sem);
+    }
+#endif
+}
+
+/**
+ * Predict the next pass every SCH_DL_PASS_PERIOD seconds, stage its frames
+ * before the AOS and start its session at the AOS. Called by taskDownlink
+ * while there is no session.
+ */
+static void _dl_pass_update(void)
+{
+    int now = dat_get_time();
+    int pending = dl_pass.aos > 0;
+    int staging = pending && now >= dl_pass.aos - SCH_DL_STAGE_LEAD;
+    if(!staging && (dl_pass_checked == 0 || now - dl_pass_checked >= SCH_DL_PASS_PERIOD))
+    {
+        // The search starts after the last pass, a session may end before its LOS
+        int aos = dl_pass.aos;
+        int rc = obc_next_pass(now > dl_pass_los ? now : dl_pass_los + 1, SCH_DL_PASS_HORIZON, &dl_pass);
+        dl_pass_checked = now;
+        if(rc != 0)
+            dl_pass.aos = 0;
+        if(rc < 0)
+        {
+            LOGD(tag, "Unable to predict the next pass");
+        }
+        else if(rc == 0 && dl_pass.aos != aos)
+        {
+            LOGI(tag, "Next pass AOS %d, LOS %d, max. elevation %.1f deg", dl_pass.aos, dl_pass.los, dl_pass.max_el);
+        }
+        pending = dl_pass.aos > 0;
+        staging = pending && now >= dl_pass.aos - SCH_DL_STAGE_LEAD;
+    }
+    if(!pending)
+        return;
+
+#if SCH_DL_STAGE_FRAMES > 0
+    if(staging && !dl_pass_staged)
+    {
+        _dl_stage();
+        dl_pass_staged = 1;
+    }
+#endif
+    if(now >= dl_pass.aos)
+    {
+        if(now < dl_pass.los)
+            _dl_pass_start(dl_pass.los - now);
+        dl_pass_los = dl_pass.los;
+        dl_pass.aos = 0;
+        dl_pass_staged = 0;
+        dl_pass_checked = 0;
+    }
+}
+#endif
+
+int dl_init(void)
+{
+    dl_sem_ok = osSemaphoreCreate(&dl_sem) == OS_SEMAPHORE_OK;
+    if(!dl_sem_ok)
+    {
+        LOGE(tag, "Unable to create downlink mutex");
+        return -1;
+    }
+
+    memset(&dl_status, 0, sizeof(dl_status));
+    memset(dl_payloads, 0, sizeof(dl_payloads));
+    dl_status.weight = 1;
+    int payload;
+    for(payload=0; payload < last_sensor; payload++)
+        dl_payloads[payload].weight = 1;
+    return 0;
+}
+
+int dl_start(int node, int seconds)
+{
+    if(!dl_sem_ok || node < 0 || seconds <= 0)
+        return -1;
+
+    osSemaphoreTake(&dl_sem, portMAX_DELAY);
+    _dl_rewind();
+    _dl_session_begin(node, seconds);
+    dl_stage_n = 0;
+    osSemaphoreGiven(&dl_sem);
+
+    LOGR(tag, "Session to node %d started (%d s)", node, seconds);
+    return 0;
+}
+
+int dl_stop(void)
+{
+    if(!dl_sem_ok)
+        return -1;
+
+    osSemaphoreTake(&dl_sem, portMAX_DELAY);
+    int node = dl_node;
+    dl_node = -1;
+    osSemaphoreGiven(&dl_sem);
+
+    if(node >= 0)
+        LOGR(tag, "Session to node %d stopped", node);
+    return 0;
+}
+
+int dl_set_weight(int source, unsigned int weight)
+{
+    if(!dl_sem_ok || source < DL_SOURCE_STATUS || source >= last_sensor)
+        return -1;
+
+    osSemaphoreTake(&dl_sem, portMAX_DELAY);
+    dl_source_t *src = source == DL_SOURCE_STATUS ? &dl_status : &dl_payloads[source];
+    src->weight = weight;
+    src->credit = 0;
+    osSemaphoreGiven(&dl_sem);
+    return 0;
+}
+
+/**
+ * Merge the acked samples [start, end) with the overlapping or adjacent
+ * ranges, keeping them sorted. Call with dl_sem taken.
+ * @return 0 if OK, -1 if there are SCH_DL_MAX_RANGES ranges already
+ */
+static int _dl_merge(dl_source_t *src, int start, int end)
+{
+    int i = 0, j;
+    while(i < src->n_acked && src->acked[i].end < start)
+        i++;
+    j = i;
+    while(j < src->n_acked && src->acked[j].start <= end)
+    {
+        if(src->acked[j].start < start)
+            start = src->acked[j].start;
+        if(src->acked[j].end > end)
+            end = src->acked[j].end;
+        j++;
+    }
+    if(end <= start)
+        return 0;
+    if(i == j && src->n_acked >= SCH_DL_MAX_RANGES)
+        return -1;
+
+    int n_after = src->n_acked - j;
+    memmove(&src->acked[i+1], &src->acked[j], n_after*sizeof(dl_range_t));
+    src->acked[i].start = start;
+    src->acked[i].end = end;
+    src->n_acked = i + 1 + n_after;
+    return 0;
+}
+
+int dl_ack(int payload, int start, int end)
+{
+    if(!dl_sem_ok || payload < 0 || payload >= last_sensor || start < 0 || end <= start)
+        return -1;
+
+    osSemaphoreTake(&dl_sem, portMAX_DELAY);
+    // Samples not stored yet can't be acked
+    int index = dat_get_system_var(data_map[payload].sys_index);
+    if(end > index)
+        end = index;
+    int rc = _dl_merge(&dl_payloads[payload], start, end);
+    _dl_update_mark(payload);
+    osSemaphoreGiven(&dl_sem);
+
+    if(rc != 0)
+        LOGW(tag, "Payload %d: too many acked ranges, [%d, %d) will be retransmitted", payload, start, end);
+    return rc;
+}
+
+int dl_ack_rle(int payload, int base, const uint16_t *runs, int n_runs)
+{
+    if(!dl_sem_ok || payload < 0 || payload >= last_sensor || base < 0 || n_runs < 0 || (n_runs > 0 && runs == NULL))
+        return -1;
+
+    int i, dropped = 0, missing = -1;
+    int start = base;
+    osSemaphoreTake(&dl_sem, portMAX_DELAY);
+    dl_source_t *src = &dl_payloads[payload];
+    int index = dat_get_system_var(data_map[payload].sys_index);
+    for(i=0; i < n_runs && start < index; i++)
+    {
+        int end = start + runs[i];
+        if(end > index)
+            end = index;
+        if(i % 2 == 0)
+        {
+            if(_dl_merge(src, start, end) != 0)
+                dropped += end - start;
+        }
+        else if(missing < 0 && end > start && i+1 < n_runs)
+        {
+            // A gap followed by received samples was lost, not delayed
+            missing = start;
+        }
+        start = end;
+    }
+    int mark = _dl_update_mark(payload);
+    // Lost samples already sent are resent now instead of after the ack timeout
+    if(missing >= mark && missing < src->cursor)
+        src->cursor = missing;
+    osSemaphoreGiven(&dl_sem);
+
+    if(dropped > 0)
+        LOGW(tag, "Payload %d: too many acked ranges, %d samples will be retransmitted", payload, dropped);
+    if(missing >= 0)
+        LOGD(tag, "Payload %d: samples from %d lost", payload, missing);
+    return dropped > 0 ? -1 : 0;
+}
+
+void dl_print_status(void)
+{
+    if(!dl_sem_ok)
+        return;
+
+    osSemaphoreTake(&dl_sem, portMAX_DELAY);
+    if(dl_node >= 0)
+    {
+        LOGR(tag, "Session to node %d, %d of %u s", dl_node,
+             (int)(_dl_elapsed_ms(dl_session_start)/1000), dl_session_ms/1000);
+    }
+    else
+    {
+        LOGR(tag, "No session");
+    }
+    LOGR(tag, "Status: weight %u", dl_status.weight);
+    LOGR(tag, "Staged frames: %d", dl_stage_n);
+
+    int payload, i;
+    char ranges[SCH_BUFF_MAX_LEN];
+    for(payload=0; payload < last_sensor; payload++)
+    {
+        dl_source_t *src = &dl_payloads[payload];
+        int mark = _dl_update_mark(payload);
+        int len = 0;
+        ranges[0] = '\0';
+        for(i=0; i < src->n_acked && len < (int)sizeof(ranges); i++)
+            len += snprintf(ranges+len, sizeof(ranges)-len, " [%d, %d)", src->acked[i].start, src->acked[i].end);
+        LOGR(tag, "Payload %d: weight %u, index %d, ack %d, cursor %d, acked%s", payload, src->weight,
+             dat_get_system_var(data_map[payload].sys_index), mark, src->cursor, ranges);
+    }
+    osSemaphoreGiven(&dl_sem);
+}
+
+void taskDownlink(void *param)
+{
+    LOGI(tag, "Started");
+
+    while(1)
+    {
+        if(!dl_sem_ok)
+        {
+            osDelay(SCH_DL_IDLE_MS);
+            continue;
+        }
+
+        osSemaphoreTake(&dl_sem, portMAX_DELAY);
+        int node = dl_node;
+        if(node >= 0 && _dl_elapsed_ms(dl_session_start) >= dl_session_ms)
+        {
+            LOGR(tag, "Session to node %d finished", node);
+            node = dl_node = -1;
+        }
+        dl_range_t range = {0, 0};
+        int source = node >= 0 ? _dl_select(&range, COM_FRAME_MAX_LEN) : last_sensor;
+        if(source >= 0 && source < last_sensor)
+        {
+            dl_payloads[source].cursor = range.end;
+            dl_payloads[source].last_sent = osTaskGetTickCount();
+        }
+#if DL_MUX
+        // Fill a partial frame with the next payloads selected, a status
+        // beacon selected meanwhile is sent after the frame
+        tm_payload_range_t mux[DL_MUX_MAX_RANGES];
+        int n_mux = 0, mux_status = 0;
+        int used = (range.end - range.start)*(source >= 0 && source < last_sensor ? data_map[source].size : 0);
+        int full = source >= 0 && source < last_sensor &&
+                   range.end - range.start == COM_FRAME_MAX_LEN/data_map[source].size;
+        if(source >= 0 && source < last_sensor && !full && used + TM_MUX_HEADER_LEN <= COM_FRAME_MAX_LEN)
+        {
+            mux[n_mux].payload = source;
+            mux[n_mux].start = range.start;
+            mux[n_mux++].end = range.end;
+            used += TM_MUX_HEADER_LEN;
+            while(n_mux < (int)DL_MUX_MAX_RANGES)
+            {
+                int next = _dl_select(&range, COM_FRAME_MAX_LEN - used - TM_MUX_HEADER_LEN);
+                if(next == DL_SOURCE_STATUS)
+                    mux_status = 1;
+                if(next < 0 || next >= last_sensor)
+                    break;
+                dl_payloads[next].cursor = range.end;
+                dl_payloads[next].last_sent = osTaskGetTickCount();
+                mux[n_mux].payload = next;
+                mux[n_mux].start = range.start;
+                mux[n_mux++].end = range.end;
+                used += TM_MUX_HEADER_LEN + (range.end - range.start)*data_map[next].size;
+            }
+        }
+#endif
+        osSemaphoreGiven(&dl_sem);
+
+        // Frames are sent without the lock, the TX pacer sets the rate
+#if DL_MUX
+        if(n_mux > 0)
+        {
+            LOGD(tag, "Sending %d payload ranges, %d bytes", n_mux, used);
+            if(tm_send_payload_mux(mux, n_mux, node) != CMD_OK)
+                LOGW(tag, "Error sending %d payload ranges", n_mux);
+            if(mux_status && tm_send_status_node(node) != CMD_OK)
+                LOGW(tag, "Error sending status to node %d", node);
+        }
+        else
+#endif
+        if(source == DL_SOURCE_STATUS)
+        {
+            if(tm_send_status_node(node) != CMD_OK)
+                LOGW(tag, "Error sending status to node %d", node);
+        }
+        else if(source < last_sensor)
+        {
+            LOGD(tag, "Payload %d: sending [%d, %d)", source, range.start, range.end);
+            if(tm_send_payload_range(range.start, range.end, source, node) != CMD_OK)
+                LOGW(tag, "Error sending payload %d [%d, %d)", source, range.start, range.end);
+        }
+        else
+        {
+#if SCH_DL_PASS_AUTO
+            if(node < 0)
+                _dl_pass_update();
+#endif
+            osDelay(SCH_DL_IDLE_MS);
+        }
+    }
+}
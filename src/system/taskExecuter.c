@@ -18,6 +18,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_TAG_ID LOG_TAG_EXECUTER
 #include "taskExecuter.h"
 
 static const char *tag = "Executer";
@@ -26,32 +27,67 @@ void taskExecuter(void *param)
 {
     LOGI(tag, "Started");
 
+    /* Workers receive their queue as parameter, see main.c */
+    osQueue exe_queue = param != NULL ? *(osQueue *)param : executer_cmd_queue;
+
     cmd_t *run_cmd = NULL;
     int cmd_stat, queue_stat;
+    int executed_cmds, failed_cmds;
         
     while(1)
     {
         /* Read the CMD that Dispatcher sent - BLOCKING */
-        queue_stat = osQueueReceive(executer_cmd_queue, &run_cmd, portMAX_DELAY);
+        queue_stat = osQueueReceive(exe_queue, &run_cmd, portMAX_DELAY);
+
+        /* A NULL marker stands for the next high priority command */
+        if(queue_stat == pdPASS && run_cmd == NULL)
+            run_cmd = cmd_queue_high(exe_queue);
 
-        if(queue_stat == pdPASS)
+        if(queue_stat == pdPASS && run_cmd != NULL)
         {
-            if(log_lvl >= LOG_LVL_INFO)
+            LOGI(tag, "Running the command: %s...", cmd_get_name(run_cmd->id));
+
+            /* Execute the command, identical commands are queued again */
+            cmd_coalesce_done(run_cmd);
+            portTick t_start = cmd_exec_begin(run_cmd);
+            cmd_lat_mark(run_cmd, CMD_LAT_START);
+            cmd_stat = run_cmd->function(run_cmd->fmt, run_cmd->params, run_cmd->nparams);
+            cmd_stats_add(run_cmd, t_start, osTaskGetTickCount(), cmd_stat != CMD_CONTINUE);
+
+            /* Chunked commands go back to the end of the queue, so the queued
+             * commands run before their next chunk. If the queue is full the
+             * next chunk runs right away */
+            while(cmd_stat == CMD_CONTINUE)
             {
-                char *cmd_name = cmd_get_name(run_cmd->id);
-                LOGI(tag, "Running the command: %s...", cmd_name);
-                free(cmd_name);
+                // The wait for the next chunk is measured from here
+                run_cmd->t_dispatch = osTaskGetTickCount();
+                if(osQueueSend(exe_queue, &run_cmd, 0) == pdPASS)
+                    break;
+                t_start = cmd_exec_begin(run_cmd);
+                cmd_stat = run_cmd->function(run_cmd->fmt, run_cmd->params, run_cmd->nparams);
+                cmd_stats_add(run_cmd, t_start, osTaskGetTickCount(), cmd_stat != CMD_CONTINUE);
             }
+            if(cmd_stat == CMD_CONTINUE)
+                continue;
 
-            /* Execute the command */
-            cmd_stat = run_cmd->function(run_cmd->fmt, run_cmd->params, run_cmd->nparams);
+            cmd_lat_mark(run_cmd, CMD_LAT_END);
+            cmd_done(run_cmd, cmd_stat);
             cmd_free(run_cmd);
             run_cmd = NULL;
 
             LOGI(tag, "Command result: %d", cmd_stat);
 
-            /* Send the result to Dispatcher - BLOCKING */
-            osQueueSend(executer_stat_queue, &cmd_stat, portMAX_DELAY);
+            /* Update the executed and failed commands count */
+            int workers = executer_io_queue != 0 || executer_cpu_queue != 0;
+            if(workers) osSemaphoreTake(&executer_stat_sem, portMAX_DELAY);
+            executed_cmds = dat_get_system_var(dat_obc_executed_cmds);
+            dat_set_system_var(dat_obc_executed_cmds, executed_cmds + 1);
+            if (cmd_stat != CMD_OK)
+            {
+                failed_cmds = dat_get_system_var(dat_obc_failed_cmds);
+                dat_set_system_var(dat_obc_failed_cmds, failed_cmds + 1);
+            }
+            if(workers) osSemaphoreGiven(&executer_stat_sem);
         }
     }
 }
@@ -18,56 +18,113 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_TAG_ID LOG_TAG_FP
 #include "taskFlightPlan.h"
 
 static const char *tag = "FlightPlan"; 
 
+/**
+ * Convert an OS ticks count to microseconds
+ */
+static int64_t ticks_to_us(portTick ticks)
+{
+    return (int64_t)ticks*1000000/osDefineTime(1000);
+}
+
+/**
+ * Build the command of a flight plan entry, NULL if it does not exist
+ */
+static cmd_t *fp_entry_cmd(fp_entry_t *entry)
+{
+    LOGI(tag, "Command: %s", entry->cmd);
+    LOGI(tag, "Arguments: %s", entry->args);
+    LOGI(tag, "Executions: %d", entry->executions);
+    LOGI(tag, "Period: %d", entry->periodical);
+
+    cmd_t *new_cmd = cmd_get_str(entry->cmd);
+    if(new_cmd == NULL)
+    {
+        LOGE(tag, "Flight plan command not found: %s", entry->cmd);
+        return NULL;
+    }
+    cmd_add_params_str(new_cmd, entry->args);
+    return new_cmd;
+}
+
 void taskFlightPlan(void *param)
 {
 
     LOGI(tag, "Started");
-    char command[SCH_CMD_MAX_STR_NAME];
-    char args[SCH_CMD_MAX_STR_PARAMS];
-    int executions;
-    int period;
-    int i;
-    portTick delay_ms = 1000;          //Task period in [ms]
-    portTick xLastWakeTime = osTaskGetTickCount();
+    fp_entry_t entry;
+    int pending = 0;                   // entry was taken from the plan, but not sent yet
+    uint32_t max_delay_ms = 60000;     //Max. sleep time [ms], bounds clock adjustments
+    uint32_t delay_ms;
 
     time_t elapsed_sec;   // Seconds counter
+    int elapsed_ms;       // Milliseconds after elapsed_sec
 
     while(1)
     {
-        osTaskDelayUntil(&xLastWakeTime, delay_ms); //Suspend task
-        // Get next command in the flight plan, if any
+        // Execute every command due, including the ones that were missed
         elapsed_sec = dat_get_time();
-        int rc = dat_get_fp((int)elapsed_sec, command, args, &executions, &period);
-        if(rc == -1)
-            continue;
+        while(pending || dat_get_fp_entry((int)elapsed_sec, &entry) == 0)
+        {
+            // Entries with the same time and ms are sent together, in the
+            // flight plan order
+            cmd_t *cmds[SCH_CMD_BATCH_MAX];
+            int n = 0;
+            int unixtime = entry.unixtime, ms = entry.ms;
+            pending = 0;
+            while(1)
+            {
+                cmd_t *new_cmd = fp_entry_cmd(&entry);
+                if(new_cmd != NULL)
+                    cmds[n++] = new_cmd;
+                if(n == SCH_CMD_BATCH_MAX || dat_get_fp_next() != unixtime ||
+                   dat_get_fp_entry((int)elapsed_sec, &entry) != 0)
+                    break;
+                if(entry.ms != ms)
+                {
+                    pending = 1;
+                    break;
+                }
+            }
+            if(n == 0)
+                continue;
 
-        LOGI(tag, "Command: %s", command);
-        LOGI(tag, "Arguments: %s", args);
-        LOGI(tag, "Executions: %d", executions);
-        LOGI(tag, "Period: %d", period);
+            // Wait for the entry milliseconds with the monotonic OS ticks, the
+            // wall clock is only read once to get the delay
+            portTick last_tick = osTaskGetTickCount();
+            time_t now_sec = dat_get_time_ms(&elapsed_ms);
+            int64_t wait_ms = ((int64_t)unixtime - (int64_t)now_sec)*1000 + ms - elapsed_ms;
+            portTick start_tick = last_tick;
+            if(wait_ms > 0)
+                osTaskDelayUntil(&last_tick, (uint32_t)wait_ms);
 
-        // Send the command for N execution
-        dat_set_system_var(dat_fpl_last, (int) elapsed_sec);
+            // Send the commands for N execution
+            dat_set_system_var(dat_fpl_last, (int)dat_get_time());
+            if(n == 1)
+                cmd_send(cmds[0]);
+            else
+                cmd_send_batch(cmds, n, 0, portMAX_DELAY);
 
-        /*If command has to be executed again, set it in flight plan for next execution*/
-        if (period>0 && executions>1) {
-            dat_set_fp((int)elapsed_sec + period, command, args, executions - 1, period);
+            // Entries missed by more than a second are not timing samples
+            if(wait_ms > -1000)
+            {
+                int64_t jitter_us = ticks_to_us(osTaskGetTickCount() - start_tick) - wait_ms*1000;
+                dat_add_fp_jitter((int32_t)jitter_us);
+            }
         }
 
-        /*If command has to be executed*/
-        cmd_t *new_cmd = cmd_get_str(command);
-        cmd_add_params_str(new_cmd, args);
-        cmd_send(new_cmd);
-
-        /*for(i=0; i < executions; i++)
+        // Sleep until the next command is due, or a new command is added
+        int next_sec = dat_get_fp_next();
+        delay_ms = max_delay_ms;
+        if(next_sec != -1)
         {
-            cmd_t *new_cmd = cmd_get_str(command);
-            cmd_add_params_str(new_cmd, args);
-            cmd_send(new_cmd);
-        }*/
+            int64_t wait_ms = ((int64_t)next_sec - (int64_t)dat_get_time_ms(&elapsed_ms))*1000 - elapsed_ms;
+            if(wait_ms < max_delay_ms)
+                delay_ms = wait_ms > 0 ? (uint32_t)wait_ms : 0;
+        }
+        dat_wait_fp(delay_ms);
     }
-}
\ No newline at end of file
+}
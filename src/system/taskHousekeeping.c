@@ -18,9 +18,159 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_TAG_ID LOG_TAG_HK
 #include "taskHousekeeping.h"
 
 static const char *tag = "Housekeeping";
+static osPeriod hk_period;  ///< Loop timing (see obc_task_stats)
+
+static hk_job_t hk_jobs[SCH_HK_JOBS_MAX];
+static osSemaphore hk_sem;
+static int hk_sem_ok = 0;
+static int hk_jobs_loaded = 0;
+
+/**
+ * Default jobs. The phases spread the jobs, so the 1 min, 5 min and 1 hour
+ * jobs do not run in the same second. The EPS and OBC sensors alternate every
+ * 5 minutes.
+ */
+static const struct {
+    char *cmd;
+    unsigned int period;
+    unsigned int phase;
+    int enable_var;
+    char *params;
+} hk_jobs_default[] = {
+    {"obc_prop_tle",      10,                        0,       dat_ads_tle_epoch, "0"},   // Update position, with a valid TLE
+    {"eps_update_status", 60,                        13,      -1,                ""},
+    {"obc_update_status", 60,                        17,      -1,                ""},
+    {"drp_sync",          SCH_STORAGE_CACHE_SYNC,    29,      -1,                ""},    // Write back status variables
+    {"drp_trim",          SCH_STORAGE_RETAIN_PERIOD, 41,      -1,                ""},    // Payload retention
+    {"eps_get_hk",        10*60,                     37,      -1,                ""},
+    {"obc_get_sensors",   10*60,                     5*60+37, -1,                ""},
+    {"drp_add_hrs_alive", 60*60,                     53,      -1,                "1"},   // Add 1hr
+};
+
+int hk_jobs_init(void)
+{
+    hk_sem_ok = osSemaphoreCreate(&hk_sem) == OS_SEMAPHORE_OK;
+    if(!hk_sem_ok)
+    {
+        LOGE(tag, "Unable to create housekeeping jobs mutex");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Set a job slot, the caller holds hk_sem
+ */
+static int _hk_job_set(int slot, unsigned int period, unsigned int phase, int enable_var, char *cmd, char *params)
+{
+    int cmd_id = cmd_resolve(cmd);
+    if(slot < 0 || slot >= SCH_HK_JOBS_MAX || period == 0 || cmd_id < 0)
+        return -1;
+    hk_jobs[slot].cmd_id = cmd_id;
+    hk_jobs[slot].period = period;
+    hk_jobs[slot].phase = phase;
+    hk_jobs[slot].enable_var = enable_var;
+    memset(hk_jobs[slot].params, 0, sizeof(hk_jobs[slot].params));
+    if(params != NULL)
+        strncpy(hk_jobs[slot].params, params, sizeof(hk_jobs[slot].params)-1);
+    return 0;
+}
+
+int hk_jobs_reset(void)
+{
+    if(!hk_sem_ok)
+        return -1;
+
+    int i, n = 0;
+    osSemaphoreTake(&hk_sem, portMAX_DELAY);
+    for(i = 0; i < SCH_HK_JOBS_MAX; i++)
+        hk_jobs[i].cmd_id = -1;
+    for(i = 0; i < (int)(sizeof(hk_jobs_default)/sizeof(hk_jobs_default[0])); i++)
+    {
+        if(_hk_job_set(n, hk_jobs_default[i].period, hk_jobs_default[i].phase, hk_jobs_default[i].enable_var,
+                       hk_jobs_default[i].cmd, hk_jobs_default[i].params) == 0)
+            n++;
+        else
+            LOGW(tag, "Default job %s not loaded", hk_jobs_default[i].cmd);
+    }
+    hk_jobs_loaded = 1;
+    osSemaphoreGiven(&hk_sem);
+    return n;
+}
+
+int hk_job_set(int slot, unsigned int period, unsigned int phase, char *cmd, char *params)
+{
+    if(!hk_sem_ok)
+        return -1;
+    osSemaphoreTake(&hk_sem, portMAX_DELAY);
+    int rc = _hk_job_set(slot, period, phase, -1, cmd, params);
+    osSemaphoreGiven(&hk_sem);
+    return rc;
+}
+
+int hk_job_delete(int slot)
+{
+    if(!hk_sem_ok || slot < 0 || slot >= SCH_HK_JOBS_MAX)
+        return -1;
+    osSemaphoreTake(&hk_sem, portMAX_DELAY);
+    hk_jobs[slot].cmd_id = -1;
+    osSemaphoreGiven(&hk_sem);
+    return 0;
+}
+
+int hk_job_get(int slot, hk_job_t *job)
+{
+    if(!hk_sem_ok || slot < 0 || slot >= SCH_HK_JOBS_MAX)
+        return -1;
+    osSemaphoreTake(&hk_sem, portMAX_DELAY);
+    *job = hk_jobs[slot];
+    osSemaphoreGiven(&hk_sem);
+    return job->cmd_id >= 0 ? 0 : -1;
+}
+
+/**
+ * Send the jobs due at @elapsed_sec
+ */
+static void _hk_run_jobs(unsigned int elapsed_sec)
+{
+    int i;
+    hk_job_t job;
+    for(i = 0; i < SCH_HK_JOBS_MAX; i++)
+    {
+        // Copy the job, the command is sent without holding the table
+        osSemaphoreTake(&hk_sem, portMAX_DELAY);
+        job = hk_jobs[i];
+        osSemaphoreGiven(&hk_sem);
+
+        if(job.cmd_id < 0 || elapsed_sec <= job.phase || (elapsed_sec - job.phase) % job.period != 0)
+            continue;
+        if(job.enable_var >= 0 && dat_get_system_var((dat_status_address_t)job.enable_var) <= 0)
+            continue;
+
+        cmd_t *cmd = cmd_get_idx(job.cmd_id);
+        if(cmd == NULL)
+            continue;
+        if(job.params[0] != '\0')
+            cmd_add_params_str(cmd, job.params);
+        cmd_try_send(cmd);
+    }
+}
+
+#define HK_BCN (!(SCH_COMM_ENABLE && SCH_TASK_BCN_ENABLED))  ///< Send the beacon from here (see taskBeacon)
+
+#if HK_BCN
+/* Beacon period, updated when dat_com_bcn_period changes (see dat_subscribe) */
+static volatile int hk_bcn_period;
+
+static void _hk_bcn_period_changed(dat_status_address_t index, value32_t value, void *arg)
+{
+    hk_bcn_period = value.i;
+}
+#endif
 
 void taskHousekeeping(void *param)
 {
@@ -28,27 +178,34 @@ void taskHousekeeping(void *param)
 
     portTick delay_ms    = 1000;            //Task period in [ms]
 
-    unsigned int elapsed_sec = 1;           // Seconds counter
-    unsigned int _10sec_check = 10;         //10[s] condition
-    unsigned int _01min_check = 1*60;       //05[m] condition
-    unsigned int _05min_check = 5*60;       //05[m] condition
-    unsigned int _1hour_check = 60*60;      //01[h] condition
-    /*Get OBC beacon period*/
-    int obc_bcn_period = dat_get_system_var(dat_com_bcn_period);
+    unsigned int elapsed_sec = 0;           // Seconds counter
+#if HK_BCN
+    /*Get OBC beacon period, then follow its changes instead of polling it*/
+    int bcn_sub = dat_subscribe(dat_com_bcn_period, _hk_bcn_period_changed, NULL, NULL, 0);
+    hk_bcn_period = dat_get_system_var(dat_com_bcn_period);
+    int obc_bcn_period = hk_bcn_period;
     int last_obc_bcn_period = obc_bcn_period;
+    int cmd_tm_send_status_id = cmd_resolve("tm_send_status");
+#endif
+
+    /* Resolve periodic commands once */
+    int cmd_dbg_id = cmd_resolve("obc_debug");
+    if(!hk_sem_ok)
+        hk_jobs_init();
+    if(!hk_jobs_loaded)
+        LOGI(tag, "%d periodic jobs", hk_jobs_reset());
 
-    portTick xLastWakeTime = osTaskGetTickCount();
+    osPeriodInit(&hk_period, "Housekeeping", delay_ms);
 
     while(1)
     {
-        osTaskDelayUntil(&xLastWakeTime, delay_ms); //Suspend task
+        osPeriodDelay(&hk_period); //Suspend task
         elapsed_sec += delay_ms / 1000; //Update seconds counts
+        dat_clock_tick();
 
-        /* 1 second actions */
-        dat_set_system_var(dat_rtc_date_time, (int) time(NULL));
-
+#if HK_BCN
         /* Send OBC beacon */
-        int curr_obc_beacon_period = dat_get_system_var(dat_com_bcn_period);
+        int curr_obc_beacon_period = bcn_sub >= 0 ? hk_bcn_period : (int)dat_get_system_var(dat_com_bcn_period);
         if(curr_obc_beacon_period != last_obc_bcn_period)
         {
             obc_bcn_period = curr_obc_beacon_period;
@@ -59,68 +216,26 @@ void taskHousekeeping(void *param)
         if (obc_bcn_period < 0)
         {
             cmd_t *cmd_tm_send_status;
-            cmd_tm_send_status = cmd_build_from_str("tm_send_status 10");
-            cmd_send(cmd_tm_send_status);
+            cmd_tm_send_status = cmd_get_idx(cmd_tm_send_status_id);
+            cmd_add_params_str(cmd_tm_send_status, "10");
+            cmd_try_send(cmd_tm_send_status);
             obc_bcn_period = curr_obc_beacon_period;
         }
+#endif
 
         //  Debug command
-        if(log_lvl > LOG_LVL_DEBUG)
+        if(LOG_ENABLED(LOG_LVL_VERBOSE))
         {
-            cmd_t *cmd_dbg = cmd_get_str("obc_debug");
+            cmd_t *cmd_dbg = cmd_get_idx(cmd_dbg_id);
             cmd_add_params_var(cmd_dbg, 0);
-            cmd_send(cmd_dbg);
+            cmd_try_send(cmd_dbg);
         }
 
-        /* 10 sec actions */
-        // Update position
-        if ((elapsed_sec % _10sec_check) == 0)
-        {
-            // Check if the TLE epoch is valid
-            int tle_epoch = dat_get_system_var(dat_ads_tle_epoch);
-            if(tle_epoch > 0)
-            {
-                cmd_t *cmd_tle_prop;
-                cmd_tle_prop = cmd_get_str("obc_prop_tle");
-                cmd_add_params_str(cmd_tle_prop, "0");
-                cmd_send(cmd_tle_prop);
-            }
-        }
+        /* Report hung commands, checked here as the executer may be blocked */
+        cmd_check_overruns();
 
-        /* 1 minute actions */
-        // Update status vars
-        if ((elapsed_sec % _01min_check) == 0)
-        {
-            cmd_t *cmd_update;
-            cmd_update = cmd_get_str("eps_update_status");
-            cmd_send(cmd_update);
-            cmd_update = cmd_get_str("obc_update_status");
-            cmd_send(cmd_update);
-        }
-
-        /* 5 minutes actions */
-        //  Sample OBC payloads
-        if ((elapsed_sec % _05min_check) == 0)
-        {
-            if ((elapsed_sec % _05min_check*2) == 0)
-            {
-                cmd_t *cmd_get_eps = cmd_get_str("eps_get_hk");
-                cmd_send(cmd_get_eps);
-            }
-            else
-            {
-                cmd_t *cmd_get_obc = cmd_get_str("obc_get_sensors");
-                cmd_send(cmd_get_obc)
-            }
-        }
-
-        /* 1 hours actions */
-        if((elapsed_sec % _1hour_check) == 0)
-        {
-            LOGD(tag, "1 hour check");
-            cmd_t *cmd_1h = cmd_get_str("drp_add_hrs_alive");
-            cmd_add_params_var(cmd_1h, 1); // Add 1hr
-            cmd_send(cmd_1h);
-        }
+        /* Periodic jobs */
+        if(hk_sem_ok)
+            _hk_run_jobs(elapsed_sec);
     }
 }
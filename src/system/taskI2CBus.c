@@ -0,0 +1,348 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "taskI2CBus.h"
+
+static const char *tag = "I2CBus";
+
+/**
+ * Bus manager context
+ */
+typedef struct i2c_bus {
+    i2c_bus_transfer_f transfer;    ///< Platform transfer function, NULL if the bus is not registered
+    osQueue queue;                  ///< Pending transactions, by reference
+    osSemaphore sem;                ///< Held while the bus is in use
+    osEvent release;                ///< Set by i2c_bus_release, waited by the bus task
+    int running;                    ///< The bus task is running, transactions are queued
+    int lock_direct;                ///< The bus was acquired in the caller, without the bus task
+    char name[8];                   ///< Queue and lock name
+    i2c_bus_stats_t stats;
+} i2c_bus_t;
+
+/**
+ * Task waiting for its transaction, @see i2c_bus_transaction
+ */
+typedef struct i2c_bus_waiter {
+    int busy;
+    int rc;
+    osEvent event;
+} i2c_bus_waiter_t;
+
+static i2c_bus_t i2c_buses[SCH_I2C_BUSES];
+static i2c_bus_waiter_t i2c_waiters[SCH_I2C_WAITERS];
+static osSemaphore i2c_sem;     ///< Protects the waiters and the counters
+static int i2c_sem_ok = 0;
+
+/**
+ * Get a registered bus
+ * @return Bus or NULL if it is not registered
+ */
+static i2c_bus_t *_i2c_bus_get(int bus)
+{
+    if(bus < 0 || bus >= SCH_I2C_BUSES || i2c_buses[bus].transfer == NULL)
+        return NULL;
+    return &i2c_buses[bus];
+}
+
+/**
+ * Update the counters of a completed transaction
+ */
+static void _i2c_bus_count(i2c_bus_t *b, int prio, int rc, uint32_t wait_ms)
+{
+    osSemaphoreTake(&i2c_sem, portMAX_DELAY);
+    b->stats.done++;
+    if(rc != 0)
+        b->stats.errors++;
+    if(wait_ms > b->stats.max_wait_ms[prio])
+        b->stats.max_wait_ms[prio] = wait_ms;
+    osSemaphoreGiven(&i2c_sem);
+}
+
+/**
+ * Run the transfers of a transaction with the bus locked
+ */
+static int _i2c_bus_run(i2c_bus_t *b, int bus, i2c_bus_trans_t *trans)
+{
+    osSemaphoreTake(&b->sem, portMAX_DELAY);
+    int rc = b->transfer(bus, trans->xfers, trans->n, trans->timeout_ms);
+    osSemaphoreGiven(&b->sem);
+    if(rc != 0)
+        LOGW(tag, "Bus %d, transaction to %#X failed", bus, trans->xfers[0].addr);
+    return rc != 0 ? -1 : 0;
+}
+
+/**
+ * Take a waiter, @see i2c_bus_transaction
+ * @return Waiter or NULL if all are busy
+ */
+static i2c_bus_waiter_t *_i2c_bus_waiter_get(void)
+{
+    int i;
+    osSemaphoreTake(&i2c_sem, portMAX_DELAY);
+    for(i = 0; i < SCH_I2C_WAITERS && i2c_waiters[i].busy; i++);
+    if(i < SCH_I2C_WAITERS)
+        i2c_waiters[i].busy = 1;
+    osSemaphoreGiven(&i2c_sem);
+
+    if(i == SCH_I2C_WAITERS)
+    {
+        LOGW(tag, "No waiters for the I2C transaction");
+        return NULL;
+    }
+    return &i2c_waiters[i];
+}
+
+static void _i2c_bus_waiter_free(i2c_bus_waiter_t *waiter)
+{
+    osSemaphoreTake(&i2c_sem, portMAX_DELAY);
+    waiter->busy = 0;
+    osSemaphoreGiven(&i2c_sem);
+}
+
+/**
+ * Completion callback of the waited transactions
+ */
+static void _i2c_bus_wake(i2c_bus_trans_t *trans, int rc, void *arg)
+{
+    i2c_bus_waiter_t *waiter = (i2c_bus_waiter_t *)arg;
+    waiter->rc = rc;
+    osEventSet(&waiter->event, 1);
+}
+
+/**
+ * Queue a transaction and wait for its completion. The bus task always
+ * completes the queued transactions, the transfers have their own timeout.
+ */
+static int _i2c_bus_wait(int bus, i2c_bus_trans_t *trans)
+{
+    i2c_bus_waiter_t *waiter = _i2c_bus_waiter_get();
+    if(waiter == NULL)
+        return -1;
+
+    trans->done = _i2c_bus_wake;
+    trans->done_arg = waiter;
+    int rc = i2c_bus_submit(bus, trans);
+    if(rc == 0)
+    {
+        osEventWait(&waiter->event, 1, portMAX_DELAY);
+        rc = waiter->rc;
+    }
+    _i2c_bus_waiter_free(waiter);
+    return rc;
+}
+
+int i2c_bus_init(int bus, i2c_bus_transfer_f transfer)
+{
+    int i;
+    if(bus < 0 || bus >= SCH_I2C_BUSES || transfer == NULL)
+    {
+        LOGE(tag, "Invalid I2C bus %d", bus);
+        return -1;
+    }
+    if(!i2c_sem_ok)
+    {
+        i2c_sem_ok = osSemaphoreCreate(&i2c_sem) == OS_SEMAPHORE_OK;
+        for(i = 0; i < SCH_I2C_WAITERS; i++)
+        {
+            i2c_waiters[i].busy = 0;
+            osEventCreate(&i2c_waiters[i].event);
+        }
+    }
+
+    i2c_bus_t *b = &i2c_buses[bus];
+    if(b->transfer != NULL)
+    {
+        b->transfer = transfer;
+        return 0;
+    }
+
+    snprintf(b->name, sizeof(b->name), "i2c%d", bus);
+    b->queue = osQueueCreateType(SCH_I2C_QUEUE_LEN, sizeof(i2c_bus_trans_t *), OS_QUEUE_MPSC);
+    if(!i2c_sem_ok || b->queue == NULL || osSemaphoreCreate(&b->sem) != OS_SEMAPHORE_OK ||
+       osEventCreate(&b->release) != OS_SEMAPHORE_OK)
+    {
+        LOGE(tag, "Unable to create the I2C bus %d", bus);
+        return -1;
+    }
+    osQueueSetName(b->queue, b->name);
+    osSemaphoreSetName(&b->sem, b->name);
+    memset(&b->stats, 0, sizeof(b->stats));
+    b->running = 0;
+    b->lock_direct = 0;
+    b->transfer = transfer;
+    return 0;
+}
+
+int i2c_bus_registered(int bus)
+{
+    return _i2c_bus_get(bus) != NULL;
+}
+
+int i2c_bus_submit(int bus, i2c_bus_trans_t *trans)
+{
+    i2c_bus_t *b = _i2c_bus_get(bus);
+    if(b == NULL || trans == NULL || (!trans->lock && (trans->n < 1 || trans->n > I2C_BUS_XFERS)))
+        return -1;
+
+    int rc;
+    trans->prio = trans->prio == I2C_PRIO_HIGH ? I2C_PRIO_HIGH : I2C_PRIO_NORMAL;
+    trans->queued = osTaskGetTickCount();
+    if(trans->prio == I2C_PRIO_HIGH)
+        rc = osQueueSendToFront(b->queue, &trans, trans->timeout_ms);
+    else
+        rc = osQueueSend(b->queue, &trans, trans->timeout_ms);
+
+    if(rc != pdPASS)
+    {
+        osSemaphoreTake(&i2c_sem, portMAX_DELAY);
+        b->stats.full++;
+        osSemaphoreGiven(&i2c_sem);
+        LOGW(tag, "Bus %d queue is full", bus);
+        return -1;
+    }
+    return 0;
+}
+
+int i2c_bus_transaction(int bus, int prio, i2c_bus_xfer_t *xfers, int n, uint32_t timeout_ms)
+{
+    i2c_bus_t *b = _i2c_bus_get(bus);
+    if(b == NULL || xfers == NULL || n < 1 || n > I2C_BUS_XFERS)
+        return -1;
+
+    i2c_bus_trans_t trans;
+    memset(&trans, 0, sizeof(trans));
+    trans.prio = prio == I2C_PRIO_HIGH ? I2C_PRIO_HIGH : I2C_PRIO_NORMAL;
+    trans.n = n;
+    memcpy(trans.xfers, xfers, n*sizeof(i2c_bus_xfer_t));
+    trans.timeout_ms = timeout_ms;
+
+    if(!b->running)
+    {
+        int rc = _i2c_bus_run(b, bus, &trans);
+        _i2c_bus_count(b, trans.prio, rc, 0);
+        return rc;
+    }
+    return _i2c_bus_wait(bus, &trans);
+}
+
+int i2c_bus_write_read(int bus, int prio, uint8_t addr, const void *tx, uint16_t tx_len, void *rx,
+                       uint16_t rx_len, uint32_t timeout_ms)
+{
+    i2c_bus_xfer_t xfer = {addr, (const uint8_t *)tx, tx_len, (uint8_t *)rx, rx_len};
+    return i2c_bus_transaction(bus, prio, &xfer, 1, timeout_ms);
+}
+
+int i2c_bus_acquire(int bus, int prio)
+{
+    i2c_bus_t *b = _i2c_bus_get(bus);
+    if(b == NULL)
+        return -1;
+
+    if(!b->running)
+    {
+        osSemaphoreTake(&b->sem, portMAX_DELAY);
+        b->lock_direct = 1;
+        return 0;
+    }
+
+    i2c_bus_trans_t trans;
+    memset(&trans, 0, sizeof(trans));
+    trans.prio = prio;
+    trans.lock = 1;
+    trans.timeout_ms = portMAX_DELAY;
+    return _i2c_bus_wait(bus, &trans);
+}
+
+void i2c_bus_release(int bus)
+{
+    i2c_bus_t *b = _i2c_bus_get(bus);
+    if(b == NULL)
+        return;
+
+    // Only the task holding the bus calls this function
+    if(b->lock_direct)
+    {
+        b->lock_direct = 0;
+        osSemaphoreGiven(&b->sem);
+    }
+    else
+        osEventSet(&b->release, 1);
+}
+
+void i2c_bus_get_stats(int bus, i2c_bus_stats_t *stats, int reset)
+{
+    i2c_bus_t *b = _i2c_bus_get(bus);
+    if(b == NULL)
+    {
+        memset(stats, 0, sizeof(i2c_bus_stats_t));
+        return;
+    }
+    osSemaphoreTake(&i2c_sem, portMAX_DELAY);
+    *stats = b->stats;
+    if(reset)
+        memset(&b->stats, 0, sizeof(b->stats));
+    osSemaphoreGiven(&i2c_sem);
+}
+
+void taskI2CBus(void *param)
+{
+    int bus = (int)(intptr_t)param;
+    i2c_bus_t *b = _i2c_bus_get(bus);
+    if(b == NULL)
+    {
+        LOGE(tag, "Invalid I2C bus %d, not registered", bus);
+        return;
+    }
+    LOGI(tag, "Started bus %d", bus);
+    b->running = 1;
+
+    i2c_bus_trans_t *trans;
+    while(1)
+    {
+        if(osQueueReceive(b->queue, &trans, portMAX_DELAY) != pdPASS)
+            continue;
+
+        // The transaction can be released by the callback
+        i2c_bus_done_f done = trans->done;
+        void *done_arg = trans->done_arg;
+        int prio = trans->prio;
+        uint32_t wait_ms = (uint32_t)((uint64_t)(portTick)(osTaskGetTickCount() - trans->queued)*1000/osDefineTime(1000));
+
+        if(trans->lock)
+        {
+            // The bus is used by the acquiring task until it releases it
+            osSemaphoreTake(&b->sem, portMAX_DELAY);
+            osSemaphoreTake(&i2c_sem, portMAX_DELAY);
+            b->stats.acquired++;
+            if(wait_ms > b->stats.max_wait_ms[prio])
+                b->stats.max_wait_ms[prio] = wait_ms;
+            osSemaphoreGiven(&i2c_sem);
+            if(done != NULL)
+                done(trans, 0, done_arg);
+            osEventWait(&b->release, 1, portMAX_DELAY);
+            osSemaphoreGiven(&b->sem);
+            continue;
+        }
+
+        int rc = _i2c_bus_run(b, bus, trans);
+        _i2c_bus_count(b, prio, rc, wait_ms);
+        if(done != NULL)
+            done(trans, rc, done_arg);
+    }
+}
@@ -0,0 +1,381 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define LOG_TAG_ID LOG_TAG_TM
+#include "taskIngest.h"
+
+static const char *tag = "Ingest";
+
+typedef struct ingest_frame {
+    int node;                   ///< Source node
+    int len;                    ///< Frame length in bytes
+    com_frame_t frame;          ///< Frame, header in host byte order
+} ingest_frame_t;
+
+static osQueue ingest_queue[SCH_INGEST_WORKERS];  ///< One queue per writer, @see ingest_put
+static osSemaphore ingest_sem;
+static int ingest_sem_ok = 0;
+static ingest_stats_t ingest_stats;
+
+#ifdef SCH_INGEST_PUB_URI
+#include <zmq.h>
+static void *ingest_pub_ctx = NULL;
+static void *ingest_pub = NULL;     ///< Samples PUB socket, NULL if not bound
+static osSemaphore ingest_pub_sem;  ///< The writers share the socket
+#endif
+
+/**
+ * Add to the ingest counters
+ */
+static void _ingest_count(uint32_t *counter, uint32_t n)
+{
+    if(!ingest_sem_ok)
+        return;
+    osSemaphoreTake(&ingest_sem, portMAX_DELAY);
+    *counter += n;
+    osSemaphoreGiven(&ingest_sem);
+}
+
+/**
+ * Get the payload id of a frame
+ * @return Payload id or -1 if it is not a payload frame
+ */
+static int _ingest_payload(com_frame_t *frame)
+{
+    if(frame->type >= TM_TYPE_PAYLOAD && frame->type < TM_TYPE_PAYLOAD+last_sensor)
+        return frame->type - TM_TYPE_PAYLOAD;
+    if(frame->type >= TM_TYPE_PAYLOAD_Z && frame->type < TM_TYPE_PAYLOAD_Z+last_sensor)
+        return frame->type - TM_TYPE_PAYLOAD_Z;
+    return -1;
+}
+
+/**
+ * Get the max number of samples a payload frame can hold
+ */
+static uint32_t _ingest_max_samples(com_frame_t *frame, int payload)
+{
+    if(frame->type < TM_TYPE_PAYLOAD_Z)
+        return COM_FRAME_MAX_LEN/data_map[payload].size;
+    return SCH_TM_COMPRESS_MAX;
+}
+
+/**
+ * Decode the payload samples of a frame
+ * @param item Frame to decode
+ * @param samples Buffer for the samples
+ * @param max Buffer size in bytes
+ * @return Number of samples or -1 if the frame is not valid
+ */
+static int _ingest_decode(ingest_frame_t *item, uint8_t *samples, int max)
+{
+    com_frame_t *frame = &item->frame;
+    int payload = _ingest_payload(frame);
+    if(payload < 0 || frame->ndata < 1 || frame->ndata > _ingest_max_samples(frame, payload)
+       || (int)frame->ndata*data_map[payload].size > max)
+        return -1;
+
+    int len = item->len - (int)offsetof(com_frame_t, data);
+    if(frame->type < TM_TYPE_PAYLOAD_Z)
+    {
+        // Only the words holding samples are received and converted
+        int bytes = (int)frame->ndata*data_map[payload].size;
+        if(bytes > len)
+            return -1;
+        com_frame_ntoh32_buff(frame, frame->data.data32, (bytes + (int)sizeof(uint32_t) - 1)/(int)sizeof(uint32_t));
+        memcpy(samples, frame->data.data8, bytes);
+        return (int)frame->ndata;
+    }
+
+    if(len <= 0 || len > COM_FRAME_MAX_LEN)
+        return -1;
+    if(dat_decompress_payload_samples(frame->data.data8, len, payload, (int)frame->ndata, samples) != 0)
+        return -1;
+    LOGD(tag, "Payload %d: %d samples from %d bytes", payload, frame->ndata, len);
+    return (int)frame->ndata;
+}
+
+#ifdef SCH_INGEST_PUB_URI
+/**
+ * Publish stored samples, @see ingest_pub_header_t. Messages are dropped if
+ * no subscriber is connected or the subscribers are slow.
+ */
+static void _ingest_publish(int node, int payload, const uint8_t *samples, int n)
+{
+    if(ingest_pub == NULL)
+        return;
+
+    const data_map_t *map = &data_map[payload];
+    ingest_pub_header_t header = {(uint16_t)node, (uint16_t)payload, (uint32_t)n, map->size};
+
+    osSemaphoreTake(&ingest_pub_sem, portMAX_DELAY);
+    int rc = zmq_send(ingest_pub, map->table, strlen(map->table), ZMQ_SNDMORE|ZMQ_DONTWAIT) >= 0 &&
+             zmq_send(ingest_pub, &header, sizeof(header), ZMQ_SNDMORE|ZMQ_DONTWAIT) >= 0 &&
+             zmq_send(ingest_pub, map->data_order, strlen(map->data_order), ZMQ_SNDMORE|ZMQ_DONTWAIT) >= 0 &&
+             zmq_send(ingest_pub, map->var_names, strlen(map->var_names), ZMQ_SNDMORE|ZMQ_DONTWAIT) >= 0 &&
+             zmq_send(ingest_pub, samples, (size_t)n*map->size, ZMQ_DONTWAIT) >= 0;
+    osSemaphoreGiven(&ingest_pub_sem);
+    if(rc)
+        _ingest_count(&ingest_stats.published, 1);
+}
+#endif
+
+/**
+ * Store frames, consecutive frames of the same payload and node are decoded
+ * together into @samples and stored with one dat_add_payload_samples_node call
+ * @param items Frames
+ * @param n Number of frames
+ * @param samples Buffer for the decoded samples
+ * @param max Buffer size in bytes
+ */
+static void _ingest_write(ingest_frame_t *items, int n, uint8_t *samples, int max)
+{
+    int i, used = 0, n_samples = 0, n_frames = 0, payload = -1, node = -1;
+    for(i=0; i <= n; i++)
+    {
+        int next = i < n ? _ingest_payload(&items[i].frame) : -1;
+        int need = 0;
+        if(next >= 0 && items[i].frame.ndata <= _ingest_max_samples(&items[i].frame, next))
+            need = (int)items[i].frame.ndata*data_map[next].size;
+
+        // Store the pending samples before changing payload, node or filling the buffer
+        if(n_samples > 0 && (i == n || next != payload || items[i].node != node || used + need > max))
+        {
+            int rc = dat_add_payload_samples_node(samples, payload, n_samples, node);
+            _ingest_count(rc < 0 ? &ingest_stats.errors : &ingest_stats.stored, n_frames);
+#ifdef SCH_INGEST_PUB_URI
+            if(rc >= 0)
+                _ingest_publish(node, payload, samples, n_samples);
+#endif
+            _ingest_count(&ingest_stats.batches, 1);
+            used = n_samples = n_frames = 0;
+        }
+        if(i == n)
+            break;
+
+        int n_frame = _ingest_decode(&items[i], samples+used, max-used);
+        if(n_frame < 0)
+        {
+            LOGE(tag, "Invalid payload frame (type %d, %d bytes, %d samples)",
+                 items[i].frame.type, items[i].len, items[i].frame.ndata);
+            _ingest_count(&ingest_stats.errors, 1);
+            continue;
+        }
+        payload = next;
+        node = items[i].node;
+        used += n_frame*data_map[payload].size;
+        n_samples += n_frame;
+        n_frames++;
+    }
+}
+
+int ingest_init(void)
+{
+    memset(&ingest_stats, 0, sizeof(ingest_stats));
+    ingest_sem_ok = osSemaphoreCreate(&ingest_sem) == OS_SEMAPHORE_OK;
+    if(!ingest_sem_ok)
+    {
+        LOGE(tag, "Unable to create ingest mutex");
+        return -1;
+    }
+#ifdef SCH_INGEST_PUB_URI
+    // The ingest keeps storing if the publisher can't be bound
+    if(ingest_pub == NULL && osSemaphoreCreate(&ingest_pub_sem) == OS_SEMAPHORE_OK)
+    {
+        ingest_pub_ctx = zmq_ctx_new();
+        ingest_pub = ingest_pub_ctx != NULL ? zmq_socket(ingest_pub_ctx, ZMQ_PUB) : NULL;
+        if(ingest_pub == NULL || zmq_bind(ingest_pub, SCH_INGEST_PUB_URI) != 0)
+        {
+            LOGE(tag, "Unable to bind the samples publisher to %s (%s)", SCH_INGEST_PUB_URI, zmq_strerror(zmq_errno()));
+            if(ingest_pub != NULL)
+                zmq_close(ingest_pub);
+            if(ingest_pub_ctx != NULL)
+                zmq_ctx_term(ingest_pub_ctx);
+            ingest_pub = ingest_pub_ctx = NULL;
+        }
+        else
+        {
+            LOGI(tag, "Publishing samples on %s", SCH_INGEST_PUB_URI);
+        }
+    }
+#endif
+#if SCH_TASK_INGEST_ENABLED
+    int i;
+    for(i=0; i < SCH_INGEST_WORKERS; i++)
+    {
+        ingest_queue[i] = osQueueCreateType(SCH_INGEST_QUEUE_LEN, sizeof(ingest_frame_t), OS_QUEUE_MPSC);
+        osQueueSetName(ingest_queue[i], "ingest");
+        if(ingest_queue[i] == 0)
+        {
+            LOGE(tag, "Unable to create ingest queue %d", i);
+            return -1;
+        }
+    }
+#endif
+    return 0;
+}
+
+/**
+ * Store the records of a TM_TYPE_PAYLOAD_MUX frame, each one as a payload
+ * frame with the data in the byte order of the received frame
+ * @return 0 if OK, -1 if a record was not valid or not stored
+ */
+static int _ingest_put_mux(int node, com_frame_t *frame, int len)
+{
+    int rc = 0;
+    int used = 0;
+    int end = len - (int)offsetof(com_frame_t, data);
+    uint32_t i;
+    for(i=0; i < frame->ndata; i++)
+    {
+        if(used + TM_MUX_HEADER_LEN > end)
+        {
+            rc = -1;
+            break;
+        }
+        uint32_t header = com_frame_ntoh32(frame, frame->data.data32[used/sizeof(uint32_t)]);
+        int payload = (int)(header >> 16);
+        int count = (int)(header & 0xFFFF);
+        int bytes = payload < last_sensor ? count*data_map[payload].size : 0;
+        if(bytes < 1 || bytes > COM_FRAME_MAX_LEN || used + TM_MUX_HEADER_LEN + bytes > end)
+        {
+            rc = -1;
+            break;
+        }
+
+        com_frame_t record;
+        record.node = frame->node;
+        record.nframe = frame->nframe;
+        record.type = (uint8_t)(TM_TYPE_PAYLOAD + payload);
+        record.ndata = (uint32_t)count;
+        memcpy(record.data.data8, frame->data.data8 + used + TM_MUX_HEADER_LEN, bytes);
+        memset(record.data.data8 + bytes, 0, sizeof(record.data) - bytes);
+        if(ingest_put(node, &record, (int)sizeof(com_frame_t)) != 0)
+            rc = -1;
+        used += TM_MUX_HEADER_LEN + bytes;
+    }
+
+    if(rc != 0 && i < frame->ndata)
+    {
+        LOGE(tag, "Invalid payload record %d (%d bytes, %d records)", (int)i, len, frame->ndata);
+        _ingest_count(&ingest_stats.errors, 1);
+    }
+    return rc;
+}
+
+int ingest_put(int node, com_frame_t *frame, int len)
+{
+    ingest_frame_t item;
+    if(frame->type == TM_TYPE_PAYLOAD_MUX && len >= (int)offsetof(com_frame_t, data) && len <= (int)sizeof(com_frame_t))
+        return _ingest_put_mux(node, frame, len);
+
+    int payload = _ingest_payload(frame);
+    if(len < (int)offsetof(com_frame_t, data) || len > (int)sizeof(com_frame_t) || payload < 0
+       || frame->ndata < 1 || frame->ndata > _ingest_max_samples(frame, payload))
+    {
+        LOGE(tag, "Invalid payload frame (type %d, %d bytes, %d samples)", frame->type, len, frame->ndata);
+        _ingest_count(&ingest_stats.errors, 1);
+        return -1;
+    }
+    item.node = node;
+    item.len = len;
+    memcpy(&item.frame, frame, len);
+
+    // Without the ingest task frames are stored by the receive task
+    osQueue queue = ingest_queue[(unsigned int)node % SCH_INGEST_WORKERS];
+    if(queue == 0)
+    {
+        int max = (int)frame->ndata*data_map[payload].size;
+        uint8_t *samples = malloc(max);
+        if(samples == NULL)
+        {
+            _ingest_count(&ingest_stats.errors, 1);
+            return -1;
+        }
+        _ingest_write(&item, 1, samples, max);
+        free(samples);
+        return 0;
+    }
+
+    // Wait for the writer only if the queue is full
+    if(osQueueSend(queue, &item, 0) != pdPASS)
+    {
+        _ingest_count(&ingest_stats.waited, 1);
+        if(osQueueSend(queue, &item, SCH_INGEST_PUT_MS) != pdPASS)
+        {
+            LOGW(tag, "Ingest queue full, frame %d type %d dropped", frame->nframe & COM_FRAME_NUM_MASK, frame->type);
+            _ingest_count(&ingest_stats.dropped, 1);
+            return -1;
+        }
+    }
+    _ingest_count(&ingest_stats.queued, 1);
+    return 0;
+}
+
+void ingest_get_stats(ingest_stats_t *stats, int reset)
+{
+    if(!ingest_sem_ok)
+    {
+        memset(stats, 0, sizeof(ingest_stats_t));
+        return;
+    }
+    osSemaphoreTake(&ingest_sem, portMAX_DELAY);
+    *stats = ingest_stats;
+    if(reset)
+        memset(&ingest_stats, 0, sizeof(ingest_stats));
+    osSemaphoreGiven(&ingest_sem);
+}
+
+void taskIngest(void *param)
+{
+    int worker = (int)(intptr_t)param;
+    LOGI(tag, "Started writer %d", worker);
+
+    static ingest_frame_t workers_items[SCH_INGEST_WORKERS][SCH_INGEST_BATCH];
+    static uint8_t workers_samples[SCH_INGEST_WORKERS][SCH_INGEST_BUFF_LEN];
+    if(worker < 0 || worker >= SCH_INGEST_WORKERS)
+    {
+        LOGE(tag, "Invalid writer %d", worker);
+        return;
+    }
+    ingest_frame_t *items = workers_items[worker];
+    uint8_t *samples = workers_samples[worker];
+
+    while(1)
+    {
+        if(ingest_queue[worker] == 0)
+        {
+            LOGE(tag, "No ingest queue, frames are stored by the receive task");
+            return;
+        }
+
+        // Take every frame queued, up to a batch, in one transaction per payload
+        int n = osQueueReceiveMany(ingest_queue[worker], items, SCH_INGEST_BATCH, sizeof(ingest_frame_t), portMAX_DELAY);
+        if(n <= 0)
+            continue;
+
+        if(ingest_sem_ok)
+        {
+            osSemaphoreTake(&ingest_sem, portMAX_DELAY);
+            if((uint32_t)n > ingest_stats.max_batch)
+                ingest_stats.max_batch = (uint32_t)n;
+            osSemaphoreGiven(&ingest_sem);
+        }
+        _ingest_write(items, n, samples, SCH_INGEST_BUFF_LEN);
+    }
+}
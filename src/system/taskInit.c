@@ -46,20 +46,21 @@ void taskInit(void *param)
     on_init_task(NULL);
 #endif
 
-    /* Initialize system variables */
-    LOGI(tag, "SETUP VARIABLES...");
-    rc = init_update_status_vars();
-    // Init LibCSP system
-    LOGI(tag, "SETUP CSP...");
-    init_setup_libcsp();
+    /* Initialize system variables, LibCSP, TRX and create tasks. Status
+     * variables and LibCSP are independent, they run in parallel */
+    LOGI(tag, "SETUP VARIABLES, CSP, TRX AND TASKS...");
+    const boot_step_t init_steps[] = {
+        {"status_vars", init_update_status_vars, 0},
+        {"libcsp", init_setup_libcsp, 0},
 #ifdef NANOMIND
-    // Init TRX;
-    LOGI(tag, "SETUP TRX...");
-    rc = init_setup_trx();
+        {"trx", init_setup_trx, BOOT_DEP(1)},
+        {"tasks", init_create_task, BOOT_DEP(0)|BOOT_DEP(1)|BOOT_DEP(2)},
+#else
+        {"tasks", init_create_task, BOOT_DEP(0)|BOOT_DEP(1)},
 #endif
-    // Create tasks
-    LOGI(tag, "CREATE TASKS...");
-    rc = init_create_task();
+    };
+    rc = boot_run(init_steps, sizeof(init_steps)/sizeof(init_steps[0]));
+    boot_print_times();
 
 #ifdef NANOMIND
     LOGI(tag, "DEPLOYMENT...");
@@ -91,9 +92,9 @@ void taskInit(void *param)
     if(deployed == 1) // Deployed not confirmed, but silence time
     {
         LOGI(tag, "ANTENNA DEPLOYMENT");
-        cmd_t *eps_update_status_cmd = cmd_get_str("eps_update_status");
-        cmd_send(eps_update_status_cmd);
-        osDelay(500);
+#ifdef SCH_USE_NANOPOWER
+        eps_update_status(0);
+#endif
         int vbat_mV = dat_get_system_var(dat_eps_vbatt);
 
         // Deploy antenna
@@ -169,6 +170,11 @@ int init_setup_libcsp(void)
 #if defined(X86) || defined(GROUNDSTATION)
     /* Set ZMQ interface as a default route*/
     uint8_t addr = (uint8_t)SCH_COMM_ADDRESS;
+#if SCH_COMM_ZMQ_BATCH > 1
+    /* Same hub format, sending the queued packets in multipart messages */
+    if(zmq_hub_init(addr, SCH_COMM_ZMQ_OUT, SCH_COMM_ZMQ_IN, &csp_if_zmqhub) != 0)
+        LOGE(tag, "ZMQ hub interface not initialized!");
+#else
     uint8_t *rxfilter = &addr;
     unsigned  int rxfilter_count = 1;
 
@@ -176,7 +182,13 @@ int init_setup_libcsp(void)
                                               rxfilter, rxfilter_count,
                                               SCH_COMM_ZMQ_OUT, SCH_COMM_ZMQ_IN,
                                               &csp_if_zmqhub);
-    csp_route_set(CSP_DEFAULT_ROUTE, csp_if_zmqhub, CSP_NODE_MAC);
+#endif
+    if(csp_if_zmqhub != NULL)
+        csp_route_set(CSP_DEFAULT_ROUTE, csp_if_zmqhub, CSP_NODE_MAC);
+#if SCH_SIM_NODES > 0
+    /* Simulated nodes in this process, routed to the SIM interface */
+    if(sim_nodes_init() != 0) LOGE(tag, "Simulated nodes not initialized!");
+#endif
 #endif //X86||GROUNDSTATION
 
 #ifdef RPI
@@ -223,14 +235,14 @@ int init_setup_trx(void) {
     trx_cmd = cmd_get_str("com_set_config");
     cmd_add_params_var(trx_cmd, 0, "tx_inhibit", TOSTRING(SCH_TX_INHIBIT));
     cmd_send(trx_cmd);
-    if(log_lvl >= LOG_LVL_DEBUG)
+    if(LOG_ENABLED(LOG_LVL_DEBUG))
     {
         trx_cmd = cmd_build_from_str("com_get_config 0 tx_inhibit");
         cmd_send(trx_cmd);
     }
     trx_cmd = cmd_build_from_str("com_set_config 0 bcn_holdoff 60)");
     cmd_send(trx_cmd);
-    if(log_lvl >= LOG_LVL_DEBUG)
+    if(LOG_ENABLED(LOG_LVL_DEBUG))
     {
         trx_cmd = cmd_build_from_str("com_get_config 0 bcn_holdoff");
         cmd_send(trx_cmd);
@@ -239,7 +251,7 @@ int init_setup_trx(void) {
     trx_cmd = cmd_get_str("com_set_config");
     cmd_add_params_var(trx_cmd, 0, "tx_pwr", dat_get_status_var(dat_com_tx_pwr).i);
     cmd_send(trx_cmd);
-    if(log_lvl >= LOG_LVL_DEBUG)
+    if(LOG_ENABLED(LOG_LVL_DEBUG))
     {
         trx_cmd = cmd_build_from_str("com_get_config 0 tx_pwr");
         cmd_send(trx_cmd);
@@ -248,7 +260,7 @@ int init_setup_trx(void) {
 //    trx_cmd = cmd_get_str("com_set_config");
 //    cmd_add_params_var(trx_cmd, 0, "bcn_interval", dat_get_status_var(dat_com_bcn_period).i);
 //    cmd_send(trx_cmd);
-//    if(log_lvl >= LOG_LVL_DEBUG)
+//    if(LOG_ENABLED(LOG_LVL_DEBUG))
 //    {
 //        trx_cmd = cmd_build_from_str("com_get_config 0 bcn_interval");
 //        cmd_send(trx_cmd);
@@ -260,7 +272,7 @@ int init_setup_trx(void) {
 //    trx_cmd = cmd_get_str("com_set_config");
 //    cmd_add_params_var(trx_cmd, 5, "freq", dat_get_status_var(dat_com_freq).i);
 //    cmd_send(trx_cmd);
-//    if(log_lvl >= LOG_LVL_DEBUG)
+//    if(LOG_ENABLED(LOG_LVL_DEBUG))
 //    {
 //        trx_cmd = cmd_build_from_str("com_get_config 1 freq");
 //        cmd_send(trx_cmd);
@@ -274,7 +286,7 @@ int init_setup_trx(void) {
 //    trx_cmd = cmd_get_str("com_set_config");
 //    cmd_add_params_var(trx_cmd, 5, "baud", dat_get_status_var(dat_com_baud).i);
 //    cmd_send(trx_cmd);
-//    if(log_lvl >= LOG_LVL_DEBUG)
+//    if(LOG_ENABLED(LOG_LVL_DEBUG))
 //    {
 //        trx_cmd = cmd_build_from_str("com_get_config 1 baud");
 //        cmd_send(trx_cmd);
@@ -286,34 +298,86 @@ int init_setup_trx(void) {
 int init_create_task(void) {
     LOGD(tag, "Creating client tasks ...");
     int t_ok;
-    int n_threads = 6;
+    int n_threads = 12 + SCH_INGEST_WORKERS + SCH_SIM_WORKERS + SCH_I2C_BUSES;
     os_thread thread_id[n_threads];
+    /* ADCS, the I2C bus managers and tracking run with the real time tasks, the rest away from them */
+    const osTaskProfile bg_profile = {2, OS_SCHED_FIFO, SCH_TASK_BG_CPUS};
+    const osTaskProfile rt_profile = {2, OS_SCHED_FIFO, SCH_TASK_RT_CPUS};
 
     /* Creating clients tasks */
 #if SCH_CON_ENABLED
-    t_ok = osCreateTask(taskConsole, "console", SCH_TASK_CON_STACK, NULL, 2, &(thread_id[0]));
+    t_ok = osCreateTaskProfile(taskConsole, "console", SCH_TASK_CON_STACK, NULL, &bg_profile, &(thread_id[0]));
     if(t_ok != 0) LOGE(tag, "Task console not created!");
 #endif
 #if SCH_HK_ENABLED
-    t_ok = osCreateTask(taskHousekeeping, "housekeeping", SCH_TASK_HKP_STACK, NULL, 2, &(thread_id[1]));
+    t_ok = osCreateTaskProfile(taskHousekeeping, "housekeeping", SCH_TASK_HKP_STACK, NULL, &bg_profile, &(thread_id[1]));
         if(t_ok != 0) LOGE(tag, "Task housekeeping not created!");
 #endif
 #if SCH_COMM_ENABLE
-    t_ok = osCreateTask(taskCommunications, "comm", SCH_TASK_COM_STACK, NULL, 2, &(thread_id[2]));
+    t_ok = osCreateTaskProfile(taskCommunications, "comm", SCH_TASK_COM_STACK, NULL, &bg_profile, &(thread_id[2]));
     if(t_ok != 0) LOGE(tag, "Task communications not created!");
 #endif
 #if SCH_FP_ENABLED
-    t_ok = osCreateTask(taskFlightPlan,"flightplan", SCH_TASK_FPL_STACK, NULL, 2, &(thread_id[3]));
+    t_ok = osCreateTaskProfile(taskFlightPlan, "flightplan", SCH_TASK_FPL_STACK, NULL, &bg_profile, &(thread_id[3]));
         if(t_ok != 0) LOGE(tag, "Task flightplan not created!");
 #endif
 #if SCH_SEN_ENABLED
-    t_ok = osCreateTask(taskSensors,"sensors", SCH_TASK_SEN_STACK, NULL, 2, &(thread_id[4]));
+    t_ok = osCreateTaskProfile(taskSensors, "sensors", SCH_TASK_SEN_STACK, NULL, &bg_profile, &(thread_id[4]));
         if(t_ok != 0) LOGE(tag, "Task sensors not created!");
 #endif
 #if SCH_ADCS_ENABLED
-    t_ok = osCreateTask(taskADCS,"adcs", SCH_TASK_SEN_STACK, NULL, 2, &(thread_id[5]));
+    t_ok = osCreateTaskProfile(taskADCS, "adcs", SCH_TASK_SEN_STACK, NULL, &rt_profile, &(thread_id[5]));
         if(t_ok != 0) LOGE(tag, "Task sensors not created!");
 #endif
+#if SCH_DL_ENABLED
+    t_ok = osCreateTaskProfile(taskDownlink, "downlink", SCH_TASK_DL_STACK, NULL, &bg_profile, &(thread_id[6]));
+    if(t_ok != 0) LOGE(tag, "Task downlink not created!");
+#endif
+#if SCH_TASK_INGEST_ENABLED
+    int i;
+    for(i=0; i < SCH_INGEST_WORKERS; i++)
+    {
+        t_ok = osCreateTaskProfile(taskIngest, "ingest", SCH_TASK_ING_STACK, (void *)(intptr_t)i, &bg_profile, &(thread_id[7+i]));
+        if(t_ok != 0) LOGE(tag, "Task ingest %d not created!", i);
+    }
+#endif
+#if SCH_COMM_ENABLE && SCH_SIM_NODES > 0 && (defined(X86) || defined(GROUNDSTATION))
+    int j;
+    for(j=0; j < SCH_SIM_WORKERS; j++)
+    {
+        t_ok = osCreateTaskProfile(taskSimNodes, "simnodes", SCH_TASK_SIM_STACK, (void *)(intptr_t)j, &bg_profile, &(thread_id[7+SCH_INGEST_WORKERS+j]));
+        if(t_ok != 0) LOGE(tag, "Task simulated nodes %d not created!", j);
+    }
+#endif
+#if SCH_TASK_I2C_ENABLED
+    /* One bus manager per bus registered by the drivers */
+    int b;
+    for(b=0; b < SCH_I2C_BUSES; b++)
+    {
+        if(!i2c_bus_registered(b))
+            continue;
+        t_ok = osCreateTaskProfile(taskI2CBus, "i2cbus", SCH_TASK_I2C_STACK, (void *)(intptr_t)b, &rt_profile, &(thread_id[7+SCH_INGEST_WORKERS+SCH_SIM_WORKERS+b]));
+        if(t_ok != 0) LOGE(tag, "Task I2C bus %d not created!", b);
+    }
+#endif
+#if SCH_TASK_TRK_ENABLED
+    t_ok = osCreateTaskProfile(taskTracking, "tracking", SCH_TASK_TRK_STACK, NULL, &rt_profile, &(thread_id[7+SCH_INGEST_WORKERS+SCH_SIM_WORKERS+SCH_I2C_BUSES]));
+    if(t_ok != 0) LOGE(tag, "Task tracking not created!");
+#endif
+#if SCH_COMM_ENABLE && SCH_TASK_RPT_ENABLED
+    t_ok = osCreateTaskProfile(taskRepeater, "repeater", SCH_TASK_RPT_STACK, NULL, &bg_profile, &(thread_id[8+SCH_INGEST_WORKERS+SCH_SIM_WORKERS+SCH_I2C_BUSES]));
+    if(t_ok != 0) LOGE(tag, "Task repeater not created!");
+#endif
+#if SCH_HK_ENABLED && SCH_COMM_ENABLE && SCH_TASK_BCN_ENABLED
+    t_ok = osCreateTaskProfile(taskBeacon, "beacon", SCH_TASK_BCN_STACK, NULL, &bg_profile, &(thread_id[9+SCH_INGEST_WORKERS+SCH_SIM_WORKERS+SCH_I2C_BUSES]));
+    if(t_ok != 0) LOGE(tag, "Task beacon not created!");
+#endif
+#if SCH_COMM_ENABLE && SCH_COMM_ZMQ_BATCH > 1 && (defined(X86) || defined(GROUNDSTATION))
+    t_ok = osCreateTaskProfile(taskZmqHubTx, "zmqhub_tx", SCH_TASK_ZMQ_STACK, NULL, &bg_profile, &(thread_id[10+SCH_INGEST_WORKERS+SCH_SIM_WORKERS+SCH_I2C_BUSES]));
+    if(t_ok != 0) LOGE(tag, "Task zmqhub_tx not created!");
+    t_ok = osCreateTaskProfile(taskZmqHubRx, "zmqhub_rx", SCH_TASK_ZMQ_STACK, NULL, &bg_profile, &(thread_id[11+SCH_INGEST_WORKERS+SCH_SIM_WORKERS+SCH_I2C_BUSES]));
+    if(t_ok != 0) LOGE(tag, "Task zmqhub_rx not created!");
+#endif
 
     return t_ok;
 }
@@ -0,0 +1,308 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define LOG_TAG_ID LOG_TAG_COM
+#include "taskRepeater.h"
+
+static const char *tag = "Repeater";
+
+#define RPT_SOURCES (CSP_BROADCAST_ADDR + 1)
+
+/**
+ * Token bucket of a source node
+ */
+typedef struct rpt_bucket {
+    int32_t tokens;         ///< Bytes that can be repeated now
+    portTick last;          ///< Last refill
+    int started;            ///< The bucket was filled the first time
+} rpt_bucket_t;
+
+static osQueue rpt_queue = 0;
+static osSemaphore rpt_sem;
+static int rpt_sem_ok = 0;
+static rpt_bucket_t rpt_buckets[RPT_SOURCES];
+static rpt_stats_t rpt_stats;
+
+#if SCH_RPT_STORE_MSGS > 0
+/**
+ * Message held until the next pass
+ */
+typedef struct rpt_msg {
+    uint16_t len;                       ///< Message length
+    uint8_t data[SCH_BUFF_MAX_LEN];     ///< Packet data
+} rpt_msg_t;
+
+static rpt_msg_t rpt_store[SCH_RPT_STORE_MSGS];    ///< Ring of held messages, only used by taskRepeater
+static int rpt_store_first = 0;
+static int rpt_store_n = 0;
+#endif
+
+/**
+ * Add to the repeater counters
+ */
+static void _rpt_count(uint32_t *counter, uint32_t n)
+{
+    if(!rpt_sem_ok)
+        return;
+    osSemaphoreTake(&rpt_sem, portMAX_DELAY);
+    *counter += n;
+    osSemaphoreGiven(&rpt_sem);
+}
+
+/**
+ * Take the tokens to repeat @len bytes from a source node
+ * @return 1 if the packet is within the rate of the source, 0 if not
+ */
+static int _rpt_admit(unsigned int src, int len)
+{
+    if(!rpt_sem_ok || src >= RPT_SOURCES)
+        return 0;
+
+    int ok = 0;
+    portTick now = osTaskGetTickCount();
+    osSemaphoreTake(&rpt_sem, portMAX_DELAY);
+    rpt_bucket_t *b = &rpt_buckets[src];
+    if(!b->started)
+    {
+        b->tokens = SCH_RPT_BURST;
+        b->last = now;
+        b->started = 1;
+    }
+    // The refill time is kept until a whole byte is added, so frequent
+    // packets do not lose the fractions
+    int64_t elapsed_ms = (int64_t)(portTick)(now - b->last)*1000/osDefineTime(1000);
+    int64_t add = elapsed_ms*SCH_RPT_RATE_BPS/1000;
+    if(add > 0)
+    {
+        b->tokens = add >= SCH_RPT_BURST - b->tokens ? SCH_RPT_BURST : b->tokens + (int32_t)add;
+        b->last = now;
+    }
+    if(b->tokens >= len)
+    {
+        b->tokens -= len;
+        ok = 1;
+        rpt_stats.queued++;
+    }
+    else
+    {
+        rpt_stats.limited++;
+    }
+    osSemaphoreGiven(&rpt_sem);
+    return ok;
+}
+
+/**
+ * Resend a packet to the broadcast address, after the TM and TC packets
+ * waiting for the radio. The packet is released.
+ */
+static void _rpt_forward(csp_packet_t *packet)
+{
+    com_tx_pace(packet->length);
+    int rc = csp_sendto(CSP_PRIO_LOW, CSP_BROADCAST_ADDR, SCH_TRX_PORT_RPT, SCH_TRX_PORT_RPT,
+                        CSP_O_NONE, packet, SCH_RPT_TX_MS);
+    LOGD(tag, "Repeating %d bytes to %d (rc: %d)", packet->length, CSP_BROADCAST_ADDR, rc);
+    if(rc != 0)
+    {
+        csp_buffer_free(packet);    // Free the packet in case of errors
+        _rpt_count(&rpt_stats.errors, 1);
+        return;
+    }
+    _rpt_count(&rpt_stats.forwarded, 1);
+}
+
+#if SCH_RPT_STORE_MSGS > 0
+/**
+ * Check if the ground station sees the satellite. Without a valid TLE the
+ * passes can't be predicted, then the messages are not held.
+ */
+static int _rpt_in_pass(int now)
+{
+    double r[3], v[3];
+    if(obc_prop_tle_rv(now, r, v) != 0)
+        return 1;
+    return obc_pass_elevation(r, now) >= SCH_GS_MIN_EL_DEG;
+}
+
+/**
+ * Copy a packet to the store and release it. The oldest message is dropped if
+ * the store is full.
+ */
+static void _rpt_hold(csp_packet_t *packet)
+{
+    if(packet->length > SCH_BUFF_MAX_LEN)
+    {
+        csp_buffer_free(packet);
+        _rpt_count(&rpt_stats.errors, 1);
+        return;
+    }
+
+    int overwritten = rpt_store_n == SCH_RPT_STORE_MSGS;
+    if(overwritten)
+    {
+        rpt_store_first = (rpt_store_first + 1) % SCH_RPT_STORE_MSGS;
+        rpt_store_n--;
+    }
+    rpt_msg_t *msg = &rpt_store[(rpt_store_first + rpt_store_n) % SCH_RPT_STORE_MSGS];
+    msg->len = packet->length;
+    memcpy(msg->data, packet->data, packet->length);
+    rpt_store_n++;
+    csp_buffer_free(packet);
+
+    osSemaphoreTake(&rpt_sem, portMAX_DELAY);
+    rpt_stats.stored++;
+    rpt_stats.overwritten += overwritten;
+    rpt_stats.held = (uint32_t)rpt_store_n;
+    osSemaphoreGiven(&rpt_sem);
+}
+
+/**
+ * Resend the held messages, while there are free CSP buffers
+ */
+static void _rpt_release(void)
+{
+    while(rpt_store_n > 0)
+    {
+        rpt_msg_t *msg = &rpt_store[rpt_store_first];
+        csp_packet_t *packet = com_buffer_get(msg->len, 0);
+        if(packet == NULL)
+            break;
+        memcpy(packet->data, msg->data, msg->len);
+        packet->length = msg->len;
+        rpt_store_first = (rpt_store_first + 1) % SCH_RPT_STORE_MSGS;
+        rpt_store_n--;
+        osSemaphoreTake(&rpt_sem, portMAX_DELAY);
+        rpt_stats.held = (uint32_t)rpt_store_n;
+        osSemaphoreGiven(&rpt_sem);
+        _rpt_forward(packet);
+    }
+}
+#endif
+
+int rpt_init(void)
+{
+    if(!rpt_sem_ok)
+        rpt_sem_ok = osSemaphoreCreate(&rpt_sem) == OS_SEMAPHORE_OK;
+    if(!rpt_sem_ok)
+    {
+        LOGE(tag, "Unable to create repeater mutex");
+        return -1;
+    }
+    memset(rpt_buckets, 0, sizeof(rpt_buckets));
+    memset(&rpt_stats, 0, sizeof(rpt_stats));
+#if SCH_TASK_RPT_ENABLED
+    if(rpt_queue == 0)
+    {
+        rpt_queue = osQueueCreateType(SCH_RPT_QUEUE_LEN, sizeof(csp_packet_t *), OS_QUEUE_MPSC);
+        if(rpt_queue == 0)
+        {
+            LOGE(tag, "Unable to create repeater queue");
+            return -1;
+        }
+        osQueueSetName(rpt_queue, "repeater");
+    }
+#endif
+    return 0;
+}
+
+int rpt_put(csp_packet_t *packet)
+{
+    if(!_rpt_admit(packet->id.src, packet->length))
+    {
+        LOGD(tag, "Packet from %d over the rate limit", packet->id.src);
+        return -1;
+    }
+
+    // Without the repeater task packets are resent by the caller
+    if(rpt_queue == 0)
+    {
+        _rpt_forward(packet);
+        return 0;
+    }
+    if(osQueueSend(rpt_queue, &packet, 0) != pdPASS)
+    {
+        osSemaphoreTake(&rpt_sem, portMAX_DELAY);
+        rpt_stats.queued--;
+        rpt_stats.full++;
+        osSemaphoreGiven(&rpt_sem);
+        return -1;
+    }
+    return 0;
+}
+
+void rpt_get_stats(rpt_stats_t *stats, int reset)
+{
+    if(!rpt_sem_ok)
+    {
+        memset(stats, 0, sizeof(rpt_stats_t));
+        return;
+    }
+    osSemaphoreTake(&rpt_sem, portMAX_DELAY);
+    *stats = rpt_stats;
+    if(reset)
+    {
+        uint32_t held = rpt_stats.held;
+        memset(&rpt_stats, 0, sizeof(rpt_stats));
+        rpt_stats.held = held;
+    }
+    osSemaphoreGiven(&rpt_sem);
+}
+
+void taskRepeater(void *param)
+{
+    LOGI(tag, "Started");
+    if(rpt_queue == 0)
+    {
+        LOGE(tag, "Repeater not initialized");
+        return;
+    }
+
+#if SCH_RPT_STORE_MSGS > 0
+    int checked = 0, in_pass = 1;
+#endif
+    while(1)
+    {
+        csp_packet_t *packet = NULL;
+#if SCH_RPT_STORE_MSGS > 0
+        // The pass is checked once per second, also without packets
+        int rc = osQueueReceive(rpt_queue, &packet, 1000);
+        int now = dat_get_time();
+        if(now != checked)
+        {
+            int was_in_pass = in_pass;
+            in_pass = _rpt_in_pass(now);
+            checked = now;
+            if(in_pass != was_in_pass)
+                LOGI(tag, "%s, %d messages held", in_pass ? "Pass started" : "Pass ended", rpt_store_n);
+        }
+        if(in_pass)
+            _rpt_release();
+        if(rc != pdPASS)
+            continue;
+        if(!in_pass)
+        {
+            _rpt_hold(packet);
+            continue;
+        }
+#else
+        if(osQueueReceive(rpt_queue, &packet, portMAX_DELAY) != pdPASS)
+            continue;
+#endif
+        _rpt_forward(packet);
+    }
+}
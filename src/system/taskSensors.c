@@ -17,33 +17,52 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define LOG_TAG_ID LOG_TAG_SENSORS
 #include "taskSensors.h"
 
 static const char *tag = "Sensors";
+static osPeriod sen_period;  ///< Loop timing (see obc_task_stats)
+
+/**
+ * Store the sampling machine state, dat_drp_mach_action to dat_drp_mach_step_ms,
+ * with one write if it changed since the last call
+ */
+static void _sen_publish_machine(value32_t *saved)
+{
+    value32_t v[dat_drp_mach_step_ms-dat_drp_mach_action+1];
+    v[dat_drp_mach_action-dat_drp_mach_action].i = (int)status_machine.action;
+    v[dat_drp_mach_state-dat_drp_mach_action].i = (int)status_machine.state;
+    v[dat_drp_mach_step-dat_drp_mach_action].i = (int)status_machine.step;
+    v[dat_drp_mach_payloads-dat_drp_mach_action].i = (int)status_machine.active_payloads;
+    v[dat_drp_mach_left-dat_drp_mach_action].i = (int)status_machine.samples_left;
+    v[dat_drp_mach_step_ms-dat_drp_mach_action].i = (int)status_machine.step_ms;
+    if(memcmp(v, saved, sizeof(v)) == 0)
+        return;
+    if(dat_set_status_vars(dat_drp_mach_action, dat_drp_mach_step_ms-dat_drp_mach_action+1, v) == 0)
+        memcpy(saved, v, sizeof(v));
+}
 
 void taskSensors(void *param)
 {
     LOGI(tag, "Started");
-    portTick xLastWakeTime = osTaskGetTickCount();
+    osPeriodInit(&sen_period, "Sensors", SCH_SEN_TICK_MS);
 
-    int i;
-    cmd_t *cmd_init;
-    cmd_t *cmd_get;
-    int nsensors = 4;
-    char *init_cmds[] = {"sen_init_dummy", "sen_init_dummy", "sen_init_dummy", "sen_init_dummy"};
-    char *get_cmds[] = {"sen_take_sample", "sen_take_sample", "sen_take_sample", "sen_take_sample"};
+    int nsensors = 4;   // Payloads handled by the sampling machine (see sen_drivers)
 
-
-    int action = dat_get_system_var(dat_drp_mach_action);
-    int state = dat_get_system_var(dat_drp_mach_state);
-    int step = dat_get_system_var(dat_drp_mach_step);
-    int active_payloads = dat_get_system_var(dat_drp_mach_payloads);
-    int samples_left = dat_get_system_var(dat_drp_mach_left);
+    value32_t saved[dat_drp_mach_step_ms-dat_drp_mach_action+1];
+    dat_get_status_vars(dat_drp_mach_action, dat_drp_mach_step_ms-dat_drp_mach_action+1, saved);
+    int action = saved[dat_drp_mach_action-dat_drp_mach_action].i;
+    int state = saved[dat_drp_mach_state-dat_drp_mach_action].i;
+    int step = saved[dat_drp_mach_step-dat_drp_mach_action].i;
+    int active_payloads = saved[dat_drp_mach_payloads-dat_drp_mach_action].i;
+    int samples_left = saved[dat_drp_mach_left-dat_drp_mach_action].i;
+    int step_ms = saved[dat_drp_mach_step_ms-dat_drp_mach_action].i;
 
     if( action < 0 || state < 0  || active_payloads < 0 || step < 0) {
-        status_machine = (dat_stmachine_t) {ST_PAUSE, ACT_START, 0, 5, -1, nsensors};
+        status_machine = (dat_stmachine_t) {ST_PAUSE, ACT_START, 0, 5, -1, nsensors, 0};
     } else {
-        status_machine = (dat_stmachine_t) {state, action, active_payloads, step, samples_left, nsensors};
+        status_machine = (dat_stmachine_t) {state, action, active_payloads, step, samples_left, nsensors,
+                                            step_ms > 0 ? step_ms : 0};
     }
 //    status_machine = (dat_stmachine_t) {ST_PAUSE, ACT_START, 1, 3600, -1, nsensors};
 
@@ -51,20 +70,25 @@ void taskSensors(void *param)
     {
         LOGE(tag, "Unable to create system status repository mutex");
     }
+    osSemaphoreSetName(&repo_machine_sem, "repo_machine");
 
-    for(i=0; i < status_machine.total_sensors; i++)
-    {
-        cmd_init = cmd_get_str(init_cmds[i]);
-//        cmd_add_params_str(cmd_init, "1010");
-        cmd_send(cmd_init);
-    }
+    int failed = sen_init_drivers();
+    if(failed > 0)
+        LOGW(tag, "%d sensors not initialized", failed);
 
-    int elapsed_sec = 0;
+    /*
+     * Samples are triggered on a monotonic schedule, elapsed_ms advances one
+     * task period per loop, and the next trigger is the previous one plus the
+     * step, so the sampling time does not drift with the work of each loop.
+     */
+    uint32_t elapsed_ms = 0;
+    uint32_t next_ms = 0;
+    int burst = 0;      // Burst mode in the previous loop
 
     while(1)
     {
-        osTaskDelayUntil(&xLastWakeTime, 1000); //Suspend task
-        LOGD(tag, "state: %d, action %d, samples left: %d", status_machine.state, status_machine.action, status_machine.samples_left)
+        osPeriodDelay(&sen_period); //Suspend task
+        elapsed_ms += SCH_SEN_TICK_MS;
 
         // Apply action
         if (status_machine.action != ACT_STAND_BY) {
@@ -73,6 +97,11 @@ void taskSensors(void *param)
 
                 status_machine.state = ST_SAMPLING;
                 status_machine.action = ACT_STAND_BY;
+                next_ms = elapsed_ms;
+            } else if (status_machine.action == ACT_BURST) {
+                status_machine.state = ST_BURST;
+                status_machine.action = ACT_STAND_BY;
+                next_ms = elapsed_ms;
             } else if (status_machine.action == ACT_PAUSE) {
                 status_machine.state = ST_PAUSE;
                 status_machine.action = ACT_STAND_BY;
@@ -81,7 +110,7 @@ void taskSensors(void *param)
         }
 
         // States
-        if (status_machine.state == ST_SAMPLING) {
+        if (status_machine.state == ST_SAMPLING || status_machine.state == ST_BURST) {
             // Check for samples left
             if (status_machine.samples_left == 0) {
                 osSemaphoreTake(&repo_machine_sem, portMAX_DELAY);
@@ -90,21 +119,31 @@ void taskSensors(void *param)
                 osSemaphoreGiven(&repo_machine_sem);
             }
             // Check for step
-            else if (elapsed_sec % status_machine.step == 0) {
-                LOGD(tag, "SAMPLING...");
-
-                for(i=0; i<nsensors; i++) {
-//                    printf("payload %d active status %d\n", i, dat_stmachine_is_sensor_active(i, status_machine.active_payloads, nsensors));
-                    if (dat_stmachine_is_sensor_active(i,
-                                                       status_machine.active_payloads,
-                                                       status_machine.total_sensors)) {
-                        cmd_get = cmd_get_str(get_cmds[i]);
-                        char cmd_args[20];
-                        sprintf(cmd_args, " %d", i);
-                        cmd_add_params_str(cmd_get, cmd_args);
-                        cmd_send(cmd_get);
-                    }
-                }
+            else if ((int32_t)(elapsed_ms - next_ms) >= 0) {
+                LOGD(tag, "SAMPLING... state: %d, action %d, samples left: %d", status_machine.state,
+                     status_machine.action, status_machine.samples_left);
+
+                // Samples are stamped with the trigger time, a late loop skips the lost samples
+                uint32_t late_ms = elapsed_ms - next_ms;
+                uint32_t step_period = status_machine.step_ms > 0 ? status_machine.step_ms : status_machine.step*1000;
+                if(step_period == 0)
+                    step_period = 1000;
+                next_ms += step_period;
+                if((int32_t)(elapsed_ms - next_ms) >= 0)
+                    next_ms = elapsed_ms + step_period;
+                uint32_t trigger = (uint32_t)dat_get_time() - late_ms/1000;
+
+                // Sample the active payloads with their drivers and store them
+                unsigned int payloads = (unsigned int)status_machine.active_payloads;
+                if(payloads >= (1U << status_machine.total_sensors))
+                    payloads = 0;
+                int rc;
+                if(status_machine.state == ST_BURST)
+                    rc = sen_burst_take_samples(payloads, trigger);
+                else
+                    rc = sen_take_samples(payloads, trigger);
+                if(rc < 0)
+                    LOGW(tag, "Unable to sample all active payloads (0x%X)", payloads);
                 if (status_machine.samples_left != -1) {
                     osSemaphoreTake(&repo_machine_sem, portMAX_DELAY);
                     status_machine.samples_left -= 1;
@@ -113,19 +152,14 @@ void taskSensors(void *param)
             }
         }
 
-        action = (int) status_machine.action;
-        state = (int) status_machine.state;
-        step = (int) status_machine.step;
-        active_payloads = (int) status_machine.active_payloads;
-        samples_left = (int) status_machine.samples_left;
-
-        dat_set_system_var(dat_drp_mach_action, action);
-        dat_set_system_var(dat_drp_mach_state, state);
-        dat_set_system_var(dat_drp_mach_step, step);
-        dat_set_system_var(dat_drp_mach_payloads, active_payloads);
-        dat_set_system_var(dat_drp_mach_left, samples_left);
-        elapsed_sec += 1;
-    }
-}
+        // Store the samples queued by sensor interrupts
+        dat_flush_isr_samples(SCH_SEN_ISR_RING_LEN);
 
+        // The burst ended, store the samples left in the RAM buffers
+        if(burst && status_machine.state != ST_BURST)
+            sen_burst_flush(~0U);
+        burst = status_machine.state == ST_BURST;
 
+        _sen_publish_machine(saved);
+    }
+}
@@ -0,0 +1,250 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define LOG_TAG_ID LOG_TAG_COM
+#include "taskSimNodes.h"
+
+static const char *tag = "SimNodes";
+
+/**
+ * Simulated node context
+ */
+typedef struct sim_node {
+    uint8_t addr;           ///< CSP address
+    uint8_t sport;          ///< Source port of the frames, one connection per node
+    uint16_t nframe;        ///< Next frame number
+    uint32_t index;         ///< Next sample number
+} sim_node_t;
+
+static sim_node_t sim_nodes[SCH_SIM_NODES > 0 ? SCH_SIM_NODES : 1];
+static osSemaphore sim_sem;
+static int sim_sem_ok = 0;
+static int sim_nodes_ok = 0;     ///< Set by sim_nodes_init, the workers do not run without it
+static sim_nodes_stats_t sim_stats;
+static uint32_t sim_drop_base = 0;  ///< SIM interface drops at the last stats reset
+
+static int _sim_nexthop(csp_iface_t *ifc, csp_packet_t *packet, uint32_t timeout);
+
+/** In-memory CSP interface of the simulated nodes */
+static csp_iface_t csp_if_sim = {
+    .name = "SIM",
+    .nexthop = _sim_nexthop,
+    .mtu = SCH_BUFF_MAX_LEN,
+};
+
+/**
+ * Add to the simulated nodes counters
+ */
+static void _sim_count(uint32_t *counter, uint32_t n)
+{
+    if(!sim_sem_ok)
+        return;
+    osSemaphoreTake(&sim_sem, portMAX_DELAY);
+    *counter += n;
+    osSemaphoreGiven(&sim_sem);
+}
+
+/**
+ * Packets routed to a simulated node. Pings are sent back to the source,
+ * other packets are dropped.
+ */
+static int _sim_nexthop(csp_iface_t *ifc, csp_packet_t *packet, uint32_t timeout)
+{
+    _sim_count(&sim_stats.received, 1);
+    if(packet->id.dport != CSP_PING)
+    {
+        csp_buffer_free(packet);
+        return CSP_ERR_NONE;
+    }
+
+    csp_id_t id = packet->id;
+    packet->id.src = id.dst;
+    packet->id.dst = id.src;
+    packet->id.sport = id.dport;
+    packet->id.dport = id.sport;
+    _sim_count(&sim_stats.pings, 1);
+    csp_qfifo_write(packet, &csp_if_sim, NULL);
+    return CSP_ERR_NONE;
+}
+
+/**
+ * Fill @n payload samples, from sample @first. Fields are taken as 32 bits
+ * values, floats are set with float values.
+ */
+static void _sim_fill(uint8_t *samples, int payload, uint32_t first, int n)
+{
+    const char *order = data_map[payload].data_order;
+    int size = data_map[payload].size;
+    int k, field;
+    for(k=0; k<n; k++)
+    {
+        uint8_t *sample = samples + k*size;
+        const char *fmt = order;
+        for(field=0; field*4+4 <= size; field++)
+        {
+            fmt = fmt != NULL ? strchr(fmt, '%') : NULL;
+            char type = fmt != NULL ? fmt[1] : 'u';
+            if(fmt != NULL)
+                fmt++;
+            if(type == 'f')
+            {
+                float value = (float)(first + k) + 0.25f*(float)field;
+                memcpy(sample + field*4, &value, 4);
+            }
+            else
+            {
+                uint32_t value = (first + k)*16 + field;
+                memcpy(sample + field*4, &value, 4);
+            }
+        }
+    }
+}
+
+/**
+ * Send a payload frame from a simulated node to this node
+ * @return 0 if OK, -1 if there is no CSP buffer
+ */
+static int _sim_send_frame(sim_node_t *node)
+{
+    int payload = SCH_SIM_PAYLOAD;
+    int n = COM_FRAME_MAX_LEN / data_map[payload].size;
+    int len = (int)offsetof(com_frame_t, data) + n*data_map[payload].size;
+
+    csp_packet_t *packet = csp_buffer_get(sizeof(com_frame_t));
+    if(packet == NULL)
+    {
+        _sim_count(&sim_stats.no_buffer, 1);
+        return -1;
+    }
+
+    com_frame_t *frame = (com_frame_t *)packet->data;
+    frame->node = node->addr;
+    frame->nframe = com_frame_hton_nframe(node->nframe);
+    frame->type = (uint8_t)(TM_TYPE_PAYLOAD + payload);
+    frame->ndata = csp_hton32((uint32_t)n);
+    _sim_fill(frame->data.data8, payload, node->index, n);
+    com_tm_hton32_buff(frame->data.data32, (len - (int)offsetof(com_frame_t, data) + 3)/4);
+    node->nframe = (uint16_t)((node->nframe + 1) & COM_FRAME_NUM_MASK);
+    node->index += (uint32_t)n;
+
+    packet->length = (uint16_t)len;
+    packet->id.ext = 0;
+    packet->id.pri = CSP_PRIO_NORM;
+    packet->id.src = node->addr;
+    packet->id.dst = SCH_COMM_ADDRESS;
+    packet->id.dport = SCH_TRX_PORT_TM;
+    packet->id.sport = node->sport;
+    com_frame_seal(packet);
+    csp_qfifo_write(packet, &csp_if_sim, NULL);
+
+    if(sim_sem_ok)
+    {
+        osSemaphoreTake(&sim_sem, portMAX_DELAY);
+        sim_stats.sent++;
+        sim_stats.samples += (uint32_t)n;
+        osSemaphoreGiven(&sim_sem);
+    }
+    return 0;
+}
+
+int sim_nodes_init(void)
+{
+    int i;
+    if(SCH_SIM_NODES < 1)
+        return 0;
+
+    if(SCH_SIM_FIRST_NODE < 0 || SCH_SIM_FIRST_NODE + SCH_SIM_NODES - 1 >= CSP_BROADCAST_ADDR ||
+       (SCH_COMM_ADDRESS >= SCH_SIM_FIRST_NODE && SCH_COMM_ADDRESS < SCH_SIM_FIRST_NODE + SCH_SIM_NODES))
+    {
+        LOGE(tag, "Invalid simulated nodes %d-%d (max. node %d, this node %d)", SCH_SIM_FIRST_NODE,
+             SCH_SIM_FIRST_NODE + SCH_SIM_NODES - 1, CSP_BROADCAST_ADDR - 1, SCH_COMM_ADDRESS);
+        return -1;
+    }
+    if(SCH_SIM_PAYLOAD < 0 || SCH_SIM_PAYLOAD >= last_sensor || data_map[SCH_SIM_PAYLOAD].size > COM_FRAME_MAX_LEN)
+    {
+        LOGE(tag, "Invalid simulated nodes payload %d", SCH_SIM_PAYLOAD);
+        return -1;
+    }
+
+    if(!sim_sem_ok)
+        sim_sem_ok = osSemaphoreCreate(&sim_sem) == OS_SEMAPHORE_OK;
+    memset(&sim_stats, 0, sizeof(sim_stats));
+
+    csp_iflist_add(&csp_if_sim);
+    for(i=0; i < SCH_SIM_NODES; i++)
+    {
+        sim_nodes[i].addr = (uint8_t)(SCH_SIM_FIRST_NODE + i);
+        sim_nodes[i].sport = (uint8_t)(CSP_MAX_BIND_PORT + 1 + i % (CSP_ID_PORT_MAX - CSP_MAX_BIND_PORT));
+        sim_nodes[i].nframe = 0;
+        sim_nodes[i].index = 0;
+        csp_route_set(sim_nodes[i].addr, &csp_if_sim, CSP_NODE_MAC);
+    }
+
+    sim_nodes_ok = 1;
+    LOGI(tag, "%d simulated nodes (%d-%d), %d workers", SCH_SIM_NODES, SCH_SIM_FIRST_NODE,
+         SCH_SIM_FIRST_NODE + SCH_SIM_NODES - 1, SCH_SIM_WORKERS);
+    return 0;
+}
+
+void sim_nodes_get_stats(sim_nodes_stats_t *stats, int reset)
+{
+    if(!sim_sem_ok)
+    {
+        memset(stats, 0, sizeof(sim_nodes_stats_t));
+        return;
+    }
+    osSemaphoreTake(&sim_sem, portMAX_DELAY);
+    *stats = sim_stats;
+    stats->dropped = csp_if_sim.drop - sim_drop_base;
+    if(reset)
+    {
+        memset(&sim_stats, 0, sizeof(sim_stats));
+        sim_drop_base = csp_if_sim.drop;
+    }
+    osSemaphoreGiven(&sim_sem);
+}
+
+void taskSimNodes(void *param)
+{
+    int worker = (int)(intptr_t)param;
+    LOGI(tag, "Started worker %d", worker);
+    if(worker < 0 || worker >= SCH_SIM_WORKERS || !sim_nodes_ok)
+    {
+        LOGE(tag, "Invalid worker %d, or simulated nodes not initialized", worker);
+        return;
+    }
+
+    // The frames of the nodes are spread along the period, so the router
+    // input queue does not fill up with the frames of all the nodes at once
+    int n_nodes = (SCH_SIM_NODES - worker + SCH_SIM_WORKERS - 1)/SCH_SIM_WORKERS;
+    if(n_nodes < 1)
+        return;
+    uint32_t slot_ms = SCH_SIM_PERIOD_MS/n_nodes > 0 ? SCH_SIM_PERIOD_MS/n_nodes : 1;
+    osDelay(slot_ms*worker/SCH_SIM_WORKERS);
+    portTick xLastWakeTime = osTaskGetTickCount();
+    int i = worker;
+    while(1)
+    {
+        _sim_send_frame(&sim_nodes[i]);
+        i += SCH_SIM_WORKERS;
+        if(i >= SCH_SIM_NODES)
+            i = worker;
+        osTaskDelayUntil(&xLastWakeTime, slot_ms);
+    }
+}
@@ -0,0 +1,191 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define LOG_TAG_ID LOG_TAG_COM
+#include "taskTracking.h"
+
+static const char *tag = "Tracking";
+static osPeriod trk_period;     ///< Loop timing (see obc_task_stats)
+
+#define TRK_TABLE_RX    (1)     ///< TRX RX parameters table (see com_set_config)
+#define TRK_TABLE_TX    (5)     ///< TRX TX parameters table
+
+static trk_state_t trk_state;
+static volatile uint32_t trk_rx_nominal = SCH_TRK_RX_FREQ_HZ;
+static volatile uint32_t trk_tx_nominal = SCH_TRK_TX_FREQ_HZ;
+static osSemaphore trk_sem;
+static int trk_sem_ok = 0;
+
+void trk_set_freq(uint32_t rx_freq, uint32_t tx_freq)
+{
+    trk_rx_nominal = rx_freq;
+    trk_tx_nominal = tx_freq;
+}
+
+uint32_t trk_doppler(uint32_t freq, double range_rate, int uplink)
+{
+    const double c = 299792.458;    // Speed of light [km/s]
+    // Received at f*(1 - rr/c), so the uplink is sent at f/(1 - rr/c)
+    double f = uplink ? (double)freq/(1.0 - range_rate/c) : (double)freq*(1.0 - range_rate/c);
+    double step = SCH_TRK_FREQ_STEP_HZ > 0 ? SCH_TRK_FREQ_STEP_HZ : 1;
+    return (uint32_t)(floor(f/step + 0.5)*step);
+}
+
+void trk_get_state(trk_state_t *state, int reset)
+{
+    if(!trk_sem_ok)
+    {
+        memset(state, 0, sizeof(trk_state_t));
+        return;
+    }
+    osSemaphoreTake(&trk_sem, portMAX_DELAY);
+    *state = trk_state;
+    if(reset)
+    {
+        trk_state.updates = 0;
+        trk_state.no_orbit = 0;
+        trk_state.sent = 0;
+        trk_state.dropped = 0;
+    }
+    osSemaphoreGiven(&trk_sem);
+}
+
+/**
+ * Queue a com_set_config command to set a TRX frequency, without waiting
+ * @return 0 if queued, 1 if there is no TRX (SCH_USE_NANOCOM), -1 if the
+ * commands queue was full
+ */
+static int _trk_send_freq(int table, uint32_t freq)
+{
+    char params[SCH_CMD_MAX_STR_PARAMS];
+    cmd_t *cmd = cmd_get_str("com_set_config");
+    if(cmd == NULL)
+        return 1;
+    snprintf(params, sizeof(params), "%d freq %u", table, (unsigned int)freq);
+    cmd_add_params_str(cmd, params);
+    return cmd_send_timeout(cmd, 0) == CMD_OK ? 0 : -1;
+}
+
+/**
+ * Send a frequency to the TRX if it changed, and count the result
+ * @param sent Last frequency sent, updated if the new one is queued
+ */
+static void _trk_update_freq(int table, uint32_t freq, uint32_t *sent, int *n_sent, int *n_dropped)
+{
+    if(freq == *sent)
+        return;
+    int rc = _trk_send_freq(table, freq);
+    if(rc < 0)
+    {
+        (*n_dropped)++;     // Retried in the next loop
+        return;
+    }
+    *sent = freq;
+    if(rc == 0)
+        (*n_sent)++;
+}
+
+/**
+ * Extrapolate an orbit state @dt seconds with the two body acceleration
+ */
+static void _trk_extrapolate(const double *r0, const double *v0, double dt, double *r, double *v)
+{
+    const double mu = 398600.4418;  // Earth gravitational parameter [km^3/s^2]
+    double d = sqrt(r0[0]*r0[0] + r0[1]*r0[1] + r0[2]*r0[2]);
+    double k = d > 0 ? -mu/(d*d*d) : 0;
+    int i;
+    for(i=0; i<3; i++)
+    {
+        v[i] = v0[i] + k*r0[i]*dt;
+        r[i] = r0[i] + v0[i]*dt + 0.5*k*r0[i]*dt*dt;
+    }
+}
+
+void taskTracking(void *param)
+{
+    LOGI(tag, "Started");
+    if(!trk_sem_ok)
+        trk_sem_ok = osSemaphoreCreate(&trk_sem) == OS_SEMAPHORE_OK;
+    if(trk_sem_ok)
+        osSemaphoreSetName(&trk_sem, "tracking");
+
+    time_t orbit_ts = 0;            // Time of the orbit state, read once per second
+    int orbit_ok = 0;
+    double r0[3], v0[3];
+    uint32_t rx_sent = 0, tx_sent = 0;
+    TLE tle;
+
+    osPeriodInit(&trk_period, "Tracking", SCH_TRK_PERIOD_MS);
+    while(1)
+    {
+        osPeriodDelay(&trk_period);
+
+        int ms;
+        time_t now = dat_get_time_ms(&ms);
+        if(now != orbit_ts)
+        {
+            orbit_ts = now;
+            orbit_ok = obc_tle_get(&tle) == 0 && obc_prop_tle_rv((int)now, r0, v0) == 0;
+        }
+
+        if(!orbit_ok)
+        {
+            if(trk_sem_ok)
+            {
+                osSemaphoreTake(&trk_sem, portMAX_DELAY);
+                trk_state.no_orbit++;
+                trk_state.tracking = 0;
+                osSemaphoreGiven(&trk_sem);
+            }
+            continue;
+        }
+
+        double r[3], v[3];
+        obc_look_t look;
+        _trk_extrapolate(r0, v0, ms/1000.0, r, v);
+        obc_pass_look(r, v, (double)now + ms/1000.0, &look);
+
+        int tracking = look.el >= SCH_TRK_MIN_EL_DEG;
+        uint32_t rx_freq = tracking ? trk_doppler(trk_rx_nominal, look.range_rate, 0) : trk_rx_nominal;
+        uint32_t tx_freq = tracking ? trk_doppler(trk_tx_nominal, look.range_rate, 1) : trk_tx_nominal;
+
+        int sent = 0, dropped = 0, changed = 0;
+        _trk_update_freq(TRK_TABLE_RX, rx_freq, &rx_sent, &sent, &dropped);
+        _trk_update_freq(TRK_TABLE_TX, tx_freq, &tx_sent, &sent, &dropped);
+
+        if(trk_sem_ok)
+        {
+            osSemaphoreTake(&trk_sem, portMAX_DELAY);
+            changed = tracking != trk_state.tracking;
+            trk_state.ts = now;
+            trk_state.ms = ms;
+            trk_state.look = look;
+            trk_state.tracking = tracking;
+            trk_state.rx_freq = rx_sent;
+            trk_state.tx_freq = tx_sent;
+            trk_state.updates++;
+            trk_state.sent += sent;
+            trk_state.dropped += dropped;
+            osSemaphoreGiven(&trk_sem);
+        }
+        if(changed)
+            LOGI(tag, "%s, az %.1f el %.1f, rx %u tx %u", tracking ? "Tracking" : "Satellite set",
+                 look.az, look.el, (unsigned int)rx_sent, (unsigned int)tx_sent);
+    }
+}
@@ -20,40 +20,82 @@
 #include "taskWatchdog.h"
 
 static const char *tag = "WDT";
+static osPeriod wdt_period;  ///< Loop timing (see obc_task_stats)
+
+/**
+ * Store the ground watchdog counter. If obc_sw_wdt changed since the last
+ * write, it was cleared (drp_clear_gnd_wdt) or set by ground, and the counter
+ * continues from the stored value.
+ * @param elapsed Counter in RAM
+ * @param saved Last value written
+ * @return Counter value
+ */
+static unsigned int _wdt_sync_gnd(unsigned int elapsed, unsigned int *saved)
+{
+    unsigned int stored = (unsigned int)dat_get_system_var(dat_obc_sw_wdt);
+    if(stored != *saved)
+        elapsed = stored;
+    dat_set_system_var(dat_obc_sw_wdt, (int)elapsed);
+    *saved = elapsed;
+    return elapsed;
+}
 
 void taskWatchdog(void *param)
 {
     LOGI(tag, "Started");
 
     portTick delay_ms    = 1000;        //Task period in [ms]
-    unsigned int max_obc_wdt = SCH_MAX_WDT_TIMER;     // Seconds to send "reset_wdt" command
+    unsigned int max_obc_wdt = SCH_MAX_WDT_TIMER;     // Seconds to clear the OBC wdt
     unsigned int max_gnd_wdt = SCH_MAX_GND_WDT_TIMER; // Seconds to send "reset" command
     unsigned int elapsed_obc_timer = 0; // OBC timer counter
-    unsigned int elapsed_sw_timer = 0; // Software timer counter
-    portTick xLastWakeTime = osTaskGetTickCount();
-    
+    unsigned int elapsed_sync = 0;      // Seconds since the software timer was stored
+    int rst_obc_id = cmd_resolve("obc_reset");
+
+    // The software timer is counted in RAM and stored every SCH_GND_WDT_SYNC seconds
+    unsigned int saved_sw_timer = (unsigned int)dat_get_system_var(dat_obc_sw_wdt);
+    unsigned int elapsed_sw_timer = saved_sw_timer; // Software timer counter. Should be cleared by a gnd command
+    osPeriodInit(&wdt_period, "Watchdog", delay_ms);
+
     while(1)
     {
         // Sleep task to count seconds
-        osTaskDelayUntil(&xLastWakeTime, delay_ms);
+        osPeriodDelay(&wdt_period);
         elapsed_obc_timer++; // Increase timer to reset the obc wdt
-        elapsed_sw_timer = (unsigned  int)dat_get_system_var(dat_obc_sw_wdt) + 1; //Increase software timer counter. Should be cleared by a gnd command
-        dat_set_system_var(dat_obc_sw_wdt, (int) elapsed_sw_timer); // Save increased software timer
+        elapsed_sw_timer++;
+        elapsed_sync++;
+
+        if(elapsed_sync >= SCH_GND_WDT_SYNC)
+        {
+            elapsed_sync = 0;
+            elapsed_sw_timer = _wdt_sync_gnd(elapsed_sw_timer, &saved_sw_timer);
+        }
 
-        // Periodically reset the OBC watchdog
+        // Periodically clear the OBC watchdog, directly so a busy command
+        // queue can not delay it
         if(elapsed_obc_timer > max_obc_wdt)
         {
             elapsed_obc_timer = 0;
-            cmd_t *rst_wdt = cmd_get_str("obc_reset_wdt");
-            cmd_send(rst_wdt);
+            obc_reset_wdt(NULL, NULL, 0);
         }
 
-        // If nobody clears elapsed_gnd_timer, then reset the OBC
+        // If nobody clears elapsed_gnd_timer, then reset the OBC. Check if it
+        // was cleared since the last sync first.
         if(elapsed_sw_timer > max_gnd_wdt)
         {
-            LOGW(tag, "Software watchdog overflow")
-            cmd_t *rst_obc = cmd_get_str("obc_reset");
-            cmd_send(rst_obc);
+            elapsed_sync = 0;
+            elapsed_sw_timer = _wdt_sync_gnd(elapsed_sw_timer, &saved_sw_timer);
+            if(elapsed_sw_timer > max_gnd_wdt)
+            {
+                LOGW(tag, "Software watchdog overflow")
+                // Do not block the watchdog, if the queue is full the reset
+                // is sent again the next period
+                cmd_t *rst_obc = cmd_get_idx(rst_obc_id);
+                if(rst_obc != NULL)
+                {
+                    rst_obc->priority = CMD_PRIO_HIGH;
+                    cmd_try_send(rst_obc);
+                }
+            }
         }
     }
 }
@@ -0,0 +1,214 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define LOG_TAG_ID LOG_TAG_COM
+#include "taskZmqHub.h"
+
+static const char *tag = "ZmqHub";
+
+#define ZMQ_HUB_HEADER (1 + sizeof(uint32_t))    ///< Message header, next hop and CSP id
+#define ZMQ_HUB_MSG_LEN (ZMQ_HUB_HEADER + SCH_BUFF_MAX_LEN)
+
+static void *zmq_hub_ctx = NULL;
+static void *zmq_hub_pub = NULL;    ///< Only used by taskZmqHubTx
+static void *zmq_hub_sub = NULL;    ///< Only used by taskZmqHubRx
+static osQueue zmq_hub_queue = 0;   ///< Packets to send
+
+static int _zmq_hub_nexthop(csp_iface_t *ifc, csp_packet_t *packet, uint32_t timeout);
+
+/** ZMQ hub CSP interface */
+static csp_iface_t csp_if_zmq_hub = {
+    .name = "ZMQHUB",
+    .nexthop = _zmq_hub_nexthop,
+    .mtu = SCH_BUFF_MAX_LEN,
+};
+
+/**
+ * Packets routed to the hub are sent by the TX task, that frees them
+ */
+static int _zmq_hub_nexthop(csp_iface_t *ifc, csp_packet_t *packet, uint32_t timeout)
+{
+    if(packet->length > SCH_BUFF_MAX_LEN)
+        return CSP_ERR_TX;
+    if(osQueueSend(zmq_hub_queue, &packet, timeout) != pdPASS)
+        return CSP_ERR_TIMEDOUT;
+    return CSP_ERR_NONE;
+}
+
+/**
+ * Next hop of a packet, the hub subscription filter of its message
+ */
+static uint8_t _zmq_hub_hop(csp_packet_t *packet)
+{
+    uint8_t mac = csp_rtable_find_mac(packet->id.dst);
+    return mac == CSP_NODE_MAC ? packet->id.dst : mac;
+}
+
+int zmq_hub_init(uint8_t addr, const char *pub_uri, const char *sub_uri, csp_iface_t **ifc)
+{
+    zmq_hub_queue = osQueueCreateType(SCH_BUFFERS_CSP, sizeof(csp_packet_t *), OS_QUEUE_MPSC);
+    if(zmq_hub_queue == 0)
+    {
+        LOGE(tag, "Unable to create the TX queue");
+        return -1;
+    }
+    osQueueSetName(zmq_hub_queue, "zmqhub");
+
+    zmq_hub_ctx = zmq_ctx_new();
+    zmq_hub_pub = zmq_hub_ctx != NULL ? zmq_socket(zmq_hub_ctx, ZMQ_PUB) : NULL;
+    zmq_hub_sub = zmq_hub_ctx != NULL ? zmq_socket(zmq_hub_ctx, ZMQ_SUB) : NULL;
+    if(zmq_hub_pub == NULL || zmq_hub_sub == NULL ||
+       zmq_connect(zmq_hub_pub, pub_uri) != 0 || zmq_connect(zmq_hub_sub, sub_uri) != 0 ||
+       zmq_setsockopt(zmq_hub_sub, ZMQ_SUBSCRIBE, &addr, sizeof(addr)) != 0)
+    {
+        LOGE(tag, "Unable to connect to the hub %s, %s (%s)", pub_uri, sub_uri, zmq_strerror(zmq_errno()));
+        if(zmq_hub_pub != NULL)
+            zmq_close(zmq_hub_pub);
+        if(zmq_hub_sub != NULL)
+            zmq_close(zmq_hub_sub);
+        if(zmq_hub_ctx != NULL)
+            zmq_ctx_term(zmq_hub_ctx);
+        zmq_hub_pub = zmq_hub_sub = zmq_hub_ctx = NULL;
+        return -1;
+    }
+
+    csp_iflist_add(&csp_if_zmq_hub);
+    *ifc = &csp_if_zmq_hub;
+    LOGI(tag, "Connected to the hub %s, %s, up to %d packets per message", pub_uri, sub_uri, SCH_COMM_ZMQ_BATCH);
+    return 0;
+}
+
+/**
+ * Send packets to the same hop as one multipart message, and free them
+ */
+static void _zmq_hub_send(csp_packet_t **packets, int n, uint8_t hop)
+{
+    uint8_t msg[ZMQ_HUB_MSG_LEN];
+    int i;
+    for(i = 0; i < n; i++)
+    {
+        csp_packet_t *packet = packets[i];
+        uint32_t id = csp_hton32(packet->id.ext);
+        msg[0] = hop;
+        memcpy(msg + 1, &id, sizeof(id));
+        memcpy(msg + ZMQ_HUB_HEADER, packet->data, packet->length);
+
+        // The last part ends the message, also after a failed part
+        if(zmq_send(zmq_hub_pub, msg, ZMQ_HUB_HEADER + packet->length, i < n-1 ? ZMQ_SNDMORE : 0) < 0)
+        {
+            csp_if_zmq_hub.tx_error++;
+        }
+        else
+        {
+            csp_if_zmq_hub.tx++;
+            csp_if_zmq_hub.txbytes += packet->length;
+        }
+        csp_buffer_free(packet);
+    }
+}
+
+void taskZmqHubTx(void *param)
+{
+    LOGI(tag, "Started TX");
+    if(zmq_hub_pub == NULL)
+    {
+        LOGE(tag, "ZMQ hub not initialized");
+        return;
+    }
+
+    csp_packet_t *batch[SCH_COMM_ZMQ_BATCH];
+    while(1)
+    {
+        // Take the queued packets, then wait a bit for the rest of the batch
+        int n = osQueueReceiveMany(zmq_hub_queue, batch, SCH_COMM_ZMQ_BATCH, sizeof(csp_packet_t *), portMAX_DELAY);
+        if(n < 1)
+            continue;
+        if(n < SCH_COMM_ZMQ_BATCH && SCH_COMM_ZMQ_BATCH_MS > 0)
+            n += osQueueReceiveMany(zmq_hub_queue, batch + n, SCH_COMM_ZMQ_BATCH - n, sizeof(csp_packet_t *), SCH_COMM_ZMQ_BATCH_MS);
+
+        // Consecutive packets to the same hop go in one message
+        int i, j;
+        for(i = 0; i < n; i = j)
+        {
+            uint8_t hop = _zmq_hub_hop(batch[i]);
+            for(j = i + 1; j < n && _zmq_hub_hop(batch[j]) == hop; j++);
+            _zmq_hub_send(batch + i, j - i, hop);
+        }
+    }
+}
+
+/**
+ * Queue a received message (or message part) to the router
+ */
+static void _zmq_hub_receive(zmq_msg_t *msg)
+{
+    size_t len = zmq_msg_size(msg);
+    if(len < ZMQ_HUB_HEADER || len > ZMQ_HUB_MSG_LEN)
+    {
+        csp_if_zmq_hub.frame++;
+        return;
+    }
+
+    csp_packet_t *packet = csp_buffer_get(len - ZMQ_HUB_HEADER);
+    if(packet == NULL)
+    {
+        csp_if_zmq_hub.drop++;
+        return;
+    }
+    const uint8_t *data = (const uint8_t *)zmq_msg_data(msg);
+    uint32_t id;
+    memcpy(&id, data + 1, sizeof(id));
+    packet->id.ext = csp_ntoh32(id);
+    packet->length = (uint16_t)(len - ZMQ_HUB_HEADER);
+    memcpy(packet->data, data + ZMQ_HUB_HEADER, packet->length);
+    csp_if_zmq_hub.rx++;
+    csp_if_zmq_hub.rxbytes += packet->length;
+    csp_qfifo_write(packet, &csp_if_zmq_hub, NULL);
+}
+
+void taskZmqHubRx(void *param)
+{
+    LOGI(tag, "Started RX");
+    if(zmq_hub_sub == NULL)
+    {
+        LOGE(tag, "ZMQ hub not initialized");
+        return;
+    }
+
+    zmq_msg_t msg;
+    zmq_msg_init(&msg);
+    while(1)
+    {
+        // Block for a message, then drain the received ones without blocking
+        int flags = 0;
+        while(zmq_msg_recv(&msg, zmq_hub_sub, flags) >= 0)
+        {
+            _zmq_hub_receive(&msg);
+            flags = ZMQ_DONTWAIT;
+        }
+        if(flags == 0)
+        {
+            if(zmq_errno() == ETERM)
+                break;
+            if(zmq_errno() != EINTR)
+                csp_if_zmq_hub.rx_error++;
+        }
+    }
+    zmq_msg_close(&msg);
+}
@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""
+Performance regression gate. Compares the benchmark results (one JSON line per
+result, as printed by the benchmark programs) with a stored baseline and fails
+if any metric is worse than the threshold.
+
+Each benchmark result is identified by the fields in BENCHS (the benchmark
+configuration) and compared in the metrics listed there. When a result appears
+several times (the runner repeats each benchmark) the best value is used, to
+filter out noise from other processes.
+
+Usage:
+    python3 bench_compare.py results.json baseline.json [--threshold 10]
+    python3 bench_compare.py results.json baseline.json --update
+
+Exit code is 1 if there is a regression or a result is missing, 0 otherwise.
+"""
+
+import argparse
+import json
+import os
+import sys
+
+# Benchmark name: (identification fields, {metric: 1 if higher is better, -1 if lower is better})
+BENCHS = {
+    "cmd_pipeline": (["storage_mode", "producers", "queue_len", "param_size"],
+                     {"cmds_per_s": 1, "lat_p50_us": -1}),
+    "storage": (["op", "storage_mode", "triple_wr", "cache", "batch", "rate"],
+                {"ops_per_s": 1, "lat_p50_us": -1}),
+    "tm_io": (["payload", "samples", "compress"],
+              {"samples_per_s": 1, "cpu_us_per_sample": -1}),
+    "constellation": (["storage_mode", "nodes", "workers", "period_ms"],
+                      {"cpu_us_per_frame": -1}),
+    "adcs": (["func", "real_size"],
+             {"ns_per_op": -1, "allocs_per_op": -1}),
+    "sgp4_range": (["threads", "points"],
+                   {"points_per_s": 1}),
+    "cmd_replay": (["storage_mode", "trace", "speed", "queue_len"],
+                   {"cmds_per_s": 1, "lat_p99_us": -1}),
+}
+
+
+def get_key(result):
+    """
+    Identification of a result: the benchmark name and its configuration
+    """
+    fields = BENCHS[result["bench"]][0]
+    return result["bench"] + "".join(" {}={}".format(f, result.get(f)) for f in fields)
+
+
+def load_results(fname):
+    """
+    Read the JSON lines of a results file, keeping the best value of each
+    metric by result key. Lines that are not benchmark results are ignored.
+    :param fname: Results file name
+    :return: Dict {key: {metric: value}}
+    """
+    results = {}
+    with open(fname) as results_file:
+        for line in results_file:
+            line = line.strip()
+            if not line.startswith('{"bench"'):
+                continue
+            result = json.loads(line)
+            if result["bench"] not in BENCHS:
+                continue
+            key = get_key(result)
+            best = results.setdefault(key, {})
+            for metric, sign in BENCHS[result["bench"]][1].items():
+                if metric not in result:
+                    continue
+                value = float(result[metric])
+                if metric not in best or (value - best[metric])*sign > 0:
+                    best[metric] = value
+    return results
+
+
+def compare(results, baseline, threshold):
+    """
+    Compare results with the baseline
+    :param results: Dict {key: {metric: value}}
+    :param baseline: Dict {key: {metric: value}}
+    :param threshold: Max. allowed slowdown in percent
+    :return: Number of regressions and missing results
+    """
+    failed = 0
+    print("{:<70} {:<18} {:>14} {:>14} {:>8}".format("Benchmark", "Metric", "Baseline", "Current", "Diff"))
+    for key in sorted(baseline):
+        bench = key.split(" ")[0]
+        if key not in results:
+            print("{:<70} missing".format(key))
+            failed += 1
+            continue
+        for metric, base in sorted(baseline[key].items()):
+            sign = BENCHS[bench][1][metric]
+            value = results[key].get(metric)
+            if value is None:
+                print("{:<70} {:<18} missing".format(key, metric))
+                failed += 1
+                continue
+            # Positive diff is a slowdown, in percent of the baseline
+            if base != 0:
+                diff = (base - value)*sign*100.0/abs(base)
+            else:
+                diff = 0.0 if value*sign >= 0 else float("inf")
+            status = "FAIL" if diff > threshold else ""
+            if status:
+                failed += 1
+            print("{:<70} {:<18} {:>14.2f} {:>14.2f} {:>7.1f}% {}".format(key, metric, base, value, 0.0 - diff, status))
+    for key in sorted(set(results) - set(baseline)):
+        print("{:<70} new, not in the baseline".format(key))
+    return failed
+
+
+def get_parameters():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('results', type=str, help="Benchmark results (JSON lines)")
+    parser.add_argument('baseline', type=str, help="Baseline file (JSON)")
+    parser.add_argument('--threshold', type=float, default=10.0, help="Max. slowdown in percent")
+    parser.add_argument('--update', action="store_true", help="Save the results as the new baseline")
+    return parser.parse_args()
+
+
+if __name__ == "__main__":
+    args = get_parameters()
+    results = load_results(args.results)
+    if len(results) == 0:
+        print("No benchmark results in {}".format(args.results))
+        sys.exit(1)
+
+    if args.update or not os.path.exists(args.baseline):
+        with open(args.baseline, "w") as baseline_file:
+            json.dump(results, baseline_file, indent=2, sort_keys=True)
+        print("Baseline saved in {} ({} results)".format(args.baseline, len(results)))
+        sys.exit(0)
+
+    with open(args.baseline) as baseline_file:
+        baseline = json.load(baseline_file)
+
+    failed = compare(results, baseline, args.threshold)
+    if failed:
+        print("{} regressions or missing results (threshold {}%)".format(failed, args.threshold))
+        sys.exit(1)
+    print("No regressions (threshold {}%)".format(args.threshold))
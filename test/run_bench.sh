@@ -0,0 +1,138 @@
+#!/usr/bin/env bash
+
+# Performance regression gate.
+#
+# Builds and runs the benchmarks (commands pipeline, storage, telemetry I/O,
+# constellation ingest, ADCS and SGP4) with a fixed number of iterations,
+# collects their JSON lines in bench_results_<ARCH>.json and compares them
+# with the baseline bench_baseline_<ARCH>.json using bench_compare.py. The
+# script fails if any metric is more than BENCH_THRESHOLD percent worse than
+# the baseline. The first run (or BENCH_UPDATE=1) saves the results as the new
+# baseline.
+#
+# Parameters (environment variables):
+#   BENCH_ARCH       X86 (default) or RPI. RPI cross-compiles the benchmarks
+#                    and runs them with qemu-arm
+#   BENCH_RUNS       Runs of each benchmark, the best result is used (default 3)
+#   BENCH_THRESHOLD  Max. slowdown in percent (default 10)
+#   BENCH_UPDATE     Set to 1 to save the results as the new baseline
+#   BENCH_TRACE      Commands trace recorded with obc_cmd_trace, replayed by
+#                    test_replay if set (take the baseline with the same trace)
+#   BENCH_TRACE_SPEED  Trace replay speed, 0 sends the commands without
+#                    waiting (default 0)
+#   RPI_CC           Cross compiler (default arm-linux-gnueabihf-gcc)
+#   RPI_SYSROOT      Target libraries for qemu-arm (default /usr/arm-linux-gnueabihf)
+#   RPI_CSP_LIB      Directory of a libcsp built with RPI_CC
+#                    (default src/drivers/rpi/libcsp/lib)
+#
+# Results are only comparable with a baseline taken in the same machine. Under
+# QEMU the times are not the ones of the real board, but a slowdown of the
+# generated code still shows up.
+
+# Gets the current execution directory (the absolute path to this script)
+SCRIPT_PATH="$( cd "$(dirname "$0")" ; pwd -P )"
+export WORKSPACE=${SCRIPT_PATH}/..
+
+BENCH_ARCH=${BENCH_ARCH:-X86}
+BENCH_RUNS=${BENCH_RUNS:-3}
+BENCH_THRESHOLD=${BENCH_THRESHOLD:-10}
+BENCH_RESULTS=${WORKSPACE}/test/bench_results_${BENCH_ARCH}.json
+BENCH_BASELINE=${WORKSPACE}/test/bench_baseline_${BENCH_ARCH}.json
+
+# Fixed iterations, change the baseline if these are changed
+export LOAD_N=5000
+export STORAGE_BENCH_N=5000
+export TM_IO_MAX_N=100
+export ADCS_BENCH_N=20000
+export CONSTELLATION_TIME_S=5
+
+if [ "${BENCH_ARCH}" = "RPI" ]; then
+    RPI_CC=${RPI_CC:-arm-linux-gnueabihf-gcc}
+    RPI_SYSROOT=${RPI_SYSROOT:-/usr/arm-linux-gnueabihf}
+    RPI_CSP_LIB=${RPI_CSP_LIB:-${WORKSPACE}/src/drivers/rpi/libcsp/lib}
+    # The linker skips the x86 libcsp (incompatible) and takes this one
+    CMAKE_ARGS="-DCMAKE_C_COMPILER=${RPI_CC} -DCMAKE_EXE_LINKER_FLAGS=-L${RPI_CSP_LIB}"
+    RUNNER="qemu-arm -L ${RPI_SYSROOT}"
+elif [ "${BENCH_ARCH}" = "X86" ]; then
+    CMAKE_ARGS=""
+    RUNNER=""
+else
+    echo "Unknown BENCH_ARCH ${BENCH_ARCH} (X86 | RPI)"
+    exit 1
+fi
+
+# Configures the flight software and builds a benchmark.
+# Usage: bench_build <test directory> <configure.py parameters>
+bench_build()
+{
+    local test_dir=$1
+    shift
+    cd ${WORKSPACE}/src/system/include
+    python3 configure.py "LINUX" --log_lvl "LOG_LVL_NONE" "$@" || return 1
+
+    cd ${WORKSPACE}/test/${test_dir}
+    rm -rf build_bench
+    mkdir build_bench
+    cd build_bench
+    cmake ${CMAKE_ARGS} .. > /dev/null && make > /dev/null
+}
+
+# Runs the benchmark built by bench_build BENCH_RUNS times, saving the results.
+# Usage: bench_run <test directory>
+bench_run()
+{
+    cd ${WORKSPACE}/test/$1/build_bench
+    local i
+    for i in $(seq ${BENCH_RUNS})
+    do
+        ${RUNNER} ./SUCHAI_Flight_Software_Test | grep '^{"bench"' >> ${BENCH_RESULTS}
+    done
+}
+
+FAILED=0
+rm -f ${BENCH_RESULTS}
+echo "Benchmarks for ${BENCH_ARCH}, ${BENCH_RUNS} runs each"
+
+# ---------------- --TEST_LOAD ------------------
+for i in "0" "1"
+do
+    bench_build test_load --comm "0" --fp "0" --hk "0" --test "0" --st_mode ${i} && bench_run test_load || FAILED=1
+done
+
+# ---------------- --TEST_STORAGE_BENCH ------------------
+for i in "0" "1" "3"
+do
+    bench_build test_storage_bench --comm "0" --fp "0" --hk "0" --test "0" --st_mode ${i} --st_triple_wr "0" && bench_run test_storage_bench || FAILED=1
+done
+
+# ---------------- --TEST_TM_IO ------------------
+bench_build test_tm_io --comm "1" --con "0" --fp "0" --hk "0" --test "0" --st_mode "0" --node "1" && bench_run test_tm_io || FAILED=1
+
+# ---------------- --TEST_CONSTELLATION ------------------
+bench_build test_constellation --comm "1" --con "0" --fp "0" --hk "0" --test "0" --st_mode "0" --node "1" --sim_nodes "15" && bench_run test_constellation || FAILED=1
+
+# ---------------- --TEST_ADCS_BENCH ------------------
+bench_build test_adcs_bench --comm "0" --fp "0" --hk "0" --test "0" --st_mode "0" && bench_run test_adcs_bench || FAILED=1
+
+# ---------------- --TEST_SGP4 ------------------
+bench_build test_sgp4 --comm "0" --fp "0" --hk "0" --test "0" --st_mode "0" && bench_run test_sgp4 || FAILED=1
+
+# ---------------- --TEST_REPLAY ------------------
+if [ -n "${BENCH_TRACE}" ]; then
+    export REPLAY_FILE=${BENCH_TRACE}
+    export REPLAY_SPEED=${BENCH_TRACE_SPEED:-0}
+    bench_build test_replay --comm "0" --fp "0" --hk "0" --test "0" --st_mode "0" && bench_run test_replay || FAILED=1
+fi
+
+if [ ${FAILED} -ne 0 ]; then
+    echo "Some benchmarks failed to build"
+    exit 1
+fi
+
+# ---------------- --COMPARE ------------------
+cd ${WORKSPACE}/test
+if [ "${BENCH_UPDATE}" = "1" ]; then
+    python3 bench_compare.py ${BENCH_RESULTS} ${BENCH_BASELINE} --update
+else
+    python3 bench_compare.py ${BENCH_RESULTS} ${BENCH_BASELINE} --threshold ${BENCH_THRESHOLD}
+fi
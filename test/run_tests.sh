@@ -49,7 +49,7 @@ python logs_comparator.py | cat >> test_cmd_comparator_log.txt
 # The test log is called test_unit_log.txt
 
 # Tests for all storage modes
-for i in "0" "1" "2"
+for i in "0" "1" "2" "3"
 do
 
     echo "Test for storage parameter ${i}"
@@ -75,23 +75,59 @@ done
 
 # ---------------- --TEST_LOAD ------------------
 
-# The test log is called test_load_log.txt
+# Commands pipeline benchmark. Each run prints one JSON line, the results of
+# all storage modes are collected in test_load_results.json. Parameters:
+# LOAD_PRODUCERS, LOAD_N, LOAD_PARAM_SIZE and LOAD_QUEUE_LEN (see taskTest.h)
 
-# Compiles the project with the test's parameters
-cd ${WORKSPACE}/src/system/include
-python3 configure.py "LINUX" --log_lvl "LOG_LVL_NONE"  --comm "0"  --fp "0"  --hk "0"  --test "0"  --st_mode "0"
+rm -f ${WORKSPACE}/test/test_load/test_load_results.json
+for i in "0" "1" "2"
+do
+    # Compiles the project with the test's parameters
+    cd ${WORKSPACE}/src/system/include
+    python3 configure.py "LINUX" --log_lvl "LOG_LVL_NONE"  --comm "0"  --fp "0"  --hk "0"  --test "0"  --st_mode ${i}
 
-# Compiles the test
-cd ${WORKSPACE}/test/test_load
-rm -rf build_test
-mkdir build_test
-cd build_test
-cmake ..
-make
+    # Compiles the test
+    cd ${WORKSPACE}/test/test_load
+    rm -rf build_test
+    mkdir build_test
+    cd build_test
+    cmake ..
+    make
 
-# Runs the test, saving a log file
-rm -f ../test_load_log.txt
-./SUCHAI_Flight_Software_Test | cat >> ../test_load_log.txt
+    # Runs the benchmark, saving the results
+    ./SUCHAI_Flight_Software_Test | grep '^{"bench"' >> ../test_load_results.json
+done
+echo ""
+
+# ---------------- --TEST_STORAGE_BENCH ------------------
+
+# Storage backends benchmark. Each run prints one JSON line per operation, the
+# results of all storage modes, with and without tripled writing, are collected
+# in test_storage_results.json. Parameters: STORAGE_BENCH_N,
+# STORAGE_BENCH_BATCH and STORAGE_BENCH_RATE (see main.c). Storage mode 3 uses
+# memory mapped files.
+
+rm -f ${WORKSPACE}/test/test_storage_bench/test_storage_results.json
+for i in "0" "1" "2" "3"
+do
+    for t in "0" "1"
+    do
+        # Compiles the project with the test's parameters
+        cd ${WORKSPACE}/src/system/include
+        python3 configure.py "LINUX" --log_lvl "LOG_LVL_NONE"  --comm "0"  --fp "0"  --hk "0"  --test "0"  --st_mode ${i}  --st_triple_wr ${t}
+
+        # Compiles the test
+        cd ${WORKSPACE}/test/test_storage_bench
+        rm -rf build_test
+        mkdir build_test
+        cd build_test
+        cmake ..
+        make
+
+        # Runs the benchmark, saving the results
+        ./SUCHAI_Flight_Software_Test | grep '^{"bench"' >> ../test_storage_results.json
+    done
+done
 echo ""
 
 # ---------------- --TEST_BUG_DELAY ------------------
@@ -116,7 +152,9 @@ rm -f ../test_bug_delay_log.txt
 
 # ---------------- --TEST_TM_IO ------------------
 
-# The test log is called test_tm_io_log.txt
+# The test log is called test_tm_io_log.txt, the telemetry round trip results
+# (one JSON line per payload and number of samples) are also saved in
+# test_tm_io_results.json
 
 # Compiles the project with the test's parameters
 cd ${WORKSPACE}/src/system/include
@@ -132,4 +170,27 @@ make
 
 # Runs the test, saving a log file
 rm -f ../test_tm_io_log.txt
-./SUCHAI_Flight_Software_Test | cat >> ../test_tm_io_log.txt
\ No newline at end of file
+./SUCHAI_Flight_Software_Test | cat >> ../test_tm_io_log.txt
+grep '^{"bench"' ../test_tm_io_log.txt > ../test_tm_io_results.json
+# ---------------- --TEST_FUZZ_TARGET ------------------
+
+# In-process fuzzing of the commands parser and the TC, CMD and TM ports,
+# needs clang. New inputs are saved in build_test/corpus, crashes in
+# build_test/crash-*. The log is called test_fuzz_target_log.txt
+
+# Compiles the project with the test's parameters
+cd ${WORKSPACE}/src/system/include
+python3 configure.py "LINUX" --log_lvl "LOG_LVL_NONE"  --comm "1" --con "0" --fp "0"  --hk "0"  --test "0"  --st_mode "0"
+
+# Compiles the test
+cd ${WORKSPACE}/test/test_fuzz_target
+rm -rf build_test
+mkdir build_test
+cd build_test
+CC=clang cmake ..
+make
+
+# Runs the fuzzer for one minute, saving a log file
+mkdir corpus
+rm -f ../test_fuzz_target_log.txt
+./SUCHAI_Flight_Software_Test -max_total_time=60 corpus ../corpus 2>&1 | cat >> ../test_fuzz_target_log.txt
@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+"""
+This file generate reference data to compare the SUCHAI ADCS math library
+(src/lib/math_utils.c) with numpy, in double and single precision.
+
+Each row has the inputs: q1 (4), q2 (4), v (3), w (3), M (3x3) and the
+expected results: q1*q2 (4), q1 frame conversion of v (3), inv(M) (3x3),
+M*v (3), v.w (1), v x w (3). Quaternions are scalar last [x, y, z, w].
+
+Execute: python3 generate_data.py
+"""
+import numpy as np
+
+N = 100
+
+
+def quat_mult(p, q):
+    """Hamilton product p*q, scalar last"""
+    pv, ps = p[:3], p[3]
+    qv, qs = q[:3], q[3]
+    vec = ps*qv + qs*pv + np.cross(pv, qv)
+    return np.hstack((vec, ps*qs - np.dot(pv, qv)))
+
+
+def quat_frame_conv(q, v):
+    """Rotate v with the attitude matrix of q (inertial to body)"""
+    qv, qs = q[:3], q[3]
+    skew = np.array([[0, -qv[2], qv[1]], [qv[2], 0, -qv[0]], [-qv[1], qv[0], 0]])
+    dcm = (qs**2 - np.dot(qv, qv))*np.eye(3) + 2*np.outer(qv, qv) - 2*qs*skew
+    return dcm.dot(v)
+
+
+rows = []
+for k in range(N):
+    q1 = np.array([np.sin(k+1), np.cos(2*k+1), np.sin(3*k+2), np.cos(k)+1.5])
+    q1 /= np.linalg.norm(q1)
+    q2 = np.array([np.cos(k+0.5), np.sin(2*k), np.cos(5*k+1), np.sin(k)+2.0])
+    q2 /= np.linalg.norm(q2)
+    v = np.array([np.sin(0.3*k), 2*np.cos(0.7*k), 0.5+np.sin(1.1*k)])*10
+    w = np.array([np.cos(0.2*k), np.sin(0.9*k), -1.0+np.cos(1.3*k)])
+    m = 2*np.eye(3) + 0.5*np.sin(np.arange(9)+k).reshape(3, 3)
+
+    rows.append(np.hstack((q1, q2, v, w, m.flatten(),
+                           quat_mult(q1, q2), quat_frame_conv(q1, v),
+                           np.linalg.inv(m).flatten(), m.dot(v),
+                           np.dot(v, w), np.cross(v, w))))
+
+np.savetxt("data.csv", np.array(rows), fmt="%.12f", delimiter=",")
@@ -0,0 +1,94 @@
+//
+// Compares the ADCS math library (math_utils.c) with numpy reference values
+// (data.csv, see generate_data.py) using the selected real_t precision.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "math_utils.h"
+
+#define N_COLS 46   ///< 23 inputs and 23 expected results per row
+
+#if SCH_ADCS_FLOAT
+#define TOL 1e-4    ///< Relative tolerance, single precision
+#else
+#define TOL 1e-9    ///< Relative tolerance, double precision
+#endif
+
+static double max_err = 0;
+static int n_fail = 0;
+
+// Compare @n results with the reference, relative to the reference magnitude
+static void check(const char *name, int row, real_t *res, double *ref, int n)
+{
+    for(int i=0; i<n; i++)
+    {
+        double err = fabs((double)res[i] - ref[i])/(1.0 + fabs(ref[i]));
+        if(err > max_err)
+            max_err = err;
+        if(err > TOL)
+        {
+            printf("Row %d %s[%d]: %.10f != %.10f\n", row, name, i, (double)res[i], ref[i]);
+            n_fail++;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char *fname = argc > 1 ? argv[1] : "../data.csv";
+    char line[1024];
+    double d[N_COLS];
+    int row = 0;
+
+    FILE *file = fopen(fname, "r");
+    if(file == NULL)
+    {
+        printf("Unable to open %s\n", fname);
+        return 1;
+    }
+
+    while(fgets(line, sizeof(line), file) != NULL)
+    {
+        char *p = line;
+        int n;
+        for(n=0; n<N_COLS; n++)
+        {
+            char *end;
+            d[n] = strtod(p, &end);
+            if(end == p)
+                break;
+            p = (*end == ',') ? end+1 : end;
+        }
+        if(n != N_COLS)
+            continue;
+
+        quaternion_t q1, q2, qm;
+        vector3_t v, w, vb, mv, vw;
+        matrix3_t m, minv;
+        int i;
+        for(i=0; i<4; i++) { q1.q[i] = d[i]; q2.q[i] = d[4+i]; }
+        for(i=0; i<3; i++) { v.v[i] = d[8+i]; w.v[i] = d[11+i]; }
+        for(i=0; i<9; i++) m.m[i/3][i%3] = d[14+i];
+
+        quat_mult(&q1, &q2, &qm);
+        quat_frame_conv(&q1, &v, &vb);
+        mat_inverse(m, &minv);
+        mat_vec_mult(m, v, &mv);
+        real_t vdotw = vec_inner_product(v, w);
+        vec_outer_product(v, w, &vw);
+
+        check("quat_mult", row, qm.q, d+23, 4);
+        check("quat_frame_conv", row, vb.v, d+27, 3);
+        check("mat_inverse", row, (real_t *)minv.m, d+30, 9);
+        check("mat_vec_mult", row, mv.v, d+39, 3);
+        check("vec_inner_product", row, &vdotw, d+42, 1);
+        check("vec_outer_product", row, vw.v, d+43, 3);
+        row++;
+    }
+    fclose(file);
+
+    printf("%s precision: %d rows, %d errors, max. relative error %e\n",
+           SCH_ADCS_FLOAT ? "Single" : "Double", row, n_fail, max_err);
+    return (row == 0 || n_fail != 0) ? 1 : 0;
+}
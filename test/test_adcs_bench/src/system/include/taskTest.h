@@ -0,0 +1,29 @@
+//
+// ADCS timing benchmark
+//
+
+#ifndef SUCHAI_FLIGHT_SOFTWARE_TASKTEST_H
+#define SUCHAI_FLIGHT_SOFTWARE_TASKTEST_H
+
+#include <math.h>
+#include <time.h>
+
+#include "config.h"
+#include "globals.h"
+
+#include "osDelay.h"
+#include "repoCommand.h"
+#include "cmdADCS.h"
+#include "taskADCS.h"
+#include "igrf13.h"
+#include "bench_utils.h"
+
+#define BENCH_N_DEFAULT 100000  ///< Default iterations per benchmark
+
+/**
+ * Run every ADCS benchmark and exit
+ * @param param Iterations as a string (ADCS_BENCH_N), BENCH_N_DEFAULT if NULL
+ */
+void taskTest(void* param);
+
+#endif //SUCHAI_FLIGHT_SOFTWARE_TASKTEST_H
@@ -0,0 +1,216 @@
+//
+// ADCS timing benchmark. Runs the ADCS estimation, control and magnetic model
+// functions with fixed inputs and reports the time and heap allocations per
+// call.
+//
+
+#include "taskTest.h"
+
+static const char* tag = "adcs_bench";
+
+/**
+ * Heap allocations counter. With BENCH_WRAP_MALLOC the linker redirects
+ * malloc, calloc and realloc to these wrappers (see CMakeLists.txt).
+ */
+static volatile unsigned long bench_allocs = 0;
+
+#ifdef BENCH_WRAP_MALLOC
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    __atomic_add_fetch(&bench_allocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    __atomic_add_fetch(&bench_allocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    __atomic_add_fetch(&bench_allocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+#endif
+
+/**
+ * Fixed benchmark inputs, restored before each call so every iteration does
+ * the same work
+ */
+typedef struct bench_input {
+    adcs_state_t st;        ///< ADCS state
+    real_t P[6][6];         ///< ESKF error covariance
+    vector3_t bias;         ///< Gyroscope bias
+    vector3_t mag_b;        ///< Magnetometer, body frame (normalized)
+    vector3_t mag_i;        ///< Magnetic model, inertial frame (normalized)
+} bench_input_t;
+
+static bench_input_t input;
+static bench_input_t work;
+static adcs_ctrl_t ctrl;        ///< Controller context, built for the input mode
+static volatile real_t sink;    ///< Keeps the results alive
+
+static void _bench_input_init(void)
+{
+    memset(&input, 0, sizeof(input));
+    quaternion_t q = {.q={0.0, 0.0, 0.38268343, 0.92387953}};
+    input.st.q_est = q;
+    input.st.q_tgt.q[0] = 0.0; input.st.q_tgt.q[1] = 0.25881905;
+    input.st.q_tgt.q[2] = 0.0; input.st.q_tgt.q[3] = 0.96592583;
+    input.st.omega_est.v0 = 0.1002623; input.st.omega_est.v1 = -0.10142402; input.st.omega_est.v2 = 0.20332787;
+    input.st.omega_tgt.v0 = 0.01; input.st.omega_tgt.v1 = 0.01; input.st.omega_tgt.v2 = 0.01;
+    input.st.mag_est.v0 = 6723.12366721; input.st.mag_est.v1 = 10229.07189747; input.st.mag_est.v2 = 15710.68799647;
+    input.st.pos_i.v0 = 4452.31; input.st.pos_i.v1 = -3218.77; input.st.pos_i.v2 = 4191.02;
+    input.st.mode = DAT_OBC_OPMODE_NAD_POINT;
+    _mat_set_diag((real_t*)input.P, REAL(1.0), 6, 6);
+    input.bias.v0 = 0.001; input.bias.v1 = -0.002; input.bias.v2 = 0.0005;
+    input.mag_b.v0 = 0.33757741; input.mag_b.v1 = 0.51358994; input.mag_b.v2 = 0.78883893;
+    vec_normalize(&input.st.mag_est, &input.mag_i);
+    memset(&ctrl, 0, sizeof(ctrl));
+    adcs_ctrl_update(&ctrl, input.st.mode);
+
+    // State block used by the commands
+    adcs_state_store(&input.st);
+}
+
+/* Benchmarks, one call each */
+
+// State block based prediction (command loop)
+static void _bench_predict_state(void)
+{
+    eskf_predict_state((real_t *)work.P, REAL(0.1));
+}
+
+// In-process prediction, same steps as taskADCS _adcs_predict
+static void _bench_predict(void)
+{
+    vector3_t w, nbias;
+    quaternion_t q;
+    real_t Q[6][6];
+    vec_cons_mult(REAL(-1.0), &work.bias, &nbias);
+    vec_sum(work.st.omega_est, nbias, &w);
+    eskf_integrate(work.st.q_est, w, REAL(0.1), &q);
+    quat_normalize(&q, &work.st.q_est);
+    eskf_compute_error(w, REAL(0.1), work.P, Q);
+    sink = work.P[0][0];
+}
+
+static void _bench_update_mag(void)
+{
+    matrix3_t R;
+    eskf_update_mag(work.mag_b, work.mag_i, work.P, &R, &work.st.q_est, &work.bias);
+    sink = work.st.q_est.q[3];
+}
+
+// adcs_control_torque without sending the torque to the ADCS system
+static void _bench_control_torque_cmd(void)
+{
+    adcs_state_t st;
+    adcs_state_load(&st);
+    adcs_ctrl_update(&ctrl, st.mode);
+    adcs_calc_torque(&st, &ctrl, REAL(0.1));
+    sink = st.torque.v0;
+}
+
+static void _bench_calc_torque(void)
+{
+    adcs_calc_torque(&work.st, &ctrl, REAL(0.1));
+    sink = work.st.torque.v0;
+}
+
+// adcs_mag_moment without sending the moment to the ADCS system
+static void _bench_mag_moment_cmd(void)
+{
+    adcs_state_t st;
+    adcs_state_load(&st);
+    adcs_ctrl_update(&ctrl, st.mode);
+    adcs_calc_mag_moment(&st, &ctrl);
+    sink = st.mag_moment.v0;
+}
+
+static void _bench_calc_mag_moment(void)
+{
+    adcs_calc_mag_moment(&work.st, &ctrl);
+    sink = work.st.mag_moment.v0;
+}
+
+static void _bench_igrf(void)
+{
+    double mag[3];
+    IgrfCalc(2021.42, 0.5865, -1.2385, 500000.0, mag);
+    sink = (real_t)mag[0];
+}
+
+typedef struct bench {
+    const char *name;
+    void (*run)(void);
+} bench_t;
+
+static const bench_t benchs[] = {
+    {"eskf_predict_state", _bench_predict_state},
+    {"eskf_predict", _bench_predict},
+    {"eskf_update_mag", _bench_update_mag},
+    {"adcs_control_torque", _bench_control_torque_cmd},
+    {"adcs_calc_torque", _bench_calc_torque},
+    {"adcs_mag_moment", _bench_mag_moment_cmd},
+    {"adcs_calc_mag_moment", _bench_calc_mag_moment},
+    {"IgrfCalc", _bench_igrf},
+};
+
+/**
+ * Run a benchmark @n times. The input copy is timed apart and subtracted.
+ */
+static void _bench_run(const bench_t *bench, long n)
+{
+    long i;
+    uint64_t t0 = bench_now_ns();
+    for(i=0; i<n; i++)
+        work = input;
+    uint64_t t_copy = bench_now_ns() - t0;
+
+    unsigned long allocs = bench_allocs;
+    t0 = bench_now_ns();
+    for(i=0; i<n; i++)
+    {
+        work = input;
+        bench->run();
+    }
+    uint64_t t_run = bench_now_ns() - t0;
+    allocs = bench_allocs - allocs;
+
+    double ns = t_run > t_copy ? (double)(t_run - t_copy)/n : 0.0;
+    LOGR(tag, "%-22s %12.1f ns/op %8.2f allocs/op", bench->name, ns, (double)allocs/n);
+
+    // One JSON line, parsed by the regression scripts
+    printf("{\"bench\": \"adcs\", \"func\": \"%s\", \"real_size\": %d, \"n\": %ld, "
+           "\"ns_per_op\": %.1f, \"allocs_per_op\": %.2f}\n",
+           bench->name, (int)sizeof(real_t), n, ns, (double)allocs/n);
+    fflush(stdout);
+}
+
+void taskTest(void* param)
+{
+    long n = param != NULL ? strtol((char *)param, NULL, 10) : BENCH_N_DEFAULT;
+    if(n <= 0)
+        n = BENCH_N_DEFAULT;
+
+    LOGI(tag, "Started");
+    LOGI(tag, "---- ADCS benchmark, %ld iterations, real_t %d bytes ----", n, (int)sizeof(real_t));
+#ifndef BENCH_WRAP_MALLOC
+    LOGW(tag, "Allocations are not counted (BENCH_WRAP_MALLOC not defined)");
+#endif
+
+    _bench_input_init();
+    int i;
+    for(i=0; i<(int)(sizeof(benchs)/sizeof(benchs[0])); i++)
+        _bench_run(&benchs[i], n);
+
+    LOGI(tag, "---- Sending Exit Command ----");
+    cmd_t *cmd_exit = cmd_get_str("obc_reset");
+    cmd_send(cmd_exit);
+}
@@ -45,10 +45,7 @@ int main(void)
     dispatcher_queue = osQueueCreate(10,sizeof(cmd_t *));
     if(dispatcher_queue == 0)
         LOGE(tag, "Error creating dispatcher queue");
-    executer_stat_queue = osQueueCreate(1,sizeof(int));
-    if(executer_stat_queue == 0)
-        LOGE(tag, "Error creating executer stat queue");
-    executer_cmd_queue = osQueueCreate(1,sizeof(cmd_t *));
+    executer_cmd_queue = osQueueCreate(SCH_CMD_EXE_QUEUE_LEN,sizeof(cmd_t *));
     if(executer_cmd_queue == 0)
         LOGE(tag, "Error creating executer cmd queue");
 
@@ -44,8 +44,7 @@ int main(void)
 
     /* Initializing shared Queues */
     dispatcher_queue = osQueueCreate(25,sizeof(cmd_t *));
-    executer_cmd_queue = osQueueCreate(1,sizeof(cmd_t *));
-    executer_stat_queue = osQueueCreate(1,sizeof(int));
+    executer_cmd_queue = osQueueCreate(SCH_CMD_EXE_QUEUE_LEN,sizeof(cmd_t *));
 
     int n_threads = 3;
     os_thread threads_id[n_threads];
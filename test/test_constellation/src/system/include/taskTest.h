@@ -0,0 +1,37 @@
+//
+// Created by gedoix on 10-01-19.
+//
+
+#ifndef SUCHAI_FLIGHT_SOFTWARE_TASKTEST_H
+#define SUCHAI_FLIGHT_SOFTWARE_TASKTEST_H
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <csp/csp.h>
+
+#include "config.h"
+#include "globals.h"
+
+#include "osDelay.h"
+
+#include "repoCommand.h"
+#include "repoData.h"
+#include "taskIngest.h"
+#include "taskSimNodes.h"
+#include "bench_utils.h"
+
+#define CONSTELLATION_TIME_S        (10)    ///< Seconds the simulated nodes are measured, CONSTELLATION_TIME_S can change it
+#define CONSTELLATION_TIMEOUT_MS    (30000) ///< Max time to wait for the frames sent to be stored
+
+/**
+ * Constellation ingest benchmark. The SCH_SIM_NODES simulated nodes send
+ * payload frames to this node for CONSTELLATION_TIME_S seconds, received by
+ * the communications task and stored by the ingest pipeline in the tables of
+ * each node. Prints a JSON line with the frames and samples stored per second,
+ * the CPU time per frame and the round trip time of a ping to a simulated
+ * node, then exits.
+ */
+void taskTest(void* param);
+
+#endif //SUCHAI_FLIGHT_SOFTWARE_TASKTEST_H
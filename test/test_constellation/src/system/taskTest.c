@@ -0,0 +1,74 @@
+//
+// Created by gedoix on 10-01-19.
+//
+// Constellation ingest benchmark: the simulated nodes of taskSimNodes send
+// payload frames to this node through the in-memory CSP interface SIM. The
+// frames are received by com_receive_tm and stored by the ingest pipeline in
+// the tables of each node, as the frames of real satellites received by a
+// ground station.
+//
+
+#include "include/taskTest.h"
+
+static const char* tag = "constellation_test";
+
+void taskTest(void* param)
+{
+    LOGI(tag, "Started");
+    LOGI(tag, "---- Constellation ingest test ----");
+
+    // Wait for the communications, ingest and simulated nodes tasks
+    osDelay(1000);
+
+    char *env = getenv("CONSTELLATION_TIME_S");
+    int seconds = env != NULL ? atoi(env) : CONSTELLATION_TIME_S;
+
+    // Routing to a simulated node and back
+    int ping_ms = csp_ping(SCH_SIM_FIRST_NODE, 1000, 16, CSP_O_NONE);
+
+    sim_nodes_stats_t sim;
+    ingest_stats_t ingest;
+    sim_nodes_get_stats(&sim, 1);
+    ingest_get_stats(&ingest, 1);
+    uint64_t cpu_start = bench_cpu_ns();
+    uint64_t t_start = bench_now_ns();
+
+    osDelay((uint32_t)seconds*1000);
+    sim_nodes_get_stats(&sim, 0);
+
+    // Wait until the frames sent in the window are stored or discarded
+    uint32_t waited_ms = 0;
+    do
+    {
+        ingest_get_stats(&ingest, 0);
+        if(ingest.stored + ingest.errors + ingest.dropped >= sim.sent)
+            break;
+        osDelay(1);
+    }
+    while(++waited_ms < CONSTELLATION_TIMEOUT_MS);
+
+    uint64_t t_run = bench_now_ns() - t_start;
+    uint64_t cpu = bench_cpu_ns() - cpu_start;
+    double run_s = (double)t_run/1e9;
+    int ok = sim.sent > 0 && ingest.stored >= sim.sent && ingest.errors == 0 && ingest.dropped == 0 &&
+             sim.no_buffer == 0 && sim.dropped == 0 && ping_ms >= 0;
+
+    printf("{\"bench\": \"constellation\", \"storage_mode\": %d, \"nodes\": %d, \"workers\": %d, \"period_ms\": %d, "
+           "\"ingest_workers\": %d, \"time_s\": %.3f, \"frames\": %u, \"samples\": %u, \"stored\": %u, "
+           "\"errors\": %u, \"dropped\": %u, \"no_buffer\": %u, \"router_drops\": %u, \"drain_ms\": %u, "
+           "\"frames_per_s\": %.1f, \"samples_per_s\": %.1f, \"cpu_us_per_frame\": %.3f, \"ping_ms\": %d, "
+           "\"ok\": %s}\n",
+           SCH_STORAGE_MODE, SCH_SIM_NODES, SCH_SIM_WORKERS, SCH_SIM_PERIOD_MS, SCH_INGEST_WORKERS, run_s,
+           sim.sent, sim.samples, ingest.stored, ingest.errors, ingest.dropped, sim.no_buffer, sim.dropped,
+           waited_ms, run_s > 0 ? ingest.stored/run_s : 0.0, run_s > 0 ? sim.samples/run_s : 0.0,
+           sim.sent > 0 ? cpu/1e3/sim.sent : 0.0, ping_ms, ok ? "true" : "false");
+    fflush(stdout);
+
+    if(!ok)
+        LOGE(tag, "Constellation test failed: %u frames sent, %u stored", sim.sent, ingest.stored);
+
+    LOGI(tag, "---- Sending Exit Command ----");
+
+    cmd_t *cmd_exit = cmd_get_str("obc_reset");
+    cmd_send(cmd_exit);
+}
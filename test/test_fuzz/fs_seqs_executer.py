@@ -5,7 +5,7 @@ import time
 import sys
 import json
 import glob
-from proc_info import *
+from mem_info import *
 
 SCH_TRX_PORT_TM = 9               # ///< Telemetry port
 SCH_TRX_PORT_TC = 10               # ///< Telecommands port
@@ -62,16 +62,10 @@ def execute_file_seqs(exec_dir, path_to_json, log_path, protocol, print_logfile)
         time.sleep(1)
         prev_dir = os.getcwd()
         # Run flight software sending n_cmds random commands with 1 random parameter
+        # The output is always captured to parse the heap usage (obc_mem_stats)
         os.chdir(exec_dir)
-        if print_logfile:
-            init_time = time.time()  # Start measuring execution time of the sequence
-            suchai_process = Popen([exec_cmd], stdin=PIPE, stdout=PIPE)
-        else:
-            init_time = time.time()  # Start measuring execution time of the sequence
-            suchai_process = Popen([exec_cmd], stdin=PIPE)
-
-        proc_pid = suchai_process.pid
-        rm_start, vm_start = get_mem_info(proc_pid)
+        init_time = time.time()  # Start measuring execution time of the sequence
+        suchai_process = Popen([exec_cmd], stdin=PIPE, stdout=PIPE)
 
         time.sleep(4)
         os.chdir(prev_dir)
@@ -81,6 +75,10 @@ def execute_file_seqs(exec_dir, path_to_json, log_path, protocol, print_logfile)
         header = CspHeader(src_node=int(addr), dst_node=int(dest), dst_port=int(port), src_port=55)
         node.send_message("drp_ebf 1010", header)
 
+        # Heap usage at the start of the sequence
+        header = CspHeader(src_node=int(addr), dst_node=int(dest), dst_port=int(port), src_port=55)
+        node.send_message(MEM_STATS_CMD + " 0", header)
+
         # Start sending sequences
         # time.sleep(0.5)  # Give some time to zmqnode threads (writer and reader)
         for cmd in seq["cmds"]:
@@ -88,7 +86,9 @@ def execute_file_seqs(exec_dir, path_to_json, log_path, protocol, print_logfile)
             header = CspHeader(src_node=int(addr), dst_node=int(dest), dst_port=int(port), src_port=55)
             node.send_message(cmd["cmd_name"] + " " + cmd["params"], header)
 
-        rm_end, vm_end = get_mem_info(proc_pid)
+        # Heap usage at the end of the sequence
+        header = CspHeader(src_node=int(addr), dst_node=int(dest), dst_port=int(port), src_port=55)
+        node.send_message(MEM_STATS_CMD + " 0", header)
 
         # Exit SUCHAI process
         hdr = CspHeader(src_node=int(addr), dst_node=int(dest), dst_port=int(port), src_port=56)
@@ -102,23 +102,25 @@ def execute_file_seqs(exec_dir, path_to_json, log_path, protocol, print_logfile)
             print("Error: {}".format(e))
         end_time = time.time()
 
+        output = suchai_process.stdout.readlines()
         if print_logfile:
             # Write log in file
             output_file = os.path.join(log_path, str(seq_num) + "-" + os.path.basename(path_to_json).split(".")[0]+".log")
             with open(output_file, 'wb') as logfile:
-                for line in suchai_process.stdout:
+                for line in output:
                     logfile.write(line)
         seq_num += 1
 
+        mem_leak = get_mem_leak(output)
         print("Return code: ", return_code)
         print("Execution time (s): ", end_time - init_time)
-        print("Memory usage (kb): ", rm_end - rm_start)
+        print("Memory not freed (bytes): ", mem_leak)
 
         return_codes.append(return_code)
 
         #assert return_code == 0
         #assert end_time - init_time < 10
-        #assert rm_end - rm_start
+        #assert all(leak == 0 for leak in mem_leak.values())
 
         node.stop()
         os.chdir(prev_dir)
@@ -0,0 +1,46 @@
+import re
+
+MEM_STATS_CMD = "obc_mem_stats"
+MEM_STATS_FIELDS = ("live", "peak", "allocs", "frees")
+_LOG_RE = re.compile(r'^\[[^\]]*\]\[[^\]]*\]\[obc\] (.*)$')
+
+
+def get_mem_stats(lines):
+    """
+    Parse the heap usage tables printed by the obc_mem_stats command in the
+    flight software output.
+    :param lines: List of output lines (bytes or str).
+    :return: List of tables, in order. Each table is a dict subsystem ->
+    dict(live, peak, allocs, frees), bytes and counters.
+    """
+    tables = []
+    table = None
+    for line in lines:
+        if isinstance(line, bytes):
+            line = line.decode('utf-8', errors='replace')
+        m = _LOG_RE.match(line.strip())
+        if m is None:
+            continue
+        values = m.group(1).split()
+        if values[:2] == ["Subsystem", "Live[B]"]:
+            table = {}
+            tables.append(table)
+        elif table is not None and len(values) == 5 and all(v.isdigit() for v in values[1:]):
+            table[values[0]] = dict(zip(MEM_STATS_FIELDS, (int(v) for v in values[1:])))
+        else:
+            table = None
+    return tables
+
+
+def get_mem_leak(lines):
+    """
+    Live bytes of each subsystem that were not freed between the first and the
+    last obc_mem_stats tables of the output.
+    :param lines: List of output lines (bytes or str).
+    :return: Dict subsystem -> bytes. Empty if there are less than two tables.
+    """
+    tables = get_mem_stats(lines)
+    if len(tables) < 2:
+        return {}
+    start, end = tables[0], tables[-1]
+    return {name: end[name]["live"] - start.get(name, {"live": 0})["live"] for name in end}
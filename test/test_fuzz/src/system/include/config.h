@@ -32,6 +32,7 @@
 /* Platform specific settings */
 #ifdef GROUNDSTATION
     #define SCH_RESEND_TM_NODE  11  ///< If defined, resend TM packets to CosmosRB node
+    #define SCH_INGEST_PUB_URI  "tcp://*:8010"  ///< If defined, publish the decoded TM samples on a ZMQ PUB socket (see ingest_pub_header_t)
     #define SCH_USE_NANOPOWER
     #define SCH_USE_NANOCOM
     //#define SCH_USE_GSSB
@@ -48,6 +49,17 @@
 #define SCH_NAME                "SUCHAI-DEV"      ///< Project code name
 #define SCH_DEVICE_ID           0                 ///< Device unique ID
 #define SCH_SW_VERSION          "2.1.5"           ///< Software version
+#define SCH_LOG_ASYNC           (0)                ///< Log from a background task (log_task), producers never block (0 | 1)
+#define SCH_LOG_QUEUE_LEN       (32)               ///< Async log messages waiting to be written
+#define SCH_LOG_MSG_LEN         (128)              ///< Max. length of an async log message
+#define SCH_LOG_RATE_MAX        (0)                ///< Max. log messages per second of each tag, except errors and results, 0 for unlimited
+#define SCH_LOG_BINARY          (0)                ///< Send logs to log_node as binary records (format ID and raw args), see sandbox/log_parser.py (0 | 1)
+#define SCH_LOG_LVL_MAX         LOG_LVL_VERBOSE    ///< Most verbose level compiled in, logs above it are removed from the build
+#define SCH_PROF_ENABLE         (1)                ///< Profiling counters and timers of hot paths (SCH_PROF_BEGIN/END), see prof_utils.h (0 | 1)
+#define SCH_PROF_SAMPLE_STACKS  (256)              ///< Distinct stacks aggregated by a sampling profiler session (SCH_TRX_PORT_PROF), Linux only
+#define SCH_PROF_SAMPLE_MAX_HZ  (100)              ///< Max. sampling profiler rate per task in Hz
+#define SCH_PROF_SAMPLE_MAX_S   (60)               ///< Max. sampling profiler session length in seconds
+#define SCH_MEM_STATS           (1)                ///< Heap accounting by subsystem of sch_malloc/sch_free, see mem_utils.h (0 | 1)
 
 /* General system settings */
 #define SCH_CON_ENABLED         1     ///< TaskConsole enabled (0 | 1)
@@ -55,12 +67,43 @@
 #define SCH_FP_ENABLED          0      ///< TaskFlightPlan enabled (0 | 1)
 #define SCH_HK_ENABLED          0      ///< TaskHousekeeping enabled (0 | 1)
 #define SCH_SEN_ENABLED         0     ///< TaskSensors enabled (0 | 1)
+#define SCH_DL_ENABLED          0      ///< TaskDownlink enabled (0 | 1)
+#define SCH_ADCS_ENGINE         1    ///< TaskADCS runs the ADCS pipeline in-process (1) or by sending ADCS commands (0)
+#define SCH_ADCS_CTRL_MS        100  ///< ADCS in-process control period in ms, the fastest one with SCH_ADCS_BUDGET
+#define SCH_ADCS_CTRL_MAX_MS    1000 ///< ADCS in-process slowest control period in ms, used if SCH_ADCS_BUDGET can't be met
+#define SCH_ADCS_EST_MIN_MS     50   ///< ADCS in-process fastest estimate (loop) period in ms
+#define SCH_ADCS_BUDGET         50   ///< ADCS in-process max. CPU utilization in %, the estimate and control rates are adapted to it (0 for fixed SCH_ADCS_CTRL_MS rates)
+#define SCH_ADCS_CALIB_MS       5000 ///< ADCS in-process window to measure the estimate and control costs, in ms
+#define SCH_ADCS_PUBLISH_MS     1000 ///< ADCS in-process status variables update period in ms
+#define SCH_ADCS_GYRO_MS        100  ///< ADCS in-process gyroscope sample period (ESKF predict) in ms, 0 to disable
+#define SCH_ADCS_MAG_MS         200  ///< ADCS in-process magnetometer sample period (ESKF update) in ms, 0 to disable
+#define SCH_ADCS_STT_MS         1000 ///< ADCS in-process quaternion (ADCS/STT) sample period in ms, 0 to disable
+#define SCH_ADCS_SUN_MS         1000 ///< ADCS in-process sun sensor and sun model sample period in ms, 0 to disable
+#define SCH_ADCS_TLE_MS         1000 ///< ADCS in-process orbit propagation and magnetic model period in ms, 0 to disable
+#define SCH_ADCS_RW_MS          200  ///< ADCS in-process reaction wheel telemetry period in ms (one speed or current each time), 0 to disable
+#define SCH_ADCS_SUN_EPH_S      600  ///< Sun ephemeris cache period in seconds, the eclipse is updated every SCH_ADCS_SUN_MS
+#define SCH_OBC_EPH_LEN         240  ///< Orbit ephemeris cache points, propagated after obc_update_tle, 0 to disable
+#define SCH_OBC_EPH_STEP        30   ///< Orbit ephemeris cache step in seconds
+#define SCH_GS_LAT_DEG          (-33.457)    ///< Ground station geodetic latitude in degrees, for the pass prediction
+#define SCH_GS_LON_DEG          (-70.664)    ///< Ground station longitude in degrees, east positive
+#define SCH_GS_ALT_M            (520.0)      ///< Ground station altitude over the WGS84 ellipsoid in meters
+#define SCH_GS_MIN_EL_DEG       (10.0)       ///< Ground station min. elevation of a pass in degrees
+#define SCH_TRK_PERIOD_MS       100          ///< Ground station tracking period in ms, Doppler and look angles of the TLE satellite (see taskTracking.h)
+#define SCH_TRK_RX_FREQ_HZ      437250000    ///< Tracking, TRX RX (downlink) frequency without Doppler in Hz (see com_track_freq)
+#define SCH_TRK_TX_FREQ_HZ      437250000    ///< Tracking, TRX TX (uplink) frequency without Doppler in Hz
+#define SCH_TRK_FREQ_STEP_HZ    50           ///< Tracking, frequency corrections are rounded to this step in Hz, and only sent to the TRX when they change
+#define SCH_TRK_MIN_EL_DEG      (0.0)        ///< Tracking, min. elevation in degrees to correct the frequencies, the nominal ones are set below it
+#ifndef SCH_ADCS_FLOAT
+#define SCH_ADCS_FLOAT          0    ///< ADCS math in single precision, for targets with a single precision FPU (0 | 1)
+#endif
 #define SCH_TEST_ENABLED        0    ///< Set to run tests (0 | 1)
 #define SCH_WDT_PERIOD          120                ///< CPU watchdog timer period in seconds
 #define SCH_MAX_WDT_TIMER       60                 ///< Seconds to send wdt_reset command
 #define SCH_MAX_GND_WDT_TIMER   (3600*48)          ///< Seconds to reset the OBC if the ground watchdog was not clear
+#define SCH_GND_WDT_SYNC        60                 ///< Seconds between writes of the ground watchdog counter (obc_sw_wdt) to storage
 #define SCH_UART_BAUDRATE       (500000)           ///< UART baud rate for serial console
 #define SCH_KISS_UART_BAUDRATE  (500000)           ///< UART baud rate for kiss communication
+#define SCH_I2C_UART_WINDOW     (4)                ///< RPi I2C-UART bridge frames waiting confirmation, 0 for fixed size frames and one frame at a time
 #define SCH_KISS_DEVICE         "/dev/ttyUSB0"     ///< Kiss device path
 
 /* Communications system settings */
@@ -68,26 +111,115 @@
 #define SCH_TNC_ADDRESS         9                  ///< TNC node address
 #define SCH_TRX_ADDRESS         5                  ///< TRX node address
 #define SCH_EPS_ADDRESS         2                  ///< EPS node address
+#define SCH_EPS_HK_MAX_AGE_MS   1000               ///< Max. age of the cached EPS housekeeping used by the EPS commands in ms
 #define SCH_TRX_PORT_TM         (9)                ///< Telemetry port
 #define SCH_TRX_PORT_TC         (10)               ///< Telecommands port
 #define SCH_TRX_PORT_RPT        (11)               ///< Digirepeater port (resend packets)
 #define SCH_TRX_PORT_CMD        (12)               ///< Commands port (execute console commands)
 #define SCH_TRX_PORT_DBG        (13)               ///< Debug port, logs output
-#define SCH_COMM_ZMQ_OUT        "tcp://127.0.0.1:8002"  ///< Out socket URI
-#define SCH_COMM_ZMQ_IN         "tcp://127.0.0.1:8001"   ///< In socket URI
+#define SCH_TRX_PORT_DBG_BIN    (17)               ///< Debug port, binary logs output
+#define SCH_TRX_PORT_TC_BIN     (18)               ///< Binary telecommands port (id, length and packed parameters records)
+#define SCH_TRX_PORT_PROF       (19)               ///< Debug port, sampling profiler sessions (Linux)
+#define SCH_TRX_PORT_ACK        (20)               ///< Telemetry acknowledgements port (run-length encoded sample ranges)
+#define SCH_COMM_ZMQ_OUT        "tcp://127.0.0.1:8002"  ///< Out socket URI, tcp:// or ipc:// (same host)
+#define SCH_COMM_ZMQ_IN         "tcp://127.0.0.1:8001"   ///< In socket URI, tcp:// or ipc:// (same host)
+#define SCH_COMM_ZMQ_BATCH      8                        ///< Max. packets sent in one multipart message (1 to use the libcsp zmqhub interface, see taskZmqHub.h)
+#define SCH_COMM_ZMQ_BATCH_MS   1                        ///< Max. delay (ms) of a packet waiting for more packets to batch (0 to batch only the queued packets)
 #define SCH_TX_INHIBIT          10                 /// Default silent time in seconds [0, 1800 (30min)]
 #define SCH_TX_PWR              0                  /// Default TX power [0|1|2|3]
 #define SCH_TX_BCN_PERIOD       60                 /// Default beacon period in seconds
 #define SCH_TX_FREQ             437250000          /// Default TRX freq in Hz
 #define SCH_TX_BAUD             4800               /// Default TRX baudrate [4800|9600|19200
+#define SCH_TM_COMPRESS         0                  /// Send payload telemetry delta encoded and compressed (0 | 1)
+#define SCH_TM_COMPRESS_MAX     64                 /// Max. payload samples in a compressed telemetry frame
+#define SCH_TM_CHUNK_FRAMES     10                 /// Payload telemetry frames sent per chunk by tm_send_all/from/range_time, queued commands run between chunks (0 to send all at once)
+#define SCH_TM_MUX              1                  /// Downlink manager packs partial frames of several payloads in TM_TYPE_PAYLOAD_MUX frames (0 | 1)
+#define SCH_TM_BCN_DELTA        0                  /// Send status beacons delta encoded against the last acknowledged keyframe (0 | 1)
+#define SCH_TM_BCN_KEYFRAME     10                 /// Status beacons between full keyframes
+#define SCH_TM_BCN_BUILD_S      5                  /// Rebuild the prebuilt status beacon every SCH_TM_BCN_BUILD_S seconds (see tm_bcn_build)
+#define SCH_COM_MAX_PACKETS     10                 /// TX pacer burst, packets to transmit in a row before pacing at the baudrate
+#define SCH_COM_TX_DELAY_MS     3000               /// Max. delay (ms) waiting for free CSP buffers before a transmission
+#define SCH_COM_TX_LOAD         80                 /// TX pacer rate, percentage of the com_baud baudrate [1, 100]
+#define SCH_COM_TX_MIN_BUFFERS  2                  /// Free CSP buffers required to transmit
+#define SCH_COM_ACK_BUFFERS     2                  /// CSP buffers reserved for TC replies, other packets leave them free (see com_buffer_get)
+#define SCH_COM_ACK_TIMEOUT_MS  100                /// Max. delay (ms) queueing the reply of a TC
+#define SCH_COM_TC_WAIT_MS      500                /// Max. delay (ms) waiting for the TC commands results before replying, shorter than the ground TC timeout
+#define SCH_COM_TC_READ_MS      100                /// Read timeout (ms) of TC, CMD and DBG connections
+#define SCH_COM_BULK_READ_MS    500                /// Read timeout (ms) of TM, file, repeater and service connections
+#define SCH_COM_BULK_QUEUE_LEN  4                  /// Bulk connections waiting for a communications worker
+#define SCH_COM_NATIVE_ORDER    1                  /// Send TM data words in the host byte order, flagged in the frame header, instead of network order (0 | 1)
+#define SCH_COM_FRAME_CRC       1                  /// Append a CRC32C to the TM frames sent, flagged in the frame header (0 | 1). Frames received with the flag are always checked
+#define SCH_COM_LINK_RDP        0                  /// Default link, connect with CSP RDP (0 | 1), see com_set_link
+#define SCH_COM_LINK_WINDOW     4                  /// Default link, RDP window in packets
+#define SCH_COM_LINK_MTU        0                  /// Default link, file frames data length in bytes sent with SFP (0 for one CSP buffer frames)
+#define SCH_COM_LINKS           4                  /// Nodes with their own link transfer mode
+#define SCH_COM_CONFIG_CACHE_S  60                 /// Max. age (s) of the cached TRX parameters read by com_get_config, 0 to always read the TRX
+#define SCH_INGEST_QUEUE_LEN    64                 /// TM ingest, received payload frames waiting to be stored
+#define SCH_INGEST_BATCH        16                 /// TM ingest, max frames taken by the writer at once
+#define SCH_INGEST_BUFF_LEN     4096               /// TM ingest, decoded samples buffer in bytes
+#define SCH_INGEST_PUT_MS       1000               /// TM ingest, max delay (ms) of the receive task with the queue full before dropping a frame
+#define SCH_INGEST_WORKERS      1                  /// TM ingest, writer tasks, frames are assigned to a writer by source node
+#define SCH_SIM_NODES           0                  /// Simulated nodes in this process, on the in-memory CSP interface SIM, sending payload TM to this node (0 to disable, see taskSimNodes.h)
+#define SCH_SIM_FIRST_NODE      16                 /// Simulated nodes, first node address, the nodes take the addresses up to 30 (31 is the CSP broadcast address)
+#define SCH_SIM_WORKERS         2                  /// Simulated nodes, tasks shared by the nodes
+#define SCH_SIM_PERIOD_MS       1000               /// Simulated nodes, period (ms) of the payload frames of each node
+#define SCH_SIM_PAYLOAD         0                  /// Simulated nodes, payload id of the frames (data_map index)
+#define SCH_DL_MAX_RANGES       8                  /// Downlink manager, max. acknowledged ranges per payload above the drp_ack mark
+#define SCH_DL_ACK_TIMEOUT_MS   10000              /// Downlink manager, time (ms) to wait for acks before retransmitting a payload
+#define SCH_DL_IDLE_MS          500                /// Downlink manager, delay (ms) when idle
+#define SCH_DL_PASS_AUTO        1                  /// Downlink manager, start a session to SCH_DL_PASS_NODE at the predicted AOS of each pass (0 | 1)
+#define SCH_DL_PASS_NODE        10                 /// Downlink manager, ground station node of the predicted passes
+#define SCH_DL_PASS_HORIZON     7200               /// Downlink manager, pass prediction horizon in seconds
+#define SCH_DL_PASS_PERIOD      600                /// Downlink manager, seconds between pass predictions until the staging starts
+#define SCH_DL_STAGE_LEAD       60                 /// Downlink manager, seconds before the AOS to stage the first frames of the pass
+#define SCH_DL_STAGE_FRAMES     16                 /// Downlink manager, payload frames staged in RAM before the AOS, 0 to disable
+#define SCH_SEN_TICK_MS         100                /// Sensors task period (ms), resolution of the sampling step
+#define SCH_SEN_BURST_BUFF      16384              /// Sensors burst mode, RAM buffers size in bytes (all payloads)
+#define SCH_SEN_REDUCE_BUFF     8192               /// Sensors data reduction, pre-trigger RAM buffers size in bytes (all payloads)
+#define SCH_SEN_REDUCE_FIELDS   16                 /// Sensors data reduction, max fields with statistics per payload
+#define SCH_SEN_ISR_RING_LEN    16                 /// Sensors, samples queued from interrupts until stored by the task (power of 2)
+#define SCH_SEN_ISR_SAMPLE_MAX  64                 /// Sensors, max. size in bytes of a sample queued from an interrupt
+#define SCH_I2C_BUSES           3                  /// I2C bus managers, the bus number is the platform bus handle (nanomind TWI 0-2, RPi /dev/i2c-N), see taskI2CBus.h
+#define SCH_I2C_QUEUE_LEN       16                 /// I2C bus manager, transactions waiting per bus
+#define SCH_RPT_QUEUE_LEN       16                 /// Repeater, packets waiting to be resent
+#define SCH_RPT_RATE_BPS        64                 /// Repeater, bytes per second resent for each source node (token bucket rate)
+#define SCH_RPT_BURST           1024               /// Repeater, token bucket size in bytes of each source node
+#define SCH_RPT_TX_MS           1000               /// Repeater, max. delay (ms) resending a packet
+#define SCH_RPT_STORE_MSGS      0                  /// Repeater, messages held out of the ground station passes until the next one (0 to resend them at once, see taskRepeater.h)
+#define SCH_I2C_WAITERS         8                  /// I2C bus manager, max. tasks waiting for their transactions at the same time (see i2c_bus_transaction)
 
 /* Data repository settings */
-#define SCH_STORAGE_MODE        1    ///< Status repository location. (0) RAM, (1) Single external.
+#define SCH_STORAGE_MODE        1    ///< Status repository location. (0) RAM, (1) SQLite, (2) PostgreSQL, (3) Memory mapped files.
 #define SCH_STORAGE_TRIPLE_WR   1   ///< Tripled writing enabled (0 | 1)
-#define SCH_STORAGE_FILE        "/tmp/suchai.db"   ///< File to store the database, only if @SCH_STORAGE_MODE is 1
+#define SCH_STORAGE_CACHE       (1)    ///< Cache status variables in RAM, only if @SCH_STORAGE_MODE > 0 (0 | 1)
+#define SCH_STORAGE_CACHE_SYNC  (60)   ///< Period in seconds to write back cached status variables
+#define SCH_STORAGE_SNAPSHOT    (1)    ///< Snapshot the cached status variables on each sync to restore them at boot in one read, only if @SCH_STORAGE_CACHE is 1 (0 | 1)
+#define SCH_STORAGE_NOINIT      (0)    ///< Keep the status variables in a .noinit RAM section across software resets (obc_reset), if the RAM survives the reset (0 | 1)
+#define SCH_STORAGE_FILE        "/tmp/suchai.db"   ///< File to store the database (or files prefix), only if @SCH_STORAGE_MODE is 1 or 3
 #define SCH_STORAGE_PGUSER      "kaminari"
 #define SCH_STORAGE_PGPASS      "proyectosuchai2020"
 #define SCH_STORAGE_PGHOST      "localhost"
+#define SCH_STORAGE_COPY_BUFF   (8192) ///< PostgreSQL COPY buffer in bytes, rows sent per round trip when storing payload batches
+#define SCH_STORAGE_PG_POOL     (2)    ///< PostgreSQL connections for concurrent payload reads and writes
+#define SCH_STORAGE_PG_TIMEOUT_MS (5000) ///< PostgreSQL max. payload query time (ms) before it is cancelled
+#define SCH_STORAGE_PG_PARTITION (0)    ///< PostgreSQL payload tables partitioned by month of tstz, with a primary key on (id, tstz). Applies to new tables
+#define SCH_STORAGE_PG_PARTITION_KEEP (0) ///< Monthly payload partitions kept attached, older ones are detached (0 to keep all)
+#define SCH_STORAGE_LAZY        (1)    ///< Create the payload tables on first use instead of at boot (0 | 1)
+#define SCH_STORAGE_SQLITE_PROFILE (1) ///< SQLite durability profile. (0) SQLite defaults, (1) Ops: WAL, synchronous NORMAL, larger cache and mmap, (2) Paranoid: rollback journal, synchronous EXTRA
+#define SCH_STORAGE_SQLITE_CACHE_KB (2048) ///< SQLite page cache in KiB, Ops profile
+#define SCH_STORAGE_SQLITE_MMAP   (16*1024*1024) ///< SQLite database bytes accessed with mmap, Ops profile (0 disables it)
+#define SCH_STORAGE_SQLITE_WAL_PAGES (4000) ///< WAL pages that force a checkpoint on commit, drp_sync checkpoints the WAL before
+#define SCH_STORAGE_SQLITE_SYNC_REPO    (-1) ///< SQLite synchronous level of status repo writes (0 OFF, 1 NORMAL, 2 FULL, 3 EXTRA), -1 to use the profile level
+#define SCH_STORAGE_SQLITE_SYNC_FP      (2)  ///< SQLite synchronous level of flight plan writes, -1 to use the profile level
+#define SCH_STORAGE_SQLITE_SYNC_PAYLOAD (-1) ///< SQLite synchronous level of payload writes, -1 to use the profile level
+#define SCH_STORAGE_SQLITE_READERS      (2)  ///< SQLite read-only connections for payload reads and flight plan listing, Ops profile (0 to read with the writer connection)
+#define SCH_STORAGE_RETAIN_ROWS   (0)    ///< Max. samples kept per payload, the oldest are deleted in the background (0 keeps all)
+#define SCH_STORAGE_RETAIN_AGE    (0)    ///< Max. age in seconds of the acknowledged payload samples kept (0 keeps all)
+#define SCH_STORAGE_RETAIN_STEP   (256)  ///< Max. samples deleted per payload in each retention run
+#define SCH_STORAGE_RETAIN_PERIOD (60)   ///< Period in seconds of the retention runs (drp_trim housekeeping job)
+#define SCH_DRP_EXPORT_CHUNK    (256)  ///< Payload samples per column chunk written by drp_export
+#define SCH_STORAGE_RECENT      (8)    ///< Last payload samples per payload kept in RAM to serve the recent samples reads (0 disables it)
+#define SCH_STORAGE_CRC         (1)    ///< Keep a CRC32C per payload sample, checked on read, only if @SCH_STORAGE_MODE is 0 or 3, and in the nanomind flash (0 | 1)
 
 #define SCH_SECTIONS_PER_PAYLOAD 2                 ///< Memory blocks for storing each payload type TODO: Make configurable per payload
 #define SCH_SIZE_PER_SECTION 256*1024              ///< Size of each memory block in flash storage
@@ -107,18 +239,102 @@
 #define SCH_TASK_WDT_STACK        (5*256)   ///< Watchdog task stack size in words
 #define SCH_TASK_INI_STACK        (5*256)   ///< Init task stack size in words
 #define SCH_TASK_COM_STACK        (5*256)   ///< Communications task stack size in words
+#define SCH_TASK_COM_WORKERS      (2)       ///< Communications workers for bulk connections (0 to handle all in taskCommunications)
 #define SCH_TASK_FPL_STACK        (5*256)   ///< Flight plan task stack size in words
 #define SCH_TASK_CON_STACK        (5*256)   ///< Console task stack size in words
 #define SCH_TASK_HKP_STACK        (5*256)   ///< Housekeeping task stack size in words
 #define SCH_TASK_CSP_STACK        (5*256)     ///< CSP route task stack size in words
 #define SCH_TASK_SEN_STACK        (5*256)   ///< Sensor task stack size in words
+#define SCH_TASK_LOG_STACK        (5*256)   ///< Async log task stack size in words
+#define SCH_TASK_DL_STACK         (5*256)   ///< Downlink task stack size in words
+#define SCH_TASK_ING_STACK        (5*256)   ///< TM ingest task stack size in words
+#define SCH_TASK_SIM_STACK        (5*256)   ///< Simulated nodes task stack size in words
+#define SCH_TASK_I2C_STACK        (5*256)   ///< I2C bus manager task stack size in words
+#define SCH_TASK_TRK_STACK        (5*256)   ///< Ground station tracking task stack size in words
+#define SCH_TASK_RPT_STACK        (5*256)   ///< Repeater task stack size in words
+#define SCH_TASK_BCN_STACK        (5*256)   ///< Beacon task stack size in words
+#define SCH_TASK_ZMQ_STACK        (5*256)   ///< ZMQ hub tasks stack size in words
+
+/**
+ * Scheduling settings. Only in Linux, and the CPU masks in ESP32.
+ *
+ * Real time tasks (dispatcher, executers and ADCS) and the other tasks can be
+ * pinned to different CPUs, so comms or console load does not delay them. In
+ * the ESP32 Wi-Fi runs on core 0 (PRO CPU), with comms and the other tasks.
+ */
+#ifdef ESP32
+#define SCH_TASK_RT_CPUS          (0x2)     ///< CPU affinity mask of the real time tasks, 0 for any CPU
+#define SCH_TASK_BG_CPUS          (0x1)     ///< CPU affinity mask of the other tasks, 0 for any CPU
+#else
+#define SCH_TASK_RT_CPUS          (0)       ///< CPU affinity mask of the real time tasks, 0 for any CPU
+#define SCH_TASK_BG_CPUS          (0)       ///< CPU affinity mask of the other tasks, 0 for any CPU
+#endif
+#define SCH_TASK_MLOCKALL         (0)       ///< Lock the process memory to avoid page faults (0 | 1)
+#define SCH_BOOT_PARALLEL         (1)       ///< Run independent boot steps in parallel threads, Linux only (0 | 1)
+#define SCH_OS_SIM_SPEED          (1)       ///< Virtual clock speed of the sim OS backend while tasks run, 0 to only set the tick with osTaskSetTickCount
+#define SCH_OS_QUEUE_STATS        (1)       ///< Queues depth, sends, full events and producers block time, see osQueueGetStats (0 | 1)
+#define SCH_OS_LOCK_STATS         (0)       ///< Lock contention statistics of named semaphores, Linux only, see osLockGetStats (0 | 1)
+#define SCH_OS_STATIC_QUEUES      (16)      ///< FreeRTOS static allocation (configSUPPORT_STATIC_ALLOCATION), max. queues with static buffers
+#define SCH_OS_STATIC_QUEUE_BYTES (8192)    ///< FreeRTOS static allocation, bytes for the items of all static queues
+#define SCH_OS_STATIC_SEMAPHORES  (48)      ///< FreeRTOS static allocation, max. static mutexes, semaphores and events
+#define SCH_OS_STATIC_STACK_WORDS (16*5*256) ///< FreeRTOS static allocation, words for the stacks of all static tasks
 
 #define SCH_BUFF_MAX_LEN          (256)     ///< General buffers max length in bytes
 #define SCH_BUFFERS_CSP           (10)       ///< Number of available CSP buffers
 #define SCH_FP_MAX_ENTRIES        (25)      ///< Max number of flight plan entries
+#define SCH_FP_PAGE               (8)       ///< Flight plan entries per page listed by fp_show and tm_send_fp
+#define SCH_FP_JOURNAL            (1)       ///< Journal the flight plan to keep it across resets, only if @SCH_STORAGE_MODE is 0 (0 | 1)
+#define SCH_FP_JOURNAL_SIZE       (4096)    ///< Journal size in bytes that triggers a compaction
+#define SCH_HK_JOBS_MAX           (16)      ///< Max number of housekeeping periodic jobs (see obc_hk_set)
+#define SCH_DAT_SUBS_MAX          (8)       ///< Max number of status variable change subscriptions (see dat_subscribe)
 #define SCH_CMD_MAX_ENTRIES       (255)      ///< Max number of commands in the repository
+#define SCH_CMD_STATIC            (0)        ///< Use the const command table generated by cmdtable.py, commands not in the table are added at runtime (0 | 1)
 #define SCH_CMD_MAX_STR_PARAMS    (256)      ///< Limit for the parameters length
 #define SCH_CMD_MAX_STR_NAME      (256)      ///< Limit for the length of the name of a command
 #define SCH_CMD_MAX_STR_FORMAT    (128)      ///< Limit for the length of the format field of a command
+#define SCH_CMD_POOL_SIZE         (32)       ///< Number of preallocated commands in the command pool
+#define SCH_CMD_POOL_PARAMS_LEN   (64)       ///< Inline parameters buffer of pooled commands in bytes
+#define SCH_CMD_EXE_QUEUE_LEN     (8)        ///< Commands waiting for execution in the executer queue
+#define SCH_CMD_BATCH_MAX         (16)       ///< Max number of commands sent in one batch (see cmd_send_batch)
+#define SCH_CMD_SEND_TIMEOUT_MS   (100)      ///< Max. time in ms the communications task waits for space in the dispatcher queue, then commands are dropped (see cmd_send_timeout)
+#define SCH_CMD_COALESCE_MAX      (16)       ///< Max number of queued coalescing commands tracked (see cmd_add_coalesce)
+#define SCH_CMD_FUTURES           (8)        ///< Max number of commands waited at the same time (see cmd_future_get)
+#define SCH_CMD_MAX_TIME_MS       (10000)    ///< Default max. runtime of a command in ms, longer executions are reported as overruns (see cmd_set_max_time), 0 to not check
+#define SCH_CMD_SHED_DEPTH        (4)        ///< Executer queue depth of high load, optional commands are dropped from there on (see cmd_set_shed), 0 to never drop commands
+#define SCH_CMD_SHED_LAG_MS       (2000)     ///< Executer lag (dispatch to start time) of high load, in ms
+#define SCH_CMD_TRACE             (0)        ///< Record the commands sent to the dispatcher in SCH_CMD_TRACE_FILE for replay benchmarks (see cmd_trace_start), GNU/Linux only (0 | 1)
+#define SCH_CMD_TRACE_FILE        "/tmp/suchai_cmd_trace.bin"    ///< Commands trace file (see test/test_replay)
+#define SCH_CMD_LATENCY           (1)        ///< Trace the latency of the TC commands by stage, from the reception to the result (see cmd_lat_begin and obc_cmd_lat) (0 | 1)
+#if defined(GROUNDSTATION)
+    #define SCH_TASK_EXE_IO_WORKERS   (2)   ///< Executer workers for CMD_CLASS_SHARED_IO commands (0 to use the main executer)
+    #define SCH_TASK_EXE_CPU_WORKERS  (1)   ///< Executer workers for CMD_CLASS_CPU commands (0 to use the main executer)
+    #define SCH_TASK_INGEST_ENABLED   (1)   ///< Store received payload TM from the ingest task (0 to store it in the receive task)
+    #define SCH_TASK_I2C_ENABLED      (0)   ///< Run the I2C transactions from one bus manager task per bus (0 to run them in the caller, with the bus locked)
+    #define SCH_TASK_TRK_ENABLED      (1)   ///< Doppler correction and pass tracking task (ground station only, see taskTracking.h)
+    #define SCH_TASK_RPT_ENABLED      (1)   ///< Resend the repeater packets from the repeater task (0 to resend them in the receive task)
+    #define SCH_TASK_BCN_ENABLED      (1)   ///< Send the status beacon from the beacon task (0 to send it from the housekeeping task through the executers)
+    #define SCH_OBC_PROP_THREADS      (4)   ///< Threads of obc_prop_tle_range (1 to propagate in the caller)
+    #define SCH_ADCS_ENV_THREADS      (4)   ///< Threads of adcs_env_range (1 to evaluate in the caller)
+#elif defined(LINUX)
+    #define SCH_TASK_EXE_IO_WORKERS   (1)   ///< Executer workers for CMD_CLASS_SHARED_IO commands (0 to use the main executer)
+    #define SCH_TASK_EXE_CPU_WORKERS  (1)   ///< Executer workers for CMD_CLASS_CPU commands (0 to use the main executer)
+    #define SCH_TASK_INGEST_ENABLED   (0)   ///< Store received payload TM from the ingest task (0 to store it in the receive task)
+    #define SCH_TASK_I2C_ENABLED      (1)   ///< Run the I2C transactions from one bus manager task per bus (0 to run them in the caller, with the bus locked)
+    #define SCH_TASK_TRK_ENABLED      (0)   ///< Doppler correction and pass tracking task (ground station only, see taskTracking.h)
+    #define SCH_TASK_RPT_ENABLED      (1)   ///< Resend the repeater packets from the repeater task (0 to resend them in the receive task)
+    #define SCH_TASK_BCN_ENABLED      (1)   ///< Send the status beacon from the beacon task (0 to send it from the housekeeping task through the executers)
+    #define SCH_OBC_PROP_THREADS      (2)   ///< Threads of obc_prop_tle_range (1 to propagate in the caller)
+    #define SCH_ADCS_ENV_THREADS      (2)   ///< Threads of adcs_env_range (1 to evaluate in the caller)
+#else
+    #define SCH_TASK_EXE_IO_WORKERS   (0)   ///< Executer workers for CMD_CLASS_SHARED_IO commands (0 to use the main executer)
+    #define SCH_TASK_EXE_CPU_WORKERS  (0)   ///< Executer workers for CMD_CLASS_CPU commands (0 to use the main executer)
+    #define SCH_TASK_INGEST_ENABLED   (0)   ///< Store received payload TM from the ingest task (0 to store it in the receive task)
+    #define SCH_TASK_I2C_ENABLED      (1)   ///< Run the I2C transactions from one bus manager task per bus (0 to run them in the caller, with the bus locked)
+    #define SCH_TASK_TRK_ENABLED      (0)   ///< Doppler correction and pass tracking task (ground station only, see taskTracking.h)
+    #define SCH_TASK_RPT_ENABLED      (1)   ///< Resend the repeater packets from the repeater task (0 to resend them in the receive task)
+    #define SCH_TASK_BCN_ENABLED      (1)   ///< Send the status beacon from the beacon task (0 to send it from the housekeeping task through the executers)
+    #define SCH_OBC_PROP_THREADS      (1)   ///< Threads of obc_prop_tle_range (1 to propagate in the caller)
+    #define SCH_ADCS_ENV_THREADS      (1)   ///< Threads of adcs_env_range (1 to evaluate in the caller)
+#endif
 
 #endif //SUCHAI_CONFIG_H
@@ -0,0 +1,203 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * LibCSP mock for the in-process fuzz target. Only the functions used by the
+ * command modules are implemented: buffers are allocated with malloc, sent
+ * packets are dropped at once and nothing is ever received, so commands that
+ * talk to other nodes fail fast instead of waiting for timeouts.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <csp/csp.h>
+#include <csp/csp_endian.h>
+
+static int csp_mock_conn;  ///< Any non null connection
+
+#define CSP_MOCK_BUFF_LEN (256)   ///< Data size of the buffers, as csp_buffer_init(n, SCH_BUFF_MAX_LEN)
+
+void *csp_buffer_get(size_t size)
+{
+    return calloc(1, sizeof(csp_packet_t) + (size > CSP_MOCK_BUFF_LEN ? size : CSP_MOCK_BUFF_LEN));
+}
+
+int csp_buffer_size(void)
+{
+    return CSP_MOCK_BUFF_LEN;
+}
+
+void csp_buffer_free(void *packet)
+{
+    free(packet);
+}
+
+void *csp_buffer_clone(void *buffer)
+{
+    return NULL;
+}
+
+int csp_buffer_remaining(void)
+{
+    return 100;
+}
+
+int csp_sendto(uint8_t prio, uint8_t dest, uint8_t dport, uint8_t src_port, uint32_t opts, csp_packet_t *packet, uint32_t timeout)
+{
+    free(packet);
+    return CSP_ERR_NONE;
+}
+
+int csp_send(csp_conn_t *conn, csp_packet_t *packet, uint32_t timeout)
+{
+    free(packet);
+    return 1;
+}
+
+int csp_transaction(uint8_t prio, uint8_t dest, uint8_t port, uint32_t timeout, void *outbuf, int outlen, void *inbuf, int inlen)
+{
+    return 0;
+}
+
+csp_conn_t *csp_connect(uint8_t prio, uint8_t dest, uint8_t dport, uint32_t timeout, uint32_t opts)
+{
+    return (csp_conn_t *)&csp_mock_conn;
+}
+
+int csp_close(csp_conn_t *conn)
+{
+    return CSP_ERR_NONE;
+}
+
+csp_packet_t *csp_read(csp_conn_t *conn, uint32_t timeout)
+{
+    return NULL;
+}
+
+int csp_conn_dport(csp_conn_t *conn)
+{
+    return 0;
+}
+
+int csp_conn_sport(csp_conn_t *conn)
+{
+    return 0;
+}
+
+int csp_conn_dst(csp_conn_t *conn)
+{
+    return 0;
+}
+
+int csp_conn_src(csp_conn_t *conn)
+{
+    return 0;
+}
+
+int csp_sfp_send(csp_conn_t *conn, void *data, int totalsize, int mtu, uint32_t timeout)
+{
+    return 0;
+}
+
+int csp_sfp_recv_fp(csp_conn_t *conn, void **dataout, int *datasize, uint32_t timeout, csp_packet_t *first_packet)
+{
+    free(first_packet);
+    return -1;
+}
+
+void csp_rdp_set_opt(unsigned int window_size, unsigned int conn_timeout_ms,
+                     unsigned int packet_timeout_ms, unsigned int delayed_acks,
+                     unsigned int ack_timeout, unsigned int ack_delay_count)
+{
+}
+
+void csp_rdp_get_opt(unsigned int *window_size, unsigned int *conn_timeout_ms,
+                     unsigned int *packet_timeout_ms, unsigned int *delayed_acks,
+                     unsigned int *ack_timeout, unsigned int *ack_delay_count)
+{
+    *window_size = *conn_timeout_ms = *packet_timeout_ms = *delayed_acks = *ack_timeout = *ack_delay_count = 0;
+}
+
+csp_socket_t *csp_socket(uint32_t opts)
+{
+    return NULL;
+}
+
+int csp_bind(csp_socket_t *socket, uint8_t port)
+{
+    return CSP_ERR_INVAL;
+}
+
+int csp_listen(csp_socket_t *socket, size_t conn_queue_length)
+{
+    return CSP_ERR_INVAL;
+}
+
+csp_conn_t *csp_accept(csp_socket_t *socket, uint32_t timeout)
+{
+    return NULL;
+}
+
+void csp_service_handler(csp_conn_t *conn, csp_packet_t *packet)
+{
+    free(packet);
+}
+
+int csp_ping(uint8_t node, uint32_t timeout, unsigned int size, uint8_t conn_options)
+{
+    return -1;
+}
+
+void csp_debug_set_level(csp_debug_level_t level, bool value)
+{
+}
+
+void csp_conn_print_table(void)
+{
+}
+
+void csp_rtable_print(void)
+{
+}
+
+void csp_iflist_print(void)
+{
+}
+
+uint16_t csp_hton16(uint16_t h16)
+{
+    return htons(h16);
+}
+
+uint32_t csp_hton32(uint32_t h32)
+{
+    return htonl(h32);
+}
+
+uint16_t csp_ntoh16(uint16_t n16)
+{
+    return ntohs(n16);
+}
+
+uint32_t csp_ntoh32(uint32_t n32)
+{
+    return ntohl(n32);
+}
@@ -0,0 +1,212 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2020, Carlos Gonzalez Cortes, carlgonz@uchile.cl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * In-process fuzz target. Inputs are fed to the command parser and to the
+ * TC, CMD and TM receive functions without CSP (see csp_mock.c) and the
+ * resulting commands are executed in the same thread, so libFuzzer or AFL
+ * get coverage feedback and run thousands of inputs per second. Use the RAM
+ * storage (--st_mode 0). The first input byte selects the entry point
+ * (modulo FUZZ_LAST, so '0'..'3' work in text seeds) and the rest is the
+ * command string or the frame:
+ *
+ *      0: cmd_build_from_str, "<command> [params]"
+ *      1: TC port, "<command> [params];<command> [params];..."
+ *      2: CMD port, "<command> [params]"
+ *      3: TM port, a com_frame_t
+ *
+ * Built with FUZZ_ENGINE=none the target is a standalone program that runs
+ * the input files given as arguments, to reproduce crashes without clang.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+#include "globals.h"
+#include "log_utils.h"
+#include "repoCommand.h"
+#include "repoData.h"
+#include "taskCommunications.h"
+
+#define FUZZ_QUEUE_LEN  (1024)  ///< Dispatcher queue length, commands sent by one input
+#define FUZZ_MAX_CMDS   (256)   ///< Max. commands executed by one input
+
+/**
+ * Entry points, selected by the first input byte
+ */
+typedef enum fuzz_entry {
+    FUZZ_CMD_STR = 0,   ///< cmd_build_from_str
+    FUZZ_PORT_TC,       ///< TC frame, com_receive_tc
+    FUZZ_PORT_CMD,      ///< Console command, com_receive_cmd
+    FUZZ_PORT_TM,       ///< Telemetry frame, com_receive_tm
+    FUZZ_LAST           ///< Dummy element, the amount of entry points
+} fuzz_entry_t;
+
+/**
+ * Commands not executed: they exit, run shell commands, change the system
+ * clock, touch arbitrary files or run for too long
+ */
+static const char *fuzz_skip_cmds[] = {
+    "obc_reset",
+    "obc_system",
+    "obc_set_time",
+    "obc_prop_tle_range",
+    "log_set",
+    "tm_send_file",
+    "tm_send_file_parts",
+    "tm_parse_file",
+    "tm_request_file",
+    NULL
+};
+
+static uint8_t fuzz_skip[SCH_CMD_MAX_ENTRIES];
+
+/**
+ * Execute a command as taskExecuter does, unless it is skipped
+ */
+static void fuzz_execute(cmd_t *cmd)
+{
+    if(cmd->id >= 0 && cmd->id < SCH_CMD_MAX_ENTRIES && !fuzz_skip[cmd->id] && cmd->function != NULL)
+    {
+        int rc = cmd->function(cmd->fmt, cmd->params, cmd->nparams);
+        cmd_done(cmd, rc);
+    }
+    cmd_free(cmd);
+}
+
+/**
+ * Execute the commands sent to the dispatcher queue, including the ones sent
+ * by these commands, up to FUZZ_MAX_CMDS. The rest are dropped.
+ */
+static void fuzz_dispatch(void)
+{
+    int n = 0;
+    cmd_t *cmd;
+    while(osQueueReceive(dispatcher_queue, &cmd, 0) == pdPASS)
+    {
+        if(n++ < FUZZ_MAX_CMDS)
+            fuzz_execute(cmd);
+        else
+            cmd_free(cmd);
+    }
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+    log_init(LOG_LVL_NONE, -1);
+    cmd_repo_init();
+    dat_repo_init();
+
+    dispatcher_queue = osQueueCreate(FUZZ_QUEUE_LEN, sizeof(cmd_t *));
+    if(dispatcher_queue == 0)
+    {
+        printf("Error creating dispatcher queue\n");
+        return -1;
+    }
+
+    int i;
+    for(i=0; fuzz_skip_cmds[i] != NULL; i++)
+    {
+        int idx = cmd_resolve(fuzz_skip_cmds[i]);
+        if(idx >= 0 && idx < SCH_CMD_MAX_ENTRIES)
+            fuzz_skip[idx] = 1;
+    }
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if(size < 1)
+        return 0;
+
+    int entry = data[0] % FUZZ_LAST;
+    data++;
+    size--;
+    if(size > SCH_BUFF_MAX_LEN)
+        return 0;
+
+    // One byte more for the null terminator, and a whole frame for TM
+    size_t buff_size = size + 1 > sizeof(com_frame_t) ? size + 1 : sizeof(com_frame_t);
+    csp_packet_t *packet = csp_buffer_get(buff_size);
+    if(packet == NULL)
+        return 0;
+    memset(packet->data, 0, buff_size);
+    memcpy(packet->data, data, size);
+    packet->length = (uint16_t)size;
+
+    // Inputs may change the baudrate, keep the TX pacer from sleeping
+    dat_set_system_var(dat_com_baud, INT32_MAX);
+
+    switch(entry)
+    {
+        case FUZZ_CMD_STR:
+        {
+            cmd_t *cmd = cmd_build_from_str((char *)packet->data);
+            if(cmd != NULL)
+                fuzz_execute(cmd);
+            break;
+        }
+        case FUZZ_PORT_TC:
+            com_receive_packet(packet, SCH_TRX_PORT_TC);
+            break;
+        case FUZZ_PORT_CMD:
+            com_receive_packet(packet, SCH_TRX_PORT_CMD);
+            break;
+        case FUZZ_PORT_TM:
+            com_receive_packet(packet, SCH_TRX_PORT_TM);
+            break;
+        default:
+            break;
+    }
+
+    csp_buffer_free(packet);
+    fuzz_dispatch();
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+/**
+ * Run the input files given as arguments, without a fuzzing engine
+ */
+int main(int argc, char **argv)
+{
+    static uint8_t buff[SCH_BUFF_MAX_LEN+2];
+    if(LLVMFuzzerInitialize(&argc, &argv) != 0)
+        return 1;
+
+    int i;
+    for(i=1; i<argc; i++)
+    {
+        FILE *f = fopen(argv[i], "rb");
+        if(f == NULL)
+        {
+            printf("Error reading file %s\n", argv[i]);
+            continue;
+        }
+        size_t len = fread(buff, 1, sizeof(buff), f);
+        fclose(f);
+        printf("Running %s (%d bytes)\n", argv[i], (int)len);
+        LLVMFuzzerTestOneInput(buff, len);
+    }
+    printf("Done, %d inputs\n", argc - 1);
+    return 0;
+}
+#endif
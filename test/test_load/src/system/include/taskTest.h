@@ -1,15 +1,50 @@
 #ifndef TEST_H
 #define TEST_H
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
 #include "config.h"
 #include "globals.h"
 
 #include "osQueue.h"
 #include "osDelay.h"
+#include "osThread.h"
+#include "osSemphr.h"
 
 #include "repoCommand.h"
+#include "bench_utils.h"
+
+#define LOAD_PRODUCERS_DEFAULT  (2)     ///< Default producer tasks (LOAD_PRODUCERS)
+#define LOAD_PRODUCERS_MAX      (16)    ///< Max producer tasks
+#define LOAD_N_DEFAULT          (10000) ///< Default commands per producer (LOAD_N)
+#define LOAD_PARAM_SIZE_DEFAULT (8)     ///< Default "test" command parameter length (LOAD_PARAM_SIZE)
+#define LOAD_QUEUE_LEN_DEFAULT  (10)    ///< Default dispatcher queue depth (LOAD_QUEUE_LEN)
+
+/**
+ * Benchmark parameters, read from the environment
+ */
+typedef struct load_config {
+    int producers;      ///< Tasks sending commands concurrently
+    int n;              ///< Commands sent by each producer
+    int param_size;     ///< Length of the "test" command parameter
+    int queue_len;      ///< Dispatcher queue depth, used by main
+} load_config_t;
 
+/**
+ * Read the benchmark parameters from the LOAD_* environment variables
+ */
+void load_config_read(load_config_t *config);
+
+/**
+ * Command pipeline benchmark. Producer tasks send "test" commands through
+ * cmd_get_str, cmd_add_params_str and cmd_send, the executer reports the
+ * completion of each one. Prints a JSON line with the throughput and the
+ * enqueue-to-completion latency percentiles, then exits.
+ * @param param load_config_t *. Benchmark parameters
+ */
 void taskTest(void *param);
 
 #endif
-
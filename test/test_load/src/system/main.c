@@ -41,18 +41,19 @@ int main(void)
     cmd_repo_init(); // Command repository initialization
     dat_repo_init(); // Update status repository
 
+    /* Benchmark parameters, the dispatcher queue depth is one of them */
+    static load_config_t config;
+    load_config_read(&config);
+
     /* Initializing shared Queues */
-    dispatcher_queue = osQueueCreate(10,sizeof(cmd_t *));
+    dispatcher_queue = osQueueCreate(config.queue_len,sizeof(cmd_t *));
     if(dispatcher_queue == 0)
         LOGE(tag, "Error creating dispatcher queue");
-    executer_stat_queue = osQueueCreate(1,sizeof(int));
-    if(executer_stat_queue == 0)
-        LOGE(tag, "Error creating executer stat queue");
-    executer_cmd_queue = osQueueCreate(1,sizeof(cmd_t *));
+    executer_cmd_queue = osQueueCreate(SCH_CMD_EXE_QUEUE_LEN,sizeof(cmd_t *));
     if(executer_cmd_queue == 0)
         LOGE(tag, "Error creating executer cmd queue");
 
-    int n_threads = 4;
+    int n_threads = 3;
     os_thread threads_id[n_threads];
 
     LOGI(tag, "Creating basic tasks...");
@@ -60,8 +61,7 @@ int main(void)
     osCreateTask(taskDispatcher,"dispatcher", 2*configMINIMAL_STACK_SIZE,NULL,3, &threads_id[0]);
     osCreateTask(taskExecuter, "executer", 5*configMINIMAL_STACK_SIZE, NULL, 4, &threads_id[1]);
 
-    osCreateTask(taskTest, "test1", 2*configMINIMAL_STACK_SIZE, "TEST 1", 2, &threads_id[2]);
-    osCreateTask(taskTest, "test2", 2*configMINIMAL_STACK_SIZE, "TEST 2", 2, &threads_id[2]);
+    osCreateTask(taskTest, "test", 2*configMINIMAL_STACK_SIZE, &config, 2, &threads_id[2]);
 
 #ifndef ESP32
     /* Start the scheduler. Should never return */
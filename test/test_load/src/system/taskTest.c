@@ -1,38 +1,151 @@
+//
+// Command pipeline benchmark. Measures the throughput and the latency from
+// cmd_send to the end of the execution of the dispatcher/executer path.
+//
+
 #include "include/taskTest.h"
 
-#define TEST_FAILS 0
+static const char *tag = "load_bench";
+
+/**
+ * Command record, filled by the done callback
+ */
+typedef struct load_cmd {
+    uint64_t t_sent_ns;     ///< Time before cmd_send
+    uint64_t lat_ns;        ///< Enqueue-to-completion latency
+    int result;             ///< Command result
+} load_cmd_t;
+
+/**
+ * Producer task parameters
+ */
+typedef struct load_producer {
+    load_cmd_t *cmds;       ///< Records of the commands sent by this producer
+    int n;                  ///< Commands to send
+    const char *params;     ///< "test" command parameter
+} load_producer_t;
+
+static load_cmd_t *load_cmds;
+static volatile int load_pending = 0;
+static osEvent load_event;
+
+void load_config_read(load_config_t *config)
+{
+    config->producers = bench_env("LOAD_PRODUCERS", LOAD_PRODUCERS_DEFAULT, 1, LOAD_PRODUCERS_MAX);
+    config->n = bench_env("LOAD_N", LOAD_N_DEFAULT, 1, 10000000);
+    config->param_size = bench_env("LOAD_PARAM_SIZE", LOAD_PARAM_SIZE_DEFAULT, 1, SCH_CMD_MAX_STR_PARAMS-1);
+    config->queue_len = bench_env("LOAD_QUEUE_LEN", LOAD_QUEUE_LEN_DEFAULT, 1, 100000);
+}
+
+/**
+ * Done callback, runs in the executer
+ */
+static void _load_done(cmd_t *cmd, int result, void *arg)
+{
+    load_cmd_t *record = (load_cmd_t *)arg;
+    record->lat_ns = bench_now_ns() - record->t_sent_ns;
+    record->result = result;
+    if(__sync_sub_and_fetch(&load_pending, 1) == 0)
+        osEventSet(&load_event, 1);
+}
 
-//const static char *tag = "taskTest";
+static void _load_producer(void *param)
+{
+    load_producer_t *producer = (load_producer_t *)param;
+    int i;
+    for(i=0; i<producer->n; i++)
+    {
+        load_cmd_t *record = &producer->cmds[i];
+        record->t_sent_ns = bench_now_ns();
+        cmd_t *cmd = cmd_get_str("test");
+        if(cmd == NULL)
+        {
+            // Not sent, counted as dropped
+            record->result = CMD_DROPPED;
+            if(__sync_sub_and_fetch(&load_pending, 1) == 0)
+                osEventSet(&load_event, 1);
+            continue;
+        }
+        cmd_add_params_str(cmd, (char *)producer->params);
+        cmd_set_done(cmd, _load_done, record);
+        cmd_send(cmd);
+    }
+    osTaskDelete(NULL);
+}
 
 void taskTest(void *param)
 {
-    char *tag = (char *)param;
+    load_config_t *config = (load_config_t *)param;
+    int total = config->producers*config->n;
+    int i;
+
     LOGI(tag, "Started");
-    LOGI(tag, "---- Commands load test ----");
+    LOGI(tag, "---- Commands pipeline benchmark: %d producers x %d commands, param size %d, queue depth %d ----",
+         config->producers, config->n, config->param_size, config->queue_len);
 
-    int test, curr;
-    int n_start = 5;
-    int n_end = 25;
-    char params[10];
+    char *params = malloc((size_t)config->param_size + 1);
+    memset(params, 'x', (size_t)config->param_size);
+    params[config->param_size] = '\0';
+    load_cmds = calloc((size_t)total, sizeof(load_cmd_t));
+    uint64_t *lat = malloc((size_t)total*sizeof(uint64_t));
+    if(params == NULL || load_cmds == NULL || lat == NULL || osEventCreate(&load_event) != OS_SEMAPHORE_OK)
+    {
+        LOGE(tag, "Unable to allocate the benchmark buffers");
+        exit(1);
+    }
 
-    for(test = n_start; test < n_end; test++)
+    load_producer_t producers[LOAD_PRODUCERS_MAX];
+    os_thread threads[LOAD_PRODUCERS_MAX];
+    load_pending = total;
+    uint64_t t_start = bench_now_ns();
+    for(i=0; i<config->producers; i++)
     {
-        osDelay(100);
-        LOGI(tag, "-- Sending %d commands --", test);
-        for (curr = 0; curr < test; curr++)
+        producers[i].cmds = &load_cmds[i*config->n];
+        producers[i].n = config->n;
+        producers[i].params = params;
+        if(osCreateTask(_load_producer, "producer", SCH_TASK_DEF_STACK, &producers[i], 2, &threads[i]) != 0)
         {
-            cmd_t *cmd = cmd_get_str("test");
-            sprintf(params, "%d", curr);
-            cmd_add_params_str(cmd, params);
-            cmd_send(cmd);
+            LOGE(tag, "Producer %d not created!", i);
+            exit(1);
         }
     }
 
-    LOGI(tag, "----Sending final commands ----");
-    cmd_t *cmd_log = cmd_get_str("test");
-    cmd_add_params_str(cmd_log, "----Test-Finished----");
-    cmd_send(cmd_log);
+    // Wait until the executer reports every command
+    osEventWait(&load_event, 1, portMAX_DELAY);
+    uint64_t t_run = bench_now_ns() - t_start;
+
+    int n_ok = 0, n_lat = 0;
+    for(i=0; i<total; i++)
+    {
+        if(load_cmds[i].result == CMD_OK)
+            n_ok++;
+        if(load_cmds[i].result != CMD_DROPPED)
+            lat[n_lat++] = load_cmds[i].lat_ns;
+    }
+    bench_stats_t stats;
+    bench_stats_get(lat, n_lat, &stats);
+    double seconds = (double)t_run/1e9;
+
+    // One JSON line, parsed by the regression scripts
+    bench_json_t json;
+    bench_json_begin(&json, "cmd_pipeline");
+    bench_json_int(&json, "storage_mode", SCH_STORAGE_MODE);
+    bench_json_int(&json, "producers", config->producers);
+    bench_json_int(&json, "queue_len", config->queue_len);
+    bench_json_int(&json, "param_size", config->param_size);
+    bench_json_int(&json, "cmds", total);
+    bench_json_int(&json, "ok", n_ok);
+    bench_json_int(&json, "dropped", total - n_lat);
+    bench_json_num(&json, "time_s", seconds, 6);
+    bench_json_num(&json, "cmds_per_s", seconds > 0 ? total/seconds : 0.0, 1);
+    bench_json_stats(&json, "lat", &stats);
+    bench_json_print(&json);
+
+    free(lat);
+    free(load_cmds);
+    free(params);
 
+    LOGI(tag, "---- Sending Exit Command ----");
     cmd_t *cmd_exit = cmd_get_str("obc_reset");
     cmd_send(cmd_exit);
 }
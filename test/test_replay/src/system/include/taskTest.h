@@ -0,0 +1,50 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "globals.h"
+
+#include "osQueue.h"
+#include "osDelay.h"
+#include "osThread.h"
+#include "osSemphr.h"
+
+#include "repoCommand.h"
+#include "bench_utils.h"
+
+#define REPLAY_SPEED_DEFAULT     (1)     ///< Default replay speed (REPLAY_SPEED)
+#define REPLAY_QUEUE_LEN_DEFAULT (25)    ///< Default dispatcher queue depth, as the flight software (REPLAY_QUEUE_LEN)
+#define REPLAY_PRODUCERS_MAX     (32)    ///< Max producer tasks, one per task in the trace
+
+/**
+ * Benchmark parameters, read from the environment
+ */
+typedef struct replay_config {
+    char file[256];     ///< Trace file recorded with cmd_trace_start
+    int speed;          ///< Times the recorded speed, 0 to send the commands without waiting
+    int queue_len;      ///< Dispatcher queue depth, used by main
+} replay_config_t;
+
+/**
+ * Read the benchmark parameters from the REPLAY_* environment variables:
+ * REPLAY_FILE (default SCH_CMD_TRACE_FILE), REPLAY_SPEED and REPLAY_QUEUE_LEN
+ */
+void replay_config_read(replay_config_t *config);
+
+/**
+ * Commands trace replay benchmark. Reads a trace recorded with
+ * cmd_trace_start (obc_cmd_trace) and sends its commands again, one producer
+ * task per task in the trace, at the recorded times divided by the speed.
+ * Commands not in this build, with other parameters format, or obc_reset are
+ * skipped. Prints a JSON line with the throughput, the enqueue-to-completion
+ * latency percentiles and how late the commands were sent, then exits.
+ * @param param replay_config_t *. Benchmark parameters
+ */
+void taskTest(void *param);
+
+#endif
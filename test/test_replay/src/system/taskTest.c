@@ -0,0 +1,299 @@
+//
+// Commands trace replay benchmark. Sends again the commands recorded by
+// cmd_trace_start, with their recorded timing or faster, and measures the
+// latency from cmd_send to the end of the execution.
+//
+
+#include "include/taskTest.h"
+
+static const char *tag = "replay_bench";
+
+/**
+ * Command of the trace, the result is filled by the done callback
+ */
+typedef struct replay_cmd {
+    uint32_t t_ms;          ///< Send time, since the trace started
+    int id;                 ///< Command id in this build
+    const char *params;     ///< Parameters, in the trace buffer
+    uint16_t len;           ///< Parameters length, 0 if none
+    uint64_t t_sent_ns;     ///< Time before cmd_send
+    uint32_t lat_us;        ///< Enqueue-to-completion latency
+    uint32_t late_us;       ///< Send time after the scheduled time
+    int result;             ///< Command result
+} replay_cmd_t;
+
+/**
+ * Producer task parameters, the commands of one task of the trace
+ */
+typedef struct replay_producer {
+    replay_cmd_t **cmds;    ///< Commands sent by this producer, in order
+    int n;                  ///< Number of commands
+    int speed;              ///< Replay speed
+    uint64_t t_start_ns;    ///< Replay start time
+} replay_producer_t;
+
+static volatile int replay_pending = 0;
+static osEvent replay_event;
+
+void replay_config_read(replay_config_t *config)
+{
+    char *file = getenv("REPLAY_FILE");
+    snprintf(config->file, sizeof(config->file), "%s", file != NULL ? file : SCH_CMD_TRACE_FILE);
+    config->speed = bench_env("REPLAY_SPEED", REPLAY_SPEED_DEFAULT, 0, 1000000);
+    config->queue_len = bench_env("REPLAY_QUEUE_LEN", REPLAY_QUEUE_LEN_DEFAULT, 1, 100000);
+}
+
+/**
+ * Read a whole file
+ * @return Buffer, free it with free, or NULL
+ */
+static char *_replay_read_file(const char *file, size_t *size)
+{
+    FILE *f = fopen(file, "rb");
+    if(f == NULL)
+        return NULL;
+    char *buff = NULL;
+    if(fseek(f, 0, SEEK_END) == 0)
+    {
+        long len = ftell(f);
+        buff = len > 0 ? malloc((size_t)len) : NULL;
+        if(buff != NULL && (fseek(f, 0, SEEK_SET) != 0 || fread(buff, (size_t)len, 1, f) != 1))
+        {
+            free(buff);
+            buff = NULL;
+        }
+        *size = (size_t)len;
+    }
+    fclose(f);
+    return buff;
+}
+
+/**
+ * Parse the trace records. Commands are listed in @cmds in the trace order,
+ * and by task in @producers.
+ * @return Number of commands in the trace, -1 if the trace is not valid
+ */
+static int _replay_parse(char *buff, size_t size, replay_cmd_t *cmds, replay_producer_t *producers, int *skipped)
+{
+    static int ids[UINT16_MAX+1];   // Trace command ids to this build ids
+    int origins[UINT8_MAX+1];       // Trace tasks to producers
+    int n = 0, nproducers = 0, i;
+    *skipped = 0;
+
+    cmd_trace_header_t header;
+    if(size < sizeof(header))
+        return -1;
+    memcpy(&header, buff, sizeof(header));
+    if(header.magic != CMD_TRACE_MAGIC || header.version != CMD_TRACE_VERSION)
+        return -1;
+    for(i=0; i<=UINT16_MAX; i++)
+        ids[i] = -1;
+    for(i=0; i<=UINT8_MAX; i++)
+        origins[i] = -1;
+
+    size_t pos = sizeof(header);
+    cmd_trace_rec_t rec;
+    while(pos + sizeof(rec) <= size)
+    {
+        memcpy(&rec, buff + pos, sizeof(rec));
+        pos += sizeof(rec);
+        if(pos + rec.len > size)
+            break;   // Cut by a reset while recording
+        char *data = buff + pos;
+        pos += rec.len;
+
+        if(rec.type == CMD_TRACE_NAME && rec.len > 0)
+        {
+            // Same command and parameters format, the parameters are valid
+            data[rec.len-1] = '\0';
+            char *name = data;
+            char *fmt = (char *)memchr(data, '\0', rec.len) + 1;
+            if(fmt - data < rec.len && strcmp(name, "obc_reset") != 0 && strcmp(cmd_get_fmt(name), fmt) == 0)
+                ids[rec.id] = cmd_resolve(name);
+            else
+                LOGW(tag, "Command %s skipped", name);
+        }
+        else if(rec.type == CMD_TRACE_ORIGIN && rec.len > 0)
+        {
+            data[rec.len-1] = '\0';
+            LOGI(tag, "Task %d: %s", rec.origin, data);
+        }
+        else if(rec.type == CMD_TRACE_CMD)
+        {
+            if(ids[rec.id] < 0)
+            {
+                (*skipped)++;
+                continue;
+            }
+            // Tasks over the max. share the last producer
+            if(origins[rec.origin] < 0)
+                origins[rec.origin] = nproducers < REPLAY_PRODUCERS_MAX ? nproducers++ : REPLAY_PRODUCERS_MAX-1;
+            replay_cmd_t *cmd = &cmds[n++];
+            cmd->t_ms = rec.t_ms;
+            cmd->id = ids[rec.id];
+            cmd->params = data;
+            cmd->len = rec.len;
+            producers[origins[rec.origin]].n++;
+        }
+    }
+
+    // Producers commands lists, in the trace order
+    for(i=0; i<nproducers; i++)
+    {
+        producers[i].cmds = malloc((size_t)(producers[i].n + 1)*sizeof(replay_cmd_t *));
+        if(producers[i].cmds == NULL)
+            return -1;
+        producers[i].n = 0;
+    }
+    int j = 0;
+    pos = sizeof(header);
+    while(pos + sizeof(rec) <= size && j < n)
+    {
+        memcpy(&rec, buff + pos, sizeof(rec));
+        pos += sizeof(rec) + rec.len;
+        if(rec.type == CMD_TRACE_CMD && ids[rec.id] >= 0)
+        {
+            replay_producer_t *producer = &producers[origins[rec.origin]];
+            producer->cmds[producer->n++] = &cmds[j++];
+        }
+    }
+    return n;
+}
+
+/**
+ * Done callback, runs in the executer
+ */
+static void _replay_done(cmd_t *cmd, int result, void *arg)
+{
+    replay_cmd_t *record = (replay_cmd_t *)arg;
+    record->lat_us = (uint32_t)((bench_now_ns() - record->t_sent_ns)/1000ULL);
+    record->result = result;
+    if(__sync_sub_and_fetch(&replay_pending, 1) == 0)
+        osEventSet(&replay_event, 1);
+}
+
+static void _replay_producer(void *param)
+{
+    replay_producer_t *producer = (replay_producer_t *)param;
+    int i;
+    for(i=0; i<producer->n; i++)
+    {
+        replay_cmd_t *record = producer->cmds[i];
+        uint64_t now = bench_now_ns();
+        if(producer->speed > 0)
+        {
+            uint64_t t_send = producer->t_start_ns + (uint64_t)record->t_ms*1000000ULL/(uint64_t)producer->speed;
+            if(t_send > now + 1000000ULL)
+            {
+                osDelay((uint32_t)((t_send - now)/1000000ULL));
+                now = bench_now_ns();
+            }
+            record->late_us = now > t_send ? (uint32_t)((now - t_send)/1000ULL) : 0;
+        }
+
+        record->t_sent_ns = now;
+        cmd_t *cmd = cmd_get_idx(record->id);
+        if(cmd == NULL)
+        {
+            // Not sent, counted as dropped
+            record->result = CMD_DROPPED;
+            if(__sync_sub_and_fetch(&replay_pending, 1) == 0)
+                osEventSet(&replay_event, 1);
+            continue;
+        }
+        if(record->len > 0)
+            cmd_add_params_raw(cmd, (void *)record->params, record->len);
+        cmd_set_done(cmd, _replay_done, record);
+        cmd_send(cmd);
+    }
+    osTaskDelete(NULL);
+}
+
+static int _replay_cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+void taskTest(void *param)
+{
+    replay_config_t *config = (replay_config_t *)param;
+    int i;
+
+    LOGI(tag, "Started");
+    LOGI(tag, "---- Commands trace replay benchmark: %s, speed %d, queue depth %d ----",
+         config->file, config->speed, config->queue_len);
+
+    size_t size = 0;
+    char *buff = _replay_read_file(config->file, &size);
+    replay_cmd_t *cmds = calloc(size/sizeof(cmd_trace_rec_t) + 1, sizeof(replay_cmd_t));
+    static replay_producer_t producers[REPLAY_PRODUCERS_MAX];
+    int skipped = 0;
+    int total = buff != NULL && cmds != NULL ? _replay_parse(buff, size, cmds, producers, &skipped) : -1;
+    uint32_t *lat = malloc((size_t)(total > 0 ? total : 1)*2*sizeof(uint32_t));
+    if(total < 0 || lat == NULL || osEventCreate(&replay_event) != OS_SEMAPHORE_OK)
+    {
+        LOGE(tag, "Unable to read the trace %s", config->file);
+        exit(1);
+    }
+
+    os_thread threads[REPLAY_PRODUCERS_MAX];
+    replay_pending = total;
+    uint64_t t_start = bench_now_ns();
+    for(i=0; i<REPLAY_PRODUCERS_MAX && producers[i].n > 0; i++)
+    {
+        producers[i].speed = config->speed;
+        producers[i].t_start_ns = t_start;
+        if(osCreateTask(_replay_producer, "producer", SCH_TASK_DEF_STACK, &producers[i], 2, &threads[i]) != 0)
+        {
+            LOGE(tag, "Producer %d not created!", i);
+            exit(1);
+        }
+    }
+    int nproducers = i;
+
+    // Wait until the executer reports every command
+    if(total > 0)
+        osEventWait(&replay_event, 1, portMAX_DELAY);
+    uint64_t t_run = bench_now_ns() - t_start;
+
+    int n_ok = 0, n_lat = 0;
+    uint32_t *late = lat + total;
+    for(i=0; i<total; i++)
+    {
+        if(cmds[i].result == CMD_OK)
+            n_ok++;
+        if(cmds[i].result != CMD_DROPPED)
+            lat[n_lat++] = cmds[i].lat_us;
+        late[i] = cmds[i].late_us;
+    }
+    qsort(lat, (size_t)n_lat, sizeof(uint32_t), _replay_cmp_u32);
+    qsort(late, (size_t)total, sizeof(uint32_t), _replay_cmp_u32);
+    uint32_t p50 = n_lat > 0 ? lat[(n_lat-1)*50/100] : 0;
+    uint32_t p99 = n_lat > 0 ? lat[(n_lat-1)*99/100] : 0;
+    uint32_t max = n_lat > 0 ? lat[n_lat-1] : 0;
+    uint32_t late_p99 = total > 0 ? late[(total-1)*99/100] : 0;
+    uint32_t late_max = total > 0 ? late[total-1] : 0;
+    double seconds = (double)t_run/1e9;
+    const char *trace = strrchr(config->file, '/');
+    trace = trace != NULL ? trace + 1 : config->file;
+
+    // One JSON line, parsed by the regression scripts
+    printf("{\"bench\": \"cmd_replay\", \"storage_mode\": %d, \"trace\": \"%s\", \"speed\": %d, "
+           "\"queue_len\": %d, \"producers\": %d, \"cmds\": %d, \"skipped\": %d, \"ok\": %d, \"dropped\": %d, \"time_s\": %.6f, "
+           "\"cmds_per_s\": %.1f, \"lat_p50_us\": %u, \"lat_p99_us\": %u, \"lat_max_us\": %u, "
+           "\"late_p99_us\": %u, \"late_max_us\": %u}\n",
+           SCH_STORAGE_MODE, trace, config->speed, config->queue_len, nproducers, total, skipped, n_ok, total - n_lat,
+           seconds, seconds > 0 ? total/seconds : 0.0, p50, p99, max, late_p99, late_max);
+    fflush(stdout);
+
+    for(i=0; i<nproducers; i++)
+        free(producers[i].cmds);
+    free(lat);
+    free(cmds);
+    free(buff);
+
+    LOGI(tag, "---- Sending Exit Command ----");
+    cmd_t *cmd_exit = cmd_get_str("obc_reset");
+    cmd_send(cmd_exit);
+}
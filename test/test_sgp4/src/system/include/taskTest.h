@@ -13,6 +13,7 @@
 #include "osDelay.h"
 #include "repoCommand.h"
 #include "cmdOBC.h"
+#include "bench_utils.h"
 
 int _obc_prop_tle_test(char *fmt, char *params, int nparams); // For testing
 int _obc_prop_tle_cmp(char *fmt, char *params, int nparams); // For testing
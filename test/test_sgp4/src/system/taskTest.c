@@ -5,7 +5,6 @@
 #include "taskTest.h"
 
 static const char* tag = "sgp4_test_task";
-extern TLE tle;
 
 // 2-norm distance for two 3D vectors
 double dist(double *v1, double *v2)
@@ -32,8 +31,10 @@ int _test_tle_prop(char *fmt, char *params, int nparams)
     int ts = 0;
     FILE *file;
     char filename[SCH_BUFF_MAX_LEN];
+    TLE tle;
+    obc_tle_get(&tle);
 
-    assert(!(params != NULL && sscanf(params, fmt, &ts, filename) != nparams));
+    assert(!(params != NULL && cmd_scan_params(fmt, params, &ts, filename) != nparams));
         //return CMD_ERROR;
 
     if(ts == 0)
@@ -80,8 +81,10 @@ int _test_tle_cmp(char *fmt, char *params, int nparams)
     double rerr = 0;
     double verr = 0;
     int cnt = 0, n;
+    TLE tle;
+    obc_tle_get(&tle);
 
-    assert(!(params != NULL && sscanf(params, fmt, fname_data, fname_test) != nparams));
+    assert(!(params != NULL && cmd_scan_params(fmt, params, fname_data, fname_test) != nparams));
         //return CMD_ERROR;
 
     file_data = fopen(fname_data, "r");
@@ -124,11 +127,71 @@ int _test_tle_cmp(char *fmt, char *params, int nparams)
     return CMD_OK;
 }
 
+// A command that propagates every reference timestamp in one batch and compares
+int _test_tle_range(char *fmt, char *params, int nparams)
+{
+    char fname_data[SCH_BUFF_MAX_LEN];
+    char line[SCH_BUFF_MAX_LEN];
+    double rv_ref[6], r[3], v[3];
+    double rerr = 0, verr = 0;
+    long ts;
+    int i, n = 0;
+    obc_rv_array_t rv;
+    TLE tle;
+    obc_tle_get(&tle);
+
+    assert(!(params != NULL && cmd_scan_params(fmt, params, fname_data) != nparams));
+    FILE *file_data = fopen(fname_data, "r");
+    assert(file_data != NULL);
+    while(fgets(line, SCH_BUFF_MAX_LEN, file_data) != NULL)
+        n++;
+    assert(obc_rv_array_alloc(&rv, n) == 0);
+
+    rewind(file_data);
+    for(i=0; i<n && fgets(line, SCH_BUFF_MAX_LEN, file_data) != NULL; i++)
+    {
+        sscanf(line, "%ld,", &ts);
+        rv.ts[i] = (int)ts;
+    }
+
+    uint64_t t_start = bench_now_ns();
+    int errors = obc_prop_tle_range(&tle, &rv);
+    double seconds = (bench_now_ns() - t_start)/1e9;
+    LOGI(tag, "obc_prop_tle_range: %d points, %.06f ms", n, seconds*1e3);
+    assert(errors == 0);
+
+    // One JSON line, parsed by the regression scripts
+    printf("{\"bench\": \"sgp4_range\", \"threads\": %d, \"points\": %d, \"time_s\": %.6f, "
+           "\"points_per_s\": %.1f}\n", SCH_OBC_PROP_THREADS, n, seconds, seconds > 0 ? n/seconds : 0.0);
+    fflush(stdout);
+
+    rewind(file_data);
+    for(i=0; i<n && fgets(line, SCH_BUFF_MAX_LEN, file_data) != NULL; i++)
+    {
+        sscanf(line, "%ld,%lf,%lf,%lf,%lf,%lf,%lf",
+               &ts, rv_ref, rv_ref+1, rv_ref+2, rv_ref+3, rv_ref+4, rv_ref+5);
+        assert(ts == rv.ts[i]);
+        r[0] = rv.rx[i]; r[1] = rv.ry[i]; r[2] = rv.rz[i];
+        v[0] = rv.vx[i]; v[1] = rv.vy[i]; v[2] = rv.vz[i];
+        rerr += dist(r, rv_ref);
+        verr += dist(v, rv_ref+3);
+    }
+    fclose(file_data);
+    obc_rv_array_free(&rv);
+
+    rerr = rerr/n;
+    verr = verr/n;
+    LOGI(tag, "Batch typical errors r=%e mm, v=%e mm/s", 1e6*rerr, 1e6*verr);
+    assert(1e6*rerr < 10e3 && 1e6*verr < 10);
+    return CMD_OK;
+}
+
 // The task to run the test
 void taskTest(void* param)
 {
     cmd_add("_test_tle_prop", _test_tle_prop, "%ld %s", 2);
     cmd_add("_test_tle_comp", _test_tle_cmp, "%s %s", 2);
+    cmd_add("_test_tle_range", _test_tle_range, "%s", 1);
 
     char* input_file = (char*) param;
     FILE *base_file = NULL;
@@ -176,6 +239,11 @@ void taskTest(void* param)
     cmd_add_params_var(cmd_prop_test, fname_data, fname_test);
     cmd_send(cmd_prop_test);
 
+    LOGI(tag, "---- Sending RANGE Command ----");
+    cmd_t *cmd_range_test = cmd_get_str("_test_tle_range");
+    cmd_add_params_var(cmd_range_test, fname_data);
+    cmd_send(cmd_range_test);
+
     LOGI(tag, "---- Sending Exit Command ----");
     cmd_t *cmd_exit = cmd_get_str("obc_reset");
     cmd_send(cmd_exit);
@@ -0,0 +1,309 @@
+//
+// Storage backend benchmark. Runs the status variables, flight plan and
+// payload repository functions at a controlled rate and batch size, and
+// reports the throughput, the latency per call, the bytes written and the
+// number of syncs. The backend is selected at build time (SCH_STORAGE_MODE,
+// SCH_STORAGE_TRIPLE_WR, SCH_STORAGE_CACHE), one JSON line is printed per
+// operation so the results of several builds can be compared.
+//
+// Parameters (environment):
+//  STORAGE_BENCH_N      Operations per benchmark (default 10000)
+//  STORAGE_BENCH_BATCH  Operations per call, >1 uses the batch functions (default 1)
+//  STORAGE_BENCH_RATE   Max. operations per second, 0 for no limit (default 0)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <sys/mman.h>
+
+#include "config.h"
+#include "log_utils.h"
+#include "bench_utils.h"
+#include "repoCommand.h"
+#include "repoData.h"
+
+static const char *tag = "storage_bench";
+
+#define BENCH_N_DEFAULT     (10000)
+#define BENCH_PAYLOAD       (temp_sensors)  ///< Payload used by the payload benchmarks
+#define BENCH_SAMPLE_MAX    (256)           ///< Max. payload sample size in bytes
+#define BENCH_PAYLOAD_BATCH (64)            ///< Max. payload samples per call
+
+/**
+ * Sync counter. These definitions take precedence over the libc ones, for
+ * the storage drivers and for the shared database libraries too.
+ */
+static volatile unsigned long bench_syncs = 0;
+
+int fsync(int fd)
+{
+    static int (*real_fsync)(int) = NULL;
+    if(real_fsync == NULL)
+        real_fsync = (int (*)(int))dlsym(RTLD_NEXT, "fsync");
+    __atomic_add_fetch(&bench_syncs, 1, __ATOMIC_RELAXED);
+    return real_fsync(fd);
+}
+
+int fdatasync(int fd)
+{
+    static int (*real_fdatasync)(int) = NULL;
+    if(real_fdatasync == NULL)
+        real_fdatasync = (int (*)(int))dlsym(RTLD_NEXT, "fdatasync");
+    __atomic_add_fetch(&bench_syncs, 1, __ATOMIC_RELAXED);
+    return real_fdatasync(fd);
+}
+
+int msync(void *addr, size_t length, int flags)
+{
+    static int (*real_msync)(void *, size_t, int) = NULL;
+    if(real_msync == NULL)
+        real_msync = (int (*)(void *, size_t, int))dlsym(RTLD_NEXT, "msync");
+    __atomic_add_fetch(&bench_syncs, 1, __ATOMIC_RELAXED);
+    return real_msync(addr, length, flags);
+}
+
+/**
+ * Bytes written by the process: wchar counts the bytes passed to write
+ * calls, write_bytes the bytes sent to the storage device
+ */
+typedef struct bench_io {
+    unsigned long long wchar;
+    unsigned long long write_bytes;
+} bench_io_t;
+
+static void _bench_io_get(bench_io_t *io)
+{
+    char line[128];
+    memset(io, 0, sizeof(bench_io_t));
+    FILE *file = fopen("/proc/self/io", "r");
+    if(file != NULL)
+    {
+        while(fgets(line, sizeof(line), file) != NULL)
+        {
+            sscanf(line, "wchar: %llu", &io->wchar);
+            sscanf(line, "write_bytes: %llu", &io->write_bytes);
+        }
+        fclose(file);
+    }
+}
+
+/* Benchmarks, one call does @batch operations starting at operation @i */
+
+static value32_t status_saved[dat_status_last_address];
+static value32_t status_values[dat_status_last_address];
+static uint8_t samples[BENCH_PAYLOAD_BATCH*BENCH_SAMPLE_MAX];
+static fp_entry_t fp_entries[SCH_FP_MAX_ENTRIES];
+static int payload_count = 0;
+
+// Status variables are written with a changing value in windows of @batch
+// variables, the original values are restored at the end
+static int _bench_status_set(int i, int batch)
+{
+    int index = i % (dat_status_last_address - batch + 1);
+    int k;
+    for(k=0; k<batch; k++)
+        status_values[index+k].u = status_saved[index+k].u ^ (uint32_t)(i & 1);
+    if(batch == 1)
+        return dat_set_status_var((dat_status_address_t)index, status_values[index]);
+    return dat_set_status_vars((dat_status_address_t)index, batch, &status_values[index]);
+}
+
+static int _bench_status_get(int i, int batch)
+{
+    int index = i % (dat_status_last_address - batch + 1);
+    if(batch == 1)
+    {
+        status_values[index] = dat_get_status_var((dat_status_address_t)index);
+        return 0;
+    }
+    return dat_get_status_vars((dat_status_address_t)index, batch, &status_values[index]);
+}
+
+// The flight plan is limited to SCH_FP_MAX_ENTRIES, it is cleared before each call
+static int _bench_fp_prepare_set(int i, int batch)
+{
+    return dat_reset_fp();
+}
+
+static int _bench_fp_set(int i, int batch)
+{
+    int k;
+    if(batch == 1)
+        return dat_set_fp(2000000000 - i, "obc_get_mem", "", 1, 0);
+    for(k=0; k<batch; k++)
+        fp_entries[k].unixtime = 2000000000 - i - k;
+    return dat_set_fp_batch(fp_entries, batch);
+}
+
+// Commands are due at once, each get removes one
+static int _bench_fp_prepare_get(int i, int batch)
+{
+    int k;
+    dat_reset_fp();
+    for(k=0; k<batch; k++)
+        fp_entries[k].unixtime = 1000 + k;
+    return dat_set_fp_batch(fp_entries, batch);
+}
+
+static int _bench_fp_get(int i, int batch)
+{
+    char command[SCH_CMD_MAX_STR_NAME];
+    char args[SCH_CMD_MAX_STR_PARAMS];
+    int executions, period, k, rc = 0;
+    for(k=0; k<batch; k++)
+        rc |= dat_get_fp(2000, command, args, &executions, &period);
+    return rc;
+}
+
+static int _bench_payload_add(int i, int batch)
+{
+    int rc;
+    if(batch == 1)
+        rc = dat_add_payload_sample(samples, BENCH_PAYLOAD);
+    else
+        rc = dat_add_payload_samples(samples, BENCH_PAYLOAD, batch);
+    if(rc < 0)
+        return -1;
+    payload_count += batch;
+    return 0;
+}
+
+static int _bench_payload_get(int i, int batch)
+{
+    int count = payload_count > batch ? payload_count : batch;
+    int index = i % (count - batch + 1);
+    if(batch == 1)
+        return dat_get_payload_sample(samples, BENCH_PAYLOAD, index);
+    return dat_get_payload_samples(samples, BENCH_PAYLOAD, index, batch) == batch ? 0 : -1;
+}
+
+typedef struct bench {
+    const char *name;
+    int max_batch;                      ///< Max. operations per call
+    int (*prepare)(int i, int batch);   ///< Not measured, called before each call if not NULL
+    int (*run)(int i, int batch);       ///< Measured call, returns 0 if OK
+} bench_t;
+
+static const bench_t benchs[] = {
+    {"status_set", dat_status_last_address, NULL, _bench_status_set},
+    {"status_get", dat_status_last_address, NULL, _bench_status_get},
+    {"fp_set", SCH_FP_MAX_ENTRIES, _bench_fp_prepare_set, _bench_fp_set},
+    {"fp_get", SCH_FP_MAX_ENTRIES, _bench_fp_prepare_get, _bench_fp_get},
+    {"payload_add", BENCH_PAYLOAD_BATCH, NULL, _bench_payload_add},
+    {"payload_get", BENCH_PAYLOAD_BATCH, NULL, _bench_payload_get},
+};
+
+/**
+ * Run a benchmark, @n operations in calls of @batch operations, at most
+ * @rate operations per second
+ */
+static void _bench_run(const bench_t *bench, int n, int batch, int rate)
+{
+    if(batch > bench->max_batch)
+        batch = bench->max_batch;
+    int calls = (n + batch - 1)/batch;
+    uint64_t *lat = malloc((size_t)calls*sizeof(uint64_t));
+    if(lat == NULL)
+    {
+        LOGE(tag, "Unable to allocate %d latencies", calls);
+        return;
+    }
+
+    uint64_t period_ns = rate > 0 ? 1000000000ULL*(uint64_t)batch/(uint64_t)rate : 0;
+    uint64_t busy_ns = 0, t0, t1;
+    unsigned long syncs = 0;
+    int i, errors = 0;
+    bench_io_t io_start, io_end;
+
+    _bench_io_get(&io_start);
+    uint64_t t_start = bench_now_ns();
+    for(i=0; i<calls; i++)
+    {
+        if(period_ns > 0)
+        {
+            uint64_t t_next = t_start + (uint64_t)i*period_ns;
+            struct timespec ts = {(time_t)(t_next/1000000000ULL), (long)(t_next%1000000000ULL)};
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+        if(bench->prepare != NULL)
+            bench->prepare(i*batch, batch);
+
+        unsigned long s0 = bench_syncs;
+        t0 = bench_now_ns();
+        errors += bench->run(i*batch, batch) != 0;
+        t1 = bench_now_ns();
+        syncs += bench_syncs - s0;
+        lat[i] = t1 - t0;
+        busy_ns += t1 - t0;
+    }
+    uint64_t wall_ns = bench_now_ns() - t_start;
+    _bench_io_get(&io_end);
+
+    bench_stats_t stats;
+    bench_stats_get(lat, calls, &stats);
+    int ops = calls*batch;
+
+    // Bytes are counted for the whole run, including the prepare calls
+    bench_json_t json;
+    bench_json_begin(&json, "storage");
+    bench_json_str(&json, "op", bench->name);
+    bench_json_int(&json, "storage_mode", SCH_STORAGE_MODE);
+    bench_json_int(&json, "triple_wr", SCH_STORAGE_TRIPLE_WR);
+    bench_json_int(&json, "cache", SCH_STORAGE_CACHE);
+    bench_json_int(&json, "ops", ops);
+    bench_json_int(&json, "batch", batch);
+    bench_json_int(&json, "rate", rate);
+    bench_json_int(&json, "errors", errors);
+    bench_json_num(&json, "ops_per_s", busy_ns > 0 ? ops/(busy_ns/1e9) : 0.0, 1);
+    bench_json_num(&json, "wall_s", wall_ns/1e9, 6);
+    bench_json_stats(&json, "lat", &stats);
+    bench_json_int(&json, "bytes_written", (long long)(io_end.wchar - io_start.wchar));
+    bench_json_int(&json, "disk_bytes", (long long)(io_end.write_bytes - io_start.write_bytes));
+    bench_json_int(&json, "syncs", (long long)syncs);
+    bench_json_print(&json);
+    free(lat);
+}
+
+int main(void)
+{
+    int n = bench_env("STORAGE_BENCH_N", BENCH_N_DEFAULT, 1, INT_MAX);
+    int batch = bench_env("STORAGE_BENCH_BATCH", 1, 1, INT_MAX);
+    int rate = bench_env("STORAGE_BENCH_RATE", 0, 0, INT_MAX);
+
+    log_init(LOG_LEVEL, 0);
+    cmd_repo_init();
+    dat_repo_init();
+    LOGI(tag, "---- Storage benchmark, mode %d, %d operations, batch %d, rate %d ----",
+         SCH_STORAGE_MODE, n, batch, rate);
+
+    // Benchmark data
+    int k;
+    dat_get_status_vars((dat_status_address_t)0, dat_status_last_address, status_saved);
+    memcpy(status_values, status_saved, sizeof(status_values));
+    memset(samples, 0x5A, sizeof(samples));
+    memset(fp_entries, 0, sizeof(fp_entries));
+    for(k=0; k<SCH_FP_MAX_ENTRIES; k++)
+    {
+        strncpy(fp_entries[k].cmd, "obc_get_mem", SCH_CMD_MAX_STR_NAME-1);
+        fp_entries[k].executions = 1;
+    }
+    dat_reset_fp();
+    dat_set_system_var(data_map[BENCH_PAYLOAD].sys_index, 0);
+
+    for(k=0; k<(int)(sizeof(benchs)/sizeof(benchs[0])); k++)
+    {
+        _bench_run(&benchs[k], n, batch, rate);
+        if(benchs[k].run == _bench_status_set)
+            dat_set_status_vars((dat_status_address_t)0, dat_status_last_address, status_saved);
+    }
+
+    // Leave the repository as it was
+    dat_reset_fp();
+    dat_set_system_var(data_map[BENCH_PAYLOAD].sys_index, 0);
+    dat_repo_close();
+    return 0;
+}
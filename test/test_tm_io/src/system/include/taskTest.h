@@ -5,13 +5,33 @@
 #ifndef SUCHAI_FLIGHT_SOFTWARE_TASKTEST_H
 #define SUCHAI_FLIGHT_SOFTWARE_TASKTEST_H
 
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <csp/csp.h>
+#include <csp/interfaces/csp_if_lo.h>
+
 #include "config.h"
 #include "globals.h"
 
 #include "osDelay.h"
 
 #include "repoCommand.h"
+#include "repoData.h"
+#include "cmdTM.h"
+#include "taskIngest.h"
+#include "bench_utils.h"
+
+#define TM_IO_MAX_N         (10000) ///< Max samples per round trip, TM_IO_MAX_N can lower it
+#define TM_IO_TIMEOUT_MS    (30000) ///< Max time to wait for the frames to be stored
 
+/**
+ * Telemetry round trip benchmark. For each payload and number of samples the
+ * samples are sent to this node, through the CSP loopback interface, and
+ * stored back by com_receive_tm and the ingest task. Prints a JSON line per
+ * round trip with the frames/s, bytes on wire, CPU time per sample and if the
+ * stored copy matches the original, then exits.
+ */
 void taskTest(void* param);
 
 #endif //SUCHAI_FLIGHT_SOFTWARE_TASKTEST_H
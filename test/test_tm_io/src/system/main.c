@@ -23,11 +23,9 @@ int main(void)
 
     /* Initializing shared Queues */
     dispatcher_queue = osQueueCreate(25,sizeof(cmd_t *));
-    executer_stat_queue = osQueueCreate(1,sizeof(int));
-    executer_cmd_queue = osQueueCreate(1,sizeof(cmd_t *));
+    executer_cmd_queue = osQueueCreate(SCH_CMD_EXE_QUEUE_LEN,sizeof(cmd_t *));
 
     if(dispatcher_queue == 0) LOGE(tag, "Error creating dispatcher queue");
-    if(executer_stat_queue == 0) LOGE(tag, "Error creating executer stat queue");
     if(executer_cmd_queue == 0) LOGE(tag, "Error creating executer cmd queue");
 
     int n_threads = 5;
@@ -1,48 +1,165 @@
 //
 // Created by gedoix on 10-01-19.
 //
+// Telemetry round trip benchmark: payload samples are sent with
+// tm_send_payload_range (_send_tel_from_to) to this node, received by
+// com_receive_tm through the CSP loopback interface and stored again by the
+// ingest pipeline. The samples [0, n) are copied to [n, 2n) of the same
+// payload table, so the copy can be compared with the original.
+//
 
 #include "include/taskTest.h"
 
-#define TEST_FAILS 0
-
 static const char* tag = "tm_io_test_task";
 
-void taskTest(void* param)
-{
-    LOGI(tag, "Started");
-    LOGI(tag, "---- Telemetries Input/Output test ----");
+/* Samples read or written per storage call */
+#define TM_IO_CHUNK (64)
 
-    int test_amount = 5;
+static uint8_t buff_a[TM_IO_CHUNK*SCH_BUFF_MAX_LEN];
+static uint8_t buff_b[TM_IO_CHUNK*SCH_BUFF_MAX_LEN];
 
-    cmd_t *drp_ebf = cmd_get_str("drp_ebf");
-    cmd_add_params_var(drp_ebf, 1010);
-    cmd_send(drp_ebf);
+/**
+ * Fill @n samples with valid values for every field of the payload (all
+ * fields are 32 bits, floats are set with float values)
+ */
+static void _tm_io_fill(uint8_t *samples, int payload, int first, int n)
+{
+    const char *order = data_map[payload].data_order;
+    int size = data_map[payload].size;
+    int k, field;
+    for(k=0; k<n; k++)
+    {
+        uint8_t *sample = samples + k*size;
+        const char *fmt = order;
+        for(field=0; field*4+4 <= size; field++)
+        {
+            fmt = strchr(fmt, '%');
+            char type = fmt != NULL ? fmt[1] : 'u';
+            if(fmt != NULL)
+                fmt++;
+            if(type == 'f')
+            {
+                float value = (float)(first + k) + 0.25f*(float)field;
+                memcpy(sample + field*4, &value, 4);
+            }
+            else
+            {
+                int32_t value = (first + k)*16 + field;
+                memcpy(sample + field*4, &value, 4);
+            }
+        }
+    }
+}
 
-    for(int current_test = 0; current_test < test_amount; current_test++)
+/**
+ * Compare the stored samples [0, n) and [n, 2n)
+ * @return Number of different samples, -1 if they can not be read
+ */
+static int _tm_io_compare(int payload, int n)
+{
+    int i, k, diff = 0;
+    int size = data_map[payload].size;
+    for(i=0; i<n; i+=TM_IO_CHUNK)
     {
-        osDelay(1000);
+        int count = n - i < TM_IO_CHUNK ? n - i : TM_IO_CHUNK;
+        if(dat_get_payload_samples(buff_a, payload, i, count) != count ||
+           dat_get_payload_samples(buff_b, payload, n + i, count) != count)
+            return -1;
+        for(k=0; k<count; k++)
+            diff += memcmp(buff_a + k*size, buff_b + k*size, (size_t)size) != 0;
+    }
+    return diff;
+}
 
-        LOGI(tag, "---- Sending Telemetry %d ----", current_test+1);
+/**
+ * Round trip @n samples of a payload and print the results
+ */
+static void _tm_io_run(int payload, int n)
+{
+    int i;
+    int size = data_map[payload].size;
 
-        for (dat_status_address_t i = 0; i < dat_status_last_address; i++)
-        {
-            value32_t value;
-            int test_value = (current_test+1)*100 + (int)i;
-            value.i = test_value;
-            if(dat_get_status_var_def(i).type == 'f')
-                value.f = (float)test_value;
-            dat_set_status_var(i, value);
-        }
+    // Original samples at [0, n)
+    dat_set_system_var(data_map[payload].sys_index, 0);
+    dat_set_system_var(data_map[payload].sys_ack, 0);
+    for(i=0; i<n; i+=TM_IO_CHUNK)
+    {
+        int count = n - i < TM_IO_CHUNK ? n - i : TM_IO_CHUNK;
+        _tm_io_fill(buff_a, payload, i, count);
+        dat_add_payload_samples(buff_a, payload, count);
+    }
 
-        cmd_t* cmd = cmd_get_str("tm_send_status");
-        cmd_add_params_var(cmd, 1);
+    ingest_stats_t stats;
+    ingest_get_stats(&stats, 1);
+    uint32_t tx = csp_if_lo.tx;
+    uint32_t tx_bytes = csp_if_lo.txbytes;
+    uint64_t cpu_start = bench_cpu_ns();
+    uint64_t t_start = bench_now_ns();
 
-        cmd_send(cmd);
+    int rc = tm_send_payload_range(0, n, payload, SCH_COMM_ADDRESS);
+    uint32_t frames = csp_if_lo.tx - tx;
+
+    // Wait until every frame is stored or discarded
+    uint32_t waited_ms = 0;
+    do
+    {
+        ingest_get_stats(&stats, 0);
+        if(stats.stored + stats.errors + stats.dropped >= frames)
+            break;
+        osDelay(1);
     }
+    while(++waited_ms < TM_IO_TIMEOUT_MS);
+
+    uint64_t t_run = bench_now_ns() - t_start;
+    uint64_t cpu = bench_cpu_ns() - cpu_start;
+    uint32_t bytes = csp_if_lo.txbytes - tx_bytes;
+
+    int stored = dat_get_system_var(data_map[payload].sys_index) - n;
+    int diff = stored == n ? _tm_io_compare(payload, n) : -1;
+    double seconds = (double)t_run/1e9;
+
+    printf("{\"bench\": \"tm_io\", \"payload\": \"%s\", \"sample_size\": %d, \"samples\": %d, \"compress\": %d, "
+           "\"send_ok\": %d, \"frames\": %u, \"bytes_on_wire\": %u, \"bytes_per_sample\": %.2f, "
+           "\"time_s\": %.6f, \"frames_per_s\": %.1f, \"samples_per_s\": %.1f, \"cpu_us_per_sample\": %.3f, "
+           "\"stored\": %d, \"errors\": %u, \"dropped\": %u, \"different\": %d, \"ok\": %s}\n",
+           data_map[payload].table, size, n, SCH_TM_COMPRESS, rc == CMD_OK, frames, bytes, (double)bytes/n,
+           seconds, seconds > 0 ? frames/seconds : 0.0, seconds > 0 ? n/seconds : 0.0, cpu/1e3/n,
+           stored, stats.errors, stats.dropped, diff, rc == CMD_OK && diff == 0 ? "true" : "false");
+    fflush(stdout);
 
+    if(diff != 0)
+        LOGE(tag, "Round trip failed: %s, %d samples (stored %d, different %d)",
+             data_map[payload].table, n, stored, diff);
+}
+
+void taskTest(void* param)
+{
+    LOGI(tag, "Started");
+    LOGI(tag, "---- Telemetries Input/Output test ----");
+
+    // Wait for the communications and ingest tasks
     osDelay(1000);
 
+    const int samples[] = {1, 100, 10000};
+    char *env = getenv("TM_IO_MAX_N");
+    int max_n = env != NULL ? atoi(env) : TM_IO_MAX_N;
+    int payload, i;
+    for(payload = 0; payload < last_sensor; payload++)
+    {
+        if(data_map[payload].size > SCH_BUFF_MAX_LEN)
+        {
+            LOGW(tag, "Payload %s skipped, samples too big", data_map[payload].table);
+            continue;
+        }
+        for(i = 0; i < (int)(sizeof(samples)/sizeof(samples[0])); i++)
+        {
+            if(samples[i] <= max_n)
+                _tm_io_run(payload, samples[i]);
+        }
+        dat_set_system_var(data_map[payload].sys_index, 0);
+        dat_set_system_var(data_map[payload].sys_ack, 0);
+    }
+
     LOGI(tag, "---- Sending Exit Command ----");
 
     cmd_t *cmd_exit = cmd_get_str("obc_reset");
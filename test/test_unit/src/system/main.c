@@ -27,6 +27,7 @@
 #include "math_utils.h"
 #include "repoCommand.h"
 #include "data_storage.h"
+#include "crc_utils.h"
 
 
 /** SUIT 2: Command repository **/
@@ -52,7 +53,7 @@ int clean_suite_repocmd(void)
 void testParseCommands(void)
 {
     cmd_t *cmd;
-    char *name;
+    const char *name;
 
     // Case 1: command without parameters; command do not req. parameters.
     cmd = cmd_build_from_str("obc_get_mem");
@@ -60,7 +61,7 @@ void testParseCommands(void)
     name = cmd_get_name(cmd->id);
     CU_ASSERT_STRING_EQUAL("obc_get_mem", name)
     CU_ASSERT_PTR_NULL(cmd->params);
-    free(cmd); free(name);
+    cmd_free(cmd);
 
     // Case 2: command with parameters; command do not req. parameters.
     cmd = cmd_build_from_str("obc_get_mem foo");
@@ -68,15 +69,19 @@ void testParseCommands(void)
     name = cmd_get_name(cmd->id);
     CU_ASSERT_STRING_EQUAL("obc_get_mem", name)
     CU_ASSERT_STRING_EQUAL("foo", cmd->params);
-    free(cmd); free(name);
+    cmd_free(cmd);
 
     // Case 3: command with parameters; command require parameters.
     cmd = cmd_build_from_str("obc_debug 1");
     CU_ASSERT_PTR_NOT_NULL(cmd);
     name = cmd_get_name(cmd->id);
     CU_ASSERT_STRING_EQUAL("obc_debug", name)
-    CU_ASSERT_STRING_EQUAL("1", cmd->params);
-    free(cmd); free(name);
+    // Numeric parameters are parsed as binary parameters
+    int value = 0;
+    CU_ASSERT_TRUE(cmd_params_is_bin(cmd->params));
+    CU_ASSERT_EQUAL(cmd_scan_params(cmd->fmt, cmd->params, &value), 1);
+    CU_ASSERT_EQUAL(value, 1);
+    cmd_free(cmd);
 
     // Case 4: command without parameters; command require parameters.
     cmd = cmd_build_from_str("obc_debug");
@@ -84,22 +89,22 @@ void testParseCommands(void)
     name = cmd_get_name(cmd->id);
     CU_ASSERT_STRING_EQUAL("obc_debug", name)
     CU_ASSERT_PTR_NULL(cmd->params);
-    free(cmd); free(name);
+    cmd_free(cmd);
 
     // Case 5: not valid command
     cmd = cmd_build_from_str("invalid_command");
     CU_ASSERT_PTR_NULL(cmd);
-    free(cmd);
+    cmd_free(cmd);
 
     // Case 6: empty command
     cmd = cmd_build_from_str("\0");
     CU_ASSERT_PTR_NULL(cmd);
-    free(cmd);
+    cmd_free(cmd);
 
     // Case 7: \n or \cr command
     cmd = cmd_build_from_str("\r\n");
     CU_ASSERT_PTR_NULL(cmd);
-    free(cmd);
+    cmd_free(cmd);
 }
 
 /** SUIT 1: Flight Plan **/
@@ -217,6 +222,9 @@ void test_system_vars(void)
 
     for (var_index = 0; var_index < dat_status_last_address; var_index++)
     {
+        // Derived variables are computed when read, writes are ignored
+        if (dat_status_var_is_derived((dat_status_address_t) var_index))
+            continue;
         init_value = dat_get_system_var((dat_status_address_t) var_index);
         dat_set_system_var((dat_status_address_t) var_index, test_value);
         var = dat_get_system_var((dat_status_address_t) var_index);
@@ -246,6 +254,8 @@ void test_set_system_vars_fault_tolerant(void)
 
     for (int i = dat_obc_opmode; i < dat_status_last_address; i++)
     {
+        if (dat_status_var_is_derived(i))
+            continue;
         val_1 = _dat_get_system_var(i);
         val_2 = _dat_get_system_var(i + dat_status_last_address);
         val_3 = _dat_get_system_var(i + dat_status_last_address * 2);
@@ -289,6 +299,8 @@ void test_get_system_vars_fault_tolerant(void)
 
     for (int i = dat_obc_opmode; i < dat_status_last_address; i++)
     {
+        if (dat_status_var_is_derived(i))
+            continue;
         val = dat_get_system_var(i);
 
         if (i == rand_ind)
@@ -505,6 +517,144 @@ void testMatrices(void)
     check_values((double*)resv.v, (double*)Av.v, 3);
 }
 
+void testMatrices6(void)
+{
+    /*
+    * Testing 6x6 kernels against the generic functions
+    */
+    double A[6][6], B[6][6], Bt[6][6], I6[6][6];
+    double res[6][6], ref[6][6];
+    for(int i=0; i<6; ++i)
+    {
+        for(int j=0; j<6; ++j)
+        {
+            A[i][j] = 0.1*(i+1) - 0.05*j;
+            B[i][j] = 0.02*(i*6+j) - 0.3;
+        }
+    }
+    _mat_set_diag((double*)I6, 1.0, 6, 6);
+
+    // Test identity
+    mat6_mat_mult((double*)A, (double*)I6, (double*)res);
+    check_values((double*)res, (double*)A, 36);
+    // Test mul
+    _mat_mat_mult((double*)A, (double*)B, (double*)ref, 6, 6, 6);
+    mat6_mat_mult((double*)A, (double*)B, (double*)res);
+    check_values((double*)res, (double*)ref, 36);
+    // Test mul by transpose
+    _mat_transpose((double*)B, (double*)Bt, 6, 6);
+    _mat_mat_mult((double*)A, (double*)Bt, (double*)ref, 6, 6, 6);
+    mat6_mat_mult_t((double*)A, (double*)B, (double*)res);
+    check_values((double*)res, (double*)ref, 36);
+    // Test blocks
+    matrix3_t At = {0.34197022, 0.53479301, 0.26827125, 0.4621773 , 0.19789368,
+                    0.30458023, 0.61930235, 0.82224241, 0.33275187};
+    mat6_set_block((double*)At.m, (double*)res, 1, 0);
+    mat6_set_block_diag((double*)res, 2.0, 0, 1);
+    CU_ASSERT_DOUBLE_EQUAL(res[3][0], At.m[0][0], 1e-12);
+    CU_ASSERT_DOUBLE_EQUAL(res[5][2], At.m[2][2], 1e-12);
+    CU_ASSERT_DOUBLE_EQUAL(res[4][1], At.m[1][1], 1e-12);
+    CU_ASSERT_DOUBLE_EQUAL(res[1][4], 2.0, 1e-12);
+    CU_ASSERT_DOUBLE_EQUAL(res[1][3], 0.0, 1e-12);
+}
+
+void testESKFCovariance(void)
+{
+    /*
+    * Testing the symmetric ESKF covariance against the full 6x6 products
+    */
+    double P[6][6], F[6][6], FP[6][6], ref[6][6], res[6][6];
+    for(int i=0; i<6; ++i)
+        for(int j=0; j<6; ++j)
+            P[i][j] = (i == j ? 1.0 : 0.0) + 0.01*(i+j);
+    sym6_t Ps;
+    sym6_from_mat((double*)P, &Ps);
+    CU_ASSERT_DOUBLE_EQUAL(sym6_get(&Ps, 4, 1), P[1][4], 1e-12);
+
+    // Test predict, F = [F11 -dt*I; 0 I]
+    matrix3_t F11 = {0.34197022, 0.53479301, 0.26827125, 0.4621773 , 0.19789368,
+                     0.30458023, 0.61930235, 0.82224241, 0.33275187};
+    double dt = 0.1;
+    _mat_set_diag((double*)F, 0.0, 6, 6);
+    mat6_set_block((double*)F11.m, (double*)F, 0, 0);
+    mat6_set_block_diag((double*)F, -dt, 0, 1);
+    mat6_set_block_diag((double*)F, 1.0, 1, 1);
+    mat6_mat_mult((double*)F, (double*)P, (double*)FP);
+    mat6_mat_mult_t((double*)FP, (double*)F, (double*)ref);
+    for(int i=0; i<3; ++i)
+    {
+        ref[i][i] += 0.01;
+        ref[i+3][i+3] += 0.02;
+    }
+    eskf_predict_cov(&Ps, &F11, dt, 0.01, 0.02);
+    sym6_to_mat(&Ps, (double*)res);
+    check_values((double*)res, (double*)ref, 36);
+
+    // Test update, Joseph form equals (I-K*H)*P with the optimal gain
+    matrix3_t H1;
+    vector3_t mag = {0.3, 0.5, -0.8}, y = {0.01, 0.02, -0.03};
+    mat_set_diag(&H1, 0.0, 0.0, 0.0);
+    mat_skew(mag, &H1);
+    double H[3][6] = {0}, Ht[6][3], PHt[6][3], S[3][3], SI[3][3], K[6][3], KH[6][6], dx[6];
+    _mat_copy((double*)H1.m, (double*)H, 3, 3, 3, 6, 0, 0);
+    _mat_transpose((double*)H, (double*)Ht, 3, 6);
+    _mat_mat_mult((double*)ref, (double*)Ht, (double*)PHt, 6, 6, 3);
+    _mat_mat_mult((double*)H, (double*)PHt, (double*)S, 3, 6, 3);
+    for(int i=0; i<3; ++i)
+        S[i][i] += 0.05;
+    mat3_inverse((double*)S, (double*)SI);
+    _mat_mat_mult((double*)PHt, (double*)SI, (double*)K, 6, 3, 3);
+    _mat_mat_mult((double*)K, (double*)H, (double*)KH, 6, 3, 6);
+    _mat_cons_mult(-1.0, (double*)KH, NULL, 6, 6);
+    for(int i=0; i<6; ++i)
+        KH[i][i] += 1.0;
+    mat6_mat_mult((double*)KH, (double*)ref, (double*)FP);
+
+    CU_ASSERT_EQUAL(eskf_update_cov(&Ps, &H1, 0.05, &y, dx), 0);
+    sym6_to_mat(&Ps, (double*)res);
+    check_values((double*)res, (double*)FP, 36);
+    CU_ASSERT_DOUBLE_EQUAL(dx[3], K[3][0]*y.v[0] + K[3][1]*y.v[1] + K[3][2]*y.v[2], 1e-12);
+}
+
+
+/** SUIT 6 **/
+/* Test CRC32C.
+ */
+
+int init_suite_crc(void)
+{
+    return 0;
+}
+
+int clean_suite_crc(void)
+{
+    return 0;
+}
+
+void testCRC32C(void)
+{
+    // Check value of the CRC32C (RFC 3720)
+    CU_ASSERT_EQUAL(crc32c_update(0, "123456789", 9), 0xE3069283);
+    CU_ASSERT_EQUAL(crc32c_update_table(0, "123456789", 9), 0xE3069283);
+    CU_ASSERT_EQUAL(crc32c_update(0, "", 0), 0);
+
+    // The hardware and the table give the same CRC, at any alignment and
+    // length, and the CRC can be computed in parts
+    uint8_t buff[300];
+    int i, offset, len;
+    for(i = 0; i < sizeof(buff); i++)
+        buff[i] = (uint8_t)(i*31 + 7);
+    for(offset = 0; offset < 8; offset++)
+    {
+        for(len = 0; len + offset <= sizeof(buff); len += 13)
+        {
+            uint32_t crc = crc32c_update(0, buff + offset, len);
+            CU_ASSERT_EQUAL(crc, crc32c_update_table(0, buff + offset, len));
+            CU_ASSERT_EQUAL(crc, crc32c_update(crc32c_update(0, buff + offset, len/3), buff + offset + len/3, len - len/3));
+        }
+    }
+}
+
 /* The main() function for setting up and running the tests.
  * Returns a CUE_SUCCESS on successful running, another
  * CUnit error code on failure.
@@ -592,7 +742,24 @@ int main()
     }
 
     /* add the tests to the suite */
-    if ((NULL == CU_add_test(pSuite, "test of matrices", testMatrices))){
+    if ((NULL == CU_add_test(pSuite, "test of matrices", testMatrices)) ||
+        (NULL == CU_add_test(pSuite, "test of 6x6 matrices", testMatrices6)) ||
+        (NULL == CU_add_test(pSuite, "test of ESKF covariance", testESKFCovariance))){
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    /**
+    * SUITE 6: CRC32C crc_utils.c
+    */
+    pSuite = CU_add_suite("Suite CRC32C", init_suite_crc, clean_suite_crc);
+    if (NULL == pSuite) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    /* add the tests to the suite */
+    if ((NULL == CU_add_test(pSuite, "test of CRC32C", testCRC32C))){
         CU_cleanup_registry();
         return CU_get_error();
     }